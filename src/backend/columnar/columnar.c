@@ -17,11 +17,13 @@
 #include <unistd.h>
 
 #include "miscadmin.h"
+#include "postmaster/bgworker.h"
 #include "utils/guc.h"
 #include "utils/rel.h"
 
 #include "citus_version.h"
 #include "columnar/columnar.h"
+#include "columnar/columnar_chunk_cache.h"
 #include "columnar/columnar_tableam.h"
 
 /* Default values for option parameters */
@@ -40,6 +42,16 @@ int columnar_compression = DEFAULT_COMPRESSION_TYPE;
 int columnar_stripe_row_limit = DEFAULT_STRIPE_ROW_COUNT;
 int columnar_chunk_group_row_limit = DEFAULT_CHUNK_ROW_COUNT;
 int columnar_compression_level = 3;
+bool columnar_enable_column_encoding = false;
+bool columnar_enable_vectorized_filter = false;
+int columnar_chunk_cache_size = 0;
+bool columnar_enable_chunk_cache = true;
+int columnar_stripe_skip_list_cache_size = 0;
+bool columnar_stream_chunk_groups = false;
+bool columnar_enable_bulk_read_strategy = false;
+int columnar_compression_workers = 0;
+int columnar_large_value_compression_threshold = 0;
+int columnar_chunk_group_size_limit = 0;
 
 static const struct config_enum_entry columnar_compression_options[] =
 {
@@ -59,6 +71,7 @@ columnar_init(void)
 {
 	columnar_init_gucs();
 	columnar_tableam_init();
+	ColumnarChunkCacheInit();
 }
 
 
@@ -115,6 +128,158 @@ columnar_init_gucs()
 							NULL,
 							NULL,
 							NULL);
+
+	DefineCustomIntVariable("columnar.chunk_cache_size",
+							"Size of the shared memory cache of decompressed "
+							"column chunks.",
+							"Scans copy the chunks that they find in the cache "
+							"instead of decompressing them. Only takes effect when "
+							"columnar is loaded via shared_preload_libraries. Set "
+							"to 0 to disable the cache.",
+							&columnar_chunk_cache_size,
+							0,
+							0,
+							MAX_KILOBYTES,
+							PGC_POSTMASTER,
+							GUC_UNIT_KB,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("columnar.enable_chunk_cache",
+							 "Enables the use of the shared memory cache of "
+							 "decompressed column chunks.",
+							 "When off, scans decompress all chunks that they read "
+							 "and do not add them to the cache. Has no effect when "
+							 "columnar.chunk_cache_size is 0.",
+							 &columnar_enable_chunk_cache,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("columnar.large_value_compression_threshold",
+							"Size from which variable-length values are stored "
+							"compressed on their own.",
+							"Such values stay compressed in the chunks, and scans only "
+							"decompress them when they are used, rather than when a "
+							"chunk group is read. Values that arrive compressed are "
+							"not decompressed. Set to 0 to store all values "
+							"uncompressed within the chunks.",
+							&columnar_large_value_compression_threshold,
+							0,
+							0,
+							INT_MAX,
+							PGC_USERSET,
+							GUC_UNIT_BYTE,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("columnar.chunk_group_size_limit",
+							"Size of the values of a chunk at which it is closed.",
+							"Chunks are closed once their uncompressed values reach "
+							"this size, even if they have fewer rows than "
+							"columnar.chunk_group_row_limit, which keeps chunk groups "
+							"of wide rows small. Set to 0 to only limit chunks by "
+							"their number of rows.",
+							&columnar_chunk_group_size_limit,
+							0,
+							0,
+							INT_MAX,
+							PGC_USERSET,
+							GUC_UNIT_BYTE,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("columnar.enable_column_encoding",
+							 "Encodes the values of chunks with dictionary, run "
+							 "length, frame of reference or delta encoding when "
+							 "that makes them smaller.",
+							 NULL,
+							 &columnar_enable_column_encoding,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("columnar.stripe_skip_list_cache_size",
+							"Size of the backend-local cache of stripe skip lists.",
+							"Scans that read a stripe again use the chunk metadata "
+							"from the cache instead of reading it from "
+							"columnar.chunk. Set to 0 to disable the cache.",
+							&columnar_stripe_skip_list_cache_size,
+							0,
+							0,
+							MAX_KILOBYTES,
+							PGC_USERSET,
+							GUC_UNIT_KB,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("columnar.enable_bulk_read_strategy",
+							 "Reads large columnar tables in sequential scans through "
+							 "a small ring of buffers.",
+							 "Like sequential scans of heap tables, scans of columnar "
+							 "tables larger than a quarter of shared_buffers then do "
+							 "not evict the rest of shared_buffers. Index scans keep "
+							 "using normal buffer replacement.",
+							 &columnar_enable_bulk_read_strategy,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.enable_vectorized_filter",
+							 "Evaluates simple comparisons of pushed down quals over "
+							 "whole chunk groups before forming tuples.",
+							 NULL,
+							 &columnar_enable_vectorized_filter,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("columnar.stream_chunk_groups",
+							 "Writes every chunk group as soon as it is full instead "
+							 "of buffering whole stripes in memory.",
+							 "Only the stripe metadata is kept in memory until the "
+							 "stripe is complete, which bounds the memory used by "
+							 "writes to wide tables. The data of a stripe is then "
+							 "stored per chunk group rather than per column.",
+							 &columnar_stream_chunk_groups,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("columnar.compression_workers",
+							"Number of background workers that compress the chunks "
+							"of a stripe when it is flushed.",
+							"The writing backend compresses chunks as well. Set to 0 "
+							"to compress chunks in the writing backend as they fill. "
+							"Not used together with columnar.stream_chunk_groups.",
+							&columnar_compression_workers,
+							0,
+							0,
+							MAX_PARALLEL_WORKER_LIMIT,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
 }
 
 
@@ -0,0 +1,976 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_aggregate_scan.c
+ *
+ * This file contains the implementation of a custom scan that computes
+ * simple aggregates over a columnar table straight from the decoded column
+ * vectors of its chunk groups, instead of forming a tuple for every row and
+ * passing it to an Agg node.
+ *
+ * Only ungrouped aggregates without a WHERE clause are handled, and only
+ * count(*), count(column) and sum, min and max of integer columns. These are
+ * also the aggregates that Citus pushes down to the shards of a distributed
+ * table for count, sum, min, max and avg, so the worker queries of columnar
+ * shards are answered by the aggregate scan as well. If all
+ * aggregates are count(*), min or max, they are answered from the row counts
+ * and minimum and maximum values in the chunk metadata, without reading the
+ * data of the table at all, unless some rows of the table are deleted.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/table.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_namespace.h"
+#include "catalog/pg_type.h"
+#include "commands/explain.h"
+#include "common/int.h"
+#include "executor/executor.h"
+#include "miscadmin.h"
+#include "nodes/extensible.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "nodes/pg_list.h"
+#include "optimizer/optimizer.h"
+#include "optimizer/pathnode.h"
+#include "optimizer/paths.h"
+#include "optimizer/planner.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_customscan.h"
+#include "columnar/columnar_tableam.h"
+#include "distributed/listutils.h"
+
+
+/* kinds of aggregates that the aggregate scan computes */
+typedef enum ColumnarAggregateKind
+{
+	COLUMNAR_AGGREGATE_COUNT_STAR,
+	COLUMNAR_AGGREGATE_COUNT,
+	COLUMNAR_AGGREGATE_SUM,
+	COLUMNAR_AGGREGATE_MIN,
+	COLUMNAR_AGGREGATE_MAX
+} ColumnarAggregateKind;
+
+/*
+ * ColumnarAggregate holds the state of an aggregate that the aggregate scan
+ * computes.
+ */
+typedef struct ColumnarAggregate
+{
+	ColumnarAggregateKind kind;
+
+	/* 0-indexed column of the argument, unused for count(*) */
+	int columnIndex;
+	Oid columnType;
+
+	/* number of rows (count(*)) or non-NULL values aggregated so far */
+	int64 count;
+
+	/* sum, minimum or maximum of the values aggregated so far */
+	int64 value;
+
+	/*
+	 * Sums of bigint columns are numeric, and the part of the sum that does
+	 * not fit in value is kept in numericSum.
+	 */
+	bool numericResult;
+	Datum numericSum;
+} ColumnarAggregate;
+
+typedef struct ColumnarAggregateScanState
+{
+	CustomScanState custom_scanstate; /* must be first field */
+
+	Relation relation;
+	List *projectedColumnList;
+	List *aggregateList;
+
+	/* whether all aggregates can be answered from chunk metadata */
+	bool metadataOnly;
+
+	bool finished;
+} ColumnarAggregateScanState;
+
+
+static void ColumnarCreateUpperPathsHook(PlannerInfo *root, UpperRelationKind stage,
+										 RelOptInfo *inputRel, RelOptInfo *outputRel,
+										 void *extra);
+static bool IsColumnarAggregateScanCandidate(PlannerInfo *root, RelOptInfo *inputRel,
+											 RelOptInfo *outputRel);
+static List * PushableAggregateList(List *targetExprList, Index relid);
+static bool ColumnarAggregateForAggref(Aggref *aggref, Index relid,
+									   ColumnarAggregateKind *kind,
+									   AttrNumber *attributeNumber);
+static Plan * ColumnarAggregatePath_PlanCustomPath(PlannerInfo *root,
+												   RelOptInfo *rel,
+												   struct CustomPath *best_path,
+												   List *tlist,
+												   List *clauses,
+												   List *custom_plans);
+static Node * ColumnarAggregateScan_CreateCustomScanState(CustomScan *cscan);
+static void ColumnarAggregateScan_BeginCustomScan(CustomScanState *node, EState *estate,
+												  int eflags);
+static TupleTableSlot * ColumnarAggregateScan_ExecCustomScan(CustomScanState *node);
+static TupleTableSlot * ColumnarAggregateScanNext(
+	ColumnarAggregateScanState *aggregateScanState);
+static bool ColumnarAggregateScanRecheck(ColumnarAggregateScanState *aggregateScanState,
+										 TupleTableSlot *slot);
+static void ColumnarAggregateScan_EndCustomScan(CustomScanState *node);
+static void ColumnarAggregateScan_ReScanCustomScan(CustomScanState *node);
+static void ColumnarAggregateScan_ExplainCustomScan(CustomScanState *node,
+													List *ancestors,
+													ExplainState *es);
+static void AccumulateChunkGroup(ColumnarAggregate *aggregate, ChunkData *chunkGroupData,
+								 uint32 rowCount);
+static void AccumulateStripeSkipList(ColumnarAggregate *aggregate,
+									 StripeSkipList *stripeSkipList);
+static void AddToNumericSum(ColumnarAggregate *aggregate, int64 value);
+static int64 IntegerDatumGetInt64(Datum value, Oid typeId);
+static Datum ColumnarAggregateResult(ColumnarAggregate *aggregate, bool *isNull);
+
+
+static create_upper_paths_hook_type PreviousCreateUpperPathsHook = NULL;
+
+static bool EnableColumnarAggregatePushdown = false;
+
+const struct CustomPathMethods ColumnarAggregatePathMethods = {
+	.CustomName = "ColumnarAggregateScan",
+	.PlanCustomPath = ColumnarAggregatePath_PlanCustomPath,
+};
+
+const struct CustomScanMethods ColumnarAggregateScanMethods = {
+	.CustomName = "ColumnarAggregateScan",
+	.CreateCustomScanState = ColumnarAggregateScan_CreateCustomScanState,
+};
+
+const struct CustomExecMethods ColumnarAggregateExecuteMethods = {
+	.CustomName = "ColumnarAggregateScan",
+
+	.BeginCustomScan = ColumnarAggregateScan_BeginCustomScan,
+	.ExecCustomScan = ColumnarAggregateScan_ExecCustomScan,
+	.EndCustomScan = ColumnarAggregateScan_EndCustomScan,
+	.ReScanCustomScan = ColumnarAggregateScan_ReScanCustomScan,
+
+	.ExplainCustomScan = ColumnarAggregateScan_ExplainCustomScan,
+};
+
+
+/*
+ * columnar_aggregate_scan_init installs the hook that adds aggregate scan
+ * paths for aggregates over columnar tables.
+ */
+void
+columnar_aggregate_scan_init()
+{
+	PreviousCreateUpperPathsHook = create_upper_paths_hook;
+	create_upper_paths_hook = ColumnarCreateUpperPathsHook;
+
+	DefineCustomBoolVariable(
+		"columnar.enable_aggregate_pushdown",
+		gettext_noop("Enables computing simple aggregates over columnar tables "
+					 "straight from the column data, without forming tuples."),
+		NULL,
+		&EnableColumnarAggregatePushdown,
+		false,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
+	RegisterCustomScanMethods(&ColumnarAggregateScanMethods);
+}
+
+
+/*
+ * ColumnarCreateUpperPathsHook adds an aggregate scan path to the grouping
+ * relation of a query that aggregates a columnar table, if the aggregate
+ * scan can compute all of its aggregates.
+ */
+static void
+ColumnarCreateUpperPathsHook(PlannerInfo *root, UpperRelationKind stage,
+							 RelOptInfo *inputRel, RelOptInfo *outputRel,
+							 void *extra)
+{
+	if (PreviousCreateUpperPathsHook != NULL)
+	{
+		PreviousCreateUpperPathsHook(root, stage, inputRel, outputRel, extra);
+	}
+
+	if (!EnableColumnarAggregatePushdown || stage != UPPERREL_GROUP_AGG)
+	{
+		return;
+	}
+
+	if (!IsColumnarAggregateScanCandidate(root, inputRel, outputRel))
+	{
+		return;
+	}
+
+	List *aggregateList = PushableAggregateList(outputRel->reltarget->exprs,
+												inputRel->relid);
+	if (aggregateList == NIL)
+	{
+		return;
+	}
+
+	RangeTblEntry *rte = planner_rt_fetch(inputRel->relid, root);
+
+	CustomPath *cpath = makeNode(CustomPath);
+	cpath->methods = &ColumnarAggregatePathMethods;
+
+	Path *path = &cpath->path;
+	path->pathtype = T_CustomScan;
+	path->parent = outputRel;
+	path->pathtarget = outputRel->reltarget;
+	path->param_info = NULL;
+	path->parallel_aware = false;
+	path->parallel_safe = false;
+	path->parallel_workers = 0;
+	path->rows = 1;
+	path->pathkeys = NIL;
+
+	/*
+	 * The scan reads the same data as the cheapest scan of the table, but
+	 * does not pay for forming a tuple per row and aggregating it.
+	 */
+	Path *inputPath = inputRel->cheapest_total_path;
+	path->startup_cost = inputPath->total_cost;
+	path->total_cost = inputPath->total_cost;
+
+	cpath->custom_private = list_make2(list_make1_oid(rte->relid), aggregateList);
+
+	add_path(outputRel, path);
+}
+
+
+/*
+ * IsColumnarAggregateScanCandidate returns whether the query aggregates all
+ * rows of a single columnar table into a single group.
+ */
+static bool
+IsColumnarAggregateScanCandidate(PlannerInfo *root, RelOptInfo *inputRel,
+								 RelOptInfo *outputRel)
+{
+	Query *parse = root->parse;
+
+	if (parse->commandType != CMD_SELECT || parse->groupClause != NIL ||
+		parse->groupingSets != NIL || root->hasHavingQual ||
+		parse->hasTargetSRFs || parse->hasWindowFuncs || parse->rowMarks != NIL)
+	{
+		return false;
+	}
+
+	if (inputRel->reloptkind != RELOPT_BASEREL ||
+		outputRel->reloptkind != RELOPT_UPPER_REL ||
+		inputRel->baserestrictinfo != NIL || !bms_is_empty(inputRel->lateral_relids) ||
+		inputRel->cheapest_total_path == NULL)
+	{
+		return false;
+	}
+
+	RangeTblEntry *rte = planner_rt_fetch(inputRel->relid, root);
+	if (rte->rtekind != RTE_RELATION || rte->inh || rte->tablesample != NULL ||
+		rte->relkind != RELKIND_RELATION)
+	{
+		return false;
+	}
+
+	Relation relation = RelationIdGetRelation(rte->relid);
+	if (!RelationIsValid(relation))
+	{
+		ereport(ERROR, (errmsg("could not open relation with OID %u", rte->relid)));
+	}
+
+	bool isColumnar = (relation->rd_tableam == GetColumnarTableAmRoutine());
+	RelationClose(relation);
+
+	return isColumnar;
+}
+
+
+/*
+ * PushableAggregateList returns the distinct aggregates in the target
+ * expressions, or NIL if the aggregate scan cannot compute all of them or if
+ * the expressions reference columns outside of aggregates.
+ */
+static List *
+PushableAggregateList(List *targetExprList, Index relid)
+{
+	List *aggregateList = NIL;
+
+	Node *targetExpr = NULL;
+	foreach_ptr(targetExpr, targetExprList)
+	{
+		if (contain_subplans(targetExpr))
+		{
+			return NIL;
+		}
+
+		List *nodeList = pull_var_clause(targetExpr, PVC_INCLUDE_AGGREGATES |
+										 PVC_INCLUDE_WINDOWFUNCS |
+										 PVC_INCLUDE_PLACEHOLDERS);
+
+		Node *node = NULL;
+		foreach_ptr(node, nodeList)
+		{
+			ColumnarAggregateKind kind;
+			AttrNumber attributeNumber = InvalidAttrNumber;
+
+			if (!IsA(node, Aggref) ||
+				!ColumnarAggregateForAggref((Aggref *) node, relid, &kind,
+											&attributeNumber))
+			{
+				return NIL;
+			}
+
+			aggregateList = list_append_unique(aggregateList, node);
+		}
+	}
+
+	return aggregateList;
+}
+
+
+/*
+ * ColumnarAggregateForAggref returns whether the aggregate scan can compute
+ * the given aggregate, and if so sets the kind of the aggregate and the
+ * attribute number of its argument. If relid is 0, the relation that the
+ * argument references is not checked.
+ */
+static bool
+ColumnarAggregateForAggref(Aggref *aggref, Index relid, ColumnarAggregateKind *kind,
+						   AttrNumber *attributeNumber)
+{
+	if (aggref->aggdistinct != NIL || aggref->aggorder != NIL ||
+		aggref->aggfilter != NULL || aggref->aggdirectargs != NIL ||
+		aggref->aggkind != AGGKIND_NORMAL || aggref->agglevelsup != 0 ||
+		aggref->aggsplit != AGGSPLIT_SIMPLE)
+	{
+		return false;
+	}
+
+	if (get_func_namespace(aggref->aggfnoid) != PG_CATALOG_NAMESPACE)
+	{
+		return false;
+	}
+
+	char *aggregateName = get_func_name(aggref->aggfnoid);
+
+	if (aggref->aggstar)
+	{
+		*kind = COLUMNAR_AGGREGATE_COUNT_STAR;
+		*attributeNumber = InvalidAttrNumber;
+		return strcmp(aggregateName, "count") == 0 && aggref->aggtype == INT8OID;
+	}
+
+	if (list_length(aggref->args) != 1)
+	{
+		return false;
+	}
+
+	TargetEntry *argument = (TargetEntry *) linitial(aggref->args);
+	if (!IsA(argument->expr, Var))
+	{
+		return false;
+	}
+
+	Var *column = (Var *) argument->expr;
+	if (column->varattno <= 0 || column->varlevelsup != 0 ||
+		(relid != 0 && column->varno != relid))
+	{
+		return false;
+	}
+
+	*attributeNumber = column->varattno;
+
+	Oid columnType = column->vartype;
+	bool isIntegerColumn = (columnType == INT2OID || columnType == INT4OID ||
+							columnType == INT8OID);
+
+	if (strcmp(aggregateName, "count") == 0)
+	{
+		*kind = COLUMNAR_AGGREGATE_COUNT;
+		return aggref->aggtype == INT8OID;
+	}
+	else if (strcmp(aggregateName, "sum") == 0)
+	{
+		/* sum(bigint) returns numeric, like avg(bigint) needs on workers */
+		*kind = COLUMNAR_AGGREGATE_SUM;
+		return ((columnType == INT2OID || columnType == INT4OID) &&
+				aggref->aggtype == INT8OID) ||
+			   (columnType == INT8OID && aggref->aggtype == NUMERICOID);
+	}
+	else if (strcmp(aggregateName, "min") == 0)
+	{
+		*kind = COLUMNAR_AGGREGATE_MIN;
+		return isIntegerColumn && aggref->aggtype == columnType;
+	}
+	else if (strcmp(aggregateName, "max") == 0)
+	{
+		*kind = COLUMNAR_AGGREGATE_MAX;
+		return isIntegerColumn && aggref->aggtype == columnType;
+	}
+
+	return false;
+}
+
+
+/*
+ * ColumnarAggregatePath_PlanCustomPath creates a CustomScan that produces
+ * the aggregates of the path as its scan tuple, from which the target list
+ * is projected.
+ */
+static Plan *
+ColumnarAggregatePath_PlanCustomPath(PlannerInfo *root,
+									 RelOptInfo *rel,
+									 struct CustomPath *best_path,
+									 List *tlist,
+									 List *clauses,
+									 List *custom_plans)
+{
+	CustomScan *cscan = makeNode(CustomScan);
+	cscan->methods = &ColumnarAggregateScanMethods;
+
+	List *relationIdList = (List *) linitial(best_path->custom_private);
+	List *aggregateList = (List *) lsecond(best_path->custom_private);
+
+	List *scanTargetList = NIL;
+	AttrNumber resultNumber = 1;
+
+	Node *aggregate = NULL;
+	foreach_ptr(aggregate, aggregateList)
+	{
+		TargetEntry *targetEntry = makeTargetEntry((Expr *) copyObject(aggregate),
+												   resultNumber++, NULL, false);
+		scanTargetList = lappend(scanTargetList, targetEntry);
+	}
+
+	/* aggregates in the target list are replaced by references to the scan tuple */
+	cscan->custom_scan_tlist = scanTargetList;
+	cscan->custom_private = list_copy(relationIdList);
+	cscan->scan.plan.targetlist = list_copy(tlist);
+	cscan->scan.plan.qual = NIL;
+	cscan->scan.scanrelid = 0;
+
+#if (PG_VERSION_NUM >= 150000)
+
+	/* necessary to avoid extra Result node in PG15 */
+	cscan->flags = CUSTOMPATH_SUPPORT_PROJECTION;
+#endif
+
+	return (Plan *) cscan;
+}
+
+
+static Node *
+ColumnarAggregateScan_CreateCustomScanState(CustomScan *cscan)
+{
+	ColumnarAggregateScanState *aggregateScanState =
+		(ColumnarAggregateScanState *) newNode(sizeof(ColumnarAggregateScanState),
+											   T_CustomScanState);
+
+	CustomScanState *cscanstate = &aggregateScanState->custom_scanstate;
+	cscanstate->methods = &ColumnarAggregateExecuteMethods;
+
+	return (Node *) cscanstate;
+}
+
+
+static void
+ColumnarAggregateScan_BeginCustomScan(CustomScanState *node, EState *estate, int eflags)
+{
+	ColumnarAggregateScanState *aggregateScanState = (ColumnarAggregateScanState *) node;
+	CustomScan *cscan = (CustomScan *) node->ss.ps.plan;
+
+	/* the planner already locked the relation */
+	Oid relationId = linitial_oid(cscan->custom_private);
+	aggregateScanState->relation = table_open(relationId, AccessShareLock);
+
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, cscan->custom_scan_tlist)
+	{
+		Aggref *aggref = castNode(Aggref, targetEntry->expr);
+		ColumnarAggregateKind kind;
+		AttrNumber attributeNumber = InvalidAttrNumber;
+
+		if (!ColumnarAggregateForAggref(aggref, 0, &kind, &attributeNumber))
+		{
+			ereport(ERROR, (errmsg("unexpected aggregate in columnar aggregate scan")));
+		}
+
+		ColumnarAggregate *aggregate = palloc0(sizeof(ColumnarAggregate));
+		aggregate->kind = kind;
+
+		if (attributeNumber != InvalidAttrNumber)
+		{
+			aggregate->columnIndex = attributeNumber - 1;
+			aggregate->columnType = exprType((Node *) linitial_node(TargetEntry,
+																	aggref->args)->expr);
+			aggregate->numericResult = (aggref->aggtype == NUMERICOID);
+
+			aggregateScanState->projectedColumnList =
+				list_append_unique_int(aggregateScanState->projectedColumnList,
+									   attributeNumber);
+		}
+
+		aggregateScanState->aggregateList =
+			lappend(aggregateScanState->aggregateList, aggregate);
+	}
+
+	/* the reader expects the projected columns in attribute order */
+	list_sort(aggregateScanState->projectedColumnList, list_int_cmp);
+
+	aggregateScanState->metadataOnly = true;
+
+	ColumnarAggregate *aggregate = NULL;
+	foreach_ptr(aggregate, aggregateScanState->aggregateList)
+	{
+		if (aggregate->kind != COLUMNAR_AGGREGATE_COUNT_STAR &&
+			aggregate->kind != COLUMNAR_AGGREGATE_MIN &&
+			aggregate->kind != COLUMNAR_AGGREGATE_MAX)
+		{
+			aggregateScanState->metadataOnly = false;
+		}
+	}
+
+	aggregateScanState->finished = false;
+}
+
+
+static TupleTableSlot *
+ColumnarAggregateScan_ExecCustomScan(CustomScanState *node)
+{
+	return ExecScan(&node->ss,
+					(ExecScanAccessMtd) ColumnarAggregateScanNext,
+					(ExecScanRecheckMtd) ColumnarAggregateScanRecheck);
+}
+
+
+/*
+ * ColumnarAggregateScanNext reads all chunk groups of the table, accumulates
+ * the aggregates over their column vectors and returns the aggregates as a
+ * single tuple.
+ */
+static TupleTableSlot *
+ColumnarAggregateScanNext(ColumnarAggregateScanState *aggregateScanState)
+{
+	CustomScanState *node = &aggregateScanState->custom_scanstate;
+	EState *estate = node->ss.ps.state;
+	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+
+	if (aggregateScanState->finished)
+	{
+		return NULL;
+	}
+
+	ColumnarAggregate *aggregate = NULL;
+	foreach_ptr(aggregate, aggregateScanState->aggregateList)
+	{
+		aggregate->count = 0;
+		aggregate->value = 0;
+		aggregate->numericSum = (Datum) 0;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(estate->es_query_cxt);
+
+	Relation relation = aggregateScanState->relation;
+	bool randomAccess = false;
+	ColumnarReadState *readState =
+		ColumnarBeginRead(relation, RelationGetDescr(relation),
+						  aggregateScanState->projectedColumnList, NIL,
+						  estate->es_query_cxt, estate->es_snapshot, randomAccess,
+						  NULL);
+
+	/* the chunk metadata also describes the rows that were deleted */
+	bool metadataOnly = aggregateScanState->metadataOnly &&
+						!ColumnarReadHasDeletedRows(readState);
+	if (metadataOnly)
+	{
+		StripeSkipList *stripeSkipList = NULL;
+		while (ColumnarReadNextStripeSkipList(readState, &stripeSkipList))
+		{
+			CHECK_FOR_INTERRUPTS();
+
+			foreach_ptr(aggregate, aggregateScanState->aggregateList)
+			{
+				AccumulateStripeSkipList(aggregate, stripeSkipList);
+			}
+		}
+	}
+	else
+	{
+		ChunkData *chunkGroupData = NULL;
+		uint32 rowCount = 0;
+		while (ColumnarReadNextChunkGroup(readState, &chunkGroupData, &rowCount))
+		{
+			CHECK_FOR_INTERRUPTS();
+
+			foreach_ptr(aggregate, aggregateScanState->aggregateList)
+			{
+				AccumulateChunkGroup(aggregate, chunkGroupData, rowCount);
+			}
+		}
+	}
+
+	ColumnarEndRead(readState);
+
+	MemoryContextSwitchTo(oldContext);
+
+	ExecClearTuple(slot);
+
+	int aggregateIndex = 0;
+	foreach_ptr(aggregate, aggregateScanState->aggregateList)
+	{
+		slot->tts_values[aggregateIndex] =
+			ColumnarAggregateResult(aggregate, &slot->tts_isnull[aggregateIndex]);
+		aggregateIndex++;
+	}
+
+	ExecStoreVirtualTuple(slot);
+
+	aggregateScanState->finished = true;
+
+	return slot;
+}
+
+
+/*
+ * AccumulateChunkGroup adds the values of the argument column in the chunk
+ * group to the aggregate. The loops only read the exists and value arrays of
+ * a single column, which keeps them tight.
+ */
+static void
+AccumulateChunkGroup(ColumnarAggregate *aggregate, ChunkData *chunkGroupData,
+					 uint32 rowCount)
+{
+	if (aggregate->kind == COLUMNAR_AGGREGATE_COUNT_STAR)
+	{
+		aggregate->count += rowCount;
+		return;
+	}
+
+	bool *existsArray = chunkGroupData->existsArray[aggregate->columnIndex];
+	Datum *valueArray = chunkGroupData->valueArray[aggregate->columnIndex];
+
+	int64 count = 0;
+	int64 sum = 0;
+	int64 min = PG_INT64_MAX;
+	int64 max = PG_INT64_MIN;
+	bool checkSumOverflow = aggregate->numericResult;
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		count += existsArray[rowIndex];
+	}
+
+	if (aggregate->kind != COLUMNAR_AGGREGATE_COUNT && count > 0)
+	{
+		for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			if (!existsArray[rowIndex])
+			{
+				continue;
+			}
+
+			int64 value = 0;
+			switch (aggregate->columnType)
+			{
+				case INT2OID:
+				{
+					value = DatumGetInt16(valueArray[rowIndex]);
+					break;
+				}
+
+				case INT4OID:
+				{
+					value = DatumGetInt32(valueArray[rowIndex]);
+					break;
+				}
+
+				default:
+				{
+					value = DatumGetInt64(valueArray[rowIndex]);
+					break;
+				}
+			}
+
+			/*
+			 * Like int2_sum and int4_sum, sums of smaller integers do not check
+			 * for overflow. Sums of bigint move to the numeric sum instead.
+			 */
+			if (unlikely(checkSumOverflow))
+			{
+				int64 newSum = 0;
+				if (pg_add_s64_overflow(sum, value, &newSum))
+				{
+					AddToNumericSum(aggregate, sum);
+					newSum = value;
+				}
+
+				sum = newSum;
+			}
+			else
+			{
+				sum += value;
+			}
+
+			min = Min(min, value);
+			max = Max(max, value);
+		}
+	}
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	switch (aggregate->kind)
+	{
+		case COLUMNAR_AGGREGATE_SUM:
+		{
+			int64 newValue = 0;
+			if (!checkSumOverflow)
+			{
+				aggregate->value += sum;
+			}
+			else if (pg_add_s64_overflow(aggregate->value, sum, &newValue))
+			{
+				AddToNumericSum(aggregate, sum);
+			}
+			else
+			{
+				aggregate->value = newValue;
+			}
+
+			break;
+		}
+
+		case COLUMNAR_AGGREGATE_MIN:
+		{
+			aggregate->value = (aggregate->count == 0) ? min : Min(aggregate->value, min);
+			break;
+		}
+
+		case COLUMNAR_AGGREGATE_MAX:
+		{
+			aggregate->value = (aggregate->count == 0) ? max : Max(aggregate->value, max);
+			break;
+		}
+
+		default:
+		{
+			break;
+		}
+	}
+
+	aggregate->count += count;
+}
+
+
+/*
+ * AccumulateStripeSkipList adds the chunk metadata of a stripe to a count(*),
+ * min or max aggregate. The minimum and maximum values of a chunk cover all
+ * of its non-NULL values, and chunks without them only have NULL values.
+ */
+static void
+AccumulateStripeSkipList(ColumnarAggregate *aggregate, StripeSkipList *stripeSkipList)
+{
+	for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	{
+		if (aggregate->kind == COLUMNAR_AGGREGATE_COUNT_STAR)
+		{
+			aggregate->count += stripeSkipList->chunkGroupRowCounts[chunkIndex];
+			continue;
+		}
+
+		ColumnChunkSkipNode *chunkSkipNode =
+			&stripeSkipList->chunkSkipNodeArray[aggregate->columnIndex][chunkIndex];
+		if (!chunkSkipNode->hasMinMax)
+		{
+			continue;
+		}
+
+		if (aggregate->kind == COLUMNAR_AGGREGATE_MIN)
+		{
+			int64 min = IntegerDatumGetInt64(chunkSkipNode->minimumValue,
+											 aggregate->columnType);
+			aggregate->value = (aggregate->count == 0) ? min : Min(aggregate->value, min);
+		}
+		else
+		{
+			int64 max = IntegerDatumGetInt64(chunkSkipNode->maximumValue,
+											 aggregate->columnType);
+			aggregate->value = (aggregate->count == 0) ? max : Max(aggregate->value, max);
+		}
+
+		/* for min and max, count only tells whether there were any values */
+		aggregate->count++;
+	}
+}
+
+
+/*
+ * AddToNumericSum adds a part of the sum of a bigint column to the numeric
+ * sum of the aggregate.
+ */
+static void
+AddToNumericSum(ColumnarAggregate *aggregate, int64 value)
+{
+	Datum numericValue = DirectFunctionCall1(int8_numeric, Int64GetDatum(value));
+
+	if (aggregate->numericSum == (Datum) 0)
+	{
+		aggregate->numericSum = numericValue;
+	}
+	else
+	{
+		aggregate->numericSum = DirectFunctionCall2(numeric_add, aggregate->numericSum,
+													numericValue);
+	}
+}
+
+
+/*
+ * IntegerDatumGetInt64 returns the value of a smallint, int or bigint datum.
+ */
+static int64
+IntegerDatumGetInt64(Datum value, Oid typeId)
+{
+	switch (typeId)
+	{
+		case INT2OID:
+		{
+			return DatumGetInt16(value);
+		}
+
+		case INT4OID:
+		{
+			return DatumGetInt32(value);
+		}
+
+		default:
+		{
+			return DatumGetInt64(value);
+		}
+	}
+}
+
+
+/*
+ * ColumnarAggregateResult returns the final value of the aggregate. Like
+ * their built-in counterparts, sum, min and max are NULL if there were no
+ * non-NULL values.
+ */
+static Datum
+ColumnarAggregateResult(ColumnarAggregate *aggregate, bool *isNull)
+{
+	*isNull = false;
+
+	if (aggregate->kind == COLUMNAR_AGGREGATE_COUNT_STAR ||
+		aggregate->kind == COLUMNAR_AGGREGATE_COUNT)
+	{
+		return Int64GetDatum(aggregate->count);
+	}
+
+	if (aggregate->count == 0)
+	{
+		*isNull = true;
+		return (Datum) 0;
+	}
+
+	if (aggregate->kind == COLUMNAR_AGGREGATE_SUM && aggregate->numericResult)
+	{
+		Datum numericValue = DirectFunctionCall1(int8_numeric,
+												 Int64GetDatum(aggregate->value));
+		if (aggregate->numericSum != (Datum) 0)
+		{
+			numericValue = DirectFunctionCall2(numeric_add, aggregate->numericSum,
+											   numericValue);
+		}
+
+		return numericValue;
+	}
+	else if (aggregate->kind == COLUMNAR_AGGREGATE_SUM)
+	{
+		return Int64GetDatum(aggregate->value);
+	}
+
+	switch (aggregate->columnType)
+	{
+		case INT2OID:
+		{
+			return Int16GetDatum((int16) aggregate->value);
+		}
+
+		case INT4OID:
+		{
+			return Int32GetDatum((int32) aggregate->value);
+		}
+
+		default:
+		{
+			return Int64GetDatum(aggregate->value);
+		}
+	}
+}
+
+
+/*
+ * ColumnarAggregateScanRecheck -- access method routine to recheck a tuple in
+ * EvalPlanQual
+ */
+static bool
+ColumnarAggregateScanRecheck(ColumnarAggregateScanState *aggregateScanState,
+							 TupleTableSlot *slot)
+{
+	return true;
+}
+
+
+static void
+ColumnarAggregateScan_EndCustomScan(CustomScanState *node)
+{
+	ColumnarAggregateScanState *aggregateScanState = (ColumnarAggregateScanState *) node;
+
+	/* free the exprcontext */
+	ExecFreeExprContext(&node->ss.ps);
+
+	/* clean out the tuple table */
+	if (node->ss.ps.ps_ResultTupleSlot)
+	{
+		ExecClearTuple(node->ss.ps.ps_ResultTupleSlot);
+	}
+	ExecClearTuple(node->ss.ss_ScanTupleSlot);
+
+	table_close(aggregateScanState->relation, NoLock);
+}
+
+
+static void
+ColumnarAggregateScan_ReScanCustomScan(CustomScanState *node)
+{
+	ColumnarAggregateScanState *aggregateScanState = (ColumnarAggregateScanState *) node;
+
+	aggregateScanState->finished = false;
+}
+
+
+static void
+ColumnarAggregateScan_ExplainCustomScan(CustomScanState *node, List *ancestors,
+										ExplainState *es)
+{
+	ColumnarAggregateScanState *aggregateScanState = (ColumnarAggregateScanState *) node;
+
+	ExplainPropertyText("Columnar Aggregated Table",
+						RelationGetRelationName(aggregateScanState->relation), es);
+	ExplainPropertyBool("Columnar Aggregates From Metadata",
+						aggregateScanState->metadataOnly, es);
+}
@@ -0,0 +1,126 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_bloom_filter.c
+ *
+ * This file contains the bloom filters that are built for the chunks of the
+ * columns in the bloom_columns option of a columnar table. The filters are
+ * built from the hashes of the values of a chunk, and let scans skip the
+ * chunks that cannot contain the values that an equality or IN qual looks
+ * for, which min/max values cannot do for randomly spread values.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "common/hashfn.h"
+
+#include "columnar/columnar_bloom_filter.h"
+
+/* number of bits set for every value, good for a 1% false positive rate */
+#define BLOOM_FILTER_HASH_COUNT 7
+
+/* number of bits per value, rounded up to a power of two per filter */
+#define BLOOM_FILTER_BITS_PER_VALUE 10
+
+/* minimum number of bits of a filter */
+#define BLOOM_FILTER_MIN_BIT_COUNT 64
+
+
+/*
+ * BloomFilterData is the bytea payload of a bloom filter. The bit positions
+ * of a value are derived from its hash by double hashing.
+ */
+typedef struct BloomFilterData
+{
+	int32 vl_len_;              /* varlena header (do not touch directly!) */
+	uint32 bitCount;
+	uint32 hashCount;
+	uint8 bits[FLEXIBLE_ARRAY_MEMBER];
+} BloomFilterData;
+
+
+static uint32 BloomFilterBitIndex(uint32 hash, uint32 hashIndex, uint32 bitCount);
+
+
+/*
+ * BuildBloomFilter returns a bloom filter that holds the given hashes. The
+ * number of bits is a power of two, such that bit positions are cheap to
+ * compute.
+ */
+bytea *
+BuildBloomFilter(uint32 *hashArray, uint32 hashCount)
+{
+	uint64 requiredBitCount = (uint64) hashCount * BLOOM_FILTER_BITS_PER_VALUE;
+	uint32 bitCount = BLOOM_FILTER_MIN_BIT_COUNT;
+
+	while (bitCount < requiredBitCount)
+	{
+		bitCount *= 2;
+	}
+
+	Size filterSize = offsetof(BloomFilterData, bits) + bitCount / 8;
+	BloomFilterData *bloomFilter = palloc0(filterSize);
+
+	SET_VARSIZE(bloomFilter, filterSize);
+	bloomFilter->bitCount = bitCount;
+	bloomFilter->hashCount = BLOOM_FILTER_HASH_COUNT;
+
+	for (uint32 hashArrayIndex = 0; hashArrayIndex < hashCount; hashArrayIndex++)
+	{
+		for (uint32 hashIndex = 0; hashIndex < bloomFilter->hashCount; hashIndex++)
+		{
+			uint32 bitIndex = BloomFilterBitIndex(hashArray[hashArrayIndex], hashIndex,
+												  bitCount);
+			bloomFilter->bits[bitIndex / 8] |= (1 << (bitIndex % 8));
+		}
+	}
+
+	return (bytea *) bloomFilter;
+}
+
+
+/*
+ * BloomFilterMightContain returns false if the value with the given hash is
+ * definitely not in the bloom filter, and true if it might be.
+ */
+bool
+BloomFilterMightContain(bytea *bloomFilterBytea, uint32 hash)
+{
+	BloomFilterData *bloomFilter = (BloomFilterData *) bloomFilterBytea;
+	uint32 bitCount = bloomFilter->bitCount;
+
+	/* be on the safe side for filters that we cannot interpret */
+	if (VARSIZE(bloomFilter) < offsetof(BloomFilterData, bits) ||
+		bitCount == 0 || (bitCount & (bitCount - 1)) != 0 ||
+		VARSIZE(bloomFilter) - offsetof(BloomFilterData, bits) < bitCount / 8)
+	{
+		return true;
+	}
+
+	for (uint32 hashIndex = 0; hashIndex < bloomFilter->hashCount; hashIndex++)
+	{
+		uint32 bitIndex = BloomFilterBitIndex(hash, hashIndex, bitCount);
+		if ((bloomFilter->bits[bitIndex / 8] & (1 << (bitIndex % 8))) == 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * BloomFilterBitIndex returns the bit that the hash function with the given
+ * index sets for a value with the given hash.
+ */
+static uint32
+BloomFilterBitIndex(uint32 hash, uint32 hashIndex, uint32 bitCount)
+{
+	/* the second hash is odd, so it cycles through all bits of the filter */
+	uint32 secondHash = murmurhash32(hash) | 1;
+
+	return (hash + hashIndex * secondHash) & (bitCount - 1);
+}
@@ -0,0 +1,425 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_chunk_cache.c
+ *
+ * This file contains a shared memory cache of decompressed column chunks.
+ * Scans that read the same chunks repeatedly, such as repeated dashboard
+ * queries or index scans that decompress a whole chunk to reach one row,
+ * can copy the decompressed values from the cache instead of reading and
+ * decompressing the chunk again.
+ *
+ * The cache is divided into fixed size blocks, and each cached chunk is
+ * stored in a chain of blocks. When the blocks run out, the least recently
+ * used chunks are evicted. The cache is only available when columnar is
+ * loaded via shared_preload_libraries and columnar.chunk_cache_size is set.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+#include "safe_lib.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "lib/ilist.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_chunk_cache.h"
+
+
+/* size of the blocks in which the decompressed chunks are stored */
+#define CHUNK_CACHE_BLOCK_SIZE 8192
+
+/* chunks that need more than this share of the blocks are not cached */
+#define CHUNK_CACHE_MAX_ENTRY_SHARE 4
+
+#define INVALID_BLOCK_INDEX (-1)
+
+
+/*
+ * ColumnarChunkCacheEntry is the shared memory hash entry of a cached chunk.
+ * The data of the chunk is stored in the chain of blocks that starts at
+ * firstBlock.
+ */
+typedef struct ColumnarChunkCacheEntry
+{
+	ColumnarChunkCacheKey key;
+	dlist_node lruNode;
+	uint32 dataLength;
+	int32 firstBlock;
+} ColumnarChunkCacheEntry;
+
+
+/*
+ * ColumnarChunkCacheControlData holds the lock protecting the chunk cache,
+ * the list of cached chunks from least to most recently used, and the
+ * chains of blocks. nextBlock links the blocks of an entry and the free
+ * blocks.
+ */
+typedef struct ColumnarChunkCacheControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+
+	dlist_head lruList;
+	int32 blockCount;
+	int32 freeBlockCount;
+	int32 freeBlockHead;
+	int32 nextBlock[FLEXIBLE_ARRAY_MEMBER];
+} ColumnarChunkCacheControlData;
+
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static ColumnarChunkCacheControlData *ColumnarChunkCacheControl = NULL;
+static char *ColumnarChunkCacheBlocks = NULL;
+static HTAB *ColumnarChunkCacheHash = NULL;
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+static void ColumnarChunkCacheShmemRequest(void);
+#endif
+static int32 ColumnarChunkCacheBlockCount(void);
+static Size ColumnarChunkCacheShmemSize(void);
+static void ColumnarChunkCacheShmemInit(void);
+static void EvictLeastRecentlyUsedChunk(void);
+
+
+/*
+ * ColumnarChunkCacheInit requests the shared memory for the chunk cache and
+ * sets the hook that initializes it. It does nothing if columnar is not
+ * being loaded via shared_preload_libraries, or the cache is disabled.
+ */
+void
+ColumnarChunkCacheInit(void)
+{
+	if (!process_shared_preload_libraries_in_progress ||
+		ColumnarChunkCacheBlockCount() == 0)
+	{
+		return;
+	}
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = ColumnarChunkCacheShmemRequest;
+#else
+	RequestAddinShmemSpace(ColumnarChunkCacheShmemSize());
+#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ColumnarChunkCacheShmemInit;
+}
+
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+
+/*
+ * ColumnarChunkCacheShmemRequest requests the shared memory for the chunk
+ * cache.
+ */
+static void
+ColumnarChunkCacheShmemRequest(void)
+{
+	if (prev_shmem_request_hook != NULL)
+	{
+		prev_shmem_request_hook();
+	}
+
+	RequestAddinShmemSpace(ColumnarChunkCacheShmemSize());
+}
+
+
+#endif
+
+
+/*
+ * ColumnarChunkCacheBlockCount returns the number of blocks of the chunk
+ * cache for the configured cache size.
+ */
+static int32
+ColumnarChunkCacheBlockCount(void)
+{
+	return (int32) ((int64) columnar_chunk_cache_size * 1024 / CHUNK_CACHE_BLOCK_SIZE);
+}
+
+
+/*
+ * ColumnarChunkCacheShmemSize returns the size of the shared memory used for
+ * the chunk cache. Every entry takes at least one block, so the hash never
+ * needs more entries than there are blocks.
+ */
+static Size
+ColumnarChunkCacheShmemSize(void)
+{
+	int32 blockCount = ColumnarChunkCacheBlockCount();
+	Size size = 0;
+
+	size = add_size(size, offsetof(ColumnarChunkCacheControlData, nextBlock));
+	size = add_size(size, mul_size(blockCount, sizeof(int32)));
+	size = add_size(size, mul_size(blockCount, CHUNK_CACHE_BLOCK_SIZE));
+	size = add_size(size, hash_estimate_size(blockCount,
+											 sizeof(ColumnarChunkCacheEntry)));
+
+	return size;
+}
+
+
+/*
+ * ColumnarChunkCacheShmemInit initializes the shared memory used for the
+ * chunk cache.
+ */
+static void
+ColumnarChunkCacheShmemInit(void)
+{
+	int32 blockCount = ColumnarChunkCacheBlockCount();
+	bool alreadyInitialized = false;
+	HASHCTL hashInfo;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	Size controlSize = add_size(offsetof(ColumnarChunkCacheControlData, nextBlock),
+								mul_size(blockCount, sizeof(int32)));
+	ColumnarChunkCacheControl =
+		(ColumnarChunkCacheControlData *) ShmemInitStruct("Columnar Chunk Cache",
+														  controlSize,
+														  &alreadyInitialized);
+
+	ColumnarChunkCacheBlocks =
+		(char *) ShmemInitStruct("Columnar Chunk Cache Blocks",
+								 mul_size(blockCount, CHUNK_CACHE_BLOCK_SIZE),
+								 &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		ColumnarChunkCacheControl->trancheId = LWLockNewTrancheId();
+		ColumnarChunkCacheControl->lockTrancheName = "Columnar Chunk Cache";
+		LWLockRegisterTranche(ColumnarChunkCacheControl->trancheId,
+							  ColumnarChunkCacheControl->lockTrancheName);
+
+		LWLockInitialize(&ColumnarChunkCacheControl->lock,
+						 ColumnarChunkCacheControl->trancheId);
+
+		dlist_init(&ColumnarChunkCacheControl->lruList);
+		ColumnarChunkCacheControl->blockCount = blockCount;
+		ColumnarChunkCacheControl->freeBlockCount = blockCount;
+		ColumnarChunkCacheControl->freeBlockHead = 0;
+
+		for (int32 blockIndex = 0; blockIndex < blockCount; blockIndex++)
+		{
+			ColumnarChunkCacheControl->nextBlock[blockIndex] =
+				(blockIndex + 1 < blockCount) ? blockIndex + 1 : INVALID_BLOCK_INDEX;
+		}
+	}
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = sizeof(ColumnarChunkCacheKey);
+	hashInfo.entrysize = sizeof(ColumnarChunkCacheEntry);
+	hashInfo.hash = tag_hash;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	ColumnarChunkCacheHash = ShmemInitHash("Columnar Chunk Cache Hash",
+										   blockCount, blockCount,
+										   &hashInfo, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * ColumnarChunkCacheEnabled returns whether the chunk cache is available and
+ * scans should use it.
+ */
+bool
+ColumnarChunkCacheEnabled(void)
+{
+	return ColumnarChunkCacheControl != NULL && columnar_enable_chunk_cache;
+}
+
+
+/*
+ * ColumnarChunkCacheLookup returns a copy of the decompressed data of the
+ * chunk with the given key, or NULL if the chunk is not cached.
+ */
+StringInfo
+ColumnarChunkCacheLookup(ColumnarChunkCacheKey *key)
+{
+	if (!ColumnarChunkCacheEnabled())
+	{
+		return NULL;
+	}
+
+	/* copy the data under a shared lock, such that readers do not block */
+	LWLockAcquire(&ColumnarChunkCacheControl->lock, LW_SHARED);
+
+	ColumnarChunkCacheEntry *entry = hash_search(ColumnarChunkCacheHash, key,
+												 HASH_FIND, NULL);
+	if (entry == NULL)
+	{
+		LWLockRelease(&ColumnarChunkCacheControl->lock);
+		return NULL;
+	}
+
+	StringInfo valueBuffer = makeStringInfo();
+	enlargeStringInfo(valueBuffer, entry->dataLength);
+
+	int32 blockIndex = entry->firstBlock;
+	uint32 copiedLength = 0;
+
+	while (copiedLength < entry->dataLength)
+	{
+		uint32 copyLength = Min(entry->dataLength - copiedLength,
+								CHUNK_CACHE_BLOCK_SIZE);
+
+		memcpy_s(valueBuffer->data + copiedLength,
+				 valueBuffer->maxlen - copiedLength,
+				 ColumnarChunkCacheBlocks + (Size) blockIndex * CHUNK_CACHE_BLOCK_SIZE,
+				 copyLength);
+
+		copiedLength += copyLength;
+		blockIndex = ColumnarChunkCacheControl->nextBlock[blockIndex];
+	}
+
+	valueBuffer->len = copiedLength;
+	valueBuffer->data[copiedLength] = '\0';
+
+	LWLockRelease(&ColumnarChunkCacheControl->lock);
+
+	/* then mark the chunk as most recently used, if it was not evicted */
+	LWLockAcquire(&ColumnarChunkCacheControl->lock, LW_EXCLUSIVE);
+
+	entry = hash_search(ColumnarChunkCacheHash, key, HASH_FIND, NULL);
+	if (entry != NULL)
+	{
+		dlist_move_tail(&ColumnarChunkCacheControl->lruList, &entry->lruNode);
+	}
+
+	LWLockRelease(&ColumnarChunkCacheControl->lock);
+
+	return valueBuffer;
+}
+
+
+/*
+ * ColumnarChunkCacheInsert stores the decompressed data of the chunk with the
+ * given key in the cache, evicting the least recently used chunks if there
+ * are not enough free blocks. Chunks that would take a large share of the
+ * cache are not cached.
+ */
+void
+ColumnarChunkCacheInsert(ColumnarChunkCacheKey *key, StringInfo valueBuffer)
+{
+	if (!ColumnarChunkCacheEnabled())
+	{
+		return;
+	}
+
+	int32 blockCount = ColumnarChunkCacheControl->blockCount;
+	int64 requiredBlockCount = Max(1, ((int64) valueBuffer->len +
+									   CHUNK_CACHE_BLOCK_SIZE - 1) /
+								   CHUNK_CACHE_BLOCK_SIZE);
+
+	if (requiredBlockCount > blockCount / CHUNK_CACHE_MAX_ENTRY_SHARE)
+	{
+		return;
+	}
+
+	LWLockAcquire(&ColumnarChunkCacheControl->lock, LW_EXCLUSIVE);
+
+	if (hash_search(ColumnarChunkCacheHash, key, HASH_FIND, NULL) != NULL)
+	{
+		/* another backend cached the chunk concurrently */
+		LWLockRelease(&ColumnarChunkCacheControl->lock);
+		return;
+	}
+
+	while (ColumnarChunkCacheControl->freeBlockCount < requiredBlockCount)
+	{
+		EvictLeastRecentlyUsedChunk();
+	}
+
+	bool found = false;
+	ColumnarChunkCacheEntry *entry = hash_search(ColumnarChunkCacheHash, key,
+												 HASH_ENTER_NULL, &found);
+	if (entry == NULL)
+	{
+		LWLockRelease(&ColumnarChunkCacheControl->lock);
+		return;
+	}
+
+	entry->dataLength = valueBuffer->len;
+	entry->firstBlock = INVALID_BLOCK_INDEX;
+
+	int32 *nextBlockPointer = &entry->firstBlock;
+	uint32 copiedLength = 0;
+
+	for (int64 blockNumber = 0; blockNumber < requiredBlockCount; blockNumber++)
+	{
+		int32 blockIndex = ColumnarChunkCacheControl->freeBlockHead;
+		uint32 copyLength = Min(valueBuffer->len - copiedLength,
+								CHUNK_CACHE_BLOCK_SIZE);
+
+		ColumnarChunkCacheControl->freeBlockHead =
+			ColumnarChunkCacheControl->nextBlock[blockIndex];
+		ColumnarChunkCacheControl->freeBlockCount--;
+
+		memcpy_s(ColumnarChunkCacheBlocks + (Size) blockIndex * CHUNK_CACHE_BLOCK_SIZE,
+				 CHUNK_CACHE_BLOCK_SIZE, valueBuffer->data + copiedLength,
+				 copyLength);
+		copiedLength += copyLength;
+
+		*nextBlockPointer = blockIndex;
+		nextBlockPointer = &ColumnarChunkCacheControl->nextBlock[blockIndex];
+	}
+
+	*nextBlockPointer = INVALID_BLOCK_INDEX;
+
+	dlist_push_tail(&ColumnarChunkCacheControl->lruList, &entry->lruNode);
+
+	LWLockRelease(&ColumnarChunkCacheControl->lock);
+}
+
+
+/*
+ * EvictLeastRecentlyUsedChunk removes the least recently used chunk from the
+ * cache and returns its blocks to the free list. The caller should hold the
+ * cache lock in exclusive mode, and there should be a cached chunk.
+ */
+static void
+EvictLeastRecentlyUsedChunk(void)
+{
+	Assert(!dlist_is_empty(&ColumnarChunkCacheControl->lruList));
+
+	dlist_node *lruNode = dlist_pop_head_node(&ColumnarChunkCacheControl->lruList);
+	ColumnarChunkCacheEntry *entry = dlist_container(ColumnarChunkCacheEntry, lruNode,
+													 lruNode);
+
+	int32 blockIndex = entry->firstBlock;
+	while (blockIndex != INVALID_BLOCK_INDEX)
+	{
+		int32 nextBlockIndex = ColumnarChunkCacheControl->nextBlock[blockIndex];
+
+		ColumnarChunkCacheControl->nextBlock[blockIndex] =
+			ColumnarChunkCacheControl->freeBlockHead;
+		ColumnarChunkCacheControl->freeBlockHead = blockIndex;
+		ColumnarChunkCacheControl->freeBlockCount++;
+
+		blockIndex = nextBlockIndex;
+	}
+
+	hash_search(ColumnarChunkCacheHash, &entry->key, HASH_REMOVE, NULL);
+}
@@ -25,6 +25,7 @@
 
 #if HAVE_LIBZSTD
 #include <zstd.h>
+#include <zdict.h>
 #endif
 
 /*
@@ -48,18 +49,30 @@ typedef struct ColumnarCompressHeader
 									  len) (((ColumnarCompressHeader *) (ptr))->rawsize = \
 												(len))
 
+#if HAVE_LIBZSTD
+
+/* contexts for compressing and decompressing with dictionaries, kept across calls */
+static ZSTD_CCtx *ZstdCompressionContext = NULL;
+static ZSTD_DCtx *ZstdDecompressionContext = NULL;
+#endif
+
 
 /*
  * CompressBuffer compresses the given buffer with the given compression type
  * outputBuffer enlarged to contain compressed data. The function returns true
  * if compression is done, returns false if compression is not done.
  * outputBuffer is valid only if the function returns true.
+ *
+ * If dictionary is not NULL, zstd compresses with the given trained
+ * dictionary, whose id is recorded in the compressed frame. Other
+ * compression types ignore the dictionary.
  */
 bool
 CompressBuffer(StringInfo inputBuffer,
 			   StringInfo outputBuffer,
 			   CompressionType compressionType,
-			   int compressionLevel)
+			   int compressionLevel,
+			   bytea *dictionary)
 {
 	switch (compressionType)
 	{
@@ -98,11 +111,37 @@ CompressBuffer(StringInfo inputBuffer,
 			resetStringInfo(outputBuffer);
 			enlargeStringInfo(outputBuffer, maximumLength);
 
-			size_t compressedSize = ZSTD_compress(outputBuffer->data,
-												  outputBuffer->maxlen,
-												  inputBuffer->data,
-												  inputBuffer->len,
-												  compressionLevel);
+			size_t compressedSize = 0;
+
+			if (dictionary != NULL)
+			{
+				if (ZstdCompressionContext == NULL)
+				{
+					ZstdCompressionContext = ZSTD_createCCtx();
+					if (ZstdCompressionContext == NULL)
+					{
+						ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY),
+										errmsg("out of memory")));
+					}
+				}
+
+				compressedSize = ZSTD_compress_usingDict(ZstdCompressionContext,
+														 outputBuffer->data,
+														 outputBuffer->maxlen,
+														 inputBuffer->data,
+														 inputBuffer->len,
+														 VARDATA_ANY(dictionary),
+														 VARSIZE_ANY_EXHDR(dictionary),
+														 compressionLevel);
+			}
+			else
+			{
+				compressedSize = ZSTD_compress(outputBuffer->data,
+											   outputBuffer->maxlen,
+											   inputBuffer->data,
+											   inputBuffer->len,
+											   compressionLevel);
+			}
 
 			if (ZSTD_isError(compressedSize))
 			{
@@ -154,14 +193,54 @@ CompressBuffer(StringInfo inputBuffer,
 }
 
 
+/*
+ * CompressedSizeBound returns the size of the output buffer that
+ * CompressBuffer uses for compressing inputSize bytes with the given
+ * compression type, which the compressed data never exceeds.
+ */
+uint64
+CompressedSizeBound(uint32 inputSize, CompressionType compressionType)
+{
+	switch (compressionType)
+	{
+#if HAVE_CITUS_LIBLZ4
+		case COMPRESSION_LZ4:
+		{
+			return LZ4_compressBound(inputSize);
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		case COMPRESSION_ZSTD:
+		{
+			return ZSTD_compressBound(inputSize);
+		}
+#endif
+
+		case COMPRESSION_PG_LZ:
+		{
+			return PGLZ_MAX_OUTPUT(inputSize) + COLUMNAR_COMPRESS_HDRSZ;
+		}
+
+		default:
+		{
+			return inputSize;
+		}
+	}
+}
+
+
 /*
  * DecompressBuffer decompresses the given buffer with the given compression
  * type. This function returns the buffer as-is when no compression is applied.
+ * dictionary should be the dictionary that the buffer was compressed with, if
+ * any, see CompressedBufferDictionaryId.
  */
 StringInfo
 DecompressBuffer(StringInfo buffer,
 				 CompressionType compressionType,
-				 uint64 decompressedSize)
+				 uint64 decompressedSize,
+				 bytea *dictionary)
 {
 	switch (compressionType)
 	{
@@ -200,10 +279,36 @@ DecompressBuffer(StringInfo buffer,
 			StringInfo decompressedBuffer = makeStringInfo();
 			enlargeStringInfo(decompressedBuffer, decompressedSize);
 
-			size_t zstdDecompressSize = ZSTD_decompress(decompressedBuffer->data,
-														decompressedSize,
-														buffer->data,
-														buffer->len);
+			size_t zstdDecompressSize = 0;
+
+			if (dictionary != NULL)
+			{
+				if (ZstdDecompressionContext == NULL)
+				{
+					ZstdDecompressionContext = ZSTD_createDCtx();
+					if (ZstdDecompressionContext == NULL)
+					{
+						ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY),
+										errmsg("out of memory")));
+					}
+				}
+
+				zstdDecompressSize =
+					ZSTD_decompress_usingDict(ZstdDecompressionContext,
+											  decompressedBuffer->data,
+											  decompressedSize,
+											  buffer->data,
+											  buffer->len,
+											  VARDATA_ANY(dictionary),
+											  VARSIZE_ANY_EXHDR(dictionary));
+			}
+			else
+			{
+				zstdDecompressSize = ZSTD_decompress(decompressedBuffer->data,
+													 decompressedSize,
+													 buffer->data,
+													 buffer->len);
+			}
 			if (ZSTD_isError(zstdDecompressSize))
 			{
 				ereport(ERROR, (errmsg("zstd decompression failed"),
@@ -264,3 +369,65 @@ DecompressBuffer(StringInfo buffer,
 		}
 	}
 }
+
+
+/*
+ * TrainCompressionDictionary trains a zstd dictionary of at most the given
+ * size from the samples, which are stored back to back in sampleData. It
+ * returns NULL if the samples are not enough to train a dictionary.
+ */
+bytea *
+TrainCompressionDictionary(char *sampleData, size_t *sampleSizeArray,
+						   uint32 sampleCount, uint32 dictionarySize)
+{
+#if HAVE_LIBZSTD
+	bytea *dictionary = palloc0(VARHDRSZ + dictionarySize);
+
+	size_t trainedSize = ZDICT_trainFromBuffer(VARDATA(dictionary), dictionarySize,
+											   sampleData, sampleSizeArray,
+											   sampleCount);
+	if (ZDICT_isError(trainedSize))
+	{
+		ereport(DEBUG1, (errmsg("zstd dictionary training failed"),
+						 errdetail("%s", ZDICT_getErrorName(trainedSize))));
+		pfree(dictionary);
+		return NULL;
+	}
+
+	SET_VARSIZE(dictionary, VARHDRSZ + trainedSize);
+	return dictionary;
+#else
+	ereport(ERROR, (errmsg("compression dictionaries require zstd support")));
+#endif
+}
+
+
+/*
+ * CompressionDictionaryId returns the id of the given zstd dictionary, which
+ * is recorded in the frames that are compressed with it.
+ */
+uint32
+CompressionDictionaryId(bytea *dictionary)
+{
+#if HAVE_LIBZSTD
+	return ZDICT_getDictID(VARDATA_ANY(dictionary), VARSIZE_ANY_EXHDR(dictionary));
+#else
+	return 0;
+#endif
+}
+
+
+/*
+ * CompressedBufferDictionaryId returns the id of the dictionary that the given
+ * zstd compressed buffer was compressed with, or 0 if it was compressed
+ * without a dictionary.
+ */
+uint32
+CompressedBufferDictionaryId(StringInfo buffer)
+{
+#if HAVE_LIBZSTD
+	return ZSTD_getDictID_fromFrame(buffer->data, buffer->len);
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,488 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_compression_workers.c
+ *
+ * This file contains the functions for compressing the chunks of a stripe
+ * in background workers. When columnar.compression_workers is set, the
+ * writer does not compress the value buffers of chunks as they fill, but
+ * compresses all of them when the stripe is flushed. The backend that
+ * flushes the stripe (the leader) copies the buffers into a dynamic shared
+ * memory segment, and the workers and the leader claim the buffers one by
+ * one and compress them into the segment.
+ *
+ * Workers only compress, so they do not connect to a database and do not
+ * need the snapshot or the locks of the leader. The leader waits for all
+ * of its workers to exit, and compresses the buffers that a worker failed
+ * to compress itself, so the stripe is written by the leader as before.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "safe_lib.h"
+
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+#include "storage/shm_toc.h"
+#include "utils/memutils.h"
+#include "utils/resowner.h"
+
+#include "columnar/columnar.h"
+#include "columnar/columnar_compression.h"
+
+
+#define COLUMNAR_COMPRESSION_MAGIC 0x43504d57
+#define COLUMNAR_COMPRESSION_KEY_QUEUE 0
+#define COLUMNAR_COMPRESSION_KEY_DATA 1
+#define COLUMNAR_COMPRESSION_NKEYS 2
+
+/* maximum size of the shared memory segment of a batch of buffers */
+#define COMPRESSION_SEGMENT_MAX_SIZE ((Size) 32 * 1024 * 1024)
+
+
+/*
+ * CompressionTask describes the compression of one buffer. The offsets are
+ * relative to the start of the data chunk of the shared memory segment, and
+ * done is only set once the compressed data is in place.
+ */
+typedef struct CompressionTask
+{
+	Size inputOffset;
+	uint32 inputLength;
+	Size outputOffset;
+	uint64 outputCapacity;
+	uint32 outputLength;
+
+	/* dictionaryOffset is only valid when hasDictionary is set */
+	bool hasDictionary;
+	Size dictionaryOffset;
+
+	bool compressed;
+	bool done;
+} CompressionTask;
+
+
+/*
+ * CompressionTaskQueue is the fixed part of the shared memory segment. Both
+ * the leader and the workers claim the next task by incrementing
+ * nextTaskIndex.
+ */
+typedef struct CompressionTaskQueue
+{
+	CompressionType compressionType;
+	int compressionLevel;
+	uint32 taskCount;
+	pg_atomic_uint32 nextTaskIndex;
+	CompressionTask tasks[FLEXIBLE_ARRAY_MEMBER];
+} CompressionTaskQueue;
+
+
+static void CompressBatchInParallel(CompressionJob *jobArray, int jobCount,
+									CompressionType compressionType,
+									int compressionLevel, int workerCount);
+static int LaunchCompressionWorkers(dsm_segment *segment, int workerCount,
+									BackgroundWorkerHandle **handleArray);
+static void RunCompressionTasks(CompressionTaskQueue *queue, char *data);
+static void CompressJob(CompressionJob *job, CompressionType compressionType,
+						int compressionLevel);
+static Size CompressionJobSegmentSize(CompressionJob *job,
+									  CompressionType compressionType);
+
+
+/*
+ * CompressBuffersInParallel compresses the input buffers of the given jobs
+ * with up to workerCount background workers. For every job, compressed is
+ * set to the result of CompressBuffer, and outputBuffer holds the
+ * compressed data if it is set.
+ *
+ * The buffers are split into batches such that the shared memory segment
+ * of a batch stays small, and a buffer that does not fit into a segment by
+ * itself is compressed by the leader.
+ */
+void
+CompressBuffersInParallel(CompressionJob *jobArray, int jobCount,
+						  CompressionType compressionType, int compressionLevel,
+						  int workerCount)
+{
+	int batchStartIndex = 0;
+
+	while (batchStartIndex < jobCount)
+	{
+		int batchEndIndex = batchStartIndex;
+		Size batchSize = 0;
+
+		while (batchEndIndex < jobCount)
+		{
+			Size jobSize = CompressionJobSegmentSize(&jobArray[batchEndIndex],
+													 compressionType);
+			if (batchEndIndex > batchStartIndex &&
+				batchSize + jobSize > COMPRESSION_SEGMENT_MAX_SIZE)
+			{
+				break;
+			}
+
+			batchSize += jobSize;
+			batchEndIndex++;
+		}
+
+		int batchJobCount = batchEndIndex - batchStartIndex;
+		if (batchJobCount == 1 || workerCount == 0 ||
+			batchSize > COMPRESSION_SEGMENT_MAX_SIZE)
+		{
+			for (int jobIndex = batchStartIndex; jobIndex < batchEndIndex; jobIndex++)
+			{
+				CompressJob(&jobArray[jobIndex], compressionType, compressionLevel);
+			}
+		}
+		else
+		{
+			CompressBatchInParallel(&jobArray[batchStartIndex], batchJobCount,
+									compressionType, compressionLevel, workerCount);
+		}
+
+		batchStartIndex = batchEndIndex;
+	}
+}
+
+
+/*
+ * CompressBatchInParallel compresses the given jobs in a single shared
+ * memory segment, with the leader taking part in the compression.
+ */
+static void
+CompressBatchInParallel(CompressionJob *jobArray, int jobCount,
+						CompressionType compressionType, int compressionLevel,
+						int workerCount)
+{
+	/* every distinct dictionary is copied only once */
+	bytea **dictionaryArray = palloc0(jobCount * sizeof(bytea *));
+	Size *dictionaryOffsetArray = palloc0(jobCount * sizeof(Size));
+	int dictionaryCount = 0;
+
+	Size dataSize = 0;
+	for (int jobIndex = 0; jobIndex < jobCount; jobIndex++)
+	{
+		dataSize = add_size(dataSize, CompressionJobSegmentSize(&jobArray[jobIndex],
+																compressionType));
+	}
+
+	Size queueSize = add_size(offsetof(CompressionTaskQueue, tasks),
+							  mul_size(jobCount, sizeof(CompressionTask)));
+
+	shm_toc_estimator estimator = { 0 };
+	shm_toc_initialize_estimator(&estimator);
+	shm_toc_estimate_chunk(&estimator, queueSize);
+	shm_toc_estimate_chunk(&estimator, dataSize);
+	shm_toc_estimate_keys(&estimator, COLUMNAR_COMPRESSION_NKEYS);
+	Size segmentSize = shm_toc_estimate(&estimator);
+
+	dsm_segment *segment = dsm_create(segmentSize, DSM_CREATE_NULL_IF_MAXSEGMENTS);
+	if (segment == NULL)
+	{
+		for (int jobIndex = 0; jobIndex < jobCount; jobIndex++)
+		{
+			CompressJob(&jobArray[jobIndex], compressionType, compressionLevel);
+		}
+
+		return;
+	}
+
+	shm_toc *toc = shm_toc_create(COLUMNAR_COMPRESSION_MAGIC,
+								  dsm_segment_address(segment), segmentSize);
+
+	CompressionTaskQueue *queue = shm_toc_allocate(toc, queueSize);
+	memset(queue, 0, queueSize);
+	queue->compressionType = compressionType;
+	queue->compressionLevel = compressionLevel;
+	queue->taskCount = jobCount;
+	pg_atomic_init_u32(&queue->nextTaskIndex, 0);
+	shm_toc_insert(toc, COLUMNAR_COMPRESSION_KEY_QUEUE, queue);
+
+	char *data = shm_toc_allocate(toc, dataSize);
+	shm_toc_insert(toc, COLUMNAR_COMPRESSION_KEY_DATA, data);
+
+	Size dataOffset = 0;
+	for (int jobIndex = 0; jobIndex < jobCount; jobIndex++)
+	{
+		CompressionJob *job = &jobArray[jobIndex];
+		CompressionTask *task = &queue->tasks[jobIndex];
+		StringInfo inputBuffer = job->inputBuffer;
+
+		task->inputOffset = dataOffset;
+		task->inputLength = inputBuffer->len;
+		if (inputBuffer->len > 0)
+		{
+			memcpy_s(data + dataOffset, dataSize - dataOffset, inputBuffer->data,
+					 inputBuffer->len);
+		}
+		dataOffset += MAXALIGN(inputBuffer->len);
+
+		task->outputOffset = dataOffset;
+		task->outputCapacity = CompressedSizeBound(inputBuffer->len, compressionType);
+		dataOffset += MAXALIGN(task->outputCapacity);
+
+		if (job->dictionary == NULL)
+		{
+			continue;
+		}
+
+		int dictionaryIndex = 0;
+		while (dictionaryIndex < dictionaryCount &&
+			   dictionaryArray[dictionaryIndex] != job->dictionary)
+		{
+			dictionaryIndex++;
+		}
+
+		if (dictionaryIndex == dictionaryCount)
+		{
+			Size dictionarySize = VARSIZE_ANY(job->dictionary);
+
+			memcpy_s(data + dataOffset, dataSize - dataOffset, job->dictionary,
+					 dictionarySize);
+			dictionaryArray[dictionaryCount] = job->dictionary;
+			dictionaryOffsetArray[dictionaryCount] = dataOffset;
+			dictionaryCount++;
+			dataOffset += MAXALIGN(dictionarySize);
+		}
+
+		task->hasDictionary = true;
+		task->dictionaryOffset = dictionaryOffsetArray[dictionaryIndex];
+	}
+
+	/* there is no point in starting more workers than there are other tasks */
+	workerCount = Min(workerCount, jobCount - 1);
+
+	BackgroundWorkerHandle **handleArray =
+		palloc0(workerCount * sizeof(BackgroundWorkerHandle *));
+	int launchedWorkerCount = LaunchCompressionWorkers(segment, workerCount,
+													   handleArray);
+
+	RunCompressionTasks(queue, data);
+
+	/* workers may still be compressing the tasks they claimed last */
+	for (int workerIndex = 0; workerIndex < launchedWorkerCount; workerIndex++)
+	{
+		BgwHandleStatus status = WaitForBackgroundWorkerShutdown(
+			handleArray[workerIndex]);
+		if (status == BGWH_POSTMASTER_DIED)
+		{
+			ereport(FATAL, (errcode(ERRCODE_ADMIN_SHUTDOWN),
+							errmsg("postmaster exited during columnar compression")));
+		}
+	}
+
+	pg_read_barrier();
+
+	for (int jobIndex = 0; jobIndex < jobCount; jobIndex++)
+	{
+		CompressionJob *job = &jobArray[jobIndex];
+		CompressionTask *task = &queue->tasks[jobIndex];
+
+		if (!task->done)
+		{
+			/* the worker that claimed the task exited early */
+			CompressJob(job, compressionType, compressionLevel);
+			continue;
+		}
+
+		job->compressed = task->compressed;
+		job->outputBuffer = makeStringInfo();
+
+		if (task->compressed)
+		{
+			appendBinaryStringInfo(job->outputBuffer, data + task->outputOffset,
+								   task->outputLength);
+		}
+	}
+
+	dsm_detach(segment);
+
+	pfree(handleArray);
+	pfree(dictionaryArray);
+	pfree(dictionaryOffsetArray);
+}
+
+
+/*
+ * LaunchCompressionWorkers registers up to workerCount workers for the tasks
+ * in the given segment, and returns the number of workers it registered.
+ * The leader compresses all tasks itself if no worker could be registered.
+ */
+static int
+LaunchCompressionWorkers(dsm_segment *segment, int workerCount,
+						 BackgroundWorkerHandle **handleArray)
+{
+	int launchedWorkerCount = 0;
+
+	for (int workerIndex = 0; workerIndex < workerCount; workerIndex++)
+	{
+		BackgroundWorker worker = { 0 };
+		strcpy_s(worker.bgw_name, sizeof(worker.bgw_name),
+				 "columnar compression worker");
+		strcpy_s(worker.bgw_type, sizeof(worker.bgw_type),
+				 "columnar compression worker");
+		worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+		worker.bgw_start_time = BgWorkerStart_ConsistentState;
+		worker.bgw_restart_time = BGW_NEVER_RESTART;
+		strcpy_s(worker.bgw_library_name, sizeof(worker.bgw_library_name),
+				 "citus_columnar");
+		strcpy_s(worker.bgw_function_name, sizeof(worker.bgw_function_name),
+				 "ColumnarCompressionWorkerMain");
+		worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(segment));
+		worker.bgw_notify_pid = MyProcPid;
+
+		if (!RegisterDynamicBackgroundWorker(&worker, &handleArray[workerIndex]))
+		{
+			/* continue with the workers we could register */
+			break;
+		}
+
+		launchedWorkerCount++;
+	}
+
+	return launchedWorkerCount;
+}
+
+
+/*
+ * ColumnarCompressionWorkerMain is the main function of a background worker
+ * that compresses buffers for a leader. It exits once there are no tasks
+ * left to claim.
+ */
+void
+ColumnarCompressionWorkerMain(Datum main_arg)
+{
+	BackgroundWorkerUnblockSignals();
+
+	/* set up a memory context and resource owner */
+	Assert(CurrentResourceOwner == NULL);
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "columnar compression worker");
+	CurrentMemoryContext = AllocSetContextCreate(TopMemoryContext,
+												 "columnar compression worker",
+												 ALLOCSET_DEFAULT_SIZES);
+
+	dsm_segment *segment = dsm_attach(DatumGetUInt32(main_arg));
+	if (segment == NULL)
+	{
+		/* the leader gave up on the batch before we started */
+		proc_exit(0);
+	}
+
+	shm_toc *toc = shm_toc_attach(COLUMNAR_COMPRESSION_MAGIC,
+								  dsm_segment_address(segment));
+	if (toc == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("bad magic number in dynamic shared memory segment")));
+	}
+
+	CompressionTaskQueue *queue = shm_toc_lookup(toc, COLUMNAR_COMPRESSION_KEY_QUEUE,
+												 false);
+	char *data = shm_toc_lookup(toc, COLUMNAR_COMPRESSION_KEY_DATA, false);
+
+	RunCompressionTasks(queue, data);
+
+	dsm_detach(segment);
+	proc_exit(0);
+}
+
+
+/*
+ * RunCompressionTasks claims and compresses tasks of the given queue until
+ * there are no tasks left. A task whose compressed data does not fit into
+ * its output area is left for the leader.
+ */
+static void
+RunCompressionTasks(CompressionTaskQueue *queue, char *data)
+{
+	StringInfo outputBuffer = makeStringInfo();
+
+	while (true)
+	{
+		uint32 taskIndex = pg_atomic_fetch_add_u32(&queue->nextTaskIndex, 1);
+		if (taskIndex >= queue->taskCount)
+		{
+			break;
+		}
+
+		CompressionTask *task = &queue->tasks[taskIndex];
+
+		StringInfoData inputBuffer = { 0 };
+		inputBuffer.data = data + task->inputOffset;
+		inputBuffer.len = task->inputLength;
+		inputBuffer.maxlen = task->inputLength;
+
+		bytea *dictionary = NULL;
+		if (task->hasDictionary)
+		{
+			dictionary = (bytea *) (data + task->dictionaryOffset);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		bool compressed = CompressBuffer(&inputBuffer, outputBuffer,
+										 queue->compressionType,
+										 queue->compressionLevel, dictionary);
+		if (compressed)
+		{
+			if (outputBuffer->len > task->outputCapacity)
+			{
+				continue;
+			}
+
+			memcpy_s(data + task->outputOffset, task->outputCapacity,
+					 outputBuffer->data, outputBuffer->len);
+			task->outputLength = outputBuffer->len;
+		}
+
+		task->compressed = compressed;
+
+		/* make the results visible before marking the task as done */
+		pg_write_barrier();
+		task->done = true;
+	}
+
+	pfree(outputBuffer->data);
+	pfree(outputBuffer);
+}
+
+
+/*
+ * CompressJob compresses the input buffer of the given job in the current
+ * backend.
+ */
+static void
+CompressJob(CompressionJob *job, CompressionType compressionType,
+			int compressionLevel)
+{
+	job->outputBuffer = makeStringInfo();
+	job->compressed = CompressBuffer(job->inputBuffer, job->outputBuffer,
+									 compressionType, compressionLevel,
+									 job->dictionary);
+}
+
+
+/*
+ * CompressionJobSegmentSize returns the size that the given job takes up in
+ * the data chunk of a shared memory segment, counting its dictionary too.
+ */
+static Size
+CompressionJobSegmentSize(CompressionJob *job, CompressionType compressionType)
+{
+	StringInfo inputBuffer = job->inputBuffer;
+	Size jobSize = MAXALIGN(inputBuffer->len);
+
+	jobSize = add_size(jobSize, MAXALIGN(CompressedSizeBound(inputBuffer->len,
+															 compressionType)));
+
+	if (job->dictionary != NULL)
+	{
+		jobSize = add_size(jobSize, MAXALIGN(VARSIZE_ANY(job->dictionary)));
+	}
+
+	return jobSize;
+}
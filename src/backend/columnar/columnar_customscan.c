@@ -18,6 +18,7 @@
 
 #include "access/amapi.h"
 #include "access/skey.h"
+#include "access/sysattr.h"
 #include "catalog/pg_am.h"
 #include "catalog/pg_statistic.h"
 #include "commands/defrem.h"
@@ -32,6 +33,7 @@
 #include "optimizer/pathnode.h"
 #include "optimizer/paths.h"
 #include "optimizer/plancat.h"
+#include "optimizer/planmain.h"
 #include "optimizer/restrictinfo.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
@@ -43,6 +45,7 @@
 #include "columnar/columnar.h"
 #include "columnar/columnar_customscan.h"
 #include "columnar/columnar_metadata.h"
+#include "columnar/columnar_storage.h"
 #include "columnar/columnar_tableam.h"
 #include "distributed/listutils.h"
 
@@ -67,6 +70,8 @@ static void CostColumnarPaths(PlannerInfo *root, RelOptInfo *rel, Oid relationId
 static void CostColumnarIndexPath(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
 								  IndexPath *indexPath);
 static void CostColumnarSeqPath(RelOptInfo *rel, Oid relationId, Path *path);
+static double ColumnarParallelDivisor(Path *path);
+static List * CostColumnarPartialSeqPaths(RelOptInfo *rel, Oid relationId);
 static void CostColumnarScan(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
 							 CustomPath *cpath, int numberOfColumnsRead,
 							 int nClauses);
@@ -75,7 +80,8 @@ static void CostColumnarScan(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
 static void AddColumnarScanPaths(PlannerInfo *root, RelOptInfo *rel,
 								 RangeTblEntry *rte);
 static void AddColumnarScanPath(PlannerInfo *root, RelOptInfo *rel,
-								RangeTblEntry *rte, Relids required_relids);
+								RangeTblEntry *rte, Relids required_relids,
+								int parallelWorkers);
 
 /* helper functions to be used when costing paths or altering them */
 static void RemovePathsByPredicate(RelOptInfo *rel, PathPredicate removePathPredicate);
@@ -114,6 +120,19 @@ static void ColumnarScan_BeginCustomScan(CustomScanState *node, EState *estate,
 static TupleTableSlot * ColumnarScan_ExecCustomScan(CustomScanState *node);
 static void ColumnarScan_EndCustomScan(CustomScanState *node);
 static void ColumnarScan_ReScanCustomScan(CustomScanState *node);
+static Size ColumnarScan_EstimateDSMCustomScan(CustomScanState *node,
+												ParallelContext *pcxt);
+static void ColumnarScan_InitializeDSMCustomScan(CustomScanState *node,
+												 ParallelContext *pcxt,
+												 void *coordinate);
+static void ColumnarScan_ReInitializeDSMCustomScan(CustomScanState *node,
+												   ParallelContext *pcxt,
+												   void *coordinate);
+static void ColumnarScan_InitializeWorkerCustomScan(CustomScanState *node,
+													shm_toc *toc,
+													void *coordinate);
+static TableScanDesc ColumnarScanBeginScan(ColumnarScanState *columnarScanState,
+										   ParallelTableScanDesc parallelScan);
 static void ColumnarScan_ExplainCustomScan(CustomScanState *node, List *ancestors,
 										   ExplainState *es);
 
@@ -126,6 +145,7 @@ static List * set_deparse_context_planstate(List *dpcontext, Node *node,
 
 /* other helpers */
 static List * ColumnarVarNeeded(ColumnarScanState *columnarScanState);
+static bool ColumnarScanIsModifyTarget(ScanState *ss);
 static Bitmapset * ColumnarAttrNeeded(ScanState *ss);
 
 /* saved hook value in case of unload */
@@ -134,6 +154,8 @@ static get_relation_info_hook_type PreviousGetRelationInfoHook = NULL;
 
 static bool EnableColumnarCustomScan = true;
 static bool EnableColumnarQualPushdown = true;
+static bool EnableColumnarParallelScan = false;
+static bool EnableColumnarParallelIndexBuild = false;
 static double ColumnarQualPushdownCorrelationThreshold = 0.9;
 static int ColumnarMaxCustomScanPaths = 64;
 static int ColumnarPlannerDebugLevel = DEBUG3;
@@ -158,6 +180,11 @@ const struct CustomExecMethods ColumnarScanExecuteMethods = {
 	.EndCustomScan = ColumnarScan_EndCustomScan,
 	.ReScanCustomScan = ColumnarScan_ReScanCustomScan,
 
+	.EstimateDSMCustomScan = ColumnarScan_EstimateDSMCustomScan,
+	.InitializeDSMCustomScan = ColumnarScan_InitializeDSMCustomScan,
+	.ReInitializeDSMCustomScan = ColumnarScan_ReInitializeDSMCustomScan,
+	.InitializeWorkerCustomScan = ColumnarScan_InitializeWorkerCustomScan,
+
 	.ExplainCustomScan = ColumnarScan_ExplainCustomScan,
 };
 
@@ -210,6 +237,26 @@ columnar_customscan_init()
 		PGC_USERSET,
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
+	DefineCustomBoolVariable(
+		"columnar.enable_parallel_index_build",
+		gettext_noop("Enables parallel index builds on columnar tables, in which "
+					 "the parallel maintenance workers read different stripes."),
+		NULL,
+		&EnableColumnarParallelIndexBuild,
+		false,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+	DefineCustomBoolVariable(
+		"columnar.enable_parallel_scan",
+		gettext_noop("Enables parallel scans of columnar tables, in which the "
+					 "parallel workers read different stripes."),
+		NULL,
+		&EnableColumnarParallelScan,
+		false,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
 	DefineCustomRealVariable(
 		"columnar.qual_pushdown_correlation_threshold",
 		gettext_noop("Correlation threshold to attempt to push a qual "
@@ -288,7 +335,7 @@ ColumnarSetRelPathlistHook(PlannerInfo *root, RelOptInfo *rel, Index rti,
 							errmsg("sample scans not supported on columnar tables")));
 		}
 
-		if (list_length(rel->partial_pathlist) != 0)
+		if (list_length(rel->partial_pathlist) != 0 && !EnableColumnarParallelScan)
 		{
 			/*
 			 * Parallel scans on columnar tables are already discardad by
@@ -297,6 +344,9 @@ ColumnarSetRelPathlistHook(PlannerInfo *root, RelOptInfo *rel, Index rti,
 			elog(ERROR, "parallel scans on columnar are not supported");
 		}
 
+		/* only keep the partial seq scans, costed for columnar */
+		rel->partial_pathlist = CostColumnarPartialSeqPaths(rel, rte->relid);
+
 		/*
 		 * There are cases where IndexPath is normally more preferrable over
 		 * SeqPath for heapAM but not for columnarAM. In such cases, an
@@ -331,6 +381,7 @@ ColumnarSetRelPathlistHook(PlannerInfo *root, RelOptInfo *rel, Index rti,
 			 * SeqPath thinking that its cost would be equal to ColumnarCustomScan.
 			 */
 			RemovePathsByPredicate(rel, IsNotIndexPath);
+			rel->partial_pathlist = NIL;
 			AddColumnarScanPaths(root, rel, rte);
 		}
 	}
@@ -349,8 +400,17 @@ ColumnarGetRelationInfoHook(PlannerInfo *root, Oid relationObjectId,
 
 	if (IsColumnarTableAmTable(relationObjectId))
 	{
-		/* disable parallel query */
-		rel->rel_parallel_workers = 0;
+		/*
+		 * Disable parallel query, unless parallel scans are enabled. Parallel
+		 * index builds have their own setting, plan_create_index_workers()
+		 * plans them for a dummy query without a join tree.
+		 */
+		bool planningIndexBuild = root->parse->jointree == NULL;
+		if (planningIndexBuild ? !EnableColumnarParallelIndexBuild
+			: !EnableColumnarParallelScan)
+		{
+			rel->rel_parallel_workers = 0;
+		}
 
 		/* disable index-only scan */
 		IndexOptInfo *indexOptInfo = NULL;
@@ -570,6 +630,54 @@ ColumnarIndexScanAdditionalCost(PlannerInfo *root, RelOptInfo *rel,
 }
 
 
+/*
+ * CostColumnarPartialSeqPaths re-costs the partial seq scan paths of the
+ * given RelOptInfo for columnar table with relationId and returns them; the
+ * other partial paths, i.e. parallel index scans, are not supported on
+ * columnar.
+ */
+static List *
+CostColumnarPartialSeqPaths(RelOptInfo *rel, Oid relationId)
+{
+	List *partialSeqPathList = NIL;
+
+	Path *path = NULL;
+	foreach_ptr(path, rel->partial_pathlist)
+	{
+		if (path->pathtype == T_SeqScan)
+		{
+			CostColumnarSeqPath(rel, relationId, path);
+			partialSeqPathList = lappend(partialSeqPathList, path);
+		}
+	}
+
+	return partialSeqPathList;
+}
+
+
+/*
+ * ColumnarParallelDivisor returns the share of the rows of a partial path
+ * that each participant processes, like get_parallel_divisor() does for the
+ * paths of postgres.
+ */
+static double
+ColumnarParallelDivisor(Path *path)
+{
+	double parallelDivisor = path->parallel_workers;
+
+	if (parallel_leader_participation)
+	{
+		double leaderContribution = 1.0 - (0.3 * path->parallel_workers);
+		if (leaderContribution > 0)
+		{
+			parallelDivisor += leaderContribution;
+		}
+	}
+
+	return parallelDivisor;
+}
+
+
 /*
  * CostColumnarSeqPath sets costs given seq path for columnar table with
  * relationId.
@@ -593,6 +701,12 @@ CostColumnarSeqPath(RelOptInfo *rel, Oid relationId, Path *path)
 	path->startup_cost = 0;
 	path->total_cost = stripesToRead *
 					   ColumnarPerStripeScanCost(rel, relationId, numberOfColumnsRead);
+
+	/* the stripes are divided over the participants of a parallel scan */
+	if (path->parallel_workers > 0)
+	{
+		path->total_cost /= ColumnarParallelDivisor(path);
+	}
 }
 
 
@@ -1144,6 +1258,18 @@ AddColumnarScanPaths(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
 
 	AddColumnarScanPathsRec(root, rel, rte, paramRelids, candidateRelids,
 							depthLimit);
+
+	/* parallel scans can only hand out the stripes of unparameterized scans */
+	if (EnableColumnarParallelScan && rel->consider_parallel &&
+		bms_is_empty(rel->lateral_relids))
+	{
+		int parallelWorkers = compute_parallel_worker(rel, rel->pages, -1,
+													  max_parallel_workers_per_gather);
+		if (parallelWorkers > 0)
+		{
+			AddColumnarScanPath(root, rel, rte, NULL, parallelWorkers);
+		}
+	}
 }
 
 
@@ -1186,7 +1312,7 @@ AddColumnarScanPathsRec(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte,
 	check_stack_depth();
 
 	Assert(!bms_overlap(paramRelids, candidateRelids));
-	AddColumnarScanPath(root, rel, rte, paramRelids);
+	AddColumnarScanPath(root, rel, rte, paramRelids, 0);
 
 	/* recurse for all candidateRelids, unless we hit the depth limit */
 	Assert(depthLimit >= 0);
@@ -1292,7 +1418,7 @@ ContainsExecParams(Node *node, void *notUsed)
  */
 static void
 AddColumnarScanPath(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte,
-					Relids paramRelids)
+					Relids paramRelids, int parallelWorkers)
 {
 	/*
 	 * Must return a CustomPath, not a larger structure containing a
@@ -1317,8 +1443,13 @@ AddColumnarScanPath(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte,
 	path->parent = rel;
 	path->pathtarget = rel->reltarget;
 
-	/* columnar scans are not parallel-aware, but they are parallel-safe */
+	/*
+	 * Columnar scans are parallel-safe, and parallel-aware if parallelWorkers
+	 * is given, in which case the path is a partial path.
+	 */
 	path->parallel_safe = rel->consider_parallel;
+	path->parallel_aware = (parallelWorkers > 0);
+	path->parallel_workers = parallelWorkers;
 
 	path->param_info = get_baserel_parampathinfo(root, rel, paramRelids);
 
@@ -1381,13 +1512,21 @@ AddColumnarScanPath(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte,
 	StringInfoData buf;
 	initStringInfo(&buf);
 	ereport(ColumnarPlannerDebugLevel,
-			(errmsg("columnar planner: adding CustomScan path for %s",
+			(errmsg("columnar planner: adding %sCustomScan path for %s",
+					path->parallel_aware ? "parallel " : "",
 					rte->eref->aliasname),
 			 errdetail("%s; %d clauses pushed down",
 					   ParameterizationAsString(root, paramRelids, &buf),
 					   numberOfClausesPushed)));
 
-	add_path(rel, path);
+	if (path->parallel_aware)
+	{
+		add_partial_path(rel, path);
+	}
+	else
+	{
+		add_path(rel, path);
+	}
 }
 
 
@@ -1418,6 +1557,15 @@ CostColumnarScan(PlannerInfo *root, RelOptInfo *rel, Oid relationId,
 	path->startup_cost = 0;
 	path->total_cost = stripesToRead *
 					   ColumnarPerStripeScanCost(rel, relationId, numberOfColumnsRead);
+
+	/* the stripes are divided over the participants of a parallel scan */
+	if (path->parallel_workers > 0)
+	{
+		double parallelDivisor = ColumnarParallelDivisor(path);
+
+		path->rows = clamp_row_est(path->rows / parallelDivisor);
+		path->total_cost /= parallelDivisor;
+	}
 }
 
 
@@ -1435,18 +1583,26 @@ ColumnarPerStripeScanCost(RelOptInfo *rel, Oid relationId, int numberOfColumnsRe
 		ereport(ERROR, (errmsg("could not open relation with OID %u", relationId)));
 	}
 
-	List *stripeList = StripesForRelfilenode(relation->rd_node);
-	RelationClose(relation);
-
-	uint32 maxColumnCount = 0;
-	uint64 totalStripeSize = 0;
-	StripeMetadata *stripeMetadata = NULL;
-	foreach_ptr(stripeMetadata, stripeList)
+	ColumnarStorageTotals totals = { 0 };
+	if (!ColumnarStorageGetTotals(relation, &totals))
 	{
-		totalStripeSize += stripeMetadata->dataLength;
-		maxColumnCount = Max(maxColumnCount, stripeMetadata->columnCount);
+		List *stripeList = StripesForRelfilenode(relation->rd_node);
+
+		StripeMetadata *stripeMetadata = NULL;
+		foreach_ptr(stripeMetadata, stripeList)
+		{
+			totals.stripeCount++;
+			totals.dataLength += stripeMetadata->dataLength;
+			totals.maxColumnCount = Max(totals.maxColumnCount,
+										stripeMetadata->columnCount);
+		}
 	}
 
+	RelationClose(relation);
+
+	uint32 maxColumnCount = totals.maxColumnCount;
+	uint64 totalStripeSize = totals.dataLength;
+
 	/*
 	 * When no stripes are in the table we don't have a count in maxColumnCount. To
 	 * prevent a division by zero turning into a NaN we keep the ratio on zero.
@@ -1460,7 +1616,7 @@ ColumnarPerStripeScanCost(RelOptInfo *rel, Oid relationId, int numberOfColumnsRe
 
 	double columnSelectionRatio = numberOfColumnsRead / (double) maxColumnCount;
 	Cost tableScanCost = (double) totalStripeSize / BLCKSZ * columnSelectionRatio;
-	Cost perStripeScanCost = tableScanCost / list_length(stripeList);
+	Cost perStripeScanCost = tableScanCost / Max(totals.stripeCount, 1);
 
 	/*
 	 * Finally, multiply the cost of reading a single stripe by seq page read
@@ -1481,7 +1637,8 @@ ColumnarPerStripeScanCost(RelOptInfo *rel, Oid relationId, int numberOfColumnsRe
 
 /*
  * ColumnarTableStripeCount returns the number of stripes that columnar
- * table with relationId has by using stripe metadata.
+ * table with relationId has by using the totals in its metapage, or the
+ * stripe metadata if the metapage has no totals.
  */
 static uint64
 ColumnarTableStripeCount(Oid relationId)
@@ -1492,8 +1649,17 @@ ColumnarTableStripeCount(Oid relationId)
 		ereport(ERROR, (errmsg("could not open relation with OID %u", relationId)));
 	}
 
-	List *stripeList = StripesForRelfilenode(relation->rd_node);
-	int stripeCount = list_length(stripeList);
+	ColumnarStorageTotals totals = { 0 };
+	uint64 stripeCount = 0;
+	if (ColumnarStorageGetTotals(relation, &totals))
+	{
+		stripeCount = totals.stripeCount;
+	}
+	else
+	{
+		List *stripeList = StripesForRelfilenode(relation->rd_node);
+		stripeCount = list_length(stripeList);
+	}
 	RelationClose(relation);
 
 	return stripeCount;
@@ -1697,6 +1863,26 @@ ColumnarScan_BeginCustomScan(CustomScanState *cscanstate, EState *estate, int ef
 }
 
 
+/*
+ * ColumnarScanIsModifyTarget returns true if the given scan reads the rows of
+ * the result relation of an UPDATE or DELETE, which needs their ctid.
+ */
+static bool
+ColumnarScanIsModifyTarget(ScanState *ss)
+{
+	PlannedStmt *plannedStmt = ss->ps.state->es_plannedstmt;
+	if (plannedStmt == NULL ||
+		(plannedStmt->commandType != CMD_UPDATE &&
+		 plannedStmt->commandType != CMD_DELETE))
+	{
+		return false;
+	}
+
+	Index scanrelid = ((Scan *) ss->ps.plan)->scanrelid;
+	return list_member_int(plannedStmt->resultRelations, scanrelid);
+}
+
+
 /*
  * ColumnarAttrNeeded returns a list of AttrNumber's for the ones that are
  * needed during columnar custom scan.
@@ -1720,6 +1906,13 @@ ColumnarAttrNeeded(ScanState *ss)
 	{
 		Var *var = lfirst(lc);
 
+		if (var->varattno == SelfItemPointerAttributeNumber &&
+			ColumnarScanIsModifyTarget(ss))
+		{
+			/* the scan slot always has the tid of the row */
+			continue;
+		}
+
 		if (var->varattno < 0)
 		{
 			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
@@ -1759,20 +1952,11 @@ ColumnarScanNext(ColumnarScanState *columnarScanState)
 
 	if (scandesc == NULL)
 	{
-		/* the columnar access method does not use the flags, they are specific to heap */
-		uint32 flags = 0;
-		Bitmapset *attr_needed = ColumnarAttrNeeded(&node->ss);
-
 		/*
 		 * We reach here if the scan is not parallel, or if we're serially
 		 * executing a scan that was planned to be parallel.
 		 */
-		scandesc = columnar_beginscan_extended(node->ss.ss_currentRelation,
-											   estate->es_snapshot,
-											   0, NULL, NULL, flags, attr_needed,
-											   columnarScanState->qual);
-		bms_free(attr_needed);
-
+		scandesc = ColumnarScanBeginScan(columnarScanState, NULL);
 		node->ss.ss_currentScanDesc = scandesc;
 	}
 
@@ -1787,6 +1971,93 @@ ColumnarScanNext(ColumnarScanState *columnarScanState)
 }
 
 
+/*
+ * ColumnarScanBeginScan begins the scan of the columnar table with the
+ * projection and quals of the custom scan, as a part of the given parallel
+ * scan if it is not NULL.
+ */
+static TableScanDesc
+ColumnarScanBeginScan(ColumnarScanState *columnarScanState,
+					  ParallelTableScanDesc parallelScan)
+{
+	CustomScanState *node = (CustomScanState *) columnarScanState;
+	EState *estate = node->ss.ps.state;
+
+	/* the columnar access method does not use the flags, they are specific to heap */
+	uint32 flags = 0;
+	Bitmapset *attr_needed = ColumnarAttrNeeded(&node->ss);
+
+	TableScanDesc scandesc = columnar_beginscan_extended(node->ss.ss_currentRelation,
+														 estate->es_snapshot,
+														 0, NULL, parallelScan, flags,
+														 attr_needed,
+														 columnarScanState->qual);
+	bms_free(attr_needed);
+
+	return scandesc;
+}
+
+
+/*
+ * ColumnarScan_EstimateDSMCustomScan returns the size of the shared state of
+ * a parallel columnar scan.
+ */
+static Size
+ColumnarScan_EstimateDSMCustomScan(CustomScanState *node, ParallelContext *pcxt)
+{
+	EState *estate = node->ss.ps.state;
+
+	return table_parallelscan_estimate(node->ss.ss_currentRelation,
+									   estate->es_snapshot);
+}
+
+
+/*
+ * ColumnarScan_InitializeDSMCustomScan initializes the shared state of a
+ * parallel columnar scan and begins the part of the scan in the leader.
+ */
+static void
+ColumnarScan_InitializeDSMCustomScan(CustomScanState *node, ParallelContext *pcxt,
+									 void *coordinate)
+{
+	EState *estate = node->ss.ps.state;
+	ParallelTableScanDesc parallelScan = (ParallelTableScanDesc) coordinate;
+
+	table_parallelscan_initialize(node->ss.ss_currentRelation, parallelScan,
+								  estate->es_snapshot);
+
+	node->ss.ss_currentScanDesc =
+		ColumnarScanBeginScan((ColumnarScanState *) node, parallelScan);
+}
+
+
+/*
+ * ColumnarScan_ReInitializeDSMCustomScan resets the shared state of a
+ * parallel columnar scan for a rescan.
+ */
+static void
+ColumnarScan_ReInitializeDSMCustomScan(CustomScanState *node, ParallelContext *pcxt,
+									   void *coordinate)
+{
+	table_parallelscan_reinitialize(node->ss.ss_currentRelation,
+									(ParallelTableScanDesc) coordinate);
+}
+
+
+/*
+ * ColumnarScan_InitializeWorkerCustomScan begins the part of a parallel
+ * columnar scan in a parallel worker.
+ */
+static void
+ColumnarScan_InitializeWorkerCustomScan(CustomScanState *node, shm_toc *toc,
+										void *coordinate)
+{
+	node->ss.ss_currentScanDesc =
+		ColumnarScanBeginScan((ColumnarScanState *) node,
+							  (ParallelTableScanDesc) coordinate);
+}
+
+
 /*
  * SeqRecheck -- access method routine to recheck a tuple in EvalPlanQual
  */
@@ -1892,6 +2163,13 @@ ColumnarScan_ExplainCustomScan(CustomScanState *node, List *ancestors,
 			ExplainPropertyInteger(
 				"Columnar Chunk Groups Removed by Filter",
 				NULL, ColumnarScanChunkGroupsFiltered(columnarScanDesc), es);
+
+			if (columnar_enable_vectorized_filter)
+			{
+				ExplainPropertyInteger(
+					"Columnar Rows Removed by Vectorized Filter",
+					NULL, ColumnarScanRowsFiltered(columnarScanDesc), es);
+			}
 		}
 	}
 }
@@ -0,0 +1,883 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_encoding.c
+ *
+ * This file contains the lightweight encodings of the values of column
+ * chunks. The writer picks the encoding that gives the smallest value buffer
+ * for every chunk, before the buffer is compressed:
+ *
+ * - dictionary encoding stores the distinct values of a varlena chunk once,
+ *   and a one byte index into them for every value,
+ * - run length encoding stores the value of every run of equal values once,
+ * - frame of reference encoding bit-packs the values of a by-value integer
+ *   chunk as their difference from the smallest value,
+ * - delta encoding bit-packs the differences between consecutive values,
+ *   which suits increasing values such as sequences and timestamps.
+ *
+ * The values of dictionary and run length encoded chunks are decoded to
+ * datums that point into the encoded buffer, so they are not copied.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "access/tupmacs.h"
+#include "common/hashfn.h"
+#include "lib/stringinfo.h"
+#include "port/pg_bitutils.h"
+
+#include "columnar/columnar_encoding.h"
+
+/* maximum number of distinct values in a dictionary encoded chunk */
+#define DICTIONARY_MAX_ENTRY_COUNT 256
+
+/* number of slots in the hash table used for finding the distinct values */
+#define DICTIONARY_HASH_SLOT_COUNT (2 * DICTIONARY_MAX_ENTRY_COUNT)
+
+/* size of the count that dictionary and run length encoded buffers start with */
+#define ENCODING_COUNT_HEADER_SIZE MAXALIGN(sizeof(uint32))
+
+
+/*
+ * IntegerPackingHeader is the start of frame of reference and delta encoded
+ * buffers, which is followed by the bit-packed differences from base.
+ * firstValue is only used by delta encoding, in which the differences are
+ * between consecutive values.
+ */
+typedef struct IntegerPackingHeader
+{
+	int64 firstValue;
+	int64 base;
+	uint32 bitWidth;
+} IntegerPackingHeader;
+
+
+static uint32 * SerializedValueOffsets(StringInfo valueBuffer, uint32 valueCount,
+									   Form_pg_attribute attributeForm);
+static bool SerializedValuesEqual(StringInfo valueBuffer, uint32 *valueOffsets,
+								  uint32 leftValueIndex, uint32 rightValueIndex);
+static uint64 RunLengthEncodedSize(StringInfo valueBuffer, uint32 *valueOffsets,
+								   uint32 valueCount);
+static bool BuildDictionary(StringInfo valueBuffer, uint32 *valueOffsets,
+							uint32 valueCount, uint32 *entryValueIndexes,
+							uint8 *valueEntryIndexes, uint32 *entryCount);
+static uint64 IntegerPackedSize(uint32 valueCount, uint32 bitWidth);
+static uint32 BitWidth(uint64 valueRange);
+static void WriteRunLengthEncoding(StringInfo valueBuffer, uint32 *valueOffsets,
+								   uint32 valueCount, StringInfo outputBuffer);
+static void WriteDictionaryEncoding(StringInfo valueBuffer, uint32 *valueOffsets,
+									uint32 valueCount, uint32 *entryValueIndexes,
+									uint8 *valueEntryIndexes, uint32 entryCount,
+									StringInfo outputBuffer);
+static void WriteIntegerPacking(int64 firstValue, int64 *valueArray,
+								uint32 valueCount, int64 base, uint32 bitWidth,
+								StringInfo outputBuffer);
+static void PackBits(uint8 *output, uint64 bitOffset, uint64 value, uint32 bitWidth);
+static uint64 UnpackBits(const uint8 *input, uint64 bitOffset, uint32 bitWidth);
+static int64 IntegerDatumValue(Datum datum, int typeLength);
+static Datum IntegerValueDatum(int64 value, int typeLength);
+static void DecodeDictionary(StringInfo encodedBuffer, bool *existsArray,
+							 uint32 rowCount, Form_pg_attribute attributeForm,
+							 Datum *datumArray, ColumnChunkDictionary **dictionary);
+static void DecodeRunLength(StringInfo encodedBuffer, bool *existsArray,
+							uint32 rowCount, Form_pg_attribute attributeForm,
+							Datum *datumArray);
+static void DecodeIntegerPacking(StringInfo encodedBuffer, bool isDelta,
+								 bool *existsArray, uint32 rowCount,
+								 Form_pg_attribute attributeForm, Datum *datumArray);
+
+
+/*
+ * EncodeValueBuffer picks the encoding that stores the serialized values in
+ * inputBuffer in the least bytes, and writes them in that encoding to
+ * outputBuffer. The function returns ENCODING_NONE if none of the encodings
+ * are smaller than inputBuffer, in which case outputBuffer is not valid.
+ */
+ColumnEncodingType
+EncodeValueBuffer(StringInfo inputBuffer, StringInfo outputBuffer, bool *existsArray,
+				  uint32 rowCount, Form_pg_attribute attributeForm)
+{
+	uint32 valueCount = 0;
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		if (existsArray[rowIndex])
+		{
+			valueCount++;
+		}
+	}
+
+	/* there is nothing to gain with fewer than two values */
+	if (valueCount < 2)
+	{
+		return ENCODING_NONE;
+	}
+
+	ColumnEncodingType encodingType = ENCODING_NONE;
+	uint64 encodedSize = inputBuffer->len;
+
+	uint32 *valueOffsets = SerializedValueOffsets(inputBuffer, valueCount,
+												  attributeForm);
+
+	uint64 runLengthSize = RunLengthEncodedSize(inputBuffer, valueOffsets, valueCount);
+	if (runLengthSize < encodedSize)
+	{
+		encodingType = ENCODING_RUN_LENGTH;
+		encodedSize = runLengthSize;
+	}
+
+	/* dictionaries are only used for varlena values */
+	uint32 *entryValueIndexes = NULL;
+	uint8 *valueEntryIndexes = NULL;
+	uint32 entryCount = 0;
+
+	if (attributeForm->attlen == -1)
+	{
+		entryValueIndexes = palloc(DICTIONARY_MAX_ENTRY_COUNT * sizeof(uint32));
+		valueEntryIndexes = palloc(valueCount * sizeof(uint8));
+
+		if (BuildDictionary(inputBuffer, valueOffsets, valueCount, entryValueIndexes,
+							valueEntryIndexes, &entryCount))
+		{
+			uint64 dictionarySize = ENCODING_COUNT_HEADER_SIZE + valueCount;
+			for (uint32 entryIndex = 0; entryIndex < entryCount; entryIndex++)
+			{
+				uint32 valueIndex = entryValueIndexes[entryIndex];
+				dictionarySize += valueOffsets[valueIndex + 1] - valueOffsets[valueIndex];
+			}
+
+			if (dictionarySize < encodedSize)
+			{
+				encodingType = ENCODING_DICTIONARY;
+				encodedSize = dictionarySize;
+			}
+		}
+	}
+
+	/* bit-packing is used for by-value integers, e.g. int, date and timestamp */
+	int64 *valueArray = NULL;
+	int64 *deltaArray = NULL;
+	int64 minimumValue = 0;
+	int64 minimumDelta = 0;
+	uint32 valueBitWidth = 0;
+	uint32 deltaBitWidth = 0;
+
+	if (attributeForm->attbyval &&
+		(attributeForm->attlen == 2 || attributeForm->attlen == 4 ||
+		 attributeForm->attlen == 8))
+	{
+		int64 maximumValue = 0;
+		int64 maximumDelta = 0;
+
+		valueArray = palloc(valueCount * sizeof(int64));
+		deltaArray = palloc(valueCount * sizeof(int64));
+
+		for (uint32 valueIndex = 0; valueIndex < valueCount; valueIndex++)
+		{
+			Datum datum = fetch_att(inputBuffer->data + valueOffsets[valueIndex], true,
+									attributeForm->attlen);
+			int64 value = IntegerDatumValue(datum, attributeForm->attlen);
+
+			valueArray[valueIndex] = value;
+
+			if (valueIndex == 0)
+			{
+				minimumValue = value;
+				maximumValue = value;
+				continue;
+			}
+
+			minimumValue = Min(minimumValue, value);
+			maximumValue = Max(maximumValue, value);
+
+			/* differences wrap around, and so does decoding them */
+			int64 delta = (int64) ((uint64) value - (uint64) valueArray[valueIndex - 1]);
+			deltaArray[valueIndex - 1] = delta;
+
+			if (valueIndex == 1)
+			{
+				minimumDelta = delta;
+				maximumDelta = delta;
+			}
+			else
+			{
+				minimumDelta = Min(minimumDelta, delta);
+				maximumDelta = Max(maximumDelta, delta);
+			}
+		}
+
+		valueBitWidth = BitWidth((uint64) maximumValue - (uint64) minimumValue);
+		deltaBitWidth = BitWidth((uint64) maximumDelta - (uint64) minimumDelta);
+
+		uint64 frameOfReferenceSize = IntegerPackedSize(valueCount, valueBitWidth);
+		if (frameOfReferenceSize < encodedSize)
+		{
+			encodingType = ENCODING_FRAME_OF_REFERENCE;
+			encodedSize = frameOfReferenceSize;
+		}
+
+		uint64 deltaSize = IntegerPackedSize(valueCount - 1, deltaBitWidth);
+		if (deltaSize < encodedSize)
+		{
+			encodingType = ENCODING_DELTA;
+			encodedSize = deltaSize;
+		}
+	}
+
+	resetStringInfo(outputBuffer);
+	enlargeStringInfo(outputBuffer, encodedSize);
+	memset(outputBuffer->data, 0, encodedSize);
+	outputBuffer->len = encodedSize;
+
+	switch (encodingType)
+	{
+		case ENCODING_RUN_LENGTH:
+		{
+			WriteRunLengthEncoding(inputBuffer, valueOffsets, valueCount, outputBuffer);
+			break;
+		}
+
+		case ENCODING_DICTIONARY:
+		{
+			WriteDictionaryEncoding(inputBuffer, valueOffsets, valueCount,
+									entryValueIndexes, valueEntryIndexes, entryCount,
+									outputBuffer);
+			break;
+		}
+
+		case ENCODING_FRAME_OF_REFERENCE:
+		{
+			WriteIntegerPacking(0, valueArray, valueCount, minimumValue, valueBitWidth,
+								outputBuffer);
+			break;
+		}
+
+		case ENCODING_DELTA:
+		{
+			WriteIntegerPacking(valueArray[0], deltaArray, valueCount - 1, minimumDelta,
+								deltaBitWidth, outputBuffer);
+			break;
+		}
+
+		default:
+		{
+			break;
+		}
+	}
+
+	Assert(encodingType == ENCODING_NONE || outputBuffer->len == encodedSize);
+
+	pfree(valueOffsets);
+
+	if (entryValueIndexes != NULL)
+	{
+		pfree(entryValueIndexes);
+		pfree(valueEntryIndexes);
+	}
+
+	if (valueArray != NULL)
+	{
+		pfree(valueArray);
+		pfree(deltaArray);
+	}
+
+	return encodingType;
+}
+
+
+/*
+ * DecodeValueBuffer reads the values of the rows for which existsArray is
+ * true from the encoded buffer and stores them in datumArray. For dictionary
+ * encoded buffers, the dictionary is also returned in the dictionary
+ * argument, which is set to NULL for the other encodings.
+ */
+void
+DecodeValueBuffer(StringInfo encodedBuffer, ColumnEncodingType encodingType,
+				  bool *existsArray, uint32 rowCount, Form_pg_attribute attributeForm,
+				  Datum *datumArray, ColumnChunkDictionary **dictionary)
+{
+	*dictionary = NULL;
+
+	switch (encodingType)
+	{
+		case ENCODING_DICTIONARY:
+		{
+			DecodeDictionary(encodedBuffer, existsArray, rowCount, attributeForm,
+							 datumArray, dictionary);
+			break;
+		}
+
+		case ENCODING_RUN_LENGTH:
+		{
+			DecodeRunLength(encodedBuffer, existsArray, rowCount, attributeForm,
+							datumArray);
+			break;
+		}
+
+		case ENCODING_FRAME_OF_REFERENCE:
+		case ENCODING_DELTA:
+		{
+			DecodeIntegerPacking(encodedBuffer, encodingType == ENCODING_DELTA,
+								 existsArray, rowCount, attributeForm, datumArray);
+			break;
+		}
+
+		default:
+		{
+			ereport(ERROR, (errmsg("unknown columnar value encoding: %d",
+								   encodingType)));
+		}
+	}
+}
+
+
+/*
+ * SerializedValueOffsets returns the offsets of the serialized values in the
+ * given buffer, and the end of the last value as the last element.
+ */
+static uint32 *
+SerializedValueOffsets(StringInfo valueBuffer, uint32 valueCount,
+					   Form_pg_attribute attributeForm)
+{
+	uint32 *valueOffsets = palloc((valueCount + 1) * sizeof(uint32));
+	uint32 currentOffset = 0;
+
+	for (uint32 valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		char *currentPointer = valueBuffer->data + currentOffset;
+
+		valueOffsets[valueIndex] = currentOffset;
+		currentOffset = att_addlength_pointer(currentOffset, attributeForm->attlen,
+											  currentPointer);
+		currentOffset = att_align_nominal(currentOffset, attributeForm->attalign);
+	}
+
+	valueOffsets[valueCount] = currentOffset;
+
+	Assert(currentOffset == valueBuffer->len);
+
+	return valueOffsets;
+}
+
+
+/*
+ * SerializedValuesEqual returns whether the serialized values with the given
+ * indexes are the same. The padding of serialized values is zeroed, so they
+ * can be compared including the padding.
+ */
+static bool
+SerializedValuesEqual(StringInfo valueBuffer, uint32 *valueOffsets,
+					  uint32 leftValueIndex, uint32 rightValueIndex)
+{
+	uint32 leftLength = valueOffsets[leftValueIndex + 1] - valueOffsets[leftValueIndex];
+	uint32 rightLength = valueOffsets[rightValueIndex + 1] -
+						 valueOffsets[rightValueIndex];
+
+	return leftLength == rightLength &&
+		   memcmp(valueBuffer->data + valueOffsets[leftValueIndex],
+				  valueBuffer->data + valueOffsets[rightValueIndex],
+				  leftLength) == 0;
+}
+
+
+/*
+ * RunLengthEncodedSize returns the size of the run length encoding of the
+ * given serialized values.
+ */
+static uint64
+RunLengthEncodedSize(StringInfo valueBuffer, uint32 *valueOffsets, uint32 valueCount)
+{
+	uint64 runCount = 1;
+	uint64 runValueSize = valueOffsets[1] - valueOffsets[0];
+
+	for (uint32 valueIndex = 1; valueIndex < valueCount; valueIndex++)
+	{
+		if (!SerializedValuesEqual(valueBuffer, valueOffsets, valueIndex - 1,
+								   valueIndex))
+		{
+			runCount++;
+			runValueSize += valueOffsets[valueIndex + 1] - valueOffsets[valueIndex];
+		}
+	}
+
+	return ENCODING_COUNT_HEADER_SIZE + MAXALIGN(runCount * sizeof(uint32)) +
+		   runValueSize;
+}
+
+
+/*
+ * BuildDictionary finds the distinct values among the given serialized
+ * values. For every distinct value, entryValueIndexes is set to the index of
+ * its first occurrence, and for every value, valueEntryIndexes is set to the
+ * index of its distinct value. The function returns false if there are more
+ * than DICTIONARY_MAX_ENTRY_COUNT distinct values.
+ */
+static bool
+BuildDictionary(StringInfo valueBuffer, uint32 *valueOffsets, uint32 valueCount,
+				uint32 *entryValueIndexes, uint8 *valueEntryIndexes,
+				uint32 *entryCount)
+{
+	int16 hashSlots[DICTIONARY_HASH_SLOT_COUNT];
+
+	memset(hashSlots, -1, sizeof(hashSlots));
+	*entryCount = 0;
+
+	for (uint32 valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		uint32 valueLength = valueOffsets[valueIndex + 1] - valueOffsets[valueIndex];
+		uint32 hash = hash_bytes((const unsigned char *) valueBuffer->data +
+								 valueOffsets[valueIndex], valueLength);
+		uint32 slotIndex = hash % DICTIONARY_HASH_SLOT_COUNT;
+
+		/* the table is never full, as it has twice the slots of entries */
+		while (hashSlots[slotIndex] >= 0)
+		{
+			int16 entryIndex = hashSlots[slotIndex];
+			if (SerializedValuesEqual(valueBuffer, valueOffsets,
+									  entryValueIndexes[entryIndex], valueIndex))
+			{
+				break;
+			}
+
+			slotIndex = (slotIndex + 1) % DICTIONARY_HASH_SLOT_COUNT;
+		}
+
+		if (hashSlots[slotIndex] < 0)
+		{
+			if (*entryCount == DICTIONARY_MAX_ENTRY_COUNT)
+			{
+				return false;
+			}
+
+			hashSlots[slotIndex] = *entryCount;
+			entryValueIndexes[*entryCount] = valueIndex;
+			(*entryCount)++;
+		}
+
+		valueEntryIndexes[valueIndex] = hashSlots[slotIndex];
+	}
+
+	return true;
+}
+
+
+/*
+ * IntegerPackedSize returns the size of a frame of reference or delta encoded
+ * buffer that holds the given number of bit-packed values.
+ */
+static uint64
+IntegerPackedSize(uint32 valueCount, uint32 bitWidth)
+{
+	return sizeof(IntegerPackingHeader) + ((uint64) valueCount * bitWidth + 7) / 8;
+}
+
+
+/*
+ * BitWidth returns the number of bits needed for storing the values from 0
+ * to valueRange.
+ */
+static uint32
+BitWidth(uint64 valueRange)
+{
+	if (valueRange == 0)
+	{
+		return 0;
+	}
+
+	return pg_leftmost_one_pos64(valueRange) + 1;
+}
+
+
+/*
+ * WriteRunLengthEncoding writes the number of runs of equal values, the
+ * length of every run and then the serialized value of every run to the
+ * output buffer. The values stay aligned, since the header sizes are.
+ */
+static void
+WriteRunLengthEncoding(StringInfo valueBuffer, uint32 *valueOffsets,
+					   uint32 valueCount, StringInfo outputBuffer)
+{
+	uint32 *runLengths = (uint32 *) (outputBuffer->data + ENCODING_COUNT_HEADER_SIZE);
+	uint32 runCount = 0;
+
+	for (uint32 valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		if (valueIndex > 0 &&
+			SerializedValuesEqual(valueBuffer, valueOffsets, valueIndex - 1,
+								  valueIndex))
+		{
+			runLengths[runCount - 1]++;
+		}
+		else
+		{
+			runLengths[runCount++] = 1;
+		}
+	}
+
+	*((uint32 *) outputBuffer->data) = runCount;
+
+	uint32 currentOffset = ENCODING_COUNT_HEADER_SIZE +
+						   MAXALIGN(runCount * sizeof(uint32));
+	uint32 valueIndex = 0;
+
+	for (uint32 runIndex = 0; runIndex < runCount; runIndex++)
+	{
+		uint32 valueLength = valueOffsets[valueIndex + 1] - valueOffsets[valueIndex];
+
+		memcpy(outputBuffer->data + currentOffset, /* IGNORE-BANNED */
+			   valueBuffer->data + valueOffsets[valueIndex], valueLength);
+		currentOffset += valueLength;
+		valueIndex += runLengths[runIndex];
+	}
+}
+
+
+/*
+ * WriteDictionaryEncoding writes the number of distinct values, the
+ * serialized distinct values and then the index of the distinct value of
+ * every value to the output buffer.
+ */
+static void
+WriteDictionaryEncoding(StringInfo valueBuffer, uint32 *valueOffsets,
+						uint32 valueCount, uint32 *entryValueIndexes,
+						uint8 *valueEntryIndexes, uint32 entryCount,
+						StringInfo outputBuffer)
+{
+	*((uint32 *) outputBuffer->data) = entryCount;
+
+	uint32 currentOffset = ENCODING_COUNT_HEADER_SIZE;
+
+	for (uint32 entryIndex = 0; entryIndex < entryCount; entryIndex++)
+	{
+		uint32 valueIndex = entryValueIndexes[entryIndex];
+		uint32 valueLength = valueOffsets[valueIndex + 1] - valueOffsets[valueIndex];
+
+		memcpy(outputBuffer->data + currentOffset, /* IGNORE-BANNED */
+			   valueBuffer->data + valueOffsets[valueIndex], valueLength);
+		currentOffset += valueLength;
+	}
+
+	memcpy(outputBuffer->data + currentOffset, valueEntryIndexes, /* IGNORE-BANNED */
+		   valueCount * sizeof(uint8));
+}
+
+
+/*
+ * WriteIntegerPacking writes the header and then the differences between the
+ * given values and base, packed in bitWidth bits each, to the output buffer.
+ */
+static void
+WriteIntegerPacking(int64 firstValue, int64 *valueArray, uint32 valueCount,
+					int64 base, uint32 bitWidth, StringInfo outputBuffer)
+{
+	IntegerPackingHeader *header = (IntegerPackingHeader *) outputBuffer->data;
+	uint8 *packedValues = (uint8 *) outputBuffer->data + sizeof(IntegerPackingHeader);
+
+	header->firstValue = firstValue;
+	header->base = base;
+	header->bitWidth = bitWidth;
+
+	for (uint32 valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		uint64 packedValue = (uint64) valueArray[valueIndex] - (uint64) base;
+		PackBits(packedValues, (uint64) valueIndex * bitWidth, packedValue, bitWidth);
+	}
+}
+
+
+/*
+ * PackBits stores the lowest bitWidth bits of value at the given bit offset
+ * of the output, which should be zeroed.
+ */
+static void
+PackBits(uint8 *output, uint64 bitOffset, uint64 value, uint32 bitWidth)
+{
+	while (bitWidth > 0)
+	{
+		uint64 byteIndex = bitOffset / 8;
+		uint32 bitIndex = bitOffset % 8;
+		uint32 bitCount = Min(8 - bitIndex, bitWidth);
+		uint8 bits = value & ((1 << bitCount) - 1);
+
+		output[byteIndex] |= (uint8) (bits << bitIndex);
+
+		value >>= bitCount;
+		bitOffset += bitCount;
+		bitWidth -= bitCount;
+	}
+}
+
+
+/*
+ * UnpackBits returns the value of bitWidth bits stored at the given bit
+ * offset of the input.
+ */
+static uint64
+UnpackBits(const uint8 *input, uint64 bitOffset, uint32 bitWidth)
+{
+	uint64 value = 0;
+	uint32 valueBitIndex = 0;
+
+	while (valueBitIndex < bitWidth)
+	{
+		uint64 byteIndex = bitOffset / 8;
+		uint32 bitIndex = bitOffset % 8;
+		uint32 bitCount = Min(8 - bitIndex, bitWidth - valueBitIndex);
+		uint64 bits = (input[byteIndex] >> bitIndex) & ((1 << bitCount) - 1);
+
+		value |= bits << valueBitIndex;
+
+		valueBitIndex += bitCount;
+		bitOffset += bitCount;
+	}
+
+	return value;
+}
+
+
+/*
+ * IntegerDatumValue returns the value of a by-value datum of the given length
+ * as an integer.
+ */
+static int64
+IntegerDatumValue(Datum datum, int typeLength)
+{
+	switch (typeLength)
+	{
+		case 2:
+		{
+			return DatumGetInt16(datum);
+		}
+
+		case 4:
+		{
+			return DatumGetInt32(datum);
+		}
+
+		default:
+		{
+			return DatumGetInt64(datum);
+		}
+	}
+}
+
+
+/*
+ * IntegerValueDatum returns the by-value datum of the given length for the
+ * given integer, the inverse of IntegerDatumValue.
+ */
+static Datum
+IntegerValueDatum(int64 value, int typeLength)
+{
+	switch (typeLength)
+	{
+		case 2:
+		{
+			return Int16GetDatum((int16) value);
+		}
+
+		case 4:
+		{
+			return Int32GetDatum((int32) value);
+		}
+
+		default:
+		{
+			return Int64GetDatum(value);
+		}
+	}
+}
+
+
+/*
+ * DecodeDictionary decodes a dictionary encoded buffer written by
+ * WriteDictionaryEncoding.
+ */
+static void
+DecodeDictionary(StringInfo encodedBuffer, bool *existsArray, uint32 rowCount,
+				 Form_pg_attribute attributeForm, Datum *datumArray,
+				 ColumnChunkDictionary **dictionary)
+{
+	if (encodedBuffer->len < ENCODING_COUNT_HEADER_SIZE)
+	{
+		ereport(ERROR, (errmsg("insufficient data left in encoded datum buffer")));
+	}
+
+	uint32 entryCount = *((uint32 *) encodedBuffer->data);
+	Datum *entryArray = palloc0(Max(entryCount, 1) * sizeof(Datum));
+	uint32 currentOffset = ENCODING_COUNT_HEADER_SIZE;
+
+	for (uint32 entryIndex = 0; entryIndex < entryCount; entryIndex++)
+	{
+		char *currentPointer = encodedBuffer->data + currentOffset;
+
+		entryArray[entryIndex] = fetch_att(currentPointer, attributeForm->attbyval,
+										   attributeForm->attlen);
+		currentOffset = att_addlength_pointer(currentOffset, attributeForm->attlen,
+											  currentPointer);
+		currentOffset = att_align_nominal(currentOffset, attributeForm->attalign);
+
+		if (currentOffset > encodedBuffer->len)
+		{
+			ereport(ERROR, (errmsg("insufficient data left in encoded datum buffer")));
+		}
+	}
+
+	uint8 *valueEntryIndexes = (uint8 *) encodedBuffer->data + currentOffset;
+	uint8 *entryIndexArray = palloc0(Max(rowCount, 1) * sizeof(uint8));
+	uint32 valueIndex = 0;
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		if (!existsArray[rowIndex])
+		{
+			continue;
+		}
+
+		if (currentOffset + valueIndex >= encodedBuffer->len)
+		{
+			ereport(ERROR, (errmsg("insufficient data left in encoded datum buffer")));
+		}
+
+		uint8 entryIndex = valueEntryIndexes[valueIndex++];
+		if (entryIndex >= entryCount)
+		{
+			ereport(ERROR, (errmsg("invalid dictionary index in columnar value buffer")));
+		}
+
+		datumArray[rowIndex] = entryArray[entryIndex];
+		entryIndexArray[rowIndex] = entryIndex;
+	}
+
+	*dictionary = palloc0(sizeof(ColumnChunkDictionary));
+	(*dictionary)->entryCount = entryCount;
+	(*dictionary)->entryArray = entryArray;
+	(*dictionary)->entryIndexArray = entryIndexArray;
+}
+
+
+/*
+ * DecodeRunLength decodes a run length encoded buffer written by
+ * WriteRunLengthEncoding.
+ */
+static void
+DecodeRunLength(StringInfo encodedBuffer, bool *existsArray, uint32 rowCount,
+				Form_pg_attribute attributeForm, Datum *datumArray)
+{
+	if (encodedBuffer->len < ENCODING_COUNT_HEADER_SIZE)
+	{
+		ereport(ERROR, (errmsg("insufficient data left in encoded datum buffer")));
+	}
+
+	uint32 runCount = *((uint32 *) encodedBuffer->data);
+	uint32 *runLengths = (uint32 *) (encodedBuffer->data + ENCODING_COUNT_HEADER_SIZE);
+	uint64 currentOffset = ENCODING_COUNT_HEADER_SIZE +
+						   MAXALIGN((uint64) runCount * sizeof(uint32));
+
+	if (currentOffset > encodedBuffer->len)
+	{
+		ereport(ERROR, (errmsg("insufficient data left in encoded datum buffer")));
+	}
+
+	uint32 runIndex = 0;
+	uint32 runRemainingCount = 0;
+	Datum runValue = 0;
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		if (!existsArray[rowIndex])
+		{
+			continue;
+		}
+
+		if (runRemainingCount == 0)
+		{
+			if (runIndex >= runCount || currentOffset >= encodedBuffer->len)
+			{
+				ereport(ERROR, (errmsg("insufficient data left in encoded datum "
+									   "buffer")));
+			}
+
+			char *currentPointer = encodedBuffer->data + currentOffset;
+
+			runValue = fetch_att(currentPointer, attributeForm->attbyval,
+								 attributeForm->attlen);
+			currentOffset = att_addlength_pointer(currentOffset, attributeForm->attlen,
+												  currentPointer);
+			currentOffset = att_align_nominal(currentOffset, attributeForm->attalign);
+			runRemainingCount = runLengths[runIndex++];
+
+			if (currentOffset > encodedBuffer->len || runRemainingCount == 0)
+			{
+				ereport(ERROR, (errmsg("invalid run in columnar value buffer")));
+			}
+		}
+
+		datumArray[rowIndex] = runValue;
+		runRemainingCount--;
+	}
+}
+
+
+/*
+ * DecodeIntegerPacking decodes a frame of reference or delta encoded buffer
+ * written by WriteIntegerPacking.
+ */
+static void
+DecodeIntegerPacking(StringInfo encodedBuffer, bool isDelta, bool *existsArray,
+					 uint32 rowCount, Form_pg_attribute attributeForm,
+					 Datum *datumArray)
+{
+	uint32 valueCount = 0;
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		if (existsArray[rowIndex])
+		{
+			valueCount++;
+		}
+	}
+
+	if (encodedBuffer->len < sizeof(IntegerPackingHeader))
+	{
+		ereport(ERROR, (errmsg("insufficient data left in encoded datum buffer")));
+	}
+
+	IntegerPackingHeader *header = (IntegerPackingHeader *) encodedBuffer->data;
+	const uint8 *packedValues =
+		(const uint8 *) encodedBuffer->data + sizeof(IntegerPackingHeader);
+	uint32 packedValueCount = (isDelta && valueCount > 0) ? valueCount - 1 : valueCount;
+
+	if (header->bitWidth > 64 ||
+		IntegerPackedSize(packedValueCount, header->bitWidth) > encodedBuffer->len)
+	{
+		ereport(ERROR, (errmsg("insufficient data left in encoded datum buffer")));
+	}
+
+	uint64 bitOffset = 0;
+	bool isFirstValue = true;
+	int64 value = header->firstValue;
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		if (!existsArray[rowIndex])
+		{
+			continue;
+		}
+
+		if (!isDelta || !isFirstValue)
+		{
+			uint64 packedValue = UnpackBits(packedValues, bitOffset, header->bitWidth);
+			bitOffset += header->bitWidth;
+
+			/* additions wrap around, like the differences did when encoding */
+			uint64 previousValue = isDelta ? (uint64) value : 0;
+			value = (int64) (previousValue + (uint64) header->base + packedValue);
+		}
+
+		isFirstValue = false;
+		datumArray[rowIndex] = IntegerValueDatum(value, attributeForm->attlen);
+	}
+}
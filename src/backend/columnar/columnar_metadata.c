@@ -39,6 +39,7 @@
 #include "catalog/pg_collation.h"
 #include "catalog/pg_type.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_am.h"
 #include "commands/defrem.h"
 #include "commands/sequence.h"
 #include "commands/trigger.h"
@@ -46,6 +47,7 @@
 #include "executor/spi.h"
 #include "miscadmin.h"
 #include "nodes/execnodes.h"
+#include "lib/ilist.h"
 #include "lib/stringinfo.h"
 #include "port.h"
 #include "storage/fd.h"
@@ -53,11 +55,14 @@
 #include "storage/procarray.h"
 #include "storage/smgr.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/fmgroids.h"
+#include "utils/hsearch.h"
 #include "utils/memutils.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/relfilenodemap.h"
+#include "utils/varlena.h"
 
 #define COLUMNAR_RELOPTION_NAMESPACE "columnar"
 
@@ -68,6 +73,31 @@ typedef struct
 	ResultRelInfo *resultRelInfo;
 } ModifyState;
 
+/*
+ * StripeSkipListCacheKey identifies a stripe within the database. Storage ids
+ * and stripe ids are never reused, and the chunk metadata of a stripe never
+ * changes once the stripe is flushed.
+ */
+typedef struct StripeSkipListCacheKey
+{
+	uint64 storageId;
+	uint64 stripeId;
+} StripeSkipListCacheKey;
+
+/*
+ * StripeSkipListCacheEntry holds a decoded skip list of a stripe in its own
+ * memory context, and its position in the list of cached skip lists from
+ * least to most recently used.
+ */
+typedef struct StripeSkipListCacheEntry
+{
+	StripeSkipListCacheKey key;
+	dlist_node lruNode;
+	MemoryContext context;
+	Size size;
+	StripeSkipList *skipList;
+} StripeSkipListCacheEntry;
+
 /* RowNumberLookupMode to be used in StripeMetadataLookupRowNumber */
 typedef enum RowNumberLookupMode
 {
@@ -84,6 +114,8 @@ typedef enum RowNumberLookupMode
 } RowNumberLookupMode;
 
 static void ParseColumnarRelOptions(List *reloptions, ColumnarOptions *options);
+static void ErrorIfInvalidBloomColumns(Oid regclass, char *bloomColumns);
+static void ErrorIfInvalidSortBy(Oid regclass, char *sortBy);
 static void InsertEmptyStripeMetadataRow(uint64 storageId, uint64 stripeId,
 										 uint32 columnCount, uint32 chunkGroupRowCount,
 										 uint64 firstRowNumber);
@@ -114,6 +146,11 @@ static void DeleteStorageFromColumnarMetadataTable(Oid metadataTableId,
 												   AttrNumber storageIdAtrrNumber,
 												   Oid storageIdIndexId,
 												   uint64 storageId);
+static void DeleteStripeFromColumnarMetadataTable(Oid metadataTableId,
+												  AttrNumber storageIdAtrrNumber,
+												  AttrNumber stripeIdAttrNumber,
+												  Oid stripeIdIndexId,
+												  uint64 storageId, uint64 stripeId);
 static ModifyState * StartModifyRelation(Relation rel);
 static void InsertTupleAndEnforceConstraints(ModifyState *state, Datum *values,
 											 bool *nulls);
@@ -127,16 +164,73 @@ static StripeMetadata * StripeMetadataLookupRowNumber(Relation relation, uint64
 													  Snapshot snapshot,
 													  RowNumberLookupMode lookupMode);
 static void CheckStripeMetadataConsistency(StripeMetadata *stripeMetadata);
+static StripeSkipList * ReadStripeSkipListFromCatalog(uint64 storageId, uint64 stripe,
+													  TupleDesc tupleDescriptor,
+													  uint32 chunkCount,
+													  Snapshot snapshot);
+static StripeSkipList * CopyStripeSkipList(StripeSkipList *skipList,
+										   TupleDesc tupleDescriptor);
+static void InitStripeSkipListCache(void);
+static void CacheStripeSkipList(StripeSkipListCacheKey *key, StripeSkipList *skipList,
+								TupleDesc tupleDescriptor);
+static void EvictStripeSkipListCacheEntry(StripeSkipListCacheEntry *entry);
+static void RemoveStorageFromStripeSkipListCache(uint64 storageId);
+static Oid ColumnarCompressionDictionaryRelationId(void);
+static Oid ColumnarCompressionDictionaryIndexRelationId(void);
+static void InsertCompressionDictionaryRow(uint64 storageId, AttrNumber attrNum,
+										   uint64 dictionaryId, int32 version,
+										   bytea *dictionary);
+static List * ReadCompressionDictionaryList(uint64 storageId, Snapshot snapshot);
+static Oid ColumnarStripeDeletionRelationId(void);
+static Oid ColumnarStripeDeletionIndexRelationId(void);
+
+/* backend-local cache of decoded stripe skip lists */
+static HTAB *StripeSkipListCache = NULL;
+static MemoryContext StripeSkipListCacheContext = NULL;
+static dlist_head StripeSkipListCacheLRUList;
+static Size StripeSkipListCacheUsedSize = 0;
+
+/* CompressionDictionary is a row of columnar_internal.compression_dictionary */
+typedef struct CompressionDictionary
+{
+	AttrNumber attrNum;
+	uint64 dictionaryId;
+	int32 version;
+	bytea *dictionary;
+} CompressionDictionary;
+
+/*
+ * The backend-local cache of compression dictionaries is keyed by the
+ * dictionary id within a column of a storage. Dictionaries are never
+ * modified and storage ids are never reused, so entries never become stale.
+ */
+typedef struct CompressionDictionaryCacheKey
+{
+	uint64 storageId;
+	uint64 dictionaryId;
+	AttrNumber attrNum;
+} CompressionDictionaryCacheKey;
+
+typedef struct CompressionDictionaryCacheEntry
+{
+	CompressionDictionaryCacheKey key;
+	bytea *dictionary;
+} CompressionDictionaryCacheEntry;
+
+static HTAB *CompressionDictionaryCache = NULL;
+static MemoryContext CompressionDictionaryCacheContext = NULL;
 
 PG_FUNCTION_INFO_V1(columnar_relation_storageid);
 
 /* constants for columnar.options */
-#define Natts_columnar_options 5
+#define Natts_columnar_options 7
 #define Anum_columnar_options_regclass 1
 #define Anum_columnar_options_chunk_group_row_limit 2
 #define Anum_columnar_options_stripe_row_limit 3
 #define Anum_columnar_options_compression_level 4
 #define Anum_columnar_options_compression 5
+#define Anum_columnar_options_bloom_columns 6
+#define Anum_columnar_options_sort_by 7
 
 /* ----------------
  *		columnar.options definition.
@@ -151,6 +245,8 @@ typedef struct FormData_columnar_options
 	NameData compression;
 
 #ifdef CATALOG_VARLEN           /* variable-length fields start here */
+	text bloom_columns;
+	text sort_by;
 #endif
 } FormData_columnar_options;
 typedef FormData_columnar_options *Form_columnar_options;
@@ -168,6 +264,20 @@ typedef FormData_columnar_options *Form_columnar_options;
 #define Anum_columnar_stripe_chunk_count 8
 #define Anum_columnar_stripe_first_row_number 9
 
+/* constants for columnar_internal.compression_dictionary */
+#define Natts_columnar_dictionary 5
+#define Anum_columnar_dictionary_storageid 1
+#define Anum_columnar_dictionary_attr 2
+#define Anum_columnar_dictionary_dictionary_id 3
+#define Anum_columnar_dictionary_version 4
+#define Anum_columnar_dictionary_dictionary 5
+
+/* constants for columnar_internal.stripe_deletion */
+#define Natts_columnar_stripe_deletion 3
+#define Anum_columnar_stripe_deletion_storageid 1
+#define Anum_columnar_stripe_deletion_stripe 2
+#define Anum_columnar_stripe_deletion_deleted_rows 3
+
 /* constants for columnar.chunk_group */
 #define Natts_columnar_chunkgroup 4
 #define Anum_columnar_chunkgroup_storageid 1
@@ -176,7 +286,7 @@ typedef FormData_columnar_options *Form_columnar_options;
 #define Anum_columnar_chunkgroup_row_count 4
 
 /* constants for columnar.chunk */
-#define Natts_columnar_chunk 14
+#define Natts_columnar_chunk 16
 #define Anum_columnar_chunk_storageid 1
 #define Anum_columnar_chunk_stripe 2
 #define Anum_columnar_chunk_attr 3
@@ -191,6 +301,8 @@ typedef FormData_columnar_options *Form_columnar_options;
 #define Anum_columnar_chunk_value_compression_level 12
 #define Anum_columnar_chunk_value_decompressed_size 13
 #define Anum_columnar_chunk_value_count 14
+#define Anum_columnar_chunk_value_encoding 15
+#define Anum_columnar_chunk_bloom_filter 16
 
 
 /*
@@ -213,7 +325,9 @@ InitColumnarOptions(Oid regclass)
 		.chunkRowCount = columnar_chunk_group_row_limit,
 		.stripeRowCount = columnar_stripe_row_limit,
 		.compressionType = columnar_compression,
-		.compressionLevel = columnar_compression_level
+		.compressionLevel = columnar_compression_level,
+		.bloomColumns = NULL,
+		.sortBy = NULL
 	};
 
 	WriteColumnarOptions(regclass, &defaultOptions, false);
@@ -281,6 +395,37 @@ ParseColumnarRelOptions(List *reloptions, ColumnarOptions *options)
 									   quote_identifier(defGetString(elem)))));
 			}
 		}
+		else if (strcmp(elem->defname, "bloom_columns") == 0)
+		{
+			options->bloomColumns = (elem->arg == NULL) ? NULL :
+									pstrdup(defGetString(elem));
+
+			/* the columns themselves are checked once the relation is known */
+			if (options->bloomColumns != NULL)
+			{
+				ColumnarOptionColumnNameList("bloom_columns", options->bloomColumns);
+			}
+
+			if (options->bloomColumns != NULL && options->bloomColumns[0] == '\0')
+			{
+				options->bloomColumns = NULL;
+			}
+		}
+		else if (strcmp(elem->defname, "sort_by") == 0)
+		{
+			options->sortBy = (elem->arg == NULL) ? NULL : pstrdup(defGetString(elem));
+
+			/* the columns themselves are checked once the relation is known */
+			if (options->sortBy != NULL)
+			{
+				ColumnarOptionColumnNameList("sort_by", options->sortBy);
+			}
+
+			if (options->sortBy != NULL && options->sortBy[0] == '\0')
+			{
+				options->sortBy = NULL;
+			}
+		}
 		else if (strcmp(elem->defname, "compression_level") == 0)
 		{
 			options->compressionLevel = (elem->arg == NULL) ?
@@ -364,10 +509,120 @@ SetColumnarRelOptions(RangeVar *rv, List *reloptions)
 
 	ParseColumnarRelOptions(reloptions, &options);
 
+	ErrorIfInvalidBloomColumns(relid, options.bloomColumns);
+	ErrorIfInvalidSortBy(relid, options.sortBy);
+
 	SetColumnarOptions(relid, &options);
 }
 
 
+/*
+ * ColumnarOptionColumnNameList returns the names of the columns in the
+ * value of the given option, which is a comma separated list of column
+ * names, such as bloom_columns and sort_by.
+ */
+List *
+ColumnarOptionColumnNameList(const char *optionName, const char *optionValue)
+{
+	List *columnNameList = NIL;
+
+	if (!SplitIdentifierString(pstrdup(optionValue), ',', &columnNameList))
+	{
+		ereport(ERROR, (errmsg("invalid list syntax for columnar option \"%s\"",
+							   optionName),
+						errhint("%s must be a comma separated list of column names",
+								optionName)));
+	}
+
+	return columnNameList;
+}
+
+
+/*
+ * ErrorIfInvalidBloomColumns errors out if the bloom_columns option names a
+ * column that the relation does not have, or a column whose type has no
+ * default hash operator class to build bloom filters with.
+ */
+static void
+ErrorIfInvalidBloomColumns(Oid regclass, char *bloomColumns)
+{
+	if (bloomColumns == NULL)
+	{
+		return;
+	}
+
+	char *columnName = NULL;
+	foreach_ptr(columnName, ColumnarOptionColumnNameList("bloom_columns", bloomColumns))
+	{
+		AttrNumber attributeNumber = get_attnum(regclass, columnName);
+		if (attributeNumber == InvalidAttrNumber)
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+							errmsg("column \"%s\" of relation \"%s\" does not exist",
+								   columnName, get_rel_name(regclass))));
+		}
+
+		Oid typeId = get_atttype(regclass, attributeNumber);
+		if (GetDefaultOpClass(typeId, HASH_AM_OID) == InvalidOid)
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT),
+							errmsg("cannot build bloom filters for column \"%s\"",
+								   columnName),
+							errdetail("Data type %s has no default hash operator "
+									  "class.", format_type_be(typeId))));
+		}
+	}
+}
+
+/*
+ * ErrorIfInvalidSortBy errors out if the sort_by option names a column that
+ * the relation does not have, or a column whose type has no default btree
+ * operator class to sort with. Since sorting the rows of a stripe changes
+ * their row numbers, the option cannot be used on tables with indexes.
+ */
+static void
+ErrorIfInvalidSortBy(Oid regclass, char *sortBy)
+{
+	if (sortBy == NULL)
+	{
+		return;
+	}
+
+	char *columnName = NULL;
+	foreach_ptr(columnName, ColumnarOptionColumnNameList("sort_by", sortBy))
+	{
+		AttrNumber attributeNumber = get_attnum(regclass, columnName);
+		if (attributeNumber == InvalidAttrNumber)
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+							errmsg("column \"%s\" of relation \"%s\" does not exist",
+								   columnName, get_rel_name(regclass))));
+		}
+
+		Oid typeId = get_atttype(regclass, attributeNumber);
+		if (GetDefaultOpClass(typeId, BTREE_AM_OID) == InvalidOid)
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT),
+							errmsg("cannot sort by column \"%s\"", columnName),
+							errdetail("Data type %s has no default btree operator "
+									  "class.", format_type_be(typeId))));
+		}
+	}
+
+	Relation relation = relation_open(regclass, AccessShareLock);
+	List *indexList = RelationGetIndexList(relation);
+	relation_close(relation, AccessShareLock);
+
+	if (indexList != NIL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("columnar option \"sort_by\" is not supported on "
+							   "tables with indexes")));
+	}
+}
+
+
+
 /*
  * SetColumnarOptions writes the passed table options as the authoritive options to the
  * table irregardless of the optiones already existing or not. This can be used to put a
@@ -412,6 +667,25 @@ WriteColumnarOptions(Oid regclass, ColumnarOptions *options, bool overwrite)
 	namestrcpy(&compressionName, CompressionTypeStr(options->compressionType));
 	values[Anum_columnar_options_compression - 1] = NameGetDatum(&compressionName);
 
+	if (options->bloomColumns != NULL)
+	{
+		values[Anum_columnar_options_bloom_columns - 1] =
+			CStringGetTextDatum(options->bloomColumns);
+	}
+	else
+	{
+		nulls[Anum_columnar_options_bloom_columns - 1] = true;
+	}
+
+	if (options->sortBy != NULL)
+	{
+		values[Anum_columnar_options_sort_by - 1] = CStringGetTextDatum(options->sortBy);
+	}
+	else
+	{
+		nulls[Anum_columnar_options_sort_by - 1] = true;
+	}
+
 	/* create heap tuple and insert into catalog table */
 	Relation columnarOptions = relation_open(ColumnarOptionsRelationId(),
 											 RowExclusiveLock);
@@ -439,6 +713,8 @@ WriteColumnarOptions(Oid regclass, ColumnarOptions *options, bool overwrite)
 			update[Anum_columnar_options_stripe_row_limit - 1] = true;
 			update[Anum_columnar_options_compression_level - 1] = true;
 			update[Anum_columnar_options_compression - 1] = true;
+			update[Anum_columnar_options_bloom_columns - 1] = true;
+			update[Anum_columnar_options_sort_by - 1] = true;
 
 			HeapTuple tuple = heap_modify_tuple(heapTuple, tupleDescriptor,
 												values, nulls, update);
@@ -564,6 +840,20 @@ ReadColumnarOptions(Oid regclass, ColumnarOptions *options)
 		options->stripeRowCount = tupOptions->stripe_row_limit;
 		options->compressionLevel = tupOptions->compressionLevel;
 		options->compressionType = ParseCompressionType(NameStr(tupOptions->compression));
+
+		bool bloomColumnsIsNull = false;
+		Datum bloomColumnsDatum = heap_getattr(heapTuple,
+											   Anum_columnar_options_bloom_columns,
+											   RelationGetDescr(columnarOptions),
+											   &bloomColumnsIsNull);
+		options->bloomColumns = bloomColumnsIsNull ? NULL :
+								TextDatumGetCString(bloomColumnsDatum);
+
+		bool sortByIsNull = false;
+		Datum sortByDatum = heap_getattr(heapTuple, Anum_columnar_options_sort_by,
+										 RelationGetDescr(columnarOptions),
+										 &sortByIsNull);
+		options->sortBy = sortByIsNull ? NULL : TextDatumGetCString(sortByDatum);
 	}
 	else
 	{
@@ -572,6 +862,8 @@ ReadColumnarOptions(Oid regclass, ColumnarOptions *options)
 		options->stripeRowCount = columnar_stripe_row_limit;
 		options->chunkRowCount = columnar_chunk_group_row_limit;
 		options->compressionLevel = columnar_compression_level;
+		options->bloomColumns = NULL;
+		options->sortBy = NULL;
 	}
 
 	systable_endscan_ordered(scanDescriptor);
@@ -620,7 +912,9 @@ SaveStripeSkipList(RelFileNode relfilenode, uint64 stripe, StripeSkipList *chunk
 				Int32GetDatum(chunk->valueCompressionType),
 				Int32GetDatum(chunk->valueCompressionLevel),
 				Int64GetDatum(chunk->decompressedValueSize),
-				Int64GetDatum(chunk->rowCount)
+				Int64GetDatum(chunk->rowCount),
+				Int32GetDatum(chunk->valueEncodingType),
+				0 /* to be filled below */
 			};
 
 			bool nulls[Natts_columnar_chunk] = { false };
@@ -640,6 +934,16 @@ SaveStripeSkipList(RelFileNode relfilenode, uint64 stripe, StripeSkipList *chunk
 				nulls[Anum_columnar_chunk_maximum_value - 1] = true;
 			}
 
+			if (chunk->bloomFilter != NULL)
+			{
+				values[Anum_columnar_chunk_bloom_filter - 1] =
+					PointerGetDatum(chunk->bloomFilter);
+			}
+			else
+			{
+				nulls[Anum_columnar_chunk_bloom_filter - 1] = true;
+			}
+
 			InsertTupleAndEnforceConstraints(modifyState, values, nulls);
 		}
 	}
@@ -687,18 +991,63 @@ SaveChunkGroups(RelFileNode relfilenode, uint64 stripe,
 
 /*
  * ReadStripeSkipList fetches chunk metadata for a given stripe.
+ *
+ * If columnar.stripe_skip_list_cache_size is set, the decoded skip lists are
+ * kept in a backend-local cache, and later reads of the same stripe return a
+ * copy of the cached skip list instead of scanning columnar.chunk again. The
+ * caller should only read the skip lists of stripes that are flushed and
+ * visible to the snapshot, such that all of their chunk metadata is visible.
  */
 StripeSkipList *
 ReadStripeSkipList(RelFileNode relfilenode, uint64 stripe, TupleDesc tupleDescriptor,
 				   uint32 chunkCount, Snapshot snapshot)
+{
+	uint64 storageId = LookupStorageId(relfilenode);
+
+	if (columnar_stripe_skip_list_cache_size == 0)
+	{
+		return ReadStripeSkipListFromCatalog(storageId, stripe, tupleDescriptor,
+											 chunkCount, snapshot);
+	}
+
+	InitStripeSkipListCache();
+
+	StripeSkipListCacheKey key = { 0 };
+	key.storageId = storageId;
+	key.stripeId = stripe;
+
+	StripeSkipListCacheEntry *entry = hash_search(StripeSkipListCache, &key, HASH_FIND,
+												  NULL);
+	if (entry != NULL && entry->skipList->chunkCount == chunkCount)
+	{
+		dlist_move_tail(&StripeSkipListCacheLRUList, &entry->lruNode);
+		return CopyStripeSkipList(entry->skipList, tupleDescriptor);
+	}
+
+	StripeSkipList *skipList = ReadStripeSkipListFromCatalog(storageId, stripe,
+															 tupleDescriptor,
+															 chunkCount, snapshot);
+
+	CacheStripeSkipList(&key, skipList, tupleDescriptor);
+
+	return skipList;
+}
+
+
+/*
+ * ReadStripeSkipListFromCatalog reads the chunk metadata for a given stripe
+ * from columnar.chunk and columnar.chunk_group.
+ */
+static StripeSkipList *
+ReadStripeSkipListFromCatalog(uint64 storageId, uint64 stripe,
+							  TupleDesc tupleDescriptor, uint32 chunkCount,
+							  Snapshot snapshot)
 {
 	int32 columnIndex = 0;
 	HeapTuple heapTuple = NULL;
 	uint32 columnCount = tupleDescriptor->natts;
 	ScanKeyData scanKey[2];
 
-	uint64 storageId = LookupStorageId(relfilenode);
-
 	Oid columnarChunkOid = ColumnarChunkRelationId();
 	Relation columnarChunk = table_open(columnarChunkOid, AccessShareLock);
 	Relation index = index_open(ColumnarChunkIndexRelationId(), AccessShareLock);
@@ -765,6 +1114,14 @@ ReadStripeSkipList(RelFileNode relfilenode, uint64 stripe, TupleDesc tupleDescri
 			DatumGetInt32(datumArray[Anum_columnar_chunk_value_compression_level - 1]);
 		chunk->decompressedValueSize =
 			DatumGetInt64(datumArray[Anum_columnar_chunk_value_decompressed_size - 1]);
+		chunk->valueEncodingType =
+			DatumGetInt32(datumArray[Anum_columnar_chunk_value_encoding - 1]);
+
+		if (!isNullArray[Anum_columnar_chunk_bloom_filter - 1])
+		{
+			chunk->bloomFilter =
+				DatumGetByteaPCopy(datumArray[Anum_columnar_chunk_bloom_filter - 1]);
+		}
 
 		if (isNullArray[Anum_columnar_chunk_minimum_value - 1] ||
 			isNullArray[Anum_columnar_chunk_maximum_value - 1])
@@ -798,6 +1155,196 @@ ReadStripeSkipList(RelFileNode relfilenode, uint64 stripe, TupleDesc tupleDescri
 }
 
 
+/*
+ * CopyStripeSkipList returns a copy of the given skip list in the current
+ * memory context, with the columns of the given tuple descriptor. Columns
+ * that were added after the skip list was read have no chunk metadata, just
+ * like columns that were added after the stripe was written.
+ */
+static StripeSkipList *
+CopyStripeSkipList(StripeSkipList *skipList, TupleDesc tupleDescriptor)
+{
+	uint32 columnCount = tupleDescriptor->natts;
+	uint32 chunkCount = skipList->chunkCount;
+
+	StripeSkipList *copy = palloc0(sizeof(StripeSkipList));
+	copy->chunkCount = chunkCount;
+	copy->columnCount = columnCount;
+	copy->chunkSkipNodeArray = palloc0(columnCount * sizeof(ColumnChunkSkipNode *));
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		copy->chunkSkipNodeArray[columnIndex] =
+			palloc0(chunkCount * sizeof(ColumnChunkSkipNode));
+
+		if (columnIndex >= skipList->columnCount)
+		{
+			continue;
+		}
+
+		for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *sourceNode =
+				&skipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+			ColumnChunkSkipNode *copyNode =
+				&copy->chunkSkipNodeArray[columnIndex][chunkIndex];
+
+			*copyNode = *sourceNode;
+
+			if (sourceNode->hasMinMax)
+			{
+				copyNode->minimumValue = datumCopy(sourceNode->minimumValue,
+												   attributeForm->attbyval,
+												   attributeForm->attlen);
+				copyNode->maximumValue = datumCopy(sourceNode->maximumValue,
+												   attributeForm->attbyval,
+												   attributeForm->attlen);
+			}
+
+			if (sourceNode->bloomFilter != NULL)
+			{
+				copyNode->bloomFilter =
+					DatumGetByteaPCopy(PointerGetDatum(sourceNode->bloomFilter));
+			}
+		}
+	}
+
+	copy->chunkGroupRowCounts = palloc0(Max(chunkCount, 1) * sizeof(uint32));
+	for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		copy->chunkGroupRowCounts[chunkIndex] = skipList->chunkGroupRowCounts[chunkIndex];
+	}
+
+	return copy;
+}
+
+
+/*
+ * InitStripeSkipListCache creates the backend-local skip list cache if it
+ * does not exist yet.
+ */
+static void
+InitStripeSkipListCache(void)
+{
+	if (StripeSkipListCache != NULL)
+	{
+		return;
+	}
+
+	StripeSkipListCacheContext = AllocSetContextCreate(TopMemoryContext,
+													   "Columnar Skip List Cache",
+													   ALLOCSET_DEFAULT_SIZES);
+
+	HASHCTL hashInfo;
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = sizeof(StripeSkipListCacheKey);
+	hashInfo.entrysize = sizeof(StripeSkipListCacheEntry);
+	hashInfo.hcxt = StripeSkipListCacheContext;
+
+	StripeSkipListCache = hash_create("Columnar Skip List Cache", 256, &hashInfo,
+									  HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	dlist_init(&StripeSkipListCacheLRUList);
+	StripeSkipListCacheUsedSize = 0;
+}
+
+
+/*
+ * CacheStripeSkipList stores a copy of the given skip list in the skip list
+ * cache, and evicts the least recently used skip lists while the cache is
+ * larger than columnar.stripe_skip_list_cache_size. Skip lists that are
+ * larger than the whole cache are not cached.
+ */
+static void
+CacheStripeSkipList(StripeSkipListCacheKey *key, StripeSkipList *skipList,
+					TupleDesc tupleDescriptor)
+{
+	Size cacheSizeLimit = (Size) columnar_stripe_skip_list_cache_size * 1024;
+
+	MemoryContext entryContext = AllocSetContextCreate(StripeSkipListCacheContext,
+													   "Columnar Skip List Cache Entry",
+													   ALLOCSET_SMALL_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(entryContext);
+	StripeSkipList *skipListCopy = CopyStripeSkipList(skipList, tupleDescriptor);
+	MemoryContextSwitchTo(oldContext);
+
+	Size entrySize = MemoryContextMemAllocated(entryContext, true);
+	if (entrySize > cacheSizeLimit)
+	{
+		MemoryContextDelete(entryContext);
+		return;
+	}
+
+	while (StripeSkipListCacheUsedSize + entrySize > cacheSizeLimit &&
+		   !dlist_is_empty(&StripeSkipListCacheLRUList))
+	{
+		dlist_node *lruNode = dlist_head_node(&StripeSkipListCacheLRUList);
+		EvictStripeSkipListCacheEntry(dlist_container(StripeSkipListCacheEntry,
+													  lruNode, lruNode));
+	}
+
+	bool found = false;
+	StripeSkipListCacheEntry *entry = hash_search(StripeSkipListCache, key, HASH_ENTER,
+												  &found);
+	if (found)
+	{
+		/* replace a skip list that was read with a different chunk count */
+		dlist_delete(&entry->lruNode);
+		StripeSkipListCacheUsedSize -= entry->size;
+		MemoryContextDelete(entry->context);
+	}
+
+	entry->context = entryContext;
+	entry->size = entrySize;
+	entry->skipList = skipListCopy;
+	dlist_push_tail(&StripeSkipListCacheLRUList, &entry->lruNode);
+	StripeSkipListCacheUsedSize += entrySize;
+}
+
+
+/*
+ * EvictStripeSkipListCacheEntry removes the given entry from the skip list
+ * cache and frees its skip list.
+ */
+static void
+EvictStripeSkipListCacheEntry(StripeSkipListCacheEntry *entry)
+{
+	dlist_delete(&entry->lruNode);
+	StripeSkipListCacheUsedSize -= entry->size;
+	MemoryContextDelete(entry->context);
+
+	hash_search(StripeSkipListCache, &entry->key, HASH_REMOVE, NULL);
+}
+
+
+/*
+ * RemoveStorageFromStripeSkipListCache removes the skip lists of the given
+ * storage from the skip list cache. The storage id is never reused, so this
+ * only frees the memory of skip lists that cannot be read anymore.
+ */
+static void
+RemoveStorageFromStripeSkipListCache(uint64 storageId)
+{
+	if (StripeSkipListCache == NULL)
+	{
+		return;
+	}
+
+	dlist_mutable_iter iter;
+	dlist_foreach_modify(iter, &StripeSkipListCacheLRUList)
+	{
+		StripeSkipListCacheEntry *entry =
+			dlist_container(StripeSkipListCacheEntry, lruNode, iter.cur);
+
+		if (entry->key.storageId == storageId)
+		{
+			EvictStripeSkipListCacheEntry(entry);
+		}
+	}
+}
+
+
 /*
  * FindStripeByRowNumber returns StripeMetadata for the stripe whose
  * firstRowNumber is greater than given rowNumber. If no such stripe
@@ -1265,6 +1812,21 @@ CompleteStripeReservation(Relation rel, uint64 stripeId, uint64 sizeBytes,
 						  uint64 rowCount, uint64 chunkCount)
 {
 	uint64 resLogicalStart = ColumnarStorageReserveData(rel, sizeBytes);
+
+	return CompleteStripeReservationAt(rel, stripeId, resLogicalStart, sizeBytes,
+									   rowCount, chunkCount);
+}
+
+
+/*
+ * CompleteStripeReservationAt completes reservation of the stripe with
+ * stripeId for data that the caller has already reserved and written at
+ * the given file offset.
+ */
+StripeMetadata *
+CompleteStripeReservationAt(Relation rel, uint64 stripeId, uint64 fileOffset,
+							uint64 sizeBytes, uint64 rowCount, uint64 chunkCount)
+{
 	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
 
 	bool update[Natts_columnar_stripe] = { false };
@@ -1274,12 +1836,55 @@ CompleteStripeReservation(Relation rel, uint64 stripeId, uint64 sizeBytes,
 	update[Anum_columnar_stripe_chunk_count - 1] = true;
 
 	Datum newValues[Natts_columnar_stripe] = { 0 };
-	newValues[Anum_columnar_stripe_file_offset - 1] = Int64GetDatum(resLogicalStart);
+	newValues[Anum_columnar_stripe_file_offset - 1] = Int64GetDatum(fileOffset);
 	newValues[Anum_columnar_stripe_data_length - 1] = Int64GetDatum(sizeBytes);
 	newValues[Anum_columnar_stripe_row_count - 1] = UInt64GetDatum(rowCount);
 	newValues[Anum_columnar_stripe_chunk_count - 1] = Int32GetDatum(chunkCount);
 
-	return UpdateStripeMetadataRow(storageId, stripeId, update, newValues);
+	StripeMetadata *stripeMetadata = UpdateStripeMetadataRow(storageId, stripeId,
+															 update, newValues);
+
+	bool add = true;
+	ColumnarStorageAddStripeTotals(rel, rowCount, sizeBytes,
+								   stripeMetadata->columnCount, add);
+
+	return stripeMetadata;
+}
+
+
+/*
+ * RecomputeStorageTotals recomputes the running totals of the flushed
+ * stripes in the metapage of the given relation from columnar.stripe, which
+ * drops the stripes of aborted writes from them. Stripes of writes that are
+ * still in progress are counted as well, as they were already added.
+ */
+void
+RecomputeStorageTotals(Relation rel)
+{
+	SnapshotData dirtySnapshot;
+	InitDirtySnapshot(dirtySnapshot);
+
+	uint64 storageId = ColumnarStorageGetStorageId(rel, false);
+	List *stripeMetadataList = ReadDataFileStripeList(storageId, &dirtySnapshot);
+
+	ColumnarStorageTotals totals = { 0 };
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, stripeMetadataList)
+	{
+		/* skip the reservations of stripes that are not flushed yet */
+		if (stripeMetadata->rowCount == 0)
+		{
+			continue;
+		}
+
+		totals.stripeCount++;
+		totals.rowCount += stripeMetadata->rowCount;
+		totals.dataLength += stripeMetadata->dataLength;
+		totals.maxColumnCount = Max(totals.maxColumnCount,
+									stripeMetadata->columnCount);
+	}
+
+	ColumnarStorageSetTotals(rel, &totals);
 }
 
 
@@ -1464,6 +2069,8 @@ DeleteMetadataRows(RelFileNode relfilenode)
 
 	uint64 storageId = LookupStorageId(relfilenode);
 
+	RemoveStorageFromStripeSkipListCache(storageId);
+
 	DeleteStorageFromColumnarMetadataTable(ColumnarStripeRelationId(),
 										   Anum_columnar_stripe_storageid,
 										   ColumnarStripePKeyIndexRelationId(),
@@ -1476,6 +2083,14 @@ DeleteMetadataRows(RelFileNode relfilenode)
 										   Anum_columnar_chunk_storageid,
 										   ColumnarChunkIndexRelationId(),
 										   storageId);
+	DeleteStorageFromColumnarMetadataTable(ColumnarCompressionDictionaryRelationId(),
+										   Anum_columnar_dictionary_storageid,
+										   ColumnarCompressionDictionaryIndexRelationId(),
+										   storageId);
+	DeleteStorageFromColumnarMetadataTable(ColumnarStripeDeletionRelationId(),
+										   Anum_columnar_stripe_deletion_storageid,
+										   ColumnarStripeDeletionIndexRelationId(),
+										   storageId);
 }
 
 
@@ -1523,12 +2138,509 @@ DeleteStorageFromColumnarMetadataTable(Oid metadataTableId,
 
 
 /*
- * StartModifyRelation allocates resources for modifications.
+ * DeleteStripeMetadata removes the stripe, chunk group, chunk and deletion
+ * rows of the given stripe. The data of the stripe stays in the storage, such
+ * that the transactions that can still see the stripe can keep reading it.
  */
-static ModifyState *
-StartModifyRelation(Relation rel)
+void
+DeleteStripeMetadata(RelFileNode relfilenode, uint64 stripeId)
 {
-	EState *estate = create_estate_for_relation(rel);
+	uint64 storageId = LookupStorageId(relfilenode);
+
+	DeleteStripeFromColumnarMetadataTable(ColumnarStripeRelationId(),
+										  Anum_columnar_stripe_storageid,
+										  Anum_columnar_stripe_stripe,
+										  ColumnarStripePKeyIndexRelationId(),
+										  storageId, stripeId);
+	DeleteStripeFromColumnarMetadataTable(ColumnarChunkGroupRelationId(),
+										  Anum_columnar_chunkgroup_storageid,
+										  Anum_columnar_chunkgroup_stripe,
+										  ColumnarChunkGroupIndexRelationId(),
+										  storageId, stripeId);
+	DeleteStripeFromColumnarMetadataTable(ColumnarChunkRelationId(),
+										  Anum_columnar_chunk_storageid,
+										  Anum_columnar_chunk_stripe,
+										  ColumnarChunkIndexRelationId(),
+										  storageId, stripeId);
+	DeleteStripeFromColumnarMetadataTable(ColumnarStripeDeletionRelationId(),
+										  Anum_columnar_stripe_deletion_storageid,
+										  Anum_columnar_stripe_deletion_stripe,
+										  ColumnarStripeDeletionIndexRelationId(),
+										  storageId, stripeId);
+}
+
+
+/*
+ * DeleteStripeFromColumnarMetadataTable removes the rows with given storageId
+ * and stripeId from given columnar metadata table.
+ */
+static void
+DeleteStripeFromColumnarMetadataTable(Oid metadataTableId,
+									  AttrNumber storageIdAtrrNumber,
+									  AttrNumber stripeIdAttrNumber,
+									  Oid stripeIdIndexId,
+									  uint64 storageId, uint64 stripeId)
+{
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], storageIdAtrrNumber, BTEqualStrategyNumber,
+				F_INT8EQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], stripeIdAttrNumber, BTEqualStrategyNumber,
+				F_INT8EQ, UInt64GetDatum(stripeId));
+
+	Relation metadataTable = table_open(metadataTableId, AccessShareLock);
+	Relation index = index_open(stripeIdIndexId, AccessShareLock);
+
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(metadataTable, index, NULL,
+															2, scanKey);
+
+	ModifyState *modifyState = StartModifyRelation(metadataTable);
+
+	HeapTuple heapTuple;
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 ForwardScanDirection)))
+	{
+		DeleteTupleAndEnforceConstraints(modifyState, heapTuple);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+
+	FinishModifyRelation(modifyState);
+
+	index_close(index, AccessShareLock);
+	table_close(metadataTable, AccessShareLock);
+}
+
+
+/*
+ * InsertCompressionDictionary stores the given zstd dictionary as the
+ * current dictionary of the given column, which the next writes to the
+ * column compress with. Earlier dictionaries of the column are kept, since
+ * the chunks that were compressed with them refer to them by id.
+ */
+void
+InsertCompressionDictionary(RelFileNode relfilenode, AttrNumber attrNum,
+							bytea *dictionary)
+{
+	uint64 storageId = LookupStorageId(relfilenode);
+	uint32 dictionaryId = CompressionDictionaryId(dictionary);
+	int32 version = 1;
+
+	if (dictionaryId == 0)
+	{
+		ereport(ERROR, (errmsg("compression dictionary does not have an id")));
+	}
+
+	CompressionDictionary *existingDictionary = NULL;
+	foreach_ptr(existingDictionary,
+				ReadCompressionDictionaryList(storageId, GetTransactionSnapshot()))
+	{
+		if (existingDictionary->attrNum != attrNum)
+		{
+			continue;
+		}
+
+		if (existingDictionary->dictionaryId == dictionaryId)
+		{
+			/* same samples gave the same dictionary */
+			return;
+		}
+
+		version = Max(version, existingDictionary->version + 1);
+	}
+
+	InsertCompressionDictionaryRow(storageId, attrNum, dictionaryId, version,
+								   dictionary);
+}
+
+
+/*
+ * InsertCompressionDictionaryRow inserts a row to
+ * columnar_internal.compression_dictionary.
+ */
+static void
+InsertCompressionDictionaryRow(uint64 storageId, AttrNumber attrNum,
+							   uint64 dictionaryId, int32 version, bytea *dictionary)
+{
+	bool nulls[Natts_columnar_dictionary] = { false };
+	Datum values[Natts_columnar_dictionary] = { 0 };
+	values[Anum_columnar_dictionary_storageid - 1] = UInt64GetDatum(storageId);
+	values[Anum_columnar_dictionary_attr - 1] = Int32GetDatum(attrNum);
+	values[Anum_columnar_dictionary_dictionary_id - 1] = UInt64GetDatum(dictionaryId);
+	values[Anum_columnar_dictionary_version - 1] = Int32GetDatum(version);
+	values[Anum_columnar_dictionary_dictionary - 1] = PointerGetDatum(dictionary);
+
+	Relation columnarDictionaries = table_open(ColumnarCompressionDictionaryRelationId(),
+											   RowExclusiveLock);
+
+	ModifyState *modifyState = StartModifyRelation(columnarDictionaries);
+
+	InsertTupleAndEnforceConstraints(modifyState, values, nulls);
+
+	FinishModifyRelation(modifyState);
+
+	table_close(columnarDictionaries, RowExclusiveLock);
+}
+
+
+/*
+ * ReadCompressionDictionaryList returns the CompressionDictionary's of the
+ * given storage that are visible to the given snapshot.
+ */
+static List *
+ReadCompressionDictionaryList(uint64 storageId, Snapshot snapshot)
+{
+	List *dictionaryList = NIL;
+	ScanKeyData scanKey[1];
+
+	ScanKeyInit(&scanKey[0], Anum_columnar_dictionary_storageid,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
+
+	Relation columnarDictionaries =
+		try_relation_open(ColumnarCompressionDictionaryRelationId(), AccessShareLock);
+	if (columnarDictionaries == NULL)
+	{
+		/* extension has been dropped */
+		return NIL;
+	}
+
+	Relation index = index_open(ColumnarCompressionDictionaryIndexRelationId(),
+								AccessShareLock);
+
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarDictionaries, index,
+															snapshot, 1, scanKey);
+
+	HeapTuple heapTuple = NULL;
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 ForwardScanDirection)))
+	{
+		Datum datumArray[Natts_columnar_dictionary];
+		bool isNullArray[Natts_columnar_dictionary];
+
+		heap_deform_tuple(heapTuple, RelationGetDescr(columnarDictionaries),
+						  datumArray, isNullArray);
+
+		CompressionDictionary *dictionary = palloc0(sizeof(CompressionDictionary));
+		dictionary->attrNum =
+			DatumGetInt32(datumArray[Anum_columnar_dictionary_attr - 1]);
+		dictionary->dictionaryId =
+			DatumGetInt64(datumArray[Anum_columnar_dictionary_dictionary_id - 1]);
+		dictionary->version =
+			DatumGetInt32(datumArray[Anum_columnar_dictionary_version - 1]);
+		dictionary->dictionary =
+			DatumGetByteaPCopy(datumArray[Anum_columnar_dictionary_dictionary - 1]);
+
+		dictionaryList = lappend(dictionaryList, dictionary);
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	table_close(columnarDictionaries, AccessShareLock);
+
+	return dictionaryList;
+}
+
+
+/*
+ * ReadCompressionDictionary returns the compression dictionary with the given
+ * id of the given column, or NULL if there is no such dictionary. Since
+ * dictionaries are never modified, they are cached for the backend.
+ */
+bytea *
+ReadCompressionDictionary(RelFileNode relfilenode, AttrNumber attrNum,
+						  uint32 dictionaryId)
+{
+	uint64 storageId = LookupStorageId(relfilenode);
+
+	if (CompressionDictionaryCache == NULL)
+	{
+		CompressionDictionaryCacheContext =
+			AllocSetContextCreate(TopMemoryContext,
+								  "Columnar Compression Dictionary Cache",
+								  ALLOCSET_DEFAULT_SIZES);
+
+		HASHCTL hashInfo;
+		memset(&hashInfo, 0, sizeof(hashInfo));
+		hashInfo.keysize = sizeof(CompressionDictionaryCacheKey);
+		hashInfo.entrysize = sizeof(CompressionDictionaryCacheEntry);
+		hashInfo.hcxt = CompressionDictionaryCacheContext;
+
+		CompressionDictionaryCache = hash_create("Columnar Compression Dictionary Cache",
+												 32, &hashInfo,
+												 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	CompressionDictionaryCacheKey key;
+	memset(&key, 0, sizeof(key));
+	key.storageId = storageId;
+	key.attrNum = attrNum;
+	key.dictionaryId = dictionaryId;
+
+	CompressionDictionaryCacheEntry *entry =
+		hash_search(CompressionDictionaryCache, &key, HASH_FIND, NULL);
+	if (entry != NULL)
+	{
+		return entry->dictionary;
+	}
+
+	CompressionDictionary *dictionary = NULL;
+	foreach_ptr(dictionary, ReadCompressionDictionaryList(storageId,
+														  GetTransactionSnapshot()))
+	{
+		if (dictionary->attrNum != attrNum || dictionary->dictionaryId != dictionaryId)
+		{
+			continue;
+		}
+
+		bytea *cachedDictionary =
+			MemoryContextAlloc(CompressionDictionaryCacheContext,
+							   VARSIZE(dictionary->dictionary));
+		memcpy_s(cachedDictionary, VARSIZE(dictionary->dictionary),
+				 dictionary->dictionary, VARSIZE(dictionary->dictionary));
+
+		bool found = false;
+		entry = hash_search(CompressionDictionaryCache, &key, HASH_ENTER, &found);
+		entry->dictionary = cachedDictionary;
+
+		return entry->dictionary;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ReadLatestCompressionDictionaries returns an array with the current
+ * compression dictionary of each column, or NULL for the columns that do not
+ * have a dictionary.
+ */
+bytea **
+ReadLatestCompressionDictionaries(RelFileNode relfilenode, uint32 columnCount)
+{
+	uint64 storageId = LookupStorageId(relfilenode);
+	bytea **dictionaryArray = palloc0(columnCount * sizeof(bytea *));
+	int32 *versionArray = palloc0(columnCount * sizeof(int32));
+
+	CompressionDictionary *dictionary = NULL;
+	foreach_ptr(dictionary, ReadCompressionDictionaryList(storageId,
+														  GetTransactionSnapshot()))
+	{
+		int columnIndex = dictionary->attrNum - 1;
+		if (columnIndex < 0 || columnIndex >= columnCount ||
+			dictionary->version < versionArray[columnIndex])
+		{
+			continue;
+		}
+
+		dictionaryArray[columnIndex] = dictionary->dictionary;
+		versionArray[columnIndex] = dictionary->version;
+	}
+
+	pfree(versionArray);
+
+	return dictionaryArray;
+}
+
+
+/*
+ * CopyCompressionDictionaries copies the compression dictionaries of the
+ * source storage to the target storage, such that a rewritten table keeps
+ * compressing with the dictionaries that were trained for it.
+ */
+void
+CopyCompressionDictionaries(RelFileNode sourceRelfilenode,
+							RelFileNode targetRelfilenode)
+{
+	uint64 sourceStorageId = LookupStorageId(sourceRelfilenode);
+	uint64 targetStorageId = LookupStorageId(targetRelfilenode);
+
+	CompressionDictionary *dictionary = NULL;
+	foreach_ptr(dictionary, ReadCompressionDictionaryList(sourceStorageId,
+														  GetTransactionSnapshot()))
+	{
+		InsertCompressionDictionaryRow(targetStorageId, dictionary->attrNum,
+									   dictionary->dictionaryId, dictionary->version,
+									   dictionary->dictionary);
+	}
+}
+
+
+/*
+ * SaveStripeDeletedRows inserts a row to columnar_internal.stripe_deletion
+ * for the rows of the given stripe in the deletedRows bitmap. Rows of a
+ * stripe are deleted by inserting more bitmaps rather than by updating one,
+ * such that each transaction sees the deletions that are visible to it.
+ */
+void
+SaveStripeDeletedRows(RelFileNode relfilenode, uint64 stripeId, uint8 *deletedRows,
+					  uint64 rowCount)
+{
+	uint64 storageId = LookupStorageId(relfilenode);
+
+	Size bitmapSize = COLUMNAR_DELETION_BITMAP_SIZE(rowCount);
+	bytea *deletedRowsBytea = palloc0(bitmapSize + VARHDRSZ);
+	SET_VARSIZE(deletedRowsBytea, bitmapSize + VARHDRSZ);
+	memcpy_s(VARDATA(deletedRowsBytea), bitmapSize, deletedRows, bitmapSize);
+
+	bool nulls[Natts_columnar_stripe_deletion] = { false };
+	Datum values[Natts_columnar_stripe_deletion] = { 0 };
+	values[Anum_columnar_stripe_deletion_storageid - 1] = UInt64GetDatum(storageId);
+	values[Anum_columnar_stripe_deletion_stripe - 1] = UInt64GetDatum(stripeId);
+	values[Anum_columnar_stripe_deletion_deleted_rows - 1] =
+		PointerGetDatum(deletedRowsBytea);
+
+	Relation columnarStripeDeletions = table_open(ColumnarStripeDeletionRelationId(),
+												  RowExclusiveLock);
+
+	ModifyState *modifyState = StartModifyRelation(columnarStripeDeletions);
+
+	InsertTupleAndEnforceConstraints(modifyState, values, nulls);
+
+	FinishModifyRelation(modifyState);
+
+	table_close(columnarStripeDeletions, RowExclusiveLock);
+}
+
+
+/*
+ * ReadStripeDeletedRows returns a bitmap of the rows of the given stripe that
+ * the deletions visible to the given snapshot delete, or NULL if none of the
+ * rows are deleted. If deletedByOtherXacts is not NULL, it is set to a bitmap
+ * of the rows that other transactions than the current one deleted.
+ */
+uint8 *
+ReadStripeDeletedRows(RelFileNode relfilenode, uint64 stripeId, uint64 rowCount,
+					  Snapshot snapshot, uint8 **deletedByOtherXacts)
+{
+	uint64 storageId = LookupStorageId(relfilenode);
+	Size bitmapSize = COLUMNAR_DELETION_BITMAP_SIZE(rowCount);
+	uint8 *deletedRows = NULL;
+
+	if (deletedByOtherXacts != NULL)
+	{
+		*deletedByOtherXacts = NULL;
+	}
+
+	Oid columnarStripeDeletionsId = ColumnarStripeDeletionRelationId();
+	if (!OidIsValid(columnarStripeDeletionsId) || bitmapSize == 0)
+	{
+		/* tables cannot have deleted rows before stripe_deletion exists */
+		return NULL;
+	}
+
+	ScanKeyData scanKey[2];
+	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_deletion_storageid,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
+	ScanKeyInit(&scanKey[1], Anum_columnar_stripe_deletion_stripe,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(stripeId));
+
+	Relation columnarStripeDeletions = table_open(columnarStripeDeletionsId,
+												  AccessShareLock);
+	Relation index = index_open(ColumnarStripeDeletionIndexRelationId(),
+								AccessShareLock);
+
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripeDeletions,
+															index, snapshot, 2,
+															scanKey);
+
+	HeapTuple heapTuple = NULL;
+	while (HeapTupleIsValid(heapTuple = systable_getnext_ordered(scanDescriptor,
+																 ForwardScanDirection)))
+	{
+		Datum datumArray[Natts_columnar_stripe_deletion];
+		bool isNullArray[Natts_columnar_stripe_deletion];
+
+		heap_deform_tuple(heapTuple, RelationGetDescr(columnarStripeDeletions),
+						  datumArray, isNullArray);
+
+		bytea *deletedRowsBytea = DatumGetByteaPP(
+			datumArray[Anum_columnar_stripe_deletion_deleted_rows - 1]);
+		if (VARSIZE_ANY_EXHDR(deletedRowsBytea) != bitmapSize)
+		{
+			ereport(ERROR, (errmsg("deletion bitmap of stripe " UINT64_FORMAT
+								   " has an unexpected size", stripeId)));
+		}
+
+		if (deletedRows == NULL)
+		{
+			deletedRows = palloc0(bitmapSize);
+		}
+
+		uint8 *xactDeletedRows = (uint8 *) VARDATA_ANY(deletedRowsBytea);
+		for (Size byteIndex = 0; byteIndex < bitmapSize; byteIndex++)
+		{
+			deletedRows[byteIndex] |= xactDeletedRows[byteIndex];
+		}
+
+		if (deletedByOtherXacts != NULL &&
+			!TransactionIdIsCurrentTransactionId(HeapTupleHeaderGetXmin(
+													 heapTuple->t_data)))
+		{
+			if (*deletedByOtherXacts == NULL)
+			{
+				*deletedByOtherXacts = palloc0(bitmapSize);
+			}
+
+			for (Size byteIndex = 0; byteIndex < bitmapSize; byteIndex++)
+			{
+				(*deletedByOtherXacts)[byteIndex] |= xactDeletedRows[byteIndex];
+			}
+		}
+	}
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	table_close(columnarStripeDeletions, AccessShareLock);
+
+	return deletedRows;
+}
+
+
+/*
+ * StorageHasDeletedRows returns true if any rows of the given storage are
+ * deleted by the deletions that are visible to the given snapshot.
+ */
+bool
+StorageHasDeletedRows(RelFileNode relfilenode, Snapshot snapshot)
+{
+	Oid columnarStripeDeletionsId = ColumnarStripeDeletionRelationId();
+	if (!OidIsValid(columnarStripeDeletionsId))
+	{
+		return false;
+	}
+
+	uint64 storageId = LookupStorageId(relfilenode);
+
+	ScanKeyData scanKey[1];
+	ScanKeyInit(&scanKey[0], Anum_columnar_stripe_deletion_storageid,
+				BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(storageId));
+
+	Relation columnarStripeDeletions = table_open(columnarStripeDeletionsId,
+												  AccessShareLock);
+	Relation index = index_open(ColumnarStripeDeletionIndexRelationId(),
+								AccessShareLock);
+
+	SysScanDesc scanDescriptor = systable_beginscan_ordered(columnarStripeDeletions,
+															index, snapshot, 1,
+															scanKey);
+
+	bool hasDeletedRows =
+		HeapTupleIsValid(systable_getnext_ordered(scanDescriptor, ForwardScanDirection));
+
+	systable_endscan_ordered(scanDescriptor);
+	index_close(index, AccessShareLock);
+	table_close(columnarStripeDeletions, AccessShareLock);
+
+	return hasDeletedRows;
+}
+
+
+/*
+ * StartModifyRelation allocates resources for modifications.
+ */
+static ModifyState *
+StartModifyRelation(Relation rel)
+{
+	EState *estate = create_estate_for_relation(rel);
 
 #if PG_VERSION_NUM >= PG_VERSION_14
 	ResultRelInfo *resultRelInfo = makeNode(ResultRelInfo);
@@ -1795,6 +2907,50 @@ ColumnarChunkGroupRelationId(void)
 }
 
 
+/*
+ * ColumnarCompressionDictionaryRelationId returns relation id of
+ * columnar_internal.compression_dictionary.
+ */
+static Oid
+ColumnarCompressionDictionaryRelationId(void)
+{
+	return get_relname_relid("compression_dictionary", ColumnarNamespaceId());
+}
+
+
+/*
+ * ColumnarCompressionDictionaryIndexRelationId returns relation id of
+ * columnar_internal.compression_dictionary_pkey.
+ */
+static Oid
+ColumnarCompressionDictionaryIndexRelationId(void)
+{
+	return get_relname_relid("compression_dictionary_pkey", ColumnarNamespaceId());
+}
+
+
+/*
+ * ColumnarStripeDeletionRelationId returns relation id of
+ * columnar_internal.stripe_deletion.
+ */
+static Oid
+ColumnarStripeDeletionRelationId(void)
+{
+	return get_relname_relid("stripe_deletion", ColumnarNamespaceId());
+}
+
+
+/*
+ * ColumnarStripeDeletionIndexRelationId returns relation id of
+ * columnar_internal.stripe_deletion_stripe_idx.
+ */
+static Oid
+ColumnarStripeDeletionIndexRelationId(void)
+{
+	return get_relname_relid("stripe_deletion_stripe_idx", ColumnarNamespaceId());
+}
+
+
 /*
  * ColumnarChunkIndexRelationId returns relation id of columnar.chunk_pkey.
  * TODO: should we cache this similar to citus?
@@ -16,11 +16,15 @@
 
 #include "postgres.h"
 
+#include "miscadmin.h"
 #include "safe_lib.h"
 
+#include "access/hash.h"
 #include "access/nbtree.h"
+#include "access/relation.h"
 #include "access/xact.h"
 #include "catalog/pg_am.h"
+#include "catalog/pg_type.h"
 #include "commands/defrem.h"
 #include "distributed/listutils.h"
 #include "nodes/makefuncs.h"
@@ -28,13 +32,19 @@
 #include "optimizer/optimizer.h"
 #include "optimizer/clauses.h"
 #include "optimizer/restrictinfo.h"
+#include "portability/instr_time.h"
 #include "storage/fd.h"
+#include "utils/array.h"
 #include "utils/guc.h"
 #include "utils/memutils.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/spccache.h"
 
 #include "columnar/columnar.h"
+#include "columnar/columnar_bloom_filter.h"
+#include "columnar/columnar_chunk_cache.h"
 #include "columnar/columnar_storage.h"
 #include "columnar/columnar_tableam.h"
 #include "columnar/columnar_version_compat.h"
@@ -43,6 +53,49 @@
 	"attempted to read an unexpected stripe while reading columnar " \
 	"table %s, stripe with id=" UINT64_FORMAT " is not flushed"
 
+/*
+ * VectorizedQual is a comparison between a column and a constant that is
+ * evaluated over the values of the column in a whole chunk group, before the
+ * rows of the chunk group are materialized.
+ */
+typedef struct VectorizedQual
+{
+	int columnIndex;
+	FmgrInfo opFunction;
+	Oid collation;
+	Datum constValue;
+	bool columnIsLeftArg;
+} VectorizedQual;
+
+/*
+ * BloomFilterQual is an equality or IN qual on a column, with the hashes of
+ * the values that it looks for. Chunks whose bloom filters contain none of
+ * the hashes cannot contain rows that pass the qual.
+ */
+typedef struct BloomFilterQual
+{
+	int columnIndex;
+	uint32 *hashArray;
+	int hashCount;
+} BloomFilterQual;
+
+/*
+ * ColumnarPrefetchState tracks the ranges of a column that LoadColumnBuffers
+ * reads, in the order in which it reads them. Before each read, the blocks of
+ * the next prefetchDistance ranges are prefetched, such that their I/O
+ * overlaps with the synchronous reads of the ranges before them.
+ */
+typedef struct ColumnarPrefetchState
+{
+	Relation relation;
+	uint64 *offsetArray;
+	uint32 *lengthArray;
+	uint32 rangeCount;
+	uint32 prefetchedRangeCount;
+	uint32 readRangeCount;
+	int prefetchDistance;
+} ColumnarPrefetchState;
+
 typedef struct ChunkGroupReadState
 {
 	int64 currentRow;
@@ -50,6 +103,14 @@ typedef struct ChunkGroupReadState
 	int columnCount;
 	List *projectedColumnList;  /* borrowed reference */
 	ChunkData *chunkGroupData;
+
+	/*
+	 * Offsets of the rows that pass the vectorized quals in ascending order,
+	 * or NULL if there are no vectorized quals.
+	 */
+	uint32 *selectionVector;
+	uint32 selectionVectorLength;
+	uint32 selectionVectorIndex;
 } ChunkGroupReadState;
 
 typedef struct StripeReadState
@@ -61,10 +122,29 @@ typedef struct StripeReadState
 	Relation relation;
 	int chunkGroupIndex;
 	int64 chunkGroupsFiltered;
+	int64 rowsFiltered;
 	MemoryContext stripeReadContext;
 	StripeBuffers *stripeBuffers;   /* allocated in stripeReadContext */
 	List *projectedColumnList;      /* borrowed reference */
+	List *vectorizedQualList;       /* borrowed reference */
 	ChunkGroupReadState *chunkGroupReadState; /* owned */
+
+	/*
+	 * Bitmap of the deleted rows of the stripe that the snapshot of the read
+	 * sees, or NULL if there are none, and the offset in the stripe of the
+	 * row that was read last.
+	 */
+	uint8 *deletedRows;
+	uint64 lastRowOffset;
+
+	/*
+	 * For reads by row number, the chunk groups are loaded one at a time when
+	 * they are read. stripeBuffers then only holds the chunk group being
+	 * read, allocated in chunkGroupLoadContext.
+	 */
+	StripeMetadata *stripeMetadata;     /* borrowed reference */
+	StripeSkipList *stripeSkipList;
+	MemoryContext chunkGroupLoadContext;
 } StripeReadState;
 
 struct ColumnarReadState
@@ -84,8 +164,12 @@ struct ColumnarReadState
 	List *whereClauseList;
 	List *whereClauseVars;
 
+	/* VectorizedQual list built from whereClauseList */
+	List *vectorizedQualList;
+
 	MemoryContext stripeReadContext;
 	int64 chunkGroupsFiltered;
+	int64 rowsFiltered;
 
 	/*
 	 * Memory context guaranteed to be not freed during scan so we can
@@ -96,6 +180,20 @@ struct ColumnarReadState
 
 	Snapshot snapshot;
 	bool snapshotRegisteredByUs;
+
+	/*
+	 * In a parallel scan, the counter in shared memory from which the
+	 * participants claim the stripes they read, and the position of
+	 * currentStripeMetadata among the stripes of the table.
+	 */
+	pg_atomic_uint64 *parallelStripeCounter;
+	uint64 currentStripeIndex;
+
+	/*
+	 * Buffer ring used by sequential reads of large tables, such that they do
+	 * not evict the rest of shared_buffers, or NULL.
+	 */
+	BufferAccessStrategy bulkReadStrategy;
 };
 
 /* static function declarations */
@@ -108,30 +206,57 @@ static void ReadStripeRowByRowNumber(ColumnarReadState *readState,
 									 bool *columnNulls);
 static bool StripeReadIsCurrentChunkGroup(StripeReadState *stripeReadState,
 										  int chunkGroupIndex);
+static int FindChunkGroupByRowOffset(StripeSkipList *stripeSkipList,
+									 uint64 stripeRowOffset,
+									 uint64 *chunkGroupRowOffset);
 static void ReadChunkGroupRowByRowOffset(ChunkGroupReadState *chunkGroupReadState,
-										 StripeMetadata *stripeMetadata,
-										 uint64 stripeRowOffset, Datum *columnValues,
-										 bool *columnNulls);
+										 uint64 chunkGroupRowOffset,
+										 Datum *columnValues, bool *columnNulls);
 static bool StripeReadInProgress(ColumnarReadState *readState);
 static bool HasUnreadStripe(ColumnarReadState *readState);
+static StripeReadState * BeginStripeRowNumberRead(StripeMetadata *stripeMetadata,
+												  Relation rel, TupleDesc tupleDesc,
+												  List *projectedColumnList,
+												  MemoryContext stripeReadContext,
+												  Snapshot snapshot);
+static void LoadChunkGroupForRowNumberRead(StripeReadState *stripeReadState,
+										   int chunkGroupIndex);
 static StripeReadState * BeginStripeRead(StripeMetadata *stripeMetadata, Relation rel,
 										 TupleDesc tupleDesc, List *projectedColumnList,
 										 List *whereClauseList, List *whereClauseVars,
+										 List *vectorizedQualList,
 										 MemoryContext stripeReadContext,
-										 Snapshot snapshot);
+										 Snapshot snapshot,
+										 BufferAccessStrategy strategy);
 static void AdvanceStripeRead(ColumnarReadState *readState);
+static StripeMetadata * FindNextReadableStripe(ColumnarReadState *readState,
+											   uint64 lastReadRowNumber);
+static void SkipToClaimedStripe(ColumnarReadState *readState);
 static bool SnapshotMightSeeUnflushedStripes(Snapshot snapshot);
+static uint8 * ReadVisibleDeletedRows(Relation relation, StripeMetadata *stripeMetadata,
+									  Snapshot snapshot);
+static bool RowNumberReadSkipsDeletedRows(Snapshot snapshot);
+static uint32 RemoveDeletedChunkGroupRows(ChunkData *chunkGroupData,
+										  List *projectedColumnList, uint32 rowCount,
+										  uint8 *deletedRows, uint64 firstRowOffset);
 static bool ReadStripeNextRow(StripeReadState *stripeReadState, Datum *columnValues,
 							  bool *columnNulls);
 static ChunkGroupReadState * BeginChunkGroupRead(StripeBuffers *stripeBuffers, int
 												 chunkIndex,
 												 TupleDesc tupleDesc,
 												 List *projectedColumnList,
+												 List *vectorizedQualList,
 												 MemoryContext cxt);
 static void EndChunkGroupRead(ChunkGroupReadState *chunkGroupReadState);
 static bool ReadChunkGroupNextRow(ChunkGroupReadState *chunkGroupReadState,
 								  Datum *columnValues,
-								  bool *columnNulls);
+								  bool *columnNulls,
+								  int64 *skippedRowCount);
+static List * BuildVectorizedQualList(List *whereClauseList, List *projectedColumnList);
+static bool EvaluateVectorizedQual(VectorizedQual *vectorizedQual, Datum value);
+static uint32 * EvaluateVectorizedQuals(ChunkData *chunkGroupData, uint32 rowCount,
+										List *vectorizedQualList,
+										uint32 *selectedRowCount);
 static StripeBuffers * LoadFilteredStripeBuffers(Relation relation,
 												 StripeMetadata *stripeMetadata,
 												 TupleDesc tupleDescriptor,
@@ -139,14 +264,31 @@ static StripeBuffers * LoadFilteredStripeBuffers(Relation relation,
 												 List *whereClauseList,
 												 List *whereClauseVars,
 												 int64 *chunkGroupsFiltered,
-												 Snapshot snapshot);
+												 Snapshot snapshot,
+												 BufferAccessStrategy strategy);
+static StripeBuffers * LoadSelectedChunkBuffers(Relation relation,
+												StripeMetadata *stripeMetadata,
+												TupleDesc tupleDescriptor,
+												bool *projectedColumnMask,
+												StripeSkipList *stripeSkipList,
+												bool *selectedChunkMask,
+												BufferAccessStrategy strategy);
 static ColumnBuffers * LoadColumnBuffers(Relation relation,
 										 ColumnChunkSkipNode *chunkSkipNodeArray,
 										 uint32 chunkCount, uint64 stripeOffset,
-										 Form_pg_attribute attributeForm);
+										 Form_pg_attribute attributeForm,
+										 ColumnarChunkCacheKey *stripeCacheKey,
+										 uint32 *chunkIndexArray,
+										 BufferAccessStrategy strategy);
+static void AddPrefetchRange(ColumnarPrefetchState *prefetchState, uint64 offset,
+							 uint32 length);
+static void PrefetchAheadOfRead(ColumnarPrefetchState *prefetchState);
 static bool * SelectedChunkMask(StripeSkipList *stripeSkipList,
 								List *whereClauseList, List *whereClauseVars,
 								int64 *chunkGroupsFiltered);
+static BloomFilterQual * BuildBloomFilterQual(Node *clause);
+static bool BloomFilterQualMightPass(BloomFilterQual *bloomFilterQual,
+									 bytea *bloomFilter);
 static Node * BuildBaseConstraint(Var *variable);
 static List * GetClauseVars(List *clauses, int natts);
 static OpExpr * MakeOpExpression(Var *variable, int16 strategyNumber);
@@ -163,23 +305,35 @@ static void DeserializeDatumArray(StringInfo datumBuffer, bool *existsArray,
 								  uint32 datumCount, bool datumTypeByValue,
 								  int datumTypeLength, char datumTypeAlign,
 								  Datum *datumArray);
+static void DeserializeFixedWidthDatumArray(StringInfo datumBuffer, bool *existsArray,
+											uint32 datumCount, int datumTypeLength,
+											Datum *datumArray);
 static ChunkData * DeserializeChunkData(StripeBuffers *stripeBuffers, uint64 chunkIndex,
 										uint32 rowCount, TupleDesc tupleDescriptor,
 										List *projectedColumnList);
+static void DeserializeChunkColumn(StripeBuffers *stripeBuffers, uint64 chunkIndex,
+								   uint32 rowCount, TupleDesc tupleDescriptor,
+								   int columnIndex, ChunkData *chunkData);
 static Datum ColumnDefaultValue(TupleConstr *tupleConstraints,
 								Form_pg_attribute attributeForm);
 
+/* only for benchmarking purposes */
+PG_FUNCTION_INFO_V1(test_columnar_deserialize_chunks);
+
 /*
  * ColumnarBeginRead initializes a columnar read operation. This function returns a
  * read handle that's used during reading rows and finishing the read operation.
  *
  * projectedColumnList is an integer list of attribute numbers (1-indexed).
+ *
+ * If parallelStripeCounter is not NULL, the read is part of a parallel scan
+ * and only reads the stripes that it claims from the shared counter.
  */
 ColumnarReadState *
 ColumnarBeginRead(Relation relation, TupleDesc tupleDescriptor,
 				  List *projectedColumnList, List *whereClauseList,
 				  MemoryContext scanContext, Snapshot snapshot,
-				  bool randomAccess)
+				  bool randomAccess, pg_atomic_uint64 *parallelStripeCounter)
 {
 	/*
 	 * We allocate all stripe specific data in the stripeReadContext, and reset
@@ -193,11 +347,28 @@ ColumnarBeginRead(Relation relation, TupleDesc tupleDescriptor,
 	readState->projectedColumnList = projectedColumnList;
 	readState->whereClauseList = whereClauseList;
 	readState->whereClauseVars = GetClauseVars(whereClauseList, tupleDescriptor->natts);
+	readState->vectorizedQualList = BuildVectorizedQualList(whereClauseList,
+															projectedColumnList);
 	readState->chunkGroupsFiltered = 0;
+	readState->rowsFiltered = 0;
 	readState->tupleDescriptor = tupleDescriptor;
 	readState->stripeReadContext = stripeReadContext;
 	readState->stripeReadState = NULL;
 	readState->scanContext = scanContext;
+	readState->parallelStripeCounter = parallelStripeCounter;
+	readState->currentStripeIndex = 0;
+
+	/*
+	 * Like heap sequential scans, read tables that are larger than a quarter
+	 * of shared_buffers through a BULKREAD ring. Random access reads single
+	 * rows and keeps using normal buffer replacement.
+	 */
+	readState->bulkReadStrategy = NULL;
+	if (columnar_enable_bulk_read_strategy && !randomAccess &&
+		RelationGetNumberOfBlocks(relation) > NBuffers / 4)
+	{
+		readState->bulkReadStrategy = GetAccessStrategy(BAS_BULKREAD);
+	}
 
 	/*
 	 * Note that ColumnarReadFlushPendingWrites might update those two by
@@ -326,6 +497,11 @@ ColumnarReadNextRow(ColumnarReadState *readState, Datum *columnValues, bool *col
 	{
 		if (!StripeReadInProgress(readState))
 		{
+			if (readState->parallelStripeCounter != NULL)
+			{
+				SkipToClaimedStripe(readState);
+			}
+
 			if (!HasUnreadStripe(readState))
 			{
 				return false;
@@ -337,8 +513,10 @@ ColumnarReadNextRow(ColumnarReadState *readState, Datum *columnValues, bool *col
 														 readState->projectedColumnList,
 														 readState->whereClauseList,
 														 readState->whereClauseVars,
+														 readState->vectorizedQualList,
 														 readState->stripeReadContext,
-														 readState->snapshot);
+														 readState->snapshot,
+														 readState->bulkReadStrategy);
 		}
 
 		if (!ReadStripeNextRow(readState->stripeReadState, columnValues, columnNulls))
@@ -350,7 +528,7 @@ ColumnarReadNextRow(ColumnarReadState *readState, Datum *columnValues, bool *col
 		if (rowNumber)
 		{
 			*rowNumber = readState->currentStripeMetadata->firstRowNumber +
-						 readState->stripeReadState->currentRow - 1;
+						 readState->stripeReadState->lastRowOffset;
 		}
 
 		return true;
@@ -360,6 +538,157 @@ ColumnarReadNextRow(ColumnarReadState *readState, Datum *columnValues, bool *col
 }
 
 
+/*
+ * ColumnarReadNextChunkGroup reads the next chunk group of the columnar table
+ * and returns its column vectors in chunkGroupData and its number of rows in
+ * rowCount, such that callers can process the projected columns of the chunk
+ * group without forming tuples. The returned data is valid until the next
+ * call. If there are no more chunk groups to read, the function returns
+ * false.
+ */
+bool
+ColumnarReadNextChunkGroup(ColumnarReadState *readState, ChunkData **chunkGroupData,
+						   uint32 *rowCount)
+{
+	while (true)
+	{
+		if (!StripeReadInProgress(readState))
+		{
+			if (!HasUnreadStripe(readState))
+			{
+				return false;
+			}
+
+			readState->stripeReadState = BeginStripeRead(readState->currentStripeMetadata,
+														 readState->relation,
+														 readState->tupleDescriptor,
+														 readState->projectedColumnList,
+														 readState->whereClauseList,
+														 readState->whereClauseVars,
+														 NIL,
+														 readState->stripeReadContext,
+														 readState->snapshot,
+														 readState->bulkReadStrategy);
+		}
+
+		StripeReadState *stripeReadState = readState->stripeReadState;
+
+		/* finish the chunk group that the previous call returned */
+		if (stripeReadState->chunkGroupReadState != NULL)
+		{
+			EndChunkGroupRead(stripeReadState->chunkGroupReadState);
+			stripeReadState->chunkGroupReadState = NULL;
+			stripeReadState->chunkGroupIndex++;
+		}
+
+		if (stripeReadState->currentRow >= stripeReadState->rowCount)
+		{
+			AdvanceStripeRead(readState);
+			continue;
+		}
+
+		ChunkGroupReadState *chunkGroupReadState =
+			BeginChunkGroupRead(stripeReadState->stripeBuffers,
+								stripeReadState->chunkGroupIndex,
+								stripeReadState->tupleDescriptor,
+								stripeReadState->projectedColumnList,
+								NIL,
+								stripeReadState->stripeReadContext);
+
+		/* the whole chunk group is consumed by the caller */
+		chunkGroupReadState->currentRow = chunkGroupReadState->rowCount;
+		stripeReadState->currentRow += chunkGroupReadState->rowCount;
+		stripeReadState->chunkGroupReadState = chunkGroupReadState;
+
+		*chunkGroupData = chunkGroupReadState->chunkGroupData;
+		*rowCount = chunkGroupReadState->rowCount;
+
+		if (stripeReadState->deletedRows != NULL)
+		{
+			StripeBuffers *stripeBuffers = stripeReadState->stripeBuffers;
+			uint64 firstRowOffset =
+				stripeBuffers->selectedChunkGroupRowOffsets[
+					stripeReadState->chunkGroupIndex];
+
+			*rowCount = RemoveDeletedChunkGroupRows(*chunkGroupData,
+													stripeReadState->projectedColumnList,
+													*rowCount,
+													stripeReadState->deletedRows,
+													firstRowOffset);
+			if (*rowCount == 0)
+			{
+				continue;
+			}
+		}
+
+		return true;
+	}
+}
+
+
+/*
+ * ColumnarReadNextStripeSkipList returns the skip list of the next stripe of
+ * the columnar table in stripeSkipList, without reading the data of the
+ * stripe. The skip list has the row counts of the chunk groups and the
+ * minimum and maximum values of the chunks. The returned skip list is valid
+ * until the next call. If there are no more stripes to read, the function
+ * returns false.
+ *
+ * This function cannot be mixed with the other functions that read the table
+ * sequentially within the same read operation.
+ */
+bool
+ColumnarReadNextStripeSkipList(ColumnarReadState *readState,
+							   StripeSkipList **stripeSkipList)
+{
+	if (StripeReadInProgress(readState))
+	{
+		AdvanceStripeRead(readState);
+	}
+
+	if (!HasUnreadStripe(readState))
+	{
+		return false;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->stripeReadContext);
+
+	StripeMetadata *stripeMetadata = readState->currentStripeMetadata;
+
+	/* an empty stripe read state makes AdvanceStripeRead move past the stripe */
+	readState->stripeReadState = palloc0(sizeof(StripeReadState));
+
+	*stripeSkipList = ReadStripeSkipList(readState->relation->rd_node,
+										 stripeMetadata->id,
+										 readState->tupleDescriptor,
+										 stripeMetadata->chunkCount,
+										 readState->snapshot);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return true;
+}
+
+
+/*
+ * ColumnarReadHasDeletedRows returns true if the table of the read has rows
+ * that are deleted for the snapshot of the read, in which case the row
+ * counts and minimum and maximum values of the skip lists do not describe
+ * the rows that the read sees.
+ */
+bool
+ColumnarReadHasDeletedRows(ColumnarReadState *readState)
+{
+	Snapshot snapshot = readState->snapshot;
+	if (snapshot != InvalidSnapshot && !IsMVCCSnapshot(snapshot))
+	{
+		snapshot = SnapshotSelf;
+	}
+
+	return StorageHasDeletedRows(readState->relation->rd_node, snapshot);
+}
+
+
 /*
  * ColumnarReadRowByRowNumberOrError is a wrapper around
  * ColumnarReadRowByRowNumber that throws an error if tuple
@@ -419,21 +748,33 @@ ColumnarReadRowByRowNumber(ColumnarReadState *readState,
 		ColumnarResetRead(readState);
 
 		TupleDesc relationTupleDesc = RelationGetDescr(columnarRelation);
-		List *whereClauseList = NIL;
-		List *whereClauseVars = NIL;
 		MemoryContext stripeReadContext = readState->stripeReadContext;
-		readState->stripeReadState = BeginStripeRead(stripeMetadata,
-													 columnarRelation,
-													 relationTupleDesc,
-													 readState->projectedColumnList,
-													 whereClauseList,
-													 whereClauseVars,
-													 stripeReadContext,
-													 snapshot);
+		readState->stripeReadState =
+			BeginStripeRowNumberRead(stripeMetadata, columnarRelation,
+									 relationTupleDesc,
+									 readState->projectedColumnList,
+									 stripeReadContext, snapshot);
 
 		readState->currentStripeMetadata = stripeMetadata;
 	}
 
+	StripeMetadata *stripeMetadata = readState->currentStripeMetadata;
+	uint64 rowOffset = rowNumber - stripeMetadata->firstRowNumber;
+	uint8 *deletedRows = readState->stripeReadState->deletedRows;
+	if (deletedRows != NULL && COLUMNAR_ROW_IS_DELETED(deletedRows, rowOffset))
+	{
+		return false;
+	}
+
+	/* random access reads do not flush the deletions of the current transaction */
+	if (RowNumberReadSkipsDeletedRows(readState->snapshot) &&
+		RowDeletedByCurrentSubXact(readState->relation->rd_node.relNode,
+								   GetCurrentSubTransactionId(), stripeMetadata->id,
+								   rowOffset))
+	{
+		return false;
+	}
+
 	ReadStripeRowByRowNumber(readState, rowNumber, columnValues, columnNulls);
 
 	return true;
@@ -495,29 +836,68 @@ ReadStripeRowByRowNumber(ColumnarReadState *readState,
 
 	/* find the exact chunk group to be read */
 	uint64 stripeRowOffset = rowNumber - stripeMetadata->firstRowNumber;
-	int chunkGroupIndex = stripeRowOffset / stripeMetadata->chunkGroupRowCount;
+	uint64 chunkGroupRowOffset = 0;
+	int chunkGroupIndex = FindChunkGroupByRowOffset(stripeReadState->stripeSkipList,
+													stripeRowOffset,
+													&chunkGroupRowOffset);
 	if (!StripeReadIsCurrentChunkGroup(stripeReadState, chunkGroupIndex))
 	{
 		if (stripeReadState->chunkGroupReadState)
 		{
 			EndChunkGroupRead(stripeReadState->chunkGroupReadState);
+			stripeReadState->chunkGroupReadState = NULL;
 		}
 
+		LoadChunkGroupForRowNumberRead(stripeReadState, chunkGroupIndex);
+
+		/* stripeBuffers only holds the chunk group that we just loaded */
 		stripeReadState->chunkGroupIndex = chunkGroupIndex;
 		stripeReadState->chunkGroupReadState = BeginChunkGroupRead(
 			stripeReadState->stripeBuffers,
-			stripeReadState->chunkGroupIndex,
+			0,
 			stripeReadState->tupleDescriptor,
 			stripeReadState->projectedColumnList,
+			NIL,
 			stripeReadState->stripeReadContext);
 	}
 
 	ReadChunkGroupRowByRowOffset(stripeReadState->chunkGroupReadState,
-								 stripeMetadata, stripeRowOffset,
+								 stripeRowOffset - chunkGroupRowOffset,
 								 columnValues, columnNulls);
 }
 
 
+/*
+ * FindChunkGroupByRowOffset returns the index of the chunk group that holds
+ * the row with stripeRowOffset, and sets chunkGroupRowOffset to the offset of
+ * its first row in the stripe. Chunk groups do not necessarily have
+ * chunk_group_row_limit rows when columnar.chunk_group_size_limit was set
+ * during the write, so we go by the row counts in the skip list. Returns -1
+ * if the stripe has no such row.
+ */
+static int
+FindChunkGroupByRowOffset(StripeSkipList *stripeSkipList, uint64 stripeRowOffset,
+						  uint64 *chunkGroupRowOffset)
+{
+	uint64 chunkGroupFirstRowOffset = 0;
+
+	for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	{
+		uint32 chunkGroupRowCount = stripeSkipList->chunkGroupRowCounts[chunkIndex];
+
+		if (stripeRowOffset < chunkGroupFirstRowOffset + chunkGroupRowCount)
+		{
+			*chunkGroupRowOffset = chunkGroupFirstRowOffset;
+			return chunkIndex;
+		}
+
+		chunkGroupFirstRowOffset += chunkGroupRowCount;
+	}
+
+	return -1;
+}
+
+
 /*
  * StripeReadIsCurrentChunkGroup returns true if chunk group being read is
  * the has given chunkGroupIndex in its stripe.
@@ -535,20 +915,21 @@ StripeReadIsCurrentChunkGroup(StripeReadState *stripeReadState, int chunkGroupIn
 
 
 /*
- * ReadChunkGroupRowByRowOffset reads row with stripeRowOffset from given
+ * ReadChunkGroupRowByRowOffset reads row with chunkGroupRowOffset from given
  * chunkGroupReadState into columnValues and columnNulls.
  * Errors out if no such row exists in the chunk group being read.
  */
 static void
 ReadChunkGroupRowByRowOffset(ChunkGroupReadState *chunkGroupReadState,
-							 StripeMetadata *stripeMetadata,
-							 uint64 stripeRowOffset, Datum *columnValues,
+							 uint64 chunkGroupRowOffset, Datum *columnValues,
 							 bool *columnNulls)
 {
 	/* set the exact row number to be read from given chunk roup */
-	chunkGroupReadState->currentRow = stripeRowOffset %
-									  stripeMetadata->chunkGroupRowCount;
-	if (!ReadChunkGroupNextRow(chunkGroupReadState, columnValues, columnNulls))
+	chunkGroupReadState->currentRow = chunkGroupRowOffset;
+
+	int64 skippedRowCount = 0;
+	if (!ReadChunkGroupNextRow(chunkGroupReadState, columnValues, columnNulls,
+							   &skippedRowCount))
 	{
 		/* not expected but be on the safe side */
 		ereport(ERROR, (errmsg("could not find the row in stripe")));
@@ -592,8 +973,11 @@ ColumnarRescan(ColumnarReadState *readState, List *scanQual)
 	AdvanceStripeRead(readState);
 
 	readState->chunkGroupsFiltered = 0;
+	readState->rowsFiltered = 0;
 
 	readState->whereClauseList = copyObject(scanQual);
+	readState->vectorizedQualList = BuildVectorizedQualList(readState->whereClauseList,
+															readState->projectedColumnList);
 	MemoryContextSwitchTo(oldContext);
 }
 
@@ -619,6 +1003,11 @@ ColumnarEndRead(ColumnarReadState *readState)
 		pfree(readState->currentStripeMetadata);
 	}
 
+	if (readState->bulkReadStrategy != NULL)
+	{
+		FreeAccessStrategy(readState->bulkReadStrategy);
+	}
+
 	pfree(readState);
 }
 
@@ -647,7 +1036,8 @@ ColumnarResetRead(ColumnarReadState *readState)
 static StripeReadState *
 BeginStripeRead(StripeMetadata *stripeMetadata, Relation rel, TupleDesc tupleDesc,
 				List *projectedColumnList, List *whereClauseList, List *whereClauseVars,
-				MemoryContext stripeReadContext, Snapshot snapshot)
+				List *vectorizedQualList, MemoryContext stripeReadContext,
+				Snapshot snapshot, BufferAccessStrategy strategy)
 {
 	MemoryContext oldContext = MemoryContextSwitchTo(stripeReadContext);
 
@@ -658,6 +1048,7 @@ BeginStripeRead(StripeMetadata *stripeMetadata, Relation rel, TupleDesc tupleDes
 	stripeReadState->columnCount = tupleDesc->natts;
 	stripeReadState->chunkGroupReadState = NULL;
 	stripeReadState->projectedColumnList = projectedColumnList;
+	stripeReadState->vectorizedQualList = vectorizedQualList;
 	stripeReadState->stripeReadContext = stripeReadContext;
 
 	stripeReadState->stripeBuffers = LoadFilteredStripeBuffers(rel,
@@ -668,9 +1059,11 @@ BeginStripeRead(StripeMetadata *stripeMetadata, Relation rel, TupleDesc tupleDes
 															   whereClauseVars,
 															   &stripeReadState->
 															   chunkGroupsFiltered,
-															   snapshot);
+															   snapshot, strategy);
 
 	stripeReadState->rowCount = stripeReadState->stripeBuffers->rowCount;
+	stripeReadState->deletedRows = ReadVisibleDeletedRows(rel, stripeMetadata,
+														  snapshot);
 
 	MemoryContextSwitchTo(oldContext);
 
@@ -679,6 +1072,89 @@ BeginStripeRead(StripeMetadata *stripeMetadata, Relation rel, TupleDesc tupleDes
 }
 
 
+/*
+ * BeginStripeRowNumberRead allocates state for reading rows of a stripe by
+ * their row numbers. Unlike BeginStripeRead, it only reads the skip list of
+ * the stripe, and LoadChunkGroupForRowNumberRead loads the chunk group of
+ * each row that is read, such that index scans do not read the data of the
+ * whole stripe to fetch a few rows.
+ */
+static StripeReadState *
+BeginStripeRowNumberRead(StripeMetadata *stripeMetadata, Relation rel,
+						 TupleDesc tupleDesc, List *projectedColumnList,
+						 MemoryContext stripeReadContext, Snapshot snapshot)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(stripeReadContext);
+
+	StripeReadState *stripeReadState = palloc0(sizeof(StripeReadState));
+
+	stripeReadState->relation = rel;
+	stripeReadState->tupleDescriptor = tupleDesc;
+	stripeReadState->columnCount = tupleDesc->natts;
+	stripeReadState->chunkGroupReadState = NULL;
+	stripeReadState->projectedColumnList = projectedColumnList;
+	stripeReadState->vectorizedQualList = NIL;
+	stripeReadState->stripeReadContext = stripeReadContext;
+	stripeReadState->rowCount = stripeMetadata->rowCount;
+
+	stripeReadState->stripeSkipList = ReadStripeSkipList(rel->rd_node,
+														 stripeMetadata->id,
+														 tupleDesc,
+														 stripeMetadata->chunkCount,
+														 snapshot);
+	stripeReadState->stripeMetadata = stripeMetadata;
+	stripeReadState->deletedRows = NULL;
+	if (RowNumberReadSkipsDeletedRows(snapshot))
+	{
+		stripeReadState->deletedRows = ReadVisibleDeletedRows(rel, stripeMetadata,
+															  snapshot);
+	}
+	stripeReadState->chunkGroupLoadContext =
+		AllocSetContextCreate(stripeReadContext, "Columnar Chunk Group Load Context",
+							  ALLOCSET_DEFAULT_SIZES);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return stripeReadState;
+}
+
+
+/*
+ * LoadChunkGroupForRowNumberRead replaces the stripe buffers of a read by
+ * row number with the buffers of the given chunk group of the stripe.
+ */
+static void
+LoadChunkGroupForRowNumberRead(StripeReadState *stripeReadState, int chunkGroupIndex)
+{
+	StripeSkipList *stripeSkipList = stripeReadState->stripeSkipList;
+
+	if (chunkGroupIndex < 0 || chunkGroupIndex >= stripeSkipList->chunkCount)
+	{
+		/* not expected but be on the safe side */
+		ereport(ERROR, (errmsg("could not find the row in stripe")));
+	}
+
+	/* chunk data of the previous chunk group is already freed */
+	MemoryContextReset(stripeReadState->chunkGroupLoadContext);
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(stripeReadState->chunkGroupLoadContext);
+
+	TupleDesc tupleDesc = stripeReadState->tupleDescriptor;
+	bool *projectedColumnMask = ProjectedColumnMask(tupleDesc->natts,
+													stripeReadState->projectedColumnList);
+	bool *selectedChunkMask = palloc0(stripeSkipList->chunkCount * sizeof(bool));
+	selectedChunkMask[chunkGroupIndex] = true;
+
+	stripeReadState->stripeBuffers =
+		LoadSelectedChunkBuffers(stripeReadState->relation,
+								 stripeReadState->stripeMetadata, tupleDesc,
+								 projectedColumnMask, stripeSkipList,
+								 selectedChunkMask, NULL);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
 /*
  * AdvanceStripeRead updates chunkGroupsFiltered and sets
  * currentStripeMetadata for next stripe read.
@@ -690,21 +1166,42 @@ AdvanceStripeRead(ColumnarReadState *readState)
 
 	/* if not read any stripes yet, start from the first one .. */
 	uint64 lastReadRowNumber = COLUMNAR_INVALID_ROW_NUMBER;
+	uint64 nextStripeIndex = 0;
 	if (StripeReadInProgress(readState))
 	{
 		/* .. otherwise, continue with the next stripe */
 		lastReadRowNumber = StripeGetHighestRowNumber(readState->currentStripeMetadata);
+		nextStripeIndex = readState->currentStripeIndex + 1;
 
 		readState->chunkGroupsFiltered +=
 			readState->stripeReadState->chunkGroupsFiltered;
+		readState->rowsFiltered += readState->stripeReadState->rowsFiltered;
 	}
 
-	readState->currentStripeMetadata = FindNextStripeByRowNumber(readState->relation,
-																 lastReadRowNumber,
-																 readState->snapshot);
+	readState->currentStripeMetadata = FindNextReadableStripe(readState,
+															  lastReadRowNumber);
+	readState->currentStripeIndex = nextStripeIndex;
+
+	readState->stripeReadState = NULL;
+	MemoryContextReset(readState->stripeReadContext);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * FindNextReadableStripe returns the first flushed stripe after the row with
+ * the given row number, or NULL if there is no such stripe.
+ */
+static StripeMetadata *
+FindNextReadableStripe(ColumnarReadState *readState, uint64 lastReadRowNumber)
+{
+	StripeMetadata *stripeMetadata = FindNextStripeByRowNumber(readState->relation,
+															   lastReadRowNumber,
+															   readState->snapshot);
 
-	if (readState->currentStripeMetadata &&
-		StripeWriteState(readState->currentStripeMetadata) != STRIPE_WRITE_FLUSHED &&
+	if (stripeMetadata &&
+		StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED &&
 		!SnapshotMightSeeUnflushedStripes(readState->snapshot))
 	{
 		/*
@@ -714,20 +1211,51 @@ AdvanceStripeRead(ColumnarReadState *readState)
 		 */
 		ereport(ERROR, (errmsg(UNEXPECTED_STRIPE_READ_ERR_MSG,
 							   RelationGetRelationName(readState->relation),
-							   readState->currentStripeMetadata->id)));
+							   stripeMetadata->id)));
 	}
 
-	while (readState->currentStripeMetadata &&
-		   StripeWriteState(readState->currentStripeMetadata) != STRIPE_WRITE_FLUSHED)
+	while (stripeMetadata &&
+		   StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED)
 	{
-		readState->currentStripeMetadata =
-			FindNextStripeByRowNumber(readState->relation,
-									  readState->currentStripeMetadata->firstRowNumber,
-									  readState->snapshot);
+		stripeMetadata = FindNextStripeByRowNumber(readState->relation,
+												   stripeMetadata->firstRowNumber,
+												   readState->snapshot);
 	}
 
-	readState->stripeReadState = NULL;
-	MemoryContextReset(readState->stripeReadContext);
+	return stripeMetadata;
+}
+
+
+/*
+ * SkipToClaimedStripe claims the next stripe to read from the counter that
+ * the participants of a parallel scan share, and moves currentStripeMetadata
+ * forward to it. All participants use the same snapshot, so they see the
+ * same stripes in the same order, and each stripe is read by exactly one of
+ * them.
+ *
+ * Stripes are claimed only right before they are read, such that a rescan
+ * that happens before the shared counter is reinitialized does not lose one.
+ */
+static void
+SkipToClaimedStripe(ColumnarReadState *readState)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(readState->scanContext);
+
+	uint64 claimedStripeIndex = pg_atomic_fetch_add_u64(readState->parallelStripeCounter,
+														1);
+
+	while (readState->currentStripeMetadata != NULL &&
+		   readState->currentStripeIndex < claimedStripeIndex)
+	{
+		StripeMetadata *skippedStripeMetadata = readState->currentStripeMetadata;
+
+		readState->currentStripeMetadata =
+			FindNextReadableStripe(readState,
+								   StripeGetHighestRowNumber(skippedStripeMetadata));
+		readState->currentStripeIndex++;
+
+		pfree(skippedStripeMetadata);
+	}
 
 	MemoryContextSwitchTo(oldContext);
 }
@@ -762,50 +1290,161 @@ SnapshotMightSeeUnflushedStripes(Snapshot snapshot)
 
 
 /*
- * ReadStripeNextRow: If more rows can be read from the current stripe, fill
- * in non-NULL columnValues and return true. Otherwise, return false.
- *
- * On entry, all entries in columnNulls should be true; this function only
- * sets non-NULL entries.
- *
+ * ReadVisibleDeletedRows returns the bitmap of the rows of the given stripe
+ * that are deleted for a read with the given snapshot, or NULL if none are.
+ * Reads with non-MVCC snapshots, such as table rewrites, index builds and
+ * unique checks, skip the rows that committed transactions and the current
+ * transaction deleted.
  */
-static bool
-ReadStripeNextRow(StripeReadState *stripeReadState, Datum *columnValues,
-				  bool *columnNulls)
+static uint8 *
+ReadVisibleDeletedRows(Relation relation, StripeMetadata *stripeMetadata,
+					   Snapshot snapshot)
 {
-	if (stripeReadState->currentRow >= stripeReadState->rowCount)
+	if (snapshot != InvalidSnapshot && !IsMVCCSnapshot(snapshot))
 	{
-		Assert(stripeReadState->currentRow == stripeReadState->rowCount);
-		return false;
+		snapshot = SnapshotSelf;
 	}
 
-	while (true)
-	{
-		if (stripeReadState->chunkGroupReadState == NULL)
-		{
-			stripeReadState->chunkGroupReadState = BeginChunkGroupRead(
-				stripeReadState->stripeBuffers,
-				stripeReadState->
-				chunkGroupIndex,
-				stripeReadState->
-				tupleDescriptor,
-				stripeReadState->
-				projectedColumnList,
-				stripeReadState->
-				stripeReadContext);
-		}
+	return ReadStripeDeletedRows(relation->rd_node, stripeMetadata->id,
+								 stripeMetadata->rowCount, snapshot, NULL);
+}
 
-		if (!ReadChunkGroupNextRow(stripeReadState->chunkGroupReadState, columnValues,
-								   columnNulls))
-		{
-			/* if this chunk group is exhausted, fetch the next one and loop */
-			EndChunkGroupRead(stripeReadState->chunkGroupReadState);
-			stripeReadState->chunkGroupReadState = NULL;
-			stripeReadState->chunkGroupIndex++;
-			continue;
-		}
 
-		stripeReadState->currentRow++;
+/*
+ * RowNumberReadSkipsDeletedRows returns true if reads by row number with the
+ * given snapshot should skip deleted rows. Only the reads that fetch the row
+ * that is being modified, which use SnapshotAny, should still see them.
+ */
+static bool
+RowNumberReadSkipsDeletedRows(Snapshot snapshot)
+{
+	return snapshot == InvalidSnapshot || snapshot->snapshot_type != SNAPSHOT_ANY;
+}
+
+
+/*
+ * RemoveDeletedChunkGroupRows removes the deleted rows from the projected
+ * columns of a chunk group that starts at the given row offset of its stripe,
+ * and returns the number of rows that are left.
+ */
+static uint32
+RemoveDeletedChunkGroupRows(ChunkData *chunkGroupData, List *projectedColumnList,
+							uint32 rowCount, uint8 *deletedRows, uint64 firstRowOffset)
+{
+	uint32 liveRowCount = 0;
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		if (COLUMNAR_ROW_IS_DELETED(deletedRows, firstRowOffset + rowIndex))
+		{
+			continue;
+		}
+
+		int attno;
+		foreach_int(attno, projectedColumnList)
+		{
+			int columnIndex = attno - 1;
+			bool *existsArray = chunkGroupData->existsArray[columnIndex];
+			Datum *valueArray = chunkGroupData->valueArray[columnIndex];
+			ColumnChunkDictionary *dictionary =
+				chunkGroupData->dictionaryArray[columnIndex];
+
+			existsArray[liveRowCount] = existsArray[rowIndex];
+			valueArray[liveRowCount] = valueArray[rowIndex];
+
+			if (dictionary != NULL)
+			{
+				dictionary->entryIndexArray[liveRowCount] =
+					dictionary->entryIndexArray[rowIndex];
+			}
+		}
+
+		liveRowCount++;
+	}
+
+	chunkGroupData->rowCount = liveRowCount;
+
+	return liveRowCount;
+}
+
+
+/*
+ * ReadStripeNextRow: If more rows can be read from the current stripe, fill
+ * in non-NULL columnValues and return true. Otherwise, return false.
+ *
+ * On entry, all entries in columnNulls should be true; this function only
+ * sets non-NULL entries.
+ *
+ */
+static bool
+ReadStripeNextRow(StripeReadState *stripeReadState, Datum *columnValues,
+				  bool *columnNulls)
+{
+	while (true)
+	{
+		if (stripeReadState->currentRow >= stripeReadState->rowCount)
+		{
+			Assert(stripeReadState->currentRow == stripeReadState->rowCount);
+			return false;
+		}
+
+		if (stripeReadState->chunkGroupReadState == NULL)
+		{
+			stripeReadState->chunkGroupReadState = BeginChunkGroupRead(
+				stripeReadState->stripeBuffers,
+				stripeReadState->
+				chunkGroupIndex,
+				stripeReadState->
+				tupleDescriptor,
+				stripeReadState->
+				projectedColumnList,
+				stripeReadState->
+				vectorizedQualList,
+				stripeReadState->
+				stripeReadContext);
+
+			ChunkGroupReadState *chunkGroupReadState =
+				stripeReadState->chunkGroupReadState;
+			if (chunkGroupReadState->selectionVector != NULL)
+			{
+				stripeReadState->rowsFiltered +=
+					chunkGroupReadState->rowCount -
+					chunkGroupReadState->selectionVectorLength;
+			}
+		}
+
+		/*
+		 * Rows that the vectorized quals filtered out are skipped, but still
+		 * count as read for the row numbers of the stripe.
+		 */
+		int64 skippedRowCount = 0;
+		bool rowFound = ReadChunkGroupNextRow(stripeReadState->chunkGroupReadState,
+											  columnValues, columnNulls,
+											  &skippedRowCount);
+		stripeReadState->currentRow += skippedRowCount;
+
+		if (!rowFound)
+		{
+			/* if this chunk group is exhausted, fetch the next one and loop */
+			EndChunkGroupRead(stripeReadState->chunkGroupReadState);
+			stripeReadState->chunkGroupReadState = NULL;
+			stripeReadState->chunkGroupIndex++;
+			continue;
+		}
+
+		stripeReadState->currentRow++;
+
+		uint64 *chunkGroupRowOffsets =
+			stripeReadState->stripeBuffers->selectedChunkGroupRowOffsets;
+		uint64 rowOffset = chunkGroupRowOffsets[stripeReadState->chunkGroupIndex] +
+						   stripeReadState->chunkGroupReadState->currentRow - 1;
+		if (stripeReadState->deletedRows != NULL &&
+			COLUMNAR_ROW_IS_DELETED(stripeReadState->deletedRows, rowOffset))
+		{
+			continue;
+		}
+
+		stripeReadState->lastRowOffset = rowOffset;
 		return true;
 	}
 
@@ -816,10 +1455,15 @@ ReadStripeNextRow(StripeReadState *stripeReadState, Datum *columnValues,
 
 /*
  * BeginChunkGroupRead allocates state for reading a chunk.
+ *
+ * If there are vectorized quals, the columns that they filter on are
+ * deserialized first, and the other projected columns are only decompressed
+ * and deserialized if some rows of the chunk group pass the quals.
  */
 static ChunkGroupReadState *
 BeginChunkGroupRead(StripeBuffers *stripeBuffers, int chunkIndex, TupleDesc tupleDesc,
-					List *projectedColumnList, MemoryContext cxt)
+					List *projectedColumnList, List *vectorizedQualList,
+					MemoryContext cxt)
 {
 	uint32 chunkGroupRowCount =
 		stripeBuffers->selectedChunkGroupRowCounts[chunkIndex];
@@ -833,10 +1477,54 @@ BeginChunkGroupRead(StripeBuffers *stripeBuffers, int chunkIndex, TupleDesc tupl
 	chunkGroupReadState->columnCount = tupleDesc->natts;
 	chunkGroupReadState->projectedColumnList = projectedColumnList;
 
-	chunkGroupReadState->chunkGroupData = DeserializeChunkData(stripeBuffers, chunkIndex,
-															   chunkGroupRowCount,
-															   tupleDesc,
-															   projectedColumnList);
+	if (vectorizedQualList == NIL)
+	{
+		chunkGroupReadState->chunkGroupData =
+			DeserializeChunkData(stripeBuffers, chunkIndex, chunkGroupRowCount,
+								 tupleDesc, projectedColumnList);
+	}
+	else
+	{
+		bool *columnMask = ProjectedColumnMask(tupleDesc->natts, projectedColumnList);
+		ChunkData *chunkGroupData = CreateEmptyChunkData(tupleDesc->natts, columnMask,
+														 chunkGroupRowCount);
+
+		/* vectorized quals are only built for projected columns */
+		VectorizedQual *vectorizedQual = NULL;
+		foreach_ptr(vectorizedQual, vectorizedQualList)
+		{
+			int columnIndex = vectorizedQual->columnIndex;
+			if (columnMask[columnIndex])
+			{
+				DeserializeChunkColumn(stripeBuffers, chunkIndex, chunkGroupRowCount,
+									   tupleDesc, columnIndex, chunkGroupData);
+				columnMask[columnIndex] = false;
+			}
+		}
+
+		chunkGroupReadState->chunkGroupData = chunkGroupData;
+		chunkGroupReadState->selectionVector =
+			EvaluateVectorizedQuals(chunkGroupData, chunkGroupRowCount,
+									vectorizedQualList,
+									&chunkGroupReadState->selectionVectorLength);
+
+		/* the remaining columns are not read for rows that were filtered out */
+		if (chunkGroupReadState->selectionVectorLength > 0)
+		{
+			for (int columnIndex = 0; columnIndex < tupleDesc->natts; columnIndex++)
+			{
+				if (columnMask[columnIndex])
+				{
+					DeserializeChunkColumn(stripeBuffers, chunkIndex,
+										   chunkGroupRowCount, tupleDesc,
+										   columnIndex, chunkGroupData);
+				}
+			}
+		}
+
+		pfree(columnMask);
+	}
+
 	MemoryContextSwitchTo(oldContext);
 
 	return chunkGroupReadState;
@@ -850,6 +1538,10 @@ static void
 EndChunkGroupRead(ChunkGroupReadState *chunkGroupReadState)
 {
 	FreeChunkData(chunkGroupReadState->chunkGroupData);
+	if (chunkGroupReadState->selectionVector != NULL)
+	{
+		pfree(chunkGroupReadState->selectionVector);
+	}
 	pfree(chunkGroupReadState);
 }
 
@@ -859,19 +1551,43 @@ EndChunkGroupRead(ChunkGroupReadState *chunkGroupReadState)
  * group, fill in non-NULL columnValues and return true. Otherwise, return
  * false.
  *
+ * If the chunk group has a selection vector, rows that are not in it are
+ * skipped and their number is returned in skippedRowCount.
+ *
  * On entry, all entries in columnNulls should be true; this function only
  * sets non-NULL entries.
  */
 static bool
 ReadChunkGroupNextRow(ChunkGroupReadState *chunkGroupReadState, Datum *columnValues,
-					  bool *columnNulls)
+					  bool *columnNulls, int64 *skippedRowCount)
 {
+	*skippedRowCount = 0;
+
 	if (chunkGroupReadState->currentRow >= chunkGroupReadState->rowCount)
 	{
 		Assert(chunkGroupReadState->currentRow == chunkGroupReadState->rowCount);
 		return false;
 	}
 
+	if (chunkGroupReadState->selectionVector != NULL)
+	{
+		int64 nextRow = chunkGroupReadState->rowCount;
+		if (chunkGroupReadState->selectionVectorIndex <
+			chunkGroupReadState->selectionVectorLength)
+		{
+			nextRow = chunkGroupReadState->selectionVector[
+				chunkGroupReadState->selectionVectorIndex++];
+		}
+
+		*skippedRowCount = nextRow - chunkGroupReadState->currentRow;
+		chunkGroupReadState->currentRow = nextRow;
+
+		if (chunkGroupReadState->currentRow >= chunkGroupReadState->rowCount)
+		{
+			return false;
+		}
+	}
+
 	/*
 	 * Initialize to all-NULL. Only non-NULL projected attributes will be set.
 	 */
@@ -910,6 +1626,231 @@ ColumnarReadChunkGroupsFiltered(ColumnarReadState *state)
 }
 
 
+/*
+ * ColumnarReadRowsFiltered
+ *
+ * Return the number of rows filtered by the vectorized quals during this read
+ * operation.
+ */
+int64
+ColumnarReadRowsFiltered(ColumnarReadState *state)
+{
+	int64 rowsFiltered = state->rowsFiltered;
+
+	/* the stripe being read is only accounted for once it is finished */
+	if (StripeReadInProgress(state))
+	{
+		rowsFiltered += state->stripeReadState->rowsFiltered;
+	}
+
+	return rowsFiltered;
+}
+
+
+/*
+ * BuildVectorizedQualList returns a VectorizedQual for each clause in
+ * whereClauseList that compares a projected column with a non-NULL constant
+ * using a strict btree comparison operator. If columnar.enable_vectorized_filter
+ * is off, it returns NIL.
+ *
+ * The clauses to read are implied by the quals of the scan, so rows that do
+ * not pass them can be skipped without changing the result. The scan still
+ * evaluates its quals on the rows that pass them.
+ */
+static List *
+BuildVectorizedQualList(List *whereClauseList, List *projectedColumnList)
+{
+	List *vectorizedQualList = NIL;
+
+	if (!columnar_enable_vectorized_filter)
+	{
+		return NIL;
+	}
+
+	Node *clause = NULL;
+	foreach_ptr(clause, whereClauseList)
+	{
+		if (!IsA(clause, OpExpr) || list_length(((OpExpr *) clause)->args) != 2)
+		{
+			continue;
+		}
+
+		OpExpr *opExpr = (OpExpr *) clause;
+		Node *leftArg = linitial(opExpr->args);
+		Node *rightArg = lsecond(opExpr->args);
+
+		/* binary compatible casts do not change the datum */
+		if (IsA(leftArg, RelabelType))
+		{
+			leftArg = (Node *) ((RelabelType *) leftArg)->arg;
+		}
+		if (IsA(rightArg, RelabelType))
+		{
+			rightArg = (Node *) ((RelabelType *) rightArg)->arg;
+		}
+
+		bool columnIsLeftArg = IsA(leftArg, Var);
+		Node *columnArg = columnIsLeftArg ? leftArg : rightArg;
+		Node *constArg = columnIsLeftArg ? rightArg : leftArg;
+
+		if (!IsA(columnArg, Var) || !IsA(constArg, Const))
+		{
+			continue;
+		}
+
+		Var *column = (Var *) columnArg;
+		Const *constValue = (Const *) constArg;
+
+		if (column->varattno <= 0 || column->varlevelsup != 0 ||
+			!list_member_int(projectedColumnList, column->varattno) ||
+			constValue->constisnull)
+		{
+			continue;
+		}
+
+		if (opExpr->opresulttype != BOOLOID || !op_strict(opExpr->opno) ||
+			get_op_btree_interpretation(opExpr->opno) == NIL)
+		{
+			continue;
+		}
+
+		VectorizedQual *vectorizedQual = palloc0(sizeof(VectorizedQual));
+		vectorizedQual->columnIndex = column->varattno - 1;
+		vectorizedQual->collation = opExpr->inputcollid;
+		vectorizedQual->constValue = constValue->constvalue;
+		vectorizedQual->columnIsLeftArg = columnIsLeftArg;
+		fmgr_info(get_opcode(opExpr->opno), &vectorizedQual->opFunction);
+
+		vectorizedQualList = lappend(vectorizedQualList, vectorizedQual);
+	}
+
+	return vectorizedQualList;
+}
+
+
+/*
+ * EvaluateVectorizedQuals evaluates the vectorized quals over the column
+ * values of the chunk group and returns the offsets of the rows that pass
+ * all of them, in ascending order. The number of those rows is returned in
+ * selectedRowCount.
+ *
+ * Each qual is evaluated in a loop over the column values of the rows that
+ * passed the previous quals, such that no tuple is formed for rows that are
+ * filtered out. For dictionary encoded columns, the qual is evaluated once for
+ * every distinct value instead, and the rows are filtered by their index into
+ * the dictionary.
+ */
+static uint32 *
+EvaluateVectorizedQuals(ChunkData *chunkGroupData, uint32 rowCount,
+						List *vectorizedQualList, uint32 *selectedRowCount)
+{
+	uint32 *selectionVector = palloc(Max(rowCount, 1) * sizeof(uint32));
+	uint32 selectionVectorLength = rowCount;
+
+	for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		selectionVector[rowIndex] = rowIndex;
+	}
+
+	/* comparison functions might leak, e.g. when detoasting the values */
+	MemoryContext qualContext = AllocSetContextCreate(CurrentMemoryContext,
+													  "Columnar Vectorized Qual Context",
+													  ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(qualContext);
+
+	VectorizedQual *vectorizedQual = NULL;
+	foreach_ptr(vectorizedQual, vectorizedQualList)
+	{
+		bool *existsArray = chunkGroupData->existsArray[vectorizedQual->columnIndex];
+		Datum *valueArray = chunkGroupData->valueArray[vectorizedQual->columnIndex];
+		ColumnChunkDictionary *dictionary =
+			chunkGroupData->dictionaryArray[vectorizedQual->columnIndex];
+		uint32 passedRowCount = 0;
+
+		if (dictionary != NULL)
+		{
+			bool *entryPassedArray = palloc(Max(dictionary->entryCount, 1) *
+											sizeof(bool));
+
+			for (uint32 entryIndex = 0; entryIndex < dictionary->entryCount;
+				 entryIndex++)
+			{
+				entryPassedArray[entryIndex] =
+					EvaluateVectorizedQual(vectorizedQual,
+										   dictionary->entryArray[entryIndex]);
+			}
+
+			for (uint32 selectionIndex = 0; selectionIndex < selectionVectorLength;
+				 selectionIndex++)
+			{
+				uint32 rowIndex = selectionVector[selectionIndex];
+
+				if (existsArray[rowIndex] &&
+					entryPassedArray[dictionary->entryIndexArray[rowIndex]])
+				{
+					selectionVector[passedRowCount++] = rowIndex;
+				}
+			}
+		}
+		else
+		{
+			for (uint32 selectionIndex = 0; selectionIndex < selectionVectorLength;
+				 selectionIndex++)
+			{
+				uint32 rowIndex = selectionVector[selectionIndex];
+
+				/* the operator is strict, so NULL values never pass */
+				if (existsArray[rowIndex] &&
+					EvaluateVectorizedQual(vectorizedQual, valueArray[rowIndex]))
+				{
+					selectionVector[passedRowCount++] = rowIndex;
+				}
+			}
+		}
+
+		selectionVectorLength = passedRowCount;
+		MemoryContextReset(qualContext);
+
+		if (selectionVectorLength == 0)
+		{
+			break;
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(qualContext);
+
+	*selectedRowCount = selectionVectorLength;
+	return selectionVector;
+}
+
+
+/*
+ * EvaluateVectorizedQual returns whether the given column value passes the
+ * vectorized qual.
+ */
+static bool
+EvaluateVectorizedQual(VectorizedQual *vectorizedQual, Datum value)
+{
+	Datum result = 0;
+
+	if (vectorizedQual->columnIsLeftArg)
+	{
+		result = FunctionCall2Coll(&vectorizedQual->opFunction,
+								   vectorizedQual->collation, value,
+								   vectorizedQual->constValue);
+	}
+	else
+	{
+		result = FunctionCall2Coll(&vectorizedQual->opFunction,
+								   vectorizedQual->collation,
+								   vectorizedQual->constValue, value);
+	}
+
+	return DatumGetBool(result);
+}
+
+
 /*
  * CreateEmptyChunkDataArray creates data buffers to keep deserialized exist and
  * value arrays for requested columns in columnMask.
@@ -923,6 +1864,7 @@ CreateEmptyChunkData(uint32 columnCount, bool *columnMask, uint32 chunkGroupRowC
 	chunkData->existsArray = palloc0(columnCount * sizeof(bool *));
 	chunkData->valueArray = palloc0(columnCount * sizeof(Datum *));
 	chunkData->valueBufferArray = palloc0(columnCount * sizeof(StringInfo));
+	chunkData->dictionaryArray = palloc0(columnCount * sizeof(ColumnChunkDictionary *));
 	chunkData->columnCount = columnCount;
 	chunkData->rowCount = chunkGroupRowCount;
 
@@ -970,18 +1912,37 @@ FreeChunkData(ChunkData *chunkData)
 		{
 			pfree(chunkData->valueArray[columnIndex]);
 		}
+
+		ColumnChunkDictionary *dictionary = chunkData->dictionaryArray[columnIndex];
+		if (dictionary != NULL)
+		{
+			pfree(dictionary->entryArray);
+			pfree(dictionary->entryIndexArray);
+			pfree(dictionary);
+		}
 	}
 
 	pfree(chunkData->existsArray);
 	pfree(chunkData->valueArray);
+	pfree(chunkData->dictionaryArray);
 	pfree(chunkData);
 }
 
 
-/* ColumnarTableRowCount returns the exact row count of a table using skiplists */
+/*
+ * ColumnarTableRowCount returns the row count of a table for planning. It uses
+ * the totals in the metapage, which may include rows of aborted writes, and
+ * falls back to the exact count from the stripe metadata if they are missing.
+ */
 uint64
 ColumnarTableRowCount(Relation relation)
 {
+	ColumnarStorageTotals totals = { 0 };
+	if (ColumnarStorageGetTotals(relation, &totals))
+	{
+		return totals.rowCount;
+	}
+
 	ListCell *stripeMetadataCell = NULL;
 	uint64 totalRowCount = 0;
 	List *stripeList = StripesForRelfilenode(relation->rd_node);
@@ -1005,9 +1966,9 @@ static StripeBuffers *
 LoadFilteredStripeBuffers(Relation relation, StripeMetadata *stripeMetadata,
 						  TupleDesc tupleDescriptor, List *projectedColumnList,
 						  List *whereClauseList, List *whereClauseVars,
-						  int64 *chunkGroupsFiltered, Snapshot snapshot)
+						  int64 *chunkGroupsFiltered, Snapshot snapshot,
+						  BufferAccessStrategy strategy)
 {
-	uint32 columnIndex = 0;
 	uint32 columnCount = tupleDescriptor->natts;
 
 	bool *projectedColumnMask = ProjectedColumnMask(columnCount, projectedColumnList);
@@ -1021,10 +1982,57 @@ LoadFilteredStripeBuffers(Relation relation, StripeMetadata *stripeMetadata,
 	bool *selectedChunkMask = SelectedChunkMask(stripeSkipList, whereClauseList,
 												whereClauseVars, chunkGroupsFiltered);
 
+	return LoadSelectedChunkBuffers(relation, stripeMetadata, tupleDescriptor,
+									projectedColumnMask, stripeSkipList,
+									selectedChunkMask, strategy);
+}
+
+
+/*
+ * LoadSelectedChunkBuffers reads the serialized data of the projected columns
+ * in the selected chunks of a stripe.
+ */
+static StripeBuffers *
+LoadSelectedChunkBuffers(Relation relation, StripeMetadata *stripeMetadata,
+						 TupleDesc tupleDescriptor, bool *projectedColumnMask,
+						 StripeSkipList *stripeSkipList, bool *selectedChunkMask,
+						 BufferAccessStrategy strategy)
+{
+	uint32 columnIndex = 0;
+	uint32 columnCount = tupleDescriptor->natts;
+
 	StripeSkipList *selectedChunkSkipList =
 		SelectedChunkSkipList(stripeSkipList, projectedColumnMask,
 							  selectedChunkMask);
 
+	/*
+	 * Chunks are cached by their index in the stripe, rather than among the
+	 * selected chunks.
+	 */
+	ColumnarChunkCacheKey *stripeCacheKey = NULL;
+	uint32 *chunkIndexArray = NULL;
+
+	if (ColumnarChunkCacheEnabled())
+	{
+		stripeCacheKey = palloc0(sizeof(ColumnarChunkCacheKey));
+		stripeCacheKey->databaseId = MyDatabaseId;
+		stripeCacheKey->storageId = ColumnarStorageGetStorageId(relation, false);
+		stripeCacheKey->stripeId = stripeMetadata->id;
+
+		chunkIndexArray = palloc0(Max(selectedChunkSkipList->chunkCount, 1) *
+								  sizeof(uint32));
+
+		uint32 selectedChunkIndex = 0;
+		for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount;
+			 chunkIndex++)
+		{
+			if (selectedChunkMask[chunkIndex])
+			{
+				chunkIndexArray[selectedChunkIndex++] = chunkIndex;
+			}
+		}
+	}
+
 	/* load column data for projected columns */
 	ColumnBuffers **columnBuffersArray = palloc0(columnCount * sizeof(ColumnBuffers *));
 
@@ -1040,40 +2048,118 @@ LoadFilteredStripeBuffers(Relation relation, StripeMetadata *stripeMetadata,
 			ColumnBuffers *columnBuffers = LoadColumnBuffers(relation, chunkSkipNode,
 															 chunkCount,
 															 stripeMetadata->fileOffset,
-															 attributeForm);
+															 attributeForm,
+															 stripeCacheKey,
+															 chunkIndexArray,
+															 strategy);
 
 			columnBuffersArray[columnIndex] = columnBuffers;
 		}
 	}
 
+	uint64 *selectedChunkGroupRowOffsets =
+		palloc0(Max(selectedChunkSkipList->chunkCount, 1) * sizeof(uint64));
+	uint64 chunkGroupRowOffset = 0;
+	uint32 selectedChunkGroupIndex = 0;
+	for (uint32 chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+	{
+		if (selectedChunkMask[chunkIndex])
+		{
+			selectedChunkGroupRowOffsets[selectedChunkGroupIndex++] = chunkGroupRowOffset;
+		}
+
+		chunkGroupRowOffset += stripeSkipList->chunkGroupRowCounts[chunkIndex];
+	}
+
 	StripeBuffers *stripeBuffers = palloc0(sizeof(StripeBuffers));
 	stripeBuffers->columnCount = columnCount;
 	stripeBuffers->rowCount = StripeSkipListRowCount(selectedChunkSkipList);
 	stripeBuffers->columnBuffersArray = columnBuffersArray;
 	stripeBuffers->selectedChunkGroupRowCounts =
 		selectedChunkSkipList->chunkGroupRowCounts;
+	stripeBuffers->selectedChunkGroupRowOffsets = selectedChunkGroupRowOffsets;
 
 	return stripeBuffers;
 }
 
 
-/*
- * LoadColumnBuffers reads serialized column data from the given file. These
- * column data are laid out as sequential chunks in the file; and chunk positions
- * and lengths are retrieved from the column chunk skip node array.
- */
-static ColumnBuffers *
-LoadColumnBuffers(Relation relation, ColumnChunkSkipNode *chunkSkipNodeArray,
-				  uint32 chunkCount, uint64 stripeOffset,
-				  Form_pg_attribute attributeForm)
-{
-	uint32 chunkIndex = 0;
-	ColumnChunkBuffers **chunkBuffersArray =
-		palloc0(chunkCount * sizeof(ColumnChunkBuffers *));
+/*
+ * LoadColumnBuffers reads serialized column data from the given file. These
+ * column data are laid out as sequential chunks in the file; and chunk positions
+ * and lengths are retrieved from the column chunk skip node array.
+ *
+ * If stripeCacheKey is not NULL, compressed value chunks are first looked up
+ * in the shared chunk cache, and chunks that are found there are neither read
+ * nor decompressed. The other compressed chunks are added to the cache once
+ * they are decompressed. chunkIndexArray has the index in the stripe of each
+ * of the chunks.
+ */
+static ColumnBuffers *
+LoadColumnBuffers(Relation relation, ColumnChunkSkipNode *chunkSkipNodeArray,
+				  uint32 chunkCount, uint64 stripeOffset,
+				  Form_pg_attribute attributeForm, ColumnarChunkCacheKey *stripeCacheKey,
+				  uint32 *chunkIndexArray, BufferAccessStrategy strategy)
+{
+	uint32 chunkIndex = 0;
+	ColumnChunkBuffers **chunkBuffersArray =
+		palloc0(chunkCount * sizeof(ColumnChunkBuffers *));
+
+	for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+		CompressionType compressionType = chunkSkipNode->valueCompressionType;
+		ColumnChunkBuffers *chunkBuffers = palloc0(sizeof(ColumnChunkBuffers));
+
+		chunkBuffers->valueCompressionType = compressionType;
+		chunkBuffers->valueEncodingType = chunkSkipNode->valueEncodingType;
+		chunkBuffers->decompressedValueSize = chunkSkipNode->decompressedValueSize;
+		chunkBuffersArray[chunkIndex] = chunkBuffers;
+
+		if (stripeCacheKey != NULL && compressionType != COMPRESSION_NONE)
+		{
+			ColumnarChunkCacheKey *cacheKey = palloc0(sizeof(ColumnarChunkCacheKey));
+			*cacheKey = *stripeCacheKey;
+			cacheKey->chunkIndex = chunkIndexArray[chunkIndex];
+			cacheKey->columnIndex = attributeForm->attnum - 1;
+
+			StringInfo cachedValueBuffer = ColumnarChunkCacheLookup(cacheKey);
+			if (cachedValueBuffer != NULL)
+			{
+				chunkBuffers->valueBuffer = cachedValueBuffer;
+				chunkBuffers->valueCompressionType = COMPRESSION_NONE;
+			}
+			else
+			{
+				chunkBuffers->cacheKey = cacheKey;
+			}
+		}
+	}
+
+	/* list the ranges that we read below, in the same order */
+	ColumnarPrefetchState prefetchState = { 0 };
+	prefetchState.relation = relation;
+	prefetchState.offsetArray = palloc0(Max(chunkCount, 1) * 2 * sizeof(uint64));
+	prefetchState.lengthArray = palloc0(Max(chunkCount, 1) * 2 * sizeof(uint32));
+	prefetchState.prefetchDistance =
+		get_tablespace_io_concurrency(relation->rd_rel->reltablespace);
+
+	for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+	{
+		ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+		AddPrefetchRange(&prefetchState,
+						 stripeOffset + chunkSkipNode->existsChunkOffset,
+						 chunkSkipNode->existsLength);
+	}
 
 	for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
 	{
-		chunkBuffersArray[chunkIndex] = palloc0(sizeof(ColumnChunkBuffers));
+		ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
+		if (chunkBuffersArray[chunkIndex]->valueBuffer == NULL)
+		{
+			AddPrefetchRange(&prefetchState,
+							 stripeOffset + chunkSkipNode->valueChunkOffset,
+							 chunkSkipNode->valueLength);
+		}
 	}
 
 	/*
@@ -1089,8 +2175,9 @@ LoadColumnBuffers(Relation relation, ColumnChunkSkipNode *chunkSkipNodeArray,
 
 		enlargeStringInfo(rawExistsBuffer, chunkSkipNode->existsLength);
 		rawExistsBuffer->len = chunkSkipNode->existsLength;
-		ColumnarStorageRead(relation, existsOffset, rawExistsBuffer->data,
-							chunkSkipNode->existsLength);
+		PrefetchAheadOfRead(&prefetchState);
+		ColumnarStorageReadExtended(relation, existsOffset, rawExistsBuffer->data,
+									chunkSkipNode->existsLength, strategy);
 
 		chunkBuffersArray[chunkIndex]->existsBuffer = rawExistsBuffer;
 	}
@@ -1099,19 +2186,43 @@ LoadColumnBuffers(Relation relation, ColumnChunkSkipNode *chunkSkipNodeArray,
 	for (chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
 	{
 		ColumnChunkSkipNode *chunkSkipNode = &chunkSkipNodeArray[chunkIndex];
-		CompressionType compressionType = chunkSkipNode->valueCompressionType;
 		uint64 valueOffset = stripeOffset + chunkSkipNode->valueChunkOffset;
+
+		/* chunks found in the chunk cache are not read */
+		if (chunkBuffersArray[chunkIndex]->valueBuffer != NULL)
+		{
+			continue;
+		}
+
 		StringInfo rawValueBuffer = makeStringInfo();
 
 		enlargeStringInfo(rawValueBuffer, chunkSkipNode->valueLength);
 		rawValueBuffer->len = chunkSkipNode->valueLength;
-		ColumnarStorageRead(relation, valueOffset, rawValueBuffer->data,
-							chunkSkipNode->valueLength);
+		PrefetchAheadOfRead(&prefetchState);
+		ColumnarStorageReadExtended(relation, valueOffset, rawValueBuffer->data,
+									chunkSkipNode->valueLength, strategy);
 
 		chunkBuffersArray[chunkIndex]->valueBuffer = rawValueBuffer;
-		chunkBuffersArray[chunkIndex]->valueCompressionType = compressionType;
-		chunkBuffersArray[chunkIndex]->decompressedValueSize =
-			chunkSkipNode->decompressedValueSize;
+
+		/* zstd frames record the id of the dictionary they were compressed with */
+		if (chunkSkipNode->valueCompressionType == COMPRESSION_ZSTD)
+		{
+			uint32 dictionaryId = CompressedBufferDictionaryId(rawValueBuffer);
+			if (dictionaryId != 0)
+			{
+				bytea *dictionary = ReadCompressionDictionary(relation->rd_node,
+															  attributeForm->attnum,
+															  dictionaryId);
+				if (dictionary == NULL)
+				{
+					ereport(ERROR, (errmsg("compression dictionary %u of column \"%s\" "
+										   "does not exist", dictionaryId,
+										   NameStr(attributeForm->attname))));
+				}
+
+				chunkBuffersArray[chunkIndex]->compressionDictionary = dictionary;
+			}
+		}
 	}
 
 	ColumnBuffers *columnBuffers = palloc0(sizeof(ColumnBuffers));
@@ -1121,6 +2232,49 @@ LoadColumnBuffers(Relation relation, ColumnChunkSkipNode *chunkSkipNodeArray,
 }
 
 
+/*
+ * AddPrefetchRange appends a range that LoadColumnBuffers reads to the
+ * prefetch state.
+ */
+static void
+AddPrefetchRange(ColumnarPrefetchState *prefetchState, uint64 offset, uint32 length)
+{
+	prefetchState->offsetArray[prefetchState->rangeCount] = offset;
+	prefetchState->lengthArray[prefetchState->rangeCount] = length;
+	prefetchState->rangeCount++;
+}
+
+
+/*
+ * PrefetchAheadOfRead is called before the next range of the prefetch state
+ * is read. It prefetches the blocks of that range and of the ranges after it,
+ * up to the prefetch distance, which is the effective_io_concurrency of the
+ * tablespace of the relation.
+ */
+static void
+PrefetchAheadOfRead(ColumnarPrefetchState *prefetchState)
+{
+	if (prefetchState->prefetchDistance > 0)
+	{
+		uint64 prefetchEnd = Min((uint64) prefetchState->rangeCount,
+								 (uint64) prefetchState->readRangeCount + 1 +
+								 prefetchState->prefetchDistance);
+
+		while (prefetchState->prefetchedRangeCount < prefetchEnd)
+		{
+			uint32 rangeIndex = prefetchState->prefetchedRangeCount;
+
+			ColumnarStoragePrefetch(prefetchState->relation,
+									prefetchState->offsetArray[rangeIndex],
+									prefetchState->lengthArray[rangeIndex]);
+			prefetchState->prefetchedRangeCount++;
+		}
+	}
+
+	prefetchState->readRangeCount++;
+}
+
+
 /*
  * SelectedChunkMask walks over each column's chunks and checks if a chunk can
  * be filtered without reading its data. The filtering happens when all rows in
@@ -1180,10 +2334,179 @@ SelectedChunkMask(StripeSkipList *stripeSkipList, List *whereClauseList,
 		}
 	}
 
+	/* min/max cannot refute equality quals on randomly spread values */
+	Node *clause = NULL;
+	foreach_ptr(clause, whereClauseList)
+	{
+		BloomFilterQual *bloomFilterQual = BuildBloomFilterQual(clause);
+		if (bloomFilterQual == NULL ||
+			bloomFilterQual->columnIndex >= stripeSkipList->columnCount)
+		{
+			continue;
+		}
+
+		for (chunkIndex = 0; chunkIndex < stripeSkipList->chunkCount; chunkIndex++)
+		{
+			ColumnChunkSkipNode *chunkSkipNode =
+				&stripeSkipList->chunkSkipNodeArray[bloomFilterQual->columnIndex][
+					chunkIndex];
+
+			if (!selectedChunkMask[chunkIndex] || chunkSkipNode->bloomFilter == NULL)
+			{
+				continue;
+			}
+
+			if (!BloomFilterQualMightPass(bloomFilterQual, chunkSkipNode->bloomFilter))
+			{
+				selectedChunkMask[chunkIndex] = false;
+				*chunkGroupsFiltered += 1;
+			}
+		}
+	}
+
 	return selectedChunkMask;
 }
 
 
+/*
+ * BuildBloomFilterQual returns a BloomFilterQual for clauses of the form
+ * column = constant and column = ANY(constant array), or NULL for other
+ * clauses. The operator should be the equality operator of the default hash
+ * operator class of the column type, with which the bloom filters are built.
+ */
+static BloomFilterQual *
+BuildBloomFilterQual(Node *clause)
+{
+	Node *columnArg = NULL;
+	Node *constArg = NULL;
+	Oid operatorId = InvalidOid;
+	Oid inputCollation = InvalidOid;
+	bool isArrayQual = false;
+
+	if (IsA(clause, OpExpr) && list_length(((OpExpr *) clause)->args) == 2)
+	{
+		OpExpr *opExpr = (OpExpr *) clause;
+		Node *leftArg = strip_implicit_coercions(linitial(opExpr->args));
+		Node *rightArg = strip_implicit_coercions(lsecond(opExpr->args));
+
+		columnArg = IsA(leftArg, Var) ? leftArg : rightArg;
+		constArg = IsA(leftArg, Var) ? rightArg : leftArg;
+		operatorId = opExpr->opno;
+		inputCollation = opExpr->inputcollid;
+	}
+	else if (IsA(clause, ScalarArrayOpExpr) &&
+			 ((ScalarArrayOpExpr *) clause)->useOr &&
+			 list_length(((ScalarArrayOpExpr *) clause)->args) == 2)
+	{
+		ScalarArrayOpExpr *arrayOpExpr = (ScalarArrayOpExpr *) clause;
+
+		columnArg = strip_implicit_coercions(linitial(arrayOpExpr->args));
+		constArg = strip_implicit_coercions(lsecond(arrayOpExpr->args));
+		operatorId = arrayOpExpr->opno;
+		inputCollation = arrayOpExpr->inputcollid;
+		isArrayQual = true;
+	}
+	else
+	{
+		return NULL;
+	}
+
+	if (!IsA(columnArg, Var) || !IsA(constArg, Const))
+	{
+		return NULL;
+	}
+
+	Var *column = (Var *) columnArg;
+	Const *constValue = (Const *) constArg;
+	Oid typeId = column->vartype;
+
+	if (column->varattno <= 0 || column->varlevelsup != 0 ||
+		constValue->constisnull || inputCollation != column->varcollid)
+	{
+		return NULL;
+	}
+
+	Oid operatorClassId = GetDefaultOpClass(typeId, HASH_AM_OID);
+	if (operatorClassId == InvalidOid ||
+		get_opfamily_member(get_opclass_family(operatorClassId), typeId, typeId,
+							HTEqualStrategyNumber) != operatorId)
+	{
+		return NULL;
+	}
+
+	FmgrInfo *hashFunction = GetFunctionInfoOrNull(typeId, HASH_AM_OID,
+												   HASHSTANDARD_PROC);
+	if (hashFunction == NULL)
+	{
+		return NULL;
+	}
+
+	Datum *valueArray = &constValue->constvalue;
+	bool *nullArray = NULL;
+	int valueCount = 1;
+
+	if (isArrayQual)
+	{
+		ArrayType *array = DatumGetArrayTypeP(constValue->constvalue);
+		int16 typeLength = 0;
+		bool typeByValue = false;
+		char typeAlign = 0;
+
+		if (ARR_ELEMTYPE(array) != typeId)
+		{
+			return NULL;
+		}
+
+		get_typlenbyvalalign(typeId, &typeLength, &typeByValue, &typeAlign);
+		deconstruct_array(array, typeId, typeLength, typeByValue, typeAlign,
+						  &valueArray, &nullArray, &valueCount);
+	}
+	else if (constValue->consttype != typeId)
+	{
+		return NULL;
+	}
+
+	BloomFilterQual *bloomFilterQual = palloc0(sizeof(BloomFilterQual));
+	bloomFilterQual->columnIndex = column->varattno - 1;
+	bloomFilterQual->hashArray = palloc(Max(valueCount, 1) * sizeof(uint32));
+
+	for (int valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		/* NULL elements never match */
+		if (nullArray != NULL && nullArray[valueIndex])
+		{
+			continue;
+		}
+
+		Datum hashDatum = FunctionCall1Coll(hashFunction, inputCollation,
+											valueArray[valueIndex]);
+		bloomFilterQual->hashArray[bloomFilterQual->hashCount++] =
+			DatumGetUInt32(hashDatum);
+	}
+
+	return bloomFilterQual;
+}
+
+
+/*
+ * BloomFilterQualMightPass returns whether the bloom filter of a chunk might
+ * contain any of the values that the qual looks for.
+ */
+static bool
+BloomFilterQualMightPass(BloomFilterQual *bloomFilterQual, bytea *bloomFilter)
+{
+	for (int hashIndex = 0; hashIndex < bloomFilterQual->hashCount; hashIndex++)
+	{
+		if (BloomFilterMightContain(bloomFilter, bloomFilterQual->hashArray[hashIndex]))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 /*
  * GetFunctionInfoOrNull first resolves the operator for the given data type,
  * access method, and support procedure. The function then uses the resolved
@@ -1499,6 +2822,10 @@ ProjectedColumnMask(uint32 columnCount, List *projectedColumnList)
 /*
  * DeserializeBoolArray reads an array of bits from the given buffer and stores
  * it in provided bool array.
+ *
+ * On little-endian machines, every byte is expanded into 8 bools at once:
+ * the byte is copied to all 8 lanes of a 64-bit word, each lane keeps its own
+ * bit, and adding 0x7F to a lane sets its high bit iff the kept bit is set.
  */
 static void
 DeserializeBoolArray(StringInfo boolArrayBuffer, bool *boolArray,
@@ -1512,7 +2839,21 @@ DeserializeBoolArray(StringInfo boolArrayBuffer, bool *boolArray,
 		ereport(ERROR, (errmsg("insufficient data for reading boolean array")));
 	}
 
-	for (boolArrayIndex = 0; boolArrayIndex < boolArrayLength; boolArrayIndex++)
+#ifndef WORDS_BIGENDIAN
+	for (; boolArrayIndex + 8 <= boolArrayLength; boolArrayIndex += 8)
+	{
+		uint64 byteValue = (uint8) boolArrayBuffer->data[boolArrayIndex / 8];
+		uint64 lanes = byteValue * UINT64CONST(0x0101010101010101);
+
+		lanes &= UINT64CONST(0x8040201008040201);
+		lanes = ((lanes + UINT64CONST(0x7F7F7F7F7F7F7F7F)) &
+				 UINT64CONST(0x8080808080808080)) >> 7;
+
+		memcpy(&boolArray[boolArrayIndex], &lanes, sizeof(uint64)); /* IGNORE-BANNED */
+	}
+#endif
+
+	for (; boolArrayIndex < boolArrayLength; boolArrayIndex++)
 	{
 		uint32 byteIndex = boolArrayIndex / 8;
 		uint32 bitIndex = boolArrayIndex % 8;
@@ -1544,6 +2885,15 @@ DeserializeDatumArray(StringInfo datumBuffer, bool *existsArray, uint32 datumCou
 	uint32 datumIndex = 0;
 	uint32 currentDatumDataOffset = 0;
 
+	/* by-value types whose alignment adds no padding are stored back to back */
+	if (datumTypeByValue && datumTypeLength > 0 &&
+		att_align_nominal(datumTypeLength, datumTypeAlign) == datumTypeLength)
+	{
+		DeserializeFixedWidthDatumArray(datumBuffer, existsArray, datumCount,
+										datumTypeLength, datumArray);
+		return;
+	}
+
 	for (datumIndex = 0; datumIndex < datumCount; datumIndex++)
 	{
 		if (!existsArray[datumIndex])
@@ -1569,6 +2919,51 @@ DeserializeDatumArray(StringInfo datumBuffer, bool *existsArray, uint32 datumCou
 }
 
 
+/*
+ * DeserializeFixedWidthDatumArray is the variant of DeserializeDatumArray for
+ * by-value types that are stored without padding. It does not need to walk
+ * the values to find their offsets, and if the datums are stored as they
+ * are in memory and there are no nulls, the values are copied in bulk.
+ */
+static void
+DeserializeFixedWidthDatumArray(StringInfo datumBuffer, bool *existsArray,
+								uint32 datumCount, int datumTypeLength,
+								Datum *datumArray)
+{
+	uint32 existsCount = 0;
+	for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		existsCount += existsArray[datumIndex];
+	}
+
+	if ((uint64) existsCount * datumTypeLength > datumBuffer->len)
+	{
+		ereport(ERROR, (errmsg("insufficient data left in datum buffer")));
+	}
+
+	if (datumCount > 0 && existsCount == datumCount &&
+		datumTypeLength == sizeof(Datum))
+	{
+		memcpy_s(datumArray, datumCount * sizeof(Datum), datumBuffer->data,
+				 (rsize_t) datumCount * sizeof(Datum));
+		return;
+	}
+
+	char *currentDatumDataPointer = datumBuffer->data;
+	for (uint32 datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		if (!existsArray[datumIndex])
+		{
+			continue;
+		}
+
+		datumArray[datumIndex] = fetch_att(currentDatumDataPointer, true,
+										   datumTypeLength);
+		currentDatumDataPointer += datumTypeLength;
+	}
+}
+
+
 /*
  * DeserializeChunkGroupData deserializes requested data chunk for all columns and
  * stores in chunkDataArray. It uncompresses serialized data if necessary. The
@@ -1589,65 +2984,102 @@ DeserializeChunkData(StripeBuffers *stripeBuffers, uint64 chunkIndex,
 
 	for (columnIndex = 0; columnIndex < stripeBuffers->columnCount; columnIndex++)
 	{
-		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
-		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
-		bool columnAdded = false;
-
-		if (columnBuffers == NULL && columnMask[columnIndex])
+		if (stripeBuffers->columnBuffersArray[columnIndex] != NULL ||
+			columnMask[columnIndex])
 		{
-			columnAdded = true;
+			DeserializeChunkColumn(stripeBuffers, chunkIndex, rowCount,
+								   tupleDescriptor, columnIndex, chunkData);
 		}
+	}
+
+	return chunkData;
+}
+
+
+/*
+ * DeserializeChunkColumn deserializes the data of the given column in the
+ * requested chunk into chunkData, which should have buffers for the column.
+ * If the column data is not present in the serialized buffers, the default
+ * value (or null) of the column is used.
+ */
+static void
+DeserializeChunkColumn(StripeBuffers *stripeBuffers, uint64 chunkIndex,
+					   uint32 rowCount, TupleDesc tupleDescriptor, int columnIndex,
+					   ChunkData *chunkData)
+{
+	Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+	ColumnBuffers *columnBuffers = NULL;
+
+	if (columnIndex < stripeBuffers->columnCount)
+	{
+		columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+	}
+
+	if (columnBuffers != NULL)
+	{
+		ColumnChunkBuffers *chunkBuffers =
+			columnBuffers->chunkBuffersArray[chunkIndex];
+
+		/* decompress and deserialize current chunk's data */
+		StringInfo valueBuffer =
+			DecompressBuffer(chunkBuffers->valueBuffer,
+							 chunkBuffers->valueCompressionType,
+							 chunkBuffers->decompressedValueSize,
+							 chunkBuffers->compressionDictionary);
 
-		if (columnBuffers != NULL)
+		if (chunkBuffers->cacheKey != NULL)
 		{
-			ColumnChunkBuffers *chunkBuffers =
-				columnBuffers->chunkBuffersArray[chunkIndex];
+			ColumnarChunkCacheInsert(chunkBuffers->cacheKey, valueBuffer);
+			chunkBuffers->cacheKey = NULL;
+		}
 
-			/* decompress and deserialize current chunk's data */
-			StringInfo valueBuffer =
-				DecompressBuffer(chunkBuffers->valueBuffer,
-								 chunkBuffers->valueCompressionType,
-								 chunkBuffers->decompressedValueSize);
+		DeserializeBoolArray(chunkBuffers->existsBuffer,
+							 chunkData->existsArray[columnIndex],
+							 rowCount);
 
-			DeserializeBoolArray(chunkBuffers->existsBuffer,
-								 chunkData->existsArray[columnIndex],
-								 rowCount);
+		if (chunkBuffers->valueEncodingType != ENCODING_NONE)
+		{
+			DecodeValueBuffer(valueBuffer, chunkBuffers->valueEncodingType,
+							  chunkData->existsArray[columnIndex], rowCount,
+							  attributeForm, chunkData->valueArray[columnIndex],
+							  &chunkData->dictionaryArray[columnIndex]);
+		}
+		else
+		{
 			DeserializeDatumArray(valueBuffer, chunkData->existsArray[columnIndex],
 								  rowCount, attributeForm->attbyval,
 								  attributeForm->attlen, attributeForm->attalign,
 								  chunkData->valueArray[columnIndex]);
-
-			/* store current chunk's data buffer to be freed at next chunk read */
-			chunkData->valueBufferArray[columnIndex] = valueBuffer;
 		}
-		else if (columnAdded)
+
+		/* store current chunk's data buffer to be freed at next chunk read */
+		chunkData->valueBufferArray[columnIndex] = valueBuffer;
+	}
+	else
+	{
+		/*
+		 * This is a column that was added after creation of this stripe.
+		 * So we use either the default value or NULL.
+		 */
+		if (attributeForm->atthasdef)
 		{
-			/*
-			 * This is a column that was added after creation of this stripe.
-			 * So we use either the default value or NULL.
-			 */
-			if (attributeForm->atthasdef)
-			{
-				int rowIndex = 0;
+			int rowIndex = 0;
 
-				Datum defaultValue = ColumnDefaultValue(tupleDescriptor->constr,
-														attributeForm);
+			Datum defaultValue = ColumnDefaultValue(tupleDescriptor->constr,
+													attributeForm);
 
-				for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
-				{
-					chunkData->existsArray[columnIndex][rowIndex] = true;
-					chunkData->valueArray[columnIndex][rowIndex] = defaultValue;
-				}
-			}
-			else
+			for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
 			{
-				memset(chunkData->existsArray[columnIndex], false,
-					   rowCount * sizeof(bool));
+				chunkData->existsArray[columnIndex][rowIndex] = true;
+				chunkData->valueArray[columnIndex][rowIndex] = defaultValue;
 			}
 		}
+		else
+		{
+			memset(chunkData->existsArray[columnIndex], false,
+				   rowCount * sizeof(bool));
+		}
 	}
-
-	return chunkData;
 }
 
 
@@ -1688,3 +3120,99 @@ ColumnDefaultValue(TupleConstr *tupleConstraints, Form_pg_attribute attributeFor
 								"does not evaluate to constant value")));
 	}
 }
+
+
+/*
+ * test_columnar_deserialize_chunks is a UDF only used for benchmarking. It
+ * deserializes all chunk groups of the first stripe of the given columnar
+ * table the given number of times and returns the average time it took to
+ * deserialize a chunk group, in nanoseconds. The stripe is read upfront, so
+ * only the decompression and decoding of the chunks is timed.
+ */
+Datum
+test_columnar_deserialize_chunks(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	int iterations = PG_GETARG_INT32(1);
+	int64 chunkGroupsFiltered = 0;
+	uint64 chunkGroupsRead = 0;
+	instr_time startTime;
+	instr_time endTime;
+
+	if (iterations <= 0)
+	{
+		ereport(ERROR, (errmsg("iterations must be a positive number")));
+	}
+
+	if (!IsColumnarTableAmTable(relationId))
+	{
+		ereport(ERROR, (errmsg("relation %s is not a columnar table",
+							   get_rel_name(relationId))));
+	}
+
+	Relation relation = relation_open(relationId, AccessShareLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	Snapshot snapshot = GetTransactionSnapshot();
+
+	StripeMetadata *stripeMetadata =
+		FindNextStripeByRowNumber(relation, COLUMNAR_INVALID_ROW_NUMBER, snapshot);
+	if (stripeMetadata == NULL)
+	{
+		relation_close(relation, AccessShareLock);
+		ereport(ERROR, (errmsg("columnar table %s does not have any stripes",
+							   get_rel_name(relationId))));
+	}
+
+	List *projectedColumnList = NIL;
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		if (!TupleDescAttr(tupleDescriptor, columnIndex)->attisdropped)
+		{
+			projectedColumnList = lappend_int(projectedColumnList, columnIndex + 1);
+		}
+	}
+
+	StripeBuffers *stripeBuffers =
+		LoadFilteredStripeBuffers(relation, stripeMetadata, tupleDescriptor,
+								  projectedColumnList, NIL, NIL,
+								  &chunkGroupsFiltered, snapshot, NULL);
+
+	MemoryContext chunkContext = AllocSetContextCreate(CurrentMemoryContext,
+													   "Columnar Chunk Benchmark",
+													   ALLOCSET_DEFAULT_SIZES);
+
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		for (uint64 chunkIndex = 0; chunkIndex < stripeMetadata->chunkCount;
+			 chunkIndex++)
+		{
+			MemoryContext oldContext = MemoryContextSwitchTo(chunkContext);
+
+			DeserializeChunkData(stripeBuffers, chunkIndex,
+								 stripeBuffers->selectedChunkGroupRowCounts[chunkIndex],
+								 tupleDescriptor, projectedColumnList);
+
+			MemoryContextSwitchTo(oldContext);
+			MemoryContextReset(chunkContext);
+
+			chunkGroupsRead++;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	INSTR_TIME_SET_CURRENT(endTime);
+	INSTR_TIME_SUBTRACT(endTime, startTime);
+
+	MemoryContextDelete(chunkContext);
+	relation_close(relation, AccessShareLock);
+
+	if (chunkGroupsRead == 0)
+	{
+		PG_RETURN_NULL();
+	}
+
+	PG_RETURN_FLOAT8(INSTR_TIME_GET_DOUBLE(endTime) * 1e9 / chunkGroupsRead);
+}
@@ -86,6 +86,17 @@ typedef struct ColumnarMetapage
 	 * XXX: Not used yet; reserved field for later support for UNLOGGED.
 	 */
 	bool unloggedReset;
+
+	/*
+	 * Running totals of the flushed stripes, which let the planner estimate
+	 * the size of the table without reading columnar.stripe. They are only
+	 * set if totalsValid is, which is not the case for metapages that were
+	 * created before these fields were added. The totals are not
+	 * transactional, so they include the stripes of aborted writes until
+	 * VACUUM recomputes them.
+	 */
+	bool totalsValid;
+	ColumnarStorageTotals totals;
 } ColumnarMetapage;
 
 
@@ -140,7 +151,8 @@ static void ColumnarOverwriteMetapage(Relation relation,
 									  ColumnarMetapage columnarMetapage);
 static ColumnarMetapage ColumnarMetapageRead(Relation rel, bool force);
 static void ReadFromBlock(Relation rel, BlockNumber blockno, uint32 offset,
-						  char *buf, uint32 len, bool force);
+						  char *buf, uint32 len, bool force,
+						  BufferAccessStrategy strategy);
 static void WriteToBlock(Relation rel, BlockNumber blockno, uint32 offset,
 						 char *buf, uint32 len, bool clear);
 static uint64 AlignReservation(uint64 prevReservation);
@@ -184,6 +196,7 @@ ColumnarStorageInit(SMgrRelation srel, uint64 storageId)
 	metapage.reservedRowNumber = COLUMNAR_FIRST_ROW_NUMBER;
 	metapage.reservedOffset = ColumnarFirstLogicalOffset;
 	metapage.unloggedReset = false;
+	metapage.totalsValid = true;
 	memcpy_s(page + phdr->pd_lower, phdr->pd_upper - phdr->pd_lower,
 			 (char *) &metapage, sizeof(ColumnarMetapage));
 	phdr->pd_lower += sizeof(ColumnarMetapage);
@@ -349,6 +362,89 @@ ColumnarStorageGetReservedOffset(Relation rel, bool force)
 }
 
 
+/*
+ * ColumnarStorageGetTotals - get the running totals of the flushed stripes
+ * from the metapage. Returns false if the metapage has no valid totals, in
+ * which case the caller needs to read the stripe metadata.
+ */
+bool
+ColumnarStorageGetTotals(Relation rel, ColumnarStorageTotals *totals)
+{
+	if (!ColumnarStorageIsCurrent(rel))
+	{
+		return false;
+	}
+
+	ColumnarMetapage metapage = ColumnarMetapageRead(rel, false);
+	if (!metapage.totalsValid)
+	{
+		return false;
+	}
+
+	*totals = metapage.totals;
+	return true;
+}
+
+
+/*
+ * ColumnarStorageSetTotals - overwrite the running totals of the flushed
+ * stripes in the metapage, and mark them as valid.
+ */
+void
+ColumnarStorageSetTotals(Relation rel, ColumnarStorageTotals *totals)
+{
+	LockRelationForExtension(rel, ExclusiveLock);
+
+	ColumnarMetapage metapage = ColumnarMetapageRead(rel, false);
+
+	metapage.totalsValid = true;
+	metapage.totals = *totals;
+
+	ColumnarOverwriteMetapage(rel, metapage);
+
+	UnlockRelationForExtension(rel, ExclusiveLock);
+}
+
+
+/*
+ * ColumnarStorageAddStripeTotals - add a flushed stripe to the running
+ * totals in the metapage, or remove it if 'add' is false. No effect if the
+ * totals are not valid.
+ */
+void
+ColumnarStorageAddStripeTotals(Relation rel, uint64 rowCount, uint64 dataLength,
+							   uint32 columnCount, bool add)
+{
+	LockRelationForExtension(rel, ExclusiveLock);
+
+	ColumnarMetapage metapage = ColumnarMetapageRead(rel, false);
+
+	if (metapage.totalsValid)
+	{
+		ColumnarStorageTotals *totals = &metapage.totals;
+
+		if (add)
+		{
+			totals->stripeCount++;
+			totals->rowCount += rowCount;
+			totals->dataLength += dataLength;
+			totals->maxColumnCount = Max(totals->maxColumnCount, columnCount);
+		}
+		else
+		{
+			/* maxColumnCount stays as is until the totals are recomputed */
+			totals->stripeCount -= Min(totals->stripeCount, 1);
+			totals->rowCount -= Min(totals->rowCount, rowCount);
+			totals->dataLength -= Min(totals->dataLength, dataLength);
+		}
+
+		ColumnarOverwriteMetapage(rel, metapage);
+	}
+
+	UnlockRelationForExtension(rel, ExclusiveLock);
+}
+
+
 /*
  * ColumnarStorageIsCurrent - return true if metapage exists and is not
  * the current version.
@@ -462,6 +558,19 @@ ColumnarStorageReserveData(Relation rel, uint64 amount)
  */
 void
 ColumnarStorageRead(Relation rel, uint64 logicalOffset, char *data, uint32 amount)
+{
+	ColumnarStorageReadExtended(rel, logicalOffset, data, amount, NULL);
+}
+
+
+/*
+ * ColumnarStorageReadExtended - like ColumnarStorageRead, but reads the blocks
+ * with the given buffer access strategy, such as the BULKREAD ring of a large
+ * sequential scan. A NULL strategy uses normal buffer replacement.
+ */
+void
+ColumnarStorageReadExtended(Relation rel, uint64 logicalOffset, char *data,
+							uint32 amount, BufferAccessStrategy strategy)
 {
 	/* if there's no work to do, succeed even with invalid offset */
 	if (amount == 0)
@@ -485,13 +594,38 @@ ColumnarStorageRead(Relation rel, uint64 logicalOffset, char *data, uint32 amoun
 
 		uint32 to_read = Min(amount - read, BLCKSZ - addr.offset);
 		ReadFromBlock(rel, addr.blockno, addr.offset, data + read, to_read,
-					  false);
+					  false, strategy);
 
 		read += to_read;
 	}
 }
 
 
+/*
+ * ColumnarStoragePrefetch - initiate asynchronous reads of the blocks that
+ * hold the given logical range, such that a later ColumnarStorageRead of the
+ * range does not need to wait for them.
+ */
+void
+ColumnarStoragePrefetch(Relation rel, uint64 logicalOffset, uint32 amount)
+{
+#ifdef USE_PREFETCH
+	if (amount == 0 || !ColumnarLogicalOffsetIsValid(logicalOffset))
+	{
+		return;
+	}
+
+	BlockNumber firstBlock = LogicalToPhysical(logicalOffset).blockno;
+	BlockNumber lastBlock = LogicalToPhysical(logicalOffset + amount - 1).blockno;
+
+	for (BlockNumber blockno = firstBlock; blockno <= lastBlock; blockno++)
+	{
+		PrefetchBuffer(rel, MAIN_FORKNUM, blockno);
+	}
+#endif
+}
+
+
 /*
  * ColumnarStorageWrite - map the logical offset to a block and offset, then
  * write the buffer across multiple blocks if necessary.
@@ -649,7 +783,8 @@ ColumnarMetapageRead(Relation rel, bool force)
 	bool forceReadBlock = true;
 	ColumnarMetapage metapage;
 	ReadFromBlock(rel, COLUMNAR_METAPAGE_BLOCKNO, SizeOfPageHeaderData,
-				  (char *) &metapage, sizeof(ColumnarMetapage), forceReadBlock);
+				  (char *) &metapage, sizeof(ColumnarMetapage), forceReadBlock,
+				  NULL);
 
 	if (!force)
 	{
@@ -663,13 +798,14 @@ ColumnarMetapageRead(Relation rel, bool force)
 /*
  * ReadFromBlock - read bytes from a page at the given offset. If 'force' is
  * true, don't check pd_lower; useful when reading a metapage of unknown
- * version.
+ * version. The block is read with the given buffer access strategy, if any.
  */
 static void
 ReadFromBlock(Relation rel, BlockNumber blockno, uint32 offset, char *buf,
-			  uint32 len, bool force)
+			  uint32 len, bool force, BufferAccessStrategy strategy)
 {
-	Buffer buffer = ReadBuffer(rel, blockno);
+	Buffer buffer = ReadBufferExtended(rel, MAIN_FORKNUM, blockno, RBM_NORMAL,
+									   strategy);
 	LockBuffer(buffer, BUFFER_LOCK_SHARE);
 	Page page = BufferGetPage(buffer);
 	PageHeader phdr = (PageHeader) page;
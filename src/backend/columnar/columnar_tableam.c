@@ -32,6 +32,7 @@
 #include "nodes/makefuncs.h"
 #include "optimizer/plancat.h"
 #include "pgstat.h"
+#include "port/pg_bitutils.h"
 #include "safe_lib.h"
 #include "storage/bufmgr.h"
 #include "storage/bufpage.h"
@@ -41,6 +42,7 @@
 #include "storage/procarray.h"
 #include "storage/smgr.h"
 #include "tcop/utility.h"
+#include "utils/acl.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/memutils.h"
@@ -54,6 +56,10 @@
 #include "columnar/columnar_storage.h"
 #include "columnar/columnar_tableam.h"
 #include "columnar/columnar_version_compat.h"
+#if PG_VERSION_NUM >= PG_VERSION_14
+#include "access/toast_compression.h"
+#endif
+#include "access/toast_internals.h"
 #include "distributed/listutils.h"
 
 /*
@@ -83,6 +89,19 @@ typedef struct ColumnarScanDescData
 } ColumnarScanDescData;
 
 
+/*
+ * ParallelColumnarScanDescData is the shared state of a parallel scan. The
+ * participants claim the stripes they read from nextStripeIndex.
+ */
+typedef struct ParallelColumnarScanDescData
+{
+	ParallelTableScanDescData base;
+	pg_atomic_uint64 nextStripeIndex;
+} ParallelColumnarScanDescData;
+
+typedef struct ParallelColumnarScanDescData *ParallelColumnarScanDesc;
+
+
 /*
  * IndexFetchColumnarData is the scan state passed between index_fetch_begin,
  * index_fetch_reset, index_fetch_end, index_fetch_tuple calls.
@@ -131,6 +150,7 @@ static void TruncateColumnar(Relation rel, int elevel);
 static HeapTuple ColumnarSlotCopyHeapTuple(TupleTableSlot *slot);
 static void ColumnarCheckLogicalReplication(Relation rel);
 static Datum * detoast_values(TupleDesc tupleDesc, Datum *orig_values, bool *isnull);
+static Datum compress_large_value(Form_pg_attribute attributeForm, Datum value);
 static ItemPointerData row_number_to_tid(uint64 rowNumber);
 static uint64 tid_to_row_number(ItemPointerData tid);
 static void ErrorIfInvalidRowNumber(uint64 rowNumber);
@@ -269,14 +289,22 @@ CreateColumnarScanMemoryContext(void)
 static ColumnarReadState *
 init_columnar_read_state(Relation relation, TupleDesc tupdesc, Bitmapset *attr_needed,
 						 List *scanQual, MemoryContext scanContext, Snapshot snapshot,
-						 bool randomAccess)
+						 bool randomAccess, ParallelTableScanDesc parallelScan)
 {
 	MemoryContext oldContext = MemoryContextSwitchTo(scanContext);
 
+	pg_atomic_uint64 *parallelStripeCounter = NULL;
+	if (parallelScan != NULL)
+	{
+		parallelStripeCounter =
+			&((ParallelColumnarScanDesc) parallelScan)->nextStripeIndex;
+	}
+
 	List *neededColumnList = NeededColumnsList(tupdesc, attr_needed);
 	ColumnarReadState *readState = ColumnarBeginRead(relation, tupdesc, neededColumnList,
 													 scanQual, scanContext, snapshot,
-													 randomAccess);
+													 randomAccess,
+													 parallelStripeCounter);
 
 	MemoryContextSwitchTo(oldContext);
 
@@ -332,7 +360,7 @@ columnar_getnextslot(TableScanDesc sscan, ScanDirection direction, TupleTableSlo
 			init_columnar_read_state(scan->cs_base.rs_rd, slot->tts_tupleDescriptor,
 									 scan->attr_needed, scan->scanQual,
 									 scan->scanContext, scan->cs_base.rs_snapshot,
-									 randomAccess);
+									 randomAccess, scan->cs_base.rs_parallel);
 	}
 
 	ExecClearTuple(slot);
@@ -411,21 +439,37 @@ ErrorIfInvalidRowNumber(uint64 rowNumber)
 static Size
 columnar_parallelscan_estimate(Relation rel)
 {
-	elog(ERROR, "columnar_parallelscan_estimate not implemented");
+	return sizeof(ParallelColumnarScanDescData);
 }
 
 
+/*
+ * columnar_parallelscan_initialize initializes the shared state of a parallel
+ * scan, in which the participants read the stripes of the table one at a
+ * time in the order they claim them.
+ */
 static Size
 columnar_parallelscan_initialize(Relation rel, ParallelTableScanDesc pscan)
 {
-	elog(ERROR, "columnar_parallelscan_initialize not implemented");
+	ParallelColumnarScanDesc parallelScan = (ParallelColumnarScanDesc) pscan;
+
+	parallelScan->base.phs_relid = RelationGetRelid(rel);
+	parallelScan->base.phs_syncscan = false;
+	pg_atomic_init_u64(&parallelScan->nextStripeIndex, 0);
+
+	/* workers cannot see the pending writes of the leader, so flush them now */
+	FlushWriteStateForRelfilenode(rel->rd_node.relNode, GetCurrentSubTransactionId());
+
+	return sizeof(ParallelColumnarScanDescData);
 }
 
 
 static void
 columnar_parallelscan_reinitialize(Relation rel, ParallelTableScanDesc pscan)
 {
-	elog(ERROR, "columnar_parallelscan_reinitialize not implemented");
+	ParallelColumnarScanDesc parallelScan = (ParallelColumnarScanDesc) pscan;
+
+	pg_atomic_write_u64(&parallelScan->nextStripeIndex, 0);
 }
 
 
@@ -519,7 +563,7 @@ columnar_index_fetch_tuple(struct IndexFetchTableData *sscan,
 													  slot->tts_tupleDescriptor,
 													  attr_needed, scanQual,
 													  scan->scanContext,
-													  snapshot, randomAccess);
+													  snapshot, randomAccess, NULL);
 	}
 
 	uint64 rowNumber = tid_to_row_number(*tid);
@@ -628,13 +672,62 @@ columnar_index_fetch_tuple(struct IndexFetchTableData *sscan,
 }
 
 
+/*
+ * columnar_fetch_row_version fetches the row with the given tid if the given
+ * snapshot sees it, which UPDATE and DELETE use to get the old version of
+ * the rows that they modify.
+ */
 static bool
 columnar_fetch_row_version(Relation relation,
 						   ItemPointer tid,
 						   Snapshot snapshot,
 						   TupleTableSlot *slot)
 {
-	elog(ERROR, "columnar_fetch_row_version not implemented");
+	CheckCitusColumnarVersion(ERROR);
+
+	ExecClearTuple(slot);
+
+	uint64 rowNumber = tid_to_row_number(*tid);
+	StripeMetadata *stripeMetadata = FindStripeByRowNumber(relation, rowNumber,
+														   snapshot);
+	if (stripeMetadata == NULL ||
+		StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED)
+	{
+		return false;
+	}
+
+	MemoryContext scanContext = CreateColumnarScanMemoryContext();
+	MemoryContext oldContext = MemoryContextSwitchTo(scanContext);
+
+	/* we need all columns */
+	int natts = relation->rd_att->natts;
+	Bitmapset *attr_needed = bms_add_range(NULL, 0, natts - 1);
+
+	bool randomAccess = true;
+	ColumnarReadState *readState = init_columnar_read_state(relation,
+															slot->tts_tupleDescriptor,
+															attr_needed, NIL,
+															scanContext, snapshot,
+															randomAccess, NULL);
+
+	bool rowFound = ColumnarReadRowByRowNumber(readState, rowNumber, slot->tts_values,
+											   slot->tts_isnull);
+	if (rowFound)
+	{
+		/* copy the values out of the scan context before freeing it */
+		ExecStoreVirtualTuple(slot);
+		ExecMaterializeSlot(slot);
+
+		slot->tts_tableOid = RelationGetRelid(relation);
+		slot->tts_tid = *tid;
+	}
+
+	ColumnarEndRead(readState);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(scanContext);
+
+	return rowFound;
 }
 
 
@@ -661,7 +754,28 @@ columnar_tuple_satisfies_snapshot(Relation rel, TupleTableSlot *slot,
 
 	uint64 rowNumber = tid_to_row_number(slot->tts_tid);
 	StripeMetadata *stripeMetadata = FindStripeByRowNumber(rel, rowNumber, snapshot);
-	return stripeMetadata != NULL;
+	if (stripeMetadata == NULL)
+	{
+		return false;
+	}
+
+	uint64 rowOffset = rowNumber - stripeMetadata->firstRowNumber;
+	if (RowDeletedByCurrentSubXact(rel->rd_node.relNode, GetCurrentSubTransactionId(),
+								   stripeMetadata->id, rowOffset))
+	{
+		return false;
+	}
+
+	Snapshot deletionSnapshot = snapshot;
+	if (!IsMVCCSnapshot(deletionSnapshot))
+	{
+		deletionSnapshot = SnapshotSelf;
+	}
+
+	uint8 *deletedRows = ReadStripeDeletedRows(rel->rd_node, stripeMetadata->id,
+											   stripeMetadata->rowCount,
+											   deletionSnapshot, NULL);
+	return deletedRows == NULL || !COLUMNAR_ROW_IS_DELETED(deletedRows, rowOffset);
 }
 
 
@@ -818,22 +932,74 @@ columnar_multi_insert(Relation relation, TupleTableSlot **slots, int ntuples,
 }
 
 
+/*
+ * columnar_tuple_delete marks the row with the given tid as deleted in the
+ * deletion bitmap of its stripe. The data of the row stays in the stripe
+ * until the table is rewritten or its stripes are compacted.
+ *
+ * Deleters of a table are serialized by the write state, so a row that
+ * another transaction deleted is always reported as TM_Deleted, and there
+ * is never a deletion to wait for.
+ */
 static TM_Result
 columnar_tuple_delete(Relation relation, ItemPointer tid, CommandId cid,
 					  Snapshot snapshot, Snapshot crosscheck, bool wait,
 					  TM_FailureData *tmfd, bool changingPart)
 {
-	elog(ERROR, "columnar_tuple_delete not implemented");
+	CheckCitusColumnarVersion(ERROR);
+
+	ColumnarWriteState *writeState = columnar_init_write_state(relation,
+															   RelationGetDescr(relation),
+															   RelationGetRelid(relation),
+															   GetCurrentSubTransactionId());
+
+	TM_Result result = ColumnarDeleteRow(writeState, relation, tid_to_row_number(*tid),
+										 snapshot);
+	if (result != TM_Ok)
+	{
+		tmfd->ctid = *tid;
+		tmfd->xmax = InvalidTransactionId;
+		tmfd->cmax = (result == TM_SelfModified) ? cid : InvalidCommandId;
+	}
+
+	return result;
 }
 
 
+/*
+ * columnar_tuple_update deletes the row with the given tid and inserts the
+ * new version of the row as a new row, since stripes cannot be modified in
+ * place.
+ */
 static TM_Result
 columnar_tuple_update(Relation relation, ItemPointer otid, TupleTableSlot *slot,
 					  CommandId cid, Snapshot snapshot, Snapshot crosscheck,
 					  bool wait, TM_FailureData *tmfd,
 					  LockTupleMode *lockmode, bool *update_indexes)
 {
-	elog(ERROR, "columnar_tuple_update not implemented");
+	CheckCitusColumnarVersion(ERROR);
+
+	*lockmode = LockTupleExclusive;
+
+	bool changingPart = false;
+	TM_Result result = columnar_tuple_delete(relation, otid, cid, snapshot, crosscheck,
+											 wait, tmfd, changingPart);
+	if (result != TM_Ok)
+	{
+		*update_indexes = false;
+		return result;
+	}
+
+	slot->tts_tableOid = RelationGetRelid(relation);
+
+	int options = 0;
+	BulkInsertState bistate = NULL;
+	columnar_tuple_insert(relation, slot, cid, options, bistate);
+
+	/* the new version of the row has a new row number */
+	*update_indexes = true;
+
+	return TM_Ok;
 }
 
 
@@ -969,6 +1135,9 @@ columnar_relation_copy_for_cluster(Relation OldHeap, Relation NewHeap,
 	ColumnarOptions columnarOptions = { 0 };
 	ReadColumnarOptions(OldHeap->rd_id, &columnarOptions);
 
+	/* keep compressing with the dictionaries that were trained for the table */
+	CopyCompressionDictionaries(OldHeap->rd_node, NewHeap->rd_node);
+
 	ColumnarWriteState *writeState = ColumnarBeginWrite(NewHeap->rd_node,
 														columnarOptions,
 														targetDesc);
@@ -988,7 +1157,7 @@ columnar_relation_copy_for_cluster(Relation OldHeap, Relation NewHeap,
 	ColumnarReadState *readState = init_columnar_read_state(OldHeap, sourceDesc,
 															attr_needed, scanQual,
 															scanContext, snapshot,
-															randomAccess);
+															randomAccess, NULL);
 
 	Datum *values = palloc0(sourceDesc->natts * sizeof(Datum));
 	bool *nulls = palloc0(sourceDesc->natts * sizeof(bool));
@@ -1101,6 +1270,9 @@ columnar_vacuum_rel(Relation rel, VacuumParams *params,
 		TruncateColumnar(rel, elevel);
 	}
 
+	/* drop aborted writes from the totals that the planner uses */
+	RecomputeStorageTotals(rel);
+
 	BlockNumber new_rel_pages = smgrnblocks(RelationGetSmgr(rel), MAIN_FORKNUM);
 
 	/* get the number of indexes */
@@ -1466,50 +1638,65 @@ columnar_index_build_range_scan(Relation columnarRelation,
 		ereport(ERROR, (errmsg("BRIN indexes on columnar tables are not supported")));
 	}
 
-	if (scan)
-	{
-		/*
-		 * Parallel scans on columnar tables are already discardad by
-		 * ColumnarGetRelationInfoHook but be on the safe side.
-		 */
-		elog(ERROR, "parallel scans on columnar are not supported");
-	}
-
-	/*
-	 * In a normal index build, we use SnapshotAny to retrieve all tuples. In
-	 * a concurrent build or during bootstrap, we take a regular MVCC snapshot
-	 * and index whatever's live according to that.
-	 */
-	TransactionId OldestXmin = InvalidTransactionId;
-	if (!IsBootstrapProcessingMode() && !indexInfo->ii_Concurrent)
+	/* rows get new row numbers when their stripe is sorted on write */
+	ColumnarOptions columnarOptions = { 0 };
+	if (ReadColumnarOptions(RelationGetRelid(columnarRelation), &columnarOptions) &&
+		columnarOptions.sortBy != NULL)
 	{
-		/* ignore lazy VACUUM's */
-		OldestXmin = GetOldestNonRemovableTransactionId_compat(columnarRelation,
-															   PROCARRAY_FLAGS_VACUUM);
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("indexes are not supported on columnar tables with "
+							   "the \"sort_by\" option"),
+						errhint("Reset the option with ALTER TABLE ... RESET "
+								"(columnar.sort_by).")));
 	}
 
 	Snapshot snapshot = { 0 };
 	bool snapshotRegisteredByUs = false;
 
-	/*
-	 * For serial index build, we begin our own scan. We may also need to
-	 * register a snapshot whose lifetime is under our direct control.
-	 */
-	if (!TransactionIdIsValid(OldestXmin))
+	if (scan != NULL)
 	{
-		snapshot = RegisterSnapshot(GetTransactionSnapshot());
-		snapshotRegisteredByUs = true;
+		/*
+		 * In a parallel index build, the leader set up the snapshot of the
+		 * parallel scan, and the participants read the stripes that they claim
+		 * from it, see columnar_parallelscan_initialize.
+		 */
+		snapshot = scan->rs_snapshot;
 	}
 	else
 	{
-		snapshot = SnapshotAny;
-	}
+		/*
+		 * In a normal index build, we use SnapshotAny to retrieve all tuples.
+		 * In a concurrent build or during bootstrap, we take a regular MVCC
+		 * snapshot and index whatever's live according to that.
+		 */
+		TransactionId OldestXmin = InvalidTransactionId;
+		if (!IsBootstrapProcessingMode() && !indexInfo->ii_Concurrent)
+		{
+			/* ignore lazy VACUUM's */
+			OldestXmin = GetOldestNonRemovableTransactionId_compat(
+				columnarRelation, PROCARRAY_FLAGS_VACUUM);
+		}
 
-	int nkeys = 0;
-	ScanKeyData *scanKey = NULL;
-	bool allowAccessStrategy = true;
-	scan = table_beginscan_strat(columnarRelation, snapshot, nkeys, scanKey,
-								 allowAccessStrategy, allow_sync);
+		/*
+		 * For serial index build, we begin our own scan. We may also need to
+		 * register a snapshot whose lifetime is under our direct control.
+		 */
+		if (!TransactionIdIsValid(OldestXmin))
+		{
+			snapshot = RegisterSnapshot(GetTransactionSnapshot());
+			snapshotRegisteredByUs = true;
+		}
+		else
+		{
+			snapshot = SnapshotAny;
+		}
+
+		int nkeys = 0;
+		ScanKeyData *scanKey = NULL;
+		bool allowAccessStrategy = true;
+		scan = table_beginscan_strat(columnarRelation, snapshot, nkeys, scanKey,
+									 allowAccessStrategy, allow_sync);
+	}
 
 	if (progress)
 	{
@@ -2008,6 +2195,7 @@ columnar_tableam_init()
 	ProcessUtility_hook = ColumnarProcessUtility;
 
 	columnar_customscan_init();
+	columnar_aggregate_scan_init();
 
 	TTSOpsColumnar = TTSOpsVirtual;
 	TTSOpsColumnar.copy_heap_tuple = ColumnarSlotCopyHeapTuple;
@@ -2043,6 +2231,27 @@ ColumnarScanChunkGroupsFiltered(ColumnarScanDesc columnarScanDesc)
 }
 
 
+/*
+ * ColumnarScanRowsFiltered returns the number of rows filtered by the
+ * vectorized quals during the given scan.
+ */
+int64
+ColumnarScanRowsFiltered(ColumnarScanDesc columnarScanDesc)
+{
+	ColumnarReadState *readState = columnarScanDesc->cs_readState;
+
+	/* readState is initialized lazily */
+	if (readState != NULL)
+	{
+		return ColumnarReadRowsFiltered(readState);
+	}
+	else
+	{
+		return 0;
+	}
+}
+
+
 /*
  * Implementation of TupleTableSlotOps.copy_heap_tuple for TTSOpsColumnar.
  */
@@ -2558,6 +2767,10 @@ columnar_handler(PG_FUNCTION_ARGS)
  * Detoast and decompress all values. If there's no work to do, return
  * original pointer; otherwise return a newly-allocated values array. Should
  * be called in per-tuple context.
+ *
+ * Values of at least columnar.large_value_compression_threshold bytes are
+ * instead stored compressed inline, such that scans only decompress them
+ * when they are used, see compress_large_value.
  */
 static Datum *
 detoast_values(TupleDesc tupleDesc, Datum *orig_values, bool *isnull)
@@ -2570,7 +2783,25 @@ detoast_values(TupleDesc tupleDesc, Datum *orig_values, bool *isnull)
 	for (int i = 0; i < tupleDesc->natts; i++)
 	{
 		if (!isnull[i] && tupleDesc->attrs[i].attlen == -1 &&
-			VARATT_IS_EXTENDED(values[i]))
+			columnar_large_value_compression_threshold > 0 &&
+			toast_raw_datum_size(values[i]) >=
+			(Size) columnar_large_value_compression_threshold)
+		{
+			Datum new_value = compress_large_value(TupleDescAttr(tupleDesc, i),
+												   values[i]);
+
+			/* make a copy */
+			if (values == orig_values)
+			{
+				values = palloc(sizeof(Datum) * natts);
+				memcpy(values, orig_values, sizeof(Datum) * natts); /* IGNORE-BANNED */
+			}
+
+			/* will be freed when per-tuple context is reset */
+			values[i] = new_value;
+		}
+		else if (!isnull[i] && tupleDesc->attrs[i].attlen == -1 &&
+				 VARATT_IS_EXTENDED(values[i]))
 		{
 			/* make a copy */
 			if (values == orig_values)
@@ -2596,6 +2827,56 @@ detoast_values(TupleDesc tupleDesc, Datum *orig_values, bool *isnull)
 }
 
 
+/*
+ * compress_large_value
+ *
+ * Returns the given large value as an inline compressed datum. Values that
+ * are already compressed, like those of toasted heap tuples, are kept as they
+ * are rather than decompressed and compressed again. Values that do not
+ * compress are returned detoasted.
+ */
+static Datum
+compress_large_value(Form_pg_attribute attributeForm, Datum value)
+{
+	struct varlena *new_value = (struct varlena *) DatumGetPointer(value);
+
+	if (VARATT_IS_EXTERNAL(new_value))
+	{
+		new_value = detoast_external_attr(new_value);
+	}
+
+	if (VARATT_IS_COMPRESSED(new_value))
+	{
+		return PointerGetDatum(new_value);
+	}
+
+	if (VARATT_IS_EXTENDED(new_value))
+	{
+		new_value = detoast_attr(new_value);
+	}
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+	char compressionMethod = attributeForm->attcompression;
+	if (!CompressionMethodIsValid(compressionMethod))
+	{
+		compressionMethod = default_toast_compression;
+	}
+
+	Datum compressedValue = toast_compress_datum(PointerGetDatum(new_value),
+												 compressionMethod);
+#else
+	Datum compressedValue = toast_compress_datum(PointerGetDatum(new_value));
+#endif
+
+	if (DatumGetPointer(compressedValue) != NULL)
+	{
+		return compressedValue;
+	}
+
+	return PointerGetDatum(new_value);
+}
+
+
 /*
  * ColumnarCheckLogicalReplication throws an error if the relation is
  * part of any publication. This should be called before any write to
@@ -2744,6 +3025,309 @@ downgrade_columnar_storage(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * compact_stripes merges the small stripes of a columnar table into new
+ * stripes of up to stripe_row_limit rows and removes the metadata of the
+ * merged stripes, which improves the compression ratio and reduces the
+ * per-stripe overhead of scans. A stripe is small if it has fewer rows than
+ * small_stripe_row_count live rows, which defaults to half of
+ * stripe_row_limit. Deleted rows are dropped from the merged stripes, so a
+ * single small stripe is rewritten if it has deleted rows. Returns the number
+ * of stripes that have been merged.
+ *
+ * Only writers are blocked while compacting. Since the merged rows get new
+ * row numbers, tables with indexes are not supported, and the space of the
+ * merged stripes is only reclaimed by VACUUM FULL.
+ *
+ * DDL:
+ *   CREATE OR REPLACE FUNCTION columnar.compact_stripes(
+ *	   table_name regclass,
+ *	   small_stripe_row_count int DEFAULT NULL)
+ *     RETURNS bigint
+ *     LANGUAGE c AS 'MODULE_PATHNAME', 'compact_stripes';
+ */
+PG_FUNCTION_INFO_V1(compact_stripes);
+Datum
+compact_stripes(PG_FUNCTION_ARGS)
+{
+	CheckCitusColumnarVersion(ERROR);
+
+	if (PG_ARGISNULL(0))
+	{
+		ereport(ERROR, (errmsg("table_name cannot be NULL")));
+	}
+
+	Oid relid = PG_GETARG_OID(0);
+
+	/* block writers but not readers, as in CREATE INDEX CONCURRENTLY */
+	Relation rel = table_open(relid, ExclusiveLock);
+	if (!IsColumnarTableAmTable(relid))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	if (!pg_class_ownercheck(relid, GetUserId()))
+	{
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE,
+					   RelationGetRelationName(rel));
+	}
+
+	if (RelationGetIndexList(rel) != NIL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("compacting stripes of columnar tables with "
+							   "indexes is not supported"),
+						errhint("Use VACUUM FULL to rewrite the table instead.")));
+	}
+
+	ColumnarOptions columnarOptions = { 0 };
+	ReadColumnarOptions(relid, &columnarOptions);
+
+	uint64 smallStripeRowCount = columnarOptions.stripeRowCount / 2;
+	if (!PG_ARGISNULL(1))
+	{
+		int32 smallStripeRowCountArg = PG_GETARG_INT32(1);
+		if (smallStripeRowCountArg <= 0)
+		{
+			ereport(ERROR, (errmsg("small_stripe_row_count must be positive")));
+		}
+
+		smallStripeRowCount = smallStripeRowCountArg;
+	}
+
+	/* make the stripes that this transaction wrote so far visible */
+	FlushWriteStateForRelfilenode(rel->rd_node.relNode, GetCurrentSubTransactionId());
+
+	Snapshot snapshot = RegisterSnapshot(GetTransactionSnapshot());
+
+	/*
+	 * Deleters are blocked by our lock, so all deletions are either committed
+	 * or aborted, and the deletion bitmaps that SnapshotSelf sees are the
+	 * ones that readers will see once we commit.
+	 */
+	List *smallStripeList = NIL;
+	List *deletedRowsList = NIL;
+	bool hasDeletedRows = false;
+	StripeMetadata *stripeMetadata = NULL;
+	foreach_ptr(stripeMetadata, StripesForRelfilenode(rel->rd_node))
+	{
+		if (StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED)
+		{
+			continue;
+		}
+
+		uint8 *deletedRows = ReadStripeDeletedRows(rel->rd_node, stripeMetadata->id,
+												   stripeMetadata->rowCount,
+												   SnapshotSelf, NULL);
+		uint64 liveRowCount = stripeMetadata->rowCount;
+		if (deletedRows != NULL)
+		{
+			liveRowCount -= pg_popcount((char *) deletedRows,
+										COLUMNAR_DELETION_BITMAP_SIZE(
+											stripeMetadata->rowCount));
+		}
+
+		if (liveRowCount < smallStripeRowCount)
+		{
+			smallStripeList = lappend(smallStripeList, stripeMetadata);
+			deletedRowsList = lappend(deletedRowsList, deletedRows);
+			hasDeletedRows |= (deletedRows != NULL);
+		}
+	}
+
+	/* a single small stripe is only worth rewriting to drop its deleted rows */
+	if (list_length(smallStripeList) < 2 && !hasDeletedRows)
+	{
+		UnregisterSnapshot(snapshot);
+		table_close(rel, ExclusiveLock);
+		PG_RETURN_INT64(0);
+	}
+
+	/* we need all columns */
+	TupleDesc tupleDesc = RelationGetDescr(rel);
+	Bitmapset *attr_needed = bms_add_range(NULL, 0, tupleDesc->natts - 1);
+
+	MemoryContext scanContext = CreateColumnarScanMemoryContext();
+	bool randomAccess = true;
+	ColumnarReadState *readState = init_columnar_read_state(rel, tupleDesc,
+															attr_needed, NIL,
+															scanContext, snapshot,
+															randomAccess, NULL);
+	ColumnarWriteState *writeState = ColumnarBeginWrite(rel->rd_node, columnarOptions,
+														tupleDesc);
+
+	Datum *values = palloc0(tupleDesc->natts * sizeof(Datum));
+	bool *nulls = palloc0(tupleDesc->natts * sizeof(bool));
+
+	/* stripes are in row number order, so the rows keep their relative order */
+	ListCell *deletedRowsCell = NULL;
+	forboth(stripeMetadataCell, smallStripeList, deletedRowsCell, deletedRowsList)
+	{
+		stripeMetadata = lfirst(stripeMetadataCell);
+		uint8 *deletedRows = lfirst(deletedRowsCell);
+
+		for (uint64 rowOffset = 0; rowOffset < stripeMetadata->rowCount; rowOffset++)
+		{
+			CHECK_FOR_INTERRUPTS();
+
+			if (deletedRows != NULL && COLUMNAR_ROW_IS_DELETED(deletedRows, rowOffset))
+			{
+				continue;
+			}
+
+			uint64 rowNumber = stripeMetadata->firstRowNumber + rowOffset;
+			ColumnarReadRowByRowNumberOrError(readState, rowNumber, values, nulls);
+			ColumnarWriteRow(writeState, values, nulls);
+		}
+	}
+
+	ColumnarEndWrite(writeState);
+	ColumnarEndRead(readState);
+
+	/*
+	 * Transactions that started before us keep seeing the merged stripes and
+	 * not the new ones, since both metadata changes commit together.
+	 */
+	foreach_ptr(stripeMetadata, smallStripeList)
+	{
+		DeleteStripeMetadata(rel->rd_node, stripeMetadata->id);
+
+		bool add = false;
+		ColumnarStorageAddStripeTotals(rel, stripeMetadata->rowCount,
+									   stripeMetadata->dataLength,
+									   stripeMetadata->columnCount, add);
+	}
+
+	UnregisterSnapshot(snapshot);
+	table_close(rel, ExclusiveLock);
+
+	PG_RETURN_INT64(list_length(smallStripeList));
+}
+
+
+/*
+ * train_compression_dictionary trains a zstd dictionary from a sample of the
+ * values of the given column and stores it as the current dictionary of the
+ * column. The chunks of the column that are compressed with zstd afterwards,
+ * including by VACUUM FULL and columnar.compact_stripes, are compressed with
+ * the dictionary, which improves the compression ratio of small chunks.
+ * Returns the id of the dictionary, or NULL if the column does not have
+ * enough data to train a dictionary.
+ *
+ * DDL:
+ *   CREATE OR REPLACE FUNCTION columnar.train_compression_dictionary(
+ *	   table_name regclass,
+ *	   column_name name)
+ *     RETURNS bigint
+ *     STRICT
+ *     LANGUAGE c AS 'MODULE_PATHNAME', 'train_compression_dictionary';
+ */
+PG_FUNCTION_INFO_V1(train_compression_dictionary);
+Datum
+train_compression_dictionary(PG_FUNCTION_ARGS)
+{
+	CheckCitusColumnarVersion(ERROR);
+
+	Oid relid = PG_GETARG_OID(0);
+	Name columnName = PG_GETARG_NAME(1);
+
+	/* serialize trainings of the same table, but do not block writers */
+	Relation rel = table_open(relid, ShareUpdateExclusiveLock);
+	if (!IsColumnarTableAmTable(relid))
+	{
+		ereport(ERROR, (errmsg("table %s is not a columnar table",
+							   quote_identifier(RelationGetRelationName(rel)))));
+	}
+
+	if (!pg_class_ownercheck(relid, GetUserId()))
+	{
+		aclcheck_error(ACLCHECK_NOT_OWNER, OBJECT_TABLE,
+					   RelationGetRelationName(rel));
+	}
+
+	AttrNumber attrNum = get_attnum(relid, NameStr(*columnName));
+	if (attrNum == InvalidAttrNumber || attrNum < 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_COLUMN),
+						errmsg("column \"%s\" of relation \"%s\" does not exist",
+							   NameStr(*columnName), RelationGetRelationName(rel))));
+	}
+
+	TupleDesc tupleDesc = RelationGetDescr(rel);
+	Form_pg_attribute attributeForm = TupleDescAttr(tupleDesc, attrNum - 1);
+	if (attributeForm->attlen != -1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("compression dictionaries are only supported for "
+							   "variable length columns")));
+	}
+
+	/* attr_needed is 0-indexed */
+	Bitmapset *attr_needed = bms_make_singleton(attrNum - 1);
+
+	Snapshot snapshot = RegisterSnapshot(GetTransactionSnapshot());
+	MemoryContext scanContext = CreateColumnarScanMemoryContext();
+	bool randomAccess = false;
+	ColumnarReadState *readState = init_columnar_read_state(rel, tupleDesc,
+															attr_needed, NIL,
+															scanContext, snapshot,
+															randomAccess, NULL);
+
+	/* zstd suggests around 100 times the dictionary size of samples */
+	uint64 maxSampleDataSize = (uint64) COMPRESSION_DICTIONARY_SIZE * 100;
+	uint32 maxSampleCount = 1024;
+	uint32 sampleCount = 0;
+	size_t *sampleSizeArray = palloc0(maxSampleCount * sizeof(size_t));
+	StringInfo sampleData = makeStringInfo();
+
+	Datum *values = palloc0(tupleDesc->natts * sizeof(Datum));
+	bool *nulls = palloc0(tupleDesc->natts * sizeof(bool));
+
+	while (sampleData->len < maxSampleDataSize &&
+		   ColumnarReadNextRow(readState, values, nulls, NULL))
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		if (nulls[attrNum - 1])
+		{
+			continue;
+		}
+
+		if (sampleCount == maxSampleCount)
+		{
+			maxSampleCount *= 2;
+			sampleSizeArray = repalloc(sampleSizeArray, maxSampleCount * sizeof(size_t));
+		}
+
+		/* chunks hold whole varlena values, so the samples do as well */
+		Pointer value = DatumGetPointer(values[attrNum - 1]);
+		appendBinaryStringInfo(sampleData, value, VARSIZE_ANY(value));
+		sampleSizeArray[sampleCount++] = VARSIZE_ANY(value);
+	}
+
+	ColumnarEndRead(readState);
+	UnregisterSnapshot(snapshot);
+
+	bytea *dictionary = TrainCompressionDictionary(sampleData->data, sampleSizeArray,
+												   sampleCount,
+												   COMPRESSION_DICTIONARY_SIZE);
+	if (dictionary == NULL)
+	{
+		ereport(NOTICE, (errmsg("column \"%s\" does not have enough data to train a "
+								"compression dictionary", NameStr(*columnName))));
+		table_close(rel, ShareUpdateExclusiveLock);
+		PG_RETURN_NULL();
+	}
+
+	InsertCompressionDictionary(rel->rd_node, attrNum, dictionary);
+
+	table_close(rel, ShareUpdateExclusiveLock);
+
+	PG_RETURN_INT64(CompressionDictionaryId(dictionary));
+}
+
+
 /*
  * Code to check the Citus Version, helps remove dependency from Citus
  */
@@ -18,20 +18,45 @@
 
 #include "safe_lib.h"
 
+#include "access/hash.h"
 #include "access/heapam.h"
 #include "access/nbtree.h"
 #include "catalog/pg_am.h"
+#include "executor/tuptable.h"
 #include "miscadmin.h"
+#include "parser/parse_oper.h"
 #include "storage/fd.h"
+#include "storage/lmgr.h"
 #include "storage/smgr.h"
 #include "utils/guc.h"
+#include "utils/hsearch.h"
 #include "utils/memutils.h"
 #include "utils/rel.h"
 #include "utils/relfilenodemap.h"
+#include "utils/tuplesort.h"
 
 #include "columnar/columnar.h"
+#include "columnar/columnar_bloom_filter.h"
 #include "columnar/columnar_storage.h"
 #include "columnar/columnar_version_compat.h"
+#include "distributed/listutils.h"
+
+/*
+ * StripeDeletionState holds the rows of a stripe that a write state deleted,
+ * along with the rows of the stripe that were deleted before. deletedRows
+ * has all of them, deletedByOtherXacts those that other transactions deleted
+ * (or NULL if none), and pendingDeletedRows those that are not flushed yet.
+ */
+typedef struct StripeDeletionState
+{
+	uint64 stripeId;            /* hash key */
+	uint64 firstRowNumber;
+	uint64 rowCount;
+	uint8 *deletedRows;
+	uint8 *deletedByOtherXacts;
+	uint8 *pendingDeletedRows;
+	uint64 pendingDeletedRowCount;
+} StripeDeletionState;
 
 struct ColumnarWriteState
 {
@@ -49,6 +74,74 @@ struct ColumnarWriteState
 
 	List *chunkGroupRowCounts;
 
+	/*
+	 * chunkIndex is the chunk group of the current stripe that rows are
+	 * appended to, chunkRowIndex the number of rows in it, and chunkSize the
+	 * size of their serialized values. When chunkGroupSizeLimit is set, a
+	 * chunk group is closed once its values reach that size, hence chunk
+	 * groups can have fewer rows than chunk_group_row_limit. The stripe
+	 * buffers and skip list have room for maxChunkCount chunk groups.
+	 */
+	uint32 chunkIndex;
+	uint32 chunkRowIndex;
+	uint64 chunkSize;
+	uint64 chunkGroupSizeLimit;
+	uint32 maxChunkCount;
+
+	/*
+	 * bloomHashFunctionArray holds the hash functions of the columns in the
+	 * bloom_columns option, and NULL for the other columns. For those
+	 * columns, bloomHashArray[column][row] holds the hashes of the values in
+	 * the current chunk.
+	 */
+	FmgrInfo **bloomHashFunctionArray;
+	uint32 **bloomHashArray;
+
+	/* current zstd dictionary of each column, or NULL for the other columns */
+	bytea **compressionDictionaryArray;
+
+	/*
+	 * When the sort_by option is set, the rows of the current stripe are
+	 * buffered in sortState and only serialized in sort order when the
+	 * stripe is flushed. The sort spills to disk beyond work_mem, and
+	 * sortBufferRowCount is the number of rows it holds.
+	 */
+	int sortKeyCount;
+	AttrNumber *sortAttrNumbers;
+	Oid *sortOperators;
+	Oid *sortCollations;
+	bool *sortNullsFirst;
+	Tuplesortstate *sortState;
+	TupleTableSlot *sortSlot;
+	uint64 sortBufferRowCount;
+
+	/*
+	 * When streamChunkGroups is set, every chunk group is written as soon
+	 * as it is serialized, and freed afterwards. The data of the stripe then
+	 * spans from stripeFileOffset to stripeFileEndOffset, which may include
+	 * data of stripes that concurrent writers wrote in between.
+	 */
+	bool streamChunkGroups;
+	uint64 stripeFileOffset;
+	uint64 stripeFileEndOffset;
+
+	/*
+	 * When compressInParallel is set, the value buffers of chunks are kept
+	 * uncompressed until the stripe is flushed, and then compressed in
+	 * background workers.
+	 */
+	bool compressInParallel;
+
+	/*
+	 * deletionStateMap maps the ids of the stripes that rows were deleted
+	 * from to their StripeDeletionState, and lastDeletionState is the one
+	 * that was used last. The map is created for the first deleted row, in
+	 * the memory context of the write state.
+	 */
+	HTAB *deletionStateMap;
+	StripeDeletionState *lastDeletionState;
+	uint64 pendingDeletedRowCount;
+
 	/*
 	 * compressionBuffer buffer is used as temporary storage during
 	 * data value compression operation. It is kept here to minimize
@@ -56,6 +149,12 @@ struct ColumnarWriteState
 	 * deallocated when memory context is reset.
 	 */
 	StringInfo compressionBuffer;
+
+	/*
+	 * encodingBuffer is used as temporary storage for the encoded values of
+	 * a chunk, similar to compressionBuffer.
+	 */
+	StringInfo encodingBuffer;
 };
 
 static StripeBuffers * CreateEmptyStripeBuffers(uint32 stripeMaxRowCount,
@@ -64,7 +163,15 @@ static StripeBuffers * CreateEmptyStripeBuffers(uint32 stripeMaxRowCount,
 static StripeSkipList * CreateEmptyStripeSkipList(uint32 stripeMaxRowCount,
 												  uint32 chunkRowCount,
 												  uint32 columnCount);
+static void EnlargeStripeChunkArrays(ColumnarWriteState *writeState);
+static void InitStripeSortKeys(ColumnarWriteState *writeState, List *sortColumnNameList);
+static void BeginStripeWrite(ColumnarWriteState *writeState);
+static void AppendStripeRow(ColumnarWriteState *writeState, Datum *columnValues,
+							bool *columnNulls);
+static void AppendSortedStripeRows(ColumnarWriteState *writeState);
 static void FlushStripe(ColumnarWriteState *writeState);
+static void FlushChunkGroup(ColumnarWriteState *writeState, uint32 chunkIndex);
+static void CompressStripeInParallel(ColumnarWriteState *writeState);
 static StringInfo SerializeBoolArray(bool *boolArray, uint32 boolArrayLength);
 static void SerializeSingleDatum(StringInfo datumBuffer, Datum datum,
 								 bool datumTypeByValue, int datumTypeLength,
@@ -77,6 +184,11 @@ static void UpdateChunkSkipNodeMinMax(ColumnChunkSkipNode *chunkSkipNode,
 									  FmgrInfo *comparisonFunction);
 static Datum DatumCopy(Datum datum, bool datumTypeByValue, int datumTypeLength);
 static StringInfo CopyStringInfo(StringInfo sourceString);
+static bool ColumnNameListMember(List *columnNameList, char *columnName);
+static StripeDeletionState * GetStripeDeletionState(ColumnarWriteState *writeState,
+													Relation relation,
+													StripeMetadata *stripeMetadata);
+static void FlushPendingDeletions(ColumnarWriteState *writeState);
 
 /*
  * ColumnarBeginWrite initializes a columnar data load operation and returns a table
@@ -108,6 +220,38 @@ ColumnarBeginWrite(RelFileNode relfilenode,
 		comparisonFunctionArray[columnIndex] = comparisonFunction;
 	}
 
+	/* get hash function pointers for the columns to build bloom filters for */
+	FmgrInfo **bloomHashFunctionArray = palloc0(columnCount * sizeof(FmgrInfo *));
+	uint32 **bloomHashArray = palloc0(columnCount * sizeof(uint32 *));
+	List *bloomColumnNameList = NIL;
+
+	if (options.bloomColumns != NULL)
+	{
+		bloomColumnNameList = ColumnarOptionColumnNameList("bloom_columns",
+															   options.bloomColumns);
+	}
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		FormData_pg_attribute *attributeForm = TupleDescAttr(tupleDescriptor,
+															 columnIndex);
+
+		if (attributeForm->attisdropped ||
+			!ColumnNameListMember(bloomColumnNameList, NameStr(attributeForm->attname)))
+		{
+			continue;
+		}
+
+		bloomHashFunctionArray[columnIndex] =
+			GetFunctionInfoOrNull(attributeForm->atttypid, HASH_AM_OID,
+								  HASHSTANDARD_PROC);
+		if (bloomHashFunctionArray[columnIndex] != NULL)
+		{
+			bloomHashArray[columnIndex] = palloc0(options.chunkRowCount *
+												  sizeof(uint32));
+		}
+	}
+
 	/*
 	 * We allocate all stripe specific data in the stripeWriteContext, and
 	 * reset this memory context once we have flushed the stripe to the file.
@@ -128,72 +272,238 @@ ColumnarBeginWrite(RelFileNode relfilenode,
 	writeState->options = options;
 	writeState->tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
 	writeState->comparisonFunctionArray = comparisonFunctionArray;
+	writeState->bloomHashFunctionArray = bloomHashFunctionArray;
+	writeState->bloomHashArray = bloomHashArray;
+
+	if (options.compressionType == COMPRESSION_ZSTD)
+	{
+		writeState->compressionDictionaryArray =
+			ReadLatestCompressionDictionaries(relfilenode, columnCount);
+	}
+	else
+	{
+		writeState->compressionDictionaryArray = palloc0(columnCount * sizeof(bytea *));
+	}
 	writeState->stripeBuffers = NULL;
 	writeState->stripeSkipList = NULL;
 	writeState->emptyStripeReservation = NULL;
 	writeState->stripeWriteContext = stripeWriteContext;
 	writeState->chunkData = chunkData;
 	writeState->compressionBuffer = NULL;
+	writeState->encodingBuffer = NULL;
+	writeState->chunkGroupSizeLimit = columnar_chunk_group_size_limit;
 	writeState->perTupleContext = AllocSetContextCreate(CurrentMemoryContext,
 														"Columnar per tuple context",
 														ALLOCSET_DEFAULT_SIZES);
 
+	if (options.sortBy != NULL)
+	{
+		InitStripeSortKeys(writeState,
+						   ColumnarOptionColumnNameList("sort_by", options.sortBy));
+	}
+
 	return writeState;
 }
 
 
+/*
+ * InitStripeSortKeys sets up the sort keys of the write state for the
+ * columns in the sort_by option. Like for bloom_columns, columns are matched
+ * by name, and the columns that no longer exist or cannot be sorted are
+ * skipped.
+ */
+static void
+InitStripeSortKeys(ColumnarWriteState *writeState, List *sortColumnNameList)
+{
+	TupleDesc tupleDescriptor = writeState->tupleDescriptor;
+	int maxSortKeyCount = list_length(sortColumnNameList);
+
+	writeState->sortAttrNumbers = palloc0(maxSortKeyCount * sizeof(AttrNumber));
+	writeState->sortOperators = palloc0(maxSortKeyCount * sizeof(Oid));
+	writeState->sortCollations = palloc0(maxSortKeyCount * sizeof(Oid));
+	writeState->sortNullsFirst = palloc0(maxSortKeyCount * sizeof(bool));
+
+	char *columnName = NULL;
+	foreach_ptr(columnName, sortColumnNameList)
+	{
+		for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+		{
+			Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor,
+															columnIndex);
+			if (attributeForm->attisdropped ||
+				strcmp(NameStr(attributeForm->attname), columnName) != 0)
+			{
+				continue;
+			}
+
+			Oid sortOperator = InvalidOid;
+			get_sort_group_operators(attributeForm->atttypid, false, false, false,
+									 &sortOperator, NULL, NULL, NULL);
+			if (sortOperator == InvalidOid)
+			{
+				break;
+			}
+
+			int sortKeyIndex = writeState->sortKeyCount;
+			writeState->sortAttrNumbers[sortKeyIndex] = attributeForm->attnum;
+			writeState->sortOperators[sortKeyIndex] = sortOperator;
+			writeState->sortCollations[sortKeyIndex] = attributeForm->attcollation;
+			writeState->sortNullsFirst[sortKeyIndex] = false;
+			writeState->sortKeyCount++;
+			break;
+		}
+	}
+
+	if (writeState->sortKeyCount > 0)
+	{
+		writeState->sortSlot = MakeSingleTupleTableSlot(tupleDescriptor,
+														&TTSOpsMinimalTuple);
+	}
+}
+
+
 /*
  * ColumnarWriteRow adds a row to the columnar table. If the stripe is not initialized,
  * we create structures to hold stripe data and skip list. Then, we serialize and
  * append data to serialized value buffer for each of the columns and update
- * corresponding skip nodes. Then, whole chunk data is compressed at every
- * rowChunkCount insertion. Then, if row count exceeds stripeMaxRowCount, we flush
+ * corresponding skip nodes, or buffer the row in the sort state if the stripe
+ * is sorted on write. Then, if row count exceeds stripeMaxRowCount, we flush
  * the stripe, and add its metadata to the table footer.
  *
- * Returns the "row number" assigned to written row.
+ * Returns the "row number" assigned to written row. For sorted stripes, this
+ * is the position at which the row arrived rather than the one it is stored
+ * at, which is why such tables cannot have indexes.
  */
 uint64
 ColumnarWriteRow(ColumnarWriteState *writeState, Datum *columnValues, bool *columnNulls)
 {
-	uint32 columnIndex = 0;
-	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
-	StripeSkipList *stripeSkipList = writeState->stripeSkipList;
-	uint32 columnCount = writeState->tupleDescriptor->natts;
 	ColumnarOptions *options = &writeState->options;
-	const uint32 chunkRowCount = options->chunkRowCount;
-	ChunkData *chunkData = writeState->chunkData;
 	MemoryContext oldContext = MemoryContextSwitchTo(writeState->stripeWriteContext);
 
-	if (stripeBuffers == NULL)
-	{
-		stripeBuffers = CreateEmptyStripeBuffers(options->stripeRowCount,
-												 chunkRowCount, columnCount);
-		stripeSkipList = CreateEmptyStripeSkipList(options->stripeRowCount,
-												   chunkRowCount, columnCount);
-		writeState->stripeBuffers = stripeBuffers;
-		writeState->stripeSkipList = stripeSkipList;
-		writeState->compressionBuffer = makeStringInfo();
-
-		Oid relationId = RelidByRelfilenode(writeState->relfilenode.spcNode,
-											writeState->relfilenode.relNode);
-		Relation relation = relation_open(relationId, NoLock);
-		writeState->emptyStripeReservation =
-			ReserveEmptyStripe(relation, columnCount, chunkRowCount,
-							   options->stripeRowCount);
-		relation_close(relation, NoLock);
+	if (writeState->stripeBuffers == NULL)
+	{
+		BeginStripeWrite(writeState);
+	}
 
-		/*
-		 * serializedValueBuffer lives in stripe write memory context so it needs to be
-		 * initialized when the stripe is created.
-		 */
-		for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	uint64 stripeFirstRowNumber =
+		writeState->emptyStripeReservation->stripeFirstRowNumber;
+	uint64 writtenRowNumber = 0;
+	uint64 stripeRowCount = 0;
+
+	if (writeState->sortKeyCount > 0)
+	{
+		/* the rows are serialized in sort order once the stripe is flushed */
+		TupleTableSlot *sortSlot = writeState->sortSlot;
+		uint32 columnCount = writeState->tupleDescriptor->natts;
+
+		ExecClearTuple(sortSlot);
+		for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
 		{
-			chunkData->valueBufferArray[columnIndex] = makeStringInfo();
+			sortSlot->tts_values[columnIndex] = columnValues[columnIndex];
+			sortSlot->tts_isnull[columnIndex] = columnNulls[columnIndex];
 		}
+		ExecStoreVirtualTuple(sortSlot);
+
+		/* tuplesort_puttupleslot copies the slot into sort context */
+		tuplesort_puttupleslot(writeState->sortState, sortSlot);
+
+		writtenRowNumber = stripeFirstRowNumber + writeState->sortBufferRowCount;
+		stripeRowCount = ++writeState->sortBufferRowCount;
+	}
+	else
+	{
+		writtenRowNumber = stripeFirstRowNumber + writeState->stripeBuffers->rowCount;
+		AppendStripeRow(writeState, columnValues, columnNulls);
+		stripeRowCount = writeState->stripeBuffers->rowCount;
 	}
 
-	uint32 chunkIndex = stripeBuffers->rowCount / chunkRowCount;
-	uint32 chunkRowIndex = stripeBuffers->rowCount % chunkRowCount;
+	if (stripeRowCount >= options->stripeRowCount)
+	{
+		ColumnarFlushPendingWrites(writeState);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return writtenRowNumber;
+}
+
+
+/*
+ * BeginStripeWrite creates the structures to hold stripe data and skip list,
+ * and reserves the row numbers of a new stripe.
+ */
+static void
+BeginStripeWrite(ColumnarWriteState *writeState)
+{
+	uint32 columnCount = writeState->tupleDescriptor->natts;
+	ColumnarOptions *options = &writeState->options;
+	const uint32 chunkRowCount = options->chunkRowCount;
+	ChunkData *chunkData = writeState->chunkData;
+
+	writeState->stripeBuffers = CreateEmptyStripeBuffers(options->stripeRowCount,
+														 chunkRowCount, columnCount);
+	writeState->stripeSkipList = CreateEmptyStripeSkipList(options->stripeRowCount,
+														   chunkRowCount, columnCount);
+	writeState->compressionBuffer = makeStringInfo();
+	writeState->encodingBuffer = makeStringInfo();
+	writeState->streamChunkGroups = columnar_stream_chunk_groups;
+	writeState->stripeFileOffset = ColumnarInvalidLogicalOffset;
+	writeState->stripeFileEndOffset = ColumnarInvalidLogicalOffset;
+	writeState->compressInParallel = columnar_compression_workers > 0 &&
+									 !writeState->streamChunkGroups &&
+									 options->compressionType != COMPRESSION_NONE;
+	writeState->chunkIndex = 0;
+	writeState->chunkRowIndex = 0;
+	writeState->chunkSize = 0;
+	writeState->maxChunkCount = (options->stripeRowCount / chunkRowCount) + 1;
+
+	Oid relationId = RelidByRelfilenode(writeState->relfilenode.spcNode,
+										writeState->relfilenode.relNode);
+	Relation relation = relation_open(relationId, NoLock);
+	writeState->emptyStripeReservation =
+		ReserveEmptyStripe(relation, columnCount, chunkRowCount,
+						   options->stripeRowCount);
+	relation_close(relation, NoLock);
+
+	/*
+	 * serializedValueBuffer lives in stripe write memory context so it needs to be
+	 * initialized when the stripe is created.
+	 */
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		chunkData->valueBufferArray[columnIndex] = makeStringInfo();
+	}
+
+	if (writeState->sortKeyCount > 0)
+	{
+		writeState->sortState =
+			tuplesort_begin_heap(writeState->tupleDescriptor, writeState->sortKeyCount,
+								 writeState->sortAttrNumbers, writeState->sortOperators,
+								 writeState->sortCollations, writeState->sortNullsFirst,
+								 work_mem, NULL, false);
+		writeState->sortBufferRowCount = 0;
+	}
+}
+
+
+/*
+ * AppendStripeRow serializes and appends the row values to the value
+ * buffers of the current chunk, and updates the corresponding skip nodes.
+ * Whole chunk data is compressed once the chunk has chunkRowCount rows, or
+ * once its values reach columnar.chunk_group_size_limit.
+ */
+static void
+AppendStripeRow(ColumnarWriteState *writeState, Datum *columnValues, bool *columnNulls)
+{
+	uint32 columnIndex = 0;
+	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
+	StripeSkipList *stripeSkipList = writeState->stripeSkipList;
+	uint32 columnCount = writeState->tupleDescriptor->natts;
+	const uint32 chunkRowCount = writeState->options.chunkRowCount;
+	ChunkData *chunkData = writeState->chunkData;
+
+	uint32 chunkIndex = writeState->chunkIndex;
+	uint32 chunkRowIndex = writeState->chunkRowIndex;
 
 	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
 	{
@@ -218,37 +528,75 @@ ColumnarWriteRow(ColumnarWriteState *writeState, Datum *columnValues, bool *colu
 
 			chunkData->existsArray[columnIndex][chunkRowIndex] = true;
 
-			SerializeSingleDatum(chunkData->valueBufferArray[columnIndex],
-								 columnValues[columnIndex], columnTypeByValue,
-								 columnTypeLength, columnTypeAlign);
+			StringInfo valueBuffer = chunkData->valueBufferArray[columnIndex];
+			int previousValueBufferLength = valueBuffer->len;
+
+			SerializeSingleDatum(valueBuffer, columnValues[columnIndex],
+								 columnTypeByValue, columnTypeLength, columnTypeAlign);
+
+			writeState->chunkSize += valueBuffer->len - previousValueBufferLength;
 
 			UpdateChunkSkipNodeMinMax(chunkSkipNode, columnValues[columnIndex],
 									  columnTypeByValue, columnTypeLength,
 									  columnCollation, comparisonFunction);
+
+			FmgrInfo *bloomHashFunction =
+				writeState->bloomHashFunctionArray[columnIndex];
+			if (bloomHashFunction != NULL)
+			{
+				Datum hashDatum = FunctionCall1Coll(bloomHashFunction, columnCollation,
+													columnValues[columnIndex]);
+				writeState->bloomHashArray[columnIndex][chunkRowIndex] =
+					DatumGetUInt32(hashDatum);
+			}
 		}
 
 		chunkSkipNode->rowCount++;
 	}
 
 	stripeSkipList->chunkCount = chunkIndex + 1;
+	stripeBuffers->rowCount++;
+	writeState->chunkRowIndex++;
 
 	/* last row of the chunk is inserted serialize the chunk */
-	if (chunkRowIndex == chunkRowCount - 1)
+	if (writeState->chunkRowIndex == chunkRowCount ||
+		(writeState->chunkGroupSizeLimit > 0 &&
+		 writeState->chunkSize >= writeState->chunkGroupSizeLimit))
 	{
-		SerializeChunkData(writeState, chunkIndex, chunkRowCount);
+		SerializeChunkData(writeState, chunkIndex, writeState->chunkRowIndex);
+
+		writeState->chunkIndex++;
+		writeState->chunkRowIndex = 0;
+		writeState->chunkSize = 0;
+
+		if (writeState->chunkIndex >= writeState->maxChunkCount)
+		{
+			EnlargeStripeChunkArrays(writeState);
+		}
 	}
+}
 
-	uint64 writtenRowNumber = writeState->emptyStripeReservation->stripeFirstRowNumber +
-							  stripeBuffers->rowCount;
-	stripeBuffers->rowCount++;
-	if (stripeBuffers->rowCount >= options->stripeRowCount)
+
+/*
+ * AppendSortedStripeRows sorts the rows that are buffered for the current
+ * stripe and appends them to the stripe in sort order.
+ */
+static void
+AppendSortedStripeRows(ColumnarWriteState *writeState)
+{
+	TupleTableSlot *sortSlot = writeState->sortSlot;
+
+	tuplesort_performsort(writeState->sortState);
+
+	while (tuplesort_gettupleslot(writeState->sortState, true, false, sortSlot, NULL))
 	{
-		ColumnarFlushPendingWrites(writeState);
+		slot_getallattrs(sortSlot);
+		AppendStripeRow(writeState, sortSlot->tts_values, sortSlot->tts_isnull);
 	}
 
-	MemoryContextSwitchTo(oldContext);
-
-	return writtenRowNumber;
+	tuplesort_end(writeState->sortState);
+	writeState->sortState = NULL;
+	writeState->sortBufferRowCount = 0;
 }
 
 
@@ -261,6 +609,16 @@ ColumnarEndWrite(ColumnarWriteState *writeState)
 {
 	ColumnarFlushPendingWrites(writeState);
 
+	if (writeState->sortSlot != NULL)
+	{
+		ExecDropSingleTupleTableSlot(writeState->sortSlot);
+	}
+
+	if (writeState->deletionStateMap != NULL)
+	{
+		hash_destroy(writeState->deletionStateMap);
+	}
+
 	MemoryContextDelete(writeState->stripeWriteContext);
 	pfree(writeState->comparisonFunctionArray);
 	FreeChunkData(writeState->chunkData);
@@ -276,6 +634,11 @@ ColumnarFlushPendingWrites(ColumnarWriteState *writeState)
 	{
 		MemoryContext oldContext = MemoryContextSwitchTo(writeState->stripeWriteContext);
 
+		if (writeState->sortState != NULL)
+		{
+			AppendSortedStripeRows(writeState);
+		}
+
 		FlushStripe(writeState);
 		MemoryContextReset(writeState->stripeWriteContext);
 
@@ -285,6 +648,192 @@ ColumnarFlushPendingWrites(ColumnarWriteState *writeState)
 
 		MemoryContextSwitchTo(oldContext);
 	}
+
+	if (writeState->pendingDeletedRowCount > 0)
+	{
+		FlushPendingDeletions(writeState);
+	}
+}
+
+
+/*
+ * ColumnarDeleteRow marks the row with the given row number as deleted. The
+ * deletion is kept in memory until the pending writes of the write state are
+ * flushed, which saves a deletion bitmap for each stripe that rows were
+ * deleted from.
+ *
+ * The row is left as is if it is already deleted, and TM_SelfModified is
+ * returned if the current transaction deleted it, or TM_Deleted if another
+ * transaction did.
+ */
+TM_Result
+ColumnarDeleteRow(ColumnarWriteState *writeState, Relation relation, uint64 rowNumber,
+				  Snapshot snapshot)
+{
+	StripeDeletionState *deletionState = writeState->lastDeletionState;
+
+	if (deletionState == NULL ||
+		rowNumber < deletionState->firstRowNumber ||
+		rowNumber >= deletionState->firstRowNumber + deletionState->rowCount)
+	{
+		StripeMetadata *stripeMetadata = FindStripeByRowNumber(relation, rowNumber,
+															   snapshot);
+		if (stripeMetadata == NULL ||
+			StripeWriteState(stripeMetadata) != STRIPE_WRITE_FLUSHED)
+		{
+			ereport(ERROR, (errmsg("could not find row " UINT64_FORMAT
+								   " of columnar table \"%s\"", rowNumber,
+								   RelationGetRelationName(relation))));
+		}
+
+		deletionState = GetStripeDeletionState(writeState, relation, stripeMetadata);
+		writeState->lastDeletionState = deletionState;
+	}
+
+	uint64 rowOffset = rowNumber - deletionState->firstRowNumber;
+	if (COLUMNAR_ROW_IS_DELETED(deletionState->deletedRows, rowOffset))
+	{
+		if (deletionState->deletedByOtherXacts != NULL &&
+			COLUMNAR_ROW_IS_DELETED(deletionState->deletedByOtherXacts, rowOffset))
+		{
+			return TM_Deleted;
+		}
+
+		return TM_SelfModified;
+	}
+
+	COLUMNAR_MARK_ROW_DELETED(deletionState->deletedRows, rowOffset);
+	COLUMNAR_MARK_ROW_DELETED(deletionState->pendingDeletedRows, rowOffset);
+	deletionState->pendingDeletedRowCount++;
+	writeState->pendingDeletedRowCount++;
+
+	return TM_Ok;
+}
+
+
+/*
+ * GetStripeDeletionState returns the StripeDeletionState of the given stripe,
+ * and creates it with the rows of the stripe that are already deleted if the
+ * write state did not delete rows from the stripe yet.
+ */
+static StripeDeletionState *
+GetStripeDeletionState(ColumnarWriteState *writeState, Relation relation,
+					   StripeMetadata *stripeMetadata)
+{
+	MemoryContext writeStateContext = GetMemoryChunkContext(writeState);
+
+	if (writeState->deletionStateMap == NULL)
+	{
+		HASHCTL info;
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(uint64);
+		info.entrysize = sizeof(StripeDeletionState);
+		info.hcxt = writeStateContext;
+
+		writeState->deletionStateMap =
+			hash_create("columnar stripe deletion states", 8, &info,
+						HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	StripeDeletionState *deletionState = hash_search(writeState->deletionStateMap,
+													 &stripeMetadata->id,
+													 HASH_FIND, NULL);
+	if (deletionState != NULL)
+	{
+		return deletionState;
+	}
+
+	/*
+	 * Deleters of a table are serialized by a self-conflicting lock that is
+	 * held until the end of the transaction. Once we hold it, the deletions
+	 * of other transactions are either committed or aborted and no more can
+	 * happen, so the deleted rows that we read now stay accurate.
+	 */
+	LockRelation(relation, ShareUpdateExclusiveLock);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(writeStateContext);
+
+	Size bitmapSize = COLUMNAR_DELETION_BITMAP_SIZE(stripeMetadata->rowCount);
+	uint8 *deletedByOtherXacts = NULL;
+	uint8 *deletedRows = ReadStripeDeletedRows(writeState->relfilenode,
+											   stripeMetadata->id,
+											   stripeMetadata->rowCount,
+											   SnapshotSelf, &deletedByOtherXacts);
+	if (deletedRows == NULL)
+	{
+		deletedRows = palloc0(bitmapSize);
+	}
+
+	deletionState = hash_search(writeState->deletionStateMap, &stripeMetadata->id,
+								HASH_ENTER, NULL);
+	deletionState->firstRowNumber = stripeMetadata->firstRowNumber;
+	deletionState->rowCount = stripeMetadata->rowCount;
+	deletionState->deletedRows = deletedRows;
+	deletionState->deletedByOtherXacts = deletedByOtherXacts;
+	deletionState->pendingDeletedRows = palloc0(bitmapSize);
+	deletionState->pendingDeletedRowCount = 0;
+
+	MemoryContextSwitchTo(oldContext);
+
+	return deletionState;
+}
+
+
+/*
+ * ColumnarWriteStateDeletedRow returns true if the row at the given offset of
+ * the given stripe is deleted through the write state, whether the deletion
+ * is flushed or not.
+ */
+bool
+ColumnarWriteStateDeletedRow(ColumnarWriteState *writeState, uint64 stripeId,
+							 uint64 rowOffset)
+{
+	if (writeState->deletionStateMap == NULL)
+	{
+		return false;
+	}
+
+	StripeDeletionState *deletionState = hash_search(writeState->deletionStateMap,
+													 &stripeId, HASH_FIND, NULL);
+	if (deletionState == NULL || rowOffset >= deletionState->rowCount)
+	{
+		return false;
+	}
+
+	return COLUMNAR_ROW_IS_DELETED(deletionState->deletedRows, rowOffset) &&
+		   (deletionState->deletedByOtherXacts == NULL ||
+			!COLUMNAR_ROW_IS_DELETED(deletionState->deletedByOtherXacts, rowOffset));
+}
+
+
+/*
+ * FlushPendingDeletions saves the deletion bitmaps of the rows that the write
+ * state deleted since the last flush.
+ */
+static void
+FlushPendingDeletions(ColumnarWriteState *writeState)
+{
+	HASH_SEQ_STATUS status;
+	StripeDeletionState *deletionState = NULL;
+
+	hash_seq_init(&status, writeState->deletionStateMap);
+	while ((deletionState = hash_seq_search(&status)) != NULL)
+	{
+		if (deletionState->pendingDeletedRowCount == 0)
+		{
+			continue;
+		}
+
+		SaveStripeDeletedRows(writeState->relfilenode, deletionState->stripeId,
+							  deletionState->pendingDeletedRows,
+							  deletionState->rowCount);
+
+		memset(deletionState->pendingDeletedRows, 0,
+			   COLUMNAR_DELETION_BITMAP_SIZE(deletionState->rowCount));
+		deletionState->pendingDeletedRowCount = 0;
+	}
+
+	writeState->pendingDeletedRowCount = 0;
 }
 
 
@@ -368,6 +917,49 @@ CreateEmptyStripeSkipList(uint32 stripeMaxRowCount, uint32 chunkRowCount,
 }
 
 
+/*
+ * EnlargeStripeChunkArrays doubles the number of chunk groups that the stripe
+ * buffers and skip list of the current stripe have room for, which is needed
+ * when columnar.chunk_group_size_limit closes chunk groups before they have
+ * chunk_group_row_limit rows.
+ */
+static void
+EnlargeStripeChunkArrays(ColumnarWriteState *writeState)
+{
+	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
+	StripeSkipList *stripeSkipList = writeState->stripeSkipList;
+	uint32 columnCount = stripeBuffers->columnCount;
+	uint32 oldChunkCount = writeState->maxChunkCount;
+	uint32 newChunkCount = oldChunkCount * 2;
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+		ColumnChunkBuffers **chunkBuffersArray =
+			repalloc(columnBuffers->chunkBuffersArray,
+					 newChunkCount * sizeof(ColumnChunkBuffers *));
+
+		for (uint32 chunkIndex = oldChunkCount; chunkIndex < newChunkCount; chunkIndex++)
+		{
+			chunkBuffersArray[chunkIndex] = palloc0(sizeof(ColumnChunkBuffers));
+			chunkBuffersArray[chunkIndex]->valueCompressionType = COMPRESSION_NONE;
+		}
+
+		columnBuffers->chunkBuffersArray = chunkBuffersArray;
+
+		ColumnChunkSkipNode *chunkSkipNodeArray =
+			repalloc(stripeSkipList->chunkSkipNodeArray[columnIndex],
+					 newChunkCount * sizeof(ColumnChunkSkipNode));
+		memset(&chunkSkipNodeArray[oldChunkCount], 0,
+			   (newChunkCount - oldChunkCount) * sizeof(ColumnChunkSkipNode));
+
+		stripeSkipList->chunkSkipNodeArray[columnIndex] = chunkSkipNodeArray;
+	}
+
+	writeState->maxChunkCount = newChunkCount;
+}
+
+
 /*
  * FlushStripe flushes current stripe data into the file. The function first ensures
  * the last data chunk for each column is properly serialized and compressed. Then,
@@ -385,9 +977,8 @@ FlushStripe(ColumnarWriteState *writeState)
 	TupleDesc tupleDescriptor = writeState->tupleDescriptor;
 	uint32 columnCount = tupleDescriptor->natts;
 	uint32 chunkCount = stripeSkipList->chunkCount;
-	uint32 chunkRowCount = writeState->options.chunkRowCount;
-	uint32 lastChunkIndex = stripeBuffers->rowCount / chunkRowCount;
-	uint32 lastChunkRowCount = stripeBuffers->rowCount % chunkRowCount;
+	uint32 lastChunkIndex = writeState->chunkIndex;
+	uint32 lastChunkRowCount = writeState->chunkRowIndex;
 	uint64 stripeSize = 0;
 	uint64 stripeRowCount = stripeBuffers->rowCount;
 
@@ -406,6 +997,33 @@ FlushStripe(ColumnarWriteState *writeState)
 		SerializeChunkData(writeState, lastChunkIndex, lastChunkRowCount);
 	}
 
+	if (writeState->compressInParallel)
+	{
+		CompressStripeInParallel(writeState);
+	}
+
+	if (writeState->streamChunkGroups)
+	{
+		/* all chunk groups have already been written by FlushChunkGroup */
+		StripeMetadata *stripeMetadata =
+			CompleteStripeReservationAt(relation,
+										writeState->emptyStripeReservation->stripeId,
+										writeState->stripeFileOffset,
+										writeState->stripeFileEndOffset -
+										writeState->stripeFileOffset,
+										stripeRowCount, chunkCount);
+
+		SaveChunkGroups(writeState->relfilenode, stripeMetadata->id,
+						writeState->chunkGroupRowCounts);
+		SaveStripeSkipList(writeState->relfilenode, stripeMetadata->id,
+						   stripeSkipList, tupleDescriptor);
+
+		writeState->chunkGroupRowCounts = NIL;
+
+		relation_close(relation, NoLock);
+		return;
+	}
+
 	/* update buffer sizes in stripe skip list */
 	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
 	{
@@ -436,6 +1054,7 @@ FlushStripe(ColumnarWriteState *writeState)
 			chunkSkipNode->valueLength = valueBufferSize;
 			chunkSkipNode->valueCompressionType = valueCompressionType;
 			chunkSkipNode->valueCompressionLevel = writeState->options.compressionLevel;
+			chunkSkipNode->valueEncodingType = chunkBuffers->valueEncodingType;
 			chunkSkipNode->decompressedValueSize = chunkBuffers->decompressedValueSize;
 
 			stripeSize += valueBufferSize;
@@ -499,9 +1118,152 @@ FlushStripe(ColumnarWriteState *writeState)
 }
 
 
+/*
+ * FlushChunkGroup writes the serialized buffers of the given chunk group of
+ * the current stripe into the file, records their offsets in the stripe skip
+ * list, and frees them. Unlike FlushStripe, the buffers of a chunk group are
+ * stored together for all columns, and the data is reserved per chunk group
+ * since the size of the stripe is not known yet.
+ */
+static void
+FlushChunkGroup(ColumnarWriteState *writeState, uint32 chunkIndex)
+{
+	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
+	ColumnChunkSkipNode **columnSkipNodeArray =
+		writeState->stripeSkipList->chunkSkipNodeArray;
+	uint32 columnCount = stripeBuffers->columnCount;
+	uint64 chunkGroupSize = 0;
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		ColumnChunkBuffers *chunkBuffers =
+			stripeBuffers->columnBuffersArray[columnIndex]->chunkBuffersArray[chunkIndex];
+
+		chunkGroupSize += chunkBuffers->existsBuffer->len;
+		chunkGroupSize += chunkBuffers->valueBuffer->len;
+	}
+
+	Oid relationId = RelidByRelfilenode(writeState->relfilenode.spcNode,
+										writeState->relfilenode.relNode);
+	Relation relation = relation_open(relationId, NoLock);
+
+	uint64 currentFileOffset = ColumnarStorageReserveData(relation, chunkGroupSize);
+	if (writeState->stripeFileOffset == ColumnarInvalidLogicalOffset)
+	{
+		writeState->stripeFileOffset = currentFileOffset;
+	}
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		ColumnChunkBuffers *chunkBuffers =
+			stripeBuffers->columnBuffersArray[columnIndex]->chunkBuffersArray[chunkIndex];
+		ColumnChunkSkipNode *chunkSkipNode =
+			&columnSkipNodeArray[columnIndex][chunkIndex];
+		StringInfo existsBuffer = chunkBuffers->existsBuffer;
+		StringInfo valueBuffer = chunkBuffers->valueBuffer;
+
+		/* skip list offsets are relative to the start of the stripe */
+		uint64 stripeOffset = currentFileOffset - writeState->stripeFileOffset;
+
+		chunkSkipNode->existsChunkOffset = stripeOffset;
+		chunkSkipNode->existsLength = existsBuffer->len;
+		chunkSkipNode->valueChunkOffset = stripeOffset + existsBuffer->len;
+		chunkSkipNode->valueLength = valueBuffer->len;
+		chunkSkipNode->valueCompressionType = chunkBuffers->valueCompressionType;
+		chunkSkipNode->valueCompressionLevel = writeState->options.compressionLevel;
+		chunkSkipNode->valueEncodingType = chunkBuffers->valueEncodingType;
+		chunkSkipNode->decompressedValueSize = chunkBuffers->decompressedValueSize;
+
+		ColumnarStorageWrite(relation, currentFileOffset,
+							 existsBuffer->data, existsBuffer->len);
+		currentFileOffset += existsBuffer->len;
+
+		ColumnarStorageWrite(relation, currentFileOffset,
+							 valueBuffer->data, valueBuffer->len);
+		currentFileOffset += valueBuffer->len;
+
+		/* only the skip list of the chunk group is kept until the stripe is done */
+		pfree(existsBuffer->data);
+		pfree(existsBuffer);
+		pfree(valueBuffer->data);
+		pfree(valueBuffer);
+		chunkBuffers->existsBuffer = NULL;
+		chunkBuffers->valueBuffer = NULL;
+	}
+
+	writeState->stripeFileEndOffset = currentFileOffset;
+
+	relation_close(relation, NoLock);
+}
+
+
+/*
+ * CompressStripeInParallel compresses the value buffers of all chunks of the
+ * current stripe with columnar.compression_workers background workers, and
+ * replaces the buffers that got compressed.
+ */
+static void
+CompressStripeInParallel(ColumnarWriteState *writeState)
+{
+	StripeBuffers *stripeBuffers = writeState->stripeBuffers;
+	uint32 columnCount = stripeBuffers->columnCount;
+	uint32 chunkCount = writeState->stripeSkipList->chunkCount;
+	CompressionType compressionType = writeState->options.compressionType;
+	int jobCount = columnCount * chunkCount;
+
+	CompressionJob *jobArray = palloc0(jobCount * sizeof(CompressionJob));
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+
+		for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			CompressionJob *job = &jobArray[columnIndex * chunkCount + chunkIndex];
+
+			job->inputBuffer = columnBuffers->chunkBuffersArray[chunkIndex]->valueBuffer;
+			job->dictionary = writeState->compressionDictionaryArray[columnIndex];
+		}
+	}
+
+	CompressBuffersInParallel(jobArray, jobCount, compressionType,
+							  writeState->options.compressionLevel,
+							  columnar_compression_workers);
+
+	for (uint32 columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
+
+		for (uint32 chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+		{
+			ColumnChunkBuffers *chunkBuffers =
+				columnBuffers->chunkBuffersArray[chunkIndex];
+			CompressionJob *job = &jobArray[columnIndex * chunkCount + chunkIndex];
+
+			if (job->compressed)
+			{
+				pfree(chunkBuffers->valueBuffer->data);
+				pfree(chunkBuffers->valueBuffer);
+				chunkBuffers->valueBuffer = job->outputBuffer;
+				chunkBuffers->valueCompressionType = compressionType;
+			}
+			else
+			{
+				pfree(job->outputBuffer->data);
+				pfree(job->outputBuffer);
+			}
+		}
+	}
+
+	pfree(jobArray);
+}
+
+
 /*
  * SerializeBoolArray serializes the given boolean array and returns the result
  * as a StringInfo. This function packs every 8 boolean values into one byte.
+ *
+ * On little-endian machines, 8 bools are read as one 64-bit word, and a
+ * multiplication gathers their low bits into the top byte of the result.
  */
 static StringInfo
 SerializeBoolArray(bool *boolArray, uint32 boolArrayLength)
@@ -514,7 +1276,20 @@ SerializeBoolArray(bool *boolArray, uint32 boolArrayLength)
 	boolArrayBuffer->len = byteCount;
 	memset(boolArrayBuffer->data, 0, byteCount);
 
-	for (boolArrayIndex = 0; boolArrayIndex < boolArrayLength; boolArrayIndex++)
+#ifndef WORDS_BIGENDIAN
+	for (; boolArrayIndex + 8 <= boolArrayLength; boolArrayIndex += 8)
+	{
+		uint64 lanes = 0;
+		memcpy(&lanes, &boolArray[boolArrayIndex], sizeof(uint64)); /* IGNORE-BANNED */
+
+		/* a true bool has its low bit set, the other bits are ignored */
+		lanes &= UINT64CONST(0x0101010101010101);
+		boolArrayBuffer->data[boolArrayIndex / 8] =
+			(char) ((lanes * UINT64CONST(0x0102040810204080)) >> 56);
+	}
+#endif
+
+	for (; boolArrayIndex < boolArrayLength; boolArrayIndex++)
 	{
 		if (boolArray[boolArrayIndex])
 		{
@@ -569,8 +1344,8 @@ SerializeSingleDatum(StringInfo datumBuffer, Datum datum, bool datumTypeByValue,
 
 
 /*
- * SerializeChunkData serializes and compresses chunk data at given chunk index with given
- * compression type for every column.
+ * SerializeChunkData serializes, encodes and compresses chunk data at given chunk
+ * index with given compression type for every column.
  */
 static void
 SerializeChunkData(ColumnarWriteState *writeState, uint32 chunkIndex, uint32 rowCount)
@@ -582,6 +1357,8 @@ SerializeChunkData(ColumnarWriteState *writeState, uint32 chunkIndex, uint32 row
 	int compressionLevel = writeState->options.compressionLevel;
 	const uint32 columnCount = stripeBuffers->columnCount;
 	StringInfo compressionBuffer = writeState->compressionBuffer;
+	StringInfo encodingBuffer = writeState->encodingBuffer;
+	TupleDesc tupleDescriptor = writeState->tupleDescriptor;
 
 	writeState->chunkGroupRowCounts =
 		lappend_int(writeState->chunkGroupRowCounts, rowCount);
@@ -596,6 +1373,30 @@ SerializeChunkData(ColumnarWriteState *writeState, uint32 chunkIndex, uint32 row
 			SerializeBoolArray(chunkData->existsArray[columnIndex], rowCount);
 	}
 
+	/* build bloom filters from the hashes of the values that are not NULL */
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		uint32 *hashArray = writeState->bloomHashArray[columnIndex];
+		uint32 hashCount = 0;
+
+		if (hashArray == NULL)
+		{
+			continue;
+		}
+
+		for (uint32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			if (chunkData->existsArray[columnIndex][rowIndex])
+			{
+				hashArray[hashCount++] = hashArray[rowIndex];
+			}
+		}
+
+		ColumnChunkSkipNode *chunkSkipNode =
+			&writeState->stripeSkipList->chunkSkipNodeArray[columnIndex][chunkIndex];
+		chunkSkipNode->bloomFilter = BuildBloomFilter(hashArray, hashCount);
+	}
+
 	/*
 	 * check and compress value buffers, if a value buffer is not compressable
 	 * then keep it as uncompressed, store compression information.
@@ -605,22 +1406,49 @@ SerializeChunkData(ColumnarWriteState *writeState, uint32 chunkIndex, uint32 row
 		ColumnBuffers *columnBuffers = stripeBuffers->columnBuffersArray[columnIndex];
 		ColumnChunkBuffers *chunkBuffers = columnBuffers->chunkBuffersArray[chunkIndex];
 		CompressionType actualCompressionType = COMPRESSION_NONE;
+		ColumnEncodingType encodingType = ENCODING_NONE;
 
 		StringInfo serializedValueBuffer = chunkData->valueBufferArray[columnIndex];
 
 		Assert(requestedCompressionType >= 0 &&
 			   requestedCompressionType < COMPRESSION_COUNT);
 
-		chunkBuffers->decompressedValueSize =
-			chunkData->valueBufferArray[columnIndex]->len;
+		/* encode the values if an encoding makes them smaller */
+		if (columnar_enable_column_encoding)
+		{
+			encodingType = EncodeValueBuffer(serializedValueBuffer, encodingBuffer,
+											 chunkData->existsArray[columnIndex],
+											 rowCount,
+											 TupleDescAttr(tupleDescriptor,
+														   columnIndex));
+			if (encodingType != ENCODING_NONE)
+			{
+				serializedValueBuffer = encodingBuffer;
+			}
+		}
+
+		chunkBuffers->valueEncodingType = encodingType;
+		chunkBuffers->decompressedValueSize = serializedValueBuffer->len;
+
+		if (writeState->compressInParallel)
+		{
+			/* compressed by CompressStripeInParallel when the stripe is flushed */
+			chunkBuffers->valueCompressionType = COMPRESSION_NONE;
+			chunkBuffers->valueBuffer = CopyStringInfo(serializedValueBuffer);
+			resetStringInfo(chunkData->valueBufferArray[columnIndex]);
+			continue;
+		}
 
 		/*
 		 * if serializedValueBuffer is be compressed, update serializedValueBuffer
 		 * with compressed data and store compression type.
 		 */
+		bytea *compressionDictionary =
+			writeState->compressionDictionaryArray[columnIndex];
 		bool compressed = CompressBuffer(serializedValueBuffer, compressionBuffer,
 										 requestedCompressionType,
-										 compressionLevel);
+										 compressionLevel,
+										 compressionDictionary);
 		if (compressed)
 		{
 			serializedValueBuffer = compressionBuffer;
@@ -634,6 +1462,11 @@ SerializeChunkData(ColumnarWriteState *writeState, uint32 chunkIndex, uint32 row
 		/* valueBuffer needs to be reset for next chunk's data */
 		resetStringInfo(chunkData->valueBufferArray[columnIndex]);
 	}
+
+	if (writeState->streamChunkGroups)
+	{
+		FlushChunkGroup(writeState, chunkIndex);
+	}
 }
 
 
@@ -755,8 +1588,34 @@ CopyStringInfo(StringInfo sourceString)
 }
 
 
+/*
+ * ColumnNameListMember returns whether the given column name is in the list
+ * of column names.
+ */
+static bool
+ColumnNameListMember(List *columnNameList, char *columnName)
+{
+	char *listColumnName = NULL;
+	foreach_ptr(listColumnName, columnNameList)
+	{
+		if (strcmp(listColumnName, columnName) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 bool
 ContainsPendingWrites(ColumnarWriteState *state)
 {
-	return state->stripeBuffers != NULL && state->stripeBuffers->rowCount != 0;
+	if (state->pendingDeletedRowCount != 0)
+	{
+		return true;
+	}
+
+	return state->stripeBuffers != NULL &&
+		   (state->stripeBuffers->rowCount != 0 || state->sortBufferRowCount != 0);
 }
@@ -1 +1,63 @@
 -- citus_columnar--11.1-1--11.2-1
+
+ALTER TABLE columnar_internal.chunk ADD COLUMN value_encoding int NOT NULL DEFAULT 0;
+ALTER TABLE columnar_internal.chunk ADD COLUMN bloom_filter bytea;
+ALTER TABLE columnar_internal.options ADD COLUMN bloom_columns text;
+ALTER TABLE columnar_internal.options ADD COLUMN sort_by text;
+
+CREATE OR REPLACE VIEW columnar.options WITH (security_barrier) AS
+  SELECT regclass AS relation, chunk_group_row_limit,
+         stripe_row_limit, compression, compression_level,
+         bloom_columns, sort_by
+    FROM columnar_internal.options o, pg_class c
+    WHERE o.regclass = c.oid
+      AND pg_has_role(c.relowner, 'USAGE');
+
+CREATE OR REPLACE VIEW columnar.chunk WITH (security_barrier) AS
+  SELECT relation, storage.storage_id, stripe_num, attr_num, chunk_group_num,
+         minimum_value, maximum_value, value_stream_offset, value_stream_length,
+         exists_stream_offset, exists_stream_length, value_compression_type,
+         value_compression_level, value_decompressed_length, value_count,
+         value_encoding, bloom_filter
+    FROM columnar_internal.chunk chunk, columnar.storage storage
+    WHERE chunk.storage_id = storage.storage_id;
+
+CREATE FUNCTION columnar.compact_stripes(
+    table_name regclass,
+    small_stripe_row_count int DEFAULT NULL)
+  RETURNS bigint
+  LANGUAGE C
+  AS 'citus_columnar', $$compact_stripes$$;
+COMMENT ON FUNCTION columnar.compact_stripes(regclass, int)
+  IS 'merge the small stripes of a columnar table into full stripes';
+
+CREATE TABLE columnar_internal.compression_dictionary (
+    storage_id bigint NOT NULL,
+    attr_num int NOT NULL,
+    dictionary_id bigint NOT NULL,
+    version int NOT NULL,
+    dictionary bytea NOT NULL,
+    PRIMARY KEY (storage_id, attr_num, dictionary_id)
+) WITH (user_catalog_table = true);
+COMMENT ON TABLE columnar_internal.compression_dictionary
+  IS 'Columnar zstd compression dictionaries per column';
+
+CREATE FUNCTION columnar.train_compression_dictionary(
+    table_name regclass,
+    column_name name)
+  RETURNS bigint
+  STRICT
+  LANGUAGE C
+  AS 'citus_columnar', $$train_compression_dictionary$$;
+COMMENT ON FUNCTION columnar.train_compression_dictionary(regclass, name)
+  IS 'train a zstd compression dictionary for a column of a columnar table';
+
+CREATE TABLE columnar_internal.stripe_deletion (
+    storage_id bigint NOT NULL,
+    stripe_num bigint NOT NULL,
+    deleted_rows bytea NOT NULL
+) WITH (user_catalog_table = true);
+CREATE INDEX stripe_deletion_stripe_idx
+  ON columnar_internal.stripe_deletion USING BTREE(storage_id, stripe_num);
+COMMENT ON TABLE columnar_internal.stripe_deletion
+  IS 'Columnar bitmaps of the rows of a stripe that are deleted';
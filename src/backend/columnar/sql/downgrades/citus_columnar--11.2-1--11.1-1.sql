@@ -1 +1,65 @@
 -- citus_columnar--11.2-1--11.1-1
+
+-- earlier versions do not know that rows can be deleted
+DO $check_stripe_deletions$
+BEGIN
+  IF EXISTS (SELECT 1 FROM columnar_internal.stripe_deletion) THEN
+    RAISE EXCEPTION 'cannot downgrade citus_columnar while columnar tables have deleted rows'
+      USING HINT = 'Rewrite the columnar tables, e.g. using VACUUM FULL.';
+  END IF;
+END;
+$check_stripe_deletions$;
+
+DROP TABLE columnar_internal.stripe_deletion;
+
+-- earlier versions cannot read chunks compressed with dictionaries
+DO $check_compression_dictionaries$
+BEGIN
+  IF EXISTS (SELECT 1 FROM columnar_internal.compression_dictionary) THEN
+    RAISE EXCEPTION 'cannot downgrade citus_columnar while columnar tables have compression dictionaries';
+  END IF;
+END;
+$check_compression_dictionaries$;
+
+DROP FUNCTION columnar.train_compression_dictionary(regclass, name);
+DROP TABLE columnar_internal.compression_dictionary;
+DROP FUNCTION columnar.compact_stripes(regclass, int);
+
+-- earlier versions cannot read encoded chunks
+DO $check_encoded_chunks$
+BEGIN
+  IF EXISTS (SELECT 1 FROM columnar_internal.chunk WHERE value_encoding <> 0) THEN
+    RAISE EXCEPTION 'cannot downgrade citus_columnar while columnar tables have encoded chunks'
+      USING HINT = 'Rewrite the columnar tables with columnar.enable_column_encoding '
+                   'disabled, e.g. using VACUUM FULL.';
+  END IF;
+END;
+$check_encoded_chunks$;
+
+DROP VIEW columnar.options;
+CREATE VIEW columnar.options WITH (security_barrier) AS
+  SELECT regclass AS relation, chunk_group_row_limit,
+         stripe_row_limit, compression, compression_level
+    FROM columnar_internal.options o, pg_class c
+    WHERE o.regclass = c.oid
+      AND pg_has_role(c.relowner, 'USAGE');
+COMMENT ON VIEW columnar.options
+  IS 'Columnar options for tables on which the current user has ownership privileges.';
+GRANT SELECT ON columnar.options TO PUBLIC;
+
+DROP VIEW columnar.chunk;
+CREATE VIEW columnar.chunk WITH (security_barrier) AS
+  SELECT relation, storage.storage_id, stripe_num, attr_num, chunk_group_num,
+         minimum_value, maximum_value, value_stream_offset, value_stream_length,
+         exists_stream_offset, exists_stream_length, value_compression_type,
+         value_compression_level, value_decompressed_length, value_count
+    FROM columnar_internal.chunk chunk, columnar.storage storage
+    WHERE chunk.storage_id = storage.storage_id;
+COMMENT ON VIEW columnar.chunk
+  IS 'Columnar chunk information for tables on which the current user has ownership privileges.';
+GRANT SELECT ON columnar.chunk TO PUBLIC;
+
+ALTER TABLE columnar_internal.options DROP COLUMN sort_by;
+ALTER TABLE columnar_internal.options DROP COLUMN bloom_columns;
+ALTER TABLE columnar_internal.chunk DROP COLUMN bloom_filter;
+ALTER TABLE columnar_internal.chunk DROP COLUMN value_encoding;
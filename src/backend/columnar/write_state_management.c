@@ -57,6 +57,21 @@ static HTAB *WriteStateMap = NULL;
 /* memory context for allocating WriteStateMap & all write states */
 static MemoryContext WriteStateContext = NULL;
 
+/*
+ * Write state that was returned last by columnar_init_write_state, such that
+ * inserts of many rows into the same relation (e.g. INSERT .. SELECT) do not
+ * look it up in WriteStateMap for every row. It is forgotten whenever write
+ * states are popped, dropped or freed.
+ */
+static Oid LastWriteStateRelfilenode = InvalidOid;
+static SubTransactionId LastWriteStateSubXid = InvalidSubTransactionId;
+static ColumnarWriteState *LastWriteState = NULL;
+
+
+static void ForgetLastWriteState(void);
+static void RememberLastWriteState(Oid relfilenode, SubTransactionId subXid,
+								   ColumnarWriteState *writeState);
+
 /*
  * Each member of the writeStateStack in WriteStateMapEntry. This means that
  * we did some inserts in the subtransaction subXid, and the state of those
@@ -108,6 +123,20 @@ CleanupWriteStateMap(void *arg)
 {
 	WriteStateMap = NULL;
 	WriteStateContext = NULL;
+	ForgetLastWriteState();
+}
+
+
+/*
+ * ForgetLastWriteState makes the next columnar_init_write_state call look up
+ * the write state in WriteStateMap.
+ */
+static void
+ForgetLastWriteState(void)
+{
+	LastWriteStateRelfilenode = InvalidOid;
+	LastWriteStateSubXid = InvalidSubTransactionId;
+	LastWriteState = NULL;
 }
 
 
@@ -118,6 +147,14 @@ columnar_init_write_state(Relation relation, TupleDesc tupdesc,
 {
 	bool found;
 
+	/* consecutive inserts into the same relation use the same write state */
+	if (LastWriteState != NULL &&
+		LastWriteStateRelfilenode == relation->rd_node.relNode &&
+		LastWriteStateSubXid == currentSubXid)
+	{
+		return LastWriteState;
+	}
+
 	/*
 	 * If this is the first call in current transaction, allocate the hash
 	 * table.
@@ -166,6 +203,8 @@ columnar_init_write_state(Relation relation, TupleDesc tupdesc,
 
 		if (stackHead->subXid == currentSubXid)
 		{
+			RememberLastWriteState(relation->rd_node.relNode, currentSubXid,
+								   stackHead->writeState);
 			return stackHead->writeState;
 		}
 	}
@@ -198,10 +237,27 @@ columnar_init_write_state(Relation relation, TupleDesc tupdesc,
 
 	MemoryContextSwitchTo(oldContext);
 
+	RememberLastWriteState(relation->rd_node.relNode, currentSubXid,
+						   stackEntry->writeState);
+
 	return stackEntry->writeState;
 }
 
 
+/*
+ * RememberLastWriteState remembers the write state that was returned for the
+ * given relfilenode and subtransaction.
+ */
+static void
+RememberLastWriteState(Oid relfilenode, SubTransactionId subXid,
+					   ColumnarWriteState *writeState)
+{
+	LastWriteStateRelfilenode = relfilenode;
+	LastWriteStateSubXid = subXid;
+	LastWriteState = writeState;
+}
+
+
 /*
  * Flushes pending writes for given relfilenode in the given subtransaction.
  */
@@ -242,6 +298,8 @@ PopWriteStateForAllRels(SubTransactionId currentSubXid, SubTransactionId parentS
 	HASH_SEQ_STATUS status;
 	WriteStateMapEntry *entry;
 
+	ForgetLastWriteState();
+
 	if (WriteStateMap == NULL)
 	{
 		return;
@@ -322,6 +380,8 @@ DiscardWriteStateForAllRels(SubTransactionId currentSubXid, SubTransactionId par
 void
 MarkRelfilenodeDropped(Oid relfilenode, SubTransactionId currentSubXid)
 {
+	ForgetLastWriteState();
+
 	if (WriteStateMap == NULL)
 	{
 		return;
@@ -345,6 +405,8 @@ MarkRelfilenodeDropped(Oid relfilenode, SubTransactionId currentSubXid)
 void
 NonTransactionDropWriteState(Oid relfilenode)
 {
+	ForgetLastWriteState();
+
 	if (WriteStateMap)
 	{
 		hash_search(WriteStateMap, &relfilenode, HASH_REMOVE, false);
@@ -385,6 +447,37 @@ PendingWritesInUpperTransactions(Oid relfilenode, SubTransactionId currentSubXid
 }
 
 
+/*
+ * RowDeletedByCurrentSubXact returns true if the row at the given offset of
+ * the given stripe is deleted by the write state of the current
+ * subtransaction, which readers that do not flush pending writes do not see
+ * in the deletion bitmaps yet.
+ */
+bool
+RowDeletedByCurrentSubXact(Oid relfilenode, SubTransactionId currentSubXid,
+						   uint64 stripeId, uint64 rowOffset)
+{
+	if (WriteStateMap == NULL)
+	{
+		return false;
+	}
+
+	WriteStateMapEntry *entry = hash_search(WriteStateMap, &relfilenode, HASH_FIND, NULL);
+
+	if (entry && entry->writeStateStack != NULL)
+	{
+		SubXidWriteState *stackEntry = entry->writeStateStack;
+		if (stackEntry->subXid == currentSubXid)
+		{
+			return ColumnarWriteStateDeletedRow(stackEntry->writeState, stripeId,
+												rowOffset);
+		}
+	}
+
+	return false;
+}
+
+
 /*
  * GetWriteContextForDebug exposes WriteStateContext for debugging
  * purposes.
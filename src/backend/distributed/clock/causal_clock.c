@@ -85,14 +85,16 @@ static LogicalClockShmemData *LogicalClockShmem = NULL;
 static void AdjustLocalClock(ClusterClock *remoteClock);
 static void GetNextNodeClockValue(ClusterClock *nextClusterClockValue);
 static ClusterClock * GetHighestClockInTransaction(List *nodeConnectionList);
-static void AdjustClocksToTransactionHighest(List *nodeConnectionList,
-											 ClusterClock *transactionClockValue);
 static void InitClockAtFirstUse(void);
 static void IncrementClusterClock(ClusterClock *clusterClock);
 static ClusterClock * LargerClock(ClusterClock *clock1, ClusterClock *clock2);
 static ClusterClock * PrepareAndSetTransactionClock(void);
 bool EnableClusterClock = true;
 
+/* clock negotiated in the current transaction, not yet sent to the workers */
+static bool TransactionClockPending = false;
+static ClusterClock PendingTransactionClock;
+
 
 /*
  * GetEpochTimeAsClock returns the epoch value milliseconds used as logical
@@ -379,31 +381,11 @@ GetHighestClockInTransaction(List *nodeConnectionList)
 }
 
 
-/*
- * AdjustClocksToTransactionHighest Sets the clock value of all the nodes, participated
- * in the PREPARE of the transaction, to the highest clock value of all the nodes.
- */
-static void
-AdjustClocksToTransactionHighest(List *nodeConnectionList,
-								 ClusterClock *transactionClockValue)
-{
-	StringInfo queryToSend = makeStringInfo();
-
-	/* Set the clock value on participating worker nodes */
-	appendStringInfo(queryToSend,
-					 "SELECT pg_catalog.citus_internal_adjust_local_clock_to_remote"
-					 "('(%lu, %u)'::pg_catalog.cluster_clock);",
-					 transactionClockValue->logical, transactionClockValue->counter);
-
-	ExecuteRemoteCommandInConnectionList(nodeConnectionList, queryToSend->data);
-	AdjustLocalClock(transactionClockValue);
-}
-
-
 /*
  * PrepareAndSetTransactionClock polls all the transaction-nodes for their respective clocks,
  * picks the highest clock and returns it via UDF citus_get_transaction_clock. All the nodes
- * will now move to this newly negotiated clock.
+ * will move to this newly negotiated clock when the transaction commits, see
+ * TransactionClockAdjustmentCommand.
  */
 static ClusterClock *
 PrepareAndSetTransactionClock(void)
@@ -450,13 +432,55 @@ PrepareAndSetTransactionClock(void)
 	ClusterClock *transactionClockValue =
 		GetHighestClockInTransaction(transactionNodeList);
 
-	/* Adjust all the nodes with the new clock value */
-	AdjustClocksToTransactionHighest(transactionNodeList, transactionClockValue);
+	/*
+	 * Adjust the local clock right away. The participating worker nodes are
+	 * adjusted by the COMMIT or PREPARE TRANSACTION command we send them at
+	 * the end of the transaction, rather than in another round trip now.
+	 */
+	AdjustLocalClock(transactionClockValue);
+
+	PendingTransactionClock = *transactionClockValue;
+	TransactionClockPending = true;
 
 	return transactionClockValue;
 }
 
 
+/*
+ * TransactionClockAdjustmentCommand returns a command that moves a remote node's
+ * clock to the clock negotiated by citus_get_transaction_clock in the current
+ * transaction, or NULL if there is no such clock. The command is meant to be
+ * sent in front of the COMMIT or PREPARE TRANSACTION command, such that the remote
+ * node adjusts its clock before the transaction becomes visible there.
+ */
+char *
+TransactionClockAdjustmentCommand(void)
+{
+	if (!TransactionClockPending)
+	{
+		return NULL;
+	}
+
+	StringInfo command = makeStringInfo();
+	appendStringInfo(command,
+					 "SELECT pg_catalog.citus_internal_adjust_local_clock_to_remote"
+					 "('(%lu, %u)'::pg_catalog.cluster_clock);",
+					 PendingTransactionClock.logical, PendingTransactionClock.counter);
+
+	return command->data;
+}
+
+
+/*
+ * ResetTransactionClock forgets the clock negotiated in the current transaction.
+ */
+void
+ResetTransactionClock(void)
+{
+	TransactionClockPending = false;
+}
+
+
 /*
  * InitClockAtFirstUse Initializes the shared memory clock value to the highest clock
  * persisted. This will protect from any clock drifts.
@@ -399,10 +399,22 @@ UndistributeTable(TableConversionParameters *params)
 
 	ErrorIfUnsupportedCascadeObjects(params->relationId);
 
+	List *seqInfoList = NIL;
+	GetDependentSequencesWithRelation(params->relationId, &seqInfoList, 0);
+
 	params->conversionType = UNDISTRIBUTE_TABLE;
 	params->shardCountIsNull = true;
 	TableConversionState *con = CreateTableConversion(params);
-	return ConvertTable(con);
+	TableConversionReturn *conversionReturn = ConvertTable(con);
+
+	/* undo citus.distributed_sequence_cache_size for the sequences of the table */
+	SequenceInfo *seqInfo = NULL;
+	foreach_ptr(seqInfo, seqInfoList)
+	{
+		ResetDistributedSequenceCacheSize(seqInfo->sequenceOid);
+	}
+
+	return conversionReturn;
 }
 
 
@@ -0,0 +1,654 @@
+/*-------------------------------------------------------------------------
+ *
+ * binary_copy_passthrough.c
+ *    Forwarding the rows of a binary COPY into a distributed table to the
+ *    shards without deserializing them.
+ *
+ * When the client sends COPY data in binary format and the COPY commands on
+ * the shards use binary format as well, the rows the client sends are
+ * already in the format we would send to the worker nodes. Instead of
+ * calling the receive function of every column and the send function again
+ * for every placement, we only parse the framing of each row, call the
+ * receive function of the distribution column to find the shard, and send
+ * the original bytes of the row to its placements. The worker nodes still
+ * validate every value when they receive the row.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include <sys/stat.h>
+
+#include "distributed/pg_version_constants.h"
+
+#include "commands/copy.h"
+#include "commands/defrem.h"
+#include "commands/progress.h"
+#include "distributed/binary_copy_passthrough.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/transmit.h"
+#include "libpq/libpq.h"
+#include "libpq/pqformat.h"
+#include "storage/fd.h"
+#include "tcop/tcopprot.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+
+/* GUC, whether rows of a binary COPY are forwarded without deserializing them */
+bool EnableBinaryCopyPassthrough = false;
+
+
+/* number of bytes read from the input at once */
+#define BINARY_COPY_READ_SIZE (64 * 1024)
+
+/* number of bytes of processed rows after which the buffer is compacted */
+#define BINARY_COPY_COMPACT_SIZE (64 * 1024)
+
+/* bit 16 of the flags field of the header indicates that rows have OIDs */
+#define BINARY_COPY_FLAG_OIDS (1 << 16)
+
+/* the signature at the start of every binary COPY input */
+static const char BinaryCopySignature[11] = "PGCOPY\n\377\r\n\0";
+
+
+/*
+ * BinaryCopyInput holds input of a binary COPY that was read, but not
+ * processed yet.
+ */
+typedef struct BinaryCopyInput
+{
+	/* file to read from, or NULL when reading from the client */
+	FILE *file;
+
+	/* buffer for COPY data messages from the client */
+	StringInfo messageBuffer;
+
+	/* input that was read, of which the bytes before cursor were processed */
+	StringInfo buffer;
+
+	/* whether all input was read */
+	bool reachedEndOfInput;
+
+	/* relation name and row number for the error context */
+	char *relationName;
+	uint64 rowNumber;
+} BinaryCopyInput;
+
+
+static bool CanUseBinaryCopyPassthrough(CopyStmt *copyStatement,
+										CitusCopyDestReceiver *copyDest);
+static void OpenBinaryCopyInput(BinaryCopyInput *input, CopyStmt *copyStatement,
+								int columnCount);
+static void SendBinaryCopyInStart(int columnCount);
+static void CloseBinaryCopyInput(BinaryCopyInput *input);
+static void ReadBinaryCopyHeader(BinaryCopyInput *input);
+static bool EnsureBinaryCopyInput(BinaryCopyInput *input, int byteCount);
+static void ReadBinaryCopyInput(BinaryCopyInput *input);
+static void CompactBinaryCopyInput(BinaryCopyInput *input);
+static void BinaryCopyErrorCallback(void *arg);
+
+
+/*
+ * BinaryCopyPassthroughToExistingShards forwards the rows of a binary COPY to
+ * the shards through the given, already started, destination receiver. It
+ * returns false without reading any input when the rows need to be
+ * deserialized, in which case the caller should parse the input itself.
+ */
+bool
+BinaryCopyPassthroughToExistingShards(CopyStmt *copyStatement, Relation
+									  distributedRelation,
+									  CitusCopyDestReceiver *copyDest,
+									  uint64 *processedRowCount)
+{
+	if (!CanUseBinaryCopyPassthrough(copyStatement, copyDest))
+	{
+		return false;
+	}
+
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+	int partitionColumnIndex = copyDest->partitionColumnIndex;
+	int columnCount = list_length(copyDest->columnNameList);
+	int partitionFieldIndex = -1;
+	FmgrInfo receiveFunction;
+	Oid typeIOParam = InvalidOid;
+	int32 typeMod = -1;
+
+	/* find the field that holds the distribution column */
+	if (partitionColumnIndex != INVALID_PARTITION_COLUMN_INDEX)
+	{
+		int fieldIndex = 0;
+
+		for (int columnIndex = 0; columnIndex < partitionColumnIndex; columnIndex++)
+		{
+			Form_pg_attribute currentColumn = TupleDescAttr(tupleDescriptor,
+															columnIndex);
+
+			if (currentColumn->attisdropped ||
+				currentColumn->attgenerated == ATTRIBUTE_GENERATED_STORED)
+			{
+				continue;
+			}
+
+			fieldIndex++;
+		}
+
+		Form_pg_attribute partitionColumn = TupleDescAttr(tupleDescriptor,
+														  partitionColumnIndex);
+		Oid receiveFunctionId = InvalidOid;
+
+		getTypeBinaryInputInfo(partitionColumn->atttypid, &receiveFunctionId,
+							   &typeIOParam);
+		fmgr_info(receiveFunctionId, &receiveFunction);
+
+		partitionFieldIndex = fieldIndex;
+		typeMod = partitionColumn->atttypmod;
+	}
+
+	EState *executorState = copyDest->executorState;
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	Datum *columnValues = palloc0(tupleDescriptor->natts * sizeof(Datum));
+	bool *columnNulls = palloc0(tupleDescriptor->natts * sizeof(bool));
+
+	BinaryCopyInput input = { 0 };
+	input.relationName = RelationGetRelationName(distributedRelation);
+
+	ErrorContextCallback errorCallback;
+	errorCallback.callback = BinaryCopyErrorCallback;
+	errorCallback.arg = (void *) &input;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	OpenBinaryCopyInput(&input, copyStatement, columnCount);
+	ReadBinaryCopyHeader(&input);
+
+	StringInfo buffer = input.buffer;
+
+	while (true)
+	{
+		CompactBinaryCopyInput(&input);
+
+		int rowStart = buffer->cursor;
+
+		/* the input may end after any row, even without a trailer */
+		if (!EnsureBinaryCopyInput(&input, sizeof(int16)))
+		{
+			break;
+		}
+
+		input.rowNumber++;
+
+		int16 fieldCount = (int16) pq_getmsgint(buffer, sizeof(int16));
+		if (fieldCount == -1)
+		{
+			/* the trailer ends the data */
+			break;
+		}
+
+		if (fieldCount != columnCount)
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("row field count is %d, expected %d",
+								   (int) fieldCount, columnCount)));
+		}
+
+		ResetPerTupleExprContext(executorState);
+
+		for (int fieldIndex = 0; fieldIndex < fieldCount; fieldIndex++)
+		{
+			if (!EnsureBinaryCopyInput(&input, sizeof(int32)))
+			{
+				ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+								errmsg("unexpected EOF in COPY data")));
+			}
+
+			int32 fieldSize = (int32) pq_getmsgint(buffer, sizeof(int32));
+			if (fieldSize < -1)
+			{
+				ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+								errmsg("invalid field size")));
+			}
+
+			if (fieldSize > 0 && !EnsureBinaryCopyInput(&input, fieldSize))
+			{
+				ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+								errmsg("unexpected EOF in COPY data")));
+			}
+
+			if (fieldIndex == partitionFieldIndex)
+			{
+				MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+				if (fieldSize == -1)
+				{
+					columnValues[partitionColumnIndex] =
+						ReceiveFunctionCall(&receiveFunction, NULL, typeIOParam,
+											typeMod);
+					columnNulls[partitionColumnIndex] = true;
+				}
+				else
+				{
+					StringInfoData fieldData = { 0 };
+					initStringInfo(&fieldData);
+					appendBinaryStringInfo(&fieldData, buffer->data + buffer->cursor,
+										   fieldSize);
+
+					columnValues[partitionColumnIndex] =
+						ReceiveFunctionCall(&receiveFunction, &fieldData, typeIOParam,
+											typeMod);
+					columnNulls[partitionColumnIndex] = false;
+
+					if (fieldData.cursor != fieldData.len)
+					{
+						ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+										errmsg("incorrect binary data format")));
+					}
+				}
+
+				MemoryContextSwitchTo(oldContext);
+			}
+
+			if (fieldSize > 0)
+			{
+				buffer->cursor += fieldSize;
+			}
+		}
+
+		uint64 shardId = ShardIdForTuple(copyDest, columnValues, columnNulls);
+
+		/* forward the row as the client sent it */
+		StringInfoData serializedRow = { 0 };
+		serializedRow.data = buffer->data + rowStart;
+		serializedRow.len = buffer->cursor - rowStart;
+		serializedRow.maxlen = serializedRow.len;
+
+		CitusSendCopyRowToPlacements(copyDest, shardId, &serializedRow);
+
+		(*processedRowCount)++;
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+		pgstat_progress_update_param(PROGRESS_COPY_TUPLES_PROCESSED,
+									 *processedRowCount);
+#endif
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	CloseBinaryCopyInput(&input);
+
+	error_context_stack = errorCallback.previous;
+
+	return true;
+}
+
+
+/*
+ * CanUseBinaryCopyPassthrough returns whether the rows of the COPY statement
+ * can be forwarded to the shards as the client sends them.
+ */
+static bool
+CanUseBinaryCopyPassthrough(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest)
+{
+	DefElem *option = NULL;
+	bool binaryInput = false;
+
+	if (!EnableBinaryCopyPassthrough)
+	{
+		return false;
+	}
+
+	foreach_ptr(option, copyStatement->options)
+	{
+		/* other options change how rows are read, let the regular COPY apply them */
+		if (strcmp(option->defname, "format") != 0)
+		{
+			return false;
+		}
+
+		binaryInput = (strcmp(defGetString(option), "binary") == 0);
+	}
+
+	/* the commands on the shards use binary format for the same column types */
+	if (!binaryInput || !copyDest->copyOutState->binary)
+	{
+		return false;
+	}
+
+	if (copyStatement->is_program)
+	{
+		return false;
+	}
+
+	if (copyStatement->filename == NULL && whereToSendOutput != DestRemote)
+	{
+		return false;
+	}
+
+#if PG_VERSION_NUM < PG_VERSION_14
+	if (copyStatement->filename == NULL && PG_PROTOCOL_MAJOR(FrontendProtocol) < 3)
+	{
+		return false;
+	}
+#endif
+
+	/* rows for local placements and intermediate results are copied from tuples */
+	if (copyDest->shouldUseLocalCopy ||
+		copyDest->colocatedIntermediateResultIdPrefix != NULL)
+	{
+		return false;
+	}
+
+	if (IsCitusTableType(copyDest->distributedRelationId, APPEND_DISTRIBUTED))
+	{
+		return false;
+	}
+
+	/* the fields of each row should be the columns of the shard COPY commands */
+	if (copyStatement->attlist != NIL)
+	{
+		String *attributeName = NULL;
+		int columnIndex = 0;
+
+		if (list_length(copyStatement->attlist) != list_length(copyDest->columnNameList))
+		{
+			return false;
+		}
+
+		foreach_ptr(attributeName, copyStatement->attlist)
+		{
+			char *columnName = list_nth(copyDest->columnNameList, columnIndex);
+
+			if (strcmp(strVal(attributeName), columnName) != 0)
+			{
+				return false;
+			}
+
+			columnIndex++;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * OpenBinaryCopyInput opens the file of the COPY, or starts receiving COPY
+ * data from the client.
+ */
+static void
+OpenBinaryCopyInput(BinaryCopyInput *input, CopyStmt *copyStatement, int columnCount)
+{
+	input->buffer = makeStringInfo();
+	input->messageBuffer = makeStringInfo();
+
+	if (copyStatement->filename != NULL)
+	{
+		struct stat fileStat;
+
+		input->file = AllocateFile(copyStatement->filename, PG_BINARY_R);
+		if (input->file == NULL)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not open file \"%s\" for reading: %m",
+								   copyStatement->filename)));
+		}
+
+		if (fstat(fileno(input->file), &fileStat) != 0)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not stat file \"%s\": %m",
+								   copyStatement->filename)));
+		}
+
+		if (S_ISDIR(fileStat.st_mode))
+		{
+			ereport(ERROR, (errcode(ERRCODE_WRONG_OBJECT_TYPE),
+							errmsg("\"%s\" is a directory", copyStatement->filename)));
+		}
+	}
+	else
+	{
+		SendBinaryCopyInStart(columnCount);
+	}
+}
+
+
+/*
+ * SendBinaryCopyInStart asks the client to start sending COPY data in binary
+ * format.
+ */
+static void
+SendBinaryCopyInStart(int columnCount)
+{
+	StringInfoData copyInStart = { NULL, 0, 0, 0 };
+	const char copyFormat = 1; /* binary copy format */
+
+	pq_beginmessage(&copyInStart, 'G');
+	pq_sendbyte(&copyInStart, copyFormat);
+	pq_sendint16(&copyInStart, columnCount);
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		pq_sendint16(&copyInStart, copyFormat);
+	}
+	pq_endmessage(&copyInStart);
+
+	/* flush here to ensure that FE knows it can send data */
+	pq_flush();
+}
+
+
+/*
+ * CloseBinaryCopyInput closes the file of the COPY, or consumes the messages
+ * of the client until the end of the COPY data.
+ */
+static void
+CloseBinaryCopyInput(BinaryCopyInput *input)
+{
+	if (input->file != NULL)
+	{
+		FreeFile(input->file);
+		input->file = NULL;
+		return;
+	}
+
+	/* like the regular COPY, do not accept data after the trailer */
+	bool receivedDataAfterTrailer = input->buffer->cursor < input->buffer->len;
+
+	while (!input->reachedEndOfInput)
+	{
+		input->reachedEndOfInput = ReceiveCopyData(input->messageBuffer);
+		if (!input->reachedEndOfInput && input->messageBuffer->len > 0)
+		{
+			receivedDataAfterTrailer = true;
+		}
+	}
+
+	if (receivedDataAfterTrailer)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("received copy data after EOF marker")));
+	}
+}
+
+
+/*
+ * ReadBinaryCopyHeader checks the header of the binary COPY input and skips
+ * over it.
+ */
+static void
+ReadBinaryCopyHeader(BinaryCopyInput *input)
+{
+	StringInfo buffer = input->buffer;
+
+	if (!EnsureBinaryCopyInput(input, sizeof(BinaryCopySignature)) ||
+		memcmp(buffer->data + buffer->cursor, BinaryCopySignature,
+			   sizeof(BinaryCopySignature)) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("COPY file signature not recognized")));
+	}
+
+	buffer->cursor += sizeof(BinaryCopySignature);
+
+	if (!EnsureBinaryCopyInput(input, sizeof(int32)))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (missing flags)")));
+	}
+
+	int32 flags = (int32) pq_getmsgint(buffer, sizeof(int32));
+	if ((flags & BINARY_COPY_FLAG_OIDS) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (WITH OIDS)")));
+	}
+
+	flags &= ~BINARY_COPY_FLAG_OIDS;
+	if ((flags >> 16) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unrecognized critical flags in COPY file header")));
+	}
+
+	if (!EnsureBinaryCopyInput(input, sizeof(int32)))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (missing length)")));
+	}
+
+	int32 extensionLength = (int32) pq_getmsgint(buffer, sizeof(int32));
+	if (extensionLength < 0 || !EnsureBinaryCopyInput(input, extensionLength))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (wrong length)")));
+	}
+
+	/* skip the header extension */
+	buffer->cursor += extensionLength;
+}
+
+
+/*
+ * EnsureBinaryCopyInput reads input until at least byteCount unprocessed
+ * bytes are in the buffer, and returns false when the input ends before.
+ */
+static bool
+EnsureBinaryCopyInput(BinaryCopyInput *input, int byteCount)
+{
+	StringInfo buffer = input->buffer;
+
+	while (buffer->len - buffer->cursor < byteCount)
+	{
+		if (input->reachedEndOfInput)
+		{
+			return false;
+		}
+
+		ReadBinaryCopyInput(input);
+	}
+
+	return true;
+}
+
+
+/*
+ * ReadBinaryCopyInput appends the next part of the input to the buffer.
+ */
+static void
+ReadBinaryCopyInput(BinaryCopyInput *input)
+{
+	StringInfo buffer = input->buffer;
+
+	if (input->file != NULL)
+	{
+		enlargeStringInfo(buffer, BINARY_COPY_READ_SIZE);
+
+		size_t bytesRead = fread(buffer->data + buffer->len, 1, BINARY_COPY_READ_SIZE,
+								 input->file);
+		if (ferror(input->file))
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not read from COPY file: %m")));
+		}
+
+		if (bytesRead == 0)
+		{
+			input->reachedEndOfInput = true;
+		}
+
+		buffer->len += bytesRead;
+		buffer->data[buffer->len] = '\0';
+	}
+	else
+	{
+		bool copyDone = ReceiveCopyData(input->messageBuffer);
+		if (copyDone)
+		{
+			input->reachedEndOfInput = true;
+		}
+		else
+		{
+			appendBinaryStringInfo(buffer, input->messageBuffer->data,
+								   input->messageBuffer->len);
+		}
+	}
+
+	CHECK_FOR_INTERRUPTS();
+}
+
+
+/*
+ * CompactBinaryCopyInput removes processed rows from the start of the buffer
+ * once they take up a significant part of it.
+ */
+static void
+CompactBinaryCopyInput(BinaryCopyInput *input)
+{
+	StringInfo buffer = input->buffer;
+	int remainingLength = buffer->len - buffer->cursor;
+
+	if (buffer->cursor < BINARY_COPY_COMPACT_SIZE)
+	{
+		return;
+	}
+
+	if (remainingLength > 0)
+	{
+		memmove_s(buffer->data, buffer->maxlen, buffer->data + buffer->cursor,
+				  remainingLength);
+	}
+
+	buffer->len = remainingLength;
+	buffer->cursor = 0;
+	buffer->data[buffer->len] = '\0';
+}
+
+
+/*
+ * BinaryCopyErrorCallback adds the row that was being forwarded to errors,
+ * similar to the error context of the regular COPY.
+ */
+static void
+BinaryCopyErrorCallback(void *arg)
+{
+	BinaryCopyInput *input = (BinaryCopyInput *) arg;
+
+	if (input->rowNumber > 0)
+	{
+		errcontext("COPY %s, line " UINT64_FORMAT, input->relationName,
+				   input->rowNumber);
+	}
+	else
+	{
+		errcontext("COPY %s", input->relationName);
+	}
+}
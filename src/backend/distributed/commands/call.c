@@ -16,6 +16,7 @@
 #include "distributed/pg_version_constants.h"
 
 #include "catalog/pg_proc.h"
+#include "catalog/pg_type.h"
 #include "commands/defrem.h"
 #include "distributed/backend_data.h"
 #include "distributed/citus_ruleutils.h"
@@ -45,10 +46,19 @@
 #include "nodes/primnodes.h"
 #include "miscadmin.h"
 #include "tcop/dest.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/syscache.h"
 
 
+static ShardPlacement * ShardPlacementForProcedureCall(CallStmt *callStmt,
+													   DistObjectCacheEntry *procedure);
+static Task * ProcedureCallTask(CallStmt *callStmt, ShardPlacement *placement);
+
+PG_FUNCTION_INFO_V1(citus_delegate_procedure_calls);
+
+
 /* global variable tracking whether we are in a delegated procedure call */
 bool InDelegatedProcedureCall = false;
 
@@ -85,18 +95,199 @@ CallDistributedProcedureRemotely(CallStmt *callStmt, DestReceiver *dest)
 		return false;
 	}
 
+	ShardPlacement *placement = ShardPlacementForProcedureCall(callStmt, procedure);
+	if (placement == NULL)
+	{
+		return false;
+	}
+
+	ereport(DEBUG1, (errmsg("pushing down the procedure")));
+
+	{
+		Tuplestorestate *tupleStore = tuplestore_begin_heap(true, false, work_mem);
+		TupleDesc tupleDesc = CallStmtResultDesc(callStmt);
+		TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDesc,
+														&TTSOpsMinimalTuple);
+		bool expectResults = true;
+		Task *task = ProcedureCallTask(callStmt, placement);
+
+		/*
+		 * We are delegating the distributed transaction to the worker, so we
+		 * should not run the CALL in a transaction block.
+		 */
+		TransactionProperties xactProperties = {
+			.errorOnAnyFailure = true,
+			.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_DISALLOWED,
+			.requires2PC = false
+		};
+
+		EnableWorkerMessagePropagation();
+
+		bool localExecutionSupported = true;
+		ExecutionParams *executionParams = CreateBasicExecutionParams(
+			ROW_MODIFY_NONE, list_make1(task), MaxAdaptiveExecutorPoolSize,
+			localExecutionSupported
+			);
+		executionParams->tupleDestination = CreateTupleStoreTupleDest(tupleStore,
+																	  tupleDesc);
+		executionParams->expectResults = expectResults;
+		executionParams->xactProperties = xactProperties;
+		executionParams->isUtilityCommand = true;
+		ExecuteTaskListExtended(executionParams);
+
+		DisableWorkerMessagePropagation();
+
+		while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+		{
+			if (!dest->receiveSlot(slot, dest))
+			{
+				break;
+			}
+		}
+
+		/* Don't call tuplestore_end(tupleStore). It'll be freed soon enough in a top level CALL,
+		 * & dest->receiveSlot could conceivably rely on slots being long lived.
+		 */
+	}
+
+	return true;
+}
+
+
+/*
+ * citus_delegate_procedure_calls delegates the given CALL commands of
+ * distributed procedures to the workers that hold the shards of their
+ * distribution arguments, in as few round trips as possible.
+ *
+ * The calls for the same worker are sent as multi-statement commands of up
+ * to batch_size calls, which run in a single transaction on the worker. The
+ * procedures can therefore not commit or roll back themselves, and a failing
+ * call undoes the other calls of its batch. The batches for different workers
+ * run in parallel. The results of the calls are discarded.
+ */
+Datum
+citus_delegate_procedure_calls(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+	{
+		ereport(ERROR, (errmsg("call_commands and batch_size cannot be NULL")));
+	}
+
+	ArrayType *callCommandArray = PG_GETARG_ARRAYTYPE_P(0);
+	int batchSize = PG_GETARG_INT32(1);
+
+	if (batchSize < 1)
+	{
+		ereport(ERROR, (errmsg("batch_size must be at least 1")));
+	}
+
+	if (IsMultiStatementTransaction())
+	{
+		ereport(ERROR, (errmsg("cannot delegate procedure calls in a transaction "
+							   "block")));
+	}
+
+	Datum *callCommandDatums = NULL;
+	bool *callCommandNulls = NULL;
+	int callCount = 0;
+	deconstruct_array(callCommandArray, TEXTOID, -1, false, TYPALIGN_INT,
+					  &callCommandDatums, &callCommandNulls, &callCount);
+
+	List *taskList = NIL;
+
+	for (int callIndex = 0; callIndex < callCount; callIndex++)
+	{
+		if (callCommandNulls[callIndex])
+		{
+			ereport(ERROR, (errmsg("call_commands cannot contain NULL values")));
+		}
+
+		char *callCommand = TextDatumGetCString(callCommandDatums[callIndex]);
+		Query *callQuery = ParseQueryString(callCommand, NULL, 0);
+
+		if (callQuery->commandType != CMD_UTILITY ||
+			!IsA(callQuery->utilityStmt, CallStmt))
+		{
+			ereport(ERROR, (errmsg("\"%s\" is not a CALL command", callCommand)));
+		}
+
+		CallStmt *callStmt = (CallStmt *) callQuery->utilityStmt;
+		DistObjectCacheEntry *procedure =
+			LookupDistObjectCacheEntry(ProcedureRelationId,
+									   callStmt->funcexpr->funcid, 0);
+		if (procedure == NULL || !procedure->isDistributed)
+		{
+			ereport(ERROR, (errmsg("procedure in \"%s\" is not distributed",
+								   callCommand)));
+		}
+
+		ShardPlacement *placement = ShardPlacementForProcedureCall(callStmt, procedure);
+		if (placement == NULL)
+		{
+			ereport(ERROR, (errmsg("cannot delegate \"%s\" to a worker", callCommand),
+							errhint("Set client_min_messages to DEBUG1 to see why "
+									"the call cannot be delegated.")));
+		}
+
+		taskList = lappend(taskList, ProcedureCallTask(callStmt, placement));
+	}
+
+	if (taskList == NIL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	taskList = CombineUtilityTasksByWorker(taskList, batchSize);
+
+	/* like single calls, the batches do not run in a transaction block */
+	TransactionProperties xactProperties = {
+		.errorOnAnyFailure = true,
+		.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_DISALLOWED,
+		.requires2PC = false
+	};
+
+	EnableWorkerMessagePropagation();
+
+	bool localExecutionSupported = true;
+	ExecutionParams *executionParams = CreateBasicExecutionParams(
+		ROW_MODIFY_NONE, taskList, MaxAdaptiveExecutorPoolSize,
+		localExecutionSupported
+		);
+	executionParams->expectResults = false;
+	executionParams->xactProperties = xactProperties;
+	executionParams->isUtilityCommand = true;
+	ExecuteTaskListExtended(executionParams);
+
+	DisableWorkerMessagePropagation();
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * ShardPlacementForProcedureCall returns the placement that a CALL of the given
+ * distributed procedure can be delegated to, or NULL if the call cannot be
+ * delegated.
+ */
+static ShardPlacement *
+ShardPlacementForProcedureCall(CallStmt *callStmt, DistObjectCacheEntry *procedure)
+{
+	FuncExpr *funcExpr = callStmt->funcexpr;
+
 	Oid colocatedRelationId = ColocatedTableId(procedure->colocationId);
 	if (colocatedRelationId == InvalidOid)
 	{
 		ereport(DEBUG1, (errmsg("stored procedure does not have co-located tables")));
-		return false;
+		return NULL;
 	}
 
 	if (contain_volatile_functions((Node *) funcExpr->args))
 	{
 		ereport(DEBUG1, (errmsg("arguments in a distributed stored procedure must "
 								"be constant expressions")));
-		return false;
+		return NULL;
 	}
 
 	CitusTableCacheEntry *distTable = GetCitusTableCacheEntry(colocatedRelationId);
@@ -137,14 +328,14 @@ CallDistributedProcedureRemotely(CallStmt *callStmt, DestReceiver *dest)
 	/* return if we could not find a placement */
 	if (placement == NULL)
 	{
-		return false;
+		return NULL;
 	}
 
 	WorkerNode *workerNode = FindWorkerNode(placement->nodeName, placement->nodePort);
 	if (workerNode == NULL || !workerNode->hasMetadata || !workerNode->metadataSynced)
 	{
 		ereport(DEBUG1, (errmsg("there is no worker node with metadata")));
-		return false;
+		return NULL;
 	}
 	else if (workerNode->groupId == GetLocalGroupId())
 	{
@@ -156,71 +347,36 @@ CallDistributedProcedureRemotely(CallStmt *callStmt, DestReceiver *dest)
 		 *      on the node itself
 		 */
 		ereport(DEBUG1, (errmsg("not pushing down procedure to the same node")));
-		return false;
+		return NULL;
 	}
 
-	ereport(DEBUG1, (errmsg("pushing down the procedure")));
+	return placement;
+}
 
+
+/*
+ * ProcedureCallTask returns a task that runs the given CALL on the given
+ * placement.
+ */
+static Task *
+ProcedureCallTask(CallStmt *callStmt, ShardPlacement *placement)
+{
 	/* build remote command with fully qualified names */
 	StringInfo callCommand = makeStringInfo();
 
 	appendStringInfo(callCommand, "CALL %s", pg_get_rule_expr((Node *) callStmt));
-	{
-		Tuplestorestate *tupleStore = tuplestore_begin_heap(true, false, work_mem);
-		TupleDesc tupleDesc = CallStmtResultDesc(callStmt);
-		TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDesc,
-														&TTSOpsMinimalTuple);
-		bool expectResults = true;
-		Task *task = CitusMakeNode(Task);
-
-		task->jobId = INVALID_JOB_ID;
-		task->taskId = INVALID_TASK_ID;
-		task->taskType = DDL_TASK;
-		SetTaskQueryString(task, callCommand->data);
-		task->replicationModel = REPLICATION_MODEL_INVALID;
-		task->dependentTaskList = NIL;
-		task->anchorShardId = placement->shardId;
-		task->relationShardList = NIL;
-		task->taskPlacementList = list_make1(placement);
 
-		/*
-		 * We are delegating the distributed transaction to the worker, so we
-		 * should not run the CALL in a transaction block.
-		 */
-		TransactionProperties xactProperties = {
-			.errorOnAnyFailure = true,
-			.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_DISALLOWED,
-			.requires2PC = false
-		};
+	Task *task = CitusMakeNode(Task);
 
-		EnableWorkerMessagePropagation();
+	task->jobId = INVALID_JOB_ID;
+	task->taskId = INVALID_TASK_ID;
+	task->taskType = DDL_TASK;
+	SetTaskQueryString(task, callCommand->data);
+	task->replicationModel = REPLICATION_MODEL_INVALID;
+	task->dependentTaskList = NIL;
+	task->anchorShardId = placement->shardId;
+	task->relationShardList = NIL;
+	task->taskPlacementList = list_make1(placement);
 
-		bool localExecutionSupported = true;
-		ExecutionParams *executionParams = CreateBasicExecutionParams(
-			ROW_MODIFY_NONE, list_make1(task), MaxAdaptiveExecutorPoolSize,
-			localExecutionSupported
-			);
-		executionParams->tupleDestination = CreateTupleStoreTupleDest(tupleStore,
-																	  tupleDesc);
-		executionParams->expectResults = expectResults;
-		executionParams->xactProperties = xactProperties;
-		executionParams->isUtilityCommand = true;
-		ExecuteTaskListExtended(executionParams);
-
-		DisableWorkerMessagePropagation();
-
-		while (tuplestore_gettupleslot(tupleStore, true, false, slot))
-		{
-			if (!dest->receiveSlot(slot, dest))
-			{
-				break;
-			}
-		}
-
-		/* Don't call tuplestore_end(tupleStore). It'll be freed soon enough in a top level CALL,
-		 * & dest->receiveSlot could conceivably rely on slots being long lived.
-		 */
-	}
-
-	return true;
+	return task;
 }
@@ -0,0 +1,477 @@
+/*-------------------------------------------------------------------------
+ *
+ * compressed_copy.c
+ *	  Routines for receiving compressed COPY data into shards.
+ *
+ * When citus.remote_copy_compression is set, the coordinator compresses the
+ * rows it sends to the shards during a COPY. It then sends
+ *
+ *   COPY shard (..) FROM STDIN WITH (.., compression 'lz4')
+ *
+ * followed by COPY data that consists of the same signature and frames as
+ * compressed intermediate results. The worker intercepts such commands in
+ * the utility hook, decompresses the frames and feeds the COPY data to the
+ * regular COPY via a data source callback.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "access/xact.h"
+#include "commands/copy.h"
+#include "commands/defrem.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/compressed_copy.h"
+#include "distributed/copy_on_conflict.h"
+#include "distributed/intermediate_result_compression.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/transmit.h"
+#include "distributed/version_compat.h"
+#include "libpq/libpq.h"
+#include "libpq/pqformat.h"
+#include "parser/parse_node.h"
+#include "tcop/tcopprot.h"
+#include "tcop/utility.h"
+#include "utils/rel.h"
+#include "utils/rls.h"
+
+
+/*
+ * CompressedCopyReader keeps the state of reading compressed COPY data from
+ * the client.
+ */
+typedef struct CompressedCopyReader
+{
+	/* last CopyData message, and the bytes of messages not yet processed */
+	StringInfo messageBuffer;
+	StringInfo inputData;
+
+	/* whether the client sent CopyDone */
+	bool reachedEndOfInput;
+
+	/* uncompressed data of the current frame */
+	StringInfo frameData;
+	int frameOffset;
+} CompressedCopyReader;
+
+
+static void SendCompressedCopyInStart(Relation relation, CopyStmt *copyStatement);
+static bool EnsureCompressedCopyInput(CompressedCopyReader *reader, int length);
+static void ConsumeCompressedCopyInput(CompressedCopyReader *reader, int length);
+static bool ReadNextCompressedCopyFrame(CompressedCopyReader *reader);
+static int ReadCompressedCopyData(void *outbuf, int minread, int maxread);
+
+
+/* GUC, determines how the COPY data sent to shards is compressed */
+int RemoteCopyCompression = INTERMEDIATE_RESULT_COMPRESSION_NONE;
+
+/*
+ * COPY only passes a buffer to its data source callback, so we keep the state
+ * of the COPY that is being read in a global.
+ */
+static CompressedCopyReader *CurrentCompressedCopyReader = NULL;
+
+
+/*
+ * RemoteCopyCompressionName returns the value of the compression option of
+ * COPY commands that send data compressed with the given method.
+ */
+const char *
+RemoteCopyCompressionName(IntermediateResultCompressionType compressionType)
+{
+	switch (compressionType)
+	{
+		case INTERMEDIATE_RESULT_COMPRESSION_LZ4:
+		{
+			return "lz4";
+		}
+
+		case INTERMEDIATE_RESULT_COMPRESSION_ZSTD:
+		{
+			return "zstd";
+		}
+
+		default:
+		{
+			ereport(ERROR, (errmsg("unexpected compression method %d",
+								   compressionType)));
+		}
+	}
+
+	return NULL; /* keep compiler quiet */
+}
+
+
+/*
+ * IsCompressedCopyStmt determines whether the given copy statement is a
+ * COPY table FROM STDIN WITH (.., compression '..') statement, which the
+ * coordinator uses to send compressed rows to shards.
+ */
+bool
+IsCompressedCopyStmt(CopyStmt *copyStatement)
+{
+	DefElem *option = NULL;
+
+	if (!copyStatement->is_from || copyStatement->relation == NULL)
+	{
+		return false;
+	}
+
+	foreach_ptr(option, copyStatement->options)
+	{
+		if (strcmp(option->defname, REMOTE_COPY_COMPRESSION_OPTION) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * CopyCompressedDataIntoTable runs a COPY .. FROM STDIN with compressed COPY
+ * data. The compression option is removed and the remaining options are
+ * applied by the regular COPY.
+ */
+void
+CopyCompressedDataIntoTable(CopyStmt *copyStatement, QueryCompletion *completionTag,
+							const char *queryString)
+{
+	if (copyStatement->filename != NULL || copyStatement->is_program)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY option \"%s\" is only supported for COPY FROM "
+							   "STDIN", REMOTE_COPY_COMPRESSION_OPTION)));
+	}
+
+	if (copyStatement->whereClause != NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY option \"%s\" is not supported with WHERE",
+							   REMOTE_COPY_COMPRESSION_OPTION)));
+	}
+
+	if (whereToSendOutput != DestRemote)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY option \"%s\" can only be used by a client",
+							   REMOTE_COPY_COMPRESSION_OPTION)));
+	}
+
+	PreventCommandIfReadOnly("COPY FROM");
+	PreventCommandIfParallelMode("COPY FROM");
+
+	List *copyOptions = NIL;
+	DefElem *option = NULL;
+
+	/* the frames carry their method, but reject methods we cannot read */
+	foreach_ptr(option, copyStatement->options)
+	{
+		if (strcmp(option->defname, REMOTE_COPY_COMPRESSION_OPTION) != 0)
+		{
+			copyOptions = lappend(copyOptions, option);
+			continue;
+		}
+
+		char *compressionName = defGetString(option);
+
+#if HAVE_CITUS_LIBLZ4
+		if (strcmp(compressionName, "lz4") == 0)
+		{
+			continue;
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		if (strcmp(compressionName, "zstd") == 0)
+		{
+			continue;
+		}
+#endif
+
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY compression method \"%s\" is not supported "
+							   "by this build of Citus", compressionName)));
+	}
+
+	/* the shards also receive upserted rows compressed */
+	CopyOnConflictAction onConflictAction = ExtractCopyOnConflictOption(&copyOptions);
+
+	/* shards are regular tables, distributed tables need the regular COPY */
+	Relation relation = table_openrv(copyStatement->relation, RowExclusiveLock);
+	if (IsCitusTable(RelationGetRelid(relation)))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY option \"%s\" is not supported for distributed "
+							   "tables", REMOTE_COPY_COMPRESSION_OPTION)));
+	}
+
+	if (check_enable_rls(RelationGetRelid(relation), InvalidOid, false) == RLS_ENABLED)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY FROM not supported with row-level security")));
+	}
+
+	CheckCopyPermissions(copyStatement);
+
+	ParseState *parseState = make_parsestate(NULL);
+	parseState->p_sourcetext = queryString;
+
+	CompressedCopyReader *reader = palloc0(sizeof(CompressedCopyReader));
+	reader->messageBuffer = makeStringInfo();
+	reader->inputData = makeStringInfo();
+	reader->frameData = makeStringInfo();
+	CurrentCompressedCopyReader = reader;
+
+	SendCompressedCopyInStart(relation, copyStatement);
+
+	/* every frame should start after the signature */
+	if (!EnsureCompressedCopyInput(reader, COMPRESSED_RESULT_SIGNATURE_SIZE) ||
+		memcmp(reader->inputData->data + reader->inputData->cursor,
+			   COMPRESSED_RESULT_SIGNATURE, COMPRESSED_RESULT_SIGNATURE_SIZE) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("compressed COPY data signature not recognized")));
+	}
+
+	ConsumeCompressedCopyInput(reader, COMPRESSED_RESULT_SIGNATURE_SIZE);
+
+	/* binary COPY reads its header here, so start reading the data first */
+	uint64 processedRowCount = 0;
+
+	if (onConflictAction != COPY_ON_CONFLICT_NONE)
+	{
+		processedRowCount = CopyFromWithOnConflict(relation, parseState,
+												   ReadCompressedCopyData,
+												   copyStatement->attlist, copyOptions,
+												   onConflictAction);
+	}
+	else
+	{
+		CopyFromState copyState = BeginCopyFrom_compat(parseState, relation, NULL,
+													   NULL, false,
+													   ReadCompressedCopyData,
+													   copyStatement->attlist,
+													   copyOptions);
+
+		processedRowCount = CopyFrom(copyState);
+
+		EndCopyFrom(copyState);
+	}
+
+	/* the COPY may stop at a \. line or a binary trailer before CopyDone */
+	while (!reader->reachedEndOfInput)
+	{
+		reader->reachedEndOfInput = ReceiveCopyData(reader->messageBuffer);
+	}
+
+	CurrentCompressedCopyReader = NULL;
+
+	free_parsestate(parseState);
+	table_close(relation, NoLock);
+
+	SetQueryCompletion(completionTag, CMDTAG_COPY, processedRowCount);
+}
+
+
+/*
+ * SendCompressedCopyInStart tells the client to start sending COPY data. The
+ * compressed data is an opaque stream, so we announce it as text.
+ */
+static void
+SendCompressedCopyInStart(Relation relation, CopyStmt *copyStatement)
+{
+	StringInfoData copyInStart = { NULL, 0, 0, 0 };
+	const char copyFormat = 0; /* text copy format */
+	int columnCount = list_length(copyStatement->attlist);
+
+	if (columnCount == 0)
+	{
+		TupleDesc tupleDescriptor = RelationGetDescr(relation);
+
+		for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+		{
+			if (!TupleDescAttr(tupleDescriptor, columnIndex)->attisdropped)
+			{
+				columnCount++;
+			}
+		}
+	}
+
+	pq_beginmessage(&copyInStart, 'G');
+	pq_sendbyte(&copyInStart, copyFormat);
+	pq_sendint16(&copyInStart, columnCount);
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		pq_sendint16(&copyInStart, copyFormat);
+	}
+	pq_endmessage(&copyInStart);
+
+	/* flush here to ensure that FE knows it can send data */
+	pq_flush();
+}
+
+
+/*
+ * EnsureCompressedCopyInput receives CopyData messages until at least length
+ * unprocessed bytes are available, and returns false when the client ends the
+ * COPY data before.
+ */
+static bool
+EnsureCompressedCopyInput(CompressedCopyReader *reader, int length)
+{
+	StringInfo inputData = reader->inputData;
+
+	while (inputData->len - inputData->cursor < length)
+	{
+		if (reader->reachedEndOfInput)
+		{
+			return false;
+		}
+
+		/* drop processed bytes before appending more */
+		if (inputData->cursor > 0)
+		{
+			int remainingLength = inputData->len - inputData->cursor;
+
+			if (remainingLength > 0)
+			{
+				memmove_s(inputData->data, inputData->maxlen,
+						  inputData->data + inputData->cursor, remainingLength);
+			}
+
+			inputData->len = remainingLength;
+			inputData->cursor = 0;
+			inputData->data[inputData->len] = '\0';
+		}
+
+		reader->reachedEndOfInput = ReceiveCopyData(reader->messageBuffer);
+		if (!reader->reachedEndOfInput)
+		{
+			appendBinaryStringInfo(inputData, reader->messageBuffer->data,
+								   reader->messageBuffer->len);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	return true;
+}
+
+
+/*
+ * ConsumeCompressedCopyInput marks the given number of bytes of input as
+ * processed.
+ */
+static void
+ConsumeCompressedCopyInput(CompressedCopyReader *reader, int length)
+{
+	reader->inputData->cursor += length;
+}
+
+
+/*
+ * ReadNextCompressedCopyFrame decompresses the next frame of the COPY data
+ * into the frame data of the reader. It returns false when the COPY data
+ * ends.
+ */
+static bool
+ReadNextCompressedCopyFrame(CompressedCopyReader *reader)
+{
+	StringInfo inputData = reader->inputData;
+
+	if (!EnsureCompressedCopyInput(reader, COMPRESSED_RESULT_FRAME_HEADER_SIZE))
+	{
+		if (inputData->len > inputData->cursor)
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("unexpected end of compressed COPY data")));
+		}
+
+		return false;
+	}
+
+	uint8 method = 0;
+	int rawLength = 0;
+	int compressedLength = 0;
+
+	ParseCompressedResultFrameHeader(inputData->data + inputData->cursor, &method,
+									 &rawLength, &compressedLength);
+	if (rawLength < 0 || compressedLength < 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid frame in compressed COPY data")));
+	}
+
+	if (!EnsureCompressedCopyInput(reader, COMPRESSED_RESULT_FRAME_HEADER_SIZE +
+								   compressedLength))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unexpected end of compressed COPY data")));
+	}
+
+	ConsumeCompressedCopyInput(reader, COMPRESSED_RESULT_FRAME_HEADER_SIZE);
+
+	resetStringInfo(reader->frameData);
+	enlargeStringInfo(reader->frameData, rawLength);
+
+	if (!DecompressResultFrame(method, inputData->data + inputData->cursor,
+							   compressedLength, reader->frameData->data, rawLength))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("could not decompress COPY data")));
+	}
+
+	ConsumeCompressedCopyInput(reader, compressedLength);
+
+	reader->frameData->len = rawLength;
+	reader->frameData->data[rawLength] = '\0';
+	reader->frameOffset = 0;
+
+	return true;
+}
+
+
+/*
+ * ReadCompressedCopyData is the data source callback of COPY for compressed
+ * COPY data. It copies at least minread and at most maxread bytes of
+ * uncompressed data into outbuf, unless the COPY data ends.
+ */
+static int
+ReadCompressedCopyData(void *outbuf, int minread, int maxread)
+{
+	CompressedCopyReader *reader = CurrentCompressedCopyReader;
+	int bytesRead = 0;
+
+	Assert(reader != NULL);
+
+	while (bytesRead < minread)
+	{
+		if (reader->frameOffset == reader->frameData->len &&
+			!ReadNextCompressedCopyFrame(reader))
+		{
+			break;
+		}
+
+		int copyLength = Min(maxread - bytesRead,
+							 reader->frameData->len - reader->frameOffset);
+
+		if (copyLength > 0)
+		{
+			memcpy_s(((char *) outbuf) + bytesRead, maxread - bytesRead,
+					 reader->frameData->data + reader->frameOffset, copyLength);
+		}
+
+		reader->frameOffset += copyLength;
+		bytesRead += copyLength;
+	}
+
+	return bytesRead;
+}
@@ -0,0 +1,471 @@
+/*-------------------------------------------------------------------------
+ *
+ * copy_on_conflict.c
+ *	  Routines for COPY FROM with ON CONFLICT semantics.
+ *
+ * COPY into a distributed table accepts an on_conflict option:
+ *
+ *   COPY table FROM STDIN WITH (.., on_conflict 'do_nothing')
+ *   COPY table FROM STDIN WITH (.., on_conflict 'do_update')
+ *
+ * The coordinator removes the option before parsing the input and forwards
+ * it in the COPY commands it sends to the shards. The shards intercept such
+ * commands in the utility hook, parse the rows with the regular COPY code and
+ * write each row with a prepared INSERT .. ON CONFLICT statement, such that
+ * bulk upserts do not have to go through a staging table.
+ *
+ * With do_update, rows that conflict on the primary key overwrite all other
+ * columns of the existing row.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "access/sysattr.h"
+#include "access/xact.h"
+#include "catalog/dependency.h"
+#include "commands/copy.h"
+#include "commands/defrem.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/copy_on_conflict.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/version_compat.h"
+#include "executor/executor.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "parser/parse_node.h"
+#include "parser/parse_relation.h"
+#include "tcop/dest.h"
+#include "tcop/tcopprot.h"
+#include "tcop/utility.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+
+
+static char * OnConflictInsertCommand(Relation relation, CopyOnConflictAction action,
+									  List **parameterAttributeList);
+
+
+/*
+ * ExtractCopyOnConflictOption returns the value of the on_conflict option in
+ * the given COPY options, and removes the option from the list.
+ */
+CopyOnConflictAction
+ExtractCopyOnConflictOption(List **copyOptions)
+{
+	CopyOnConflictAction action = COPY_ON_CONFLICT_NONE;
+	List *remainingOptions = NIL;
+	bool optionFound = false;
+	DefElem *option = NULL;
+
+	foreach_ptr(option, *copyOptions)
+	{
+		if (strcmp(option->defname, COPY_ON_CONFLICT_OPTION) != 0)
+		{
+			remainingOptions = lappend(remainingOptions, option);
+			continue;
+		}
+
+		if (optionFound)
+		{
+			ereport(ERROR, (errcode(ERRCODE_SYNTAX_ERROR),
+							errmsg("conflicting or redundant options")));
+		}
+
+		char *actionName = defGetString(option);
+
+		if (strcmp(actionName, "error") == 0)
+		{
+			action = COPY_ON_CONFLICT_NONE;
+		}
+		else if (strcmp(actionName, "do_nothing") == 0)
+		{
+			action = COPY_ON_CONFLICT_DO_NOTHING;
+		}
+		else if (strcmp(actionName, "do_update") == 0)
+		{
+			action = COPY_ON_CONFLICT_DO_UPDATE;
+		}
+		else
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("COPY option \"%s\" must be one of \"error\", "
+								   "\"do_nothing\" or \"do_update\"",
+								   COPY_ON_CONFLICT_OPTION)));
+		}
+
+		optionFound = true;
+	}
+
+	if (optionFound)
+	{
+		*copyOptions = remainingOptions;
+	}
+
+	return action;
+}
+
+
+/*
+ * CopyOnConflictActionName returns the value of the on_conflict option of
+ * COPY commands that apply the given action.
+ */
+const char *
+CopyOnConflictActionName(CopyOnConflictAction action)
+{
+	switch (action)
+	{
+		case COPY_ON_CONFLICT_DO_NOTHING:
+		{
+			return "do_nothing";
+		}
+
+		case COPY_ON_CONFLICT_DO_UPDATE:
+		{
+			return "do_update";
+		}
+
+		default:
+		{
+			return "error";
+		}
+	}
+}
+
+
+/*
+ * EnsureCopyOnConflictSupported errors out when COPY cannot apply the given
+ * action to the relation, which for do_update requires a primary key.
+ */
+void
+EnsureCopyOnConflictSupported(Relation relation, CopyOnConflictAction action)
+{
+	if (action == COPY_ON_CONFLICT_DO_UPDATE &&
+		!OidIsValid(RelationGetPrimaryKeyIndex(relation)))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY option \"%s\" 'do_update' requires a primary "
+							   "key on \"%s\"", COPY_ON_CONFLICT_OPTION,
+							   RelationGetRelationName(relation))));
+	}
+}
+
+
+/*
+ * IsCopyOnConflictStmt determines whether the given copy statement is a
+ * COPY table FROM .. WITH (.., on_conflict '..') statement.
+ */
+bool
+IsCopyOnConflictStmt(CopyStmt *copyStatement)
+{
+	DefElem *option = NULL;
+
+	if (!copyStatement->is_from || copyStatement->relation == NULL)
+	{
+		return false;
+	}
+
+	foreach_ptr(option, copyStatement->options)
+	{
+		if (strcmp(option->defname, COPY_ON_CONFLICT_OPTION) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * CopyOnConflictIntoTable runs a COPY .. FROM with an on_conflict option into
+ * a regular table, which is how shards receive upserted rows.
+ */
+void
+CopyOnConflictIntoTable(CopyStmt *copyStatement, QueryCompletion *completionTag,
+						const char *queryString)
+{
+	if (copyStatement->filename != NULL || copyStatement->is_program)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY option \"%s\" is only supported for COPY FROM "
+							   "STDIN", COPY_ON_CONFLICT_OPTION)));
+	}
+
+	if (copyStatement->whereClause != NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY option \"%s\" is not supported with WHERE",
+							   COPY_ON_CONFLICT_OPTION)));
+	}
+
+	if (whereToSendOutput != DestRemote)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("COPY option \"%s\" can only be used by a client",
+							   COPY_ON_CONFLICT_OPTION)));
+	}
+
+	PreventCommandIfReadOnly("COPY FROM");
+	PreventCommandIfParallelMode("COPY FROM");
+
+	List *copyOptions = list_copy(copyStatement->options);
+	CopyOnConflictAction action = ExtractCopyOnConflictOption(&copyOptions);
+
+	Relation relation = table_openrv(copyStatement->relation, RowExclusiveLock);
+
+	CheckCopyPermissions(copyStatement);
+
+	ParseState *parseState = make_parsestate(NULL);
+	parseState->p_sourcetext = queryString;
+	(void) addRangeTableEntryForRelation(parseState, relation, RowExclusiveLock,
+										 NULL, false, false);
+
+	uint64 processedRowCount = 0;
+
+	if (action == COPY_ON_CONFLICT_NONE)
+	{
+		CopyFromState copyState = BeginCopyFrom_compat(parseState, relation, NULL, NULL,
+													   false, NULL,
+													   copyStatement->attlist,
+													   copyOptions);
+
+		processedRowCount = CopyFrom(copyState);
+
+		EndCopyFrom(copyState);
+	}
+	else
+	{
+		processedRowCount = CopyFromWithOnConflict(relation, parseState, NULL,
+												   copyStatement->attlist, copyOptions,
+												   action);
+	}
+
+	free_parsestate(parseState);
+	table_close(relation, NoLock);
+
+	SetQueryCompletion(completionTag, CMDTAG_COPY, processedRowCount);
+}
+
+
+/*
+ * CopyFromWithOnConflict parses COPY data for the given relation, from the
+ * data source callback or from the client if no callback is given, and
+ * inserts each row with INSERT .. ON CONFLICT. It returns the number of rows
+ * that were inserted or updated.
+ *
+ * Rows are written one INSERT at a time, so a row may also conflict with a
+ * row that appeared earlier in the same COPY, which do_nothing keeps and
+ * do_update overwrites.
+ */
+uint64
+CopyFromWithOnConflict(Relation relation, ParseState *parseState,
+					   copy_data_source_cb dataSourceCallback, List *attributeList,
+					   List *copyOptions, CopyOnConflictAction action)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	uint32 columnCount = tupleDescriptor->natts;
+	Datum *columnValues = palloc0(columnCount * sizeof(Datum));
+	bool *columnNulls = palloc0(columnCount * sizeof(bool));
+	List *parameterAttributeList = NIL;
+	uint64 processedRowCount = 0;
+	ErrorContextCallback errorCallback;
+
+	Assert(action != COPY_ON_CONFLICT_NONE);
+
+	char *insertCommand = OnConflictInsertCommand(relation, action,
+												  &parameterAttributeList);
+	int parameterCount = list_length(parameterAttributeList);
+	Oid *parameterTypes = palloc0(Max(parameterCount, 1) * sizeof(Oid));
+	Datum *parameterValues = palloc0(Max(parameterCount, 1) * sizeof(Datum));
+	char *parameterNulls = palloc0(Max(parameterCount, 1) * sizeof(char));
+
+	int parameterIndex = 0;
+	int attributeNumber = 0;
+	foreach_int(attributeNumber, parameterAttributeList)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor,
+													attributeNumber - 1);
+
+		parameterTypes[parameterIndex++] = attribute->atttypid;
+	}
+
+	EState *executorState = CreateExecutorState();
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	ExprContext *executorExpressionContext = GetPerTupleExprContext(executorState);
+
+	if (parseState->p_rtable == NIL)
+	{
+		(void) addRangeTableEntryForRelation(parseState, relation, RowExclusiveLock,
+											 NULL, false, false);
+	}
+
+	CopyFromState copyState = BeginCopyFrom_compat(parseState, relation, NULL, NULL,
+												   false, dataSourceCallback,
+												   attributeList, copyOptions);
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	SPIPlanPtr insertPlan = SPI_prepare(insertCommand, parameterCount, parameterTypes);
+	if (insertPlan == NULL)
+	{
+		ereport(ERROR, (errmsg("could not prepare \"%s\": %s", insertCommand,
+							   SPI_result_code_string(SPI_result))));
+	}
+
+	/* set up callback to identify error line number */
+	errorCallback.callback = CopyFromErrorCallback;
+	errorCallback.arg = (void *) copyState;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	while (true)
+	{
+		ResetPerTupleExprContext(executorState);
+
+		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+		bool nextRowFound = NextCopyFrom(copyState, executorExpressionContext,
+										 columnValues, columnNulls);
+
+		MemoryContextSwitchTo(oldContext);
+
+		if (!nextRowFound)
+		{
+			break;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		parameterIndex = 0;
+		foreach_int(attributeNumber, parameterAttributeList)
+		{
+			parameterValues[parameterIndex] = columnValues[attributeNumber - 1];
+			parameterNulls[parameterIndex] = columnNulls[attributeNumber - 1] ? 'n' : ' ';
+			parameterIndex++;
+		}
+
+		bool readOnly = false;
+		long rowLimit = 0;
+		int spiResult = SPI_execute_plan(insertPlan, parameterValues, parameterNulls,
+										 readOnly, rowLimit);
+		if (spiResult != SPI_OK_INSERT)
+		{
+			ereport(ERROR, (errmsg("could not run \"%s\": %s", insertCommand,
+								   SPI_result_code_string(spiResult))));
+		}
+
+		processedRowCount += SPI_processed;
+	}
+
+	/* all lines have been copied, stop showing line number in errors */
+	error_context_stack = errorCallback.previous;
+
+	SPI_finish();
+
+	EndCopyFrom(copyState);
+	FreeExecutorState(executorState);
+
+	return processedRowCount;
+}
+
+
+/*
+ * OnConflictInsertCommand builds the INSERT .. ON CONFLICT command that writes
+ * a single row of a COPY with the given action into the relation. The command
+ * takes a parameter for every column that COPY produces a value for, whose
+ * attribute numbers are returned in parameterAttributeList.
+ */
+static char *
+OnConflictInsertCommand(Relation relation, CopyOnConflictAction action,
+						List **parameterAttributeList)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	char *qualifiedName =
+		quote_qualified_identifier(get_namespace_name(RelationGetNamespace(relation)),
+								   RelationGetRelationName(relation));
+	Bitmapset *primaryKeyAttributes = NULL;
+	Oid primaryKeyConstraintId = InvalidOid;
+	StringInfo columnList = makeStringInfo();
+	StringInfo valueList = makeStringInfo();
+	StringInfo updateList = makeStringInfo();
+
+	if (action == COPY_ON_CONFLICT_DO_UPDATE)
+	{
+		EnsureCopyOnConflictSupported(relation, action);
+
+		primaryKeyConstraintId =
+			get_index_constraint(RelationGetPrimaryKeyIndex(relation));
+
+		primaryKeyAttributes = RelationGetIndexAttrBitmap(relation,
+														  INDEX_ATTR_BITMAP_PRIMARY_KEY);
+	}
+
+	*parameterAttributeList = NIL;
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		const char *columnName = quote_identifier(NameStr(attribute->attname));
+
+		/* COPY computes generated columns after parsing, so let INSERT do it */
+		if (attribute->attisdropped ||
+			attribute->attgenerated == ATTRIBUTE_GENERATED_STORED)
+		{
+			continue;
+		}
+
+		*parameterAttributeList = lappend_int(*parameterAttributeList,
+											  attribute->attnum);
+
+		if (columnList->len > 0)
+		{
+			appendStringInfoString(columnList, ", ");
+			appendStringInfoString(valueList, ", ");
+		}
+
+		appendStringInfoString(columnList, columnName);
+		appendStringInfo(valueList, "$%d", list_length(*parameterAttributeList));
+
+		if (action == COPY_ON_CONFLICT_DO_UPDATE &&
+			!bms_is_member(attribute->attnum - FirstLowInvalidHeapAttributeNumber,
+						   primaryKeyAttributes))
+		{
+			if (updateList->len > 0)
+			{
+				appendStringInfoString(updateList, ", ");
+			}
+
+			appendStringInfo(updateList, "%s = EXCLUDED.%s", columnName, columnName);
+		}
+	}
+
+	/* COPY also writes the values of identity columns that it receives */
+	StringInfo insertCommand = makeStringInfo();
+	appendStringInfo(insertCommand, "INSERT INTO %s (%s) OVERRIDING SYSTEM VALUE "
+									"VALUES (%s) ON CONFLICT ",
+					 qualifiedName, columnList->data, valueList->data);
+
+	if (action == COPY_ON_CONFLICT_DO_UPDATE && updateList->len > 0)
+	{
+		appendStringInfo(insertCommand, "ON CONSTRAINT %s DO UPDATE SET %s",
+						 quote_identifier(get_constraint_name(primaryKeyConstraintId)),
+						 updateList->data);
+	}
+	else
+	{
+		appendStringInfoString(insertCommand, "DO NOTHING");
+	}
+
+	return insertCommand->data;
+}
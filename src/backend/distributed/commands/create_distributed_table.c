@@ -55,6 +55,7 @@
 #include "distributed/multi_executor.h"
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_partitioning_utils.h"
+#include "distributed/parallel_local_table_copy.h"
 #include "distributed/pg_dist_colocation.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/reference_table_utils.h"
@@ -150,6 +151,8 @@ static void DoCopyFromLocalTableIntoShards(Relation distributedRelation,
 										   DestReceiver *copyDest,
 										   TupleTableSlot *slot,
 										   EState *estate);
+static void ReportLocalTableCopyCompleted(Relation distributedRelation,
+										  uint64 rowsCopied);
 static void ErrorIfTemporaryTable(Oid relationId);
 static void ErrorIfForeignTable(Oid relationOid);
 static void SendAddLocalTableToMetadataCommandOutsideTransaction(Oid relationId);
@@ -1318,6 +1321,8 @@ EnsureDistributedSequencesHaveOneType(Oid relationId, List *seqInfoList)
 		{
 			AlterSequenceType(sequenceOid, attributeTypeId);
 		}
+
+		EnsureDistributedSequenceCacheSize(sequenceOid);
 	}
 }
 
@@ -2258,13 +2263,23 @@ DoCopyFromLocalTableIntoShards(Relation distributedRelation,
 							   TupleTableSlot *slot,
 							   EState *estate)
 {
+	uint64 rowsCopied = 0;
+
+	/* large tables can be read by parallel workers */
+	if (ParallelCopyLocalTableIntoShards(distributedRelation,
+										 (CitusCopyDestReceiver *) copyDest,
+										 &rowsCopied))
+	{
+		ReportLocalTableCopyCompleted(distributedRelation, rowsCopied);
+		return;
+	}
+
 	/* begin reading from local table */
 	TableScanDesc scan = table_beginscan(distributedRelation, GetActiveSnapshot(), 0,
 										 NULL);
 
 	MemoryContext oldContext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
 
-	uint64 rowsCopied = 0;
 	while (table_scan_getnextslot(scan, ForwardScanDirection, slot))
 	{
 		/* send tuple it to a shard */
@@ -2289,6 +2304,22 @@ DoCopyFromLocalTableIntoShards(Relation distributedRelation,
 		}
 	}
 
+	ReportLocalTableCopyCompleted(distributedRelation, rowsCopied);
+
+	MemoryContextSwitchTo(oldContext);
+
+	/* finish reading from the local table */
+	table_endscan(scan);
+}
+
+
+/*
+ * ReportLocalTableCopyCompleted logs the number of rows that were copied from
+ * the local table, and tells the user how to remove the local data.
+ */
+static void
+ReportLocalTableCopyCompleted(Relation distributedRelation, uint64 rowsCopied)
+{
 	if (rowsCopied % LOG_PER_TUPLE_AMOUNT != 0)
 	{
 		ereport(DEBUG1, (errmsg("Copied " UINT64_FORMAT " rows", rowsCopied)));
@@ -2305,11 +2336,6 @@ DoCopyFromLocalTableIntoShards(Relation distributedRelation,
 								 "truncate_local_data_after_distributing_table($$%s$$)",
 								 qualifiedRelationName)));
 	}
-
-	MemoryContextSwitchTo(oldContext);
-
-	/* finish reading from the local table */
-	table_endscan(scan);
 }
 
 
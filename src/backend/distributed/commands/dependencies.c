@@ -36,7 +36,7 @@ static void ErrorIfCircularDependencyExists(const ObjectAddress *objectAddress);
 static int ObjectAddressComparator(const void *a, const void *b);
 static List * FilterObjectAddressListByPredicate(List *objectAddressList,
 												 AddressPredicate predicate);
-static void EnsureDependenciesExistOnAllNodes(const ObjectAddress *target);
+static void EnsureDependenciesExistOnAllNodes(const List *targets);
 static List * GetDependencyCreateDDLCommands(const ObjectAddress *dependency);
 static bool ShouldPropagateObject(const ObjectAddress *address);
 
@@ -55,7 +55,7 @@ static bool ShouldPropagateObject(const ObjectAddress *address);
  * postgres native CREATE IF NOT EXISTS, or citus helper functions.
  */
 static void
-EnsureDependenciesExistOnAllNodes(const ObjectAddress *target)
+EnsureDependenciesExistOnAllNodes(const List *targets)
 {
 	List *dependenciesWithCommands = NIL;
 	List *ddlCommands = NULL;
@@ -64,10 +64,18 @@ EnsureDependenciesExistOnAllNodes(const ObjectAddress *target)
 	 * If there is any unsupported dependency or circular dependency exists, Citus can
 	 * not ensure dependencies will exist on all nodes.
 	 */
-	EnsureDependenciesCanBeDistributed(target);
+	ObjectAddress *target = NULL;
+	foreach_ptr(target, targets)
+	{
+		EnsureDependenciesCanBeDistributed(target);
+	}
 
-	/* collect all dependencies in creation order and get their ddl commands */
-	List *dependencies = GetDependenciesForObject(target);
+	/*
+	 * Collect all dependencies in creation order and get their ddl commands. The
+	 * dependencies of all targets are resolved in one traversal, such that shared
+	 * dependencies are visited and created only once.
+	 */
+	List *dependencies = GetDependenciesForObjectList(targets);
 	ObjectAddress *dependency = NULL;
 	foreach_ptr(dependency, dependencies)
 	{
@@ -146,17 +154,18 @@ EnsureDependenciesExistOnAllNodes(const ObjectAddress *target)
 
 
 /*
- * EnsureAllObjectDependenciesExistOnAllNodes iteratively calls EnsureDependenciesExistOnAllNodes
+ * EnsureAllObjectDependenciesExistOnAllNodes calls EnsureDependenciesExistOnAllNodes
  * for given targets.
  */
 void
 EnsureAllObjectDependenciesExistOnAllNodes(const List *targets)
 {
-	ObjectAddress *target = NULL;
-	foreach_ptr(target, targets)
+	if (list_length(targets) == 0)
 	{
-		EnsureDependenciesExistOnAllNodes(target);
+		return;
 	}
+
+	EnsureDependenciesExistOnAllNodes(targets);
 }
 
 
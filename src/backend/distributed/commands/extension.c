@@ -669,11 +669,15 @@ GetAllViews(void)
 
 /*
  * PreprocessAlterExtensionContentsStmt issues a notice. It does not propagate.
+ * It also resets the dependency cache, since membership changes come without
+ * an invalidation of the member objects.
  */
 List *
 PreprocessAlterExtensionContentsStmt(Node *node, const char *queryString,
 									 ProcessUtilityContext processUtilityContext)
 {
+	ResetDependencyCache();
+
 	ereport(NOTICE, (errmsg(
 						 "Citus does not propagate adding/dropping member objects"),
 					 errhint(
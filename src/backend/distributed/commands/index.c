@@ -483,6 +483,7 @@ GenerateCreateIndexDDLJob(IndexStmt *createIndexStatement, const char *createInd
 					 CreateIndexStmtGetRelationId(createIndexStatement));
 	ddlJob->startNewTransaction = createIndexStatement->concurrent;
 	ddlJob->metadataSyncCommand = createIndexCommand;
+	ddlJob->buildsIndexes = true;
 	ddlJob->taskList = CreateIndexTaskList(createIndexStatement);
 
 	return ddlJob;
@@ -642,6 +643,7 @@ PreprocessReindexStmt(Node *node, const char *reindexCommand,
 			ddlJob->startNewTransaction = IsReindexWithParam_compat(reindexStatement,
 																	"concurrently");
 			ddlJob->metadataSyncCommand = reindexCommand;
+			ddlJob->buildsIndexes = true;
 			ddlJob->taskList = CreateReindexTaskList(relationId, reindexStatement);
 
 			ddlJobs = list_make1(ddlJob);
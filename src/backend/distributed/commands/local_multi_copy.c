@@ -13,6 +13,12 @@
  * even if user did not do a copy with binary format, it is possible that
  * we are going to be using binary format internally.
  *
+ * When citus.enable_local_copy_multi_insert is enabled, shards that do not
+ * need the full COPY machinery (triggers, defaults, generated columns) skip
+ * the serialization altogether: the slots are batched and written with
+ * table_multi_insert, while constraints and indexes are maintained the same
+ * way CopyFrom does.
+ *
  *
  * Copyright (c) Citus Data, Inc.
  *
@@ -20,26 +26,62 @@
  */
 
 #include "postgres.h"
+#include "access/heapam.h"
+#include "access/tableam.h"
 #include "commands/copy.h"
 #include "catalog/namespace.h"
+#include "executor/executor.h"
 #include "parser/parse_relation.h"
 #include "utils/lsyscache.h"
+#include "utils/rls.h"
 #include "nodes/makefuncs.h"
 #include "safe_lib.h"
 #include <netinet/in.h> /* for htons */
 
 #include "distributed/transmit.h"
 #include "distributed/commands/multi_copy.h"
+#include "distributed/copy_on_conflict.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/multi_partitioning_utils.h"
 #include "distributed/local_executor.h"
 #include "distributed/local_multi_copy.h"
+#include "distributed/query_result_cache.h"
 #include "distributed/shard_utils.h"
 #include "distributed/version_compat.h"
 
 /* managed via GUC, default is 512 kB */
 int LocalCopyFlushThresholdByte = 512 * 1024;
 
+/* GUC, whether local placements are written with table_multi_insert */
+bool EnableLocalCopyMultiInsert = false;
+
+/* maximum number of slots buffered for a local multi-insert, like CopyFrom */
+#define MAX_LOCAL_MULTI_INSERT_SLOTS 1000
+
+
+/*
+ * LocalMultiInsertState holds the slots buffered for a local shard placement
+ * and the executor state that is needed to write them.
+ */
+struct LocalMultiInsertState
+{
+	Relation shard;
+	EState *estate;
+	ResultRelInfo *resultRelInfo;
+	BulkInsertState bulkInsertState;
+	CommandId commandId;
+
+	/* shard attribute number of each input column, or 0 for skipped columns */
+	AttrNumber *shardAttributeNumbers;
+
+	TupleTableSlot **slots;
+	int slotCount;
+	Size bufferedBytes;
+
+	/* number of the row being written since the last flush, for errors */
+	uint64 currentRow;
+};
+
 
 static void AddSlotToBuffer(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest,
 							CopyOutState localCopyOutState);
@@ -48,6 +90,10 @@ static bool ShouldSendCopyNow(StringInfo buffer);
 static void DoLocalCopy(StringInfo buffer, Oid relationId, int64 shardId,
 						CopyStmt *copyStatement, bool isEndOfCopy);
 static int ReadFromLocalBufferCallback(void *outBuf, int minRead, int maxRead);
+static AttrNumber * LocalMultiInsertAttributeNumbers(Relation shard,
+													 CitusCopyDestReceiver *copyDest);
+static void FlushLocalMultiInsert(LocalMultiInsertState *multiInsertState);
+static void LocalMultiInsertErrorCallback(void *arg);
 
 
 /*
@@ -157,6 +203,352 @@ FinishLocalCopyToFile(CopyOutState localFileCopyOutState, FileCompat *fileCompat
 }
 
 
+/*
+ * StartLocalMultiInsert prepares writing the tuples of the given shard into its
+ * local placement with table_multi_insert. It returns NULL when the shard
+ * needs the full COPY machinery, in which case the caller falls back to
+ * WriteTupleToLocalShard.
+ */
+LocalMultiInsertState *
+StartLocalMultiInsert(CitusCopyDestReceiver *copyDest, int64 shardId)
+{
+	Oid shardOid = GetTableLocalShardOid(copyDest->distributedRelationId, shardId);
+	Relation shard = table_open(shardOid, RowExclusiveLock);
+
+	/* cached query results that read the shard become stale on commit */
+	RecordShardModification(shardId);
+
+	AttrNumber *shardAttributeNumbers = LocalMultiInsertAttributeNumbers(shard,
+																		  copyDest);
+	if (shardAttributeNumbers == NULL)
+	{
+		/* keep the lock until the end of the transaction, like DoLocalCopy */
+		table_close(shard, NoLock);
+		return NULL;
+	}
+
+	EState *estate = CreateExecutorState();
+
+	RangeTblEntry *rangeTableEntry = makeNode(RangeTblEntry);
+	rangeTableEntry->rtekind = RTE_RELATION;
+	rangeTableEntry->relid = shardOid;
+	rangeTableEntry->relkind = shard->rd_rel->relkind;
+	rangeTableEntry->rellockmode = RowExclusiveLock;
+	ExecInitRangeTable(estate, list_make1(rangeTableEntry));
+
+	ResultRelInfo *resultRelInfo = makeNode(ResultRelInfo);
+	InitResultRelInfo(resultRelInfo, shard, 1, NULL, 0);
+
+#if PG_VERSION_NUM < PG_VERSION_14
+	estate->es_result_relations = resultRelInfo;
+	estate->es_num_result_relations = 1;
+	estate->es_result_relation_info = resultRelInfo;
+#endif
+
+	ExecOpenIndices(resultRelInfo, false);
+
+	LocalMultiInsertState *multiInsertState = palloc0(sizeof(LocalMultiInsertState));
+	multiInsertState->shard = shard;
+	multiInsertState->estate = estate;
+	multiInsertState->resultRelInfo = resultRelInfo;
+	multiInsertState->bulkInsertState = GetBulkInsertState();
+	multiInsertState->commandId = GetCurrentCommandId(true);
+	multiInsertState->shardAttributeNumbers = shardAttributeNumbers;
+	multiInsertState->slots =
+		palloc0(MAX_LOCAL_MULTI_INSERT_SLOTS * sizeof(TupleTableSlot *));
+
+	estate->es_output_cid = multiInsertState->commandId;
+
+	return multiInsertState;
+}
+
+
+/*
+ * LocalMultiInsertAttributeNumbers returns the attribute number in the shard
+ * of each column of the tuples that the COPY receives, or NULL if the shard
+ * cannot be written with table_multi_insert.
+ *
+ * That is the case when the shard has triggers, which includes foreign keys
+ * and deferrable constraints, generated columns, row level security, or
+ * columns that are not part of the COPY and therefore need their defaults.
+ */
+static AttrNumber *
+LocalMultiInsertAttributeNumbers(Relation shard, CitusCopyDestReceiver *copyDest)
+{
+	TupleDesc shardTupleDescriptor = RelationGetDescr(shard);
+	TupleDesc inputTupleDescriptor = copyDest->tupleDescriptor;
+
+	if (shard->rd_rel->relkind != RELKIND_RELATION ||
+		shard->trigdesc != NULL ||
+		(shardTupleDescriptor->constr != NULL &&
+		 shardTupleDescriptor->constr->has_generated_stored) ||
+		check_enable_rls(RelationGetRelid(shard), InvalidOid, true) == RLS_ENABLED)
+	{
+		return NULL;
+	}
+
+	int shardColumnCount = 0;
+	for (int attributeIndex = 0; attributeIndex < shardTupleDescriptor->natts;
+		 attributeIndex++)
+	{
+		if (!TupleDescAttr(shardTupleDescriptor, attributeIndex)->attisdropped)
+		{
+			shardColumnCount++;
+		}
+	}
+
+	AttrNumber *shardAttributeNumbers =
+		palloc0(inputTupleDescriptor->natts * sizeof(AttrNumber));
+	bool *shardAttributeSeen = palloc0(shardTupleDescriptor->natts * sizeof(bool));
+	ListCell *columnNameCell = list_head(copyDest->columnNameList);
+	int inputColumnCount = 0;
+
+	for (int columnIndex = 0; columnIndex < inputTupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute inputColumn = TupleDescAttr(inputTupleDescriptor, columnIndex);
+
+		/* skip the same columns as AppendCopyRowData */
+		if (inputColumn->attisdropped ||
+			inputColumn->attgenerated == ATTRIBUTE_GENERATED_STORED)
+		{
+			continue;
+		}
+
+		if (columnNameCell == NULL)
+		{
+			return NULL;
+		}
+
+		char *columnName = lfirst(columnNameCell);
+		columnNameCell = lnext(copyDest->columnNameList, columnNameCell);
+
+		AttrNumber shardAttributeNumber = get_attnum(RelationGetRelid(shard),
+													 columnName);
+		if (shardAttributeNumber <= 0 ||
+			shardAttributeSeen[shardAttributeNumber - 1])
+		{
+			return NULL;
+		}
+
+		shardAttributeNumbers[columnIndex] = shardAttributeNumber;
+		shardAttributeSeen[shardAttributeNumber - 1] = true;
+		inputColumnCount++;
+	}
+
+	if (inputColumnCount != shardColumnCount)
+	{
+		return NULL;
+	}
+
+	return shardAttributeNumbers;
+}
+
+
+/*
+ * WriteTupleToLocalMultiInsert adds the given slot, coerced to the types of
+ * the shard, to the multi-insert buffer and writes the buffer when it is full.
+ */
+void
+WriteTupleToLocalMultiInsert(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest,
+							 LocalMultiInsertState *multiInsertState)
+{
+	/* see WriteTupleToLocalShard */
+	SetLocalExecutionStatus(LOCAL_EXECUTION_REQUIRED);
+
+	Relation shard = multiInsertState->shard;
+	TupleDesc inputTupleDescriptor = copyDest->tupleDescriptor;
+	TupleDesc shardTupleDescriptor = RelationGetDescr(shard);
+	CopyCoercionData *columnCoercionPaths = copyDest->columnCoercionPaths;
+	int slotIndex = multiInsertState->slotCount;
+
+	if (multiInsertState->slots[slotIndex] == NULL)
+	{
+		multiInsertState->slots[slotIndex] =
+			MakeSingleTupleTableSlot(shardTupleDescriptor, table_slot_callbacks(shard));
+	}
+
+	TupleTableSlot *shardSlot = multiInsertState->slots[slotIndex];
+
+	ExecClearTuple(shardSlot);
+
+	/* columns that are not part of the input are dropped columns */
+	memset(shardSlot->tts_isnull, true, shardTupleDescriptor->natts * sizeof(bool));
+
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(GetPerTupleMemoryContext(copyDest->executorState));
+
+	for (int columnIndex = 0; columnIndex < inputTupleDescriptor->natts; columnIndex++)
+	{
+		AttrNumber shardAttributeNumber =
+			multiInsertState->shardAttributeNumbers[columnIndex];
+		if (shardAttributeNumber == 0)
+		{
+			continue;
+		}
+
+		Datum value = slot->tts_values[columnIndex];
+		bool isNull = slot->tts_isnull[columnIndex];
+
+		if (!isNull && columnCoercionPaths != NULL)
+		{
+			value = CoerceColumnValue(value, &columnCoercionPaths[columnIndex]);
+		}
+
+		shardSlot->tts_values[shardAttributeNumber - 1] = value;
+		shardSlot->tts_isnull[shardAttributeNumber - 1] = isNull;
+
+		if (!isNull)
+		{
+			Form_pg_attribute shardAttribute =
+				TupleDescAttr(shardTupleDescriptor, shardAttributeNumber - 1);
+
+			multiInsertState->bufferedBytes +=
+				att_addlength_datum(0, shardAttribute->attlen, value);
+		}
+	}
+
+	ExecStoreVirtualTuple(shardSlot);
+
+	/* copy the values into the slot, they are freed with the input tuple */
+	ExecMaterializeSlot(shardSlot);
+
+	MemoryContextSwitchTo(oldContext);
+
+	ErrorContextCallback errorCallback;
+	errorCallback.callback = LocalMultiInsertErrorCallback;
+	errorCallback.arg = (void *) multiInsertState;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	multiInsertState->currentRow = slotIndex + 1;
+
+	EState *estate = multiInsertState->estate;
+	ResultRelInfo *resultRelInfo = multiInsertState->resultRelInfo;
+
+	if (shardTupleDescriptor->constr != NULL)
+	{
+		ExecConstraints(resultRelInfo, shardSlot, estate);
+	}
+
+	if (shard->rd_rel->relispartition)
+	{
+		ExecPartitionCheck(resultRelInfo, shardSlot, estate, true);
+	}
+
+	error_context_stack = errorCallback.previous;
+
+	ResetPerTupleExprContext(estate);
+
+	multiInsertState->slotCount++;
+
+	if (multiInsertState->slotCount == MAX_LOCAL_MULTI_INSERT_SLOTS ||
+		multiInsertState->bufferedBytes > LocalCopyFlushThresholdByte)
+	{
+		FlushLocalMultiInsert(multiInsertState);
+	}
+}
+
+
+/*
+ * FlushLocalMultiInsert writes the buffered slots into the shard and inserts
+ * their index entries.
+ */
+static void
+FlushLocalMultiInsert(LocalMultiInsertState *multiInsertState)
+{
+	int slotCount = multiInsertState->slotCount;
+	if (slotCount == 0)
+	{
+		return;
+	}
+
+	EState *estate = multiInsertState->estate;
+	ResultRelInfo *resultRelInfo = multiInsertState->resultRelInfo;
+	TupleTableSlot **slots = multiInsertState->slots;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
+
+	table_multi_insert(multiInsertState->shard, slots, slotCount,
+					   multiInsertState->commandId, 0,
+					   multiInsertState->bulkInsertState);
+
+	ErrorContextCallback errorCallback;
+	errorCallback.callback = LocalMultiInsertErrorCallback;
+	errorCallback.arg = (void *) multiInsertState;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	for (int slotIndex = 0; slotIndex < slotCount; slotIndex++)
+	{
+		multiInsertState->currentRow = slotIndex + 1;
+
+		if (resultRelInfo->ri_NumIndices > 0)
+		{
+			/* deferrable constraints have triggers, so there is nothing to recheck */
+			List *recheckIndexes =
+				ExecInsertIndexTuples_compat(resultRelInfo, slots[slotIndex], estate,
+											 false, false, NULL, NIL);
+			list_free(recheckIndexes);
+		}
+
+		ExecClearTuple(slots[slotIndex]);
+	}
+
+	error_context_stack = errorCallback.previous;
+
+	MemoryContextSwitchTo(oldContext);
+	ResetPerTupleExprContext(estate);
+
+	multiInsertState->slotCount = 0;
+	multiInsertState->bufferedBytes = 0;
+}
+
+
+/*
+ * FinishLocalMultiInsert writes the remaining slots into the shard and
+ * releases the resources of the multi-insert.
+ */
+void
+FinishLocalMultiInsert(LocalMultiInsertState *multiInsertState)
+{
+	FlushLocalMultiInsert(multiInsertState);
+
+	for (int slotIndex = 0; slotIndex < MAX_LOCAL_MULTI_INSERT_SLOTS; slotIndex++)
+	{
+		if (multiInsertState->slots[slotIndex] != NULL)
+		{
+			ExecDropSingleTupleTableSlot(multiInsertState->slots[slotIndex]);
+		}
+	}
+
+	FreeBulkInsertState(multiInsertState->bulkInsertState);
+	table_finish_bulk_insert(multiInsertState->shard, 0);
+
+	ExecCloseIndices(multiInsertState->resultRelInfo);
+#if PG_VERSION_NUM < PG_VERSION_14
+	ExecCleanUpTriggerState(multiInsertState->estate);
+#endif
+	FreeExecutorState(multiInsertState->estate);
+
+	table_close(multiInsertState->shard, NoLock);
+}
+
+
+/*
+ * LocalMultiInsertErrorCallback adds the same context to errors as COPY into
+ * the shard would, see CopyFromErrorCallback.
+ */
+static void
+LocalMultiInsertErrorCallback(void *arg)
+{
+	LocalMultiInsertState *multiInsertState = (LocalMultiInsertState *) arg;
+
+	errcontext("COPY %s, line " UINT64_FORMAT,
+			   RelationGetRelationName(multiInsertState->shard),
+			   multiInsertState->currentRow);
+}
+
+
 /*
  * AddSlotToBuffer serializes the given slot and adds it to
  * the buffer in localCopyOutState.
@@ -206,17 +598,32 @@ DoLocalCopy(StringInfo buffer, Oid relationId, int64 shardId, CopyStmt *copyStat
 	 */
 	LocalCopyBuffer = buffer;
 
+	/* cached query results that read the shard become stale on commit */
+	RecordShardModification(shardId);
+
 	Oid shardOid = GetTableLocalShardOid(relationId, shardId);
 	Relation shard = table_open(shardOid, RowExclusiveLock);
 	ParseState *pState = make_parsestate(NULL);
 	(void) addRangeTableEntryForRelation(pState, shard, AccessShareLock,
 										 NULL, false, false);
-	CopyFromState cstate = BeginCopyFrom_compat(pState, shard, NULL, NULL, false,
-												ReadFromLocalBufferCallback,
-												copyStatement->attlist,
-												copyStatement->options);
-	CopyFrom(cstate);
-	EndCopyFrom(cstate);
+
+	/* upserts go through INSERT .. ON CONFLICT, like on remote placements */
+	List *copyOptions = copyStatement->options;
+	CopyOnConflictAction onConflictAction = ExtractCopyOnConflictOption(&copyOptions);
+	if (onConflictAction != COPY_ON_CONFLICT_NONE)
+	{
+		CopyFromWithOnConflict(shard, pState, ReadFromLocalBufferCallback,
+							   copyStatement->attlist, copyOptions, onConflictAction);
+	}
+	else
+	{
+		CopyFromState cstate = BeginCopyFrom_compat(pState, shard, NULL, NULL, false,
+													ReadFromLocalBufferCallback,
+													copyStatement->attlist,
+													copyOptions);
+		CopyFrom(cstate);
+		EndCopyFrom(cstate);
+	}
 
 	table_close(shard, NoLock);
 	free_parsestate(pState);
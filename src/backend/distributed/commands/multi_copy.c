@@ -62,12 +62,18 @@
 #include "catalog/namespace.h"
 #include "catalog/pg_attribute.h"
 #include "catalog/pg_type.h"
+#include "common/hashfn.h"
 #include "commands/copy.h"
 #include "commands/defrem.h"
 #include "commands/progress.h"
+#include "distributed/binary_copy_passthrough.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/commands/utility_hook.h"
+#include "distributed/compressed_copy.h"
+#include "distributed/copy_on_conflict.h"
+#include "distributed/distributed_command_progress.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
@@ -76,6 +82,7 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_partitioning_utils.h"
+#include "distributed/parallel_multi_copy.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_executor.h"
@@ -102,11 +109,14 @@
 #include "nodes/nodeFuncs.h"
 #include "parser/parse_func.h"
 #include "parser/parse_type.h"
+#include "storage/latch.h"
 #include "tcop/cmdtag.h"
 #include "tsearch/ts_locale.h"
 #include "utils/builtins.h"
+#include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
+#include "utils/inval.h"
 #include "utils/syscache.h"
 #include "utils/memutils.h"
 
@@ -117,6 +127,12 @@ static const char BinarySignature[11] = "PGCOPY\n\377\r\n\0";
 /* if true, skip validation of JSONB columns during COPY */
 bool SkipJsonbValidationInCopy = true;
 
+/* GUC, if true, COPY .. TO exports multiple shards at once */
+bool EnableParallelCopyTo = false;
+
+/* GUC, if true, the functions used to serialize rows are cached per session */
+bool EnableCopySerializationCache = false;
+
 /* custom Citus option for appending to a shard */
 #define APPEND_TO_SHARD_OPTION "append_to_shard"
 
@@ -129,6 +145,9 @@ bool SkipJsonbValidationInCopy = true;
  */
 int CopySwitchOverThresholdBytes = 4 * 1024 * 1024;
 
+/* session-level cache of serialization functions, see CopySerializationCacheEntry */
+static HTAB *CopySerializationCache = NULL;
+
 #define FILE_IS_OPEN(x) (x > -1)
 
 typedef struct CopyShardState CopyShardState;
@@ -174,6 +193,13 @@ typedef struct CopyConnectionState
 
 	/* length of bufferedPlacementList, to avoid iterations over the list when needed */
 	int bufferedPlacementCount;
+
+	/*
+	 * Method with which the active COPY on the connection is compressed, and
+	 * the COPY data that was not compressed and sent yet.
+	 */
+	IntermediateResultCompressionType compressionType;
+	StringInfo compressionBuffer;
 } CopyConnectionState;
 
 
@@ -213,11 +239,38 @@ struct CopyShardState
 	/* containsLocalPlacement is true if we have a local placement for the shard id of this state */
 	bool containsLocalPlacement;
 
+	/* used when the local placement is written with table_multi_insert */
+	LocalMultiInsertState *localMultiInsertState;
+
 	/* List of CopyPlacementStates for all active placements of the shard. */
 	List *placementStateList;
 };
 
 
+/*
+ * CopySerializationCacheEntry keeps the functions with which the rows of a
+ * COPY into a distributed table were serialized, such that later COPY
+ * commands with the same columns in the session do not look them up again.
+ */
+typedef struct CopySerializationCacheEntry
+{
+	/* distributed table the functions were looked up for */
+	Oid relationId;
+
+	/* memory context that holds the functions, NULL until they are filled in */
+	MemoryContext memoryContext;
+
+	/* input columns and format for which the functions were looked up */
+	bool binaryFormat;
+	int columnCount;
+	Oid *inputTypeArray;
+	List *columnNameList;
+
+	CopyCoercionData *columnCoercionPaths;
+	FmgrInfo *columnOutputFunctions;
+} CopySerializationCacheEntry;
+
+
 /*
  * Represents the state for allowing copy via local
  * execution.
@@ -240,11 +293,13 @@ static List * RemoveOptionFromList(List *optionList, char *optionName);
 static bool BinaryOutputFunctionDefined(Oid typeId);
 static bool BinaryInputFunctionDefined(Oid typeId);
 static void SendCopyBinaryHeaders(CopyOutState copyOutState, int64 shardId,
-								  List *connectionList);
+								  CopyConnectionState *connectionState);
 static void SendCopyBinaryFooters(CopyOutState copyOutState, int64 shardId,
-								  List *connectionList);
+								  CopyConnectionState *connectionState);
 static StringInfo ConstructCopyStatement(CopyStmt *copyStatement, int64 shardId);
-static void SendCopyDataToAll(StringInfo dataBuffer, int64 shardId, List *connectionList);
+static void SendCopyDataToConnection(StringInfo dataBuffer, int64 shardId,
+									 CopyConnectionState *connectionState);
+static void FlushCompressedCopyData(int64 shardId, CopyConnectionState *connectionState);
 static void SendCopyDataToPlacement(StringInfo dataBuffer, int64 shardId,
 									MultiConnection *connection);
 static uint32 AvailableColumnCount(TupleDesc tupleDescriptor);
@@ -257,11 +312,31 @@ static CopyCoercionData * ColumnCoercionPaths(TupleDesc destTupleDescriptor,
 											  Oid *finalColumnTypeArray);
 static FmgrInfo * TypeOutputFunctions(uint32 columnCount, Oid *typeIdArray,
 									  bool binaryFormat);
+static void LookupCopySerializationFunctions(CitusCopyDestReceiver *copyDest,
+											 TupleDesc destTupleDescriptor,
+											 TupleDesc inputTupleDescriptor,
+											 bool binaryFormat);
+static CopySerializationCacheEntry * CopySerializationCacheLookup(Oid relationId);
+static bool CopySerializationEntryMatches(CopySerializationCacheEntry *entry,
+										  bool binaryFormat, int columnCount,
+										  Oid *inputTypeArray, List *columnNameList);
+static void FillCopySerializationEntry(CopySerializationCacheEntry *entry,
+									   TupleDesc destTupleDescriptor,
+									   TupleDesc inputTupleDescriptor,
+									   List *columnNameList, bool binaryFormat);
+static void ResetCopySerializationEntry(CopySerializationCacheEntry *entry);
+static void CopyFunctionInfo(FmgrInfo *target, FmgrInfo *source);
+static void InvalidateCopySerializationCacheCallback(Datum argument, Oid relationId);
+static void InvalidateCopySerializationCacheSyscacheCallback(Datum argument,
+															 int cacheId,
+															 uint32 hashValue);
 #if PG_VERSION_NUM < PG_VERSION_14
 static List * CopyGetAttnums(TupleDesc tupDesc, Relation rel, List *attnamelist);
 #endif
 static bool CopyStatementHasFormat(CopyStmt *copyStatement, char *formatName);
 static void CitusCopyFrom(CopyStmt *copyStatement, QueryCompletion *completionTag);
+static uint64 CopyRowsFromInput(CopyStmt *copyStatement, Relation distributedRelation,
+								CitusCopyDestReceiver *copyDest);
 static void EnsureCopyCanRunOnRelation(Oid relationId);
 static HTAB * CreateConnectionStateHash(MemoryContext memoryContext);
 static HTAB * CreateShardStateHash(MemoryContext memoryContext);
@@ -296,6 +371,22 @@ static void ShutdownCopyConnectionState(CopyConnectionState *connectionState,
 										CitusCopyDestReceiver *copyDest);
 static SelectStmt * CitusCopySelect(CopyStmt *copyStatement);
 static void CitusCopyTo(CopyStmt *copyStatement, QueryCompletion *completionTag);
+static bool CopyStatementHasHeader(CopyStmt *copyStatement);
+static MultiConnection * StartCopyToShard(CopyStmt *copyStatement,
+										  ShardInterval *shardInterval,
+										  int connectionFlags);
+static MultiConnection * StartParallelCopyToShard(CopyStmt *copyStatement,
+												  ShardInterval *shardInterval,
+												  CopyOutState copyOutState,
+												  List **activeConnectionList,
+												  int64 *tuplesSent);
+static int ActiveCopyToConnectionCount(List *activeConnectionList, char *nodeName,
+									   int nodePort);
+static int64 ForwardCopyDataFromActiveConnections(CopyOutState copyOutState,
+												  List **activeConnectionList);
+static int64 ForwardAvailableCopyData(CopyOutState copyOutState,
+									  MultiConnection *connection, bool *copyDone);
+static void WaitForCopyToConnections(List *connectionList);
 static int64 ForwardCopyDataFromConnection(CopyOutState copyOutState,
 										   MultiConnection *connection);
 
@@ -312,6 +403,15 @@ static void CopyAttributeOutText(CopyOutState outputState, char *string);
 static inline void CopyFlushOutput(CopyOutState outputState, char *start, char *pointer);
 static bool CitusSendTupleToPlacements(TupleTableSlot *slot,
 									   CitusCopyDestReceiver *copyDest);
+static CopyShardState * GetCopyDestShardState(CitusCopyDestReceiver *copyDest,
+											  uint64 shardId, bool *firstTupleInShard);
+static void SendCopyRowToPlacements(CitusCopyDestReceiver *copyDest,
+									CopyShardState *shardState, uint64 shardId,
+									Datum *columnValues, bool *columnNulls,
+									StringInfo serializedRow);
+static CopyHashMethod CopyPartitionHashMethod(CitusTableCacheEntry *cacheEntry);
+static inline int32 HashPartitionColumnValue(CopyHashMethod hashMethod,
+											 Datum partitionColumnValue);
 static void AddPlacementStateToCopyConnectionStateBuffer(CopyConnectionState *
 														 connectionState,
 														 CopyPlacementState *
@@ -321,8 +421,6 @@ static void RemovePlacementStateFromCopyConnectionStateBuffer(CopyConnectionStat
 															  CopyPlacementState *
 															  placementState);
 static uint64 ProcessAppendToShardOption(Oid relationId, CopyStmt *copyStatement);
-static uint64 ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues,
-							  bool *columnNulls);
 
 /* CitusCopyDestReceiver functions */
 static void CitusCopyDestReceiverStartup(DestReceiver *copyDest, int operation,
@@ -445,24 +543,11 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 	List *columnNameList = NIL;
 	int partitionColumnIndex = INVALID_PARTITION_COLUMN_INDEX;
 
-	bool isInputFormatBinary = IsCopyInBinaryFormat(copyStatement);
 	uint64 processedRowCount = 0;
 
-	ErrorContextCallback errorCallback;
-
-	/* allocate column values and nulls arrays */
 	Relation distributedRelation = table_open(tableId, RowExclusiveLock);
 	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
 	uint32 columnCount = tupleDescriptor->natts;
-	Datum *columnValues = palloc0(columnCount * sizeof(Datum));
-	bool *columnNulls = palloc0(columnCount * sizeof(bool));
-
-	/* set up a virtual tuple table slot */
-	TupleTableSlot *tupleTableSlot = MakeSingleTupleTableSlot(tupleDescriptor,
-															  &TTSOpsVirtual);
-	tupleTableSlot->tts_nvalid = columnCount;
-	tupleTableSlot->tts_values = columnValues;
-	tupleTableSlot->tts_isnull = columnNulls;
 
 	/* determine the partition column index in the tuple descriptor */
 	Var *partitionColumn = PartitionColumn(tableId, 0);
@@ -488,8 +573,6 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 	}
 
 	EState *executorState = CreateExecutorState();
-	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
-	ExprContext *executorExpressionContext = GetPerTupleExprContext(executorState);
 
 	/* set up the destination for the COPY */
 	CitusCopyDestReceiver *copyDest = CreateCitusCopyDestReceiver(tableId, columnNameList,
@@ -503,9 +586,144 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 		copyDest->appendShardId = appendShardId;
 	}
 
+	/* let the shards skip or update rows that conflict with existing rows */
+	copyDest->onConflictAction = ExtractCopyOnConflictOption(&copyStatement->options);
+	EnsureCopyOnConflictSupported(distributedRelation, copyDest->onConflictAction);
+
 	DestReceiver *dest = (DestReceiver *) copyDest;
 	dest->rStartup(dest, 0, tupleDescriptor);
 
+	/*
+	 * Forward binary rows as they are, or parse the input in background
+	 * workers when possible. Otherwise parse it in this backend.
+	 */
+	if (BinaryCopyPassthroughToExistingShards(copyStatement, distributedRelation,
+											  copyDest, &processedRowCount))
+	{
+		/* rows were forwarded without deserializing them */
+	}
+	else if (!ParallelCopyToExistingShards(copyStatement, copyDest, &processedRowCount))
+	{
+		processedRowCount = CopyRowsFromInput(copyStatement, distributedRelation,
+											  copyDest);
+	}
+
+	/* finish the COPY commands */
+	dest->rShutdown(dest);
+	dest->rDestroy(dest);
+
+	FreeExecutorState(executorState);
+	table_close(distributedRelation, NoLock);
+
+	CHECK_FOR_INTERRUPTS();
+
+	if (completionTag != NULL)
+	{
+		CompleteCopyQueryTagCompat(completionTag, processedRowCount);
+	}
+}
+
+
+/*
+ * CopyRowsFromInput parses the input of the given COPY statement in the
+ * current backend and sends the rows to the (already started) destination.
+ * It returns the number of rows that were read.
+ */
+static uint64
+CopyRowsFromInput(CopyStmt *copyStatement, Relation distributedRelation,
+				  CitusCopyDestReceiver *copyDest)
+{
+	DestReceiver *dest = (DestReceiver *) copyDest;
+	EState *executorState = copyDest->executorState;
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	ExprContext *executorExpressionContext = GetPerTupleExprContext(executorState);
+	uint64 processedRowCount = 0;
+
+	ErrorContextCallback errorCallback;
+
+	/* allocate column values and nulls arrays */
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+	uint32 columnCount = tupleDescriptor->natts;
+	Datum *columnValues = palloc0(columnCount * sizeof(Datum));
+	bool *columnNulls = palloc0(columnCount * sizeof(bool));
+
+	/* set up a virtual tuple table slot */
+	TupleTableSlot *tupleTableSlot = MakeSingleTupleTableSlot(tupleDescriptor,
+															  &TTSOpsVirtual);
+	tupleTableSlot->tts_nvalid = columnCount;
+	tupleTableSlot->tts_values = columnValues;
+	tupleTableSlot->tts_isnull = columnNulls;
+
+	/* initialize copy state to read from COPY data source */
+	CopyFromState copyState = BeginCopyFromDistributedRelation(copyStatement,
+															   distributedRelation,
+															   copyDest, NULL);
+
+	/* set up callback to identify error line number */
+	errorCallback.callback = CopyFromErrorCallback;
+	errorCallback.arg = (void *) copyState;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	while (true)
+	{
+		ResetPerTupleExprContext(executorState);
+
+		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+		/* parse a row from the input */
+		bool nextRowFound = NextCopyFrom(copyState, executorExpressionContext,
+										 columnValues, columnNulls);
+
+		if (!nextRowFound)
+		{
+			MemoryContextSwitchTo(oldContext);
+			break;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		MemoryContextSwitchTo(oldContext);
+
+		dest->receiveSlot(tupleTableSlot, dest);
+
+		++processedRowCount;
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+		pgstat_progress_update_param(PROGRESS_COPY_TUPLES_PROCESSED, processedRowCount);
+#endif
+	}
+
+	EndCopyFrom(copyState);
+
+	/* all lines have been copied, stop showing line number in errors */
+	error_context_stack = errorCallback.previous;
+
+	ExecDropSingleTupleTableSlot(tupleTableSlot);
+
+	return processedRowCount;
+}
+
+
+/*
+ * BeginCopyFromDistributedRelation starts parsing the input of a COPY into
+ * the given distributed relation, using the options of the COPY statement.
+ * The input comes from the file, program or client named by the statement,
+ * unless a data source callback is given. The column output functions of
+ * the destination receiver may be changed to skip JSONB validation, so the
+ * receiver should have been set up for serialization.
+ */
+CopyFromState
+BeginCopyFromDistributedRelation(CopyStmt *copyStatement,
+								 Relation distributedRelation,
+								 CitusCopyDestReceiver *copyDest,
+								 copy_data_source_cb dataSourceCallback)
+{
+	Oid tableId = RelationGetRelid(distributedRelation);
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+	int partitionColumnIndex = copyDest->partitionColumnIndex;
+	bool isInputFormatBinary = IsCopyInBinaryFormat(copyStatement);
+
 	/*
 	 * Below, we change a few fields in the Relation to control the behaviour
 	 * of BeginCopyFrom. However, we obviously should not do this in relcache
@@ -603,70 +821,14 @@ CopyToExistingShards(CopyStmt *copyStatement, QueryCompletion *completionTag)
 		}
 	}
 
-	/* initialize copy state to read from COPY data source */
-	CopyFromState copyState = BeginCopyFrom_compat(NULL,
-												   copiedDistributedRelation,
-												   NULL,
-												   copyStatement->filename,
-												   copyStatement->is_program,
-												   NULL,
-												   copyStatement->attlist,
-												   copyStatement->options);
-
-	/* set up callback to identify error line number */
-	errorCallback.callback = CopyFromErrorCallback;
-	errorCallback.arg = (void *) copyState;
-	errorCallback.previous = error_context_stack;
-	error_context_stack = &errorCallback;
-
-	while (true)
-	{
-		ResetPerTupleExprContext(executorState);
-
-		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
-
-		/* parse a row from the input */
-		bool nextRowFound = NextCopyFrom(copyState, executorExpressionContext,
-										 columnValues, columnNulls);
-
-		if (!nextRowFound)
-		{
-			MemoryContextSwitchTo(oldContext);
-			break;
-		}
-
-		CHECK_FOR_INTERRUPTS();
-
-		MemoryContextSwitchTo(oldContext);
-
-		dest->receiveSlot(tupleTableSlot, dest);
-
-		++processedRowCount;
-
-#if PG_VERSION_NUM >= PG_VERSION_14
-		pgstat_progress_update_param(PROGRESS_COPY_TUPLES_PROCESSED, processedRowCount);
-#endif
-	}
-
-	EndCopyFrom(copyState);
-
-	/* all lines have been copied, stop showing line number in errors */
-	error_context_stack = errorCallback.previous;
-
-	/* finish the COPY commands */
-	dest->rShutdown(dest);
-	dest->rDestroy(dest);
-
-	ExecDropSingleTupleTableSlot(tupleTableSlot);
-	FreeExecutorState(executorState);
-	table_close(distributedRelation, NoLock);
-
-	CHECK_FOR_INTERRUPTS();
-
-	if (completionTag != NULL)
-	{
-		CompleteCopyQueryTagCompat(completionTag, processedRowCount);
-	}
+	return BeginCopyFrom_compat(NULL,
+								copiedDistributedRelation,
+								NULL,
+								copyStatement->filename,
+								copyStatement->is_program,
+								dataSourceCallback,
+								copyStatement->attlist,
+								copyStatement->options);
 }
 
 
@@ -978,23 +1140,25 @@ BinaryInputFunctionDefined(Oid typeId)
 }
 
 
-/* Send copy binary headers to given connections */
+/* Send copy binary headers to given connection */
 static void
-SendCopyBinaryHeaders(CopyOutState copyOutState, int64 shardId, List *connectionList)
+SendCopyBinaryHeaders(CopyOutState copyOutState, int64 shardId,
+					  CopyConnectionState *connectionState)
 {
 	resetStringInfo(copyOutState->fe_msgbuf);
 	AppendCopyBinaryHeaders(copyOutState);
-	SendCopyDataToAll(copyOutState->fe_msgbuf, shardId, connectionList);
+	SendCopyDataToConnection(copyOutState->fe_msgbuf, shardId, connectionState);
 }
 
 
-/* Send copy binary footers to given connections */
+/* Send copy binary footers to given connection */
 static void
-SendCopyBinaryFooters(CopyOutState copyOutState, int64 shardId, List *connectionList)
+SendCopyBinaryFooters(CopyOutState copyOutState, int64 shardId,
+					  CopyConnectionState *connectionState)
 {
 	resetStringInfo(copyOutState->fe_msgbuf);
 	AppendCopyBinaryFooters(copyOutState);
-	SendCopyDataToAll(copyOutState->fe_msgbuf, shardId, connectionList);
+	SendCopyDataToConnection(copyOutState->fe_msgbuf, shardId, connectionState);
 }
 
 
@@ -1102,17 +1266,53 @@ ConstructCopyStatement(CopyStmt *copyStatement, int64 shardId)
 
 
 /*
- * SendCopyDataToAll sends copy data to all connections in a list.
+ * SendCopyDataToConnection sends copy data for the active COPY on the given
+ * connection. When the COPY is compressed, the data is collected until there
+ * is enough of it to compress.
  */
 static void
-SendCopyDataToAll(StringInfo dataBuffer, int64 shardId, List *connectionList)
+SendCopyDataToConnection(StringInfo dataBuffer, int64 shardId,
+						 CopyConnectionState *connectionState)
 {
-	ListCell *connectionCell = NULL;
-	foreach(connectionCell, connectionList)
+	if (connectionState->compressionType == INTERMEDIATE_RESULT_COMPRESSION_NONE)
 	{
-		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
-		SendCopyDataToPlacement(dataBuffer, shardId, connection);
+		SendCopyDataToPlacement(dataBuffer, shardId, connectionState->connection);
+		return;
+	}
+
+	StringInfo compressionBuffer = connectionState->compressionBuffer;
+	appendBinaryStringInfo(compressionBuffer, dataBuffer->data, dataBuffer->len);
+
+	if (compressionBuffer->len >= REMOTE_COPY_COMPRESSION_FRAME_SIZE)
+	{
+		FlushCompressedCopyData(shardId, connectionState);
+	}
+}
+
+
+/*
+ * FlushCompressedCopyData compresses the collected copy data of the active
+ * COPY on the given connection into a frame and sends it.
+ */
+static void
+FlushCompressedCopyData(int64 shardId, CopyConnectionState *connectionState)
+{
+	StringInfo compressionBuffer = connectionState->compressionBuffer;
+
+	if (compressionBuffer == NULL || compressionBuffer->len == 0)
+	{
+		return;
 	}
+
+	StringInfo frame = makeStringInfo();
+	AppendCompressedResultFrame(frame, compressionBuffer->data, compressionBuffer->len,
+								connectionState->compressionType);
+
+	SendCopyDataToPlacement(frame, shardId, connectionState->connection);
+
+	pfree(frame->data);
+	pfree(frame);
+	resetStringInfo(compressionBuffer);
 }
 
 
@@ -1131,6 +1331,8 @@ SendCopyDataToPlacement(StringInfo dataBuffer, int64 shardId, MultiConnection *c
 						errdetail("failed to send %d bytes %s", dataBuffer->len,
 								  dataBuffer->data)));
 	}
+
+	ReportDistributedCommandBytesSent(dataBuffer->len);
 }
 
 
@@ -2045,15 +2247,11 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 
 	ListCell *columnNameCell = NULL;
 
-	const char *delimiterCharacter = "\t";
-	const char *nullPrintCharacter = "\\N";
-
 	/* look up table properties */
 	Relation distributedRelation = table_open(tableId, RowExclusiveLock);
 	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(tableId);
 
 	copyDest->distributedRelation = distributedRelation;
-	copyDest->tupleDescriptor = inputTupleDescriptor;
 
 	/* load the list of shards and verify that we have shards to copy into */
 	List *shardIntervalList = LoadShardIntervalList(tableId);
@@ -2106,29 +2304,10 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 	Use2PCForCoordinatedTransaction();
 
 	/* define how tuples will be serialised */
-	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
-	copyOutState->delim = (char *) delimiterCharacter;
-	copyOutState->null_print = (char *) nullPrintCharacter;
-	copyOutState->null_print_client = (char *) nullPrintCharacter;
-	copyOutState->binary = CanUseBinaryCopyFormat(inputTupleDescriptor);
-	copyOutState->fe_msgbuf = makeStringInfo();
-	copyOutState->rowcontext = GetPerTupleMemoryContext(copyDest->executorState);
-	copyDest->copyOutState = copyOutState;
-	copyDest->multiShardCopy = false;
+	PrepareCopyRowSerialization(copyDest, distributedRelation, inputTupleDescriptor,
+								CanUseBinaryCopyFormat(inputTupleDescriptor));
 
-	/* prepare functions to call on received tuples */
-	{
-		TupleDesc destTupleDescriptor = distributedRelation->rd_att;
-		int columnCount = inputTupleDescriptor->natts;
-		Oid *finalTypeArray = palloc0(columnCount * sizeof(Oid));
-
-		copyDest->columnCoercionPaths =
-			ColumnCoercionPaths(destTupleDescriptor, inputTupleDescriptor,
-								tableId, columnNameList, finalTypeArray);
-
-		copyDest->columnOutputFunctions =
-			TypeOutputFunctions(columnCount, finalTypeArray, copyOutState->binary);
-	}
+	CopyOutState copyOutState = copyDest->copyOutState;
 
 	/* wrap the column names as Values */
 	foreach(columnNameCell, columnNameList)
@@ -2175,6 +2354,16 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 
 			copyStatement->options = lappend(copyStatement->options, binaryFormatOption);
 		}
+
+		if (copyDest->onConflictAction != COPY_ON_CONFLICT_NONE)
+		{
+			const char *actionName = CopyOnConflictActionName(copyDest->onConflictAction);
+			DefElem *onConflictOption =
+				makeDefElem(COPY_ON_CONFLICT_OPTION,
+							(Node *) makeString(pstrdup(actionName)), -1);
+
+			copyStatement->options = lappend(copyStatement->options, onConflictOption);
+		}
 	}
 
 
@@ -2244,25 +2433,418 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 			copyDest->shouldUseLocalCopy = !reservedConnection;
 		}
 	}
+
+	copyDest->progressStarted =
+		StartDistributedCommandProgress(DISTRIBUTED_COMMAND_COPY, tableId,
+										cacheEntry->shardIntervalArrayLength);
 }
 
 
 /*
- * CitusCopyDestReceiverReceive implements the receiveSlot function of
- * CitusCopyDestReceiver. It takes a TupleTableSlot and sends the contents to
- * the appropriate shard placement(s).
+ * PrepareCopyRowSerialization sets up the state that the destination receiver
+ * uses to route tuples to shards and to serialize them in the format sent to
+ * the workers. It does not open connections, which allows parallel COPY
+ * workers to prepare rows that the leader backend sends over its connections.
  */
-static bool
-CitusCopyDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
+void
+PrepareCopyRowSerialization(CitusCopyDestReceiver *copyDest,
+							Relation distributedRelation,
+							TupleDesc inputTupleDescriptor, bool binaryFormat)
 {
-	bool result = false;
-	CitusCopyDestReceiver *copyDest = (CitusCopyDestReceiver *) dest;
+	const char *delimiterCharacter = "\t";
+	const char *nullPrintCharacter = "\\N";
 
-	PG_TRY();
-	{
-		result = CitusSendTupleToPlacements(slot, copyDest);
-	}
-	PG_CATCH();
+	copyDest->tupleDescriptor = inputTupleDescriptor;
+
+	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
+	copyOutState->delim = (char *) delimiterCharacter;
+	copyOutState->null_print = (char *) nullPrintCharacter;
+	copyOutState->null_print_client = (char *) nullPrintCharacter;
+	copyOutState->binary = binaryFormat;
+	copyOutState->fe_msgbuf = makeStringInfo();
+	copyOutState->rowcontext = GetPerTupleMemoryContext(copyDest->executorState);
+	copyDest->copyOutState = copyOutState;
+	copyDest->multiShardCopy = false;
+
+	/* prepare functions to call on received tuples */
+	TupleDesc destTupleDescriptor = distributedRelation->rd_att;
+
+	if (EnableCopySerializationCache)
+	{
+		LookupCopySerializationFunctions(copyDest, destTupleDescriptor,
+										 inputTupleDescriptor, copyOutState->binary);
+	}
+	else
+	{
+		int columnCount = inputTupleDescriptor->natts;
+		Oid *finalTypeArray = palloc0(columnCount * sizeof(Oid));
+
+		copyDest->columnCoercionPaths =
+			ColumnCoercionPaths(destTupleDescriptor, inputTupleDescriptor,
+								copyDest->distributedRelationId,
+								copyDest->columnNameList, finalTypeArray);
+
+		copyDest->columnOutputFunctions =
+			TypeOutputFunctions(columnCount, finalTypeArray, copyOutState->binary);
+	}
+
+	/* metadata stays valid until the end of the transaction */
+	copyDest->tableCacheEntry = GetCitusTableCacheEntry(copyDest->distributedRelationId);
+	copyDest->partitionHashMethod = CopyPartitionHashMethod(copyDest->tableCacheEntry);
+}
+
+
+/*
+ * LookupCopySerializationFunctions sets the coercion paths and output functions
+ * of the destination receiver from the session-level cache, and fills the
+ * cache if the table has not been copied into with the same columns before.
+ * The receiver gets its own copy of the functions, since it may replace some
+ * of them and frees them when it is destroyed.
+ */
+static void
+LookupCopySerializationFunctions(CitusCopyDestReceiver *copyDest,
+								 TupleDesc destTupleDescriptor,
+								 TupleDesc inputTupleDescriptor, bool binaryFormat)
+{
+	int columnCount = inputTupleDescriptor->natts;
+	Oid *inputTypeArray = TypeArrayFromTupleDescriptor(inputTupleDescriptor);
+
+	CopySerializationCacheEntry *entry =
+		CopySerializationCacheLookup(copyDest->distributedRelationId);
+
+	if (!CopySerializationEntryMatches(entry, binaryFormat, columnCount,
+									   inputTypeArray, copyDest->columnNameList))
+	{
+		ResetCopySerializationEntry(entry);
+		FillCopySerializationEntry(entry, destTupleDescriptor, inputTupleDescriptor,
+								   copyDest->columnNameList, binaryFormat);
+	}
+
+	CopyCoercionData *columnCoercionPaths =
+		palloc0(columnCount * sizeof(CopyCoercionData));
+	FmgrInfo *columnOutputFunctions = palloc0(columnCount * sizeof(FmgrInfo));
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		CopyCoercionData *cachedCoercionPath = &entry->columnCoercionPaths[columnIndex];
+		CopyCoercionData *coercionPath = &columnCoercionPaths[columnIndex];
+
+		coercionPath->coercionType = cachedCoercionPath->coercionType;
+		coercionPath->typioparam = cachedCoercionPath->typioparam;
+		CopyFunctionInfo(&coercionPath->coerceFunction,
+						 &cachedCoercionPath->coerceFunction);
+		CopyFunctionInfo(&coercionPath->inputFunction,
+						 &cachedCoercionPath->inputFunction);
+		CopyFunctionInfo(&coercionPath->outputFunction,
+						 &cachedCoercionPath->outputFunction);
+
+		CopyFunctionInfo(&columnOutputFunctions[columnIndex],
+						 &entry->columnOutputFunctions[columnIndex]);
+	}
+
+	copyDest->columnCoercionPaths = columnCoercionPaths;
+	copyDest->columnOutputFunctions = columnOutputFunctions;
+
+	pfree(inputTypeArray);
+}
+
+
+/*
+ * CopySerializationCacheLookup returns the cache entry of the given table,
+ * creating the cache and registering its invalidation callbacks on first use.
+ */
+static CopySerializationCacheEntry *
+CopySerializationCacheLookup(Oid relationId)
+{
+	if (CopySerializationCache == NULL)
+	{
+		HASHCTL info;
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(Oid);
+		info.entrysize = sizeof(CopySerializationCacheEntry);
+		info.hcxt = CacheMemoryContext;
+		int hashFlags = (HASH_ELEM | HASH_CONTEXT | HASH_BLOBS);
+
+		CopySerializationCache = hash_create("Copy Serialization Cache", 32, &info,
+											 hashFlags);
+
+		/* functions depend on the columns of the table, their types and casts */
+		CacheRegisterRelcacheCallback(InvalidateCopySerializationCacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(TYPEOID,
+									  InvalidateCopySerializationCacheSyscacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(CASTSOURCETARGET,
+									  InvalidateCopySerializationCacheSyscacheCallback,
+									  (Datum) 0);
+	}
+
+	bool found = false;
+	CopySerializationCacheEntry *entry = hash_search(CopySerializationCache,
+													 &relationId, HASH_ENTER, &found);
+	if (!found)
+	{
+		entry->memoryContext = NULL;
+	}
+
+	return entry;
+}
+
+
+/*
+ * CopySerializationEntryMatches returns whether the functions in the cache
+ * entry were looked up for the given input columns and format.
+ */
+static bool
+CopySerializationEntryMatches(CopySerializationCacheEntry *entry, bool binaryFormat,
+							  int columnCount, Oid *inputTypeArray,
+							  List *columnNameList)
+{
+	if (entry->memoryContext == NULL ||
+		entry->binaryFormat != binaryFormat ||
+		entry->columnCount != columnCount ||
+		list_length(entry->columnNameList) != list_length(columnNameList))
+	{
+		return false;
+	}
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		if (entry->inputTypeArray[columnIndex] != inputTypeArray[columnIndex])
+		{
+			return false;
+		}
+	}
+
+	ListCell *cachedNameCell = NULL;
+	ListCell *columnNameCell = NULL;
+	forboth(cachedNameCell, entry->columnNameList, columnNameCell, columnNameList)
+	{
+		if (strcmp(lfirst(cachedNameCell), lfirst(columnNameCell)) != 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * FillCopySerializationEntry looks up the coercion paths and output functions
+ * for the given input columns, and stores them in the cache entry.
+ */
+static void
+FillCopySerializationEntry(CopySerializationCacheEntry *entry,
+						   TupleDesc destTupleDescriptor,
+						   TupleDesc inputTupleDescriptor, List *columnNameList,
+						   bool binaryFormat)
+{
+	int columnCount = inputTupleDescriptor->natts;
+
+	MemoryContext entryContext = AllocSetContextCreate(CacheMemoryContext,
+													   "Copy Serialization Cache Entry",
+													   ALLOCSET_SMALL_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(entryContext);
+
+	Oid *finalTypeArray = palloc0(columnCount * sizeof(Oid));
+
+	entry->binaryFormat = binaryFormat;
+	entry->columnCount = columnCount;
+	entry->inputTypeArray = TypeArrayFromTupleDescriptor(inputTupleDescriptor);
+	entry->columnNameList = NIL;
+
+	char *columnName = NULL;
+	foreach_ptr(columnName, columnNameList)
+	{
+		entry->columnNameList = lappend(entry->columnNameList, pstrdup(columnName));
+	}
+
+	entry->columnCoercionPaths =
+		ColumnCoercionPaths(destTupleDescriptor, inputTupleDescriptor,
+							entry->relationId, entry->columnNameList, finalTypeArray);
+	entry->columnOutputFunctions =
+		TypeOutputFunctions(columnCount, finalTypeArray, binaryFormat);
+
+	MemoryContextSwitchTo(oldContext);
+
+	/* only mark the entry valid once all lookups succeeded */
+	entry->memoryContext = entryContext;
+}
+
+
+/*
+ * ResetCopySerializationEntry releases the functions in the cache entry.
+ */
+static void
+ResetCopySerializationEntry(CopySerializationCacheEntry *entry)
+{
+	if (entry->memoryContext != NULL)
+	{
+		MemoryContextDelete(entry->memoryContext);
+		entry->memoryContext = NULL;
+	}
+}
+
+
+/*
+ * CopyFunctionInfo copies a cached function lookup into the current memory
+ * context. State that the function itself caches in fn_extra is not shared,
+ * such that it is allocated in the memory of the current COPY.
+ */
+static void
+CopyFunctionInfo(FmgrInfo *target, FmgrInfo *source)
+{
+	*target = *source;
+	target->fn_extra = NULL;
+	target->fn_mcxt = CurrentMemoryContext;
+}
+
+
+/*
+ * InvalidateCopySerializationCacheCallback drops the cached functions of a
+ * table when its definition changes, or of all tables when relationId is
+ * InvalidOid.
+ */
+static void
+InvalidateCopySerializationCacheCallback(Datum argument, Oid relationId)
+{
+	CopySerializationCacheEntry *entry = NULL;
+	HASH_SEQ_STATUS status;
+
+	foreach_htab(entry, &status, CopySerializationCache)
+	{
+		if (relationId == InvalidOid || entry->relationId == relationId)
+		{
+			ResetCopySerializationEntry(entry);
+		}
+	}
+}
+
+
+/*
+ * InvalidateCopySerializationCacheSyscacheCallback drops all cached functions
+ * when a type or a cast changes, since we do not track which tables use them.
+ */
+static void
+InvalidateCopySerializationCacheSyscacheCallback(Datum argument, int cacheId,
+												 uint32 hashValue)
+{
+	InvalidateCopySerializationCacheCallback(argument, InvalidOid);
+}
+
+
+/*
+ * CopyPartitionHashMethod returns how ShardIdForTuple can hash the values of
+ * the distribution column of the given table. Inline hashing is only used
+ * for the built-in hash functions, and only when the shards divide the hash
+ * space uniformly such that the shard index can be computed directly.
+ */
+static CopyHashMethod
+CopyPartitionHashMethod(CitusTableCacheEntry *cacheEntry)
+{
+	if (!IsCitusTableTypeCacheEntry(cacheEntry, HASH_DISTRIBUTED) ||
+		!cacheEntry->hasUniformHashDistribution ||
+		cacheEntry->shardIntervalArrayLength == 0 ||
+		cacheEntry->hashFunction == NULL)
+	{
+		return COPY_HASH_FUNCTION_CALL;
+	}
+
+	switch (cacheEntry->hashFunction->fn_oid)
+	{
+		case F_HASHINT4:
+		{
+			return COPY_HASH_INT4;
+		}
+
+		case F_HASHINT8:
+		{
+			return COPY_HASH_INT8;
+		}
+
+		case F_HASHTEXT:
+		{
+			/* non-deterministic collations hash the sort key of the value */
+			Oid collationId = cacheEntry->partitionColumn->varcollid;
+			if (OidIsValid(collationId) && get_collation_isdeterministic(collationId))
+			{
+				return COPY_HASH_TEXT;
+			}
+
+			return COPY_HASH_FUNCTION_CALL;
+		}
+
+		default:
+		{
+			return COPY_HASH_FUNCTION_CALL;
+		}
+	}
+}
+
+
+/*
+ * HashPartitionColumnValue computes the same hash as hashint4, hashint8 or
+ * hashtext (for deterministic collations) on the given value.
+ */
+static inline int32
+HashPartitionColumnValue(CopyHashMethod hashMethod, Datum partitionColumnValue)
+{
+	switch (hashMethod)
+	{
+		case COPY_HASH_INT4:
+		{
+			return (int32) hash_bytes_uint32((uint32) DatumGetInt32(
+												 partitionColumnValue));
+		}
+
+		case COPY_HASH_INT8:
+		{
+			int64 value = DatumGetInt64(partitionColumnValue);
+			uint32 lohalf = (uint32) value;
+			uint32 hihalf = (uint32) (value >> 32);
+
+			/* the same folding as hashint8, such that int4 and int8 hashes agree */
+			lohalf ^= (value >= 0) ? hihalf : ~hihalf;
+
+			return (int32) hash_bytes_uint32(lohalf);
+		}
+
+		case COPY_HASH_TEXT:
+		{
+			text *value = DatumGetTextPP(partitionColumnValue);
+
+			return (int32) hash_bytes((unsigned char *) VARDATA_ANY(value),
+									  VARSIZE_ANY_EXHDR(value));
+		}
+
+		default:
+		{
+			ereport(ERROR, (errmsg("unexpected hash method %d", hashMethod)));
+		}
+	}
+
+	return 0; /* keep compiler quiet */
+}
+
+
+/*
+ * CitusCopyDestReceiverReceive implements the receiveSlot function of
+ * CitusCopyDestReceiver. It takes a TupleTableSlot and sends the contents to
+ * the appropriate shard placement(s).
+ */
+static bool
+CitusCopyDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
+{
+	bool result = false;
+	CitusCopyDestReceiver *copyDest = (CitusCopyDestReceiver *) dest;
+
+	PG_TRY();
+	{
+		result = CitusSendTupleToPlacements(slot, copyDest);
+	}
+	PG_CATCH();
 	{
 		/*
 		 * We might be able to recover from errors with ROLLBACK TO SAVEPOINT,
@@ -2286,17 +2868,8 @@ CitusCopyDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 static bool
 CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest)
 {
-	TupleDesc tupleDescriptor = copyDest->tupleDescriptor;
-	CopyStmt *copyStatement = copyDest->copyStatement;
-
-	CopyOutState copyOutState = copyDest->copyOutState;
-	FmgrInfo *columnOutputFunctions = copyDest->columnOutputFunctions;
-	CopyCoercionData *columnCoercionPaths = copyDest->columnCoercionPaths;
-	ListCell *placementStateCell = NULL;
-	bool cachedShardStateFound = false;
 	bool firstTupleInShard = false;
 
-
 	EState *executorState = copyDest->executorState;
 	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
 	MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
@@ -2313,18 +2886,134 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 	bool isColocatedIntermediateResult =
 		copyDest->colocatedIntermediateResultIdPrefix != NULL;
 
+	CopyShardState *shardState = GetCopyDestShardState(copyDest, shardId,
+													   &firstTupleInShard);
+
+	if (isColocatedIntermediateResult && copyDest->shouldUseLocalCopy &&
+		shardState->containsLocalPlacement)
+	{
+		if (firstTupleInShard)
+		{
+			CreateLocalColocatedIntermediateFile(copyDest, shardState);
+		}
+
+		WriteTupleToLocalFile(slot, copyDest, shardId,
+							  shardState->copyOutState, &shardState->fileDest);
+	}
+	else if (copyDest->shouldUseLocalCopy && shardState->containsLocalPlacement)
+	{
+		/* table_multi_insert cannot resolve conflicts */
+		if (firstTupleInShard && EnableLocalCopyMultiInsert &&
+			copyDest->onConflictAction == COPY_ON_CONFLICT_NONE)
+		{
+			shardState->localMultiInsertState = StartLocalMultiInsert(copyDest,
+																	  shardId);
+		}
+
+		if (shardState->localMultiInsertState != NULL)
+		{
+			WriteTupleToLocalMultiInsert(slot, copyDest,
+										 shardState->localMultiInsertState);
+		}
+		else
+		{
+			WriteTupleToLocalShard(slot, copyDest, shardId, shardState->copyOutState);
+		}
+	}
+
+	SendCopyRowToPlacements(copyDest, shardState, shardId, columnValues, columnNulls,
+							NULL);
+
+	MemoryContextSwitchTo(oldContext);
+
+	copyDest->tuplesSent++;
+	ReportDistributedCommandShardRows(shardId, 1);
+
+	/*
+	 * Release per tuple memory allocated in this function. If we're writing
+	 * the results of an INSERT ... SELECT then the SELECT execution will use
+	 * its own executor state and reset the per tuple expression context
+	 * separately.
+	 */
+	ResetPerTupleExprContext(executorState);
+
+	return true;
+}
+
+
+/*
+ * CitusSendCopyRowToPlacements sends a row that was already serialized in the
+ * format of the destination receiver's copy out state to the placements of
+ * the given shard. Parallel COPY uses it to forward the rows prepared by its
+ * workers, which is only possible when the shard is not copied locally.
+ */
+void
+CitusSendCopyRowToPlacements(CitusCopyDestReceiver *copyDest, uint64 shardId,
+							 StringInfo serializedRow)
+{
+	bool firstTupleInShard = false;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(copyDest->memoryContext);
+
+	CopyShardState *shardState = GetCopyDestShardState(copyDest, shardId,
+													   &firstTupleInShard);
+
+	if (copyDest->shouldUseLocalCopy && shardState->containsLocalPlacement)
+	{
+		ereport(ERROR, (errmsg("cannot send a serialized row to the local "
+							   "placement of shard " UINT64_FORMAT, shardId)));
+	}
+
+	SendCopyRowToPlacements(copyDest, shardState, shardId, NULL, NULL, serializedRow);
+
+	MemoryContextSwitchTo(oldContext);
+
+	copyDest->tuplesSent++;
+	ReportDistributedCommandShardRows(shardId, 1);
+}
+
+
+/*
+ * CitusPrepareCopyToShard sets up the state of the given shard in the COPY,
+ * which opens the connections to its placements. Callers that cannot open
+ * connections while sending rows, such as the leader of parallel workers,
+ * prepare all shards up front.
+ */
+void
+CitusPrepareCopyToShard(CitusCopyDestReceiver *copyDest, uint64 shardId)
+{
+	bool firstTupleInShard = false;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(copyDest->memoryContext);
+
+	(void) GetCopyDestShardState(copyDest, shardId, &firstTupleInShard);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * GetCopyDestShardState returns the state of the given shard in the COPY and
+ * marks the COPY as a multi-shard modification once a second shard is seen.
+ * firstTupleInShard is set to true when the shard state was not created yet.
+ */
+static CopyShardState *
+GetCopyDestShardState(CitusCopyDestReceiver *copyDest, uint64 shardId,
+					  bool *firstTupleInShard)
+{
+	bool cachedShardStateFound = false;
+	bool isColocatedIntermediateResult =
+		copyDest->colocatedIntermediateResultIdPrefix != NULL;
+
 	CopyShardState *shardState = GetShardState(shardId, copyDest->shardStateHash,
 											   copyDest->connectionStateHash,
 											   &cachedShardStateFound,
 											   copyDest->shouldUseLocalCopy,
 											   copyDest->copyOutState,
 											   isColocatedIntermediateResult);
-	if (!cachedShardStateFound)
-	{
-		firstTupleInShard = true;
-	}
+	*firstTupleInShard = !cachedShardStateFound;
 
-	if (firstTupleInShard && !copyDest->multiShardCopy &&
+	if (*firstTupleInShard && !copyDest->multiShardCopy &&
 		hash_get_num_entries(copyDest->shardStateHash) == 2)
 	{
 		Oid relationId = copyDest->distributedRelationId;
@@ -2339,21 +3028,28 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 		}
 	}
 
-	if (isColocatedIntermediateResult && copyDest->shouldUseLocalCopy &&
-		shardState->containsLocalPlacement)
-	{
-		if (firstTupleInShard)
-		{
-			CreateLocalColocatedIntermediateFile(copyDest, shardState);
-		}
+	return shardState;
+}
 
-		WriteTupleToLocalFile(slot, copyDest, shardId,
-							  shardState->copyOutState, &shardState->fileDest);
-	}
-	else if (copyDest->shouldUseLocalCopy && shardState->containsLocalPlacement)
-	{
-		WriteTupleToLocalShard(slot, copyDest, shardId, shardState->copyOutState);
-	}
+
+/*
+ * SendCopyRowToPlacements sends a row to the remote placements of the given
+ * shard, buffering it for placements whose connection is busy with another
+ * placement. The row is either given as column values, which are serialized
+ * for every placement, or as an already serialized row.
+ */
+static void
+SendCopyRowToPlacements(CitusCopyDestReceiver *copyDest, CopyShardState *shardState,
+						uint64 shardId, Datum *columnValues, bool *columnNulls,
+						StringInfo serializedRow)
+{
+	TupleDesc tupleDescriptor = copyDest->tupleDescriptor;
+	CopyStmt *copyStatement = copyDest->copyStatement;
+
+	CopyOutState copyOutState = copyDest->copyOutState;
+	FmgrInfo *columnOutputFunctions = copyDest->columnOutputFunctions;
+	CopyCoercionData *columnCoercionPaths = copyDest->columnCoercionPaths;
+	ListCell *placementStateCell = NULL;
 
 	foreach(placementStateCell, shardState->placementStateList)
 	{
@@ -2389,8 +3085,8 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 			connectionState->activePlacementState = currentPlacementState;
 
 			/* send previously buffered tuples */
-			SendCopyDataToPlacement(currentPlacementState->data, shardId,
-									connectionState->connection);
+			SendCopyDataToConnection(currentPlacementState->data, shardId,
+									 connectionState);
 			resetStringInfo(currentPlacementState->data);
 
 			/* additionaly, we need to send the current tuple too */
@@ -2399,13 +3095,21 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 		else if (currentPlacementState != activePlacementState)
 		{
 			/* buffer data */
-			StringInfo copyBuffer = copyOutState->fe_msgbuf;
-			resetStringInfo(copyBuffer);
-			AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-							  copyOutState, columnOutputFunctions,
-							  columnCoercionPaths);
-			appendBinaryStringInfo(currentPlacementState->data, copyBuffer->data,
-								   copyBuffer->len);
+			if (serializedRow != NULL)
+			{
+				appendBinaryStringInfo(currentPlacementState->data,
+									   serializedRow->data, serializedRow->len);
+			}
+			else
+			{
+				StringInfo copyBuffer = copyOutState->fe_msgbuf;
+				resetStringInfo(copyBuffer);
+				AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
+								  copyOutState, columnOutputFunctions,
+								  columnCoercionPaths);
+				appendBinaryStringInfo(currentPlacementState->data, copyBuffer->data,
+									   copyBuffer->len);
+			}
 		}
 		else
 		{
@@ -2413,29 +3117,19 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 			sendTupleOverConnection = true;
 		}
 
-		if (sendTupleOverConnection)
+		if (sendTupleOverConnection && serializedRow != NULL)
+		{
+			SendCopyDataToConnection(serializedRow, shardId, connectionState);
+		}
+		else if (sendTupleOverConnection)
 		{
 			resetStringInfo(copyOutState->fe_msgbuf);
 			AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-							  copyOutState, columnOutputFunctions, columnCoercionPaths);
-			SendCopyDataToPlacement(copyOutState->fe_msgbuf, shardId,
-									connectionState->connection);
-		}
-	}
-
-	MemoryContextSwitchTo(oldContext);
-
-	copyDest->tuplesSent++;
-
-	/*
-	 * Release per tuple memory allocated in this function. If we're writing
-	 * the results of an INSERT ... SELECT then the SELECT execution will use
-	 * its own executor state and reset the per tuple expression context
-	 * separately.
-	 */
-	ResetPerTupleExprContext(executorState);
-
-	return true;
+							  copyOutState, columnOutputFunctions, columnCoercionPaths);
+			SendCopyDataToConnection(copyOutState->fe_msgbuf, shardId,
+									 connectionState);
+		}
+	}
 }
 
 
@@ -2547,14 +3241,18 @@ ContainsLocalPlacement(int64 shardId)
 /*
  * ShardIdForTuple returns id of the shard to which the given tuple belongs to.
  */
-static uint64
+uint64
 ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues, bool *columnNulls)
 {
 	int partitionColumnIndex = copyDest->partitionColumnIndex;
 	Datum partitionColumnValue = 0;
 	CopyCoercionData *columnCoercionPaths = copyDest->columnCoercionPaths;
-	CitusTableCacheEntry *cacheEntry =
-		GetCitusTableCacheEntry(copyDest->distributedRelationId);
+	CitusTableCacheEntry *cacheEntry = copyDest->tableCacheEntry;
+
+	if (cacheEntry == NULL)
+	{
+		cacheEntry = GetCitusTableCacheEntry(copyDest->distributedRelationId);
+	}
 
 	if (IsCitusTableTypeCacheEntry(cacheEntry, APPEND_DISTRIBUTED))
 	{
@@ -2591,6 +3289,17 @@ ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues, bool *colu
 
 		/* annoyingly this is evaluated twice, but at least we don't crash! */
 		partitionColumnValue = CoerceColumnValue(partitionColumnValue, coercePath);
+
+		/* skip the function manager and the shard lookup for common types */
+		if (copyDest->partitionHashMethod != COPY_HASH_FUNCTION_CALL)
+		{
+			int32 hashedValue = HashPartitionColumnValue(copyDest->partitionHashMethod,
+														 partitionColumnValue);
+			int shardCount = cacheEntry->shardIntervalArrayLength;
+			int shardIndex = CalculateUniformHashRangeIndex(hashedValue, shardCount);
+
+			return GetCachedShardId(cacheEntry, shardIndex);
+		}
 	}
 
 	/*
@@ -2654,6 +3363,9 @@ CitusCopyDestReceiverShutdown(DestReceiver *destReceiver)
 	PG_END_TRY();
 
 	table_close(distributedRelation, NoLock);
+
+	FinishDistributedCommandProgress(copyDest->progressStarted);
+	copyDest->progressStarted = false;
 }
 
 
@@ -2669,8 +3381,13 @@ FinishLocalCopy(CitusCopyDestReceiver *copyDest)
 
 	foreach_htab(copyShardState, &status, shardStateHash)
 	{
-		if (copyShardState->copyOutState != NULL &&
-			copyShardState->copyOutState->fe_msgbuf->len > 0)
+		if (copyShardState->localMultiInsertState != NULL)
+		{
+			FinishLocalMultiInsert(copyShardState->localMultiInsertState);
+			copyShardState->localMultiInsertState = NULL;
+		}
+		else if (copyShardState->copyOutState != NULL &&
+				 copyShardState->copyOutState->fe_msgbuf->len > 0)
 		{
 			FinishLocalCopyToShard(copyDest, copyShardState->shardId,
 								   copyShardState->copyOutState);
@@ -2761,8 +3478,7 @@ ShutdownCopyConnectionState(CopyConnectionState *connectionState,
 
 		StartPlacementStateCopyCommand(placementState, copyStatement,
 									   copyOutState);
-		SendCopyDataToPlacement(placementState->data, shardId,
-								connectionState->connection);
+		SendCopyDataToConnection(placementState->data, shardId, connectionState);
 		EndPlacementStateCopyCommand(placementState, copyOutState);
 	}
 }
@@ -2874,6 +3590,16 @@ ProcessCopyStmt(CopyStmt *copyStatement, QueryCompletion *completionTag, const
 		return NULL;
 	}
 
+	/*
+	 * Handle COPY shard FROM STDIN WITH (.., compression '..') commands, with
+	 * which the coordinator sends compressed rows to shards.
+	 */
+	if (IsCompressedCopyStmt(copyStatement))
+	{
+		CopyCompressedDataIntoTable(copyStatement, completionTag, queryString);
+		return NULL;
+	}
+
 	/*
 	 * We check whether a distributed relation is affected. For that, we need to open the
 	 * relation. To prevent race conditions with later lookups, lock the table, and modify
@@ -2901,6 +3627,16 @@ ProcessCopyStmt(CopyStmt *copyStatement, QueryCompletion *completionTag, const
 
 		table_close(copiedRelation, NoLock);
 
+		/*
+		 * Handle COPY shard FROM STDIN WITH (.., on_conflict '..') commands,
+		 * with which the coordinator upserts rows into shards.
+		 */
+		if (!isCitusRelation && IsCopyOnConflictStmt(copyStatement))
+		{
+			CopyOnConflictIntoTable(copyStatement, completionTag, queryString);
+			return NULL;
+		}
+
 		if (isCitusRelation)
 		{
 			if (copyStatement->is_from)
@@ -3001,6 +3737,12 @@ CitusCopySelect(CopyStmt *copyStatement)
 /*
  * CitusCopyTo runs a COPY .. TO STDOUT command on each shard to do a full
  * table dump.
+ *
+ * By default, the shards are exported one at a time in shard order. With
+ * citus.enable_parallel_copy_to, up to citus.max_adaptive_executor_pool_size
+ * shards per node are exported at once and the rows are forwarded from
+ * whichever connection has data ready, so the order of the rows across
+ * shards is not defined.
  */
 static void
 CitusCopyTo(CopyStmt *copyStatement, QueryCompletion *completionTag)
@@ -3022,82 +3764,385 @@ CitusCopyTo(CopyStmt *copyStatement, QueryCompletion *completionTag)
 
 	List *shardIntervalList = LoadShardIntervalList(relationId);
 
+	List *activeConnectionList = NIL;
+
 	foreach(shardIntervalCell, shardIntervalList)
 	{
 		ShardInterval *shardInterval = lfirst(shardIntervalCell);
-		List *shardPlacementList = ActiveShardPlacementList(shardInterval->shardId);
-		ListCell *shardPlacementCell = NULL;
-		int placementIndex = 0;
+		bool firstShard = shardIntervalCell == list_head(shardIntervalList);
 
-		StringInfo copyCommand = ConstructCopyStatement(copyStatement,
-														shardInterval->shardId);
+		/* the header has to come first, so the first shard is exported alone */
+		bool exportShardInParallel =
+			EnableParallelCopyTo &&
+			!(firstShard && CopyStatementHasHeader(copyStatement));
 
-		foreach(shardPlacementCell, shardPlacementList)
+		if (exportShardInParallel)
+		{
+			MultiConnection *connection =
+				StartParallelCopyToShard(copyStatement, shardInterval, copyOutState,
+										 &activeConnectionList, &tuplesSent);
+			if (connection != NULL)
+			{
+				activeConnectionList = lappend(activeConnectionList, connection);
+			}
+		}
+		else
 		{
-			ShardPlacement *shardPlacement = lfirst(shardPlacementCell);
 			int connectionFlags = 0;
-			char *userName = NULL;
-			const bool raiseErrors = true;
+			MultiConnection *connection = StartCopyToShard(copyStatement, shardInterval,
+														   connectionFlags);
+			if (connection != NULL)
+			{
+				tuplesSent += ForwardCopyDataFromConnection(copyOutState, connection);
+			}
+		}
 
-			MultiConnection *connection = GetPlacementConnection(connectionFlags,
-																 shardPlacement,
-																 userName);
+		if (firstShard)
+		{
+			/* remove header after the first shard */
+			copyStatement->options =
+				RemoveOptionFromList(copyStatement->options, "header");
+		}
+	}
 
-			/*
-			 * This code-path doesn't support optional connections, so we don't expect
-			 * NULL connections.
-			 */
-			Assert(connection != NULL);
+	while (activeConnectionList != NIL)
+	{
+		tuplesSent += ForwardCopyDataFromActiveConnections(copyOutState,
+														   &activeConnectionList);
+	}
 
-			if (placementIndex == list_length(shardPlacementList) - 1)
-			{
-				/* last chance for this shard */
-				MarkRemoteTransactionCritical(connection);
-			}
+	SendCopyEnd(copyOutState);
 
-			if (PQstatus(connection->pgConn) != CONNECTION_OK)
-			{
-				ReportConnectionError(connection, ERROR);
-				continue;
-			}
+	table_close(distributedRelation, AccessShareLock);
 
-			RemoteTransactionBeginIfNecessary(connection);
+	if (completionTag != NULL)
+	{
+		CompleteCopyQueryTagCompat(completionTag, tuplesSent);
+	}
+}
+
+
+/*
+ * CopyStatementHasHeader returns whether the given COPY statement asks for a
+ * header line.
+ */
+static bool
+CopyStatementHasHeader(CopyStmt *copyStatement)
+{
+	DefElem *defel = NULL;
+	foreach_ptr(defel, copyStatement->options)
+	{
+		if (strcmp(defel->defname, "header") == 0)
+		{
+			return defGetBoolean(defel);
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * StartCopyToShard starts a COPY .. TO STDOUT for the given shard on a
+ * connection to one of its placements, and returns the connection once it is
+ * ready to stream the COPY data. It returns NULL if the shard has no active
+ * placements.
+ */
+static MultiConnection *
+StartCopyToShard(CopyStmt *copyStatement, ShardInterval *shardInterval,
+				 int connectionFlags)
+{
+	List *shardPlacementList = ActiveShardPlacementList(shardInterval->shardId);
+	ListCell *shardPlacementCell = NULL;
+	int placementIndex = 0;
+
+	StringInfo copyCommand = ConstructCopyStatement(copyStatement,
+													shardInterval->shardId);
+
+	foreach(shardPlacementCell, shardPlacementList)
+	{
+		ShardPlacement *shardPlacement = lfirst(shardPlacementCell);
+		char *userName = NULL;
+		const bool raiseErrors = true;
+
+		MultiConnection *connection = GetPlacementConnection(connectionFlags,
+															 shardPlacement,
+															 userName);
+
+		/*
+		 * This code-path doesn't support optional connections, so we don't expect
+		 * NULL connections.
+		 */
+		Assert(connection != NULL);
+
+		if (placementIndex == list_length(shardPlacementList) - 1)
+		{
+			/* last chance for this shard */
+			MarkRemoteTransactionCritical(connection);
+		}
+
+		if (PQstatus(connection->pgConn) != CONNECTION_OK)
+		{
+			ReportConnectionError(connection, ERROR);
+			continue;
+		}
+
+		RemoteTransactionBeginIfNecessary(connection);
+
+		if (!SendRemoteCommand(connection, copyCommand->data))
+		{
+			ReportConnectionError(connection, ERROR);
+			continue;
+		}
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
+		if (PQresultStatus(result) != PGRES_COPY_OUT)
+		{
+			ReportResultError(connection, result, ERROR);
+		}
+
+		PQclear(result);
+
+		return connection;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * StartParallelCopyToShard starts the export of the given shard while other
+ * shards are being exported over the connections in activeConnectionList.
+ *
+ * Placements that were not accessed earlier in the transaction get a clean
+ * connection, such that each shard streams over its own connection. Before
+ * starting the shard, the function forwards data from the active connections
+ * until the node of the shard has fewer than
+ * citus.max_adaptive_executor_pool_size exports running, and until the
+ * connection that the shard has to use is idle.
+ */
+static MultiConnection *
+StartParallelCopyToShard(CopyStmt *copyStatement, ShardInterval *shardInterval,
+						 CopyOutState copyOutState, List **activeConnectionList,
+						 int64 *tuplesSent)
+{
+	List *shardPlacementList = ActiveShardPlacementList(shardInterval->shardId);
+	if (shardPlacementList == NIL)
+	{
+		return NULL;
+	}
+
+	ShardPlacement *firstPlacement = linitial(shardPlacementList);
+
+	while (ActiveCopyToConnectionCount(*activeConnectionList,
+									   firstPlacement->nodeName,
+									   firstPlacement->nodePort) >=
+		   MaxAdaptiveExecutorPoolSize)
+	{
+		*tuplesSent += ForwardCopyDataFromActiveConnections(copyOutState,
+															activeConnectionList);
+	}
+
+	ShardPlacementAccess *placementAccess =
+		CreatePlacementAccess(firstPlacement, PLACEMENT_ACCESS_SELECT);
+	MultiConnection *assignedConnection =
+		GetConnectionIfPlacementAccessedInXact(0, list_make1(placementAccess), NULL);
+
+	while (assignedConnection != NULL &&
+		   list_member_ptr(*activeConnectionList, assignedConnection))
+	{
+		*tuplesSent += ForwardCopyDataFromActiveConnections(copyOutState,
+															activeConnectionList);
+	}
+
+	return StartCopyToShard(copyStatement, shardInterval, REQUIRE_CLEAN_CONNECTION);
+}
+
+
+/*
+ * ActiveCopyToConnectionCount returns the number of connections in the list
+ * that go to the given node.
+ */
+static int
+ActiveCopyToConnectionCount(List *activeConnectionList, char *nodeName, int nodePort)
+{
+	int connectionCount = 0;
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, activeConnectionList)
+	{
+		if (strncmp(connection->hostname, nodeName, MAX_NODE_LENGTH) == 0 &&
+			connection->port == nodePort)
+		{
+			connectionCount++;
+		}
+	}
+
+	return connectionCount;
+}
+
+
+/*
+ * ForwardCopyDataFromActiveConnections forwards the COPY data that is ready
+ * on any of the given connections, waiting for data if there is none. It
+ * returns once at least one row was forwarded or an export finished, and
+ * removes the connections whose export finished from the list.
+ *
+ * The function returns the number of rows that were forwarded.
+ */
+static int64
+ForwardCopyDataFromActiveConnections(CopyOutState copyOutState,
+									 List **activeConnectionList)
+{
+	int64 tuplesSent = 0;
+
+	while (true)
+	{
+		List *remainingConnectionList = NIL;
+		bool madeProgress = false;
+
+		MultiConnection *connection = NULL;
+		foreach_ptr(connection, *activeConnectionList)
+		{
+			bool copyDone = false;
+
+			int64 connectionTuplesSent =
+				ForwardAvailableCopyData(copyOutState, connection, &copyDone);
 
-			if (!SendRemoteCommand(connection, copyCommand->data))
+			if (copyDone)
 			{
-				ReportConnectionError(connection, ERROR);
-				continue;
+				madeProgress = true;
 			}
-
-			PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
-			if (PQresultStatus(result) != PGRES_COPY_OUT)
+			else
 			{
-				ReportResultError(connection, result, ERROR);
+				remainingConnectionList = lappend(remainingConnectionList, connection);
 			}
 
-			PQclear(result);
-
-			tuplesSent += ForwardCopyDataFromConnection(copyOutState, connection);
-
-			break;
+			if (connectionTuplesSent > 0)
+			{
+				tuplesSent += connectionTuplesSent;
+				madeProgress = true;
+			}
 		}
 
-		if (shardIntervalCell == list_head(shardIntervalList))
+		list_free(*activeConnectionList);
+		*activeConnectionList = remainingConnectionList;
+
+		if (madeProgress || *activeConnectionList == NIL)
 		{
-			/* remove header after the first shard */
-			copyStatement->options =
-				RemoveOptionFromList(copyStatement->options, "header");
+			return tuplesSent;
 		}
+
+		WaitForCopyToConnections(*activeConnectionList);
 	}
+}
 
-	SendCopyEnd(copyOutState);
 
-	table_close(distributedRelation, AccessShareLock);
+/*
+ * ForwardAvailableCopyData forwards the COPY data that was already received
+ * over the given connection without blocking. copyDone is set when the
+ * export over the connection finished.
+ */
+static int64
+ForwardAvailableCopyData(CopyOutState copyOutState, MultiConnection *connection,
+						 bool *copyDone)
+{
+	char *receiveBuffer = NULL;
+	const int useAsync = 1;
+	bool raiseErrors = true;
+	int64 tuplesSent = 0;
 
-	if (completionTag != NULL)
+	if (PQconsumeInput(connection->pgConn) == 0)
 	{
-		CompleteCopyQueryTagCompat(completionTag, tuplesSent);
+		ReportConnectionError(connection, ERROR);
+	}
+
+	int receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, useAsync);
+	while (receiveLength > 0)
+	{
+		bool includeEndOfLine = false;
+
+		CopySendData(copyOutState, receiveBuffer, receiveLength);
+		CopySendEndOfRow(copyOutState, includeEndOfLine);
+		tuplesSent++;
+
+		PQfreemem(receiveBuffer);
+
+		receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, useAsync);
+	}
+
+	if (receiveLength == 0)
+	{
+		/* no complete row available yet */
+		*copyDone = false;
+		return tuplesSent;
+	}
+
+	if (receiveLength != -1)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
+	if (!IsResponseOK(result))
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+	ClearResults(connection, raiseErrors);
+
+	*copyDone = true;
+
+	return tuplesSent;
+}
+
+
+/*
+ * WaitForCopyToConnections waits until any of the given connections has data
+ * to read, while accepting interrupts.
+ */
+static void
+WaitForCopyToConnections(List *connectionList)
+{
+	int eventSetSize = list_length(connectionList) + 2;
+	WaitEvent *events = palloc0(eventSetSize * sizeof(WaitEvent));
+	WaitEventSet *waitEventSet = CreateWaitEventSet(CurrentMemoryContext,
+													eventSetSize);
+
+	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL,
+					  NULL);
+	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		AddWaitEventToSet(waitEventSet, WL_SOCKET_READABLE,
+						  PQsocket(connection->pgConn), NULL, (void *) connection);
+	}
+
+	int eventCount = WaitEventSetWait(waitEventSet, -1, events, eventSetSize,
+									  CitusWaitEventInfo(
+										  CITUS_WAIT_EVENT_REMOTE_QUERY_RESULT));
+
+	for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
+	{
+		WaitEvent *event = &events[eventIndex];
+
+		if (event->events & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+		}
+
+		if (event->events & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+			CHECK_FOR_INTERRUPTS();
+		}
 	}
+
+	FreeWaitEventSet(waitEventSet);
+	pfree(events);
 }
 
 
@@ -3366,6 +4411,8 @@ GetConnectionState(HTAB *connectionStateHash, MultiConnection *connection)
 		connectionState->activePlacementState = NULL;
 		connectionState->bufferedPlacementCount = 0;
 		dlist_init(&connectionState->bufferedPlacementList);
+		connectionState->compressionType = INTERMEDIATE_RESULT_COMPRESSION_NONE;
+		connectionState->compressionBuffer = NULL;
 	}
 
 	return connectionState;
@@ -3486,6 +4533,7 @@ InitializeCopyShardState(CopyShardState *shardState,
 	shardState->placementStateList = NIL;
 	shardState->copyOutState = NULL;
 	shardState->containsLocalPlacement = ContainsLocalPlacement(shardId);
+	shardState->localMultiInsertState = NULL;
 	shardState->fileDest.fd = -1;
 
 	foreach(placementCell, activePlacementList)
@@ -3906,12 +4954,33 @@ static void
 StartPlacementStateCopyCommand(CopyPlacementState *placementState,
 							   CopyStmt *copyStatement, CopyOutState copyOutState)
 {
-	MultiConnection *connection = placementState->connectionState->connection;
+	CopyConnectionState *connectionState = placementState->connectionState;
+	MultiConnection *connection = connectionState->connection;
 	uint64 shardId = placementState->shardState->shardId;
 	bool raiseInterrupts = true;
 	bool binaryCopy = copyOutState->binary;
+	IntermediateResultCompressionType compressionType = RemoteCopyCompression;
+	CopyStmt shardCopyStatement = *copyStatement;
+
+	/* intermediate results are written to files as they are received */
+	if (IsCopyResultStmt(copyStatement))
+	{
+		compressionType = INTERMEDIATE_RESULT_COMPRESSION_NONE;
+	}
+
+	/* ask the worker to decompress the COPY data */
+	if (compressionType != INTERMEDIATE_RESULT_COMPRESSION_NONE)
+	{
+		const char *compressionName = RemoteCopyCompressionName(compressionType);
+		DefElem *compressionOption =
+			makeDefElem(REMOTE_COPY_COMPRESSION_OPTION,
+						(Node *) makeString(pstrdup(compressionName)), -1);
+
+		shardCopyStatement.options = lappend(list_copy(copyStatement->options),
+											 compressionOption);
+	}
 
-	StringInfo copyCommand = ConstructCopyStatement(copyStatement, shardId);
+	StringInfo copyCommand = ConstructCopyStatement(&shardCopyStatement, shardId);
 
 	if (!SendRemoteCommand(connection, copyCommand->data))
 	{
@@ -3926,9 +4995,26 @@ StartPlacementStateCopyCommand(CopyPlacementState *placementState,
 
 	PQclear(result);
 
+	connectionState->compressionType = compressionType;
+
+	if (compressionType != INTERMEDIATE_RESULT_COMPRESSION_NONE)
+	{
+		if (connectionState->compressionBuffer == NULL)
+		{
+			MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+			connectionState->compressionBuffer = makeStringInfo();
+			MemoryContextSwitchTo(oldContext);
+		}
+
+		/* the signature precedes the frames */
+		StringInfo signature = makeStringInfo();
+		AppendCompressedResultHeader(signature);
+		SendCopyDataToPlacement(signature, shardId, connection);
+	}
+
 	if (binaryCopy)
 	{
-		SendCopyBinaryHeaders(copyOutState, shardId, list_make1(connection));
+		SendCopyBinaryHeaders(copyOutState, shardId, connectionState);
 	}
 }
 
@@ -3941,16 +5027,20 @@ static void
 EndPlacementStateCopyCommand(CopyPlacementState *placementState,
 							 CopyOutState copyOutState)
 {
-	MultiConnection *connection = placementState->connectionState->connection;
+	CopyConnectionState *connectionState = placementState->connectionState;
+	MultiConnection *connection = connectionState->connection;
 	uint64 shardId = placementState->shardState->shardId;
 	bool binaryCopy = copyOutState->binary;
 
 	/* send footers and end copy command */
 	if (binaryCopy)
 	{
-		SendCopyBinaryFooters(copyOutState, shardId, list_make1(connection));
+		SendCopyBinaryFooters(copyOutState, shardId, connectionState);
 	}
 
+	FlushCompressedCopyData(shardId, connectionState);
+	connectionState->compressionType = INTERMEDIATE_RESULT_COMPRESSION_NONE;
+
 	EndRemoteCopy(shardId, list_make1(connection));
 }
 
@@ -0,0 +1,478 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_local_table_copy.c
+ *    Copying the local data of a table that is being distributed into its
+ *    shards with parallel workers.
+ *
+ * When create_distributed_table or create_reference_table is called on a
+ * table with data, the backend that runs it reads the local table, finds the
+ * shard of each row and serializes the row for the worker nodes. For large
+ * tables, this is mostly CPU work on the coordinator. When
+ * citus.local_table_copy_parallel_workers is set, the backend (the leader)
+ * launches parallel workers that divide the blocks of the table between them
+ * through a parallel table scan. Each worker routes and serializes the rows
+ * in its blocks and sends them back to the leader, together with the id of
+ * their shard.
+ *
+ * Parallel workers share the transaction of the leader, hence they see the
+ * shards and metadata that were created in it and read the table with the
+ * snapshot of the leader. The leader keeps all connections to the shards and
+ * forwards the rows over them, such that the copy still runs in a single
+ * distributed transaction. The leader opens the connections to all shards
+ * before entering parallel mode, since it cannot make changes of its own
+ * while the workers run.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "access/parallel.h"
+#include "access/tableam.h"
+#include "access/xact.h"
+#include "catalog/pg_am.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/parallel_local_table_copy.h"
+#include "distributed/version_compat.h"
+#include "executor/executor.h"
+#include "libpq/pqformat.h"
+#include "optimizer/paths.h"
+#include "storage/bufmgr.h"
+#include "storage/latch.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+
+
+/* GUC, number of parallel workers that read the local data of a table */
+int LocalTableCopyParallelWorkers = 0;
+
+
+#define CITUS_LOCAL_TABLE_COPY_KEY_SHARED 1
+#define CITUS_LOCAL_TABLE_COPY_KEY_SCAN 2
+#define CITUS_LOCAL_TABLE_COPY_KEY_QUEUES 3
+#define CITUS_LOCAL_TABLE_COPY_NKEYS 3
+
+/* size of the queue between the leader and each worker */
+#define LOCAL_TABLE_COPY_QUEUE_SIZE ((Size) 1024 * 1024)
+
+/* number of bytes of serialized rows a worker sends to the leader at once */
+#define LOCAL_TABLE_COPY_BATCH_SIZE (64 * 1024)
+
+
+/*
+ * LocalTableCopyShared is the fixed part of the shared memory that the leader
+ * passes to its workers.
+ */
+typedef struct LocalTableCopyShared
+{
+	Oid relationId;
+
+	/* whether rows are serialized in binary format for the worker nodes */
+	bool binaryOutput;
+} LocalTableCopyShared;
+
+
+static bool CanCopyLocalTableInParallel(Relation distributedRelation,
+										CitusCopyDestReceiver *copyDest);
+static void PrepareCopyToAllShards(CitusCopyDestReceiver *copyDest);
+static uint64 ForwardLocalTableCopyRows(ParallelContext *parallelContext,
+										shm_mq_handle **queueHandles,
+										CitusCopyDestReceiver *copyDest);
+static void SendLocalTableCopyBatch(shm_mq_handle *queueHandle, StringInfo batch);
+
+
+/*
+ * ParallelCopyLocalTableIntoShards copies the rows of the local table into
+ * the shards through the given, already started, destination receiver by
+ * reading the table in parallel workers. It returns false without copying
+ * any rows when the table cannot be read in parallel or no workers could be
+ * launched, in which case the caller should copy the rows itself.
+ */
+bool
+ParallelCopyLocalTableIntoShards(Relation distributedRelation,
+								 CitusCopyDestReceiver *copyDest, uint64 *rowsCopied)
+{
+	if (!CanCopyLocalTableInParallel(distributedRelation, copyDest))
+	{
+		return false;
+	}
+
+	PrepareCopyToAllShards(copyDest);
+
+	Snapshot snapshot = GetActiveSnapshot();
+	int workerCount = LocalTableCopyParallelWorkers;
+
+	EnterParallelMode();
+
+	ParallelContext *parallelContext =
+		CreateParallelContext("citus", "CitusLocalTableCopyWorkerMain", workerCount);
+
+	Size scanSize = table_parallelscan_estimate(distributedRelation, snapshot);
+	Size queueSpaceSize = mul_size(LOCAL_TABLE_COPY_QUEUE_SIZE, workerCount);
+
+	shm_toc_estimate_chunk(&parallelContext->estimator, sizeof(LocalTableCopyShared));
+	shm_toc_estimate_chunk(&parallelContext->estimator, scanSize);
+	shm_toc_estimate_chunk(&parallelContext->estimator, queueSpaceSize);
+	shm_toc_estimate_keys(&parallelContext->estimator, CITUS_LOCAL_TABLE_COPY_NKEYS);
+
+	InitializeParallelDSM(parallelContext);
+
+	/* without dynamic shared memory, the context cannot have workers */
+	if (parallelContext->seg == NULL)
+	{
+		DestroyParallelContext(parallelContext);
+		ExitParallelMode();
+		return false;
+	}
+
+	shm_toc *toc = parallelContext->toc;
+
+	LocalTableCopyShared *shared = shm_toc_allocate(toc, sizeof(LocalTableCopyShared));
+	shared->relationId = RelationGetRelid(distributedRelation);
+	shared->binaryOutput = copyDest->copyOutState->binary;
+	shm_toc_insert(toc, CITUS_LOCAL_TABLE_COPY_KEY_SHARED, shared);
+
+	ParallelTableScanDesc parallelScan = shm_toc_allocate(toc, scanSize);
+	table_parallelscan_initialize(distributedRelation, parallelScan, snapshot);
+	shm_toc_insert(toc, CITUS_LOCAL_TABLE_COPY_KEY_SCAN, parallelScan);
+
+	char *queueSpace = shm_toc_allocate(toc, queueSpaceSize);
+	for (int workerIndex = 0; workerIndex < workerCount; workerIndex++)
+	{
+		Size queueOffset = mul_size(LOCAL_TABLE_COPY_QUEUE_SIZE, workerIndex);
+		shm_mq *queue = shm_mq_create(queueSpace + queueOffset,
+									  LOCAL_TABLE_COPY_QUEUE_SIZE);
+		shm_mq_set_receiver(queue, MyProc);
+	}
+	shm_toc_insert(toc, CITUS_LOCAL_TABLE_COPY_KEY_QUEUES, queueSpace);
+
+	LaunchParallelWorkers(parallelContext);
+
+	int launchedWorkerCount = parallelContext->nworkers_launched;
+	if (launchedWorkerCount == 0)
+	{
+		ereport(DEBUG1, (errmsg("could not launch parallel workers, copying the "
+								"local data in this backend")));
+
+		DestroyParallelContext(parallelContext);
+		ExitParallelMode();
+		return false;
+	}
+
+	ereport(DEBUG1, (errmsg("copying the local data in %d parallel workers",
+							launchedWorkerCount)));
+
+	shm_mq_handle **queueHandles = palloc0(launchedWorkerCount * sizeof(shm_mq_handle *));
+	for (int workerIndex = 0; workerIndex < launchedWorkerCount; workerIndex++)
+	{
+		Size queueOffset = mul_size(LOCAL_TABLE_COPY_QUEUE_SIZE, workerIndex);
+		shm_mq *queue = (shm_mq *) (queueSpace + queueOffset);
+
+		queueHandles[workerIndex] =
+			shm_mq_attach(queue, parallelContext->seg,
+						  parallelContext->worker[workerIndex].bgwhandle);
+	}
+
+	*rowsCopied = ForwardLocalTableCopyRows(parallelContext, queueHandles, copyDest);
+
+	/* rethrows the error of a worker that exited before sending all of its rows */
+	WaitForParallelWorkersToFinish(parallelContext);
+
+	for (int workerIndex = 0; workerIndex < launchedWorkerCount; workerIndex++)
+	{
+		shm_mq_detach(queueHandles[workerIndex]);
+	}
+
+	DestroyParallelContext(parallelContext);
+	ExitParallelMode();
+
+	return true;
+}
+
+
+/*
+ * CanCopyLocalTableInParallel returns whether the rows of the local table can
+ * be read by parallel workers and forwarded by the leader.
+ */
+static bool
+CanCopyLocalTableInParallel(Relation distributedRelation,
+							CitusCopyDestReceiver *copyDest)
+{
+	if (LocalTableCopyParallelWorkers <= 0 || IsInParallelMode())
+	{
+		return false;
+	}
+
+	/* other table access methods might not implement parallel scans */
+	if (distributedRelation->rd_rel->relam != HEAP_TABLE_AM_OID)
+	{
+		return false;
+	}
+
+	/* rows for local placements are copied from tuples in this backend */
+	if (copyDest->shouldUseLocalCopy ||
+		copyDest->colocatedIntermediateResultIdPrefix != NULL)
+	{
+		return false;
+	}
+
+	/* the target shard of append-distributed tables is picked up front */
+	if (IsCitusTableTypeCacheEntry(copyDest->tableCacheEntry, APPEND_DISTRIBUTED))
+	{
+		return false;
+	}
+
+	/* launching workers does not pay off for small tables */
+	BlockNumber blockCount = RelationGetNumberOfBlocks(distributedRelation);
+	if (blockCount < (BlockNumber) min_parallel_table_scan_size)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * PrepareCopyToAllShards opens the connections to the placements of all
+ * shards of the table, such that forwarding rows does not need to.
+ */
+static void
+PrepareCopyToAllShards(CitusCopyDestReceiver *copyDest)
+{
+	CitusTableCacheEntry *cacheEntry = copyDest->tableCacheEntry;
+
+	for (int shardIndex = 0; shardIndex < cacheEntry->shardIntervalArrayLength;
+		 shardIndex++)
+	{
+		CitusPrepareCopyToShard(copyDest, GetCachedShardId(cacheEntry, shardIndex));
+	}
+}
+
+
+/*
+ * ForwardLocalTableCopyRows sends the rows that the workers prepare to their
+ * shards until all workers are done, and returns the number of rows.
+ */
+static uint64
+ForwardLocalTableCopyRows(ParallelContext *parallelContext,
+						  shm_mq_handle **queueHandles,
+						  CitusCopyDestReceiver *copyDest)
+{
+	int workerCount = parallelContext->nworkers_launched;
+	bool *workerDone = palloc0(workerCount * sizeof(bool));
+	int doneWorkerCount = 0;
+	uint64 rowsCopied = 0;
+
+	while (doneWorkerCount < workerCount)
+	{
+		bool receivedMessage = false;
+
+		for (int workerIndex = 0; workerIndex < workerCount; workerIndex++)
+		{
+			Size messageLength = 0;
+			void *messageData = NULL;
+			const bool noWait = true;
+
+			if (workerDone[workerIndex])
+			{
+				continue;
+			}
+
+			shm_mq_result result = shm_mq_receive(queueHandles[workerIndex],
+												  &messageLength, &messageData, noWait);
+			if (result == SHM_MQ_WOULD_BLOCK)
+			{
+				continue;
+			}
+			else if (result == SHM_MQ_DETACHED)
+			{
+				/* workers detach once they sent all rows, or on error */
+				workerDone[workerIndex] = true;
+				doneWorkerCount++;
+				continue;
+			}
+
+			/* rows are read in place, the message stays valid until the next receive */
+			StringInfoData message = { 0 };
+			message.data = messageData;
+			message.len = messageLength;
+			message.maxlen = messageLength;
+			message.cursor = 0;
+
+			while (message.cursor < message.len)
+			{
+				uint64 shardId = (uint64) pq_getmsgint64(&message);
+				int rowLength = pq_getmsgint(&message, 4);
+
+				StringInfoData serializedRow = { 0 };
+				serializedRow.data = (char *) pq_getmsgbytes(&message, rowLength);
+				serializedRow.len = rowLength;
+				serializedRow.maxlen = rowLength;
+
+				if (rowsCopied == 0)
+				{
+					ereport(NOTICE, (errmsg("Copying data from local table...")));
+				}
+
+				CitusSendCopyRowToPlacements(copyDest, shardId, &serializedRow);
+
+				rowsCopied++;
+			}
+
+			receivedMessage = true;
+		}
+
+		if (!receivedMessage && doneWorkerCount < workerCount)
+		{
+			/* workers set our latch when they write to a queue or send an error */
+			(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_EXIT_ON_PM_DEATH, -1L,
+							 PG_WAIT_EXTENSION);
+			ResetLatch(MyLatch);
+		}
+
+		/* rethrows errors of the workers and makes sure we roll back on cancellation */
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	return rowsCopied;
+}
+
+
+/*
+ * CitusLocalTableCopyWorkerMain is the main function of a parallel worker that
+ * reads the local data of a table that is being distributed. It scans the
+ * blocks that the parallel scan hands out, and sends back batches of rows
+ * serialized for the worker nodes, each preceded by the id of its shard.
+ */
+void
+CitusLocalTableCopyWorkerMain(dsm_segment *segment, shm_toc *toc)
+{
+	LocalTableCopyShared *shared = shm_toc_lookup(toc, CITUS_LOCAL_TABLE_COPY_KEY_SHARED,
+												  false);
+	ParallelTableScanDesc parallelScan = shm_toc_lookup(toc,
+														CITUS_LOCAL_TABLE_COPY_KEY_SCAN,
+														false);
+	char *queueSpace = shm_toc_lookup(toc, CITUS_LOCAL_TABLE_COPY_KEY_QUEUES, false);
+
+	Size queueOffset = mul_size(LOCAL_TABLE_COPY_QUEUE_SIZE, ParallelWorkerNumber);
+	shm_mq *queue = (shm_mq *) (queueSpace + queueOffset);
+	shm_mq_set_sender(queue, MyProc);
+	shm_mq_handle *queueHandle = shm_mq_attach(queue, segment, NULL);
+
+	/* the ExclusiveLock of the leader does not conflict within the lock group */
+	Relation distributedRelation = table_open(shared->relationId, AccessShareLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+	List *columnNameList = NIL;
+	int partitionColumnIndex = INVALID_PARTITION_COLUMN_INDEX;
+
+	/* the metadata created by the leader is visible in its transaction */
+	Var *partitionColumn = PartitionColumn(shared->relationId, 0);
+	if (partitionColumn != NULL)
+	{
+		partitionColumnIndex = partitionColumn->varattno - 1;
+	}
+
+	/* use the same columns as the leader */
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute currentColumn = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (currentColumn->attisdropped ||
+			currentColumn->attgenerated == ATTRIBUTE_GENERATED_STORED)
+		{
+			continue;
+		}
+
+		columnNameList = lappend(columnNameList, NameStr(currentColumn->attname));
+	}
+
+	EState *executorState = CreateExecutorState();
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+
+	CitusCopyDestReceiver *copyDest = CreateCitusCopyDestReceiver(shared->relationId,
+																  columnNameList,
+																  partitionColumnIndex,
+																  executorState, NULL);
+	PrepareCopyRowSerialization(copyDest, distributedRelation, tupleDescriptor,
+								shared->binaryOutput);
+
+	CopyOutState copyOutState = copyDest->copyOutState;
+	StringInfo rowData = copyOutState->fe_msgbuf;
+	StringInfo batch = makeStringInfo();
+
+	TupleTableSlot *slot = table_slot_create(distributedRelation, NULL);
+	TableScanDesc scan = table_beginscan_parallel(distributedRelation, parallelScan);
+
+	while (table_scan_getnextslot(scan, ForwardScanDirection, slot))
+	{
+		ResetPerTupleExprContext(executorState);
+
+		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+		slot_getallattrs(slot);
+
+		uint64 shardId = ShardIdForTuple(copyDest, slot->tts_values, slot->tts_isnull);
+
+		resetStringInfo(rowData);
+		AppendCopyRowData(slot->tts_values, slot->tts_isnull, tupleDescriptor,
+						  copyOutState, copyDest->columnOutputFunctions,
+						  copyDest->columnCoercionPaths);
+
+		MemoryContextSwitchTo(oldContext);
+
+		pq_sendint64(batch, shardId);
+		pq_sendint32(batch, rowData->len);
+		pq_sendbytes(batch, rowData->data, rowData->len);
+
+		if (batch->len >= LOCAL_TABLE_COPY_BATCH_SIZE)
+		{
+			SendLocalTableCopyBatch(queueHandle, batch);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	SendLocalTableCopyBatch(queueHandle, batch);
+
+	table_endscan(scan);
+	ExecDropSingleTupleTableSlot(slot);
+	table_close(distributedRelation, NoLock);
+	FreeExecutorState(executorState);
+
+	/* the leader treats a detached queue as the end of our rows */
+	shm_mq_detach(queueHandle);
+}
+
+
+/*
+ * SendLocalTableCopyBatch sends a batch of serialized rows to the leader.
+ */
+static void
+SendLocalTableCopyBatch(shm_mq_handle *queueHandle, StringInfo batch)
+{
+	const bool noWait = false;
+	const bool forceFlush = true;
+
+	if (batch->len == 0)
+	{
+		return;
+	}
+
+	shm_mq_result result = shm_mq_send_compat(queueHandle, batch->len, batch->data,
+											  noWait, forceFlush);
+	if (result != SHM_MQ_SUCCESS)
+	{
+		ereport(ERROR, (errmsg("could not send rows to the parallel copy leader")));
+	}
+
+	resetStringInfo(batch);
+}
@@ -0,0 +1,1464 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_multi_copy.c
+ *    Parsing the input of a COPY into a distributed table in background
+ *    workers.
+ *
+ * A COPY into a distributed table spends most of its time on the coordinator
+ * parsing the input, calling input functions, finding the shard of each row
+ * and serializing the row again for the worker nodes. When
+ * citus.parallel_copy_workers is set, the backend that runs the COPY (the
+ * leader) splits the input at line boundaries and hands out chunks of lines
+ * to background workers in a round-robin fashion. Each worker parses its
+ * lines with the regular COPY machinery and sends the serialized rows back
+ * to the leader, together with the id of their shard.
+ *
+ * The leader keeps all connections to the shards and forwards the rows over
+ * them, such that the COPY still runs in a single distributed transaction
+ * and follows the usual connection management rules. Background workers do
+ * not share the snapshot or the locks of the leader, hence we only use them
+ * outside of transaction blocks, when the input does not need transcoding
+ * and when none of the rows have to be copied to local placements.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include <sys/stat.h>
+
+#include "distributed/pg_version_constants.h"
+
+#include "access/xact.h"
+#include "commands/copy.h"
+#include "commands/defrem.h"
+#include "commands/progress.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/parallel_multi_copy.h"
+#include "distributed/transmit.h"
+#include "distributed/version_compat.h"
+#include "executor/executor.h"
+#include "libpq/libpq.h"
+#include "libpq/pqformat.h"
+#include "libpq/pqmq.h"
+#include "mb/pg_wchar.h"
+#include "nodes/makefuncs.h"
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+#include "storage/fd.h"
+#include "storage/latch.h"
+#include "storage/lmgr.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/resowner.h"
+
+
+/* GUC, number of background workers that parse the input of a COPY */
+int ParallelCopyWorkers = 0;
+
+
+#define CITUS_PARALLEL_COPY_MAGIC 0x51028082
+#define CITUS_PARALLEL_COPY_KEY_SHARED 0
+#define CITUS_PARALLEL_COPY_KEY_GUC_STATE 1
+#define CITUS_PARALLEL_COPY_KEY_OPTIONS 2
+#define CITUS_PARALLEL_COPY_KEY_INPUT_QUEUES 3
+#define CITUS_PARALLEL_COPY_KEY_OUTPUT_QUEUES 4
+#define CITUS_PARALLEL_COPY_NKEYS 5
+
+/* size of each of the queues between the leader and a worker */
+#define PARALLEL_COPY_QUEUE_SIZE ((Size) 1024 * 1024)
+
+/* number of bytes of complete lines the leader sends to a worker at once */
+#define PARALLEL_COPY_CHUNK_SIZE (64 * 1024)
+
+/* number of bytes of serialized rows a worker sends to the leader at once */
+#define PARALLEL_COPY_BATCH_SIZE (64 * 1024)
+
+/* messages that workers send to the leader, next to 'E' and 'N' for errors */
+#define PARALLEL_COPY_MESSAGE_READY 'Z'
+#define PARALLEL_COPY_MESSAGE_ROWS 'd'
+#define PARALLEL_COPY_MESSAGE_DONE 'C'
+
+
+/*
+ * ParallelCopyShared is the fixed part of the shared memory segment that the
+ * leader passes to its workers.
+ */
+typedef struct ParallelCopyShared
+{
+	Oid databaseId;
+	Oid authenticatedUserId;
+	Oid currentUserId;
+	int securityContext;
+	Oid relationId;
+
+	/* whether rows are serialized in binary format for the worker nodes */
+	bool binaryOutput;
+
+	/* number of COPY options and column names in the options chunk */
+	int optionCount;
+	int attributeCount;
+} ParallelCopyShared;
+
+
+/*
+ * ParallelCopyWorker is the state the leader keeps for each of its workers.
+ */
+typedef struct ParallelCopyWorker
+{
+	BackgroundWorkerHandle *handle;
+
+	/* queue for sending chunks of lines to the worker */
+	shm_mq_handle *inputQueue;
+
+	/* queue for receiving serialized rows and errors from the worker */
+	shm_mq_handle *outputQueue;
+
+	/* whether the worker has sent all of its rows */
+	bool done;
+} ParallelCopyWorker;
+
+
+/*
+ * ParallelCopyLeader is the state of the backend that runs the COPY.
+ */
+typedef struct ParallelCopyLeader
+{
+	dsm_segment *segment;
+
+	int workerCount;
+	int doneWorkerCount;
+	ParallelCopyWorker *workers;
+
+	/* worker that receives the next chunk of lines */
+	int nextWorkerIndex;
+
+	/* destination that forwards the rows to the shards */
+	CitusCopyDestReceiver *copyDest;
+	uint64 processedRowCount;
+} ParallelCopyLeader;
+
+
+/*
+ * ParallelCopyInput holds the input of the COPY that has not been sent to a
+ * worker yet, together with the state of the search for line boundaries.
+ */
+typedef struct ParallelCopyInput
+{
+	/* file to read from, or NULL when reading from the client */
+	FILE *file;
+
+	/* buffer for COPY data messages from the client */
+	StringInfo messageBuffer;
+
+	/* input that was read, but not sent to a worker yet */
+	StringInfo buffer;
+
+	/* whether all input was read */
+	bool reachedEndOfInput;
+
+	/* whether a \. line ended the data */
+	bool reachedEndMarker;
+
+	/* number of bytes in the buffer that were searched for line boundaries */
+	int scanOffset;
+
+	/* number of bytes at the start of the buffer that form complete lines */
+	int lineEndOffset;
+
+	/* state of the search at scanOffset */
+	bool atLineStart;
+	bool inQuote;
+	bool lastWasEscape;
+
+	/* format of the input */
+	bool csvMode;
+	char quoteChar;
+	char escapeChar;
+} ParallelCopyInput;
+
+
+static bool CanUseParallelCopy(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest,
+							   ParallelCopyInput *input);
+static dsm_segment * StoreParallelCopyArgumentsInDSM(CopyStmt *copyStatement,
+													 CitusCopyDestReceiver *copyDest,
+													 int workerCount);
+static ParallelCopyLeader * StartParallelCopyWorkers(CopyStmt *copyStatement,
+													 CitusCopyDestReceiver *copyDest,
+													 int workerCount);
+static bool WaitForParallelCopyWorkersReady(ParallelCopyLeader *leader);
+static void TerminateParallelCopyWorkers(ParallelCopyLeader *leader);
+static void SendChunkToParallelCopyWorker(ParallelCopyLeader *leader, char *chunk,
+										  int chunkLength);
+static bool ConsumeParallelCopyOutput(ParallelCopyLeader *leader);
+static void ProcessParallelCopyMessage(ParallelCopyLeader *leader,
+									   ParallelCopyWorker *worker,
+									   StringInfo message);
+static void ThrowParallelCopyWorkerMessage(StringInfo message);
+static void WaitForParallelCopyProgress(void);
+static void OpenParallelCopyInput(ParallelCopyInput *input, CopyStmt *copyStatement,
+								  CitusCopyDestReceiver *copyDest);
+static void SendParallelCopyInStart(int columnCount);
+static void CloseParallelCopyInput(ParallelCopyInput *input);
+static int NextParallelCopyChunk(ParallelCopyInput *input);
+static void ReadParallelCopyInput(ParallelCopyInput *input);
+static void ScanParallelCopyInput(ParallelCopyInput *input);
+static void RemoveChunkFromParallelCopyInput(ParallelCopyInput *input, int chunkLength);
+static CopyStmt * ParallelCopyStatement(ParallelCopyShared *shared, char *options);
+static int ReadParallelCopyChunkCallback(void *outbuf, int minread, int maxread);
+static void FlushParallelCopyBatch(StringInfo batch);
+
+
+/* queue from which a worker reads its input, and the chunk that is being read */
+static shm_mq_handle *ParallelCopyInputQueue = NULL;
+static char *ParallelCopyInputChunk = NULL;
+static Size ParallelCopyInputChunkRemaining = 0;
+static bool ParallelCopyInputDetached = false;
+
+
+/*
+ * ParallelCopyToExistingShards parses the input of the COPY statement in
+ * background workers and sends the rows they prepare to the shards through
+ * the given, already started, destination receiver. It returns false without
+ * reading any input when the COPY cannot run in parallel, in which case the
+ * caller should parse the input itself.
+ */
+bool
+ParallelCopyToExistingShards(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest,
+							 uint64 *processedRowCount)
+{
+	ParallelCopyInput input = { 0 };
+
+	if (!CanUseParallelCopy(copyStatement, copyDest, &input))
+	{
+		return false;
+	}
+
+	ParallelCopyLeader *leader = StartParallelCopyWorkers(copyStatement, copyDest,
+														  ParallelCopyWorkers);
+	if (leader == NULL)
+	{
+		ereport(DEBUG1, (errmsg("could not start parallel COPY workers, parsing "
+								"the input in this backend")));
+		return false;
+	}
+
+	ereport(DEBUG1, (errmsg("parsing the COPY input in %d background workers",
+							leader->workerCount)));
+
+	OpenParallelCopyInput(&input, copyStatement, copyDest);
+
+	int chunkLength = NextParallelCopyChunk(&input);
+	while (chunkLength > 0)
+	{
+		SendChunkToParallelCopyWorker(leader, input.buffer->data, chunkLength);
+		RemoveChunkFromParallelCopyInput(&input, chunkLength);
+
+		/* forward the rows that are already prepared */
+		ConsumeParallelCopyOutput(leader);
+
+		chunkLength = NextParallelCopyChunk(&input);
+	}
+
+	CloseParallelCopyInput(&input);
+
+	/* workers treat a detached input queue as the end of their input */
+	for (int workerIndex = 0; workerIndex < leader->workerCount; workerIndex++)
+	{
+		shm_mq_detach(leader->workers[workerIndex].inputQueue);
+	}
+
+	while (leader->doneWorkerCount < leader->workerCount)
+	{
+		if (!ConsumeParallelCopyOutput(leader))
+		{
+			WaitForParallelCopyProgress();
+		}
+	}
+
+	for (int workerIndex = 0; workerIndex < leader->workerCount; workerIndex++)
+	{
+		shm_mq_detach(leader->workers[workerIndex].outputQueue);
+	}
+
+	dsm_detach(leader->segment);
+
+	*processedRowCount = leader->processedRowCount;
+
+	return true;
+}
+
+
+/*
+ * CanUseParallelCopy returns whether the input of the COPY statement can be
+ * parsed by background workers, and sets the format of the input.
+ */
+static bool
+CanUseParallelCopy(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest,
+				   ParallelCopyInput *input)
+{
+	DefElem *option = NULL;
+	bool escapeCharGiven = false;
+
+	if (ParallelCopyWorkers <= 0)
+	{
+		return false;
+	}
+
+	/* workers cannot see the changes of the current transaction */
+	if (IsTransactionBlock() || GetTopTransactionIdIfAny() != InvalidTransactionId)
+	{
+		return false;
+	}
+
+	/* rows for local placements are copied from tuples in this backend */
+	if (copyDest->shouldUseLocalCopy ||
+		copyDest->colocatedIntermediateResultIdPrefix != NULL)
+	{
+		return false;
+	}
+
+	/* the target shard of append-distributed tables is picked up front */
+	if (IsCitusTableType(copyDest->distributedRelationId, APPEND_DISTRIBUTED))
+	{
+		return false;
+	}
+
+	/* the output of a program is read by the backend that runs it */
+	if (copyStatement->is_program)
+	{
+		return false;
+	}
+
+	if (copyStatement->filename == NULL && whereToSendOutput != DestRemote)
+	{
+		return false;
+	}
+
+#if PG_VERSION_NUM < PG_VERSION_14
+	if (copyStatement->filename == NULL && PG_PROTOCOL_MAJOR(FrontendProtocol) < 3)
+	{
+		return false;
+	}
+#endif
+
+	/* line boundaries are only searched for in the database encoding */
+	if (pg_get_client_encoding() != GetDatabaseEncoding())
+	{
+		return false;
+	}
+
+	input->csvMode = false;
+	input->quoteChar = '"';
+
+	foreach_ptr(option, copyStatement->options)
+	{
+		/* options are passed to the workers as strings */
+		if (option->arg != NULL && (IsA(option->arg, List) || IsA(option->arg, A_Star)))
+		{
+			return false;
+		}
+
+		if (strcmp(option->defname, "format") == 0)
+		{
+			char *format = defGetString(option);
+
+			if (strcmp(format, "csv") == 0)
+			{
+				input->csvMode = true;
+			}
+			else if (strcmp(format, "text") != 0)
+			{
+				return false;
+			}
+		}
+		else if (strcmp(option->defname, "header") == 0 ||
+				 strcmp(option->defname, "encoding") == 0)
+		{
+			return false;
+		}
+		else if (strcmp(option->defname, "quote") == 0 ||
+				 strcmp(option->defname, "escape") == 0)
+		{
+			char *character = defGetString(option);
+
+			/* let the regular COPY report invalid options */
+			if (strlen(character) != 1)
+			{
+				return false;
+			}
+
+			if (strcmp(option->defname, "quote") == 0)
+			{
+				input->quoteChar = character[0];
+			}
+			else
+			{
+				input->escapeChar = character[0];
+				escapeCharGiven = true;
+			}
+		}
+	}
+
+	if (!escapeCharGiven)
+	{
+		input->escapeChar = input->quoteChar;
+	}
+
+	return true;
+}
+
+
+/*
+ * StoreParallelCopyArgumentsInDSM creates the dynamic shared memory segment
+ * that holds the COPY options, the settings of the current session and the
+ * queues between the leader and each of its workers.
+ */
+static dsm_segment *
+StoreParallelCopyArgumentsInDSM(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest,
+								int workerCount)
+{
+	StringInfo options = makeStringInfo();
+	DefElem *option = NULL;
+	String *attributeName = NULL;
+
+	/* serialize the options as names followed by an optional string value */
+	foreach_ptr(option, copyStatement->options)
+	{
+		appendStringInfoString(options, option->defname);
+		appendStringInfoChar(options, '\0');
+
+		if (option->arg != NULL)
+		{
+			appendStringInfoChar(options, 'v');
+			appendStringInfoString(options, defGetString(option));
+			appendStringInfoChar(options, '\0');
+		}
+		else
+		{
+			appendStringInfoChar(options, 'n');
+		}
+	}
+
+	foreach_ptr(attributeName, copyStatement->attlist)
+	{
+		appendStringInfoString(options, strVal(attributeName));
+		appendStringInfoChar(options, '\0');
+	}
+
+	Size gucStateSize = EstimateGUCStateSpace();
+	Size queueSpaceSize = mul_size(PARALLEL_COPY_QUEUE_SIZE, workerCount);
+
+	shm_toc_estimator e = { 0 };
+	shm_toc_initialize_estimator(&e);
+	shm_toc_estimate_chunk(&e, sizeof(ParallelCopyShared));
+	shm_toc_estimate_chunk(&e, gucStateSize);
+	shm_toc_estimate_chunk(&e, options->len + 1);
+	shm_toc_estimate_chunk(&e, queueSpaceSize);
+	shm_toc_estimate_chunk(&e, queueSpaceSize);
+	shm_toc_estimate_keys(&e, CITUS_PARALLEL_COPY_NKEYS);
+	Size segmentSize = shm_toc_estimate(&e);
+
+	dsm_segment *segment = dsm_create(segmentSize, DSM_CREATE_NULL_IF_MAXSEGMENTS);
+	if (segment == NULL)
+	{
+		return NULL;
+	}
+
+	shm_toc *toc = shm_toc_create(CITUS_PARALLEL_COPY_MAGIC,
+								  dsm_segment_address(segment), segmentSize);
+
+	ParallelCopyShared *shared = shm_toc_allocate(toc, sizeof(ParallelCopyShared));
+	shared->databaseId = MyDatabaseId;
+	shared->authenticatedUserId = GetAuthenticatedUserId();
+	GetUserIdAndSecContext(&shared->currentUserId, &shared->securityContext);
+	shared->relationId = copyDest->distributedRelationId;
+	shared->binaryOutput = copyDest->copyOutState->binary;
+	shared->optionCount = list_length(copyStatement->options);
+	shared->attributeCount = list_length(copyStatement->attlist);
+	shm_toc_insert(toc, CITUS_PARALLEL_COPY_KEY_SHARED, shared);
+
+	char *gucState = shm_toc_allocate(toc, gucStateSize);
+	SerializeGUCState(gucStateSize, gucState);
+	shm_toc_insert(toc, CITUS_PARALLEL_COPY_KEY_GUC_STATE, gucState);
+
+	char *optionsTarget = shm_toc_allocate(toc, options->len + 1);
+	memcpy_s(optionsTarget, options->len + 1, options->data, options->len + 1);
+	shm_toc_insert(toc, CITUS_PARALLEL_COPY_KEY_OPTIONS, optionsTarget);
+
+	char *inputQueueSpace = shm_toc_allocate(toc, queueSpaceSize);
+	char *outputQueueSpace = shm_toc_allocate(toc, queueSpaceSize);
+
+	for (int workerIndex = 0; workerIndex < workerCount; workerIndex++)
+	{
+		Size queueOffset = mul_size(PARALLEL_COPY_QUEUE_SIZE, workerIndex);
+
+		shm_mq *inputQueue = shm_mq_create(inputQueueSpace + queueOffset,
+										   PARALLEL_COPY_QUEUE_SIZE);
+		shm_mq_set_sender(inputQueue, MyProc);
+
+		shm_mq *outputQueue = shm_mq_create(outputQueueSpace + queueOffset,
+											PARALLEL_COPY_QUEUE_SIZE);
+		shm_mq_set_receiver(outputQueue, MyProc);
+	}
+
+	shm_toc_insert(toc, CITUS_PARALLEL_COPY_KEY_INPUT_QUEUES, inputQueueSpace);
+	shm_toc_insert(toc, CITUS_PARALLEL_COPY_KEY_OUTPUT_QUEUES, outputQueueSpace);
+
+	return segment;
+}
+
+
+/*
+ * StartParallelCopyWorkers registers up to workerCount background workers for
+ * the COPY and waits until they are ready to parse input. It returns NULL when
+ * none of the workers could be started.
+ */
+static ParallelCopyLeader *
+StartParallelCopyWorkers(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest,
+						 int workerCount)
+{
+	dsm_segment *segment = StoreParallelCopyArgumentsInDSM(copyStatement, copyDest,
+														   workerCount);
+	if (segment == NULL)
+	{
+		return NULL;
+	}
+
+	shm_toc *toc = shm_toc_attach(CITUS_PARALLEL_COPY_MAGIC,
+								  dsm_segment_address(segment));
+	char *inputQueueSpace = shm_toc_lookup(toc, CITUS_PARALLEL_COPY_KEY_INPUT_QUEUES,
+										   false);
+	char *outputQueueSpace = shm_toc_lookup(toc, CITUS_PARALLEL_COPY_KEY_OUTPUT_QUEUES,
+											false);
+
+	ParallelCopyLeader *leader = palloc0(sizeof(ParallelCopyLeader));
+	leader->segment = segment;
+	leader->copyDest = copyDest;
+	leader->workers = palloc0(workerCount * sizeof(ParallelCopyWorker));
+
+	for (int workerIndex = 0; workerIndex < workerCount; workerIndex++)
+	{
+		BackgroundWorker worker = { 0 };
+		SafeSnprintf(worker.bgw_name, BGW_MAXLEN,
+					 "Citus Parallel COPY Worker %d for PID %d",
+					 workerIndex, MyProcPid);
+		worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+		worker.bgw_start_time = BgWorkerStart_ConsistentState;
+
+		/* the leader parses the input itself if a worker fails to start */
+		worker.bgw_restart_time = BGW_NEVER_RESTART;
+		strcpy_s(worker.bgw_library_name, sizeof(worker.bgw_library_name), "citus");
+		strcpy_s(worker.bgw_function_name, sizeof(worker.bgw_function_name),
+				 "CitusParallelCopyWorkerMain");
+		worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(segment));
+		memcpy_s(worker.bgw_extra, sizeof(worker.bgw_extra), &workerIndex,
+				 sizeof(int));
+		worker.bgw_notify_pid = MyProcPid;
+
+		BackgroundWorkerHandle *handle = NULL;
+		if (!RegisterDynamicBackgroundWorker(&worker, &handle))
+		{
+			/* continue with the workers we could register */
+			break;
+		}
+
+		Size queueOffset = mul_size(PARALLEL_COPY_QUEUE_SIZE, workerIndex);
+		shm_mq *inputQueue = (shm_mq *) (inputQueueSpace + queueOffset);
+		shm_mq *outputQueue = (shm_mq *) (outputQueueSpace + queueOffset);
+
+		ParallelCopyWorker *copyWorker = &leader->workers[workerIndex];
+		copyWorker->handle = handle;
+		copyWorker->inputQueue = shm_mq_attach(inputQueue, segment, handle);
+		copyWorker->outputQueue = shm_mq_attach(outputQueue, segment, handle);
+
+		leader->workerCount++;
+	}
+
+	if (leader->workerCount == 0 || !WaitForParallelCopyWorkersReady(leader))
+	{
+		TerminateParallelCopyWorkers(leader);
+		return NULL;
+	}
+
+	return leader;
+}
+
+
+/*
+ * WaitForParallelCopyWorkersReady waits until all workers are ready to parse
+ * input, meaning they locked the relation and prepared the COPY. It returns
+ * false when a worker failed to do so.
+ */
+static bool
+WaitForParallelCopyWorkersReady(ParallelCopyLeader *leader)
+{
+	for (int workerIndex = 0; workerIndex < leader->workerCount; workerIndex++)
+	{
+		ParallelCopyWorker *worker = &leader->workers[workerIndex];
+		bool ready = false;
+
+		while (!ready)
+		{
+			Size messageLength = 0;
+			void *messageData = NULL;
+			const bool noWait = false;
+
+			/* we get SHM_MQ_DETACHED when the worker did not start or exited */
+			shm_mq_result result = shm_mq_receive(worker->outputQueue, &messageLength,
+												  &messageData, noWait);
+			if (result != SHM_MQ_SUCCESS)
+			{
+				return false;
+			}
+
+			StringInfoData message = { 0 };
+			initStringInfo(&message);
+			appendBinaryStringInfo(&message, messageData, messageLength);
+
+			char messageType = pq_getmsgbyte(&message);
+			if (messageType == PARALLEL_COPY_MESSAGE_READY)
+			{
+				ready = true;
+			}
+			else if (messageType == 'E')
+			{
+				ErrorData errorData = { 0 };
+				pq_parse_errornotice(&message, &errorData);
+
+				ereport(DEBUG1, (errmsg("parallel COPY worker failed to start: %s",
+										errorData.message)));
+				return false;
+			}
+			else
+			{
+				ThrowParallelCopyWorkerMessage(&message);
+			}
+
+			pfree(message.data);
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * TerminateParallelCopyWorkers stops the workers of a COPY that did not get
+ * to run in parallel, and releases the shared memory.
+ */
+static void
+TerminateParallelCopyWorkers(ParallelCopyLeader *leader)
+{
+	for (int workerIndex = 0; workerIndex < leader->workerCount; workerIndex++)
+	{
+		ParallelCopyWorker *worker = &leader->workers[workerIndex];
+
+		TerminateBackgroundWorker(worker->handle);
+		shm_mq_detach(worker->inputQueue);
+		shm_mq_detach(worker->outputQueue);
+	}
+
+	dsm_detach(leader->segment);
+}
+
+
+/*
+ * SendChunkToParallelCopyWorker sends a chunk of complete lines to the next
+ * worker. While the queue of the worker is full, it forwards the rows that
+ * workers prepared to make room.
+ */
+static void
+SendChunkToParallelCopyWorker(ParallelCopyLeader *leader, char *chunk, int chunkLength)
+{
+	ParallelCopyWorker *worker = &leader->workers[leader->nextWorkerIndex];
+	leader->nextWorkerIndex = (leader->nextWorkerIndex + 1) % leader->workerCount;
+
+	while (true)
+	{
+		const bool noWait = true;
+		const bool forceFlush = true;
+
+		/* a partially sent chunk is continued on the next call */
+		shm_mq_result result = shm_mq_send_compat(worker->inputQueue, chunkLength,
+												  chunk, noWait, forceFlush);
+		if (result == SHM_MQ_SUCCESS)
+		{
+			break;
+		}
+		else if (result == SHM_MQ_DETACHED)
+		{
+			/* report the error of the worker if it sent one */
+			ConsumeParallelCopyOutput(leader);
+
+			ereport(ERROR, (errmsg("parallel COPY worker exited unexpectedly")));
+		}
+
+		if (!ConsumeParallelCopyOutput(leader))
+		{
+			WaitForParallelCopyProgress();
+		}
+	}
+}
+
+
+/*
+ * ConsumeParallelCopyOutput processes the messages that are available in the
+ * output queues of the workers without waiting for more. It returns whether
+ * any message was processed.
+ */
+static bool
+ConsumeParallelCopyOutput(ParallelCopyLeader *leader)
+{
+	bool receivedMessage = false;
+
+	for (int workerIndex = 0; workerIndex < leader->workerCount; workerIndex++)
+	{
+		ParallelCopyWorker *worker = &leader->workers[workerIndex];
+
+		while (!worker->done)
+		{
+			Size messageLength = 0;
+			void *messageData = NULL;
+			const bool noWait = true;
+
+			shm_mq_result result = shm_mq_receive(worker->outputQueue, &messageLength,
+												  &messageData, noWait);
+			if (result == SHM_MQ_WOULD_BLOCK)
+			{
+				break;
+			}
+			else if (result == SHM_MQ_DETACHED)
+			{
+				ereport(ERROR, (errmsg("parallel COPY worker exited unexpectedly")));
+			}
+
+			/* rows are read in place, the message stays valid until the next receive */
+			StringInfoData message = { 0 };
+			message.data = messageData;
+			message.len = messageLength;
+			message.maxlen = messageLength;
+			message.cursor = 0;
+
+			ProcessParallelCopyMessage(leader, worker, &message);
+			receivedMessage = true;
+		}
+	}
+
+	return receivedMessage;
+}
+
+
+/*
+ * ProcessParallelCopyMessage handles a message from a worker. Batches of rows
+ * are forwarded to their shards, errors and notices are rethrown.
+ */
+static void
+ProcessParallelCopyMessage(ParallelCopyLeader *leader, ParallelCopyWorker *worker,
+						   StringInfo message)
+{
+	char messageType = pq_getmsgbyte(message);
+
+	switch (messageType)
+	{
+		case PARALLEL_COPY_MESSAGE_ROWS:
+		{
+			while (message->cursor < message->len)
+			{
+				uint64 shardId = (uint64) pq_getmsgint64(message);
+				int rowLength = pq_getmsgint(message, 4);
+
+				StringInfoData serializedRow = { 0 };
+				serializedRow.data = (char *) pq_getmsgbytes(message, rowLength);
+				serializedRow.len = rowLength;
+				serializedRow.maxlen = rowLength;
+
+				CitusSendCopyRowToPlacements(leader->copyDest, shardId, &serializedRow);
+
+				leader->processedRowCount++;
+			}
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+			pgstat_progress_update_param(PROGRESS_COPY_TUPLES_PROCESSED,
+										 leader->processedRowCount);
+#endif
+			break;
+		}
+
+		case PARALLEL_COPY_MESSAGE_DONE:
+		{
+			worker->done = true;
+			leader->doneWorkerCount++;
+			break;
+		}
+
+		case 'E':
+		case 'N':
+		{
+			/* the message is parsed as a string, so copy it */
+			StringInfoData errorMessage = { 0 };
+			initStringInfo(&errorMessage);
+			appendBinaryStringInfo(&errorMessage, message->data, message->len);
+			errorMessage.cursor = message->cursor;
+
+			ThrowParallelCopyWorkerMessage(&errorMessage);
+			break;
+		}
+
+		default:
+		{
+			ereport(ERROR, (errmsg("unexpected message type %c from parallel COPY "
+								   "worker", messageType)));
+		}
+	}
+}
+
+
+/*
+ * ThrowParallelCopyWorkerMessage rethrows an error or notice of a worker, of
+ * which the message type was already read, in the leader.
+ */
+static void
+ThrowParallelCopyWorkerMessage(StringInfo message)
+{
+	ErrorData errorData = { 0 };
+	pq_parse_errornotice(message, &errorData);
+
+	/* errors in workers are promoted to FATAL, but only fail the COPY */
+	errorData.elevel = Min(errorData.elevel, ERROR);
+
+	if (errorData.context != NULL)
+	{
+		errorData.context = psprintf("%s\nparallel COPY worker", errorData.context);
+	}
+	else
+	{
+		errorData.context = pstrdup("parallel COPY worker");
+	}
+
+	ThrowErrorData(&errorData);
+}
+
+
+/*
+ * WaitForParallelCopyProgress waits until a worker reads from or writes to
+ * one of its queues.
+ */
+static void
+WaitForParallelCopyProgress(void)
+{
+	(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_EXIT_ON_PM_DEATH, -1L,
+					 PG_WAIT_EXTENSION);
+	ResetLatch(MyLatch);
+
+	CHECK_FOR_INTERRUPTS();
+}
+
+
+/*
+ * OpenParallelCopyInput opens the file of the COPY, or starts receiving COPY
+ * data from the client.
+ */
+static void
+OpenParallelCopyInput(ParallelCopyInput *input, CopyStmt *copyStatement,
+					  CitusCopyDestReceiver *copyDest)
+{
+	input->buffer = makeStringInfo();
+	input->messageBuffer = makeStringInfo();
+	input->atLineStart = true;
+
+	if (copyStatement->filename != NULL)
+	{
+		struct stat fileStat;
+
+		input->file = AllocateFile(copyStatement->filename, PG_BINARY_R);
+		if (input->file == NULL)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not open file \"%s\" for reading: %m",
+								   copyStatement->filename)));
+		}
+
+		if (fstat(fileno(input->file), &fileStat) != 0)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not stat file \"%s\": %m",
+								   copyStatement->filename)));
+		}
+
+		if (S_ISDIR(fileStat.st_mode))
+		{
+			ereport(ERROR, (errcode(ERRCODE_WRONG_OBJECT_TYPE),
+							errmsg("\"%s\" is a directory", copyStatement->filename)));
+		}
+	}
+	else
+	{
+		int columnCount = list_length(copyStatement->attlist);
+		if (columnCount == 0)
+		{
+			columnCount = list_length(copyDest->columnNameList);
+		}
+
+		SendParallelCopyInStart(columnCount);
+	}
+}
+
+
+/*
+ * SendParallelCopyInStart asks the client to start sending COPY data in text
+ * format.
+ */
+static void
+SendParallelCopyInStart(int columnCount)
+{
+	StringInfoData copyInStart = { NULL, 0, 0, 0 };
+	const char copyFormat = 0; /* text copy format */
+
+	pq_beginmessage(&copyInStart, 'G');
+	pq_sendbyte(&copyInStart, copyFormat);
+	pq_sendint16(&copyInStart, columnCount);
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		pq_sendint16(&copyInStart, copyFormat);
+	}
+	pq_endmessage(&copyInStart);
+
+	/* flush here to ensure that FE knows it can send data */
+	pq_flush();
+}
+
+
+/*
+ * CloseParallelCopyInput closes the file of the COPY. When the data ended
+ * with \. we still consume the remaining messages of the client.
+ */
+static void
+CloseParallelCopyInput(ParallelCopyInput *input)
+{
+	if (input->file != NULL)
+	{
+		FreeFile(input->file);
+		input->file = NULL;
+	}
+	else
+	{
+		while (!input->reachedEndOfInput)
+		{
+			input->reachedEndOfInput = ReceiveCopyData(input->messageBuffer);
+		}
+	}
+}
+
+
+/*
+ * NextParallelCopyChunk reads input until the buffer starts with at least
+ * PARALLEL_COPY_CHUNK_SIZE bytes of complete lines, or until the input ends.
+ * It returns the number of bytes to send to a worker, which is 0 once all
+ * input was sent.
+ */
+static int
+NextParallelCopyChunk(ParallelCopyInput *input)
+{
+	while (true)
+	{
+		ScanParallelCopyInput(input);
+
+		if (input->reachedEndMarker)
+		{
+			return input->lineEndOffset;
+		}
+		else if (input->reachedEndOfInput)
+		{
+			/* the last line does not need to end with a newline */
+			return input->buffer->len;
+		}
+		else if (input->lineEndOffset >= PARALLEL_COPY_CHUNK_SIZE)
+		{
+			return input->lineEndOffset;
+		}
+
+		ReadParallelCopyInput(input);
+	}
+}
+
+
+/*
+ * ReadParallelCopyInput appends the next part of the input to the buffer.
+ */
+static void
+ReadParallelCopyInput(ParallelCopyInput *input)
+{
+	StringInfo buffer = input->buffer;
+
+	if (input->file != NULL)
+	{
+		enlargeStringInfo(buffer, PARALLEL_COPY_CHUNK_SIZE);
+
+		size_t bytesRead = fread(buffer->data + buffer->len, 1,
+								 PARALLEL_COPY_CHUNK_SIZE, input->file);
+		if (ferror(input->file))
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not read from COPY file: %m")));
+		}
+
+		if (bytesRead == 0)
+		{
+			input->reachedEndOfInput = true;
+		}
+
+		buffer->len += bytesRead;
+		buffer->data[buffer->len] = '\0';
+	}
+	else
+	{
+		bool copyDone = ReceiveCopyData(input->messageBuffer);
+		if (copyDone)
+		{
+			input->reachedEndOfInput = true;
+		}
+		else
+		{
+			appendBinaryStringInfo(buffer, input->messageBuffer->data,
+								   input->messageBuffer->len);
+		}
+	}
+
+	CHECK_FOR_INTERRUPTS();
+}
+
+
+/*
+ * ScanParallelCopyInput searches the buffer for line boundaries, following
+ * the escaping rules of the text format and the quoting rules of the csv
+ * format. It stops early when it needs to see more input to make a decision,
+ * and when it finds a line with only \. on it, which ends the data.
+ */
+static void
+ScanParallelCopyInput(ParallelCopyInput *input)
+{
+	char *data = input->buffer->data;
+	int length = input->buffer->len;
+	bool endOfInput = input->reachedEndOfInput;
+	int offset = input->scanOffset;
+
+	if (input->reachedEndMarker)
+	{
+		return;
+	}
+
+	while (offset < length)
+	{
+		char currentChar = data[offset];
+
+		if (input->atLineStart && currentChar == '\\')
+		{
+			if (offset + 2 >= length && !endOfInput)
+			{
+				break;
+			}
+
+			if (offset + 1 < length && data[offset + 1] == '.' &&
+				(offset + 2 >= length || data[offset + 2] == '\n' ||
+				 data[offset + 2] == '\r'))
+			{
+				input->reachedEndMarker = true;
+				input->lineEndOffset = offset;
+				break;
+			}
+		}
+
+		if (!input->csvMode && currentChar == '\\')
+		{
+			/* in text format, a backslash escapes the next byte, even a newline */
+			if (offset + 1 >= length && !endOfInput)
+			{
+				break;
+			}
+
+			input->atLineStart = false;
+			offset += 2;
+			continue;
+		}
+
+		if (currentChar == '\r' && !input->inQuote && offset + 1 >= length &&
+			!endOfInput)
+		{
+			/* we need to see whether a newline follows */
+			break;
+		}
+
+		input->atLineStart = false;
+
+		if (input->csvMode)
+		{
+			if (input->lastWasEscape)
+			{
+				input->lastWasEscape = false;
+			}
+			else if (input->inQuote && currentChar == input->escapeChar &&
+					 input->escapeChar != input->quoteChar)
+			{
+				input->lastWasEscape = true;
+			}
+			else if (currentChar == input->quoteChar)
+			{
+				input->inQuote = !input->inQuote;
+			}
+		}
+
+		offset++;
+
+		if ((currentChar == '\n' || currentChar == '\r') && !input->inQuote)
+		{
+			/* \r\n is a single line ending */
+			if (currentChar == '\r' && offset < length && data[offset] == '\n')
+			{
+				offset++;
+			}
+
+			input->lineEndOffset = offset;
+			input->atLineStart = true;
+		}
+	}
+
+	input->scanOffset = Min(offset, length);
+}
+
+
+/*
+ * RemoveChunkFromParallelCopyInput removes a chunk that was sent to a worker
+ * from the start of the buffer.
+ */
+static void
+RemoveChunkFromParallelCopyInput(ParallelCopyInput *input, int chunkLength)
+{
+	StringInfo buffer = input->buffer;
+	int remainingLength = buffer->len - chunkLength;
+
+	if (remainingLength > 0)
+	{
+		memmove_s(buffer->data, buffer->maxlen, buffer->data + chunkLength,
+				  remainingLength);
+	}
+
+	buffer->len = remainingLength;
+	buffer->data[buffer->len] = '\0';
+
+	input->scanOffset = Max(input->scanOffset - chunkLength, 0);
+	input->lineEndOffset = Max(input->lineEndOffset - chunkLength, 0);
+}
+
+
+/*
+ * CitusParallelCopyWorkerMain is the main function of a parallel COPY worker.
+ * It parses the chunks of lines it receives from the leader, and sends back
+ * batches of rows serialized for the worker nodes, each preceded by the id of
+ * its shard.
+ */
+void
+CitusParallelCopyWorkerMain(Datum main_arg)
+{
+	int workerIndex = 0;
+	memcpy_s(&workerIndex, sizeof(workerIndex), MyBgworkerEntry->bgw_extra,
+			 sizeof(int));
+
+	BackgroundWorkerUnblockSignals();
+
+	/* set up a memory context and resource owner */
+	Assert(CurrentResourceOwner == NULL);
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "citus parallel copy worker");
+	CurrentMemoryContext = AllocSetContextCreate(TopMemoryContext,
+												 "citus parallel copy worker",
+												 ALLOCSET_DEFAULT_SIZES);
+
+	dsm_segment *segment = dsm_attach(DatumGetUInt32(main_arg));
+	if (segment == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("unable to map dynamic shared memory segment")));
+	}
+
+	shm_toc *toc = shm_toc_attach(CITUS_PARALLEL_COPY_MAGIC,
+								  dsm_segment_address(segment));
+	if (toc == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("bad magic number in dynamic shared memory segment")));
+	}
+
+	ParallelCopyShared *shared = shm_toc_lookup(toc, CITUS_PARALLEL_COPY_KEY_SHARED,
+												false);
+	char *gucState = shm_toc_lookup(toc, CITUS_PARALLEL_COPY_KEY_GUC_STATE, false);
+	char *options = shm_toc_lookup(toc, CITUS_PARALLEL_COPY_KEY_OPTIONS, false);
+	char *inputQueueSpace = shm_toc_lookup(toc, CITUS_PARALLEL_COPY_KEY_INPUT_QUEUES,
+										   false);
+	char *outputQueueSpace = shm_toc_lookup(toc, CITUS_PARALLEL_COPY_KEY_OUTPUT_QUEUES,
+											false);
+
+	Size queueOffset = mul_size(PARALLEL_COPY_QUEUE_SIZE, workerIndex);
+	shm_mq *inputQueue = (shm_mq *) (inputQueueSpace + queueOffset);
+	shm_mq *outputQueue = (shm_mq *) (outputQueueSpace + queueOffset);
+
+	shm_mq_set_receiver(inputQueue, MyProc);
+	ParallelCopyInputQueue = shm_mq_attach(inputQueue, segment, NULL);
+
+	/* from here on, errors are sent to the leader */
+	shm_mq_set_sender(outputQueue, MyProc);
+	shm_mq_handle *outputQueueHandle = shm_mq_attach(outputQueue, segment, NULL);
+	pq_redirect_to_shm_mq(segment, outputQueueHandle);
+
+	BackgroundWorkerInitializeConnectionByOid(shared->databaseId,
+											  shared->authenticatedUserId, 0);
+
+	StartTransactionCommand();
+
+	/* parse the input with the settings of the leader, e.g. DateStyle */
+	RestoreGUCState(gucState);
+	SetUserIdAndSecContext(shared->currentUserId, shared->securityContext);
+
+	/*
+	 * The leader holds a RowExclusiveLock on the relation. We should not wait
+	 * behind a conflicting lock that waits for the leader, since the deadlock
+	 * detector does not know that the leader waits for us.
+	 */
+	if (!ConditionalLockRelationOid(shared->relationId, AccessShareLock))
+	{
+		ereport(ERROR, (errcode(ERRCODE_LOCK_NOT_AVAILABLE),
+						errmsg("could not lock relation with OID %u",
+							   shared->relationId)));
+	}
+
+	Relation distributedRelation = table_open(shared->relationId, NoLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+	uint32 columnCount = tupleDescriptor->natts;
+	List *columnNameList = NIL;
+	int partitionColumnIndex = INVALID_PARTITION_COLUMN_INDEX;
+
+	/* determine the partition column index in the tuple descriptor */
+	Var *partitionColumn = PartitionColumn(shared->relationId, 0);
+	if (partitionColumn != NULL)
+	{
+		partitionColumnIndex = partitionColumn->varattno - 1;
+	}
+
+	/* use the same columns as the COPY commands of the leader */
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute currentColumn = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (currentColumn->attisdropped ||
+			currentColumn->attgenerated == ATTRIBUTE_GENERATED_STORED)
+		{
+			continue;
+		}
+
+		columnNameList = lappend(columnNameList, NameStr(currentColumn->attname));
+	}
+
+	EState *executorState = CreateExecutorState();
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	ExprContext *executorExpressionContext = GetPerTupleExprContext(executorState);
+
+	CitusCopyDestReceiver *copyDest = CreateCitusCopyDestReceiver(shared->relationId,
+																  columnNameList,
+																  partitionColumnIndex,
+																  executorState, NULL);
+	PrepareCopyRowSerialization(copyDest, distributedRelation, tupleDescriptor,
+								shared->binaryOutput);
+
+	CopyStmt *copyStatement = ParallelCopyStatement(shared, options);
+	CopyFromState copyState =
+		BeginCopyFromDistributedRelation(copyStatement, distributedRelation, copyDest,
+										 ReadParallelCopyChunkCallback);
+
+	pq_putmessage(PARALLEL_COPY_MESSAGE_READY, NULL, 0);
+
+	Datum *columnValues = palloc0(columnCount * sizeof(Datum));
+	bool *columnNulls = palloc0(columnCount * sizeof(bool));
+	CopyOutState copyOutState = copyDest->copyOutState;
+	StringInfo rowData = copyOutState->fe_msgbuf;
+	StringInfo batch = makeStringInfo();
+
+	while (true)
+	{
+		ResetPerTupleExprContext(executorState);
+
+		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+		bool nextRowFound = NextCopyFrom(copyState, executorExpressionContext,
+										 columnValues, columnNulls);
+		if (!nextRowFound)
+		{
+			MemoryContextSwitchTo(oldContext);
+			break;
+		}
+
+		uint64 shardId = ShardIdForTuple(copyDest, columnValues, columnNulls);
+
+		resetStringInfo(rowData);
+		AppendCopyRowData(columnValues, columnNulls, tupleDescriptor, copyOutState,
+						  copyDest->columnOutputFunctions,
+						  copyDest->columnCoercionPaths);
+
+		MemoryContextSwitchTo(oldContext);
+
+		pq_sendint64(batch, shardId);
+		pq_sendint32(batch, rowData->len);
+		pq_sendbytes(batch, rowData->data, rowData->len);
+
+		if (batch->len >= PARALLEL_COPY_BATCH_SIZE)
+		{
+			FlushParallelCopyBatch(batch);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	FlushParallelCopyBatch(batch);
+
+	EndCopyFrom(copyState);
+
+	/* the leader does not send lines after \., but be safe and drain the queue */
+	char discardBuffer[BLCKSZ];
+	while (ReadParallelCopyChunkCallback(discardBuffer, 1, BLCKSZ) > 0)
+	{ }
+
+	pq_putmessage(PARALLEL_COPY_MESSAGE_DONE, NULL, 0);
+
+	table_close(distributedRelation, NoLock);
+	FreeExecutorState(executorState);
+
+	CommitTransactionCommand();
+
+	dsm_detach(segment);
+	proc_exit(0);
+}
+
+
+/*
+ * ParallelCopyStatement builds the COPY statement of the leader from the
+ * options and column names in shared memory.
+ */
+static CopyStmt *
+ParallelCopyStatement(ParallelCopyShared *shared, char *options)
+{
+	CopyStmt *copyStatement = makeNode(CopyStmt);
+	char *currentOption = options;
+
+	copyStatement->is_from = true;
+
+	for (int optionIndex = 0; optionIndex < shared->optionCount; optionIndex++)
+	{
+		char *optionName = currentOption;
+		currentOption += strlen(optionName) + 1;
+
+		Node *optionValue = NULL;
+		char valueKind = *currentOption;
+		currentOption++;
+
+		if (valueKind == 'v')
+		{
+			optionValue = (Node *) makeString(pstrdup(currentOption));
+			currentOption += strlen(currentOption) + 1;
+		}
+
+		copyStatement->options = lappend(copyStatement->options,
+										 makeDefElem(pstrdup(optionName), optionValue,
+													 -1));
+	}
+
+	for (int attributeIndex = 0; attributeIndex < shared->attributeCount;
+		 attributeIndex++)
+	{
+		char *attributeName = currentOption;
+		currentOption += strlen(attributeName) + 1;
+
+		copyStatement->attlist = lappend(copyStatement->attlist,
+										 makeString(pstrdup(attributeName)));
+	}
+
+	return copyStatement;
+}
+
+
+/*
+ * ReadParallelCopyChunkCallback is the data source of the COPY in a worker.
+ * It reads the chunks of lines that the leader sends, and returns fewer than
+ * minread bytes only once the leader detached from the input queue.
+ */
+static int
+ReadParallelCopyChunkCallback(void *outbuf, int minread, int maxread)
+{
+	int bytesRead = 0;
+
+	while (bytesRead < minread)
+	{
+		if (ParallelCopyInputChunkRemaining == 0)
+		{
+			Size chunkLength = 0;
+			void *chunkData = NULL;
+			const bool noWait = false;
+
+			if (ParallelCopyInputDetached)
+			{
+				break;
+			}
+
+			shm_mq_result result = shm_mq_receive(ParallelCopyInputQueue, &chunkLength,
+												  &chunkData, noWait);
+			if (result != SHM_MQ_SUCCESS)
+			{
+				ParallelCopyInputDetached = true;
+				break;
+			}
+
+			ParallelCopyInputChunk = chunkData;
+			ParallelCopyInputChunkRemaining = chunkLength;
+			continue;
+		}
+
+		int copyLength = Min(ParallelCopyInputChunkRemaining, maxread - bytesRead);
+		memcpy_s((char *) outbuf + bytesRead, maxread - bytesRead,
+				 ParallelCopyInputChunk, copyLength);
+
+		ParallelCopyInputChunk += copyLength;
+		ParallelCopyInputChunkRemaining -= copyLength;
+		bytesRead += copyLength;
+	}
+
+	return bytesRead;
+}
+
+
+/*
+ * FlushParallelCopyBatch sends a batch of serialized rows to the leader.
+ */
+static void
+FlushParallelCopyBatch(StringInfo batch)
+{
+	if (batch->len == 0)
+	{
+		return;
+	}
+
+	if (pq_putmessage(PARALLEL_COPY_MESSAGE_ROWS, batch->data, batch->len) != 0)
+	{
+		ereport(ERROR, (errmsg("could not send rows to the parallel COPY leader")));
+	}
+
+	resetStringInfo(batch);
+}
@@ -16,6 +16,8 @@
 #include "catalog/namespace.h"
 #include "commands/defrem.h"
 #include "commands/extension.h"
+#include "commands/sequence.h"
+#include "distributed/citus_ruleutils.h"
 #include "distributed/commands.h"
 #include "distributed/commands/sequence.h"
 #include "distributed/commands/utility_hook.h"
@@ -26,14 +28,24 @@
 #include "distributed/metadata_sync.h"
 #include "nodes/makefuncs.h"
 #include "distributed/worker_create_or_replace.h"
+#include "distributed/worker_protocol.h"
+#include "distributed/worker_transaction.h"
 #include "nodes/parsenodes.h"
+#include "parser/parse_node.h"
 #include "rewrite/rewriteHandler.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
 
+/*
+ * GUC, number of values of the sequences used in distributed tables that each
+ * backend preallocates, 0 leaves the CACHE setting of the sequences as is.
+ */
+int DistributedSequenceCacheSize = 0;
+
 /* Local functions forward declarations for helper functions */
 static bool OptionsSpecifyOwnedBy(List *optionList, Oid *ownedByTableId);
 static Oid SequenceUsedInDistributedTable(const ObjectAddress *sequenceAddress);
+static void AlterSequenceCache(Oid sequenceOid, int cacheSize);
 static List * FilterDistributedSequences(GrantStmt *stmt);
 
 
@@ -237,6 +249,118 @@ ColumnDefaultsToNextVal(Oid relationId, AttrNumber attrNumber)
 }
 
 
+/*
+ * EnsureDistributedSequenceCacheSize raises the CACHE setting of the given
+ * sequence, used as the default of a column in a Citus table, from the default
+ * of 1 to citus.distributed_sequence_cache_size. Each backend then reserves
+ * that many values at once when it calls nextval(), such that inserts through
+ * the coordinator, COPY, and INSERT..SELECT do not contend on the sequence for
+ * every row. Like any cached sequence, the values are not assigned in order
+ * across backends and the unused values of a backend are lost when it exits.
+ *
+ * The workers with metadata get the same setting if the sequence is already
+ * distributed, or with the definition of the sequence otherwise, and
+ * undistribute_table restores the default later on.
+ */
+void
+EnsureDistributedSequenceCacheSize(Oid sequenceOid)
+{
+	if (DistributedSequenceCacheSize <= 1)
+	{
+		return;
+	}
+
+	/* leave sequences alone whose cache the user chose */
+	Form_pg_sequence sequenceData = pg_get_sequencedef(sequenceOid);
+	if (sequenceData->seqcache != 1)
+	{
+		return;
+	}
+
+	char *qualifiedSequenceName = generate_qualified_relation_name(sequenceOid);
+	ereport(NOTICE, (errmsg("setting the cache of sequence %s to %d",
+							qualifiedSequenceName, DistributedSequenceCacheSize),
+					 errdetail("Each backend reserves this many values of the sequence "
+							   "at a time, so values are not assigned in order across "
+							   "backends."),
+					 errhint("undistribute_table resets the cache to 1.")));
+
+	AlterSequenceCache(sequenceOid, DistributedSequenceCacheSize);
+}
+
+
+/*
+ * ResetDistributedSequenceCacheSize restores the default CACHE setting of 1 of
+ * a sequence that is no longer used in a Citus table, if the sequence has the
+ * cache that EnsureDistributedSequenceCacheSize gives it.
+ */
+void
+ResetDistributedSequenceCacheSize(Oid sequenceOid)
+{
+	if (DistributedSequenceCacheSize <= 1)
+	{
+		return;
+	}
+
+	Form_pg_sequence sequenceData = pg_get_sequencedef(sequenceOid);
+	if (sequenceData->seqcache != DistributedSequenceCacheSize)
+	{
+		return;
+	}
+
+	ObjectAddress sequenceAddress = { 0 };
+	ObjectAddressSet(sequenceAddress, RelationRelationId, sequenceOid);
+	if (SequenceUsedInDistributedTable(&sequenceAddress) != InvalidOid)
+	{
+		return;
+	}
+
+	ereport(NOTICE, (errmsg("resetting the cache of sequence %s to 1",
+							generate_qualified_relation_name(sequenceOid))));
+
+	AlterSequenceCache(sequenceOid, 1);
+}
+
+
+/*
+ * AlterSequenceCache sets the CACHE setting of the given sequence, on the
+ * workers with metadata as well if the sequence is distributed. Users cannot
+ * alter distributed sequences, hence we go around the utility hook.
+ */
+static void
+AlterSequenceCache(Oid sequenceOid, int cacheSize)
+{
+	AlterSeqStmt *alterSequenceStatement = makeNode(AlterSeqStmt);
+	char *sequenceSchemaName = get_namespace_name(get_rel_namespace(sequenceOid));
+	char *sequenceName = get_rel_name(sequenceOid);
+	alterSequenceStatement->sequence = makeRangeVar(sequenceSchemaName, sequenceName,
+													-1);
+
+	Node *cacheArg = (Node *) makeInteger(cacheSize);
+	SetDefElemArg(alterSequenceStatement, "cache", cacheArg);
+
+	ParseState *pstate = make_parsestate(NULL);
+	AlterSequence(pstate, alterSequenceStatement);
+	CommandCounterIncrement();
+
+	ObjectAddress sequenceAddress = { 0 };
+	ObjectAddressSet(sequenceAddress, RelationRelationId, sequenceOid);
+	if (!IsAnyObjectDistributed(list_make1(&sequenceAddress)))
+	{
+		return;
+	}
+
+	StringInfo command = makeStringInfo();
+	appendStringInfo(command, "ALTER SEQUENCE IF EXISTS %s CACHE %d",
+					 quote_qualified_identifier(sequenceSchemaName, sequenceName),
+					 cacheSize);
+
+	/* prevent recursive propagation */
+	SendCommandToWorkersWithMetadata(DISABLE_DDL_PROPAGATION);
+	SendCommandToWorkersWithMetadata(command->data);
+}
+
+
 /*
  * PreprocessDropSequenceStmt gets called during the planning phase of a DROP SEQUENCE statement
  * and returns a list of DDLJob's that will drop any distributed sequences from the
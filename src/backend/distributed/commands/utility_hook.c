@@ -67,8 +67,11 @@
 #include "distributed/multi_executor.h"
 #include "distributed/multi_explain.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/query_result_cache.h"
 #include "distributed/reference_table_utils.h"
+#include "distributed/reference_table_write_batch.h"
 #include "distributed/resource_lock.h"
+#include "distributed/shared_metadata_cache.h"
 #include "distributed/string_utils.h"
 #include "distributed/transaction_management.h"
 #include "distributed/version_compat.h"
@@ -114,10 +117,12 @@ static void IncrementUtilityHookCountersIfNecessary(Node *parsetree);
 static void PostStandardProcessUtility(Node *parsetree);
 static void DecrementUtilityHookCountersIfNecessary(Node *parsetree);
 static bool IsDropSchemaOrDB(Node *parsetree);
+static bool IsRollbackStmt(Node *parsetree);
 static bool ShouldCheckUndistributeCitusLocalTables(void);
 static bool ShouldAddNewTableToMetadata(Node *parsetree);
 static bool ServerUsesPostgresFDW(char *serverName);
 static void ErrorIfOptionListHasNoTableName(List *optionList);
+static void ExecuteDDLJobTaskList(DDLJob *ddlJob, bool localExecutionSupported);
 
 
 /*
@@ -181,6 +186,22 @@ multi_ProcessUtility(PlannedStmt *pstmt,
 		{
 			SaveBeginCommandProperties(transactionStmt);
 		}
+
+		if (transactionStmt->kind == TRANS_STMT_PREPARE)
+		{
+			SharedMetadataCacheBeforePrepare(transactionStmt->gid);
+			QueryResultCacheBeforePrepare(transactionStmt->gid);
+		}
+	}
+
+	if (HasPendingReferenceTableWrites() && !IsAbortedTransactionBlockState() &&
+		!IsA(parsetree, ExecuteStmt) && !IsRollbackStmt(parsetree))
+	{
+		/*
+		 * Utility commands might observe the held back writes. EXECUTE flushes
+		 * them in the executor, and rolled back writes are discarded.
+		 */
+		FlushReferenceTableWrites();
 	}
 
 	if (IsA(parsetree, TransactionStmt) ||
@@ -203,6 +224,20 @@ multi_ProcessUtility(PlannedStmt *pstmt,
 		PrevProcessUtility_compat(pstmt, queryString, false, context,
 								  params, queryEnv, dest, completionTag);
 
+		if (IsA(parsetree, TransactionStmt))
+		{
+			TransactionStmt *transactionStmt = (TransactionStmt *) parsetree;
+
+			if (transactionStmt->kind == TRANS_STMT_COMMIT_PREPARED ||
+				transactionStmt->kind == TRANS_STMT_ROLLBACK_PREPARED)
+			{
+				bool isCommit = transactionStmt->kind == TRANS_STMT_COMMIT_PREPARED;
+
+				SharedMetadataCacheAfterFinishPrepared(transactionStmt->gid, isCommit);
+				QueryResultCacheAfterFinishPrepared(transactionStmt->gid, isCommit);
+			}
+		}
+
 		return;
 	}
 
@@ -1099,6 +1134,25 @@ ShouldAddNewTableToMetadata(Node *parsetree)
 }
 
 
+/*
+ * IsRollbackStmt returns true if the given parse tree is a ROLLBACK or a
+ * ROLLBACK TO SAVEPOINT command.
+ */
+static bool
+IsRollbackStmt(Node *parsetree)
+{
+	if (!IsA(parsetree, TransactionStmt))
+	{
+		return false;
+	}
+
+	TransactionStmt *transactionStmt = (TransactionStmt *) parsetree;
+
+	return transactionStmt->kind == TRANS_STMT_ROLLBACK ||
+		   transactionStmt->kind == TRANS_STMT_ROLLBACK_TO;
+}
+
+
 /*
  * ServerUsesPostgresFDW gets a foreign server name and returns true if the FDW that
  * the server depends on is postgres_fdw. Returns false otherwise.
@@ -1243,7 +1297,7 @@ ExecuteDistributedDDLJob(DDLJob *ddlJob)
 			}
 		}
 
-		ExecuteUtilityTaskList(ddlJob->taskList, localExecutionSupported);
+		ExecuteDDLJobTaskList(ddlJob, localExecutionSupported);
 	}
 	else
 	{
@@ -1344,7 +1398,7 @@ ExecuteDistributedDDLJob(DDLJob *ddlJob)
 
 		PG_TRY();
 		{
-			ExecuteUtilityTaskList(ddlJob->taskList, localExecutionSupported);
+			ExecuteDDLJobTaskList(ddlJob, localExecutionSupported);
 
 			if (shouldSyncMetadata)
 			{
@@ -1403,6 +1457,24 @@ ExecuteDistributedDDLJob(DDLJob *ddlJob)
 }
 
 
+/*
+ * ExecuteDDLJobTaskList executes the task list of the given DDL job, using
+ * the index build executor for the jobs that build indexes.
+ */
+static void
+ExecuteDDLJobTaskList(DDLJob *ddlJob, bool localExecutionSupported)
+{
+	if (ddlJob->buildsIndexes)
+	{
+		ExecuteIndexBuildTaskList(ddlJob->taskList, localExecutionSupported);
+	}
+	else
+	{
+		ExecuteUtilityTaskList(ddlJob->taskList, localExecutionSupported);
+	}
+}
+
+
 #if PG_VERSION_NUM >= 140000
 
 /*
@@ -33,6 +33,12 @@
 
 #define VACUUM_PARALLEL_NOTSET -2
 
+/*
+ * GUC, number of shards vacuumed concurrently per worker across all the tables
+ * of the command, 0 means the tables are vacuumed one after another.
+ */
+int MaxVacuumTasksPerWorker = 0;
+
 /*
  * Subset of VacuumParams we care about
  */
@@ -175,13 +181,21 @@ IsDistributedVacuumStmt(List *vacuumRelationIdList)
 /*
  * ExecuteVacuumOnDistributedTables executes the vacuum for the shard placements of given tables
  * if they are citus tables.
+ *
+ * When citus.max_vacuum_tasks_per_worker is set, the shards of all the tables
+ * are vacuumed in a single execution with that many connections per worker,
+ * such that the shards of small tables do not wait for the ones of large
+ * tables. Otherwise, the tables are vacuumed one after another.
  */
 static void
 ExecuteVacuumOnDistributedTables(VacuumStmt *vacuumStmt, List *relationIdList,
 								 CitusVacuumParams vacuumParams)
 {
 	int relationIndex = 0;
-	int executedVacuumCount = 0;
+	List *vacuumTaskList = NIL;
+
+	/* local execution is not implemented for VACUUM commands */
+	bool localExecutionSupported = false;
 
 	Oid relationId = InvalidOid;
 	foreach_oid(relationId, relationIdList)
@@ -191,13 +205,33 @@ ExecuteVacuumOnDistributedTables(VacuumStmt *vacuumStmt, List *relationIdList,
 			List *vacuumColumnList = VacuumColumnList(vacuumStmt, relationIndex);
 			List *taskList = VacuumTaskList(relationId, vacuumParams, vacuumColumnList);
 
-			/* local execution is not implemented for VACUUM commands */
-			bool localExecutionSupported = false;
-			ExecuteUtilityTaskList(taskList, localExecutionSupported);
-			executedVacuumCount++;
+			if (MaxVacuumTasksPerWorker > 0)
+			{
+				vacuumTaskList = list_concat(vacuumTaskList, taskList);
+			}
+			else
+			{
+				ExecuteUtilityTaskList(taskList, localExecutionSupported);
+			}
 		}
 		relationIndex++;
 	}
+
+	if (vacuumTaskList == NIL)
+	{
+		return;
+	}
+
+	/* the tasks of each table are numbered from 1, make their ids unique */
+	int taskId = 1;
+	Task *task = NULL;
+	foreach_ptr(task, vacuumTaskList)
+	{
+		task->taskId = taskId++;
+	}
+
+	ExecuteUtilityTaskListExtended(vacuumTaskList, MaxVacuumTasksPerWorker,
+								   localExecutionSupported);
 }
 
 
@@ -32,10 +32,13 @@
 #include "distributed/run_from_same_connection.h"
 #include "distributed/shared_connection_stats.h"
 #include "distributed/cancel_utils.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/remote_commands.h"
 #include "distributed/time_constants.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_log_messages.h"
+#include "distributed/worker_manager.h"
+#include "distributed/worker_prepared_statements.h"
 #include "mb/pg_wchar.h"
 #include "pg_config.h"
 #include "portability/instr_time.h"
@@ -47,12 +50,16 @@
 int NodeConnectionTimeout = 30000;
 int MaxCachedConnectionsPerWorker = 1;
 int MaxCachedConnectionLifetime = 10 * MS_PER_MINUTE;
+bool ReleaseCachedConnectionsOnFullPool = false;
 
 HTAB *ConnectionHash = NULL;
 HTAB *ConnParamsHash = NULL;
 
 MemoryContext ConnectionContext = NULL;
 
+PG_FUNCTION_INFO_V1(citus_prewarm_connections);
+
+static bool ConnectionNeedsRefresh(MultiConnection *connection);
 static uint32 ConnectionHashHash(const void *key, Size keysize);
 static int ConnectionHashCompare(const void *a, const void *b, Size keysize);
 static void StartConnectionEstablishment(MultiConnection *connectionn,
@@ -418,6 +425,7 @@ StartNodeUserDatabaseConnection(uint32 flags, const char *hostname, int32 port,
 	 * when we're done with the connection.
 	 */
 	connection->initilizationState = POOL_STATE_COUNTER_INCREMENTED;
+	connection->sharedPoolRoleId = GetUserId();
 
 	StartConnectionEstablishment(connection, &key);
 
@@ -1015,7 +1023,8 @@ FinishConnectionListEstablishment(List *multiConnectionList)
 		}
 
 		int eventCount = WaitEventSetWait(waitEventSet, timeout, events, waitCount,
-										  WAIT_EVENT_CLIENT_READ);
+										  CitusWaitEventInfo(
+											  CITUS_WAIT_EVENT_REMOTE_CONNECT));
 
 		for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
 		{
@@ -1181,10 +1190,13 @@ CitusPQFinish(MultiConnection *connection)
 		connection->pgConn = NULL;
 	}
 
+	FreeWorkerPreparedStatementCache(connection);
+
 	/* behave idempotently, there is no gurantee that CitusPQFinish() is called once */
 	if (connection->initilizationState >= POOL_STATE_COUNTER_INCREMENTED)
 	{
-		DecrementSharedConnectionCounter(connection->hostname, connection->port);
+		DecrementSharedConnectionCounter(connection->hostname, connection->port,
+										 connection->sharedPoolRoleId);
 		connection->initilizationState = POOL_STATE_NOT_INITIALIZED;
 	}
 }
@@ -1330,9 +1342,120 @@ WarmUpConnParamsHash(void)
 #endif
 
 
+/*
+ * citus_prewarm_connections opens connections to all the active primary nodes
+ * other than the local node, such that the session keeps up to
+ * citus.max_cached_conns_per_worker established connections to each of them
+ * when the transaction ends. Cached connections that are broken or that are
+ * past half of citus.max_cached_connection_lifetime are replaced, such that
+ * queries later in the session do not pay for connection establishment.
+ *
+ * Connections are established in parallel and never wait for a slot in the
+ * shared pool. The function returns the number of connections that are ready
+ * to use.
+ */
+Datum
+citus_prewarm_connections(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	int connectionFlags = OPTIONAL_CONNECTION | OUTSIDE_TRANSACTION;
+	List *connectionList = NIL;
+
+	List *workerNodeList = ActivePrimaryRemoteNodeList(NoLock);
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		for (int connectionIndex = 0; connectionIndex < MaxCachedConnectionsPerWorker;
+			 connectionIndex++)
+		{
+			MultiConnection *connection =
+				StartNodeUserDatabaseConnection(connectionFlags,
+												workerNode->workerName,
+												workerNode->workerPort,
+												NULL, NULL);
+
+			if (connection != NULL && ConnectionNeedsRefresh(connection))
+			{
+				CloseConnection(connection);
+
+				connection =
+					StartNodeUserDatabaseConnection(connectionFlags |
+													FORCE_NEW_CONNECTION,
+													workerNode->workerName,
+													workerNode->workerPort,
+													NULL, NULL);
+			}
+
+			if (connection == NULL)
+			{
+				/* the shared pool for the node is full */
+				break;
+			}
+
+			/* make sure the next iteration gets another connection */
+			ClaimConnectionExclusively(connection);
+
+			connectionList = lappend(connectionList, connection);
+		}
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	int readyConnectionCount = 0;
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		if (PQstatus(connection->pgConn) == CONNECTION_OK)
+		{
+			readyConnectionCount++;
+		}
+
+		UnclaimConnection(connection);
+	}
+
+	PG_RETURN_INT32(readyConnectionCount);
+}
+
+
+/*
+ * ConnectionNeedsRefresh returns whether a cached connection that is not used
+ * by the current transaction is broken or is about to reach its maximum
+ * lifetime.
+ */
+static bool
+ConnectionNeedsRefresh(MultiConnection *connection)
+{
+	if (connection->remoteTransaction.transactionState != REMOTE_TRANS_NOT_STARTED ||
+		!dlist_is_empty(&connection->referencedPlacements))
+	{
+		/* the connection is in use, we cannot replace it */
+		return false;
+	}
+
+	if (PQstatus(connection->pgConn) == CONNECTION_BAD)
+	{
+		return true;
+	}
+
+	return MaxCachedConnectionLifetime >= 0 &&
+		   MillisecondsToTimeout(connection->connectionEstablishmentStart,
+								 MaxCachedConnectionLifetime / 2) <= 0;
+}
+
+
 /*
  * FindOrCreateConnParamsEntry searches ConnParamsHash for the given key,
  * if it is not found, it is created.
+ *
+ * Note that the entry only holds libpq parameters, not TLS state. libpq sets
+ * up its own SSL object inside PQconnectStartParams and offers no way to hand
+ * it a saved TLS session before the handshake, so we cannot resume sessions
+ * across connections. The cost of the handshakes is instead reduced by reusing
+ * connections, see citus.max_cached_conns_per_worker and
+ * citus.max_cached_connection_lifetime.
  */
 static ConnParamsHashEntry *
 FindOrCreateConnParamsEntry(ConnectionHashKey *key)
@@ -1483,6 +1606,7 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
  * - Connection is not in OK state
  * - A transaction is still in progress (usually because we are cancelling a distributed transaction)
  * - A connection reached its maximum lifetime
+ * - The shared pool for the node is full and citus.release_cached_connections_on_full_pool is set
  */
 static bool
 ShouldShutdownConnection(MultiConnection *connection, const int cachedConnectionCount)
@@ -1502,7 +1626,9 @@ ShouldShutdownConnection(MultiConnection *connection, const int cachedConnection
 		   connection->requiresReplication ||
 		   (MaxCachedConnectionLifetime >= 0 &&
 			MillisecondsToTimeout(connection->connectionEstablishmentStart,
-								  MaxCachedConnectionLifetime) <= 0);
+								  MaxCachedConnectionLifetime) <= 0) ||
+		   (ReleaseCachedConnectionsOnFullPool &&
+			SharedConnectionPoolIsFull(connection->hostname, connection->port));
 }
 
 
@@ -239,7 +239,8 @@ DeallocateReservedConnections(void)
 			 * We have not used this reservation, make sure to clean-up from
 			 * the shared memory as well.
 			 */
-			DecrementSharedConnectionCounter(entry->key.hostname, entry->key.port);
+			DecrementSharedConnectionCounter(entry->key.hostname, entry->key.port,
+											 entry->key.userId);
 
 			/* for completeness, set it to true */
 			entry->usedReservation = true;
@@ -24,7 +24,9 @@
 #include "distributed/distributed_planner.h"
 #include "distributed/multi_partitioning_utils.h"
 #include "distributed/placement_connection.h"
+#include "distributed/query_result_cache.h"
 #include "distributed/relation_access_tracking.h"
+#include "distributed/relay_utility.h"
 #include "utils/hsearch.h"
 #include "common/hashfn.h"
 #include "utils/memutils.h"
@@ -188,6 +190,19 @@ typedef struct ConnectionShardHashEntry
 static HTAB *ConnectionShardHash;
 
 
+/*
+ * ReferencedColocationGroup is an entry of the referencedColocationGroups list
+ * of a connection, which tells which shard range of a co-location group the
+ * connection accessed, or that it accessed multiple shard ranges.
+ */
+typedef struct ReferencedColocationGroup
+{
+	uint32 colocationGroupId;
+	uint32 representativeValue;
+	bool multipleRepresentativeValues;
+} ReferencedColocationGroup;
+
+
 static MultiConnection * FindPlacementListConnection(int flags, List *placementAccessList,
 													 const char *userName);
 static ConnectionPlacementHashEntry * FindOrCreatePlacementEntry(
@@ -196,6 +211,8 @@ static bool CanUseExistingConnection(uint32 flags, const char *userName,
 									 ConnectionReference *placementConnection);
 static bool ConnectionAccessedDifferentPlacement(MultiConnection *connection,
 												 ShardPlacement *placement);
+static void AddPlacementReferenceToConnection(MultiConnection *connection,
+											 ConnectionReference *reference);
 static void AssociatePlacementWithShard(ConnectionPlacementHashEntry *placementEntry,
 										ShardPlacement *placement);
 static bool HasModificationFailedForShard(ConnectionShardHashEntry *shardEntry);
@@ -406,8 +423,7 @@ AssignPlacementListToConnection(List *placementAccessList, MultiConnection *conn
 			placementConnection->placementId = placementAccess->placement->placementId;
 
 			/* record association with connection */
-			dlist_push_tail(&connection->referencedPlacements,
-							&placementConnection->connectionNode);
+			AddPlacementReferenceToConnection(connection, placementConnection);
 		}
 		else
 		{
@@ -432,8 +448,7 @@ AssignPlacementListToConnection(List *placementAccessList, MultiConnection *conn
 				Assert(!placementConnection->hadDML);
 
 				/* record association with connection */
-				dlist_push_tail(&connection->referencedPlacements,
-								&placementConnection->connectionNode);
+				AddPlacementReferenceToConnection(connection, placementConnection);
 			}
 
 			/*
@@ -455,16 +470,31 @@ AssignPlacementListToConnection(List *placementAccessList, MultiConnection *conn
 		if (accessType == PLACEMENT_ACCESS_DDL)
 		{
 			placementConnection->hadDDL = true;
+			connection->referencedPlacementModified = true;
 		}
 
 		if (accessType == PLACEMENT_ACCESS_DML)
 		{
 			placementConnection->hadDML = true;
+			connection->referencedPlacementModified = true;
+		}
+
+		if (accessType != PLACEMENT_ACCESS_SELECT)
+		{
+			/* cached query results that read the shard become stale on commit */
+			RecordShardModification(placement->shardId);
 		}
 
-		/* record the relation access */
-		Oid relationId = RelationIdForShard(placement->shardId);
-		RecordRelationAccessIfNonDistTable(relationId, accessType);
+		/*
+		 * Record the relation access. Only tables without a distribution key
+		 * are tracked, so we skip the shard lookup for hash distributed tables.
+		 */
+		if (placement->partitionMethod != DISTRIBUTE_BY_HASH &&
+			ShouldRecordRelationAccess())
+		{
+			Oid relationId = RelationIdForShard(placement->shardId);
+			RecordRelationAccessIfNonDistTable(relationId, accessType);
+		}
 	}
 }
 
@@ -786,6 +816,60 @@ CanUseExistingConnection(uint32 flags, const char *userName,
 }
 
 
+/*
+ * AddPlacementReferenceToConnection adds the given placement reference to the
+ * referenced placements of the connection and updates their summary. Long
+ * transactions can reference many thousands of placements over a connection,
+ * so we check the summary rather than the list on every statement.
+ */
+static void
+AddPlacementReferenceToConnection(MultiConnection *connection,
+								  ConnectionReference *reference)
+{
+	if (dlist_is_empty(&connection->referencedPlacements))
+	{
+		connection->referencedPlacementId = reference->placementId;
+	}
+	else if (connection->referencedPlacementId != reference->placementId)
+	{
+		connection->referencedMultiplePlacements = true;
+	}
+
+	dlist_push_tail(&connection->referencedPlacements, &reference->connectionNode);
+
+	if (reference->colocationGroupId == INVALID_COLOCATION_ID)
+	{
+		return;
+	}
+
+	ReferencedColocationGroup *colocationGroup = NULL;
+	foreach_ptr(colocationGroup, connection->referencedColocationGroups)
+	{
+		if (colocationGroup->colocationGroupId == reference->colocationGroupId)
+		{
+			if (colocationGroup->representativeValue != reference->representativeValue)
+			{
+				colocationGroup->multipleRepresentativeValues = true;
+			}
+
+			return;
+		}
+	}
+
+	/* the references and the summary go away at the end of the transaction */
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	colocationGroup = palloc0(sizeof(ReferencedColocationGroup));
+	colocationGroup->colocationGroupId = reference->colocationGroupId;
+	colocationGroup->representativeValue = reference->representativeValue;
+
+	connection->referencedColocationGroups =
+		lappend(connection->referencedColocationGroups, colocationGroup);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
 /*
  * ConnectionAccessedDifferentPlacement returns true if the connection accessed another
  * placement in the same colocation group with a different representative value,
@@ -795,27 +879,34 @@ static bool
 ConnectionAccessedDifferentPlacement(MultiConnection *connection,
 									 ShardPlacement *placement)
 {
-	dlist_iter placementIter;
+	if (dlist_is_empty(&connection->referencedPlacements))
+	{
+		return false;
+	}
 
-	dlist_foreach(placementIter, &connection->referencedPlacements)
+	/* handle append and range distributed tables */
+	if (placement->partitionMethod != DISTRIBUTE_BY_HASH &&
+		(connection->referencedMultiplePlacements ||
+		 placement->placementId != connection->referencedPlacementId))
 	{
-		ConnectionReference *connectionReference =
-			dlist_container(ConnectionReference, connectionNode, placementIter.cur);
+		return true;
+	}
 
-		/* handle append and range distributed tables */
-		if (placement->partitionMethod != DISTRIBUTE_BY_HASH &&
-			placement->placementId != connectionReference->placementId)
-		{
-			return true;
-		}
+	/* handle hash distributed tables */
+	if (placement->colocationGroupId == INVALID_COLOCATION_ID)
+	{
+		return false;
+	}
 
-		/* handle hash distributed tables */
-		if (placement->colocationGroupId != INVALID_COLOCATION_ID &&
-			placement->colocationGroupId == connectionReference->colocationGroupId &&
-			placement->representativeValue != connectionReference->representativeValue)
+	ReferencedColocationGroup *colocationGroup = NULL;
+	foreach_ptr(colocationGroup, connection->referencedColocationGroups)
+	{
+		if (colocationGroup->colocationGroupId == placement->colocationGroupId)
 		{
 			/* non-co-located placements from the same co-location group */
-			return true;
+			return colocationGroup->multipleRepresentativeValues ||
+				   colocationGroup->representativeValue !=
+				   placement->representativeValue;
 		}
 	}
 
@@ -830,8 +921,6 @@ ConnectionAccessedDifferentPlacement(MultiConnection *connection,
 bool
 ConnectionModifiedPlacement(MultiConnection *connection)
 {
-	dlist_iter placementIter;
-
 	if (connection->remoteTransaction.transactionState == REMOTE_TRANS_NOT_STARTED)
 	{
 		/*
@@ -856,18 +945,8 @@ ConnectionModifiedPlacement(MultiConnection *connection)
 		return true;
 	}
 
-	dlist_foreach(placementIter, &connection->referencedPlacements)
-	{
-		ConnectionReference *connectionReference =
-			dlist_container(ConnectionReference, connectionNode, placementIter.cur);
-
-		if (connectionReference->hadDDL || connectionReference->hadDML)
-		{
-			return true;
-		}
-	}
-
-	return false;
+	/* set whenever DML or DDL is assigned to one of the referenced placements */
+	return connection->referencedPlacementModified;
 }
 
 
@@ -954,6 +1033,11 @@ void
 ResetShardPlacementAssociation(struct MultiConnection *connection)
 {
 	dlist_init(&connection->referencedPlacements);
+
+	connection->referencedColocationGroups = NIL;
+	connection->referencedPlacementId = INVALID_PLACEMENT_ID;
+	connection->referencedMultiplePlacements = false;
+	connection->referencedPlacementModified = false;
 }
 
 
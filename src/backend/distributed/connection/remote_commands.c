@@ -9,6 +9,7 @@
  */
 
 #include "postgres.h"
+#include "funcapi.h"
 #include "pgstat.h"
 
 #include "libpq-fe.h"
@@ -17,9 +18,13 @@
 #include "distributed/errormessage.h"
 #include "distributed/listutils.h"
 #include "distributed/log_utils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/pg_version_constants.h"
 #include "distributed/remote_commands.h"
 #include "distributed/errormessage.h"
 #include "distributed/cancel_utils.h"
+#include "distributed/citus_wait_events.h"
+#include "distributed/tuplestore.h"
 #include "lib/stringinfo.h"
 #include "miscadmin.h"
 #include "storage/latch.h"
@@ -34,6 +39,45 @@
  */
 int RemoteCopyFlushThreshold = 8 * 1024 * 1024;
 
+/* GUC, whether the COPY flush threshold adapts to the throughput of connections */
+bool EnableAdaptiveCopyFlush = false;
+
+/*
+ * When the flush threshold adapts, we aim for flushes that take about
+ * ADAPTIVE_COPY_FLUSH_TARGET_MS at the observed drain rate, but never flush
+ * less than MIN_ADAPTIVE_COPY_FLUSH_THRESHOLD bytes at a time to keep the
+ * number of system calls reasonable.
+ */
+#define ADAPTIVE_COPY_FLUSH_TARGET_MS 10.0
+#define MIN_ADAPTIVE_COPY_FLUSH_THRESHOLD (64 * 1024)
+
+/* weight of the latest flush in the smoothed drain rate of a connection */
+#define COPY_DRAIN_RATE_SMOOTHING 0.25
+
+#define COPY_CONNECTION_STATS_COLUMNS 8
+
+/*
+ * PipelineClearState tracks the synchronization point that ClearResults and
+ * ClearResultsIfReady send themselves to finish a pipeline whose own sync may
+ * never have been queued, for instance because a send failed mid-pipeline.
+ */
+typedef struct PipelineClearState
+{
+	/* whether we sent a synchronization point while clearing */
+	bool syncSent;
+
+	/* whether a synchronization point was received after we sent ours */
+	bool syncReceived;
+} PipelineClearState;
+
+/* outcome of finishing the pipeline when there are no results left */
+typedef enum PipelineClearStatus
+{
+	PIPELINE_CLEAR_DONE,
+	PIPELINE_CLEAR_PENDING,
+	PIPELINE_CLEAR_FAILED
+} PipelineClearStatus;
+
 
 /* GUC, determining whether statements sent to remote nodes are logged */
 bool LogRemoteCommands = false;
@@ -42,11 +86,24 @@ char *GrepRemoteCommands = "";
 
 static bool ClearResultsInternal(MultiConnection *connection, bool raiseErrors,
 								 bool discardWarnings);
-static bool FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts);
+static PipelineClearStatus FinishPipelineWhileClearing(MultiConnection *connection,
+															PipelineClearState *state);
+static bool FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts,
+							   uint32 waitEventInfo);
+static bool FlushRemoteCopyData(MultiConnection *connection);
+static uint64 RemoteCopyFlushThresholdForConnection(MultiConnection *connection);
+static void UpdateRemoteCopyFlushThreshold(MultiConnection *connection,
+										   uint64 flushedBytes, double flushMs,
+										   bool hadBackpressure);
+static void StoreCopyConnectionStats(MultiConnection *connection,
+									 Tuplestorestate *tupleStore,
+									 TupleDesc tupleDescriptor);
 static WaitEventSet * BuildWaitEventSet(MultiConnection **allConnections,
 										int totalConnectionCount,
 										int pendingConnectionsStartIndex);
 
+PG_FUNCTION_INFO_V1(citus_copy_connection_stats);
+
 
 /* simple helpers */
 
@@ -64,7 +121,97 @@ IsResponseOK(PGresult *result)
 		return true;
 	}
 
+#ifdef LIBPQ_HAS_CHUNK_MODE
+	if (resultStatus == PGRES_TUPLES_CHUNK)
+	{
+		return true;
+	}
+#endif
+
+	return false;
+}
+
+
+/*
+ * IsPipelineSyncResult checks whether the result is the synchronization point
+ * that terminates a libpq pipeline. Such a result does not carry a response of
+ * a command, so callers that clear results should skip it.
+ */
+bool
+IsPipelineSyncResult(PGresult *result)
+{
+#if PG_VERSION_NUM >= PG_VERSION_14
+	return PQresultStatus(result) == PGRES_PIPELINE_SYNC;
+#else
+	return false;
+#endif
+}
+
+
+/*
+ * InPipelineMode returns whether the connection is in libpq pipeline mode.
+ */
+bool
+InPipelineMode(MultiConnection *connection)
+{
+#if PG_VERSION_NUM >= PG_VERSION_14
+	return PQpipelineStatus(connection->pgConn) != PQ_PIPELINE_OFF;
+#else
+	return false;
+#endif
+}
+
+
+/*
+ * EnterPipelineMode puts the connection into libpq pipeline mode, such that
+ * multiple queries can be sent before receiving their results. It returns
+ * false if pipeline mode is not available or the connection is busy.
+ */
+bool
+EnterPipelineMode(MultiConnection *connection)
+{
+#if PG_VERSION_NUM >= PG_VERSION_14
+	return PQenterPipelineMode(connection->pgConn) == 1;
+#else
+	return false;
+#endif
+}
+
+
+/*
+ * SendPipelineSync marks the end of the queries in the pipeline of the
+ * connection, which makes the remote node send the results of the queries.
+ */
+bool
+SendPipelineSync(MultiConnection *connection)
+{
+#if PG_VERSION_NUM >= PG_VERSION_14
+	return PQpipelineSync(connection->pgConn) == 1;
+#else
 	return false;
+#endif
+}
+
+
+/*
+ * ExitPipelineModeIfDone takes the connection out of libpq pipeline mode once
+ * all the results of the pipeline are consumed. It returns false if the
+ * connection is still in pipeline mode and more results are expected, and
+ * true otherwise.
+ */
+bool
+ExitPipelineModeIfDone(MultiConnection *connection)
+{
+	if (!InPipelineMode(connection))
+	{
+		return true;
+	}
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+	return PQexitPipelineMode(connection->pgConn) == 1;
+#else
+	return true;
+#endif
 }
 
 
@@ -117,15 +264,35 @@ static bool
 ClearResultsInternal(MultiConnection *connection, bool raiseErrors, bool discardWarnings)
 {
 	bool success = true;
+	PipelineClearState pipelineState = { 0 };
 
 	while (true)
 	{
 		PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
 		if (result == NULL)
 		{
+			/* in pipeline mode, NULL only terminates the results of one command */
+			PipelineClearStatus pipelineStatus =
+				FinishPipelineWhileClearing(connection, &pipelineState);
+			if (pipelineStatus == PIPELINE_CLEAR_PENDING)
+			{
+				continue;
+			}
+			else if (pipelineStatus == PIPELINE_CLEAR_FAILED)
+			{
+				success = false;
+			}
+
 			break;
 		}
 
+		if (IsPipelineSyncResult(result))
+		{
+			pipelineState.syncReceived = pipelineState.syncSent;
+			PQclear(result);
+			continue;
+		}
+
 		/*
 		 * End any pending copy operation. Transaction will be marked
 		 * as failed by the following part.
@@ -179,6 +346,8 @@ ClearResultsIfReady(MultiConnection *connection)
 
 	Assert(PQisnonblocking(pgConn));
 
+	PipelineClearState pipelineState = { 0 };
+
 	while (true)
 	{
 		/*
@@ -209,11 +378,31 @@ ClearResultsIfReady(MultiConnection *connection)
 		PGresult *result = PQgetResult(pgConn);
 		if (result == NULL)
 		{
+			/* in pipeline mode, NULL only terminates the results of one command */
+			PipelineClearStatus pipelineStatus =
+				FinishPipelineWhileClearing(connection, &pipelineState);
+			if (pipelineStatus == PIPELINE_CLEAR_PENDING)
+			{
+				continue;
+			}
+			else if (pipelineStatus == PIPELINE_CLEAR_FAILED)
+			{
+				return false;
+			}
+
 			/* no more results available */
 			return true;
 		}
 
+		if (IsPipelineSyncResult(result))
+		{
+			pipelineState.syncReceived = pipelineState.syncSent;
+			PQclear(result);
+			continue;
+		}
+
 		ExecStatusType resultStatus = PQresultStatus(result);
+		bool responseOK = IsResponseOK(result);
 
 		/* only care about the status, can clear now */
 		PQclear(result);
@@ -224,8 +413,7 @@ ClearResultsIfReady(MultiConnection *connection)
 			return false;
 		}
 
-		if (!(resultStatus == PGRES_SINGLE_TUPLE || resultStatus == PGRES_TUPLES_OK ||
-			  resultStatus == PGRES_COMMAND_OK))
+		if (!responseOK)
 		{
 			/* an error occurred just when we were aborting */
 			return false;
@@ -238,6 +426,47 @@ ClearResultsIfReady(MultiConnection *connection)
 }
 
 
+/*
+ * FinishPipelineWhileClearing is called when there are no results left for the
+ * current command while clearing the results of the connection. It takes the
+ * connection out of pipeline mode if all results of the pipeline are consumed.
+ *
+ * Otherwise, the remote node only sends the remaining results once it receives
+ * a synchronization point. We cannot tell whether the pipeline's own one was
+ * queued, so we send one, which at worst yields an extra sync result. If the
+ * connection still stays in pipeline mode after that sync came back, or the
+ * sync cannot be sent, we give up on the connection, rather than waiting for
+ * results that never arrive.
+ */
+static PipelineClearStatus
+FinishPipelineWhileClearing(MultiConnection *connection, PipelineClearState *state)
+{
+	if (ExitPipelineModeIfDone(connection))
+	{
+		return PIPELINE_CLEAR_DONE;
+	}
+
+	if (!state->syncSent)
+	{
+		state->syncSent = true;
+
+		if (SendPipelineSync(connection))
+		{
+			return PIPELINE_CLEAR_PENDING;
+		}
+	}
+	else if (!state->syncReceived)
+	{
+		/* the results before our sync are still coming in */
+		return PIPELINE_CLEAR_PENDING;
+	}
+
+	connection->connectionState = MULTI_CONNECTION_LOST;
+
+	return PIPELINE_CLEAR_FAILED;
+}
+
+
 /* report errors & warnings */
 
 /*
@@ -635,7 +864,8 @@ GetRemoteCommandResult(MultiConnection *connection, bool raiseInterrupts)
 		return PQgetResult(connection->pgConn);
 	}
 
-	if (!FinishConnectionIO(connection, raiseInterrupts))
+	if (!FinishConnectionIO(connection, raiseInterrupts,
+							CitusWaitEventInfo(CITUS_WAIT_EVENT_REMOTE_QUERY_RESULT)))
 	{
 		/* some error(s) happened while doing the I/O, signal the callers */
 		if (PQstatus(pgConn) == CONNECTION_BAD)
@@ -665,7 +895,6 @@ bool
 PutRemoteCopyData(MultiConnection *connection, const char *buffer, int nbytes)
 {
 	PGconn *pgConn = connection->pgConn;
-	bool allowInterrupts = true;
 
 	if (PQstatus(pgConn) != CONNECTION_OK)
 	{
@@ -690,13 +919,17 @@ PutRemoteCopyData(MultiConnection *connection, const char *buffer, int nbytes)
 	 * providing back pressure based on experimentation that showed
 	 * throughput get worse at 4MB and lower due to the number of CPU
 	 * cycles spent in networking system calls.
+	 *
+	 * With citus.enable_adaptive_copy_flush, connections that drain slowly
+	 * flush in smaller batches instead, see UpdateRemoteCopyFlushThreshold().
 	 */
 
 	connection->copyBytesWrittenSinceLastFlush += nbytes;
-	if (connection->copyBytesWrittenSinceLastFlush > RemoteCopyFlushThreshold)
+	connection->copyBytesSent += nbytes;
+	if (connection->copyBytesWrittenSinceLastFlush >
+		RemoteCopyFlushThresholdForConnection(connection))
 	{
-		connection->copyBytesWrittenSinceLastFlush = 0;
-		return FinishConnectionIO(connection, allowInterrupts);
+		return FlushRemoteCopyData(connection);
 	}
 
 	return true;
@@ -713,7 +946,6 @@ bool
 PutRemoteCopyEnd(MultiConnection *connection, const char *errormsg)
 {
 	PGconn *pgConn = connection->pgConn;
-	bool allowInterrupts = true;
 
 	if (PQstatus(pgConn) != CONNECTION_OK)
 	{
@@ -730,15 +962,200 @@ PutRemoteCopyEnd(MultiConnection *connection, const char *errormsg)
 
 	/* see PutRemoteCopyData() */
 
+	return FlushRemoteCopyData(connection);
+}
+
+
+/*
+ * FlushRemoteCopyData waits for the COPY data buffered for the connection to
+ * be sent, and records how long that took to adapt the flush threshold of the
+ * connection.
+ *
+ * Returns true if the data was flushed successfully, false otherwise.
+ */
+static bool
+FlushRemoteCopyData(MultiConnection *connection)
+{
+	bool allowInterrupts = true;
+	uint64 flushedBytes = connection->copyBytesWrittenSinceLastFlush;
+	instr_time flushStart;
+	instr_time flushDuration;
+
 	connection->copyBytesWrittenSinceLastFlush = 0;
 
-	return FinishConnectionIO(connection, allowInterrupts);
+	INSTR_TIME_SET_CURRENT(flushStart);
+
+	/* a full socket buffer means the worker could not keep up */
+	int sendStatus = PQflush(connection->pgConn);
+	if (sendStatus == -1)
+	{
+		return false;
+	}
+
+	bool hadBackpressure = sendStatus == 1;
+
+	if (!FinishConnectionIO(connection, allowInterrupts,
+							CitusWaitEventInfo(CITUS_WAIT_EVENT_COPY_FLUSH)))
+	{
+		return false;
+	}
+
+	INSTR_TIME_SET_CURRENT(flushDuration);
+	INSTR_TIME_SUBTRACT(flushDuration, flushStart);
+	INSTR_TIME_ADD(connection->copyFlushDuration, flushDuration);
+	connection->copyFlushCount++;
+
+	UpdateRemoteCopyFlushThreshold(connection, flushedBytes,
+								   INSTR_TIME_GET_MILLISEC(flushDuration),
+								   hadBackpressure);
+
+	return true;
+}
+
+
+/*
+ * RemoteCopyFlushThresholdForConnection returns the number of bytes of COPY
+ * data that may be buffered for the connection before we flush.
+ */
+static uint64
+RemoteCopyFlushThresholdForConnection(MultiConnection *connection)
+{
+	if (!EnableAdaptiveCopyFlush || connection->copyFlushThreshold == 0)
+	{
+		return RemoteCopyFlushThreshold;
+	}
+
+	return Min(connection->copyFlushThreshold, (uint64) RemoteCopyFlushThreshold);
+}
+
+
+/*
+ * UpdateRemoteCopyFlushThreshold updates the smoothed drain rate of the
+ * connection after flushing the given number of bytes, and derives the flush
+ * threshold from it such that a flush takes about
+ * ADAPTIVE_COPY_FLUSH_TARGET_MS.
+ *
+ * A flush that did not run into back pressure only tells us that the
+ * connection can take at least that much, so the threshold then grows, but
+ * at most by a factor of two per flush to avoid overshooting.
+ */
+static void
+UpdateRemoteCopyFlushThreshold(MultiConnection *connection, uint64 flushedBytes,
+							   double flushMs, bool hadBackpressure)
+{
+	if (flushedBytes == 0)
+	{
+		return;
+	}
+
+	/* avoid dividing by zero for flushes that returned immediately */
+	double drainRate = flushedBytes / Max(flushMs, 0.001);
+
+	if (connection->copyDrainRate == 0)
+	{
+		connection->copyDrainRate = drainRate;
+	}
+	else
+	{
+		connection->copyDrainRate =
+			COPY_DRAIN_RATE_SMOOTHING * drainRate +
+			(1.0 - COPY_DRAIN_RATE_SMOOTHING) * connection->copyDrainRate;
+	}
+
+	uint64 currentThreshold = RemoteCopyFlushThresholdForConnection(connection);
+	uint64 targetThreshold =
+		(uint64) (connection->copyDrainRate * ADAPTIVE_COPY_FLUSH_TARGET_MS);
+
+	if (!hadBackpressure)
+	{
+		targetThreshold = Max(targetThreshold, currentThreshold);
+	}
+
+	targetThreshold = Min(targetThreshold, currentThreshold * 2);
+	targetThreshold = Max(targetThreshold, MIN_ADAPTIVE_COPY_FLUSH_THRESHOLD);
+
+	connection->copyFlushThreshold = targetThreshold;
+}
+
+
+/*
+ * citus_copy_connection_stats returns the COPY throughput statistics of the
+ * connections of the current backend that sent COPY data.
+ */
+Datum
+citus_copy_connection_stats(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	HASH_SEQ_STATUS status;
+	ConnectionHashEntry *entry = NULL;
+
+	hash_seq_init(&status, ConnectionHash);
+	while ((entry = (ConnectionHashEntry *) hash_seq_search(&status)) != NULL)
+	{
+		dlist_iter iter;
+
+		dlist_foreach(iter, entry->connections)
+		{
+			MultiConnection *connection =
+				dlist_container(MultiConnection, connectionNode, iter.cur);
+
+			if (connection->copyBytesSent == 0)
+			{
+				continue;
+			}
+
+			StoreCopyConnectionStats(connection, tupleStore, tupleDescriptor);
+		}
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * StoreCopyConnectionStats adds the COPY throughput statistics of the given
+ * connection to the tuplestore.
+ */
+static void
+StoreCopyConnectionStats(MultiConnection *connection, Tuplestorestate *tupleStore,
+						 TupleDesc tupleDescriptor)
+{
+	Datum values[COPY_CONNECTION_STATS_COLUMNS];
+	bool isNulls[COPY_CONNECTION_STATS_COLUMNS];
+
+	memset(values, 0, sizeof(values));
+	memset(isNulls, false, sizeof(isNulls));
+
+	values[0] = PointerGetDatum(cstring_to_text(connection->hostname));
+	values[1] = Int32GetDatum(connection->port);
+	values[2] = Int64GetDatum(connection->connectionId);
+	values[3] = Int64GetDatum(connection->copyBytesSent);
+	values[4] = Int64GetDatum(connection->copyFlushCount);
+	values[5] = Float8GetDatum(INSTR_TIME_GET_MILLISEC(connection->copyFlushDuration));
+
+	/* the drain rate is in bytes per millisecond */
+	if (connection->copyDrainRate > 0)
+	{
+		values[6] = Float8GetDatum(connection->copyDrainRate * 1000.0);
+	}
+	else
+	{
+		isNulls[6] = true;
+	}
+
+	values[7] = Int64GetDatum(RemoteCopyFlushThresholdForConnection(connection));
+
+	tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
 }
 
 
 /*
  * FinishConnectionIO performs pending IO for the connection, while accepting
- * interrupts.
+ * interrupts. While waiting, the backend reports the given wait event.
  *
  * See GetRemoteCommandResult() for documentation of interrupt handling
  * behaviour.
@@ -746,7 +1163,8 @@ PutRemoteCopyEnd(MultiConnection *connection, const char *errormsg)
  * Returns true if IO was successfully completed, false otherwise.
  */
 static bool
-FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts)
+FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts,
+				   uint32 waitEventInfo)
 {
 	PGconn *pgConn = connection->pgConn;
 	int sock = PQsocket(pgConn);
@@ -793,7 +1211,7 @@ FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts)
 			return true;
 		}
 
-		int rc = WaitLatchOrSocket(MyLatch, waitFlags, sock, 0, PG_WAIT_EXTENSION);
+		int rc = WaitLatchOrSocket(MyLatch, waitFlags, sock, 0, waitEventInfo);
 		if (rc & WL_POSTMASTER_DEATH)
 		{
 			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
@@ -832,6 +1250,20 @@ FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts)
  */
 void
 WaitForAllConnections(List *connectionList, bool raiseInterrupts)
+{
+	WaitForAllConnectionsWithWaitEvent(connectionList, raiseInterrupts,
+									   CitusWaitEventInfo(
+										   CITUS_WAIT_EVENT_REMOTE_QUERY_RESULT));
+}
+
+
+/*
+ * WaitForAllConnectionsWithWaitEvent is WaitForAllConnections, reporting the
+ * given wait event while waiting.
+ */
+void
+WaitForAllConnectionsWithWaitEvent(List *connectionList, bool raiseInterrupts,
+								   uint32 waitEventInfo)
 {
 	int totalConnectionCount = list_length(connectionList);
 	int pendingConnectionsStartIndex = 0;
@@ -896,7 +1328,7 @@ WaitForAllConnections(List *connectionList, bool raiseInterrupts)
 			/* wait for I/O events */
 			int eventCount = WaitEventSetWait(waitEventSet, timeout, events,
 											  pendingConnectionCount,
-											  WAIT_EVENT_CLIENT_READ);
+											  waitEventInfo);
 
 			/* process I/O events */
 			for (; eventIndex < eventCount; eventIndex++)
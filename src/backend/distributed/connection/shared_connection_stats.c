@@ -5,6 +5,11 @@
  *   backends. The primary goal is to prevent excessive number of
  *   connections (typically > max_connections) to any worker node.
  *
+ *   We also keep moving averages of the connection establishment and task
+ *   execution times per worker node, such that new executions can decide
+ *   on the number of connections without first measuring them, along with
+ *   the number of tasks that are running on each worker node.
+ *
  * Copyright (c) Citus Data, Inc.
  *
  *-------------------------------------------------------------------------
@@ -25,6 +30,7 @@
 #include "commands/dbcommands.h"
 #include "distributed/backend_data.h"
 #include "distributed/cancel_utils.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/connection_management.h"
 #include "distributed/listutils.h"
 #include "distributed/locally_reserved_shared_connections.h"
@@ -37,11 +43,22 @@
 #include "distributed/tuplestore.h"
 #include "utils/builtins.h"
 #include "common/hashfn.h"
+#include "port/atomics.h"
 #include "storage/ipc.h"
+#include "storage/spin.h"
 
 
 #define REMOTE_CONNECTION_STATS_COLUMNS 4
 
+/* weight of a new sample in the moving averages of worker latencies */
+#define WORKER_LATENCY_EWMA_WEIGHT 0.2
+
+/* number of query shapes for which we keep the task execution time per worker */
+#define WORKER_LATENCY_QUERY_SHAPE_SLOTS 8
+
+/* number of roles per node whose connections are counted separately */
+#define SHARED_POOL_ROLE_SLOTS 16
+
 
 /*
  * The data structure used to store data in shared memory. This data structure is only
@@ -56,6 +73,9 @@ typedef struct ConnectionStatsSharedData
 
 	LWLock sharedConnectionHashLock;
 	ConditionVariable waitersConditionVariable;
+
+	/* protects SharedWorkerLatencyHash */
+	LWLock sharedWorkerLatencyHashLock;
 } ConnectionStatsSharedData;
 
 
@@ -76,15 +96,84 @@ typedef struct SharedConnStatsHashKey
 	Oid databaseOid;
 } SharedConnStatsHashKey;
 
-/* hash entry for per worker stats */
+/*
+ * Connections and waiting backends of a role on a node, used to share the
+ * pool among the roles, see RoleMayTakeSharedPoolSlot(). Slots without
+ * connections and waiters are free.
+ */
+typedef struct SharedPoolRoleUsage
+{
+	Oid roleId;
+	uint32 connectionCount;
+	uint32 waiterCount;
+
+	/* citus.shared_pool_weight of the last backend of the role */
+	uint32 weight;
+} SharedPoolRoleUsage;
+
+/*
+ * Hash entry for per worker stats. The hash lock only protects adding and
+ * removing entries, such that backends can look up an entry under a shared
+ * lock and adjust its counter atomically. Entries whose counter dropped to 0
+ * are only removed when the hash runs out of space.
+ *
+ * The connections per role are protected by the mutex. Roles that do not
+ * fit in the slots are not counted separately.
+ */
 typedef struct SharedConnStatsHashEntry
 {
 	SharedConnStatsHashKey key;
 
-	int connectionCount;
+	pg_atomic_uint32 connectionCount;
+
+	slock_t roleUsageMutex;
+	SharedPoolRoleUsage roleUsage[SHARED_POOL_ROLE_SLOTS];
 } SharedConnStatsHashEntry;
 
 
+/* moving average of the task execution time of a query shape on a worker */
+typedef struct QueryShapeLatency
+{
+	uint64 queryShapeId;
+	double avgTaskExecutionTime;
+
+	/* value of updateCounter of the entry at the last update, 0 if unused */
+	uint64 lastUpdate;
+} QueryShapeLatency;
+
+
+/*
+ * Hash entry for per worker latencies. Unlike SharedConnStatsHashEntry, these
+ * entries are kept when there are no connections to the worker, such that
+ * the next execution can still benefit from them.
+ */
+typedef struct SharedWorkerLatencyHashEntry
+{
+	SharedConnStatsHashKey key;
+
+	/* moving average of the connection establishment time in microseconds */
+	double avgConnectionEstablishmentTime;
+	bool hasConnectionEstablishmentTime;
+
+	/* moving average of the task execution time of all query shapes */
+	double avgTaskExecutionTime;
+
+	/*
+	 * Number of tasks that the adaptive executors are running on the worker.
+	 * It changes on every task start and finish, so it is updated atomically
+	 * while holding the lock of the hash in shared mode.
+	 */
+	pg_atomic_uint32 runningTaskCount;
+
+	/*
+	 * Moving averages of the task execution times in microseconds, for the
+	 * most recently executed query shapes.
+	 */
+	uint64 updateCounter;
+	QueryShapeLatency queryShapes[WORKER_LATENCY_QUERY_SHAPE_SLOTS];
+} SharedWorkerLatencyHashEntry;
+
+
 /*
  * Controlled via a GUC, never access directly, use GetMaxSharedPoolSize().
  *  "0" means adjust MaxSharedPoolSize automatically by using MaxConnections.
@@ -104,9 +193,19 @@ int LocalSharedPoolSize = 0;
 /* number of connections reserved for Citus */
 int MaxClientConnections = ALLOW_ALL_EXTERNAL_CONNECTIONS;
 
+/* GUC, whether roles that compete for the pool get a share by their weight */
+bool SharedPoolFairShare = false;
+
+/* GUC, number of connections per node that each role can always get */
+int SharedPoolMinConnectionsPerRole = 0;
+
+/* GUC, weight of the role of the backend in citus.shared_pool_fair_share */
+int SharedPoolWeight = 1;
+
 
 /* the following two structs are used for accessing shared memory */
 static HTAB *SharedConnStatsHash = NULL;
+static HTAB *SharedWorkerLatencyHash = NULL;
 static ConnectionStatsSharedData *ConnectionStatsSharedState = NULL;
 
 
@@ -118,9 +217,30 @@ static void StoreAllRemoteConnectionStats(Tuplestorestate *tupleStore, TupleDesc
 										  tupleDescriptor);
 static void LockConnectionSharedMemory(LWLockMode lockMode);
 static void UnLockConnectionSharedMemory(void);
+static SharedConnStatsHashEntry * LockSharedConnStatsEntry(SharedConnStatsHashKey *connKey);
+static void RemoveUnusedSharedConnStatsEntries(void);
+static bool SharedPoolRoleLimitsEnabled(void);
+static bool IncrementConnectionCounterWithinLimit(SharedConnStatsHashEntry *
+												  connectionEntry, int limit,
+												  Oid roleId);
+static bool RoleMayTakeSharedPoolSlot(SharedConnStatsHashEntry *connectionEntry,
+									  SharedPoolRoleUsage *roleUsage,
+									  uint32 currentCount, int limit);
+static SharedPoolRoleUsage * FindSharedPoolRoleUsage(SharedConnStatsHashEntry *
+													 connectionEntry, Oid roleId,
+													 bool createIfMissing);
+static void AdjustSharedPoolRoleConnectionCount(SharedConnStatsHashEntry *
+												connectionEntry, Oid roleId,
+												int delta);
+static void AdjustSharedPoolRoleWaiterCount(const char *hostname, int port, Oid roleId,
+											int delta);
 static bool ShouldWaitForConnection(int currentConnectionCount);
 static uint32 SharedConnectionHashHash(const void *key, Size keysize);
 static int SharedConnectionHashCompare(const void *a, const void *b, Size keysize);
+static SharedWorkerLatencyHashEntry * FindOrCreateWorkerLatencyEntry(const char *hostname,
+																	 int port,
+																	 HASHACTION action);
+static double UpdateMovingAverage(double average, double sample);
 
 
 PG_FUNCTION_INFO_V1(citus_remote_connection_stats);
@@ -176,10 +296,17 @@ StoreAllRemoteConnectionStats(Tuplestorestate *tupleStore, TupleDesc tupleDescri
 			continue;
 		}
 
+		uint32 connectionCount = pg_atomic_read_u32(&connectionEntry->connectionCount);
+		if (connectionCount == 0)
+		{
+			/* unused entries are only removed when the hash is full */
+			continue;
+		}
+
 		values[0] = PointerGetDatum(cstring_to_text(connectionEntry->key.hostname));
 		values[1] = Int32GetDatum(connectionEntry->key.port);
 		values[2] = PointerGetDatum(cstring_to_text(databaseName));
-		values[3] = Int32GetDatum(connectionEntry->connectionCount);
+		values[3] = Int32GetDatum(connectionCount);
 
 		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
 	}
@@ -255,11 +382,33 @@ GetLocalSharedPoolSize(void)
 void
 WaitLoopForSharedConnection(const char *hostname, int port)
 {
-	while (!TryToIncrementSharedConnectionCounter(hostname, port))
+	if (!TryToIncrementSharedConnectionCounter(hostname, port))
 	{
-		CHECK_FOR_INTERRUPTS();
+		/* let the other roles know that we wait, see RoleMayTakeSharedPoolSlot() */
+		Oid userId = GetUserId();
+		bool countWaiter = SharedPoolRoleLimitsEnabled();
+		if (countWaiter)
+		{
+			AdjustSharedPoolRoleWaiterCount(hostname, port, userId, 1);
+		}
+
+		PG_TRY();
+		{
+			while (!TryToIncrementSharedConnectionCounter(hostname, port))
+			{
+				CHECK_FOR_INTERRUPTS();
 
-		WaitForSharedConnection();
+				WaitForSharedConnection();
+			}
+		}
+		PG_FINALLY();
+		{
+			if (countWaiter)
+			{
+				AdjustSharedPoolRoleWaiterCount(hostname, port, userId, -1);
+			}
+		}
+		PG_END_TRY();
 	}
 
 	ConditionVariableCancelSleep();
@@ -336,17 +485,31 @@ TryToIncrementSharedConnectionCounter(const char *hostname, int port)
 		activeBackendCount = GetExternalClientBackendCount();
 	}
 
-	LockConnectionSharedMemory(LW_EXCLUSIVE);
-
 	/*
-	 * As the hash map is  allocated in shared memory, it doesn't rely on palloc for
-	 * memory allocation, so we could get NULL via HASH_ENTER_NULL when there is no
-	 * space in the shared memory. That's why we prefer continuing the execution
-	 * instead of throwing an error.
+	 * For local nodes, solely relying on citus.max_shared_pool_size or
+	 * max_connections might not be sufficient. The former gives us
+	 * a preview of the future (e.g., we let the new connections to establish,
+	 * but they are not established yet). The latter gives us the close to
+	 * precise view of the past (e.g., the active number of client backends).
+	 *
+	 * Overall, we want to limit both of the metrics. The former limit typically
+	 * kicks in under regular loads, where the load of the database increases in
+	 * a reasonable pace. The latter limit typically kicks in when the database
+	 * is issued lots of concurrent sessions at the same time, such as benchmarks.
 	 */
-	bool entryFound = false;
-	SharedConnStatsHashEntry *connectionEntry =
-		hash_search(SharedConnStatsHash, &connKey, HASH_ENTER_NULL, &entryFound);
+	int connectionLimit = GetMaxSharedPoolSize();
+	if (connectionToLocalNode)
+	{
+		connectionLimit = GetLocalSharedPoolSize();
+
+		if (activeBackendCount + 1 > connectionLimit)
+		{
+			/* only the first connection is allowed */
+			connectionLimit = 0;
+		}
+	}
+
+	SharedConnStatsHashEntry *connectionEntry = LockSharedConnStatsEntry(&connKey);
 
 	/*
 	 * It is possible to throw an error at this point, but that doesn't help us in anyway.
@@ -359,51 +522,8 @@ TryToIncrementSharedConnectionCounter(const char *hostname, int port)
 		return true;
 	}
 
-	if (!entryFound)
-	{
-		/* we successfully allocated the entry for the first time, so initialize it */
-		connectionEntry->connectionCount = 1;
-
-		counterIncremented = true;
-	}
-	else if (connectionToLocalNode)
-	{
-		/*
-		 * For local nodes, solely relying on citus.max_shared_pool_size or
-		 * max_connections might not be sufficient. The former gives us
-		 * a preview of the future (e.g., we let the new connections to establish,
-		 * but they are not established yet). The latter gives us the close to
-		 * precise view of the past (e.g., the active number of client backends).
-		 *
-		 * Overall, we want to limit both of the metrics. The former limit typically
-		 * kicks in under regular loads, where the load of the database increases in
-		 * a reasonable pace. The latter limit typically kicks in when the database
-		 * is issued lots of concurrent sessions at the same time, such as benchmarks.
-		 */
-		if (activeBackendCount + 1 > GetLocalSharedPoolSize())
-		{
-			counterIncremented = false;
-		}
-		else if (connectionEntry->connectionCount + 1 > GetLocalSharedPoolSize())
-		{
-			counterIncremented = false;
-		}
-		else
-		{
-			connectionEntry->connectionCount++;
-			counterIncremented = true;
-		}
-	}
-	else if (connectionEntry->connectionCount + 1 > GetMaxSharedPoolSize())
-	{
-		/* there is no space left for this connection */
-		counterIncremented = false;
-	}
-	else
-	{
-		connectionEntry->connectionCount++;
-		counterIncremented = true;
-	}
+	counterIncremented = IncrementConnectionCounterWithinLimit(connectionEntry,
+															   connectionLimit, userId);
 
 	UnLockConnectionSharedMemory();
 
@@ -437,16 +557,7 @@ IncrementSharedConnectionCounter(const char *hostname, int port)
 	connKey.port = port;
 	connKey.databaseOid = MyDatabaseId;
 
-	LockConnectionSharedMemory(LW_EXCLUSIVE);
-
-	/*
-	 * As the hash map is  allocated in shared memory, it doesn't rely on palloc for
-	 * memory allocation, so we could get NULL via HASH_ENTER_NULL. That's why we prefer
-	 * continuing the execution instead of throwing an error.
-	 */
-	bool entryFound = false;
-	SharedConnStatsHashEntry *connectionEntry =
-		hash_search(SharedConnStatsHash, &connKey, HASH_ENTER_NULL, &entryFound);
+	SharedConnStatsHashEntry *connectionEntry = LockSharedConnStatsEntry(&connKey);
 
 	/*
 	 * It is possible to throw an error at this point, but that doesn't help us in anyway.
@@ -463,24 +574,24 @@ IncrementSharedConnectionCounter(const char *hostname, int port)
 		return;
 	}
 
-	if (!entryFound)
+	pg_atomic_fetch_add_u32(&connectionEntry->connectionCount, 1);
+
+	if (SharedPoolRoleLimitsEnabled())
 	{
-		/* we successfully allocated the entry for the first time, so initialize it */
-		connectionEntry->connectionCount = 0;
+		AdjustSharedPoolRoleConnectionCount(connectionEntry, GetUserId(), 1);
 	}
 
-	connectionEntry->connectionCount += 1;
-
 	UnLockConnectionSharedMemory();
 }
 
 
 /*
  * DecrementSharedConnectionCounter decrements the shared counter
- * for the given hostname and port for the given count.
+ * for the given hostname and port, and the connections of the role that
+ * the connection was charged to.
  */
 void
-DecrementSharedConnectionCounter(const char *hostname, int port)
+DecrementSharedConnectionCounter(const char *hostname, int port, Oid roleId)
 {
 	SharedConnStatsHashKey connKey;
 
@@ -505,7 +616,7 @@ DecrementSharedConnectionCounter(const char *hostname, int port)
 	connKey.port = port;
 	connKey.databaseOid = MyDatabaseId;
 
-	LockConnectionSharedMemory(LW_EXCLUSIVE);
+	LockConnectionSharedMemory(LW_SHARED);
 
 	bool entryFound = false;
 	SharedConnStatsHashEntry *connectionEntry =
@@ -526,20 +637,13 @@ DecrementSharedConnectionCounter(const char *hostname, int port)
 	}
 
 	/* we should never go below 0 */
-	Assert(connectionEntry->connectionCount > 0);
+	uint32 previousCount PG_USED_FOR_ASSERTS_ONLY =
+		pg_atomic_fetch_sub_u32(&connectionEntry->connectionCount, 1);
+	Assert(previousCount > 0);
 
-	connectionEntry->connectionCount -= 1;
-
-	if (connectionEntry->connectionCount == 0)
+	if (SharedPoolRoleLimitsEnabled())
 	{
-		/*
-		 * We don't have to remove at this point as the node might be still active
-		 * and will have new connections open to it. Still, this seems like a convenient
-		 * place to remove the entry, as connectionCount == 0 implies that the server is
-		 * not busy, and given the default value of MaxCachedConnectionsPerWorker = 1,
-		 * we're unlikely to trigger this often.
-		 */
-		hash_search(SharedConnStatsHash, &connKey, HASH_REMOVE, &entryFound);
+		AdjustSharedPoolRoleConnectionCount(connectionEntry, roleId, -1);
 	}
 
 	UnLockConnectionSharedMemory();
@@ -548,6 +652,303 @@ DecrementSharedConnectionCounter(const char *hostname, int port)
 }
 
 
+/*
+ * SharedConnectionPoolIsFull returns whether the shared connection counter for
+ * the given hostname and port reached citus.max_shared_pool_size, meaning that
+ * backends that need a new connection to the node have to wait until another
+ * backend closes one.
+ */
+bool
+SharedConnectionPoolIsFull(const char *hostname, int port)
+{
+	SharedConnStatsHashKey connKey;
+
+	/*
+	 * Do not call GetMaxSharedPoolSize() here, since it may read from
+	 * the catalog and we may be at the end of the transaction.
+	 */
+	int maxSharedPoolSize = MaxSharedPoolSize;
+	if (maxSharedPoolSize == DISABLE_CONNECTION_THROTTLING)
+	{
+		/* connection throttling disabled */
+		return false;
+	}
+	else if (maxSharedPoolSize == ADJUST_POOLSIZE_AUTOMATICALLY)
+	{
+		maxSharedPoolSize = MaxConnections;
+	}
+
+	strlcpy(connKey.hostname, hostname, MAX_NODE_LENGTH);
+	connKey.port = port;
+	connKey.databaseOid = MyDatabaseId;
+
+	LockConnectionSharedMemory(LW_SHARED);
+
+	bool entryFound = false;
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search(SharedConnStatsHash, &connKey, HASH_FIND, &entryFound);
+
+	bool poolIsFull = entryFound &&
+					  pg_atomic_read_u32(&connectionEntry->connectionCount) >=
+					  maxSharedPoolSize;
+
+	UnLockConnectionSharedMemory();
+
+	return poolIsFull;
+}
+
+
+/*
+ * RecordWorkerConnectionEstablishmentTime adds the time it took to establish
+ * a connection to the given node to the moving average of the node.
+ */
+void
+RecordWorkerConnectionEstablishmentTime(const char *hostname, int port,
+										double durationMicrosecs)
+{
+	LWLockAcquire(&ConnectionStatsSharedState->sharedWorkerLatencyHashLock,
+				  LW_EXCLUSIVE);
+
+	SharedWorkerLatencyHashEntry *latencyEntry =
+		FindOrCreateWorkerLatencyEntry(hostname, port, HASH_ENTER_NULL);
+	if (latencyEntry != NULL)
+	{
+		latencyEntry->avgConnectionEstablishmentTime =
+			latencyEntry->hasConnectionEstablishmentTime ?
+			UpdateMovingAverage(latencyEntry->avgConnectionEstablishmentTime,
+								durationMicrosecs) :
+			durationMicrosecs;
+		latencyEntry->hasConnectionEstablishmentTime = true;
+	}
+
+	LWLockRelease(&ConnectionStatsSharedState->sharedWorkerLatencyHashLock);
+}
+
+
+/*
+ * RecordWorkerTaskExecutionTime adds the average execution time of the tasks
+ * of an execution of the given query shape on the given node to the moving
+ * average of the query shape. If there is no slot for the query shape, we take
+ * the least recently updated one.
+ */
+void
+RecordWorkerTaskExecutionTime(const char *hostname, int port, uint64 queryShapeId,
+							  double durationMicrosecs)
+{
+	LWLockAcquire(&ConnectionStatsSharedState->sharedWorkerLatencyHashLock,
+				  LW_EXCLUSIVE);
+
+	SharedWorkerLatencyHashEntry *latencyEntry =
+		FindOrCreateWorkerLatencyEntry(hostname, port, HASH_ENTER_NULL);
+	if (latencyEntry != NULL)
+	{
+		QueryShapeLatency *shapeLatency = NULL;
+		QueryShapeLatency *leastRecentlyUpdated = &latencyEntry->queryShapes[0];
+
+		for (int slotIndex = 0; slotIndex < WORKER_LATENCY_QUERY_SHAPE_SLOTS;
+			 slotIndex++)
+		{
+			QueryShapeLatency *slot = &latencyEntry->queryShapes[slotIndex];
+
+			if (slot->lastUpdate != 0 && slot->queryShapeId == queryShapeId)
+			{
+				shapeLatency = slot;
+				break;
+			}
+
+			if (slot->lastUpdate < leastRecentlyUpdated->lastUpdate)
+			{
+				leastRecentlyUpdated = slot;
+			}
+		}
+
+		latencyEntry->avgTaskExecutionTime =
+			latencyEntry->updateCounter == 0 ?
+			durationMicrosecs :
+			UpdateMovingAverage(latencyEntry->avgTaskExecutionTime, durationMicrosecs);
+
+		latencyEntry->updateCounter++;
+
+		if (shapeLatency == NULL)
+		{
+			shapeLatency = leastRecentlyUpdated;
+			shapeLatency->queryShapeId = queryShapeId;
+			shapeLatency->avgTaskExecutionTime = durationMicrosecs;
+		}
+		else
+		{
+			shapeLatency->avgTaskExecutionTime =
+				UpdateMovingAverage(shapeLatency->avgTaskExecutionTime,
+									durationMicrosecs);
+		}
+
+		shapeLatency->lastUpdate = latencyEntry->updateCounter;
+	}
+
+	LWLockRelease(&ConnectionStatsSharedState->sharedWorkerLatencyHashLock);
+}
+
+
+/*
+ * GetWorkerLatencyEstimates returns the moving averages of the task execution
+ * time for the given query shape and the connection establishment time on the
+ * given node, as observed by all backends. The values are 0 when unknown.
+ */
+void
+GetWorkerLatencyEstimates(const char *hostname, int port, uint64 queryShapeId,
+						  double *avgTaskExecutionTime,
+						  double *avgConnectionEstablishmentTime)
+{
+	*avgTaskExecutionTime = 0;
+	*avgConnectionEstablishmentTime = 0;
+
+	LWLockAcquire(&ConnectionStatsSharedState->sharedWorkerLatencyHashLock,
+				  LW_SHARED);
+
+	SharedWorkerLatencyHashEntry *latencyEntry =
+		FindOrCreateWorkerLatencyEntry(hostname, port, HASH_FIND);
+	if (latencyEntry != NULL)
+	{
+		*avgConnectionEstablishmentTime = latencyEntry->avgConnectionEstablishmentTime;
+
+		for (int slotIndex = 0; slotIndex < WORKER_LATENCY_QUERY_SHAPE_SLOTS;
+			 slotIndex++)
+		{
+			QueryShapeLatency *slot = &latencyEntry->queryShapes[slotIndex];
+
+			if (slot->lastUpdate != 0 && slot->queryShapeId == queryShapeId)
+			{
+				*avgTaskExecutionTime = slot->avgTaskExecutionTime;
+				break;
+			}
+		}
+	}
+
+	LWLockRelease(&ConnectionStatsSharedState->sharedWorkerLatencyHashLock);
+}
+
+
+/*
+ * AdjustWorkerRunningTaskCount adds the given delta to the number of tasks
+ * that are running on the given node.
+ *
+ * This happens for every task the adaptive executor runs, so we only take the
+ * lock of the hash in shared mode and change the counter atomically. Only the
+ * first task on a node needs the exclusive lock, to create the entry.
+ */
+void
+AdjustWorkerRunningTaskCount(const char *hostname, int port, int delta)
+{
+	LWLockAcquire(&ConnectionStatsSharedState->sharedWorkerLatencyHashLock,
+				  LW_SHARED);
+
+	SharedWorkerLatencyHashEntry *latencyEntry =
+		FindOrCreateWorkerLatencyEntry(hostname, port, HASH_FIND);
+	if (latencyEntry == NULL)
+	{
+		LWLockRelease(&ConnectionStatsSharedState->sharedWorkerLatencyHashLock);
+		LWLockAcquire(&ConnectionStatsSharedState->sharedWorkerLatencyHashLock,
+					  LW_EXCLUSIVE);
+
+		latencyEntry = FindOrCreateWorkerLatencyEntry(hostname, port, HASH_ENTER_NULL);
+	}
+
+	if (latencyEntry != NULL)
+	{
+		uint32 runningTaskCount = pg_atomic_read_u32(&latencyEntry->runningTaskCount);
+		uint32 newRunningTaskCount = 0;
+
+		do {
+			/* the entry might have been created after we incremented the count */
+			newRunningTaskCount = (uint32) Max(0, (int64) runningTaskCount + delta);
+		} while (!pg_atomic_compare_exchange_u32(&latencyEntry->runningTaskCount,
+												 &runningTaskCount,
+												 newRunningTaskCount));
+	}
+
+	LWLockRelease(&ConnectionStatsSharedState->sharedWorkerLatencyHashLock);
+}
+
+
+/*
+ * GetWorkerLoad returns the number of tasks that are running on the given
+ * node and the moving average of their execution time across all query
+ * shapes. Both values are 0 when unknown.
+ */
+void
+GetWorkerLoad(const char *hostname, int port, int *runningTaskCount,
+			  double *avgTaskExecutionTime)
+{
+	*runningTaskCount = 0;
+	*avgTaskExecutionTime = 0;
+
+	LWLockAcquire(&ConnectionStatsSharedState->sharedWorkerLatencyHashLock,
+				  LW_SHARED);
+
+	SharedWorkerLatencyHashEntry *latencyEntry =
+		FindOrCreateWorkerLatencyEntry(hostname, port, HASH_FIND);
+	if (latencyEntry != NULL)
+	{
+		*runningTaskCount = (int) pg_atomic_read_u32(&latencyEntry->runningTaskCount);
+		*avgTaskExecutionTime = latencyEntry->avgTaskExecutionTime;
+	}
+
+	LWLockRelease(&ConnectionStatsSharedState->sharedWorkerLatencyHashLock);
+}
+
+
+/*
+ * FindOrCreateWorkerLatencyEntry finds the latency entry for the given node
+ * and the current database in SharedWorkerLatencyHash, or creates it when the
+ * action is HASH_ENTER_NULL. The caller should hold the lock of the hash.
+ *
+ * The function returns NULL if there is no entry, or if there is no space
+ * left in the shared memory for a new one. The latencies are only used to
+ * optimize the executions, so we prefer not to throw errors here.
+ */
+static SharedWorkerLatencyHashEntry *
+FindOrCreateWorkerLatencyEntry(const char *hostname, int port, HASHACTION action)
+{
+	SharedConnStatsHashKey workerKey;
+
+	if (strlen(hostname) >= MAX_NODE_LENGTH)
+	{
+		return NULL;
+	}
+
+	memset(&workerKey, 0, sizeof(workerKey));
+	strlcpy(workerKey.hostname, hostname, MAX_NODE_LENGTH);
+	workerKey.port = port;
+	workerKey.databaseOid = MyDatabaseId;
+
+	bool entryFound = false;
+	SharedWorkerLatencyHashEntry *latencyEntry =
+		hash_search(SharedWorkerLatencyHash, &workerKey, action, &entryFound);
+
+	if (latencyEntry != NULL && !entryFound)
+	{
+		/* we successfully allocated the entry for the first time, so initialize it */
+		memset(((char *) latencyEntry) + sizeof(SharedConnStatsHashKey), 0,
+			   sizeof(SharedWorkerLatencyHashEntry) - sizeof(SharedConnStatsHashKey));
+		pg_atomic_init_u32(&latencyEntry->runningTaskCount, 0);
+	}
+
+	return latencyEntry;
+}
+
+
+/*
+ * UpdateMovingAverage returns the exponentially weighted moving average after
+ * adding the given sample.
+ */
+static double
+UpdateMovingAverage(double average, double sample)
+{
+	return (1.0 - WORKER_LATENCY_EWMA_WEIGHT) * average +
+		   WORKER_LATENCY_EWMA_WEIGHT * sample;
+}
+
+
 /*
  * LockConnectionSharedMemory is a utility function that should be used when
  * accessing to the SharedConnStatsHash, which is in the shared memory.
@@ -570,6 +971,337 @@ UnLockConnectionSharedMemory(void)
 }
 
 
+/*
+ * LockSharedConnStatsEntry returns the SharedConnStatsHash entry for the given
+ * key, creating it if it does not exist yet, while holding the lock on the
+ * hash. In the common case of an existing entry, the lock is only taken in
+ * shared mode, and the caller is expected to change the counter of the entry
+ * atomically. The caller should call UnLockConnectionSharedMemory() when done
+ * with the entry.
+ *
+ * As the hash map is allocated in shared memory, it doesn't rely on palloc for
+ * memory allocation, so we could get NULL via HASH_ENTER_NULL when there is no
+ * space in the shared memory. In that case, we return NULL.
+ */
+static SharedConnStatsHashEntry *
+LockSharedConnStatsEntry(SharedConnStatsHashKey *connKey)
+{
+	bool entryFound = false;
+
+	LockConnectionSharedMemory(LW_SHARED);
+
+	SharedConnStatsHashEntry *connectionEntry =
+		hash_search(SharedConnStatsHash, connKey, HASH_FIND, &entryFound);
+	if (entryFound)
+	{
+		return connectionEntry;
+	}
+
+	UnLockConnectionSharedMemory();
+
+	/* adding entries requires the lock in exclusive mode */
+	LockConnectionSharedMemory(LW_EXCLUSIVE);
+
+	connectionEntry = hash_search(SharedConnStatsHash, connKey, HASH_ENTER_NULL,
+								  &entryFound);
+	if (!connectionEntry)
+	{
+		/* make space by removing the entries of nodes without connections */
+		RemoveUnusedSharedConnStatsEntries();
+
+		connectionEntry = hash_search(SharedConnStatsHash, connKey, HASH_ENTER_NULL,
+									  &entryFound);
+	}
+
+	if (connectionEntry && !entryFound)
+	{
+		/* we successfully allocated the entry for the first time, so initialize it */
+		pg_atomic_init_u32(&connectionEntry->connectionCount, 0);
+
+		SpinLockInit(&connectionEntry->roleUsageMutex);
+		memset(connectionEntry->roleUsage, 0, sizeof(connectionEntry->roleUsage));
+	}
+
+	return connectionEntry;
+}
+
+
+/*
+ * RemoveUnusedSharedConnStatsEntries removes the entries of SharedConnStatsHash
+ * whose connection counter is 0. The caller should hold the lock in exclusive
+ * mode, such that no other backend refers to the entries.
+ */
+static void
+RemoveUnusedSharedConnStatsEntries(void)
+{
+	HASH_SEQ_STATUS status;
+	SharedConnStatsHashEntry *connectionEntry = NULL;
+
+	hash_seq_init(&status, SharedConnStatsHash);
+	while ((connectionEntry = (SharedConnStatsHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		if (pg_atomic_read_u32(&connectionEntry->connectionCount) == 0)
+		{
+			/* removing the entry that was just returned is allowed by dynahash */
+			hash_search(SharedConnStatsHash, &connectionEntry->key, HASH_REMOVE, NULL);
+		}
+	}
+}
+
+
+/*
+ * SharedPoolRoleLimitsEnabled returns whether citus.shared_pool_fair_share or
+ * citus.shared_pool_min_connections_per_role is set, in which case we keep
+ * track of the connections and the waiters of each role on each node.
+ *
+ * Otherwise the connections per role are not needed and we skip them, such
+ * that the counters are maintained without taking the mutex of the entry.
+ * Since the settings can change while connections are open, the connections
+ * per role only converge once the connections that were opened in between
+ * are closed. That merely makes the limits per role less accurate for a
+ * while, the total number of connections is always exact.
+ */
+static bool
+SharedPoolRoleLimitsEnabled(void)
+{
+	return SharedPoolFairShare || SharedPoolMinConnectionsPerRole > 0;
+}
+
+
+/*
+ * IncrementConnectionCounterWithinLimit increments the connection counter of
+ * the given entry if it is below the given limit, using compare-and-swap such
+ * that concurrent backends only need a shared lock on the hash. The first
+ * connection to a node is always allowed. Returns whether the counter was
+ * incremented.
+ *
+ * When citus.shared_pool_fair_share or citus.shared_pool_min_connections_per_role
+ * is set, the role also has to be allowed to take the slot, which we decide
+ * under the mutex of the connections per role instead. Otherwise, we do not
+ * keep track of the connections per role, see SharedPoolRoleLimitsEnabled().
+ */
+static bool
+IncrementConnectionCounterWithinLimit(SharedConnStatsHashEntry *connectionEntry,
+									  int limit, Oid roleId)
+{
+	if (!SharedPoolRoleLimitsEnabled())
+	{
+		uint32 currentCount = pg_atomic_read_u32(&connectionEntry->connectionCount);
+
+		while (currentCount == 0 || (int64) currentCount < limit)
+		{
+			/* on failure, currentCount is set to the value of the counter */
+			if (pg_atomic_compare_exchange_u32(&connectionEntry->connectionCount,
+											   &currentCount, currentCount + 1))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	SpinLockAcquire(&connectionEntry->roleUsageMutex);
+
+	uint32 currentCount = pg_atomic_read_u32(&connectionEntry->connectionCount);
+	SharedPoolRoleUsage *roleUsage =
+		FindSharedPoolRoleUsage(connectionEntry, roleId, true);
+	if (roleUsage != NULL)
+	{
+		roleUsage->weight = SharedPoolWeight;
+	}
+
+	bool mayIncrement = currentCount == 0 ||
+						((int64) currentCount < limit &&
+						 RoleMayTakeSharedPoolSlot(connectionEntry, roleUsage,
+												   currentCount, limit));
+	if (mayIncrement)
+	{
+		pg_atomic_fetch_add_u32(&connectionEntry->connectionCount, 1);
+
+		if (roleUsage != NULL)
+		{
+			roleUsage->connectionCount++;
+		}
+	}
+
+	SpinLockRelease(&connectionEntry->roleUsageMutex);
+
+	return mayIncrement;
+}
+
+
+/*
+ * RoleMayTakeSharedPoolSlot decides whether the role of the given usage, or a
+ * role without a slot when roleUsage is NULL, may take one of the remaining
+ * slots of a node whose pool is not full. The caller should hold the mutex of
+ * the connections per role.
+ *
+ * A role can always get citus.shared_pool_min_connections_per_role slots.
+ * Beyond that, it may not take the slots that the other active roles, which
+ * have connections or wait for one, can still claim. Lastly, when
+ * citus.shared_pool_fair_share is on and other roles wait for a slot, the
+ * role may not exceed its share of the pool by weight, such that a single
+ * busy role cannot starve the others.
+ */
+static bool
+RoleMayTakeSharedPoolSlot(SharedConnStatsHashEntry *connectionEntry,
+						  SharedPoolRoleUsage *roleUsage, uint32 currentCount, int limit)
+{
+	int64 minConnections = SharedPoolMinConnectionsPerRole;
+	int64 roleConnectionCount = roleUsage != NULL ? roleUsage->connectionCount : 0;
+
+	if (roleUsage != NULL && roleConnectionCount < minConnections)
+	{
+		return true;
+	}
+
+	int64 unclaimedMinConnections = 0;
+	uint64 weightSum = roleUsage != NULL ? roleUsage->weight : 1;
+	bool otherRolesWaiting = false;
+
+	for (int slotIndex = 0; slotIndex < SHARED_POOL_ROLE_SLOTS; slotIndex++)
+	{
+		SharedPoolRoleUsage *otherUsage = &connectionEntry->roleUsage[slotIndex];
+		if (otherUsage == roleUsage ||
+			(otherUsage->connectionCount == 0 && otherUsage->waiterCount == 0))
+		{
+			continue;
+		}
+
+		if (otherUsage->connectionCount < minConnections)
+		{
+			unclaimedMinConnections += minConnections - otherUsage->connectionCount;
+		}
+
+		weightSum += otherUsage->weight;
+		otherRolesWaiting |= otherUsage->waiterCount > 0;
+	}
+
+	if ((int64) currentCount + unclaimedMinConnections >= limit)
+	{
+		return false;
+	}
+
+	if (SharedPoolFairShare && otherRolesWaiting)
+	{
+		if (roleUsage == NULL)
+		{
+			/* roles without a slot yield to the counted roles */
+			return false;
+		}
+
+		double fairShare = (double) limit * roleUsage->weight / weightSum;
+		if (roleConnectionCount >= fairShare)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * FindSharedPoolRoleUsage returns the slot of the given role in the
+ * connections per role of the given entry, optionally taking a free slot
+ * for the role. Returns NULL if the role has no slot. The caller should
+ * hold the mutex of the connections per role.
+ */
+static SharedPoolRoleUsage *
+FindSharedPoolRoleUsage(SharedConnStatsHashEntry *connectionEntry, Oid roleId,
+						bool createIfMissing)
+{
+	SharedPoolRoleUsage *freeUsage = NULL;
+
+	for (int slotIndex = 0; slotIndex < SHARED_POOL_ROLE_SLOTS; slotIndex++)
+	{
+		SharedPoolRoleUsage *roleUsage = &connectionEntry->roleUsage[slotIndex];
+		bool slotIsFree = roleUsage->connectionCount == 0 &&
+						  roleUsage->waiterCount == 0;
+
+		if (roleUsage->roleId == roleId && !slotIsFree)
+		{
+			return roleUsage;
+		}
+
+		if (slotIsFree && freeUsage == NULL)
+		{
+			freeUsage = roleUsage;
+		}
+	}
+
+	if (!createIfMissing || freeUsage == NULL)
+	{
+		return NULL;
+	}
+
+	freeUsage->roleId = roleId;
+	freeUsage->weight = SharedPoolWeight;
+
+	return freeUsage;
+}
+
+
+/*
+ * AdjustSharedPoolRoleConnectionCount adds delta to the connections of the
+ * given role on the node of the given entry.
+ */
+static void
+AdjustSharedPoolRoleConnectionCount(SharedConnStatsHashEntry *connectionEntry,
+									Oid roleId, int delta)
+{
+	SpinLockAcquire(&connectionEntry->roleUsageMutex);
+
+	SharedPoolRoleUsage *roleUsage =
+		FindSharedPoolRoleUsage(connectionEntry, roleId, delta > 0);
+	if (roleUsage != NULL && (delta > 0 || roleUsage->connectionCount > 0))
+	{
+		roleUsage->connectionCount += delta;
+	}
+
+	SpinLockRelease(&connectionEntry->roleUsageMutex);
+}
+
+
+/*
+ * AdjustSharedPoolRoleWaiterCount adds delta to the number of backends of the
+ * given role that wait for a connection slot on the given node.
+ */
+static void
+AdjustSharedPoolRoleWaiterCount(const char *hostname, int port, Oid roleId, int delta)
+{
+	SharedConnStatsHashKey connKey;
+
+	if (MaxSharedPoolSize == DISABLE_CONNECTION_THROTTLING)
+	{
+		return;
+	}
+
+	memset(&connKey, 0, sizeof(connKey));
+	strlcpy(connKey.hostname, hostname, MAX_NODE_LENGTH);
+	connKey.port = port;
+	connKey.databaseOid = MyDatabaseId;
+
+	SharedConnStatsHashEntry *connectionEntry = LockSharedConnStatsEntry(&connKey);
+	if (connectionEntry != NULL)
+	{
+		SpinLockAcquire(&connectionEntry->roleUsageMutex);
+
+		SharedPoolRoleUsage *roleUsage =
+			FindSharedPoolRoleUsage(connectionEntry, roleId, delta > 0);
+		if (roleUsage != NULL && (delta > 0 || roleUsage->waiterCount > 0))
+		{
+			roleUsage->waiterCount += delta;
+		}
+
+		SpinLockRelease(&connectionEntry->roleUsageMutex);
+	}
+
+	UnLockConnectionSharedMemory();
+}
+
+
 /*
  * WakeupWaiterBackendsForSharedConnection is a wrapper around the condition variable
  * broadcast operation.
@@ -603,7 +1335,7 @@ void
 WaitForSharedConnection(void)
 {
 	ConditionVariableSleep(&ConnectionStatsSharedState->waitersConditionVariable,
-						   PG_WAIT_EXTENSION);
+						   CitusWaitEventInfo(CITUS_WAIT_EVENT_SHARED_CONNECTION));
 }
 
 
@@ -645,6 +1377,11 @@ SharedConnectionStatsShmemSize(void)
 
 	size = add_size(size, hashSize);
 
+	Size latencyHashSize = hash_estimate_size(MaxWorkerNodesTracked,
+											  sizeof(SharedWorkerLatencyHashEntry));
+
+	size = add_size(size, latencyHashSize);
+
 	return size;
 }
 
@@ -691,6 +1428,9 @@ SharedConnectionStatsShmemInit(void)
 		LWLockInitialize(&ConnectionStatsSharedState->sharedConnectionHashLock,
 						 ConnectionStatsSharedState->sharedConnectionHashTrancheId);
 
+		LWLockInitialize(&ConnectionStatsSharedState->sharedWorkerLatencyHashLock,
+						 ConnectionStatsSharedState->sharedConnectionHashTrancheId);
+
 		ConditionVariableInit(&ConnectionStatsSharedState->waitersConditionVariable);
 	}
 
@@ -699,9 +1439,16 @@ SharedConnectionStatsShmemInit(void)
 		ShmemInitHash("Shared Conn. Stats Hash", MaxWorkerNodesTracked,
 					  MaxWorkerNodesTracked, &info, hashFlags);
 
+	/* create (hostname, port, database) -> [latencies], using the same key */
+	info.entrysize = sizeof(SharedWorkerLatencyHashEntry);
+	SharedWorkerLatencyHash =
+		ShmemInitHash("Shared Worker Latency Hash", MaxWorkerNodesTracked,
+					  MaxWorkerNodesTracked, &info, hashFlags);
+
 	LWLockRelease(AddinShmemInitLock);
 
 	Assert(SharedConnStatsHash != NULL);
+	Assert(SharedWorkerLatencyHash != NULL);
 	Assert(ConnectionStatsSharedState->sharedConnectionHashTrancheId != 0);
 
 	if (prev_shmem_startup_hook != NULL)
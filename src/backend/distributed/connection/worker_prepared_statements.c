@@ -0,0 +1,356 @@
+/*-------------------------------------------------------------------------
+ *
+ * worker_prepared_statements.c
+ *	  Named prepared statements on worker connections.
+ *
+ * Parameterized router queries are normally sent with PQsendQueryParams,
+ * which makes the worker parse and plan the shard query on every execution.
+ * When citus.enable_worker_prepared_statements is on, we instead prepare the
+ * shard query as a named statement the first time a connection runs it, and
+ * only send the parameters afterwards. The worker then caches the parse tree
+ * and, depending on its plan_cache_mode, the plan.
+ *
+ * The statements of a connection are kept in a hash keyed by the query string
+ * and the parameter types. Any invalidation of the Citus metadata cache, for
+ * instance because of DDL on a distributed table or a shard move, makes the
+ * connections deallocate their statements before preparing new ones.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "libpq-fe.h"
+
+#include "common/hashfn.h"
+#include "distributed/connection_management.h"
+#include "distributed/remote_commands.h"
+#include "distributed/worker_prepared_statements.h"
+#include "lib/stringinfo.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+
+/* prefix of the names of the statements we prepare on the workers */
+#define WORKER_PREPARED_STATEMENT_PREFIX "citus_stmt_"
+
+/* we stop preparing new statements on a connection beyond this number */
+#define MAX_WORKER_PREPARED_STATEMENTS 1024
+
+
+/*
+ * WorkerPreparedStatementKey identifies a statement by the query string and
+ * the parameter types, both encoded in keyString.
+ */
+typedef struct WorkerPreparedStatementKey
+{
+	char *keyString;
+} WorkerPreparedStatementKey;
+
+
+/* statement prepared on the remote end of a connection */
+typedef struct WorkerPreparedStatement
+{
+	WorkerPreparedStatementKey key;
+	uint32 statementId;
+} WorkerPreparedStatement;
+
+
+/* the statements prepared on the remote end of a connection */
+typedef struct WorkerPreparedStatementCache
+{
+	/* memory context holding the cache, its hash and the key strings */
+	MemoryContext context;
+
+	HTAB *statementHash;
+
+	/* value of WorkerPreparedStatementGeneration when the cache was reset */
+	uint64 generation;
+
+	uint32 statementCount;
+} WorkerPreparedStatementCache;
+
+
+static WorkerPreparedStatementCache * GetWorkerPreparedStatementCache(
+	MultiConnection *connection);
+static uint32 WorkerPreparedStatementKeyHash(const void *key, Size keysize);
+static int WorkerPreparedStatementKeyCompare(const void *left, const void *right,
+											 Size keysize);
+static char * WorkerPreparedStatementKeyString(const char *command, int parameterCount,
+											   const Oid *parameterTypes);
+static char * FindOrPrepareStatement(MultiConnection *connection, const char *command,
+									 int parameterCount, const Oid *parameterTypes);
+static bool PrepareStatementOnConnection(MultiConnection *connection,
+										 const char *statementName, const char *command,
+										 int parameterCount, const Oid *parameterTypes);
+
+
+/* GUC, whether to use named prepared statements for parameterized router queries */
+bool EnableWorkerPreparedStatements = false;
+
+/* incremented when the prepared statements on the workers might be stale */
+static uint64 WorkerPreparedStatementGeneration = 0;
+
+
+/*
+ * SendRemoteCommandPrepared sends a parameterized command through a named
+ * prepared statement on the connection, preparing the statement if it does
+ * not exist yet. Preparing is done synchronously, so the caller should only
+ * use this function when it has no other connections to attend to, and the
+ * command should be a single statement.
+ *
+ * If the statement cannot be prepared, the command is sent with
+ * SendRemoteCommandParams instead. The return value is the same as that of
+ * SendRemoteCommandParams.
+ */
+int
+SendRemoteCommandPrepared(MultiConnection *connection, const char *command,
+						  int parameterCount, const Oid *parameterTypes,
+						  const char *const *parameterValues, bool binaryResults)
+{
+	PGconn *pgConn = connection->pgConn;
+
+	if (!pgConn || PQstatus(pgConn) != CONNECTION_OK)
+	{
+		return 0;
+	}
+
+	char *statementName = FindOrPrepareStatement(connection, command, parameterCount,
+												 parameterTypes);
+	if (statementName == NULL)
+	{
+		return SendRemoteCommandParams(connection, command, parameterCount,
+									   parameterTypes, parameterValues, binaryResults);
+	}
+
+	LogRemoteCommand(connection, command);
+
+	if (PQstatus(pgConn) != CONNECTION_OK)
+	{
+		return 0;
+	}
+
+	Assert(PQisnonblocking(pgConn));
+
+	return PQsendQueryPrepared(pgConn, statementName, parameterCount, parameterValues,
+							   NULL, NULL, binaryResults ? 1 : 0);
+}
+
+
+/*
+ * InvalidateWorkerPreparedStatements makes all connections deallocate their
+ * prepared statements before they use them again. It is called from the
+ * metadata cache invalidation callback, so it only flips a counter.
+ */
+void
+InvalidateWorkerPreparedStatements(void)
+{
+	WorkerPreparedStatementGeneration++;
+}
+
+
+/*
+ * FreeWorkerPreparedStatementCache releases the prepared statement cache of a
+ * connection that is being closed. The statements on the remote end go away
+ * with the connection.
+ */
+void
+FreeWorkerPreparedStatementCache(MultiConnection *connection)
+{
+	if (connection->preparedStatementCache == NULL)
+	{
+		return;
+	}
+
+	MemoryContextDelete(connection->preparedStatementCache->context);
+	connection->preparedStatementCache = NULL;
+}
+
+
+/*
+ * GetWorkerPreparedStatementCache returns the prepared statement cache of the
+ * connection, creating it if needed.
+ */
+static WorkerPreparedStatementCache *
+GetWorkerPreparedStatementCache(MultiConnection *connection)
+{
+	if (connection->preparedStatementCache != NULL)
+	{
+		return connection->preparedStatementCache;
+	}
+
+	MemoryContext cacheContext = AllocSetContextCreate(ConnectionContext,
+													   "Worker Prepared Statements",
+													   ALLOCSET_SMALL_SIZES);
+
+	WorkerPreparedStatementCache *cache =
+		MemoryContextAllocZero(cacheContext, sizeof(WorkerPreparedStatementCache));
+	cache->context = cacheContext;
+	cache->generation = WorkerPreparedStatementGeneration;
+
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(WorkerPreparedStatementKey);
+	info.entrysize = sizeof(WorkerPreparedStatement);
+	info.hash = WorkerPreparedStatementKeyHash;
+	info.match = WorkerPreparedStatementKeyCompare;
+	info.hcxt = cacheContext;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+
+	cache->statementHash = hash_create("Worker Prepared Statement Hash", 32, &info,
+									   hashFlags);
+
+	connection->preparedStatementCache = cache;
+
+	return cache;
+}
+
+
+/*
+ * WorkerPreparedStatementKeyHash computes the hash of a prepared statement key.
+ */
+static uint32
+WorkerPreparedStatementKeyHash(const void *key, Size keysize)
+{
+	const WorkerPreparedStatementKey *statementKey = key;
+
+	return string_hash(statementKey->keyString, strlen(statementKey->keyString) + 1);
+}
+
+
+/*
+ * WorkerPreparedStatementKeyCompare compares two prepared statement keys, it
+ * returns 0 if they are the same.
+ */
+static int
+WorkerPreparedStatementKeyCompare(const void *left, const void *right, Size keysize)
+{
+	const WorkerPreparedStatementKey *leftKey = left;
+	const WorkerPreparedStatementKey *rightKey = right;
+
+	return strcmp(leftKey->keyString, rightKey->keyString);
+}
+
+
+/*
+ * WorkerPreparedStatementKeyString encodes the parameter types and the command
+ * in a single string.
+ */
+static char *
+WorkerPreparedStatementKeyString(const char *command, int parameterCount,
+								 const Oid *parameterTypes)
+{
+	StringInfo keyString = makeStringInfo();
+
+	for (int parameterIndex = 0; parameterIndex < parameterCount; parameterIndex++)
+	{
+		appendStringInfo(keyString, "%u,", parameterTypes[parameterIndex]);
+	}
+
+	appendStringInfo(keyString, ":%s", command);
+
+	return keyString->data;
+}
+
+
+/*
+ * FindOrPrepareStatement returns the name of the statement for the command on
+ * the connection, after preparing it if needed. It returns NULL if the
+ * statement should not or could not be prepared.
+ */
+static char *
+FindOrPrepareStatement(MultiConnection *connection, const char *command,
+					   int parameterCount, const Oid *parameterTypes)
+{
+	WorkerPreparedStatementCache *cache = GetWorkerPreparedStatementCache(connection);
+
+	if (cache->generation != WorkerPreparedStatementGeneration)
+	{
+		if (cache->statementCount > 0)
+		{
+			/* the statements might refer to shards that changed */
+			if (ExecuteOptionalRemoteCommand(connection, "DEALLOCATE ALL", NULL) !=
+				RESPONSE_OKAY)
+			{
+				return NULL;
+			}
+
+			FreeWorkerPreparedStatementCache(connection);
+			cache = GetWorkerPreparedStatementCache(connection);
+		}
+
+		cache->generation = WorkerPreparedStatementGeneration;
+	}
+
+	WorkerPreparedStatementKey key;
+	key.keyString = WorkerPreparedStatementKeyString(command, parameterCount,
+													 parameterTypes);
+
+	bool found = false;
+	WorkerPreparedStatement *statement = hash_search(cache->statementHash, &key,
+													 HASH_FIND, &found);
+	if (!found)
+	{
+		if (cache->statementCount >= MAX_WORKER_PREPARED_STATEMENTS)
+		{
+			return NULL;
+		}
+
+		uint32 statementId = cache->statementCount + 1;
+		char *statementName = psprintf(WORKER_PREPARED_STATEMENT_PREFIX "%u",
+									   statementId);
+
+		if (!PrepareStatementOnConnection(connection, statementName, command,
+										  parameterCount, parameterTypes))
+		{
+			return NULL;
+		}
+
+		key.keyString = MemoryContextStrdup(cache->context, key.keyString);
+
+		statement = hash_search(cache->statementHash, &key, HASH_ENTER, &found);
+		statement->statementId = statementId;
+		cache->statementCount++;
+	}
+
+	return psprintf(WORKER_PREPARED_STATEMENT_PREFIX "%u", statement->statementId);
+}
+
+
+/*
+ * PrepareStatementOnConnection prepares the command as a named statement on
+ * the connection and waits for the result. If the worker rejects the
+ * statement we throw its error, since executing the command would fail in the
+ * same way. It returns false if the connection failed.
+ */
+static bool
+PrepareStatementOnConnection(MultiConnection *connection, const char *statementName,
+							 const char *command, int parameterCount,
+							 const Oid *parameterTypes)
+{
+	bool raiseInterrupts = true;
+
+	if (PQsendPrepare(connection->pgConn, statementName, command, parameterCount,
+					  parameterTypes) == 0)
+	{
+		return false;
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (result == NULL)
+	{
+		return false;
+	}
+
+	if (!IsResponseOK(result))
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+	ForgetResults(connection);
+
+	return true;
+}
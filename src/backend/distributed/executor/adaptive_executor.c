@@ -134,10 +134,13 @@
 #include "catalog/pg_type.h"
 #include "commands/dbcommands.h"
 #include "commands/schemacmds.h"
+#include "common/hashfn.h"
+#include "distributed/admission_control.h"
 #include "distributed/adaptive_executor.h"
 #include "distributed/cancel_utils.h"
 #include "distributed/citus_custom_scan.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/connection_management.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/deparse_shard_query.h"
@@ -150,24 +153,36 @@
 #include "distributed/multi_explain.h"
 #include "distributed/multi_partitioning_utils.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/multi_progress.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/param_utils.h"
 #include "distributed/placement_access.h"
 #include "distributed/placement_connection.h"
+#include "distributed/query_stats.h"
+#include "distributed/query_result_cache.h"
+#include "distributed/reference_table_write_batch.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/remote_commands.h"
 #include "distributed/repartition_join_execution.h"
 #include "distributed/resource_lock.h"
+#include "distributed/secondary_read_routing.h"
+#include "distributed/shard_access_stats.h"
+#include "distributed/shard_task_progress.h"
 #include "distributed/shared_connection_stats.h"
+#include "distributed/sorted_merge.h"
 #include "distributed/subplan_execution.h"
+#include "distributed/trace_context.h"
 #include "distributed/transaction_management.h"
 #include "distributed/transaction_identifier.h"
 #include "distributed/tuple_destination.h"
 #include "distributed/version_compat.h"
+#include "distributed/worker_prepared_statements.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/backend_data.h"
+#include "executor/executor.h"
 #include "lib/ilist.h"
 #include "portability/instr_time.h"
+#include "port/pg_bswap.h"
 #include "storage/fd.h"
 #include "storage/latch.h"
 #include "utils/builtins.h"
@@ -244,6 +259,16 @@ typedef struct DistributedExecution
 	 */
 	WaitEventSet *waitEventSet;
 
+	/*
+	 * State of the wait loop in ContinueDistributedExecution. We keep it in
+	 * the execution such that a streaming execution can return to the scan
+	 * once new rows arrive, and resume the loop later on.
+	 */
+	bool waitLoopStarted;
+	WaitEvent *events;
+	int eventSetSize;
+	bool cancellationReceived;
+
 	/*
 	 * The number of connections we aim to open per worker.
 	 *
@@ -281,6 +306,68 @@ typedef struct DistributedExecution
 	 */
 	uint64 rowsProcessed;
 
+	/*
+	 * Identifies the shape of the query for the task execution times that we
+	 * share across backends, 0 if we do not share them.
+	 */
+	uint64 queryShapeId;
+
+	/*
+	 * The number of rows after which the combine query has enough rows to
+	 * satisfy its LIMIT, such that the remaining tasks can be cancelled, or
+	 * -1 if we need the rows of all the tasks.
+	 */
+	int64 rowLimit;
+
+	/*
+	 * Subtransaction in which the execution took or joined the admission slot
+	 * of the backend, or InvalidSubTransactionId, see admission_control.c.
+	 */
+	SubTransactionId admittedSubId;
+
+	/*
+	 * The merge of the sorted rows of the tasks that we notify when a task
+	 * finishes during a streaming execution, or NULL.
+	 */
+	SortedMergeState *sortedMerge;
+
+	/*
+	 * The query identifier under which we track the task timings for
+	 * citus_stat_statements_task_timings, or 0 if we do not track them.
+	 */
+	uint64 taskTimingsQueryId;
+
+	/*
+	 * The query identifier that we send to the workers in a comment for
+	 * citus_stat_statements_cluster, or 0 if we do not send it.
+	 */
+	uint64 workerStatsQueryId;
+
+	/* whether the task queries carry a child span of citus.trace_context */
+	bool propagateTraceContext;
+
+	/*
+	 * Whether we record the network and connection metrics of the tasks for
+	 * EXPLAIN ANALYZE, and the time spent decoding results and waiting for
+	 * the workers.
+	 */
+	bool collectNetworkMetrics;
+	instr_time resultDecodeTime;
+	instr_time remoteWaitTime;
+
+	/*
+	 * The progress monitor steps of the remote tasks, in the order of
+	 * remoteTaskList, or NULL if we do not report the progress of the tasks.
+	 */
+	ShardTaskProgress *taskProgressSteps;
+
+	/*
+	 * Called when a remote task finishes, returns the tasks that are added to
+	 * the execution as a result, see ExecutionParams.
+	 */
+	TaskFinishedCallback taskFinishedCallback;
+	void *taskFinishedContext;
+
 	/*
 	 * The following fields are used while receiving results from remote nodes.
 	 * We store this information here to avoid re-allocating it every time.
@@ -293,6 +380,10 @@ typedef struct DistributedExecution
 	void **columnArray;
 	StringInfoData *stringInfoDataArray;
 
+	/* values and nulls of the columns that are decoded from binary results */
+	Datum *columnValues;
+	bool *columnNulls;
+
 	/*
 	 * jobIdList contains all jobs in the job tree, this is used to
 	 * do cleanup for repartition queries.
@@ -428,6 +519,27 @@ typedef struct WorkerPool
 	/* execution statistics per pool, in microseconds */
 	uint64 totalTaskExecutionTime;
 	int totalExecutedTasks;
+
+	/*
+	 * Moving averages of the task execution and connection establishment times
+	 * on the worker across all backends, in microseconds, 0 when unknown. We
+	 * use them until the pool has its own statistics.
+	 */
+	double sharedAvgTaskExecutionTime;
+	double sharedAvgConnectionEstablishmentTime;
+
+	/*
+	 * Task execution times that are not yet added to the shared moving
+	 * averages of the worker, which we do once at the end of the execution.
+	 */
+	uint64 unrecordedTaskExecutionTime;
+	int unrecordedExecutedTasks;
+
+	/* number of running tasks that we added to the shared count of the worker */
+	int sharedRunningTaskCount;
+
+	/* timings of the tasks that finished on the pool, if we track them */
+	TaskTimingHistogram taskTimings;
 } WorkerPool;
 
 struct TaskPlacementExecution;
@@ -464,6 +576,13 @@ typedef struct WorkerSession
 	/* task the worker should work on or NULL */
 	struct TaskPlacementExecution *currentTask;
 
+	/*
+	 * Tasks that are sent over the connection in the same libpq pipeline
+	 * as currentTask and whose results are expected after currentTask's
+	 * results, in the order they were sent.
+	 */
+	dlist_head pipelinedTaskQueue;
+
 	/*
 	 * The number of commands sent to the worker over the session. Excludes
 	 * distributed transaction related commands such as BEGIN/COMMIT etc.
@@ -481,6 +600,9 @@ typedef struct WorkerSession
 
 	/* keep track of if the session has an active connection */
 	bool sessionHasActiveConnection;
+
+	/* whether the connection was already established when the session started */
+	bool connectionReused;
 } WorkerSession;
 
 
@@ -497,6 +619,41 @@ bool EnableBinaryProtocol = false;
 
 /* GUC, number of ms to wait between opening connections to the same worker */
 int ExecutorSlowStartInterval = 10;
+
+/* GUC, maximum number of read tasks sent in a single pipeline over a connection */
+int ExecutorPipelineDepth = 1;
+
+/* GUC, number of rows libpq collects into a single result while fetching rows */
+int ExecutorResultChunkSize = 1;
+
+/* GUC, maximum number of read tasks for the same worker combined into one query */
+int ExecutorTaskGroupSize = 1;
+
+/* GUC, maximum number of utility tasks for the same worker sent as one command */
+int ExecutorUtilityTaskGroupSize = 1;
+
+/* GUC, maximum number of concurrent index builds per worker, 0 means no limit */
+int MaxIndexBuildsPerWorker = 0;
+
+/* GUC, determining whether the scan returns rows while the execution is running */
+bool EnableStreamingResults = false;
+
+/* GUC, determining whether local tasks run while remote tasks are in flight */
+bool EnableOverlappingLocalExecution = false;
+
+/*
+ * GUC, the number of multiples of the average task execution time on a worker
+ * after which a read-only task is also started on another placement, 0 means
+ * that hedged reads are disabled.
+ */
+double HedgedReadDelayFactor = 0.0;
+
+/*
+ * The scan whose execution is streaming its results, if any. We track it to
+ * be able to finish the execution before any other execution might need the
+ * connections that it uses.
+ */
+static CitusScanState *StreamingScanState = NULL;
 bool EnableCostBasedConnectionEstablishment = true;
 bool PreventIncompleteConnectionEstablishment = true;
 
@@ -526,6 +683,25 @@ typedef enum PlacementExecutionOrder
 } PlacementExecutionOrder;
 
 
+/*
+ * BinaryDecodeMethod describes how a column that is received in binary
+ * format is decoded. Fixed-width by-value types are decoded directly from the
+ * result, all other types go through their receive function.
+ */
+typedef enum BinaryDecodeMethod
+{
+	BINARY_DECODE_RECEIVE_FUNCTION = 0,
+	BINARY_DECODE_BOOL,
+	BINARY_DECODE_INT2,
+	BINARY_DECODE_INT4,
+	BINARY_DECODE_OID,
+	BINARY_DECODE_INT8,
+	BINARY_DECODE_FLOAT4,
+	BINARY_DECODE_FLOAT8,
+	BINARY_DECODE_TIMESTAMP
+} BinaryDecodeMethod;
+
+
 /*
  * ShardCommandExecution represents an execution of a command on a shard
  * that may (need to) run across multiple placements.
@@ -542,6 +718,9 @@ typedef struct ShardCommandExecution
 	 * encoding/decoding functions */
 	bool binaryResults;
 
+	/* per query, how to decode each column in case of binaryResults */
+	BinaryDecodeMethod **binaryDecodeMethods;
+
 	/* order in which the command should be replicated on replicas */
 	PlacementExecutionOrder executionOrder;
 
@@ -555,6 +734,19 @@ typedef struct ShardCommandExecution
 	 */
 	bool gotResults;
 
+	/*
+	 * The additional placement execution that we started because the task
+	 * ran for too long (see citus.hedged_read_delay_factor), or NULL if the
+	 * task is not hedged.
+	 */
+	struct TaskPlacementExecution *hedgedPlacementExecution;
+
+	/*
+	 * For hedged tasks, the placement execution that responded first and
+	 * whose results we use. The other placement executions are cancelled.
+	 */
+	struct TaskPlacementExecution *resultPlacementExecution;
+
 	TaskExecutionState executionState;
 
 	/*
@@ -562,6 +754,9 @@ typedef struct ShardCommandExecution
 	 * placements. Normally determined by DistributedExecution's same field.
 	 */
 	bool localExecutionSupported;
+
+	/* progress monitor step of the task, or NULL if we do not report progress */
+	ShardTaskProgress *taskProgress;
 } ShardCommandExecution;
 
 /*
@@ -617,12 +812,34 @@ typedef struct TaskPlacementExecution
 	/* membership in ready-to-start task queue of worker */
 	dlist_node workerReadyQueueNode;
 
+	/* membership in pipelined task queue of a particular session */
+	dlist_node sessionPipelinedQueueNode;
+
 	/* index in array of placement executions in a ShardCommandExecution */
 	int placementExecutionIndex;
 
-	/* execution time statistics for this placement execution */
+	/*
+	 * Execution time statistics for this placement execution: when it became
+	 * ready, when it got a connection, when its query was sent, when the first
+	 * result arrived and when it finished.
+	 */
+	instr_time readyTime;
 	instr_time startTime;
+	instr_time querySentTime;
+	instr_time firstResultTime;
 	instr_time endTime;
+
+	/* whether the execution is in the shared running task count of the worker */
+	bool inSharedRunningTaskCount;
+
+	/* number of rows returned or modified by this placement execution */
+	uint64 rowsProcessed;
+
+	/* traceparent of the span of this placement execution, if traced */
+	char *traceParent;
+
+	/* number of queries sent for this placement execution */
+	uint32 roundTrips;
 } TaskPlacementExecution;
 
 
@@ -645,6 +862,21 @@ static TransactionProperties DecideTransactionPropertiesForTaskList(RowModifyLev
 static void StartDistributedExecution(DistributedExecution *execution);
 static void RunLocalExecution(CitusScanState *scanState, DistributedExecution *execution);
 static void RunDistributedExecution(DistributedExecution *execution);
+static bool ShouldOverlapLocalExecution(CitusScanState *scanState,
+										DistributedExecution *execution);
+static void RunOverlappingLocalAndDistributedExecution(CitusScanState *scanState,
+													   DistributedExecution *execution);
+static void AbortDistributedExecutionWaitLoop(DistributedExecution *execution);
+static ParamListInfo ParamListFromConstList(List *constList);
+static bool ContinueDistributedExecution(DistributedExecution *execution,
+										 bool returnOnNewRows, bool returnWhenIdle);
+static bool ShouldStreamResults(CitusScanState *scanState,
+								DistributedExecution *execution);
+static void StartStreamingExecution(CitusScanState *scanState,
+									DistributedExecution *execution);
+static void CompleteStreamingExecution(CitusScanState *scanState);
+static bool StreamingScanHasNextTuple(CitusScanState *scanState);
+static void StreamingExecutionContextCallback(void *arg);
 static void SequentialRunDistributedExecution(DistributedExecution *execution);
 static void FinishDistributedExecution(DistributedExecution *execution);
 static void CleanUpSessions(DistributedExecution *execution);
@@ -657,7 +889,10 @@ static bool TaskListModifiesDatabase(RowModifyLevel modLevel, List *taskList);
 static bool DistributedExecutionRequiresRollback(List *taskList);
 static bool TaskListRequires2PC(List *taskList);
 static bool SelectForUpdateOnReferenceTable(List *taskList);
-static void AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution);
+static void AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution,
+												 List *taskList);
+static void AddTasksToDistributedExecution(DistributedExecution *execution,
+										   List *taskList);
 static void UnclaimAllSessionConnections(List *sessionList);
 static PlacementExecutionOrder ExecutionOrderForTask(RowModifyLevel modLevel, Task *task);
 static WorkerPool * FindOrCreateWorkerPool(DistributedExecution *execution,
@@ -674,6 +909,10 @@ static bool UsingExistingSessionsCheaperThanEstablishingNewConnections(int
 																	   workerPool);
 static double AvgTaskExecutionTimeApproximation(WorkerPool *workerPool);
 static double AvgConnectionEstablishmentTime(WorkerPool *workerPool);
+static uint64 DistributedPlanQueryShapeId(DistributedPlan *distributedPlan);
+static void AddToSharedRunningTaskCount(TaskPlacementExecution *placementExecution);
+static void RemoveFromSharedRunningTaskCount(TaskPlacementExecution *placementExecution);
+static void RemoveAllFromSharedRunningTaskCounts(DistributedExecution *execution);
 static void OpenNewConnections(WorkerPool *workerPool, int newConnectionCount,
 							   TransactionProperties *transactionProperties);
 static void CheckConnectionTimeout(WorkerPool *workerPool);
@@ -689,6 +928,43 @@ static TaskPlacementExecution * PopAssignedPlacementExecution(WorkerSession *ses
 static TaskPlacementExecution * PopUnassignedPlacementExecution(WorkerPool *workerPool);
 static bool StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 											 WorkerSession *session);
+static TaskPlacementExecution * PeekPlacementExecution(WorkerSession *session);
+static bool CanPipelinePlacementExecution(TaskPlacementExecution *placementExecution);
+static bool SendPipelinedPlacementExecutions(WorkerSession *session);
+static bool StartPipelinedPlacementExecution(TaskPlacementExecution *placementExecution,
+											 WorkerSession *session);
+static bool AdvancePipelinedPlacementExecution(WorkerSession *session);
+static void StartHedgedPlacementExecutions(DistributedExecution *execution);
+static int64 CombineQueryRowLimit(Query *combineQuery);
+static List * GroupReadTasksByWorker(List *taskList, int maxGroupSize);
+static bool CanGroupReadTask(Task *task);
+static Task * CreateGroupedReadTask(List *taskList);
+static List * GroupUtilityTasksByWorker(List *taskList, int maxGroupSize);
+static bool CanGroupUtilityTask(Task *task);
+static bool UtilityTaskRelationsAccessedInTransaction(List *taskList);
+static Task * CreateGroupedUtilityTask(List *taskList);
+static bool RowLimitReached(DistributedExecution *execution);
+static void CancelRemainingTasks(DistributedExecution *execution);
+static void CancelTaskOfPlacementExecution(DistributedExecution *execution,
+										   TaskPlacementExecution *placementExecution);
+static void ReportPlacementExecutionTraceSpan(TaskPlacementExecution *placementExecution,
+											  bool succeeded);
+static void AddPlacementExecutionTaskTimings(TaskPlacementExecution *placementExecution);
+static void RecordPlacementExecutionNetworkMetrics(
+	TaskPlacementExecution *placementExecution);
+static void RecordTaskTimings(DistributedExecution *execution);
+static void RecordWorkerPoolTaskExecutionTimes(DistributedExecution *execution);
+static int64 TimeUntilHedgedRead(WorkerSession *session, instr_time now);
+static TaskPlacementExecution * FindHedgePlacementExecution(ShardCommandExecution *
+															shardCommandExecution);
+static bool ClaimHedgedTaskResults(TaskPlacementExecution *placementExecution,
+								   ExecStatusType resultStatus);
+static void CancelHedgedPlacementExecutions(ShardCommandExecution *shardCommandExecution);
+static bool PlacementExecutionLostHedgedRead(TaskPlacementExecution *placementExecution);
+static bool HasActiveHedgedPlacementExecution(ShardCommandExecution *
+											  shardCommandExecution);
+static bool ShouldUseWorkerPreparedStatement(DistributedExecution *execution,
+											 MultiConnection *connection, Task *task);
 static bool SendNextQuery(TaskPlacementExecution *placementExecution,
 						  WorkerSession *session);
 static void ConnectionStateMachine(WorkerSession *session);
@@ -701,6 +977,7 @@ static void TransactionStateMachine(WorkerSession *session);
 static void UpdateConnectionWaitFlags(WorkerSession *session, int waitFlags);
 static bool CheckConnectionReady(WorkerSession *session);
 static bool ReceiveResults(WorkerSession *session, bool storeRows);
+static int SetRowFetchMode(MultiConnection *connection);
 static void WorkerSessionFailed(WorkerSession *session);
 static void WorkerPoolFailed(WorkerPool *workerPool);
 static void PlacementExecutionDone(TaskPlacementExecution *placementExecution,
@@ -729,13 +1006,16 @@ static bool ProcessWaitEventsForSocketClosed(WaitEvent *events, int eventCount);
 #endif
 static long MillisecondsBetweenTimestamps(instr_time startTime, instr_time endTime);
 static uint64 MicrosecondsBetweenTimestamps(instr_time startTime, instr_time endTime);
-static HeapTuple BuildTupleFromBytes(AttInMetadata *attinmeta, fmStringInfo *values);
-static AttInMetadata * TupleDescGetAttBinaryInMetadata(TupleDesc tupdesc);
+static BinaryDecodeMethod * TupleDescGetBinaryDecodeMethods(TupleDesc tupdesc);
+static bool DecodeFixedWidthBinaryValue(BinaryDecodeMethod decodeMethod, char *value,
+										int valueLength, Datum *datum);
 static int WorkerPoolCompare(const void *lhsKey, const void *rhsKey);
 static void SetAttributeInputMetadata(DistributedExecution *execution,
 									  ShardCommandExecution *shardCommandExecution);
-static void LookupTaskPlacementHostAndPort(ShardPlacement *taskPlacement, char **nodeName,
+static void LookupTaskPlacementHostAndPort(ShardPlacement *taskPlacement,
+										   bool readFromSecondary, char **nodeName,
 										   int *nodePort);
+static bool ShouldReadFromCaughtUpSecondaries(DistributedExecution *execution);
 static bool IsDummyPlacement(ShardPlacement *taskPlacement);
 
 /*
@@ -765,7 +1045,13 @@ AdaptiveExecutorPreExecutorRun(CitusScanState *scanState)
 	 */
 	LockPartitionsForDistributedPlan(distributedPlan);
 
-	ExecuteSubPlans(distributedPlan);
+	/* the tasks of the plan need to outlive the subplans that inline results */
+	EState *executorState = ScanStateGetExecutorState(scanState);
+	MemoryContext oldContext = MemoryContextSwitchTo(executorState->es_query_cxt);
+
+	scanState->distributedPlan = ExecuteSubPlansAndInlineResults(distributedPlan);
+
+	MemoryContextSwitchTo(oldContext);
 
 	scanState->finishedPreScan = true;
 }
@@ -795,6 +1081,14 @@ AdaptiveExecutor(CitusScanState *scanState)
 	/* we should only call this once before the scan finished */
 	Assert(!scanState->finishedRemoteScan);
 
+	Tuplestorestate *prefetchedResults = TakePrefetchedSubPlanResult(distributedPlan);
+	if (prefetchedResults != NULL)
+	{
+		/* the tasks already ran along with other subplans, see ExecuteSubPlans */
+		scanState->tuplestorestate = prefetchedResults;
+		return resultSlot;
+	}
+
 	MemoryContext localContext = AllocSetContextCreate(CurrentMemoryContext,
 													   "AdaptiveExecutor",
 													   ALLOCSET_DEFAULT_SIZES);
@@ -804,13 +1098,58 @@ AdaptiveExecutor(CitusScanState *scanState)
 	/* Reset Task fields that are only valid for a single execution */
 	ResetExplainAnalyzeData(taskList);
 
+	TupleDesc tupleDescriptor = ScanStateGetTupleDescriptor(scanState);
+
+	QueryResultCacheState *resultCacheState = NULL;
+	if (!RequestedForExplainAnalyze(scanState) &&
+		ShouldCacheQueryResult(distributedPlan))
+	{
+		Tuplestorestate *cachedResults =
+			LookupQueryResultCache(taskList, paramListInfo, tupleDescriptor,
+								   &resultCacheState);
+		if (cachedResults != NULL)
+		{
+			/* the tasks ran recently, see query_result_cache.c */
+			scanState->tuplestorestate = cachedResults;
+
+			MemoryContextSwitchTo(oldContext);
+
+			return resultSlot;
+		}
+	}
+
 	scanState->tuplestorestate =
 		tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
-
-	TupleDesc tupleDescriptor = ScanStateGetTupleDescriptor(scanState);
 	TupleDestination *defaultTupleDest =
 		CreateTupleStoreTupleDest(scanState->tuplestorestate, tupleDescriptor);
 
+	if (!RequestedForExplainAnalyze(scanState) &&
+		ShouldBatchReferenceTableWrite(distributedPlan, paramListInfo))
+	{
+		/* the write goes out with the next flush, see reference_table_write_batch.c */
+		BatchReferenceTableWrite(linitial(taskList));
+		executorState->es_processed = 1;
+
+		MemoryContextSwitchTo(oldContext);
+
+		return resultSlot;
+	}
+
+	/* statements that may observe the pending writes run after them */
+	FlushReferenceTableWrites();
+
+	if (distributedPlan->sortedMergeClauseList != NIL)
+	{
+		/*
+		 * The combine query does not sort the rows, since the tasks return
+		 * them in order and we merge them (see SortedMergeClauseList).
+		 */
+		scanState->sortedMerge =
+			CreateSortedMergeState(distributedPlan->sortedMergeClauseList,
+								   tupleDescriptor, defaultTupleDest);
+		taskList = SortedMergeTaskList(scanState->sortedMerge, taskList);
+	}
+
 	if (RequestedForExplainAnalyze(scanState))
 	{
 		/*
@@ -831,6 +1170,20 @@ AdaptiveExecutor(CitusScanState *scanState)
 		jobIdList = ExecuteDependentTasks(taskList, job);
 	}
 
+	/*
+	 * Grouped tasks use a single connection for the placements of several
+	 * shards, which is only safe if no earlier statement in the transaction
+	 * accessed those placements over other connections.
+	 */
+	if (ExecutorTaskGroupSize > 1 && !hasDependentJobs &&
+		distributedPlan->modLevel == ROW_MODIFY_READONLY &&
+		!RequestedForExplainAnalyze(scanState) && scanState->sortedMerge == NULL &&
+		!InCoordinatedTransaction() && !IsMultiStatementTransaction())
+	{
+		/* send the read tasks for the same worker in one round trip */
+		taskList = GroupReadTasksByWorker(taskList, ExecutorTaskGroupSize);
+	}
+
 	if (MultiShardConnectionType == SEQUENTIAL_CONNECTION)
 	{
 		/* defer decision after ExecuteSubPlans() */
@@ -844,6 +1197,12 @@ AdaptiveExecutor(CitusScanState *scanState)
 
 	bool localExecutionSupported = true;
 
+	if (job->parameterValueList != NIL)
+	{
+		/* the job query has parameters of its own, e.g. a delegated function call */
+		paramListInfo = ParamListFromConstList(job->parameterValueList);
+	}
+
 	/*
 	 * In some rare cases, we have prepared statements that pass a parameter
 	 * and never used in the query, mark such parameters' type as Invalid(0),
@@ -866,16 +1225,64 @@ AdaptiveExecutor(CitusScanState *scanState)
 		jobIdList,
 		localExecutionSupported);
 
+	execution->queryShapeId = DistributedPlanQueryShapeId(distributedPlan);
+
+	if (StatStatementsTrack == STAT_STATEMENTS_TRACK_ALL)
+	{
+		execution->taskTimingsQueryId = distributedPlan->queryId;
+
+		if (StatStatementsTrackWorkers)
+		{
+			execution->workerStatsQueryId = distributedPlan->queryId;
+		}
+	}
+
+	execution->propagateTraceContext = ShouldPropagateTraceContext();
+	execution->collectNetworkMetrics = ExplainAnalyzeNetworkMetrics &&
+									   RequestedForExplainAnalyze(scanState);
+
+	/*
+	 * Cancelling tasks would abort the remote transaction blocks, and EXPLAIN
+	 * ANALYZE needs to see all the tasks finish.
+	 */
+	if (xactProperties.useRemoteTransactionBlocks == TRANSACTION_BLOCKS_DISALLOWED &&
+		!RequestedForExplainAnalyze(scanState))
+	{
+		execution->rowLimit = CombineQueryRowLimit(distributedPlan->combineQuery);
+	}
+
+	/* large read-only queries might have to wait for the ones that run */
+	execution->admittedSubId = AdmitMultiShardExecution(execution->modLevel,
+														execution->remoteTaskList);
+
 	/*
 	 * Make sure that we acquire the appropriate locks even if the local tasks
 	 * are going to be executed with local execution.
 	 */
 	StartDistributedExecution(execution);
 
+	if (ShouldStreamResults(scanState, execution))
+	{
+		/*
+		 * Rather than running the execution to completion here, we let the
+		 * scan continue the execution whenever it runs out of rows.
+		 */
+		StartStreamingExecution(scanState, execution);
+
+		MemoryContextSwitchTo(oldContext);
+
+		return resultSlot;
+	}
+
 	if (ShouldRunTasksSequentially(execution->remoteTaskList))
 	{
 		SequentialRunDistributedExecution(execution);
 	}
+	else if (ShouldOverlapLocalExecution(scanState, execution))
+	{
+		/* runs the local tasks while the remote tasks are in flight */
+		RunOverlappingLocalAndDistributedExecution(scanState, execution);
+	}
 	else
 	{
 		RunDistributedExecution(execution);
@@ -894,13 +1301,42 @@ AdaptiveExecutor(CitusScanState *scanState)
 		executorState->es_processed = execution->rowsProcessed;
 	}
 
+	if (execution->collectNetworkMetrics)
+	{
+		SaveExplainAnalyzeTaskMetrics(taskList);
+
+		scanState->resultDecodeTime +=
+			INSTR_TIME_GET_MILLISEC(execution->resultDecodeTime);
+		scanState->remoteWaitTime += INSTR_TIME_GET_MILLISEC(execution->remoteWaitTime);
+	}
+
 	FinishDistributedExecution(execution);
 
+	if (scanState->sortedMerge != NULL)
+	{
+		SortedMergeExecutionFinished(scanState->sortedMerge);
+
+		if ((scanState->eflags & (EXEC_FLAG_REWIND | EXEC_FLAG_BACKWARD |
+								  EXEC_FLAG_MARK)) != 0)
+		{
+			/* the scan might read the rows more than once, keep them in order */
+			SortedMergeIntoTupleStore(scanState->sortedMerge,
+									  scanState->tuplestorestate);
+			scanState->sortedMerge = NULL;
+		}
+	}
+
 	if (SortReturning && distributedPlan->expectResults && commandType != CMD_SELECT)
 	{
 		SortTupleStore(scanState);
 	}
 
+	if (resultCacheState != NULL && scanState->sortedMerge == NULL)
+	{
+		StoreQueryResult(resultCacheState, scanState->tuplestorestate,
+						 tupleDescriptor);
+	}
+
 	MemoryContextSwitchTo(oldContext);
 
 	return resultSlot;
@@ -908,3660 +1344,5718 @@ AdaptiveExecutor(CitusScanState *scanState)
 
 
 /*
- * HasDependentJobs returns true if there is any dependent job
- * for the mainjob(top level) job.
+ * ParamListFromConstList returns a parameter list that holds the values of
+ * the given Const nodes as parameters $1, $2, ...
  */
-static bool
-HasDependentJobs(Job *mainJob)
+static ParamListInfo
+ParamListFromConstList(List *constList)
 {
-	return list_length(mainJob->dependentJobList) > 0;
+	ParamListInfo paramListInfo = makeParamList(list_length(constList));
+
+	int paramIndex = 0;
+	Const *constValue = NULL;
+	foreach_ptr(constValue, constList)
+	{
+		ParamExternData *param = &paramListInfo->params[paramIndex];
+
+		param->value = constValue->constvalue;
+		param->isnull = constValue->constisnull;
+		param->pflags = PARAM_FLAG_CONST;
+		param->ptype = constValue->consttype;
+
+		paramIndex++;
+	}
+
+	return paramListInfo;
 }
 
 
 /*
- * RunLocalExecution runs the localTaskList in the execution, fills the tuplestore
- * and sets the es_processed if necessary.
+ * ShouldStreamResults returns true if the scan can return the rows of the
+ * execution as they arrive from the workers, rather than after all the
+ * rows are written to the tuple store.
  *
- * It also sorts the tuplestore if there are no remote tasks remaining.
+ * Streaming requires that the scan never reads rows that it already
+ * returned, since we remove them from the tuple store, and that all rows
+ * come from remote tasks that run in parallel.
  */
-static void
-RunLocalExecution(CitusScanState *scanState, DistributedExecution *execution)
+static bool
+ShouldStreamResults(CitusScanState *scanState, DistributedExecution *execution)
 {
-	EState *estate = ScanStateGetExecutorState(scanState);
-	bool isUtilityCommand = false;
-	uint64 rowsProcessed = ExecuteLocalTaskListExtended(execution->localTaskList,
-														estate->es_param_list_info,
-														scanState->distributedPlan,
-														execution->defaultTupleDest,
-														isUtilityCommand);
+	DistributedPlan *distributedPlan = scanState->distributedPlan;
+	Job *job = distributedPlan->workerJob;
 
-	execution->rowsProcessed += rowsProcessed;
-}
+	if (!EnableStreamingResults)
+	{
+		return false;
+	}
 
+	if ((scanState->eflags & (EXEC_FLAG_REWIND | EXEC_FLAG_BACKWARD |
+							  EXEC_FLAG_MARK)) != 0)
+	{
+		return false;
+	}
 
-/*
- * ExecuteUtilityTaskList is a wrapper around executing task
- * list for utility commands.
- */
-uint64
-ExecuteUtilityTaskList(List *utilityTaskList, bool localExecutionSupported)
-{
-	RowModifyLevel modLevel = ROW_MODIFY_NONE;
-	ExecutionParams *executionParams = CreateBasicExecutionParams(
-		modLevel, utilityTaskList, MaxAdaptiveExecutorPoolSize, localExecutionSupported
-		);
-	executionParams->xactProperties =
-		DecideTransactionPropertiesForTaskList(modLevel, utilityTaskList, false);
-	executionParams->isUtilityCommand = true;
+	if (job->jobQuery->commandType != CMD_SELECT ||
+		distributedPlan->modLevel != ROW_MODIFY_READONLY)
+	{
+		return false;
+	}
 
-	return ExecuteTaskListExtended(executionParams);
+	if (RequestedForExplainAnalyze(scanState) || HasDependentJobs(job))
+	{
+		return false;
+	}
+
+	/* local and sequential executions produce all their rows at once */
+	if (execution->localTaskList != NIL ||
+		ShouldRunTasksSequentially(execution->remoteTaskList))
+	{
+		return false;
+	}
+
+	/*
+	 * Other commands in a transaction block may need the connections of the
+	 * execution while the scan is still running, let's not go there.
+	 */
+	if (IsMultiStatementTransaction())
+	{
+		return false;
+	}
+
+	return true;
 }
 
 
 /*
- * ExecuteUtilityTaskListExtended is a wrapper around executing task
- * list for utility commands.
+ * StartStreamingExecution prepares the execution to be continued by the scan
+ * via ContinueStreamingExecution.
  */
-uint64
-ExecuteUtilityTaskListExtended(List *utilityTaskList, int poolSize,
-							   bool localExecutionSupported)
+static void
+StartStreamingExecution(CitusScanState *scanState, DistributedExecution *execution)
 {
-	RowModifyLevel modLevel = ROW_MODIFY_NONE;
-	ExecutionParams *executionParams = CreateBasicExecutionParams(
-		modLevel, utilityTaskList, poolSize, localExecutionSupported
-		);
+	/* any other streaming execution should have finished by now */
+	Assert(StreamingScanState == NULL);
 
-	bool excludeFromXact = false;
-	executionParams->xactProperties =
-		DecideTransactionPropertiesForTaskList(modLevel, utilityTaskList,
-											   excludeFromXact);
-	executionParams->isUtilityCommand = true;
+	/* rows that the scan returned can be removed from the tuple store */
+	tuplestore_set_eflags(scanState->tuplestorestate, 0);
 
-	return ExecuteTaskListExtended(executionParams);
-}
+	AssignTasksToConnectionsOrWorkerPool(execution, execution->remoteTaskList);
 
+	/*
+	 * If the query fails outside of the execution, we should still release
+	 * the resources of the execution.
+	 */
+	MemoryContextCallback *callback = palloc0(sizeof(MemoryContextCallback));
+	callback->func = StreamingExecutionContextCallback;
+	callback->arg = execution;
+	MemoryContextRegisterResetCallback(CurrentMemoryContext, callback);
 
-/*
- * ExecuteTaskList is a proxy to ExecuteTaskListExtended
- * with defaults for some of the arguments.
- */
-uint64
-ExecuteTaskList(RowModifyLevel modLevel, List *taskList)
-{
-	bool localExecutionSupported = true;
-	ExecutionParams *executionParams = CreateBasicExecutionParams(
-		modLevel, taskList, MaxAdaptiveExecutorPoolSize, localExecutionSupported
-		);
+	scanState->streamingExecution = execution;
+	scanState->returnedTupleCount = 0;
 
-	bool excludeFromXact = false;
-	executionParams->xactProperties = DecideTransactionPropertiesForTaskList(
-		modLevel, taskList, excludeFromXact);
+	execution->sortedMerge = scanState->sortedMerge;
 
-	return ExecuteTaskListExtended(executionParams);
+	StreamingScanState = scanState;
 }
 
 
 /*
- * ExecuteTaskListOutsideTransaction is a proxy to ExecuteTaskListExtended
- * with defaults for some of the arguments.
+ * ContinueStreamingExecution continues the streaming execution of the scan,
+ * if any, until there are rows in the tuple store that the scan did not
+ * return yet, or the execution finishes.
  */
-uint64
-ExecuteTaskListOutsideTransaction(RowModifyLevel modLevel, List *taskList,
-								  int targetPoolSize, List *jobIdList)
+void
+ContinueStreamingExecution(CitusScanState *scanState)
 {
-	/*
-	 * As we are going to run the tasks outside transaction, we shouldn't use local execution.
-	 * However, there is some problem when using local execution related to
-	 * repartition joins, when we solve that problem, we can execute the tasks
-	 * coming to this path with local execution. See PR:3711
-	 */
-	bool localExecutionSupported = false;
-	ExecutionParams *executionParams = CreateBasicExecutionParams(
-		modLevel, taskList, targetPoolSize, localExecutionSupported
-		);
-
-	executionParams->xactProperties = DecideTransactionPropertiesForTaskList(
-		modLevel, taskList, true);
-	return ExecuteTaskListExtended(executionParams);
-}
+	DistributedExecution *execution = scanState->streamingExecution;
+	if (execution == NULL)
+	{
+		return;
+	}
 
+	MemoryContext oldContext = MemoryContextSwitchTo(GetMemoryChunkContext(execution));
+	bool returnOnNewRows = true;
+	bool returnWhenIdle = false;
 
-/*
- * ExecuteTaskListIntoTupleDest is a proxy to ExecuteTaskListExtended() with defaults
- * for some of the arguments.
- */
-uint64
-ExecuteTaskListIntoTupleDest(RowModifyLevel modLevel, List *taskList,
-							 TupleDestination *tupleDest,
-							 bool expectResults)
-{
-	int targetPoolSize = MaxAdaptiveExecutorPoolSize;
-	bool localExecutionSupported = true;
-	ExecutionParams *executionParams = CreateBasicExecutionParams(
-		modLevel, taskList, targetPoolSize, localExecutionSupported
-		);
+	while (!StreamingScanHasNextTuple(scanState))
+	{
+		/* no need to keep the rows that are already returned */
+		tuplestore_trim(scanState->tuplestorestate);
 
-	executionParams->xactProperties = DecideTransactionPropertiesForTaskList(
-		modLevel, taskList, false);
-	executionParams->expectResults = expectResults;
-	executionParams->tupleDestination = tupleDest;
+		bool executionFinished =
+			ContinueDistributedExecution(execution, returnOnNewRows, returnWhenIdle);
+		if (executionFinished)
+		{
+			CompleteStreamingExecution(scanState);
+			break;
+		}
+	}
 
-	return ExecuteTaskListExtended(executionParams);
+	MemoryContextSwitchTo(oldContext);
 }
 
 
 /*
- * ExecuteTaskListExtended sets up the execution for given task list and
- * runs it.
+ * StreamingScanHasNextTuple returns whether the scan can return its next row
+ * without continuing the streaming execution.
  */
-uint64
-ExecuteTaskListExtended(ExecutionParams *executionParams)
+static bool
+StreamingScanHasNextTuple(CitusScanState *scanState)
 {
-	ParamListInfo paramListInfo = NULL;
-	uint64 locallyProcessedRows = 0;
-
-	TupleDestination *defaultTupleDest = executionParams->tupleDestination;
-
-	if (MultiShardConnectionType == SEQUENTIAL_CONNECTION)
+	if (scanState->sortedMerge != NULL)
 	{
-		executionParams->targetPoolSize = 1;
+		return SortedMergeHasNextTuple(scanState->sortedMerge);
 	}
 
-	DistributedExecution *execution =
-		CreateDistributedExecution(
-			executionParams->modLevel, executionParams->taskList,
-			paramListInfo, executionParams->targetPoolSize,
-			defaultTupleDest, &executionParams->xactProperties,
-			executionParams->jobIdList, executionParams->localExecutionSupported);
-
-	/*
-	 * If current transaction accessed local placements and task list includes
-	 * tasks that should be executed locally (accessing any of the local placements),
-	 * then we should error out as it would cause inconsistencies across the
-	 * remote connection and local execution.
-	 */
-	EnsureCompatibleLocalExecutionState(execution->remoteTaskList);
+	return scanState->streamingExecution->rowsProcessed >
+		   scanState->returnedTupleCount;
+}
 
-	/* run the remote execution */
-	StartDistributedExecution(execution);
-	RunDistributedExecution(execution);
-	FinishDistributedExecution(execution);
 
-	/* now, switch back to the local execution */
-	if (executionParams->isUtilityCommand)
+/*
+ * EndStreamingExecution is called when the scan ends, possibly before it read
+ * all the rows of the streaming execution. A sorted merge already returned
+ * all the rows that the combine query needs, such that we can cancel the
+ * remaining tasks unless that would abort a remote transaction block. In
+ * other cases, we let the execution finish.
+ */
+void
+EndStreamingExecution(CitusScanState *scanState)
+{
+	DistributedExecution *execution = scanState->streamingExecution;
+	if (execution == NULL)
 	{
-		locallyProcessedRows += ExecuteLocalUtilityTaskList(execution->localTaskList);
+		return;
 	}
-	else
+
+	if (scanState->sortedMerge != NULL &&
+		execution->transactionProperties->useRemoteTransactionBlocks ==
+		TRANSACTION_BLOCKS_DISALLOWED)
 	{
-		locallyProcessedRows += ExecuteLocalTaskList(execution->localTaskList,
-													 defaultTupleDest);
+		/* none of the remaining rows are going to be returned */
+		execution->rowLimit = 0;
 	}
 
-	return execution->rowsProcessed + locallyProcessedRows;
+	FinishStreamingExecution(scanState);
 }
 
 
 /*
- * CreateBasicExecutionParams creates basic execution parameters with some common
- * fields.
+ * FinishStreamingExecution runs the streaming execution of the scan, if any,
+ * to completion and writes all the remaining rows to the tuple store.
  */
-ExecutionParams *
-CreateBasicExecutionParams(RowModifyLevel modLevel,
-						   List *taskList,
-						   int targetPoolSize,
-						   bool localExecutionSupported)
+void
+FinishStreamingExecution(CitusScanState *scanState)
 {
-	ExecutionParams *executionParams = palloc0(sizeof(ExecutionParams));
-	executionParams->modLevel = modLevel;
-	executionParams->taskList = taskList;
-	executionParams->targetPoolSize = targetPoolSize;
-	executionParams->localExecutionSupported = localExecutionSupported;
+	DistributedExecution *execution = scanState->streamingExecution;
+	if (execution == NULL)
+	{
+		return;
+	}
 
-	executionParams->tupleDestination = CreateTupleDestNone();
-	executionParams->expectResults = false;
-	executionParams->isUtilityCommand = false;
-	executionParams->jobIdList = NIL;
+	MemoryContext oldContext = MemoryContextSwitchTo(GetMemoryChunkContext(execution));
+	bool returnOnNewRows = false;
+	bool returnWhenIdle = false;
 
-	return executionParams;
+	ContinueDistributedExecution(execution, returnOnNewRows, returnWhenIdle);
+	CompleteStreamingExecution(scanState);
+
+	MemoryContextSwitchTo(oldContext);
 }
 
 
 /*
- * CreateDistributedExecution creates a distributed execution data structure for
- * a distributed plan.
+ * CompleteStreamingExecution finishes the streaming execution of the scan
+ * once all its tasks are done.
  */
-static DistributedExecution *
-CreateDistributedExecution(RowModifyLevel modLevel, List *taskList,
-						   ParamListInfo paramListInfo,
-						   int targetPoolSize, TupleDestination *defaultTupleDest,
-						   TransactionProperties *xactProperties,
-						   List *jobIdList, bool localExecutionSupported)
+static void
+CompleteStreamingExecution(CitusScanState *scanState)
 {
-	DistributedExecution *execution =
-		(DistributedExecution *) palloc0(sizeof(DistributedExecution));
-
-	execution->modLevel = modLevel;
-	execution->remoteAndLocalTaskList = taskList;
-	execution->transactionProperties = xactProperties;
-
-	/* we are going to calculate this values below */
-	execution->localTaskList = NIL;
-	execution->remoteTaskList = NIL;
-
-	execution->paramListInfo = paramListInfo;
-	execution->workerList = NIL;
-	execution->sessionList = NIL;
-	execution->targetPoolSize = targetPoolSize;
-	execution->defaultTupleDest = defaultTupleDest;
+	FinishDistributedExecution(scanState->streamingExecution);
 
-	execution->rowsProcessed = 0;
+	scanState->streamingExecution = NULL;
 
-	execution->raiseInterrupts = true;
+	if (scanState->sortedMerge != NULL)
+	{
+		SortedMergeExecutionFinished(scanState->sortedMerge);
+	}
 
-	execution->rebuildWaitEventSet = false;
-	execution->waitFlagsChanged = false;
+	if (StreamingScanState == scanState)
+	{
+		StreamingScanState = NULL;
+	}
+}
 
-	execution->jobIdList = jobIdList;
 
-	execution->localExecutionSupported = localExecutionSupported;
+/*
+ * StreamingExecutionContextCallback releases the resources of a streaming
+ * execution that did not finish when its memory context goes away, which
+ * happens when the query fails or is cancelled while the scan is running.
+ */
+static void
+StreamingExecutionContextCallback(void *arg)
+{
+	DistributedExecution *execution = (DistributedExecution *) arg;
 
-	/*
-	 * Since task can have multiple queries, we are not sure how many columns we should
-	 * allocate for. We start with 16, and reallocate when we need more.
-	 */
-	execution->allocatedColumnCount = 16;
-	execution->columnArray = palloc0(execution->allocatedColumnCount * sizeof(void *));
-	if (EnableBinaryProtocol)
+	if (StreamingScanState == NULL ||
+		StreamingScanState->streamingExecution != execution)
 	{
-		/*
-		 * Initialize enough StringInfos for each column. These StringInfos
-		 * (and thus the backing buffers) will be reused for each row.
-		 * We will reference these StringInfos in the columnArray if the value
-		 * is not NULL.
-		 *
-		 * NOTE: StringInfos are always grown in the memory context in which
-		 * they were initially created. So appending in any memory context will
-		 * result in bufferes that are still valid after removing that memory
-		 * context.
-		 */
-		execution->stringInfoDataArray = palloc0(
-			execution->allocatedColumnCount *
-			sizeof(StringInfoData));
-		for (int i = 0; i < execution->allocatedColumnCount; i++)
-		{
-			initStringInfo(&execution->stringInfoDataArray[i]);
-		}
+		/* the execution finished */
+		return;
 	}
 
-	if (execution->localExecutionSupported &&
-		ShouldExecuteTasksLocally(taskList))
+	UnclaimAllSessionConnections(execution->sessionList);
+	RemoveAllFromSharedRunningTaskCounts(execution);
+
+	if (execution->admittedSubId != InvalidSubTransactionId)
 	{
-		bool readOnlyPlan = !TaskListModifiesDatabase(modLevel, taskList);
-		ExtractLocalAndRemoteTasks(readOnlyPlan, taskList, &execution->localTaskList,
-								   &execution->remoteTaskList);
+		ReleaseExecutionAdmission(execution->admittedSubId);
+		execution->admittedSubId = InvalidSubTransactionId;
 	}
-	else
+
+	if (execution->waitEventSet != NULL)
 	{
-		/*
-		 * Get a shallow copy of the list as we rely on remoteAndLocalTaskList
-		 * across the execution.
-		 */
-		execution->remoteTaskList = list_copy(execution->remoteAndLocalTaskList);
+		FreeWaitEventSet(execution->waitEventSet);
+		execution->waitEventSet = NULL;
 	}
 
-	execution->totalTaskCount = list_length(execution->remoteTaskList);
-	execution->unfinishedTaskCount = list_length(execution->remoteTaskList);
-
-	return execution;
+	StreamingScanState->streamingExecution = NULL;
+	StreamingScanState = NULL;
 }
 
 
 /*
- * DecideTransactionPropertiesForTaskList decides whether to use remote transaction
- * blocks, whether to use 2PC for the given task list, and whether to error on any
- * failure.
- *
- * Since these decisions have specific dependencies on each other (e.g. 2PC implies
- * errorOnAnyFailure, but not the other way around) we keep them in the same place.
+ * HasDependentJobs returns true if there is any dependent job
+ * for the mainjob(top level) job.
  */
-static TransactionProperties
-DecideTransactionPropertiesForTaskList(RowModifyLevel modLevel, List *taskList, bool
-									   exludeFromTransaction)
+static bool
+HasDependentJobs(Job *mainJob)
 {
-	TransactionProperties xactProperties;
+	return list_length(mainJob->dependentJobList) > 0;
+}
 
-	/* ensure uninitialized padding doesn't escape the function */
-	memset_struct_0(xactProperties);
-	xactProperties.errorOnAnyFailure = false;
-	xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_ALLOWED;
-	xactProperties.requires2PC = false;
 
-	if (taskList == NIL)
+/*
+ * ShouldOverlapLocalExecution returns true if the local tasks of the execution
+ * can run while its remote tasks are in flight.
+ *
+ * We only do this for reads, for which the order in which the local and the
+ * remote tasks run does not matter. Modifications keep running the remote
+ * tasks first, such that their locks are taken in the usual order.
+ */
+static bool
+ShouldOverlapLocalExecution(CitusScanState *scanState, DistributedExecution *execution)
+{
+	if (!EnableOverlappingLocalExecution)
 	{
-		/* nothing to do, return defaults */
-		return xactProperties;
+		return false;
 	}
 
-	if (exludeFromTransaction)
+	if (execution->localTaskList == NIL || execution->remoteTaskList == NIL)
 	{
-		xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_DISALLOWED;
-		return xactProperties;
+		return false;
 	}
 
-	if (TaskListCannotBeExecutedInTransaction(taskList))
+	if (scanState->distributedPlan->modLevel != ROW_MODIFY_READONLY)
 	{
-		/*
-		 * We prefer to error on any failures for CREATE INDEX
-		 * CONCURRENTLY or VACUUM//VACUUM ANALYZE (e.g., COMMIT_PROTOCOL_BARE).
-		 */
-		xactProperties.errorOnAnyFailure = true;
-		xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_DISALLOWED;
-		return xactProperties;
+		return false;
 	}
 
-	if (DistributedExecutionRequiresRollback(taskList))
-	{
-		/* transaction blocks are required if the task list needs to roll back */
-		xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_REQUIRED;
-
-		if (TaskListRequires2PC(taskList))
-		{
-			/*
-			 * Although using two phase commit protocol is an independent decision than
-			 * failing on any error, we prefer to couple them. Our motivation is that
-			 * the failures are rare, and we prefer to avoid marking placements invalid
-			 * in case of failures.
-			 */
-			xactProperties.errorOnAnyFailure = true;
-			xactProperties.requires2PC = true;
-		}
-	}
-	else if (InCoordinatedTransaction())
-	{
-		/*
-		 * If we are already in a coordinated transaction then transaction blocks
-		 * are required even if they are not strictly required for the current
-		 * execution.
-		 */
-		xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_REQUIRED;
-	}
-
-	return xactProperties;
-}
+	return true;
+}
 
 
 /*
- * StartDistributedExecution sets up the coordinated transaction and 2PC for
- * the execution whenever necessary. It also keeps track of parallel relation
- * accesses to enforce restrictions that arise due to foreign keys to reference
- * tables.
+ * RunOverlappingLocalAndDistributedExecution sends the remote tasks of the
+ * execution, and runs its local tasks one by one while the remote tasks are
+ * in flight. Between local tasks, it processes the results that arrived from
+ * the workers without waiting for more. Once the local tasks are done, the
+ * function waits for the remote tasks to finish.
+ *
+ * Tasks that fail over to local execution while the remote tasks run are
+ * left in the localTaskList of the execution, for the caller to run.
  */
-void
-StartDistributedExecution(DistributedExecution *execution)
+static void
+RunOverlappingLocalAndDistributedExecution(CitusScanState *scanState,
+										   DistributedExecution *execution)
 {
-	TransactionProperties *xactProperties = execution->transactionProperties;
+	EState *estate = ScanStateGetExecutorState(scanState);
+	List *localTaskList = execution->localTaskList;
+	int localTaskCount = list_length(localTaskList);
+	bool returnOnNewRows = false;
+	bool isUtilityCommand = false;
 
-	if (xactProperties->useRemoteTransactionBlocks == TRANSACTION_BLOCKS_REQUIRED)
-	{
-		UseCoordinatedTransaction();
-	}
+	AssignTasksToConnectionsOrWorkerPool(execution, execution->remoteTaskList);
 
-	if (xactProperties->requires2PC)
+	PG_TRY();
 	{
-		Use2PCForCoordinatedTransaction();
-	}
+		bool executionFinished = false;
 
-	/*
-	 * Prevent unsafe concurrent modifications of replicated shards by taking
-	 * locks.
-	 *
-	 * When modifying a reference tables in MX mode, we take the lock via RPC
-	 * to the first worker in a transaction block, which activates a coordinated
-	 * transaction. We need to do this before determining whether the execution
-	 * should use transaction blocks (see below).
-	 */
-	AcquireExecutorShardLocksForExecution(execution);
+		for (int taskIndex = 0; taskIndex < localTaskCount; taskIndex++)
+		{
+			if (!executionFinished)
+			{
+				/* send the queries that are ready and read the available results */
+				bool returnWhenIdle = true;
+				executionFinished = ContinueDistributedExecution(execution,
+																 returnOnNewRows,
+																 returnWhenIdle);
+			}
 
-	/*
-	 * We should not record parallel access if the target pool size is less than 2.
-	 * The reason is that we define parallel access as at least two connections
-	 * accessing established to worker node.
-	 *
-	 * It is not ideal to have this check here, it'd have been better if we simply passed
-	 * DistributedExecution directly to the RecordParallelAccess*() function. However,
-	 * since we have two other executors that rely on the function, we had to only pass
-	 * the tasklist to have a common API.
-	 */
-	if (execution->targetPoolSize > 1)
-	{
-		/*
-		 * Record the access for both the local and remote tasks. The main goal
-		 * is to make sure that Citus behaves consistently even if the local
-		 * shards are moved away.
-		 */
-		RecordParallelRelationAccessForTaskList(execution->remoteAndLocalTaskList);
-	}
+			Task *localTask = list_nth(localTaskList, taskIndex);
+			execution->rowsProcessed +=
+				ExecuteLocalTaskListExtended(list_make1(localTask),
+											 estate->es_param_list_info,
+											 scanState->distributedPlan,
+											 execution->defaultTupleDest,
+											 isUtilityCommand);
+		}
 
-	/* make sure we are not doing remote execution from within a task */
-	if (execution->remoteTaskList != NIL)
+		if (!executionFinished)
+		{
+			bool returnWhenIdle = false;
+			ContinueDistributedExecution(execution, returnOnNewRows, returnWhenIdle);
+		}
+	}
+	PG_CATCH();
 	{
-		bool isRemote = true;
-		EnsureTaskExecutionAllowed(isRemote);
+		/* an error in a local task leaves the wait loop of the execution open */
+		AbortDistributedExecutionWaitLoop(execution);
+
+		PG_RE_THROW();
 	}
+	PG_END_TRY();
+
+	/* keep the tasks that failed over to local execution in the meantime */
+	execution->localTaskList = list_copy_tail(execution->localTaskList,
+											  localTaskCount);
 }
 
 
 /*
- *  DistributedExecutionModifiesDatabase returns true if the execution modifies the data
- *  or the schema.
+ * RunLocalExecution runs the localTaskList in the execution, fills the tuplestore
+ * and sets the es_processed if necessary.
+ *
+ * It also sorts the tuplestore if there are no remote tasks remaining.
  */
-static bool
-DistributedExecutionModifiesDatabase(DistributedExecution *execution)
+static void
+RunLocalExecution(CitusScanState *scanState, DistributedExecution *execution)
 {
-	return TaskListModifiesDatabase(execution->modLevel,
-									execution->remoteAndLocalTaskList);
+	EState *estate = ScanStateGetExecutorState(scanState);
+	bool isUtilityCommand = false;
+	uint64 rowsProcessed = ExecuteLocalTaskListExtended(execution->localTaskList,
+														estate->es_param_list_info,
+														scanState->distributedPlan,
+														execution->defaultTupleDest,
+														isUtilityCommand);
+
+	execution->rowsProcessed += rowsProcessed;
 }
 
 
 /*
- *  DistributedPlanModifiesDatabase returns true if the plan modifies the data
- *  or the schema.
+ * ExecuteUtilityTaskList is a wrapper around executing task
+ * list for utility commands.
  */
-bool
-DistributedPlanModifiesDatabase(DistributedPlan *plan)
+uint64
+ExecuteUtilityTaskList(List *utilityTaskList, bool localExecutionSupported)
 {
-	return TaskListModifiesDatabase(plan->modLevel, plan->workerJob->taskList);
+	utilityTaskList = GroupUtilityTasksByWorker(utilityTaskList,
+												ExecutorUtilityTaskGroupSize);
+
+	RowModifyLevel modLevel = ROW_MODIFY_NONE;
+	ExecutionParams *executionParams = CreateBasicExecutionParams(
+		modLevel, utilityTaskList, MaxAdaptiveExecutorPoolSize, localExecutionSupported
+		);
+	executionParams->xactProperties =
+		DecideTransactionPropertiesForTaskList(modLevel, utilityTaskList, false);
+	executionParams->isUtilityCommand = true;
+
+	return ExecuteTaskListExtended(executionParams);
 }
 
 
 /*
- *  TaskListModifiesDatabase is a helper function for DistributedExecutionModifiesDatabase and
- *  DistributedPlanModifiesDatabase.
+ * ExecuteUtilityTaskListExtended is a wrapper around executing task
+ * list for utility commands.
  */
-static bool
-TaskListModifiesDatabase(RowModifyLevel modLevel, List *taskList)
+uint64
+ExecuteUtilityTaskListExtended(List *utilityTaskList, int poolSize,
+							   bool localExecutionSupported)
 {
-	if (modLevel > ROW_MODIFY_READONLY)
-	{
-		return true;
-	}
+	utilityTaskList = GroupUtilityTasksByWorker(utilityTaskList,
+												ExecutorUtilityTaskGroupSize);
 
-	/*
-	 * If we cannot decide by only checking the row modify level,
-	 * we should look closer to the tasks.
-	 */
-	if (list_length(taskList) < 1)
-	{
-		/* is this ever possible? */
-		return false;
-	}
+	RowModifyLevel modLevel = ROW_MODIFY_NONE;
+	ExecutionParams *executionParams = CreateBasicExecutionParams(
+		modLevel, utilityTaskList, poolSize, localExecutionSupported
+		);
 
-	Task *firstTask = (Task *) linitial(taskList);
+	bool excludeFromXact = false;
+	executionParams->xactProperties =
+		DecideTransactionPropertiesForTaskList(modLevel, utilityTaskList,
+											   excludeFromXact);
+	executionParams->isUtilityCommand = true;
 
-	return !ReadOnlyTask(firstTask->taskType);
+	return ExecuteTaskListExtended(executionParams);
 }
 
 
 /*
- * DistributedExecutionRequiresRollback returns true if the distributed
- * execution should start a CoordinatedTransaction. In other words, if the
- * function returns true, the execution sends BEGIN; to every connection
- * involved in the distributed execution.
+ * ExecuteSequentialUtilityTaskList executes the given utility task list over a
+ * single connection per worker. Since all placements on a worker are then
+ * accessed over the same connection anyway, the commands of the tasks for the
+ * same worker are also combined inside transaction blocks, as long as their
+ * tables were not accessed over other connections earlier in the transaction.
  */
-static bool
-DistributedExecutionRequiresRollback(List *taskList)
+uint64
+ExecuteSequentialUtilityTaskList(List *utilityTaskList, bool localExecutionSupported)
 {
-	int taskCount = list_length(taskList);
-
-	if (taskCount == 0)
+	if (ExecutorUtilityTaskGroupSize > 1 && list_length(utilityTaskList) > 1 &&
+		!UtilityTaskRelationsAccessedInTransaction(utilityTaskList))
 	{
-		return false;
-	}
-
-	Task *task = (Task *) linitial(taskList);
-	if (task->cannotBeExecutedInTransction)
-	{
-		/* vacuum, create index concurrently etc. */
-		return false;
+		utilityTaskList = CombineUtilityTasksByWorker(utilityTaskList,
+													  ExecutorUtilityTaskGroupSize);
 	}
 
-	bool selectForUpdate = task->relationRowLockList != NIL;
-	if (selectForUpdate)
-	{
-		/*
-		 * Do not check SelectOpensTransactionBlock, always open transaction block
-		 * if SELECT FOR UPDATE is executed inside a distributed transaction.
-		 */
-		return IsMultiStatementTransaction();
-	}
+	int poolSize = 1;
+	RowModifyLevel modLevel = ROW_MODIFY_NONE;
+	ExecutionParams *executionParams = CreateBasicExecutionParams(
+		modLevel, utilityTaskList, poolSize, localExecutionSupported
+		);
+	executionParams->xactProperties =
+		DecideTransactionPropertiesForTaskList(modLevel, utilityTaskList, false);
+	executionParams->isUtilityCommand = true;
 
-	if (ReadOnlyTask(task->taskType))
-	{
-		return SelectOpensTransactionBlock &&
-			   IsTransactionBlock();
-	}
+	return ExecuteTaskListExtended(executionParams);
+}
 
-	if (IsMultiStatementTransaction())
-	{
-		return true;
-	}
 
-	if (list_length(taskList) > 1)
-	{
-		return true;
-	}
+/*
+ * ExecuteIndexBuildTaskList executes the task list of a CREATE INDEX or
+ * REINDEX command, opening at most citus.max_index_builds_per_worker
+ * connections per worker such that the index builds do not saturate the
+ * workers, and reporting the progress of the shards that are being indexed
+ * for citus_index_build_progress().
+ */
+uint64
+ExecuteIndexBuildTaskList(List *utilityTaskList, bool localExecutionSupported)
+{
+	utilityTaskList = GroupUtilityTasksByWorker(utilityTaskList,
+												ExecutorUtilityTaskGroupSize);
 
-	if (list_length(task->taskPlacementList) > 1)
+	int poolSize = MaxAdaptiveExecutorPoolSize;
+	if (MaxIndexBuildsPerWorker > 0)
 	{
-		/*
-		 * Single DML/DDL tasks with replicated tables (including
-		 * reference and non-reference tables) should require
-		 * BEGIN/COMMIT/ROLLBACK.
-		 */
-		return true;
+		poolSize = Min(poolSize, MaxIndexBuildsPerWorker);
 	}
 
-	if (task->queryCount > 1)
-	{
-		/*
-		 * When there are multiple sequential queries in a task
-		 * we need to run those as a transaction.
-		 */
-		return true;
-	}
+	RowModifyLevel modLevel = ROW_MODIFY_NONE;
+	ExecutionParams *executionParams = CreateBasicExecutionParams(
+		modLevel, utilityTaskList, poolSize, localExecutionSupported
+		);
+	executionParams->xactProperties =
+		DecideTransactionPropertiesForTaskList(modLevel, utilityTaskList, false);
+	executionParams->isUtilityCommand = true;
+	executionParams->taskProgressMagicNumber = INDEX_BUILD_ACTIVITY_MAGIC_NUMBER;
 
-	return false;
+	return ExecuteTaskListExtended(executionParams);
 }
 
 
 /*
- * TaskListRequires2PC determines whether the given task list requires 2PC.
+ * ExecuteTaskList is a proxy to ExecuteTaskListExtended
+ * with defaults for some of the arguments.
  */
-static bool
-TaskListRequires2PC(List *taskList)
+uint64
+ExecuteTaskList(RowModifyLevel modLevel, List *taskList)
 {
-	if (taskList == NIL)
-	{
-		return false;
-	}
+	bool localExecutionSupported = true;
+	ExecutionParams *executionParams = CreateBasicExecutionParams(
+		modLevel, taskList, MaxAdaptiveExecutorPoolSize, localExecutionSupported
+		);
 
-	Task *task = (Task *) linitial(taskList);
-	if (ReadOnlyTask(task->taskType))
-	{
-		/* we do not trigger 2PC for ReadOnly queries */
-		return false;
-	}
+	bool excludeFromXact = false;
+	executionParams->xactProperties = DecideTransactionPropertiesForTaskList(
+		modLevel, taskList, excludeFromXact);
 
-	bool singleTask = list_length(taskList) == 1;
-	if (singleTask && list_length(task->taskPlacementList) == 1)
-	{
-		/* we do not trigger 2PC for modifications that are:
-		 *    - single task
-		 *    - single placement
-		 */
-		return false;
-	}
+	return ExecuteTaskListExtended(executionParams);
+}
 
+
+/*
+ * ExecuteTaskListOutsideTransaction is a proxy to ExecuteTaskListExtended
+ * with defaults for some of the arguments.
+ */
+uint64
+ExecuteTaskListOutsideTransaction(RowModifyLevel modLevel, List *taskList,
+								  int targetPoolSize, List *jobIdList)
+{
 	/*
-	 * Otherwise, all modifications are done via 2PC. This includes:
-	 *    - Multi-shard commands irrespective of the replication factor
-	 *    - Single-shard commands that are targeting more than one replica
+	 * As we are going to run the tasks outside transaction, we shouldn't use local execution.
+	 * However, there is some problem when using local execution related to
+	 * repartition joins, when we solve that problem, we can execute the tasks
+	 * coming to this path with local execution. See PR:3711
 	 */
-	return true;
+	bool localExecutionSupported = false;
+	ExecutionParams *executionParams = CreateBasicExecutionParams(
+		modLevel, taskList, targetPoolSize, localExecutionSupported
+		);
+
+	executionParams->xactProperties = DecideTransactionPropertiesForTaskList(
+		modLevel, taskList, true);
+	return ExecuteTaskListExtended(executionParams);
 }
 
 
 /*
- * ReadOnlyTask returns true if the input task does a read-only operation
- * on the database.
+ * ExecuteTaskListIntoTupleDest is a proxy to ExecuteTaskListExtended() with defaults
+ * for some of the arguments.
  */
-bool
-ReadOnlyTask(TaskType taskType)
+uint64
+ExecuteTaskListIntoTupleDest(RowModifyLevel modLevel, List *taskList,
+							 TupleDestination *tupleDest,
+							 bool expectResults)
 {
-	switch (taskType)
-	{
-		case READ_TASK:
-		case MAP_OUTPUT_FETCH_TASK:
-		case MAP_TASK:
-		case MERGE_TASK:
-		{
-			return true;
-		}
+	int targetPoolSize = MaxAdaptiveExecutorPoolSize;
+	bool localExecutionSupported = true;
+	ExecutionParams *executionParams = CreateBasicExecutionParams(
+		modLevel, taskList, targetPoolSize, localExecutionSupported
+		);
 
-		default:
-		{
-			return false;
-		}
-	}
+	executionParams->xactProperties = DecideTransactionPropertiesForTaskList(
+		modLevel, taskList, false);
+	executionParams->expectResults = expectResults;
+	executionParams->tupleDestination = tupleDest;
+
+	return ExecuteTaskListExtended(executionParams);
 }
 
 
 /*
- * TaskListCannotBeExecutedInTransaction returns true if any of the
- * tasks in the input cannot be executed in a transaction. These are
- * tasks like VACUUM or CREATE INDEX CONCURRENTLY etc.
+ * ExecuteTaskListWithTaskFinishedCallback is a proxy to ExecuteTaskListExtended
+ * that calls the given callback whenever a task finishes, and adds the tasks
+ * that it returns to the running execution. Local execution is not used, as
+ * the local tasks would only run after the remote execution.
  */
-bool
-TaskListCannotBeExecutedInTransaction(List *taskList)
+uint64
+ExecuteTaskListWithTaskFinishedCallback(RowModifyLevel modLevel, List *taskList,
+										TaskFinishedCallback taskFinishedCallback,
+										void *taskFinishedContext)
 {
-	Task *task = NULL;
-	foreach_ptr(task, taskList)
-	{
-		if (task->cannotBeExecutedInTransction)
-		{
-			return true;
-		}
-	}
+	bool localExecutionSupported = false;
+	ExecutionParams *executionParams = CreateBasicExecutionParams(
+		modLevel, taskList, MaxAdaptiveExecutorPoolSize, localExecutionSupported
+		);
 
-	return false;
+	bool excludeFromXact = false;
+	executionParams->xactProperties = DecideTransactionPropertiesForTaskList(
+		modLevel, taskList, excludeFromXact);
+	executionParams->taskFinishedCallback = taskFinishedCallback;
+	executionParams->taskFinishedContext = taskFinishedContext;
+
+	return ExecuteTaskListExtended(executionParams);
 }
 
 
 /*
- * SelectForUpdateOnReferenceTable returns true if the input task
- * contains a FOR UPDATE clause that locks any reference tables.
+ * ExecuteTaskListExtended sets up the execution for given task list and
+ * runs it.
  */
-static bool
-SelectForUpdateOnReferenceTable(List *taskList)
+uint64
+ExecuteTaskListExtended(ExecutionParams *executionParams)
 {
-	if (list_length(taskList) != 1)
+	ParamListInfo paramListInfo = NULL;
+	uint64 locallyProcessedRows = 0;
+
+	TupleDestination *defaultTupleDest = executionParams->tupleDestination;
+
+	if (MultiShardConnectionType == SEQUENTIAL_CONNECTION)
 	{
-		/* we currently do not support SELECT FOR UPDATE on multi task queries */
-		return false;
+		executionParams->targetPoolSize = 1;
 	}
 
-	Task *task = (Task *) linitial(taskList);
-	RelationRowLock *relationRowLock = NULL;
-	foreach_ptr(relationRowLock, task->relationRowLockList)
+	DistributedExecution *execution =
+		CreateDistributedExecution(
+			executionParams->modLevel, executionParams->taskList,
+			paramListInfo, executionParams->targetPoolSize,
+			defaultTupleDest, &executionParams->xactProperties,
+			executionParams->jobIdList, executionParams->localExecutionSupported);
+
+	/*
+	 * If current transaction accessed local placements and task list includes
+	 * tasks that should be executed locally (accessing any of the local placements),
+	 * then we should error out as it would cause inconsistencies across the
+	 * remote connection and local execution.
+	 */
+	EnsureCompatibleLocalExecutionState(execution->remoteTaskList);
+
+	execution->taskFinishedCallback = executionParams->taskFinishedCallback;
+	execution->taskFinishedContext = executionParams->taskFinishedContext;
+
+	/*
+	 * Nested commands, such as the ones of a function that runs during the
+	 * execution, do not replace the progress monitor of the outer command.
+	 */
+	bool reportTaskProgress = executionParams->taskProgressMagicNumber != 0 &&
+							  !HasProgressMonitor();
+	if (reportTaskProgress)
 	{
-		Oid relationId = relationRowLock->relationId;
+		execution->taskProgressSteps =
+			SetupShardTaskProgressMonitor(executionParams->taskProgressMagicNumber,
+										  execution->remoteTaskList);
+	}
 
-		if (IsCitusTableType(relationId, REFERENCE_TABLE))
-		{
-			return true;
-		}
+	/* large read-only task lists wait for admission like distributed queries */
+	execution->admittedSubId = AdmitMultiShardExecution(execution->modLevel,
+														execution->remoteTaskList);
+
+	/* run the remote execution */
+	StartDistributedExecution(execution);
+	RunDistributedExecution(execution);
+	FinishDistributedExecution(execution);
+
+	if (reportTaskProgress)
+	{
+		FinalizeCurrentProgressMonitor();
 	}
 
-	return false;
+	/* now, switch back to the local execution */
+	if (executionParams->isUtilityCommand)
+	{
+		locallyProcessedRows += ExecuteLocalUtilityTaskList(execution->localTaskList);
+	}
+	else
+	{
+		locallyProcessedRows += ExecuteLocalTaskList(execution->localTaskList,
+													 defaultTupleDest);
+	}
+
+	return execution->rowsProcessed + locallyProcessedRows;
 }
 
 
 /*
- * LockPartitionsForDistributedPlan ensures commands take locks on all partitions
- * of a distributed table that appears in the query. We do this primarily out of
- * consistency with PostgreSQL locking.
+ * CreateBasicExecutionParams creates basic execution parameters with some common
+ * fields.
  */
-static void
-LockPartitionsForDistributedPlan(DistributedPlan *distributedPlan)
+ExecutionParams *
+CreateBasicExecutionParams(RowModifyLevel modLevel,
+						   List *taskList,
+						   int targetPoolSize,
+						   bool localExecutionSupported)
 {
-	if (DistributedPlanModifiesDatabase(distributedPlan))
-	{
-		Oid targetRelationId = distributedPlan->targetRelationId;
+	ExecutionParams *executionParams = palloc0(sizeof(ExecutionParams));
+	executionParams->modLevel = modLevel;
+	executionParams->taskList = taskList;
+	executionParams->targetPoolSize = targetPoolSize;
+	executionParams->localExecutionSupported = localExecutionSupported;
 
-		LockPartitionsInRelationList(list_make1_oid(targetRelationId), RowExclusiveLock);
-	}
+	executionParams->tupleDestination = CreateTupleDestNone();
+	executionParams->expectResults = false;
+	executionParams->isUtilityCommand = false;
+	executionParams->jobIdList = NIL;
+	executionParams->taskProgressMagicNumber = 0;
+	executionParams->taskFinishedCallback = NULL;
+	executionParams->taskFinishedContext = NULL;
 
-	/*
-	 * Lock partitions of tables that appear in a SELECT or subquery. In the
-	 * DML case this also includes the target relation, but since we already
-	 * have a stronger lock this doesn't do any harm.
-	 */
-	LockPartitionsInRelationList(distributedPlan->relationIdList, AccessShareLock);
+	return executionParams;
 }
 
 
 /*
- * AcquireExecutorShardLocksForExecution acquires advisory lock on shard IDs
- * to prevent unsafe concurrent modifications of shards.
- *
- * We prevent concurrent modifications of shards in two cases:
- * 1. Any non-commutative writes to a replicated table
- * 2. Multi-shard writes that are executed in parallel
- *
- * The first case ensures we do not apply updates in different orders on
- * different replicas (e.g. of a reference table), which could lead the
- * replicas to diverge.
- *
- * The second case prevents deadlocks due to out-of-order execution.
- *
- * There are two GUCs that can override the default behaviors.
- *  'citus.all_modifications_commutative' relaxes locking
- *  that's done for the purpose of keeping replicas consistent.
- *  'citus.enable_deadlock_prevention' relaxes locking done for
- *  the purpose of avoiding deadlocks between concurrent
- *  multi-shard commands.
- *
- * We do not take executor shard locks for utility commands such as
- * TRUNCATE because the table locks already prevent concurrent access.
+ * CreateDistributedExecution creates a distributed execution data structure for
+ * a distributed plan.
  */
-static void
-AcquireExecutorShardLocksForExecution(DistributedExecution *execution)
+static DistributedExecution *
+CreateDistributedExecution(RowModifyLevel modLevel, List *taskList,
+						   ParamListInfo paramListInfo,
+						   int targetPoolSize, TupleDestination *defaultTupleDest,
+						   TransactionProperties *xactProperties,
+						   List *jobIdList, bool localExecutionSupported)
 {
-	RowModifyLevel modLevel = execution->modLevel;
-
-	/* acquire the locks for both the remote and local tasks */
-	List *taskList = execution->remoteAndLocalTaskList;
-
-	if (modLevel <= ROW_MODIFY_READONLY &&
-		!SelectForUpdateOnReferenceTable(taskList))
+	if (StreamingScanState != NULL)
 	{
-		/*
-		 * Executor locks only apply to DML commands and SELECT FOR UPDATE queries
-		 * touching reference tables.
-		 */
-		return;
+		/* the streaming execution might use connections that we need */
+		FinishStreamingExecution(StreamingScanState);
 	}
 
-	bool requiresParallelExecutionLocks =
-		!(list_length(taskList) == 1 || ShouldRunTasksSequentially(taskList));
+	DistributedExecution *execution =
+		(DistributedExecution *) palloc0(sizeof(DistributedExecution));
 
-	bool modifiedTableReplicated = ModifiedTableReplicated(taskList);
-	if (!modifiedTableReplicated && !requiresParallelExecutionLocks)
-	{
-		/*
-		 * When a distributed query on tables with replication
-		 * factor == 1 and command hits only a single shard, we
-		 * rely on Postgres to handle the serialization of the
-		 * concurrent modifications on the workers.
-		 *
-		 * For reference tables, even if their placements are replicated
-		 * ones (e.g., single node), we acquire the distributed execution
-		 * locks to be consistent when new node(s) are added. So, they
-		 * do not return at this point.
-		 */
-		return;
-	}
+	execution->modLevel = modLevel;
+	execution->remoteAndLocalTaskList = taskList;
+	execution->transactionProperties = xactProperties;
 
-	/*
-	 * We first assume that all the remaining modifications are going to
-	 * be serialized. So, start with an ExclusiveLock and lower the lock level
-	 * as much as possible.
-	 */
-	int lockMode = ExclusiveLock;
+	/* we are going to calculate this values below */
+	execution->localTaskList = NIL;
+	execution->remoteTaskList = NIL;
+
+	execution->paramListInfo = paramListInfo;
+	execution->workerList = NIL;
+	execution->sessionList = NIL;
+	execution->targetPoolSize = targetPoolSize;
+	execution->defaultTupleDest = defaultTupleDest;
+
+	execution->rowsProcessed = 0;
+	execution->rowLimit = -1;
+
+	execution->raiseInterrupts = true;
+
+	execution->rebuildWaitEventSet = false;
+	execution->waitFlagsChanged = false;
+
+	execution->jobIdList = jobIdList;
+
+	execution->localExecutionSupported = localExecutionSupported;
 
 	/*
-	 * In addition to honouring commutativity rules, we currently only
-	 * allow a single multi-shard command on a shard at a time. Otherwise,
-	 * concurrent multi-shard commands may take row-level locks on the
-	 * shard placements in a different order and create a distributed
-	 * deadlock. This applies even when writes are commutative and/or
-	 * there is no replication. This can be relaxed via
-	 * EnableDeadlockPrevention.
-	 *
-	 * 1. If citus.all_modifications_commutative is set to true, then all locks
-	 * are acquired as RowExclusiveLock.
-	 *
-	 * 2. If citus.all_modifications_commutative is false, then only the shards
-	 * with more than one replicas are locked with ExclusiveLock. Otherwise, the
-	 * lock is acquired with ShareUpdateExclusiveLock.
-	 *
-	 * ShareUpdateExclusiveLock conflicts with itself such that only one
-	 * multi-shard modification at a time is allowed on a shard. It also conflicts
-	 * with ExclusiveLock, which ensures that updates/deletes/upserts are applied
-	 * in the same order on all placements. It does not conflict with
-	 * RowExclusiveLock, which is normally obtained by single-shard, commutative
-	 * writes.
+	 * Since task can have multiple queries, we are not sure how many columns we should
+	 * allocate for. We start with 16, and reallocate when we need more.
 	 */
-	if (!modifiedTableReplicated && requiresParallelExecutionLocks)
+	execution->allocatedColumnCount = 16;
+	execution->columnArray = palloc0(execution->allocatedColumnCount * sizeof(void *));
+	if (EnableBinaryProtocol)
 	{
 		/*
-		 * When there is no replication then we only need to prevent
-		 * concurrent multi-shard commands on the same shards. This is
-		 * because concurrent, parallel commands may modify the same
-		 * set of shards, but in different orders. The order of the
-		 * accesses might trigger distributed deadlocks that are not
-		 * possible to happen on non-distributed systems such
-		 * regular Postgres.
-		 *
-		 * As an example, assume that we have two queries: query-1 and query-2.
-		 * Both queries access shard-1 and shard-2. If query-1 first accesses to
-		 * shard-1 then shard-2, and query-2 accesses shard-2 then shard-1, these
-		 * two commands might block each other in case they modify the same rows
-		 * (e.g., cause distributed deadlocks).
-		 *
-		 * In either case, ShareUpdateExclusive has the desired effect, since
-		 * it conflicts with itself and ExclusiveLock (taken by non-commutative
-		 * writes).
+		 * Initialize enough StringInfos for each column. These StringInfos
+		 * (and thus the backing buffers) will be reused for each row.
+		 * We will reference these StringInfos in the columnArray if the value
+		 * is not NULL.
 		 *
-		 * However, some users find this too restrictive, so we allow them to
-		 * reduce to a RowExclusiveLock when citus.enable_deadlock_prevention
-		 * is enabled, which lets multi-shard modifications run in parallel as
-		 * long as they all disable the GUC.
+		 * NOTE: StringInfos are always grown in the memory context in which
+		 * they were initially created. So appending in any memory context will
+		 * result in bufferes that are still valid after removing that memory
+		 * context.
 		 */
-		lockMode =
-			EnableDeadlockPrevention ? ShareUpdateExclusiveLock : RowExclusiveLock;
-
-		if (!IsCoordinator())
+		execution->stringInfoDataArray = palloc0(
+			execution->allocatedColumnCount *
+			sizeof(StringInfoData));
+		for (int i = 0; i < execution->allocatedColumnCount; i++)
 		{
-			/*
-			 * We also skip taking a heavy-weight lock when running a multi-shard
-			 * commands from workers, since we currently do not prevent concurrency
-			 * across workers anyway.
-			 */
-			lockMode = RowExclusiveLock;
+			initStringInfo(&execution->stringInfoDataArray[i]);
 		}
+
+		execution->columnValues = palloc0(execution->allocatedColumnCount *
+										  sizeof(Datum));
+		execution->columnNulls = palloc0(execution->allocatedColumnCount *
+										 sizeof(bool));
 	}
-	else if (modifiedTableReplicated)
+
+	if (execution->localExecutionSupported &&
+		ShouldExecuteTasksLocally(taskList))
 	{
-		/*
-		 * When we are executing distributed queries on replicated tables, our
-		 * default behaviour is to prevent any concurrency. This is valid
-		 * for when parallel execution is happening or not.
-		 *
-		 * The reason is that we cannot control the order of the placement accesses
-		 * of two distributed queries to the same shards. The order of the accesses
-		 * might cause the replicas of the same shard placements diverge. This is
-		 * not possible to happen on non-distributed systems such regular Postgres.
-		 *
-		 * As an example, assume that we have two queries: query-1 and query-2.
-		 * Both queries only access the placements of shard-1, say p-1 and p-2.
-		 *
-		 * And, assume that these queries are non-commutative, such as:
-		 *  query-1: UPDATE table SET b = 1 WHERE key = 1;
-		 *  query-2: UPDATE table SET b = 2 WHERE key = 1;
-		 *
-		 * If query-1 accesses to p-1 then p-2, and query-2 accesses
-		 * p-2 then p-1, these two commands would leave the p-1 and p-2
-		 * diverged (e.g., the values for the column "b" would be different).
-		 *
-		 * The only exception to this rule is the single shard commutative
-		 * modifications, such as INSERTs. In that case, we can allow
-		 * concurrency among such backends, hence lowering the lock level
-		 * to RowExclusiveLock.
-		 */
-		if (!requiresParallelExecutionLocks && modLevel < ROW_MODIFY_NONCOMMUTATIVE)
-		{
-			lockMode = RowExclusiveLock;
-		}
+		bool readOnlyPlan = !TaskListModifiesDatabase(modLevel, taskList);
+		ExtractLocalAndRemoteTasks(readOnlyPlan, taskList, &execution->localTaskList,
+								   &execution->remoteTaskList);
 	}
-
-	if (AllModificationsCommutative)
+	else
 	{
 		/*
-		 * The mapping is overridden when all_modifications_commutative is set to true.
-		 * In that case, all modifications are treated as commutative, which can be used
-		 * to communicate that the application is only generating commutative
-		 * UPDATE/DELETE/UPSERT commands and exclusive locks are unnecessary. This
-		 * is irrespective of single-shard/multi-shard or replicated tables.
+		 * Get a shallow copy of the list as we rely on remoteAndLocalTaskList
+		 * across the execution.
 		 */
-		lockMode = RowExclusiveLock;
+		execution->remoteTaskList = list_copy(execution->remoteAndLocalTaskList);
 	}
 
-	/* now, iterate on the tasks and acquire the executor locks on the shards */
-	List *anchorShardIntervalList = NIL;
-	List *relationRowLockList = NIL;
-	List *requiresConsistentSnapshotRelationShardList = NIL;
-
-	Task *task = NULL;
-	foreach_ptr(task, taskList)
-	{
-		ShardInterval *anchorShardInterval = LoadShardInterval(task->anchorShardId);
-		anchorShardIntervalList = lappend(anchorShardIntervalList, anchorShardInterval);
-
-		/* Acquire additional locks for SELECT .. FOR UPDATE on reference tables */
-		AcquireExecutorShardLocksForRelationRowLockList(task->relationRowLockList);
-
-		relationRowLockList =
-			list_concat(relationRowLockList,
-						task->relationRowLockList);
+	execution->totalTaskCount = list_length(execution->remoteTaskList);
+	execution->unfinishedTaskCount = list_length(execution->remoteTaskList);
 
-		/*
-		 * If the task has a subselect, then we may need to lock the shards from which
-		 * the query selects as well to prevent the subselects from seeing different
-		 * results on different replicas.
-		 */
-		if (RequiresConsistentSnapshot(task))
-		{
-			/*
-			 * ExclusiveLock conflicts with all lock types used by modifications
-			 * and therefore prevents other modifications from running
-			 * concurrently.
-			 */
-			requiresConsistentSnapshotRelationShardList =
-				list_concat(requiresConsistentSnapshotRelationShardList,
-							task->relationShardList);
-		}
-	}
+	return execution;
+}
 
-	/*
-	 * Acquire the locks in a sorted way to avoid deadlocks due to lock
-	 * ordering across concurrent sessions.
-	 */
-	anchorShardIntervalList =
-		SortList(anchorShardIntervalList, CompareShardIntervalsById);
 
-	/*
-	 * If we are dealing with a partition we are also taking locks on parent table
-	 * to prevent deadlocks on concurrent operations on a partition and its parent.
-	 *
-	 * Note that this function currently does not acquire any remote locks as that
-	 * is necessary to control the concurrency across multiple nodes for replicated
-	 * tables. That is because Citus currently does not allow modifications to
-	 * partitions from any node other than the coordinator.
-	 */
-	LockParentShardResourceIfPartition(anchorShardIntervalList, lockMode);
+/*
+ * DecideTransactionPropertiesForTaskList decides whether to use remote transaction
+ * blocks, whether to use 2PC for the given task list, and whether to error on any
+ * failure.
+ *
+ * Since these decisions have specific dependencies on each other (e.g. 2PC implies
+ * errorOnAnyFailure, but not the other way around) we keep them in the same place.
+ */
+static TransactionProperties
+DecideTransactionPropertiesForTaskList(RowModifyLevel modLevel, List *taskList, bool
+									   exludeFromTransaction)
+{
+	TransactionProperties xactProperties;
 
-	/* Acquire distribution execution locks on the affected shards */
-	SerializeNonCommutativeWrites(anchorShardIntervalList, lockMode);
+	/* ensure uninitialized padding doesn't escape the function */
+	memset_struct_0(xactProperties);
+	xactProperties.errorOnAnyFailure = false;
+	xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_ALLOWED;
+	xactProperties.requires2PC = false;
 
-	if (relationRowLockList != NIL)
+	if (taskList == NIL)
 	{
-		/* Acquire additional locks for SELECT .. FOR UPDATE on reference tables */
-		AcquireExecutorShardLocksForRelationRowLockList(relationRowLockList);
+		/* nothing to do, return defaults */
+		return xactProperties;
 	}
 
+	if (exludeFromTransaction)
+	{
+		xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_DISALLOWED;
+		return xactProperties;
+	}
 
-	if (requiresConsistentSnapshotRelationShardList != NIL)
+	if (TaskListCannotBeExecutedInTransaction(taskList))
 	{
 		/*
-		 * If the task has a subselect, then we may need to lock the shards from which
-		 * the query selects as well to prevent the subselects from seeing different
-		 * results on different replicas.
-		 *
-		 * ExclusiveLock conflicts with all lock types used by modifications
-		 * and therefore prevents other modifications from running
-		 * concurrently.
+		 * We prefer to error on any failures for CREATE INDEX
+		 * CONCURRENTLY or VACUUM//VACUUM ANALYZE (e.g., COMMIT_PROTOCOL_BARE).
 		 */
-		LockRelationShardResources(requiresConsistentSnapshotRelationShardList,
-								   ExclusiveLock);
+		xactProperties.errorOnAnyFailure = true;
+		xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_DISALLOWED;
+		return xactProperties;
 	}
-}
 
-
-/*
- * ModifiedTableReplicated iterates on the task list and returns true
- * if any of the tasks' anchor shard is a replicated table. We qualify
- * replicated tables as any reference table or any distributed table with
- * replication factor > 1.
- */
-static bool
-ModifiedTableReplicated(List *taskList)
-{
-	Task *task = NULL;
-	foreach_ptr(task, taskList)
+	if (DistributedExecutionRequiresRollback(taskList))
 	{
-		int64 shardId = task->anchorShardId;
-
-		if (shardId == INVALID_SHARD_ID)
-		{
-			continue;
-		}
-
-		if (ReferenceTableShardId(shardId))
-		{
-			return true;
-		}
+		/* transaction blocks are required if the task list needs to roll back */
+		xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_REQUIRED;
 
-		Oid relationId = RelationIdForShard(shardId);
-		if (!SingleReplicatedTable(relationId))
+		if (TaskListRequires2PC(taskList))
 		{
-			return true;
+			/*
+			 * Although using two phase commit protocol is an independent decision than
+			 * failing on any error, we prefer to couple them. Our motivation is that
+			 * the failures are rare, and we prefer to avoid marking placements invalid
+			 * in case of failures.
+			 */
+			xactProperties.errorOnAnyFailure = true;
+			xactProperties.requires2PC = true;
 		}
 	}
+	else if (modLevel > ROW_MODIFY_READONLY && ReadFromCaughtUpSecondaries())
+	{
+		/*
+		 * Reads can only go to secondaries once we know the WAL position of our
+		 * writes, which we learn while committing remote transaction blocks.
+		 */
+		xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_REQUIRED;
+	}
+	else if (InCoordinatedTransaction())
+	{
+		/*
+		 * If we are already in a coordinated transaction then transaction blocks
+		 * are required even if they are not strictly required for the current
+		 * execution.
+		 */
+		xactProperties.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_REQUIRED;
+	}
 
-	return false;
+	return xactProperties;
 }
 
 
 /*
- * FinishDistributedExecution cleans up resources associated with a
- * distributed execution.
+ * StartDistributedExecution sets up the coordinated transaction and 2PC for
+ * the execution whenever necessary. It also keeps track of parallel relation
+ * accesses to enforce restrictions that arise due to foreign keys to reference
+ * tables.
  */
-static void
-FinishDistributedExecution(DistributedExecution *execution)
+void
+StartDistributedExecution(DistributedExecution *execution)
 {
-	if (DistributedExecutionModifiesDatabase(execution))
+	TransactionProperties *xactProperties = execution->transactionProperties;
+
+	if (xactProperties->useRemoteTransactionBlocks == TRANSACTION_BLOCKS_REQUIRED)
 	{
-		/* prevent copying shards in same transaction */
-		XactModificationLevel = XACT_MODIFICATION_DATA;
+		UseCoordinatedTransaction();
 	}
-}
 
+	if (xactProperties->requires2PC)
+	{
+		Use2PCForCoordinatedTransaction();
+	}
 
-/*
- * CleanUpSessions does any clean-up necessary for the session used
- * during the execution. We only reach the function after successfully
- * completing all the tasks and we expect no tasks are still in progress.
- */
-static void
-CleanUpSessions(DistributedExecution *execution)
-{
-	List *sessionList = execution->sessionList;
-
-	/* we get to this function only after successful executions */
-	Assert(!execution->failed && execution->unfinishedTaskCount == 0);
+	/*
+	 * Prevent unsafe concurrent modifications of replicated shards by taking
+	 * locks.
+	 *
+	 * When modifying a reference tables in MX mode, we take the lock via RPC
+	 * to the first worker in a transaction block, which activates a coordinated
+	 * transaction. We need to do this before determining whether the execution
+	 * should use transaction blocks (see below).
+	 */
+	AcquireExecutorShardLocksForExecution(execution);
 
-	/* always trigger wait event set in the first round */
-	WorkerSession *session = NULL;
-	foreach_ptr(session, sessionList)
+	/*
+	 * We should not record parallel access if the target pool size is less than 2.
+	 * The reason is that we define parallel access as at least two connections
+	 * accessing established to worker node.
+	 *
+	 * It is not ideal to have this check here, it'd have been better if we simply passed
+	 * DistributedExecution directly to the RecordParallelAccess*() function. However,
+	 * since we have two other executors that rely on the function, we had to only pass
+	 * the tasklist to have a common API.
+	 */
+	if (execution->targetPoolSize > 1)
 	{
-		MultiConnection *connection = session->connection;
-
-		ereport(DEBUG4, (errmsg("Total number of commands sent over the session %ld: %ld "
-								"to node %s:%d", session->sessionId,
-								session->commandsSent,
-								connection->hostname, connection->port)));
+		/*
+		 * Record the access for both the local and remote tasks. The main goal
+		 * is to make sure that Citus behaves consistently even if the local
+		 * shards are moved away.
+		 */
+		RecordParallelRelationAccessForTaskList(execution->remoteAndLocalTaskList);
+	}
 
-		UnclaimConnection(connection);
+	/* make sure we are not doing remote execution from within a task */
+	if (execution->remoteTaskList != NIL)
+	{
+		bool isRemote = true;
+		EnsureTaskExecutionAllowed(isRemote);
+	}
+}
 
-		if (connection->connectionState == MULTI_CONNECTION_CONNECTING ||
-			connection->connectionState == MULTI_CONNECTION_FAILED ||
-			connection->connectionState == MULTI_CONNECTION_LOST ||
-			connection->connectionState == MULTI_CONNECTION_TIMED_OUT)
-		{
-			/*
-			 * We want the MultiConnection go away and not used in
-			 * the subsequent executions.
-			 *
-			 * We cannot get MULTI_CONNECTION_LOST via the ConnectionStateMachine,
-			 * but we might get it via the connection API and find us here before
-			 * changing any states in the ConnectionStateMachine.
-			 *
-			 */
-			CloseConnection(connection);
-		}
-		else if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
-		{
-			RemoteTransaction *transaction = &(connection->remoteTransaction);
-			RemoteTransactionState transactionState = transaction->transactionState;
 
-			if (transactionState == REMOTE_TRANS_CLEARING_RESULTS)
-			{
-				/*
-				 * We might have established the connection, and even sent BEGIN, but not
-				 * get to the point where we assigned a task to this specific connection
-				 * (because other connections in the pool already finished all the tasks).
-				 */
-				Assert(session->commandsSent == 0);
+/*
+ *  DistributedExecutionModifiesDatabase returns true if the execution modifies the data
+ *  or the schema.
+ */
+static bool
+DistributedExecutionModifiesDatabase(DistributedExecution *execution)
+{
+	return TaskListModifiesDatabase(execution->modLevel,
+									execution->remoteAndLocalTaskList);
+}
 
-				ClearResults(connection, false);
-			}
-			else if (!(transactionState == REMOTE_TRANS_NOT_STARTED ||
-					   transactionState == REMOTE_TRANS_STARTED))
-			{
-				/*
-				 * We don't have to handle anything else. Note that the execution
-				 * could only finish on connectionStates of MULTI_CONNECTION_CONNECTING,
-				 * MULTI_CONNECTION_FAILED and MULTI_CONNECTION_CONNECTED. The first two
-				 * are already handled above.
-				 *
-				 * When we're on MULTI_CONNECTION_CONNECTED, TransactionStateMachine
-				 * ensures that all the necessary commands are successfully sent over
-				 * the connection and everything is cleared up. Otherwise, we'd have been
-				 * on MULTI_CONNECTION_FAILED state.
-				 */
-				ereport(WARNING, (errmsg("unexpected transaction state at the end of "
-										 "execution: %d", transactionState)));
-			}
 
-			/* get ready for the next executions if we need use the same connection */
-			connection->waitFlags = WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE;
-		}
-		else
-		{
-			ereport(WARNING, (errmsg("unexpected connection state at the end of "
-									 "execution: %d", connection->connectionState)));
-		}
-	}
+/*
+ *  DistributedPlanModifiesDatabase returns true if the plan modifies the data
+ *  or the schema.
+ */
+bool
+DistributedPlanModifiesDatabase(DistributedPlan *plan)
+{
+	return TaskListModifiesDatabase(plan->modLevel, plan->workerJob->taskList);
 }
 
 
 /*
- * UnclaimAllSessionConnections unclaims all of the connections for the given
- * sessionList.
+ *  TaskListModifiesDatabase is a helper function for DistributedExecutionModifiesDatabase and
+ *  DistributedPlanModifiesDatabase.
  */
-static void
-UnclaimAllSessionConnections(List *sessionList)
+static bool
+TaskListModifiesDatabase(RowModifyLevel modLevel, List *taskList)
 {
-	WorkerSession *session = NULL;
-	foreach_ptr(session, sessionList)
+	if (modLevel > ROW_MODIFY_READONLY)
 	{
-		MultiConnection *connection = session->connection;
+		return true;
+	}
 
-		UnclaimConnection(connection);
+	/*
+	 * If we cannot decide by only checking the row modify level,
+	 * we should look closer to the tasks.
+	 */
+	if (list_length(taskList) < 1)
+	{
+		/* is this ever possible? */
+		return false;
 	}
+
+	Task *firstTask = (Task *) linitial(taskList);
+
+	return !ReadOnlyTask(firstTask->taskType);
 }
 
 
 /*
- * AssignTasksToConnectionsOrWorkerPool goes through the list of tasks to determine whether any
- * task placements need to be assigned to particular connections because of preceding
- * operations in the transaction. It then adds those connections to the pool and adds
- * the task placement executions to the assigned task queue of the connection.
+ * DistributedExecutionRequiresRollback returns true if the distributed
+ * execution should start a CoordinatedTransaction. In other words, if the
+ * function returns true, the execution sends BEGIN; to every connection
+ * involved in the distributed execution.
  */
-static void
-AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution)
+static bool
+DistributedExecutionRequiresRollback(List *taskList)
 {
-	RowModifyLevel modLevel = execution->modLevel;
-	List *taskList = execution->remoteTaskList;
+	int taskCount = list_length(taskList);
 
-	Task *task = NULL;
-	foreach_ptr(task, taskList)
+	if (taskCount == 0)
 	{
-		bool placementExecutionReady = true;
-		int placementExecutionIndex = 0;
-		int placementExecutionCount = list_length(task->taskPlacementList);
+		return false;
+	}
 
-		/*
-		 * Execution of a command on a shard, which may have multiple replicas.
-		 */
-		ShardCommandExecution *shardCommandExecution =
-			(ShardCommandExecution *) palloc0(sizeof(ShardCommandExecution));
-		shardCommandExecution->task = task;
-		shardCommandExecution->executionOrder = ExecutionOrderForTask(modLevel, task);
-		shardCommandExecution->executionState = TASK_EXECUTION_NOT_FINISHED;
-		shardCommandExecution->localExecutionSupported =
-			execution->localExecutionSupported;
-		shardCommandExecution->placementExecutions =
-			(TaskPlacementExecution **) palloc0(placementExecutionCount *
-												sizeof(TaskPlacementExecution *));
-		shardCommandExecution->placementExecutionCount = placementExecutionCount;
-
-		SetAttributeInputMetadata(execution, shardCommandExecution);
-		ShardPlacement *taskPlacement = NULL;
-		foreach_ptr(taskPlacement, task->taskPlacementList)
-		{
-			int connectionFlags = 0;
-			char *nodeName = NULL;
-			int nodePort = 0;
-			LookupTaskPlacementHostAndPort(taskPlacement, &nodeName, &nodePort);
-
-			WorkerPool *workerPool = FindOrCreateWorkerPool(execution, nodeName,
-															nodePort);
-
-			/*
-			 * Execution of a command on a shard placement, which may not always
-			 * happen if the query is read-only and the shard has multiple placements.
-			 */
-			TaskPlacementExecution *placementExecution =
-				(TaskPlacementExecution *) palloc0(sizeof(TaskPlacementExecution));
-			placementExecution->shardCommandExecution = shardCommandExecution;
-			placementExecution->shardPlacement = taskPlacement;
-			placementExecution->workerPool = workerPool;
-			placementExecution->placementExecutionIndex = placementExecutionIndex;
-			placementExecution->queryIndex = 0;
-			INSTR_TIME_SET_ZERO(placementExecution->startTime);
-			INSTR_TIME_SET_ZERO(placementExecution->endTime);
-
-			if (placementExecutionReady)
-			{
-				placementExecution->executionState = PLACEMENT_EXECUTION_READY;
-			}
-			else
-			{
-				placementExecution->executionState = PLACEMENT_EXECUTION_NOT_READY;
-			}
-
-			shardCommandExecution->placementExecutions[placementExecutionIndex] =
-				placementExecution;
-
-			placementExecutionIndex++;
-
-			List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
-
-			MultiConnection *connection = NULL;
-			if (execution->transactionProperties->useRemoteTransactionBlocks !=
-				TRANSACTION_BLOCKS_DISALLOWED)
-			{
-				/*
-				 * Determine whether the task has to be assigned to a particular connection
-				 * due to a preceding access to the placement in the same transaction.
-				 */
-				connection = GetConnectionIfPlacementAccessedInXact(
-					connectionFlags,
-					placementAccessList,
-					NULL);
-			}
-
-			if (connection != NULL)
-			{
-				/*
-				 * Note: We may get the same connection for multiple task placements.
-				 * FindOrCreateWorkerSession ensures that we only have one session per
-				 * connection.
-				 */
-				WorkerSession *session =
-					FindOrCreateWorkerSession(workerPool, connection);
-
-				ereport(DEBUG4, (errmsg("Session %ld (%s:%d) has an assigned task",
-										session->sessionId, connection->hostname,
-										connection->port)));
-
-				placementExecution->assignedSession = session;
-
-				/* if executed, this task placement must use this session */
-				if (placementExecutionReady)
-				{
-					dlist_push_tail(&session->readyTaskQueue,
-									&placementExecution->sessionReadyQueueNode);
-				}
-				else
-				{
-					dlist_push_tail(&session->pendingTaskQueue,
-									&placementExecution->sessionPendingQueueNode);
-				}
-
-				/* always poll the connection in the first round */
-				UpdateConnectionWaitFlags(session,
-										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
-
-				/* If the connections are already avaliable, make sure to activate
-				 * 2PC when necessary.
-				 */
-				Activate2PCIfModifyingTransactionExpandsToNewNode(session);
-			}
-			else
-			{
-				placementExecution->assignedSession = NULL;
-
-				if (placementExecutionReady)
-				{
-					/* task is ready to execute on any session */
-					dlist_push_tail(&workerPool->readyTaskQueue,
-									&placementExecution->workerReadyQueueNode);
-
-					workerPool->readyTaskCount++;
-				}
-				else
-				{
-					/* task can be executed on any session, but is not yet ready */
-					dlist_push_tail(&workerPool->pendingTaskQueue,
-									&placementExecution->workerPendingQueueNode);
-				}
-			}
-
-			if (shardCommandExecution->executionOrder != EXECUTION_ORDER_PARALLEL)
-			{
-				/*
-				 * Except for commands that can be executed across all placements
-				 * in parallel, only the first placement execution is immediately
-				 * ready. Set placementExecutionReady to false for the remaining
-				 * placements.
-				 */
-				placementExecutionReady = false;
-			}
-		}
+	Task *task = (Task *) linitial(taskList);
+	if (task->cannotBeExecutedInTransction)
+	{
+		/* vacuum, create index concurrently etc. */
+		return false;
 	}
 
-	/*
-	 * We sort the workerList because adaptive connection management
-	 * (e.g., OPTIONAL_CONNECTION) requires any concurrent executions
-	 * to wait for the connections in the same order to prevent any
-	 * starvation. If we don't sort, we might end up with:
-	 *      Execution 1: Get connection for worker 1, wait for worker 2
-	 *      Execution 2: Get connection for worker 2, wait for worker 1
-	 *
-	 *  and, none could proceed. Instead, we enforce every execution establish
-	 *  the required connections to workers in the same order.
-	 */
-	execution->workerList = SortList(execution->workerList, WorkerPoolCompare);
+	bool selectForUpdate = task->relationRowLockList != NIL;
+	if (selectForUpdate)
+	{
+		/*
+		 * Do not check SelectOpensTransactionBlock, always open transaction block
+		 * if SELECT FOR UPDATE is executed inside a distributed transaction.
+		 */
+		return IsMultiStatementTransaction();
+	}
 
-	/*
-	 * The executor claims connections exclusively to make sure that calls to
-	 * StartNodeUserDatabaseConnection do not return the same connections.
-	 *
-	 * We need to do this after assigning tasks to connections because the same
-	 * connection may be be returned multiple times by GetPlacementListConnectionIfCached.
-	 */
-	WorkerSession *session = NULL;
-	foreach_ptr(session, execution->sessionList)
+	if (ReadOnlyTask(task->taskType))
 	{
-		MultiConnection *connection = session->connection;
+		return SelectOpensTransactionBlock &&
+			   IsTransactionBlock();
+	}
 
-		ClaimConnectionExclusively(connection);
+	if (IsMultiStatementTransaction())
+	{
+		return true;
 	}
-}
 
+	if (list_length(taskList) > 1)
+	{
+		return true;
+	}
 
-/*
- * LookupTaskPlacementHostAndPort sets the nodename and nodeport for the given task placement
- * with a lookup.
- */
-static void
-LookupTaskPlacementHostAndPort(ShardPlacement *taskPlacement, char **nodeName,
-							   int *nodePort)
-{
-	if (IsDummyPlacement(taskPlacement))
+	if (list_length(task->taskPlacementList) > 1)
 	{
 		/*
-		 * If we create a dummy placement for the local node, it is possible
-		 * that the entry doesn't exist in pg_dist_node, hence a lookup will fail.
-		 * In that case we want to use the dummy placements values.
+		 * Single DML/DDL tasks with replicated tables (including
+		 * reference and non-reference tables) should require
+		 * BEGIN/COMMIT/ROLLBACK.
 		 */
-		*nodeName = taskPlacement->nodeName;
-		*nodePort = taskPlacement->nodePort;
+		return true;
 	}
-	else
+
+	if (task->queryCount > 1)
 	{
 		/*
-		 * We want to lookup the node information again since it is possible that
-		 * there were changes in pg_dist_node and we will get those invalidations
-		 * in LookupNodeForGroup.
+		 * When there are multiple sequential queries in a task
+		 * we need to run those as a transaction.
 		 */
-		WorkerNode *workerNode = LookupNodeForGroup(taskPlacement->groupId);
-		*nodeName = workerNode->workerName;
-		*nodePort = workerNode->workerPort;
+		return true;
 	}
+
+	return false;
 }
 
 
 /*
- * IsDummyPlacement returns true if the given placement is a dummy placement.
+ * TaskListRequires2PC determines whether the given task list requires 2PC.
  */
 static bool
-IsDummyPlacement(ShardPlacement *taskPlacement)
+TaskListRequires2PC(List *taskList)
 {
-	return taskPlacement->nodeId == LOCAL_NODE_ID;
-}
+	if (taskList == NIL)
+	{
+		return false;
+	}
 
+	Task *task = (Task *) linitial(taskList);
+	if (ReadOnlyTask(task->taskType))
+	{
+		/* we do not trigger 2PC for ReadOnly queries */
+		return false;
+	}
 
-/*
- * WorkerPoolCompare is based on WorkerNodeCompare function. The function
- * compares two worker nodes by their host name and port number.
- */
-static int
-WorkerPoolCompare(const void *lhsKey, const void *rhsKey)
-{
-	const WorkerPool *workerLhs = *(const WorkerPool **) lhsKey;
-	const WorkerPool *workerRhs = *(const WorkerPool **) rhsKey;
+	bool singleTask = list_length(taskList) == 1;
+	if (singleTask && list_length(task->taskPlacementList) == 1)
+	{
+		/* we do not trigger 2PC for modifications that are:
+		 *    - single task
+		 *    - single placement
+		 */
+		return false;
+	}
 
-	return NodeNamePortCompare(workerLhs->nodeName, workerRhs->nodeName,
-							   workerLhs->nodePort, workerRhs->nodePort);
+	/*
+	 * Otherwise, all modifications are done via 2PC. This includes:
+	 *    - Multi-shard commands irrespective of the replication factor
+	 *    - Single-shard commands that are targeting more than one replica
+	 */
+	return true;
 }
 
 
 /*
- * SetAttributeInputMetadata sets attributeInputMetadata in
- * shardCommandExecution for all the queries that are part of its task.
- * This contains the deserialization functions for the tuples that will be
- * received. It also sets binaryResults when applicable.
- */
-static void
-SetAttributeInputMetadata(DistributedExecution *execution,
-						  ShardCommandExecution *shardCommandExecution)
-{
-	TupleDestination *tupleDest = shardCommandExecution->task->tupleDest ?
-								  shardCommandExecution->task->tupleDest :
-								  execution->defaultTupleDest;
-	uint32 queryCount = shardCommandExecution->task->queryCount;
-	shardCommandExecution->attributeInputMetadata = palloc0(queryCount *
-															sizeof(AttInMetadata *));
-
-	for (uint32 queryIndex = 0; queryIndex < queryCount; queryIndex++)
-	{
-		AttInMetadata *attInMetadata = NULL;
-		TupleDesc tupleDescriptor = tupleDest->tupleDescForQuery(tupleDest,
-																 queryIndex);
-		if (tupleDescriptor == NULL)
-		{
-			attInMetadata = NULL;
-		}
-		else if (EnableBinaryProtocol && CanUseBinaryCopyFormat(tupleDescriptor))
-		{
-			attInMetadata = TupleDescGetAttBinaryInMetadata(tupleDescriptor);
-			shardCommandExecution->binaryResults = true;
-		}
-		else
-		{
-			attInMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
-		}
-
-		shardCommandExecution->attributeInputMetadata[queryIndex] = attInMetadata;
-	}
-}
-
-
-/*
- * ExecutionOrderForTask gives the appropriate execution order for a task.
+ * ReadOnlyTask returns true if the input task does a read-only operation
+ * on the database.
  */
-static PlacementExecutionOrder
-ExecutionOrderForTask(RowModifyLevel modLevel, Task *task)
+bool
+ReadOnlyTask(TaskType taskType)
 {
-	switch (task->taskType)
+	switch (taskType)
 	{
 		case READ_TASK:
-		{
-			return EXECUTION_ORDER_ANY;
-		}
-
-		case MODIFY_TASK:
-		{
-			/*
-			 * For non-commutative modifications we take aggressive locks, so
-			 * there is no risk of deadlock and we can run them in parallel.
-			 * When the modification is commutative, we take no additional
-			 * locks, so we take a conservative approach and execute sequentially
-			 * to avoid deadlocks.
-			 */
-			if (modLevel < ROW_MODIFY_NONCOMMUTATIVE)
-			{
-				return EXECUTION_ORDER_SEQUENTIAL;
-			}
-			else
-			{
-				return EXECUTION_ORDER_PARALLEL;
-			}
-		}
-
-		case DDL_TASK:
-		case VACUUM_ANALYZE_TASK:
+		case MAP_OUTPUT_FETCH_TASK:
 		case MAP_TASK:
 		case MERGE_TASK:
-		case MAP_OUTPUT_FETCH_TASK:
-		case MERGE_FETCH_TASK:
 		{
-			return EXECUTION_ORDER_PARALLEL;
+			return true;
 		}
 
 		default:
 		{
-			ereport(ERROR, (errmsg("unsupported task type %d in adaptive executor",
-								   task->taskType)));
+			return false;
 		}
 	}
 }
 
 
 /*
- * FindOrCreateWorkerPool gets the pool of connections for a particular worker.
+ * TaskListCannotBeExecutedInTransaction returns true if any of the
+ * tasks in the input cannot be executed in a transaction. These are
+ * tasks like VACUUM or CREATE INDEX CONCURRENTLY etc.
  */
-static WorkerPool *
-FindOrCreateWorkerPool(DistributedExecution *execution, char *nodeName, int nodePort)
+bool
+TaskListCannotBeExecutedInTransaction(List *taskList)
 {
-	WorkerPool *workerPool = NULL;
-	foreach_ptr(workerPool, execution->workerList)
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
 	{
-		if (strncmp(nodeName, workerPool->nodeName, WORKER_LENGTH) == 0 &&
-			nodePort == workerPool->nodePort)
+		if (task->cannotBeExecutedInTransction)
 		{
-			return workerPool;
+			return true;
 		}
 	}
 
-	workerPool = (WorkerPool *) palloc0(sizeof(WorkerPool));
-	workerPool->nodeName = pstrdup(nodeName);
-	workerPool->nodePort = nodePort;
-
-	WorkerNode *workerNode = FindWorkerNode(nodeName, nodePort);
-	if (workerNode)
-	{
-		workerPool->poolToLocalNode =
-			workerNode->groupId == GetLocalGroupId();
-	}
-
-	/* "open" connections aggressively when there are cached connections */
-	int nodeConnectionCount = MaxCachedConnectionsPerWorker;
-	workerPool->maxNewConnectionsPerCycle = Max(1, nodeConnectionCount);
-
-	dlist_init(&workerPool->pendingTaskQueue);
-	dlist_init(&workerPool->readyTaskQueue);
-
-	workerPool->distributedExecution = execution;
-
-	execution->workerList = lappend(execution->workerList, workerPool);
-
-	return workerPool;
+	return false;
 }
 
 
 /*
- * FindOrCreateWorkerSession returns a session with the given connection,
- * either existing or new. New sessions are added to the worker pool and
- * the distributed execution.
+ * SelectForUpdateOnReferenceTable returns true if the input task
+ * contains a FOR UPDATE clause that locks any reference tables.
  */
-static WorkerSession *
-FindOrCreateWorkerSession(WorkerPool *workerPool, MultiConnection *connection)
+static bool
+SelectForUpdateOnReferenceTable(List *taskList)
 {
-	DistributedExecution *execution = workerPool->distributedExecution;
-	static uint64 sessionId = 1;
+	if (list_length(taskList) != 1)
+	{
+		/* we currently do not support SELECT FOR UPDATE on multi task queries */
+		return false;
+	}
 
-	WorkerSession *session = NULL;
-	foreach_ptr(session, workerPool->sessionList)
+	Task *task = (Task *) linitial(taskList);
+	RelationRowLock *relationRowLock = NULL;
+	foreach_ptr(relationRowLock, task->relationRowLockList)
 	{
-		if (session->connection == connection)
+		Oid relationId = relationRowLock->relationId;
+
+		if (IsCitusTableType(relationId, REFERENCE_TABLE))
 		{
-			return session;
+			return true;
 		}
 	}
 
+	return false;
+}
 
-	session = (WorkerSession *) palloc0(sizeof(WorkerSession));
-	session->sessionId = sessionId++;
-	session->connection = connection;
-	session->workerPool = workerPool;
-	session->commandsSent = 0;
-	session->waitEventSetIndex = WAIT_EVENT_SET_INDEX_NOT_INITIALIZED;
-
-	dlist_init(&session->pendingTaskQueue);
-	dlist_init(&session->readyTaskQueue);
-
-	/*
-	 * Before using this connection in the distributed execution, we check
-	 * whether the remote connection is closed/lost. This is common
-	 * when we have a cached connection and remote server restarted
-	 * (due to failover or restart etc.). We do this because we can
-	 * retry connection a single time.
-	 */
-	if (RemoteSocketClosedForNewSession(session))
-	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
-	}
 
-	if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
+/*
+ * LockPartitionsForDistributedPlan ensures commands take locks on all partitions
+ * of a distributed table that appears in the query. We do this primarily out of
+ * consistency with PostgreSQL locking.
+ */
+static void
+LockPartitionsForDistributedPlan(DistributedPlan *distributedPlan)
+{
+	if (DistributedPlanModifiesDatabase(distributedPlan))
 	{
-		/* keep track of how many connections are ready */
-		workerPool->activeConnectionCount++;
-		workerPool->idleConnectionCount++;
+		Oid targetRelationId = distributedPlan->targetRelationId;
 
-		session->sessionHasActiveConnection = true;
+		LockPartitionsInRelationList(list_make1_oid(targetRelationId), RowExclusiveLock);
 	}
 
-	workerPool->unusedConnectionCount++;
-
 	/*
-	 * Record the first connection establishment time to the pool. We need this
-	 * to enforce NodeConnectionTimeout.
+	 * Lock partitions of tables that appear in a SELECT or subquery. In the
+	 * DML case this also includes the target relation, but since we already
+	 * have a stronger lock this doesn't do any harm.
 	 */
-	if (list_length(workerPool->sessionList) == 0)
-	{
-		INSTR_TIME_SET_CURRENT(workerPool->poolStartTime);
-		workerPool->checkForPoolTimeout = true;
-	}
-
-	workerPool->sessionList = lappend(workerPool->sessionList, session);
-	execution->sessionList = lappend(execution->sessionList, session);
-
-	return session;
+	LockPartitionsInRelationList(distributedPlan->relationIdList, AccessShareLock);
 }
 
 
 /*
- * RemoteSocketClosedForNewSession is a helper function for detecting whether
- * the remote socket corresponding to the input session is closed. This is
- * mostly common there is a cached connection and remote server restarted
- * (due to failover or restart etc.).
+ * AcquireExecutorShardLocksForExecution acquires advisory lock on shard IDs
+ * to prevent unsafe concurrent modifications of shards.
  *
- * The function is not a generic function that can be called at the start of
- * the execution. The function is not generic because it does not check all
- * the events, even ignores cancellation events. Future callers of this
- * function should consider its limitations.
+ * We prevent concurrent modifications of shards in two cases:
+ * 1. Any non-commutative writes to a replicated table
+ * 2. Multi-shard writes that are executed in parallel
+ *
+ * The first case ensures we do not apply updates in different orders on
+ * different replicas (e.g. of a reference table), which could lead the
+ * replicas to diverge.
+ *
+ * The second case prevents deadlocks due to out-of-order execution.
+ *
+ * There are two GUCs that can override the default behaviors.
+ *  'citus.all_modifications_commutative' relaxes locking
+ *  that's done for the purpose of keeping replicas consistent.
+ *  'citus.enable_deadlock_prevention' relaxes locking done for
+ *  the purpose of avoiding deadlocks between concurrent
+ *  multi-shard commands.
+ *
+ * We do not take executor shard locks for utility commands such as
+ * TRUNCATE because the table locks already prevent concurrent access.
  */
-static bool
-RemoteSocketClosedForNewSession(WorkerSession *session)
+static void
+AcquireExecutorShardLocksForExecution(DistributedExecution *execution)
 {
-	bool socketClosed = false;
+	RowModifyLevel modLevel = execution->modLevel;
 
-#if PG_VERSION_NUM >= PG_VERSION_15
+	/* acquire the locks for both the remote and local tasks */
+	List *taskList = execution->remoteAndLocalTaskList;
 
-	if (!WaitEventSetCanReportClosed())
+	if (modLevel <= ROW_MODIFY_READONLY &&
+		!SelectForUpdateOnReferenceTable(taskList))
 	{
-		/* we cannot detect for this OS */
-		return socketClosed;
+		/*
+		 * Executor locks only apply to DML commands and SELECT FOR UPDATE queries
+		 * touching reference tables.
+		 */
+		return;
 	}
 
-	MultiConnection *connection = session->connection;
-	long timeout = 0;/* don't wait */
-	int eventSetSize = 2;
-	WaitEvent *events = palloc0(eventSetSize * sizeof(WaitEvent));
+	bool requiresParallelExecutionLocks =
+		!(list_length(taskList) == 1 || ShouldRunTasksSequentially(taskList));
+
+	bool modifiedTableReplicated = ModifiedTableReplicated(taskList);
+	if (!modifiedTableReplicated && !requiresParallelExecutionLocks)
+	{
+		/*
+		 * When a distributed query on tables with replication
+		 * factor == 1 and command hits only a single shard, we
+		 * rely on Postgres to handle the serialization of the
+		 * concurrent modifications on the workers.
+		 *
+		 * For reference tables, even if their placements are replicated
+		 * ones (e.g., single node), we acquire the distributed execution
+		 * locks to be consistent when new node(s) are added. So, they
+		 * do not return at this point.
+		 */
+		return;
+	}
 
 	/*
-	 * Only wait for WL_SOCKET_CLOSED and postmaster death, do not even check
-	 * for cancellations. Everything else are going to be checked soon in the
-	 * main event processing. At this point, our only goal is to understand
-	 * whether the remote socket is closed or not.
+	 * We first assume that all the remaining modifications are going to
+	 * be serialized. So, start with an ExclusiveLock and lower the lock level
+	 * as much as possible.
 	 */
-	int originalWaitFlags = connection->waitFlags;
-	connection->waitFlags = WL_SOCKET_CLOSED;
-	WaitEventSet *waitEventSet =
-		CreateWaitEventSet(CurrentMemoryContext, eventSetSize);
+	int lockMode = ExclusiveLock;
 
-	AddSessionToWaitEventSet(session, waitEventSet);
+	/*
+	 * In addition to honouring commutativity rules, we currently only
+	 * allow a single multi-shard command on a shard at a time. Otherwise,
+	 * concurrent multi-shard commands may take row-level locks on the
+	 * shard placements in a different order and create a distributed
+	 * deadlock. This applies even when writes are commutative and/or
+	 * there is no replication. This can be relaxed via
+	 * EnableDeadlockPrevention.
+	 *
+	 * 1. If citus.all_modifications_commutative is set to true, then all locks
+	 * are acquired as RowExclusiveLock.
+	 *
+	 * 2. If citus.all_modifications_commutative is false, then only the shards
+	 * with more than one replicas are locked with ExclusiveLock. Otherwise, the
+	 * lock is acquired with ShareUpdateExclusiveLock.
+	 *
+	 * ShareUpdateExclusiveLock conflicts with itself such that only one
+	 * multi-shard modification at a time is allowed on a shard. It also conflicts
+	 * with ExclusiveLock, which ensures that updates/deletes/upserts are applied
+	 * in the same order on all placements. It does not conflict with
+	 * RowExclusiveLock, which is normally obtained by single-shard, commutative
+	 * writes.
+	 */
+	if (!modifiedTableReplicated && requiresParallelExecutionLocks)
+	{
+		/*
+		 * When there is no replication then we only need to prevent
+		 * concurrent multi-shard commands on the same shards. This is
+		 * because concurrent, parallel commands may modify the same
+		 * set of shards, but in different orders. The order of the
+		 * accesses might trigger distributed deadlocks that are not
+		 * possible to happen on non-distributed systems such
+		 * regular Postgres.
+		 *
+		 * As an example, assume that we have two queries: query-1 and query-2.
+		 * Both queries access shard-1 and shard-2. If query-1 first accesses to
+		 * shard-1 then shard-2, and query-2 accesses shard-2 then shard-1, these
+		 * two commands might block each other in case they modify the same rows
+		 * (e.g., cause distributed deadlocks).
+		 *
+		 * In either case, ShareUpdateExclusive has the desired effect, since
+		 * it conflicts with itself and ExclusiveLock (taken by non-commutative
+		 * writes).
+		 *
+		 * However, some users find this too restrictive, so we allow them to
+		 * reduce to a RowExclusiveLock when citus.enable_deadlock_prevention
+		 * is enabled, which lets multi-shard modifications run in parallel as
+		 * long as they all disable the GUC.
+		 */
+		lockMode =
+			EnableDeadlockPrevention ? ShareUpdateExclusiveLock : RowExclusiveLock;
 
-	/* always good to wait for postmaster death */
-	CitusAddWaitEventSetToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL,
-							  NULL);
+		if (!IsCoordinator())
+		{
+			/*
+			 * We also skip taking a heavy-weight lock when running a multi-shard
+			 * commands from workers, since we currently do not prevent concurrency
+			 * across workers anyway.
+			 */
+			lockMode = RowExclusiveLock;
+		}
+	}
+	else if (modifiedTableReplicated)
+	{
+		/*
+		 * When we are executing distributed queries on replicated tables, our
+		 * default behaviour is to prevent any concurrency. This is valid
+		 * for when parallel execution is happening or not.
+		 *
+		 * The reason is that we cannot control the order of the placement accesses
+		 * of two distributed queries to the same shards. The order of the accesses
+		 * might cause the replicas of the same shard placements diverge. This is
+		 * not possible to happen on non-distributed systems such regular Postgres.
+		 *
+		 * As an example, assume that we have two queries: query-1 and query-2.
+		 * Both queries only access the placements of shard-1, say p-1 and p-2.
+		 *
+		 * And, assume that these queries are non-commutative, such as:
+		 *  query-1: UPDATE table SET b = 1 WHERE key = 1;
+		 *  query-2: UPDATE table SET b = 2 WHERE key = 1;
+		 *
+		 * If query-1 accesses to p-1 then p-2, and query-2 accesses
+		 * p-2 then p-1, these two commands would leave the p-1 and p-2
+		 * diverged (e.g., the values for the column "b" would be different).
+		 *
+		 * The only exception to this rule is the single shard commutative
+		 * modifications, such as INSERTs. In that case, we can allow
+		 * concurrency among such backends, hence lowering the lock level
+		 * to RowExclusiveLock.
+		 */
+		if (!requiresParallelExecutionLocks && modLevel < ROW_MODIFY_NONCOMMUTATIVE)
+		{
+			lockMode = RowExclusiveLock;
+		}
+	}
 
-	int eventCount = WaitEventSetWait(waitEventSet, timeout, events,
-									  eventSetSize, WAIT_EVENT_CLIENT_READ);
-	socketClosed =
-		ProcessWaitEventsForSocketClosed(events, eventCount);
+	if (AllModificationsCommutative)
+	{
+		/*
+		 * The mapping is overridden when all_modifications_commutative is set to true.
+		 * In that case, all modifications are treated as commutative, which can be used
+		 * to communicate that the application is only generating commutative
+		 * UPDATE/DELETE/UPSERT commands and exclusive locks are unnecessary. This
+		 * is irrespective of single-shard/multi-shard or replicated tables.
+		 */
+		lockMode = RowExclusiveLock;
+	}
 
-	/* we can at most receive a single event, which is WL_SOCKET_CLOSED */
-	Assert(eventCount <= 1);
+	/* now, iterate on the tasks and acquire the executor locks on the shards */
+	List *anchorShardIntervalList = NIL;
+	List *relationRowLockList = NIL;
+	List *requiresConsistentSnapshotRelationShardList = NIL;
 
-	FreeWaitEventSet(waitEventSet);
-	pfree(events);
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		ShardInterval *anchorShardInterval = LoadShardInterval(task->anchorShardId);
+		anchorShardIntervalList = lappend(anchorShardIntervalList, anchorShardInterval);
+
+		/* Acquire additional locks for SELECT .. FOR UPDATE on reference tables */
+		AcquireExecutorShardLocksForRelationRowLockList(task->relationRowLockList);
+
+		relationRowLockList =
+			list_concat(relationRowLockList,
+						task->relationRowLockList);
+
+		/*
+		 * If the task has a subselect, then we may need to lock the shards from which
+		 * the query selects as well to prevent the subselects from seeing different
+		 * results on different replicas.
+		 */
+		if (RequiresConsistentSnapshot(task))
+		{
+			/*
+			 * ExclusiveLock conflicts with all lock types used by modifications
+			 * and therefore prevents other modifications from running
+			 * concurrently.
+			 */
+			requiresConsistentSnapshotRelationShardList =
+				list_concat(requiresConsistentSnapshotRelationShardList,
+							task->relationShardList);
+		}
+	}
 
 	/*
-	 * We only searched for WL_SOCKET_CLOSED, and we processed the
-	 * event already. Now, set back to the original flags.
+	 * Acquire the locks in a sorted way to avoid deadlocks due to lock
+	 * ordering across concurrent sessions.
 	 */
-	UpdateConnectionWaitFlags(session, originalWaitFlags);
-	session->latestUnconsumedWaitEvents = 0;
+	anchorShardIntervalList =
+		SortList(anchorShardIntervalList, CompareShardIntervalsById);
 
-#endif
+	/*
+	 * If we are dealing with a partition we are also taking locks on parent table
+	 * to prevent deadlocks on concurrent operations on a partition and its parent.
+	 *
+	 * Note that this function currently does not acquire any remote locks as that
+	 * is necessary to control the concurrency across multiple nodes for replicated
+	 * tables. That is because Citus currently does not allow modifications to
+	 * partitions from any node other than the coordinator.
+	 */
+	LockParentShardResourceIfPartition(anchorShardIntervalList, lockMode);
 
-	return socketClosed;
+	/* Acquire distribution execution locks on the affected shards */
+	SerializeNonCommutativeWrites(anchorShardIntervalList, lockMode);
+
+	if (relationRowLockList != NIL)
+	{
+		/* Acquire additional locks for SELECT .. FOR UPDATE on reference tables */
+		AcquireExecutorShardLocksForRelationRowLockList(relationRowLockList);
+	}
+
+
+	if (requiresConsistentSnapshotRelationShardList != NIL)
+	{
+		/*
+		 * If the task has a subselect, then we may need to lock the shards from which
+		 * the query selects as well to prevent the subselects from seeing different
+		 * results on different replicas.
+		 *
+		 * ExclusiveLock conflicts with all lock types used by modifications
+		 * and therefore prevents other modifications from running
+		 * concurrently.
+		 */
+		LockRelationShardResources(requiresConsistentSnapshotRelationShardList,
+								   ExclusiveLock);
+	}
+}
+
+
+/*
+ * ModifiedTableReplicated iterates on the task list and returns true
+ * if any of the tasks' anchor shard is a replicated table. We qualify
+ * replicated tables as any reference table or any distributed table with
+ * replication factor > 1.
+ */
+static bool
+ModifiedTableReplicated(List *taskList)
+{
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		int64 shardId = task->anchorShardId;
+
+		if (shardId == INVALID_SHARD_ID)
+		{
+			continue;
+		}
+
+		if (ReferenceTableShardId(shardId))
+		{
+			return true;
+		}
+
+		Oid relationId = RelationIdForShard(shardId);
+		if (!SingleReplicatedTable(relationId))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * FinishDistributedExecution cleans up resources associated with a
+ * distributed execution.
+ */
+static void
+FinishDistributedExecution(DistributedExecution *execution)
+{
+	if (DistributedExecutionModifiesDatabase(execution))
+	{
+		/* prevent copying shards in same transaction */
+		XactModificationLevel = XACT_MODIFICATION_DATA;
+	}
+
+	if (execution->admittedSubId != InvalidSubTransactionId)
+	{
+		ReleaseExecutionAdmission(execution->admittedSubId);
+		execution->admittedSubId = InvalidSubTransactionId;
+	}
+}
+
+
+/*
+ * CleanUpSessions does any clean-up necessary for the session used
+ * during the execution. We only reach the function after successfully
+ * completing all the tasks and we expect no tasks are still in progress.
+ */
+static void
+CleanUpSessions(DistributedExecution *execution)
+{
+	List *sessionList = execution->sessionList;
+
+	/* we get to this function only after successful executions */
+	Assert(!execution->failed && execution->unfinishedTaskCount == 0);
+
+	/* always trigger wait event set in the first round */
+	WorkerSession *session = NULL;
+	foreach_ptr(session, sessionList)
+	{
+		MultiConnection *connection = session->connection;
+
+		ereport(DEBUG4, (errmsg("Total number of commands sent over the session %ld: %ld "
+								"to node %s:%d", session->sessionId,
+								session->commandsSent,
+								connection->hostname, connection->port)));
+
+		UnclaimConnection(connection);
+
+		if (session->currentTask != NULL)
+		{
+			/*
+			 * A cancelled task, such as the losing copy of a hedged read or a
+			 * task whose rows are beyond the LIMIT, did not finish yet. We do
+			 * not wait for its remaining results.
+			 */
+			CloseConnection(connection);
+		}
+		else if (connection->connectionState == MULTI_CONNECTION_CONNECTING ||
+				 connection->connectionState == MULTI_CONNECTION_FAILED ||
+				 connection->connectionState == MULTI_CONNECTION_LOST ||
+				 connection->connectionState == MULTI_CONNECTION_TIMED_OUT)
+		{
+			/*
+			 * We want the MultiConnection go away and not used in
+			 * the subsequent executions.
+			 *
+			 * We cannot get MULTI_CONNECTION_LOST via the ConnectionStateMachine,
+			 * but we might get it via the connection API and find us here before
+			 * changing any states in the ConnectionStateMachine.
+			 *
+			 */
+			CloseConnection(connection);
+		}
+		else if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
+		{
+			RemoteTransaction *transaction = &(connection->remoteTransaction);
+			RemoteTransactionState transactionState = transaction->transactionState;
+
+			if (transactionState == REMOTE_TRANS_CLEARING_RESULTS)
+			{
+				/*
+				 * We might have established the connection, and even sent BEGIN, but not
+				 * get to the point where we assigned a task to this specific connection
+				 * (because other connections in the pool already finished all the tasks).
+				 */
+				Assert(session->commandsSent == 0);
+
+				ClearResults(connection, false);
+			}
+			else if (!(transactionState == REMOTE_TRANS_NOT_STARTED ||
+					   transactionState == REMOTE_TRANS_STARTED))
+			{
+				/*
+				 * We don't have to handle anything else. Note that the execution
+				 * could only finish on connectionStates of MULTI_CONNECTION_CONNECTING,
+				 * MULTI_CONNECTION_FAILED and MULTI_CONNECTION_CONNECTED. The first two
+				 * are already handled above.
+				 *
+				 * When we're on MULTI_CONNECTION_CONNECTED, TransactionStateMachine
+				 * ensures that all the necessary commands are successfully sent over
+				 * the connection and everything is cleared up. Otherwise, we'd have been
+				 * on MULTI_CONNECTION_FAILED state.
+				 */
+				ereport(WARNING, (errmsg("unexpected transaction state at the end of "
+										 "execution: %d", transactionState)));
+			}
+
+			/* get ready for the next executions if we need use the same connection */
+			connection->waitFlags = WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE;
+		}
+		else
+		{
+			ereport(WARNING, (errmsg("unexpected connection state at the end of "
+									 "execution: %d", connection->connectionState)));
+		}
+	}
+}
+
+
+/*
+ * UnclaimAllSessionConnections unclaims all of the connections for the given
+ * sessionList.
+ */
+static void
+UnclaimAllSessionConnections(List *sessionList)
+{
+	WorkerSession *session = NULL;
+	foreach_ptr(session, sessionList)
+	{
+		MultiConnection *connection = session->connection;
+
+		UnclaimConnection(connection);
+	}
+}
+
+
+/*
+ * AssignTasksToConnectionsOrWorkerPool goes through the given tasks of the execution
+ * to determine whether any task placements need to be assigned to particular
+ * connections because of preceding operations in the transaction. It then adds those
+ * connections to the pool and adds the task placement executions to the assigned task
+ * queue of the connection.
+ */
+static void
+AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution, List *taskList)
+{
+	RowModifyLevel modLevel = execution->modLevel;
+	bool readFromSecondaries = ShouldReadFromCaughtUpSecondaries(execution);
+
+	/* sessions of earlier tasks of the execution are claimed already */
+	int claimedSessionCount = list_length(execution->sessionList);
+
+	int taskIndex = 0;
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		bool placementExecutionReady = true;
+		int placementExecutionIndex = 0;
+		int placementExecutionCount = list_length(task->taskPlacementList);
+
+		/*
+		 * Execution of a command on a shard, which may have multiple replicas.
+		 */
+		ShardCommandExecution *shardCommandExecution =
+			(ShardCommandExecution *) palloc0(sizeof(ShardCommandExecution));
+		shardCommandExecution->task = task;
+		shardCommandExecution->executionOrder = ExecutionOrderForTask(modLevel, task);
+		shardCommandExecution->executionState = TASK_EXECUTION_NOT_FINISHED;
+		shardCommandExecution->localExecutionSupported =
+			execution->localExecutionSupported;
+		shardCommandExecution->placementExecutions =
+			(TaskPlacementExecution **) palloc0(placementExecutionCount *
+												sizeof(TaskPlacementExecution *));
+		shardCommandExecution->placementExecutionCount = placementExecutionCount;
+
+		if (execution->taskProgressSteps != NULL)
+		{
+			shardCommandExecution->taskProgress =
+				execution->taskProgressSteps + taskIndex;
+		}
+
+		taskIndex++;
+
+		SetAttributeInputMetadata(execution, shardCommandExecution);
+		ShardPlacement *taskPlacement = NULL;
+		foreach_ptr(taskPlacement, task->taskPlacementList)
+		{
+			int connectionFlags = 0;
+			char *nodeName = NULL;
+			int nodePort = 0;
+			/* row locks can only be taken on the primary */
+			bool readFromSecondary = readFromSecondaries &&
+									 task->relationRowLockList == NIL;
+
+			LookupTaskPlacementHostAndPort(taskPlacement, readFromSecondary, &nodeName,
+										   &nodePort);
+
+			WorkerPool *workerPool = FindOrCreateWorkerPool(execution, nodeName,
+															nodePort);
+
+			/*
+			 * Execution of a command on a shard placement, which may not always
+			 * happen if the query is read-only and the shard has multiple placements.
+			 */
+			TaskPlacementExecution *placementExecution =
+				(TaskPlacementExecution *) palloc0(sizeof(TaskPlacementExecution));
+			placementExecution->shardCommandExecution = shardCommandExecution;
+			placementExecution->shardPlacement = taskPlacement;
+			placementExecution->workerPool = workerPool;
+			placementExecution->placementExecutionIndex = placementExecutionIndex;
+			placementExecution->queryIndex = 0;
+			INSTR_TIME_SET_ZERO(placementExecution->readyTime);
+			INSTR_TIME_SET_ZERO(placementExecution->startTime);
+			INSTR_TIME_SET_ZERO(placementExecution->querySentTime);
+			INSTR_TIME_SET_ZERO(placementExecution->firstResultTime);
+			INSTR_TIME_SET_ZERO(placementExecution->endTime);
+
+			if (placementExecutionReady)
+			{
+				placementExecution->executionState = PLACEMENT_EXECUTION_READY;
+				INSTR_TIME_SET_CURRENT(placementExecution->readyTime);
+			}
+			else
+			{
+				placementExecution->executionState = PLACEMENT_EXECUTION_NOT_READY;
+			}
+
+			shardCommandExecution->placementExecutions[placementExecutionIndex] =
+				placementExecution;
+
+			placementExecutionIndex++;
+
+			List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
+
+			MultiConnection *connection = NULL;
+			if (execution->transactionProperties->useRemoteTransactionBlocks !=
+				TRANSACTION_BLOCKS_DISALLOWED)
+			{
+				/*
+				 * Determine whether the task has to be assigned to a particular connection
+				 * due to a preceding access to the placement in the same transaction.
+				 */
+				connection = GetConnectionIfPlacementAccessedInXact(
+					connectionFlags,
+					placementAccessList,
+					NULL);
+			}
+
+			if (connection != NULL)
+			{
+				/*
+				 * Note: We may get the same connection for multiple task placements.
+				 * FindOrCreateWorkerSession ensures that we only have one session per
+				 * connection.
+				 */
+				WorkerSession *session =
+					FindOrCreateWorkerSession(workerPool, connection);
+
+				ereport(DEBUG4, (errmsg("Session %ld (%s:%d) has an assigned task",
+										session->sessionId, connection->hostname,
+										connection->port)));
+
+				placementExecution->assignedSession = session;
+
+				/* if executed, this task placement must use this session */
+				if (placementExecutionReady)
+				{
+					dlist_push_tail(&session->readyTaskQueue,
+									&placementExecution->sessionReadyQueueNode);
+				}
+				else
+				{
+					dlist_push_tail(&session->pendingTaskQueue,
+									&placementExecution->sessionPendingQueueNode);
+				}
+
+				/* always poll the connection in the first round */
+				UpdateConnectionWaitFlags(session,
+										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+
+				/* If the connections are already avaliable, make sure to activate
+				 * 2PC when necessary.
+				 */
+				Activate2PCIfModifyingTransactionExpandsToNewNode(session);
+			}
+			else
+			{
+				placementExecution->assignedSession = NULL;
+
+				if (placementExecutionReady)
+				{
+					/* task is ready to execute on any session */
+					dlist_push_tail(&workerPool->readyTaskQueue,
+									&placementExecution->workerReadyQueueNode);
+
+					workerPool->readyTaskCount++;
+				}
+				else
+				{
+					/* task can be executed on any session, but is not yet ready */
+					dlist_push_tail(&workerPool->pendingTaskQueue,
+									&placementExecution->workerPendingQueueNode);
+				}
+			}
+
+			if (shardCommandExecution->executionOrder != EXECUTION_ORDER_PARALLEL)
+			{
+				/*
+				 * Except for commands that can be executed across all placements
+				 * in parallel, only the first placement execution is immediately
+				 * ready. Set placementExecutionReady to false for the remaining
+				 * placements.
+				 */
+				placementExecutionReady = false;
+			}
+		}
+	}
+
+	/*
+	 * We sort the workerList because adaptive connection management
+	 * (e.g., OPTIONAL_CONNECTION) requires any concurrent executions
+	 * to wait for the connections in the same order to prevent any
+	 * starvation. If we don't sort, we might end up with:
+	 *      Execution 1: Get connection for worker 1, wait for worker 2
+	 *      Execution 2: Get connection for worker 2, wait for worker 1
+	 *
+	 *  and, none could proceed. Instead, we enforce every execution establish
+	 *  the required connections to workers in the same order.
+	 */
+	execution->workerList = SortList(execution->workerList, WorkerPoolCompare);
+
+	/*
+	 * The executor claims connections exclusively to make sure that calls to
+	 * StartNodeUserDatabaseConnection do not return the same connections.
+	 *
+	 * We need to do this after assigning tasks to connections because the same
+	 * connection may be be returned multiple times by GetPlacementListConnectionIfCached.
+	 */
+	for (int sessionIndex = claimedSessionCount;
+		 sessionIndex < list_length(execution->sessionList); sessionIndex++)
+	{
+		WorkerSession *session = list_nth(execution->sessionList, sessionIndex);
+		MultiConnection *connection = session->connection;
+
+		ClaimConnectionExclusively(connection);
+	}
+}
+
+
+/*
+ * AddTasksToDistributedExecution adds the given tasks to an execution that is
+ * already running, such that the wait loop executes them along with the tasks
+ * that are still unfinished.
+ */
+static void
+AddTasksToDistributedExecution(DistributedExecution *execution, List *taskList)
+{
+	if (taskList == NIL)
+	{
+		return;
+	}
+
+	/* the progress steps only cover the tasks that the execution started with */
+	Assert(execution->taskProgressSteps == NULL);
+
+	if (execution->targetPoolSize > 1)
+	{
+		RecordParallelRelationAccessForTaskList(taskList);
+	}
+
+	execution->remoteAndLocalTaskList =
+		list_concat(execution->remoteAndLocalTaskList, taskList);
+	execution->remoteTaskList = list_concat(execution->remoteTaskList, taskList);
+	execution->totalTaskCount += list_length(taskList);
+	execution->unfinishedTaskCount += list_length(taskList);
+
+	AssignTasksToConnectionsOrWorkerPool(execution, taskList);
+
+	/* wake up idle connections by checking whether they are writeable */
+	WorkerSession *session = NULL;
+	foreach_ptr(session, execution->sessionList)
+	{
+		MultiConnection *connection = session->connection;
+		RemoteTransaction *transaction = &(connection->remoteTransaction);
+		RemoteTransactionState transactionState = transaction->transactionState;
+
+		if (transactionState == REMOTE_TRANS_NOT_STARTED ||
+			transactionState == REMOTE_TRANS_STARTED)
+		{
+			UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+		}
+	}
+}
+
+
+/*
+ * LookupTaskPlacementHostAndPort sets the nodename and nodeport for the given task placement
+ * with a lookup. If readFromSecondary is true, we prefer a secondary of the placement's
+ * group that has replayed the writes of this session.
+ */
+static void
+LookupTaskPlacementHostAndPort(ShardPlacement *taskPlacement, bool readFromSecondary,
+							   char **nodeName, int *nodePort)
+{
+	if (IsDummyPlacement(taskPlacement))
+	{
+		/*
+		 * If we create a dummy placement for the local node, it is possible
+		 * that the entry doesn't exist in pg_dist_node, hence a lookup will fail.
+		 * In that case we want to use the dummy placements values.
+		 */
+		*nodeName = taskPlacement->nodeName;
+		*nodePort = taskPlacement->nodePort;
+	}
+	else
+	{
+		/*
+		 * We want to lookup the node information again since it is possible that
+		 * there were changes in pg_dist_node and we will get those invalidations
+		 * in LookupNodeForGroup.
+		 */
+		WorkerNode *workerNode = LookupNodeForGroup(taskPlacement->groupId);
+
+		if (readFromSecondary)
+		{
+			WorkerNode *secondaryNode =
+				CaughtUpSecondaryNodeForGroup(taskPlacement->groupId, workerNode);
+
+			if (secondaryNode != NULL)
+			{
+				workerNode = secondaryNode;
+			}
+		}
+
+		*nodeName = workerNode->workerName;
+		*nodePort = workerNode->workerPort;
+	}
+}
+
+
+/*
+ * ShouldReadFromCaughtUpSecondaries returns true if citus.use_secondary_nodes is
+ * set to caught_up and the execution is a read that is not part of a transaction
+ * block. Reads in transaction blocks stay on the primaries, since they need to see
+ * the uncommitted writes of the transaction and use the same connections.
+ */
+static bool
+ShouldReadFromCaughtUpSecondaries(DistributedExecution *execution)
+{
+	if (!ReadFromCaughtUpSecondaries())
+	{
+		return false;
+	}
+
+	if (execution->modLevel != ROW_MODIFY_READONLY)
+	{
+		return false;
+	}
+
+	if (execution->transactionProperties->useRemoteTransactionBlocks ==
+		TRANSACTION_BLOCKS_REQUIRED)
+	{
+		return false;
+	}
+
+	return !InCoordinatedTransaction() && !IsMultiStatementTransaction();
+}
+
+
+/*
+ * IsDummyPlacement returns true if the given placement is a dummy placement.
+ */
+static bool
+IsDummyPlacement(ShardPlacement *taskPlacement)
+{
+	return taskPlacement->nodeId == LOCAL_NODE_ID;
+}
+
+
+/*
+ * WorkerPoolCompare is based on WorkerNodeCompare function. The function
+ * compares two worker nodes by their host name and port number.
+ */
+static int
+WorkerPoolCompare(const void *lhsKey, const void *rhsKey)
+{
+	const WorkerPool *workerLhs = *(const WorkerPool **) lhsKey;
+	const WorkerPool *workerRhs = *(const WorkerPool **) rhsKey;
+
+	return NodeNamePortCompare(workerLhs->nodeName, workerRhs->nodeName,
+							   workerLhs->nodePort, workerRhs->nodePort);
+}
+
+
+/*
+ * SetAttributeInputMetadata sets attributeInputMetadata in
+ * shardCommandExecution for all the queries that are part of its task.
+ * This contains the deserialization functions for the tuples that will be
+ * received. It also sets binaryResults when applicable.
+ */
+static void
+SetAttributeInputMetadata(DistributedExecution *execution,
+						  ShardCommandExecution *shardCommandExecution)
+{
+	TupleDestination *tupleDest = shardCommandExecution->task->tupleDest ?
+								  shardCommandExecution->task->tupleDest :
+								  execution->defaultTupleDest;
+	uint32 queryCount = shardCommandExecution->task->queryCount;
+	shardCommandExecution->attributeInputMetadata = palloc0(queryCount *
+															sizeof(AttInMetadata *));
+	shardCommandExecution->binaryDecodeMethods = palloc0(queryCount *
+														 sizeof(BinaryDecodeMethod *));
+
+	for (uint32 queryIndex = 0; queryIndex < queryCount; queryIndex++)
+	{
+		AttInMetadata *attInMetadata = NULL;
+		TupleDesc tupleDescriptor = tupleDest->tupleDescForQuery(tupleDest,
+																 queryIndex);
+		if (tupleDescriptor == NULL)
+		{
+			attInMetadata = NULL;
+		}
+		else if (EnableBinaryProtocol && CanUseBinaryCopyFormat(tupleDescriptor))
+		{
+			attInMetadata = TupleDescGetAttBinaryInMetadata(tupleDescriptor);
+			shardCommandExecution->binaryDecodeMethods[queryIndex] =
+				TupleDescGetBinaryDecodeMethods(tupleDescriptor);
+			shardCommandExecution->binaryResults = true;
+		}
+		else
+		{
+			attInMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
+		}
+
+		shardCommandExecution->attributeInputMetadata[queryIndex] = attInMetadata;
+	}
+}
+
+
+/*
+ * ExecutionOrderForTask gives the appropriate execution order for a task.
+ */
+static PlacementExecutionOrder
+ExecutionOrderForTask(RowModifyLevel modLevel, Task *task)
+{
+	switch (task->taskType)
+	{
+		case READ_TASK:
+		{
+			return EXECUTION_ORDER_ANY;
+		}
+
+		case MODIFY_TASK:
+		{
+			/*
+			 * For non-commutative modifications we take aggressive locks, so
+			 * there is no risk of deadlock and we can run them in parallel.
+			 * When the modification is commutative, we take no additional
+			 * locks, so we take a conservative approach and execute sequentially
+			 * to avoid deadlocks.
+			 */
+			if (modLevel < ROW_MODIFY_NONCOMMUTATIVE)
+			{
+				return EXECUTION_ORDER_SEQUENTIAL;
+			}
+			else
+			{
+				return EXECUTION_ORDER_PARALLEL;
+			}
+		}
+
+		case DDL_TASK:
+		case VACUUM_ANALYZE_TASK:
+		case MAP_TASK:
+		case MERGE_TASK:
+		case MAP_OUTPUT_FETCH_TASK:
+		case MERGE_FETCH_TASK:
+		{
+			return EXECUTION_ORDER_PARALLEL;
+		}
+
+		default:
+		{
+			ereport(ERROR, (errmsg("unsupported task type %d in adaptive executor",
+								   task->taskType)));
+		}
+	}
+}
+
+
+/*
+ * FindOrCreateWorkerPool gets the pool of connections for a particular worker.
+ */
+static WorkerPool *
+FindOrCreateWorkerPool(DistributedExecution *execution, char *nodeName, int nodePort)
+{
+	WorkerPool *workerPool = NULL;
+	foreach_ptr(workerPool, execution->workerList)
+	{
+		if (strncmp(nodeName, workerPool->nodeName, WORKER_LENGTH) == 0 &&
+			nodePort == workerPool->nodePort)
+		{
+			return workerPool;
+		}
+	}
+
+	workerPool = (WorkerPool *) palloc0(sizeof(WorkerPool));
+	workerPool->nodeName = pstrdup(nodeName);
+	workerPool->nodePort = nodePort;
+
+	WorkerNode *workerNode = FindWorkerNode(nodeName, nodePort);
+	if (workerNode)
+	{
+		workerPool->poolToLocalNode =
+			workerNode->groupId == GetLocalGroupId();
+	}
+
+	/* "open" connections aggressively when there are cached connections */
+	int nodeConnectionCount = MaxCachedConnectionsPerWorker;
+	workerPool->maxNewConnectionsPerCycle = Max(1, nodeConnectionCount);
+
+	if (EnableCostBasedConnectionEstablishment || HedgedReadDelayFactor > 0)
+	{
+		uint64 queryShapeId = execution->queryShapeId;
+
+		GetWorkerLatencyEstimates(nodeName, nodePort, queryShapeId,
+								  &workerPool->sharedAvgTaskExecutionTime,
+								  &workerPool->sharedAvgConnectionEstablishmentTime);
+	}
+
+	dlist_init(&workerPool->pendingTaskQueue);
+	dlist_init(&workerPool->readyTaskQueue);
+
+	workerPool->distributedExecution = execution;
+
+	execution->workerList = lappend(execution->workerList, workerPool);
+
+	return workerPool;
+}
+
+
+/*
+ * FindOrCreateWorkerSession returns a session with the given connection,
+ * either existing or new. New sessions are added to the worker pool and
+ * the distributed execution.
+ */
+static WorkerSession *
+FindOrCreateWorkerSession(WorkerPool *workerPool, MultiConnection *connection)
+{
+	DistributedExecution *execution = workerPool->distributedExecution;
+	static uint64 sessionId = 1;
+
+	WorkerSession *session = NULL;
+	foreach_ptr(session, workerPool->sessionList)
+	{
+		if (session->connection == connection)
+		{
+			return session;
+		}
+	}
+
+
+	session = (WorkerSession *) palloc0(sizeof(WorkerSession));
+	session->sessionId = sessionId++;
+	session->connection = connection;
+	session->workerPool = workerPool;
+	session->commandsSent = 0;
+	session->waitEventSetIndex = WAIT_EVENT_SET_INDEX_NOT_INITIALIZED;
+
+	dlist_init(&session->pendingTaskQueue);
+	dlist_init(&session->readyTaskQueue);
+	dlist_init(&session->pipelinedTaskQueue);
+
+	/*
+	 * Before using this connection in the distributed execution, we check
+	 * whether the remote connection is closed/lost. This is common
+	 * when we have a cached connection and remote server restarted
+	 * (due to failover or restart etc.). We do this because we can
+	 * retry connection a single time.
+	 */
+	if (RemoteSocketClosedForNewSession(session))
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+	}
+
+	if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
+	{
+		/* keep track of how many connections are ready */
+		workerPool->activeConnectionCount++;
+		workerPool->idleConnectionCount++;
+
+		session->sessionHasActiveConnection = true;
+		session->connectionReused = true;
+	}
+
+	workerPool->unusedConnectionCount++;
+
+	/*
+	 * Record the first connection establishment time to the pool. We need this
+	 * to enforce NodeConnectionTimeout.
+	 */
+	if (list_length(workerPool->sessionList) == 0)
+	{
+		INSTR_TIME_SET_CURRENT(workerPool->poolStartTime);
+		workerPool->checkForPoolTimeout = true;
+	}
+
+	workerPool->sessionList = lappend(workerPool->sessionList, session);
+	execution->sessionList = lappend(execution->sessionList, session);
+
+	return session;
+}
+
+
+/*
+ * RemoteSocketClosedForNewSession is a helper function for detecting whether
+ * the remote socket corresponding to the input session is closed. This is
+ * mostly common there is a cached connection and remote server restarted
+ * (due to failover or restart etc.).
+ *
+ * The function is not a generic function that can be called at the start of
+ * the execution. The function is not generic because it does not check all
+ * the events, even ignores cancellation events. Future callers of this
+ * function should consider its limitations.
+ */
+static bool
+RemoteSocketClosedForNewSession(WorkerSession *session)
+{
+	bool socketClosed = false;
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+
+	if (!WaitEventSetCanReportClosed())
+	{
+		/* we cannot detect for this OS */
+		return socketClosed;
+	}
+
+	MultiConnection *connection = session->connection;
+	long timeout = 0;/* don't wait */
+	int eventSetSize = 2;
+	WaitEvent *events = palloc0(eventSetSize * sizeof(WaitEvent));
+
+	/*
+	 * Only wait for WL_SOCKET_CLOSED and postmaster death, do not even check
+	 * for cancellations. Everything else are going to be checked soon in the
+	 * main event processing. At this point, our only goal is to understand
+	 * whether the remote socket is closed or not.
+	 */
+	int originalWaitFlags = connection->waitFlags;
+	connection->waitFlags = WL_SOCKET_CLOSED;
+	WaitEventSet *waitEventSet =
+		CreateWaitEventSet(CurrentMemoryContext, eventSetSize);
+
+	AddSessionToWaitEventSet(session, waitEventSet);
+
+	/* always good to wait for postmaster death */
+	CitusAddWaitEventSetToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL,
+							  NULL);
+
+	int eventCount = WaitEventSetWait(waitEventSet, timeout, events,
+									  eventSetSize, WAIT_EVENT_CLIENT_READ);
+	socketClosed =
+		ProcessWaitEventsForSocketClosed(events, eventCount);
+
+	/* we can at most receive a single event, which is WL_SOCKET_CLOSED */
+	Assert(eventCount <= 1);
+
+	FreeWaitEventSet(waitEventSet);
+	pfree(events);
+
+	/*
+	 * We only searched for WL_SOCKET_CLOSED, and we processed the
+	 * event already. Now, set back to the original flags.
+	 */
+	UpdateConnectionWaitFlags(session, originalWaitFlags);
+	session->latestUnconsumedWaitEvents = 0;
+
+#endif
+
+	return socketClosed;
+}
+
+
+/*
+ * ShouldRunTasksSequentially returns true if each of the individual tasks
+ * should be executed one by one. Note that this is different than
+ * MultiShardConnectionType == SEQUENTIAL_CONNECTION case. In that case,
+ * running the tasks across the nodes in parallel is acceptable and implemented
+ * in that way.
+ *
+ * However, the executions that are qualified here would perform poorly if the
+ * tasks across the workers are executed in parallel. We currently qualify only
+ * one class of distributed queries here, multi-row INSERTs. If we do not enforce
+ * true sequential execution, concurrent multi-row upserts could easily form
+ * a distributed deadlock when the upserts touch the same rows.
+ */
+bool
+ShouldRunTasksSequentially(List *taskList)
+{
+	if (list_length(taskList) < 2)
+	{
+		/* single task plans are already qualified as sequential by definition */
+		return false;
+	}
+
+	/* all the tasks are the same, so we only look one */
+	Task *initialTask = (Task *) linitial(taskList);
+	if (initialTask->rowValuesLists != NIL)
+	{
+		/* found a multi-row INSERT */
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * SequentialRunDistributedExecution gets a distributed execution and
+ * executes each individual task in the execution sequentially, one
+ * task at a time. See related function ShouldRunTasksSequentially()
+ * for more detail on the definition of SequentialRun.
+ */
+static void
+SequentialRunDistributedExecution(DistributedExecution *execution)
+{
+	List *taskList = execution->remoteTaskList;
+	int connectionMode = MultiShardConnectionType;
+
+	/*
+	 * There are some implicit assumptions about this setting for the sequential
+	 * executions, so make sure to set it.
+	 */
+	MultiShardConnectionType = SEQUENTIAL_CONNECTION;
+
+	/* the progress steps follow the order of the original task list */
+	ShardTaskProgress *taskProgressSteps = execution->taskProgressSteps;
+	int taskIndex = 0;
+
+	Task *taskToExecute = NULL;
+	foreach_ptr(taskToExecute, taskList)
+	{
+		execution->remoteAndLocalTaskList = list_make1(taskToExecute);
+		execution->remoteTaskList = list_make1(taskToExecute);
+		execution->totalTaskCount = 1;
+		execution->unfinishedTaskCount = 1;
+
+		if (taskProgressSteps != NULL)
+		{
+			execution->taskProgressSteps = taskProgressSteps + taskIndex;
+		}
+
+		taskIndex++;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (IsHoldOffCancellationReceived() || RowLimitReached(execution))
+		{
+			break;
+		}
+
+		/* simply call the regular execution function */
+		RunDistributedExecution(execution);
+	}
+
+	/* set back the original execution mode */
+	MultiShardConnectionType = connectionMode;
+}
+
+
+/*
+ * RunDistributedExecution runs a distributed execution to completion. It first opens
+ * connections for distributed execution and assigns each task with shard placements
+ * that have previously been modified in the current transaction to the connection
+ * that modified them. Then, it creates a wait event set to listen for events on
+ * any of the connections and runs the connection state machine when a connection
+ * has an event.
+ */
+void
+RunDistributedExecution(DistributedExecution *execution)
+{
+	AssignTasksToConnectionsOrWorkerPool(execution, execution->remoteTaskList);
+
+	bool returnOnNewRows = false;
+	bool returnWhenIdle = false;
+	ContinueDistributedExecution(execution, returnOnNewRows, returnWhenIdle);
+}
+
+
+/*
+ * ContinueDistributedExecution runs the wait loop of a distributed execution
+ * whose tasks are assigned to connections or worker pools.
+ *
+ * If returnOnNewRows is true, the function returns as soon as new rows are
+ * written to the tuple destination, such that a streaming scan can return
+ * them before the execution continues. If returnWhenIdle is true, the function
+ * returns once none of the connections has an event, rather than waiting for
+ * one. The function returns true once the execution is finished.
+ */
+static bool
+ContinueDistributedExecution(DistributedExecution *execution, bool returnOnNewRows,
+							 bool returnWhenIdle)
+{
+	bool executionFinished = false;
+
+	PG_TRY();
+	{
+		if (!execution->waitLoopStarted)
+		{
+			/* Preemptively step state machines in case of immediate errors */
+			WorkerSession *session = NULL;
+			foreach_ptr(session, execution->sessionList)
+			{
+				ConnectionStateMachine(session);
+			}
+
+			execution->eventSetSize = GetEventSetSize(execution->sessionList);
+
+			/* always (re)build the wait event set the first time */
+			execution->rebuildWaitEventSet = true;
+			execution->waitLoopStarted = true;
+		}
+
+		uint64 rowsProcessedAtStart = execution->rowsProcessed;
+		bool pausedWaitLoop = false;
+
+		/*
+		 * Iterate until all the tasks are finished. Once all the tasks
+		 * are finished, ensure that that all the connection initializations
+		 * are also finished. Otherwise, those connections are terminated
+		 * abruptly before they are established (or failed). Instead, we let
+		 * the ConnectionStateMachine() to properly handle them.
+		 *
+		 * Note that we could have the connections that are not established
+		 * as a side effect of slow-start algorithm. At the time the algorithm
+		 * decides to establish new connections, the execution might have tasks
+		 * to finish. But, the execution might finish before the new connections
+		 * are established.
+		 *
+		 * Note that the rules explained above could be overriden by any
+		 * cancellation to the query. In that case, we terminate the execution
+		 * irrespective of the current status of the tasks or the connections.
+		 */
+		while (!execution->cancellationReceived &&
+			   (execution->unfinishedTaskCount > 0 ||
+				HasIncompleteConnectionEstablishment(execution)))
+		{
+			if (returnOnNewRows && execution->rowsProcessed > rowsProcessedAtStart)
+			{
+				/* let the scan return the new rows first */
+				pausedWaitLoop = true;
+				break;
+			}
+
+			if (RowLimitReached(execution) && execution->unfinishedTaskCount > 0)
+			{
+				/* we have all the rows we need, do not wait for the other tasks */
+				CancelRemainingTasks(execution);
+				continue;
+			}
+
+			if (HedgedReadDelayFactor > 0)
+			{
+				StartHedgedPlacementExecutions(execution);
+			}
+
+			WorkerPool *workerPool = NULL;
+			foreach_ptr(workerPool, execution->workerList)
+			{
+				ManageWorkerPool(workerPool);
+			}
+
+			bool skipWaitEvents = false;
+			if (execution->remoteTaskList == NIL)
+			{
+				/*
+				 * All the tasks are failed over to the local execution, no need
+				 * to wait for any connection activity.
+				 */
+				continue;
+			}
+			else if (execution->rebuildWaitEventSet)
+			{
+				if (execution->events != NULL)
+				{
+					/*
+					 * The execution might take a while, so explicitly free at this point
+					 * because we don't need anymore.
+					 */
+					pfree(execution->events);
+					execution->events = NULL;
+				}
+				execution->eventSetSize = RebuildWaitEventSet(execution);
+				execution->events = palloc0(execution->eventSetSize * sizeof(WaitEvent));
+
+				skipWaitEvents =
+					ProcessSessionsWithFailedWaitEventSetOperations(execution);
+			}
+			else if (execution->waitFlagsChanged)
+			{
+				RebuildWaitEventSetFlags(execution->waitEventSet, execution->sessionList);
+				execution->waitFlagsChanged = false;
+
+				skipWaitEvents =
+					ProcessSessionsWithFailedWaitEventSetOperations(execution);
+			}
+
+			if (skipWaitEvents)
+			{
+				/*
+				 * Some operation on the wait event set is failed, retry
+				 * as we already removed the problematic connections.
+				 */
+				execution->rebuildWaitEventSet = true;
+
+				continue;
+			}
+
+			/* wait for I/O events */
+			long timeout = returnWhenIdle ? 0 : NextEventTimeout(execution);
+			instr_time waitStart;
+			if (execution->collectNetworkMetrics)
+			{
+				INSTR_TIME_SET_CURRENT(waitStart);
+			}
+
+			int eventCount = WaitEventSetWait(execution->waitEventSet, timeout,
+											  execution->events, execution->eventSetSize,
+											  CitusWaitEventInfo(
+												  CITUS_WAIT_EVENT_REMOTE_QUERY_RESULT));
+
+			if (execution->collectNetworkMetrics)
+			{
+				instr_time waitEnd;
+				INSTR_TIME_SET_CURRENT(waitEnd);
+				INSTR_TIME_ACCUM_DIFF(execution->remoteWaitTime, waitEnd, waitStart);
+			}
+			ProcessWaitEvents(execution, execution->events, eventCount,
+							  &execution->cancellationReceived);
+
+			if (returnWhenIdle && eventCount == 0)
+			{
+				/* nothing to do without waiting, let the caller do other work */
+				pausedWaitLoop = true;
+				break;
+			}
+		}
+
+		if (!pausedWaitLoop)
+		{
+			if (execution->events != NULL)
+			{
+				pfree(execution->events);
+				execution->events = NULL;
+			}
+
+			if (execution->waitEventSet != NULL)
+			{
+				FreeWaitEventSet(execution->waitEventSet);
+				execution->waitEventSet = NULL;
+			}
+
+			CleanUpSessions(execution);
+
+			/* tasks might still be running after a cancellation */
+			RemoveAllFromSharedRunningTaskCounts(execution);
+
+			if (execution->taskTimingsQueryId != 0)
+			{
+				RecordTaskTimings(execution);
+			}
+
+			if (execution->queryShapeId != 0)
+			{
+				RecordWorkerPoolTaskExecutionTimes(execution);
+			}
+
+			executionFinished = true;
+		}
+	}
+	PG_CATCH();
+	{
+		AbortDistributedExecutionWaitLoop(execution);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	return executionFinished;
+}
+
+
+/*
+ * AbortDistributedExecutionWaitLoop releases the resources of the wait loop
+ * of a distributed execution that is aborted by an error.
+ */
+static void
+AbortDistributedExecutionWaitLoop(DistributedExecution *execution)
+{
+	/*
+	 * We can still recover from error using ROLLBACK TO SAVEPOINT,
+	 * unclaim all connections to allow that.
+	 */
+	UnclaimAllSessionConnections(execution->sessionList);
+
+	RemoveAllFromSharedRunningTaskCounts(execution);
+
+	if (execution->waitEventSet != NULL)
+	{
+		FreeWaitEventSet(execution->waitEventSet);
+		execution->waitEventSet = NULL;
+	}
+}
+
+
+/*
+ * ProcessSessionsWithFailedWaitEventSetOperations goes over the session list
+ * and processes sessions with failed wait event set operations.
+ *
+ * Failed sessions are not going to generate any further events, so it is our
+ * only chance to process the failure by calling into `ConnectionStateMachine`.
+ *
+ * The function returns true if any session failed.
+ */
+static bool
+ProcessSessionsWithFailedWaitEventSetOperations(DistributedExecution *execution)
+{
+	bool foundFailedSession = false;
+	WorkerSession *session = NULL;
+	foreach_ptr(session, execution->sessionList)
+	{
+		if (session->waitEventSetIndex == WAIT_EVENT_SET_INDEX_FAILED)
+		{
+			/*
+			 * We can only lost only already connected connections,
+			 * others are regular failures.
+			 */
+			MultiConnection *connection = session->connection;
+			if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
+			{
+				connection->connectionState = MULTI_CONNECTION_LOST;
+			}
+			else
+			{
+				connection->connectionState = MULTI_CONNECTION_FAILED;
+			}
+
+
+			ConnectionStateMachine(session);
+
+			session->waitEventSetIndex = WAIT_EVENT_SET_INDEX_NOT_INITIALIZED;
+
+			foundFailedSession = true;
+		}
+	}
+
+	return foundFailedSession;
+}
+
+
+/*
+ * HasIncompleteConnectionEstablishment returns true if any of the connections
+ * that has been initiated by the executor is in initilization stage.
+ */
+static bool
+HasIncompleteConnectionEstablishment(DistributedExecution *execution)
+{
+	if (!PreventIncompleteConnectionEstablishment)
+	{
+		return false;
+	}
+
+	WorkerSession *session = NULL;
+	foreach_ptr(session, execution->sessionList)
+	{
+		MultiConnection *connection = session->connection;
+		if (connection->connectionState == MULTI_CONNECTION_INITIAL ||
+			connection->connectionState == MULTI_CONNECTION_CONNECTING)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * RebuildWaitEventSet updates the waitEventSet for the distributed execution.
+ * This happens when the connection set for the distributed execution is changed,
+ * which means that we need to update which connections we wait on for events.
+ * It returns the new event set size.
+ */
+static int
+RebuildWaitEventSet(DistributedExecution *execution)
+{
+	if (execution->waitEventSet != NULL)
+	{
+		FreeWaitEventSet(execution->waitEventSet);
+		execution->waitEventSet = NULL;
+	}
+
+	execution->waitEventSet = BuildWaitEventSet(execution->sessionList);
+	execution->rebuildWaitEventSet = false;
+	execution->waitFlagsChanged = false;
+
+	return GetEventSetSize(execution->sessionList);
+}
+
+
+/*
+ * ProcessWaitEvents processes the received events from connections.
+ */
+static void
+ProcessWaitEvents(DistributedExecution *execution, WaitEvent *events, int eventCount,
+				  bool *cancellationReceived)
+{
+	int eventIndex = 0;
+
+	/* process I/O events */
+	for (; eventIndex < eventCount; eventIndex++)
+	{
+		WaitEvent *event = &events[eventIndex];
+
+		if (event->events & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+		}
+
+		if (event->events & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+
+			if (execution->raiseInterrupts)
+			{
+				CHECK_FOR_INTERRUPTS();
+			}
+
+			if (IsHoldOffCancellationReceived())
+			{
+				/*
+				 * Break out of event loop immediately in case of cancellation.
+				 * We cannot use "return" here inside a PG_TRY() block since
+				 * then the exception stack won't be reset.
+				 */
+				*cancellationReceived = true;
+			}
+
+			continue;
+		}
+
+		WorkerSession *session = (WorkerSession *) event->user_data;
+		session->latestUnconsumedWaitEvents = event->events;
+
+		ConnectionStateMachine(session);
+	}
+}
+
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+
+/*
+ * ProcessWaitEventsForSocketClosed mainly checks for WL_SOCKET_CLOSED event.
+ * If WL_SOCKET_CLOSED is found, the function sets the underlying connection's
+ * state as MULTI_CONNECTION_LOST.
+ */
+static bool
+ProcessWaitEventsForSocketClosed(WaitEvent *events, int eventCount)
+{
+	int eventIndex = 0;
+
+	/* process I/O events */
+	for (; eventIndex < eventCount; eventIndex++)
+	{
+		WaitEvent *event = &events[eventIndex];
+
+		if (event->events & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+		}
+
+		WorkerSession *session = (WorkerSession *) event->user_data;
+		session->latestUnconsumedWaitEvents = event->events;
+
+		if (session->latestUnconsumedWaitEvents & WL_SOCKET_CLOSED)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+#endif
+
+
+/*
+ * ManageWorkerPool ensures the worker pool has the appropriate number of connections
+ * based on the number of pending tasks.
+ */
+static void
+ManageWorkerPool(WorkerPool *workerPool)
+{
+	DistributedExecution *execution = workerPool->distributedExecution;
+
+	/* we do not expand the pool further if there was any failure */
+	if (HasAnyConnectionFailure(workerPool))
+	{
+		return;
+	}
+
+	/* we wait until a slow start interval has passed before expanding the pool */
+	if (ShouldWaitForSlowStart(workerPool))
+	{
+		return;
+	}
+
+	int newConnectionCount = CalculateNewConnectionCount(workerPool);
+	if (newConnectionCount <= 0)
+	{
+		return;
+	}
+
+	/* increase the open rate every cycle (like TCP slow start) */
+	workerPool->maxNewConnectionsPerCycle += 1;
+
+	OpenNewConnections(workerPool, newConnectionCount, execution->transactionProperties);
+
+	/*
+	 * Cannot establish new connections to the local host, most probably because the
+	 * local node cannot accept new connections (e.g., hit max_connections). Switch
+	 * the tasks to the local execution.
+	 *
+	 * We prefer initiatedConnectionCount over the new connection establishments happen
+	 * in this iteration via OpenNewConnections(). The reason is that it is expected for
+	 * OpenNewConnections() to not open any new connections as long as the connections
+	 * are optional (e.g., the second or later connections in the pool). But, for
+	 * initiatedConnectionCount to be zero, the connection to the local pool should have
+	 * been failed.
+	 */
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	if (initiatedConnectionCount == 0)
+	{
+		/*
+		 * Only the pools to the local node are allowed to have optional
+		 * connections for the first connection. Hence, initiatedConnectionCount
+		 * could only be zero for poolToLocalNode. For other pools, the connection
+		 * manager would wait until it gets at least one connection.
+		 */
+		Assert(workerPool->poolToLocalNode);
+
+		WorkerPoolFailed(workerPool);
+
+		if (execution->failed)
+		{
+			const char *errHint =
+				execution->localExecutionSupported ?
+				"This command supports local execution. Consider enabling "
+				"local execution using SET citus.enable_local_execution "
+				"TO true;" :
+				"Consider using a higher value for max_connections";
+
+			ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+							errmsg("the total number of connections on the "
+								   "server is more than max_connections(%d)",
+								   MaxConnections),
+							errhint("%s", errHint)));
+		}
+
+		return;
+	}
+
+	INSTR_TIME_SET_CURRENT(workerPool->lastConnectionOpenTime);
+	execution->rebuildWaitEventSet = true;
+}
+
+
+/*
+ * HasAnyConnectionFailure returns true if worker pool has failed,
+ * or connection timed out or we have a failure in connections.
+ */
+static bool
+HasAnyConnectionFailure(WorkerPool *workerPool)
+{
+	if (workerPool->failureState == WORKER_POOL_FAILED ||
+		workerPool->failureState == WORKER_POOL_FAILED_OVER_TO_LOCAL)
+	{
+		/* connection pool failed */
+		return true;
+	}
+
+	/* we might fail the execution or warn the user about connection timeouts */
+	if (workerPool->checkForPoolTimeout)
+	{
+		CheckConnectionTimeout(workerPool);
+	}
+
+	int failedConnectionCount = workerPool->failedConnectionCount;
+	if (failedConnectionCount >= 1)
+	{
+		/* do not attempt to open more connections after one failed */
+		return true;
+	}
+	return false;
+}
+
+
+/*
+ * ShouldWaitForSlowStart returns true if we should wait before
+ * opening a new connection because of slow start algorithm.
+ */
+static bool
+ShouldWaitForSlowStart(WorkerPool *workerPool)
+{
+	/* if we can use a connection per placement, we don't need to wait for slowstart */
+	if (UseConnectionPerPlacement())
+	{
+		return false;
+	}
+
+	/* if slow start is disabled, we can open new connections */
+	if (ExecutorSlowStartInterval == SLOW_START_DISABLED)
+	{
+		return false;
+	}
+
+	double milliSecondsPassedSince = MillisecondsPassedSince(
+		workerPool->lastConnectionOpenTime);
+	if (milliSecondsPassedSince < ExecutorSlowStartInterval)
+	{
+		return true;
+	}
+
+	/*
+	 * Refrain from establishing new connections unless we have already
+	 * finalized all the earlier connection attempts. This prevents unnecessary
+	 * load on the remote nodes and emulates the TCP slow-start algorithm.
+	 */
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	int finalizedConnectionCount =
+		workerPool->activeConnectionCount + workerPool->failedConnectionCount;
+	if (finalizedConnectionCount < initiatedConnectionCount)
+	{
+		return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * CalculateNewConnectionCount returns the amount of connections
+ * that we can currently open.
+ */
+static int
+CalculateNewConnectionCount(WorkerPool *workerPool)
+{
+	DistributedExecution *execution = workerPool->distributedExecution;
+
+	int targetPoolSize = execution->targetPoolSize;
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	int activeConnectionCount PG_USED_FOR_ASSERTS_ONLY =
+		workerPool->activeConnectionCount;
+	int idleConnectionCount PG_USED_FOR_ASSERTS_ONLY =
+		workerPool->idleConnectionCount;
+	int readyTaskCount = workerPool->readyTaskCount;
+	int newConnectionCount = 0;
+
+
+	/* we should always have more (or equal) active connections than idle connections */
+	Assert(activeConnectionCount >= idleConnectionCount);
+
+	/* we should always have more (or equal) initiated connections than active connections */
+	Assert(initiatedConnectionCount >= activeConnectionCount);
+
+	/* we should never have less than 0 connections ever */
+	Assert(activeConnectionCount >= 0 && idleConnectionCount >= 0);
+
+	if (UseConnectionPerPlacement())
+	{
+		int unusedConnectionCount = workerPool->unusedConnectionCount;
+
+		/*
+		 * If force_max_query_parallelization is enabled then we ignore pool size
+		 * and idle connections. Instead, we open new connections as long as there
+		 * are more tasks than unused connections.
+		 */
+
+		newConnectionCount = Max(readyTaskCount - unusedConnectionCount, 0);
+	}
+	else
+	{
+		/* cannot open more than targetPoolSize connections */
+		int maxNewConnectionCount = targetPoolSize - initiatedConnectionCount;
+
+		/* total number of connections that are (almost) available for tasks */
+		int usableConnectionCount = UsableConnectionCount(workerPool);
+
+		/*
+		 * Number of additional connections we would need to run all ready tasks in
+		 * parallel.
+		 */
+		int newConnectionsForReadyTasks = Max(0, readyTaskCount - usableConnectionCount);
+
+		/* If Slow start is enabled we need to update the maxNewConnection to the current cycle's maximum.*/
+		if (ExecutorSlowStartInterval != SLOW_START_DISABLED)
+		{
+			maxNewConnectionCount = Min(workerPool->maxNewConnectionsPerCycle,
+										maxNewConnectionCount);
+		}
+
+		/*
+		 * Open enough connections to handle all tasks that are ready, but no more
+		 * than the target pool size.
+		 */
+		newConnectionCount = Min(newConnectionsForReadyTasks, maxNewConnectionCount);
+		if (EnableCostBasedConnectionEstablishment && newConnectionCount > 0 &&
+			initiatedConnectionCount <= MaxCachedConnectionsPerWorker &&
+			UsingExistingSessionsCheaperThanEstablishingNewConnections(
+				readyTaskCount, workerPool))
+		{
+			/*
+			 * Before giving the decision, we do one more check. If the cost of
+			 * executing the remaining tasks over the existing sessions in the
+			 * pool is cheaper than establishing new connections and executing
+			 * the tasks over the new connections, we prefer the former.
+			 *
+			 * For cached connections we should ignore any optimizations as
+			 * cached connections are almost free to get. In other words,
+			 * as long as there are cached connections that the pool has
+			 * not used yet, aggressively use these already established
+			 * connections.
+			 *
+			 * Note that until MaxCachedConnectionsPerWorker has already been
+			 * established within the session, we still need to establish
+			 * the connections right now.
+			 *
+			 * Also remember that we are not trying to find the optimal number
+			 * of connections for the remaining tasks here. Our goal is to prevent
+			 * connection establishments that are absolutely unnecessary. In the
+			 * future, we may improve the calculations below to find the optimal
+			 * number of new connections required.
+			 */
+			return 0;
+		}
+	}
+
+	return newConnectionCount;
+}
+
+
+/*
+ * UsingExistingSessionsCheaperThanEstablishingNewConnections returns true if
+ * using the already established connections takes less time compared to opening
+ * new connections based on the current execution's stats.
+ *
+ * Until the pool finishes its first task, the function relies on the task
+ * execution times that other executions of the same query shape observed on
+ * the worker.
+ *
+ * The function returns false if the current execution has not established any
+ * connections, or if neither the current execution nor any other execution
+ * finished any tasks (e.g., no stats to act on).
+ */
+static bool
+UsingExistingSessionsCheaperThanEstablishingNewConnections(int readyTaskCount,
+														   WorkerPool *workerPool)
+{
+	int activeConnectionCount = workerPool->activeConnectionCount;
+	if ((workerPool->totalExecutedTasks < 1 &&
+		 workerPool->sharedAvgTaskExecutionTime <= 0) ||
+		activeConnectionCount < 1)
+	{
+		/*
+		 * The pool has not finished any connection establishment or
+		 * task yet. So, we refrain from optimizing the execution.
+		 */
+		return false;
+	}
+
+	double avgTaskExecutionTime = AvgTaskExecutionTimeApproximation(workerPool);
+	double avgConnectionEstablishmentTime = AvgConnectionEstablishmentTime(workerPool);
+
+	/* we assume that we are halfway through the execution */
+	double remainingTimeForActiveTaskExecutionsToFinish = avgTaskExecutionTime / 2;
+
+	/*
+	 * We use "newConnectionCount" as if it is the task count as
+	 * we are only interested in this iteration of CalculateNewConnectionCount().
+	 */
+	double totalTimeToExecuteNewTasks = avgTaskExecutionTime * readyTaskCount;
+
+	double estimatedExecutionTimeForNewTasks =
+		floor(totalTimeToExecuteNewTasks / activeConnectionCount);
+
+	/*
+	 * First finish the already running tasks, and then use the connections
+	 * to execute the new tasks.
+	 */
+	double costOfExecutingTheTasksOverExistingConnections =
+		remainingTimeForActiveTaskExecutionsToFinish +
+		estimatedExecutionTimeForNewTasks;
+
+	/*
+	 * For every task, the executor is supposed to establish one
+	 * connection and then execute the task over the connection.
+	 */
+	double costOfExecutingTheTasksOverNewConnection =
+		(avgTaskExecutionTime + avgConnectionEstablishmentTime);
+
+	return (costOfExecutingTheTasksOverExistingConnections <=
+			costOfExecutingTheTasksOverNewConnection);
+}
+
+
+/*
+ * AvgTaskExecutionTimeApproximation returns the approximation of the average task
+ * execution times on the workerPool.
+ */
+static double
+AvgTaskExecutionTimeApproximation(WorkerPool *workerPool)
+{
+	uint64 totalTaskExecutionTime = workerPool->totalTaskExecutionTime;
+	int taskCount = workerPool->totalExecutedTasks;
+
+	if (taskCount == 0 && workerPool->sharedAvgTaskExecutionTime > 0)
+	{
+		/* no task finished yet, start from what other executions observed */
+		totalTaskExecutionTime = (uint64) workerPool->sharedAvgTaskExecutionTime;
+		taskCount = 1;
+	}
+
+	instr_time now;
+	INSTR_TIME_SET_CURRENT(now);
+
+	WorkerSession *session = NULL;
+	foreach_ptr(session, workerPool->sessionList)
+	{
+		/*
+		 * Involve the tasks that are currently running. We do this to
+		 * make sure that the execution responds with new connections
+		 * quickly if the actively running tasks
+		 */
+		TaskPlacementExecution *placementExecution = session->currentTask;
+		if (placementExecution != NULL &&
+			placementExecution->executionState == PLACEMENT_EXECUTION_RUNNING)
+		{
+			uint64 durationInMicroSecs =
+				MicrosecondsBetweenTimestamps(placementExecution->startTime, now);
+
+			/*
+			 * Our approximation is that we assume that the task execution is
+			 * just in the halfway through.
+			 */
+			totalTaskExecutionTime += (2 * durationInMicroSecs);
+			taskCount += 1;
+		}
+	}
+
+	return taskCount == 0 ? 0 : ((double) totalTaskExecutionTime / taskCount);
+}
+
+
+/*
+ * AvgConnectionEstablishmentTime calculates the average connection establishment times
+ * for the input workerPool.
+ */
+static double
+AvgConnectionEstablishmentTime(WorkerPool *workerPool)
+{
+	double totalTimeMicrosec = 0;
+	int sessionCount = 0;
+
+	WorkerSession *session = NULL;
+	foreach_ptr(session, workerPool->sessionList)
+	{
+		MultiConnection *connection = session->connection;
+
+		/*
+		 * There could be MaxCachedConnectionsPerWorker connections that are
+		 * already connected. Those connections might skew the average
+		 * connection establishment times for the current execution. The reason
+		 * is that they are established earlier and the connection establishment
+		 * times might be different at the moment those connections are established.
+		 */
+		if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
+		{
+			long connectionEstablishmentTime =
+				MicrosecondsBetweenTimestamps(connection->connectionEstablishmentStart,
+											  connection->connectionEstablishmentEnd);
+
+			totalTimeMicrosec += connectionEstablishmentTime;
+			++sessionCount;
+		}
+	}
+
+	if (sessionCount == 0)
+	{
+		/* no connection established yet, use what other executions observed */
+		return workerPool->sharedAvgConnectionEstablishmentTime;
+	}
+
+	return totalTimeMicrosec / sessionCount;
+}
+
+
+/*
+ * AddToSharedRunningTaskCount adds the placement execution that just started
+ * to the number of running tasks on its worker, which is visible to other
+ * backends (see citus.task_assignment_policy = 'least-loaded').
+ */
+static void
+AddToSharedRunningTaskCount(TaskPlacementExecution *placementExecution)
+{
+	WorkerPool *workerPool = placementExecution->workerPool;
+
+	Assert(!placementExecution->inSharedRunningTaskCount);
+
+	AdjustWorkerRunningTaskCount(workerPool->nodeName, workerPool->nodePort, 1);
+
+	placementExecution->inSharedRunningTaskCount = true;
+	workerPool->sharedRunningTaskCount++;
+}
+
+
+/*
+ * RemoveFromSharedRunningTaskCount removes the placement execution from the
+ * number of running tasks on its worker, if it was added.
+ */
+static void
+RemoveFromSharedRunningTaskCount(TaskPlacementExecution *placementExecution)
+{
+	WorkerPool *workerPool = placementExecution->workerPool;
+
+	if (!placementExecution->inSharedRunningTaskCount)
+	{
+		return;
+	}
+
+	AdjustWorkerRunningTaskCount(workerPool->nodeName, workerPool->nodePort, -1);
+
+	placementExecution->inSharedRunningTaskCount = false;
+	workerPool->sharedRunningTaskCount--;
+}
+
+
+/*
+ * RemoveAllFromSharedRunningTaskCounts removes the placement executions that
+ * are still running from the number of running tasks on their workers. We
+ * call this when the execution is aborted.
+ */
+static void
+RemoveAllFromSharedRunningTaskCounts(DistributedExecution *execution)
+{
+	WorkerPool *workerPool = NULL;
+	foreach_ptr(workerPool, execution->workerList)
+	{
+		if (workerPool->sharedRunningTaskCount > 0)
+		{
+			AdjustWorkerRunningTaskCount(workerPool->nodeName, workerPool->nodePort,
+										 -workerPool->sharedRunningTaskCount);
+			workerPool->sharedRunningTaskCount = 0;
+		}
+	}
+}
+
+
+/*
+ * DistributedPlanQueryShapeId returns an identifier for the shape of the query
+ * of the given plan, such that executions of the same query can share their
+ * task execution times. We use the query identifier when it is computed, and
+ * otherwise fall back to the command type and the relations in the query.
+ */
+static uint64
+DistributedPlanQueryShapeId(DistributedPlan *distributedPlan)
+{
+	if (distributedPlan->queryId != 0)
+	{
+		return distributedPlan->queryId;
+	}
+
+	Job *job = distributedPlan->workerJob;
+	if (job == NULL || job->jobQuery == NULL)
+	{
+		return 0;
+	}
+
+	uint64 queryShapeId = hash_uint32((uint32) job->jobQuery->commandType);
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, distributedPlan->relationIdList)
+	{
+		queryShapeId = hash_combine64(queryShapeId, hash_uint32(relationId));
+	}
+
+	return queryShapeId;
+}
+
+
+/*
+ * OpenNewConnections opens the given amount of connections for the given workerPool.
+ */
+static void
+OpenNewConnections(WorkerPool *workerPool, int newConnectionCount,
+				   TransactionProperties *transactionProperties)
+{
+	ereport(DEBUG4, (errmsg("opening %d new connections to %s:%d", newConnectionCount,
+							workerPool->nodeName, workerPool->nodePort)));
+
+	for (int connectionIndex = 0; connectionIndex < newConnectionCount; connectionIndex++)
+	{
+		/* experimental: just to see the perf benefits of caching connections */
+		int connectionFlags = 0;
+
+		if (transactionProperties->useRemoteTransactionBlocks ==
+			TRANSACTION_BLOCKS_DISALLOWED)
+		{
+			connectionFlags |= OUTSIDE_TRANSACTION;
+		}
+
+		/*
+		 * Enforce the requirements for adaptive connection management (a.k.a.,
+		 * throttle connections if citus.max_shared_pool_size reached)
+		 */
+		int adaptiveConnectionManagementFlag =
+			AdaptiveConnectionManagementFlag(workerPool->poolToLocalNode,
+											 list_length(workerPool->sessionList));
+		connectionFlags |= adaptiveConnectionManagementFlag;
+
+		/* open a new connection to the worker */
+		MultiConnection *connection = StartNodeUserDatabaseConnection(connectionFlags,
+																	  workerPool->nodeName,
+																	  workerPool->nodePort,
+																	  NULL, NULL);
+		if (!connection)
+		{
+			/* connection can only be NULL for optional connections */
+			Assert((connectionFlags & OPTIONAL_CONNECTION));
+			continue;
+		}
+
+		/*
+		 * Assign the initial state in the connection state machine. The connection
+		 * may already be open, but ConnectionStateMachine will immediately detect
+		 * this.
+		 */
+		connection->connectionState = MULTI_CONNECTION_CONNECTING;
+
+		/*
+		 * Ensure that subsequent calls to StartNodeUserDatabaseConnection get a
+		 * different connection.
+		 */
+		connection->claimedExclusively = true;
+
+		if (list_length(workerPool->sessionList) == 0)
+		{
+			/*
+			 * The worker pool has just started to establish connections. We need to
+			 * defer this initilization after StartNodeUserDatabaseConnection()
+			 * because for non-optional connections, we have some logic to wait
+			 * until a connection is allowed to be established.
+			 */
+			INSTR_TIME_SET_ZERO(workerPool->poolStartTime);
+		}
+
+		/* create a session for the connection */
+		WorkerSession *session = FindOrCreateWorkerSession(workerPool, connection);
+
+		/* immediately run the state machine to handle potential failure */
+		ConnectionStateMachine(session);
+	}
+}
+
+
+/*
+ * CheckConnectionTimeout makes sure that the execution enforces the connection
+ * establishment timeout defined by the user (NodeConnectionTimeout).
+ *
+ * The rule is that if a worker pool has already initiated connection establishment
+ * and has not succeeded to finish establishments that are necessary to execute tasks,
+ * take an action. For the types of actions, see the comments in the function.
+ *
+ * Enforcing the timeout per pool (over per session) helps the execution to continue
+ * even if we can establish a single connection as we expect to have target pool size
+ * number of connections. In the end, the executor is capable of using one connection
+ * to execute multiple tasks.
+ */
+static void
+CheckConnectionTimeout(WorkerPool *workerPool)
+{
+	DistributedExecution *execution = workerPool->distributedExecution;
+	instr_time poolStartTime = workerPool->poolStartTime;
+	instr_time now;
+	INSTR_TIME_SET_CURRENT(now);
+
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	int activeConnectionCount = workerPool->activeConnectionCount;
+	int requiredActiveConnectionCount = 1;
+
+	if (initiatedConnectionCount == 0)
+	{
+		/* no connection has been planned for the pool yet */
+		Assert(INSTR_TIME_IS_ZERO(poolStartTime));
+		return;
+	}
+
+	/*
+	 * This is a special case where we assign tasks to sessions even before
+	 * the connections are established. So, make sure to apply similar
+	 * restrictions. In this case, make sure that we get all the connections
+	 * established.
+	 */
+	if (UseConnectionPerPlacement())
+	{
+		requiredActiveConnectionCount = initiatedConnectionCount;
+	}
+
+	if (MillisecondsBetweenTimestamps(poolStartTime, now) >= NodeConnectionTimeout)
+	{
+		if (activeConnectionCount < requiredActiveConnectionCount)
+		{
+			int logLevel = WARNING;
+
+			/*
+			 * First fail the pool and create an opportunity to execute tasks
+			 * over other pools when tasks have more than one placement to execute.
+			 */
+			WorkerPoolFailed(workerPool);
+
+			if (workerPool->failureState == WORKER_POOL_FAILED_OVER_TO_LOCAL)
+			{
+				/*
+				 *
+				 * When the pool is failed over to local execution, warning
+				 * the user just creates chatter as the executor is capable of
+				 * finishing the execution.
+				 */
+				logLevel = DEBUG1;
+			}
+			else if (execution->transactionProperties->errorOnAnyFailure ||
+					 execution->failed)
+			{
+				/*
+				 * The enforcement is not always erroring out. For example, if a SELECT task
+				 * has two different placements, we'd warn the user, fail the pool and continue
+				 * with the next placement.
+				 */
+				logLevel = ERROR;
+			}
+
+			ereport(logLevel, (errcode(ERRCODE_CONNECTION_FAILURE),
+							   errmsg("could not establish any connections to the node "
+									  "%s:%d after %u ms", workerPool->nodeName,
+									  workerPool->nodePort,
+									  NodeConnectionTimeout)));
+
+			/*
+			 * We hit the connection timeout. In that case, we should not let the
+			 * connection establishment to continue because the execution logic
+			 * pretends that failed sessions are not going to be used anymore.
+			 *
+			 * That's why we mark the connection as timed out to trigger the state
+			 * changes in the executor.
+			 */
+			MarkEstablishingSessionsTimedOut(workerPool);
+		}
+		else
+		{
+			/* stop interrupting WaitEventSetWait for timeouts */
+			workerPool->checkForPoolTimeout = false;
+		}
+	}
+}
+
+
+/*
+ * MarkEstablishingSessionsTimedOut goes over the sessions in the given
+ * workerPool and marks them timed out. ConnectionStateMachine()
+ * later cleans up the sessions.
+ */
+static void
+MarkEstablishingSessionsTimedOut(WorkerPool *workerPool)
+{
+	WorkerSession *session = NULL;
+	foreach_ptr(session, workerPool->sessionList)
+	{
+		MultiConnection *connection = session->connection;
+
+		if (connection->connectionState == MULTI_CONNECTION_CONNECTING ||
+			connection->connectionState == MULTI_CONNECTION_INITIAL)
+		{
+			connection->connectionState = MULTI_CONNECTION_TIMED_OUT;
+		}
+	}
 }
 
 
 /*
- * ShouldRunTasksSequentially returns true if each of the individual tasks
- * should be executed one by one. Note that this is different than
- * MultiShardConnectionType == SEQUENTIAL_CONNECTION case. In that case,
- * running the tasks across the nodes in parallel is acceptable and implemented
- * in that way.
- *
- * However, the executions that are qualified here would perform poorly if the
- * tasks across the workers are executed in parallel. We currently qualify only
- * one class of distributed queries here, multi-row INSERTs. If we do not enforce
- * true sequential execution, concurrent multi-row upserts could easily form
- * a distributed deadlock when the upserts touch the same rows.
+ * UsableConnectionCount returns the number of connections in the worker pool
+ * that are (soon to be) usable for sending commands, this includes both idle
+ * connections and connections that are still establishing.
  */
-bool
-ShouldRunTasksSequentially(List *taskList)
+static int
+UsableConnectionCount(WorkerPool *workerPool)
 {
-	if (list_length(taskList) < 2)
-	{
-		/* single task plans are already qualified as sequential by definition */
-		return false;
-	}
+	int initiatedConnectionCount = list_length(workerPool->sessionList);
+	int activeConnectionCount = workerPool->activeConnectionCount;
+	int failedConnectionCount = workerPool->failedConnectionCount;
+	int idleConnectionCount = workerPool->idleConnectionCount;
 
-	/* all the tasks are the same, so we only look one */
-	Task *initialTask = (Task *) linitial(taskList);
-	if (initialTask->rowValuesLists != NIL)
-	{
-		/* found a multi-row INSERT */
-		return true;
-	}
+	/* connections that are still establishing will soon be available for tasks */
+	int establishingConnectionCount =
+		initiatedConnectionCount - activeConnectionCount - failedConnectionCount;
 
-	return false;
+	int usableConnectionCount = idleConnectionCount + establishingConnectionCount;
+
+	return usableConnectionCount;
 }
 
 
 /*
- * SequentialRunDistributedExecution gets a distributed execution and
- * executes each individual task in the execution sequentially, one
- * task at a time. See related function ShouldRunTasksSequentially()
- * for more detail on the definition of SequentialRun.
+ * NextEventTimeout finds the earliest time at which we need to interrupt
+ * WaitEventSetWait because of a timeout and returns the number of milliseconds
+ * until that event with a minimum of 1ms and a maximum of 1000ms.
+ *
+ * This code may be sensitive to clock jumps, but only has the effect of waking
+ * up WaitEventSetWait slightly earlier to later.
  */
-static void
-SequentialRunDistributedExecution(DistributedExecution *execution)
+static long
+NextEventTimeout(DistributedExecution *execution)
 {
-	List *taskList = execution->remoteTaskList;
-	int connectionMode = MultiShardConnectionType;
+	instr_time now;
+	INSTR_TIME_SET_CURRENT(now);
+	long eventTimeout = 1000; /* milliseconds */
 
-	/*
-	 * There are some implicit assumptions about this setting for the sequential
-	 * executions, so make sure to set it.
-	 */
-	MultiShardConnectionType = SEQUENTIAL_CONNECTION;
-	Task *taskToExecute = NULL;
-	foreach_ptr(taskToExecute, taskList)
+	WorkerPool *workerPool = NULL;
+	foreach_ptr(workerPool, execution->workerList)
 	{
-		execution->remoteAndLocalTaskList = list_make1(taskToExecute);
-		execution->remoteTaskList = list_make1(taskToExecute);
-		execution->totalTaskCount = 1;
-		execution->unfinishedTaskCount = 1;
+		if (workerPool->failureState == WORKER_POOL_FAILED)
+		{
+			/* worker pool may have already timed out */
+			continue;
+		}
 
-		CHECK_FOR_INTERRUPTS();
+		if (!INSTR_TIME_IS_ZERO(workerPool->poolStartTime) &&
+			workerPool->checkForPoolTimeout)
+		{
+			long timeSincePoolStartMs =
+				MillisecondsBetweenTimestamps(workerPool->poolStartTime, now);
+
+			/*
+			 * This could go into the negative if the connection timeout just passed.
+			 * In that case we want to wake up as soon as possible. Once the timeout
+			 * has been processed, checkForPoolTimeout will be false so we will skip
+			 * this check.
+			 */
+			long timeUntilConnectionTimeoutMs =
+				NodeConnectionTimeout - timeSincePoolStartMs;
+
+			if (timeUntilConnectionTimeoutMs < eventTimeout)
+			{
+				eventTimeout = timeUntilConnectionTimeoutMs;
+			}
+		}
+
+		int initiatedConnectionCount = list_length(workerPool->sessionList);
 
-		if (IsHoldOffCancellationReceived())
+		/*
+		 * If there are connections to open we wait at most up to the end of the
+		 * current slow start interval.
+		 */
+		if (workerPool->readyTaskCount > UsableConnectionCount(workerPool) &&
+			initiatedConnectionCount < execution->targetPoolSize)
 		{
-			break;
+			long timeSinceLastConnectMs =
+				MillisecondsBetweenTimestamps(workerPool->lastConnectionOpenTime, now);
+			long timeUntilSlowStartInterval =
+				ExecutorSlowStartInterval - timeSinceLastConnectMs;
+
+			if (timeUntilSlowStartInterval < eventTimeout)
+			{
+				eventTimeout = timeUntilSlowStartInterval;
+			}
 		}
+	}
 
-		/* simply call the regular execution function */
-		RunDistributedExecution(execution);
+	if (HedgedReadDelayFactor > 0)
+	{
+		/* wake up in time to start hedged reads for slow tasks */
+		WorkerSession *session = NULL;
+		foreach_ptr(session, execution->sessionList)
+		{
+			int64 timeUntilHedgedReadUs = TimeUntilHedgedRead(session, now);
+			if (timeUntilHedgedReadUs >= 0 &&
+				timeUntilHedgedReadUs / 1000 < eventTimeout)
+			{
+				eventTimeout = timeUntilHedgedReadUs / 1000;
+			}
+		}
 	}
 
-	/* set back the original execution mode */
-	MultiShardConnectionType = connectionMode;
+	return Max(1, eventTimeout);
 }
 
 
 /*
- * RunDistributedExecution runs a distributed execution to completion. It first opens
- * connections for distributed execution and assigns each task with shard placements
- * that have previously been modified in the current transaction to the connection
- * that modified them. Then, it creates a wait event set to listen for events on
- * any of the connections and runs the connection state machine when a connection
- * has an event.
+ * MillisecondsBetweenTimestamps is a helper to get the number of milliseconds
+ * between timestamps when it is expected to be small enough to fit in a
+ * long.
  */
-void
-RunDistributedExecution(DistributedExecution *execution)
+static long
+MillisecondsBetweenTimestamps(instr_time startTime, instr_time endTime)
 {
-	WaitEvent *events = NULL;
+	INSTR_TIME_SUBTRACT(endTime, startTime);
+	return INSTR_TIME_GET_MILLISEC(endTime);
+}
 
-	AssignTasksToConnectionsOrWorkerPool(execution);
 
-	PG_TRY();
-	{
-		/* Preemptively step state machines in case of immediate errors */
-		WorkerSession *session = NULL;
-		foreach_ptr(session, execution->sessionList)
-		{
-			ConnectionStateMachine(session);
-		}
+/*
+ * MicrosecondsBetweenTimestamps is a helper to get the number of microseconds
+ * between timestamps.
+ */
+static uint64
+MicrosecondsBetweenTimestamps(instr_time startTime, instr_time endTime)
+{
+	INSTR_TIME_SUBTRACT(endTime, startTime);
+	return INSTR_TIME_GET_MICROSEC(endTime);
+}
 
-		bool cancellationReceived = false;
 
-		int eventSetSize = GetEventSetSize(execution->sessionList);
+/*
+ * ConnectionStateMachine opens a connection and descends into the transaction
+ * state machine when ready.
+ */
+static void
+ConnectionStateMachine(WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
 
-		/* always (re)build the wait event set the first time */
-		execution->rebuildWaitEventSet = true;
+	MultiConnection *connection = session->connection;
+	MultiConnectionState currentState;
 
-		/*
-		 * Iterate until all the tasks are finished. Once all the tasks
-		 * are finished, ensure that that all the connection initializations
-		 * are also finished. Otherwise, those connections are terminated
-		 * abruptly before they are established (or failed). Instead, we let
-		 * the ConnectionStateMachine() to properly handle them.
-		 *
-		 * Note that we could have the connections that are not established
-		 * as a side effect of slow-start algorithm. At the time the algorithm
-		 * decides to establish new connections, the execution might have tasks
-		 * to finish. But, the execution might finish before the new connections
-		 * are established.
-		 *
-		 * Note that the rules explained above could be overriden by any
-		 * cancellation to the query. In that case, we terminate the execution
-		 * irrespective of the current status of the tasks or the connections.
-		 */
-		while (!cancellationReceived &&
-			   (execution->unfinishedTaskCount > 0 ||
-				HasIncompleteConnectionEstablishment(execution)))
+	do {
+		currentState = connection->connectionState;
+
+		switch (currentState)
 		{
-			WorkerPool *workerPool = NULL;
-			foreach_ptr(workerPool, execution->workerList)
+			case MULTI_CONNECTION_INITIAL:
 			{
-				ManageWorkerPool(workerPool);
+				/* simply iterate the state machine */
+				connection->connectionState = MULTI_CONNECTION_CONNECTING;
+				break;
+			}
+
+			case MULTI_CONNECTION_TIMED_OUT:
+			{
+				/*
+				 * When the connection timeout happens, the connection
+				 * might still be able to successfuly established. However,
+				 * the executor should not try to use this connection as
+				 * the state machines might have already progressed and used
+				 * new pools/sessions instead. That's why we terminate the
+				 * connection, clear any state associated with it.
+				 */
+				connection->connectionState = MULTI_CONNECTION_FAILED;
+				break;
 			}
 
-			bool skipWaitEvents = false;
-			if (execution->remoteTaskList == NIL)
-			{
-				/*
-				 * All the tasks are failed over to the local execution, no need
-				 * to wait for any connection activity.
-				 */
-				continue;
+			case MULTI_CONNECTION_CONNECTING:
+			{
+				ConnStatusType status = PQstatus(connection->pgConn);
+				if (status == CONNECTION_OK)
+				{
+					HandleMultiConnectionSuccess(session);
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+					break;
+				}
+				else if (status == CONNECTION_BAD)
+				{
+					connection->connectionState = MULTI_CONNECTION_FAILED;
+					break;
+				}
+
+				int beforePollSocket = PQsocket(connection->pgConn);
+				PostgresPollingStatusType pollMode = PQconnectPoll(connection->pgConn);
+
+				if (beforePollSocket != PQsocket(connection->pgConn))
+				{
+					/* rebuild the wait events if PQconnectPoll() changed the socket */
+					execution->rebuildWaitEventSet = true;
+				}
+
+				if (pollMode == PGRES_POLLING_FAILED)
+				{
+					connection->connectionState = MULTI_CONNECTION_FAILED;
+				}
+				else if (pollMode == PGRES_POLLING_READING)
+				{
+					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+
+					/* we should have a valid socket */
+					Assert(PQsocket(connection->pgConn) != -1);
+				}
+				else if (pollMode == PGRES_POLLING_WRITING)
+				{
+					UpdateConnectionWaitFlags(session, WL_SOCKET_WRITEABLE);
+
+					/* we should have a valid socket */
+					Assert(PQsocket(connection->pgConn) != -1);
+				}
+				else
+				{
+					HandleMultiConnectionSuccess(session);
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+
+					/* we should have a valid socket */
+					Assert(PQsocket(connection->pgConn) != -1);
+				}
+
+				break;
 			}
-			else if (execution->rebuildWaitEventSet)
+
+			case MULTI_CONNECTION_CONNECTED:
 			{
-				if (events != NULL)
+				if (HasUnfinishedTaskForSession(session))
 				{
 					/*
-					 * The execution might take a while, so explicitly free at this point
-					 * because we don't need anymore.
+					 * Connection is ready, and we have unfinished tasks.
+					 * So, run the transaction state machine.
 					 */
-					pfree(events);
-					events = NULL;
+					TransactionStateMachine(session);
+				}
+				else
+				{
+					/*
+					 * Connection is ready, but we don't have any unfinished
+					 * tasks that this session can execute.
+					 *
+					 * Note that we can be in a situation where the executor
+					 * decides to establish a connection, but not need to
+					 * use it at the time the connection is established. This could
+					 * happen when the earlier connections manages to finish all the
+					 * tasks after this connection
+					 *
+					 * As no tasks are ready to be executed at the moment, we
+					 * mark the socket readable to get any notices if exists.
+					 */
+					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
 				}
-				eventSetSize = RebuildWaitEventSet(execution);
-				events = palloc0(eventSetSize * sizeof(WaitEvent));
-
-				skipWaitEvents =
-					ProcessSessionsWithFailedWaitEventSetOperations(execution);
-			}
-			else if (execution->waitFlagsChanged)
-			{
-				RebuildWaitEventSetFlags(execution->waitEventSet, execution->sessionList);
-				execution->waitFlagsChanged = false;
 
-				skipWaitEvents =
-					ProcessSessionsWithFailedWaitEventSetOperations(execution);
+				break;
 			}
 
-			if (skipWaitEvents)
+			case MULTI_CONNECTION_LOST:
 			{
 				/*
-				 * Some operation on the wait event set is failed, retry
-				 * as we already removed the problematic connections.
+				 * If a connection is lost, we retry the connection for some
+				 * very restricted scenarios. The main use case is to retry
+				 * connection establishment when a cached connection is used
+				 * in the executor while remote server has restarted / failedover
+				 * etc.
+				 *
+				 * For simplicity, we only allow retrying connection establishment
+				 * a single time.
+				 *
+				 * We can only retry connection when the remote transaction has
+				 * not started over the connection. Otherwise, we'd have to deal
+				 * with restoring the transaction state, which iis beyond our
+				 * purpose at this time.
 				 */
-				execution->rebuildWaitEventSet = true;
-
-				continue;
-			}
-
-			/* wait for I/O events */
-			long timeout = NextEventTimeout(execution);
-			int eventCount = WaitEventSetWait(execution->waitEventSet, timeout, events,
-											  eventSetSize, WAIT_EVENT_CLIENT_READ);
-			ProcessWaitEvents(execution, events, eventCount, &cancellationReceived);
-		}
-
-		if (events != NULL)
-		{
-			pfree(events);
-		}
-
-		if (execution->waitEventSet != NULL)
-		{
-			FreeWaitEventSet(execution->waitEventSet);
-			execution->waitEventSet = NULL;
-		}
-
-		CleanUpSessions(execution);
-	}
-	PG_CATCH();
-	{
-		/*
-		 * We can still recover from error using ROLLBACK TO SAVEPOINT,
-		 * unclaim all connections to allow that.
-		 */
-		UnclaimAllSessionConnections(execution->sessionList);
+				RemoteTransaction *transaction = &connection->remoteTransaction;
+				if (!session->connectionRetried &&
+					transaction->transactionState == REMOTE_TRANS_NOT_STARTED)
+				{
+					/*
+					 * Try to connect again, we will reuse the same MultiConnection
+					 * and keep it as claimed.
+					 */
+					RestartConnection(connection);
 
-		if (execution->waitEventSet != NULL)
-		{
-			FreeWaitEventSet(execution->waitEventSet);
-			execution->waitEventSet = NULL;
-		}
+					/* socket have changed */
+					execution->rebuildWaitEventSet = true;
+					session->latestUnconsumedWaitEvents = 0;
 
-		PG_RE_THROW();
-	}
-	PG_END_TRY();
-}
+					session->connectionRetried = true;
 
+					break;
+				}
 
-/*
- * ProcessSessionsWithFailedWaitEventSetOperations goes over the session list
- * and processes sessions with failed wait event set operations.
- *
- * Failed sessions are not going to generate any further events, so it is our
- * only chance to process the failure by calling into `ConnectionStateMachine`.
- *
- * The function returns true if any session failed.
- */
-static bool
-ProcessSessionsWithFailedWaitEventSetOperations(DistributedExecution *execution)
-{
-	bool foundFailedSession = false;
-	WorkerSession *session = NULL;
-	foreach_ptr(session, execution->sessionList)
-	{
-		if (session->waitEventSetIndex == WAIT_EVENT_SET_INDEX_FAILED)
-		{
-			/*
-			 * We can only lost only already connected connections,
-			 * others are regular failures.
-			 */
-			MultiConnection *connection = session->connection;
-			if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
-			{
-				connection->connectionState = MULTI_CONNECTION_LOST;
-			}
-			else
-			{
 				connection->connectionState = MULTI_CONNECTION_FAILED;
+				break;
 			}
 
+			case MULTI_CONNECTION_FAILED:
+			{
+				/* managed to connect, but connection was lost */
+				if (session->sessionHasActiveConnection)
+				{
+					workerPool->activeConnectionCount--;
 
-			ConnectionStateMachine(session);
-
-			session->waitEventSetIndex = WAIT_EVENT_SET_INDEX_NOT_INITIALIZED;
-
-			foundFailedSession = true;
-		}
-	}
-
-	return foundFailedSession;
-}
-
+					if (session->currentTask == NULL)
+					{
+						/* this was an idle connection */
+						workerPool->idleConnectionCount--;
+					}
 
-/*
- * HasIncompleteConnectionEstablishment returns true if any of the connections
- * that has been initiated by the executor is in initilization stage.
- */
-static bool
-HasIncompleteConnectionEstablishment(DistributedExecution *execution)
-{
-	if (!PreventIncompleteConnectionEstablishment)
-	{
-		return false;
-	}
+					session->sessionHasActiveConnection = false;
+				}
 
-	WorkerSession *session = NULL;
-	foreach_ptr(session, execution->sessionList)
-	{
-		MultiConnection *connection = session->connection;
-		if (connection->connectionState == MULTI_CONNECTION_INITIAL ||
-			connection->connectionState == MULTI_CONNECTION_CONNECTING)
-		{
-			return true;
-		}
-	}
+				/* connection failed or was lost */
+				int totalConnectionCount = list_length(workerPool->sessionList);
 
-	return false;
-}
+				workerPool->failedConnectionCount++;
 
+				/* if the connection executed a critical command it should fail */
+				MarkRemoteTransactionFailed(connection, false);
 
-/*
- * RebuildWaitEventSet updates the waitEventSet for the distributed execution.
- * This happens when the connection set for the distributed execution is changed,
- * which means that we need to update which connections we wait on for events.
- * It returns the new event set size.
- */
-static int
-RebuildWaitEventSet(DistributedExecution *execution)
-{
-	if (execution->waitEventSet != NULL)
-	{
-		FreeWaitEventSet(execution->waitEventSet);
-		execution->waitEventSet = NULL;
-	}
+				/* mark all assigned placement executions as failed */
+				WorkerSessionFailed(session);
 
-	execution->waitEventSet = BuildWaitEventSet(execution->sessionList);
-	execution->rebuildWaitEventSet = false;
-	execution->waitFlagsChanged = false;
+				if (workerPool->failedConnectionCount >= totalConnectionCount)
+				{
+					/*
+					 * All current connection attempts have failed.
+					 * Mark all unassigned placement executions as failed.
+					 *
+					 * We do not currently retry if the first connection
+					 * attempt fails.
+					 */
+					WorkerPoolFailed(workerPool);
+				}
 
-	return GetEventSetSize(execution->sessionList);
-}
+				/*
+				 * The execution may have failed as a result of WorkerSessionFailed
+				 * or WorkerPoolFailed.
+				 *
+				 * Even if this execution has not failed -- but just a single session is
+				 * failed -- and an earlier execution in this transaction which marked
+				 * the remote transaction as critical, we should fail right away as the
+				 * transaction will fail anyway on PREPARE/COMMIT time.
+				 */
+				RemoteTransaction *transaction = &connection->remoteTransaction;
 
+				if (transaction->transactionCritical ||
+					execution->failed ||
+					(execution->transactionProperties->errorOnAnyFailure &&
+					 workerPool->failureState != WORKER_POOL_FAILED_OVER_TO_LOCAL))
+				{
+					/* a task has failed due to this connection failure */
+					ReportConnectionError(connection, ERROR);
+				}
+				else if (workerPool->activeConnectionCount > 0 ||
+						 workerPool->failureState == WORKER_POOL_FAILED_OVER_TO_LOCAL)
+				{
+					/*
+					 * We already have active connection(s) to the node, and the
+					 * executor is capable of using those connections to successfully
+					 * finish the execution. So, there is not much value in warning
+					 * the user.
+					 *
+					 * Similarly when the pool is failed over to local execution, warning
+					 * the user just creates chatter.
+					 */
+					ReportConnectionError(connection, DEBUG1);
+				}
+				else
+				{
+					ReportConnectionError(connection, WARNING);
+				}
 
-/*
- * ProcessWaitEvents processes the received events from connections.
- */
-static void
-ProcessWaitEvents(DistributedExecution *execution, WaitEvent *events, int eventCount,
-				  bool *cancellationReceived)
-{
-	int eventIndex = 0;
+				/* remove the connection */
+				UnclaimConnection(connection);
 
-	/* process I/O events */
-	for (; eventIndex < eventCount; eventIndex++)
-	{
-		WaitEvent *event = &events[eventIndex];
+				/*
+				 * We forcefully close the underlying libpq connection because
+				 * we don't want any subsequent execution (either subPlan executions
+				 * or new command executions within a transaction block) use the
+				 * connection.
+				 *
+				 * However, we prefer to keep the MultiConnection around until
+				 * the end of FinishDistributedExecution() to simplify the code.
+				 * Thus, we prefer ShutdownConnection() over CloseConnection().
+				 */
+				ShutdownConnection(connection);
 
-		if (event->events & WL_POSTMASTER_DEATH)
-		{
-			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
-		}
+				/* remove connection from wait event set */
+				execution->rebuildWaitEventSet = true;
 
-		if (event->events & WL_LATCH_SET)
-		{
-			ResetLatch(MyLatch);
+				/*
+				 * Reset the transaction state machine since CloseConnection()
+				 * relies on it and even if we're not inside a distributed transaction
+				 * we set the transaction state (e.g., REMOTE_TRANS_SENT_COMMAND).
+				 */
+				if (!connection->remoteTransaction.beginSent)
+				{
+					connection->remoteTransaction.transactionState =
+						REMOTE_TRANS_NOT_STARTED;
+				}
 
-			if (execution->raiseInterrupts)
-			{
-				CHECK_FOR_INTERRUPTS();
+				break;
 			}
 
-			if (IsHoldOffCancellationReceived())
+			default:
 			{
-				/*
-				 * Break out of event loop immediately in case of cancellation.
-				 * We cannot use "return" here inside a PG_TRY() block since
-				 * then the exception stack won't be reset.
-				 */
-				*cancellationReceived = true;
+				break;
 			}
-
-			continue;
 		}
-
-		WorkerSession *session = (WorkerSession *) event->user_data;
-		session->latestUnconsumedWaitEvents = event->events;
-
-		ConnectionStateMachine(session);
-	}
+	} while (connection->connectionState != currentState);
 }
 
 
-#if PG_VERSION_NUM >= PG_VERSION_15
-
 /*
- * ProcessWaitEventsForSocketClosed mainly checks for WL_SOCKET_CLOSED event.
- * If WL_SOCKET_CLOSED is found, the function sets the underlying connection's
- * state as MULTI_CONNECTION_LOST.
+ * HasUnfinishedTaskForSession gets a session and returns true if there
+ * are any tasks that this session can execute.
  */
 static bool
-ProcessWaitEventsForSocketClosed(WaitEvent *events, int eventCount)
+HasUnfinishedTaskForSession(WorkerSession *session)
 {
-	int eventIndex = 0;
-
-	/* process I/O events */
-	for (; eventIndex < eventCount; eventIndex++)
+	if (session->currentTask != NULL)
 	{
-		WaitEvent *event = &events[eventIndex];
-
-		if (event->events & WL_POSTMASTER_DEATH)
-		{
-			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
-		}
+		/* the session is executing a command right now */
+		return true;
+	}
 
-		WorkerSession *session = (WorkerSession *) event->user_data;
-		session->latestUnconsumedWaitEvents = event->events;
+	dlist_head *sessionReadyTaskQueue = &(session->readyTaskQueue);
+	if (!dlist_is_empty(sessionReadyTaskQueue))
+	{
+		/* session has an assigned task, which is ready for execution */
+		return true;
+	}
 
-		if (session->latestUnconsumedWaitEvents & WL_SOCKET_CLOSED)
-		{
-			return true;
-		}
+	WorkerPool *workerPool = session->workerPool;
+	dlist_head *poolReadyTaskQueue = &(workerPool->readyTaskQueue);
+	if (!dlist_is_empty(poolReadyTaskQueue))
+	{
+		/*
+		 * Pool has unassigned tasks that can be executed
+		 * by the input session.
+		 */
+		return true;
 	}
 
 	return false;
 }
 
 
-#endif
-
-
 /*
- * ManageWorkerPool ensures the worker pool has the appropriate number of connections
- * based on the number of pending tasks.
+ * HandleMultiConnectionSuccess logs the established connection and updates
+ * connection's state.
  */
 static void
-ManageWorkerPool(WorkerPool *workerPool)
+HandleMultiConnectionSuccess(WorkerSession *session)
 {
-	DistributedExecution *execution = workerPool->distributedExecution;
+	MultiConnection *connection = session->connection;
+	WorkerPool *workerPool = session->workerPool;
 
-	/* we do not expand the pool further if there was any failure */
-	if (HasAnyConnectionFailure(workerPool))
-	{
-		return;
-	}
+	/* cached connections are already marked as connected */
+	bool newlyEstablished = INSTR_TIME_IS_ZERO(connection->connectionEstablishmentEnd);
 
-	/* we wait until a slow start interval has passed before expanding the pool */
-	if (ShouldWaitForSlowStart(workerPool))
-	{
-		return;
-	}
+	MarkConnectionConnected(connection);
 
-	int newConnectionCount = CalculateNewConnectionCount(workerPool);
-	if (newConnectionCount <= 0)
+	if (newlyEstablished)
 	{
-		return;
+		RecordWorkerConnectionEstablishmentTime(
+			connection->hostname, connection->port,
+			MicrosecondsBetweenTimestamps(connection->connectionEstablishmentStart,
+										  connection->connectionEstablishmentEnd));
 	}
 
-	/* increase the open rate every cycle (like TCP slow start) */
-	workerPool->maxNewConnectionsPerCycle += 1;
-
-	OpenNewConnections(workerPool, newConnectionCount, execution->transactionProperties);
-
-	/*
-	 * Cannot establish new connections to the local host, most probably because the
-	 * local node cannot accept new connections (e.g., hit max_connections). Switch
-	 * the tasks to the local execution.
-	 *
-	 * We prefer initiatedConnectionCount over the new connection establishments happen
-	 * in this iteration via OpenNewConnections(). The reason is that it is expected for
-	 * OpenNewConnections() to not open any new connections as long as the connections
-	 * are optional (e.g., the second or later connections in the pool). But, for
-	 * initiatedConnectionCount to be zero, the connection to the local pool should have
-	 * been failed.
-	 */
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	if (initiatedConnectionCount == 0)
-	{
-		/*
-		 * Only the pools to the local node are allowed to have optional
-		 * connections for the first connection. Hence, initiatedConnectionCount
-		 * could only be zero for poolToLocalNode. For other pools, the connection
-		 * manager would wait until it gets at least one connection.
-		 */
-		Assert(workerPool->poolToLocalNode);
-
-		WorkerPoolFailed(workerPool);
-
-		if (execution->failed)
-		{
-			const char *errHint =
-				execution->localExecutionSupported ?
-				"This command supports local execution. Consider enabling "
-				"local execution using SET citus.enable_local_execution "
-				"TO true;" :
-				"Consider using a higher value for max_connections";
-
-			ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
-							errmsg("the total number of connections on the "
-								   "server is more than max_connections(%d)",
-								   MaxConnections),
-							errhint("%s", errHint)));
-		}
-
-		return;
-	}
+	ereport(DEBUG4, (errmsg("established connection to %s:%d for "
+							"session %ld in %ld microseconds",
+							connection->hostname, connection->port,
+							session->sessionId,
+							MicrosecondsBetweenTimestamps(
+								connection->connectionEstablishmentStart,
+								connection->connectionEstablishmentEnd))));
 
-	INSTR_TIME_SET_CURRENT(workerPool->lastConnectionOpenTime);
-	execution->rebuildWaitEventSet = true;
+	workerPool->activeConnectionCount++;
+	workerPool->idleConnectionCount++;
+	session->sessionHasActiveConnection = true;
 }
 
 
 /*
- * HasAnyConnectionFailure returns true if worker pool has failed,
- * or connection timed out or we have a failure in connections.
- */
-static bool
-HasAnyConnectionFailure(WorkerPool *workerPool)
-{
-	if (workerPool->failureState == WORKER_POOL_FAILED ||
-		workerPool->failureState == WORKER_POOL_FAILED_OVER_TO_LOCAL)
-	{
-		/* connection pool failed */
-		return true;
-	}
-
-	/* we might fail the execution or warn the user about connection timeouts */
-	if (workerPool->checkForPoolTimeout)
-	{
-		CheckConnectionTimeout(workerPool);
-	}
-
-	int failedConnectionCount = workerPool->failedConnectionCount;
-	if (failedConnectionCount >= 1)
+ * Activate2PCIfModifyingTransactionExpandsToNewNode sets the coordinated
+ * transaction to use 2PC under the following circumstances:
+ *     - We're already in a transaction block
+ *     - At least one of the previous commands in the transaction block
+ *       made a modification, which have not set 2PC itself because it
+ *       was a single shard command
+ *     - The input "session" is used for a distributed execution which
+ *       modifies the database. However, the session (and hence the
+ *       connection) is established to a different worker than the ones
+ *       that is used previously in the transaction.
+ *
+ *  To give an example,
+ *      BEGIN;
+ *          -- assume that the following INSERT goes to worker-A
+ *          -- also note that this single command does not activate
+ *          -- 2PC itself since it is a single shard modification
+ *          INSERT INTO distributed_table (dist_key) VALUES (1);
+ *
+ *          -- do one more single shard UPDATE hitting the same
+ *          shard (or worker node in general)
+ *          -- this wouldn't activate 2PC, since we're operating on the
+ *          -- same worker node that we've modified earlier
+ *          -- so the executor would use the same connection
+ *			UPDATE distributed_table SET value = 10 WHERE dist_key = 1;
+ *
+ *          -- now, do one more INSERT, which goes to worker-B
+ *          -- At this point, this function would activate 2PC
+ *          -- since we're now expanding to a new node
+ *          -- for example, if this command were a SELECT, we wouldn't
+ *          -- activate 2PC since we're only interested in modifications/DDLs
+ *          INSERT INTO distributed_table (dist_key) VALUES (2);
+ */
+static void
+Activate2PCIfModifyingTransactionExpandsToNewNode(WorkerSession *session)
+{
+	DistributedExecution *execution = session->workerPool->distributedExecution;
+	if (TransactionModifiedDistributedTable(execution) &&
+		DistributedExecutionModifiesDatabase(execution) &&
+		!ConnectionModifiedPlacement(session->connection))
 	{
-		/* do not attempt to open more connections after one failed */
-		return true;
+		/*
+		 * We already did a modification, but not on the connection that we
+		 * just opened, which means we're now going to make modifications
+		 * over multiple connections. Activate 2PC!
+		 */
+		Use2PCForCoordinatedTransaction();
 	}
-	return false;
 }
 
 
 /*
- * ShouldWaitForSlowStart returns true if we should wait before
- * opening a new connection because of slow start algorithm.
+ * TransactionModifiedDistributedTable returns true if the current transaction already
+ * executed a command which modified at least one distributed table in the current
+ * transaction.
  */
 static bool
-ShouldWaitForSlowStart(WorkerPool *workerPool)
+TransactionModifiedDistributedTable(DistributedExecution *execution)
 {
-	/* if we can use a connection per placement, we don't need to wait for slowstart */
-	if (UseConnectionPerPlacement())
-	{
-		return false;
-	}
-
-	/* if slow start is disabled, we can open new connections */
-	if (ExecutorSlowStartInterval == SLOW_START_DISABLED)
-	{
-		return false;
-	}
-
-	double milliSecondsPassedSince = MillisecondsPassedSince(
-		workerPool->lastConnectionOpenTime);
-	if (milliSecondsPassedSince < ExecutorSlowStartInterval)
-	{
-		return true;
-	}
-
 	/*
-	 * Refrain from establishing new connections unless we have already
-	 * finalized all the earlier connection attempts. This prevents unnecessary
-	 * load on the remote nodes and emulates the TCP slow-start algorithm.
+	 * We need to explicitly check for TRANSACTION_BLOCKS_REQUIRED due to
+	 * citus.function_opens_transaction_block flag. When set to false, we
+	 * should not be pretending that we're in a coordinated transaction even
+	 * if XACT_MODIFICATION_DATA is set. That's why we implemented this workaround.
 	 */
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	int finalizedConnectionCount =
-		workerPool->activeConnectionCount + workerPool->failedConnectionCount;
-	if (finalizedConnectionCount < initiatedConnectionCount)
-	{
-		return true;
-	}
-
-	return false;
+	return execution->transactionProperties->useRemoteTransactionBlocks ==
+		   TRANSACTION_BLOCKS_REQUIRED &&
+		   XactModificationLevel == XACT_MODIFICATION_DATA;
 }
 
 
 /*
- * CalculateNewConnectionCount returns the amount of connections
- * that we can currently open.
+ * TransactionStateMachine manages the execution of tasks over a connection.
  */
-static int
-CalculateNewConnectionCount(WorkerPool *workerPool)
+static void
+TransactionStateMachine(WorkerSession *session)
 {
+	WorkerPool *workerPool = session->workerPool;
 	DistributedExecution *execution = workerPool->distributedExecution;
+	TransactionBlocksUsage useRemoteTransactionBlocks =
+		execution->transactionProperties->useRemoteTransactionBlocks;
 
-	int targetPoolSize = execution->targetPoolSize;
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	int activeConnectionCount PG_USED_FOR_ASSERTS_ONLY =
-		workerPool->activeConnectionCount;
-	int idleConnectionCount PG_USED_FOR_ASSERTS_ONLY =
-		workerPool->idleConnectionCount;
-	int readyTaskCount = workerPool->readyTaskCount;
-	int newConnectionCount = 0;
+	MultiConnection *connection = session->connection;
+	RemoteTransaction *transaction = &(connection->remoteTransaction);
+	RemoteTransactionState currentState;
 
+	do {
+		currentState = transaction->transactionState;
 
-	/* we should always have more (or equal) active connections than idle connections */
-	Assert(activeConnectionCount >= idleConnectionCount);
+		if (!CheckConnectionReady(session))
+		{
+			/* connection is busy, no state transitions to make */
+			break;
+		}
 
-	/* we should always have more (or equal) initiated connections than active connections */
-	Assert(initiatedConnectionCount >= activeConnectionCount);
+		switch (currentState)
+		{
+			case REMOTE_TRANS_NOT_STARTED:
+			{
+				if (useRemoteTransactionBlocks == TRANSACTION_BLOCKS_REQUIRED)
+				{
+					/* if we're expanding the nodes in a transaction, use 2PC */
+					Activate2PCIfModifyingTransactionExpandsToNewNode(session);
 
-	/* we should never have less than 0 connections ever */
-	Assert(activeConnectionCount >= 0 && idleConnectionCount >= 0);
+					/* need to open a transaction block first */
+					StartRemoteTransactionBegin(connection);
 
-	if (UseConnectionPerPlacement())
-	{
-		int unusedConnectionCount = workerPool->unusedConnectionCount;
+					transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
+				}
+				else
+				{
+					TaskPlacementExecution *placementExecution = PopPlacementExecution(
+						session);
+					if (placementExecution == NULL)
+					{
+						/*
+						 * No tasks are ready to be executed at the moment. But we
+						 * still mark the socket readable to get any notices if exists.
+						 */
+						UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
 
-		/*
-		 * If force_max_query_parallelization is enabled then we ignore pool size
-		 * and idle connections. Instead, we open new connections as long as there
-		 * are more tasks than unused connections.
-		 */
+						break;
+					}
 
-		newConnectionCount = Max(readyTaskCount - unusedConnectionCount, 0);
-	}
-	else
-	{
-		/* cannot open more than targetPoolSize connections */
-		int maxNewConnectionCount = targetPoolSize - initiatedConnectionCount;
+					bool placementExecutionStarted =
+						StartPlacementExecutionOnSession(placementExecution, session);
+					if (!placementExecutionStarted)
+					{
+						/* no need to continue, connection is lost */
+						Assert(session->connection->connectionState ==
+							   MULTI_CONNECTION_LOST);
+
+						return;
+					}
+
+					transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
+				}
+
+				UpdateConnectionWaitFlags(session,
+										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+				break;
+			}
+
+			case REMOTE_TRANS_SENT_BEGIN:
+			case REMOTE_TRANS_CLEARING_RESULTS:
+			{
+				PGresult *result = PQgetResult(connection->pgConn);
+				if (result != NULL)
+				{
+					if (!IsResponseOK(result) && !IsPipelineSyncResult(result))
+					{
+						/* query failures are always hard errors */
+						ReportResultError(connection, result, ERROR);
+					}
+
+					PQclear(result);
+
+					/* wake up WaitEventSetWait */
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+
+					break;
+				}
+
+				if (!ExitPipelineModeIfDone(connection))
+				{
+					/* we consumed all results of the pipeline, this is unexpected */
+					connection->connectionState = MULTI_CONNECTION_LOST;
+					return;
+				}
+
+				if (session->currentTask != NULL)
+				{
+					TaskPlacementExecution *placementExecution = session->currentTask;
+
+					/*
+					 * The copy of a hedged read whose results we discarded does
+					 * not count as a successful execution of the task.
+					 */
+					bool succeeded = !PlacementExecutionLostHedgedRead(placementExecution);
+
+					/*
+					 * Once we finished a task on a connection, we no longer
+					 * allow that connection to fail.
+					 */
+					MarkRemoteTransactionCritical(connection);
+
+					session->currentTask = NULL;
+
+					PlacementExecutionDone(placementExecution, succeeded);
+
+					/* connection is ready to use for executing commands */
+					workerPool->idleConnectionCount++;
+				}
+
+				/* connection needs to be writeable to send next command */
+				UpdateConnectionWaitFlags(session,
+										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+
+				if (transaction->beginSent)
+				{
+					transaction->transactionState = REMOTE_TRANS_STARTED;
+				}
+				else
+				{
+					transaction->transactionState = REMOTE_TRANS_NOT_STARTED;
+				}
+				break;
+			}
+
+			case REMOTE_TRANS_STARTED:
+			{
+				TaskPlacementExecution *placementExecution = PopPlacementExecution(
+					session);
+				if (placementExecution == NULL)
+				{
+					/* no tasks are ready to be executed at the moment */
+					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+					break;
+				}
+
+				bool placementExecutionStarted =
+					StartPlacementExecutionOnSession(placementExecution, session);
+				if (!placementExecutionStarted)
+				{
+					/* no need to continue, connection is lost */
+					Assert(session->connection->connectionState == MULTI_CONNECTION_LOST);
+
+					return;
+				}
+
+				transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
+				break;
+			}
+
+			case REMOTE_TRANS_SENT_COMMAND:
+			{
+				TaskPlacementExecution *placementExecution = session->currentTask;
+				if (placementExecution == NULL)
+				{
+					/*
+					 * We have seen accounts in production where the placementExecution
+					 * could inadvertently be not set. Investigation documented on
+					 * https://github.com/citusdata/citus-enterprise/issues/493
+					 * (due to sensitive data in the initial report it is not discussed
+					 * in our community repository)
+					 *
+					 * Currently we don't have a reliable way of reproducing this issue.
+					 * Erroring here seems to be a more desirable approach compared to a
+					 * SEGFAULT on the dereference of placementExecution, with a possible
+					 * crash recovery as a result.
+					 */
+					ereport(ERROR, (errmsg(
+										"unable to recover from inconsistent state in "
+										"the connection state machine on coordinator")));
+				}
 
-		/* total number of connections that are (almost) available for tasks */
-		int usableConnectionCount = UsableConnectionCount(workerPool);
+				ShardCommandExecution *shardCommandExecution =
+					placementExecution->shardCommandExecution;
+				Task *task = shardCommandExecution->task;
 
-		/*
-		 * Number of additional connections we would need to run all ready tasks in
-		 * parallel.
-		 */
-		int newConnectionsForReadyTasks = Max(0, readyTaskCount - usableConnectionCount);
+				/*
+				 * In EXPLAIN ANALYZE we need to store results except for multiple placements,
+				 * regardless of query type. In other cases, doing the same doesn't seem to have
+				 * a drawback.
+				 */
+				bool storeRows = true;
 
-		/* If Slow start is enabled we need to update the maxNewConnection to the current cycle's maximum.*/
-		if (ExecutorSlowStartInterval != SLOW_START_DISABLED)
-		{
-			maxNewConnectionCount = Min(workerPool->maxNewConnectionsPerCycle,
-										maxNewConnectionCount);
-		}
+				if (shardCommandExecution->gotResults)
+				{
+					/* already received results from another replica */
+					storeRows = false;
+				}
+				else if (task->partiallyLocalOrRemote)
+				{
+					/*
+					 * For the tasks that involves placements from both
+					 * remote and local placments, such as modifications
+					 * to reference tables, we store the rows during the
+					 * local placement/execution.
+					 */
+					storeRows = false;
+				}
 
-		/*
-		 * Open enough connections to handle all tasks that are ready, but no more
-		 * than the target pool size.
-		 */
-		newConnectionCount = Min(newConnectionsForReadyTasks, maxNewConnectionCount);
-		if (EnableCostBasedConnectionEstablishment && newConnectionCount > 0 &&
-			initiatedConnectionCount <= MaxCachedConnectionsPerWorker &&
-			UsingExistingSessionsCheaperThanEstablishingNewConnections(
-				readyTaskCount, workerPool))
-		{
-			/*
-			 * Before giving the decision, we do one more check. If the cost of
-			 * executing the remaining tasks over the existing sessions in the
-			 * pool is cheaper than establishing new connections and executing
-			 * the tasks over the new connections, we prefer the former.
-			 *
-			 * For cached connections we should ignore any optimizations as
-			 * cached connections are almost free to get. In other words,
-			 * as long as there are cached connections that the pool has
-			 * not used yet, aggressively use these already established
-			 * connections.
-			 *
-			 * Note that until MaxCachedConnectionsPerWorker has already been
-			 * established within the session, we still need to establish
-			 * the connections right now.
-			 *
-			 * Also remember that we are not trying to find the optimal number
-			 * of connections for the remaining tasks here. Our goal is to prevent
-			 * connection establishments that are absolutely unnecessary. In the
-			 * future, we may improve the calculations below to find the optimal
-			 * number of new connections required.
-			 */
-			return 0;
-		}
-	}
+				instr_time receiveStart;
+				if (execution->collectNetworkMetrics)
+				{
+					INSTR_TIME_SET_CURRENT(receiveStart);
+				}
 
-	return newConnectionCount;
-}
+				bool fetchDone = ReceiveResults(session, storeRows);
 
+				if (execution->collectNetworkMetrics)
+				{
+					instr_time receiveEnd;
+					INSTR_TIME_SET_CURRENT(receiveEnd);
+					INSTR_TIME_ACCUM_DIFF(execution->resultDecodeTime, receiveEnd,
+										  receiveStart);
+				}
 
-/*
- * UsingExistingSessionsCheaperThanEstablishingNewConnections returns true if
- * using the already established connections takes less time compared to opening
- * new connections based on the current execution's stats.
- *
- * The function returns false if the current execution has not established any connections
- * or finished any tasks (e.g., no stats to act on).
- */
-static bool
-UsingExistingSessionsCheaperThanEstablishingNewConnections(int readyTaskCount,
-														   WorkerPool *workerPool)
-{
-	int activeConnectionCount = workerPool->activeConnectionCount;
-	if (workerPool->totalExecutedTasks < 1 || activeConnectionCount < 1)
-	{
-		/*
-		 * The pool has not finished any connection establishment or
-		 * task yet. So, we refrain from optimizing the execution.
-		 */
-		return false;
-	}
+				if (!fetchDone)
+				{
+					break;
+				}
 
-	double avgTaskExecutionTime = AvgTaskExecutionTimeApproximation(workerPool);
-	double avgConnectionEstablishmentTime = AvgConnectionEstablishmentTime(workerPool);
+				/* if this is a multi-query task, send the next query */
+				if (placementExecution->queryIndex < task->queryCount)
+				{
+					bool querySent = SendNextQuery(placementExecution, session);
+					if (!querySent)
+					{
+						/* no need to continue, connection is lost */
+						Assert(session->connection->connectionState ==
+							   MULTI_CONNECTION_LOST);
 
-	/* we assume that we are halfway through the execution */
-	double remainingTimeForActiveTaskExecutionsToFinish = avgTaskExecutionTime / 2;
+						return;
+					}
 
-	/*
-	 * We use "newConnectionCount" as if it is the task count as
-	 * we are only interested in this iteration of CalculateNewConnectionCount().
-	 */
-	double totalTimeToExecuteNewTasks = avgTaskExecutionTime * readyTaskCount;
+					/*
+					 * At this point the query might be just in pgconn buffers. We
+					 * need to wait until it becomes writeable to actually send
+					 * the query.
+					 */
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_WRITEABLE | WL_SOCKET_READABLE);
 
-	double estimatedExecutionTimeForNewTasks =
-		floor(totalTimeToExecuteNewTasks / activeConnectionCount);
+					transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
 
-	/*
-	 * First finish the already running tasks, and then use the connections
-	 * to execute the new tasks.
-	 */
-	double costOfExecutingTheTasksOverExistingConnections =
-		remainingTimeForActiveTaskExecutionsToFinish +
-		estimatedExecutionTimeForNewTasks;
+					break;
+				}
 
-	/*
-	 * For every task, the executor is supposed to establish one
-	 * connection and then execute the task over the connection.
-	 */
-	double costOfExecutingTheTasksOverNewConnection =
-		(avgTaskExecutionTime + avgConnectionEstablishmentTime);
+				if (!PlacementExecutionLostHedgedRead(placementExecution))
+				{
+					shardCommandExecution->gotResults = true;
+				}
 
-	return (costOfExecutingTheTasksOverExistingConnections <=
-			costOfExecutingTheTasksOverNewConnection);
-}
+				if (!dlist_is_empty(&session->pipelinedTaskQueue))
+				{
+					/* results of the next pipelined task follow on the connection */
+					if (!AdvancePipelinedPlacementExecution(session))
+					{
+						/* no need to continue, connection is lost */
+						Assert(session->connection->connectionState ==
+							   MULTI_CONNECTION_LOST);
 
+						return;
+					}
 
-/*
- * AvgTaskExecutionTimeApproximation returns the approximation of the average task
- * execution times on the workerPool.
- */
-static double
-AvgTaskExecutionTimeApproximation(WorkerPool *workerPool)
-{
-	uint64 totalTaskExecutionTime = workerPool->totalTaskExecutionTime;
-	int taskCount = workerPool->totalExecutedTasks;
+					/* the results might already be buffered, wake up WaitEventSetWait */
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_WRITEABLE | WL_SOCKET_READABLE);
 
-	instr_time now;
-	INSTR_TIME_SET_CURRENT(now);
+					break;
+				}
 
-	WorkerSession *session = NULL;
-	foreach_ptr(session, workerPool->sessionList)
-	{
-		/*
-		 * Involve the tasks that are currently running. We do this to
-		 * make sure that the execution responds with new connections
-		 * quickly if the actively running tasks
-		 */
-		TaskPlacementExecution *placementExecution = session->currentTask;
-		if (placementExecution != NULL &&
-			placementExecution->executionState == PLACEMENT_EXECUTION_RUNNING)
-		{
-			uint64 durationInMicroSecs =
-				MicrosecondsBetweenTimestamps(placementExecution->startTime, now);
+				transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
+				break;
+			}
 
-			/*
-			 * Our approximation is that we assume that the task execution is
-			 * just in the halfway through.
-			 */
-			totalTaskExecutionTime += (2 * durationInMicroSecs);
-			taskCount += 1;
+			default:
+			{
+				break;
+			}
 		}
 	}
-
-	return taskCount == 0 ? 0 : ((double) totalTaskExecutionTime / taskCount);
+	/* iterate in case we can perform multiple transitions at once */
+	while (transaction->transactionState != currentState);
 }
 
 
 /*
- * AvgConnectionEstablishmentTime calculates the average connection establishment times
- * for the input workerPool.
+ * UpdateConnectionWaitFlags is a wrapper around setting waitFlags of the connection.
+ *
+ * This function might further improved in a sense that to use use ModifyWaitEvent on
+ * waitFlag changes as opposed to what we do now: always rebuild the wait event sets.
+ * Our initial benchmarks didn't show any significant performance improvements, but
+ * good to keep in mind the potential improvements.
  */
-static double
-AvgConnectionEstablishmentTime(WorkerPool *workerPool)
+static void
+UpdateConnectionWaitFlags(WorkerSession *session, int waitFlags)
 {
-	double totalTimeMicrosec = 0;
-	int sessionCount = 0;
+	MultiConnection *connection = session->connection;
+	DistributedExecution *execution = session->workerPool->distributedExecution;
 
-	WorkerSession *session = NULL;
-	foreach_ptr(session, workerPool->sessionList)
+	/* do not take any actions if the flags not changed */
+	if (connection->waitFlags == waitFlags)
 	{
-		MultiConnection *connection = session->connection;
+		return;
+	}
 
-		/*
-		 * There could be MaxCachedConnectionsPerWorker connections that are
-		 * already connected. Those connections might skew the average
-		 * connection establishment times for the current execution. The reason
-		 * is that they are established earlier and the connection establishment
-		 * times might be different at the moment those connections are established.
-		 */
-		if (connection->connectionState == MULTI_CONNECTION_CONNECTED)
-		{
-			long connectionEstablishmentTime =
-				MicrosecondsBetweenTimestamps(connection->connectionEstablishmentStart,
-											  connection->connectionEstablishmentEnd);
+#if PG_VERSION_NUM >= PG_VERSION_15
 
-			totalTimeMicrosec += connectionEstablishmentTime;
-			++sessionCount;
-		}
-	}
+	/* always detect closed sockets */
+	connection->waitFlags = waitFlags | WL_SOCKET_CLOSED;
+#else
+	connection->waitFlags = waitFlags;
+#endif
 
-	return (sessionCount == 0) ? 0 : (totalTimeMicrosec / sessionCount);
+	/* without signalling the execution, the flag changes won't be reflected */
+	execution->waitFlagsChanged = true;
 }
 
 
 /*
- * OpenNewConnections opens the given amount of connections for the given workerPool.
+ * CheckConnectionReady returns true if the connection is ready to
+ * read or write, or false if it still has bytes to send/receive.
  */
-static void
-OpenNewConnections(WorkerPool *workerPool, int newConnectionCount,
-				   TransactionProperties *transactionProperties)
+static bool
+CheckConnectionReady(WorkerSession *session)
 {
-	ereport(DEBUG4, (errmsg("opening %d new connections to %s:%d", newConnectionCount,
-							workerPool->nodeName, workerPool->nodePort)));
+	MultiConnection *connection = session->connection;
+	int waitFlags = WL_SOCKET_READABLE;
+	bool connectionReady = false;
 
-	for (int connectionIndex = 0; connectionIndex < newConnectionCount; connectionIndex++)
+	ConnStatusType status = PQstatus(connection->pgConn);
+	if (status == CONNECTION_BAD)
 	{
-		/* experimental: just to see the perf benefits of caching connections */
-		int connectionFlags = 0;
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
 
-		if (transactionProperties->useRemoteTransactionBlocks ==
-			TRANSACTION_BLOCKS_DISALLOWED)
-		{
-			connectionFlags |= OUTSIDE_TRANSACTION;
-		}
+#if PG_VERSION_NUM >= PG_VERSION_15
+	if ((session->latestUnconsumedWaitEvents & WL_SOCKET_CLOSED) != 0)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
+#endif
 
-		/*
-		 * Enforce the requirements for adaptive connection management (a.k.a.,
-		 * throttle connections if citus.max_shared_pool_size reached)
-		 */
-		int adaptiveConnectionManagementFlag =
-			AdaptiveConnectionManagementFlag(workerPool->poolToLocalNode,
-											 list_length(workerPool->sessionList));
-		connectionFlags |= adaptiveConnectionManagementFlag;
+	/* try to send all pending data */
+	int sendStatus = PQflush(connection->pgConn);
+	if (sendStatus == -1)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
+	else if (sendStatus == 1)
+	{
+		/* more data to send, wait for socket to become writable */
+		waitFlags = waitFlags | WL_SOCKET_WRITEABLE;
+	}
 
-		/* open a new connection to the worker */
-		MultiConnection *connection = StartNodeUserDatabaseConnection(connectionFlags,
-																	  workerPool->nodeName,
-																	  workerPool->nodePort,
-																	  NULL, NULL);
-		if (!connection)
+	if ((session->latestUnconsumedWaitEvents & WL_SOCKET_READABLE) != 0)
+	{
+		if (PQconsumeInput(connection->pgConn) == 0)
 		{
-			/* connection can only be NULL for optional connections */
-			Assert((connectionFlags & OPTIONAL_CONNECTION));
-			continue;
+			connection->connectionState = MULTI_CONNECTION_LOST;
+			return false;
 		}
+	}
 
-		/*
-		 * Assign the initial state in the connection state machine. The connection
-		 * may already be open, but ConnectionStateMachine will immediately detect
-		 * this.
-		 */
-		connection->connectionState = MULTI_CONNECTION_CONNECTING;
+	if (!PQisBusy(connection->pgConn))
+	{
+		connectionReady = true;
+	}
 
-		/*
-		 * Ensure that subsequent calls to StartNodeUserDatabaseConnection get a
-		 * different connection.
-		 */
-		connection->claimedExclusively = true;
+	UpdateConnectionWaitFlags(session, waitFlags);
 
-		if (list_length(workerPool->sessionList) == 0)
+	/* don't consume input redundantly if we cycle back into CheckConnectionReady */
+	session->latestUnconsumedWaitEvents = 0;
+
+	return connectionReady;
+}
+
+
+/*
+ * PopPlacementExecution returns the next available assigned or unassigned
+ * placement execution for the given session.
+ */
+static TaskPlacementExecution *
+PopPlacementExecution(WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+
+	TaskPlacementExecution *placementExecution = PopAssignedPlacementExecution(session);
+	if (placementExecution == NULL)
+	{
+		if (session->commandsSent > 0 && UseConnectionPerPlacement())
 		{
 			/*
-			 * The worker pool has just started to establish connections. We need to
-			 * defer this initilization after StartNodeUserDatabaseConnection()
-			 * because for non-optional connections, we have some logic to wait
-			 * until a connection is allowed to be established.
+			 * Only send one command per connection if force_max_query_parallelisation
+			 * is enabled, unless it's an assigned placement execution.
 			 */
-			INSTR_TIME_SET_ZERO(workerPool->poolStartTime);
+			return NULL;
 		}
 
-		/* create a session for the connection */
-		WorkerSession *session = FindOrCreateWorkerSession(workerPool, connection);
-
-		/* immediately run the state machine to handle potential failure */
-		ConnectionStateMachine(session);
+		/* no more assigned tasks, pick an unassigned task */
+		placementExecution = PopUnassignedPlacementExecution(workerPool);
 	}
+
+	return placementExecution;
 }
 
 
 /*
- * CheckConnectionTimeout makes sure that the execution enforces the connection
- * establishment timeout defined by the user (NodeConnectionTimeout).
- *
- * The rule is that if a worker pool has already initiated connection establishment
- * and has not succeeded to finish establishments that are necessary to execute tasks,
- * take an action. For the types of actions, see the comments in the function.
- *
- * Enforcing the timeout per pool (over per session) helps the execution to continue
- * even if we can establish a single connection as we expect to have target pool size
- * number of connections. In the end, the executor is capable of using one connection
- * to execute multiple tasks.
+ * PopAssignedPlacementExecution finds an executable task from the queue of assigned tasks.
  */
-static void
-CheckConnectionTimeout(WorkerPool *workerPool)
+static TaskPlacementExecution *
+PopAssignedPlacementExecution(WorkerSession *session)
 {
-	DistributedExecution *execution = workerPool->distributedExecution;
-	instr_time poolStartTime = workerPool->poolStartTime;
-	instr_time now;
-	INSTR_TIME_SET_CURRENT(now);
-
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	int activeConnectionCount = workerPool->activeConnectionCount;
-	int requiredActiveConnectionCount = 1;
-
-	if (initiatedConnectionCount == 0)
-	{
-		/* no connection has been planned for the pool yet */
-		Assert(INSTR_TIME_IS_ZERO(poolStartTime));
-		return;
-	}
+	dlist_head *readyTaskQueue = &(session->readyTaskQueue);
 
-	/*
-	 * This is a special case where we assign tasks to sessions even before
-	 * the connections are established. So, make sure to apply similar
-	 * restrictions. In this case, make sure that we get all the connections
-	 * established.
-	 */
-	if (UseConnectionPerPlacement())
+	if (dlist_is_empty(readyTaskQueue))
 	{
-		requiredActiveConnectionCount = initiatedConnectionCount;
+		return NULL;
 	}
 
-	if (MillisecondsBetweenTimestamps(poolStartTime, now) >= NodeConnectionTimeout)
-	{
-		if (activeConnectionCount < requiredActiveConnectionCount)
-		{
-			int logLevel = WARNING;
-
-			/*
-			 * First fail the pool and create an opportunity to execute tasks
-			 * over other pools when tasks have more than one placement to execute.
-			 */
-			WorkerPoolFailed(workerPool);
-
-			if (workerPool->failureState == WORKER_POOL_FAILED_OVER_TO_LOCAL)
-			{
-				/*
-				 *
-				 * When the pool is failed over to local execution, warning
-				 * the user just creates chatter as the executor is capable of
-				 * finishing the execution.
-				 */
-				logLevel = DEBUG1;
-			}
-			else if (execution->transactionProperties->errorOnAnyFailure ||
-					 execution->failed)
-			{
-				/*
-				 * The enforcement is not always erroring out. For example, if a SELECT task
-				 * has two different placements, we'd warn the user, fail the pool and continue
-				 * with the next placement.
-				 */
-				logLevel = ERROR;
-			}
-
-			ereport(logLevel, (errcode(ERRCODE_CONNECTION_FAILURE),
-							   errmsg("could not establish any connections to the node "
-									  "%s:%d after %u ms", workerPool->nodeName,
-									  workerPool->nodePort,
-									  NodeConnectionTimeout)));
+	TaskPlacementExecution *placementExecution = dlist_container(TaskPlacementExecution,
+																 sessionReadyQueueNode,
+																 dlist_pop_head_node(
+																	 readyTaskQueue));
 
-			/*
-			 * We hit the connection timeout. In that case, we should not let the
-			 * connection establishment to continue because the execution logic
-			 * pretends that failed sessions are not going to be used anymore.
-			 *
-			 * That's why we mark the connection as timed out to trigger the state
-			 * changes in the executor.
-			 */
-			MarkEstablishingSessionsTimedOut(workerPool);
-		}
-		else
-		{
-			/* stop interrupting WaitEventSetWait for timeouts */
-			workerPool->checkForPoolTimeout = false;
-		}
-	}
+	return placementExecution;
 }
 
 
 /*
- * MarkEstablishingSessionsTimedOut goes over the sessions in the given
- * workerPool and marks them timed out. ConnectionStateMachine()
- * later cleans up the sessions.
+ * PopAssignedPlacementExecution finds an executable task from the queue of assigned tasks.
  */
-static void
-MarkEstablishingSessionsTimedOut(WorkerPool *workerPool)
+static TaskPlacementExecution *
+PopUnassignedPlacementExecution(WorkerPool *workerPool)
 {
-	WorkerSession *session = NULL;
-	foreach_ptr(session, workerPool->sessionList)
-	{
-		MultiConnection *connection = session->connection;
+	dlist_head *readyTaskQueue = &(workerPool->readyTaskQueue);
 
-		if (connection->connectionState == MULTI_CONNECTION_CONNECTING ||
-			connection->connectionState == MULTI_CONNECTION_INITIAL)
-		{
-			connection->connectionState = MULTI_CONNECTION_TIMED_OUT;
-		}
+	if (dlist_is_empty(readyTaskQueue))
+	{
+		return NULL;
 	}
+
+	TaskPlacementExecution *placementExecution = dlist_container(TaskPlacementExecution,
+																 workerReadyQueueNode,
+																 dlist_pop_head_node(
+																	 readyTaskQueue));
+
+	workerPool->readyTaskCount--;
+
+	return placementExecution;
 }
 
 
 /*
- * UsableConnectionCount returns the number of connections in the worker pool
- * that are (soon to be) usable for sending commands, this includes both idle
- * connections and connections that are still establishing.
+ * StartPlacementExecutionOnSession gets a TaskPlacementExecution and
+ * WorkerSession, the task's query is sent to the worker via the session.
+ *
+ * The function does some bookkeeping such as associating the placement
+ * accesses with the connection and updating session's local variables. For
+ * details read the comments in the function.
+ *
+ * The function returns true if the query is successfully sent over the
+ * connection, otherwise false.
  */
-static int
-UsableConnectionCount(WorkerPool *workerPool)
+static bool
+StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
+								 WorkerSession *session)
 {
-	int initiatedConnectionCount = list_length(workerPool->sessionList);
-	int activeConnectionCount = workerPool->activeConnectionCount;
-	int failedConnectionCount = workerPool->failedConnectionCount;
-	int idleConnectionCount = workerPool->idleConnectionCount;
+	WorkerPool *workerPool = session->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+	MultiConnection *connection = session->connection;
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+	Task *task = shardCommandExecution->task;
+	ShardPlacement *taskPlacement = placementExecution->shardPlacement;
+	List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
 
-	/* connections that are still establishing will soon be available for tasks */
-	int establishingConnectionCount =
-		initiatedConnectionCount - activeConnectionCount - failedConnectionCount;
+	if (execution->transactionProperties->useRemoteTransactionBlocks !=
+		TRANSACTION_BLOCKS_DISALLOWED)
+	{
+		/*
+		 * Make sure that subsequent commands on the same placement
+		 * use the same connection.
+		 */
+		AssignPlacementListToConnection(placementAccessList, connection);
+	}
 
-	int usableConnectionCount = idleConnectionCount + establishingConnectionCount;
+	if (session->commandsSent == 0)
+	{
+		/* first time we send a command, consider the connection used (not unused) */
+		workerPool->unusedConnectionCount--;
+	}
 
-	return usableConnectionCount;
-}
+	/* connection is going to be in use */
+	workerPool->idleConnectionCount--;
+	session->currentTask = placementExecution;
+	placementExecution->executionState = PLACEMENT_EXECUTION_RUNNING;
+	AddToSharedRunningTaskCount(placementExecution);
 
+	Assert(INSTR_TIME_IS_ZERO(placementExecution->startTime));
 
-/*
- * NextEventTimeout finds the earliest time at which we need to interrupt
- * WaitEventSetWait because of a timeout and returns the number of milliseconds
- * until that event with a minimum of 1ms and a maximum of 1000ms.
- *
- * This code may be sensitive to clock jumps, but only has the effect of waking
- * up WaitEventSetWait slightly earlier to later.
- */
-static long
-NextEventTimeout(DistributedExecution *execution)
-{
-	instr_time now;
-	INSTR_TIME_SET_CURRENT(now);
-	long eventTimeout = 1000; /* milliseconds */
+	/*
+	 * The same TaskPlacementExecution can be used to have
+	 * call SendNextQuery() several times if queryIndex is
+	 * non-zero. Still, all are executed under the current
+	 * placementExecution, so we can start the timer right
+	 * now.
+	 */
+	INSTR_TIME_SET_CURRENT(placementExecution->startTime);
 
-	WorkerPool *workerPool = NULL;
-	foreach_ptr(workerPool, execution->workerList)
+	if (shardCommandExecution->taskProgress != NULL)
 	{
-		if (workerPool->failureState == WORKER_POOL_FAILED)
-		{
-			/* worker pool may have already timed out */
-			continue;
-		}
+		ReportShardTaskStarted(shardCommandExecution->taskProgress);
+	}
 
-		if (!INSTR_TIME_IS_ZERO(workerPool->poolStartTime) &&
-			workerPool->checkForPoolTimeout)
-		{
-			long timeSincePoolStartMs =
-				MillisecondsBetweenTimestamps(workerPool->poolStartTime, now);
+	/*
+	 * If more tasks that can share a pipeline are waiting for this session,
+	 * we send them back-to-back to save a round trip per task.
+	 */
+	bool usePipeline = false;
 
-			/*
-			 * This could go into the negative if the connection timeout just passed.
-			 * In that case we want to wake up as soon as possible. Once the timeout
-			 * has been processed, checkForPoolTimeout will be false so we will skip
-			 * this check.
-			 */
-			long timeUntilConnectionTimeoutMs =
-				NodeConnectionTimeout - timeSincePoolStartMs;
+	if (CanPipelinePlacementExecution(placementExecution))
+	{
+		TaskPlacementExecution *nextPlacementExecution = PeekPlacementExecution(session);
 
-			if (timeUntilConnectionTimeoutMs < eventTimeout)
-			{
-				eventTimeout = timeUntilConnectionTimeoutMs;
-			}
+		if (nextPlacementExecution != NULL &&
+			CanPipelinePlacementExecution(nextPlacementExecution))
+		{
+			usePipeline = EnterPipelineMode(connection);
 		}
+	}
 
-		int initiatedConnectionCount = list_length(workerPool->sessionList);
+	bool querySent = SendNextQuery(placementExecution, session);
+	if (querySent)
+	{
+		session->commandsSent++;
+		INSTR_TIME_SET_CURRENT(placementExecution->querySentTime);
 
-		/*
-		 * If there are connections to open we wait at most up to the end of the
-		 * current slow start interval.
-		 */
-		if (workerPool->readyTaskCount > UsableConnectionCount(workerPool) &&
-			initiatedConnectionCount < execution->targetPoolSize)
+		if (workerPool->poolToLocalNode)
 		{
-			long timeSinceLastConnectMs =
-				MillisecondsBetweenTimestamps(workerPool->lastConnectionOpenTime, now);
-			long timeUntilSlowStartInterval =
-				ExecutorSlowStartInterval - timeSinceLastConnectMs;
-
-			if (timeUntilSlowStartInterval < eventTimeout)
-			{
-				eventTimeout = timeUntilSlowStartInterval;
-			}
+			/*
+			 * As we started remote execution to the local node,
+			 * we cannot switch back to local execution as that
+			 * would cause self-deadlocks and breaking
+			 * read-your-own-writes consistency.
+			 */
+			SetLocalExecutionStatus(LOCAL_EXECUTION_DISABLED);
 		}
 	}
 
-	return Max(1, eventTimeout);
+	if (querySent && usePipeline)
+	{
+		querySent = SendPipelinedPlacementExecutions(session);
+	}
+
+	return querySent;
 }
 
 
 /*
- * MillisecondsBetweenTimestamps is a helper to get the number of milliseconds
- * between timestamps when it is expected to be small enough to fit in a
- * long.
+ * PeekPlacementExecution returns the placement execution that the next call
+ * to PopPlacementExecution would return for the session, without removing it
+ * from its queue.
  */
-static long
-MillisecondsBetweenTimestamps(instr_time startTime, instr_time endTime)
+static TaskPlacementExecution *
+PeekPlacementExecution(WorkerSession *session)
 {
-	INSTR_TIME_SUBTRACT(endTime, startTime);
-	return INSTR_TIME_GET_MILLISEC(endTime);
+	WorkerPool *workerPool = session->workerPool;
+
+	dlist_head *sessionReadyTaskQueue = &(session->readyTaskQueue);
+	if (!dlist_is_empty(sessionReadyTaskQueue))
+	{
+		return dlist_container(TaskPlacementExecution, sessionReadyQueueNode,
+							   dlist_head_node(sessionReadyTaskQueue));
+	}
+
+	if (session->commandsSent > 0 && UseConnectionPerPlacement())
+	{
+		/* PopPlacementExecution does not pick unassigned tasks in this case */
+		return NULL;
+	}
+
+	dlist_head *poolReadyTaskQueue = &(workerPool->readyTaskQueue);
+	if (!dlist_is_empty(poolReadyTaskQueue))
+	{
+		return dlist_container(TaskPlacementExecution, workerReadyQueueNode,
+							   dlist_head_node(poolReadyTaskQueue));
+	}
+
+	return NULL;
 }
 
 
 /*
- * MicrosecondsBetweenTimestamps is a helper to get the number of microseconds
- * between timestamps.
+ * CanPipelinePlacementExecution returns true if the placement execution can
+ * be sent over a connection in the same libpq pipeline as other placement
+ * executions.
+ *
+ * We only pipeline read tasks that consist of a single query, such that the
+ * results on the connection can be matched to the tasks in the order that the
+ * tasks are sent. Tasks that also run on the local node rely on the local
+ * execution for storing the rows, so we skip them as well.
  */
-static uint64
-MicrosecondsBetweenTimestamps(instr_time startTime, instr_time endTime)
+static bool
+CanPipelinePlacementExecution(TaskPlacementExecution *placementExecution)
 {
-	INSTR_TIME_SUBTRACT(endTime, startTime);
-	return INSTR_TIME_GET_MICROSEC(endTime);
+	Task *task = placementExecution->shardCommandExecution->task;
+
+	if (ExecutorPipelineDepth <= 1)
+	{
+		return false;
+	}
+
+	if (placementExecution->shardCommandExecution->hedgedPlacementExecution != NULL)
+	{
+		/* we might need to cancel the copies of a hedged read individually */
+		return false;
+	}
+
+	return task->taskType == READ_TASK && task->queryCount == 1 &&
+		   !task->partiallyLocalOrRemote;
 }
 
 
 /*
- * ConnectionStateMachine opens a connection and descends into the transaction
- * state machine when ready.
+ * SendPipelinedPlacementExecutions sends the queries of up to
+ * citus.executor_pipeline_depth - 1 additional placement executions over
+ * the session's connection, which is already in pipeline mode and has the
+ * query of session->currentTask sent. Finally, it marks the end of the
+ * pipeline such that the worker starts returning the results.
+ *
+ * The function returns false if the connection is lost.
  */
-static void
-ConnectionStateMachine(WorkerSession *session)
+static bool
+SendPipelinedPlacementExecutions(WorkerSession *session)
 {
-	WorkerPool *workerPool = session->workerPool;
-	DistributedExecution *execution = workerPool->distributedExecution;
-
 	MultiConnection *connection = session->connection;
-	MultiConnectionState currentState;
-
-	do {
-		currentState = connection->connectionState;
+	int pipelinedTaskCount = 1;
 
-		switch (currentState)
+	while (pipelinedTaskCount < ExecutorPipelineDepth)
+	{
+		TaskPlacementExecution *placementExecution = PeekPlacementExecution(session);
+		if (placementExecution == NULL ||
+			!CanPipelinePlacementExecution(placementExecution))
 		{
-			case MULTI_CONNECTION_INITIAL:
-			{
-				/* simply iterate the state machine */
-				connection->connectionState = MULTI_CONNECTION_CONNECTING;
-				break;
-			}
-
-			case MULTI_CONNECTION_TIMED_OUT:
-			{
-				/*
-				 * When the connection timeout happens, the connection
-				 * might still be able to successfuly established. However,
-				 * the executor should not try to use this connection as
-				 * the state machines might have already progressed and used
-				 * new pools/sessions instead. That's why we terminate the
-				 * connection, clear any state associated with it.
-				 */
-				connection->connectionState = MULTI_CONNECTION_FAILED;
-				break;
-			}
+			break;
+		}
 
-			case MULTI_CONNECTION_CONNECTING:
-			{
-				ConnStatusType status = PQstatus(connection->pgConn);
-				if (status == CONNECTION_OK)
-				{
-					HandleMultiConnectionSuccess(session);
-					UpdateConnectionWaitFlags(session,
-											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
-					break;
-				}
-				else if (status == CONNECTION_BAD)
-				{
-					connection->connectionState = MULTI_CONNECTION_FAILED;
-					break;
-				}
+		/* removes the placement execution we peeked at from its queue */
+		placementExecution = PopPlacementExecution(session);
 
-				int beforePollSocket = PQsocket(connection->pgConn);
-				PostgresPollingStatusType pollMode = PQconnectPoll(connection->pgConn);
+		if (!StartPipelinedPlacementExecution(placementExecution, session))
+		{
+			return false;
+		}
 
-				if (beforePollSocket != PQsocket(connection->pgConn))
-				{
-					/* rebuild the wait events if PQconnectPoll() changed the socket */
-					execution->rebuildWaitEventSet = true;
-				}
+		pipelinedTaskCount++;
+	}
 
-				if (pollMode == PGRES_POLLING_FAILED)
-				{
-					connection->connectionState = MULTI_CONNECTION_FAILED;
-				}
-				else if (pollMode == PGRES_POLLING_READING)
-				{
-					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+	if (!SendPipelineSync(connection))
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
 
-					/* we should have a valid socket */
-					Assert(PQsocket(connection->pgConn) != -1);
-				}
-				else if (pollMode == PGRES_POLLING_WRITING)
-				{
-					UpdateConnectionWaitFlags(session, WL_SOCKET_WRITEABLE);
+	return true;
+}
 
-					/* we should have a valid socket */
-					Assert(PQsocket(connection->pgConn) != -1);
-				}
-				else
-				{
-					HandleMultiConnectionSuccess(session);
-					UpdateConnectionWaitFlags(session,
-											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
 
-					/* we should have a valid socket */
-					Assert(PQsocket(connection->pgConn) != -1);
-				}
+/*
+ * StartPipelinedPlacementExecution sends the query of the placement execution
+ * in the pipeline of the session and appends the placement execution to the
+ * pipelinedTaskQueue of the session. Unlike StartPlacementExecutionOnSession,
+ * it does not change the connection counters of the pool, since the connection
+ * is already in use by session->currentTask.
+ */
+static bool
+StartPipelinedPlacementExecution(TaskPlacementExecution *placementExecution,
+								 WorkerSession *session)
+{
+	DistributedExecution *execution = session->workerPool->distributedExecution;
+	MultiConnection *connection = session->connection;
+	Task *task = placementExecution->shardCommandExecution->task;
+	ShardPlacement *taskPlacement = placementExecution->shardPlacement;
 
-				break;
-			}
+	if (execution->transactionProperties->useRemoteTransactionBlocks !=
+		TRANSACTION_BLOCKS_DISALLOWED)
+	{
+		List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
+		AssignPlacementListToConnection(placementAccessList, connection);
+	}
 
-			case MULTI_CONNECTION_CONNECTED:
-			{
-				if (HasUnfinishedTaskForSession(session))
-				{
-					/*
-					 * Connection is ready, and we have unfinished tasks.
-					 * So, run the transaction state machine.
-					 */
-					TransactionStateMachine(session);
-				}
-				else
-				{
-					/*
-					 * Connection is ready, but we don't have any unfinished
-					 * tasks that this session can execute.
-					 *
-					 * Note that we can be in a situation where the executor
-					 * decides to establish a connection, but not need to
-					 * use it at the time the connection is established. This could
-					 * happen when the earlier connections manages to finish all the
-					 * tasks after this connection
-					 *
-					 * As no tasks are ready to be executed at the moment, we
-					 * mark the socket readable to get any notices if exists.
-					 */
-					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
-				}
+	dlist_push_tail(&session->pipelinedTaskQueue,
+					&placementExecution->sessionPipelinedQueueNode);
+	placementExecution->executionState = PLACEMENT_EXECUTION_RUNNING;
+	AddToSharedRunningTaskCount(placementExecution);
 
-				break;
-			}
+	Assert(INSTR_TIME_IS_ZERO(placementExecution->startTime));
+	INSTR_TIME_SET_CURRENT(placementExecution->startTime);
 
-			case MULTI_CONNECTION_LOST:
-			{
-				/*
-				 * If a connection is lost, we retry the connection for some
-				 * very restricted scenarios. The main use case is to retry
-				 * connection establishment when a cached connection is used
-				 * in the executor while remote server has restarted / failedover
-				 * etc.
-				 *
-				 * For simplicity, we only allow retrying connection establishment
-				 * a single time.
-				 *
-				 * We can only retry connection when the remote transaction has
-				 * not started over the connection. Otherwise, we'd have to deal
-				 * with restoring the transaction state, which iis beyond our
-				 * purpose at this time.
-				 */
-				RemoteTransaction *transaction = &connection->remoteTransaction;
-				if (!session->connectionRetried &&
-					transaction->transactionState == REMOTE_TRANS_NOT_STARTED)
-				{
-					/*
-					 * Try to connect again, we will reuse the same MultiConnection
-					 * and keep it as claimed.
-					 */
-					RestartConnection(connection);
+	bool querySent = SendNextQuery(placementExecution, session);
+	if (querySent)
+	{
+		session->commandsSent++;
+		INSTR_TIME_SET_CURRENT(placementExecution->querySentTime);
+	}
 
-					/* socket have changed */
-					execution->rebuildWaitEventSet = true;
-					session->latestUnconsumedWaitEvents = 0;
+	return querySent;
+}
 
-					session->connectionRetried = true;
 
-					break;
-				}
+/*
+ * AdvancePipelinedPlacementExecution marks session->currentTask, whose results
+ * are all received, as done and makes the next task in the pipeline the
+ * current task of the session.
+ *
+ * The function returns false if the connection is lost.
+ */
+static bool
+AdvancePipelinedPlacementExecution(WorkerSession *session)
+{
+	MultiConnection *connection = session->connection;
+	TaskPlacementExecution *finishedPlacementExecution = session->currentTask;
 
-				connection->connectionState = MULTI_CONNECTION_FAILED;
-				break;
-			}
+	/*
+	 * The copy of a hedged read whose results we discarded does not count as
+	 * a successful execution of the task.
+	 */
+	bool succeeded = !PlacementExecutionLostHedgedRead(finishedPlacementExecution);
 
-			case MULTI_CONNECTION_FAILED:
-			{
-				/* managed to connect, but connection was lost */
-				if (session->sessionHasActiveConnection)
-				{
-					workerPool->activeConnectionCount--;
+	/*
+	 * Once we finished a task on a connection, we no longer
+	 * allow that connection to fail.
+	 */
+	MarkRemoteTransactionCritical(connection);
 
-					if (session->currentTask == NULL)
-					{
-						/* this was an idle connection */
-						workerPool->idleConnectionCount--;
-					}
+	dlist_node *nextNode = dlist_pop_head_node(&session->pipelinedTaskQueue);
+	session->currentTask = dlist_container(TaskPlacementExecution,
+										   sessionPipelinedQueueNode, nextNode);
 
-					session->sessionHasActiveConnection = false;
-				}
+	PlacementExecutionDone(finishedPlacementExecution, succeeded);
 
-				/* connection failed or was lost */
-				int totalConnectionCount = list_length(workerPool->sessionList);
+	/* the next query is at the head of the pipeline, fetch its rows in chunks */
+	if (SetRowFetchMode(connection) == 0)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
 
-				workerPool->failedConnectionCount++;
+	return true;
+}
 
-				/* if the connection executed a critical command it should fail */
-				MarkRemoteTransactionFailed(connection, false);
 
-				/* mark all assigned placement executions as failed */
-				WorkerSessionFailed(session);
+/*
+ * StartHedgedPlacementExecutions goes over the tasks that are currently running
+ * and starts a second copy of the read-only tasks that have been running for
+ * longer than citus.hedged_read_delay_factor times the average task execution
+ * time on their worker. The copy runs on another placement of the shard, such
+ * that a single stalled worker does not hold back the whole execution.
+ */
+static void
+StartHedgedPlacementExecutions(DistributedExecution *execution)
+{
+	instr_time now;
+	INSTR_TIME_SET_CURRENT(now);
 
-				if (workerPool->failedConnectionCount >= totalConnectionCount)
-				{
-					/*
-					 * All current connection attempts have failed.
-					 * Mark all unassigned placement executions as failed.
-					 *
-					 * We do not currently retry if the first connection
-					 * attempt fails.
-					 */
-					WorkerPoolFailed(workerPool);
-				}
+	WorkerSession *session = NULL;
+	foreach_ptr(session, execution->sessionList)
+	{
+		int64 timeUntilHedgedReadUs = TimeUntilHedgedRead(session, now);
+		if (timeUntilHedgedReadUs != 0)
+		{
+			/* either not eligible for hedging or not running for long enough */
+			continue;
+		}
 
-				/*
-				 * The execution may have failed as a result of WorkerSessionFailed
-				 * or WorkerPoolFailed.
-				 *
-				 * Even if this execution has not failed -- but just a single session is
-				 * failed -- and an earlier execution in this transaction which marked
-				 * the remote transaction as critical, we should fail right away as the
-				 * transaction will fail anyway on PREPARE/COMMIT time.
-				 */
-				RemoteTransaction *transaction = &connection->remoteTransaction;
+		ShardCommandExecution *shardCommandExecution =
+			session->currentTask->shardCommandExecution;
+		TaskPlacementExecution *hedgePlacementExecution =
+			FindHedgePlacementExecution(shardCommandExecution);
 
-				if (transaction->transactionCritical ||
-					execution->failed ||
-					(execution->transactionProperties->errorOnAnyFailure &&
-					 workerPool->failureState != WORKER_POOL_FAILED_OVER_TO_LOCAL))
-				{
-					/* a task has failed due to this connection failure */
-					ReportConnectionError(connection, ERROR);
-				}
-				else if (workerPool->activeConnectionCount > 0 ||
-						 workerPool->failureState == WORKER_POOL_FAILED_OVER_TO_LOCAL)
-				{
-					/*
-					 * We already have active connection(s) to the node, and the
-					 * executor is capable of using those connections to successfully
-					 * finish the execution. So, there is not much value in warning
-					 * the user.
-					 *
-					 * Similarly when the pool is failed over to local execution, warning
-					 * the user just creates chatter.
-					 */
-					ReportConnectionError(connection, DEBUG1);
-				}
-				else
-				{
-					ReportConnectionError(connection, WARNING);
-				}
+		ereport(DEBUG4, (errmsg("starting hedged read for task %d on node %s:%d",
+								shardCommandExecution->task->taskId,
+								hedgePlacementExecution->workerPool->nodeName,
+								hedgePlacementExecution->workerPool->nodePort)));
 
-				/* remove the connection */
-				UnclaimConnection(connection);
+		shardCommandExecution->hedgedPlacementExecution = hedgePlacementExecution;
+		PlacementExecutionReady(hedgePlacementExecution);
+	}
+}
 
-				/*
-				 * We forcefully close the underlying libpq connection because
-				 * we don't want any subsequent execution (either subPlan executions
-				 * or new command executions within a transaction block) use the
-				 * connection.
-				 *
-				 * However, we prefer to keep the MultiConnection around until
-				 * the end of FinishDistributedExecution() to simplify the code.
-				 * Thus, we prefer ShutdownConnection() over CloseConnection().
-				 */
-				ShutdownConnection(connection);
 
-				/* remove connection from wait event set */
-				execution->rebuildWaitEventSet = true;
+/*
+ * TimeUntilHedgedRead returns the number of microseconds after which the task
+ * that is currently running on the session should be hedged, 0 if it should be
+ * hedged right away, or -1 if the task cannot be hedged.
+ *
+ * We only hedge single-query read-only tasks outside of transaction blocks,
+ * whose shard has a placement on which the task has not been started yet.
+ * Pipelined tasks are never hedged since we cannot cancel them individually.
+ */
+static int64
+TimeUntilHedgedRead(WorkerSession *session, instr_time now)
+{
+	TaskPlacementExecution *placementExecution = session->currentTask;
+	if (placementExecution == NULL ||
+		placementExecution->executionState != PLACEMENT_EXECUTION_RUNNING)
+	{
+		return -1;
+	}
 
-				/*
-				 * Reset the transaction state machine since CloseConnection()
-				 * relies on it and even if we're not inside a distributed transaction
-				 * we set the transaction state (e.g., REMOTE_TRANS_SENT_COMMAND).
-				 */
-				if (!connection->remoteTransaction.beginSent)
-				{
-					connection->remoteTransaction.transactionState =
-						REMOTE_TRANS_NOT_STARTED;
-				}
+	WorkerPool *workerPool = placementExecution->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+	if (execution->transactionProperties->useRemoteTransactionBlocks !=
+		TRANSACTION_BLOCKS_DISALLOWED)
+	{
+		return -1;
+	}
+
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+	Task *task = shardCommandExecution->task;
+	if (shardCommandExecution->executionState != TASK_EXECUTION_NOT_FINISHED ||
+		shardCommandExecution->hedgedPlacementExecution != NULL ||
+		shardCommandExecution->executionOrder != EXECUTION_ORDER_ANY ||
+		task->taskType != READ_TASK || task->queryCount != 1 ||
+		task->partiallyLocalOrRemote)
+	{
+		return -1;
+	}
+
+	if (InPipelineMode(session->connection) ||
+		!dlist_is_empty(&session->pipelinedTaskQueue))
+	{
+		return -1;
+	}
+
+	/* prefer the averages of this execution over the ones of earlier executions */
+	double avgTaskExecutionTime = workerPool->sharedAvgTaskExecutionTime;
+	if (workerPool->totalExecutedTasks > 0)
+	{
+		avgTaskExecutionTime = (double) workerPool->totalTaskExecutionTime /
+							   workerPool->totalExecutedTasks;
+	}
 
-				break;
-			}
+	if (avgTaskExecutionTime <= 0)
+	{
+		/* we do not know yet what a slow task is */
+		return -1;
+	}
 
-			default:
-			{
-				break;
-			}
-		}
-	} while (connection->connectionState != currentState);
+	if (FindHedgePlacementExecution(shardCommandExecution) == NULL)
+	{
+		return -1;
+	}
+
+	int64 hedgedReadDelayUs = (int64) (HedgedReadDelayFactor * avgTaskExecutionTime);
+	int64 runningTimeUs =
+		(int64) MicrosecondsBetweenTimestamps(placementExecution->startTime, now);
+
+	return Max(0, hedgedReadDelayUs - runningTimeUs);
 }
 
 
 /*
- * HasUnfinishedTaskForSession gets a session and returns true if there
- * are any tasks that this session can execute.
+ * FindHedgePlacementExecution returns a placement execution of the task that
+ * has not been started yet and that can run the task in addition to the
+ * placement execution that is currently running, or NULL if there is none.
  */
-static bool
-HasUnfinishedTaskForSession(WorkerSession *session)
+static TaskPlacementExecution *
+FindHedgePlacementExecution(ShardCommandExecution *shardCommandExecution)
 {
-	if (session->currentTask != NULL)
-	{
-		/* the session is executing a command right now */
-		return true;
-	}
-
-	dlist_head *sessionReadyTaskQueue = &(session->readyTaskQueue);
-	if (!dlist_is_empty(sessionReadyTaskQueue))
+	for (int placementExecutionIndex = 0;
+		 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+		 placementExecutionIndex++)
 	{
-		/* session has an assigned task, which is ready for execution */
-		return true;
-	}
+		TaskPlacementExecution *placementExecution =
+			shardCommandExecution->placementExecutions[placementExecutionIndex];
+		WorkerPool *workerPool = placementExecution->workerPool;
 
-	WorkerPool *workerPool = session->workerPool;
-	dlist_head *poolReadyTaskQueue = &(workerPool->readyTaskQueue);
-	if (!dlist_is_empty(poolReadyTaskQueue))
-	{
 		/*
-		 * Pool has unassigned tasks that can be executed
-		 * by the input session.
+		 * We skip the local node to not interfere with the decisions on local
+		 * execution, which also affect the rest of the transaction.
 		 */
-		return true;
+		if (placementExecution->executionState == PLACEMENT_EXECUTION_NOT_READY &&
+			placementExecution->assignedSession == NULL &&
+			workerPool->failureState == WORKER_POOL_NOT_FAILED &&
+			!workerPool->poolToLocalNode)
+		{
+			return placementExecution;
+		}
 	}
 
-	return false;
+	return NULL;
 }
 
 
 /*
- * HandleMultiConnectionSuccess logs the established connection and updates
- * connection's state.
+ * ClaimHedgedTaskResults is called for each result that a placement execution
+ * of a hedged task receives, and returns whether the placement execution
+ * provides the results of the task. The first placement execution that
+ * receives a successful result claims the results, after which the other
+ * placement executions of the task are cancelled.
  */
-static void
-HandleMultiConnectionSuccess(WorkerSession *session)
+static bool
+ClaimHedgedTaskResults(TaskPlacementExecution *placementExecution,
+					   ExecStatusType resultStatus)
 {
-	MultiConnection *connection = session->connection;
-	WorkerPool *workerPool = session->workerPool;
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
 
-	MarkConnectionConnected(connection);
+	if (shardCommandExecution->resultPlacementExecution == NULL)
+	{
+		if (resultStatus != PGRES_COMMAND_OK && resultStatus != PGRES_TUPLES_OK &&
+			resultStatus != PGRES_SINGLE_TUPLE)
+		{
+			/* errors before any copy responded are handled as usual */
+			return true;
+		}
 
-	ereport(DEBUG4, (errmsg("established connection to %s:%d for "
-							"session %ld in %ld microseconds",
-							connection->hostname, connection->port,
-							session->sessionId,
-							MicrosecondsBetweenTimestamps(
-								connection->connectionEstablishmentStart,
-								connection->connectionEstablishmentEnd))));
+		shardCommandExecution->resultPlacementExecution = placementExecution;
 
-	workerPool->activeConnectionCount++;
-	workerPool->idleConnectionCount++;
-	session->sessionHasActiveConnection = true;
+		CancelHedgedPlacementExecutions(shardCommandExecution);
+	}
+
+	return shardCommandExecution->resultPlacementExecution == placementExecution;
 }
 
 
 /*
- * Activate2PCIfModifyingTransactionExpandsToNewNode sets the coordinated
- * transaction to use 2PC under the following circumstances:
- *     - We're already in a transaction block
- *     - At least one of the previous commands in the transaction block
- *       made a modification, which have not set 2PC itself because it
- *       was a single shard command
- *     - The input "session" is used for a distributed execution which
- *       modifies the database. However, the session (and hence the
- *       connection) is established to a different worker than the ones
- *       that is used previously in the transaction.
- *
- *  To give an example,
- *      BEGIN;
- *          -- assume that the following INSERT goes to worker-A
- *          -- also note that this single command does not activate
- *          -- 2PC itself since it is a single shard modification
- *          INSERT INTO distributed_table (dist_key) VALUES (1);
- *
- *          -- do one more single shard UPDATE hitting the same
- *          shard (or worker node in general)
- *          -- this wouldn't activate 2PC, since we're operating on the
- *          -- same worker node that we've modified earlier
- *          -- so the executor would use the same connection
- *			UPDATE distributed_table SET value = 10 WHERE dist_key = 1;
- *
- *          -- now, do one more INSERT, which goes to worker-B
- *          -- At this point, this function would activate 2PC
- *          -- since we're now expanding to a new node
- *          -- for example, if this command were a SELECT, we wouldn't
- *          -- activate 2PC since we're only interested in modifications/DDLs
- *          INSERT INTO distributed_table (dist_key) VALUES (2);
+ * CancelHedgedPlacementExecutions cancels the placement executions of a hedged
+ * task, except for the one that provides the results. Running placement
+ * executions get a cancellation request, and their connection is closed at
+ * the end of the transaction such that a late cancellation cannot affect
+ * later commands. Placement executions that did not start yet are removed
+ * from the ready queue.
  */
 static void
-Activate2PCIfModifyingTransactionExpandsToNewNode(WorkerSession *session)
+CancelHedgedPlacementExecutions(ShardCommandExecution *shardCommandExecution)
 {
-	DistributedExecution *execution = session->workerPool->distributedExecution;
-	if (TransactionModifiedDistributedTable(execution) &&
-		DistributedExecutionModifiesDatabase(execution) &&
-		!ConnectionModifiedPlacement(session->connection))
+	for (int placementExecutionIndex = 0;
+		 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+		 placementExecutionIndex++)
 	{
-		/*
-		 * We already did a modification, but not on the connection that we
-		 * just opened, which means we're now going to make modifications
-		 * over multiple connections. Activate 2PC!
-		 */
-		Use2PCForCoordinatedTransaction();
+		TaskPlacementExecution *placementExecution =
+			shardCommandExecution->placementExecutions[placementExecutionIndex];
+		WorkerPool *workerPool = placementExecution->workerPool;
+
+		if (placementExecution == shardCommandExecution->resultPlacementExecution)
+		{
+			continue;
+		}
+
+		if (placementExecution->executionState == PLACEMENT_EXECUTION_READY)
+		{
+			if (placementExecution->assignedSession != NULL)
+			{
+				dlist_delete(&placementExecution->sessionReadyQueueNode);
+			}
+			else
+			{
+				dlist_delete(&placementExecution->workerReadyQueueNode);
+				workerPool->readyTaskCount--;
+			}
+
+			placementExecution->executionState = PLACEMENT_EXECUTION_FAILED;
+		}
+		else if (placementExecution->executionState == PLACEMENT_EXECUTION_RUNNING)
+		{
+			WorkerSession *session = NULL;
+			foreach_ptr(session, workerPool->sessionList)
+			{
+				MultiConnection *connection = session->connection;
+
+				if (session->currentTask == placementExecution &&
+					!InPipelineMode(connection))
+				{
+					/* if the cancellation fails, we discard the results instead */
+					SendCancelationRequest(connection);
+					connection->forceCloseAtTransactionEnd = true;
+				}
+			}
+		}
 	}
 }
 
 
 /*
- * TransactionModifiedDistributedTable returns true if the current transaction already
- * executed a command which modified at least one distributed table in the current
- * transaction.
+ * PlacementExecutionLostHedgedRead returns whether another copy of the hedged
+ * read provides the results of the task of the placement execution.
  */
 static bool
-TransactionModifiedDistributedTable(DistributedExecution *execution)
+PlacementExecutionLostHedgedRead(TaskPlacementExecution *placementExecution)
 {
-	/*
-	 * We need to explicitly check for TRANSACTION_BLOCKS_REQUIRED due to
-	 * citus.function_opens_transaction_block flag. When set to false, we
-	 * should not be pretending that we're in a coordinated transaction even
-	 * if XACT_MODIFICATION_DATA is set. That's why we implemented this workaround.
-	 */
-	return execution->transactionProperties->useRemoteTransactionBlocks ==
-		   TRANSACTION_BLOCKS_REQUIRED &&
-		   XactModificationLevel == XACT_MODIFICATION_DATA;
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+
+	return shardCommandExecution->resultPlacementExecution != NULL &&
+		   shardCommandExecution->resultPlacementExecution != placementExecution;
 }
 
 
 /*
- * TransactionStateMachine manages the execution of tasks over a connection.
+ * HasActiveHedgedPlacementExecution returns whether the task is hedged and
+ * one of its placement executions is ready or running, in which case a
+ * failure of another placement execution does not require starting the task
+ * on the next placement.
  */
-static void
-TransactionStateMachine(WorkerSession *session)
+static bool
+HasActiveHedgedPlacementExecution(ShardCommandExecution *shardCommandExecution)
 {
-	WorkerPool *workerPool = session->workerPool;
-	DistributedExecution *execution = workerPool->distributedExecution;
-	TransactionBlocksUsage useRemoteTransactionBlocks =
-		execution->transactionProperties->useRemoteTransactionBlocks;
-
-	MultiConnection *connection = session->connection;
-	RemoteTransaction *transaction = &(connection->remoteTransaction);
-	RemoteTransactionState currentState;
+	if (shardCommandExecution->hedgedPlacementExecution == NULL)
+	{
+		return false;
+	}
 
-	do {
-		currentState = transaction->transactionState;
+	for (int placementExecutionIndex = 0;
+		 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+		 placementExecutionIndex++)
+	{
+		TaskPlacementExecution *placementExecution =
+			shardCommandExecution->placementExecutions[placementExecutionIndex];
 
-		if (!CheckConnectionReady(session))
+		if (placementExecution->executionState == PLACEMENT_EXECUTION_READY ||
+			placementExecution->executionState == PLACEMENT_EXECUTION_RUNNING)
 		{
-			/* connection is busy, no state transitions to make */
-			break;
+			return true;
 		}
+	}
 
-		switch (currentState)
-		{
-			case REMOTE_TRANS_NOT_STARTED:
-			{
-				if (useRemoteTransactionBlocks == TRANSACTION_BLOCKS_REQUIRED)
-				{
-					/* if we're expanding the nodes in a transaction, use 2PC */
-					Activate2PCIfModifyingTransactionExpandsToNewNode(session);
-
-					/* need to open a transaction block first */
-					StartRemoteTransactionBegin(connection);
-
-					transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
-				}
-				else
-				{
-					TaskPlacementExecution *placementExecution = PopPlacementExecution(
-						session);
-					if (placementExecution == NULL)
-					{
-						/*
-						 * No tasks are ready to be executed at the moment. But we
-						 * still mark the socket readable to get any notices if exists.
-						 */
-						UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+	return false;
+}
 
-						break;
-					}
 
-					bool placementExecutionStarted =
-						StartPlacementExecutionOnSession(placementExecution, session);
-					if (!placementExecutionStarted)
-					{
-						/* no need to continue, connection is lost */
-						Assert(session->connection->connectionState ==
-							   MULTI_CONNECTION_LOST);
+/*
+ * CombineQueryRowLimit returns the number of rows that the combine query needs
+ * to satisfy its LIMIT, or -1 if the combine query needs all the rows that the
+ * tasks return. The latter is the case when there is no constant LIMIT, or when
+ * the combine query sorts, aggregates or filters the rows.
+ */
+static int64
+CombineQueryRowLimit(Query *combineQuery)
+{
+	if (combineQuery == NULL || combineQuery->limitCount == NULL ||
+		combineQuery->limitOption != LIMIT_OPTION_COUNT)
+	{
+		return -1;
+	}
 
-						return;
-					}
+	if (combineQuery->sortClause != NIL || combineQuery->groupClause != NIL ||
+		combineQuery->groupingSets != NIL || combineQuery->distinctClause != NIL ||
+		combineQuery->havingQual != NULL || combineQuery->hasAggs ||
+		combineQuery->hasWindowFuncs || combineQuery->hasTargetSRFs ||
+		combineQuery->jointree == NULL || combineQuery->jointree->quals != NULL ||
+		list_length(combineQuery->rtable) != 1)
+	{
+		return -1;
+	}
 
-					transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
-				}
+	Node *limitCount = combineQuery->limitCount;
+	Node *limitOffset = combineQuery->limitOffset;
 
-				UpdateConnectionWaitFlags(session,
-										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
-				break;
-			}
+	if (!IsA(limitCount, Const) || (limitOffset != NULL && !IsA(limitOffset, Const)))
+	{
+		return -1;
+	}
 
-			case REMOTE_TRANS_SENT_BEGIN:
-			case REMOTE_TRANS_CLEARING_RESULTS:
-			{
-				PGresult *result = PQgetResult(connection->pgConn);
-				if (result != NULL)
-				{
-					if (!IsResponseOK(result))
-					{
-						/* query failures are always hard errors */
-						ReportResultError(connection, result, ERROR);
-					}
+	Const *limitCountConst = (Const *) limitCount;
+	if (limitCountConst->constisnull)
+	{
+		/* LIMIT NULL is the same as LIMIT ALL */
+		return -1;
+	}
 
-					PQclear(result);
+	int64 rowLimit = DatumGetInt64(limitCountConst->constvalue);
+	if (rowLimit < 0)
+	{
+		/* the combine query throws an error */
+		return -1;
+	}
 
-					/* wake up WaitEventSetWait */
-					UpdateConnectionWaitFlags(session,
-											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+	if (limitOffset != NULL && !((Const *) limitOffset)->constisnull)
+	{
+		int64 rowOffset = DatumGetInt64(((Const *) limitOffset)->constvalue);
+		if (rowOffset < 0 || rowLimit > PG_INT64_MAX - rowOffset)
+		{
+			return -1;
+		}
 
-					break;
-				}
+		rowLimit += rowOffset;
+	}
 
-				if (session->currentTask != NULL)
-				{
-					TaskPlacementExecution *placementExecution = session->currentTask;
-					bool succeeded = true;
+	return rowLimit;
+}
 
-					/*
-					 * Once we finished a task on a connection, we no longer
-					 * allow that connection to fail.
-					 */
-					MarkRemoteTransactionCritical(connection);
 
-					session->currentTask = NULL;
+/*
+ * GroupReadTasksByWorker returns a task list in which the read tasks that
+ * go to the same worker are combined into tasks of up to maxGroupSize
+ * shard queries, such that the worker receives them as a single UNION ALL
+ * query. This saves a round trip and the per-statement overhead on the
+ * worker for every task but the first of a group. The rows of all tasks
+ * go into the same tuple destination and are merged by the combine query,
+ * so combining the rows of several tasks into one result does not change
+ * the outcome.
+ *
+ * Tasks that cannot be combined (see CanGroupReadTask) are returned as is.
+ */
+static List *
+GroupReadTasksByWorker(List *taskList, int maxGroupSize)
+{
+	List *groupedTaskList = NIL;
+	List *workerGroupIdList = NIL;
+	List *workerTaskListList = NIL;
 
-					PlacementExecutionDone(placementExecution, succeeded);
+	if (list_length(taskList) <= 1)
+	{
+		return taskList;
+	}
 
-					/* connection is ready to use for executing commands */
-					workerPool->idleConnectionCount++;
-				}
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (!CanGroupReadTask(task))
+		{
+			groupedTaskList = lappend(groupedTaskList, task);
+			continue;
+		}
 
-				/* connection needs to be writeable to send next command */
-				UpdateConnectionWaitFlags(session,
-										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+		ShardPlacement *placement = linitial(task->taskPlacementList);
+		ListCell *workerGroupIdCell = NULL;
+		ListCell *workerTaskListCell = NULL;
 
-				if (transaction->beginSent)
-				{
-					transaction->transactionState = REMOTE_TRANS_STARTED;
-				}
-				else
-				{
-					transaction->transactionState = REMOTE_TRANS_NOT_STARTED;
-				}
+		forboth(workerGroupIdCell, workerGroupIdList,
+				workerTaskListCell, workerTaskListList)
+		{
+			if (lfirst_int(workerGroupIdCell) == placement->groupId)
+			{
 				break;
 			}
+		}
 
-			case REMOTE_TRANS_STARTED:
-			{
-				TaskPlacementExecution *placementExecution = PopPlacementExecution(
-					session);
-				if (placementExecution == NULL)
-				{
-					/* no tasks are ready to be executed at the moment */
-					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
-					break;
-				}
-
-				bool placementExecutionStarted =
-					StartPlacementExecutionOnSession(placementExecution, session);
-				if (!placementExecutionStarted)
-				{
-					/* no need to continue, connection is lost */
-					Assert(session->connection->connectionState == MULTI_CONNECTION_LOST);
+		if (workerGroupIdCell == NULL)
+		{
+			workerGroupIdList = lappend_int(workerGroupIdList, placement->groupId);
+			workerTaskListList = lappend(workerTaskListList, list_make1(task));
+		}
+		else
+		{
+			lfirst(workerTaskListCell) = lappend(lfirst(workerTaskListCell), task);
+		}
+	}
 
-					return;
-				}
+	List *workerTaskList = NIL;
+	foreach_ptr(workerTaskList, workerTaskListList)
+	{
+		int taskCount = list_length(workerTaskList);
 
-				transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
-				break;
-			}
+		for (int groupStart = 0; groupStart < taskCount; groupStart += maxGroupSize)
+		{
+			int groupEnd = Min(groupStart + maxGroupSize, taskCount);
+			List *groupTaskList = list_truncate(list_copy_tail(workerTaskList,
+															   groupStart),
+												groupEnd - groupStart);
 
-			case REMOTE_TRANS_SENT_COMMAND:
-			{
-				TaskPlacementExecution *placementExecution = session->currentTask;
-				if (placementExecution == NULL)
-				{
-					/*
-					 * We have seen accounts in production where the placementExecution
-					 * could inadvertently be not set. Investigation documented on
-					 * https://github.com/citusdata/citus-enterprise/issues/493
-					 * (due to sensitive data in the initial report it is not discussed
-					 * in our community repository)
-					 *
-					 * Currently we don't have a reliable way of reproducing this issue.
-					 * Erroring here seems to be a more desirable approach compared to a
-					 * SEGFAULT on the dereference of placementExecution, with a possible
-					 * crash recovery as a result.
-					 */
-					ereport(ERROR, (errmsg(
-										"unable to recover from inconsistent state in "
-										"the connection state machine on coordinator")));
-				}
+			groupedTaskList = lappend(groupedTaskList,
+									  CreateGroupedReadTask(groupTaskList));
+		}
+	}
 
-				ShardCommandExecution *shardCommandExecution =
-					placementExecution->shardCommandExecution;
-				Task *task = shardCommandExecution->task;
+	return groupedTaskList;
+}
 
-				/*
-				 * In EXPLAIN ANALYZE we need to store results except for multiple placements,
-				 * regardless of query type. In other cases, doing the same doesn't seem to have
-				 * a drawback.
-				 */
-				bool storeRows = true;
 
-				if (shardCommandExecution->gotResults)
-				{
-					/* already received results from another replica */
-					storeRows = false;
-				}
-				else if (task->partiallyLocalOrRemote)
-				{
-					/*
-					 * For the tasks that involves placements from both
-					 * remote and local placments, such as modifications
-					 * to reference tables, we store the rows during the
-					 * local placement/execution.
-					 */
-					storeRows = false;
-				}
+/*
+ * CanGroupReadTask returns whether the given task is a plain single-query
+ * read of a single remote placement, which can be part of a UNION ALL with
+ * the queries of other tasks.
+ */
+static bool
+CanGroupReadTask(Task *task)
+{
+	if (task->taskType != READ_TASK || task->queryCount != 1 ||
+		list_length(task->taskPlacementList) != 1)
+	{
+		return false;
+	}
 
-				bool fetchDone = ReceiveResults(session, storeRows);
-				if (!fetchDone)
-				{
-					break;
-				}
+	/* repartition joins, FOR UPDATE and custom destinations are excluded */
+	if (task->dependentTaskList != NIL || task->relationRowLockList != NIL ||
+		task->tupleDest != NULL || task->partiallyLocalOrRemote ||
+		task->cannotBeExecutedInTransction)
+	{
+		return false;
+	}
 
-				/* if this is a multi-query task, send the next query */
-				if (placementExecution->queryIndex < task->queryCount)
-				{
-					bool querySent = SendNextQuery(placementExecution, session);
-					if (!querySent)
-					{
-						/* no need to continue, connection is lost */
-						Assert(session->connection->connectionState ==
-							   MULTI_CONNECTION_LOST);
+	/* local tasks are cheaper to run via local execution */
+	ShardPlacement *placement = linitial(task->taskPlacementList);
+	if (placement->groupId == GetLocalGroupId())
+	{
+		return false;
+	}
 
-						return;
-					}
+	return true;
+}
 
-					/*
-					 * At this point the query might be just in pgconn buffers. We
-					 * need to wait until it becomes writeable to actually send
-					 * the query.
-					 */
-					UpdateConnectionWaitFlags(session,
-											  WL_SOCKET_WRITEABLE | WL_SOCKET_READABLE);
 
-					transaction->transactionState = REMOTE_TRANS_SENT_COMMAND;
+/*
+ * CreateGroupedReadTask returns a read task that runs the queries of the given
+ * tasks, which all read from the same placement, as a single UNION ALL query.
+ */
+static Task *
+CreateGroupedReadTask(List *taskList)
+{
+	Task *firstTask = linitial(taskList);
 
-					break;
-				}
+	if (list_length(taskList) == 1)
+	{
+		return firstTask;
+	}
 
-				shardCommandExecution->gotResults = true;
-				transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
-				break;
-			}
+	StringInfo queryString = makeStringInfo();
+	List *relationShardList = NIL;
 
-			default:
-			{
-				break;
-			}
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (queryString->len > 0)
+		{
+			appendStringInfoString(queryString, " UNION ALL ");
 		}
+
+		appendStringInfo(queryString, "(%s)", TaskQueryString(task));
+
+		relationShardList = list_concat(relationShardList,
+										list_copy(task->relationShardList));
 	}
-	/* iterate in case we can perform multiple transitions at once */
-	while (transaction->transactionState != currentState);
+
+	Task *groupedTask = CitusMakeNode(Task);
+	groupedTask->taskType = READ_TASK;
+	groupedTask->jobId = firstTask->jobId;
+	groupedTask->taskId = firstTask->taskId;
+	groupedTask->anchorShardId = firstTask->anchorShardId;
+	groupedTask->taskPlacementList = firstTask->taskPlacementList;
+	groupedTask->replicationModel = firstTask->replicationModel;
+	groupedTask->relationShardList = relationShardList;
+	groupedTask->parametersInQueryStringResolved =
+		firstTask->parametersInQueryStringResolved;
+	SetTaskQueryString(groupedTask, queryString->data);
+
+	return groupedTask;
 }
 
 
 /*
- * UpdateConnectionWaitFlags is a wrapper around setting waitFlags of the connection.
+ * GroupUtilityTasksByWorker returns a task list in which the utility tasks
+ * that go to the same worker are combined into tasks of up to maxGroupSize
+ * shard commands, such that the worker receives them as a single
+ * multi-statement command. A DDL command on a table with many shards then
+ * costs one round trip per group instead of one per shard, while the groups
+ * for different workers still run in parallel.
  *
- * This function might further improved in a sense that to use use ModifyWaitEvent on
- * waitFlag changes as opposed to what we do now: always rebuild the wait event sets.
- * Our initial benchmarks didn't show any significant performance improvements, but
- * good to keep in mind the potential improvements.
+ * A grouped task accesses the placements of all of its shards over a single
+ * connection, which is only safe if no earlier statement in the transaction
+ * accessed those placements over other connections. Tasks that cannot be
+ * combined (see CanGroupUtilityTask) are returned as is.
  */
-static void
-UpdateConnectionWaitFlags(WorkerSession *session, int waitFlags)
+static List *
+GroupUtilityTasksByWorker(List *taskList, int maxGroupSize)
 {
-	MultiConnection *connection = session->connection;
-	DistributedExecution *execution = session->workerPool->distributedExecution;
-
-	/* do not take any actions if the flags not changed */
-	if (connection->waitFlags == waitFlags)
+	if (maxGroupSize <= 1 || list_length(taskList) <= 1 ||
+		IsMultiStatementTransaction() ||
+		UtilityTaskRelationsAccessedInTransaction(taskList))
 	{
-		return;
+		return taskList;
 	}
 
-#if PG_VERSION_NUM >= PG_VERSION_15
-
-	/* always detect closed sockets */
-	connection->waitFlags = waitFlags | WL_SOCKET_CLOSED;
-#else
-	connection->waitFlags = waitFlags;
-#endif
-
-	/* without signalling the execution, the flag changes won't be reflected */
-	execution->waitFlagsChanged = true;
+	return CombineUtilityTasksByWorker(taskList, maxGroupSize);
 }
 
 
 /*
- * CheckConnectionReady returns true if the connection is ready to
- * read or write, or false if it still has bytes to send/receive.
+ * CombineUtilityTasksByWorker combines the utility tasks that go to the same
+ * worker into tasks of up to maxGroupSize shard commands. The caller should
+ * make sure that the placements of the tasks can be accessed over a single
+ * connection.
  */
-static bool
-CheckConnectionReady(WorkerSession *session)
+List *
+CombineUtilityTasksByWorker(List *taskList, int maxGroupSize)
 {
-	MultiConnection *connection = session->connection;
-	int waitFlags = WL_SOCKET_READABLE;
-	bool connectionReady = false;
+	List *groupedTaskList = NIL;
+	List *workerGroupIdList = NIL;
+	List *workerTaskListList = NIL;
 
-	ConnStatusType status = PQstatus(connection->pgConn);
-	if (status == CONNECTION_BAD)
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
 	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
-		return false;
-	}
+		if (!CanGroupUtilityTask(task))
+		{
+			groupedTaskList = lappend(groupedTaskList, task);
+			continue;
+		}
 
-#if PG_VERSION_NUM >= PG_VERSION_15
-	if ((session->latestUnconsumedWaitEvents & WL_SOCKET_CLOSED) != 0)
-	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
-		return false;
+		ShardPlacement *placement = linitial(task->taskPlacementList);
+		ListCell *workerGroupIdCell = NULL;
+		ListCell *workerTaskListCell = NULL;
+
+		forboth(workerGroupIdCell, workerGroupIdList,
+				workerTaskListCell, workerTaskListList)
+		{
+			if (lfirst_int(workerGroupIdCell) == placement->groupId)
+			{
+				break;
+			}
+		}
+
+		if (workerGroupIdCell == NULL)
+		{
+			workerGroupIdList = lappend_int(workerGroupIdList, placement->groupId);
+			workerTaskListList = lappend(workerTaskListList, list_make1(task));
+		}
+		else
+		{
+			lfirst(workerTaskListCell) = lappend(lfirst(workerTaskListCell), task);
+		}
 	}
-#endif
 
-	/* try to send all pending data */
-	int sendStatus = PQflush(connection->pgConn);
-	if (sendStatus == -1)
+	List *workerTaskList = NIL;
+	foreach_ptr(workerTaskList, workerTaskListList)
 	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
-		return false;
+		int taskCount = list_length(workerTaskList);
+
+		for (int groupStart = 0; groupStart < taskCount; groupStart += maxGroupSize)
+		{
+			int groupEnd = Min(groupStart + maxGroupSize, taskCount);
+			List *groupTaskList = list_truncate(list_copy_tail(workerTaskList,
+															   groupStart),
+												groupEnd - groupStart);
+
+			groupedTaskList = lappend(groupedTaskList,
+									  CreateGroupedUtilityTask(groupTaskList));
+		}
 	}
-	else if (sendStatus == 1)
+
+	return groupedTaskList;
+}
+
+
+/*
+ * CanGroupUtilityTask returns whether the given task is a DDL task on a single
+ * remote placement, of which the commands can be part of a multi-statement
+ * command with the commands of other tasks.
+ */
+static bool
+CanGroupUtilityTask(Task *task)
+{
+	if (task->taskType != DDL_TASK || task->queryCount < 1 ||
+		list_length(task->taskPlacementList) != 1 ||
+		task->anchorShardId == INVALID_SHARD_ID)
 	{
-		/* more data to send, wait for socket to become writable */
-		waitFlags = waitFlags | WL_SOCKET_WRITEABLE;
+		return false;
 	}
 
-	if ((session->latestUnconsumedWaitEvents & WL_SOCKET_READABLE) != 0)
+	if (task->dependentTaskList != NIL || task->tupleDest != NULL ||
+		task->cannotBeExecutedInTransction)
 	{
-		if (PQconsumeInput(connection->pgConn) == 0)
-		{
-			connection->connectionState = MULTI_CONNECTION_LOST;
-			return false;
-		}
+		return false;
 	}
 
-	if (!PQisBusy(connection->pgConn))
+	/* local tasks do not need a round trip */
+	ShardPlacement *placement = linitial(task->taskPlacementList);
+	if (placement->groupId == GetLocalGroupId())
 	{
-		connectionReady = true;
+		return false;
 	}
 
-	UpdateConnectionWaitFlags(session, waitFlags);
-
-	/* don't consume input redundantly if we cycle back into CheckConnectionReady */
-	session->latestUnconsumedWaitEvents = 0;
-
-	return connectionReady;
+	return true;
 }
 
 
 /*
- * PopPlacementExecution returns the next available assigned or unassigned
- * placement execution for the given session.
+ * UtilityTaskRelationsAccessedInTransaction returns whether any of the tables
+ * that the tasks operate on were already accessed in the current transaction.
  */
-static TaskPlacementExecution *
-PopPlacementExecution(WorkerSession *session)
+static bool
+UtilityTaskRelationsAccessedInTransaction(List *taskList)
 {
-	WorkerPool *workerPool = session->workerPool;
+	List *relationIdList = NIL;
 
-	TaskPlacementExecution *placementExecution = PopAssignedPlacementExecution(session);
-	if (placementExecution == NULL)
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
 	{
-		if (session->commandsSent > 0 && UseConnectionPerPlacement())
+		RelationShard *relationShard = NULL;
+		foreach_ptr(relationShard, task->relationShardList)
 		{
-			/*
-			 * Only send one command per connection if force_max_query_parallelisation
-			 * is enabled, unless it's an assigned placement execution.
-			 */
-			return NULL;
+			relationIdList = list_append_unique_oid(relationIdList,
+													relationShard->relationId);
 		}
 
-		/* no more assigned tasks, pick an unassigned task */
-		placementExecution = PopUnassignedPlacementExecution(workerPool);
+		if (task->anchorShardId != INVALID_SHARD_ID)
+		{
+			relationIdList = list_append_unique_oid(relationIdList,
+													RelationIdForShard(
+														task->anchorShardId));
+		}
 	}
 
-	return placementExecution;
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, relationIdList)
+	{
+		if (GetRelationDDLAccessMode(relationId) != RELATION_NOT_ACCESSED ||
+			GetRelationDMLAccessMode(relationId) != RELATION_NOT_ACCESSED ||
+			GetRelationSelectAccessMode(relationId) != RELATION_NOT_ACCESSED)
+		{
+			return true;
+		}
+	}
+
+	return false;
 }
 
 
 /*
- * PopAssignedPlacementExecution finds an executable task from the queue of assigned tasks.
+ * CreateGroupedUtilityTask returns a DDL task that sends the commands of the
+ * given tasks, which all go to the same worker, as a single multi-statement
+ * command. The task accesses the placements of all of their shards.
  */
-static TaskPlacementExecution *
-PopAssignedPlacementExecution(WorkerSession *session)
+static Task *
+CreateGroupedUtilityTask(List *taskList)
 {
-	dlist_head *readyTaskQueue = &(session->readyTaskQueue);
+	Task *firstTask = linitial(taskList);
 
-	if (dlist_is_empty(readyTaskQueue))
+	if (list_length(taskList) == 1)
 	{
-		return NULL;
+		return firstTask;
 	}
 
-	TaskPlacementExecution *placementExecution = dlist_container(TaskPlacementExecution,
-																 sessionReadyQueueNode,
-																 dlist_pop_head_node(
-																	 readyTaskQueue));
+	StringInfo queryString = makeStringInfo();
+	List *relationShardList = NIL;
 
-	return placementExecution;
-}
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (queryString->len > 0)
+		{
+			appendStringInfoChar(queryString, ';');
+		}
 
+		appendStringInfoString(queryString, TaskQueryString(task));
 
-/*
- * PopAssignedPlacementExecution finds an executable task from the queue of assigned tasks.
- */
-static TaskPlacementExecution *
-PopUnassignedPlacementExecution(WorkerPool *workerPool)
-{
-	dlist_head *readyTaskQueue = &(workerPool->readyTaskQueue);
+		/* the executor otherwise only records the access of the anchor shard */
+		RelationShard *anchorRelationShard = CitusMakeNode(RelationShard);
+		anchorRelationShard->relationId = RelationIdForShard(task->anchorShardId);
+		anchorRelationShard->shardId = task->anchorShardId;
 
-	if (dlist_is_empty(readyTaskQueue))
-	{
-		return NULL;
+		relationShardList = lappend(relationShardList, anchorRelationShard);
+		relationShardList = list_concat(relationShardList,
+										list_copy(task->relationShardList));
 	}
 
-	TaskPlacementExecution *placementExecution = dlist_container(TaskPlacementExecution,
-																 workerReadyQueueNode,
-																 dlist_pop_head_node(
-																	 readyTaskQueue));
+	Task *groupedTask = CitusMakeNode(Task);
+	groupedTask->taskType = DDL_TASK;
+	groupedTask->jobId = firstTask->jobId;
+	groupedTask->taskId = firstTask->taskId;
+	groupedTask->anchorShardId = firstTask->anchorShardId;
+	groupedTask->taskPlacementList = firstTask->taskPlacementList;
+	groupedTask->replicationModel = firstTask->replicationModel;
+	groupedTask->relationShardList = relationShardList;
+	SetTaskQueryString(groupedTask, queryString->data);
 
-	workerPool->readyTaskCount--;
+	return groupedTask;
+}
 
-	return placementExecution;
+
+/*
+ * RowLimitReached returns whether the execution received enough rows for the
+ * combine query to satisfy its LIMIT.
+ */
+static bool
+RowLimitReached(DistributedExecution *execution)
+{
+	return execution->rowLimit >= 0 &&
+		   execution->rowsProcessed >= (uint64) execution->rowLimit;
 }
 
 
 /*
- * StartPlacementExecutionOnSession gets a TaskPlacementExecution and
- * WorkerSession, the task's query is sent to the worker via the session.
- *
- * The function does some bookkeeping such as associating the placement
- * accesses with the connection and updating session's local variables. For
- * details read the comments in the function.
+ * CancelRemainingTasks is called once the execution received enough rows to
+ * satisfy the LIMIT of the combine query. It sends a cancellation request over
+ * the connections on which tasks are running, removes the tasks that did
+ * not start yet from the queues and marks all the remaining tasks as finished.
  *
- * The function returns true if the query is successfully sent over the
- * connection, otherwise false.
+ * The connections of the cancelled tasks are closed at the end of the
+ * execution, or at the end of the transaction if they finish in the
+ * meantime, such that a late cancellation cannot affect later commands.
  */
-static bool
-StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
-								 WorkerSession *session)
+static void
+CancelRemainingTasks(DistributedExecution *execution)
 {
-	WorkerPool *workerPool = session->workerPool;
-	DistributedExecution *execution = workerPool->distributedExecution;
-	MultiConnection *connection = session->connection;
-	ShardCommandExecution *shardCommandExecution =
-		placementExecution->shardCommandExecution;
-	Task *task = shardCommandExecution->task;
-	ShardPlacement *taskPlacement = placementExecution->shardPlacement;
-	List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
+	ereport(DEBUG4, (errmsg("cancelling %d remaining tasks after receiving "
+							UINT64_FORMAT " rows", execution->unfinishedTaskCount,
+							execution->rowsProcessed)));
 
-	if (execution->transactionProperties->useRemoteTransactionBlocks !=
-		TRANSACTION_BLOCKS_DISALLOWED)
+	WorkerPool *workerPool = NULL;
+	foreach_ptr(workerPool, execution->workerList)
 	{
-		/*
-		 * Make sure that subsequent commands on the same placement
-		 * use the same connection.
-		 */
-		AssignPlacementListToConnection(placementAccessList, connection);
+		while (!dlist_is_empty(&workerPool->pendingTaskQueue))
+		{
+			dlist_node *node = dlist_pop_head_node(&workerPool->pendingTaskQueue);
+			TaskPlacementExecution *placementExecution =
+				dlist_container(TaskPlacementExecution, workerPendingQueueNode, node);
+
+			placementExecution->executionState = PLACEMENT_EXECUTION_FAILED;
+			CancelTaskOfPlacementExecution(execution, placementExecution);
+		}
+
+		while (!dlist_is_empty(&workerPool->readyTaskQueue))
+		{
+			dlist_node *node = dlist_pop_head_node(&workerPool->readyTaskQueue);
+			TaskPlacementExecution *placementExecution =
+				dlist_container(TaskPlacementExecution, workerReadyQueueNode, node);
+
+			placementExecution->executionState = PLACEMENT_EXECUTION_FAILED;
+			CancelTaskOfPlacementExecution(execution, placementExecution);
+		}
+
+		workerPool->readyTaskCount = 0;
 	}
 
-	if (session->commandsSent == 0)
+	WorkerSession *session = NULL;
+	foreach_ptr(session, execution->sessionList)
 	{
-		/* first time we send a command, consider the connection used (not unused) */
-		workerPool->unusedConnectionCount--;
-	}
+		while (!dlist_is_empty(&session->pendingTaskQueue))
+		{
+			dlist_node *node = dlist_pop_head_node(&session->pendingTaskQueue);
+			TaskPlacementExecution *placementExecution =
+				dlist_container(TaskPlacementExecution, sessionPendingQueueNode, node);
 
-	/* connection is going to be in use */
-	workerPool->idleConnectionCount--;
-	session->currentTask = placementExecution;
-	placementExecution->executionState = PLACEMENT_EXECUTION_RUNNING;
+			placementExecution->executionState = PLACEMENT_EXECUTION_FAILED;
+			CancelTaskOfPlacementExecution(execution, placementExecution);
+		}
 
-	Assert(INSTR_TIME_IS_ZERO(placementExecution->startTime));
+		while (!dlist_is_empty(&session->readyTaskQueue))
+		{
+			dlist_node *node = dlist_pop_head_node(&session->readyTaskQueue);
+			TaskPlacementExecution *placementExecution =
+				dlist_container(TaskPlacementExecution, sessionReadyQueueNode, node);
 
-	/*
-	 * The same TaskPlacementExecution can be used to have
-	 * call SendNextQuery() several times if queryIndex is
-	 * non-zero. Still, all are executed under the current
-	 * placementExecution, so we can start the timer right
-	 * now.
-	 */
-	INSTR_TIME_SET_CURRENT(placementExecution->startTime);
+			placementExecution->executionState = PLACEMENT_EXECUTION_FAILED;
+			CancelTaskOfPlacementExecution(execution, placementExecution);
+		}
 
-	bool querySent = SendNextQuery(placementExecution, session);
-	if (querySent)
+		if (session->currentTask == NULL)
+		{
+			continue;
+		}
+
+		/* the pipelined tasks are consumed from the connection as usual */
+		dlist_iter iter;
+		dlist_foreach(iter, &session->pipelinedTaskQueue)
+		{
+			TaskPlacementExecution *placementExecution =
+				dlist_container(TaskPlacementExecution, sessionPipelinedQueueNode,
+								iter.cur);
+
+			CancelTaskOfPlacementExecution(execution, placementExecution);
+		}
+
+		CancelTaskOfPlacementExecution(execution, session->currentTask);
+
+		MultiConnection *connection = session->connection;
+
+		SendCancelationRequest(connection);
+		connection->forceCloseAtTransactionEnd = true;
+	}
+}
+
+
+/*
+ * CancelTaskOfPlacementExecution marks the task of the placement execution as
+ * finished, without waiting for any of its placement executions, unless the
+ * task is already finished.
+ */
+static void
+CancelTaskOfPlacementExecution(DistributedExecution *execution,
+							   TaskPlacementExecution *placementExecution)
+{
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+
+	if (shardCommandExecution->executionState == TASK_EXECUTION_NOT_FINISHED)
 	{
-		session->commandsSent++;
+		shardCommandExecution->executionState = TASK_EXECUTION_FINISHED;
+		execution->unfinishedTaskCount--;
 
-		if (workerPool->poolToLocalNode)
+		if (execution->sortedMerge != NULL)
 		{
-			/*
-			 * As we started remote execution to the local node,
-			 * we cannot switch back to local execution as that
-			 * would cause self-deadlocks and breaking
-			 * read-your-own-writes consistency.
-			 */
-			SetLocalExecutionStatus(LOCAL_EXECUTION_DISABLED);
+			SortedMergeTaskFinished(execution->sortedMerge,
+									shardCommandExecution->task);
 		}
 	}
+}
 
-	return querySent;
+
+/*
+ * ShouldUseWorkerPreparedStatement returns whether we should send the
+ * parameterized query of the task through a named prepared statement on the
+ * connection. Since the statement is prepared synchronously, we only do that
+ * for single-task executions, such as router queries.
+ */
+static bool
+ShouldUseWorkerPreparedStatement(DistributedExecution *execution,
+								 MultiConnection *connection, Task *task)
+{
+	if (!EnableWorkerPreparedStatements)
+	{
+		return false;
+	}
+
+	return list_length(execution->remoteTaskList) == 1 && task->queryCount == 1 &&
+		   !InPipelineMode(connection);
 }
 
 
@@ -4587,6 +7081,36 @@ SendNextQuery(TaskPlacementExecution *placementExecution,
 	Assert(queryIndex < task->queryCount);
 	char *queryString = TaskQueryStringAtIndex(task, queryIndex);
 
+	if (task->sendQueriesTogether && queryIndex == 0)
+	{
+		/* each of the queries still gives a result, which advances queryIndex */
+		queryString = TaskQueryString(task);
+	}
+
+	/*
+	 * Worker prepared statements are keyed by their query string, which a
+	 * different span id for every execution would make unique.
+	 */
+	if (execution->propagateTraceContext &&
+		!(paramListInfo != NULL && !task->parametersInQueryStringResolved &&
+		  ShouldUseWorkerPreparedStatement(execution, connection, task)))
+	{
+		if (placementExecution->traceParent == NULL)
+		{
+			placementExecution->traceParent = CreateChildTraceParent();
+		}
+
+		queryString = QueryStringWithTraceParent(placementExecution->traceParent,
+												 queryString);
+	}
+
+	/* the query identifier comes first, such that workers find it quickly */
+	if (execution->workerStatsQueryId != 0)
+	{
+		queryString = QueryStringWithCitusQueryId(execution->workerStatsQueryId,
+												  queryString);
+	}
+
 	if (paramListInfo != NULL && !task->parametersInQueryStringResolved)
 	{
 		int parameterCount = paramListInfo->numParams;
@@ -4598,9 +7122,19 @@ SendNextQuery(TaskPlacementExecution *placementExecution,
 
 		ExtractParametersForRemoteExecution(paramListInfo, &parameterTypes,
 											&parameterValues);
-		querySent = SendRemoteCommandParams(connection, queryString, parameterCount,
-											parameterTypes, parameterValues,
-											binaryResults);
+
+		if (ShouldUseWorkerPreparedStatement(execution, connection, task))
+		{
+			querySent = SendRemoteCommandPrepared(connection, queryString,
+												  parameterCount, parameterTypes,
+												  parameterValues, binaryResults);
+		}
+		else
+		{
+			querySent = SendRemoteCommandParams(connection, queryString, parameterCount,
+												parameterTypes, parameterValues,
+												binaryResults);
+		}
 	}
 	else
 	{
@@ -4616,12 +7150,13 @@ SendNextQuery(TaskPlacementExecution *placementExecution,
 		 * isolation_select_vs_all.spec, when doing an s1-router-select in one
 		 * session blocked an s2-ddl-create-index-concurrently in another.
 		 */
-		if (!binaryResults)
+		if (!binaryResults && !InPipelineMode(connection))
 		{
 			querySent = SendRemoteCommand(connection, queryString);
 		}
 		else
 		{
+			/* simple query protocol cannot be used in pipeline mode */
 			querySent = SendRemoteCommandParams(connection, queryString, 0, NULL, NULL,
 												binaryResults);
 		}
@@ -4633,8 +7168,20 @@ SendNextQuery(TaskPlacementExecution *placementExecution,
 		return false;
 	}
 
-	int singleRowMode = PQsetSingleRowMode(connection->pgConn);
-	if (singleRowMode == 0)
+	placementExecution->roundTrips++;
+
+	if (placementExecution != session->currentTask)
+	{
+		/*
+		 * Single row mode applies to the query at the head of the pipeline,
+		 * we enable it for pipelined queries once their results are next in
+		 * line (see AdvancePipelinedPlacementExecution).
+		 */
+		return true;
+	}
+
+	int rowFetchMode = SetRowFetchMode(connection);
+	if (rowFetchMode == 0)
 	{
 		connection->connectionState = MULTI_CONNECTION_LOST;
 		return false;
@@ -4644,6 +7191,28 @@ SendNextQuery(TaskPlacementExecution *placementExecution,
 }
 
 
+/*
+ * SetRowFetchMode makes libpq return the rows of the query whose results are
+ * next in line on the connection in results of at most
+ * citus.executor_result_chunk_size rows, such that the memory used for a
+ * result stays bounded without paying the per-row overhead of single-row
+ * mode. When libpq does not support chunked rows mode, or the chunk size is
+ * 1, we fall back to single-row mode. Returns 0 on failure, like libpq.
+ */
+static int
+SetRowFetchMode(MultiConnection *connection)
+{
+#ifdef LIBPQ_HAS_CHUNK_MODE
+	if (ExecutorResultChunkSize > 1)
+	{
+		return PQsetChunkedRowsMode(connection->pgConn, ExecutorResultChunkSize);
+	}
+#endif
+
+	return PQsetSingleRowMode(connection->pgConn);
+}
+
+
 /*
  * ReceiveResults reads the result of a command or query and writes returned
  * rows to the tuple store of the scan state. It returns whether fetching results
@@ -4688,18 +7257,65 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 			break;
 		}
 
-		ExecStatusType resultStatus = PQresultStatus(result);
+		if (INSTR_TIME_IS_ZERO(placementExecution->firstResultTime))
+		{
+			INSTR_TIME_SET_CURRENT(placementExecution->firstResultTime);
+		}
+
+		ExecStatusType resultStatus = PQresultStatus(result);
+
+#ifdef LIBPQ_HAS_CHUNK_MODE
+		if (resultStatus == PGRES_TUPLES_CHUNK)
+		{
+			/* a chunk of rows is processed the same way as a single row */
+			resultStatus = PGRES_SINGLE_TUPLE;
+		}
+#endif
+
+		if (shardCommandExecution->hedgedPlacementExecution != NULL &&
+			!ClaimHedgedTaskResults(placementExecution, resultStatus))
+		{
+			/* another copy of the hedged read provides the results */
+			storeRows = false;
+
+			if (resultStatus != PGRES_COMMAND_OK && resultStatus != PGRES_TUPLES_OK &&
+				resultStatus != PGRES_SINGLE_TUPLE)
+			{
+				/* most likely the cancellation we sent, not a reason to fail */
+				PQclear(result);
+
+				placementExecution->queryIndex++;
+				continue;
+			}
+		}
+
+		if (shardCommandExecution->executionState == TASK_EXECUTION_FINISHED &&
+			resultStatus != PGRES_COMMAND_OK && resultStatus != PGRES_TUPLES_OK &&
+			resultStatus != PGRES_SINGLE_TUPLE)
+		{
+			/* the task was cancelled once we had enough rows, ignore the error */
+			PQclear(result);
+
+			placementExecution->queryIndex++;
+			continue;
+		}
+
 		if (resultStatus == PGRES_COMMAND_OK)
 		{
 			char *currentAffectedTupleString = PQcmdTuples(result);
 			int64 currentAffectedTupleCount = 0;
 
-			/* if there are multiple replicas, make sure to consider only one */
-			if (storeRows && *currentAffectedTupleString != '\0')
+			if (*currentAffectedTupleString != '\0')
 			{
 				currentAffectedTupleCount = pg_strtoint64(currentAffectedTupleString);
 				Assert(currentAffectedTupleCount >= 0);
-				execution->rowsProcessed += currentAffectedTupleCount;
+				placementExecution->rowsProcessed += currentAffectedTupleCount;
+
+				/* if there are multiple replicas, make sure to consider only one */
+				if (storeRows)
+				{
+					execution->rowsProcessed += currentAffectedTupleCount;
+				}
 			}
 
 			PQclear(result);
@@ -4781,12 +7397,23 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 				{
 					initStringInfo(&execution->stringInfoDataArray[i]);
 				}
+
+				pfree(execution->columnValues);
+				pfree(execution->columnNulls);
+				execution->columnValues = palloc0(execution->allocatedColumnCount *
+												  sizeof(Datum));
+				execution->columnNulls = palloc0(execution->allocatedColumnCount *
+												 sizeof(bool));
 			}
 		}
 
 		void **columnArray = execution->columnArray;
 		StringInfoData *stringInfoDataArray = execution->stringInfoDataArray;
+		Datum *columnValues = execution->columnValues;
+		bool *columnNulls = execution->columnNulls;
 		bool binaryResults = shardCommandExecution->binaryResults;
+		BinaryDecodeMethod *binaryDecodeMethods =
+			shardCommandExecution->binaryDecodeMethods[queryIndex];
 
 		/*
 		 * stringInfoDataArray is NULL when EnableBinaryProtocol is false. So
@@ -4810,6 +7437,12 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 
 			for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
 			{
+				if (binaryResults)
+				{
+					/* BuildTupleFromBytes treats non-null columns as decoded */
+					columnNulls[columnIndex] = true;
+				}
+
 				if (PQgetisnull(result, rowIndex, columnIndex))
 				{
 					columnArray[columnIndex] = NULL;
@@ -4824,6 +7457,18 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 						{
 							ereport(ERROR, (errmsg("unexpected text result")));
 						}
+
+						if (binaryDecodeMethods != NULL &&
+							DecodeFixedWidthBinaryValue(binaryDecodeMethods[columnIndex],
+														value, valueLength,
+														&columnValues[columnIndex]))
+						{
+							/* decoded straight from the result, no need to copy */
+							columnNulls[columnIndex] = false;
+							tupleLibpqSize += valueLength;
+							continue;
+						}
+
 						resetStringInfo(&stringInfoDataArray[columnIndex]);
 						appendBinaryStringInfo(&stringInfoDataArray[columnIndex],
 											   value, valueLength);
@@ -4848,7 +7493,8 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 			if (binaryResults)
 			{
 				heapTuple = BuildTupleFromBytes(attInMetadata,
-												(fmStringInfo *) columnArray);
+												(fmStringInfo *) columnArray,
+												columnValues, columnNulls);
 			}
 			else
 			{
@@ -4865,6 +7511,7 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 			MemoryContextReset(rowContext);
 
 			execution->rowsProcessed++;
+			placementExecution->rowsProcessed++;
 		}
 
 		PQclear(result);
@@ -4886,7 +7533,7 @@ ReceiveResults(WorkerSession *session, bool storeRows)
  * NOTE: This function is a copy of the PG function TupleDescGetAttInMetadata,
  * except that it uses getTypeBinaryInputInfo instead of getTypeInputInfo.
  */
-static AttInMetadata *
+AttInMetadata *
 TupleDescGetAttBinaryInMetadata(TupleDesc tupdesc)
 {
 	int natts = tupdesc->natts;
@@ -4927,31 +7574,247 @@ TupleDescGetAttBinaryInMetadata(TupleDesc tupdesc)
 }
 
 
+/*
+ * TupleDescGetBinaryDecodeMethods returns, for each attribute of the given
+ * TupleDesc, whether it can be decoded from its binary representation without
+ * calling the receive function. That is the case for the common fixed-width
+ * by-value types, whose receive functions only convert from network byte
+ * order. Domains are not decoded directly, since their constraints need to
+ * be checked.
+ */
+static BinaryDecodeMethod *
+TupleDescGetBinaryDecodeMethods(TupleDesc tupdesc)
+{
+	int natts = tupdesc->natts;
+	BinaryDecodeMethod *decodeMethods = palloc0(natts * sizeof(BinaryDecodeMethod));
+
+	for (int i = 0; i < natts; i++)
+	{
+		Form_pg_attribute att = TupleDescAttr(tupdesc, i);
+
+		if (att->attisdropped)
+		{
+			continue;
+		}
+
+		switch (att->atttypid)
+		{
+			case BOOLOID:
+			{
+				decodeMethods[i] = BINARY_DECODE_BOOL;
+				break;
+			}
+
+			case INT2OID:
+			{
+				decodeMethods[i] = BINARY_DECODE_INT2;
+				break;
+			}
+
+			case INT4OID:
+			{
+				decodeMethods[i] = BINARY_DECODE_INT4;
+				break;
+			}
+
+			case OIDOID:
+			{
+				decodeMethods[i] = BINARY_DECODE_OID;
+				break;
+			}
+
+			case INT8OID:
+			{
+				decodeMethods[i] = BINARY_DECODE_INT8;
+				break;
+			}
+
+			case FLOAT4OID:
+			{
+				decodeMethods[i] = BINARY_DECODE_FLOAT4;
+				break;
+			}
+
+			case FLOAT8OID:
+			{
+				decodeMethods[i] = BINARY_DECODE_FLOAT8;
+				break;
+			}
+
+			case TIMESTAMPOID:
+			case TIMESTAMPTZOID:
+			{
+				/* a typmod requires rounding, leave that to the receive function */
+				if (att->atttypmod < 0)
+				{
+					decodeMethods[i] = BINARY_DECODE_TIMESTAMP;
+				}
+				break;
+			}
+
+			default:
+			{
+				decodeMethods[i] = BINARY_DECODE_RECEIVE_FUNCTION;
+				break;
+			}
+		}
+	}
+
+	return decodeMethods;
+}
+
+
+/*
+ * DecodeFixedWidthBinaryValue decodes the binary representation of a column
+ * value into a datum using the given decode method, and returns true if it
+ * did so. It returns false for values that should go through the receive
+ * function of the type, including the ones with an unexpected length, such
+ * that the receive function can throw the appropriate error.
+ */
+static bool
+DecodeFixedWidthBinaryValue(BinaryDecodeMethod decodeMethod, char *value,
+							int valueLength, Datum *datum)
+{
+	switch (decodeMethod)
+	{
+		case BINARY_DECODE_BOOL:
+		{
+			if (valueLength != 1)
+			{
+				return false;
+			}
+
+			*datum = BoolGetDatum(*value != 0);
+			return true;
+		}
+
+		case BINARY_DECODE_INT2:
+		{
+			uint16 networkValue = 0;
+			if (valueLength != sizeof(networkValue))
+			{
+				return false;
+			}
+
+			memcpy_s(&networkValue, sizeof(networkValue), value, sizeof(networkValue));
+			*datum = Int16GetDatum((int16) pg_ntoh16(networkValue));
+			return true;
+		}
+
+		case BINARY_DECODE_INT4:
+		case BINARY_DECODE_OID:
+		{
+			uint32 networkValue = 0;
+			if (valueLength != sizeof(networkValue))
+			{
+				return false;
+			}
+
+			memcpy_s(&networkValue, sizeof(networkValue), value, sizeof(networkValue));
+			uint32 hostValue = pg_ntoh32(networkValue);
+
+			*datum = decodeMethod == BINARY_DECODE_OID ?
+					 ObjectIdGetDatum((Oid) hostValue) :
+					 Int32GetDatum((int32) hostValue);
+			return true;
+		}
+
+		case BINARY_DECODE_FLOAT4:
+		{
+			union
+			{
+				float4 f;
+				uint32 i;
+			} swap;
+
+			if (valueLength != sizeof(swap.i))
+			{
+				return false;
+			}
+
+			memcpy_s(&swap.i, sizeof(swap.i), value, sizeof(swap.i));
+			swap.i = pg_ntoh32(swap.i);
+
+			*datum = Float4GetDatum(swap.f);
+			return true;
+		}
+
+		case BINARY_DECODE_INT8:
+		case BINARY_DECODE_FLOAT8:
+		case BINARY_DECODE_TIMESTAMP:
+		{
+			union
+			{
+				float8 f;
+				int64 i;
+			} swap;
+
+			if (valueLength != sizeof(swap.i))
+			{
+				return false;
+			}
+
+			memcpy_s(&swap.i, sizeof(swap.i), value, sizeof(swap.i));
+			swap.i = (int64) pg_ntoh64((uint64) swap.i);
+
+			if (decodeMethod == BINARY_DECODE_FLOAT8)
+			{
+				*datum = Float8GetDatum(swap.f);
+			}
+			else if (decodeMethod == BINARY_DECODE_TIMESTAMP &&
+					 !TIMESTAMP_NOT_FINITE(swap.i) && !IS_VALID_TIMESTAMP(swap.i))
+			{
+				/* let the receive function report the out of range timestamp */
+				return false;
+			}
+			else
+			{
+				*datum = Int64GetDatum(swap.i);
+			}
+
+			return true;
+		}
+
+		case BINARY_DECODE_RECEIVE_FUNCTION:
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
 /*
  * BuildTupleFromBytes - build a HeapTuple given user data in binary form.
  * values is an array of StringInfos, one for each attribute of the return
- * tuple. A NULL StringInfo pointer indicates we want to create a NULL field.
+ * tuple. A NULL StringInfo pointer indicates we want to create a NULL field,
+ * unless the corresponding entry in nulls is false, in which case the caller
+ * already decoded the value into dvalues. The caller provides dvalues and
+ * nulls such that they can be reused across tuples.
  *
  * NOTE: This function is a copy of the PG function BuildTupleFromCStrings,
  * except that it uses ReceiveFunctionCall instead of InputFunctionCall.
  */
-static HeapTuple
-BuildTupleFromBytes(AttInMetadata *attinmeta, fmStringInfo *values)
+HeapTuple
+BuildTupleFromBytes(AttInMetadata *attinmeta, fmStringInfo *values, Datum *dvalues,
+					bool *nulls)
 {
 	TupleDesc tupdesc = attinmeta->tupdesc;
 	int natts = tupdesc->natts;
 	int i;
 
-	Datum *dvalues = (Datum *) palloc(natts * sizeof(Datum));
-	bool *nulls = (bool *) palloc(natts * sizeof(bool));
-
 	/*
 	 * Call the "in" function for each non-dropped attribute, even for nulls,
 	 * to support domains.
 	 */
 	for (i = 0; i < natts; i++)
 	{
-		if (!TupleDescAttr(tupdesc, i)->attisdropped)
+		if (values[i] == NULL && !nulls[i])
+		{
+			/* value is already decoded by DecodeFixedWidthBinaryValue */
+			continue;
+		}
+		else if (!TupleDescAttr(tupdesc, i)->attisdropped)
 		{
 			/* Non-dropped attributes */
 			dvalues[i] = ReceiveFunctionCall(&attinmeta->attinfuncs[i],
@@ -4980,13 +7843,6 @@ BuildTupleFromBytes(AttInMetadata *attinmeta, fmStringInfo *values)
 	 */
 	HeapTuple tuple = heap_form_tuple(tupdesc, dvalues, nulls);
 
-	/*
-	 * Release locally palloc'd space.  XXX would probably be good to pfree
-	 * values of pass-by-reference datums, as well.
-	 */
-	pfree(dvalues);
-	pfree(nulls);
-
 	return tuple;
 }
 
@@ -5090,6 +7946,14 @@ WorkerSessionFailed(WorkerSession *session)
 		PlacementExecutionDone(placementExecution, succeeded);
 	}
 
+	dlist_foreach(iter, &session->pipelinedTaskQueue)
+	{
+		placementExecution =
+			dlist_container(TaskPlacementExecution, sessionPipelinedQueueNode, iter.cur);
+
+		PlacementExecutionDone(placementExecution, succeeded);
+	}
+
 	dlist_foreach(iter, &session->pendingTaskQueue)
 	{
 		placementExecution =
@@ -5133,6 +7997,13 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 		return;
 	}
 
+	RemoveFromSharedRunningTaskCount(placementExecution);
+
+	if (placementExecution->traceParent != NULL)
+	{
+		ReportPlacementExecutionTraceSpan(placementExecution, succeeded);
+	}
+
 	if (succeeded)
 	{
 		/* mark the placement execution as finished */
@@ -5146,6 +8017,22 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 		workerPool->totalTaskExecutionTime += durationMicrosecs;
 		workerPool->totalExecutedTasks += 1;
 
+		workerPool->unrecordedTaskExecutionTime += durationMicrosecs;
+		workerPool->unrecordedExecutedTasks += 1;
+
+		if (execution->taskTimingsQueryId != 0)
+		{
+			AddPlacementExecutionTaskTimings(placementExecution);
+		}
+
+		if (execution->collectNetworkMetrics)
+		{
+			RecordPlacementExecutionNetworkMetrics(placementExecution);
+		}
+
+		RecordShardAccess(shardCommandExecution->task->anchorShardId,
+						  placementExecution->rowsProcessed, durationMicrosecs);
+
 		if (IsLoggableLevel(DEBUG4))
 		{
 			ereport(DEBUG4, (errmsg("task execution (%d) for placement (%ld) on anchor "
@@ -5200,6 +8087,26 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 	if (newExecutionState == TASK_EXECUTION_FINISHED)
 	{
 		execution->unfinishedTaskCount--;
+
+		if (shardCommandExecution->taskProgress != NULL)
+		{
+			ReportShardTaskFinished(shardCommandExecution->taskProgress);
+		}
+
+		if (execution->taskFinishedCallback != NULL)
+		{
+			List *readyTaskList =
+				execution->taskFinishedCallback(shardCommandExecution->task,
+												execution->taskFinishedContext);
+			AddTasksToDistributedExecution(execution, readyTaskList);
+		}
+
+		if (execution->sortedMerge != NULL)
+		{
+			SortedMergeTaskFinished(execution->sortedMerge,
+									shardCommandExecution->task);
+		}
+
 		return;
 	}
 	else if (newExecutionState == TASK_EXECUTION_FAILOVER_TO_LOCAL_EXECUTION)
@@ -5236,13 +8143,174 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 		execution->failed = true;
 		return;
 	}
-	else if (!failedPlacementExecutionIsOnPendingQueue)
+	else if (!failedPlacementExecutionIsOnPendingQueue &&
+			 !HasActiveHedgedPlacementExecution(shardCommandExecution))
 	{
+		/* the other copy of a hedged read can still finish the task */
 		ScheduleNextPlacementExecution(placementExecution, succeeded);
 	}
 }
 
 
+/*
+ * ReportPlacementExecutionTraceSpan passes the span of a traced placement
+ * execution, from getting a connection until now, to the trace span hook.
+ */
+static void
+ReportPlacementExecutionTraceSpan(TaskPlacementExecution *placementExecution,
+								  bool succeeded)
+{
+	WorkerPool *workerPool = placementExecution->workerPool;
+	Task *task = placementExecution->shardCommandExecution->task;
+	instr_time endTime;
+
+	INSTR_TIME_SET_CURRENT(endTime);
+	INSTR_TIME_SUBTRACT(endTime, placementExecution->startTime);
+
+	ReportTraceSpan(placementExecution->traceParent, workerPool->nodeName,
+					workerPool->nodePort, task->anchorShardId,
+					INSTR_TIME_GET_MILLISEC(endTime), succeeded);
+}
+
+
+/*
+ * RecordPlacementExecutionNetworkMetrics records the network and connection
+ * metrics of a successful placement execution on its task for EXPLAIN ANALYZE.
+ */
+static void
+RecordPlacementExecutionNetworkMetrics(TaskPlacementExecution *placementExecution)
+{
+	Task *task = placementExecution->shardCommandExecution->task;
+	WorkerSession *session = placementExecution->assignedSession;
+	instr_time connectionWaitTime = placementExecution->startTime;
+	instr_time firstRowTime = placementExecution->firstResultTime;
+
+	if (!INSTR_TIME_IS_ZERO(placementExecution->readyTime))
+	{
+		INSTR_TIME_SUBTRACT(connectionWaitTime, placementExecution->readyTime);
+	}
+	else
+	{
+		INSTR_TIME_SET_ZERO(connectionWaitTime);
+	}
+
+	if (!INSTR_TIME_IS_ZERO(firstRowTime) &&
+		!INSTR_TIME_IS_ZERO(placementExecution->querySentTime))
+	{
+		INSTR_TIME_SUBTRACT(firstRowTime, placementExecution->querySentTime);
+	}
+	else
+	{
+		INSTR_TIME_SET_ZERO(firstRowTime);
+	}
+
+	task->explainAnalyzeConnectionWaitTime = INSTR_TIME_GET_MILLISEC(connectionWaitTime);
+	task->explainAnalyzeFirstRowTime = INSTR_TIME_GET_MILLISEC(firstRowTime);
+	task->explainAnalyzeRoundTrips = placementExecution->roundTrips;
+	task->explainAnalyzeConnectionReused = session != NULL && session->connectionReused;
+}
+
+
+/*
+ * AddPlacementExecutionTaskTimings adds the durations of the phases of a
+ * successful placement execution to the task timings of its pool.
+ */
+static void
+AddPlacementExecutionTaskTimings(TaskPlacementExecution *placementExecution)
+{
+	TaskTimingHistogram *taskTimings = &(placementExecution->workerPool->taskTimings);
+	instr_time readyTime = placementExecution->readyTime;
+	instr_time startTime = placementExecution->startTime;
+	instr_time querySentTime = placementExecution->querySentTime;
+	instr_time firstResultTime = placementExecution->firstResultTime;
+	instr_time endTime = placementExecution->endTime;
+
+	/* be defensive about timestamps that we did not get to set */
+	if (INSTR_TIME_IS_ZERO(readyTime))
+	{
+		readyTime = startTime;
+	}
+
+	if (INSTR_TIME_IS_ZERO(querySentTime))
+	{
+		querySentTime = startTime;
+	}
+
+	if (INSTR_TIME_IS_ZERO(firstResultTime))
+	{
+		firstResultTime = endTime;
+	}
+
+	AddTaskTimingToHistogram(taskTimings, TASK_TIMING_CONNECTION_WAIT,
+							 MicrosecondsBetweenTimestamps(readyTime, startTime));
+	AddTaskTimingToHistogram(taskTimings, TASK_TIMING_QUERY_SEND,
+							 MicrosecondsBetweenTimestamps(startTime, querySentTime));
+	AddTaskTimingToHistogram(taskTimings, TASK_TIMING_FIRST_RESULT,
+							 MicrosecondsBetweenTimestamps(querySentTime,
+														   firstResultTime));
+	AddTaskTimingToHistogram(taskTimings, TASK_TIMING_RESULT_TRANSFER,
+							 MicrosecondsBetweenTimestamps(firstResultTime, endTime));
+
+	taskTimings->taskCount++;
+}
+
+
+/*
+ * RecordTaskTimings adds the task timings of the pools of a finished execution
+ * to the shared task timings of the query.
+ */
+static void
+RecordTaskTimings(DistributedExecution *execution)
+{
+	WorkerPool *workerPool = NULL;
+	foreach_ptr(workerPool, execution->workerList)
+	{
+		if (workerPool->taskTimings.taskCount == 0)
+		{
+			continue;
+		}
+
+		CitusQueryStatsTaskTimingsEntry(execution->taskTimingsQueryId,
+										workerPool->nodeName, workerPool->nodePort,
+										&workerPool->taskTimings);
+
+		/* do not record the same tasks twice if the execution is reused */
+		memset(&workerPool->taskTimings, 0, sizeof(TaskTimingHistogram));
+	}
+}
+
+
+/*
+ * RecordWorkerPoolTaskExecutionTimes adds the average task execution time of
+ * each pool of a finished execution to the shared moving averages of its
+ * worker. Doing so once per pool rather than once per task keeps the lock of
+ * the shared averages off the path of every task.
+ */
+static void
+RecordWorkerPoolTaskExecutionTimes(DistributedExecution *execution)
+{
+	WorkerPool *workerPool = NULL;
+	foreach_ptr(workerPool, execution->workerList)
+	{
+		if (workerPool->unrecordedExecutedTasks == 0)
+		{
+			continue;
+		}
+
+		double avgTaskExecutionTime =
+			(double) workerPool->unrecordedTaskExecutionTime /
+			workerPool->unrecordedExecutedTasks;
+
+		RecordWorkerTaskExecutionTime(workerPool->nodeName, workerPool->nodePort,
+									  execution->queryShapeId, avgTaskExecutionTime);
+
+		/* do not record the same tasks twice if the execution is reused */
+		workerPool->unrecordedTaskExecutionTime = 0;
+		workerPool->unrecordedExecutedTasks = 0;
+	}
+}
+
+
 /*
  * CanFailoverPlacementExecutionToLocalExecution returns true if the input
  * TaskPlacementExecution can be fail overed to local execution. In other words,
@@ -5425,6 +8493,11 @@ PlacementExecutionReady(TaskPlacementExecution *placementExecution)
 
 	/* update the state to ready for further processing */
 	placementExecution->executionState = PLACEMENT_EXECUTION_READY;
+
+	if (INSTR_TIME_IS_ZERO(placementExecution->readyTime))
+	{
+		INSTR_TIME_SET_CURRENT(placementExecution->readyTime);
+	}
 }
 
 
@@ -0,0 +1,506 @@
+/*-------------------------------------------------------------------------
+ *
+ * admission_control.c
+ *	  Routines for limiting the number of multi-shard queries that run at
+ *	  once across the backends of a node.
+ *
+ * Each multi-shard query may open up to citus.max_adaptive_executor_pool_size
+ * connections per worker, hence a few large analytical queries can take up
+ * the workers and make the router queries that run on the same cluster time
+ * out. When citus.max_concurrent_multi_shard_queries is set, read-only
+ * executions with more than one remote task wait for an admission slot
+ * before they start. Router and fast-path queries have a single task and are
+ * never queued.
+ *
+ * Waiting backends are admitted in the order of their
+ * citus.multi_shard_query_priority, which can be set per role, and then in
+ * the order in which they started to wait. Lower priority queries wait for as
+ * long as higher priority queries keep arriving.
+ *
+ * We do not queue executions in transactions that hold a transaction id or
+ * modified data, since the locks they hold could block the queries that hold
+ * the admission slots. Executions that run while the backend holds a slot,
+ * like those of subplans or of functions called by the query, use the same
+ * slot. A backend gives its slot back when its executions finish, when the
+ * subtransactions they ran in abort, and at the latest at the end of the
+ * transaction.
+ *
+ * Besides the distributed queries, this applies to the task lists that other
+ * parts of Citus run through ExecuteTaskList, like those that sample the
+ * shards to compute the statistics of distributed tables.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "access/xact.h"
+#include "storage/condition_variable.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "utils/memutils.h"
+
+#include "distributed/admission_control.h"
+#include "distributed/backend_data.h"
+#include "distributed/citus_wait_events.h"
+#include "distributed/listutils.h"
+#include "distributed/transaction_management.h"
+
+
+/*
+ * ExecutionAdmissionSlot is the shared memory slot in which a backend tells
+ * the other backends that it waits for admission.
+ */
+typedef struct ExecutionAdmissionSlot
+{
+	bool waiting;
+	int priority;
+
+	/* order in which the backend started to wait */
+	uint64 ticket;
+} ExecutionAdmissionSlot;
+
+
+/*
+ * ExecutionAdmissionControlData holds the number of admitted executions and
+ * the slots of the backends that wait for admission.
+ */
+typedef struct ExecutionAdmissionControlData
+{
+	int trancheId;
+	char *trancheName;
+
+	/* protects all the fields below */
+	LWLock lock;
+
+	/* waiting backends sleep on it until an admitted execution finishes */
+	ConditionVariable waitersConditionVariable;
+
+	int admittedExecutionCount;
+	uint64 nextTicket;
+
+	ExecutionAdmissionSlot slots[FLEXIBLE_ARRAY_MEMBER];
+} ExecutionAdmissionControlData;
+
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static ExecutionAdmissionControlData *ExecutionAdmissionControl = NULL;
+
+/*
+ * Subtransactions of the executions of this backend that use its admission
+ * slot, one entry per execution, in TopTransactionContext. The backend holds
+ * a slot while the list is not empty.
+ */
+static List *AdmittedExecutionSubXacts = NIL;
+
+/* whether we registered the exit callback that gives the slot back */
+static bool RegisteredExecutionAdmissionExit = false;
+
+static bool ShouldQueueExecution(RowModifyLevel modLevel, List *remoteTaskList);
+static void WaitForExecutionAdmission(void);
+static bool HasPrecedingWaiter(int priority, uint64 ticket);
+static void GiveBackAdmissionSlot(void);
+static void ExecutionAdmissionShmemExit(int code, Datum arg);
+
+
+/* GUC, maximum number of multi-shard queries that run at once, 0 for no limit */
+int MaxConcurrentMultiShardQueries = 0;
+
+/* GUC, queries with a higher priority are admitted before those that wait longer */
+int MultiShardQueryPriority = 0;
+
+
+/*
+ * InitializeExecutionAdmission requests the shared memory for admission
+ * control and sets up its initialization.
+ */
+void
+InitializeExecutionAdmission(void)
+{
+	/* On PG 15 and above, we use shmem_request_hook_type */
+	#if PG_VERSION_NUM < PG_VERSION_15
+
+	/* allocate shared memory for pre PG-15 versions */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(ExecutionAdmissionShmemSize());
+	}
+
+	#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ExecutionAdmissionShmemInit;
+}
+
+
+/*
+ * ExecutionAdmissionShmemSize returns the size of the shared memory used for
+ * admission control, which has a slot for each backend.
+ */
+size_t
+ExecutionAdmissionShmemSize(void)
+{
+	Size size = offsetof(ExecutionAdmissionControlData, slots);
+
+	return add_size(size, mul_size(sizeof(ExecutionAdmissionSlot), TotalProcCount()));
+}
+
+
+/*
+ * ExecutionAdmissionShmemInit initializes the shared memory used for
+ * admission control.
+ */
+void
+ExecutionAdmissionShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ExecutionAdmissionControl =
+		(ExecutionAdmissionControlData *) ShmemInitStruct(
+			"Citus Execution Admission Control",
+			ExecutionAdmissionShmemSize(),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		ExecutionAdmissionControl->trancheId = LWLockNewTrancheId();
+		ExecutionAdmissionControl->trancheName = "Citus Execution Admission Control";
+		LWLockRegisterTranche(ExecutionAdmissionControl->trancheId,
+							  ExecutionAdmissionControl->trancheName);
+		LWLockInitialize(&ExecutionAdmissionControl->lock,
+						 ExecutionAdmissionControl->trancheId);
+
+		ConditionVariableInit(&ExecutionAdmissionControl->waitersConditionVariable);
+
+		ExecutionAdmissionControl->admittedExecutionCount = 0;
+		ExecutionAdmissionControl->nextTicket = 0;
+
+		int totalProcCount = TotalProcCount();
+		for (int procIndex = 0; procIndex < totalProcCount; procIndex++)
+		{
+			ExecutionAdmissionSlot *slot = &ExecutionAdmissionControl->slots[procIndex];
+
+			slot->waiting = false;
+			slot->priority = 0;
+			slot->ticket = 0;
+		}
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * AdmitMultiShardExecution waits until the execution with the given remote
+ * tasks may start, if it needs to be admitted. If the execution uses the
+ * admission slot of the backend, returns the current subtransaction, which
+ * the caller should pass to ReleaseExecutionAdmission when the execution
+ * finishes. Returns InvalidSubTransactionId otherwise.
+ */
+SubTransactionId
+AdmitMultiShardExecution(RowModifyLevel modLevel, List *remoteTaskList)
+{
+	if (AdmittedExecutionSubXacts == NIL)
+	{
+		if (!ShouldQueueExecution(modLevel, remoteTaskList))
+		{
+			return InvalidSubTransactionId;
+		}
+
+		if (!RegisteredExecutionAdmissionExit)
+		{
+			before_shmem_exit(ExecutionAdmissionShmemExit, (Datum) 0);
+			RegisteredExecutionAdmissionExit = true;
+		}
+
+		WaitForExecutionAdmission();
+	}
+
+	/*
+	 * Otherwise we already hold a slot, for instance for the query that calls
+	 * us.
+	 */
+	SubTransactionId subId = GetCurrentSubTransactionId();
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+	AdmittedExecutionSubXacts = lappend_int(AdmittedExecutionSubXacts, (int) subId);
+	MemoryContextSwitchTo(oldContext);
+
+	return subId;
+}
+
+
+/*
+ * ShouldQueueExecution returns whether an execution with the given remote
+ * tasks needs to be admitted before it starts.
+ */
+static bool
+ShouldQueueExecution(RowModifyLevel modLevel, List *remoteTaskList)
+{
+	if (MaxConcurrentMultiShardQueries <= 0 || ExecutionAdmissionControl == NULL ||
+		MyProc == NULL)
+	{
+		return false;
+	}
+
+	if (modLevel != ROW_MODIFY_READONLY || list_length(remoteTaskList) <= 1)
+	{
+		/* router queries and modifications are never queued */
+		return false;
+	}
+
+	/*
+	 * Our locks could block the admitted queries, which would then never give
+	 * back their slots.
+	 */
+	if (GetTopTransactionIdIfAny() != InvalidTransactionId ||
+		XactModificationLevel != XACT_MODIFICATION_NONE)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * WaitForExecutionAdmission waits until fewer than
+ * citus.max_concurrent_multi_shard_queries executions are admitted and no
+ * backend that waits before us does, and then takes an admission slot.
+ */
+static void
+WaitForExecutionAdmission(void)
+{
+	ExecutionAdmissionControlData *control = ExecutionAdmissionControl;
+	ExecutionAdmissionSlot *mySlot = &control->slots[MyProc->pgprocno];
+
+	LWLockAcquire(&control->lock, LW_EXCLUSIVE);
+
+	if (control->admittedExecutionCount < MaxConcurrentMultiShardQueries &&
+		!HasPrecedingWaiter(MultiShardQueryPriority, PG_UINT64_MAX))
+	{
+		control->admittedExecutionCount++;
+		LWLockRelease(&control->lock);
+
+		return;
+	}
+
+	mySlot->priority = MultiShardQueryPriority;
+	mySlot->ticket = control->nextTicket++;
+	mySlot->waiting = true;
+
+	LWLockRelease(&control->lock);
+
+	PG_TRY();
+	{
+		for (;;)
+		{
+			CHECK_FOR_INTERRUPTS();
+
+			uint32 waitEventInfo =
+				CitusWaitEventInfo(CITUS_WAIT_EVENT_EXECUTION_ADMISSION);
+			ConditionVariableSleep(&control->waitersConditionVariable, waitEventInfo);
+
+			LWLockAcquire(&control->lock, LW_EXCLUSIVE);
+
+			if (control->admittedExecutionCount < MaxConcurrentMultiShardQueries &&
+				!HasPrecedingWaiter(mySlot->priority, mySlot->ticket))
+			{
+				control->admittedExecutionCount++;
+				mySlot->waiting = false;
+				LWLockRelease(&control->lock);
+
+				break;
+			}
+
+			LWLockRelease(&control->lock);
+		}
+	}
+	PG_CATCH();
+	{
+		LWLockAcquire(&control->lock, LW_EXCLUSIVE);
+		mySlot->waiting = false;
+		LWLockRelease(&control->lock);
+
+		/* the backends that waited after us might be next now */
+		ConditionVariableBroadcast(&control->waitersConditionVariable);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	ConditionVariableCancelSleep();
+}
+
+
+/*
+ * HasPrecedingWaiter returns whether another backend waits for admission with
+ * a higher priority, or with the same priority and an earlier ticket. The
+ * caller should hold the lock of the admission control.
+ */
+static bool
+HasPrecedingWaiter(int priority, uint64 ticket)
+{
+	int totalProcCount = TotalProcCount();
+
+	for (int procIndex = 0; procIndex < totalProcCount; procIndex++)
+	{
+		ExecutionAdmissionSlot *slot = &ExecutionAdmissionControl->slots[procIndex];
+
+		if (!slot->waiting || procIndex == MyProc->pgprocno)
+		{
+			continue;
+		}
+
+		if (slot->priority > priority ||
+			(slot->priority == priority && slot->ticket < ticket))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ReleaseExecutionAdmission is called when an execution that
+ * AdmitMultiShardExecution admitted in the given subtransaction finishes. The
+ * backend gives its slot back when no other execution uses it.
+ */
+void
+ReleaseExecutionAdmission(SubTransactionId admittedSubId)
+{
+	if (!list_member_int(AdmittedExecutionSubXacts, (int) admittedSubId))
+	{
+		/*
+		 * The transaction or subtransaction ended before the execution, see
+		 * ResetExecutionAdmission and ExecutionAdmissionAtSubAbort. Since
+		 * subtransaction ids are not reused, no other execution has the id.
+		 */
+		return;
+	}
+
+	AdmittedExecutionSubXacts = list_delete_int(AdmittedExecutionSubXacts,
+												(int) admittedSubId);
+
+	if (AdmittedExecutionSubXacts == NIL)
+	{
+		GiveBackAdmissionSlot();
+	}
+}
+
+
+/*
+ * ExecutionAdmissionAtSubAbort stops counting the executions that ran in the
+ * aborted subtransaction or in the subtransactions it started, which have
+ * higher ids, and gives back the slot of the backend if no other execution
+ * uses it.
+ */
+void
+ExecutionAdmissionAtSubAbort(SubTransactionId subId)
+{
+	if (AdmittedExecutionSubXacts == NIL)
+	{
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	List *remainingSubXacts = NIL;
+	int admittedSubId = 0;
+	foreach_int(admittedSubId, AdmittedExecutionSubXacts)
+	{
+		if ((SubTransactionId) admittedSubId < subId)
+		{
+			remainingSubXacts = lappend_int(remainingSubXacts, admittedSubId);
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	AdmittedExecutionSubXacts = remainingSubXacts;
+
+	if (AdmittedExecutionSubXacts == NIL)
+	{
+		GiveBackAdmissionSlot();
+	}
+}
+
+
+/*
+ * ResetExecutionAdmission gives back the admission slot of the backend at the
+ * end of the transaction, in case an execution that used it failed.
+ */
+void
+ResetExecutionAdmission(void)
+{
+	if (AdmittedExecutionSubXacts != NIL)
+	{
+		/* the list goes away with TopTransactionContext */
+		AdmittedExecutionSubXacts = NIL;
+		GiveBackAdmissionSlot();
+	}
+}
+
+
+/*
+ * GiveBackAdmissionSlot gives back the admission slot of the backend and
+ * wakes up the waiting backends.
+ */
+static void
+GiveBackAdmissionSlot(void)
+{
+	ExecutionAdmissionControlData *control = ExecutionAdmissionControl;
+
+	LWLockAcquire(&control->lock, LW_EXCLUSIVE);
+
+	Assert(control->admittedExecutionCount > 0);
+	control->admittedExecutionCount--;
+
+	LWLockRelease(&control->lock);
+
+	ConditionVariableBroadcast(&control->waitersConditionVariable);
+}
+
+
+/*
+ * ExecutionAdmissionShmemExit gives back the admission slot of a backend that
+ * exits while it holds or waits for one.
+ */
+static void
+ExecutionAdmissionShmemExit(int code, Datum arg)
+{
+	ExecutionAdmissionControlData *control = ExecutionAdmissionControl;
+
+	if (control == NULL || MyProc == NULL)
+	{
+		return;
+	}
+
+	ExecutionAdmissionSlot *mySlot = &control->slots[MyProc->pgprocno];
+	if (mySlot->waiting)
+	{
+		LWLockAcquire(&control->lock, LW_EXCLUSIVE);
+		mySlot->waiting = false;
+		LWLockRelease(&control->lock);
+
+		ConditionVariableBroadcast(&control->waitersConditionVariable);
+	}
+
+	ResetExecutionAdmission();
+}
@@ -14,6 +14,7 @@
 #include "miscadmin.h"
 
 #include "commands/copy.h"
+#include "distributed/adaptive_executor.h"
 #include "distributed/backend_data.h"
 #include "distributed/citus_clauses.h"
 #include "distributed/citus_custom_scan.h"
@@ -30,10 +31,14 @@
 #include "distributed/multi_executor.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/multi_router_planner.h"
+#include "distributed/parallel_combine.h"
+#include "distributed/parallel_result_scan.h"
 #include "distributed/query_stats.h"
 #include "distributed/shard_utils.h"
 #include "distributed/subplan_execution.h"
+#include "distributed/tenant_load_stats.h"
 #include "distributed/worker_log_messages.h"
+#include "distributed/worker_prepared_statements.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/colocation_utils.h"
 #include "distributed/function_call_delegation.h"
@@ -60,9 +65,9 @@ static void CitusBeginReadOnlyScan(CustomScanState *node, EState *estate, int ef
 static void CitusBeginModifyScan(CustomScanState *node, EState *estate, int eflags);
 static void CitusPreExecScan(CitusScanState *scanState);
 static bool ModifyJobNeedsEvaluation(Job *workerJob);
-static void RegenerateTaskForFasthPathQuery(Job *workerJob);
+static void RegenerateTaskForFasthPathQuery(Job *workerJob, Query *pruningQuery);
 static void RegenerateTaskListForInsert(Job *workerJob);
-static DistributedPlan * CopyDistributedPlanWithoutCache(
+static DistributedPlan * CopyDistributedPlanForExecution(
 	DistributedPlan *originalDistributedPlan);
 static void CitusEndScan(CustomScanState *node);
 static void CitusReScan(CustomScanState *node);
@@ -71,6 +76,9 @@ static void EnsureForceDelegationDistributionKey(Job *job);
 static void EnsureAnchorShardsInJobExist(Job *job);
 static bool AnchorShardsInTaskListExist(List *taskList);
 static void TryToRerouteFastPathModifyQuery(Job *job);
+static void CacheLocalPlansForLocalTasks(List *taskList,
+										 DistributedPlan *originalDistributedPlan,
+										 ParamListInfo paramListInfo);
 
 
 /* create custom scan methods for all executors */
@@ -143,6 +151,8 @@ RegisterCitusCustomScanMethods(void)
 	RegisterCustomScanMethods(&AdaptiveExecutorCustomScanMethods);
 	RegisterCustomScanMethods(&NonPushableInsertSelectCustomScanMethods);
 	RegisterCustomScanMethods(&DelayedErrorCustomScanMethods);
+	RegisterCustomScanMethods(&ParallelCombineCustomScanMethods);
+	RegisterCustomScanMethods(&ParallelResultScanCustomScanMethods);
 }
 
 
@@ -157,6 +167,9 @@ CitusBeginScan(CustomScanState *node, EState *estate, int eflags)
 {
 	CitusScanState *scanState = (CitusScanState *) node;
 
+	/* the adaptive executor only streams results if the scan reads them once */
+	scanState->eflags = eflags;
+
 	/*
 	 * Make sure we can see notices during regular queries, which would typically
 	 * be the result of a function that raises a notices being called.
@@ -178,9 +191,25 @@ CitusBeginScan(CustomScanState *node, EState *estate, int eflags)
 
 	ExecInitScanTupleSlot(node->ss.ps.state, &node->ss, node->ss.ps.scandesc,
 						  &TTSOpsMinimalTuple);
-	ExecAssignScanProjectionInfoWithVarno(&node->ss, INDEX_VAR);
 
-	node->ss.ps.qual = ExecInitQual(node->ss.ps.plan->qual, (PlanState *) node);
+	if (outerPlan(node->ss.ps.plan) != NULL)
+	{
+		/*
+		 * Parallel workers read our rows in the Gather below us and we only
+		 * pass on its rows, see parallel_combine.c. The distributed query is
+		 * executed completely before the Gather starts, so we do not stream.
+		 */
+		scanState->eflags |= EXEC_FLAG_REWIND;
+		node->ss.ps.ps_ProjInfo = NULL;
+
+		ExecInitParallelCombineSource(scanState, estate, eflags);
+	}
+	else
+	{
+		ExecAssignScanProjectionInfoWithVarno(&node->ss, INDEX_VAR);
+
+		node->ss.ps.qual = ExecInitQual(node->ss.ps.plan->qual, (PlanState *) node);
+	}
 
 	DistributedPlan *distributedPlan = scanState->distributedPlan;
 	if (distributedPlan->insertSelectQuery != NULL)
@@ -211,6 +240,10 @@ CitusBeginScan(CustomScanState *node, EState *estate, int eflags)
 		EnsureForceDelegationDistributionKey(workerJob);
 	}
 
+	/* the distribution column value of router queries is known by now */
+	scanState->tenantLoadSample =
+		StartTenantLoadSample(scanState->distributedPlan->workerJob);
+
 	/*
 	 * In case of a prepared statement, we will see this distributed plan again
 	 * on the next execution with a higher usage counter.
@@ -226,6 +259,18 @@ static void
 CitusPreExecScan(CitusScanState *scanState)
 {
 	AdaptiveExecutorPreExecutorRun(scanState);
+
+	if (outerPlanState(&scanState->customScanState) != NULL &&
+		!scanState->finishedRemoteScan)
+	{
+		/*
+		 * The parallel combine scan below us reads our rows. Execute the
+		 * distributed query now, before postgres enters parallel mode.
+		 */
+		AdaptiveExecutor(scanState);
+
+		scanState->finishedRemoteScan = true;
+	}
 }
 
 
@@ -240,6 +285,18 @@ CitusExecScan(CustomScanState *node)
 {
 	CitusScanState *scanState = (CitusScanState *) node;
 
+	if (outerPlanState(node) != NULL)
+	{
+		/* pass on the rows of the parallel combine plan below us */
+		TupleTableSlot *slot = ExecProcNode(outerPlanState(node));
+		if (TupIsNull(slot))
+		{
+			return NULL;
+		}
+
+		return ExecCopySlot(node->ss.ps.ps_ResultTupleSlot, slot);
+	}
+
 	if (!scanState->finishedRemoteScan)
 	{
 		AdaptiveExecutor(scanState);
@@ -266,19 +323,28 @@ CitusBeginReadOnlyScan(CustomScanState *node, EState *estate, int eflags)
 	{
 		/*
 		 * For SELECT queries that have already been pruned we can proceed straight
-		 * to execution, since none of the prepared statement logic applies.
+		 * to execution, since none of the prepared statement logic applies, except
+		 * for caching the local plans of multi-shard queries.
 		 */
+		Job *workerJob = originalDistributedPlan->workerJob;
+		if (IsLocalPlanCachingSupported(workerJob, originalDistributedPlan))
+		{
+			CacheLocalPlansForLocalTasks(workerJob->taskList, originalDistributedPlan,
+										 estate->es_param_list_info);
+		}
+
 		return;
 	}
 
 	/*
-	 * Create a copy of the generic plan for the current execution, but make a shallow
-	 * copy of the plan cache. That means we'll be able to access the plan cache via
-	 * currentPlan->workerJob->localPlannedStatements, but it will be preserved across
-	 * executions by the prepared statement logic.
+	 * Create a copy of the generic plan for the current execution, which shares
+	 * the parts that the execution does not change with the generic plan. That
+	 * includes the plan cache, such that we'll be able to access it via
+	 * currentPlan->workerJob->localPlannedStatements, but it will be preserved
+	 * across executions by the prepared statement logic.
 	 */
 	DistributedPlan *currentPlan =
-		CopyDistributedPlanWithoutCache(originalDistributedPlan);
+		CopyDistributedPlanForExecution(originalDistributedPlan);
 	scanState->distributedPlan = currentPlan;
 
 	Job *workerJob = currentPlan->workerJob;
@@ -301,18 +367,31 @@ CitusBeginReadOnlyScan(CustomScanState *node, EState *estate, int eflags)
 	 *
 	 * TODO: evaluate stable functions
 	 */
-	ExecuteCoordinatorEvaluableExpressions(jobQuery, planState);
+	if (EnableWorkerPreparedStatements && estate->es_param_list_info != NULL)
+	{
+		/*
+		 * Only fill in the parameters for pruning, and send them along with
+		 * the shard query. That way every execution sends the same query
+		 * string for a given shard, which the worker can then keep prepared.
+		 */
+		Query *pruningQuery = copyObject(jobQuery);
+		ExecuteCoordinatorEvaluableExpressions(pruningQuery, planState);
+
+		RegenerateTaskForFasthPathQuery(workerJob, pruningQuery);
+	}
+	else
+	{
+		ExecuteCoordinatorEvaluableExpressions(jobQuery, planState);
 
-	/* job query no longer has parameters, so we should not send any */
-	workerJob->parametersInJobQueryResolved = true;
+		/* job query no longer has parameters, so we should not send any */
+		workerJob->parametersInJobQueryResolved = true;
 
-	/* parameters are filled in, so we can generate a task for this execution */
-	RegenerateTaskForFasthPathQuery(workerJob);
+		/* parameters are filled in, so we can generate a task for this execution */
+		RegenerateTaskForFasthPathQuery(workerJob, jobQuery);
+	}
 
 	if (IsLocalPlanCachingSupported(workerJob, originalDistributedPlan))
 	{
-		Task *task = linitial(workerJob->taskList);
-
 		/*
 		 * We are going to execute this task locally. If it's not already in
 		 * the cache, create a local plan now and add it to the cache. During
@@ -321,8 +400,27 @@ CitusBeginReadOnlyScan(CustomScanState *node, EState *estate, int eflags)
 		 * The plan will be cached across executions when originalDistributedPlan
 		 * represents a prepared statement.
 		 */
-		CacheLocalPlanForShardQuery(task, originalDistributedPlan,
-									estate->es_param_list_info);
+		CacheLocalPlansForLocalTasks(workerJob->taskList, originalDistributedPlan,
+									 estate->es_param_list_info);
+	}
+}
+
+
+/*
+ * CacheLocalPlansForLocalTasks caches a local plan in the given distributed
+ * plan for each task in the list that accesses the local node.
+ */
+static void
+CacheLocalPlansForLocalTasks(List *taskList, DistributedPlan *originalDistributedPlan,
+							 ParamListInfo paramListInfo)
+{
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (TaskAccessesLocalNode(task))
+		{
+			CacheLocalPlanForShardQuery(task, originalDistributedPlan, paramListInfo);
+		}
 	}
 }
 
@@ -349,7 +447,7 @@ CitusBeginModifyScan(CustomScanState *node, EState *estate, int eflags)
 	MemoryContext oldContext = MemoryContextSwitchTo(localContext);
 
 	DistributedPlan *currentPlan =
-		CopyDistributedPlanWithoutCache(originalDistributedPlan);
+		CopyDistributedPlanForExecution(originalDistributedPlan);
 	scanState->distributedPlan = currentPlan;
 
 	Job *workerJob = currentPlan->workerJob;
@@ -386,7 +484,7 @@ CitusBeginModifyScan(CustomScanState *node, EState *estate, int eflags)
 		}
 		else
 		{
-			RegenerateTaskForFasthPathQuery(workerJob);
+			RegenerateTaskForFasthPathQuery(workerJob, jobQuery);
 		}
 	}
 	else if (workerJob->requiresCoordinatorEvaluation)
@@ -434,8 +532,6 @@ CitusBeginModifyScan(CustomScanState *node, EState *estate, int eflags)
 	 */
 	if (IsLocalPlanCachingSupported(workerJob, originalDistributedPlan))
 	{
-		Task *task = linitial(workerJob->taskList);
-
 		/*
 		 * We are going to execute this task locally. If it's not already in
 		 * the cache, create a local plan now and add it to the cache. During
@@ -449,8 +545,8 @@ CitusBeginModifyScan(CustomScanState *node, EState *estate, int eflags)
 		 * The plan will be cached across executions when originalDistributedPlan
 		 * represents a prepared statement.
 		 */
-		CacheLocalPlanForShardQuery(task, originalDistributedPlan,
-									estate->es_param_list_info);
+		CacheLocalPlansForLocalTasks(workerJob->taskList, originalDistributedPlan,
+									 estate->es_param_list_info);
 	}
 
 	MemoryContextSwitchTo(oldContext);
@@ -472,7 +568,7 @@ TryToRerouteFastPathModifyQuery(Job *job)
 	}
 	else
 	{
-		RegenerateTaskForFasthPathQuery(job);
+		RegenerateTaskForFasthPathQuery(job, job->jobQuery);
 		RebuildQueryStrings(job);
 	}
 }
@@ -541,28 +637,50 @@ ModifyJobNeedsEvaluation(Job *workerJob)
 
 
 /*
- * CopyDistributedPlanWithoutCache is a helper function which copies the
+ * CopyDistributedPlanForExecution is a helper function which copies the
  * distributedPlan into the current memory context.
  *
  * We must not change the distributed plan since it may be reused across multiple
- * executions of a prepared statement. Instead we create a deep copy that we only
+ * executions of a prepared statement. Instead we create a copy that we only
  * use for the current execution.
  *
- * We also exclude localPlannedStatements from the copyObject call for performance
- * reasons, as they are immutable, so no need to have a deep copy.
+ * Deep copies of plans with many tasks are expensive, so the copy is mostly an
+ * overlay of the plan: the plan, the worker job and the tasks themselves are
+ * copied, such that the execution can assign their fields, but everything they
+ * point to, like the subplans, the placements and the query strings of the tasks
+ * and localPlannedStatements, is shared with the original plan. Only the job
+ * query is copied deeply, since it gets evaluated and gets its shard names
+ * filled in. With deferred pruning, the execution builds new tasks anyway.
  */
 static DistributedPlan *
-CopyDistributedPlanWithoutCache(DistributedPlan *originalDistributedPlan)
+CopyDistributedPlanForExecution(DistributedPlan *originalDistributedPlan)
 {
-	List *localPlannedStatements =
-		originalDistributedPlan->workerJob->localPlannedStatements;
-	originalDistributedPlan->workerJob->localPlannedStatements = NIL;
+	DistributedPlan *distributedPlan = palloc(sizeof(DistributedPlan));
+	*distributedPlan = *originalDistributedPlan;
+
+	Job *workerJob = palloc(sizeof(Job));
+	*workerJob = *originalDistributedPlan->workerJob;
+
+	workerJob->jobQuery = copyObject(workerJob->jobQuery);
 
-	DistributedPlan *distributedPlan = copyObject(originalDistributedPlan);
+	if (!workerJob->deferredPruning)
+	{
+		/* the tasks get new placements and possibly new query strings */
+		List *taskList = NIL;
+
+		Task *originalTask = NULL;
+		foreach_ptr(originalTask, workerJob->taskList)
+		{
+			Task *task = palloc(sizeof(Task));
+			*task = *originalTask;
 
-	/* set back the immutable field */
-	originalDistributedPlan->workerJob->localPlannedStatements = localPlannedStatements;
-	distributedPlan->workerJob->localPlannedStatements = localPlannedStatements;
+			taskList = lappend(taskList, task);
+		}
+
+		workerJob->taskList = taskList;
+	}
+
+	distributedPlan->workerJob = workerJob;
 
 	return distributedPlan;
 }
@@ -606,15 +724,38 @@ RegenerateTaskListForInsert(Job *workerJob)
 /*
  * RegenerateTaskForFasthPathQuery does the shard pruning for
  * UPDATE/DELETE/SELECT fast path router queries and rebuilds the query strings.
+ * The pruning is done on pruningQuery, which is either the job query or a copy
+ * of it in which the parameters are filled in.
  */
 static void
-RegenerateTaskForFasthPathQuery(Job *workerJob)
+RegenerateTaskForFasthPathQuery(Job *workerJob, Query *pruningQuery)
 {
+	if (pruningQuery->commandType == CMD_SELECT)
+	{
+		List *valueGroupList = DistributionKeyValueGroups(pruningQuery);
+		if (list_length(valueGroupList) > 1)
+		{
+			/* the values of the IN-list or = ANY(array) belong to multiple shards */
+			DeferredErrorMessage *planningError = NULL;
+
+			workerJob->taskList = FastPathArrayFilterTaskList(workerJob, valueGroupList,
+															  &planningError);
+			if (planningError != NULL)
+			{
+				RaiseDeferredError(planningError, ERROR);
+			}
+
+			return;
+		}
+	}
+
 	bool isMultiShardQuery = false;
+	List *cachedPlacementList = NIL;
 	List *shardIntervalList =
-		TargetShardIntervalForFastPathQuery(workerJob->jobQuery,
+		TargetShardIntervalForFastPathQuery(pruningQuery,
 											&isMultiShardQuery, NULL,
-											&workerJob->partitionKeyValue);
+											&workerJob->partitionKeyValue,
+											&cachedPlacementList);
 
 	/*
 	 * A fast-path router query can only yield multiple shards when the parameter
@@ -639,9 +780,13 @@ RegenerateTaskForFasthPathQuery(Job *workerJob)
 	/* fast path queries cannot have local tables */
 	bool hasLocalRelation = false;
 
-	List *placementList =
-		CreateTaskPlacementListForShardIntervals(shardIntervalList, shardsPresent, true,
-												 hasLocalRelation);
+	List *placementList = cachedPlacementList;
+	if (placementList == NIL)
+	{
+		placementList =
+			CreateTaskPlacementListForShardIntervals(shardIntervalList, shardsPresent,
+													 true, hasLocalRelation);
+	}
 	uint64 shardId = INVALID_SHARD_ID;
 
 	if (shardsPresent)
@@ -737,6 +882,18 @@ CitusEndScan(CustomScanState *node)
 	Const *partitionKeyConst = NULL;
 	char *partitionKeyString = NULL;
 
+	if (outerPlanState(node) != NULL)
+	{
+		/* end the Gather, and thereby the parallel workers, first */
+		ExecEndNode(outerPlanState(node));
+	}
+
+	/*
+	 * Queries like LIMIT might stop reading before a streaming execution
+	 * finishes, let it finish to keep the connections in a known state.
+	 */
+	EndStreamingExecution(scanState);
+
 	/* stop propagating notices */
 	DisableWorkerMessagePropagation();
 
@@ -767,6 +924,18 @@ CitusEndScan(CustomScanState *node)
 		CitusQueryStatsExecutorsEntry(queryId, executorType, partitionKeyString);
 	}
 
+	if (scanState->tenantLoadSample != NULL)
+	{
+		uint64 rowCount = scanState->returnedTupleCount;
+		if (scanState->distributedPlan->modLevel != ROW_MODIFY_READONLY)
+		{
+			rowCount = ScanStateGetExecutorState(scanState)->es_processed;
+		}
+
+		FinishTenantLoadSample(scanState->tenantLoadSample, rowCount);
+		scanState->tenantLoadSample = NULL;
+	}
+
 	if (scanState->tuplestorestate)
 	{
 		tuplestore_end(scanState->tuplestorestate);
@@ -777,11 +946,17 @@ CitusEndScan(CustomScanState *node)
 
 /*
  * CitusReScan is not normally called, except in certain cases of
- * DECLARE .. CURSOR WITH HOLD ..
+ * DECLARE .. CURSOR WITH HOLD .., and when the parallel combine plan
+ * below the scan needs to be rescanned.
  */
 static void
 CitusReScan(CustomScanState *node)
-{ }
+{
+	if (outerPlanState(node) != NULL)
+	{
+		ExecReScan(outerPlanState(node));
+	}
+}
 
 
 /*
@@ -13,8 +13,11 @@
 
 #include "distributed/adaptive_executor.h"
 #include "distributed/directed_acyclic_graph_execution.h"
+#include "distributed/distributed_command_progress.h"
 #include "distributed/listutils.h"
+#include "distributed/local_executor.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/transaction_management.h"
@@ -40,8 +43,42 @@ typedef struct TaskHashEntry
 	Task *task;
 }TaskHashEntry;
 
+/*
+ * TaskDependencyEntry keeps track of how many dependencies of a task are not
+ * completed yet, and which tasks depend on the task.
+ */
+typedef struct TaskDependencyEntry
+{
+	TaskHashKey key;
+	int uncompletedDependencyCount;
+	List *dependingTaskList;
+} TaskDependencyEntry;
+
+/*
+ * DataflowExecution is the state of executing the tasks as soon as their
+ * own dependencies are completed.
+ */
+typedef struct DataflowExecution
+{
+	HTAB *completedTasks;
+	HTAB *taskDependencies;
+} DataflowExecution;
+
+
+/* GUC, whether tasks start as soon as their own dependencies are completed */
+bool EnableRepartitionDataflowScheduling = false;
+
+static bool ExecuteTasksInDataflowOrder(List *allTasks, HTAB *completedTasks);
+static TaskDependencyEntry * TaskDependencies(DataflowExecution *dataflowExecution,
+											  Task *task);
+static void CompleteDataflowTask(DataflowExecution *dataflowExecution, Task *task,
+								 List **readyTaskList);
+static void ScheduleDataflowTask(DataflowExecution *dataflowExecution, Task *task,
+								 List **readyTaskList);
+static List * DataflowTaskFinished(Task *task, void *context);
 static bool IsAllDependencyCompleted(Task *task, HTAB *completedTasks);
 static void AddCompletedTasks(List *curCompletedTasks, HTAB *completedTasks);
+static void ExecuteTaskBatch(List *taskList);
 static List * FindExecutableTasks(List *allTasks, HTAB *completedTasks);
 static List * RemoveMergeTasks(List *taskList);
 static bool IsTaskAlreadyCompleted(Task *task, HTAB *completedTasks);
@@ -51,6 +88,10 @@ static bool IsTaskAlreadyCompleted(Task *task, HTAB *completedTasks);
  * tasks in their dependency order. To do so, it iterates all
  * the tasks and finds the ones that can be executed at that time, it tries to
  * execute all of them in parallel. The parallelism is bound by MaxAdaptiveExecutorPoolSize.
+ *
+ * When citus.enable_repartition_dataflow_scheduling is on, the tasks instead
+ * run in a single execution that starts each task as soon as its own
+ * dependencies are completed, see ExecuteTasksInDataflowOrder.
  */
 void
 ExecuteTasksInDependencyOrder(List *allTasks, List *excludedTasks, List *jobIds)
@@ -61,6 +102,13 @@ ExecuteTasksInDependencyOrder(List *allTasks, List *excludedTasks, List *jobIds)
 	/* We only execute depended jobs' tasks, therefore to not execute */
 	/* top level tasks, we add them to the completedTasks. */
 	AddCompletedTasks(excludedTasks, completedTasks);
+
+	if (EnableRepartitionDataflowScheduling &&
+		ExecuteTasksInDataflowOrder(allTasks, completedTasks))
+	{
+		return;
+	}
+
 	while (true)
 	{
 		List *curTasks = FindExecutableTasks(allTasks, completedTasks);
@@ -73,7 +121,7 @@ ExecuteTasksInDependencyOrder(List *allTasks, List *excludedTasks, List *jobIds)
 		List *executableTasks = RemoveMergeTasks(curTasks);
 		if (list_length(executableTasks) > 0)
 		{
-			ExecuteTaskList(ROW_MODIFY_NONE, executableTasks);
+			ExecuteTaskBatch(executableTasks);
 		}
 
 		AddCompletedTasks(curTasks, completedTasks);
@@ -82,6 +130,229 @@ ExecuteTasksInDependencyOrder(List *allTasks, List *excludedTasks, List *jobIds)
 }
 
 
+/*
+ * ExecuteTasksInDataflowOrder executes the tasks that are not completed yet
+ * through one execution, which starts with the tasks whose dependencies are
+ * completed and then adds each task once its own dependencies finished. A
+ * slow task therefore only holds back the tasks that depend on it, rather
+ * than all the tasks of the next level.
+ *
+ * Local execution only runs after the remote execution, so the function
+ * returns false without executing anything if any of the tasks accesses the
+ * local node, and the caller executes the tasks level by level instead.
+ */
+static bool
+ExecuteTasksInDataflowOrder(List *allTasks, HTAB *completedTasks)
+{
+	List *uncompletedTaskList = NIL;
+
+	Task *task = NULL;
+	foreach_ptr(task, allTasks)
+	{
+		bool found = false;
+		TaskHashKey taskKey = { task->jobId, task->taskId };
+
+		hash_search(completedTasks, &taskKey, HASH_FIND, &found);
+		if (!found)
+		{
+			uncompletedTaskList = lappend(uncompletedTaskList, task);
+		}
+	}
+
+	if (AnyTaskAccessesLocalNode(RemoveMergeTasks(uncompletedTaskList)))
+	{
+		return false;
+	}
+
+	DataflowExecution *dataflowExecution = palloc0(sizeof(DataflowExecution));
+	dataflowExecution->completedTasks = completedTasks;
+	dataflowExecution->taskDependencies =
+		CreateSimpleHash(TaskHashKey, TaskDependencyEntry);
+
+	foreach_ptr(task, uncompletedTaskList)
+	{
+		TaskDependencyEntry *taskEntry = TaskDependencies(dataflowExecution, task);
+
+		Task *dependencyTask = NULL;
+		foreach_ptr(dependencyTask, task->dependentTaskList)
+		{
+			bool found = false;
+			TaskHashKey dependencyKey = { dependencyTask->jobId, dependencyTask->taskId };
+
+			hash_search(completedTasks, &dependencyKey, HASH_FIND, &found);
+			if (!found)
+			{
+				TaskDependencyEntry *dependencyEntry =
+					TaskDependencies(dataflowExecution, dependencyTask);
+				dependencyEntry->dependingTaskList =
+					lappend(dependencyEntry->dependingTaskList, task);
+
+				taskEntry->uncompletedDependencyCount++;
+			}
+		}
+	}
+
+	List *readyTaskList = NIL;
+	foreach_ptr(task, uncompletedTaskList)
+	{
+		TaskDependencyEntry *taskEntry = TaskDependencies(dataflowExecution, task);
+		if (taskEntry->uncompletedDependencyCount == 0)
+		{
+			ScheduleDataflowTask(dataflowExecution, task, &readyTaskList);
+		}
+	}
+
+	if (readyTaskList != NIL)
+	{
+		SetDistributedCommandPhase(DISTRIBUTED_COMMAND_PHASE_PARTITIONING_RESULTS);
+
+		ExecuteTaskListWithTaskFinishedCallback(ROW_MODIFY_NONE, readyTaskList,
+												DataflowTaskFinished,
+												dataflowExecution);
+	}
+
+	return true;
+}
+
+
+/*
+ * TaskDependencies returns the dependency entry of the given task, which is
+ * created if it does not exist yet.
+ */
+static TaskDependencyEntry *
+TaskDependencies(DataflowExecution *dataflowExecution, Task *task)
+{
+	bool found = false;
+	TaskHashKey taskKey = { task->jobId, task->taskId };
+
+	TaskDependencyEntry *taskEntry = hash_search(dataflowExecution->taskDependencies,
+												 &taskKey, HASH_ENTER, &found);
+	if (!found)
+	{
+		taskEntry->uncompletedDependencyCount = 0;
+		taskEntry->dependingTaskList = NIL;
+	}
+
+	return taskEntry;
+}
+
+
+/*
+ * ScheduleDataflowTask adds a task whose dependencies are completed to
+ * readyTaskList. Merge tasks do not need to be executed, so they complete
+ * right away.
+ */
+static void
+ScheduleDataflowTask(DataflowExecution *dataflowExecution, Task *task,
+					 List **readyTaskList)
+{
+	if (task->taskType == MERGE_TASK)
+	{
+		CompleteDataflowTask(dataflowExecution, task, readyTaskList);
+		return;
+	}
+
+	*readyTaskList = lappend(*readyTaskList, task);
+}
+
+
+/*
+ * CompleteDataflowTask marks the given task as completed and schedules the
+ * depending tasks whose dependencies are all completed now.
+ */
+static void
+CompleteDataflowTask(DataflowExecution *dataflowExecution, Task *task,
+					 List **readyTaskList)
+{
+	AddCompletedTasks(list_make1(task), dataflowExecution->completedTasks);
+
+	if (task->taskType == MAP_TASK)
+	{
+		ReportDistributedCommandFragmentsProduced(1);
+	}
+	else if (task->taskType == MAP_OUTPUT_FETCH_TASK)
+	{
+		ReportDistributedCommandFragmentsFetched(1);
+	}
+
+	TaskDependencyEntry *taskEntry = TaskDependencies(dataflowExecution, task);
+
+	Task *dependingTask = NULL;
+	foreach_ptr(dependingTask, taskEntry->dependingTaskList)
+	{
+		TaskDependencyEntry *dependingEntry =
+			TaskDependencies(dataflowExecution, dependingTask);
+
+		dependingEntry->uncompletedDependencyCount--;
+		if (dependingEntry->uncompletedDependencyCount == 0)
+		{
+			ScheduleDataflowTask(dataflowExecution, dependingTask, readyTaskList);
+		}
+	}
+}
+
+
+/*
+ * DataflowTaskFinished is called by the adaptive executor when a task
+ * finishes, and returns the tasks that can start now.
+ */
+static List *
+DataflowTaskFinished(Task *task, void *context)
+{
+	DataflowExecution *dataflowExecution = (DataflowExecution *) context;
+	List *readyTaskList = NIL;
+
+	CompleteDataflowTask(dataflowExecution, task, &readyTaskList);
+
+	Task *readyTask = NULL;
+	foreach_ptr(readyTask, readyTaskList)
+	{
+		if (readyTask->taskType == MAP_OUTPUT_FETCH_TASK)
+		{
+			SetDistributedCommandPhase(DISTRIBUTED_COMMAND_PHASE_FETCHING_FRAGMENTS);
+			break;
+		}
+	}
+
+	return readyTaskList;
+}
+
+
+/*
+ * ExecuteTaskBatch executes the given tasks, whose dependencies are completed,
+ * and reports the fragments they produce or fetch as the progress of the
+ * repartitioning.
+ */
+static void
+ExecuteTaskBatch(List *taskList)
+{
+	uint64 mapTaskCount = 0;
+	uint64 fetchTaskCount = 0;
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (task->taskType == MAP_OUTPUT_FETCH_TASK)
+		{
+			fetchTaskCount++;
+		}
+		else if (task->taskType == MAP_TASK)
+		{
+			mapTaskCount++;
+		}
+	}
+
+	SetDistributedCommandPhase(fetchTaskCount > 0 ?
+							   DISTRIBUTED_COMMAND_PHASE_FETCHING_FRAGMENTS :
+							   DISTRIBUTED_COMMAND_PHASE_PARTITIONING_RESULTS);
+
+	ExecuteTaskList(ROW_MODIFY_NONE, taskList);
+
+	ReportDistributedCommandFragmentsProduced(mapTaskCount);
+	ReportDistributedCommandFragmentsFetched(fetchTaskCount);
+}
+
+
 /*
  * FindExecutableTasks finds the tasks that can be executed currently,
  * which means that all of their dependencies are executed. If a task
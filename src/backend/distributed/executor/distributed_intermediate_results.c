@@ -22,6 +22,7 @@
 #include "access/tupdesc.h"
 #include "catalog/pg_type.h"
 #include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_command_progress.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_utility.h"
@@ -56,30 +57,51 @@ typedef struct PartitioningTupleDest
 
 	/* what do tuples look like */
 	TupleDesc tupleDesc;
+
+	/* whether the partitions were streamed to the nodes of the target shards */
+	bool streamedToTargetNodes;
 } PartitioningTupleDest;
 
 
+/* GUC, whether to stream partitions to the nodes where they are needed */
+bool EnableStreamingRepartition = false;
+
+
 /* forward declarations of local functions */
+static List * PartitionTasklistResultsInternal(const char *resultIdPrefix,
+											   List *selectTaskList,
+											   int partitionColumnIndex,
+											   CitusTableCacheEntry *targetRelation,
+											   bool binaryFormat,
+											   bool streamToTargetNodes);
+static bool CanStreamTaskListResults(List *selectTaskList,
+									 CitusTableCacheEntry *targetRelation);
 static List * WrapTasksForPartitioning(const char *resultIdPrefix,
 									   List *selectTaskList,
 									   int partitionColumnIndex,
 									   CitusTableCacheEntry *targetRelation,
-									   bool binaryFormat);
+									   bool binaryFormat,
+									   bool streamToTargetNodes);
+static void AppendTargetNodeArguments(StringInfo partitionArguments, Task *selectTask,
+									  CitusTableCacheEntry *targetRelation);
 static List * ExecutePartitionTaskList(List *partitionTaskList,
-									   CitusTableCacheEntry *targetRelation);
+									   CitusTableCacheEntry *targetRelation,
+									   bool streamedToTargetNodes);
 static PartitioningTupleDest * CreatePartitioningTupleDest(
-	CitusTableCacheEntry *targetRelation);
+	CitusTableCacheEntry *targetRelation, bool streamedToTargetNodes);
 static void PartitioningTupleDestPutTuple(TupleDestination *self, Task *task,
 										  int placementIndex, int queryNumber,
 										  HeapTuple heapTuple, uint64 tupleLibpqSize);
 static TupleDesc PartitioningTupleDestTupleDescForQuery(TupleDestination *self, int
 														queryNumber);
-static char * SourceShardPrefix(const char *resultPrefix, uint64 shardId);
+static char * SourceTaskPrefix(const char *resultPrefix, Task *task);
 static DistributedResultFragment * TupleToDistributedResultFragment(HeapTuple heapTuple,
 																	TupleDesc tupleDesc,
 																	CitusTableCacheEntry *
 																	targetRelation,
-																	uint32 sourceNodeId);
+																	uint32 sourceNodeId,
+																	bool
+																	streamedToTargetNodes);
 static void ExecuteSelectTasksIntoTupleDest(List *taskList,
 											TupleDestination *tupleDestination,
 											bool errorOnAnyFailure);
@@ -104,6 +126,11 @@ static void ExecuteFetchTaskList(List *fetchTaskList);
  *
  * partitionColumnIndex determines the column in the selectTaskList to use for
  * partitioning.
+ *
+ * When citus.enable_streaming_repartition is set and every source task and
+ * target shard has a single placement, the partitions are streamed to the
+ * nodes of the target shards while they are produced, so nothing needs to be
+ * fetched afterwards.
  */
 List **
 RedistributeTaskListResults(const char *resultIdPrefix, List *selectTaskList,
@@ -119,13 +146,52 @@ RedistributeTaskListResults(const char *resultIdPrefix, List *selectTaskList,
 	 */
 	UseCoordinatedTransaction();
 
-	List *fragmentList = PartitionTasklistResults(resultIdPrefix, selectTaskList,
-												  partitionColumnIndex,
-												  targetRelation, binaryFormat);
+	bool streamToTargetNodes = EnableStreamingRepartition &&
+							   CanStreamTaskListResults(selectTaskList, targetRelation);
+
+	List *fragmentList = PartitionTasklistResultsInternal(resultIdPrefix, selectTaskList,
+														  partitionColumnIndex,
+														  targetRelation, binaryFormat,
+														  streamToTargetNodes);
 	return ColocateFragmentsWithRelation(fragmentList, targetRelation);
 }
 
 
+/*
+ * CanStreamTaskListResults returns whether the results of the given tasks can
+ * be streamed to the nodes of the target shards, which requires every task and
+ * every target shard to have a single placement.
+ */
+static bool
+CanStreamTaskListResults(List *selectTaskList, CitusTableCacheEntry *targetRelation)
+{
+	Task *selectTask = NULL;
+	foreach_ptr(selectTask, selectTaskList)
+	{
+		if (list_length(selectTask->taskPlacementList) != 1)
+		{
+			return false;
+		}
+	}
+
+	ShardInterval **shardIntervalArray = GetSortedShardIntervalArray(targetRelation);
+	int shardCount = targetRelation->shardIntervalArrayLength;
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		uint64 shardId = shardIntervalArray[shardIndex]->shardId;
+		List *placementList = ActiveShardPlacementList(shardId);
+
+		if (list_length(placementList) != 1)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
 /*
  * PartitionTasklistResults executes the given task list, and partitions results
  * of each task based on targetRelation's distribution method and intervals.
@@ -145,6 +211,25 @@ PartitionTasklistResults(const char *resultIdPrefix, List *selectTaskList,
 						 int partitionColumnIndex,
 						 CitusTableCacheEntry *targetRelation,
 						 bool binaryFormat)
+{
+	bool streamToTargetNodes = false;
+
+	return PartitionTasklistResultsInternal(resultIdPrefix, selectTaskList,
+											partitionColumnIndex, targetRelation,
+											binaryFormat, streamToTargetNodes);
+}
+
+
+/*
+ * PartitionTasklistResultsInternal implements PartitionTasklistResults. When
+ * streamToTargetNodes is set, each partition is stored on the node of the
+ * corresponding target shard instead of the node where the task was executed.
+ */
+static List *
+PartitionTasklistResultsInternal(const char *resultIdPrefix, List *selectTaskList,
+								 int partitionColumnIndex,
+								 CitusTableCacheEntry *targetRelation,
+								 bool binaryFormat, bool streamToTargetNodes)
 {
 	if (!IsCitusTableTypeCacheEntry(targetRelation, HASH_DISTRIBUTED) &&
 		!IsCitusTableTypeCacheEntry(targetRelation, RANGE_DISTRIBUTED))
@@ -164,8 +249,9 @@ PartitionTasklistResults(const char *resultIdPrefix, List *selectTaskList,
 
 	selectTaskList = WrapTasksForPartitioning(resultIdPrefix, selectTaskList,
 											  partitionColumnIndex, targetRelation,
-											  binaryFormat);
-	return ExecutePartitionTaskList(selectTaskList, targetRelation);
+											  binaryFormat, streamToTargetNodes);
+	return ExecutePartitionTaskList(selectTaskList, targetRelation,
+									streamToTargetNodes);
 }
 
 
@@ -178,10 +264,10 @@ static List *
 WrapTasksForPartitioning(const char *resultIdPrefix, List *selectTaskList,
 						 int partitionColumnIndex,
 						 CitusTableCacheEntry *targetRelation,
-						 bool binaryFormat)
+						 bool binaryFormat, bool streamToTargetNodes)
 {
 	List *wrappedTaskList = NIL;
-	ShardInterval **shardIntervalArray = targetRelation->sortedShardIntervalArray;
+	ShardInterval **shardIntervalArray = GetSortedShardIntervalArray(targetRelation);
 	int shardCount = targetRelation->shardIntervalArrayLength;
 
 	ArrayType *minValueArray = NULL;
@@ -206,27 +292,36 @@ WrapTasksForPartitioning(const char *resultIdPrefix, List *selectTaskList,
 	Task *selectTask = NULL;
 	foreach_ptr(selectTask, selectTaskList)
 	{
-		char *taskPrefix = SourceShardPrefix(resultIdPrefix, selectTask->anchorShardId);
+		char *taskPrefix = SourceTaskPrefix(resultIdPrefix, selectTask);
 		char *partitionMethodString = targetRelation->partitionMethod == 'h' ?
 									  "hash" : "range";
 		const char *binaryFormatString = binaryFormat ? "true" : "false";
 
 		Task *wrappedSelectTask = copyObject(selectTask);
 
+		StringInfo partitionArguments = makeStringInfo();
+		appendStringInfo(partitionArguments, "%s,%s,%d,%s,%s,%s,%s",
+						 quote_literal_cstr(taskPrefix),
+						 quote_literal_cstr(TaskQueryString(selectTask)),
+						 partitionColumnIndex,
+						 quote_literal_cstr(partitionMethodString),
+						 minValuesString->data, maxValuesString->data,
+						 binaryFormatString);
+
+		if (streamToTargetNodes)
+		{
+			AppendTargetNodeArguments(partitionArguments, selectTask, targetRelation);
+		}
+
 		StringInfo wrappedQuery = makeStringInfo();
 		appendStringInfo(wrappedQuery,
 						 "SELECT partition_index"
 						 ", %s || '_' || partition_index::text "
 						 ", rows_written "
 						 "FROM worker_partition_query_result"
-						 "(%s,%s,%d,%s,%s,%s,%s) WHERE rows_written > 0",
-						 quote_literal_cstr(taskPrefix),
+						 "(%s) WHERE rows_written > 0",
 						 quote_literal_cstr(taskPrefix),
-						 quote_literal_cstr(TaskQueryString(selectTask)),
-						 partitionColumnIndex,
-						 quote_literal_cstr(partitionMethodString),
-						 minValuesString->data, maxValuesString->data,
-						 binaryFormatString);
+						 partitionArguments->data);
 
 		SetTaskQueryString(wrappedSelectTask, wrappedQuery->data);
 		wrappedTaskList = lappend(wrappedTaskList, wrappedSelectTask);
@@ -236,12 +331,57 @@ WrapTasksForPartitioning(const char *resultIdPrefix, List *selectTaskList,
 }
 
 
+/*
+ * AppendTargetNodeArguments appends the worker_partition_query_result arguments
+ * that make the given task stream each partition to the node of the target
+ * shard. Partitions whose target shard is on the node of the task are written
+ * to a local file, which is denoted by an empty node name.
+ */
+static void
+AppendTargetNodeArguments(StringInfo partitionArguments, Task *selectTask,
+						  CitusTableCacheEntry *targetRelation)
+{
+	ShardPlacement *sourcePlacement = linitial(selectTask->taskPlacementList);
+	ShardInterval **shardIntervalArray = GetSortedShardIntervalArray(targetRelation);
+	int shardCount = targetRelation->shardIntervalArrayLength;
+
+	StringInfo targetNodeNames = makeStringInfo();
+	StringInfo targetNodePorts = makeStringInfo();
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		uint64 shardId = shardIntervalArray[shardIndex]->shardId;
+		ShardPlacement *targetPlacement = linitial(ActiveShardPlacementList(shardId));
+		const char *separator = shardIndex > 0 ? "," : "";
+
+		if (targetPlacement->nodeId == sourcePlacement->nodeId)
+		{
+			appendStringInfo(targetNodeNames, "%s''", separator);
+			appendStringInfo(targetNodePorts, "%s0", separator);
+		}
+		else
+		{
+			appendStringInfo(targetNodeNames, "%s%s", separator,
+							 quote_literal_cstr(targetPlacement->nodeName));
+			appendStringInfo(targetNodePorts, "%s%d", separator,
+							 targetPlacement->nodePort);
+		}
+	}
+
+	appendStringInfo(partitionArguments,
+					 ",target_node_names => ARRAY[%s]::text[]"
+					 ",target_node_ports => ARRAY[%s]::int[]",
+					 targetNodeNames->data, targetNodePorts->data);
+}
+
+
 /*
  * CreatePartitioningTupleDest creates a TupleDestination which consumes results of
  * tasks constructed in WrapTasksForPartitioning.
  */
 static PartitioningTupleDest *
-CreatePartitioningTupleDest(CitusTableCacheEntry *targetRelation)
+CreatePartitioningTupleDest(CitusTableCacheEntry *targetRelation,
+							bool streamedToTargetNodes)
 {
 	int resultColumnCount = 3;
 
@@ -258,6 +398,7 @@ CreatePartitioningTupleDest(CitusTableCacheEntry *targetRelation)
 	PartitioningTupleDest *tupleDest = palloc0(sizeof(PartitioningTupleDest));
 	tupleDest->targetRelation = targetRelation;
 	tupleDest->tupleDesc = tupleDescriptor;
+	tupleDest->streamedToTargetNodes = streamedToTargetNodes;
 	tupleDest->fragmentContext = CurrentMemoryContext;
 	tupleDest->pub.putTuple = PartitioningTupleDestPutTuple;
 	tupleDest->pub.tupleDescForQuery =
@@ -289,11 +430,15 @@ PartitioningTupleDestPutTuple(TupleDestination *self, Task *task,
 	DistributedResultFragment *fragment =
 		TupleToDistributedResultFragment(heapTuple, tupleDest->tupleDesc,
 										 tupleDest->targetRelation,
-										 placement->nodeId);
+										 placement->nodeId,
+										 tupleDest->streamedToTargetNodes);
 
 	tupleDest->fragmentList = lappend(tupleDest->fragmentList, fragment);
 
 	MemoryContextSwitchTo(oldContext);
+
+	ReportDistributedCommandFragmentsProduced(1);
+	ReportDistributedCommandShardRows(fragment->targetShardId, fragment->rowCount);
 }
 
 
@@ -313,15 +458,24 @@ PartitioningTupleDestTupleDescForQuery(TupleDestination *self, int queryNumber)
 
 
 /*
- * SourceShardPrefix returns result id prefix for partitions which have the
- * given anchor shard id.
+ * SourceTaskPrefix returns result id prefix for partitions of the given task,
+ * which is derived from its anchor shard id. Tasks that do not read a shard,
+ * such as the file reads of citus_bulk_load, are told apart by their task id.
  */
 static char *
-SourceShardPrefix(const char *resultPrefix, uint64 shardId)
+SourceTaskPrefix(const char *resultPrefix, Task *task)
 {
 	StringInfo taskPrefix = makeStringInfo();
 
-	appendStringInfo(taskPrefix, "%s_from_" UINT64_FORMAT "_to", resultPrefix, shardId);
+	if (task->anchorShardId == INVALID_SHARD_ID)
+	{
+		appendStringInfo(taskPrefix, "%s_from_task_%u_to", resultPrefix, task->taskId);
+	}
+	else
+	{
+		appendStringInfo(taskPrefix, "%s_from_" UINT64_FORMAT "_to", resultPrefix,
+						 task->anchorShardId);
+	}
 
 	return taskPrefix->data;
 }
@@ -395,9 +549,11 @@ CreateArrayFromDatums(Datum *datumArray, bool *nullsArray, int datumCount, Oid t
  * and returns its results as a list of DistributedResultFragment.
  */
 static List *
-ExecutePartitionTaskList(List *taskList, CitusTableCacheEntry *targetRelation)
+ExecutePartitionTaskList(List *taskList, CitusTableCacheEntry *targetRelation,
+						 bool streamedToTargetNodes)
 {
-	PartitioningTupleDest *tupleDest = CreatePartitioningTupleDest(targetRelation);
+	PartitioningTupleDest *tupleDest = CreatePartitioningTupleDest(targetRelation,
+																   streamedToTargetNodes);
 
 	bool errorOnAnyFailure = false;
 	ExecuteSelectTasksIntoTupleDest(taskList, (TupleDestination *) tupleDest,
@@ -409,13 +565,15 @@ ExecutePartitionTaskList(List *taskList, CitusTableCacheEntry *targetRelation)
 
 /*
  * TupleToDistributedResultFragment converts a tuple returned by the query in
- * WrapTasksForPartitioning() to a DistributedResultFragment.
+ * WrapTasksForPartitioning() to a DistributedResultFragment. Fragments that
+ * were streamed to the node of their target shard are stored on that node.
  */
 static DistributedResultFragment *
 TupleToDistributedResultFragment(HeapTuple tuple,
 								 TupleDesc tupleDesc,
 								 CitusTableCacheEntry *targetRelation,
-								 uint32 sourceNodeId)
+								 uint32 sourceNodeId,
+								 bool streamedToTargetNodes)
 {
 	bool isNull = false;
 	uint32 targetShardIndex = DatumGetUInt32(heap_getattr(tuple, 1, tupleDesc, &isNull));
@@ -424,12 +582,19 @@ TupleToDistributedResultFragment(HeapTuple tuple,
 
 	Assert(targetShardIndex < targetRelation->shardIntervalArrayLength);
 	ShardInterval *shardInterval =
-		targetRelation->sortedShardIntervalArray[targetShardIndex];
+		GetCachedShardInterval(targetRelation, targetShardIndex);
 
 	DistributedResultFragment *distributedResultFragment =
 		palloc0(sizeof(DistributedResultFragment));
 
 	distributedResultFragment->nodeId = sourceNodeId;
+
+	if (streamedToTargetNodes)
+	{
+		ShardPlacement *targetPlacement =
+			linitial(ActiveShardPlacementList(shardInterval->shardId));
+		distributedResultFragment->nodeId = targetPlacement->nodeId;
+	}
 	distributedResultFragment->targetShardIndex = targetShardIndex;
 	distributedResultFragment->targetShardId = shardInterval->shardId;
 	distributedResultFragment->resultId = text_to_cstring(resultId);
@@ -482,8 +647,16 @@ ColocateFragmentsWithRelation(List *fragmentList, CitusTableCacheEntry *targetRe
 	List *fragmentListTransfers = ColocationTransfers(fragmentList, targetRelation);
 	List *fragmentTransferTaskList = FragmentTransferTaskList(fragmentListTransfers);
 
+	SetDistributedCommandPhase(DISTRIBUTED_COMMAND_PHASE_FETCHING_FRAGMENTS);
+
 	ExecuteFetchTaskList(fragmentTransferTaskList);
 
+	NodeToNodeFragmentsTransfer *transfer = NULL;
+	foreach_ptr(transfer, fragmentListTransfers)
+	{
+		ReportDistributedCommandFragmentsFetched(list_length(transfer->fragmentList));
+	}
+
 	int shardCount = targetRelation->shardIntervalArrayLength;
 	List **shardResultIdList = palloc0(shardCount * sizeof(List *));
 
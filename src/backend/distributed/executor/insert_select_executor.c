@@ -15,6 +15,7 @@
 #include "distributed/commands/multi_copy.h"
 #include "distributed/adaptive_executor.h"
 #include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_command_progress.h"
 #include "distributed/distributed_execution_locks.h"
 #include "distributed/insert_select_executor.h"
 #include "distributed/insert_select_planner.h"
@@ -111,6 +112,13 @@ NonPushableInsertSelectExecScan(CustomScanState *node)
 			LockPartitionRelations(targetRelationId, RowExclusiveLock);
 		}
 
+		CitusTableCacheEntry *targetCacheEntry =
+			GetCitusTableCacheEntry(targetRelationId);
+		bool progressStarted =
+			StartDistributedCommandProgress(DISTRIBUTED_COMMAND_INSERT_SELECT,
+											targetRelationId,
+											targetCacheEntry->shardIntervalArrayLength);
+
 		if (distributedPlan->insertSelectMethod == INSERT_SELECT_REPARTITION)
 		{
 			ereport(DEBUG1, (errmsg("performing repartitioned INSERT ... SELECT")));
@@ -180,6 +188,8 @@ NonPushableInsertSelectExecScan(CustomScanState *node)
 				WrapTaskListForProjection(distSelectTaskList, projectedTargetEntries);
 			}
 
+			SetDistributedCommandPhase(DISTRIBUTED_COMMAND_PHASE_PARTITIONING_RESULTS);
+
 			List **redistributedResults = RedistributeTaskListResults(distResultPrefix,
 																	  distSelectTaskList,
 																	  partitionColumnIndex,
@@ -202,6 +212,9 @@ NonPushableInsertSelectExecScan(CustomScanState *node)
 			TupleDesc tupleDescriptor = ScanStateGetTupleDescriptor(scanState);
 			TupleDestination *tupleDest = CreateTupleStoreTupleDest(
 				scanState->tuplestorestate, tupleDescriptor);
+
+			SetDistributedCommandPhase(DISTRIBUTED_COMMAND_PHASE_WRITING_RESULTS);
+
 			uint64 rowsInserted = ExecuteTaskListIntoTupleDest(ROW_MODIFY_COMMUTATIVE,
 															   taskList, tupleDest,
 															   hasReturning);
@@ -271,6 +284,8 @@ NonPushableInsertSelectExecScan(CustomScanState *node)
 				TupleDestination *tupleDest = CreateTupleStoreTupleDest(
 					scanState->tuplestorestate, tupleDescriptor);
 
+				SetDistributedCommandPhase(DISTRIBUTED_COMMAND_PHASE_WRITING_RESULTS);
+
 				ExecuteTaskListIntoTupleDest(ROW_MODIFY_COMMUTATIVE, prunedTaskList,
 											 tupleDest, hasReturning);
 
@@ -289,6 +304,8 @@ NonPushableInsertSelectExecScan(CustomScanState *node)
 									executorState);
 		}
 
+		FinishDistributedCommandProgress(progressStarted);
+
 		scanState->finishedRemoteScan = true;
 	}
 
@@ -326,7 +343,7 @@ TwoPhaseInsertSelectTaskList(Oid targetRelationId, Query *insertSelectQuery,
 	for (int shardOffset = 0; shardOffset < shardCount; shardOffset++)
 	{
 		ShardInterval *targetShardInterval =
-			targetCacheEntry->sortedShardIntervalArray[shardOffset];
+			GetCachedShardInterval(targetCacheEntry, shardOffset);
 		uint64 shardId = targetShardInterval->shardId;
 		List *columnAliasList = NIL;
 		StringInfo queryString = makeStringInfo();
@@ -558,7 +575,7 @@ RedistributedInsertSelectTaskList(Query *insertSelectQuery,
 	for (shardOffset = 0; shardOffset < shardCount; shardOffset++)
 	{
 		ShardInterval *targetShardInterval =
-			targetRelation->sortedShardIntervalArray[shardOffset];
+			GetCachedShardInterval(targetRelation, shardOffset);
 		List *resultIdList = redistributedResults[targetShardInterval->shardIndex];
 		uint64 shardId = targetShardInterval->shardId;
 		StringInfo queryString = makeStringInfo();
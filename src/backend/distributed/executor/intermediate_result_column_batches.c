@@ -0,0 +1,859 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_column_batches.c
+ *	  Routines for writing intermediate result files in batches of columns
+ *	  and for reading them into a tuple store.
+ *
+ * Reading an intermediate result in COPY format parses every row and calls
+ * the input or receive function of every value. When
+ * citus.enable_column_batched_intermediate_results is set, the nodes that
+ * write an intermediate result instead collect rows into batches, which hold
+ * the values of each column next to each other. Values of built-in,
+ * fixed-width pass-by-value types are stored as raw bytes and are copied
+ * back into Datums when reading, without calling any functions. Values of
+ * other types are stored in their binary or text representation.
+ *
+ * A file starts with a signature and a header that describes the columns,
+ * followed by batches and a trailer. A batch starts with its number of rows,
+ * followed by a null bitmap and the data of each column. The trailer is a
+ * batch with zero rows. The data of a column holds the values of the rows
+ * that are not null. Raw values take the length of the type in network byte
+ * order, while other values are prefixed by their length.
+ *
+ * Readers recognise the signature, so files can be read regardless of the
+ * setting and of the COPY format that the reader asks for.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <sys/stat.h>
+
+#include "postgres.h"
+
+#include "funcapi.h"
+#include "pgstat.h"
+
+#include "access/htup_details.h"
+#include "access/transam.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/intermediate_result_column_batches.h"
+#include "distributed/intermediate_result_compression.h"
+#include "distributed/transmit.h"
+#include "distributed/version_compat.h"
+#include "port/pg_bswap.h"
+#include "storage/fd.h"
+#include "utils/format_type.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+
+
+/*
+ * The signature at the start of a column-batched intermediate result file. It
+ * contains a zero byte, which text COPY data cannot contain, and binary COPY
+ * data starts with its own signature.
+ */
+static const char ColumnBatchSignature[] = "CITUSCB";
+
+#define COLUMN_BATCH_SIGNATURE_SIZE sizeof(ColumnBatchSignature)
+
+/* we write a batch when it has this many rows or this many bytes */
+#define COLUMN_BATCH_MAX_ROWS 8192
+#define COLUMN_BATCH_MAX_BYTES (4 * 1024 * 1024)
+
+/* size of the null bitmap of a column in a batch with the given number of rows */
+#define COLUMN_BATCH_NULLS_SIZE(rowCount) (((rowCount) + 7) / 8)
+
+/* representations of the values of a column */
+#define COLUMN_BATCH_ENCODING_RAW 'r'
+#define COLUMN_BATCH_ENCODING_BINARY 'b'
+#define COLUMN_BATCH_ENCODING_TEXT 't'
+
+
+/*
+ * ColumnBatchWriterColumn keeps the values of a column of the current batch.
+ */
+typedef struct ColumnBatchWriterColumn
+{
+	Oid typeId;
+	int16 typeLength;
+	char encoding;
+
+	/* send or output function, for columns that are not raw */
+	FmgrInfo outputFunction;
+
+	/* null bitmap and data of the current batch */
+	StringInfo nulls;
+	StringInfo data;
+} ColumnBatchWriterColumn;
+
+
+/*
+ * ColumnBatchWriter collects rows into batches.
+ */
+struct ColumnBatchWriter
+{
+	int columnCount;
+	ColumnBatchWriterColumn *columns;
+
+	/* number of rows and bytes in the current batch */
+	int rowCount;
+	int64 byteCount;
+};
+
+
+/*
+ * ColumnBatchReaderColumn keeps the state of reading a column.
+ */
+typedef struct ColumnBatchReaderColumn
+{
+	int16 typeLength;
+	char encoding;
+
+	/* receive or input function, for columns that are not raw */
+	FmgrInfo inputFunction;
+	Oid typeIOParam;
+	int32 typeMod;
+
+	/* null bitmap and data of the current batch */
+	StringInfo nulls;
+	StringInfo data;
+
+	/* values of the current batch */
+	Datum *values;
+	bool *isNull;
+} ColumnBatchReaderColumn;
+
+
+/*
+ * ColumnBatchReader keeps the state of reading a column-batched file.
+ */
+typedef struct ColumnBatchReader
+{
+	const char *fileName;
+
+	/* compressed files are read via ReadCompressedResult */
+	bool compressedFile;
+	File fileDesc;
+	FileCompat fileCompat;
+
+	int columnCount;
+	ColumnBatchReaderColumn *columns;
+
+	/* number of rows for which the value arrays have room */
+	int valuesSize;
+} ColumnBatchReader;
+
+
+static char ColumnEncodingForType(Oid typeId, int16 typeLength, bool typeByValue);
+static void AppendRawValue(StringInfo data, Datum value, int16 typeLength);
+static void AppendUInt32(StringInfo output, uint32 value);
+static void ReadColumnBatchHeader(ColumnBatchReader *reader, TupleDesc tupleDescriptor);
+static int ReadColumnBatch(ColumnBatchReader *reader);
+static void DecodeColumn(ColumnBatchReader *reader, ColumnBatchReaderColumn *column,
+						 int rowCount);
+static Datum DecodeRawValue(const char *data, int16 typeLength);
+static uint32 ReadUInt32(ColumnBatchReader *reader);
+static void ReadBytes(ColumnBatchReader *reader, char *buffer, int length);
+static void ReportCorruptedFile(ColumnBatchReader *reader);
+
+
+/* GUC, determines whether new intermediate results are written in column batches */
+bool EnableColumnBatchedIntermediateResults = false;
+
+
+/*
+ * CreateColumnBatchWriter creates a writer for rows with the given tuple
+ * descriptor in the current memory context.
+ */
+ColumnBatchWriter *
+CreateColumnBatchWriter(TupleDesc tupleDescriptor)
+{
+	ColumnBatchWriter *writer = palloc0(sizeof(ColumnBatchWriter));
+
+	writer->columnCount = tupleDescriptor->natts;
+	writer->columns = palloc0(writer->columnCount * sizeof(ColumnBatchWriterColumn));
+
+	for (int columnIndex = 0; columnIndex < writer->columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		ColumnBatchWriterColumn *column = &writer->columns[columnIndex];
+		Oid outputFunctionId = InvalidOid;
+		bool typeVarLength = false;
+
+		column->typeId = attribute->atttypid;
+		column->typeLength = attribute->attlen;
+		column->encoding = ColumnEncodingForType(attribute->atttypid, attribute->attlen,
+												 attribute->attbyval);
+		column->nulls = makeStringInfo();
+		column->data = makeStringInfo();
+
+		if (column->encoding == COLUMN_BATCH_ENCODING_BINARY)
+		{
+			getTypeBinaryOutputInfo(column->typeId, &outputFunctionId, &typeVarLength);
+			fmgr_info(outputFunctionId, &column->outputFunction);
+		}
+		else if (column->encoding == COLUMN_BATCH_ENCODING_TEXT)
+		{
+			getTypeOutputInfo(column->typeId, &outputFunctionId, &typeVarLength);
+			fmgr_info(outputFunctionId, &column->outputFunction);
+		}
+	}
+
+	return writer;
+}
+
+
+/*
+ * ColumnEncodingForType returns how the values of the given type are stored.
+ * Only built-in types are stored as raw bytes, since their representation is
+ * the same on all nodes.
+ */
+static char
+ColumnEncodingForType(Oid typeId, int16 typeLength, bool typeByValue)
+{
+	if (typeByValue && typeId < FirstNormalObjectId &&
+		(typeLength == 1 || typeLength == 2 || typeLength == 4 ||
+		 typeLength == sizeof(Datum)))
+	{
+		return COLUMN_BATCH_ENCODING_RAW;
+	}
+
+	if (CanUseBinaryCopyFormatForType(typeId))
+	{
+		return COLUMN_BATCH_ENCODING_BINARY;
+	}
+
+	return COLUMN_BATCH_ENCODING_TEXT;
+}
+
+
+/*
+ * AppendColumnBatchHeader appends the signature and the description of the
+ * columns that start a column-batched file.
+ */
+void
+AppendColumnBatchHeader(ColumnBatchWriter *writer, StringInfo output)
+{
+	appendBinaryStringInfo(output, ColumnBatchSignature, COLUMN_BATCH_SIGNATURE_SIZE);
+	AppendUInt32(output, (uint32) writer->columnCount);
+
+	for (int columnIndex = 0; columnIndex < writer->columnCount; columnIndex++)
+	{
+		ColumnBatchWriterColumn *column = &writer->columns[columnIndex];
+
+		AppendUInt32(output, (uint32) column->typeId);
+		appendStringInfoCharMacro(output, column->encoding);
+	}
+}
+
+
+/*
+ * ColumnBatchWriterAddRow adds a row to the current batch, and returns whether
+ * the batch is full and should be appended to the result.
+ */
+bool
+ColumnBatchWriterAddRow(ColumnBatchWriter *writer, Datum *columnValues,
+						bool *columnNulls)
+{
+	int rowIndex = writer->rowCount;
+
+	for (int columnIndex = 0; columnIndex < writer->columnCount; columnIndex++)
+	{
+		ColumnBatchWriterColumn *column = &writer->columns[columnIndex];
+		StringInfo data = column->data;
+		int dataLength = data->len;
+
+		if (rowIndex % 8 == 0)
+		{
+			appendStringInfoCharMacro(column->nulls, '\0');
+		}
+
+		if (columnNulls[columnIndex])
+		{
+			column->nulls->data[rowIndex / 8] |= (1 << (rowIndex % 8));
+			continue;
+		}
+
+		Datum value = columnValues[columnIndex];
+
+		if (column->encoding == COLUMN_BATCH_ENCODING_RAW)
+		{
+			AppendRawValue(data, value, column->typeLength);
+		}
+		else if (column->encoding == COLUMN_BATCH_ENCODING_BINARY)
+		{
+			bytea *outputBytes = SendFunctionCall(&column->outputFunction, value);
+			uint32 outputLength = VARSIZE(outputBytes) - VARHDRSZ;
+
+			AppendUInt32(data, outputLength);
+			appendBinaryStringInfo(data, VARDATA(outputBytes), outputLength);
+		}
+		else
+		{
+			char *outputString = OutputFunctionCall(&column->outputFunction, value);
+			uint32 outputLength = strlen(outputString);
+
+			AppendUInt32(data, outputLength);
+			appendBinaryStringInfo(data, outputString, outputLength);
+		}
+
+		writer->byteCount += data->len - dataLength;
+	}
+
+	writer->rowCount++;
+
+	return writer->rowCount >= COLUMN_BATCH_MAX_ROWS ||
+		   writer->byteCount >= COLUMN_BATCH_MAX_BYTES;
+}
+
+
+/*
+ * AppendRawValue appends a value of a fixed-width pass-by-value type in
+ * network byte order.
+ */
+static void
+AppendRawValue(StringInfo data, Datum value, int16 typeLength)
+{
+	switch (typeLength)
+	{
+		case 1:
+		{
+			appendStringInfoCharMacro(data, (char) GET_1_BYTE(value));
+			break;
+		}
+
+		case 2:
+		{
+			uint16 networkValue = pg_hton16((uint16) GET_2_BYTES(value));
+			appendBinaryStringInfo(data, (char *) &networkValue, sizeof(networkValue));
+			break;
+		}
+
+		case 4:
+		{
+			uint32 networkValue = pg_hton32((uint32) GET_4_BYTES(value));
+			appendBinaryStringInfo(data, (char *) &networkValue, sizeof(networkValue));
+			break;
+		}
+
+#if SIZEOF_DATUM == 8
+		case 8:
+		{
+			uint64 networkValue = pg_hton64((uint64) GET_8_BYTES(value));
+			appendBinaryStringInfo(data, (char *) &networkValue, sizeof(networkValue));
+			break;
+		}
+#endif
+
+		default:
+		{
+			elog(ERROR, "unsupported byval length: %d", typeLength);
+		}
+	}
+}
+
+
+/*
+ * AppendColumnBatch appends the current batch to the output and starts a new
+ * batch. It does nothing when the current batch is empty.
+ */
+void
+AppendColumnBatch(ColumnBatchWriter *writer, StringInfo output)
+{
+	if (writer->rowCount == 0)
+	{
+		return;
+	}
+
+	AppendUInt32(output, (uint32) writer->rowCount);
+
+	for (int columnIndex = 0; columnIndex < writer->columnCount; columnIndex++)
+	{
+		ColumnBatchWriterColumn *column = &writer->columns[columnIndex];
+
+		appendBinaryStringInfo(output, column->nulls->data, column->nulls->len);
+		AppendUInt32(output, (uint32) column->data->len);
+		appendBinaryStringInfo(output, column->data->data, column->data->len);
+
+		resetStringInfo(column->nulls);
+		resetStringInfo(column->data);
+	}
+
+	writer->rowCount = 0;
+	writer->byteCount = 0;
+}
+
+
+/*
+ * AppendColumnBatchTrailer appends the batch without rows that ends a
+ * column-batched file.
+ */
+void
+AppendColumnBatchTrailer(StringInfo output)
+{
+	AppendUInt32(output, 0);
+}
+
+
+/*
+ * AppendUInt32 appends an integer in network byte order.
+ */
+static void
+AppendUInt32(StringInfo output, uint32 value)
+{
+	uint32 networkValue = pg_hton32(value);
+	appendBinaryStringInfo(output, (char *) &networkValue, sizeof(networkValue));
+}
+
+
+/*
+ * IsColumnBatchResultFile returns whether the given intermediate result file
+ * is written in column batches. For compressed files, the caller should have
+ * started reading the file with BeginCompressedResultRead.
+ */
+bool
+IsColumnBatchResultFile(const char *fileName, bool compressedFile)
+{
+	char signature[COLUMN_BATCH_SIGNATURE_SIZE];
+	int readBytes = 0;
+
+	if (compressedFile)
+	{
+		readBytes = PeekCompressedResult(signature, COLUMN_BATCH_SIGNATURE_SIZE);
+	}
+	else
+	{
+		File fileDesc = FileOpenForTransmit(fileName, O_RDONLY | PG_BINARY, 0);
+		FileCompat fileCompat = FileCompatFromFileStart(fileDesc);
+
+		readBytes = FileReadCompat(&fileCompat, signature, COLUMN_BATCH_SIGNATURE_SIZE,
+								   PG_WAIT_IO);
+
+		FileClose(fileDesc);
+	}
+
+	return readBytes == COLUMN_BATCH_SIGNATURE_SIZE &&
+		   memcmp(signature, ColumnBatchSignature, COLUMN_BATCH_SIGNATURE_SIZE) == 0;
+}
+
+
+/*
+ * ReadColumnBatchFileIntoTupleStore reads the rows of a column-batched file
+ * into the tuple store. For compressed files, the caller should have started
+ * reading the file with BeginCompressedResultRead.
+ */
+void
+ReadColumnBatchFileIntoTupleStore(const char *fileName, bool compressedFile,
+								  TupleDesc tupleDescriptor, Tuplestorestate *tupstore)
+{
+	ColumnBatchReader *reader = palloc0(sizeof(ColumnBatchReader));
+	char signature[COLUMN_BATCH_SIGNATURE_SIZE];
+
+	reader->fileName = fileName;
+	reader->compressedFile = compressedFile;
+
+	if (!compressedFile)
+	{
+		reader->fileDesc = FileOpenForTransmit(fileName, O_RDONLY | PG_BINARY, 0);
+		reader->fileCompat = FileCompatFromFileStart(reader->fileDesc);
+	}
+
+	/* skip the signature, which IsColumnBatchResultFile checked */
+	ReadBytes(reader, signature, COLUMN_BATCH_SIGNATURE_SIZE);
+
+	ReadColumnBatchHeader(reader, tupleDescriptor);
+
+	int columnCount = reader->columnCount;
+	Datum *rowValues = palloc0(columnCount * sizeof(Datum));
+	bool *rowNulls = palloc0(columnCount * sizeof(bool));
+
+	MemoryContext batchContext = AllocSetContextCreate(CurrentMemoryContext,
+													   "ColumnBatchContext",
+													   ALLOCSET_DEFAULT_SIZES);
+
+	while (true)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(batchContext);
+
+		int rowCount = ReadColumnBatch(reader);
+
+		MemoryContextSwitchTo(oldContext);
+
+		if (rowCount == 0)
+		{
+			break;
+		}
+
+		for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+			{
+				ColumnBatchReaderColumn *column = &reader->columns[columnIndex];
+
+				rowValues[columnIndex] = column->values[rowIndex];
+				rowNulls[columnIndex] = column->isNull[rowIndex];
+			}
+
+			tuplestore_putvalues(tupstore, tupleDescriptor, rowValues, rowNulls);
+		}
+
+		MemoryContextReset(batchContext);
+	}
+
+	if (!compressedFile)
+	{
+		FileClose(reader->fileDesc);
+	}
+
+	MemoryContextDelete(batchContext);
+	pfree(rowValues);
+	pfree(rowNulls);
+}
+
+
+/*
+ * ReadColumnBatchHeader reads the description of the columns of the file and
+ * sets up the reader for reading them as the columns of the tuple descriptor.
+ */
+static void
+ReadColumnBatchHeader(ColumnBatchReader *reader, TupleDesc tupleDescriptor)
+{
+	int columnCount = (int) ReadUInt32(reader);
+
+	if (columnCount != tupleDescriptor->natts)
+	{
+		ereport(ERROR, (errmsg("intermediate result file \"%s\" has %d columns, but "
+							   "%d columns were expected", reader->fileName,
+							   columnCount, tupleDescriptor->natts)));
+	}
+
+	reader->columnCount = columnCount;
+	reader->columns = palloc0(columnCount * sizeof(ColumnBatchReaderColumn));
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		ColumnBatchReaderColumn *column = &reader->columns[columnIndex];
+		Oid inputFunctionId = InvalidOid;
+
+		Oid typeId = (Oid) ReadUInt32(reader);
+		ReadBytes(reader, &column->encoding, 1);
+
+		column->typeLength = attribute->attlen;
+		column->typeMod = attribute->atttypmod;
+		column->nulls = makeStringInfo();
+		column->data = makeStringInfo();
+
+		if (column->encoding == COLUMN_BATCH_ENCODING_RAW)
+		{
+			/* raw values can only be read as the type they were written as */
+			if (typeId != attribute->atttypid)
+			{
+				ereport(ERROR, (errmsg("cannot read column %d of intermediate result "
+									   "file \"%s\" as type %s", columnIndex + 1,
+									   reader->fileName,
+									   format_type_be(attribute->atttypid)),
+								errdetail("The column has type %s.",
+										  format_type_be(typeId))));
+			}
+		}
+		else if (column->encoding == COLUMN_BATCH_ENCODING_BINARY)
+		{
+			getTypeBinaryInputInfo(attribute->atttypid, &inputFunctionId,
+								   &column->typeIOParam);
+			fmgr_info(inputFunctionId, &column->inputFunction);
+		}
+		else if (column->encoding == COLUMN_BATCH_ENCODING_TEXT)
+		{
+			getTypeInputInfo(attribute->atttypid, &inputFunctionId,
+							 &column->typeIOParam);
+			fmgr_info(inputFunctionId, &column->inputFunction);
+		}
+		else
+		{
+			ReportCorruptedFile(reader);
+		}
+	}
+}
+
+
+/*
+ * ReadColumnBatch reads the next batch of the file and decodes the values of
+ * its columns. It returns the number of rows in the batch, which is 0 at the
+ * end of the file.
+ */
+static int
+ReadColumnBatch(ColumnBatchReader *reader)
+{
+	uint32 rowCount = ReadUInt32(reader);
+	if (rowCount == 0)
+	{
+		return 0;
+	}
+	else if (rowCount > MaxAllocSize / sizeof(Datum))
+	{
+		ReportCorruptedFile(reader);
+	}
+
+	if (rowCount > reader->valuesSize)
+	{
+		/* the value arrays outlive the batch */
+		MemoryContext oldContext = MemoryContextSwitchTo(GetMemoryChunkContext(reader));
+
+		for (int columnIndex = 0; columnIndex < reader->columnCount; columnIndex++)
+		{
+			ColumnBatchReaderColumn *column = &reader->columns[columnIndex];
+
+			if (column->values != NULL)
+			{
+				pfree(column->values);
+				pfree(column->isNull);
+			}
+
+			column->values = palloc(rowCount * sizeof(Datum));
+			column->isNull = palloc(rowCount * sizeof(bool));
+		}
+
+		reader->valuesSize = rowCount;
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	for (int columnIndex = 0; columnIndex < reader->columnCount; columnIndex++)
+	{
+		ColumnBatchReaderColumn *column = &reader->columns[columnIndex];
+		int nullsLength = COLUMN_BATCH_NULLS_SIZE(rowCount);
+
+		resetStringInfo(column->nulls);
+		enlargeStringInfo(column->nulls, nullsLength);
+		ReadBytes(reader, column->nulls->data, nullsLength);
+		column->nulls->len = nullsLength;
+
+		uint32 dataLength = ReadUInt32(reader);
+		if (dataLength >= MaxAllocSize)
+		{
+			ReportCorruptedFile(reader);
+		}
+
+		resetStringInfo(column->data);
+		enlargeStringInfo(column->data, dataLength);
+		ReadBytes(reader, column->data->data, dataLength);
+		column->data->len = dataLength;
+		column->data->data[dataLength] = '\0';
+
+		DecodeColumn(reader, column, rowCount);
+	}
+
+	return rowCount;
+}
+
+
+/*
+ * DecodeColumn fills the value arrays of the column from the null bitmap and
+ * the data of the current batch.
+ */
+static void
+DecodeColumn(ColumnBatchReader *reader, ColumnBatchReaderColumn *column, int rowCount)
+{
+	char *data = column->data->data;
+	int dataLength = column->data->len;
+	int dataOffset = 0;
+
+	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		bool isNull = (column->nulls->data[rowIndex / 8] & (1 << (rowIndex % 8))) != 0;
+
+		column->isNull[rowIndex] = isNull;
+		column->values[rowIndex] = (Datum) 0;
+
+		if (isNull)
+		{
+			continue;
+		}
+
+		if (column->encoding == COLUMN_BATCH_ENCODING_RAW)
+		{
+			if (dataLength - dataOffset < column->typeLength)
+			{
+				ReportCorruptedFile(reader);
+			}
+
+			column->values[rowIndex] = DecodeRawValue(data + dataOffset,
+													  column->typeLength);
+			dataOffset += column->typeLength;
+			continue;
+		}
+
+		uint32 valueLengthNetwork = 0;
+		if (dataLength - dataOffset < sizeof(uint32))
+		{
+			ReportCorruptedFile(reader);
+		}
+
+		memcpy_s(&valueLengthNetwork, sizeof(uint32), data + dataOffset, sizeof(uint32));
+		dataOffset += sizeof(uint32);
+
+		uint32 valueLength = pg_ntoh32(valueLengthNetwork);
+		if (dataLength - dataOffset < valueLength)
+		{
+			ReportCorruptedFile(reader);
+		}
+
+		/*
+		 * Input and receive functions expect the value to be terminated, so
+		 * we temporarily overwrite the first byte of the next value, like
+		 * array_recv does.
+		 */
+		char *value = data + dataOffset;
+		char savedByte = value[valueLength];
+		value[valueLength] = '\0';
+
+		if (column->encoding == COLUMN_BATCH_ENCODING_BINARY)
+		{
+			StringInfoData valueBuffer;
+
+			valueBuffer.data = value;
+			valueBuffer.len = valueLength;
+			valueBuffer.maxlen = valueLength + 1;
+			valueBuffer.cursor = 0;
+
+			column->values[rowIndex] = ReceiveFunctionCall(&column->inputFunction,
+														   &valueBuffer,
+														   column->typeIOParam,
+														   column->typeMod);
+
+			if (valueBuffer.cursor != valueBuffer.len)
+			{
+				ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+								errmsg("incorrect binary data format")));
+			}
+		}
+		else
+		{
+			column->values[rowIndex] = InputFunctionCall(&column->inputFunction,
+														 value,
+														 column->typeIOParam,
+														 column->typeMod);
+		}
+
+		value[valueLength] = savedByte;
+		dataOffset += valueLength;
+	}
+
+	if (dataOffset != dataLength)
+	{
+		ReportCorruptedFile(reader);
+	}
+}
+
+
+/*
+ * DecodeRawValue returns the Datum of a value of a fixed-width pass-by-value
+ * type that is stored in network byte order.
+ */
+static Datum
+DecodeRawValue(const char *data, int16 typeLength)
+{
+	switch (typeLength)
+	{
+		case 1:
+		{
+			return (Datum) (uint8) data[0];
+		}
+
+		case 2:
+		{
+			uint16 networkValue = 0;
+			memcpy_s(&networkValue, sizeof(networkValue), data, sizeof(networkValue));
+			return (Datum) pg_ntoh16(networkValue);
+		}
+
+		case 4:
+		{
+			uint32 networkValue = 0;
+			memcpy_s(&networkValue, sizeof(networkValue), data, sizeof(networkValue));
+			return (Datum) pg_ntoh32(networkValue);
+		}
+
+#if SIZEOF_DATUM == 8
+		case 8:
+		{
+			uint64 networkValue = 0;
+			memcpy_s(&networkValue, sizeof(networkValue), data, sizeof(networkValue));
+			return (Datum) pg_ntoh64(networkValue);
+		}
+#endif
+
+		default:
+		{
+			elog(ERROR, "unsupported byval length: %d", typeLength);
+		}
+	}
+
+	return (Datum) 0;   /* keep compiler quiet */
+}
+
+
+/*
+ * ReadUInt32 reads an integer in network byte order from the file.
+ */
+static uint32
+ReadUInt32(ColumnBatchReader *reader)
+{
+	uint32 networkValue = 0;
+	ReadBytes(reader, (char *) &networkValue, sizeof(networkValue));
+	return pg_ntoh32(networkValue);
+}
+
+
+/*
+ * ReadBytes reads exactly the given number of bytes from the file, or errors
+ * out.
+ */
+static void
+ReadBytes(ColumnBatchReader *reader, char *buffer, int length)
+{
+	int readBytes = 0;
+
+	if (length == 0)
+	{
+		return;
+	}
+
+	if (reader->compressedFile)
+	{
+		readBytes = ReadCompressedResult(buffer, length, length);
+	}
+	else
+	{
+		readBytes = FileReadCompat(&reader->fileCompat, buffer, length, PG_WAIT_IO);
+		if (readBytes < 0)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not read intermediate result file \"%s\": "
+								   "%m", reader->fileName)));
+		}
+	}
+
+	if (readBytes != length)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read intermediate result file \"%s\": "
+							   "unexpected end of file", reader->fileName)));
+	}
+}
+
+
+/*
+ * ReportCorruptedFile errors out for a file whose contents do not match the
+ * column-batched format.
+ */
+static void
+ReportCorruptedFile(ColumnBatchReader *reader)
+{
+	ereport(ERROR, (errmsg("intermediate result file \"%s\" is corrupted",
+						   reader->fileName)));
+}
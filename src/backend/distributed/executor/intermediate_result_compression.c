@@ -0,0 +1,557 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_compression.c
+ *	  Routines for compressing intermediate result files and for reading
+ *	  compressed intermediate result files.
+ *
+ * When citus.intermediate_result_compression is set, the nodes that write
+ * an intermediate result compress the COPY data before writing it to the
+ * result file or sending it to other nodes. Since intermediate results are
+ * sent between nodes as the raw bytes of the file, this compresses both the
+ * files on disk and the data that is sent over the network.
+ *
+ * A compressed file starts with a signature, followed by frames that each
+ * hold a block of COPY data with a header of the compression method, the
+ * uncompressed length and the compressed length. Readers recognise the
+ * signature, so compressed and uncompressed files can be read regardless
+ * of the setting.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <sys/stat.h>
+
+#include "postgres.h"
+
+#include "citus_version.h"
+#include "pgstat.h"
+
+#include "distributed/citus_safe_lib.h"
+#include "distributed/intermediate_result_compression.h"
+#include "distributed/transmit.h"
+#include "distributed/version_compat.h"
+#include "port/pg_bswap.h"
+#include "storage/fd.h"
+
+#if HAVE_CITUS_LIBLZ4
+#include <lz4.h>
+#endif
+
+#if HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+
+/*
+ * The signature at the start of a compressed intermediate result file. It
+ * contains a zero byte, which text COPY data cannot contain, and binary COPY
+ * data starts with its own signature.
+ */
+static const char CompressedResultSignature[] = COMPRESSED_RESULT_SIGNATURE;
+
+/* we favour speed, since the results are written and read during the query */
+#define ZSTD_RESULT_COMPRESSION_LEVEL 1
+
+
+/*
+ * CompressedResultReader keeps the state of reading a compressed intermediate
+ * result file for COPY.
+ */
+typedef struct CompressedResultReader
+{
+	const char *fileName;
+	File fileDesc;
+	FileCompat fileCompat;
+
+	/* uncompressed data of the current frame */
+	StringInfo frameData;
+	int frameOffset;
+
+	/* compressed data of the current frame */
+	StringInfo compressedData;
+} CompressedResultReader;
+
+
+static int CompressionBound(IntermediateResultCompressionType compressionType,
+							int length);
+static int CompressBlock(IntermediateResultCompressionType compressionType,
+						 const char *data, int length, char *output,
+						 int outputLength);
+static bool ReadNextFrame(CompressedResultReader *reader);
+static void ReadFromResultFile(CompressedResultReader *reader, char *buffer,
+							   int length);
+static void DecompressBlock(CompressedResultReader *reader, uint8 method,
+							int compressedLength, int rawLength);
+static bool IsSupportedFrameMethod(uint8 method);
+
+
+/* GUC, determines how new intermediate results are compressed */
+int IntermediateResultCompression = INTERMEDIATE_RESULT_COMPRESSION_NONE;
+
+/*
+ * COPY only passes a buffer to its data source callback, so we keep the file
+ * that is being read in a global. COPY reads a single file at a time.
+ */
+static CompressedResultReader *CurrentCompressedResultReader = NULL;
+
+
+/*
+ * AppendCompressedResultHeader appends the signature that marks the start of
+ * a compressed intermediate result file.
+ */
+void
+AppendCompressedResultHeader(StringInfo output)
+{
+	appendBinaryStringInfo(output, CompressedResultSignature,
+						   COMPRESSED_RESULT_SIGNATURE_SIZE);
+}
+
+
+/*
+ * AppendCompressedResultFrame compresses the given COPY data with the given
+ * method and appends it to the output as a single frame. Data that does not
+ * get smaller is stored as is.
+ */
+void
+AppendCompressedResultFrame(StringInfo output, const char *data, int length,
+							IntermediateResultCompressionType compressionType)
+{
+	int frameOffset = output->len;
+	int compressionBound = Max(CompressionBound(compressionType, length), length);
+
+	enlargeStringInfo(output, COMPRESSED_RESULT_FRAME_HEADER_SIZE + compressionBound);
+
+	char *frameData = output->data + frameOffset + COMPRESSED_RESULT_FRAME_HEADER_SIZE;
+	uint8 method = (uint8) compressionType;
+
+	int compressedLength = CompressBlock(compressionType, data, length, frameData,
+										 compressionBound);
+	if (compressedLength <= 0 || compressedLength >= length)
+	{
+		method = COMPRESSED_RESULT_FRAME_STORED;
+		compressedLength = length;
+		if (length > 0)
+		{
+			memcpy_s(frameData, compressionBound, data, length);
+		}
+	}
+
+	uint32 rawLengthNetwork = pg_hton32((uint32) length);
+	uint32 compressedLengthNetwork = pg_hton32((uint32) compressedLength);
+	char *frameHeader = output->data + frameOffset;
+
+	frameHeader[0] = (char) method;
+	memcpy_s(frameHeader + 1, sizeof(uint32), &rawLengthNetwork, sizeof(uint32));
+	memcpy_s(frameHeader + 1 + sizeof(uint32), sizeof(uint32),
+			 &compressedLengthNetwork, sizeof(uint32));
+
+	output->len += COMPRESSED_RESULT_FRAME_HEADER_SIZE + compressedLength;
+	output->data[output->len] = '\0';
+}
+
+
+/*
+ * CompressionBound returns the maximum size of the given number of bytes after
+ * compressing them with the given method.
+ */
+static int
+CompressionBound(IntermediateResultCompressionType compressionType, int length)
+{
+	switch (compressionType)
+	{
+#if HAVE_CITUS_LIBLZ4
+		case INTERMEDIATE_RESULT_COMPRESSION_LZ4:
+		{
+			return LZ4_compressBound(length);
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		case INTERMEDIATE_RESULT_COMPRESSION_ZSTD:
+		{
+			return ZSTD_compressBound(length);
+		}
+#endif
+
+		default:
+		{
+			return length;
+		}
+	}
+}
+
+
+/*
+ * CompressBlock compresses the given data into the output buffer and returns
+ * the compressed length, or -1 if the data could not be compressed.
+ */
+static int
+CompressBlock(IntermediateResultCompressionType compressionType, const char *data,
+			  int length, char *output, int outputLength)
+{
+	switch (compressionType)
+	{
+#if HAVE_CITUS_LIBLZ4
+		case INTERMEDIATE_RESULT_COMPRESSION_LZ4:
+		{
+			int compressedLength = LZ4_compress_default(data, output, length,
+														outputLength);
+			if (compressedLength <= 0)
+			{
+				elog(DEBUG1, "failure in LZ4_compress_default, input size=%d, "
+							 "output size=%d", length, outputLength);
+				return -1;
+			}
+
+			return compressedLength;
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		case INTERMEDIATE_RESULT_COMPRESSION_ZSTD:
+		{
+			size_t compressedLength = ZSTD_compress(output, outputLength, data, length,
+													ZSTD_RESULT_COMPRESSION_LEVEL);
+			if (ZSTD_isError(compressedLength))
+			{
+				elog(DEBUG1, "failure in ZSTD_compress: %s",
+					 ZSTD_getErrorName(compressedLength));
+				return -1;
+			}
+
+			return (int) compressedLength;
+		}
+#endif
+
+		default:
+		{
+			return -1;
+		}
+	}
+}
+
+
+/*
+ * IsCompressedResultFile returns whether the given intermediate result file
+ * starts with the signature of a compressed file.
+ */
+bool
+IsCompressedResultFile(const char *fileName)
+{
+	char signature[COMPRESSED_RESULT_SIGNATURE_SIZE];
+
+	File fileDesc = FileOpenForTransmit(fileName, O_RDONLY | PG_BINARY, 0);
+	FileCompat fileCompat = FileCompatFromFileStart(fileDesc);
+
+	int readBytes = FileReadCompat(&fileCompat, signature,
+								   COMPRESSED_RESULT_SIGNATURE_SIZE, PG_WAIT_IO);
+
+	FileClose(fileDesc);
+
+	return readBytes == COMPRESSED_RESULT_SIGNATURE_SIZE &&
+		   memcmp(signature, CompressedResultSignature,
+				  COMPRESSED_RESULT_SIGNATURE_SIZE) == 0;
+}
+
+
+/*
+ * BeginCompressedResultRead opens the given compressed intermediate result
+ * file, such that COPY can read its uncompressed data via ReadCompressedResult.
+ */
+void
+BeginCompressedResultRead(const char *fileName)
+{
+	CompressedResultReader *reader = palloc0(sizeof(CompressedResultReader));
+
+	reader->fileName = fileName;
+	reader->fileDesc = FileOpenForTransmit(fileName, O_RDONLY | PG_BINARY, 0);
+	reader->fileCompat = FileCompatFromFileStart(reader->fileDesc);
+	reader->frameData = makeStringInfo();
+	reader->compressedData = makeStringInfo();
+
+	/* skip the signature, which IsCompressedResultFile checked */
+	reader->fileCompat.offset = COMPRESSED_RESULT_SIGNATURE_SIZE;
+
+	CurrentCompressedResultReader = reader;
+}
+
+
+/*
+ * ReadCompressedResult is the data source callback of COPY for compressed
+ * intermediate results. It copies at least minread and at most maxread bytes
+ * of uncompressed data into outbuf, unless the file ends.
+ */
+int
+ReadCompressedResult(void *outbuf, int minread, int maxread)
+{
+	CompressedResultReader *reader = CurrentCompressedResultReader;
+	int bytesRead = 0;
+
+	Assert(reader != NULL);
+
+	while (bytesRead < minread)
+	{
+		if (reader->frameOffset == reader->frameData->len && !ReadNextFrame(reader))
+		{
+			break;
+		}
+
+		int copyLength = Min(maxread - bytesRead,
+							 reader->frameData->len - reader->frameOffset);
+
+		if (copyLength > 0)
+		{
+			memcpy_s(((char *) outbuf) + bytesRead, maxread - bytesRead,
+					 reader->frameData->data + reader->frameOffset, copyLength);
+		}
+
+		reader->frameOffset += copyLength;
+		bytesRead += copyLength;
+	}
+
+	return bytesRead;
+}
+
+
+/*
+ * PeekCompressedResult copies up to the given number of bytes of uncompressed
+ * data into the buffer without consuming them, and returns the number of bytes
+ * copied. It only looks at the current frame, which is enough for detecting
+ * the format of the data at the start of the file, since writers always put
+ * that in the first frame.
+ */
+int
+PeekCompressedResult(char *buffer, int length)
+{
+	CompressedResultReader *reader = CurrentCompressedResultReader;
+
+	Assert(reader != NULL);
+
+	if (reader->frameOffset == reader->frameData->len && !ReadNextFrame(reader))
+	{
+		return 0;
+	}
+
+	int copyLength = Min(length, reader->frameData->len - reader->frameOffset);
+
+	if (copyLength > 0)
+	{
+		memcpy_s(buffer, length, reader->frameData->data + reader->frameOffset,
+				 copyLength);
+	}
+
+	return copyLength;
+}
+
+
+/*
+ * EndCompressedResultRead closes the intermediate result file that is being
+ * read.
+ */
+void
+EndCompressedResultRead(void)
+{
+	CompressedResultReader *reader = CurrentCompressedResultReader;
+
+	FileClose(reader->fileDesc);
+	pfree(reader->frameData->data);
+	pfree(reader->compressedData->data);
+	pfree(reader);
+
+	CurrentCompressedResultReader = NULL;
+}
+
+
+/*
+ * ReadNextFrame reads and decompresses the next frame of the file into the
+ * frame data of the reader. It returns false when the file ends.
+ */
+static bool
+ReadNextFrame(CompressedResultReader *reader)
+{
+	char frameHeader[COMPRESSED_RESULT_FRAME_HEADER_SIZE];
+
+	int readBytes = FileReadCompat(&reader->fileCompat, frameHeader,
+								   COMPRESSED_RESULT_FRAME_HEADER_SIZE, PG_WAIT_IO);
+	if (readBytes == 0)
+	{
+		return false;
+	}
+	else if (readBytes != COMPRESSED_RESULT_FRAME_HEADER_SIZE)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read intermediate result file \"%s\": "
+							   "unexpected end of file", reader->fileName)));
+	}
+
+	uint8 method = 0;
+	int rawLength = 0;
+	int compressedLength = 0;
+
+	ParseCompressedResultFrameHeader(frameHeader, &method, &rawLength,
+									 &compressedLength);
+
+	resetStringInfo(reader->compressedData);
+	enlargeStringInfo(reader->compressedData, compressedLength);
+	ReadFromResultFile(reader, reader->compressedData->data, compressedLength);
+	reader->compressedData->len = compressedLength;
+
+	resetStringInfo(reader->frameData);
+	enlargeStringInfo(reader->frameData, rawLength);
+	DecompressBlock(reader, method, compressedLength, rawLength);
+	reader->frameData->len = rawLength;
+	reader->frameOffset = 0;
+
+	return true;
+}
+
+
+/*
+ * ReadFromResultFile reads exactly the given number of bytes from the file, or
+ * errors out.
+ */
+static void
+ReadFromResultFile(CompressedResultReader *reader, char *buffer, int length)
+{
+	int readBytes = FileReadCompat(&reader->fileCompat, buffer, length, PG_WAIT_IO);
+	if (readBytes < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read intermediate result file \"%s\": %m",
+							   reader->fileName)));
+	}
+	else if (readBytes != length)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read intermediate result file \"%s\": "
+							   "unexpected end of file", reader->fileName)));
+	}
+}
+
+
+/*
+ * DecompressBlock decompresses the compressed data of the current frame into
+ * the frame data of the reader.
+ */
+static void
+DecompressBlock(CompressedResultReader *reader, uint8 method, int compressedLength,
+				int rawLength)
+{
+	if (!IsSupportedFrameMethod(method))
+	{
+		ereport(ERROR, (errmsg("intermediate result file \"%s\" is compressed "
+							   "with a method that this build of Citus does not "
+							   "support", reader->fileName)));
+	}
+
+	if (!DecompressResultFrame(method, reader->compressedData->data, compressedLength,
+							   reader->frameData->data, rawLength))
+	{
+		ereport(ERROR, (errmsg("intermediate result file \"%s\" is corrupted",
+							   reader->fileName)));
+	}
+}
+
+
+/*
+ * ParseCompressedResultFrameHeader reads the method, the uncompressed length
+ * and the compressed length from the header of a frame.
+ */
+void
+ParseCompressedResultFrameHeader(const char *frameHeader, uint8 *method,
+								 int *rawLength, int *compressedLength)
+{
+	uint32 rawLengthNetwork = 0;
+	uint32 compressedLengthNetwork = 0;
+
+	*method = (uint8) frameHeader[0];
+	memcpy_s(&rawLengthNetwork, sizeof(uint32), frameHeader + 1, sizeof(uint32));
+	memcpy_s(&compressedLengthNetwork, sizeof(uint32),
+			 frameHeader + 1 + sizeof(uint32), sizeof(uint32));
+
+	*rawLength = (int) pg_ntoh32(rawLengthNetwork);
+	*compressedLength = (int) pg_ntoh32(compressedLengthNetwork);
+}
+
+
+/*
+ * IsSupportedFrameMethod returns whether this build of Citus can decompress
+ * frames with the given method.
+ */
+static bool
+IsSupportedFrameMethod(uint8 method)
+{
+	switch (method)
+	{
+		case COMPRESSED_RESULT_FRAME_STORED:
+#if HAVE_CITUS_LIBLZ4
+		case INTERMEDIATE_RESULT_COMPRESSION_LZ4:
+#endif
+#if HAVE_LIBZSTD
+		case INTERMEDIATE_RESULT_COMPRESSION_ZSTD:
+#endif
+		{
+			return true;
+		}
+
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+
+/*
+ * DecompressResultFrame decompresses the data of a frame into rawData, which
+ * should have room for rawLength bytes. It returns false when the frame uses
+ * an unsupported method or its data is corrupted.
+ */
+bool
+DecompressResultFrame(uint8 method, const char *compressedData, int compressedLength,
+					  char *rawData, int rawLength)
+{
+	switch (method)
+	{
+		case COMPRESSED_RESULT_FRAME_STORED:
+		{
+			if (compressedLength != rawLength)
+			{
+				return false;
+			}
+
+			if (rawLength > 0)
+			{
+				memcpy_s(rawData, rawLength, compressedData, rawLength);
+			}
+			return true;
+		}
+
+#if HAVE_CITUS_LIBLZ4
+		case INTERMEDIATE_RESULT_COMPRESSION_LZ4:
+		{
+			int decompressedLength = LZ4_decompress_safe(compressedData, rawData,
+														 compressedLength, rawLength);
+			return decompressedLength == rawLength;
+		}
+#endif
+
+#if HAVE_LIBZSTD
+		case INTERMEDIATE_RESULT_COMPRESSION_ZSTD:
+		{
+			size_t decompressedLength = ZSTD_decompress(rawData, rawLength,
+														compressedData,
+														compressedLength);
+			return !ZSTD_isError(decompressedLength) &&
+				   decompressedLength == (size_t) rawLength;
+		}
+#endif
+
+		default:
+		{
+			return false;
+		}
+	}
+}
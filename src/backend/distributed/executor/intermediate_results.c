@@ -19,9 +19,12 @@
 #include "catalog/pg_enum.h"
 #include "catalog/pg_type.h"
 #include "commands/copy.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/connection_management.h"
 #include "distributed/error_codes.h"
+#include "distributed/intermediate_result_column_batches.h"
+#include "distributed/intermediate_result_compression.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_utility.h"
@@ -70,6 +73,9 @@ typedef struct RemoteFileDestReceiver
 	List *initialNodeList;
 	List *connectionList;
 
+	/* worker nodes that fetch the result from other worker nodes */
+	List *relayNodeList;
+
 	/* whether to write to a local file */
 	bool writeLocalFile;
 	FileCompat fileCompat;
@@ -78,6 +84,14 @@ typedef struct RemoteFileDestReceiver
 	CopyOutState copyOutState;
 	FmgrInfo *columnOutputFunctions;
 
+	/* set when rows are written in column batches instead of COPY format */
+	ColumnBatchWriter *columnBatchWriter;
+
+	/* compression of the result, see intermediate_result_compression.c */
+	IntermediateResultCompressionType compressionType;
+	StringInfo uncompressedData;
+	StringInfo compressedData;
+
 	/* statistics */
 	uint64 tuplesSent;
 	uint64 bytesSent;
@@ -98,9 +112,17 @@ static void RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 static void PrepareIntermediateResultBroadcast(RemoteFileDestReceiver *resultDest);
 static StringInfo ConstructCopyResultStatement(const char *resultId);
 static bool RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void AppendCopyDataToResult(RemoteFileDestReceiver *resultDest,
+								   StringInfo copyData);
+static void FlushCompressedCopyData(RemoteFileDestReceiver *resultDest);
+static void WriteCopyDataToResult(RemoteFileDestReceiver *resultDest,
+								  StringInfo copyData);
 static void BroadcastCopyData(StringInfo dataBuffer, List *connectionList);
 static void SendCopyDataOverConnection(StringInfo dataBuffer,
 									   MultiConnection *connection);
+static void RelayIntermediateResult(RemoteFileDestReceiver *resultDest);
+static void FetchIntermediateResultOnNodes(const char *resultId, List *sourceNodeList,
+										   List *targetNodeList);
 static void RemoteFileDestReceiverShutdown(DestReceiver *destReceiver);
 static void RemoteFileDestReceiverDestroy(DestReceiver *destReceiver);
 
@@ -114,9 +136,13 @@ static CopyStatus CopyDataFromConnection(MultiConnection *connection,
 										 FileCompat *fileCompat,
 										 uint64 *bytesReceived);
 
+/* GUC, number of nodes that receive a broadcast directly, 0 for all nodes */
+int IntermediateResultBroadcastFanout = 0;
+
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(read_intermediate_result);
 PG_FUNCTION_INFO_V1(read_intermediate_result_array);
+PG_FUNCTION_INFO_V1(read_inline_intermediate_result);
 PG_FUNCTION_INFO_V1(broadcast_intermediate_result);
 PG_FUNCTION_INFO_V1(create_intermediate_result);
 PG_FUNCTION_INFO_V1(fetch_intermediate_results);
@@ -246,6 +272,20 @@ RemoteFileDestReceiverBytesSent(DestReceiver *destReceiver)
 }
 
 
+/*
+ * RemoteFileDestReceiverStats returns the number of rows and bytes that were
+ * sent per remote worker.
+ */
+void
+RemoteFileDestReceiverStats(DestReceiver *destReceiver, uint64 *rowsSent,
+							uint64 *bytesSent)
+{
+	RemoteFileDestReceiver *remoteDestReceiver = (RemoteFileDestReceiver *) destReceiver;
+	*rowsSent = remoteDestReceiver->tuplesSent;
+	*bytesSent = remoteDestReceiver->bytesSent;
+}
+
+
 /*
  * RemoteFileDestReceiverStartup implements the rStartup interface of
  * RemoteFileDestReceiver. It opens connections to the nodes in initialNodeList,
@@ -274,6 +314,18 @@ RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 
 	resultDest->columnOutputFunctions = ColumnOutputFunctions(inputTupleDescriptor,
 															  copyOutState->binary);
+
+	if (EnableColumnBatchedIntermediateResults)
+	{
+		resultDest->columnBatchWriter = CreateColumnBatchWriter(inputTupleDescriptor);
+	}
+
+	resultDest->compressionType = IntermediateResultCompression;
+	if (resultDest->compressionType != INTERMEDIATE_RESULT_COMPRESSION_NONE)
+	{
+		resultDest->uncompressedData = makeStringInfo();
+		resultDest->compressedData = makeStringInfo();
+	}
 }
 
 
@@ -305,6 +357,16 @@ PrepareIntermediateResultBroadcast(RemoteFileDestReceiver *resultDest)
 																			 fileMode));
 	}
 
+	if (IntermediateResultBroadcastFanout > 0 &&
+		list_length(initialNodeList) > IntermediateResultBroadcastFanout)
+	{
+		/* the other nodes fetch the result from the nodes that we send it to */
+		resultDest->relayNodeList = list_copy_tail(initialNodeList,
+												   IntermediateResultBroadcastFanout);
+		initialNodeList = list_truncate(list_copy(initialNodeList),
+										IntermediateResultBroadcastFanout);
+	}
+
 	WorkerNode *workerNode = NULL;
 	foreach_ptr(workerNode, initialNodeList)
 	{
@@ -350,20 +412,30 @@ PrepareIntermediateResultBroadcast(RemoteFileDestReceiver *resultDest)
 		PQclear(result);
 	}
 
-	if (copyOutState->binary)
+	resultDest->connectionList = connectionList;
+
+	if (resultDest->compressionType != INTERMEDIATE_RESULT_COMPRESSION_NONE)
+	{
+		/* the signature tells readers that the result file is compressed */
+		StringInfo compressedHeader = makeStringInfo();
+		AppendCompressedResultHeader(compressedHeader);
+		WriteCopyDataToResult(resultDest, compressedHeader);
+	}
+
+	if (resultDest->columnBatchWriter != NULL)
+	{
+		/* send the description of the columns when using column batches */
+		resetStringInfo(copyOutState->fe_msgbuf);
+		AppendColumnBatchHeader(resultDest->columnBatchWriter, copyOutState->fe_msgbuf);
+		AppendCopyDataToResult(resultDest, copyOutState->fe_msgbuf);
+	}
+	else if (copyOutState->binary)
 	{
 		/* send headers when using binary encoding */
 		resetStringInfo(copyOutState->fe_msgbuf);
 		AppendCopyBinaryHeaders(copyOutState);
-		BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
-
-		if (resultDest->writeLocalFile)
-		{
-			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
-		}
+		AppendCopyDataToResult(resultDest, copyOutState->fe_msgbuf);
 	}
-
-	resultDest->connectionList = connectionList;
 }
 
 
@@ -404,7 +476,6 @@ RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 
 	TupleDesc tupleDescriptor = resultDest->tupleDescriptor;
 
-	List *connectionList = resultDest->connectionList;
 	CopyOutState copyOutState = resultDest->copyOutState;
 	FmgrInfo *columnOutputFunctions = resultDest->columnOutputFunctions;
 
@@ -421,17 +492,24 @@ RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 
 	resetStringInfo(copyData);
 
-	/* construct row in COPY format */
-	AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-					  copyOutState, columnOutputFunctions, NULL);
-
-	/* send row to nodes */
-	BroadcastCopyData(copyData, connectionList);
-
-	/* write to local file (if applicable) */
-	if (resultDest->writeLocalFile)
+	if (resultDest->columnBatchWriter != NULL)
+	{
+		/* add row to the current batch, and send the batch once it is full */
+		if (ColumnBatchWriterAddRow(resultDest->columnBatchWriter, columnValues,
+									columnNulls))
+		{
+			AppendColumnBatch(resultDest->columnBatchWriter, copyData);
+			AppendCopyDataToResult(resultDest, copyData);
+		}
+	}
+	else
 	{
-		WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+		/* construct row in COPY format */
+		AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
+						  copyOutState, columnOutputFunctions, NULL);
+
+		/* send row to nodes and write to local file (if applicable) */
+		AppendCopyDataToResult(resultDest, copyData);
 	}
 
 	MemoryContextSwitchTo(oldContext);
@@ -486,22 +564,33 @@ RemoteFileDestReceiverShutdown(DestReceiver *destReceiver)
 	List *connectionList = resultDest->connectionList;
 	CopyOutState copyOutState = resultDest->copyOutState;
 
-	if (copyOutState->binary)
+	if (resultDest->columnBatchWriter != NULL)
+	{
+		/* send the last batch and the trailer when using column batches */
+		resetStringInfo(copyOutState->fe_msgbuf);
+		AppendColumnBatch(resultDest->columnBatchWriter, copyOutState->fe_msgbuf);
+		AppendColumnBatchTrailer(copyOutState->fe_msgbuf);
+		AppendCopyDataToResult(resultDest, copyOutState->fe_msgbuf);
+		resultDest->bytesSent += copyOutState->fe_msgbuf->len;
+	}
+	else if (copyOutState->binary)
 	{
 		/* send footers when using binary encoding */
 		resetStringInfo(copyOutState->fe_msgbuf);
 		AppendCopyBinaryFooters(copyOutState);
-		BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
-
-		if (resultDest->writeLocalFile)
-		{
-			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
-		}
+		AppendCopyDataToResult(resultDest, copyOutState->fe_msgbuf);
 	}
 
+	FlushCompressedCopyData(resultDest);
+
 	/* close the COPY input */
 	EndRemoteCopy(0, connectionList);
 
+	if (resultDest->relayNodeList != NIL)
+	{
+		RelayIntermediateResult(resultDest);
+	}
+
 	if (resultDest->writeLocalFile)
 	{
 		FileClose(resultDest->fileCompat.fd);
@@ -509,6 +598,166 @@ RemoteFileDestReceiverShutdown(DestReceiver *destReceiver)
 }
 
 
+/*
+ * AppendCopyDataToResult sends the given COPY data to the nodes and writes it
+ * to the local file (if applicable). When the result is compressed, the data
+ * is collected until there is enough to compress.
+ */
+static void
+AppendCopyDataToResult(RemoteFileDestReceiver *resultDest, StringInfo copyData)
+{
+	if (resultDest->compressionType == INTERMEDIATE_RESULT_COMPRESSION_NONE)
+	{
+		WriteCopyDataToResult(resultDest, copyData);
+		return;
+	}
+
+	appendBinaryStringInfo(resultDest->uncompressedData, copyData->data,
+						   copyData->len);
+
+	if (resultDest->uncompressedData->len >= INTERMEDIATE_RESULT_FRAME_SIZE)
+	{
+		FlushCompressedCopyData(resultDest);
+	}
+}
+
+
+/*
+ * FlushCompressedCopyData compresses the COPY data that was collected for a
+ * compressed result, and sends and writes it as a single frame.
+ */
+static void
+FlushCompressedCopyData(RemoteFileDestReceiver *resultDest)
+{
+	if (resultDest->compressionType == INTERMEDIATE_RESULT_COMPRESSION_NONE ||
+		resultDest->uncompressedData->len == 0)
+	{
+		return;
+	}
+
+	StringInfo uncompressedData = resultDest->uncompressedData;
+	StringInfo compressedData = resultDest->compressedData;
+
+	resetStringInfo(compressedData);
+	AppendCompressedResultFrame(compressedData, uncompressedData->data,
+								uncompressedData->len, resultDest->compressionType);
+
+	WriteCopyDataToResult(resultDest, compressedData);
+
+	resetStringInfo(uncompressedData);
+}
+
+
+/*
+ * WriteCopyDataToResult sends the given data to the nodes as is and writes it
+ * to the local file (if applicable).
+ */
+static void
+WriteCopyDataToResult(RemoteFileDestReceiver *resultDest, StringInfo copyData)
+{
+	BroadcastCopyData(copyData, resultDest->connectionList);
+
+	if (resultDest->writeLocalFile)
+	{
+		WriteToLocalFile(copyData, &resultDest->fileCompat);
+	}
+}
+
+
+/*
+ * RelayIntermediateResult lets the nodes in the relay list fetch the result
+ * from the nodes that already have it. In every round, each node that has
+ * the result serves one other node, such that the number of nodes that have
+ * the result doubles and every node only sends the result once per round.
+ */
+static void
+RelayIntermediateResult(RemoteFileDestReceiver *resultDest)
+{
+	List *sourceNodeList = list_truncate(list_copy(resultDest->initialNodeList),
+										 IntermediateResultBroadcastFanout);
+	List *remainingNodeList = resultDest->relayNodeList;
+
+	while (remainingNodeList != NIL)
+	{
+		int targetNodeCount = Min(list_length(sourceNodeList),
+								  list_length(remainingNodeList));
+		List *targetNodeList = list_truncate(list_copy(remainingNodeList),
+											 targetNodeCount);
+
+		FetchIntermediateResultOnNodes(resultDest->resultId, sourceNodeList,
+									   targetNodeList);
+
+		remainingNodeList = list_copy_tail(remainingNodeList, targetNodeCount);
+		sourceNodeList = list_concat(sourceNodeList, targetNodeList);
+	}
+}
+
+
+/*
+ * FetchIntermediateResultOnNodes makes each node in the target list fetch the
+ * result from the node at the same position in the source list, using
+ * fetch_intermediate_results. The target nodes fetch the result in parallel.
+ */
+static void
+FetchIntermediateResultOnNodes(const char *resultId, List *sourceNodeList,
+							   List *targetNodeList)
+{
+	List *connectionList = NIL;
+
+	WorkerNode *targetNode = NULL;
+	foreach_ptr(targetNode, targetNodeList)
+	{
+		int flags = 0;
+
+		MultiConnection *connection = StartNodeConnection(flags, targetNode->workerName,
+														  targetNode->workerPort);
+		ClaimConnectionExclusively(connection);
+		MarkRemoteTransactionCritical(connection);
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	/* must open transaction blocks to use intermediate results */
+	RemoteTransactionsBeginIfNecessary(connectionList);
+
+	MultiConnection *connection = NULL;
+	WorkerNode *sourceNode = NULL;
+	forboth_ptr(connection, connectionList, sourceNode, sourceNodeList)
+	{
+		StringInfo fetchCommand = makeStringInfo();
+
+		appendStringInfo(fetchCommand,
+						 "SELECT fetch_intermediate_results(ARRAY[%s]::text[], %s, %d)",
+						 quote_literal_cstr(resultId),
+						 quote_literal_cstr(sourceNode->workerName),
+						 sourceNode->workerPort);
+
+		bool querySent = SendRemoteCommand(connection, fetchCommand->data);
+		if (!querySent)
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+	}
+
+	foreach_ptr(connection, connectionList)
+	{
+		bool raiseInterrupts = true;
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (PQresultStatus(result) != PGRES_TUPLES_OK)
+		{
+			ReportResultError(connection, result, ERROR);
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+		UnclaimConnection(connection);
+	}
+}
+
+
 /*
  * BroadcastCopyData sends copy data to all connections in a list.
  */
@@ -830,6 +1079,30 @@ read_intermediate_result_array(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * read_inline_intermediate_result returns the set of records in the given
+ * COPY text data. The coordinator inlines small intermediate results into the
+ * queries of the tasks that read them as the argument of this function, rather
+ * than sending the results to the workers as files, see ExecuteSubPlans.
+ */
+Datum
+read_inline_intermediate_result(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	text *copyDataText = PG_GETARG_TEXT_PP(0);
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	ReadCopyDataIntoTupleStore(VARDATA_ANY(copyDataText),
+							   VARSIZE_ANY_EXHDR(copyDataText),
+							   tupleDescriptor, tupleStore);
+
+	PG_RETURN_DATUM(0);
+}
+
+
 /*
  * ReadIntermediateResultsIntoFuncOutput reads the given result files and stores
  * them at the function's output tuple store. Errors out if any of the result files
@@ -1017,7 +1290,9 @@ FetchRemoteIntermediateResult(MultiConnection *connection, char *resultId)
 
 		Assert(copyStatus == CLIENT_COPY_MORE);
 
-		int rc = WaitLatchOrSocket(MyLatch, waitFlags, socket, 0, PG_WAIT_EXTENSION);
+		int rc = WaitLatchOrSocket(MyLatch, waitFlags, socket, 0,
+								   CitusWaitEventInfo(
+									   CITUS_WAIT_EVENT_INTERMEDIATE_RESULT_FETCH));
 		if (rc & WL_POSTMASTER_DEATH)
 		{
 			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
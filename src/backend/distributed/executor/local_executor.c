@@ -83,7 +83,10 @@
 #include "distributed/adaptive_executor.h"
 #include "distributed/commands/utility_hook.h"
 #include "distributed/citus_custom_scan.h"
+#include "distributed/citus_nodefuncs.h"
 #include "distributed/citus_ruleutils.h"
+#include "distributed/combine_query_planner.h"
+#include "distributed/query_result_cache.h"
 #include "distributed/query_utils.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/listutils.h"
@@ -94,18 +97,25 @@
 #include "distributed/multi_executor.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/relation_access_tracking.h"
+#include "distributed/relay_utility.h"
 #include "distributed/remote_commands.h" /* to access LogRemoteCommands */
 #include "distributed/transaction_management.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_protocol.h"
+#include "catalog/namespace.h"
 #include "executor/tstoreReceiver.h"
 #include "executor/tuptable.h"
 #include "optimizer/optimizer.h"
+#include "nodes/nodeFuncs.h"
 #include "nodes/params.h"
+#include "storage/lmgr.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
 #include "utils/snapmgr.h"
 
 /* controlled via a GUC */
 bool EnableLocalExecution = true;
+bool EnableLocalExecutionFromQueryTree = false;
 bool LogLocalCommands = false;
 
 /* global variable that tracks whether the local execution is on a shard */
@@ -128,6 +138,9 @@ static uint64 LocallyPlanAndExecuteMultipleQueries(List *queryStrings,
 												   TupleDestination *tupleDest,
 												   Task *task);
 static void LocallyExecuteUtilityTask(Task *task);
+static Query * LocalShardQueryFromQueryTree(Task *task);
+static bool ConvertShardPlaceholdersToShardRelations(Node *node, void *context);
+static bool ConvertRteToShardRelation(RangeTblEntry *rte, Oid shardRelationId);
 static void ExecuteUdfTaskQuery(Query *localUdfCommandQuery);
 static void EnsureTransitionPossible(LocalExecutionStatus from,
 									 LocalExecutionStatus to);
@@ -263,6 +276,14 @@ ExecuteLocalTaskListExtended(List *taskList,
 			Use2PCForCoordinatedTransaction();
 		}
 
+		/* the query tree might get replaced by the query string when logging */
+		Query *shardQueryTree = NULL;
+		if (EnableLocalExecutionFromQueryTree && !isUtilityCommand &&
+			GetTaskQueryType(task) == TASK_QUERY_OBJECT)
+		{
+			shardQueryTree = LocalShardQueryFromQueryTree(task);
+		}
+
 		LogLocalCommand(task);
 
 		if (isUtilityCommand)
@@ -324,10 +345,13 @@ ExecuteLocalTaskListExtended(List *taskList,
 				continue;
 			}
 
-			Query *shardQuery = ParseQueryString(TaskQueryString(task),
-												 taskParameterTypes,
-												 taskNumParams);
-
+			Query *shardQuery = shardQueryTree;
+			if (shardQuery == NULL)
+			{
+				shardQuery = ParseQueryString(TaskQueryString(task),
+											  taskParameterTypes,
+											  taskNumParams);
+			}
 
 			int cursorOptions = CURSOR_OPT_PARALLEL_OK;
 
@@ -392,6 +416,201 @@ LocallyPlanAndExecuteMultipleQueries(List *queryStrings, TupleDestination *tuple
 }
 
 
+/*
+ * LocalShardQueryFromQueryTree returns a copy of the query tree of the given
+ * task in which the distributed tables are replaced by their local shards,
+ * such that the shard query can be planned without deparsing the query and
+ * parsing it again. It returns NULL when the query cannot be planned from
+ * the query tree, in which case the caller falls back to the query string.
+ */
+static Query *
+LocalShardQueryFromQueryTree(Task *task)
+{
+	Query *jobQuery = task->taskQuery.data.jobQueryReferenceForLazyDeparsing;
+	Query *shardQuery = copyObject(jobQuery);
+
+	if (shardQuery->commandType != CMD_SELECT &&
+		shardQuery->commandType != CMD_INSERT &&
+		shardQuery->commandType != CMD_UPDATE &&
+		shardQuery->commandType != CMD_DELETE)
+	{
+		return NULL;
+	}
+
+	/* row level security was applied to the shell table by the rewriter */
+	if (shardQuery->hasRowSecurity)
+	{
+		return NULL;
+	}
+
+	if (shardQuery->commandType == CMD_INSERT)
+	{
+		/* the arbiter constraint would refer to the shell table */
+		if (shardQuery->onConflict != NULL)
+		{
+			return NULL;
+		}
+
+		/* the target of an INSERT is not replaced by a shard name placeholder */
+		RangeTblEntry *resultRte = rt_fetch(shardQuery->resultRelation,
+											shardQuery->rtable);
+		if (resultRte->rtekind == RTE_RELATION && IsCitusTable(resultRte->relid))
+		{
+			char *shardRelationName = get_rel_name(resultRte->relid);
+			AppendShardIdToName(&shardRelationName, task->anchorShardId);
+
+			Oid shardRelationId =
+				get_relname_relid(shardRelationName,
+								  get_rel_namespace(resultRte->relid));
+
+			if (!ConvertRteToShardRelation(resultRte, shardRelationId))
+			{
+				return NULL;
+			}
+		}
+	}
+
+	if (ConvertShardPlaceholdersToShardRelations((Node *) shardQuery, NULL))
+	{
+		return NULL;
+	}
+
+	return shardQuery;
+}
+
+
+/*
+ * ConvertShardPlaceholdersToShardRelations walks over the query tree and
+ * turns the shard name placeholders that UpdateRelationToShardNames() left
+ * into range table entries for the local shards. It returns true if the
+ * query contains a distributed table that cannot be replaced by its shard.
+ */
+static bool
+ConvertShardPlaceholdersToShardRelations(Node *node, void *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node,
+								 ConvertShardPlaceholdersToShardRelations,
+								 context, QTW_EXAMINE_RTES_BEFORE);
+	}
+
+	if (!IsA(node, RangeTblEntry))
+	{
+		return expression_tree_walker(node, ConvertShardPlaceholdersToShardRelations,
+									  context);
+	}
+
+	RangeTblEntry *rte = (RangeTblEntry *) node;
+
+	if (rte->rtekind == RTE_RELATION)
+	{
+		/* only the shards of distributed tables can be accessed */
+		return IsCitusTable(rte->relid);
+	}
+
+	RangeTblEntry *placeholderRte = NULL;
+	if (rte->rtekind != RTE_FUNCTION ||
+		!FindCitusExtradataContainerRTE(node, &placeholderRte))
+	{
+		return false;
+	}
+
+	CitusRTEKind rteKind = CITUS_RTE_RELATION;
+	char *shardSchemaName = NULL;
+	char *shardRelationName = NULL;
+
+	ExtractRangeTblExtraData(rte, &rteKind, &shardSchemaName, &shardRelationName,
+							 NULL);
+
+	if (rteKind != CITUS_RTE_SHARD || shardSchemaName == NULL ||
+		shardRelationName == NULL)
+	{
+		return true;
+	}
+
+	bool missingOk = true;
+	Oid shardSchemaId = get_namespace_oid(shardSchemaName, missingOk);
+	Oid shardRelationId = get_relname_relid(shardRelationName, shardSchemaId);
+
+	return !ConvertRteToShardRelation(rte, shardRelationId);
+}
+
+
+/*
+ * ConvertRteToShardRelation turns the given range table entry of a distributed
+ * table into a range table entry of the given shard and locks the shard like
+ * parse analysis would. It returns false if the shard does not exist or its
+ * columns might not have the same attribute numbers as the distributed table,
+ * e.g. due to dropped columns.
+ */
+static bool
+ConvertRteToShardRelation(RangeTblEntry *rte, Oid shardRelationId)
+{
+	if (!OidIsValid(shardRelationId))
+	{
+		return false;
+	}
+
+	LockRelationOid(shardRelationId, rte->rellockmode);
+
+	Relation relation = RelationIdGetRelation(rte->relid);
+	Relation shardRelation = RelationIdGetRelation(shardRelationId);
+	bool hasSameColumns = RelationIsValid(relation) && RelationIsValid(shardRelation);
+
+	if (hasSameColumns)
+	{
+		TupleDesc tupleDescriptor = RelationGetDescr(relation);
+		TupleDesc shardTupleDescriptor = RelationGetDescr(shardRelation);
+
+		hasSameColumns = tupleDescriptor->natts == shardTupleDescriptor->natts &&
+						 relation->rd_rel->relkind == shardRelation->rd_rel->relkind &&
+						 !shardRelation->rd_rel->relrowsecurity;
+
+		for (int columnIndex = 0; hasSameColumns && columnIndex < tupleDescriptor->natts;
+			 columnIndex++)
+		{
+			Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor,
+															columnIndex);
+			Form_pg_attribute shardAttributeForm = TupleDescAttr(shardTupleDescriptor,
+																 columnIndex);
+
+			hasSameColumns =
+				attributeForm->attisdropped == shardAttributeForm->attisdropped &&
+				attributeForm->atttypid == shardAttributeForm->atttypid &&
+				attributeForm->atttypmod == shardAttributeForm->atttypmod &&
+				attributeForm->attcollation == shardAttributeForm->attcollation;
+		}
+	}
+
+	if (RelationIsValid(relation))
+	{
+		RelationClose(relation);
+	}
+
+	if (RelationIsValid(shardRelation))
+	{
+		RelationClose(shardRelation);
+	}
+
+	if (!hasSameColumns)
+	{
+		return false;
+	}
+
+	rte->rtekind = RTE_RELATION;
+	rte->functions = NIL;
+	rte->relid = shardRelationId;
+
+	return true;
+}
+
+
 /*
  * ExtractParametersForLocalExecution extracts parameter types and values
  * from the given ParamListInfo structure, and fills parameter type and
@@ -786,6 +1005,12 @@ RecordNonDistTableAccessesForTask(Task *task)
 		Oid accessedRelationId = RelationIdForShard(placementAccessShardId);
 		ShardPlacementAccessType shardPlacementAccessType = placementAccess->accessType;
 		RecordRelationAccessIfNonDistTable(accessedRelationId, shardPlacementAccessType);
+
+		if (shardPlacementAccessType != PLACEMENT_ACCESS_SELECT)
+		{
+			/* cached query results that read the shard become stale on commit */
+			RecordShardModification(placementAccessShardId);
+		}
 	}
 }
 
@@ -18,13 +18,17 @@
 #include "catalog/dependency.h"
 #include "catalog/pg_class.h"
 #include "catalog/namespace.h"
+#include "distributed/adaptive_executor.h"
 #include "distributed/backend_data.h"
 #include "distributed/citus_custom_scan.h"
+#include "distributed/citus_safe_lib.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/commands/utility_hook.h"
 #include "distributed/function_call_delegation.h"
 #include "distributed/insert_select_executor.h"
 #include "distributed/insert_select_planner.h"
+#include "distributed/intermediate_result_column_batches.h"
+#include "distributed/intermediate_result_compression.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
 #include "distributed/coordinator_protocol.h"
@@ -33,8 +37,12 @@
 #include "distributed/distributed_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/query_stats.h"
+#include "distributed/reference_table_write_batch.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/resource_lock.h"
+#include "distributed/sorted_merge.h"
+#include "distributed/trace_context.h"
 #include "distributed/transaction_management.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_shard_visibility.h"
@@ -92,8 +100,16 @@ bool SortReturning = false;
  */
 int ExecutorLevel = 0;
 
+/* COPY data that ReadCopyData passes to COPY, see ReadCopyDataIntoTupleStore */
+static StringInfo CurrentCopyData = NULL;
+
 
 /* local function forward declarations */
+static void ReadCopyFileIntoTupleStore(char *fileName,
+									   copy_data_source_cb dataSourceCallback,
+									   char *copyFormat, TupleDesc tupleDescriptor,
+									   Tuplestorestate *tupstore);
+static int ReadCopyData(void *outbuf, int minread, int maxread);
 static Relation StubRelation(TupleDesc tupleDescriptor);
 static char * GetObjectTypeString(ObjectType objType);
 static bool AlterTableConstraintCheck(QueryDesc *queryDesc);
@@ -115,6 +131,13 @@ CitusExecutorStart(QueryDesc *queryDesc, int eflags)
 {
 	PlannedStmt *plannedStmt = queryDesc->plannedstmt;
 
+	if (HasPendingReferenceTableWrites() &&
+		!IsReferenceTableWriteBatchCandidate(plannedStmt))
+	{
+		/* the statement might observe the writes we held back */
+		FlushReferenceTableWrites();
+	}
+
 	/*
 	 * We cannot modify XactReadOnly on Windows because it is not
 	 * declared with PGDLLIMPORT.
@@ -177,6 +200,43 @@ CitusExecutorRun(QueryDesc *queryDesc,
 	Instrumentation *volatile totalTime = queryDesc->totaltime;
 	queryDesc->totaltime = NULL;
 
+	/*
+	 * Tasks of distributed queries carry the query identifier of the
+	 * coordinator, under which we track their statistics on this node.
+	 */
+	uint64 coordinatorQueryId = 0;
+	instr_time startTime;
+	BufferUsage startBufferUsage;
+
+	/*
+	 * Tasks of traced statements carry a child span, which we show in
+	 * citus.trace_context and the context of errors while the task runs.
+	 */
+	bool receivedTraceContext = false;
+	ErrorContextCallback traceContextCallback;
+
+	INSTR_TIME_SET_ZERO(startTime);
+	memset(&startBufferUsage, 0, sizeof(startBufferUsage));
+
+	if (ExecutorLevel == 0)
+	{
+		coordinatorQueryId = CitusQueryIdFromQueryString(queryDesc->sourceText);
+		if (coordinatorQueryId != 0)
+		{
+			INSTR_TIME_SET_CURRENT(startTime);
+			startBufferUsage = pgBufferUsage;
+		}
+
+		receivedTraceContext = SetReceivedTraceContext(queryDesc->sourceText);
+		if (receivedTraceContext)
+		{
+			traceContextCallback.callback = TraceContextErrorCallback;
+			traceContextCallback.arg = NULL;
+			traceContextCallback.previous = error_context_stack;
+			error_context_stack = &traceContextCallback;
+		}
+	}
+
 	PG_TRY();
 	{
 		ExecutorLevel++;
@@ -244,6 +304,18 @@ CitusExecutorRun(QueryDesc *queryDesc,
 			queryDesc->totaltime = totalTime;
 		}
 
+		if (coordinatorQueryId != 0)
+		{
+			CitusQueryStatsWorkerEntry(coordinatorQueryId, startTime, &startBufferUsage,
+									   queryDesc->estate->es_processed);
+		}
+
+		if (receivedTraceContext)
+		{
+			error_context_stack = traceContextCallback.previous;
+			ResetReceivedTraceContext();
+		}
+
 		executorBoundParams = savedBoundParams;
 		ExecutorLevel--;
 
@@ -274,6 +346,12 @@ CitusExecutorRun(QueryDesc *queryDesc,
 			queryDesc->totaltime = totalTime;
 		}
 
+		/* PG_TRY already restored the error context stack */
+		if (receivedTraceContext)
+		{
+			ResetReceivedTraceContext();
+		}
+
 		executorBoundParams = savedBoundParams;
 		ExecutorLevel--;
 
@@ -358,9 +436,7 @@ ReturnTupleFromTuplestore(CitusScanState *scanState)
 	if (!qual && !projInfo)
 	{
 		/* no quals, nor projections return directly from the tuple store. */
-		TupleTableSlot *slot = scanState->customScanState.ss.ss_ScanTupleSlot;
-		tuplestore_gettupleslot(tupleStore, forwardScanDirection, false, slot);
-		return slot;
+		return ReadNextTupleFromTuplestore(scanState, forwardScanDirection);
 	}
 
 	for (;;)
@@ -377,8 +453,8 @@ ReturnTupleFromTuplestore(CitusScanState *scanState)
 		 */
 		ResetExprContext(econtext);
 
-		TupleTableSlot *slot = scanState->customScanState.ss.ss_ScanTupleSlot;
-		tuplestore_gettupleslot(tupleStore, forwardScanDirection, false, slot);
+		TupleTableSlot *slot = ReadNextTupleFromTuplestore(scanState,
+														   forwardScanDirection);
 
 		if (TupIsNull(slot))
 		{
@@ -426,13 +502,158 @@ ReturnTupleFromTuplestore(CitusScanState *scanState)
 
 
 /*
- * ReadFileIntoTupleStore parses the records in a COPY-formatted file according
+ * ReadNextTupleFromTuplestore reads the next tuple from the tuple store of the
+ * scan, or from the merge of the sorted task results, into the scan tuple slot.
+ * If the execution of the scan is streaming its results, we first continue the
+ * execution until there is a new tuple to read.
+ */
+TupleTableSlot *
+ReadNextTupleFromTuplestore(CitusScanState *scanState, bool forwardScanDirection)
+{
+	TupleTableSlot *slot = scanState->customScanState.ss.ss_ScanTupleSlot;
+
+	ContinueStreamingExecution(scanState);
+
+	if (scanState->sortedMerge != NULL)
+	{
+		/* the scan only reads forward when we merge the rows while reading */
+		Assert(forwardScanDirection);
+
+		SortedMergeGetNextTuple(scanState->sortedMerge, slot);
+	}
+	else
+	{
+		tuplestore_gettupleslot(scanState->tuplestorestate, forwardScanDirection,
+								false, slot);
+	}
+
+	if (!TupIsNull(slot))
+	{
+		scanState->returnedTupleCount++;
+	}
+
+	return slot;
+}
+
+
+/*
+ * ReadFileIntoTupleStore parses the records in an intermediate result file
  * according to the given tuple descriptor and stores the records in a tuple
- * store.
+ * store. Files in COPY format are parsed according to the given COPY format,
+ * while compressed and column-batched files are recognised by their signature.
  */
 void
 ReadFileIntoTupleStore(char *fileName, char *copyFormat, TupleDesc tupleDescriptor,
 					   Tuplestorestate *tupstore)
+{
+	/* compressed files are decompressed while reading them */
+	bool compressedFile = IsCompressedResultFile(fileName);
+	if (compressedFile)
+	{
+		BeginCompressedResultRead(fileName);
+	}
+
+	if (IsColumnBatchResultFile(fileName, compressedFile))
+	{
+		ReadColumnBatchFileIntoTupleStore(fileName, compressedFile, tupleDescriptor,
+										  tupstore);
+	}
+	else
+	{
+		/* compressed files are decompressed by a data source callback */
+		char *copyFileName = compressedFile ? NULL : fileName;
+		copy_data_source_cb dataSourceCallback =
+			compressedFile ? ReadCompressedResult : NULL;
+
+		ReadCopyFileIntoTupleStore(copyFileName, dataSourceCallback, copyFormat,
+								   tupleDescriptor, tupstore);
+	}
+
+	if (compressedFile)
+	{
+		EndCompressedResultRead();
+	}
+}
+
+
+/*
+ * ReadCopyFormatFileIntoTupleStore parses the records in a COPY-formatted file
+ * that is not an intermediate result, such as an input file of citus_bulk_load,
+ * and stores them in a tuple store.
+ */
+void
+ReadCopyFormatFileIntoTupleStore(char *fileName, char *copyFormat,
+								 TupleDesc tupleDescriptor, Tuplestorestate *tupstore)
+{
+	ReadCopyFileIntoTupleStore(fileName, NULL, copyFormat, tupleDescriptor, tupstore);
+}
+
+
+/*
+ * ReadCopyDataIntoTupleStore parses the records in the given data in COPY text
+ * format according to the given tuple descriptor and stores the records in a
+ * tuple store.
+ */
+void
+ReadCopyDataIntoTupleStore(char *copyData, int copyDataLength,
+						   TupleDesc tupleDescriptor, Tuplestorestate *tupstore)
+{
+	StringInfoData copyDataString;
+
+	copyDataString.data = copyData;
+	copyDataString.len = copyDataLength;
+	copyDataString.maxlen = copyDataLength;
+	copyDataString.cursor = 0;
+
+	StringInfo previousCopyData = CurrentCopyData;
+	CurrentCopyData = &copyDataString;
+
+	PG_TRY();
+	{
+		ReadCopyFileIntoTupleStore(NULL, ReadCopyData, "text", tupleDescriptor,
+								   tupstore);
+	}
+	PG_FINALLY();
+	{
+		CurrentCopyData = previousCopyData;
+	}
+	PG_END_TRY();
+}
+
+
+/*
+ * ReadCopyData is the data source callback of COPY for the data given to
+ * ReadCopyDataIntoTupleStore. It copies at most maxread bytes of the data
+ * that was not read yet into outbuf.
+ */
+static int
+ReadCopyData(void *outbuf, int minread, int maxread)
+{
+	StringInfo copyData = CurrentCopyData;
+
+	Assert(copyData != NULL);
+
+	int bytesRead = Min(maxread, copyData->len - copyData->cursor);
+	if (bytesRead > 0)
+	{
+		memcpy_s(outbuf, maxread, copyData->data + copyData->cursor, bytesRead);
+		copyData->cursor += bytesRead;
+	}
+
+	return bytesRead;
+}
+
+
+/*
+ * ReadCopyFileIntoTupleStore parses the records in a COPY-formatted file
+ * according to the given tuple descriptor and stores the records in a tuple
+ * store. When a data source callback is given, the records are read through
+ * the callback instead, as for compressed files via ReadCompressedResult.
+ */
+static void
+ReadCopyFileIntoTupleStore(char *fileName, copy_data_source_cb dataSourceCallback,
+						   char *copyFormat, TupleDesc tupleDescriptor,
+						   Tuplestorestate *tupstore)
 {
 	/*
 	 * Trick BeginCopyFrom into using our tuple descriptor by pretending it belongs
@@ -456,7 +677,8 @@ ReadFileIntoTupleStore(char *fileName, char *copyFormat, TupleDesc tupleDescript
 	copyOptions = lappend(copyOptions, copyOption);
 
 	CopyFromState copyState = BeginCopyFrom_compat(NULL, stubRelation, NULL,
-												   fileName, false, NULL,
+												   fileName, false,
+												   dataSourceCallback,
 												   NULL, copyOptions);
 
 	while (true)
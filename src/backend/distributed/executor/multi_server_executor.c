@@ -35,6 +35,9 @@ int TaskExecutorType = MULTI_EXECUTOR_ADAPTIVE; /* distributed executor type */
 bool EnableRepartitionJoins = false;
 
 
+static bool DependsOnRepartitionJoin(Job *job);
+
+
 /*
  * JobExecutorType selects the executor type for the given distributedPlan using the task
  * executor type config value. The function then checks if the given distributedPlan needs
@@ -60,10 +63,10 @@ JobExecutorType(DistributedPlan *distributedPlan)
 
 	/*
 	 * If we have repartition jobs with adaptive executor and repartition
-	 * joins are not enabled, error out.
+	 * joins are not enabled, error out. Repartitioned window functions have
+	 * a setting of their own that the planner already checked.
 	 */
-	int dependentJobCount = list_length(job->dependentJobList);
-	if (!EnableRepartitionJoins && dependentJobCount > 0)
+	if (!EnableRepartitionJoins && DependsOnRepartitionJoin(job))
 	{
 		ereport(ERROR, (errmsg("the query contains a join that requires repartitioning"),
 						errhint("Set citus.enable_repartition_joins to on to enable "
@@ -93,3 +96,29 @@ JobExecutorType(DistributedPlan *distributedPlan)
 
 	return MULTI_EXECUTOR_ADAPTIVE;
 }
+
+
+/*
+ * DependsOnRepartitionJoin returns whether the given job depends, directly or
+ * through other jobs, on a map merge job that repartitions a side of a join.
+ */
+static bool
+DependsOnRepartitionJoin(Job *job)
+{
+	Job *dependentJob = NULL;
+	foreach_ptr(dependentJob, job->dependentJobList)
+	{
+		if (CitusIsA(dependentJob, MapMergeJob) &&
+			((MapMergeJob *) dependentJob)->boundaryNodeJobType == JOIN_MAP_MERGE_JOB)
+		{
+			return true;
+		}
+
+		if (DependsOnRepartitionJoin(dependentJob))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
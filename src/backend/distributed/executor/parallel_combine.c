@@ -0,0 +1,655 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_combine.c
+ *	  Routines for reading the rows of a distributed query from postgres
+ *	  parallel workers during the combine query on the coordinator.
+ *
+ * The rows of the tasks end up in the tuple store of the Citus custom scan,
+ * which lives in the memory of the backend and hence cannot be read by
+ * parallel workers. When citus.enable_parallel_combine is on, we give the
+ * standard planner a partial path for the remote scan in addition to the
+ * regular one, such that it can plan the combine query as it would plan a
+ * parallel query on a regular table, for instance with a Partial Aggregate
+ * below a Gather and a Finalize Aggregate above it.
+ *
+ * The partial path becomes a "Citus Parallel Combine" custom scan, which
+ * does not carry the distributed plan and can therefore be sent to the
+ * parallel workers. After planning, we put the Citus custom scan above the
+ * Gather node of the combine plan. It executes the distributed query before
+ * the Gather starts the workers and, when the Gather sets up its dynamic
+ * shared memory, the leader copies the rows into a shared tuple store that
+ * all the participants of the parallel scan read from.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "miscadmin.h"
+
+#include "access/parallel.h"
+#include "distributed/adaptive_executor.h"
+#include "distributed/citus_custom_scan.h"
+#include "distributed/listutils.h"
+#include "distributed/multi_executor.h"
+#include "distributed/parallel_combine.h"
+#include "executor/executor.h"
+#include "nodes/extensible.h"
+#include "nodes/makefuncs.h"
+#include "optimizer/cost.h"
+#include "storage/dsm.h"
+#include "storage/sharedfileset.h"
+#include "storage/shmem.h"
+#include "utils/sharedtuplestore.h"
+
+
+/*
+ * ParallelCombineSharedState is the part of the dynamic shared memory of the
+ * Gather that belongs to a parallel combine scan. It is followed by the
+ * shared tuple store that holds the rows of the distributed query.
+ */
+typedef struct ParallelCombineSharedState
+{
+	/* segment that the workers attach the file set to */
+	dsm_handle segmentHandle;
+
+	/* files that back the shared tuple store */
+	SharedFileSet fileSet;
+} ParallelCombineSharedState;
+
+#define SHARED_TUPLE_STORE_OFFSET MAXALIGN(sizeof(ParallelCombineSharedState))
+
+
+/*
+ * ParallelCombineScanState is the executor state of a parallel combine scan,
+ * in both the leader and the parallel workers.
+ */
+typedef struct ParallelCombineScanState
+{
+	CustomScanState customScanState;
+
+	/* Citus scan that executes the distributed query, only set in the leader */
+	CitusScanState *sourceScanState;
+
+	/* rows of the distributed query, NULL when running without workers */
+	SharedTuplestoreAccessor *sharedTupleStore;
+	bool sharedScanStarted;
+} ParallelCombineScanState;
+
+
+static Plan * ParallelCombineScanPathPlan(PlannerInfo *root, RelOptInfo *rel,
+										  CustomPath *best_path, List *tlist,
+										  List *clauses, List *custom_plans);
+static int CountParallelCombineScans(Plan *plan);
+static Plan ** FindParallelCombineGather(Plan **planSlot);
+static Node * ParallelCombineCreateScan(CustomScan *scan);
+static void ParallelCombineBeginScan(CustomScanState *node, EState *estate, int eflags);
+static TupleTableSlot * ParallelCombineExecScan(CustomScanState *node);
+static TupleTableSlot * ParallelCombineScanNext(ScanState *node);
+static bool ParallelCombineScanRecheck(ScanState *node, TupleTableSlot *slot);
+static void ParallelCombineEndScan(CustomScanState *node);
+static void ParallelCombineReScan(CustomScanState *node);
+static Size ParallelCombineEstimateDSM(CustomScanState *node, ParallelContext *pcxt);
+static void ParallelCombineInitializeDSM(CustomScanState *node, ParallelContext *pcxt,
+										 void *coordinate);
+static void ParallelCombineReInitializeDSM(CustomScanState *node,
+										   ParallelContext *pcxt, void *coordinate);
+static void ParallelCombineInitializeWorker(CustomScanState *node, shm_toc *toc,
+											void *coordinate);
+static void FinishRemoteScan(CitusScanState *scanState);
+
+
+/* GUC, determines whether the combine query may use parallel workers */
+bool EnableParallelCombine = false;
+
+/* number of parallel combine scans created while planning the combine query */
+static int ParallelCombineScanCount = 0;
+
+/* Citus scan whose Gather is being initialized, read by the parallel scan */
+static CitusScanState *ParallelCombineSourceScanState = NULL;
+
+
+static CustomPathMethods ParallelCombineScanPathMethods = {
+	.CustomName = "ParallelCombineScanPath",
+	.PlanCustomPath = ParallelCombineScanPathPlan,
+};
+
+CustomScanMethods ParallelCombineCustomScanMethods = {
+	"Citus Parallel Combine",
+	ParallelCombineCreateScan
+};
+
+static CustomExecMethods ParallelCombineCustomExecMethods = {
+	.CustomName = "ParallelCombineScan",
+	.BeginCustomScan = ParallelCombineBeginScan,
+	.ExecCustomScan = ParallelCombineExecScan,
+	.EndCustomScan = ParallelCombineEndScan,
+	.ReScanCustomScan = ParallelCombineReScan,
+	.EstimateDSMCustomScan = ParallelCombineEstimateDSM,
+	.InitializeDSMCustomScan = ParallelCombineInitializeDSM,
+	.ReInitializeDSMCustomScan = ParallelCombineReInitializeDSM,
+	.InitializeWorkerCustomScan = ParallelCombineInitializeWorker
+};
+
+
+/*
+ * CreateParallelCombineScanPath creates a partial path for the remote scan of
+ * the combine query, which lets the standard planner consider plans in which
+ * parallel workers read the rows of the distributed query.
+ */
+Path *
+CreateParallelCombineScanPath(PlannerInfo *root, RelOptInfo *relOptInfo,
+							  CustomScan *remoteScan)
+{
+	CitusCustomScanPath *path = (CitusCustomScanPath *) newNode(
+		sizeof(CitusCustomScanPath), T_CustomPath);
+	path->custom_path.methods = &ParallelCombineScanPathMethods;
+	path->custom_path.path.pathtype = T_CustomScan;
+	path->custom_path.path.pathtarget = relOptInfo->reltarget;
+	path->custom_path.path.parent = relOptInfo;
+
+#if (PG_VERSION_NUM >= PG_VERSION_15)
+
+	/* necessary to avoid extra Result node in PG15 */
+	path->custom_path.flags = CUSTOMPATH_SUPPORT_PROJECTION;
+#endif
+
+	int parallelWorkers = max_parallel_workers_per_gather;
+
+	path->custom_path.path.parallel_aware = true;
+	path->custom_path.path.parallel_safe = true;
+	path->custom_path.path.parallel_workers = parallelWorkers;
+
+	/*
+	 * We use the same arbitrary 100k rows as the regular path of the remote
+	 * scan, spread over the workers and the leader.
+	 */
+	path->custom_path.path.rows = 100000 / (parallelWorkers + 1);
+	path->remoteScan = remoteScan;
+
+	return (Path *) path;
+}
+
+
+/*
+ * ParallelCombineScanPathPlan is called for the parallel combine path when it
+ * ends up in the best path of the combine query. It returns a custom scan that
+ * reads the columns of the remote scan, but does not carry the distributed
+ * plan, since the plan below a Gather needs to be sent to the workers.
+ */
+static Plan *
+ParallelCombineScanPathPlan(PlannerInfo *root, RelOptInfo *rel, CustomPath *best_path,
+							List *tlist, List *clauses, List *custom_plans)
+{
+	CitusCustomScanPath *citusPath = (CitusCustomScanPath *) best_path;
+	CustomScan *combineScan = makeNode(CustomScan);
+
+	combineScan->methods = &ParallelCombineCustomScanMethods;
+	combineScan->scan.plan.targetlist = tlist;
+
+	/* see CitusCustomScanPathPlan for why we point the columns to our relation */
+	combineScan->custom_scan_tlist = copyObject(citusPath->remoteScan->custom_scan_tlist);
+
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, combineScan->custom_scan_tlist)
+	{
+		Var *var = castNode(Var, targetEntry->expr);
+
+		var->varno = rel->relid;
+	}
+
+	/* clauses might have been added by the planner, need to add them to our scan */
+	RestrictInfo *restrictInfo = NULL;
+	List **quals = &combineScan->scan.plan.qual;
+	foreach_ptr(restrictInfo, clauses)
+	{
+		*quals = lappend(*quals, restrictInfo->clause);
+	}
+
+	ParallelCombineScanCount++;
+
+	return (Plan *) combineScan;
+}
+
+
+/*
+ * ResetParallelCombineScanCount is called before planning a combine query, such
+ * that AddParallelCombineSource knows whether the planner picked the partial path.
+ */
+void
+ResetParallelCombineScanCount(void)
+{
+	ParallelCombineScanCount = 0;
+}
+
+
+/*
+ * AddParallelCombineSource puts the given remote scan above the Gather node of
+ * the combine plan that reads the rows of the distributed query in parallel.
+ * The remote scan passes on the rows of the Gather and executes the
+ * distributed query for the parallel combine scan below it.
+ *
+ * The function returns false if the combine plan contains a parallel combine
+ * scan that the remote scan cannot be placed above, in which case the combine
+ * query needs to be planned without parallel workers.
+ */
+bool
+AddParallelCombineSource(PlannedStmt *combinePlan, CustomScan *remoteScan)
+{
+	if (ParallelCombineScanCount == 0)
+	{
+		/* the planner did not pick the partial path */
+		return true;
+	}
+
+	/*
+	 * The remote scan is the only relation in the combine query, so we only
+	 * expect a single Gather above a single parallel combine scan. We do not
+	 * look for the scan in subplans or below other nodes than the outer and
+	 * inner plans, so we count the scans that were planned to catch those.
+	 */
+	Plan **gatherSlot = FindParallelCombineGather(&combinePlan->planTree);
+	if (ParallelCombineScanCount != 1 || gatherSlot == NULL ||
+		CountParallelCombineScans(*gatherSlot) != 1)
+	{
+		return false;
+	}
+
+	Plan *gatherPlan = *gatherSlot;
+	Plan *remotePlan = &remoteScan->scan.plan;
+
+	/* the remote scan returns the rows of the Gather as they are */
+	List *targetList = NIL;
+	TargetEntry *gatherTargetEntry = NULL;
+	foreach_ptr(gatherTargetEntry, gatherPlan->targetlist)
+	{
+		Var *outerColumn = makeVarFromTargetEntry(OUTER_VAR, gatherTargetEntry);
+		TargetEntry *targetEntry = makeTargetEntry((Expr *) outerColumn,
+												   gatherTargetEntry->resno,
+												   gatherTargetEntry->resname,
+												   gatherTargetEntry->resjunk);
+
+		targetList = lappend(targetList, targetEntry);
+	}
+
+	remotePlan->targetlist = targetList;
+	remotePlan->qual = NIL;
+	remotePlan->lefttree = gatherPlan;
+	remotePlan->startup_cost = gatherPlan->startup_cost;
+	remotePlan->total_cost = gatherPlan->total_cost;
+	remotePlan->plan_rows = gatherPlan->plan_rows;
+	remotePlan->plan_width = gatherPlan->plan_width;
+
+	*gatherSlot = remotePlan;
+
+	return true;
+}
+
+
+/*
+ * CountParallelCombineScans returns the number of parallel combine scans in
+ * the outer and inner plans of the given plan.
+ */
+static int
+CountParallelCombineScans(Plan *plan)
+{
+	if (plan == NULL)
+	{
+		return 0;
+	}
+
+	int scanCount = 0;
+	if (IsA(plan, CustomScan) &&
+		((CustomScan *) plan)->methods == &ParallelCombineCustomScanMethods)
+	{
+		scanCount++;
+	}
+
+	return scanCount + CountParallelCombineScans(plan->lefttree) +
+		   CountParallelCombineScans(plan->righttree);
+}
+
+
+/*
+ * FindParallelCombineGather returns the location of the pointer to the
+ * topmost Gather or Gather Merge node that has a parallel combine scan below
+ * it, or NULL if there is none.
+ */
+static Plan **
+FindParallelCombineGather(Plan **planSlot)
+{
+	Plan *plan = *planSlot;
+	if (plan == NULL)
+	{
+		return NULL;
+	}
+
+	if ((IsA(plan, Gather) || IsA(plan, GatherMerge)) &&
+		CountParallelCombineScans(plan) > 0)
+	{
+		return planSlot;
+	}
+
+	Plan **gatherSlot = FindParallelCombineGather(&plan->lefttree);
+	if (gatherSlot == NULL)
+	{
+		gatherSlot = FindParallelCombineGather(&plan->righttree);
+	}
+
+	return gatherSlot;
+}
+
+
+/*
+ * ExecInitParallelCombineSource initializes the Gather below the given Citus
+ * scan, which lets the parallel combine scan that is initialized in the
+ * process find the scan that it reads the rows from.
+ */
+void
+ExecInitParallelCombineSource(CitusScanState *scanState, EState *estate, int eflags)
+{
+	CustomScanState *node = &scanState->customScanState;
+	CitusScanState *previousSourceScanState = ParallelCombineSourceScanState;
+
+	ParallelCombineSourceScanState = scanState;
+
+	PG_TRY();
+	{
+		outerPlanState(node) = ExecInitNode(outerPlan(node->ss.ps.plan), estate,
+											eflags);
+	}
+	PG_CATCH();
+	{
+		ParallelCombineSourceScanState = previousSourceScanState;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	ParallelCombineSourceScanState = previousSourceScanState;
+}
+
+
+/*
+ * ParallelCombineCreateScan creates the scan state of a parallel combine scan.
+ */
+static Node *
+ParallelCombineCreateScan(CustomScan *scan)
+{
+	ParallelCombineScanState *scanState = palloc0(sizeof(ParallelCombineScanState));
+
+	scanState->customScanState.ss.ps.type = T_CustomScanState;
+	scanState->customScanState.methods = &ParallelCombineCustomExecMethods;
+
+	return (Node *) scanState;
+}
+
+
+/*
+ * ParallelCombineBeginScan prepares the scan for reading minimal tuples and,
+ * in the leader, remembers the Citus scan that executes the distributed query.
+ */
+static void
+ParallelCombineBeginScan(CustomScanState *node, EState *estate, int eflags)
+{
+	ParallelCombineScanState *scanState = (ParallelCombineScanState *) node;
+
+	/* we read minimal tuples, see CitusBeginScan */
+	ExecInitResultSlot(&node->ss.ps, &TTSOpsMinimalTuple);
+	ExecInitScanTupleSlot(estate, &node->ss, node->ss.ps.scandesc,
+						  &TTSOpsMinimalTuple);
+	ExecAssignScanProjectionInfoWithVarno(&node->ss, INDEX_VAR);
+
+	node->ss.ps.qual = ExecInitQual(node->ss.ps.plan->qual, (PlanState *) node);
+
+	if (!IsParallelWorker())
+	{
+		scanState->sourceScanState = ParallelCombineSourceScanState;
+		if (scanState->sourceScanState == NULL)
+		{
+			ereport(ERROR, (errmsg("parallel combine scan is not below a Citus "
+								   "custom scan")));
+		}
+	}
+}
+
+
+/*
+ * ParallelCombineExecScan returns the next row of the distributed query that
+ * passes the quals of the scan.
+ */
+static TupleTableSlot *
+ParallelCombineExecScan(CustomScanState *node)
+{
+	return ExecScan(&node->ss, ParallelCombineScanNext, ParallelCombineScanRecheck);
+}
+
+
+/*
+ * ParallelCombineScanNext reads the next row from the shared tuple store or,
+ * when the Gather runs without workers, directly from the Citus scan.
+ */
+static TupleTableSlot *
+ParallelCombineScanNext(ScanState *node)
+{
+	ParallelCombineScanState *scanState = (ParallelCombineScanState *) node;
+	TupleTableSlot *slot = node->ss_ScanTupleSlot;
+
+	if (scanState->sharedTupleStore != NULL)
+	{
+		if (!scanState->sharedScanStarted)
+		{
+			sts_begin_parallel_scan(scanState->sharedTupleStore);
+			scanState->sharedScanStarted = true;
+		}
+
+		MinimalTuple tuple = sts_parallel_scan_next(scanState->sharedTupleStore, NULL);
+		if (tuple == NULL)
+		{
+			return ExecClearTuple(slot);
+		}
+
+		return ExecStoreMinimalTuple(tuple, slot, false);
+	}
+
+	CitusScanState *sourceScanState = scanState->sourceScanState;
+	if (sourceScanState == NULL)
+	{
+		ereport(ERROR, (errmsg("parallel worker cannot read the rows of the "
+							   "distributed query")));
+	}
+
+	FinishRemoteScan(sourceScanState);
+
+	TupleTableSlot *sourceSlot = ReadNextTupleFromTuplestore(sourceScanState, true);
+	if (TupIsNull(sourceSlot))
+	{
+		return ExecClearTuple(slot);
+	}
+
+	return ExecCopySlot(slot, sourceSlot);
+}
+
+
+/*
+ * ParallelCombineScanRecheck is not called since the scan does not lock rows,
+ * but ExecScan requires it.
+ */
+static bool
+ParallelCombineScanRecheck(ScanState *node, TupleTableSlot *slot)
+{
+	return true;
+}
+
+
+/*
+ * ParallelCombineEndScan stops reading the shared tuple store, whose files are
+ * removed when the dynamic shared memory of the Gather is detached.
+ */
+static void
+ParallelCombineEndScan(CustomScanState *node)
+{
+	ParallelCombineScanState *scanState = (ParallelCombineScanState *) node;
+
+	if (scanState->sharedScanStarted)
+	{
+		sts_end_parallel_scan(scanState->sharedTupleStore);
+		scanState->sharedScanStarted = false;
+	}
+}
+
+
+/*
+ * ParallelCombineReScan prepares the scan for reading the rows again. The
+ * Gather reinitializes the shared tuple store afterwards, if there is one.
+ */
+static void
+ParallelCombineReScan(CustomScanState *node)
+{
+	ParallelCombineScanState *scanState = (ParallelCombineScanState *) node;
+
+	if (scanState->sharedScanStarted)
+	{
+		sts_end_parallel_scan(scanState->sharedTupleStore);
+		scanState->sharedScanStarted = false;
+	}
+
+	CitusScanState *sourceScanState = scanState->sourceScanState;
+	if (scanState->sharedTupleStore == NULL && sourceScanState != NULL &&
+		sourceScanState->tuplestorestate != NULL)
+	{
+		tuplestore_rescan(sourceScanState->tuplestorestate);
+	}
+}
+
+
+/*
+ * ParallelCombineEstimateDSM returns the size of the shared state of the scan,
+ * including a shared tuple store for the leader and all the workers.
+ */
+static Size
+ParallelCombineEstimateDSM(CustomScanState *node, ParallelContext *pcxt)
+{
+	return add_size(SHARED_TUPLE_STORE_OFFSET, sts_estimate(pcxt->nworkers + 1));
+}
+
+
+/*
+ * ParallelCombineInitializeDSM is called in the leader when the Gather sets up
+ * its dynamic shared memory, before the workers start. We copy the rows of the
+ * distributed query into a shared tuple store, such that all the participants
+ * of the scan can read them.
+ */
+static void
+ParallelCombineInitializeDSM(CustomScanState *node, ParallelContext *pcxt,
+							 void *coordinate)
+{
+	ParallelCombineScanState *scanState = (ParallelCombineScanState *) node;
+	ParallelCombineSharedState *sharedState = (ParallelCombineSharedState *) coordinate;
+	CitusScanState *sourceScanState = scanState->sourceScanState;
+
+	if (pcxt->seg == NULL)
+	{
+		/* postgres fell back to private memory, which means no workers */
+		return;
+	}
+
+	sharedState->segmentHandle = dsm_segment_handle(pcxt->seg);
+	SharedFileSetInit(&sharedState->fileSet, pcxt->seg);
+
+	SharedTuplestore *sharedTupleStore =
+		(SharedTuplestore *) ((char *) coordinate + SHARED_TUPLE_STORE_OFFSET);
+
+	scanState->sharedTupleStore = sts_initialize(sharedTupleStore, pcxt->nworkers + 1,
+												 0, 0, 0, &sharedState->fileSet,
+												 "citus_parallel_combine");
+
+	FinishRemoteScan(sourceScanState);
+
+	for (;;)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		TupleTableSlot *slot = ReadNextTupleFromTuplestore(sourceScanState, true);
+		if (TupIsNull(slot))
+		{
+			break;
+		}
+
+		bool shouldFree = false;
+		MinimalTuple tuple = ExecFetchSlotMinimalTuple(slot, &shouldFree);
+
+		sts_puttuple(scanState->sharedTupleStore, NULL, tuple);
+
+		if (shouldFree)
+		{
+			pfree(tuple);
+		}
+	}
+
+	sts_end_write(scanState->sharedTupleStore);
+}
+
+
+/*
+ * ParallelCombineReInitializeDSM prepares the shared tuple store for reading
+ * the rows again when the Gather is rescanned.
+ */
+static void
+ParallelCombineReInitializeDSM(CustomScanState *node, ParallelContext *pcxt,
+							   void *coordinate)
+{
+	ParallelCombineScanState *scanState = (ParallelCombineScanState *) node;
+
+	if (scanState->sharedTupleStore != NULL)
+	{
+		sts_reinitialize(scanState->sharedTupleStore);
+	}
+}
+
+
+/*
+ * ParallelCombineInitializeWorker attaches a parallel worker to the shared
+ * tuple store that the leader filled.
+ */
+static void
+ParallelCombineInitializeWorker(CustomScanState *node, shm_toc *toc, void *coordinate)
+{
+	ParallelCombineScanState *scanState = (ParallelCombineScanState *) node;
+	ParallelCombineSharedState *sharedState = (ParallelCombineSharedState *) coordinate;
+
+	dsm_segment *segment = dsm_find_mapping(sharedState->segmentHandle);
+	if (segment == NULL)
+	{
+		ereport(ERROR, (errmsg("could not find the dynamic shared memory of the "
+							   "parallel combine scan")));
+	}
+
+	SharedFileSetAttach(&sharedState->fileSet, segment);
+
+	SharedTuplestore *sharedTupleStore =
+		(SharedTuplestore *) ((char *) coordinate + SHARED_TUPLE_STORE_OFFSET);
+
+	scanState->sharedTupleStore = sts_attach(sharedTupleStore, ParallelWorkerNumber + 1,
+											 &sharedState->fileSet);
+}
+
+
+/*
+ * FinishRemoteScan executes the distributed query of the given Citus scan if
+ * that did not happen yet. Normally, CitusPreExecScan already did so before
+ * postgres entered parallel mode.
+ */
+static void
+FinishRemoteScan(CitusScanState *scanState)
+{
+	if (!scanState->finishedRemoteScan)
+	{
+		AdaptiveExecutor(scanState);
+
+		scanState->finishedRemoteScan = true;
+	}
+}
@@ -0,0 +1,606 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_result_scan.c
+ *	  Routines for reading intermediate results from postgres parallel
+ *	  workers.
+ *
+ * Postgres plans read_intermediate_result() calls as function scans, which
+ * cannot be partial, hence a query that joins a recursively planned subquery
+ * with large local tables on the coordinator cannot read the intermediate
+ * result below a Gather, and the join above it runs in a single process.
+ *
+ * When citus.enable_parallel_result_scan is on, we give the standard planner
+ * a partial path for read_intermediate_result() calls with constant arguments
+ * in addition to the function scan. The path becomes a "Citus Parallel
+ * Result Scan" custom scan. When the Gather above it sets up its dynamic
+ * shared memory, the leader reads the intermediate result and copies the rows
+ * into a shared tuple store that all the participants of the parallel scan
+ * read from, similar to the parallel combine scan in parallel_combine.c.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "miscadmin.h"
+
+#include "access/parallel.h"
+#include "distributed/listutils.h"
+#include "distributed/multi_logical_planner.h"
+#include "distributed/parallel_result_scan.h"
+#include "executor/executor.h"
+#include "nodes/makefuncs.h"
+#include "optimizer/cost.h"
+#include "optimizer/optimizer.h"
+#include "optimizer/pathnode.h"
+#include "optimizer/paths.h"
+#include "optimizer/planmain.h"
+#include "storage/dsm.h"
+#include "storage/sharedfileset.h"
+#include "storage/shmem.h"
+#include "utils/memutils.h"
+#include "utils/sharedtuplestore.h"
+#include "utils/tuplestore.h"
+
+
+/*
+ * ParallelResultScanSharedState is the part of the dynamic shared memory of
+ * the Gather that belongs to a parallel result scan. It is followed by the
+ * shared tuple store that holds the rows of the intermediate result.
+ */
+typedef struct ParallelResultScanSharedState
+{
+	/* segment that the workers attach the file set to */
+	dsm_handle segmentHandle;
+
+	/* files that back the shared tuple store */
+	SharedFileSet fileSet;
+} ParallelResultScanSharedState;
+
+#define SHARED_TUPLE_STORE_OFFSET MAXALIGN(sizeof(ParallelResultScanSharedState))
+
+
+/*
+ * ParallelResultScanState is the executor state of a parallel result scan,
+ * in both the leader and the parallel workers.
+ */
+typedef struct ParallelResultScanState
+{
+	CustomScanState customScanState;
+
+	/* read_intermediate_result() call, only evaluated by the leader */
+	SetExprState *functionState;
+	MemoryContext argumentContext;
+
+	/* rows of the intermediate result when running without workers */
+	Tuplestorestate *tupleStore;
+
+	/* rows of the intermediate result, NULL when running without workers */
+	SharedTuplestoreAccessor *sharedTupleStore;
+	bool sharedScanStarted;
+} ParallelResultScanState;
+
+
+static bool IsParallelResultScanCandidate(RelOptInfo *relOptInfo,
+										  RangeTblEntry *rangeTableEntry);
+static Plan * ParallelResultScanPathPlan(PlannerInfo *root, RelOptInfo *rel,
+										 CustomPath *best_path, List *tlist,
+										 List *clauses, List *custom_plans);
+static Node * ParallelResultScanCreateScan(CustomScan *scan);
+static void ParallelResultScanBeginScan(CustomScanState *node, EState *estate,
+										int eflags);
+static TupleTableSlot * ParallelResultScanExecScan(CustomScanState *node);
+static TupleTableSlot * ParallelResultScanNext(ScanState *node);
+static bool ParallelResultScanRecheck(ScanState *node, TupleTableSlot *slot);
+static void ParallelResultScanEndScan(CustomScanState *node);
+static void ParallelResultScanReScan(CustomScanState *node);
+static Size ParallelResultScanEstimateDSM(CustomScanState *node, ParallelContext *pcxt);
+static void ParallelResultScanInitializeDSM(CustomScanState *node,
+											ParallelContext *pcxt, void *coordinate);
+static void ParallelResultScanReInitializeDSM(CustomScanState *node,
+											  ParallelContext *pcxt, void *coordinate);
+static void ParallelResultScanInitializeWorker(CustomScanState *node, shm_toc *toc,
+											   void *coordinate);
+static Tuplestorestate * ReadIntermediateResultRows(ParallelResultScanState *scanState);
+
+
+/* GUC, determines whether intermediate results may be read by parallel workers */
+bool EnableParallelResultScan = false;
+
+
+static CustomPathMethods ParallelResultScanPathMethods = {
+	.CustomName = "ParallelResultScanPath",
+	.PlanCustomPath = ParallelResultScanPathPlan,
+};
+
+CustomScanMethods ParallelResultScanCustomScanMethods = {
+	"Citus Parallel Result Scan",
+	ParallelResultScanCreateScan
+};
+
+static CustomExecMethods ParallelResultScanCustomExecMethods = {
+	.CustomName = "ParallelResultScan",
+	.BeginCustomScan = ParallelResultScanBeginScan,
+	.ExecCustomScan = ParallelResultScanExecScan,
+	.EndCustomScan = ParallelResultScanEndScan,
+	.ReScanCustomScan = ParallelResultScanReScan,
+	.EstimateDSMCustomScan = ParallelResultScanEstimateDSM,
+	.InitializeDSMCustomScan = ParallelResultScanInitializeDSM,
+	.ReInitializeDSMCustomScan = ParallelResultScanReInitializeDSM,
+	.InitializeWorkerCustomScan = ParallelResultScanInitializeWorker
+};
+
+
+/*
+ * AddParallelResultScanPath adds a partial path for the given relation if it
+ * reads intermediate results and is large enough for parallel workers, which
+ * lets the standard planner consider parallel plans for the joins and
+ * aggregates above it.
+ *
+ * We expect the function scan path of the relation to have the costs that
+ * AdjustReadIntermediateResultCost derived from the size of the result files.
+ */
+void
+AddParallelResultScanPath(PlannerInfo *root, RelOptInfo *relOptInfo,
+						  RangeTblEntry *rangeTableEntry)
+{
+	if (!EnableParallelResultScan ||
+		!IsParallelResultScanCandidate(relOptInfo, rangeTableEntry))
+	{
+		return;
+	}
+
+	Path *functionScanPath = (Path *) linitial(relOptInfo->pathlist);
+	double rowCount = functionScanPath->rows;
+	double resultPages = rowCount * relOptInfo->reltarget->width / BLCKSZ;
+
+	int parallelWorkers = compute_parallel_worker(relOptInfo, resultPages, -1,
+												  max_parallel_workers_per_gather);
+	if (parallelWorkers <= 0)
+	{
+		/* the result is too small to be worth reading in parallel */
+		return;
+	}
+
+	/* the leader's share of the rows, see get_parallel_divisor in postgres */
+	double parallelDivisor = parallelWorkers;
+	if (parallel_leader_participation)
+	{
+		double leaderContribution = 1.0 - (0.3 * parallelWorkers);
+		if (leaderContribution > 0)
+		{
+			parallelDivisor += leaderContribution;
+		}
+	}
+
+	CustomPath *path = makeNode(CustomPath);
+	path->methods = &ParallelResultScanPathMethods;
+	path->path.pathtype = T_CustomScan;
+	path->path.pathtarget = relOptInfo->reltarget;
+	path->path.parent = relOptInfo;
+
+#if (PG_VERSION_NUM >= PG_VERSION_15)
+
+	/* necessary to avoid extra Result node in PG15 */
+	path->flags = CUSTOMPATH_SUPPORT_PROJECTION;
+#endif
+
+	path->path.parallel_aware = true;
+	path->path.parallel_safe = true;
+	path->path.parallel_workers = parallelWorkers;
+	path->path.rows = clamp_row_est(rowCount / parallelDivisor);
+
+	/*
+	 * The leader reads the whole result before the workers start, after which
+	 * each participant only reads its share of the rows from the shared tuple
+	 * store.
+	 */
+	path->path.startup_cost = functionScanPath->total_cost;
+	path->path.total_cost = functionScanPath->total_cost +
+							cpu_tuple_cost * path->path.rows;
+
+	add_partial_path(relOptInfo, (Path *) path);
+}
+
+
+/*
+ * IsParallelResultScanCandidate returns whether the given relation is a call
+ * to read_intermediate_result() or read_intermediate_results() with constant
+ * arguments that the planner allows to be read by parallel workers.
+ */
+static bool
+IsParallelResultScanCandidate(RelOptInfo *relOptInfo, RangeTblEntry *rangeTableEntry)
+{
+	if (rangeTableEntry->rtekind != RTE_FUNCTION ||
+		list_length(rangeTableEntry->functions) != 1 ||
+		rangeTableEntry->funcordinality)
+	{
+		return false;
+	}
+
+	if (!relOptInfo->consider_parallel || !bms_is_empty(relOptInfo->lateral_relids) ||
+		relOptInfo->pathlist == NIL)
+	{
+		return false;
+	}
+
+	RangeTblFunction *rangeTableFunction =
+		(RangeTblFunction *) linitial(rangeTableEntry->functions);
+	Node *functionExpression = rangeTableFunction->funcexpr;
+
+	if (!IsA(functionExpression, FuncExpr) ||
+		rangeTableFunction->funccoltypes == NIL)
+	{
+		return false;
+	}
+
+	if (!ContainsReadIntermediateResultFunction(functionExpression) &&
+		!ContainsReadIntermediateResultArrayFunction(functionExpression))
+	{
+		return false;
+	}
+
+	Node *argument = NULL;
+	foreach_ptr(argument, ((FuncExpr *) functionExpression)->args)
+	{
+		if (!IsA(argument, Const))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ParallelResultScanPathPlan is called for the parallel result scan path when
+ * it ends up in the best path. It returns a custom scan whose scan tuple has
+ * all the columns of the intermediate result, and which keeps the function
+ * call in its expressions such that the leader can evaluate it.
+ */
+static Plan *
+ParallelResultScanPathPlan(PlannerInfo *root, RelOptInfo *rel, CustomPath *best_path,
+						   List *tlist, List *clauses, List *custom_plans)
+{
+	RangeTblEntry *rangeTableEntry = root->simple_rte_array[rel->relid];
+	RangeTblFunction *rangeTableFunction =
+		(RangeTblFunction *) linitial(rangeTableEntry->functions);
+	CustomScan *resultScan = makeNode(CustomScan);
+
+	resultScan->methods = &ParallelResultScanCustomScanMethods;
+	resultScan->scan.plan.targetlist = tlist;
+	resultScan->custom_exprs = list_make1(copyObject(rangeTableFunction->funcexpr));
+
+	/*
+	 * The scan tuple has the columns of the result in the order in which they
+	 * are stored, and we point its columns to our relation such that setrefs
+	 * can map the target list and the quals onto it.
+	 */
+	ListCell *typeCell = NULL;
+	ListCell *typmodCell = NULL;
+	ListCell *collationCell = NULL;
+	AttrNumber columnNumber = 1;
+	forthree(typeCell, rangeTableFunction->funccoltypes,
+			 typmodCell, rangeTableFunction->funccoltypmods,
+			 collationCell, rangeTableFunction->funccolcollations)
+	{
+		Var *column = makeVar(rel->relid, columnNumber, lfirst_oid(typeCell),
+							  lfirst_int(typmodCell), lfirst_oid(collationCell), 0);
+		char *columnName = strVal(list_nth(rangeTableEntry->eref->colnames,
+										   columnNumber - 1));
+
+		resultScan->custom_scan_tlist =
+			lappend(resultScan->custom_scan_tlist,
+					makeTargetEntry((Expr *) column, columnNumber, columnName, false));
+
+		columnNumber++;
+	}
+
+	/* clauses might have been added by the planner, need to add them to our scan */
+	RestrictInfo *restrictInfo = NULL;
+	List **quals = &resultScan->scan.plan.qual;
+	foreach_ptr(restrictInfo, clauses)
+	{
+		*quals = lappend(*quals, restrictInfo->clause);
+	}
+
+	return (Plan *) resultScan;
+}
+
+
+/*
+ * ParallelResultScanCreateScan creates the scan state of a parallel result
+ * scan.
+ */
+static Node *
+ParallelResultScanCreateScan(CustomScan *scan)
+{
+	ParallelResultScanState *scanState = palloc0(sizeof(ParallelResultScanState));
+
+	scanState->customScanState.ss.ps.type = T_CustomScanState;
+	scanState->customScanState.methods = &ParallelResultScanCustomExecMethods;
+
+	return (Node *) scanState;
+}
+
+
+/*
+ * ParallelResultScanBeginScan prepares the scan for reading minimal tuples
+ * and, in the leader, prepares the evaluation of read_intermediate_result().
+ */
+static void
+ParallelResultScanBeginScan(CustomScanState *node, EState *estate, int eflags)
+{
+	ParallelResultScanState *scanState = (ParallelResultScanState *) node;
+	CustomScan *resultScan = (CustomScan *) node->ss.ps.plan;
+
+	/* tuple stores return minimal tuples */
+	ExecInitResultSlot(&node->ss.ps, &TTSOpsMinimalTuple);
+	ExecInitScanTupleSlot(estate, &node->ss, node->ss.ps.scandesc,
+						  &TTSOpsMinimalTuple);
+	ExecAssignScanProjectionInfoWithVarno(&node->ss, INDEX_VAR);
+
+	node->ss.ps.qual = ExecInitQual(node->ss.ps.plan->qual, (PlanState *) node);
+
+	if (!IsParallelWorker())
+	{
+		Expr *functionExpression = (Expr *) linitial(resultScan->custom_exprs);
+
+		scanState->functionState =
+			ExecInitTableFunctionResult(functionExpression, node->ss.ps.ps_ExprContext,
+										&node->ss.ps);
+		scanState->argumentContext = AllocSetContextCreate(CurrentMemoryContext,
+														   "Table function arguments",
+														   ALLOCSET_DEFAULT_SIZES);
+	}
+}
+
+
+/*
+ * ParallelResultScanExecScan returns the next row of the intermediate result
+ * that passes the quals of the scan.
+ */
+static TupleTableSlot *
+ParallelResultScanExecScan(CustomScanState *node)
+{
+	return ExecScan(&node->ss, ParallelResultScanNext, ParallelResultScanRecheck);
+}
+
+
+/*
+ * ParallelResultScanNext reads the next row from the shared tuple store or,
+ * when the Gather runs without workers, from the result that the leader read.
+ */
+static TupleTableSlot *
+ParallelResultScanNext(ScanState *node)
+{
+	ParallelResultScanState *scanState = (ParallelResultScanState *) node;
+	TupleTableSlot *slot = node->ss_ScanTupleSlot;
+
+	if (scanState->sharedTupleStore != NULL)
+	{
+		if (!scanState->sharedScanStarted)
+		{
+			sts_begin_parallel_scan(scanState->sharedTupleStore);
+			scanState->sharedScanStarted = true;
+		}
+
+		MinimalTuple tuple = sts_parallel_scan_next(scanState->sharedTupleStore, NULL);
+		if (tuple == NULL)
+		{
+			return ExecClearTuple(slot);
+		}
+
+		return ExecStoreMinimalTuple(tuple, slot, false);
+	}
+
+	if (scanState->functionState == NULL)
+	{
+		ereport(ERROR, (errmsg("parallel worker cannot read the intermediate "
+							   "result")));
+	}
+
+	if (scanState->tupleStore == NULL)
+	{
+		scanState->tupleStore = ReadIntermediateResultRows(scanState);
+	}
+
+	if (!tuplestore_gettupleslot(scanState->tupleStore, true, false, slot))
+	{
+		return ExecClearTuple(slot);
+	}
+
+	return slot;
+}
+
+
+/*
+ * ParallelResultScanRecheck is not called since the scan does not lock rows,
+ * but ExecScan requires it.
+ */
+static bool
+ParallelResultScanRecheck(ScanState *node, TupleTableSlot *slot)
+{
+	return true;
+}
+
+
+/*
+ * ParallelResultScanEndScan stops reading the shared tuple store, whose files
+ * are removed when the dynamic shared memory of the Gather is detached, and
+ * frees the rows that the leader read.
+ */
+static void
+ParallelResultScanEndScan(CustomScanState *node)
+{
+	ParallelResultScanState *scanState = (ParallelResultScanState *) node;
+
+	if (scanState->sharedScanStarted)
+	{
+		sts_end_parallel_scan(scanState->sharedTupleStore);
+		scanState->sharedScanStarted = false;
+	}
+
+	if (scanState->tupleStore != NULL)
+	{
+		tuplestore_end(scanState->tupleStore);
+		scanState->tupleStore = NULL;
+	}
+}
+
+
+/*
+ * ParallelResultScanReScan prepares the scan for reading the rows again. The
+ * Gather reinitializes the shared tuple store afterwards, if there is one.
+ */
+static void
+ParallelResultScanReScan(CustomScanState *node)
+{
+	ParallelResultScanState *scanState = (ParallelResultScanState *) node;
+
+	if (scanState->sharedScanStarted)
+	{
+		sts_end_parallel_scan(scanState->sharedTupleStore);
+		scanState->sharedScanStarted = false;
+	}
+
+	if (scanState->tupleStore != NULL)
+	{
+		tuplestore_rescan(scanState->tupleStore);
+	}
+}
+
+
+/*
+ * ParallelResultScanEstimateDSM returns the size of the shared state of the
+ * scan, including a shared tuple store for the leader and all the workers.
+ */
+static Size
+ParallelResultScanEstimateDSM(CustomScanState *node, ParallelContext *pcxt)
+{
+	return add_size(SHARED_TUPLE_STORE_OFFSET, sts_estimate(pcxt->nworkers + 1));
+}
+
+
+/*
+ * ParallelResultScanInitializeDSM is called in the leader when the Gather sets
+ * up its dynamic shared memory, before the workers start. We read the
+ * intermediate result and copy its rows into a shared tuple store, such that
+ * all the participants of the scan can read them.
+ */
+static void
+ParallelResultScanInitializeDSM(CustomScanState *node, ParallelContext *pcxt,
+								void *coordinate)
+{
+	ParallelResultScanState *scanState = (ParallelResultScanState *) node;
+	ParallelResultScanSharedState *sharedState =
+		(ParallelResultScanSharedState *) coordinate;
+
+	if (pcxt->seg == NULL)
+	{
+		/* postgres fell back to private memory, which means no workers */
+		return;
+	}
+
+	sharedState->segmentHandle = dsm_segment_handle(pcxt->seg);
+	SharedFileSetInit(&sharedState->fileSet, pcxt->seg);
+
+	SharedTuplestore *sharedTupleStore =
+		(SharedTuplestore *) ((char *) coordinate + SHARED_TUPLE_STORE_OFFSET);
+
+	scanState->sharedTupleStore = sts_initialize(sharedTupleStore, pcxt->nworkers + 1,
+												 0, 0, 0, &sharedState->fileSet,
+												 "citus_parallel_result_scan");
+
+	Tuplestorestate *tupleStore = ReadIntermediateResultRows(scanState);
+	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		bool shouldFree = false;
+		MinimalTuple tuple = ExecFetchSlotMinimalTuple(slot, &shouldFree);
+
+		sts_puttuple(scanState->sharedTupleStore, NULL, tuple);
+
+		if (shouldFree)
+		{
+			pfree(tuple);
+		}
+	}
+
+	ExecClearTuple(slot);
+	tuplestore_end(tupleStore);
+
+	sts_end_write(scanState->sharedTupleStore);
+}
+
+
+/*
+ * ParallelResultScanReInitializeDSM prepares the shared tuple store for
+ * reading the rows again when the Gather is rescanned.
+ */
+static void
+ParallelResultScanReInitializeDSM(CustomScanState *node, ParallelContext *pcxt,
+								  void *coordinate)
+{
+	ParallelResultScanState *scanState = (ParallelResultScanState *) node;
+
+	if (scanState->sharedTupleStore != NULL)
+	{
+		sts_reinitialize(scanState->sharedTupleStore);
+	}
+}
+
+
+/*
+ * ParallelResultScanInitializeWorker attaches a parallel worker to the shared
+ * tuple store that the leader filled.
+ */
+static void
+ParallelResultScanInitializeWorker(CustomScanState *node, shm_toc *toc,
+								   void *coordinate)
+{
+	ParallelResultScanState *scanState = (ParallelResultScanState *) node;
+	ParallelResultScanSharedState *sharedState =
+		(ParallelResultScanSharedState *) coordinate;
+
+	dsm_segment *segment = dsm_find_mapping(sharedState->segmentHandle);
+	if (segment == NULL)
+	{
+		ereport(ERROR, (errmsg("could not find the dynamic shared memory of the "
+							   "parallel result scan")));
+	}
+
+	SharedFileSetAttach(&sharedState->fileSet, segment);
+
+	SharedTuplestore *sharedTupleStore =
+		(SharedTuplestore *) ((char *) coordinate + SHARED_TUPLE_STORE_OFFSET);
+
+	scanState->sharedTupleStore = sts_attach(sharedTupleStore, ParallelWorkerNumber + 1,
+											 &sharedState->fileSet);
+}
+
+
+/*
+ * ReadIntermediateResultRows evaluates the read_intermediate_result() call of
+ * the scan in the leader and returns the tuple store with its rows.
+ */
+static Tuplestorestate *
+ReadIntermediateResultRows(ParallelResultScanState *scanState)
+{
+	ScanState *node = &scanState->customScanState.ss;
+	TupleDesc scanDescriptor = node->ss_ScanTupleSlot->tts_tupleDescriptor;
+	bool randomAccess = false;
+
+	return ExecMakeTableFunctionResult(scanState->functionState,
+									   node->ps.ps_ExprContext,
+									   scanState->argumentContext,
+									   scanDescriptor, randomAccess);
+}
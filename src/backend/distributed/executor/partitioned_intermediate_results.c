@@ -26,15 +26,20 @@
 #include "distributed/multi_executor.h"
 #include "distributed/pg_dist_shard.h"
 #include "distributed/remote_commands.h"
+#include "distributed/repartition_join_filter.h"
+#include "distributed/repartition_join_skew.h"
+#include "distributed/transaction_management.h"
 #include "distributed/tuplestore.h"
 #include "distributed/utils/array_type.h"
 #include "distributed/utils/function.h"
 #include "distributed/version_compat.h"
+#include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "nodes/makefuncs.h"
 #include "nodes/primnodes.h"
 #include "tcop/pquery.h"
 #include "tcop/tcopprot.h"
+#include "utils/builtins.h"
 #include "utils/typcache.h"
 
 
@@ -92,6 +97,23 @@ typedef struct PartitionedResultDestReceiver
 
 	/* whether NULL partition column values are allowed */
 	bool allowNullPartitionColumnValues;
+
+	/*
+	 * Heavy hitters of the partition column and the partitions they hash to.
+	 * Their rows are spread across all partitions or, when replicateHeavyHitters
+	 * is set, sent to all partitions. partitionHasHeavyHitters is NULL when
+	 * there are no heavy hitters.
+	 */
+	int heavyHitterCount;
+	Datum *heavyHitterValues;
+	int *heavyHitterPartitions;
+	bool *partitionHasHeavyHitters;
+	bool replicateHeavyHitters;
+	FmgrInfo *heavyHitterEqualityFunction;
+	Oid heavyHitterCollation;
+
+	/* partition that gets the next row of a heavy hitter that we spread */
+	int nextSpreadPartitionIndex;
 } PartitionedResultDestReceiver;
 
 static Portal StartPortalForQueryExecution(const char *queryString);
@@ -100,6 +122,10 @@ static void PartitionedResultDestReceiverStartup(DestReceiver *dest, int operati
 static bool PartitionedResultDestReceiverReceive(TupleTableSlot *slot,
 												 DestReceiver *dest);
 static void PartitionedResultDestReceiverShutdown(DestReceiver *dest);
+static bool IsHeavyHitter(PartitionedResultDestReceiver *self, Datum value,
+						  int partitionIndex);
+static void ForwardToPartition(PartitionedResultDestReceiver *self,
+							   TupleTableSlot *slot, int partitionIndex);
 static void PartitionedResultDestReceiverDestroy(DestReceiver *copyDest);
 
 /* exports for SQL callable functions */
@@ -146,6 +172,52 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 	bool allowNullPartitionColumnValues = PG_GETARG_BOOL(7);
 	bool generateEmptyResults = PG_GETARG_BOOL(8);
 
+	/* result id of the join key filter to apply, older versions do not pass it */
+	char *joinKeyFilterResultId = NULL;
+	if (PG_NARGS() > 9)
+	{
+		joinKeyFilterResultId = text_to_cstring(PG_GETARG_TEXT_P(9));
+		if (joinKeyFilterResultId[0] == '\0')
+		{
+			joinKeyFilterResultId = NULL;
+		}
+	}
+
+	/* heavy hitters of the partition column, older versions do not pass them */
+	char *heavyHitterResultId = NULL;
+	bool replicateHeavyHitters = false;
+	if (PG_NARGS() > 13)
+	{
+		heavyHitterResultId = text_to_cstring(PG_GETARG_TEXT_P(12));
+		if (heavyHitterResultId[0] == '\0')
+		{
+			heavyHitterResultId = NULL;
+		}
+
+		replicateHeavyHitters = PG_GETARG_BOOL(13);
+	}
+
+	/* nodes to stream the partitions to, older versions do not pass them */
+	Datum *targetNodeNames = NULL;
+	Datum *targetNodePorts = NULL;
+	int targetNodeCount = 0;
+	if (PG_NARGS() > 11)
+	{
+		ArrayType *targetNodeNamesArray = PG_GETARG_ARRAYTYPE_P(10);
+		ArrayType *targetNodePortsArray = PG_GETARG_ARRAYTYPE_P(11);
+
+		targetNodeCount = ArrayObjectCount(targetNodeNamesArray);
+		if (ArrayObjectCount(targetNodePortsArray) != targetNodeCount)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("target node names and target node ports must "
+								   "have the same number of elements")));
+		}
+
+		targetNodeNames = DeconstructArrayObject(targetNodeNamesArray);
+		targetNodePorts = DeconstructArrayObject(targetNodePortsArray);
+	}
+
 	if (!IsMultiStatementTransaction())
 	{
 		ereport(ERROR, (errmsg("worker_partition_query_result can only be used in a "
@@ -177,6 +249,13 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 						errmsg("number of partitions cannot be 0")));
 	}
 
+	if (targetNodeCount > 0 && targetNodeCount != partitionCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("number of target nodes must match the number of "
+							   "partitions")));
+	}
+
 	/* start execution early in order to extract the tuple descriptor */
 	Portal portal = StartPortalForQueryExecution(queryString);
 
@@ -213,14 +292,43 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 
 	/* create all dest receivers */
 	DestReceiver **dests = palloc0(partitionCount * sizeof(DestReceiver *));
+	bool *streamedPartitions = palloc0(partitionCount * sizeof(bool));
 	for (int partitionIndex = 0; partitionIndex < partitionCount; partitionIndex++)
 	{
 		StringInfo resultId = makeStringInfo();
 		appendStringInfo(resultId, "%s_%d", resultIdPrefixString, partitionIndex);
-		char *filePath = QueryResultFileName(resultId->data);
-		DestReceiver *partitionDest = CreateFileDestReceiver(filePath, tupleContext,
-															 binaryCopy);
-		dests[partitionIndex] = partitionDest;
+
+		char *targetNodeName = NULL;
+		if (targetNodeCount > 0)
+		{
+			targetNodeName = TextDatumGetCString(targetNodeNames[partitionIndex]);
+		}
+
+		if (targetNodeName != NULL && targetNodeName[0] != '\0')
+		{
+			/*
+			 * Stream the partition to the node where it is needed. The remote
+			 * transaction needs to stay open until the end of our transaction,
+			 * since the result file is removed when it ends.
+			 */
+			UseCoordinatedTransaction();
+
+			WorkerNode *targetNode = palloc0(sizeof(WorkerNode));
+			strlcpy(targetNode->workerName, targetNodeName, WORKER_LENGTH);
+			targetNode->workerPort = DatumGetInt32(targetNodePorts[partitionIndex]);
+
+			bool writeLocalFile = false;
+			dests[partitionIndex] = CreateRemoteFileDestReceiver(resultId->data, estate,
+																 list_make1(targetNode),
+																 writeLocalFile);
+			streamedPartitions[partitionIndex] = true;
+		}
+		else
+		{
+			char *filePath = QueryResultFileName(resultId->data);
+			dests[partitionIndex] = CreateFileDestReceiver(filePath, tupleContext,
+														   binaryCopy);
+		}
 	}
 
 	/*
@@ -239,6 +347,34 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 		lazyStartup,
 		allowNullPartitionColumnValues);
 
+	if (heavyHitterResultId != NULL)
+	{
+		int heavyHitterCount = 0;
+		Datum *heavyHitterValues =
+			ReadRepartitionJoinHeavyHitters(heavyHitterResultId,
+											partitionColumnAttr->atttypid,
+											partitionColumnAttr->atttypmod,
+											&heavyHitterCount);
+		if (heavyHitterCount > 0)
+		{
+			SetPartitionedResultHeavyHitters(dest, heavyHitterValues, heavyHitterCount,
+											 partitionColumnAttr->atttypid,
+											 partitionColumnAttr->attcollation,
+											 replicateHeavyHitters);
+		}
+	}
+
+	if (joinKeyFilterResultId != NULL)
+	{
+		bytea *joinKeyFilter = ReadJoinKeyFilter(joinKeyFilterResultId);
+		if (joinKeyFilter != NULL)
+		{
+			/* skip rows that cannot find a join partner before partitioning */
+			dest = CreateJoinKeyFilterDestReceiver(dest, partitionColumnIndex,
+												   joinKeyFilter);
+		}
+	}
+
 	/* execute the query */
 	PortalRun(portal, FETCH_ALL, false, true, dest, dest, NULL);
 
@@ -256,7 +392,16 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 		Datum values[3];
 		bool nulls[3];
 
-		FileDestReceiverStats(dests[partitionIndex], &recordsWritten, &bytesWritten);
+		if (streamedPartitions[partitionIndex])
+		{
+			RemoteFileDestReceiverStats(dests[partitionIndex], &recordsWritten,
+										&bytesWritten);
+		}
+		else
+		{
+			FileDestReceiverStats(dests[partitionIndex], &recordsWritten,
+								  &bytesWritten);
+		}
 
 		memset(values, 0, sizeof(values));
 		memset(nulls, 0, sizeof(nulls));
@@ -427,6 +572,56 @@ CreatePartitionedResultDestReceiver(int partitionColumnIndex,
 }
 
 
+/*
+ * SetPartitionedResultHeavyHitters sets the heavy hitters of the partition
+ * column of a PartitionedResultDestReceiver. Rows whose partition column is
+ * a heavy hitter are spread across all partitions in a round-robin fashion
+ * or, if replicateHeavyHitters is set, sent to all partitions.
+ */
+void
+SetPartitionedResultHeavyHitters(DestReceiver *dest, Datum *heavyHitterValues,
+								 int heavyHitterCount, Oid typeId, Oid collation,
+								 bool replicateHeavyHitters)
+{
+	PartitionedResultDestReceiver *self = (PartitionedResultDestReceiver *) dest;
+
+	TypeCacheEntry *typeEntry = lookup_type_cache(typeId, TYPECACHE_EQ_OPR_FINFO);
+	if (!OidIsValid(typeEntry->eq_opr_finfo.fn_oid))
+	{
+		ereport(ERROR, (errmsg("could not identify an equality operator for type %s",
+							   format_type_be(typeId))));
+	}
+
+	self->heavyHitterEqualityFunction = palloc0(sizeof(FmgrInfo));
+	fmgr_info_copy(self->heavyHitterEqualityFunction, &(typeEntry->eq_opr_finfo),
+				   CurrentMemoryContext);
+	self->heavyHitterCollation = collation;
+
+	self->heavyHitterCount = heavyHitterCount;
+	self->heavyHitterValues = heavyHitterValues;
+	self->heavyHitterPartitions = palloc0(heavyHitterCount * sizeof(int));
+	self->partitionHasHeavyHitters = palloc0(self->partitionCount * sizeof(bool));
+	self->replicateHeavyHitters = replicateHeavyHitters;
+	self->nextSpreadPartitionIndex = 0;
+
+	for (int heavyHitterIndex = 0; heavyHitterIndex < heavyHitterCount;
+		 heavyHitterIndex++)
+	{
+		ShardInterval *shardInterval =
+			FindShardInterval(heavyHitterValues[heavyHitterIndex],
+							  self->shardSearchInfo);
+		if (shardInterval == NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("could not find shard for heavy hitter")));
+		}
+
+		self->heavyHitterPartitions[heavyHitterIndex] = shardInterval->shardIndex;
+		self->partitionHasHeavyHitters[shardInterval->shardIndex] = true;
+	}
+}
+
+
 /*
  * PartitionedResultDestReceiverStartup implements the rStartup interface of
  * PartitionedResultDestReceiver.
@@ -503,8 +698,70 @@ PartitionedResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 		}
 
 		partitionIndex = shardInterval->shardIndex;
+
+		if (self->partitionHasHeavyHitters != NULL &&
+			self->partitionHasHeavyHitters[partitionIndex] &&
+			IsHeavyHitter(self, partitionColumnValue, partitionIndex))
+		{
+			if (self->replicateHeavyHitters)
+			{
+				for (int targetIndex = 0; targetIndex < self->partitionCount;
+					 targetIndex++)
+				{
+					ForwardToPartition(self, slot, targetIndex);
+				}
+
+				return true;
+			}
+
+			partitionIndex = self->nextSpreadPartitionIndex;
+			self->nextSpreadPartitionIndex =
+				(self->nextSpreadPartitionIndex + 1) % self->partitionCount;
+		}
 	}
 
+	ForwardToPartition(self, slot, partitionIndex);
+
+	return true;
+}
+
+
+/*
+ * IsHeavyHitter returns whether the given partition column value, which hashes
+ * to the given partition, is one of the heavy hitters.
+ */
+static bool
+IsHeavyHitter(PartitionedResultDestReceiver *self, Datum value, int partitionIndex)
+{
+	for (int heavyHitterIndex = 0; heavyHitterIndex < self->heavyHitterCount;
+		 heavyHitterIndex++)
+	{
+		if (self->heavyHitterPartitions[heavyHitterIndex] != partitionIndex)
+		{
+			continue;
+		}
+
+		Datum isEqual = FunctionCall2Coll(self->heavyHitterEqualityFunction,
+										  self->heavyHitterCollation, value,
+										  self->heavyHitterValues[heavyHitterIndex]);
+		if (DatumGetBool(isEqual))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * ForwardToPartition forwards the tuple in the slot to the DestReceiver of the
+ * given partition, and starts the DestReceiver if that did not happen yet.
+ */
+static void
+ForwardToPartition(PartitionedResultDestReceiver *self, TupleTableSlot *slot,
+				   int partitionIndex)
+{
 	DestReceiver *partitionDest = self->partitionDestReceivers[partitionIndex];
 
 	/* check if this partitionDestReceiver has been started before, start if not */
@@ -519,8 +776,6 @@ PartitionedResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 
 	/* forward the tuple to the appropriate dest receiver */
 	partitionDest->receiveSlot(slot, partitionDest);
-
-	return true;
 }
 
 
@@ -0,0 +1,838 @@
+/*-------------------------------------------------------------------------
+ *
+ * query_result_cache.c
+ *
+ * Dashboards tend to send the same read-only multi-shard query every few
+ * seconds, and every run executes its tasks on all the workers again. When
+ * citus.query_result_cache_ttl is set, we keep the rows that the tasks of
+ * such queries returned in a per-backend cache, keyed by the user, the task
+ * queries, which include the shard names, and the parameters. A repeated
+ * query whose entry is still valid gets the cached rows instead of running
+ * the tasks, and the coordinator only runs the combine query on top of them.
+ *
+ * An entry is valid for citus.query_result_cache_ttl milliseconds, as long as
+ * the metadata did not change and none of the shards that the tasks read got
+ * modified. To learn about the latter, we keep an array of modification
+ * counters in shared memory, indexed by the shard id. Transactions remember
+ * the slots of the shards that they send DML or DDL to over a placement
+ * connection, via local execution or via local COPY, and advance the counters
+ * once their changes are visible on all the nodes. Entries remember the
+ * counters of the shards they read as of before the tasks ran, hence a
+ * modification that commits while the tasks run also invalidates the entry.
+ *
+ * Prepared transactions, which is how the transactions of other nodes that
+ * modify local shards commit, only become visible with COMMIT PREPARED. We
+ * keep their counters in shared memory, keyed by the GID, and advance them
+ * after COMMIT PREPARED. A transaction we did not track, for instance because
+ * it was prepared before the server started, advances all the counters.
+ *
+ * Writes that do not go through this node, like writes on other nodes with
+ * metadata or directly on the shards, do not advance the counters. For those
+ * the TTL bounds how stale the results can be.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "access/htup_details.h"
+#include "access/twophase.h"
+#include "access/xact.h"
+#include "common/hashfn.h"
+#include "executor/tuptable.h"
+#include "nodes/bitmapset.h"
+#include "optimizer/optimizer.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+#include "distributed/citus_safe_lib.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
+#include "distributed/query_result_cache.h"
+#include "distributed/transaction_management.h"
+
+
+/* number of shard modification counters, shards share them by shard id */
+#define SHARD_MODIFICATION_COUNTER_COUNT 4096
+
+/* number of words of a bitmap of modification counters */
+#define SHARD_MODIFICATION_COUNTER_WORDS (SHARD_MODIFICATION_COUNTER_COUNT / 64)
+
+
+/*
+ * PreparedModificationSlot holds the modification counters of the shards that
+ * a prepared transaction modified, until COMMIT PREPARED or ROLLBACK PREPARED.
+ */
+typedef struct PreparedModificationSlot
+{
+	bool inUse;
+	char gid[GIDSIZE];
+	uint64 modifiedCounters[SHARD_MODIFICATION_COUNTER_WORDS];
+} PreparedModificationSlot;
+
+
+/*
+ * QueryResultCacheControlData holds the shard modification counters and the
+ * prepared transactions that modified shards.
+ */
+typedef struct QueryResultCacheControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+
+	/* protects the prepared transaction slots */
+	LWLock lock;
+
+	pg_atomic_uint64 modificationCounters[SHARD_MODIFICATION_COUNTER_COUNT];
+
+	int preparedSlotCount;
+	PreparedModificationSlot preparedSlots[FLEXIBLE_ARRAY_MEMBER];
+} QueryResultCacheControlData;
+
+
+/*
+ * QueryResultCacheState is the part of a cache entry that we determine before
+ * the tasks run, namely its key and the modification counters of the shards.
+ */
+struct QueryResultCacheState
+{
+	uint64 keyHash;
+	char *queryKey;
+	uint64 metadataGeneration;
+	int counterCount;
+	int *counterIndexes;
+	uint64 *counterValues;
+};
+
+
+/*
+ * QueryResultCacheEntry is a cached query result. Everything it points to is
+ * allocated in its own memory context.
+ */
+typedef struct QueryResultCacheEntry
+{
+	uint64 keyHash;
+	MemoryContext entryContext;
+	QueryResultCacheState *state;
+	TimestampTz storedAt;
+	List *tupleList;
+	Size size;
+} QueryResultCacheEntry;
+
+
+/* GUC, milliseconds for which query results are cached, 0 to disable */
+int QueryResultCacheTTL = 0;
+
+/* GUC, maximum size of the cached query results of a backend in kB */
+int QueryResultCacheSize = 16384;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static QueryResultCacheControlData *QueryResultCacheControl = NULL;
+
+/* counters of the shards that the transaction modified, in TopTransactionContext */
+static Bitmapset *ModifiedShardCounters = NULL;
+
+/* GID of the PREPARE TRANSACTION command of the current transaction, if any */
+static char PreparingTransactionGid[GIDSIZE] = "";
+
+static HTAB *QueryResultCache = NULL;
+static MemoryContext QueryResultCacheContext = NULL;
+static Size QueryResultCacheTotalSize = 0;
+
+static char * QueryResultCacheKey(List *taskList, ParamListInfo paramListInfo);
+static QueryResultCacheState * CreateQueryResultCacheState(List *taskList,
+														   char *queryKey,
+														   uint64 keyHash);
+static bool QueryResultCacheEntryIsValid(QueryResultCacheEntry *entry);
+static void RemoveQueryResultCacheEntry(QueryResultCacheEntry *entry);
+static void RemoveStaleQueryResultCacheEntries(void);
+static uint64 ShardModificationCounter(int counterIndex);
+static void AdvanceShardModificationCounter(int counterIndex);
+
+
+/*
+ * InitializeQueryResultCache requests the shared memory for the shard
+ * modification counters and sets up its initialization.
+ */
+void
+InitializeQueryResultCache(void)
+{
+	/* On PG 15 and above, we use shmem_request_hook_type */
+	#if PG_VERSION_NUM < PG_VERSION_15
+
+	/* allocate shared memory for pre PG-15 versions */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(QueryResultCacheShmemSize());
+	}
+
+	#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = QueryResultCacheShmemInit;
+}
+
+
+/*
+ * QueryResultCacheShmemSize returns the size of the shared memory used for
+ * the shard modification counters.
+ */
+size_t
+QueryResultCacheShmemSize(void)
+{
+	Size size = offsetof(QueryResultCacheControlData, preparedSlots);
+
+	return add_size(size, mul_size(max_prepared_xacts,
+								   sizeof(PreparedModificationSlot)));
+}
+
+
+/*
+ * QueryResultCacheShmemInit initializes the shard modification counters.
+ */
+void
+QueryResultCacheShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	QueryResultCacheControl =
+		(QueryResultCacheControlData *) ShmemInitStruct(
+			"Citus Query Result Cache", QueryResultCacheShmemSize(),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		QueryResultCacheControl->trancheId = LWLockNewTrancheId();
+		QueryResultCacheControl->lockTrancheName = "Citus Query Result Cache";
+		LWLockRegisterTranche(QueryResultCacheControl->trancheId,
+							  QueryResultCacheControl->lockTrancheName);
+
+		LWLockInitialize(&QueryResultCacheControl->lock,
+						 QueryResultCacheControl->trancheId);
+
+		QueryResultCacheControl->preparedSlotCount = max_prepared_xacts;
+		memset(QueryResultCacheControl->preparedSlots, 0,
+			   max_prepared_xacts * sizeof(PreparedModificationSlot));
+
+		for (int counterIndex = 0; counterIndex < SHARD_MODIFICATION_COUNTER_COUNT;
+			 counterIndex++)
+		{
+			pg_atomic_init_u64(&QueryResultCacheControl->modificationCounters[
+								   counterIndex], 0);
+		}
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * RecordShardModification remembers that the current transaction modifies
+ * the given shard, such that committing it invalidates the cached results
+ * that read the shard. We do this regardless of whether the current backend
+ * caches results, since other backends might.
+ */
+void
+RecordShardModification(uint64 shardId)
+{
+	if (shardId == INVALID_SHARD_ID || !IsTransactionState())
+	{
+		return;
+	}
+
+	int counterIndex = (int) (shardId % SHARD_MODIFICATION_COUNTER_COUNT);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+	ModifiedShardCounters = bms_add_member(ModifiedShardCounters, counterIndex);
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * QueryResultCacheAtCommit advances the modification counters of the shards
+ * that the committed transaction modified. It is called once the changes are
+ * visible on all the nodes.
+ */
+void
+QueryResultCacheAtCommit(void)
+{
+	if (QueryResultCacheControl != NULL)
+	{
+		int counterIndex = -1;
+		while ((counterIndex = bms_next_member(ModifiedShardCounters,
+											   counterIndex)) >= 0)
+		{
+			AdvanceShardModificationCounter(counterIndex);
+		}
+	}
+
+	/* the bitmapset goes away with TopTransactionContext */
+	ModifiedShardCounters = NULL;
+	PreparingTransactionGid[0] = '\0';
+}
+
+
+/*
+ * QueryResultCacheAtPrepare keeps the modification counters of the shards
+ * that the prepared transaction modified in shared memory, such that COMMIT
+ * PREPARED advances them. If there is no slot left, the transaction is not
+ * tracked, and committing it advances all the counters.
+ */
+void
+QueryResultCacheAtPrepare(void)
+{
+	if (QueryResultCacheControl != NULL && PreparingTransactionGid[0] != '\0')
+	{
+		LWLockAcquire(&QueryResultCacheControl->lock, LW_EXCLUSIVE);
+
+		for (int slotIndex = 0; slotIndex < QueryResultCacheControl->preparedSlotCount;
+			 slotIndex++)
+		{
+			PreparedModificationSlot *slot =
+				&QueryResultCacheControl->preparedSlots[slotIndex];
+
+			if (slot->inUse)
+			{
+				continue;
+			}
+
+			slot->inUse = true;
+			strlcpy(slot->gid, PreparingTransactionGid, GIDSIZE);
+			memset(slot->modifiedCounters, 0, sizeof(slot->modifiedCounters));
+
+			int counterIndex = -1;
+			while ((counterIndex = bms_next_member(ModifiedShardCounters,
+												   counterIndex)) >= 0)
+			{
+				slot->modifiedCounters[counterIndex / 64] |=
+					UINT64CONST(1) << (counterIndex % 64);
+			}
+
+			break;
+		}
+
+		LWLockRelease(&QueryResultCacheControl->lock);
+	}
+
+	ModifiedShardCounters = NULL;
+	PreparingTransactionGid[0] = '\0';
+}
+
+
+/*
+ * QueryResultCacheAtAbort forgets the shards that an aborted transaction
+ * modified.
+ */
+void
+QueryResultCacheAtAbort(void)
+{
+	ModifiedShardCounters = NULL;
+	PreparingTransactionGid[0] = '\0';
+}
+
+
+/*
+ * QueryResultCacheBeforePrepare remembers the GID of a PREPARE TRANSACTION
+ * command, to track the modified shards once the transaction is prepared.
+ */
+void
+QueryResultCacheBeforePrepare(const char *gid)
+{
+	strlcpy(PreparingTransactionGid, gid, GIDSIZE);
+}
+
+
+/*
+ * QueryResultCacheAfterFinishPrepared stops tracking a prepared transaction
+ * after COMMIT PREPARED or ROLLBACK PREPARED, and advances the modification
+ * counters of the shards that a committed transaction modified, or all of
+ * them if the transaction was not tracked.
+ */
+void
+QueryResultCacheAfterFinishPrepared(const char *gid, bool isCommit)
+{
+	uint64 modifiedCounters[SHARD_MODIFICATION_COUNTER_WORDS];
+	bool tracked = false;
+
+	if (QueryResultCacheControl == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&QueryResultCacheControl->lock, LW_EXCLUSIVE);
+
+	for (int slotIndex = 0; slotIndex < QueryResultCacheControl->preparedSlotCount;
+		 slotIndex++)
+	{
+		PreparedModificationSlot *slot =
+			&QueryResultCacheControl->preparedSlots[slotIndex];
+
+		if (slot->inUse && strncmp(slot->gid, gid, GIDSIZE) == 0)
+		{
+			memcpy_s(modifiedCounters, sizeof(modifiedCounters),
+					 slot->modifiedCounters, sizeof(slot->modifiedCounters));
+			slot->inUse = false;
+			tracked = true;
+			break;
+		}
+	}
+
+	LWLockRelease(&QueryResultCacheControl->lock);
+
+	if (!isCommit)
+	{
+		return;
+	}
+
+	for (int counterIndex = 0; counterIndex < SHARD_MODIFICATION_COUNTER_COUNT;
+		 counterIndex++)
+	{
+		uint64 counterBit = UINT64CONST(1) << (counterIndex % 64);
+
+		if (!tracked || (modifiedCounters[counterIndex / 64] & counterBit) != 0)
+		{
+			AdvanceShardModificationCounter(counterIndex);
+		}
+	}
+}
+
+
+/*
+ * ShouldCacheQueryResult returns whether the results of the tasks of the
+ * given plan may be served from, and stored in, the query result cache.
+ */
+bool
+ShouldCacheQueryResult(DistributedPlan *distributedPlan)
+{
+	if (QueryResultCacheTTL <= 0 || QueryResultCacheSize <= 0)
+	{
+		return false;
+	}
+
+	/* transactions should see their own writes and keep their snapshot */
+	if (IsTransactionBlock() || InCoordinatedTransaction() ||
+		DoBlockLevel > 0 || StoredProcedureLevel > 0 || MaybeExecutingUDF())
+	{
+		return false;
+	}
+
+	Job *workerJob = distributedPlan->workerJob;
+
+	if (distributedPlan->modLevel != ROW_MODIFY_READONLY ||
+		distributedPlan->insertSelectQuery != NULL ||
+		distributedPlan->subPlanList != NIL ||
+		distributedPlan->sortedMergeClauseList != NIL ||
+		workerJob == NULL || workerJob->jobQuery == NULL ||
+		workerJob->dependentJobList != NIL)
+	{
+		return false;
+	}
+
+	/* volatile functions should be evaluated for every run */
+	if (contain_volatile_functions((Node *) workerJob->jobQuery))
+	{
+		return false;
+	}
+
+	Task *task = NULL;
+	foreach_ptr(task, workerJob->taskList)
+	{
+		int taskQueryType = GetTaskQueryType(task);
+
+		if (task->taskType != READ_TASK ||
+			(taskQueryType != TASK_QUERY_TEXT && taskQueryType != TASK_QUERY_OBJECT))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * LookupQueryResultCache returns a tuple store with the cached results of the
+ * given tasks, or NULL if there are none. In the latter case, it sets
+ * cacheState to what StoreQueryResult needs to cache the results once the
+ * tasks ran.
+ */
+Tuplestorestate *
+LookupQueryResultCache(List *taskList, ParamListInfo paramListInfo,
+					   TupleDesc tupleDescriptor, QueryResultCacheState **cacheState)
+{
+	if (QueryResultCache == NULL)
+	{
+		QueryResultCacheContext = AllocSetContextCreate(CacheMemoryContext,
+														"QueryResultCache",
+														ALLOCSET_DEFAULT_SIZES);
+
+		HASHCTL info;
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(uint64);
+		info.entrysize = sizeof(QueryResultCacheEntry);
+		info.hcxt = QueryResultCacheContext;
+		uint32 hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		QueryResultCache = hash_create("citus query result cache", 32, &info,
+									   hashFlags);
+	}
+
+	char *queryKey = QueryResultCacheKey(taskList, paramListInfo);
+	uint64 keyHash = hash_bytes_extended((unsigned char *) queryKey,
+										 strlen(queryKey), 0);
+
+	bool found = false;
+	QueryResultCacheEntry *entry = hash_search(QueryResultCache, &keyHash, HASH_FIND,
+											   &found);
+	if (found && strcmp(entry->state->queryKey, queryKey) == 0 &&
+		QueryResultCacheEntryIsValid(entry))
+	{
+		bool randomAccess = true;
+		bool interTransactions = false;
+		Tuplestorestate *tupleStore = tuplestore_begin_heap(randomAccess,
+															interTransactions,
+															work_mem);
+		TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor,
+														&TTSOpsMinimalTuple);
+
+		MinimalTuple tuple = NULL;
+		foreach_ptr(tuple, entry->tupleList)
+		{
+			ExecStoreMinimalTuple(tuple, slot, false);
+			tuplestore_puttupleslot(tupleStore, slot);
+		}
+
+		ExecDropSingleTupleTableSlot(slot);
+
+		*cacheState = NULL;
+		return tupleStore;
+	}
+
+	/* read the counters before the tasks run, such that we miss no write */
+	*cacheState = CreateQueryResultCacheState(taskList, queryKey, keyHash);
+	return NULL;
+}
+
+
+/*
+ * StoreQueryResult adds the results in the given tuple store, which the scan
+ * did not read yet, to the query result cache if they fit.
+ */
+void
+StoreQueryResult(QueryResultCacheState *cacheState, Tuplestorestate *tupleStore,
+				 TupleDesc tupleDescriptor)
+{
+	Size maxSize = QueryResultCacheSize * 1024L;
+
+	MemoryContext entryContext = AllocSetContextCreate(QueryResultCacheContext,
+													   "QueryResultCacheEntry",
+													   ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(entryContext);
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor,
+													&TTSOpsMinimalTuple);
+	List *tupleList = NIL;
+	Size size = strlen(cacheState->queryKey);
+	bool fits = true;
+
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		bool shouldFree = false;
+		MinimalTuple tuple = ExecFetchSlotMinimalTuple(slot, &shouldFree);
+
+		size += tuple->t_len;
+		if (size > maxSize)
+		{
+			fits = false;
+			break;
+		}
+
+		tupleList = lappend(tupleList, heap_copy_minimal_tuple(tuple));
+
+		if (shouldFree)
+		{
+			pfree(tuple);
+		}
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+
+	/* the scan reads the results from the start */
+	tuplestore_rescan(tupleStore);
+
+	if (!fits)
+	{
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextDelete(entryContext);
+		return;
+	}
+
+	QueryResultCacheState *state = palloc0(sizeof(QueryResultCacheState));
+	*state = *cacheState;
+	state->queryKey = pstrdup(cacheState->queryKey);
+	state->counterIndexes = palloc0(Max(cacheState->counterCount, 1) * sizeof(int));
+	state->counterValues = palloc0(Max(cacheState->counterCount, 1) * sizeof(uint64));
+
+	for (int counterIndex = 0; counterIndex < cacheState->counterCount; counterIndex++)
+	{
+		state->counterIndexes[counterIndex] = cacheState->counterIndexes[counterIndex];
+		state->counterValues[counterIndex] = cacheState->counterValues[counterIndex];
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	bool found = false;
+	QueryResultCacheEntry *entry = hash_search(QueryResultCache, &state->keyHash,
+											   HASH_FIND, &found);
+	if (found)
+	{
+		RemoveQueryResultCacheEntry(entry);
+	}
+
+	if (QueryResultCacheTotalSize + size > maxSize)
+	{
+		RemoveStaleQueryResultCacheEntries();
+
+		if (QueryResultCacheTotalSize + size > maxSize)
+		{
+			MemoryContextDelete(entryContext);
+			return;
+		}
+	}
+
+	entry = hash_search(QueryResultCache, &state->keyHash, HASH_ENTER, &found);
+	entry->entryContext = entryContext;
+	entry->state = state;
+	entry->storedAt = GetCurrentTimestamp();
+	entry->tupleList = tupleList;
+	entry->size = size;
+
+	QueryResultCacheTotalSize += size;
+}
+
+
+/*
+ * QueryResultCacheKey returns the key of the results of the given tasks,
+ * which consists of the user, the queries of the tasks and the parameters.
+ */
+static char *
+QueryResultCacheKey(List *taskList, ParamListInfo paramListInfo)
+{
+	StringInfo queryKey = makeStringInfo();
+
+	appendStringInfo(queryKey, "%u", GetUserId());
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		appendStringInfo(queryKey, "|" UINT64_FORMAT ":%s", task->anchorShardId,
+						 TaskQueryString(task));
+	}
+
+	if (paramListInfo != NULL && paramListInfo->numParams > 0)
+	{
+		Oid *parameterTypes = NULL;
+		const char **parameterValues = NULL;
+
+		ExtractParametersFromParamList(paramListInfo, &parameterTypes,
+									   &parameterValues, false);
+
+		for (int paramIndex = 0; paramIndex < paramListInfo->numParams; paramIndex++)
+		{
+			if (parameterValues[paramIndex] == NULL)
+			{
+				appendStringInfo(queryKey, "|%u:n", parameterTypes[paramIndex]);
+			}
+			else
+			{
+				appendStringInfo(queryKey, "|%u:v%s", parameterTypes[paramIndex],
+								 parameterValues[paramIndex]);
+			}
+		}
+	}
+
+	return queryKey->data;
+}
+
+
+/*
+ * CreateQueryResultCacheState returns the state of a new cache entry for the
+ * given tasks, with the current modification counters of the shards that
+ * they read.
+ */
+static QueryResultCacheState *
+CreateQueryResultCacheState(List *taskList, char *queryKey, uint64 keyHash)
+{
+	Bitmapset *counterSet = NULL;
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (task->anchorShardId != INVALID_SHARD_ID)
+		{
+			counterSet = bms_add_member(counterSet,
+										(int) (task->anchorShardId %
+											   SHARD_MODIFICATION_COUNTER_COUNT));
+		}
+
+		RelationShard *relationShard = NULL;
+		foreach_ptr(relationShard, task->relationShardList)
+		{
+			if (relationShard->shardId != INVALID_SHARD_ID)
+			{
+				counterSet = bms_add_member(counterSet,
+											(int) (relationShard->shardId %
+												   SHARD_MODIFICATION_COUNTER_COUNT));
+			}
+		}
+	}
+
+	QueryResultCacheState *cacheState = palloc0(sizeof(QueryResultCacheState));
+	cacheState->keyHash = keyHash;
+	cacheState->queryKey = queryKey;
+	cacheState->metadataGeneration = MetadataCacheGeneration();
+	cacheState->counterCount = bms_num_members(counterSet);
+	cacheState->counterIndexes = palloc0(Max(cacheState->counterCount, 1) * sizeof(int));
+	cacheState->counterValues = palloc0(Max(cacheState->counterCount, 1) *
+										sizeof(uint64));
+
+	int stateIndex = 0;
+	int counterIndex = -1;
+	while ((counterIndex = bms_next_member(counterSet, counterIndex)) >= 0)
+	{
+		cacheState->counterIndexes[stateIndex] = counterIndex;
+		cacheState->counterValues[stateIndex] = ShardModificationCounter(counterIndex);
+		stateIndex++;
+	}
+
+	return cacheState;
+}
+
+
+/*
+ * QueryResultCacheEntryIsValid returns whether the given entry did not expire
+ * and neither the metadata nor the shards that it read changed.
+ */
+static bool
+QueryResultCacheEntryIsValid(QueryResultCacheEntry *entry)
+{
+	QueryResultCacheState *state = entry->state;
+
+	if (TimestampDifferenceExceeds(entry->storedAt, GetCurrentTimestamp(),
+								   QueryResultCacheTTL))
+	{
+		return false;
+	}
+
+	if (state->metadataGeneration != MetadataCacheGeneration())
+	{
+		return false;
+	}
+
+	for (int stateIndex = 0; stateIndex < state->counterCount; stateIndex++)
+	{
+		if (state->counterValues[stateIndex] !=
+			ShardModificationCounter(state->counterIndexes[stateIndex]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * RemoveQueryResultCacheEntry removes the given entry from the cache and
+ * frees its memory.
+ */
+static void
+RemoveQueryResultCacheEntry(QueryResultCacheEntry *entry)
+{
+	uint64 keyHash = entry->keyHash;
+
+	QueryResultCacheTotalSize -= entry->size;
+	MemoryContextDelete(entry->entryContext);
+
+	hash_search(QueryResultCache, &keyHash, HASH_REMOVE, NULL);
+}
+
+
+/*
+ * RemoveStaleQueryResultCacheEntries removes the entries that are no longer
+ * valid, and all entries if that does not free any memory.
+ */
+static void
+RemoveStaleQueryResultCacheEntries(void)
+{
+	Size sizeBefore = QueryResultCacheTotalSize;
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		HASH_SEQ_STATUS status;
+		QueryResultCacheEntry *entry = NULL;
+
+		hash_seq_init(&status, QueryResultCache);
+		while ((entry = hash_seq_search(&status)) != NULL)
+		{
+			if (pass == 1 || !QueryResultCacheEntryIsValid(entry))
+			{
+				/* removing the current entry during a scan is allowed */
+				RemoveQueryResultCacheEntry(entry);
+			}
+		}
+
+		if (QueryResultCacheTotalSize < sizeBefore)
+		{
+			break;
+		}
+	}
+}
+
+
+/*
+ * ShardModificationCounter returns the current value of the given shard
+ * modification counter.
+ */
+static uint64
+ShardModificationCounter(int counterIndex)
+{
+	if (QueryResultCacheControl == NULL)
+	{
+		return 0;
+	}
+
+	return pg_atomic_read_u64(
+		&QueryResultCacheControl->modificationCounters[counterIndex]);
+}
+
+
+/*
+ * AdvanceShardModificationCounter advances the given shard modification
+ * counter, which invalidates the cached results that read its shards.
+ */
+static void
+AdvanceShardModificationCounter(int counterIndex)
+{
+	pg_atomic_fetch_add_u64(
+		&QueryResultCacheControl->modificationCounters[counterIndex], 1);
+}
@@ -20,6 +20,7 @@
 #include "access/hash.h"
 #include "catalog/pg_authid.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/connection_management.h"
 #include "distributed/function_utils.h"
 #include "distributed/hash_helpers.h"
 #include "distributed/multi_executor.h"
@@ -44,6 +45,9 @@
 #define CITUS_STAT_STATAMENTS_EXECUTOR_TYPE 3
 #define CITUS_STAT_STATAMENTS_PARTITION_KEY 4
 #define CITUS_STAT_STATAMENTS_CALLS 5
+#define CITUS_QUERY_TASK_TIMINGS_COLS 14
+#define CITUS_QUERY_PLANNER_TIMINGS_COLS 9
+#define CITUS_WORKER_QUERY_STATS_COLS 9
 
 
 #define USAGE_DECREASE_FACTOR (0.99)    /* decreased every CitusQueryStatsEntryDealloc */
@@ -61,6 +65,21 @@ int StatStatementsPurgeInterval = 10;
 /* maximum number of entries in queryStats hash, controlled by GUC citus.stat_statements_max */
 int StatStatementsMax = 50000;
 
+/*
+ * maximum number of entries in taskTimings hash, controlled by GUC
+ * citus.stat_statements_task_timings_max
+ */
+int StatStatementsTaskTimingsMax = 5000;
+
+/*
+ * maximum number of entries in workerQueryStats hash, controlled by GUC
+ * citus.stat_statements_worker_max
+ */
+int StatStatementsWorkerMax = 5000;
+
+/* whether the query identifiers of distributed queries are sent to the workers */
+bool StatStatementsTrackWorkers = false;
+
 /* tracking all or none, for citus_stat_statements, controlled by GUC citus.stat_statements_track */
 int StatStatementsTrack = STAT_STATEMENTS_TRACK_NONE;
 
@@ -97,6 +116,79 @@ typedef struct QueryStatsSharedState
 	double cur_median_usage;            /* current median usage in hashtable */
 } QueryStatsSharedState;
 
+/*
+ * Hashtable key of the task timings of a query on a worker. The key is
+ * compared as a blob, so unused bytes of nodeName must be zero.
+ */
+typedef struct TaskTimingsHashKey
+{
+	Oid userid;                     /* user OID */
+	Oid dbid;                       /* database OID */
+	uint64 queryid;                 /* query identifier */
+	char nodeName[MAX_NODE_LENGTH];
+	int32 nodePort;
+} TaskTimingsHashKey;
+
+/*
+ * Histograms of the durations of the phases of the tasks of a query on a worker
+ */
+typedef struct TaskTimingsEntry
+{
+	TaskTimingsHashKey key;        /* hash key of entry - MUST BE FIRST */
+	TaskTimingHistogram histogram;
+	slock_t mutex;                 /* protects the histogram only */
+} TaskTimingsEntry;
+
+/*
+ * Hashtable key of the planner timings of a query. The key is compared as a
+ * blob, so padding bytes must be zero.
+ */
+typedef struct PlannerTimingsHashKey
+{
+	Oid userid;                     /* user OID */
+	Oid dbid;                       /* database OID */
+	uint64 queryid;                 /* query identifier */
+} PlannerTimingsHashKey;
+
+/*
+ * Time spent in the phases of the distributed planning of a query
+ */
+typedef struct PlannerTimingsEntry
+{
+	PlannerTimingsHashKey key;        /* hash key of entry - MUST BE FIRST */
+	int64 plans;                      /* # of times planned */
+	PlannerPhaseTimings totalTimings; /* sum of the timings of all plans */
+	slock_t mutex;                    /* protects the counters only */
+} PlannerTimingsEntry;
+
+/*
+ * Hashtable key of the statistics of the executions of the tasks of a
+ * distributed query on this node. The query identifier is the one of the
+ * distributed query on the coordinator. The key is compared as a blob, so
+ * padding bytes must be zero.
+ */
+typedef struct WorkerQueryStatsHashKey
+{
+	Oid userid;                     /* user OID */
+	Oid dbid;                       /* database OID */
+	uint64 queryid;                 /* query identifier on the coordinator */
+} WorkerQueryStatsHashKey;
+
+/*
+ * Statistics of the executions of the tasks of a distributed query on this node
+ */
+typedef struct WorkerQueryStatsEntry
+{
+	WorkerQueryStatsHashKey key;   /* hash key of entry - MUST BE FIRST */
+	int64 calls;                   /* # of tasks executed */
+	double totalTime;              /* total execution time, in msec */
+	int64 rows;                    /* total # of retrieved or affected rows */
+	int64 sharedBlksHit;           /* # of shared buffer hits */
+	int64 sharedBlksRead;          /* # of shared disk blocks read */
+	int64 sharedBlksWritten;       /* # of shared disk blocks written */
+	slock_t mutex;                 /* protects the counters only */
+} WorkerQueryStatsEntry;
+
 /* lookup table for existing pg_stat_statements entries */
 typedef struct ExistingStatsHashKey
 {
@@ -111,6 +203,9 @@ static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 /* Links to shared memory state */
 static QueryStatsSharedState *queryStats = NULL;
 static HTAB *queryStatsHash = NULL;
+static HTAB *taskTimingsHash = NULL;
+static HTAB *plannerTimingsHash = NULL;
+static HTAB *workerQueryStatsHash = NULL;
 
 /*--- Functions --- */
 
@@ -119,6 +214,9 @@ Datum citus_query_stats(PG_FUNCTION_ARGS);
 
 PG_FUNCTION_INFO_V1(citus_stat_statements_reset);
 PG_FUNCTION_INFO_V1(citus_query_stats);
+PG_FUNCTION_INFO_V1(citus_query_task_timings);
+PG_FUNCTION_INFO_V1(citus_query_planner_timings);
+PG_FUNCTION_INFO_V1(citus_worker_query_stats);
 PG_FUNCTION_INFO_V1(citus_executor_name);
 
 
@@ -136,6 +234,8 @@ static int CitusQuerysStatsMatchFn(const void *key1, const void *key2, Size keys
 static HTAB * BuildExistingQueryIdHash(void);
 static int GetPGStatStatementsMax(void);
 static void CitusQueryStatsRemoveExpiredEntries(HTAB *existingQueryIdHash);
+static double TaskTimingPercentile(TaskTimingHistogram *histogram, TaskTimingPhase phase,
+								   double fraction);
 
 void
 InitializeCitusQueryStats(void)
@@ -199,6 +299,38 @@ CitusQueryStatsShmemStartup(void)
 								   &info,
 								   HASH_ELEM | HASH_FUNCTION | HASH_COMPARE);
 
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(TaskTimingsHashKey);
+	info.entrysize = sizeof(TaskTimingsEntry);
+
+	/* allocate task timings shared memory hash, protected by the same lock */
+	taskTimingsHash = ShmemInitHash("citus_query_task_timings hash",
+									StatStatementsTaskTimingsMax,
+									StatStatementsTaskTimingsMax,
+									&info,
+									HASH_ELEM | HASH_BLOBS);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(PlannerTimingsHashKey);
+	info.entrysize = sizeof(PlannerTimingsEntry);
+
+	/* allocate planner timings shared memory hash, protected by the same lock */
+	plannerTimingsHash = ShmemInitHash("citus_query_planner_timings hash",
+									   StatStatementsMax, StatStatementsMax,
+									   &info,
+									   HASH_ELEM | HASH_BLOBS);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(WorkerQueryStatsHashKey);
+	info.entrysize = sizeof(WorkerQueryStatsEntry);
+
+	/* allocate worker query stats shared memory hash, protected by the same lock */
+	workerQueryStatsHash = ShmemInitHash("citus_worker_query_stats hash",
+										 StatStatementsWorkerMax,
+										 StatStatementsWorkerMax,
+										 &info,
+										 HASH_ELEM | HASH_BLOBS);
+
 	LWLockRelease(AddinShmemInitLock);
 
 	if (!IsUnderPostmaster)
@@ -385,6 +517,12 @@ CitusQueryStatsSharedMemSize(void)
 
 	Size size = MAXALIGN(sizeof(QueryStatsSharedState));
 	size = add_size(size, hash_estimate_size(StatStatementsMax, sizeof(QueryStatsEntry)));
+	size = add_size(size, hash_estimate_size(StatStatementsTaskTimingsMax,
+											 sizeof(TaskTimingsEntry)));
+	size = add_size(size, hash_estimate_size(StatStatementsMax,
+											 sizeof(PlannerTimingsEntry)));
+	size = add_size(size, hash_estimate_size(StatStatementsWorkerMax,
+											 sizeof(WorkerQueryStatsEntry)));
 
 	return size;
 }
@@ -596,6 +734,31 @@ CitusQueryStatsEntryReset(void)
 		hash_search(queryStatsHash, &entry->key, HASH_REMOVE, NULL);
 	}
 
+	TaskTimingsEntry *taskTimingsEntry = NULL;
+
+	hash_seq_init(&hash_seq, taskTimingsHash);
+	while ((taskTimingsEntry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		hash_search(taskTimingsHash, &taskTimingsEntry->key, HASH_REMOVE, NULL);
+	}
+
+	PlannerTimingsEntry *plannerTimingsEntry = NULL;
+
+	hash_seq_init(&hash_seq, plannerTimingsHash);
+	while ((plannerTimingsEntry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		hash_search(plannerTimingsHash, &plannerTimingsEntry->key, HASH_REMOVE, NULL);
+	}
+
+	WorkerQueryStatsEntry *workerQueryStatsEntry = NULL;
+
+	hash_seq_init(&hash_seq, workerQueryStatsHash);
+	while ((workerQueryStatsEntry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		hash_search(workerQueryStatsHash, &workerQueryStatsEntry->key, HASH_REMOVE,
+					NULL);
+	}
+
 	LWLockRelease(queryStats->lock);
 }
 
@@ -766,6 +929,602 @@ citus_query_stats(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * AddTaskTimingToHistogram counts the duration of a phase of a task in the
+ * corresponding bucket of the histogram.
+ */
+void
+AddTaskTimingToHistogram(TaskTimingHistogram *histogram, TaskTimingPhase phase,
+						 uint64 durationMicrosecs)
+{
+	int bucketIndex = 0;
+
+	while (durationMicrosecs > 1 && bucketIndex < TASK_TIMING_HISTOGRAM_BUCKETS - 1)
+	{
+		durationMicrosecs >>= 1;
+		bucketIndex++;
+	}
+
+	histogram->bucketCounts[phase][bucketIndex]++;
+}
+
+
+/*
+ * CitusQueryStatsTaskTimingsEntry adds the task timings of an execution of the
+ * given query on the given worker to the shared task timings of the query and
+ * worker. If the hash is full, the timings of new query and worker combinations
+ * are not tracked until entries are removed along with their pg_stat_statements
+ * entries.
+ */
+void
+CitusQueryStatsTaskTimingsEntry(uint64 queryId, const char *nodeName, int nodePort,
+								TaskTimingHistogram *histogram)
+{
+	TaskTimingsHashKey key;
+
+	/* Safety check... */
+	if (!queryStats || !taskTimingsHash)
+	{
+		return;
+	}
+
+	/* early return if tracking is disabled */
+	if (!StatStatementsTrack)
+	{
+		return;
+	}
+
+	/* Set up key for hashtable search, unused bytes are part of the key */
+	memset(&key, 0, sizeof(key));
+	key.userid = GetUserId();
+	key.dbid = MyDatabaseId;
+	key.queryid = queryId;
+	strlcpy(key.nodeName, nodeName, MAX_NODE_LENGTH);
+	key.nodePort = nodePort;
+
+	/* Lookup the hash table entry with shared lock. */
+	LWLockAcquire(queryStats->lock, LW_SHARED);
+
+	TaskTimingsEntry *entry = (TaskTimingsEntry *) hash_search(taskTimingsHash, &key,
+															   HASH_FIND, NULL);
+
+	/* Create new entry, if not present */
+	if (!entry)
+	{
+		/* Need exclusive lock to make a new hashtable entry - promote */
+		LWLockRelease(queryStats->lock);
+		LWLockAcquire(queryStats->lock, LW_EXCLUSIVE);
+
+		bool found = false;
+
+		entry = (TaskTimingsEntry *) hash_search(taskTimingsHash, &key, HASH_FIND,
+												 &found);
+		if (!found)
+		{
+			if (hash_get_num_entries(taskTimingsHash) >= StatStatementsTaskTimingsMax)
+			{
+				LWLockRelease(queryStats->lock);
+				return;
+			}
+
+			entry = (TaskTimingsEntry *) hash_search(taskTimingsHash, &key,
+													 HASH_ENTER, &found);
+			memset(&entry->histogram, 0, sizeof(TaskTimingHistogram));
+			SpinLockInit(&entry->mutex);
+		}
+	}
+
+	volatile TaskTimingsEntry *e = (volatile TaskTimingsEntry *) entry;
+
+	SpinLockAcquire(&e->mutex);
+
+	e->histogram.taskCount += histogram->taskCount;
+
+	for (int phase = 0; phase < TASK_TIMING_PHASE_COUNT; phase++)
+	{
+		for (int bucketIndex = 0; bucketIndex < TASK_TIMING_HISTOGRAM_BUCKETS;
+			 bucketIndex++)
+		{
+			e->histogram.bucketCounts[phase][bucketIndex] +=
+				histogram->bucketCounts[phase][bucketIndex];
+		}
+	}
+
+	SpinLockRelease(&e->mutex);
+
+	LWLockRelease(queryStats->lock);
+}
+
+
+/*
+ * TaskTimingPercentile returns an approximation of the given percentile
+ * (as a fraction between 0 and 1) of the durations of a phase in milliseconds,
+ * by interpolating linearly within the bucket that contains the percentile.
+ */
+static double
+TaskTimingPercentile(TaskTimingHistogram *histogram, TaskTimingPhase phase,
+					 double fraction)
+{
+	uint64 totalCount = 0;
+
+	for (int bucketIndex = 0; bucketIndex < TASK_TIMING_HISTOGRAM_BUCKETS; bucketIndex++)
+	{
+		totalCount += histogram->bucketCounts[phase][bucketIndex];
+	}
+
+	if (totalCount == 0)
+	{
+		return 0.0;
+	}
+
+	double targetCount = fraction * totalCount;
+	uint64 cumulativeCount = 0;
+
+	for (int bucketIndex = 0; bucketIndex < TASK_TIMING_HISTOGRAM_BUCKETS; bucketIndex++)
+	{
+		uint32 bucketCount = histogram->bucketCounts[phase][bucketIndex];
+
+		if (bucketCount > 0 && cumulativeCount + bucketCount >= targetCount)
+		{
+			double lowerBound = bucketIndex == 0 ? 0.0 : (double) (UINT64CONST(1) <<
+																	 bucketIndex);
+			double upperBound = (double) (UINT64CONST(1) << (bucketIndex + 1));
+			double position = (targetCount - cumulativeCount) / bucketCount;
+
+			return (lowerBound + position * (upperBound - lowerBound)) / 1000.0;
+		}
+
+		cumulativeCount += bucketCount;
+	}
+
+	return (double) (UINT64CONST(1) << TASK_TIMING_HISTOGRAM_BUCKETS) / 1000.0;
+}
+
+
+/*
+ * citus_query_task_timings returns the median and the 99th percentile of the
+ * durations of the phases of the tasks of queries, per query and worker.
+ */
+Datum
+citus_query_task_timings(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupdesc;
+	HASH_SEQ_STATUS hash_seq;
+	TaskTimingsEntry *entry;
+	Oid currentUserId = GetUserId();
+	bool canSeeStats = superuser();
+
+	if (!queryStats)
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("citus_query_task_timings: shared memory not initialized")));
+	}
+
+	if (is_member_of_role(GetUserId(), ROLE_PG_READ_ALL_STATS))
+	{
+		canSeeStats = true;
+	}
+
+	Tuplestorestate *tupstore = SetupTuplestore(fcinfo, &tupdesc);
+
+	/* exclusive lock on queryStats->lock is acquired and released inside the function */
+	CitusQueryStatsSynchronizeEntries();
+
+	LWLockAcquire(queryStats->lock, LW_SHARED);
+
+	hash_seq_init(&hash_seq, taskTimingsHash);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		Datum values[CITUS_QUERY_TASK_TIMINGS_COLS];
+		bool nulls[CITUS_QUERY_TASK_TIMINGS_COLS];
+
+		/* keep data for processing after spinlock release */
+		TaskTimingHistogram histogram;
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		if (!(currentUserId == entry->key.userid || canSeeStats))
+		{
+			continue;
+		}
+
+		SpinLockAcquire(&entry->mutex);
+		histogram = entry->histogram;
+		SpinLockRelease(&entry->mutex);
+
+		int columnIndex = 0;
+		values[columnIndex++] = UInt64GetDatum(entry->key.queryid);
+		values[columnIndex++] = ObjectIdGetDatum(entry->key.userid);
+		values[columnIndex++] = ObjectIdGetDatum(entry->key.dbid);
+		values[columnIndex++] = CStringGetTextDatum(entry->key.nodeName);
+		values[columnIndex++] = Int32GetDatum(entry->key.nodePort);
+		values[columnIndex++] = Int64GetDatum(histogram.taskCount);
+
+		for (int phase = 0; phase < TASK_TIMING_PHASE_COUNT; phase++)
+		{
+			values[columnIndex++] =
+				Float8GetDatum(TaskTimingPercentile(&histogram, phase, 0.5));
+			values[columnIndex++] =
+				Float8GetDatum(TaskTimingPercentile(&histogram, phase, 0.99));
+		}
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	LWLockRelease(queryStats->lock);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * CitusQueryStatsPlannerTimingsEntry adds the timings of a distributed
+ * planning of the given query to the shared planner timings of the query. If
+ * the hash is full, the timings of new queries are not tracked until entries
+ * are removed along with their pg_stat_statements entries.
+ */
+void
+CitusQueryStatsPlannerTimingsEntry(uint64 queryId, PlannerPhaseTimings *timings)
+{
+	PlannerTimingsHashKey key;
+
+	/* Safety check... */
+	if (!queryStats || !plannerTimingsHash)
+	{
+		return;
+	}
+
+	/* early return if tracking is disabled */
+	if (!StatStatementsTrack)
+	{
+		return;
+	}
+
+	/* Set up key for hashtable search, padding bytes are part of the key */
+	memset(&key, 0, sizeof(key));
+	key.userid = GetUserId();
+	key.dbid = MyDatabaseId;
+	key.queryid = queryId;
+
+	/* Lookup the hash table entry with shared lock. */
+	LWLockAcquire(queryStats->lock, LW_SHARED);
+
+	PlannerTimingsEntry *entry =
+		(PlannerTimingsEntry *) hash_search(plannerTimingsHash, &key, HASH_FIND, NULL);
+
+	/* Create new entry, if not present */
+	if (!entry)
+	{
+		/* Need exclusive lock to make a new hashtable entry - promote */
+		LWLockRelease(queryStats->lock);
+		LWLockAcquire(queryStats->lock, LW_EXCLUSIVE);
+
+		bool found = false;
+
+		entry = (PlannerTimingsEntry *) hash_search(plannerTimingsHash, &key,
+													HASH_FIND, &found);
+		if (!found)
+		{
+			if (hash_get_num_entries(plannerTimingsHash) >= StatStatementsMax)
+			{
+				LWLockRelease(queryStats->lock);
+				return;
+			}
+
+			entry = (PlannerTimingsEntry *) hash_search(plannerTimingsHash, &key,
+														HASH_ENTER, &found);
+			entry->plans = 0;
+			memset(&entry->totalTimings, 0, sizeof(PlannerPhaseTimings));
+			SpinLockInit(&entry->mutex);
+		}
+	}
+
+	volatile PlannerTimingsEntry *e = (volatile PlannerTimingsEntry *) entry;
+
+	SpinLockAcquire(&e->mutex);
+
+	e->plans += 1;
+	e->totalTimings.totalMillisecs += timings->totalMillisecs;
+
+	for (int phase = 0; phase < PLANNER_PHASE_COUNT; phase++)
+	{
+		e->totalTimings.phaseMillisecs[phase] += timings->phaseMillisecs[phase];
+	}
+
+	SpinLockRelease(&e->mutex);
+
+	LWLockRelease(queryStats->lock);
+}
+
+
+/*
+ * citus_query_planner_timings returns the number of distributed plans of
+ * queries and the total time spent in the phases of planning them, per query.
+ */
+Datum
+citus_query_planner_timings(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupdesc;
+	HASH_SEQ_STATUS hash_seq;
+	PlannerTimingsEntry *entry;
+	Oid currentUserId = GetUserId();
+	bool canSeeStats = superuser();
+
+	if (!queryStats)
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("citus_query_planner_timings: shared memory not initialized")));
+	}
+
+	if (is_member_of_role(GetUserId(), ROLE_PG_READ_ALL_STATS))
+	{
+		canSeeStats = true;
+	}
+
+	Tuplestorestate *tupstore = SetupTuplestore(fcinfo, &tupdesc);
+
+	/* exclusive lock on queryStats->lock is acquired and released inside the function */
+	CitusQueryStatsSynchronizeEntries();
+
+	LWLockAcquire(queryStats->lock, LW_SHARED);
+
+	hash_seq_init(&hash_seq, plannerTimingsHash);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		Datum values[CITUS_QUERY_PLANNER_TIMINGS_COLS];
+		bool nulls[CITUS_QUERY_PLANNER_TIMINGS_COLS];
+
+		/* keep data for processing after spinlock release */
+		int64 plans = 0;
+		PlannerPhaseTimings totalTimings;
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		if (!(currentUserId == entry->key.userid || canSeeStats))
+		{
+			continue;
+		}
+
+		SpinLockAcquire(&entry->mutex);
+		plans = entry->plans;
+		totalTimings = entry->totalTimings;
+		SpinLockRelease(&entry->mutex);
+
+		int columnIndex = 0;
+		values[columnIndex++] = UInt64GetDatum(entry->key.queryid);
+		values[columnIndex++] = ObjectIdGetDatum(entry->key.userid);
+		values[columnIndex++] = ObjectIdGetDatum(entry->key.dbid);
+		values[columnIndex++] = Int64GetDatum(plans);
+		values[columnIndex++] = Float8GetDatum(totalTimings.totalMillisecs);
+
+		for (int phase = 0; phase < PLANNER_PHASE_COUNT; phase++)
+		{
+			values[columnIndex++] = Float8GetDatum(totalTimings.phaseMillisecs[phase]);
+		}
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	LWLockRelease(queryStats->lock);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * QueryStringWithCitusQueryId returns the given task query string, prefixed
+ * with a comment that carries the identifier of the distributed query to the
+ * worker, where CitusQueryIdFromQueryString reads it back. pg_stat_statements
+ * ignores comments when computing query identifiers, so the comment does not
+ * add entries on the worker.
+ */
+char *
+QueryStringWithCitusQueryId(uint64 queryId, const char *queryString)
+{
+	return psprintf(CITUS_QUERY_ID_COMMENT_PREFIX UINT64_FORMAT " */ %s", queryId,
+					queryString);
+}
+
+
+/*
+ * CitusQueryIdFromQueryString returns the identifier of the distributed query
+ * that the given query string carries in its leading comment, or 0 if it does
+ * not start with such a comment.
+ */
+uint64
+CitusQueryIdFromQueryString(const char *queryString)
+{
+	int prefixLength = strlen(CITUS_QUERY_ID_COMMENT_PREFIX);
+	char *endPointer = NULL;
+
+	if (queryString == NULL ||
+		strncmp(queryString, CITUS_QUERY_ID_COMMENT_PREFIX, prefixLength) != 0)
+	{
+		return 0;
+	}
+
+	errno = 0;
+	uint64 queryId = strtou64(queryString + prefixLength, &endPointer, 10);
+	if (errno != 0 || strncmp(endPointer, " */", 3) != 0)
+	{
+		return 0;
+	}
+
+	return queryId;
+}
+
+
+/*
+ * CitusQueryStatsWorkerEntry adds an execution of a task of the given
+ * distributed query, which started at the given time and buffer usage, to
+ * the shared worker statistics of the query. If the hash is full, new queries
+ * are not tracked until citus_stat_statements_reset() is called.
+ */
+void
+CitusQueryStatsWorkerEntry(uint64 queryId, instr_time startTime,
+						   BufferUsage *startBufferUsage, uint64 rows)
+{
+	WorkerQueryStatsHashKey key;
+	instr_time duration;
+	BufferUsage bufferUsage;
+
+	/* Safety check... */
+	if (!queryStats || !workerQueryStatsHash)
+	{
+		return;
+	}
+
+	INSTR_TIME_SET_CURRENT(duration);
+	INSTR_TIME_SUBTRACT(duration, startTime);
+
+	memset(&bufferUsage, 0, sizeof(bufferUsage));
+	BufferUsageAccumDiff(&bufferUsage, &pgBufferUsage, startBufferUsage);
+
+	/* Set up key for hashtable search, padding bytes are part of the key */
+	memset(&key, 0, sizeof(key));
+	key.userid = GetUserId();
+	key.dbid = MyDatabaseId;
+	key.queryid = queryId;
+
+	/* Lookup the hash table entry with shared lock. */
+	LWLockAcquire(queryStats->lock, LW_SHARED);
+
+	WorkerQueryStatsEntry *entry =
+		(WorkerQueryStatsEntry *) hash_search(workerQueryStatsHash, &key, HASH_FIND,
+											  NULL);
+
+	/* Create new entry, if not present */
+	if (!entry)
+	{
+		/* Need exclusive lock to make a new hashtable entry - promote */
+		LWLockRelease(queryStats->lock);
+		LWLockAcquire(queryStats->lock, LW_EXCLUSIVE);
+
+		bool found = false;
+
+		entry = (WorkerQueryStatsEntry *) hash_search(workerQueryStatsHash, &key,
+													  HASH_FIND, &found);
+		if (!found)
+		{
+			if (hash_get_num_entries(workerQueryStatsHash) >= StatStatementsWorkerMax)
+			{
+				LWLockRelease(queryStats->lock);
+				return;
+			}
+
+			entry = (WorkerQueryStatsEntry *) hash_search(workerQueryStatsHash, &key,
+														  HASH_ENTER, &found);
+			entry->calls = 0;
+			entry->totalTime = 0.0;
+			entry->rows = 0;
+			entry->sharedBlksHit = 0;
+			entry->sharedBlksRead = 0;
+			entry->sharedBlksWritten = 0;
+			SpinLockInit(&entry->mutex);
+		}
+	}
+
+	volatile WorkerQueryStatsEntry *e = (volatile WorkerQueryStatsEntry *) entry;
+
+	SpinLockAcquire(&e->mutex);
+
+	e->calls += 1;
+	e->totalTime += INSTR_TIME_GET_MILLISEC(duration);
+	e->rows += rows;
+	e->sharedBlksHit += bufferUsage.shared_blks_hit;
+	e->sharedBlksRead += bufferUsage.shared_blks_read;
+	e->sharedBlksWritten += bufferUsage.shared_blks_written;
+
+	SpinLockRelease(&e->mutex);
+
+	LWLockRelease(queryStats->lock);
+}
+
+
+/*
+ * citus_worker_query_stats returns the statistics of the executions of the
+ * tasks of distributed queries on this node, per query identifier on the
+ * coordinator.
+ */
+Datum
+citus_worker_query_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupdesc;
+	HASH_SEQ_STATUS hash_seq;
+	WorkerQueryStatsEntry *entry;
+	Oid currentUserId = GetUserId();
+	bool canSeeStats = superuser();
+
+	if (!queryStats)
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("citus_worker_query_stats: shared memory not initialized")));
+	}
+
+	if (is_member_of_role(GetUserId(), ROLE_PG_READ_ALL_STATS))
+	{
+		canSeeStats = true;
+	}
+
+	Tuplestorestate *tupstore = SetupTuplestore(fcinfo, &tupdesc);
+
+	LWLockAcquire(queryStats->lock, LW_SHARED);
+
+	hash_seq_init(&hash_seq, workerQueryStatsHash);
+	while ((entry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		Datum values[CITUS_WORKER_QUERY_STATS_COLS];
+		bool nulls[CITUS_WORKER_QUERY_STATS_COLS];
+
+		/* keep data for processing after spinlock release */
+		WorkerQueryStatsEntry counters;
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		if (!(currentUserId == entry->key.userid || canSeeStats))
+		{
+			continue;
+		}
+
+		SpinLockAcquire(&entry->mutex);
+		counters = *entry;
+		SpinLockRelease(&entry->mutex);
+
+		int columnIndex = 0;
+		values[columnIndex++] = UInt64GetDatum(entry->key.queryid);
+		values[columnIndex++] = ObjectIdGetDatum(entry->key.userid);
+		values[columnIndex++] = ObjectIdGetDatum(entry->key.dbid);
+		values[columnIndex++] = Int64GetDatum(counters.calls);
+		values[columnIndex++] = Float8GetDatum(counters.totalTime);
+		values[columnIndex++] = Int64GetDatum(counters.rows);
+		values[columnIndex++] = Int64GetDatum(counters.sharedBlksHit);
+		values[columnIndex++] = Int64GetDatum(counters.sharedBlksRead);
+		values[columnIndex++] = Int64GetDatum(counters.sharedBlksWritten);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	LWLockRelease(queryStats->lock);
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
+
+
 /*
  * CitusQueryStatsSynchronizeEntries removes all entries in queryStats hash
  * that does not have matching queryId in pg_stat_statements.
@@ -969,6 +1728,59 @@ CitusQueryStatsRemoveExpiredEntries(HTAB *existingQueryIdHash)
 		}
 	}
 
+	TaskTimingsEntry *taskTimingsEntry = NULL;
+
+	hash_seq_init(&hash_seq, taskTimingsHash);
+	while ((taskTimingsEntry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		bool found = false;
+		ExistingStatsHashKey existingStatsKey = { 0, 0, 0 };
+
+		/* see above */
+		if (!(currentUserId == taskTimingsEntry->key.userid || canSeeStats))
+		{
+			continue;
+		}
+
+		existingStatsKey.userid = taskTimingsEntry->key.userid;
+		existingStatsKey.dbid = taskTimingsEntry->key.dbid;
+		existingStatsKey.queryid = taskTimingsEntry->key.queryid;
+
+		hash_search(existingQueryIdHash, (void *) &existingStatsKey, HASH_FIND, &found);
+		if (!found)
+		{
+			hash_search(taskTimingsHash, &taskTimingsEntry->key, HASH_REMOVE, NULL);
+			removedCount++;
+		}
+	}
+
+	PlannerTimingsEntry *plannerTimingsEntry = NULL;
+
+	hash_seq_init(&hash_seq, plannerTimingsHash);
+	while ((plannerTimingsEntry = hash_seq_search(&hash_seq)) != NULL)
+	{
+		bool found = false;
+		ExistingStatsHashKey existingStatsKey = { 0, 0, 0 };
+
+		/* see above */
+		if (!(currentUserId == plannerTimingsEntry->key.userid || canSeeStats))
+		{
+			continue;
+		}
+
+		existingStatsKey.userid = plannerTimingsEntry->key.userid;
+		existingStatsKey.dbid = plannerTimingsEntry->key.dbid;
+		existingStatsKey.queryid = plannerTimingsEntry->key.queryid;
+
+		hash_search(existingQueryIdHash, (void *) &existingStatsKey, HASH_FIND, &found);
+		if (!found)
+		{
+			hash_search(plannerTimingsHash, &plannerTimingsEntry->key, HASH_REMOVE,
+						NULL);
+			removedCount++;
+		}
+	}
+
 	LWLockRelease(queryStats->lock);
 
 	if (removedCount > 0)
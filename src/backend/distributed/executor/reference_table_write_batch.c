@@ -0,0 +1,420 @@
+/*-------------------------------------------------------------------------
+ *
+ * reference_table_write_batch.c
+ *	  Batching of single-row modifications of reference tables and hash
+ *	  distributed tables within a transaction block.
+ *
+ * Every write to a reference table is a round trip to all of its placements,
+ * which makes transactions that insert rows one by one slow. When
+ * citus.reference_table_write_batch_size is set, we hold back single-row
+ * INSERTs into reference tables that run as top-level statements of a
+ * transaction block, and send the pending writes to the placements as a single
+ * task per node once:
+ *
+ *   - the number of pending writes reaches the batch size,
+ *   - any other statement starts, including utility commands, or
+ *   - the transaction commits.
+ *
+ * Since any statement that could observe the writes first flushes them, reads
+ * always see the writes of the transaction, whichever placement they go to.
+ * The flushed writes run over the regular executor, so they take the same
+ * locks and use the same (2PC) transaction as they would have without
+ * batching. The only visible difference is that an error in one of the writes
+ * is reported by the statement that flushes them, with a context that tells
+ * which of the held back writes failed.
+ *
+ * When citus.distributed_table_write_batch_size is set, we do the same for
+ * single-row INSERTs into hash distributed tables. Those only go to the
+ * placements of a single shard, so we only combine consecutive writes into
+ * the same shard, which keeps each flushed command on the connection that
+ * the transaction already uses for the shard.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "distributed/adaptive_executor.h"
+#include "distributed/citus_custom_scan.h"
+#include "distributed/citus_nodes.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/reference_table_write_batch.h"
+#include "distributed/transaction_management.h"
+#include "utils/memutils.h"
+
+
+/* GUC, maximum number of reference table writes we hold back in a transaction */
+int ReferenceTableWriteBatchSize = 0;
+
+/* GUC, maximum number of distributed table writes we hold back in a transaction */
+int DistributedTableWriteBatchSize = 0;
+
+/* writes that are not yet sent to the placements, in TopTransactionContext */
+static List *PendingReferenceTableWrites = NIL;
+
+
+/*
+ * BatchedWriteRange is the range of pending writes that a flushed command
+ * consists of, numbered in the order of the statements that made them.
+ */
+typedef struct BatchedWriteRange
+{
+	int firstWrite;
+	int lastWrite;
+	int writeCount;
+} BatchedWriteRange;
+
+
+
+static int WriteBatchSize(Oid relationId);
+static Task * CreateBatchedWriteTask(List *writeList);
+static bool WritesCanShareTask(Task *leftTask, Task *rightTask);
+static bool TaskPlacementGroupsEqual(Task *leftTask, Task *rightTask);
+static void ReferenceTableWriteFlushErrorCallback(void *arg);
+
+
+/*
+ * IsReferenceTableWriteBatchCandidate returns whether the given plan might be
+ * a write that we batch. Other statements flush the pending writes before they
+ * start, the executor decides for the candidates.
+ */
+bool
+IsReferenceTableWriteBatchCandidate(PlannedStmt *plannedStmt)
+{
+	return (ReferenceTableWriteBatchSize > 1 || DistributedTableWriteBatchSize > 1) &&
+		   plannedStmt->commandType == CMD_INSERT &&
+		   IsCitusPlan(plannedStmt->planTree);
+}
+
+
+/*
+ * ShouldBatchReferenceTableWrite returns whether the given plan is a single-row
+ * INSERT into a reference table or hash distributed table that we can hold
+ * back until the next flush.
+ */
+bool
+ShouldBatchReferenceTableWrite(DistributedPlan *distributedPlan,
+							   ParamListInfo paramListInfo)
+{
+	if (ReferenceTableWriteBatchSize <= 1 && DistributedTableWriteBatchSize <= 1)
+	{
+		return false;
+	}
+
+	/* outside of a transaction block, nothing would flush the writes */
+	if (!IsTransactionBlock())
+	{
+		return false;
+	}
+
+	/* function bodies and procedures might depend on the outcome of the write */
+	if (DoBlockLevel > 0 || StoredProcedureLevel > 0 || MaybeExecutingUDF())
+	{
+		return false;
+	}
+
+	Job *workerJob = distributedPlan->workerJob;
+	Query *jobQuery = workerJob->jobQuery;
+
+	if (distributedPlan->modLevel == ROW_MODIFY_READONLY ||
+		distributedPlan->expectResults ||
+		distributedPlan->insertSelectQuery != NULL ||
+		workerJob->dependentJobList != NIL ||
+		list_length(workerJob->taskList) != 1)
+	{
+		return false;
+	}
+
+	/* only single-row INSERTs, which cannot return anything to the client */
+	if (jobQuery == NULL || jobQuery->commandType != CMD_INSERT ||
+		jobQuery->returningList != NIL || jobQuery->onConflict != NULL ||
+		list_length(jobQuery->rtable) != 1)
+	{
+		return false;
+	}
+
+	if (WriteBatchSize(distributedPlan->targetRelationId) <= 1)
+	{
+		return false;
+	}
+
+	Task *task = linitial(workerJob->taskList);
+	if (task->rowValuesLists != NIL ||
+		(paramListInfo != NULL && !task->parametersInQueryStringResolved))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * BatchReferenceTableWrite adds the write of the given task to the pending
+ * writes of the transaction and flushes them when the batch is full.
+ */
+void
+BatchReferenceTableWrite(Task *task)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	Task *pendingTask = CitusMakeNode(Task);
+	pendingTask->taskType = MODIFY_TASK;
+	pendingTask->jobId = task->jobId;
+	pendingTask->taskId = task->taskId;
+	pendingTask->anchorShardId = task->anchorShardId;
+	pendingTask->taskPlacementList = copyObject(task->taskPlacementList);
+	pendingTask->relationShardList = copyObject(task->relationShardList);
+	pendingTask->replicationModel = task->replicationModel;
+	SetTaskQueryString(pendingTask, pstrdup(TaskQueryString(task)));
+
+	PendingReferenceTableWrites = lappend(PendingReferenceTableWrites, pendingTask);
+
+	MemoryContextSwitchTo(oldContext);
+
+	if (list_length(PendingReferenceTableWrites) >=
+		WriteBatchSize(RelationIdForShard(task->anchorShardId)))
+	{
+		FlushReferenceTableWrites();
+	}
+}
+
+
+/*
+ * HasPendingReferenceTableWrites returns whether the transaction has writes
+ * that are not yet sent to the placements.
+ */
+bool
+HasPendingReferenceTableWrites(void)
+{
+	return PendingReferenceTableWrites != NIL;
+}
+
+
+/*
+ * FlushReferenceTableWrites sends the pending writes to the placements. The
+ * consecutive writes that go to the same nodes, or for distributed tables to
+ * the same shard, are sent as a single command.
+ */
+void
+FlushReferenceTableWrites(void)
+{
+	if (PendingReferenceTableWrites == NIL)
+	{
+		return;
+	}
+
+	/* the writes are gone if they fail, and the flush should not recurse */
+	List *writeList = PendingReferenceTableWrites;
+	PendingReferenceTableWrites = NIL;
+
+	BatchedWriteRange writeRange;
+	writeRange.firstWrite = 1;
+	writeRange.lastWrite = 0;
+	writeRange.writeCount = list_length(writeList);
+
+	ErrorContextCallback errorCallback;
+	errorCallback.callback = ReferenceTableWriteFlushErrorCallback;
+	errorCallback.arg = &writeRange;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	List *groupWriteList = NIL;
+
+	Task *write = NULL;
+	foreach_ptr(write, writeList)
+	{
+		if (groupWriteList != NIL &&
+			!WritesCanShareTask(linitial(groupWriteList), write))
+		{
+			/* preserve the order of the writes that go to different nodes */
+			ExecuteTaskList(ROW_MODIFY_COMMUTATIVE,
+							list_make1(CreateBatchedWriteTask(groupWriteList)));
+			groupWriteList = NIL;
+			writeRange.firstWrite = writeRange.lastWrite + 1;
+		}
+
+		groupWriteList = lappend(groupWriteList, write);
+		writeRange.lastWrite++;
+	}
+
+	ExecuteTaskList(ROW_MODIFY_COMMUTATIVE,
+					list_make1(CreateBatchedWriteTask(groupWriteList)));
+
+	error_context_stack = errorCallback.previous;
+}
+
+
+/*
+ * DiscardReferenceTableWrites forgets about the pending writes, which is what
+ * we want when the (sub)transaction that made them aborts. The memory goes
+ * away with the transaction.
+ */
+void
+DiscardReferenceTableWrites(void)
+{
+	PendingReferenceTableWrites = NIL;
+}
+
+
+/*
+ * WriteBatchSize returns the number of writes into the given table that we
+ * hold back before flushing, where 0 or 1 means that we do not batch them.
+ */
+static int
+WriteBatchSize(Oid relationId)
+{
+	if (IsCitusTableType(relationId, REFERENCE_TABLE))
+	{
+		return ReferenceTableWriteBatchSize;
+	}
+	else if (IsCitusTableType(relationId, HASH_DISTRIBUTED))
+	{
+		return DistributedTableWriteBatchSize;
+	}
+
+	return 0;
+}
+
+
+/*
+ * CreateBatchedWriteTask returns a task that runs the given writes, which go
+ * to the same placement groups, as a list of queries. Remote placements get
+ * them as a single multi-statement command, while local execution plans them
+ * one by one, since it can only parse a single statement at a time.
+ */
+static Task *
+CreateBatchedWriteTask(List *writeList)
+{
+	Task *firstWrite = linitial(writeList);
+
+	if (list_length(writeList) == 1)
+	{
+		return firstWrite;
+	}
+
+	List *queryStringList = NIL;
+	List *relationShardList = NIL;
+
+	Task *write = NULL;
+	foreach_ptr(write, writeList)
+	{
+		queryStringList = lappend(queryStringList, TaskQueryString(write));
+
+		/* the executor otherwise only records the access of the anchor shard */
+		RelationShard *anchorRelationShard = CitusMakeNode(RelationShard);
+		anchorRelationShard->relationId = RelationIdForShard(write->anchorShardId);
+		anchorRelationShard->shardId = write->anchorShardId;
+
+		relationShardList = lappend(relationShardList, anchorRelationShard);
+		relationShardList = list_concat(relationShardList,
+										list_copy(write->relationShardList));
+	}
+
+	Task *batchedTask = CitusMakeNode(Task);
+	batchedTask->taskType = MODIFY_TASK;
+	batchedTask->jobId = firstWrite->jobId;
+	batchedTask->taskId = firstWrite->taskId;
+	batchedTask->anchorShardId = firstWrite->anchorShardId;
+	batchedTask->taskPlacementList = firstWrite->taskPlacementList;
+	batchedTask->replicationModel = firstWrite->replicationModel;
+	batchedTask->relationShardList = relationShardList;
+	SetTaskQueryStringList(batchedTask, queryStringList);
+	batchedTask->sendQueriesTogether = true;
+
+	return batchedTask;
+}
+
+
+/*
+ * WritesCanShareTask returns whether the given pending writes can be sent as
+ * a single command. Writes into the same shard always can, reference table
+ * writes can when their placements are in the same node groups.
+ */
+static bool
+WritesCanShareTask(Task *leftTask, Task *rightTask)
+{
+	if (leftTask->anchorShardId == rightTask->anchorShardId)
+	{
+		return true;
+	}
+
+	/*
+	 * Different shards of a distributed table on the same node may have been
+	 * modified over different connections earlier in the transaction.
+	 */
+	if (!ReferenceTableShardId(leftTask->anchorShardId) ||
+		!ReferenceTableShardId(rightTask->anchorShardId))
+	{
+		return false;
+	}
+
+	return TaskPlacementGroupsEqual(leftTask, rightTask);
+}
+
+
+/*
+ * TaskPlacementGroupsEqual returns whether the given tasks have placements in
+ * the same node groups.
+ */
+static bool
+TaskPlacementGroupsEqual(Task *leftTask, Task *rightTask)
+{
+	if (list_length(leftTask->taskPlacementList) !=
+		list_length(rightTask->taskPlacementList))
+	{
+		return false;
+	}
+
+	ShardPlacement *leftPlacement = NULL;
+	foreach_ptr(leftPlacement, leftTask->taskPlacementList)
+	{
+		bool foundGroup = false;
+
+		ShardPlacement *rightPlacement = NULL;
+		foreach_ptr(rightPlacement, rightTask->taskPlacementList)
+		{
+			if (rightPlacement->groupId == leftPlacement->groupId)
+			{
+				foundGroup = true;
+				break;
+			}
+		}
+
+		if (!foundGroup)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ReferenceTableWriteFlushErrorCallback tells the user that an error comes
+ * from a write of an earlier statement, and which of the held back writes
+ * were sent by the failed command.
+ */
+static void
+ReferenceTableWriteFlushErrorCallback(void *arg)
+{
+	BatchedWriteRange *writeRange = (BatchedWriteRange *) arg;
+
+	if (writeRange->firstWrite == writeRange->lastWrite)
+	{
+		errcontext("while sending batched write %d of %d",
+				   writeRange->firstWrite, writeRange->writeCount);
+	}
+	else
+	{
+		errcontext("while sending batched writes %d to %d of %d",
+				   writeRange->firstWrite, writeRange->lastWrite,
+				   writeRange->writeCount);
+	}
+}
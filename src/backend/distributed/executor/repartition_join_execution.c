@@ -11,6 +11,8 @@
  *  gives an error, so if we come to a fetchTask we know for sure that its dependedMapTask is executed in all
  *  replicas.
  * - It creates schemas in each worker in a single transaction to store intermediate results.
+ * - It builds and broadcasts the join key filters of dual repartition joins, if any.
+ * - It samples and broadcasts the heavy hitters of dual repartition joins, if any.
  * - It iterates all tasks and finds the ones whose dependencies are already executed, and executes them with
  *  adaptive executor logic.
  *
@@ -31,6 +33,7 @@
 
 #include "distributed/adaptive_executor.h"
 #include "distributed/directed_acyclic_graph_execution.h"
+#include "distributed/distributed_command_progress.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
 #include "distributed/metadata_cache.h"
@@ -38,6 +41,8 @@
 #include "distributed/multi_server_executor.h"
 #include "distributed/task_execution_utils.h"
 #include "distributed/repartition_join_execution.h"
+#include "distributed/repartition_join_filter.h"
+#include "distributed/repartition_join_skew.h"
 #include "distributed/transaction_management.h"
 #include "distributed/transmit.h"
 #include "distributed/worker_manager.h"
@@ -59,8 +64,21 @@ ExecuteDependentTasks(List *topLevelTasks, Job *topLevelJob)
 	List *allTasks = CreateTaskListForJobTree(topLevelTasks);
 	List *jobIds = ExtractJobsInJobTree(topLevelJob);
 
+	/* the repartitioning is what makes these joins long-running */
+	bool progressStarted =
+		StartDistributedCommandProgress(DISTRIBUTED_COMMAND_REPARTITION_JOIN,
+										InvalidOid, 0);
+
+	/* join key filters need to be in place before the map tasks run */
+	ExecuteRepartitionJoinFilters(topLevelJob);
+
+	/* the same goes for the heavy hitters of join keys */
+	ExecuteRepartitionJoinSkewHandling(topLevelJob);
+
 	ExecuteTasksInDependencyOrder(allTasks, topLevelTasks, jobIds);
 
+	FinishDistributedCommandProgress(progressStarted);
+
 	return jobIds;
 }
 
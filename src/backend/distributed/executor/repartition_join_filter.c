@@ -0,0 +1,547 @@
+/*-------------------------------------------------------------------------
+ *
+ * repartition_join_filter.c
+ *	  Join key filters for dual repartition joins.
+ *
+ * A dual repartition join shuffles all rows of both sides, even when only a
+ * few of them find a join partner. When citus.enable_repartition_join_filters
+ * is on, the planner picks one side of the join to build a bloom filter of its
+ * join keys. Before the map tasks run, we build the filter on the workers that
+ * hold the shards of that side, merge the filters on the coordinator and send
+ * the merged filter as an intermediate result to the workers that run the map
+ * tasks of the other side. worker_partition_query_result then skips the rows
+ * whose join key is not in the filter before partitioning them.
+ *
+ * Since repartition joins are always inner joins, the skipped rows could not
+ * have produced any results. The filter may yield false positives, which just
+ * means that some rows are shuffled needlessly.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/tupdesc.h"
+#include "catalog/pg_type.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/intermediate_results.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/repartition_join_filter.h"
+#include "distributed/tuple_destination.h"
+#include "distributed/worker_manager.h"
+#include "executor/executor.h"
+#include "miscadmin.h"
+#include "port/pg_bitutils.h"
+#include "utils/builtins.h"
+#include "utils/tuplestore.h"
+#include "utils/typcache.h"
+
+
+/* number of bits we set in the filter for each join key */
+#define JOIN_KEY_FILTER_HASH_COUNT 3
+
+/* we do not apply filters with more bits set than this, they filter too little */
+#define JOIN_KEY_FILTER_MAX_FILL_RATIO 0.5
+
+
+/*
+ * JoinKeyFilterDestReceiver adds the join keys of the tuples it receives to a
+ * join key filter or, if it has an inner DestReceiver, forwards the tuples
+ * whose join key might be in the filter.
+ */
+typedef struct JoinKeyFilterDestReceiver
+{
+	/* public DestReceiver interface */
+	DestReceiver pub;
+
+	/* receiver of the tuples that pass the filter, NULL when building it */
+	DestReceiver *innerDest;
+
+	/* which column of the tuples contains the join key */
+	int columnIndex;
+
+	/* bits of the join key filter */
+	bytea *joinKeyFilter;
+	uint64 filterBitCount;
+
+	/* extended hash function and collation of the join key */
+	FmgrInfo *hashFunction;
+	Oid collation;
+} JoinKeyFilterDestReceiver;
+
+
+static void ExecuteJoinKeyFilter(MapMergeJob *buildJob, MapMergeJob *probeJob);
+static bytea * BuildJoinKeyFilter(MapMergeJob *buildJob);
+static void BroadcastJoinKeyFilter(bytea *joinKeyFilter, MapMergeJob *probeJob);
+static TupleDesc JoinKeyFilterTupleDesc(void);
+static void JoinKeyFilterDestReceiverStartup(DestReceiver *dest, int operation,
+											 TupleDesc inputTupleDescriptor);
+static bool JoinKeyFilterDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void JoinKeyFilterDestReceiverShutdown(DestReceiver *dest);
+static void JoinKeyFilterDestReceiverDestroy(DestReceiver *dest);
+static uint64 JoinKeyFilterBitPosition(uint64 hash, int hashIndex, uint64 filterBitCount);
+
+/* exports for SQL callable functions */
+PG_FUNCTION_INFO_V1(worker_build_join_key_filter);
+
+
+/*
+ * worker_build_join_key_filter executes a query and returns a bloom filter of
+ * the given size that contains the values of the given column.
+ */
+Datum
+worker_build_join_key_filter(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	text *queryText = PG_GETARG_TEXT_P(0);
+	char *queryString = text_to_cstring(queryText);
+	int columnIndex = PG_GETARG_INT32(1);
+	int filterSize = PG_GETARG_INT32(2);
+
+	if (filterSize <= 0 || filterSize > MaxAllocSize - VARHDRSZ)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("join key filter size must be between 1 and %d",
+							   (int) (MaxAllocSize - VARHDRSZ))));
+	}
+
+	bytea *joinKeyFilter = palloc0(VARHDRSZ + filterSize);
+	SET_VARSIZE(joinKeyFilter, VARHDRSZ + filterSize);
+
+	DestReceiver *dest = CreateJoinKeyFilterDestReceiver(NULL, columnIndex,
+														 joinKeyFilter);
+
+	ExecuteQueryStringIntoDestReceiver(queryString, NULL, dest);
+
+	dest->rDestroy(dest);
+
+	PG_RETURN_BYTEA_P(joinKeyFilter);
+}
+
+
+/*
+ * ExecuteRepartitionJoinFilters builds and broadcasts the join key filters of
+ * all dual repartition joins in the job tree for which the planner decided to
+ * use one. It should be called before the map tasks are executed.
+ */
+void
+ExecuteRepartitionJoinFilters(Job *job)
+{
+	MapMergeJob *buildJob = NULL;
+	MapMergeJob *probeJob = NULL;
+
+	Job *dependentJob = NULL;
+	foreach_ptr(dependentJob, job->dependentJobList)
+	{
+		ExecuteRepartitionJoinFilters(dependentJob);
+
+		if (!CitusIsA(dependentJob, MapMergeJob))
+		{
+			continue;
+		}
+
+		MapMergeJob *mapMergeJob = (MapMergeJob *) dependentJob;
+		if (mapMergeJob->joinKeyFilterResultId == NULL)
+		{
+			continue;
+		}
+
+		if (mapMergeJob->buildsJoinKeyFilter)
+		{
+			buildJob = mapMergeJob;
+		}
+		else
+		{
+			probeJob = mapMergeJob;
+		}
+	}
+
+	if (buildJob != NULL && probeJob != NULL)
+	{
+		ExecuteJoinKeyFilter(buildJob, probeJob);
+	}
+}
+
+
+/*
+ * ExecuteJoinKeyFilter builds the join key filter of buildJob and sends it to
+ * the workers that run the map tasks of probeJob. If the filter has so many
+ * bits set that it would not filter much, we send an empty filter instead,
+ * which disables the filtering.
+ */
+static void
+ExecuteJoinKeyFilter(MapMergeJob *buildJob, MapMergeJob *probeJob)
+{
+	bytea *joinKeyFilter = BuildJoinKeyFilter(buildJob);
+
+	int filterSize = VARSIZE(joinKeyFilter) - VARHDRSZ;
+	uint64 setBitCount = pg_popcount(VARDATA(joinKeyFilter), filterSize);
+	double fillRatio = (double) setBitCount / ((uint64) filterSize * BITS_PER_BYTE);
+
+	if (fillRatio > JOIN_KEY_FILTER_MAX_FILL_RATIO)
+	{
+		ereport(DEBUG1, (errmsg("not applying the join key filter of a repartition "
+								"join, too many bits are set")));
+
+		joinKeyFilter = palloc0(VARHDRSZ);
+		SET_VARSIZE(joinKeyFilter, VARHDRSZ);
+	}
+	else
+	{
+		ereport(DEBUG1, (errmsg("applying a join key filter to a repartition join")));
+	}
+
+	BroadcastJoinKeyFilter(joinKeyFilter, probeJob);
+}
+
+
+/*
+ * BuildJoinKeyFilter executes the join key filter tasks of the given job and
+ * returns the union of the filters they return.
+ */
+static bytea *
+BuildJoinKeyFilter(MapMergeJob *buildJob)
+{
+	TupleDesc tupleDescriptor = JoinKeyFilterTupleDesc();
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+	TupleDestination *tupleDest = CreateTupleStoreTupleDest(tupleStore,
+															tupleDescriptor);
+	bool expectResults = true;
+
+	ExecuteTaskListIntoTupleDest(ROW_MODIFY_READONLY, buildJob->joinKeyFilterTaskList,
+								 tupleDest, expectResults);
+
+	bytea *joinKeyFilter = NULL;
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor,
+													&TTSOpsMinimalTuple);
+
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		bool isNull = false;
+		Datum filterDatum = slot_getattr(slot, 1, &isNull);
+		if (isNull)
+		{
+			ereport(ERROR, (errmsg("worker returned a NULL join key filter")));
+		}
+
+		bytea *workerFilter = DatumGetByteaPP(filterDatum);
+		char *workerFilterData = VARDATA_ANY(workerFilter);
+		int workerFilterSize = VARSIZE_ANY_EXHDR(workerFilter);
+
+		if (joinKeyFilter == NULL)
+		{
+			joinKeyFilter = palloc(VARHDRSZ + workerFilterSize);
+			SET_VARSIZE(joinKeyFilter, VARHDRSZ + workerFilterSize);
+			memcpy_s(VARDATA(joinKeyFilter), workerFilterSize, workerFilterData,
+					 workerFilterSize);
+			continue;
+		}
+
+		if (VARSIZE(joinKeyFilter) - VARHDRSZ != workerFilterSize)
+		{
+			ereport(ERROR, (errmsg("workers returned join key filters of different "
+								   "sizes")));
+		}
+
+		char *filterData = VARDATA(joinKeyFilter);
+		for (int byteIndex = 0; byteIndex < workerFilterSize; byteIndex++)
+		{
+			filterData[byteIndex] |= workerFilterData[byteIndex];
+		}
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	if (joinKeyFilter == NULL)
+	{
+		/* there were no tasks, hence no rows can pass the filter */
+		joinKeyFilter = palloc0(VARHDRSZ + 1);
+		SET_VARSIZE(joinKeyFilter, VARHDRSZ + 1);
+	}
+
+	return joinKeyFilter;
+}
+
+
+/*
+ * BroadcastJoinKeyFilter writes the join key filter to an intermediate result
+ * on all nodes that run a map task of the given job.
+ */
+static void
+BroadcastJoinKeyFilter(bytea *joinKeyFilter, MapMergeJob *probeJob)
+{
+	List *remoteNodeIdList = NIL;
+	bool writeLocalFile = false;
+	int32 localGroupId = GetLocalGroupId();
+
+	Task *mapTask = NULL;
+	foreach_ptr(mapTask, probeJob->mapTaskList)
+	{
+		/* map tasks only have a single placement */
+		ShardPlacement *taskPlacement = linitial(mapTask->taskPlacementList);
+
+		if (taskPlacement->groupId == localGroupId)
+		{
+			writeLocalFile = true;
+		}
+		else
+		{
+			remoteNodeIdList = list_append_unique_int(remoteNodeIdList,
+													  taskPlacement->nodeId);
+		}
+	}
+
+	List *remoteNodeList = NIL;
+	int remoteNodeId = 0;
+	foreach_int(remoteNodeId, remoteNodeIdList)
+	{
+		remoteNodeList = lappend(remoteNodeList, LookupNodeByNodeIdOrError(remoteNodeId));
+	}
+
+	TupleDesc tupleDescriptor = JoinKeyFilterTupleDesc();
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor, &TTSOpsVirtual);
+	slot->tts_values[0] = PointerGetDatum(joinKeyFilter);
+	slot->tts_isnull[0] = false;
+	ExecStoreVirtualTuple(slot);
+
+	EState *estate = CreateExecutorState();
+	DestReceiver *copyDest =
+		CreateRemoteFileDestReceiver(probeJob->joinKeyFilterResultId, estate,
+									 remoteNodeList, writeLocalFile);
+
+	copyDest->rStartup(copyDest, CMD_SELECT, tupleDescriptor);
+	copyDest->receiveSlot(slot, copyDest);
+	copyDest->rShutdown(copyDest);
+	copyDest->rDestroy(copyDest);
+
+	ExecDropSingleTupleTableSlot(slot);
+	FreeExecutorState(estate);
+}
+
+
+/*
+ * ReadJoinKeyFilter reads the join key filter that the coordinator wrote to
+ * the intermediate result with the given id. It returns NULL if the filter is
+ * empty, which means that no rows should be filtered.
+ */
+bytea *
+ReadJoinKeyFilter(char *resultId)
+{
+	char *fileName = QueryResultFileName(resultId);
+	TupleDesc tupleDescriptor = JoinKeyFilterTupleDesc();
+	char *copyFormat = CanUseBinaryCopyFormat(tupleDescriptor) ? "binary" : "text";
+
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+	ReadFileIntoTupleStore(fileName, copyFormat, tupleDescriptor, tupleStore);
+
+	bytea *joinKeyFilter = NULL;
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor,
+													&TTSOpsMinimalTuple);
+
+	if (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		bool isNull = false;
+		Datum filterDatum = slot_getattr(slot, 1, &isNull);
+		if (!isNull)
+		{
+			joinKeyFilter = DatumGetByteaPCopy(filterDatum);
+		}
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	if (joinKeyFilter == NULL || VARSIZE(joinKeyFilter) == VARHDRSZ)
+	{
+		return NULL;
+	}
+
+	return joinKeyFilter;
+}
+
+
+/*
+ * JoinKeyFilterTupleDesc returns the tuple descriptor of the join key filters
+ * that the workers return and that we broadcast.
+ */
+static TupleDesc
+JoinKeyFilterTupleDesc(void)
+{
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(1);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "join_key_filter",
+					   BYTEAOID, -1, 0);
+
+	return tupleDescriptor;
+}
+
+
+/*
+ * CreateJoinKeyFilterDestReceiver creates a DestReceiver that applies the join
+ * key filter to the given column. If innerDest is NULL, the join keys of all
+ * tuples are added to the filter. Otherwise tuples whose join key might be in
+ * the filter are forwarded to innerDest, and all others are skipped.
+ */
+DestReceiver *
+CreateJoinKeyFilterDestReceiver(DestReceiver *innerDest, int columnIndex,
+								bytea *joinKeyFilter)
+{
+	JoinKeyFilterDestReceiver *filterDest = palloc0(sizeof(JoinKeyFilterDestReceiver));
+
+	/* set up the DestReceiver function pointers */
+	filterDest->pub.receiveSlot = JoinKeyFilterDestReceiverReceive;
+	filterDest->pub.rStartup = JoinKeyFilterDestReceiverStartup;
+	filterDest->pub.rShutdown = JoinKeyFilterDestReceiverShutdown;
+	filterDest->pub.rDestroy = JoinKeyFilterDestReceiverDestroy;
+	filterDest->pub.mydest = DestCopyOut;
+
+	filterDest->innerDest = innerDest;
+	filterDest->columnIndex = columnIndex;
+	filterDest->joinKeyFilter = joinKeyFilter;
+	filterDest->filterBitCount =
+		(uint64) (VARSIZE(joinKeyFilter) - VARHDRSZ) * BITS_PER_BYTE;
+
+	return (DestReceiver *) filterDest;
+}
+
+
+/*
+ * JoinKeyFilterDestReceiverStartup implements the rStartup interface of
+ * JoinKeyFilterDestReceiver. It looks up the hash function of the join key.
+ */
+static void
+JoinKeyFilterDestReceiverStartup(DestReceiver *dest, int operation,
+								 TupleDesc inputTupleDescriptor)
+{
+	JoinKeyFilterDestReceiver *self = (JoinKeyFilterDestReceiver *) dest;
+
+	if (self->columnIndex < 0 || self->columnIndex >= inputTupleDescriptor->natts)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("join key column index must be between 0 and %d",
+							   inputTupleDescriptor->natts - 1)));
+	}
+
+	Form_pg_attribute joinKeyAttr = TupleDescAttr(inputTupleDescriptor,
+												  self->columnIndex);
+	TypeCacheEntry *typeEntry = lookup_type_cache(joinKeyAttr->atttypid,
+												  TYPECACHE_HASH_EXTENDED_PROC_FINFO);
+
+	if (!OidIsValid(typeEntry->hash_extended_proc_finfo.fn_oid))
+	{
+		ereport(ERROR, (errmsg("no extended hash function defined for type %s",
+							   format_type_be(joinKeyAttr->atttypid))));
+	}
+
+	self->hashFunction = palloc0(sizeof(FmgrInfo));
+	fmgr_info_copy(self->hashFunction, &(typeEntry->hash_extended_proc_finfo),
+				   CurrentMemoryContext);
+	self->collation = joinKeyAttr->attcollation;
+
+	if (self->innerDest != NULL)
+	{
+		self->innerDest->rStartup(self->innerDest, operation, inputTupleDescriptor);
+	}
+}
+
+
+/*
+ * JoinKeyFilterDestReceiverReceive implements the receiveSlot interface of
+ * JoinKeyFilterDestReceiver.
+ */
+static bool
+JoinKeyFilterDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
+{
+	JoinKeyFilterDestReceiver *self = (JoinKeyFilterDestReceiver *) dest;
+	uint8 *filterData = (uint8 *) VARDATA(self->joinKeyFilter);
+
+	bool isNull = false;
+	Datum joinKey = slot_getattr(slot, self->columnIndex + 1, &isNull);
+
+	/* NULL join keys never find a join partner */
+	if (isNull)
+	{
+		return true;
+	}
+
+	uint64 hash = DatumGetUInt64(FunctionCall2Coll(self->hashFunction, self->collation,
+												   joinKey, UInt64GetDatum(0)));
+
+	for (int hashIndex = 0; hashIndex < JOIN_KEY_FILTER_HASH_COUNT; hashIndex++)
+	{
+		uint64 bitPosition = JoinKeyFilterBitPosition(hash, hashIndex,
+													  self->filterBitCount);
+		uint8 bitMask = 1 << (bitPosition % BITS_PER_BYTE);
+
+		if (self->innerDest == NULL)
+		{
+			filterData[bitPosition / BITS_PER_BYTE] |= bitMask;
+		}
+		else if ((filterData[bitPosition / BITS_PER_BYTE] & bitMask) == 0)
+		{
+			/* the join key is not in the filter */
+			return true;
+		}
+	}
+
+	if (self->innerDest == NULL)
+	{
+		return true;
+	}
+
+	return self->innerDest->receiveSlot(slot, self->innerDest);
+}
+
+
+/*
+ * JoinKeyFilterDestReceiverShutdown implements the rShutdown interface of
+ * JoinKeyFilterDestReceiver.
+ */
+static void
+JoinKeyFilterDestReceiverShutdown(DestReceiver *dest)
+{
+	JoinKeyFilterDestReceiver *self = (JoinKeyFilterDestReceiver *) dest;
+
+	if (self->innerDest != NULL)
+	{
+		self->innerDest->rShutdown(self->innerDest);
+	}
+}
+
+
+/*
+ * JoinKeyFilterDestReceiverDestroy implements the rDestroy interface of
+ * JoinKeyFilterDestReceiver.
+ */
+static void
+JoinKeyFilterDestReceiverDestroy(DestReceiver *dest)
+{
+	JoinKeyFilterDestReceiver *self = (JoinKeyFilterDestReceiver *) dest;
+
+	if (self->innerDest != NULL)
+	{
+		self->innerDest->rDestroy(self->innerDest);
+	}
+}
+
+
+/*
+ * JoinKeyFilterBitPosition returns the position of the bit for the given
+ * hash function of a join key. We derive the hash functions from the two
+ * halves of the 64-bit hash of the join key, as in double hashing.
+ */
+static uint64
+JoinKeyFilterBitPosition(uint64 hash, int hashIndex, uint64 filterBitCount)
+{
+	uint32 firstHash = (uint32) hash;
+	uint32 secondHash = (uint32) (hash >> 32);
+
+	return ((uint64) firstHash + (uint64) hashIndex * secondHash) % filterBitCount;
+}
@@ -0,0 +1,384 @@
+/*-------------------------------------------------------------------------
+ *
+ * repartition_join_skew.c
+ *	  Handling of heavy hitter join keys in dual repartition joins.
+ *
+ * A dual repartition join sends all rows with the same join key to the same
+ * merge task. When a single join key is very common, the merge task of that
+ * key runs much longer than all others. When
+ * citus.enable_repartition_join_skew_handling is on, we sample the join keys
+ * of the left side of the join before the map tasks run, and broadcast the
+ * keys that are more frequent than the average partition size as heavy
+ * hitters to the workers that run the map tasks of both sides.
+ *
+ * worker_partition_query_result then spreads the rows of the left side whose
+ * join key is a heavy hitter across all partitions in a round-robin fashion,
+ * and sends the rows of the right side whose join key is a heavy hitter to all
+ * partitions. Every pair of matching rows therefore meets in exactly one merge
+ * task. Since repartition joins are always inner joins, replicating the rows
+ * of the right side does not change the results.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/tupdesc.h"
+#include "catalog/pg_type.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/intermediate_results.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/repartition_join_skew.h"
+#include "distributed/tuple_destination.h"
+#include "distributed/worker_manager.h"
+#include "executor/executor.h"
+#include "miscadmin.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/tuplestore.h"
+
+
+/* join keys that occur fewer times in the sample are never heavy hitters */
+#define HEAVY_HITTER_MIN_FREQUENCY 100
+
+
+/* frequency of a join key in the sample of one map task */
+typedef struct SampledJoinKey
+{
+	char *joinKey;
+	int64 frequency;
+} SampledJoinKey;
+
+
+static List * SampleHeavyHitters(MapMergeJob *spreadJob);
+static void BroadcastHeavyHitters(List *heavyHitterList, MapMergeJob *spreadJob,
+								  MapMergeJob *replicateJob);
+static List * MapTaskNodeIdList(MapMergeJob *mapMergeJob, bool *includesLocalNode);
+static TupleDesc HeavyHitterSampleTupleDesc(void);
+static TupleDesc HeavyHitterTupleDesc(void);
+static int CompareSampledJoinKeys(const void *leftElement, const void *rightElement);
+
+
+/*
+ * ExecuteRepartitionJoinSkewHandling samples and broadcasts the heavy hitters
+ * of all dual repartition joins in the job tree for which the planner decided
+ * to handle skew. It should be called before the map tasks are executed.
+ */
+void
+ExecuteRepartitionJoinSkewHandling(Job *job)
+{
+	MapMergeJob *spreadJob = NULL;
+	MapMergeJob *replicateJob = NULL;
+
+	Job *dependentJob = NULL;
+	foreach_ptr(dependentJob, job->dependentJobList)
+	{
+		ExecuteRepartitionJoinSkewHandling(dependentJob);
+
+		if (!CitusIsA(dependentJob, MapMergeJob))
+		{
+			continue;
+		}
+
+		MapMergeJob *mapMergeJob = (MapMergeJob *) dependentJob;
+		if (mapMergeJob->heavyHitterResultId == NULL)
+		{
+			continue;
+		}
+
+		if (mapMergeJob->samplesHeavyHitters)
+		{
+			spreadJob = mapMergeJob;
+		}
+		else
+		{
+			replicateJob = mapMergeJob;
+		}
+	}
+
+	if (spreadJob != NULL && replicateJob != NULL)
+	{
+		List *heavyHitterList = SampleHeavyHitters(spreadJob);
+
+		if (heavyHitterList != NIL)
+		{
+			ereport(DEBUG1, (errmsg("spreading %d heavy hitters of a repartition "
+									"join across %u partitions",
+									list_length(heavyHitterList),
+									spreadJob->partitionCount)));
+		}
+
+		BroadcastHeavyHitters(heavyHitterList, spreadJob, replicateJob);
+	}
+}
+
+
+/*
+ * SampleHeavyHitters executes the sample tasks of the given job and returns
+ * the join keys that make up a larger share of the sampled rows than a single
+ * partition would get if the keys were evenly distributed.
+ */
+static List *
+SampleHeavyHitters(MapMergeJob *spreadJob)
+{
+	TupleDesc tupleDescriptor = HeavyHitterSampleTupleDesc();
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+	TupleDestination *tupleDest = CreateTupleStoreTupleDest(tupleStore,
+															tupleDescriptor);
+	bool expectResults = true;
+
+	ExecuteTaskListIntoTupleDest(ROW_MODIFY_READONLY,
+								 spreadJob->heavyHitterSampleTaskList,
+								 tupleDest, expectResults);
+
+	/* each task returns every key once, collect them to add up the frequencies */
+	int64 sampledKeyCount = tuplestore_tuple_count(tupleStore);
+	SampledJoinKey *sampledKeys = palloc0(Max(sampledKeyCount, 1) *
+										  sizeof(SampledJoinKey));
+	int64 totalFrequency = 0;
+	int64 keyIndex = 0;
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor,
+													&TTSOpsMinimalTuple);
+
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		bool joinKeyIsNull = false;
+		bool frequencyIsNull = false;
+		Datum joinKeyDatum = slot_getattr(slot, 1, &joinKeyIsNull);
+		Datum frequencyDatum = slot_getattr(slot, 2, &frequencyIsNull);
+
+		if (joinKeyIsNull || frequencyIsNull)
+		{
+			continue;
+		}
+
+		sampledKeys[keyIndex].joinKey = TextDatumGetCString(joinKeyDatum);
+		sampledKeys[keyIndex].frequency = DatumGetInt64(frequencyDatum);
+		totalFrequency += sampledKeys[keyIndex].frequency;
+		keyIndex++;
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	sampledKeyCount = keyIndex;
+	SafeQsort(sampledKeys, sampledKeyCount, sizeof(SampledJoinKey),
+			  CompareSampledJoinKeys);
+
+	List *heavyHitterList = NIL;
+	int64 runStart = 0;
+
+	while (runStart < sampledKeyCount)
+	{
+		char *joinKey = sampledKeys[runStart].joinKey;
+		int64 frequency = 0;
+		int64 runEnd = runStart;
+
+		while (runEnd < sampledKeyCount &&
+			   strcmp(sampledKeys[runEnd].joinKey, joinKey) == 0)
+		{
+			frequency += sampledKeys[runEnd].frequency;
+			runEnd++;
+		}
+
+		if (frequency >= HEAVY_HITTER_MIN_FREQUENCY &&
+			frequency * spreadJob->partitionCount > totalFrequency)
+		{
+			heavyHitterList = lappend(heavyHitterList, joinKey);
+		}
+
+		runStart = runEnd;
+	}
+
+	return heavyHitterList;
+}
+
+
+/*
+ * BroadcastHeavyHitters writes the heavy hitters to an intermediate result on
+ * all nodes that run a map task of either side of the join. We also write the
+ * result when there are no heavy hitters, since the map tasks read it.
+ */
+static void
+BroadcastHeavyHitters(List *heavyHitterList, MapMergeJob *spreadJob,
+					  MapMergeJob *replicateJob)
+{
+	bool spreadJobIsLocal = false;
+	bool replicateJobIsLocal = false;
+	List *remoteNodeIdList = MapTaskNodeIdList(spreadJob, &spreadJobIsLocal);
+	remoteNodeIdList = list_concat_unique_int(remoteNodeIdList,
+											  MapTaskNodeIdList(replicateJob,
+																&replicateJobIsLocal));
+	bool writeLocalFile = spreadJobIsLocal || replicateJobIsLocal;
+
+	List *remoteNodeList = NIL;
+	int remoteNodeId = 0;
+	foreach_int(remoteNodeId, remoteNodeIdList)
+	{
+		remoteNodeList = lappend(remoteNodeList, LookupNodeByNodeIdOrError(remoteNodeId));
+	}
+
+	TupleDesc tupleDescriptor = HeavyHitterTupleDesc();
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor, &TTSOpsVirtual);
+
+	EState *estate = CreateExecutorState();
+	DestReceiver *copyDest =
+		CreateRemoteFileDestReceiver(spreadJob->heavyHitterResultId, estate,
+									 remoteNodeList, writeLocalFile);
+
+	copyDest->rStartup(copyDest, CMD_SELECT, tupleDescriptor);
+
+	char *heavyHitter = NULL;
+	foreach_ptr(heavyHitter, heavyHitterList)
+	{
+		ExecClearTuple(slot);
+		slot->tts_values[0] = CStringGetTextDatum(heavyHitter);
+		slot->tts_isnull[0] = false;
+		ExecStoreVirtualTuple(slot);
+
+		copyDest->receiveSlot(slot, copyDest);
+	}
+
+	copyDest->rShutdown(copyDest);
+	copyDest->rDestroy(copyDest);
+
+	ExecDropSingleTupleTableSlot(slot);
+	FreeExecutorState(estate);
+}
+
+
+/*
+ * MapTaskNodeIdList returns the IDs of the remote nodes that run a map task of
+ * the given job, and sets includesLocalNode if the local node runs one.
+ */
+static List *
+MapTaskNodeIdList(MapMergeJob *mapMergeJob, bool *includesLocalNode)
+{
+	List *remoteNodeIdList = NIL;
+	int32 localGroupId = GetLocalGroupId();
+
+	*includesLocalNode = false;
+
+	Task *mapTask = NULL;
+	foreach_ptr(mapTask, mapMergeJob->mapTaskList)
+	{
+		/* map tasks only have a single placement */
+		ShardPlacement *taskPlacement = linitial(mapTask->taskPlacementList);
+
+		if (taskPlacement->groupId == localGroupId)
+		{
+			*includesLocalNode = true;
+		}
+		else
+		{
+			remoteNodeIdList = list_append_unique_int(remoteNodeIdList,
+													  taskPlacement->nodeId);
+		}
+	}
+
+	return remoteNodeIdList;
+}
+
+
+/*
+ * ReadRepartitionJoinHeavyHitters reads the heavy hitters that the coordinator
+ * wrote to the intermediate result with the given id, and returns them as
+ * values of the given type.
+ */
+Datum *
+ReadRepartitionJoinHeavyHitters(char *resultId, Oid typeId, int32 typeMod,
+								int *heavyHitterCount)
+{
+	char *fileName = QueryResultFileName(resultId);
+	TupleDesc tupleDescriptor = HeavyHitterTupleDesc();
+	char *copyFormat = CanUseBinaryCopyFormat(tupleDescriptor) ? "binary" : "text";
+
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+	ReadFileIntoTupleStore(fileName, copyFormat, tupleDescriptor, tupleStore);
+
+	Oid inputFunctionId = InvalidOid;
+	Oid typeIOParam = InvalidOid;
+	getTypeInputInfo(typeId, &inputFunctionId, &typeIOParam);
+
+	Datum *heavyHitterValues = palloc0(Max(tuplestore_tuple_count(tupleStore), 1) *
+									   sizeof(Datum));
+	int valueIndex = 0;
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor,
+													&TTSOpsMinimalTuple);
+
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		bool isNull = false;
+		Datum heavyHitterDatum = slot_getattr(slot, 1, &isNull);
+		if (isNull)
+		{
+			continue;
+		}
+
+		char *heavyHitter = TextDatumGetCString(heavyHitterDatum);
+		heavyHitterValues[valueIndex++] = OidInputFunctionCall(inputFunctionId,
+															   heavyHitter,
+															   typeIOParam, typeMod);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	*heavyHitterCount = valueIndex;
+
+	return heavyHitterValues;
+}
+
+
+/*
+ * HeavyHitterSampleTupleDesc returns the tuple descriptor of the results of
+ * the sample tasks.
+ */
+static TupleDesc
+HeavyHitterSampleTupleDesc(void)
+{
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(2);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "join_key",
+					   TEXTOID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 2, "frequency",
+					   INT8OID, -1, 0);
+
+	return tupleDescriptor;
+}
+
+
+/*
+ * HeavyHitterTupleDesc returns the tuple descriptor of the heavy hitters that
+ * we broadcast.
+ */
+static TupleDesc
+HeavyHitterTupleDesc(void)
+{
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(1);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "heavy_hitter",
+					   TEXTOID, -1, 0);
+
+	return tupleDescriptor;
+}
+
+
+/*
+ * CompareSampledJoinKeys is a comparison function for sorting sampled join
+ * keys by their text representation.
+ */
+static int
+CompareSampledJoinKeys(const void *leftElement, const void *rightElement)
+{
+	const SampledJoinKey *leftKey = (const SampledJoinKey *) leftElement;
+	const SampledJoinKey *rightKey = (const SampledJoinKey *) rightElement;
+
+	return strcmp(leftKey->joinKey, rightKey->joinKey);
+}
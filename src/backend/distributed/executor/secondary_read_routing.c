@@ -0,0 +1,335 @@
+/*-------------------------------------------------------------------------
+ *
+ * secondary_read_routing.c
+ *	  Routing of read-only tasks to secondary nodes that have replayed the
+ *	  writes of the current session.
+ *
+ * When citus.use_secondary_nodes is set to 'caught_up', writes go to the
+ * primary nodes as usual and we learn the WAL position of each primary right
+ * after our remote transactions commit there. Read-only tasks that run outside
+ * of a transaction block are sent to a secondary of the same group if the
+ * secondary's replay position, as last observed by this backend, is past the
+ * position of our latest write to the primary. Otherwise, we ask the secondary
+ * for its replay position once per statement, and fall back to the primary if
+ * it is still behind.
+ *
+ * This gives read-your-writes consistency within a session, while letting
+ * most reads go to the secondaries.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "libpq-fe.h"
+#include "miscadmin.h"
+
+#include "access/xact.h"
+#include "access/xlogdefs.h"
+#include "distributed/connection_management.h"
+#include "distributed/hash_helpers.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/remote_commands.h"
+#include "distributed/secondary_read_routing.h"
+#include "distributed/worker_manager.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+
+/* command we use to learn how far a secondary has replayed the WAL */
+#define REPLAY_WAL_POSITION_COMMAND "SELECT pg_catalog.pg_last_wal_replay_lsn()"
+
+
+/*
+ * NodeAddress identifies a node by its name and port. We cannot use the node
+ * id for the write positions, since they are recorded while committing, where
+ * we should not access the metadata.
+ */
+typedef struct NodeAddress
+{
+	char nodeName[WORKER_LENGTH];
+	int32 nodePort;
+} NodeAddress;
+assert_valid_hash_key2(NodeAddress, nodeName, nodePort);
+
+
+/* position of the latest write of this backend to a primary node */
+typedef struct NodeWritePosition
+{
+	NodeAddress key;
+	XLogRecPtr writePosition;
+} NodeWritePosition;
+
+
+/* replay position of a secondary node, as last observed by this backend */
+typedef struct NodeReplayPosition
+{
+	uint32 nodeId;
+	XLogRecPtr replayPosition;
+	TimestampTz observedAt;
+} NodeReplayPosition;
+
+
+static void EnsureReadRoutingHashesExist(void);
+static bool ParseWalPosition(const char *walPositionString, XLogRecPtr *walPosition);
+static XLogRecPtr NodeWritePositionFor(WorkerNode *primaryNode);
+static bool SecondaryCaughtUp(WorkerNode *secondaryNode, XLogRecPtr writePosition);
+static bool FetchReplayPosition(WorkerNode *secondaryNode, XLogRecPtr *replayPosition);
+
+
+/* session-lifetime hashes, allocated in ReadRoutingContext */
+static MemoryContext ReadRoutingContext = NULL;
+static HTAB *NodeWritePositionHash = NULL;
+static HTAB *NodeReplayPositionHash = NULL;
+
+
+/*
+ * ReadFromCaughtUpSecondaries returns true if citus.use_secondary_nodes is
+ * set to 'caught_up'.
+ */
+bool
+ReadFromCaughtUpSecondaries(void)
+{
+	return ReadFromSecondaries == USE_SECONDARY_NODES_CAUGHT_UP;
+}
+
+
+/*
+ * EnsureReadRoutingHashesExist creates the session-lifetime hashes to keep
+ * track of write and replay positions, unless they already exist.
+ */
+static void
+EnsureReadRoutingHashesExist(void)
+{
+	if (ReadRoutingContext != NULL)
+	{
+		return;
+	}
+
+	ReadRoutingContext = AllocSetContextCreate(TopMemoryContext,
+											   "Secondary Read Routing Context",
+											   ALLOCSET_SMALL_SIZES);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(ReadRoutingContext);
+
+	NodeWritePositionHash = CreateSimpleHashWithName(NodeAddress, NodeWritePosition,
+													 "Node Write Position Hash");
+	NodeReplayPositionHash = CreateSimpleHashWithName(uint32, NodeReplayPosition,
+													  "Node Replay Position Hash");
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * RecordNodeWritePosition remembers the WAL position the given primary node
+ * returned right after one of our transactions committed there, as text.
+ *
+ * The function is called while committing, so it avoids throwing errors for
+ * unexpected input and simply ignores it.
+ */
+void
+RecordNodeWritePosition(const char *nodeName, int nodePort,
+						const char *walPositionString)
+{
+	XLogRecPtr walPosition = InvalidXLogRecPtr;
+	if (!ParseWalPosition(walPositionString, &walPosition))
+	{
+		return;
+	}
+
+	EnsureReadRoutingHashesExist();
+
+	NodeAddress key;
+	memset(&key, 0, sizeof(key));
+	strlcpy(key.nodeName, nodeName, WORKER_LENGTH);
+	key.nodePort = nodePort;
+
+	bool found = false;
+	NodeWritePosition *entry = hash_search(NodeWritePositionHash, &key,
+										   HASH_ENTER, &found);
+	if (!found || entry->writePosition < walPosition)
+	{
+		entry->writePosition = walPosition;
+	}
+}
+
+
+/*
+ * ParseWalPosition parses a WAL position in the pg_lsn text format without
+ * throwing errors. It returns false if the string is not a valid position.
+ */
+static bool
+ParseWalPosition(const char *walPositionString, XLogRecPtr *walPosition)
+{
+	if (walPositionString == NULL)
+	{
+		return false;
+	}
+
+	char *highEnd = NULL;
+	unsigned long high = strtoul(walPositionString, &highEnd, 16);
+	if (highEnd == walPositionString || *highEnd != '/' || high > PG_UINT32_MAX)
+	{
+		return false;
+	}
+
+	const char *lowString = highEnd + 1;
+	char *lowEnd = NULL;
+	unsigned long low = strtoul(lowString, &lowEnd, 16);
+	if (lowEnd == lowString || *lowEnd != '\0' || low > PG_UINT32_MAX)
+	{
+		return false;
+	}
+
+	*walPosition = ((uint64) high << 32) | (uint64) low;
+
+	return true;
+}
+
+
+/*
+ * CaughtUpSecondaryNodeForGroup returns an active secondary node in the given
+ * group, which has replayed all of our writes to the primary node of the group.
+ * It returns NULL if there is no such secondary, in which case the caller
+ * should read from the primary.
+ */
+WorkerNode *
+CaughtUpSecondaryNodeForGroup(int32 groupId, WorkerNode *primaryNode)
+{
+	if (groupId == GetLocalGroupId())
+	{
+		/* local writes are not tracked, keep reading from the local node */
+		return NULL;
+	}
+
+	EnsureReadRoutingHashesExist();
+
+	XLogRecPtr writePosition = NodeWritePositionFor(primaryNode);
+
+	HTAB *workerNodeHash = GetWorkerNodeHash();
+	HASH_SEQ_STATUS status;
+	WorkerNode *workerNode = NULL;
+
+	hash_seq_init(&status, workerNodeHash);
+
+	while ((workerNode = hash_seq_search(&status)) != NULL)
+	{
+		if (workerNode->groupId != groupId || !workerNode->isActive ||
+			!NodeIsSecondary(workerNode))
+		{
+			continue;
+		}
+
+		if (SecondaryCaughtUp(workerNode, writePosition))
+		{
+			hash_seq_term(&status);
+			return workerNode;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * NodeWritePositionFor returns the position of our latest write to the given
+ * primary node, or InvalidXLogRecPtr if we did not write to it.
+ */
+static XLogRecPtr
+NodeWritePositionFor(WorkerNode *primaryNode)
+{
+	NodeAddress key;
+	memset(&key, 0, sizeof(key));
+	strlcpy(key.nodeName, primaryNode->workerName, WORKER_LENGTH);
+	key.nodePort = primaryNode->workerPort;
+
+	bool found = false;
+	NodeWritePosition *entry = hash_search(NodeWritePositionHash, &key,
+										   HASH_FIND, &found);
+
+	return found ? entry->writePosition : InvalidXLogRecPtr;
+}
+
+
+/*
+ * SecondaryCaughtUp returns whether the given secondary has replayed the WAL
+ * up to writePosition. We first check the replay position we observed most
+ * recently, and only ask the secondary again if that is not enough and we did
+ * not already ask during the current statement.
+ */
+static bool
+SecondaryCaughtUp(WorkerNode *secondaryNode, XLogRecPtr writePosition)
+{
+	bool found = false;
+	NodeReplayPosition *entry = hash_search(NodeReplayPositionHash,
+											&secondaryNode->nodeId,
+											HASH_ENTER, &found);
+	if (!found)
+	{
+		entry->replayPosition = InvalidXLogRecPtr;
+		entry->observedAt = 0;
+	}
+
+	if (entry->observedAt != 0 && entry->replayPosition >= writePosition)
+	{
+		return true;
+	}
+
+	if (entry->observedAt >= GetCurrentStatementStartTimestamp())
+	{
+		/* we already asked during this statement, and it was behind */
+		return false;
+	}
+
+	XLogRecPtr replayPosition = InvalidXLogRecPtr;
+	if (!FetchReplayPosition(secondaryNode, &replayPosition))
+	{
+		return false;
+	}
+
+	entry->replayPosition = replayPosition;
+	entry->observedAt = GetCurrentTimestamp();
+
+	return replayPosition >= writePosition;
+}
+
+
+/*
+ * FetchReplayPosition asks the given secondary how far it replayed the WAL.
+ * The connection is cached, hence the executor reuses it for the read that
+ * follows. The function returns false if the position could not be fetched.
+ */
+static bool
+FetchReplayPosition(WorkerNode *secondaryNode, XLogRecPtr *replayPosition)
+{
+	int connectionFlags = 0;
+	PGresult *result = NULL;
+	bool positionFetched = false;
+
+	MultiConnection *connection =
+		GetNodeUserDatabaseConnection(connectionFlags, secondaryNode->workerName,
+									  secondaryNode->workerPort, NULL, NULL);
+
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		return false;
+	}
+
+	int queryResult = ExecuteOptionalRemoteCommand(connection,
+												   REPLAY_WAL_POSITION_COMMAND,
+												   &result);
+	if (queryResult == RESPONSE_OKAY && PQntuples(result) == 1 &&
+		!PQgetisnull(result, 0, 0))
+	{
+		positionFetched = ParseWalPosition(PQgetvalue(result, 0, 0), replayPosition);
+	}
+
+	PQclear(result);
+	ForgetResults(connection);
+
+	return positionFetched;
+}
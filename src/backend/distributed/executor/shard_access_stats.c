@@ -0,0 +1,379 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_access_stats.c
+ *
+ * Routines for counting the queries, rows and execution time of the tasks
+ * that the adaptive executor runs on the placements of each shard. The
+ * counts are kept in shared memory and halved periodically by the
+ * maintenance daemon, such that they reflect the load of each shard over
+ * the last minutes. The by_load rebalance strategy uses them as its shard
+ * cost, which spreads the shards that are queried a lot over the nodes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "access/hash.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/hsearch.h"
+
+#include "distributed/metadata_cache.h"
+#include "distributed/relay_utility.h"
+#include "distributed/shard_access_stats.h"
+#include "distributed/tuplestore.h"
+
+
+#define SHARD_ACCESS_STATS_COLUMNS 4
+
+/* entries whose decayed query count drops below this are removed */
+#define SHARD_ACCESS_STATS_MIN_QUERY_COUNT 0.5
+
+
+/*
+ * ShardAccessStatsKey identifies a shard across all databases.
+ */
+typedef struct ShardAccessStatsKey
+{
+	Oid databaseId;
+	uint64 shardId;
+} ShardAccessStatsKey;
+
+
+/*
+ * ShardAccessStatsEntry is the shared memory hash entry holding the decayed
+ * statistics of a shard. The statistics are protected by the mutex, such that
+ * backends only need a shared lock on the hash to update existing entries.
+ */
+typedef struct ShardAccessStatsEntry
+{
+	ShardAccessStatsKey key;
+	slock_t mutex;
+	ShardAccessStats stats;
+} ShardAccessStatsEntry;
+
+
+/*
+ * ShardAccessStatsControlData holds the lock protecting the hash.
+ */
+typedef struct ShardAccessStatsControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+} ShardAccessStatsControlData;
+
+
+/* GUC, maximum number of shards whose accesses are counted, 0 to disable */
+int StatShardAccessMax = 10000;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static ShardAccessStatsControlData *ShardAccessStatsControl = NULL;
+static HTAB *ShardAccessStatsHash = NULL;
+
+
+PG_FUNCTION_INFO_V1(citus_shard_access_stats);
+
+
+/*
+ * InitializeShardAccessStats requests the shared memory for the shard access
+ * statistics and sets the hook that initializes it.
+ */
+void
+InitializeShardAccessStats(void)
+{
+	/* On PG 15 and above, we use shmem_request_hook_type */
+	#if PG_VERSION_NUM < PG_VERSION_15
+
+	/* allocate shared memory for pre PG-15 versions */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(ShardAccessStatsShmemSize());
+	}
+
+	#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ShardAccessStatsShmemInit;
+}
+
+
+/*
+ * ShardAccessStatsShmemSize returns the size of the shared memory used for
+ * the shard access statistics.
+ */
+size_t
+ShardAccessStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(ShardAccessStatsControlData));
+
+	if (StatShardAccessMax > 0)
+	{
+		size = add_size(size, hash_estimate_size(StatShardAccessMax,
+												 sizeof(ShardAccessStatsEntry)));
+	}
+
+	return size;
+}
+
+
+/*
+ * ShardAccessStatsShmemInit initializes the shared memory used for the shard
+ * access statistics.
+ */
+void
+ShardAccessStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL hashInfo;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ShardAccessStatsControl =
+		(ShardAccessStatsControlData *) ShmemInitStruct("Citus Shard Access Stats",
+														sizeof(
+															ShardAccessStatsControlData),
+														&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		ShardAccessStatsControl->trancheId = LWLockNewTrancheId();
+		ShardAccessStatsControl->lockTrancheName = "Citus Shard Access Stats";
+		LWLockRegisterTranche(ShardAccessStatsControl->trancheId,
+							  ShardAccessStatsControl->lockTrancheName);
+
+		LWLockInitialize(&ShardAccessStatsControl->lock,
+						 ShardAccessStatsControl->trancheId);
+	}
+
+	if (StatShardAccessMax > 0)
+	{
+		memset(&hashInfo, 0, sizeof(hashInfo));
+		hashInfo.keysize = sizeof(ShardAccessStatsKey);
+		hashInfo.entrysize = sizeof(ShardAccessStatsEntry);
+		hashInfo.hash = tag_hash;
+		int hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+		ShardAccessStatsHash = ShmemInitHash("Citus Shard Access Stats Hash",
+											 StatShardAccessMax,
+											 StatShardAccessMax,
+											 &hashInfo, hashFlags);
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * RecordShardAccess adds a task that ran on a placement of the given shard to
+ * the statistics of the shard. Tasks are not counted when the statistics of
+ * citus.stat_shard_access_max shards are kept already.
+ */
+void
+RecordShardAccess(uint64 shardId, uint64 rowCount, uint64 executionTimeMicrosecs)
+{
+	ShardAccessStatsKey key;
+	bool found = false;
+
+	if (ShardAccessStatsHash == NULL || shardId == INVALID_SHARD_ID)
+	{
+		return;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.databaseId = MyDatabaseId;
+	key.shardId = shardId;
+
+	LWLockAcquire(&ShardAccessStatsControl->lock, LW_SHARED);
+
+	ShardAccessStatsEntry *entry =
+		(ShardAccessStatsEntry *) hash_search(ShardAccessStatsHash, &key, HASH_FIND,
+											  &found);
+	if (entry == NULL)
+	{
+		/* need an exclusive lock to add the entry */
+		LWLockRelease(&ShardAccessStatsControl->lock);
+		LWLockAcquire(&ShardAccessStatsControl->lock, LW_EXCLUSIVE);
+
+		entry = (ShardAccessStatsEntry *) hash_search(ShardAccessStatsHash, &key,
+													  HASH_ENTER_NULL, &found);
+		if (entry != NULL && !found)
+		{
+			SpinLockInit(&entry->mutex);
+			memset(&entry->stats, 0, sizeof(ShardAccessStats));
+		}
+	}
+
+	if (entry != NULL)
+	{
+		volatile ShardAccessStatsEntry *e = (volatile ShardAccessStatsEntry *) entry;
+
+		SpinLockAcquire(&e->mutex);
+		e->stats.queryCount += 1;
+		e->stats.rowCount += rowCount;
+		e->stats.executionTimeMs += executionTimeMicrosecs / 1000.0;
+		SpinLockRelease(&e->mutex);
+	}
+
+	LWLockRelease(&ShardAccessStatsControl->lock);
+}
+
+
+/*
+ * GetShardAccessStats copies the statistics of the given shard into stats and
+ * returns true, or returns false if no accesses of the shard were counted.
+ */
+bool
+GetShardAccessStats(uint64 shardId, ShardAccessStats *stats)
+{
+	ShardAccessStatsKey key;
+	bool found = false;
+
+	if (ShardAccessStatsHash == NULL)
+	{
+		return false;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.databaseId = MyDatabaseId;
+	key.shardId = shardId;
+
+	LWLockAcquire(&ShardAccessStatsControl->lock, LW_SHARED);
+
+	ShardAccessStatsEntry *entry =
+		(ShardAccessStatsEntry *) hash_search(ShardAccessStatsHash, &key, HASH_FIND,
+											  &found);
+	if (entry != NULL)
+	{
+		volatile ShardAccessStatsEntry *e = (volatile ShardAccessStatsEntry *) entry;
+
+		SpinLockAcquire(&e->mutex);
+		stats->queryCount = e->stats.queryCount;
+		stats->rowCount = e->stats.rowCount;
+		stats->executionTimeMs = e->stats.executionTimeMs;
+		SpinLockRelease(&e->mutex);
+	}
+
+	LWLockRelease(&ShardAccessStatsControl->lock);
+
+	return entry != NULL;
+}
+
+
+/*
+ * DecayShardAccessStats halves the statistics of the shards in the current
+ * database, such that they reflect recent load, and removes the shards that
+ * are barely accessed anymore. Dropped shards therefore disappear after a
+ * while, too.
+ */
+void
+DecayShardAccessStats(void)
+{
+	HASH_SEQ_STATUS status;
+
+	if (ShardAccessStatsHash == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&ShardAccessStatsControl->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, ShardAccessStatsHash);
+
+	ShardAccessStatsEntry *entry = NULL;
+	while ((entry = (ShardAccessStatsEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (entry->key.databaseId != MyDatabaseId)
+		{
+			continue;
+		}
+
+		/* no spinlock needed, we hold the lock exclusively */
+		entry->stats.queryCount /= 2;
+		entry->stats.rowCount /= 2;
+		entry->stats.executionTimeMs /= 2;
+
+		if (entry->stats.queryCount < SHARD_ACCESS_STATS_MIN_QUERY_COUNT)
+		{
+			hash_search(ShardAccessStatsHash, &entry->key, HASH_REMOVE, NULL);
+		}
+	}
+
+	LWLockRelease(&ShardAccessStatsControl->lock);
+}
+
+
+/*
+ * citus_shard_access_stats returns the decayed query count, row count and
+ * execution time in milliseconds of the tasks that ran on the placements of
+ * the shards in the current database.
+ */
+Datum
+citus_shard_access_stats(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	if (ShardAccessStatsHash == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	LWLockAcquire(&ShardAccessStatsControl->lock, LW_SHARED);
+
+	HASH_SEQ_STATUS status;
+	hash_seq_init(&status, ShardAccessStatsHash);
+
+	ShardAccessStatsEntry *entry = NULL;
+	while ((entry = (ShardAccessStatsEntry *) hash_seq_search(&status)) != NULL)
+	{
+		Datum values[SHARD_ACCESS_STATS_COLUMNS];
+		bool isNulls[SHARD_ACCESS_STATS_COLUMNS];
+		ShardAccessStats stats;
+
+		if (entry->key.databaseId != MyDatabaseId)
+		{
+			continue;
+		}
+
+		volatile ShardAccessStatsEntry *e = (volatile ShardAccessStatsEntry *) entry;
+
+		SpinLockAcquire(&e->mutex);
+		stats.queryCount = e->stats.queryCount;
+		stats.rowCount = e->stats.rowCount;
+		stats.executionTimeMs = e->stats.executionTimeMs;
+		SpinLockRelease(&e->mutex);
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = Int64GetDatum(entry->key.shardId);
+		values[1] = Float8GetDatum(stats.queryCount);
+		values[2] = Float8GetDatum(stats.rowCount);
+		values[3] = Float8GetDatum(stats.executionTimeMs);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&ShardAccessStatsControl->lock);
+
+	PG_RETURN_VOID();
+}
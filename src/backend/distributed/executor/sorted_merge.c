@@ -0,0 +1,578 @@
+/*-------------------------------------------------------------------------
+ *
+ * sorted_merge.c
+ *	  Routines for merging the sorted results of the tasks of a distributed
+ *	  query on the coordinator.
+ *
+ * When the workers sort the rows in the same order as the combine query,
+ * each task returns an already sorted stream of rows. Rather than collecting
+ * the rows of all the tasks in a single tuple store and sorting them again
+ * in the combine query, we keep the rows of each task in a tuple store of
+ * its own and return them in order by repeatedly taking the smallest of the
+ * first rows of the tasks from a binary heap, similar to MergeAppend.
+ *
+ * Similarly, when the workers sort their groups by the GROUP BY keys, the
+ * merged rows reach the combine query grouped by those keys, such that it
+ * can combine the partial aggregates of adjacent rows with a GroupAggregate
+ * whose memory use does not depend on the number of groups.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "distributed/listutils.h"
+#include "distributed/sorted_merge.h"
+#include "distributed/tuple_destination.h"
+#include "executor/executor.h"
+#include "lib/binaryheap.h"
+#include "optimizer/optimizer.h"
+#include "utils/sortsupport.h"
+
+
+/*
+ * SortedMergeSource is the TupleDestination of a single task of the merge,
+ * which keeps the rows of the task until the merge returns them.
+ */
+typedef struct SortedMergeSource
+{
+	TupleDestination pub;
+
+	/* tuple store destination that holds the rows of the task */
+	Tuplestorestate *tupleStore;
+	TupleDestination *tupleStoreDest;
+
+	/* first row of the task that the merge did not return yet, if any */
+	TupleTableSlot *slot;
+
+	/* whether the task finished, such that no more rows will arrive */
+	bool taskFinished;
+
+	/* whether the slot holds a row, in which case the source is in the heap */
+	bool inHeap;
+} SortedMergeSource;
+
+
+/*
+ * SortedMergeState describes the merge of the sorted rows of a set of tasks.
+ */
+struct SortedMergeState
+{
+	TupleDesc tupleDescriptor;
+
+	/* destination whose size limits the sources share */
+	TupleDestination *defaultTupleDest;
+
+	/* the sort keys of the combine query */
+	int sortKeyCount;
+	SortSupport sortKeys;
+
+	/* one source per task */
+	int sourceCount;
+	SortedMergeSource **sources;
+
+	/* indexes of the sources whose first row is known */
+	binaryheap *heap;
+
+	/* whether all the tasks finished, such that no more rows will arrive */
+	bool executionFinished;
+};
+
+
+/* GUC, determines whether we merge sorted task results on the coordinator */
+bool EnableSortedMerge = false;
+
+/* GUC, determines whether the workers sort groups to merge them on the coordinator */
+bool EnableSortedMergeAggregation = false;
+
+
+static void SortedMergeSourcePutTuple(TupleDestination *self, Task *task,
+									  int placementIndex, int queryNumber,
+									  HeapTuple heapTuple, uint64 tupleLibpqSize);
+static TupleDesc SortedMergeSourceTupleDescForQuery(TupleDestination *self,
+													int queryNumber);
+static List * WorkerSortedMergeClauseList(List *combineClauseList, Query *combineQuery,
+										  Query *workerQuery);
+static int RemoteScanColumnNumber(List *targetList, TargetEntry *targetEntry);
+static bool FillSortedMergeHeap(SortedMergeState *mergeState);
+static bool ReadSortedMergeSource(SortedMergeSource *source);
+static int CompareSortedMergeSources(Datum a, Datum b, void *arg);
+
+
+/*
+ * SortedMergeClauseList returns the sort clauses of the combine query if the
+ * rows of the tasks of the worker query are already sorted in that order,
+ * such that the CustomScan can merge them instead of the combine query
+ * sorting all the rows. In the returned clauses, tleSortGroupRef holds the
+ * number of the column of the CustomScan that the clause sorts by.
+ *
+ * For a combine query with a GROUP BY, the function instead returns its group
+ * clauses in the same form if the worker query sorts its groups by them.
+ *
+ * Otherwise, the function returns NIL.
+ */
+List *
+SortedMergeClauseList(Query *combineQuery, Query *workerQuery)
+{
+	if (combineQuery == NULL)
+	{
+		return NIL;
+	}
+
+	if (combineQuery->groupClause != NIL)
+	{
+		if (!EnableSortedMergeAggregation)
+		{
+			return NIL;
+		}
+
+		/* the rows should reach the grouping as they come from the CustomScan */
+		if (combineQuery->groupingSets != NIL || combineQuery->hasWindowFuncs ||
+			combineQuery->hasTargetSRFs || combineQuery->jointree == NULL ||
+			combineQuery->jointree->quals != NULL ||
+			list_length(combineQuery->rtable) != 1)
+		{
+			return NIL;
+		}
+
+		return WorkerSortedMergeClauseList(combineQuery->groupClause, combineQuery,
+										   workerQuery);
+	}
+
+	if (!EnableSortedMerge || combineQuery->sortClause == NIL)
+	{
+		return NIL;
+	}
+
+	/* the rows should reach the sort as they come from the CustomScan */
+	if (combineQuery->groupClause != NIL || combineQuery->groupingSets != NIL ||
+		combineQuery->distinctClause != NIL || combineQuery->havingQual != NULL ||
+		combineQuery->hasAggs || combineQuery->hasWindowFuncs ||
+		combineQuery->hasTargetSRFs || combineQuery->jointree == NULL ||
+		combineQuery->jointree->quals != NULL ||
+		list_length(combineQuery->rtable) != 1)
+	{
+		return NIL;
+	}
+
+	return WorkerSortedMergeClauseList(combineQuery->sortClause, combineQuery,
+									   workerQuery);
+}
+
+
+/*
+ * WorkerSortedMergeClauseList returns the given sort or group clauses of the
+ * combine query, with tleSortGroupRef set to the column of the CustomScan,
+ * if they are a prefix of the sort clauses of the worker query. Otherwise,
+ * the function returns NIL.
+ */
+static List *
+WorkerSortedMergeClauseList(List *combineClauseList, Query *combineQuery,
+							Query *workerQuery)
+{
+	/* the clauses of the combine query should be a prefix of the worker's */
+	if (list_length(workerQuery->sortClause) < list_length(combineClauseList))
+	{
+		return NIL;
+	}
+
+	List *sortClauseList = NIL;
+
+	ListCell *combineSortCell = NULL;
+	ListCell *workerSortCell = NULL;
+	forboth(combineSortCell, combineClauseList,
+			workerSortCell, workerQuery->sortClause)
+	{
+		SortGroupClause *combineSortClause = lfirst(combineSortCell);
+		SortGroupClause *workerSortClause = lfirst(workerSortCell);
+
+		TargetEntry *combineTargetEntry =
+			get_sortgroupclause_tle(combineSortClause, combineQuery->targetList);
+		TargetEntry *workerTargetEntry =
+			get_sortgroupclause_tle(workerSortClause, workerQuery->targetList);
+
+		if (!IsA(combineTargetEntry->expr, Var) || workerTargetEntry->resjunk)
+		{
+			return NIL;
+		}
+
+		Var *column = (Var *) combineTargetEntry->expr;
+		if (column->varlevelsup != 0 ||
+			column->varattno != RemoteScanColumnNumber(workerQuery->targetList,
+													   workerTargetEntry))
+		{
+			return NIL;
+		}
+
+		if (!OidIsValid(combineSortClause->sortop) ||
+			combineSortClause->sortop != workerSortClause->sortop ||
+			combineSortClause->nulls_first != workerSortClause->nulls_first)
+		{
+			return NIL;
+		}
+
+		SortGroupClause *sortClause = copyObject(combineSortClause);
+		sortClause->tleSortGroupRef = column->varattno;
+
+		sortClauseList = lappend(sortClauseList, sortClause);
+	}
+
+	return sortClauseList;
+}
+
+
+/*
+ * RemoteScanColumnNumber returns the number of the column of the CustomScan
+ * for the given entry of the worker target list, which skips the junk entries
+ * the same way as RemoteScanTargetList.
+ */
+static int
+RemoteScanColumnNumber(List *targetList, TargetEntry *targetEntry)
+{
+	int columnNumber = 0;
+
+	TargetEntry *currentTargetEntry = NULL;
+	foreach_ptr(currentTargetEntry, targetList)
+	{
+		if (currentTargetEntry->resjunk)
+		{
+			continue;
+		}
+
+		columnNumber++;
+
+		if (currentTargetEntry == targetEntry)
+		{
+			return columnNumber;
+		}
+	}
+
+	return InvalidAttrNumber;
+}
+
+
+/*
+ * CreateSortedMergeState creates the state for merging rows with the given
+ * tuple descriptor by the sort clauses that SortedMergeClauseList returned.
+ */
+SortedMergeState *
+CreateSortedMergeState(List *sortClauseList, TupleDesc tupleDescriptor,
+					   TupleDestination *defaultTupleDest)
+{
+	SortedMergeState *mergeState = palloc0(sizeof(SortedMergeState));
+	mergeState->tupleDescriptor = tupleDescriptor;
+	mergeState->defaultTupleDest = defaultTupleDest;
+	mergeState->sortKeyCount = list_length(sortClauseList);
+	mergeState->sortKeys = palloc0(mergeState->sortKeyCount * sizeof(SortSupportData));
+
+	int sortKeyIndex = 0;
+	SortGroupClause *sortClause = NULL;
+	foreach_ptr(sortClause, sortClauseList)
+	{
+		SortSupport sortKey = &mergeState->sortKeys[sortKeyIndex];
+		AttrNumber columnNumber = (AttrNumber) sortClause->tleSortGroupRef;
+
+		sortKey->ssup_cxt = CurrentMemoryContext;
+		sortKey->ssup_collation =
+			TupleDescAttr(tupleDescriptor, columnNumber - 1)->attcollation;
+		sortKey->ssup_nulls_first = sortClause->nulls_first;
+		sortKey->ssup_attno = columnNumber;
+		sortKey->abbreviate = false;
+
+		PrepareSortSupportFromOrderingOp(sortClause->sortop, sortKey);
+
+		sortKeyIndex++;
+	}
+
+	return mergeState;
+}
+
+
+/*
+ * SortedMergeTaskList returns copies of the given tasks that write their rows
+ * to a source of the merge. We copy the tasks to not modify the plan.
+ */
+List *
+SortedMergeTaskList(SortedMergeState *mergeState, List *taskList)
+{
+	List *mergeTaskList = NIL;
+	bool randomAccess = false;
+	bool interTransactions = false;
+
+	mergeState->sourceCount = list_length(taskList);
+	mergeState->sources =
+		palloc0(Max(mergeState->sourceCount, 1) * sizeof(SortedMergeSource *));
+	mergeState->heap = binaryheap_allocate(Max(mergeState->sourceCount, 1),
+										   CompareSortedMergeSources, mergeState);
+
+	int sourceIndex = 0;
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		SortedMergeSource *source = palloc0(sizeof(SortedMergeSource));
+
+		source->pub.putTuple = SortedMergeSourcePutTuple;
+		source->pub.tupleDescForQuery = SortedMergeSourceTupleDescForQuery;
+
+		/* enforce citus.max_intermediate_result_size across all the sources */
+		source->pub.tupleDestinationStats =
+			mergeState->defaultTupleDest->tupleDestinationStats;
+
+		source->tupleStore =
+			tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
+
+		/* rows that the merge returned can be removed from the tuple store */
+		tuplestore_set_eflags(source->tupleStore, 0);
+
+		source->tupleStoreDest = CreateTupleStoreTupleDest(source->tupleStore,
+														   mergeState->tupleDescriptor);
+		source->tupleStoreDest->tupleDestinationStats =
+			source->pub.tupleDestinationStats;
+
+		source->slot = MakeSingleTupleTableSlot(mergeState->tupleDescriptor,
+												&TTSOpsMinimalTuple);
+
+		mergeState->sources[sourceIndex] = source;
+		sourceIndex++;
+
+		Task *mergeTask = palloc(sizeof(Task));
+		*mergeTask = *task;
+		mergeTask->tupleDest = &source->pub;
+
+		mergeTaskList = lappend(mergeTaskList, mergeTask);
+	}
+
+	return mergeTaskList;
+}
+
+
+/*
+ * SortedMergeSourcePutTuple implements TupleDestination->putTuple for
+ * SortedMergeSource.
+ */
+static void
+SortedMergeSourcePutTuple(TupleDestination *self, Task *task,
+						  int placementIndex, int queryNumber,
+						  HeapTuple heapTuple, uint64 tupleLibpqSize)
+{
+	SortedMergeSource *source = (SortedMergeSource *) self;
+	TupleDestination *tupleStoreDest = source->tupleStoreDest;
+
+	tupleStoreDest->putTuple(tupleStoreDest, task, placementIndex, queryNumber,
+							 heapTuple, tupleLibpqSize);
+}
+
+
+/*
+ * SortedMergeSourceTupleDescForQuery implements TupleDestination->tupleDescForQuery
+ * for SortedMergeSource.
+ */
+static TupleDesc
+SortedMergeSourceTupleDescForQuery(TupleDestination *self, int queryNumber)
+{
+	SortedMergeSource *source = (SortedMergeSource *) self;
+	TupleDestination *tupleStoreDest = source->tupleStoreDest;
+
+	return tupleStoreDest->tupleDescForQuery(tupleStoreDest, queryNumber);
+}
+
+
+/*
+ * SortedMergeTaskFinished records that the given task, as returned by
+ * SortedMergeTaskList, will not return any more rows.
+ */
+void
+SortedMergeTaskFinished(SortedMergeState *mergeState, Task *task)
+{
+	TupleDestination *tupleDest = task->tupleDest;
+
+	if (tupleDest == NULL || tupleDest->putTuple != SortedMergeSourcePutTuple)
+	{
+		/* not a task of the merge */
+		return;
+	}
+
+	((SortedMergeSource *) tupleDest)->taskFinished = true;
+}
+
+
+/*
+ * SortedMergeExecutionFinished records that none of the tasks will return
+ * any more rows.
+ */
+void
+SortedMergeExecutionFinished(SortedMergeState *mergeState)
+{
+	mergeState->executionFinished = true;
+}
+
+
+/*
+ * SortedMergeHasNextTuple returns whether the merge knows which row comes
+ * next, which is the case when the first row of each task has arrived, or
+ * the task will not return any more rows.
+ */
+bool
+SortedMergeHasNextTuple(SortedMergeState *mergeState)
+{
+	return FillSortedMergeHeap(mergeState);
+}
+
+
+/*
+ * SortedMergeGetNextTuple stores the next row of the merge in the given slot
+ * and returns true, or clears the slot and returns false once the rows of
+ * all the tasks are returned. The caller should make sure that the merge
+ * has a next row, or that all the tasks finished.
+ */
+bool
+SortedMergeGetNextTuple(SortedMergeState *mergeState, TupleTableSlot *slot)
+{
+	if (!FillSortedMergeHeap(mergeState))
+	{
+		ereport(ERROR, (errmsg("cannot merge the rows of tasks that did not "
+							   "return their first row yet")));
+	}
+
+	if (binaryheap_empty(mergeState->heap))
+	{
+		ExecClearTuple(slot);
+		return false;
+	}
+
+	int sourceIndex = DatumGetInt32(binaryheap_first(mergeState->heap));
+	SortedMergeSource *source = mergeState->sources[sourceIndex];
+
+	ExecCopySlot(slot, source->slot);
+
+	if (ReadSortedMergeSource(source))
+	{
+		/* the next row of the source takes its place in the heap */
+		binaryheap_replace_first(mergeState->heap, Int32GetDatum(sourceIndex));
+	}
+	else
+	{
+		/* the next row of the source did not arrive yet, or there is none */
+		binaryheap_remove_first(mergeState->heap);
+		source->inHeap = false;
+	}
+
+	return true;
+}
+
+
+/*
+ * SortedMergeIntoTupleStore writes all the rows of the merge in order to the
+ * given tuple store, after all the tasks finished.
+ */
+void
+SortedMergeIntoTupleStore(SortedMergeState *mergeState, Tuplestorestate *tupleStore)
+{
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(mergeState->tupleDescriptor,
+													&TTSOpsMinimalTuple);
+
+	Assert(mergeState->executionFinished);
+
+	while (SortedMergeGetNextTuple(mergeState, slot))
+	{
+		tuplestore_puttupleslot(tupleStore, slot);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+}
+
+
+/*
+ * FillSortedMergeHeap adds the sources whose first row arrived to the heap,
+ * and returns whether all the other sources are finished.
+ */
+static bool
+FillSortedMergeHeap(SortedMergeState *mergeState)
+{
+	bool hasNextTuple = true;
+
+	for (int sourceIndex = 0; sourceIndex < mergeState->sourceCount; sourceIndex++)
+	{
+		SortedMergeSource *source = mergeState->sources[sourceIndex];
+
+		if (source->inHeap)
+		{
+			continue;
+		}
+
+		/* check whether the task finished before we read its rows */
+		bool taskFinished = source->taskFinished || mergeState->executionFinished;
+
+		if (ReadSortedMergeSource(source))
+		{
+			binaryheap_add(mergeState->heap, Int32GetDatum(sourceIndex));
+			source->inHeap = true;
+		}
+		else if (!taskFinished)
+		{
+			/* the first row of the task might still arrive */
+			hasNextTuple = false;
+		}
+	}
+
+	return hasNextTuple;
+}
+
+
+/*
+ * ReadSortedMergeSource reads the next row of the source into its slot and
+ * returns whether the row was there.
+ */
+static bool
+ReadSortedMergeSource(SortedMergeSource *source)
+{
+	bool forwardScanDirection = true;
+	bool copyTuple = true;
+
+	bool found = tuplestore_gettupleslot(source->tupleStore, forwardScanDirection,
+										 copyTuple, source->slot);
+
+	/* the tuple store does not need to keep the rows that we read */
+	tuplestore_trim(source->tupleStore);
+
+	return found;
+}
+
+
+/*
+ * CompareSortedMergeSources compares the rows in the slots of two sources
+ * of the merge. Since binaryheap keeps the largest element on top, we
+ * invert the result to return the rows in ascending sort order.
+ */
+static int
+CompareSortedMergeSources(Datum a, Datum b, void *arg)
+{
+	SortedMergeState *mergeState = (SortedMergeState *) arg;
+	TupleTableSlot *leftSlot = mergeState->sources[DatumGetInt32(a)]->slot;
+	TupleTableSlot *rightSlot = mergeState->sources[DatumGetInt32(b)]->slot;
+
+	for (int sortKeyIndex = 0; sortKeyIndex < mergeState->sortKeyCount; sortKeyIndex++)
+	{
+		SortSupport sortKey = &mergeState->sortKeys[sortKeyIndex];
+		AttrNumber columnNumber = sortKey->ssup_attno;
+		bool leftIsNull = false;
+		bool rightIsNull = false;
+
+		Datum leftValue = slot_getattr(leftSlot, columnNumber, &leftIsNull);
+		Datum rightValue = slot_getattr(rightSlot, columnNumber, &rightIsNull);
+
+		int compare = ApplySortComparator(leftValue, leftIsNull,
+										  rightValue, rightIsNull,
+										  sortKey);
+		if (compare != 0)
+		{
+			INVERT_COMPARE_RESULT(compare);
+			return compare;
+		}
+	}
+
+	return 0;
+}
@@ -9,33 +9,206 @@
  */
 
 #include "postgres.h"
+#include "miscadmin.h"
 
+#include "catalog/pg_collation.h"
+#include "catalog/pg_type.h"
+#include "distributed/citus_custom_scan.h"
+#include "distributed/citus_ruleutils.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_planner.h"
 #include "distributed/intermediate_result_pruning.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
+#include "distributed/local_executor.h"
+#include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/transaction_management.h"
+#include "distributed/tuple_destination.h"
 #include "distributed/worker_manager.h"
 #include "executor/executor.h"
+#include "executor/tuptable.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "utils/builtins.h"
 #include "utils/datetime.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
 
 #define SECOND_TO_MILLI_SECOND 1000
 #define MICRO_TO_MILLI_SECOND 0.001
 
+/* intermediate results are only inlined into the task queries up to this size */
+#define MAX_INLINED_INTERMEDIATE_RESULT_SIZE (64 * 1024)
+
+
+/*
+ * PrefetchedSubPlanResult holds the rows of the distributed query of a
+ * subplan whose tasks were executed together with the tasks of other
+ * subplans, until the Citus scan of the subplan picks them up.
+ */
+typedef struct PrefetchedSubPlanResult
+{
+	DistributedPlan *distributedPlan;
+	Tuplestorestate *tupleStore;
+} PrefetchedSubPlanResult;
+
+
+/*
+ * InlinedIntermediateResult is the data in COPY text format of an intermediate
+ * result that is inlined into the queries of the tasks that read it.
+ */
+typedef struct InlinedIntermediateResult
+{
+	char *resultId;
+	char *copyData;
+} InlinedIntermediateResult;
+
+
+/*
+ * IntermediateResultReadContext is the context of IntermediateResultReadWalker,
+ * which finds the calls to read_intermediate_result() for an intermediate
+ * result in a query tree.
+ */
+typedef struct IntermediateResultReadContext
+{
+	char *resultId;
+
+	/* call that replaces the reads in the FROM clause, or NULL to only count */
+	Node *inlinedRead;
+
+	/* number of reads in function range table entries, and in total */
+	int fromClauseReadCount;
+	int readCount;
+} IntermediateResultReadContext;
+
+
+/*
+ * InlineResultDestReceiver collects the rows of a subplan in COPY text format,
+ * such that they can be inlined into the queries of the tasks that read its
+ * intermediate result. Once the rows exceed the threshold, it passes the rows
+ * that it collected so far and the remaining rows on to the receiver that
+ * writes the intermediate result.
+ */
+typedef struct InlineResultDestReceiver
+{
+	DestReceiver pub;
+
+	/* receiver that writes the intermediate result if it is not inlined */
+	DestReceiver *resultDest;
+	bool resultDestStarted;
+
+	int operation;
+	TupleDesc tupleDescriptor;
+
+	/* rows collected so far, to pass on to resultDest if needed */
+	Tuplestorestate *tupleStore;
+	uint64 rowCount;
+
+	/* the collected rows in COPY text format */
+	CopyOutState copyOutState;
+	FmgrInfo *columnOutputFunctions;
+
+	/* context of the collected rows, which outlive the execution of the subplan */
+	MemoryContext memoryContext;
+} InlineResultDestReceiver;
+
+
 int MaxIntermediateResult = 1048576; /* maximum size in KB the intermediate result can grow to */
 /* when this is true, we enforce intermediate result size limit in all executors */
 int SubPlanLevel = 0;
 
+/* GUC, whether independent subplans execute their tasks together */
+bool EnableParallelSubPlans = false;
+
+/* GUC, number of rows up to which intermediate results are inlined, 0 to disable */
+int InlineIntermediateResultThreshold = 0;
+
+/* prefetched rows of the subplan that is being executed, if any */
+static PrefetchedSubPlanResult *CurrentPrefetchedSubPlanResult = NULL;
+
+static void PrefetchIndependentSubPlans(List *subPlanList, int firstSubPlanIndex,
+										List *executedResultIdList,
+										PrefetchedSubPlanResult **prefetchedResults);
+static CustomScan * PrefetchableSubPlanScan(DistributedSubPlan *subPlan,
+											List *executedResultIdList);
+static void ExecutePlanWithPrefetchedResult(PlannedStmt *plannedStmt,
+											ParamListInfo params,
+											DestReceiver *dest,
+											PrefetchedSubPlanResult *prefetchedResult);
+static DistributedPlan * ExecuteSubPlansInternal(DistributedPlan *distributedPlan,
+												 bool allowInlining);
+static bool CanInlineIntermediateResults(DistributedPlan *distributedPlan);
+static bool IntermediateResultCanBeInlined(DistributedPlan *distributedPlan,
+										   IntermediateResultsHashEntry *entry,
+										   char *resultId);
+static bool IntermediateResultUsedBySubPlans(List *subPlanList, char *resultId);
+static bool IntermediateResultReadWalker(Node *node,
+										 IntermediateResultReadContext *context);
+static bool IsIntermediateResultRead(Node *node, char *resultId);
+static DistributedPlan * InlineIntermediateResults(DistributedPlan *distributedPlan,
+												   List *inlinedResultList);
+static Node * InlinedIntermediateResultRead(InlinedIntermediateResult *inlinedResult);
+static DestReceiver * CreateInlineResultDestReceiver(DestReceiver *resultDest);
+static void InlineResultDestReceiverStartup(DestReceiver *dest, int operation,
+											TupleDesc tupleDescriptor);
+static bool InlineResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void StartIntermediateResultDest(InlineResultDestReceiver *inlineDest);
+static void InlineResultDestReceiverShutdown(DestReceiver *dest);
+static void InlineResultDestReceiverDestroy(DestReceiver *dest);
+
 
 /*
  * ExecuteSubPlans executes a list of subplans from a distributed plan
  * by sequentially executing each plan from the top.
+ *
+ * When citus.enable_parallel_subplans is on, consecutive subplans that do not
+ * use each other's results and consist of a single read-only distributed
+ * query first execute their tasks together, such that the workers run them
+ * concurrently, bounded by the adaptive executor pool and the shared pool.
+ * Each subplan then only runs its coordinator part on the prefetched rows
+ * and writes its intermediate result as usual.
  */
 void
 ExecuteSubPlans(DistributedPlan *distributedPlan)
+{
+	bool allowInlining = false;
+	ExecuteSubPlansInternal(distributedPlan, allowInlining);
+}
+
+
+/*
+ * ExecuteSubPlansAndInlineResults executes the subplans of the given
+ * distributed plan like ExecuteSubPlans and returns the distributed plan that
+ * the caller should execute.
+ *
+ * When citus.inline_intermediate_result_threshold is set, the results of
+ * subplans that have at most that many rows and that are only read by the
+ * tasks of the plan on remote nodes are not written to files. Instead, the
+ * rows are inlined into the task queries in COPY text format, as the argument
+ * of read_inline_intermediate_result(), which saves the broadcast of the
+ * result and the file I/O on the workers. The returned plan is then a copy of
+ * the given plan with the rewritten tasks, since the given plan may be cached.
+ */
+DistributedPlan *
+ExecuteSubPlansAndInlineResults(DistributedPlan *distributedPlan)
+{
+	bool allowInlining = true;
+	return ExecuteSubPlansInternal(distributedPlan, allowInlining);
+}
+
+
+/*
+ * ExecuteSubPlansInternal executes the subplans of the given distributed plan,
+ * inlining the small results into the task queries if allowed, and returns the
+ * distributed plan with the inlined results.
+ */
+static DistributedPlan *
+ExecuteSubPlansInternal(DistributedPlan *distributedPlan, bool allowInlining)
 {
 	uint64 planId = distributedPlan->planId;
 	List *subPlanList = distributedPlan->subPlanList;
@@ -43,7 +216,7 @@ ExecuteSubPlans(DistributedPlan *distributedPlan)
 	if (subPlanList == NIL)
 	{
 		/* no subplans to execute */
-		return;
+		return distributedPlan;
 	}
 
 	HTAB *intermediateResultsHash = MakeIntermediateResultHTAB();
@@ -57,9 +230,23 @@ ExecuteSubPlans(DistributedPlan *distributedPlan)
 	 */
 	UseCoordinatedTransaction();
 
+	PrefetchedSubPlanResult **prefetchedResults =
+		palloc0(list_length(subPlanList) * sizeof(PrefetchedSubPlanResult *));
+	List *executedResultIdList = NIL;
+	List *inlinedResultList = NIL;
+	int subPlanIndex = 0;
+
+	allowInlining = allowInlining && CanInlineIntermediateResults(distributedPlan);
+
 	DistributedSubPlan *subPlan = NULL;
 	foreach_ptr(subPlan, subPlanList)
 	{
+		if (EnableParallelSubPlans && prefetchedResults[subPlanIndex] == NULL)
+		{
+			PrefetchIndependentSubPlans(subPlanList, subPlanIndex, executedResultIdList,
+										prefetchedResults);
+		}
+
 		PlannedStmt *plannedStmt = subPlan->plan;
 		uint32 subPlanId = subPlan->subPlanId;
 		ParamListInfo params = NULL;
@@ -75,10 +262,43 @@ ExecuteSubPlans(DistributedPlan *distributedPlan)
 		DestReceiver *copyDest =
 			CreateRemoteFileDestReceiver(resultId, estate, remoteWorkerNodeList,
 										 entry->writeLocalFile);
+		DestReceiver *resultDest = copyDest;
+
+		if (allowInlining &&
+			IntermediateResultCanBeInlined(distributedPlan, entry, resultId))
+		{
+			resultDest = CreateInlineResultDestReceiver(copyDest);
+		}
 
 		TimestampTz startTimestamp = GetCurrentTimestamp();
 
-		ExecutePlanIntoDestReceiver(plannedStmt, params, copyDest);
+		if (prefetchedResults[subPlanIndex] != NULL)
+		{
+			ExecutePlanWithPrefetchedResult(plannedStmt, params, resultDest,
+											prefetchedResults[subPlanIndex]);
+		}
+		else
+		{
+			ExecutePlanIntoDestReceiver(plannedStmt, params, resultDest);
+		}
+
+		InlinedIntermediateResult *inlinedResult = NULL;
+		if (resultDest != copyDest)
+		{
+			InlineResultDestReceiver *inlineDest =
+				(InlineResultDestReceiver *) resultDest;
+
+			if (!inlineDest->resultDestStarted)
+			{
+				inlinedResult = palloc0(sizeof(InlinedIntermediateResult));
+				inlinedResult->resultId = resultId;
+				inlinedResult->copyData = inlineDest->copyOutState->fe_msgbuf->data;
+
+				inlinedResultList = lappend(inlinedResultList, inlinedResult);
+			}
+
+			resultDest->rDestroy(resultDest);
+		}
 
 		/*
 		 * EXPLAIN ANALYZE instrumentations. Calculating these are very light-weight,
@@ -92,11 +312,738 @@ ExecuteSubPlans(DistributedPlan *distributedPlan)
 		subPlan->durationMillisecs = durationSeconds * SECOND_TO_MILLI_SECOND;
 		subPlan->durationMillisecs += durationMicrosecs * MICRO_TO_MILLI_SECOND;
 
-		subPlan->bytesSentPerWorker = RemoteFileDestReceiverBytesSent(copyDest);
-		subPlan->remoteWorkerCount = list_length(remoteWorkerNodeList);
-		subPlan->writeLocalFile = entry->writeLocalFile;
+		if (inlinedResult != NULL)
+		{
+			subPlan->bytesSentPerWorker = strlen(inlinedResult->copyData);
+			subPlan->remoteWorkerCount = 0;
+			subPlan->writeLocalFile = false;
+			subPlan->inlined = true;
+		}
+		else
+		{
+			subPlan->bytesSentPerWorker = RemoteFileDestReceiverBytesSent(copyDest);
+			subPlan->remoteWorkerCount = list_length(remoteWorkerNodeList);
+			subPlan->writeLocalFile = entry->writeLocalFile;
+			subPlan->inlined = false;
+		}
 
 		SubPlanLevel--;
 		FreeExecutorState(estate);
+
+		executedResultIdList = lappend(executedResultIdList, resultId);
+		subPlanIndex++;
+	}
+
+	if (inlinedResultList == NIL)
+	{
+		return distributedPlan;
+	}
+
+	return InlineIntermediateResults(distributedPlan, inlinedResultList);
+}
+
+
+/*
+ * CanInlineIntermediateResults returns whether the intermediate results that
+ * the tasks of the given distributed plan read can be inlined into the queries
+ * of the tasks. That requires a read-only router or pushdown job, since we
+ * deparse the task queries again from the job query after replacing the reads
+ * of the inlined results, and tasks that all run on remote nodes, since local
+ * execution may not use the task query strings.
+ */
+static bool
+CanInlineIntermediateResults(DistributedPlan *distributedPlan)
+{
+	if (InlineIntermediateResultThreshold <= 0)
+	{
+		return false;
+	}
+
+	Job *workerJob = distributedPlan->workerJob;
+	if (workerJob == NULL || workerJob->dependentJobList != NIL ||
+		distributedPlan->insertSelectQuery != NULL ||
+		distributedPlan->modLevel != ROW_MODIFY_READONLY)
+	{
+		return false;
+	}
+
+	/* router jobs have a single task, whose query is the job query */
+	bool routerJob = distributedPlan->combineQuery == NULL &&
+					 list_length(workerJob->taskList) == 1;
+	if (!routerJob && !workerJob->subqueryPushdown)
+	{
+		return false;
+	}
+
+	if (AnyTaskAccessesLocalNode(workerJob->taskList))
+	{
+		return false;
+	}
+
+	Task *task = NULL;
+	foreach_ptr(task, workerJob->taskList)
+	{
+		if (GetTaskQueryType(task) != TASK_QUERY_TEXT)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * IntermediateResultCanBeInlined returns whether the intermediate result with
+ * the given id can be inlined into the task queries of the given distributed
+ * plan, which CanInlineIntermediateResults accepted. That is the case if only
+ * those tasks read the result, which means that no node writes it to a local
+ * file, and the job query only reads it in calls to read_intermediate_result()
+ * in the FROM clause, which we can replace.
+ */
+static bool
+IntermediateResultCanBeInlined(DistributedPlan *distributedPlan,
+							   IntermediateResultsHashEntry *entry, char *resultId)
+{
+	if (entry->writeLocalFile)
+	{
+		/* the result is read on the coordinator or by local execution */
+		return false;
+	}
+
+	bool usedByWorkerJob = false;
+
+	UsedDistributedSubPlan *usedSubPlan = NULL;
+	foreach_ptr(usedSubPlan, distributedPlan->usedSubPlanNodeList)
+	{
+		if (strcmp(usedSubPlan->subPlanId, resultId) != 0)
+		{
+			continue;
+		}
+
+		if (usedSubPlan->accessType != SUBPLAN_ACCESS_REMOTE)
+		{
+			return false;
+		}
+
+		usedByWorkerJob = true;
+	}
+
+	if (!usedByWorkerJob ||
+		IntermediateResultUsedBySubPlans(distributedPlan->subPlanList, resultId))
+	{
+		return false;
+	}
+
+	IntermediateResultReadContext readContext = { 0 };
+	readContext.resultId = resultId;
+
+	IntermediateResultReadWalker((Node *) distributedPlan->workerJob->jobQuery,
+								 &readContext);
+
+	return readContext.fromClauseReadCount > 0 &&
+		   readContext.fromClauseReadCount == readContext.readCount;
+}
+
+
+/*
+ * IntermediateResultUsedBySubPlans returns whether any of the given subplans,
+ * or the subplans below them, reads the intermediate result with the given id.
+ */
+static bool
+IntermediateResultUsedBySubPlans(List *subPlanList, char *resultId)
+{
+	DistributedSubPlan *subPlan = NULL;
+	foreach_ptr(subPlan, subPlanList)
+	{
+		CustomScan *customScan = FetchCitusCustomScanIfExists(subPlan->plan->planTree);
+		if (customScan == NULL)
+		{
+			continue;
+		}
+
+		DistributedPlan *subPlanDistributedPlan = GetDistributedPlan(customScan);
+
+		UsedDistributedSubPlan *usedSubPlan = NULL;
+		foreach_ptr(usedSubPlan, subPlanDistributedPlan->usedSubPlanNodeList)
+		{
+			if (strcmp(usedSubPlan->subPlanId, resultId) == 0)
+			{
+				return true;
+			}
+		}
+
+		if (IntermediateResultUsedBySubPlans(subPlanDistributedPlan->subPlanList,
+											 resultId))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * IntermediateResultReadWalker walks over the query tree and counts the calls
+ * to read_intermediate_result() for the result in the context, both in total
+ * and as the functions of RTE_FUNCTION range table entries. If the context has
+ * an inlined read, the walker replaces the latter calls with it.
+ */
+static bool
+IntermediateResultReadWalker(Node *node, IntermediateResultReadContext *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	/* want to look at all RTEs, even in subqueries, CTEs and such */
+	if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, IntermediateResultReadWalker,
+								 context, QTW_EXAMINE_RTES_BEFORE);
+	}
+
+	if (IsA(node, RangeTblEntry))
+	{
+		RangeTblEntry *rangeTableEntry = (RangeTblEntry *) node;
+		if (rangeTableEntry->rtekind != RTE_FUNCTION)
+		{
+			return false;
+		}
+
+		RangeTblFunction *rangeTableFunction = NULL;
+		foreach_ptr(rangeTableFunction, rangeTableEntry->functions)
+		{
+			if (!IsIntermediateResultRead(rangeTableFunction->funcexpr,
+										  context->resultId))
+			{
+				continue;
+			}
+
+			context->fromClauseReadCount++;
+
+			if (context->inlinedRead != NULL)
+			{
+				rangeTableFunction->funcexpr = copyObject(context->inlinedRead);
+			}
+		}
+
+		/* the walker descends into the functions afterwards */
+		return false;
+	}
+
+	if (IsIntermediateResultRead(node, context->resultId))
+	{
+		context->readCount++;
+	}
+
+	return expression_tree_walker(node, IntermediateResultReadWalker, context);
+}
+
+
+/*
+ * IsIntermediateResultRead returns whether the given expression is a call to
+ * read_intermediate_result() for the intermediate result with the given id.
+ */
+static bool
+IsIntermediateResultRead(Node *node, char *resultId)
+{
+	if (node == NULL || !IsA(node, FuncExpr))
+	{
+		return false;
+	}
+
+	FuncExpr *funcExpr = (FuncExpr *) node;
+	if (funcExpr->funcid != CitusReadIntermediateResultFuncId())
+	{
+		return false;
+	}
+
+	Node *resultIdArg = linitial(funcExpr->args);
+	if (!IsA(resultIdArg, Const) || ((Const *) resultIdArg)->constisnull)
+	{
+		return false;
+	}
+
+	char *readResultId = TextDatumGetCString(((Const *) resultIdArg)->constvalue);
+
+	return strcmp(readResultId, resultId) == 0;
+}
+
+
+/*
+ * InlineIntermediateResults returns a copy of the given distributed plan in
+ * which the task queries read the given inlined results through
+ * read_inline_intermediate_result() instead of read_intermediate_result().
+ * We replace the calls in a copy of the job query and deparse the task queries
+ * from it again, the same way the planner deparsed them from the job query.
+ * The plan, the job and the tasks are copied shallowly, since the task queries
+ * are the only fields that change.
+ */
+static DistributedPlan *
+InlineIntermediateResults(DistributedPlan *distributedPlan, List *inlinedResultList)
+{
+	DistributedPlan *inlinedPlan = palloc(sizeof(DistributedPlan));
+	*inlinedPlan = *distributedPlan;
+
+	Job *workerJob = palloc(sizeof(Job));
+	*workerJob = *distributedPlan->workerJob;
+	workerJob->jobQuery = copyObject(distributedPlan->workerJob->jobQuery);
+	workerJob->taskList = NIL;
+	inlinedPlan->workerJob = workerJob;
+
+	InlinedIntermediateResult *inlinedResult = NULL;
+	foreach_ptr(inlinedResult, inlinedResultList)
+	{
+		IntermediateResultReadContext readContext = { 0 };
+		readContext.resultId = inlinedResult->resultId;
+		readContext.inlinedRead = InlinedIntermediateResultRead(inlinedResult);
+
+		IntermediateResultReadWalker((Node *) workerJob->jobQuery, &readContext);
+	}
+
+	Task *originalTask = NULL;
+	foreach_ptr(originalTask, distributedPlan->workerJob->taskList)
+	{
+		Task *task = palloc(sizeof(Task));
+		*task = *originalTask;
+
+		char *queryString = NULL;
+
+		if (workerJob->subqueryPushdown)
+		{
+			queryString = QueryPushdownTaskQueryString(workerJob->jobQuery,
+													   task->relationShardList);
+		}
+		else
+		{
+			/* the job query of a router job already has the shard names */
+			StringInfo routerQueryString = makeStringInfo();
+			pg_get_query_def(workerJob->jobQuery, routerQueryString);
+
+			queryString = routerQueryString->data;
+		}
+
+		SetTaskQueryString(task, queryString);
+
+		workerJob->taskList = lappend(workerJob->taskList, task);
+	}
+
+	return inlinedPlan;
+}
+
+
+/*
+ * InlinedIntermediateResultRead returns a call to
+ * read_inline_intermediate_result() with the data of the given inlined result,
+ * to replace the calls to read_intermediate_result() for the result. The
+ * column definition list of the function range table entry stays the same.
+ */
+static Node *
+InlinedIntermediateResultRead(InlinedIntermediateResult *inlinedResult)
+{
+	Const *copyDataConst = makeConst(TEXTOID, -1, DEFAULT_COLLATION_OID, -1,
+									 CStringGetTextDatum(inlinedResult->copyData),
+									 false, false);
+
+	FuncExpr *funcExpr = makeFuncExpr(CitusReadInlineIntermediateResultFuncId(),
+									  RECORDOID, list_make1(copyDataConst),
+									  InvalidOid, InvalidOid, COERCE_EXPLICIT_CALL);
+	funcExpr->funcretset = true;
+
+	return (Node *) funcExpr;
+}
+
+
+/*
+ * CreateInlineResultDestReceiver returns a receiver that collects the rows of
+ * a subplan for inlining, and passes them on to the given receiver of the
+ * intermediate result once they exceed citus.inline_intermediate_result_threshold
+ * or the maximum size of inlined results.
+ */
+static DestReceiver *
+CreateInlineResultDestReceiver(DestReceiver *resultDest)
+{
+	InlineResultDestReceiver *inlineDest = palloc0(sizeof(InlineResultDestReceiver));
+
+	inlineDest->pub.receiveSlot = InlineResultDestReceiverReceive;
+	inlineDest->pub.rStartup = InlineResultDestReceiverStartup;
+	inlineDest->pub.rShutdown = InlineResultDestReceiverShutdown;
+	inlineDest->pub.rDestroy = InlineResultDestReceiverDestroy;
+	inlineDest->pub.mydest = DestCopyOut;
+
+	inlineDest->resultDest = resultDest;
+	inlineDest->memoryContext = CurrentMemoryContext;
+
+	return (DestReceiver *) inlineDest;
+}
+
+
+/*
+ * InlineResultDestReceiverStartup implements the rStartup interface of
+ * InlineResultDestReceiver. The receiver of the intermediate result is only
+ * started once the rows cannot be inlined.
+ */
+static void
+InlineResultDestReceiverStartup(DestReceiver *dest, int operation,
+								TupleDesc tupleDescriptor)
+{
+	InlineResultDestReceiver *inlineDest = (InlineResultDestReceiver *) dest;
+
+	inlineDest->operation = operation;
+	inlineDest->tupleDescriptor = tupleDescriptor;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(inlineDest->memoryContext);
+
+	bool randomAccess = false;
+	bool interTransactions = false;
+	inlineDest->tupleStore =
+		tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
+
+	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
+	copyOutState->delim = (char *) "\t";
+	copyOutState->null_print = (char *) "\\N";
+	copyOutState->null_print_client = (char *) "\\N";
+	copyOutState->binary = false;
+	copyOutState->fe_msgbuf = makeStringInfo();
+	copyOutState->rowcontext = AllocSetContextCreate(CurrentMemoryContext,
+													 "InlineResultDestReceiver",
+													 ALLOCSET_DEFAULT_SIZES);
+	inlineDest->copyOutState = copyOutState;
+
+	inlineDest->columnOutputFunctions = ColumnOutputFunctions(tupleDescriptor,
+															  copyOutState->binary);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * InlineResultDestReceiverReceive implements the receiveSlot interface of
+ * InlineResultDestReceiver. It collects the rows until they exceed the
+ * threshold, and then passes all rows on to the receiver of the intermediate
+ * result.
+ */
+static bool
+InlineResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
+{
+	InlineResultDestReceiver *inlineDest = (InlineResultDestReceiver *) dest;
+	CopyOutState copyOutState = inlineDest->copyOutState;
+
+	if (inlineDest->resultDestStarted)
+	{
+		DestReceiver *resultDest = inlineDest->resultDest;
+		return resultDest->receiveSlot(slot, resultDest);
+	}
+
+	slot_getallattrs(slot);
+
+	AppendCopyRowData(slot->tts_values, slot->tts_isnull, inlineDest->tupleDescriptor,
+					  copyOutState, inlineDest->columnOutputFunctions, NULL);
+	MemoryContextReset(copyOutState->rowcontext);
+
+	tuplestore_puttupleslot(inlineDest->tupleStore, slot);
+	inlineDest->rowCount++;
+
+	if (inlineDest->rowCount > InlineIntermediateResultThreshold ||
+		copyOutState->fe_msgbuf->len > MAX_INLINED_INTERMEDIATE_RESULT_SIZE)
+	{
+		StartIntermediateResultDest(inlineDest);
+	}
+
+	return true;
+}
+
+
+/*
+ * StartIntermediateResultDest starts the receiver of the intermediate result
+ * for rows that cannot be inlined, and passes it the rows collected so far.
+ */
+static void
+StartIntermediateResultDest(InlineResultDestReceiver *inlineDest)
+{
+	DestReceiver *resultDest = inlineDest->resultDest;
+	TupleDesc tupleDescriptor = inlineDest->tupleDescriptor;
+
+	resultDest->rStartup(resultDest, inlineDest->operation, tupleDescriptor);
+	inlineDest->resultDestStarted = true;
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(tupleDescriptor,
+													&TTSOpsMinimalTuple);
+
+	while (tuplestore_gettupleslot(inlineDest->tupleStore, true, false, slot))
+	{
+		resultDest->receiveSlot(slot, resultDest);
 	}
+
+	ExecDropSingleTupleTableSlot(slot);
+
+	tuplestore_end(inlineDest->tupleStore);
+	inlineDest->tupleStore = NULL;
+}
+
+
+/*
+ * InlineResultDestReceiverShutdown implements the rShutdown interface of
+ * InlineResultDestReceiver.
+ */
+static void
+InlineResultDestReceiverShutdown(DestReceiver *dest)
+{
+	InlineResultDestReceiver *inlineDest = (InlineResultDestReceiver *) dest;
+
+	if (inlineDest->resultDestStarted)
+	{
+		DestReceiver *resultDest = inlineDest->resultDest;
+		resultDest->rShutdown(resultDest);
+	}
+
+	if (inlineDest->tupleStore != NULL)
+	{
+		tuplestore_end(inlineDest->tupleStore);
+		inlineDest->tupleStore = NULL;
+	}
+}
+
+
+/*
+ * InlineResultDestReceiverDestroy implements the rDestroy interface of
+ * InlineResultDestReceiver. It keeps the collected rows, which are inlined
+ * into the task queries.
+ */
+static void
+InlineResultDestReceiverDestroy(DestReceiver *dest)
+{
+	InlineResultDestReceiver *inlineDest = (InlineResultDestReceiver *) dest;
+	CopyOutState copyOutState = inlineDest->copyOutState;
+
+	if (copyOutState != NULL)
+	{
+		MemoryContextDelete(copyOutState->rowcontext);
+	}
+
+	if (inlineDest->columnOutputFunctions != NULL)
+	{
+		pfree(inlineDest->columnOutputFunctions);
+	}
+
+	pfree(inlineDest);
+}
+
+
+/*
+ * PrefetchIndependentSubPlans executes the tasks of the distributed queries of
+ * the subplan at firstSubPlanIndex and of the consecutive subplans after it
+ * together, as long as the subplans can be prefetched and do not use the
+ * results of subplans that did not execute yet. The rows of each subplan are
+ * stored in prefetchedResults at the index of the subplan. Nothing is
+ * prefetched unless there are at least 2 such subplans.
+ */
+static void
+PrefetchIndependentSubPlans(List *subPlanList, int firstSubPlanIndex,
+							List *executedResultIdList,
+							PrefetchedSubPlanResult **prefetchedResults)
+{
+	List *prefetchedResultList = NIL;
+	List *taskList = NIL;
+
+	for (int subPlanIndex = firstSubPlanIndex; subPlanIndex < list_length(subPlanList);
+		 subPlanIndex++)
+	{
+		DistributedSubPlan *subPlan = list_nth(subPlanList, subPlanIndex);
+		CustomScan *customScan = PrefetchableSubPlanScan(subPlan, executedResultIdList);
+		if (customScan == NULL)
+		{
+			break;
+		}
+
+		DistributedPlan *subPlanDistributedPlan = GetDistributedPlan(customScan);
+		TupleDesc tupleDescriptor = ExecTypeFromTL(customScan->custom_scan_tlist);
+
+		bool randomAccess = true;
+		bool interTransactions = false;
+		PrefetchedSubPlanResult *prefetchedResult =
+			palloc0(sizeof(PrefetchedSubPlanResult));
+		prefetchedResult->distributedPlan = subPlanDistributedPlan;
+		prefetchedResult->tupleStore =
+			tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
+
+		TupleDestination *tupleDest =
+			CreateTupleStoreTupleDest(prefetchedResult->tupleStore, tupleDescriptor);
+
+		/* the tasks belong to a plan that may be cached, so send copies */
+		Task *task = NULL;
+		foreach_ptr(task, subPlanDistributedPlan->workerJob->taskList)
+		{
+			Task *prefetchTask = copyObject(task);
+			prefetchTask->tupleDest = tupleDest;
+
+			taskList = lappend(taskList, prefetchTask);
+		}
+
+		prefetchedResultList = lappend(prefetchedResultList, prefetchedResult);
+	}
+
+	if (list_length(prefetchedResultList) < 2)
+	{
+		/* a single subplan is executed as usual */
+		PrefetchedSubPlanResult *prefetchedResult = NULL;
+		foreach_ptr(prefetchedResult, prefetchedResultList)
+		{
+			tuplestore_end(prefetchedResult->tupleStore);
+		}
+
+		return;
+	}
+
+	/* the rows count towards citus.max_intermediate_result_size */
+	SubPlanLevel++;
+
+	bool expectResults = true;
+	ExecuteTaskListIntoTupleDest(ROW_MODIFY_READONLY, taskList, CreateTupleDestNone(),
+								 expectResults);
+
+	SubPlanLevel--;
+
+	int subPlanIndex = firstSubPlanIndex;
+	PrefetchedSubPlanResult *prefetchedResult = NULL;
+	foreach_ptr(prefetchedResult, prefetchedResultList)
+	{
+		prefetchedResults[subPlanIndex] = prefetchedResult;
+		subPlanIndex++;
+	}
+}
+
+
+/*
+ * PrefetchableSubPlanScan returns the Citus scan of the given subplan if the
+ * tasks of the subplan can be executed ahead of the subplan, or NULL if not.
+ * That is the case for read-only subplans whose plan has a single adaptive
+ * executor scan with plain tasks below a chain of coordinator nodes, and that
+ * only use the results of executed subplans.
+ */
+static CustomScan *
+PrefetchableSubPlanScan(DistributedSubPlan *subPlan, List *executedResultIdList)
+{
+	PlannedStmt *plannedStmt = subPlan->plan;
+	if (plannedStmt->commandType != CMD_SELECT || plannedStmt->hasModifyingCTE ||
+		plannedStmt->subplans != NIL)
+	{
+		return NULL;
+	}
+
+	Plan *plan = plannedStmt->planTree;
+	while (plan != NULL && !IsCitusCustomScan(plan))
+	{
+		if (plan->righttree != NULL || plan->initPlan != NIL)
+		{
+			return NULL;
+		}
+
+		plan = plan->lefttree;
+	}
+
+	if (plan == NULL)
+	{
+		return NULL;
+	}
+
+	CustomScan *customScan = (CustomScan *) plan;
+	if (customScan->methods != &AdaptiveExecutorCustomScanMethods ||
+		customScan->custom_plans != NIL || customScan->custom_scan_tlist == NIL)
+	{
+		/* parallel combine plans read the rows of the scan themselves */
+		return NULL;
+	}
+
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+	Job *workerJob = distributedPlan->workerJob;
+	if (distributedPlan->modLevel != ROW_MODIFY_READONLY ||
+		distributedPlan->planningError != NULL ||
+		distributedPlan->insertSelectQuery != NULL ||
+		distributedPlan->subPlanList != NIL ||
+		distributedPlan->sortedMergeClauseList != NIL ||
+		workerJob == NULL || workerJob->deferredPruning ||
+		workerJob->dependentJobList != NIL || workerJob->parameterValueList != NIL)
+	{
+		return NULL;
+	}
+
+	UsedDistributedSubPlan *usedSubPlan = NULL;
+	foreach_ptr(usedSubPlan, distributedPlan->usedSubPlanNodeList)
+	{
+		bool resultExecuted = false;
+
+		char *executedResultId = NULL;
+		foreach_ptr(executedResultId, executedResultIdList)
+		{
+			if (strcmp(executedResultId, usedSubPlan->subPlanId) == 0)
+			{
+				resultExecuted = true;
+				break;
+			}
+		}
+
+		if (!resultExecuted)
+		{
+			return NULL;
+		}
+	}
+
+	return customScan;
+}
+
+
+/*
+ * ExecutePlanWithPrefetchedResult executes the plan of a subplan whose Citus
+ * scan reads the given prefetched rows instead of executing its tasks.
+ */
+static void
+ExecutePlanWithPrefetchedResult(PlannedStmt *plannedStmt, ParamListInfo params,
+								DestReceiver *dest,
+								PrefetchedSubPlanResult *prefetchedResult)
+{
+	PrefetchedSubPlanResult *previousResult = CurrentPrefetchedSubPlanResult;
+	CurrentPrefetchedSubPlanResult = prefetchedResult;
+
+	PG_TRY();
+	{
+		ExecutePlanIntoDestReceiver(plannedStmt, params, dest);
+	}
+	PG_FINALLY();
+	{
+		CurrentPrefetchedSubPlanResult = previousResult;
+	}
+	PG_END_TRY();
+
+	if (prefetchedResult->tupleStore != NULL)
+	{
+		/* the plan did not need the rows of the scan */
+		tuplestore_end(prefetchedResult->tupleStore);
+		prefetchedResult->tupleStore = NULL;
+	}
+}
+
+
+/*
+ * TakePrefetchedSubPlanResult returns the prefetched rows of the given
+ * distributed plan, if it is the distributed plan of the subplan that is
+ * being executed and its tasks were executed ahead of it, and otherwise NULL.
+ * The caller becomes the owner of the returned tuple store.
+ */
+Tuplestorestate *
+TakePrefetchedSubPlanResult(DistributedPlan *distributedPlan)
+{
+	PrefetchedSubPlanResult *prefetchedResult = CurrentPrefetchedSubPlanResult;
+	if (prefetchedResult == NULL || prefetchedResult->distributedPlan != distributedPlan)
+	{
+		return NULL;
+	}
+
+	Tuplestorestate *tupleStore = prefetchedResult->tupleStore;
+	prefetchedResult->tupleStore = NULL;
+
+	return tupleStore;
 }
@@ -0,0 +1,697 @@
+/*-------------------------------------------------------------------------
+ *
+ * tenant_load_stats.c
+ *
+ * Routines for sampling the distribution column values of the router
+ * queries that a node executes. For a fraction of the router queries, given
+ * by citus.tenant_load_sample_rate, we count the query for its distribution
+ * column value, the tenant, and for the colocation group of the queried
+ * tables, along with its rows and its execution and CPU time. Queries that
+ * are not sampled only cost a random number.
+ *
+ * The tenants are kept in a fixed size shared memory hash that works as a
+ * Space-Saving top-k structure: when the hash is full, a new tenant replaces
+ * the tenant with the fewest samples and inherits its sample count, which
+ * keeps the tenants with the most queries in the hash no matter how many
+ * tenants there are. The sample counts are halved periodically by the
+ * maintenance daemon, such that the share of a tenant in the count of its
+ * colocation group reflects its share of the recent load. The hot tenant
+ * isolation policy uses these shares to find tenants that are worth
+ * isolating in a shard of their own.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "distributed/pg_version_constants.h"
+
+#if PG_VERSION_NUM >= PG_VERSION_15
+#include "common/pg_prng.h"
+#endif
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_utility.h"
+#include "distributed/multi_router_planner.h"
+#include "distributed/tenant_load_stats.h"
+#include "distributed/tuplestore.h"
+
+
+#define TENANT_LOAD_STATS_COLUMNS 9
+
+/* maximum number of tenants and colocation groups whose load is sampled */
+#define MAX_TENANT_LOAD_ENTRIES 1024
+#define MAX_TENANT_LOAD_GROUPS 256
+
+/* entries whose decayed sample count drops below this are removed */
+#define TENANT_LOAD_STATS_MIN_SAMPLE_COUNT 0.5
+
+
+/*
+ * TenantLoadGroupKey identifies a colocation group across all databases.
+ */
+typedef struct TenantLoadGroupKey
+{
+	Oid databaseId;
+	uint32 colocationId;
+} TenantLoadGroupKey;
+
+
+/*
+ * TenantLoadKey identifies a tenant of a colocation group across all
+ * databases. The value is zero-padded, since the key is hashed as a whole.
+ */
+typedef struct TenantLoadKey
+{
+	TenantLoadGroupKey group;
+	char tenantValue[TENANT_VALUE_MAX_LENGTH];
+} TenantLoadKey;
+
+
+/*
+ * TenantLoadGroupEntry is the shared memory hash entry holding the decayed
+ * number of sampled queries of a colocation group.
+ */
+typedef struct TenantLoadGroupEntry
+{
+	TenantLoadGroupKey key;
+	slock_t mutex;
+	double sampleCount;
+} TenantLoadGroupEntry;
+
+
+/*
+ * TenantLoadEntry is the shared memory hash entry holding the statistics of
+ * a tenant, along with the last queried table of the colocation group. The
+ * statistics are protected by the mutexes, such that backends only need a
+ * shared lock on the hashes to update existing entries.
+ */
+typedef struct TenantLoadEntry
+{
+	TenantLoadKey key;
+	slock_t mutex;
+	Oid relationId;
+	double calls;
+	double rows;
+	double totalTimeMs;
+	double cpuTimeMs;
+	double sampleCount;
+	double sampleCountError;
+} TenantLoadEntry;
+
+
+/*
+ * TenantLoadStatsControlData holds the lock protecting the hashes.
+ */
+typedef struct TenantLoadStatsControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+} TenantLoadStatsControlData;
+
+
+/* GUC, fraction of the router queries whose distribution value is sampled */
+double TenantLoadSampleRate = 0.0;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static TenantLoadStatsControlData *TenantLoadStatsControl = NULL;
+static HTAB *TenantLoadHash = NULL;
+static HTAB *TenantLoadGroupHash = NULL;
+
+static double RandomFraction(void);
+static void AddTenantLoadSample(TenantLoadKey *key, Oid relationId, double weight,
+								uint64 rowCount, double totalTimeMs, double cpuTimeMs);
+static TenantLoadEntry * ReplaceLeastSampledTenant(TenantLoadKey *key);
+static double RUsageMillisecondsBetween(struct timeval *start, struct timeval *end);
+
+
+PG_FUNCTION_INFO_V1(citus_tenant_load_stats);
+
+
+/*
+ * InitializeTenantLoadStats requests the shared memory for the tenant load
+ * statistics and sets the hook that initializes it.
+ */
+void
+InitializeTenantLoadStats(void)
+{
+	/* On PG 15 and above, we use shmem_request_hook_type */
+	#if PG_VERSION_NUM < PG_VERSION_15
+
+	/* allocate shared memory for pre PG-15 versions */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(TenantLoadStatsShmemSize());
+	}
+
+	#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = TenantLoadStatsShmemInit;
+}
+
+
+/*
+ * TenantLoadStatsShmemSize returns the size of the shared memory used for
+ * the tenant load statistics.
+ */
+size_t
+TenantLoadStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(TenantLoadStatsControlData));
+	size = add_size(size, hash_estimate_size(MAX_TENANT_LOAD_ENTRIES,
+											 sizeof(TenantLoadEntry)));
+	size = add_size(size, hash_estimate_size(MAX_TENANT_LOAD_GROUPS,
+											 sizeof(TenantLoadGroupEntry)));
+
+	return size;
+}
+
+
+/*
+ * TenantLoadStatsShmemInit initializes the shared memory used for the tenant
+ * load statistics.
+ */
+void
+TenantLoadStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL hashInfo;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	TenantLoadStatsControl =
+		(TenantLoadStatsControlData *) ShmemInitStruct("Citus Tenant Load Stats",
+													   sizeof(
+														   TenantLoadStatsControlData),
+													   &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		TenantLoadStatsControl->trancheId = LWLockNewTrancheId();
+		TenantLoadStatsControl->lockTrancheName = "Citus Tenant Load Stats";
+		LWLockRegisterTranche(TenantLoadStatsControl->trancheId,
+							  TenantLoadStatsControl->lockTrancheName);
+
+		LWLockInitialize(&TenantLoadStatsControl->lock,
+						 TenantLoadStatsControl->trancheId);
+	}
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = sizeof(TenantLoadKey);
+	hashInfo.entrysize = sizeof(TenantLoadEntry);
+	hashInfo.hash = tag_hash;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	TenantLoadHash = ShmemInitHash("Citus Tenant Load Hash",
+								   MAX_TENANT_LOAD_ENTRIES, MAX_TENANT_LOAD_ENTRIES,
+								   &hashInfo, hashFlags);
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = sizeof(TenantLoadGroupKey);
+	hashInfo.entrysize = sizeof(TenantLoadGroupEntry);
+	hashInfo.hash = tag_hash;
+
+	TenantLoadGroupHash = ShmemInitHash("Citus Tenant Load Group Hash",
+										MAX_TENANT_LOAD_GROUPS, MAX_TENANT_LOAD_GROUPS,
+										&hashInfo, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * RandomFraction returns a random number in the range [0, 1).
+ */
+static double
+RandomFraction(void)
+{
+#if PG_VERSION_NUM >= PG_VERSION_15
+	return pg_prng_double(&pg_global_prng_state);
+#else
+	return (double) random() / ((double) MAX_RANDOM_VALUE + 1);
+#endif
+}
+
+
+/*
+ * StartTenantLoadSample samples the distribution column value of the given
+ * job with probability citus.tenant_load_sample_rate, if it is a router job
+ * on a hash distributed table. It returns the sample, which should be passed
+ * to FinishTenantLoadSample when the execution finishes, or NULL if the job
+ * is not sampled.
+ */
+TenantLoadSample *
+StartTenantLoadSample(Job *job)
+{
+	double sampleRate = TenantLoadSampleRate;
+
+	if (sampleRate <= 0.0 || TenantLoadHash == NULL || job == NULL)
+	{
+		return NULL;
+	}
+
+	Const *partitionKeyValue = job->partitionKeyValue;
+	if (partitionKeyValue == NULL || partitionKeyValue->constisnull ||
+		list_length(job->taskList) != 1)
+	{
+		return NULL;
+	}
+
+	if (sampleRate < 1.0 && RandomFraction() >= sampleRate)
+	{
+		return NULL;
+	}
+
+	Oid relationId = ExtractFirstCitusTableId(job->jobQuery);
+	if (!OidIsValid(relationId))
+	{
+		return NULL;
+	}
+
+	CitusTableCacheEntry *cacheEntry = LookupCitusTableCacheEntry(relationId);
+	if (cacheEntry == NULL || !IsCitusTableTypeCacheEntry(cacheEntry, HASH_DISTRIBUTED))
+	{
+		return NULL;
+	}
+
+	char *tenantValue = DatumToString(partitionKeyValue->constvalue,
+									  partitionKeyValue->consttype);
+	if (strlen(tenantValue) >= TENANT_VALUE_MAX_LENGTH)
+	{
+		return NULL;
+	}
+
+	TenantLoadSample *sample = palloc0(sizeof(TenantLoadSample));
+	sample->colocationId = cacheEntry->colocationId;
+	sample->relationId = relationId;
+	strlcpy(sample->tenantValue, tenantValue, TENANT_VALUE_MAX_LENGTH);
+	sample->sampleRate = sampleRate;
+	pg_rusage_init(&sample->startUsage);
+
+	return sample;
+}
+
+
+/*
+ * FinishTenantLoadSample adds the sampled query to the statistics of its
+ * tenant and colocation group.
+ */
+void
+FinishTenantLoadSample(TenantLoadSample *sample, uint64 rowCount)
+{
+	TenantLoadKey key;
+	PGRUsage endUsage;
+
+	pg_rusage_init(&endUsage);
+
+	double totalTimeMs = RUsageMillisecondsBetween(&sample->startUsage.tv,
+												   &endUsage.tv);
+	double cpuTimeMs =
+		RUsageMillisecondsBetween(&sample->startUsage.ru.ru_utime,
+								  &endUsage.ru.ru_utime) +
+		RUsageMillisecondsBetween(&sample->startUsage.ru.ru_stime,
+								  &endUsage.ru.ru_stime);
+
+	memset(&key, 0, sizeof(key));
+	key.group.databaseId = MyDatabaseId;
+	key.group.colocationId = sample->colocationId;
+	strlcpy(key.tenantValue, sample->tenantValue, TENANT_VALUE_MAX_LENGTH);
+
+	/* each sampled query stands for 1 / sample rate queries */
+	double weight = 1.0 / sample->sampleRate;
+
+	AddTenantLoadSample(&key, sample->relationId, weight, rowCount, totalTimeMs,
+						cpuTimeMs);
+}
+
+
+/*
+ * RUsageMillisecondsBetween returns the number of milliseconds between two
+ * timevals.
+ */
+static double
+RUsageMillisecondsBetween(struct timeval *start, struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000.0 +
+		   (end->tv_usec - start->tv_usec) / 1000.0;
+}
+
+
+/*
+ * AddTenantLoadSample counts a sampled query for the given tenant and its
+ * colocation group. When the hash of the tenants is full, the tenant replaces
+ * the tenant with the fewest samples. Queries are not counted when there is
+ * no room for the colocation group.
+ */
+static void
+AddTenantLoadSample(TenantLoadKey *key, Oid relationId, double weight,
+					uint64 rowCount, double totalTimeMs, double cpuTimeMs)
+{
+	bool found = false;
+
+	LWLockAcquire(&TenantLoadStatsControl->lock, LW_SHARED);
+
+	TenantLoadGroupEntry *groupEntry =
+		(TenantLoadGroupEntry *) hash_search(TenantLoadGroupHash, &key->group,
+											 HASH_FIND, &found);
+	TenantLoadEntry *entry =
+		(TenantLoadEntry *) hash_search(TenantLoadHash, key, HASH_FIND, &found);
+
+	if (groupEntry == NULL || entry == NULL)
+	{
+		/* need an exclusive lock to add the entries */
+		LWLockRelease(&TenantLoadStatsControl->lock);
+		LWLockAcquire(&TenantLoadStatsControl->lock, LW_EXCLUSIVE);
+
+		groupEntry = (TenantLoadGroupEntry *) hash_search(TenantLoadGroupHash,
+														  &key->group,
+														  HASH_ENTER_NULL, &found);
+		if (groupEntry != NULL && !found)
+		{
+			SpinLockInit(&groupEntry->mutex);
+			groupEntry->sampleCount = 0;
+		}
+
+		if (groupEntry != NULL)
+		{
+			entry = (TenantLoadEntry *) hash_search(TenantLoadHash, key,
+													HASH_ENTER_NULL, &found);
+			if (entry == NULL)
+			{
+				entry = ReplaceLeastSampledTenant(key);
+			}
+			else if (!found)
+			{
+				SpinLockInit(&entry->mutex);
+				entry->calls = 0;
+				entry->rows = 0;
+				entry->totalTimeMs = 0;
+				entry->cpuTimeMs = 0;
+				entry->sampleCount = 0;
+				entry->sampleCountError = 0;
+			}
+		}
+	}
+
+	if (groupEntry != NULL)
+	{
+		volatile TenantLoadGroupEntry *g = (volatile TenantLoadGroupEntry *) groupEntry;
+
+		SpinLockAcquire(&g->mutex);
+		g->sampleCount += 1;
+		SpinLockRelease(&g->mutex);
+	}
+
+	if (entry != NULL)
+	{
+		volatile TenantLoadEntry *e = (volatile TenantLoadEntry *) entry;
+
+		SpinLockAcquire(&e->mutex);
+		e->relationId = relationId;
+		e->calls += weight;
+		e->rows += rowCount * weight;
+		e->totalTimeMs += totalTimeMs * weight;
+		e->cpuTimeMs += cpuTimeMs * weight;
+		e->sampleCount += 1;
+		SpinLockRelease(&e->mutex);
+	}
+
+	LWLockRelease(&TenantLoadStatsControl->lock);
+}
+
+
+/*
+ * ReplaceLeastSampledTenant replaces the tenant with the fewest samples by
+ * the tenant with the given key and returns the new entry. As in the
+ * Space-Saving algorithm, the new tenant inherits the sample count of the
+ * tenant it replaces, which may be an overestimate of its own count by that
+ * much. The other statistics start from 0. The caller should hold the lock
+ * exclusively.
+ */
+static TenantLoadEntry *
+ReplaceLeastSampledTenant(TenantLoadKey *key)
+{
+	HASH_SEQ_STATUS status;
+	TenantLoadEntry *leastSampledEntry = NULL;
+	bool found = false;
+
+	hash_seq_init(&status, TenantLoadHash);
+
+	TenantLoadEntry *entry = NULL;
+	while ((entry = (TenantLoadEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (leastSampledEntry == NULL ||
+			entry->sampleCount < leastSampledEntry->sampleCount)
+		{
+			leastSampledEntry = entry;
+		}
+	}
+
+	if (leastSampledEntry == NULL)
+	{
+		return NULL;
+	}
+
+	double inheritedSampleCount = leastSampledEntry->sampleCount;
+
+	hash_search(TenantLoadHash, &leastSampledEntry->key, HASH_REMOVE, NULL);
+
+	entry = (TenantLoadEntry *) hash_search(TenantLoadHash, key, HASH_ENTER_NULL,
+											&found);
+	if (entry != NULL)
+	{
+		SpinLockInit(&entry->mutex);
+		entry->calls = 0;
+		entry->rows = 0;
+		entry->totalTimeMs = 0;
+		entry->cpuTimeMs = 0;
+		entry->sampleCount = inheritedSampleCount;
+		entry->sampleCountError = inheritedSampleCount;
+	}
+
+	return entry;
+}
+
+
+/*
+ * TenantLoadList returns the sampled load of the tenants in the current
+ * database as a list of TenantLoad pointers.
+ */
+List *
+TenantLoadList(void)
+{
+	List *tenantLoadList = NIL;
+	HASH_SEQ_STATUS status;
+
+	if (TenantLoadHash == NULL)
+	{
+		return NIL;
+	}
+
+	LWLockAcquire(&TenantLoadStatsControl->lock, LW_SHARED);
+
+	hash_seq_init(&status, TenantLoadHash);
+
+	TenantLoadEntry *entry = NULL;
+	while ((entry = (TenantLoadEntry *) hash_seq_search(&status)) != NULL)
+	{
+		bool found = false;
+
+		if (entry->key.group.databaseId != MyDatabaseId)
+		{
+			continue;
+		}
+
+		TenantLoad *tenantLoad = palloc0(sizeof(TenantLoad));
+		tenantLoad->colocationId = entry->key.group.colocationId;
+		strlcpy(tenantLoad->tenantValue, entry->key.tenantValue,
+				TENANT_VALUE_MAX_LENGTH);
+
+		volatile TenantLoadEntry *e = (volatile TenantLoadEntry *) entry;
+
+		SpinLockAcquire(&e->mutex);
+		tenantLoad->relationId = e->relationId;
+		tenantLoad->calls = e->calls;
+		tenantLoad->rows = e->rows;
+		tenantLoad->totalTimeMs = e->totalTimeMs;
+		tenantLoad->cpuTimeMs = e->cpuTimeMs;
+		tenantLoad->sampleCount = e->sampleCount;
+		tenantLoad->sampleCountError = e->sampleCountError;
+		SpinLockRelease(&e->mutex);
+
+		TenantLoadGroupEntry *groupEntry =
+			(TenantLoadGroupEntry *) hash_search(TenantLoadGroupHash, &entry->key.group,
+												 HASH_FIND, &found);
+		if (groupEntry != NULL)
+		{
+			volatile TenantLoadGroupEntry *g =
+				(volatile TenantLoadGroupEntry *) groupEntry;
+
+			SpinLockAcquire(&g->mutex);
+			tenantLoad->groupSampleCount = g->sampleCount;
+			SpinLockRelease(&g->mutex);
+		}
+
+		tenantLoadList = lappend(tenantLoadList, tenantLoad);
+	}
+
+	LWLockRelease(&TenantLoadStatsControl->lock);
+
+	return tenantLoadList;
+}
+
+
+/*
+ * RemoveTenantLoad forgets the sampled load of the given tenant of the
+ * current database, such that it has to become hot again to be considered.
+ */
+void
+RemoveTenantLoad(uint32 colocationId, const char *tenantValue)
+{
+	TenantLoadKey key;
+
+	if (TenantLoadHash == NULL)
+	{
+		return;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.group.databaseId = MyDatabaseId;
+	key.group.colocationId = colocationId;
+	strlcpy(key.tenantValue, tenantValue, TENANT_VALUE_MAX_LENGTH);
+
+	LWLockAcquire(&TenantLoadStatsControl->lock, LW_EXCLUSIVE);
+
+	hash_search(TenantLoadHash, &key, HASH_REMOVE, NULL);
+
+	LWLockRelease(&TenantLoadStatsControl->lock);
+}
+
+
+/*
+ * DecayTenantLoadStats halves the sample counts of the tenants and colocation
+ * groups in the current database, such that they reflect recent load, and
+ * removes the ones that are barely queried anymore. The calls, rows and times
+ * of the tenants keep counting up while they are in the hash.
+ */
+void
+DecayTenantLoadStats(void)
+{
+	HASH_SEQ_STATUS status;
+
+	if (TenantLoadHash == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&TenantLoadStatsControl->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, TenantLoadHash);
+
+	TenantLoadEntry *entry = NULL;
+	while ((entry = (TenantLoadEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (entry->key.group.databaseId != MyDatabaseId)
+		{
+			continue;
+		}
+
+		/* no spinlock needed, we hold the lock exclusively */
+		entry->sampleCount /= 2;
+		entry->sampleCountError /= 2;
+
+		if (entry->sampleCount < TENANT_LOAD_STATS_MIN_SAMPLE_COUNT)
+		{
+			hash_search(TenantLoadHash, &entry->key, HASH_REMOVE, NULL);
+		}
+	}
+
+	hash_seq_init(&status, TenantLoadGroupHash);
+
+	TenantLoadGroupEntry *groupEntry = NULL;
+	while ((groupEntry = (TenantLoadGroupEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (groupEntry->key.databaseId != MyDatabaseId)
+		{
+			continue;
+		}
+
+		groupEntry->sampleCount /= 2;
+
+		if (groupEntry->sampleCount < TENANT_LOAD_STATS_MIN_SAMPLE_COUNT)
+		{
+			hash_search(TenantLoadGroupHash, &groupEntry->key, HASH_REMOVE, NULL);
+		}
+	}
+
+	LWLockRelease(&TenantLoadStatsControl->lock);
+}
+
+
+/*
+ * citus_tenant_load_stats returns the estimated calls, rows, execution time
+ * and CPU time in milliseconds of the router queries of the tenants in the
+ * current database, along with the decayed number of sampled queries and
+ * their share of the sampled queries of their colocation group.
+ */
+Datum
+citus_tenant_load_stats(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	TenantLoad *tenantLoad = NULL;
+	foreach_ptr(tenantLoad, TenantLoadList())
+	{
+		Datum values[TENANT_LOAD_STATS_COLUMNS];
+		bool isNulls[TENANT_LOAD_STATS_COLUMNS];
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = UInt32GetDatum(tenantLoad->colocationId);
+		values[1] = ObjectIdGetDatum(tenantLoad->relationId);
+		values[2] = CStringGetTextDatum(tenantLoad->tenantValue);
+		values[3] = Int64GetDatum((int64) (tenantLoad->calls + 0.5));
+		values[4] = Int64GetDatum((int64) (tenantLoad->rows + 0.5));
+		values[5] = Float8GetDatum(tenantLoad->totalTimeMs);
+		values[6] = Float8GetDatum(tenantLoad->cpuTimeMs);
+		values[7] = Float8GetDatum(tenantLoad->sampleCount);
+
+		if (tenantLoad->groupSampleCount > 0)
+		{
+			values[8] = Float8GetDatum(tenantLoad->sampleCount /
+									   tenantLoad->groupSampleCount);
+		}
+		else
+		{
+			isNulls[8] = true;
+		}
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	PG_RETURN_VOID();
+}
@@ -14,8 +14,13 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#endif
 
 #include "commands/defrem.h"
+#include "distributed/citus_safe_lib.h"
 #include "distributed/listutils.h"
 #include "distributed/relay_utility.h"
 #include "distributed/transmit.h"
@@ -24,15 +29,40 @@
 #include "distributed/version_compat.h"
 #include "libpq/libpq.h"
 #include "libpq/pqformat.h"
+#include "port/pg_bswap.h"
 #include "storage/fd.h"
+#include "storage/latch.h"
+#include "tcop/tcopprot.h"
+
+
+/*
+ * Files are sent in copy data messages of at most 1 MB, which is large enough
+ * to keep the number of system calls low, and small enough for the receiving
+ * side, which buffers each message in full.
+ */
+#define TRANSMIT_FILE_BUFFER_SIZE (1024 * 1024)
+
+/* size of the header of a copy data message: the type and the length */
+#define COPY_DATA_HEADER_SIZE 5
+
+
+/* GUC, whether files are sent to clients without copying them into userspace */
+bool EnableZeroCopyResultTransfer = false;
 
 
 /* Local functions forward declarations */
 static void SendCopyInStart(void);
 static void SendCopyOutStart(void);
 static void SendCopyDone(void);
-static void SendCopyData(StringInfo fileBuffer);
-static bool ReceiveCopyData(StringInfo copyData);
+static void SendFileViaBuffer(File fileDesc);
+#ifdef __linux__
+static bool CanSendFileZeroCopy(void);
+static void SendFileZeroCopy(File fileDesc);
+static void SendBytesToClientSocket(const char *data, size_t length);
+static void SendFileRangeToClientSocket(int fileDescriptor, off_t offset,
+										size_t length);
+static void WaitForClientSocketWritable(void);
+#endif
 static void FreeStringInfo(StringInfo stringInfo);
 
 
@@ -81,47 +111,252 @@ RedirectCopyDataToRegularFile(const char *filename)
  * SendRegularFile reads data from the given file, and sends these data to
  * stdout using the standard copy protocol. After all file data are sent, the
  * function ends the copy protocol and closes the file.
+ *
+ * When citus.enable_zero_copy_result_transfer is on and the connection is not
+ * encrypted, the kernel sends the file contents to the client socket directly
+ * with sendfile(), such that they are not copied through the backend.
  */
 void
 SendRegularFile(const char *filename)
 {
-	const uint32 fileBufferSize = 32768; /* 32 KB */
 	const int fileFlags = (O_RDONLY | PG_BINARY);
 	const int fileMode = 0;
 
 	/* we currently do not check if the caller has permissions for this file */
 	File fileDesc = FileOpenForTransmit(filename, fileFlags, fileMode);
+
+	SendCopyOutStart();
+
+#ifdef __linux__
+	if (EnableZeroCopyResultTransfer && CanSendFileZeroCopy())
+	{
+		SendFileZeroCopy(fileDesc);
+	}
+	else
+#endif
+	{
+		SendFileViaBuffer(fileDesc);
+	}
+
+	SendCopyDone();
+
+	FileClose(fileDesc);
+}
+
+
+/*
+ * SendFileViaBuffer reads the contents of the given file into a buffer and
+ * sends each buffer as a copy data message. The messages are passed to
+ * pq_putmessage directly from the buffer, which sends large messages to the
+ * client without copying them to its own buffer.
+ */
+static void
+SendFileViaBuffer(File fileDesc)
+{
 	FileCompat fileCompat = FileCompatFromFileStart(fileDesc);
 
-	/*
-	 * We read file's contents into buffers of 32 KB. This buffer size is twice
-	 * as large as Hadoop's default buffer size, and may later be configurable.
-	 */
 	StringInfo fileBuffer = makeStringInfo();
-	enlargeStringInfo(fileBuffer, fileBufferSize);
-
-	SendCopyOutStart();
+	enlargeStringInfo(fileBuffer, TRANSMIT_FILE_BUFFER_SIZE);
 
-	int readBytes = FileReadCompat(&fileCompat, fileBuffer->data, fileBufferSize,
-								   PG_WAIT_IO);
+	int readBytes = FileReadCompat(&fileCompat, fileBuffer->data,
+								   TRANSMIT_FILE_BUFFER_SIZE, PG_WAIT_IO);
 	while (readBytes > 0)
 	{
-		fileBuffer->len = readBytes;
-
-		SendCopyData(fileBuffer);
+		pq_putmessage('d', fileBuffer->data, readBytes);
 
-		resetStringInfo(fileBuffer);
-		readBytes = FileReadCompat(&fileCompat, fileBuffer->data, fileBufferSize,
-								   PG_WAIT_IO);
+		readBytes = FileReadCompat(&fileCompat, fileBuffer->data,
+								   TRANSMIT_FILE_BUFFER_SIZE, PG_WAIT_IO);
 	}
 
-	SendCopyDone();
+	if (readBytes < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read file: %m")));
+	}
 
 	FreeStringInfo(fileBuffer);
-	FileClose(fileDesc);
 }
 
 
+#ifdef __linux__
+
+/*
+ * CanSendFileZeroCopy returns whether we can write to the socket of the client
+ * ourselves, which requires a regular frontend connection that is not
+ * encrypted.
+ */
+static bool
+CanSendFileZeroCopy(void)
+{
+	if (MyProcPort == NULL || whereToSendOutput != DestRemote)
+	{
+		return false;
+	}
+
+#ifdef USE_SSL
+	if (MyProcPort->ssl_in_use)
+	{
+		return false;
+	}
+#endif
+
+#ifdef ENABLE_GSS
+	if (be_gssapi_get_enc(MyProcPort))
+	{
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+
+/*
+ * SendFileZeroCopy sends the contents of the given file as copy data messages,
+ * writing the header of each message to the client socket and then letting
+ * the kernel send the contents with sendfile(). Errors while writing to the
+ * socket terminate the backend, since the client cannot make sense of the
+ * connection after a partial message.
+ */
+static void
+SendFileZeroCopy(File fileDesc)
+{
+	int fileDescriptor = FileGetRawDesc(fileDesc);
+	struct stat fileStat;
+
+	if (fstat(fileDescriptor, &fileStat) < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not stat file: %m")));
+	}
+
+	/* the messages that are already buffered, like CopyOutResponse, go first */
+	if (pq_flush() != 0)
+	{
+		ereport(FATAL, (errcode(ERRCODE_CONNECTION_FAILURE),
+						errmsg("could not send data to client")));
+	}
+
+	off_t offset = 0;
+	while (offset < fileStat.st_size)
+	{
+		size_t length = Min(fileStat.st_size - offset, TRANSMIT_FILE_BUFFER_SIZE);
+		char header[COPY_DATA_HEADER_SIZE];
+
+		/* the message length includes the length itself */
+		uint32 messageLength = pg_hton32((uint32) length + 4);
+
+		header[0] = 'd';
+		memcpy_s(header + 1, sizeof(header) - 1, &messageLength, sizeof(messageLength));
+
+		SendBytesToClientSocket(header, sizeof(header));
+		SendFileRangeToClientSocket(fileDescriptor, offset, length);
+
+		offset += length;
+	}
+}
+
+
+/*
+ * SendBytesToClientSocket writes the given bytes to the client socket, waiting
+ * for the socket to become writable when needed.
+ */
+static void
+SendBytesToClientSocket(const char *data, size_t length)
+{
+	size_t sentBytes = 0;
+
+	while (sentBytes < length)
+	{
+		ssize_t written = send(MyProcPort->sock, data + sentBytes,
+							   length - sentBytes, 0);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				WaitForClientSocketWritable();
+				continue;
+			}
+
+			ereport(FATAL, (errcode_for_socket_access(),
+							errmsg("could not send data to client: %m")));
+		}
+
+		sentBytes += written;
+	}
+}
+
+
+/*
+ * SendFileRangeToClientSocket sends the given range of the given file to the
+ * client socket with sendfile(), waiting for the socket to become writable
+ * when needed.
+ */
+static void
+SendFileRangeToClientSocket(int fileDescriptor, off_t offset, size_t length)
+{
+	off_t endOffset = offset + length;
+
+	while (offset < endOffset)
+	{
+		ssize_t written = sendfile(MyProcPort->sock, fileDescriptor, &offset,
+								   endOffset - offset);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				WaitForClientSocketWritable();
+				continue;
+			}
+
+			ereport(FATAL, (errcode_for_socket_access(),
+							errmsg("could not send file to client: %m")));
+		}
+		else if (written == 0)
+		{
+			/* the file got shorter than it was, we cannot finish the message */
+			ereport(FATAL, (errcode_for_file_access(),
+							errmsg("could not send file to client: "
+								   "unexpected end of file")));
+		}
+	}
+}
+
+
+/*
+ * WaitForClientSocketWritable waits for the non-blocking client socket to
+ * become writable. Like secure_write(), it only acts on interrupts that
+ * terminate the backend, since we are in the middle of a message.
+ */
+static void
+WaitForClientSocketWritable(void)
+{
+	int waitFlags = WL_SOCKET_WRITEABLE | WL_LATCH_SET | WL_EXIT_ON_PM_DEATH;
+	long timeout = -1;
+
+	int rc = WaitLatchOrSocket(MyLatch, waitFlags, MyProcPort->sock, timeout,
+							   WAIT_EVENT_CLIENT_WRITE);
+	if (rc & WL_LATCH_SET)
+	{
+		ResetLatch(MyLatch);
+
+		bool blocked = true;
+		ProcessClientWriteInterrupt(blocked);
+	}
+}
+
+
+#endif
+
+
 /* Helper function that deallocates string info object. */
 static void
 FreeStringInfo(StringInfo stringInfo)
@@ -223,18 +458,6 @@ SendCopyDone(void)
 }
 
 
-/* Sends the copy data message to stdout. */
-static void
-SendCopyData(StringInfo fileBuffer)
-{
-	StringInfoData copyData = { NULL, 0, 0, 0 };
-
-	pq_beginmessage(&copyData, 'd');
-	pq_sendbytes(&copyData, fileBuffer->data, fileBuffer->len);
-	pq_endmessage(&copyData);
-}
-
-
 /*
  * ReceiveCopyData receives one copy data message from stdin, and writes this
  * message's contents into the given argument. The function then checks if the
@@ -243,7 +466,7 @@ SendCopyData(StringInfo fileBuffer)
  * If the received message does not conform to the copy protocol, the function
  * mirrors copy.c's error behavior.
  */
-static bool
+bool
 ReceiveCopyData(StringInfo copyData)
 {
 	bool copyDone = true;
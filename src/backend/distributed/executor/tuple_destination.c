@@ -7,12 +7,26 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "distributed/pg_version_constants.h"
+
 #include "access/htup_details.h"
+#if PG_VERSION_NUM >= PG_VERSION_14
+#include "access/toast_compression.h"
+#endif
+#include "access/toast_internals.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/tuple_destination.h"
 
 
+/* variable-length values smaller than this are not worth compressing */
+#define MIN_COMPRESSED_RESULT_VALUE_SIZE 256
+
+
+/* GUC, whether large result sets are stored with compressed values */
+bool EnableSpilledResultCompression = false;
+
+
 /*
  * TupleStoreTupleDestination is internal representation of a TupleDestination
  * which forwards tuples to a tuple store.
@@ -26,6 +40,9 @@ typedef struct TupleStoreTupleDestination
 
 	/* how does tuples look like? */
 	TupleDesc tupleDesc;
+
+	/* number of bytes of the tuples that we put into the tuple store */
+	uint64 storedTupleBytes;
 } TupleStoreTupleDestination;
 
 /*
@@ -47,6 +64,7 @@ typedef struct TupleDestDestReceiver
 static void TupleStoreTupleDestPutTuple(TupleDestination *self, Task *task,
 										int placementIndex, int queryNumber,
 										HeapTuple heapTuple, uint64 tupleLibpqSize);
+static HeapTuple CompressTupleValues(HeapTuple heapTuple, TupleDesc tupleDesc);
 static void EnsureIntermediateSizeLimitNotExceeded(TupleDestinationStats *
 												   tupleDestinationStats);
 static TupleDesc TupleStoreTupleDestTupleDescForQuery(TupleDestination *self, int
@@ -121,14 +139,107 @@ TupleStoreTupleDestPutTuple(TupleDestination *self, Task *task,
 		EnsureIntermediateSizeLimitNotExceeded(tupleDestinationStats);
 	}
 
-	/* do the actual work */
-	tuplestore_puttuple(tupleDest->tupleStore, heapTuple);
+	/*
+	 * Once the tuples no longer fit in work_mem, the tuple store writes them
+	 * to a temporary file. Compressing the wide values of the tuples that go
+	 * to the file trades some CPU for less temporary file I/O.
+	 */
+	if (EnableSpilledResultCompression &&
+		tupleDest->storedTupleBytes > work_mem * 1024L &&
+		HeapTupleHasVarWidth(heapTuple))
+	{
+		HeapTuple compressedTuple = CompressTupleValues(heapTuple,
+														tupleDest->tupleDesc);
+
+		tuplestore_puttuple(tupleDest->tupleStore, compressedTuple);
+
+		if (compressedTuple != heapTuple)
+		{
+			heap_freetuple(compressedTuple);
+		}
+	}
+	else
+	{
+		/* do the actual work */
+		tuplestore_puttuple(tupleDest->tupleStore, heapTuple);
+	}
+
+	tupleDest->storedTupleBytes += heapTuple->t_len;
 
 	/* we record tuples received over network */
 	task->totalReceivedTupleData += tupleLibpqSize;
 }
 
 
+/*
+ * CompressTupleValues returns a copy of the given tuple in which the wide
+ * variable-length values are compressed inline, the same way as Postgres
+ * compresses them on disk. Functions that read the values transparently
+ * decompress them. Returns the tuple itself if no value got smaller.
+ */
+static HeapTuple
+CompressTupleValues(HeapTuple heapTuple, TupleDesc tupleDesc)
+{
+	int columnCount = tupleDesc->natts;
+	Datum *values = palloc(columnCount * sizeof(Datum));
+	bool *isNulls = palloc(columnCount * sizeof(bool));
+	bool *isCompressed = palloc0(columnCount * sizeof(bool));
+	bool anyCompressed = false;
+
+	heap_deform_tuple(heapTuple, tupleDesc, values, isNulls);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDesc, columnIndex);
+		if (isNulls[columnIndex] || attribute->attlen != -1)
+		{
+			continue;
+		}
+
+		struct varlena *value = (struct varlena *) DatumGetPointer(values[columnIndex]);
+		if (VARATT_IS_EXTENDED(value) ||
+			VARSIZE(value) < MIN_COMPRESSED_RESULT_VALUE_SIZE)
+		{
+			continue;
+		}
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+		Datum compressedValue = toast_compress_datum(values[columnIndex],
+													 default_toast_compression);
+#else
+		Datum compressedValue = toast_compress_datum(values[columnIndex]);
+#endif
+
+		if (DatumGetPointer(compressedValue) != NULL)
+		{
+			values[columnIndex] = compressedValue;
+			isCompressed[columnIndex] = true;
+			anyCompressed = true;
+		}
+	}
+
+	HeapTuple compressedTuple = heapTuple;
+	if (anyCompressed)
+	{
+		compressedTuple = heap_form_tuple(tupleDesc, values, isNulls);
+
+		for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			if (isCompressed[columnIndex])
+			{
+				pfree(DatumGetPointer(values[columnIndex]));
+			}
+		}
+	}
+
+	pfree(values);
+	pfree(isNulls);
+	pfree(isCompressed);
+
+	return compressedTuple;
+}
+
+
 /*
  * EnsureIntermediateSizeLimitNotExceeded is a helper function for checking the current
  * state of the tupleDestinationStats and throws error if necessary.
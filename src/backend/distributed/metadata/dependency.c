@@ -49,7 +49,9 @@
 #include "miscadmin.h"
 #include "utils/fmgroids.h"
 #include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/syscache.h"
 
 /*
@@ -117,6 +119,26 @@ typedef struct DependencyDefinition
 	} data;
 } DependencyDefinition;
 
+/*
+ * DependencyCacheKey identifies the object whose dependencies are cached.
+ */
+typedef struct DependencyCacheKey
+{
+	Oid classId;
+	Oid objectId;
+} DependencyCacheKey;
+
+/*
+ * DependencyCacheEntry holds the pg_depend and pg_shdepend records describing
+ * the dependencies of an object, as returned by DependencyDefinitionList.
+ */
+typedef struct DependencyCacheEntry
+{
+	DependencyCacheKey key;
+	int definitionCount;
+	DependencyDefinition *definitionArray;
+} DependencyCacheEntry;
+
 /*
  * ViewDependencyNode represents a view (or possibly a table) in a dependency graph of
  * views.
@@ -191,9 +213,25 @@ static List * ExpandRolesToGroups(Oid roleid);
 static ViewDependencyNode * BuildViewDependencyGraph(Oid relationId, HTAB *nodeMap);
 static bool IsObjectAddressOwnedByExtension(const ObjectAddress *target,
 											ObjectAddress *extensionAddress);
+static List * DependencyDefinitionList(ObjectAddress target);
+static void InitializeDependencyCache(void);
+static void InvalidateDependencyCacheCallback(Datum argument, Oid relationId);
+static void InvalidateDependencyCacheSyscacheCallback(Datum argument, int cacheId,
+													  uint32 hashValue);
 static bool ErrorOrWarnIfObjectHasUnsupportedDependency(const
 														ObjectAddress *objectAddress);
 
+/* GUC, whether the dependencies of objects are cached across traversals */
+bool EnableDependencyCache = false;
+
+/* per-backend cache of the direct dependencies of objects */
+static HTAB *DependencyCache = NULL;
+static MemoryContext DependencyCacheContext = NULL;
+
+/* whether DependencyCache reflects the current catalogs */
+static bool DependencyCacheValid = false;
+
+
 /*
  * GetUniqueDependenciesList takes a list of object addresses and returns a new list
  * of ObjectAddesses whose elements are unique.
@@ -241,6 +279,33 @@ GetDependenciesForObject(const ObjectAddress *target)
 }
 
 
+/*
+ * GetDependenciesForObjectList returns the dependencies of all the given targets
+ * in creation order, like GetDependenciesForObject does for a single target.
+ * Dependencies shared by several targets are visited only once, and appear in
+ * the list only once. The targets themselves are not part of the list unless
+ * they depend on one another.
+ */
+List *
+GetDependenciesForObjectList(const List *targets)
+{
+	ObjectAddressCollector collector = { 0 };
+	InitObjectAddressCollector(&collector);
+
+	ObjectAddress *target = NULL;
+	foreach_ptr(target, targets)
+	{
+		RecurseObjectDependencies(*target,
+								  &ExpandCitusSupportedTypes,
+								  &FollowNewSupportedDependencies,
+								  &ApplyAddToDependencyList,
+								  &collector);
+	}
+
+	return collector.dependencyList;
+}
+
+
 /*
  * GetAllSupportedDependenciesForObject returns a list of all the ObjectAddresses to be
  * created in order before the target object could safely be created on a worker, if all
@@ -387,10 +452,7 @@ RecurseObjectDependencies(ObjectAddress target, expandFn expand, followFn follow
 	MarkObjectVisited(collector, target);
 
 	/* lookup both pg_depend and pg_shdepend for dependencies */
-	List *pgDependDefinitions = DependencyDefinitionFromPgDepend(target);
-	List *pgShDependDefinitions = DependencyDefinitionFromPgShDepend(target);
-	List *dependenyDefinitionList = list_concat(pgDependDefinitions,
-												pgShDependDefinitions);
+	List *dependenyDefinitionList = DependencyDefinitionList(target);
 
 	/* concat expanded entries if applicable */
 	if (expand != NULL)
@@ -425,6 +487,188 @@ RecurseObjectDependencies(ObjectAddress target, expandFn expand, followFn follow
 }
 
 
+/*
+ * DependencyDefinitionList returns the pg_depend and pg_shdepend records
+ * describing the dependencies of target. When citus.enable_dependency_cache
+ * is on, the records are kept in a per-backend cache, such that traversing
+ * the same objects again, as happens for every propagated DDL command and
+ * for every object when activating a node, does not scan the catalogs.
+ *
+ * The returned list is a copy, since the cache may be reset by invalidations
+ * that arrive while the caller still uses the list.
+ */
+static List *
+DependencyDefinitionList(ObjectAddress target)
+{
+	DependencyCacheKey key;
+	bool found = false;
+
+	if (!EnableDependencyCache)
+	{
+		List *pgDependDefinitions = DependencyDefinitionFromPgDepend(target);
+		List *pgShDependDefinitions = DependencyDefinitionFromPgShDepend(target);
+
+		return list_concat(pgDependDefinitions, pgShDependDefinitions);
+	}
+
+	if (!DependencyCacheValid)
+	{
+		InitializeDependencyCache();
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.classId = target.classId;
+	key.objectId = target.objectId;
+
+	DependencyCacheEntry *entry = hash_search(DependencyCache, &key, HASH_FIND,
+											  &found);
+	if (!found)
+	{
+		List *pgDependDefinitions = DependencyDefinitionFromPgDepend(target);
+		List *pgShDependDefinitions = DependencyDefinitionFromPgShDepend(target);
+		List *definitionList = list_concat(pgDependDefinitions, pgShDependDefinitions);
+
+		/* the scans may have processed invalidations that reset the cache */
+		if (!DependencyCacheValid)
+		{
+			return definitionList;
+		}
+
+		int definitionCount = list_length(definitionList);
+		DependencyDefinition *definitionArray =
+			MemoryContextAlloc(DependencyCacheContext,
+							   Max(definitionCount, 1) * sizeof(DependencyDefinition));
+
+		int definitionIndex = 0;
+		DependencyDefinition *definition = NULL;
+		foreach_ptr(definition, definitionList)
+		{
+			definitionArray[definitionIndex] = *definition;
+			definitionIndex++;
+		}
+
+		entry = hash_search(DependencyCache, &key, HASH_ENTER, &found);
+		entry->definitionCount = definitionCount;
+		entry->definitionArray = definitionArray;
+
+		return definitionList;
+	}
+
+	List *definitionList = NIL;
+	for (int definitionIndex = 0; definitionIndex < entry->definitionCount;
+		 definitionIndex++)
+	{
+		DependencyDefinition *definition = palloc(sizeof(DependencyDefinition));
+		*definition = entry->definitionArray[definitionIndex];
+
+		definitionList = lappend(definitionList, definition);
+	}
+
+	return definitionList;
+}
+
+
+/*
+ * InitializeDependencyCache creates an empty dependency cache, or empties the
+ * existing one. The invalidation callbacks are registered on first use.
+ */
+static void
+InitializeDependencyCache(void)
+{
+	HASHCTL info;
+
+	if (DependencyCacheContext == NULL)
+	{
+		DependencyCacheContext = AllocSetContextCreate(CacheMemoryContext,
+													   "Dependency Cache",
+													   ALLOCSET_DEFAULT_SIZES);
+
+		/*
+		 * Changes to pg_depend come with invalidations of the objects that
+		 * depend on something, which are typically relations, types, functions
+		 * and the other kinds of objects Citus propagates. Rather than track
+		 * which cached objects an invalidation covers, any of them resets the
+		 * whole cache.
+		 */
+		CacheRegisterRelcacheCallback(InvalidateDependencyCacheCallback, (Datum) 0);
+		CacheRegisterSyscacheCallback(TYPEOID,
+									  InvalidateDependencyCacheSyscacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(PROCOID,
+									  InvalidateDependencyCacheSyscacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(NAMESPACEOID,
+									  InvalidateDependencyCacheSyscacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(COLLOID,
+									  InvalidateDependencyCacheSyscacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(AUTHOID,
+									  InvalidateDependencyCacheSyscacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(FOREIGNSERVEROID,
+									  InvalidateDependencyCacheSyscacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(TSCONFIGOID,
+									  InvalidateDependencyCacheSyscacheCallback,
+									  (Datum) 0);
+		CacheRegisterSyscacheCallback(TSDICTOID,
+									  InvalidateDependencyCacheSyscacheCallback,
+									  (Datum) 0);
+	}
+	else
+	{
+		MemoryContextReset(DependencyCacheContext);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(DependencyCacheKey);
+	info.entrysize = sizeof(DependencyCacheEntry);
+	info.hcxt = DependencyCacheContext;
+	int hashFlags = (HASH_ELEM | HASH_CONTEXT | HASH_BLOBS);
+
+	DependencyCache = hash_create("Dependency Cache", 256, &info, hashFlags);
+
+	DependencyCacheValid = true;
+}
+
+
+/*
+ * ResetDependencyCache marks the dependency cache of this backend as outdated,
+ * for dependency changes that do not come with an invalidation, such as
+ * adding objects to or dropping them from an extension.
+ */
+void
+ResetDependencyCache(void)
+{
+	DependencyCacheValid = false;
+}
+
+
+/*
+ * InvalidateDependencyCacheCallback marks the dependency cache as outdated
+ * when a relation changes. The cache is emptied on next use, since the
+ * callback may run while a traversal uses the cached entries.
+ */
+static void
+InvalidateDependencyCacheCallback(Datum argument, Oid relationId)
+{
+	DependencyCacheValid = false;
+}
+
+
+/*
+ * InvalidateDependencyCacheSyscacheCallback marks the dependency cache as
+ * outdated when one of the objects whose dependencies Citus follows changes.
+ */
+static void
+InvalidateDependencyCacheSyscacheCallback(Datum argument, int cacheId,
+										  uint32 hashValue)
+{
+	DependencyCacheValid = false;
+}
+
+
 /*
  * DependencyDefinitionFromPgDepend loads all pg_depend records describing the
  * dependencies of target.
@@ -0,0 +1,653 @@
+/*-------------------------------------------------------------------------
+ *
+ * distributed_table_statistics.c
+ *
+ * Routines for computing column statistics of distributed tables and storing
+ * them in pg_statistic for their shell tables on the coordinator. The shell
+ * tables do not hold any rows, so without these statistics the coordinator's
+ * planner guesses the selectivities when planning queries that involve them,
+ * for instance to combine the results of a distributed query or to join a
+ * distributed table with a local table.
+ *
+ * The statistics are computed the same way ANALYZE computes them: we sample
+ * rows uniformly from all shards, and let the type's analyze routine compute
+ * the null fraction, width, number of distinct values, most common values and
+ * histogram of each column from the sample.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "fmgr.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "access/htup_details.h"
+#include "access/relation.h"
+#include "access/table.h"
+#include "access/tupdesc.h"
+#include "access/xact.h"
+#include "catalog/indexing.h"
+#include "catalog/pg_statistic.h"
+#include "catalog/pg_type.h"
+#include "commands/vacuum.h"
+#include "executor/tuptable.h"
+#include "utils/acl.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+#include "utils/tuplestore.h"
+
+#include "distributed/citus_safe_lib.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_table_statistics.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_utility.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/relay_utility.h"
+#include "distributed/tuple_destination.h"
+
+
+/* GUC, interval in milliseconds between statistics refreshes, 0 to disable */
+int DistributedStatisticsRefreshInterval = 0;
+
+
+static List * AnalyzableColumnStats(Relation relation, MemoryContext analyzeContext);
+static VacAttrStats * ExamineColumn(Relation relation, int attributeNumber,
+									MemoryContext analyzeContext);
+static double DistributedTableRowCount(List *shardIntervalList);
+static HeapTuple * SampleShardRows(List *shardIntervalList, List *columnStatsList,
+								   TupleDesc sampleTupleDesc, double samplePercentage,
+								   int *sampleRowCount);
+static TupleDesc SampleTupleDesc(List *columnStatsList);
+static List * ShardReadTaskList(List *shardIntervalList, List *queryStringList);
+static char * QualifiedShardName(ShardInterval *shardInterval);
+static Datum SampleRowFetchFunc(VacAttrStatsP stats, int rownum, bool *isNull);
+static void StoreColumnStatistics(Oid relationId, bool inherited, List *columnStatsList);
+
+PG_FUNCTION_INFO_V1(citus_analyze_distributed);
+
+
+/*
+ * citus_analyze_distributed computes the column statistics of the given
+ * distributed table, or of all distributed tables the user owns when no table
+ * is given, and stores them for the shell tables on this node.
+ */
+Datum
+citus_analyze_distributed(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	if (PG_ARGISNULL(0))
+	{
+		AnalyzeAllDistributedTables();
+	}
+	else
+	{
+		Oid relationId = PG_GETARG_OID(0);
+
+		EnsureTableOwner(relationId);
+
+		if (!IsCitusTableType(relationId, DISTRIBUTED_TABLE) &&
+			!IsCitusTableType(relationId, REFERENCE_TABLE))
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("table \"%s\" is not a distributed table",
+								   get_rel_name(relationId))));
+		}
+
+		AnalyzeDistributedTable(relationId);
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * AnalyzeAllDistributedTables computes the column statistics of all distributed
+ * and reference tables that the current user owns, and skips the other tables
+ * with a warning, like ANALYZE does.
+ */
+void
+AnalyzeAllDistributedTables(void)
+{
+	List *citusTableIds = AllCitusTableIds();
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, citusTableIds)
+	{
+		if (!IsCitusTableType(relationId, DISTRIBUTED_TABLE) &&
+			!IsCitusTableType(relationId, REFERENCE_TABLE))
+		{
+			continue;
+		}
+
+		char *relationName = get_rel_name(relationId);
+		if (relationName == NULL)
+		{
+			/* table was dropped concurrently */
+			continue;
+		}
+
+		if (!pg_class_ownercheck(relationId, GetUserId()))
+		{
+			ereport(WARNING, (errmsg("skipping \"%s\" --- only table or database "
+									 "owner can analyze it", relationName)));
+			continue;
+		}
+
+		AnalyzeDistributedTable(relationId);
+	}
+}
+
+
+/*
+ * AnalyzeDistributedTable samples rows from the shards of the given table,
+ * computes the column statistics and stores them in pg_statistic for the shell
+ * table. The sample size is picked by the type analyze routines, which follow
+ * the statistics targets of the columns. The sampling fraction is based on
+ * the reltuples of the shards, so tables whose shards were never vacuumed or
+ * analyzed are skipped.
+ */
+void
+AnalyzeDistributedTable(Oid relationId)
+{
+	/* same lock as ANALYZE, such that concurrent analyzes are serialized */
+	Relation relation = try_relation_open(relationId, ShareUpdateExclusiveLock);
+	if (relation == NULL)
+	{
+		/* table was dropped concurrently */
+		return;
+	}
+
+	MemoryContext analyzeContext = AllocSetContextCreate(CurrentMemoryContext,
+														 "Distributed Analyze",
+														 ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(analyzeContext);
+
+	List *columnStatsList = AnalyzableColumnStats(relation, analyzeContext);
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+	double totalRowCount = DistributedTableRowCount(shardIntervalList);
+
+	if (columnStatsList == NIL)
+	{
+		ereport(DEBUG1, (errmsg("skipping \"%s\" --- no columns to analyze",
+								RelationGetRelationName(relation))));
+	}
+	else if (totalRowCount <= 0.0)
+	{
+		ereport(NOTICE, (errmsg("skipping \"%s\" --- its shards have no row "
+								"estimates", RelationGetRelationName(relation)),
+						 errhint("Run ANALYZE on the table to compute row "
+								 "estimates for its shards.")));
+	}
+	else
+	{
+		int targetRowCount = 0;
+
+		VacAttrStats *columnStats = NULL;
+		foreach_ptr(columnStats, columnStatsList)
+		{
+			targetRowCount = Max(targetRowCount, columnStats->minrows);
+		}
+
+		double samplePercentage = Min(100.0, 100.0 * targetRowCount / totalRowCount);
+		TupleDesc sampleTupleDesc = SampleTupleDesc(columnStatsList);
+		int sampleRowCount = 0;
+		HeapTuple *sampleRows = SampleShardRows(shardIntervalList, columnStatsList,
+												sampleTupleDesc, samplePercentage,
+												&sampleRowCount);
+
+		ereport(DEBUG1, (errmsg("analyzing \"%s\" using %d sampled rows out of "
+								"about %.0f rows", RelationGetRelationName(relation),
+								sampleRowCount, totalRowCount)));
+
+		if (sampleRowCount > 0)
+		{
+			int columnIndex = 0;
+			foreach_ptr(columnStats, columnStatsList)
+			{
+				columnStats->rows = sampleRows;
+				columnStats->tupDesc = sampleTupleDesc;
+				columnStats->tupattnum = columnIndex + 1;
+
+				columnStats->compute_stats(columnStats, SampleRowFetchFunc,
+										   sampleRowCount,
+										   Max(totalRowCount, sampleRowCount));
+
+				columnIndex++;
+			}
+
+			/* statistics of partitioned tables cover their partitions */
+			bool inherited =
+				relation->rd_rel->relkind == RELKIND_PARTITIONED_TABLE;
+
+			StoreColumnStatistics(relationId, inherited, columnStatsList);
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(analyzeContext);
+
+	relation_close(relation, NoLock);
+}
+
+
+/*
+ * AnalyzableColumnStats returns a VacAttrStats for each column of the relation
+ * that ANALYZE would compute statistics for.
+ */
+static List *
+AnalyzableColumnStats(Relation relation, MemoryContext analyzeContext)
+{
+	List *columnStatsList = NIL;
+	int attributeCount = RelationGetNumberOfAttributes(relation);
+
+	for (int attributeNumber = 1; attributeNumber <= attributeCount; attributeNumber++)
+	{
+		VacAttrStats *columnStats = ExamineColumn(relation, attributeNumber,
+												  analyzeContext);
+		if (columnStats != NULL)
+		{
+			columnStatsList = lappend(columnStatsList, columnStats);
+		}
+	}
+
+	return columnStatsList;
+}
+
+
+/*
+ * ExamineColumn prepares the VacAttrStats for a column of the relation and
+ * runs the type's analyze routine on it, or returns NULL if the column should
+ * not be analyzed. It follows examine_attribute in PostgreSQL's analyze.c.
+ */
+static VacAttrStats *
+ExamineColumn(Relation relation, int attributeNumber, MemoryContext analyzeContext)
+{
+	Form_pg_attribute attribute = TupleDescAttr(RelationGetDescr(relation),
+												attributeNumber - 1);
+
+	if (attribute->attisdropped || attribute->attstattarget == 0)
+	{
+		return NULL;
+	}
+
+	VacAttrStats *columnStats = palloc0(sizeof(VacAttrStats));
+	columnStats->attr = palloc(ATTRIBUTE_FIXED_PART_SIZE);
+	memcpy_s(columnStats->attr, ATTRIBUTE_FIXED_PART_SIZE, attribute,
+			 ATTRIBUTE_FIXED_PART_SIZE);
+	columnStats->attrtypid = attribute->atttypid;
+	columnStats->attrtypmod = attribute->atttypmod;
+	columnStats->attrcollid = attribute->attcollation;
+
+	HeapTuple typeTuple = SearchSysCacheCopy1(TYPEOID,
+											  ObjectIdGetDatum(attribute->atttypid));
+	if (!HeapTupleIsValid(typeTuple))
+	{
+		elog(ERROR, "cache lookup failed for type %u", attribute->atttypid);
+	}
+
+	columnStats->attrtype = (Form_pg_type) GETSTRUCT(typeTuple);
+	columnStats->anl_context = analyzeContext;
+	columnStats->tupattnum = attributeNumber;
+
+	for (int slotIndex = 0; slotIndex < STATISTIC_NUM_SLOTS; slotIndex++)
+	{
+		columnStats->statypid[slotIndex] = columnStats->attrtypid;
+		columnStats->statyplen[slotIndex] = columnStats->attrtype->typlen;
+		columnStats->statypbyval[slotIndex] = columnStats->attrtype->typbyval;
+		columnStats->statypalign[slotIndex] = columnStats->attrtype->typalign;
+	}
+
+	bool analyzable = false;
+	if (OidIsValid(columnStats->attrtype->typanalyze))
+	{
+		analyzable = DatumGetBool(OidFunctionCall1(columnStats->attrtype->typanalyze,
+												   PointerGetDatum(columnStats)));
+	}
+	else
+	{
+		analyzable = std_typanalyze(columnStats);
+	}
+
+	if (!analyzable || columnStats->compute_stats == NULL || columnStats->minrows <= 0)
+	{
+		return NULL;
+	}
+
+	return columnStats;
+}
+
+
+/*
+ * DistributedTableRowCount returns the sum of the reltuples of the given
+ * shards, counting the leaf partitions of partitioned shards. Shards that were
+ * never vacuumed or analyzed count as empty.
+ */
+static double
+DistributedTableRowCount(List *shardIntervalList)
+{
+	List *queryStringList = NIL;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		StringInfo rowCountQuery = makeStringInfo();
+
+		appendStringInfo(rowCountQuery,
+						 "SELECT coalesce(sum(c.reltuples) FILTER "
+						 "(WHERE c.reltuples > 0), 0)::float8 "
+						 "FROM pg_partition_tree(to_regclass(%s)) AS t "
+						 "JOIN pg_class c ON (c.oid = t.relid) WHERE t.isleaf",
+						 quote_literal_cstr(QualifiedShardName(shardInterval)));
+
+		queryStringList = lappend(queryStringList, rowCountQuery->data);
+	}
+
+	TupleDesc rowCountTupleDesc = CreateTemplateTupleDesc(1);
+	TupleDescInitEntry(rowCountTupleDesc, (AttrNumber) 1, "row_count",
+					   FLOAT8OID, -1, 0);
+
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+	TupleDestination *tupleDest = CreateTupleStoreTupleDest(tupleStore,
+															rowCountTupleDesc);
+	bool expectResults = true;
+
+	ExecuteTaskListIntoTupleDest(ROW_MODIFY_READONLY,
+								 ShardReadTaskList(shardIntervalList, queryStringList),
+								 tupleDest, expectResults);
+
+	double totalRowCount = 0.0;
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(rowCountTupleDesc,
+													&TTSOpsMinimalTuple);
+
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		bool isNull = false;
+		Datum rowCountDatum = slot_getattr(slot, 1, &isNull);
+
+		if (!isNull)
+		{
+			totalRowCount += DatumGetFloat8(rowCountDatum);
+		}
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	return totalRowCount;
+}
+
+
+/*
+ * SampleShardRows samples the given percentage of the rows of each shard and
+ * returns them as tuples of sampleTupleDesc, which has one attribute for each
+ * analyzed column. Since every shard is sampled with the same percentage, the
+ * combined sample is uniform over the distributed table.
+ */
+static HeapTuple *
+SampleShardRows(List *shardIntervalList, List *columnStatsList,
+				TupleDesc sampleTupleDesc, double samplePercentage,
+				int *sampleRowCount)
+{
+	StringInfo columnList = makeStringInfo();
+
+	VacAttrStats *columnStats = NULL;
+	foreach_ptr(columnStats, columnStatsList)
+	{
+		appendStringInfo(columnList, "%s%s", columnList->len > 0 ? ", " : "",
+						 quote_identifier(NameStr(columnStats->attr->attname)));
+	}
+
+	List *queryStringList = NIL;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		StringInfo sampleQuery = makeStringInfo();
+
+		appendStringInfo(sampleQuery, "SELECT %s FROM %s TABLESAMPLE BERNOULLI (%g)",
+						 columnList->data, QualifiedShardName(shardInterval),
+						 samplePercentage);
+
+		queryStringList = lappend(queryStringList, sampleQuery->data);
+	}
+
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+	TupleDestination *tupleDest = CreateTupleStoreTupleDest(tupleStore,
+															sampleTupleDesc);
+	bool expectResults = true;
+
+	ExecuteTaskListIntoTupleDest(ROW_MODIFY_READONLY,
+								 ShardReadTaskList(shardIntervalList, queryStringList),
+								 tupleDest, expectResults);
+
+	int64 tupleCount = tuplestore_tuple_count(tupleStore);
+	HeapTuple *sampleRows = palloc0(Max(tupleCount, 1) * sizeof(HeapTuple));
+	TupleTableSlot *slot = MakeSingleTupleTableSlot(sampleTupleDesc,
+													&TTSOpsMinimalTuple);
+	int rowIndex = 0;
+
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		sampleRows[rowIndex++] = ExecCopySlotHeapTuple(slot);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	*sampleRowCount = rowIndex;
+
+	return sampleRows;
+}
+
+
+/*
+ * SampleTupleDesc returns the tuple descriptor of the sampled rows, which has
+ * an attribute for each of the analyzed columns.
+ */
+static TupleDesc
+SampleTupleDesc(List *columnStatsList)
+{
+	TupleDesc sampleTupleDesc = CreateTemplateTupleDesc(list_length(columnStatsList));
+	AttrNumber attributeNumber = 1;
+
+	VacAttrStats *columnStats = NULL;
+	foreach_ptr(columnStats, columnStatsList)
+	{
+		TupleDescInitEntry(sampleTupleDesc, attributeNumber,
+						   NameStr(columnStats->attr->attname),
+						   columnStats->attrtypid, columnStats->attrtypmod, 0);
+		TupleDescInitEntryCollation(sampleTupleDesc, attributeNumber,
+									columnStats->attrcollid);
+
+		attributeNumber++;
+	}
+
+	return sampleTupleDesc;
+}
+
+
+/*
+ * ShardReadTaskList returns a read task for each of the given shards that runs
+ * the query at the same position in queryStringList on one of the active
+ * placements of the shard.
+ */
+static List *
+ShardReadTaskList(List *shardIntervalList, List *queryStringList)
+{
+	List *taskList = NIL;
+	uint32 taskId = 1;
+
+	ShardInterval *shardInterval = NULL;
+	char *queryString = NULL;
+	forboth_ptr(shardInterval, shardIntervalList, queryString, queryStringList)
+	{
+		uint64 shardId = shardInterval->shardId;
+
+		Task *task = CitusMakeNode(Task);
+		task->taskId = taskId++;
+		task->taskType = READ_TASK;
+		task->anchorShardId = shardId;
+		task->taskPlacementList = ActiveShardPlacementList(shardId);
+		SetTaskQueryString(task, queryString);
+
+		taskList = lappend(taskList, task);
+	}
+
+	return taskList;
+}
+
+
+/*
+ * QualifiedShardName returns the schema-qualified, quoted name of the shard.
+ */
+static char *
+QualifiedShardName(ShardInterval *shardInterval)
+{
+	Oid relationId = shardInterval->relationId;
+	char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+	char *shardName = get_rel_name(relationId);
+
+	AppendShardIdToName(&shardName, shardInterval->shardId);
+
+	return quote_qualified_identifier(schemaName, shardName);
+}
+
+
+/*
+ * SampleRowFetchFunc returns the value of the column in the given sampled row,
+ * like std_fetch_func in PostgreSQL's analyze.c.
+ */
+static Datum
+SampleRowFetchFunc(VacAttrStatsP stats, int rownum, bool *isNull)
+{
+	return heap_getattr(stats->rows[rownum], stats->tupattnum, stats->tupDesc,
+						isNull);
+}
+
+
+/*
+ * StoreColumnStatistics inserts or updates the pg_statistic rows of the
+ * relation with the computed column statistics. It follows update_attstats
+ * in PostgreSQL's analyze.c.
+ */
+static void
+StoreColumnStatistics(Oid relationId, bool inherited, List *columnStatsList)
+{
+	Relation statisticRelation = table_open(StatisticRelationId, RowExclusiveLock);
+
+	VacAttrStats *columnStats = NULL;
+	foreach_ptr(columnStats, columnStatsList)
+	{
+		Datum values[Natts_pg_statistic];
+		bool nulls[Natts_pg_statistic];
+		bool replaces[Natts_pg_statistic];
+
+		if (!columnStats->stats_valid)
+		{
+			continue;
+		}
+
+		memset(nulls, false, sizeof(nulls));
+		memset(replaces, true, sizeof(replaces));
+
+		values[Anum_pg_statistic_starelid - 1] = ObjectIdGetDatum(relationId);
+		values[Anum_pg_statistic_staattnum - 1] =
+			Int16GetDatum(columnStats->attr->attnum);
+		values[Anum_pg_statistic_stainherit - 1] = BoolGetDatum(inherited);
+		values[Anum_pg_statistic_stanullfrac - 1] =
+			Float4GetDatum(columnStats->stanullfrac);
+		values[Anum_pg_statistic_stawidth - 1] = Int32GetDatum(columnStats->stawidth);
+		values[Anum_pg_statistic_stadistinct - 1] =
+			Float4GetDatum(columnStats->stadistinct);
+
+		for (int slotIndex = 0; slotIndex < STATISTIC_NUM_SLOTS; slotIndex++)
+		{
+			values[Anum_pg_statistic_stakind1 - 1 + slotIndex] =
+				Int16GetDatum(columnStats->stakind[slotIndex]);
+			values[Anum_pg_statistic_staop1 - 1 + slotIndex] =
+				ObjectIdGetDatum(columnStats->staop[slotIndex]);
+			values[Anum_pg_statistic_stacoll1 - 1 + slotIndex] =
+				ObjectIdGetDatum(columnStats->stacoll[slotIndex]);
+
+			int numberIndex = Anum_pg_statistic_stanumbers1 - 1 + slotIndex;
+			int numberCount = columnStats->numnumbers[slotIndex];
+			if (numberCount > 0)
+			{
+				Datum *numberDatums = palloc(numberCount * sizeof(Datum));
+
+				for (int numberOffset = 0; numberOffset < numberCount; numberOffset++)
+				{
+					numberDatums[numberOffset] =
+						Float4GetDatum(columnStats->stanumbers[slotIndex][numberOffset]);
+				}
+
+				ArrayType *numberArray = construct_array(numberDatums, numberCount,
+														 FLOAT4OID, sizeof(float4),
+														 true, TYPALIGN_INT);
+				values[numberIndex] = PointerGetDatum(numberArray);
+			}
+			else
+			{
+				nulls[numberIndex] = true;
+				values[numberIndex] = (Datum) 0;
+			}
+
+			int valueIndex = Anum_pg_statistic_stavalues1 - 1 + slotIndex;
+			if (columnStats->numvalues[slotIndex] > 0)
+			{
+				ArrayType *valueArray =
+					construct_array(columnStats->stavalues[slotIndex],
+									columnStats->numvalues[slotIndex],
+									columnStats->statypid[slotIndex],
+									columnStats->statyplen[slotIndex],
+									columnStats->statypbyval[slotIndex],
+									columnStats->statypalign[slotIndex]);
+				values[valueIndex] = PointerGetDatum(valueArray);
+			}
+			else
+			{
+				nulls[valueIndex] = true;
+				values[valueIndex] = (Datum) 0;
+			}
+		}
+
+		HeapTuple statisticTuple = NULL;
+		HeapTuple oldStatisticTuple =
+			SearchSysCache3(STATRELATTINH, ObjectIdGetDatum(relationId),
+							Int16GetDatum(columnStats->attr->attnum),
+							BoolGetDatum(inherited));
+
+		if (HeapTupleIsValid(oldStatisticTuple))
+		{
+			statisticTuple = heap_modify_tuple(oldStatisticTuple,
+											   RelationGetDescr(statisticRelation),
+											   values, nulls, replaces);
+			ReleaseSysCache(oldStatisticTuple);
+			CatalogTupleUpdate(statisticRelation, &statisticTuple->t_self,
+							   statisticTuple);
+		}
+		else
+		{
+			statisticTuple = heap_form_tuple(RelationGetDescr(statisticRelation),
+											 values, nulls);
+			CatalogTupleInsert(statisticRelation, statisticTuple);
+		}
+
+		heap_freetuple(statisticTuple);
+	}
+
+	table_close(statisticRelation, RowExclusiveLock);
+
+	CommandCounterIncrement();
+}
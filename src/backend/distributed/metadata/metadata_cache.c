@@ -47,6 +47,7 @@
 #include "distributed/metadata_utility.h"
 #include "distributed/metadata/pg_dist_object.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/metadata_cache_warmup.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/pg_dist_local_group.h"
@@ -55,12 +56,15 @@
 #include "distributed/pg_dist_partition.h"
 #include "distributed/pg_dist_shard.h"
 #include "distributed/pg_dist_placement.h"
+#include "distributed/routing_table.h"
 #include "distributed/shared_library_init.h"
+#include "distributed/shared_metadata_cache.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/utils/array_type.h"
 #include "distributed/utils/function.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_manager.h"
+#include "distributed/worker_prepared_statements.h"
 #include "distributed/worker_protocol.h"
 #include "executor/executor.h"
 #include "nodes/makefuncs.h"
@@ -132,6 +136,39 @@ typedef struct ShardIdCacheEntry
 } ShardIdCacheEntry;
 
 
+/*
+ * ColocationShardLayout holds the hash ranges of the shards of a colocation
+ * group in shard index order. All hash distributed tables in a colocation
+ * group have the same ranges, such that the tables that share a layout only
+ * store the IDs of their shards and build their intervals on first use.
+ */
+typedef struct ColocationShardLayout
+{
+	uint32 colocationId;
+	int shardCount;
+	int32 *shardMinValues;
+	int32 *shardMaxValues;
+	bool hasUniformHashDistribution;
+
+	/* number of cache entries that use the layout */
+	int referenceCount;
+} ColocationShardLayout;
+
+
+/*
+ * ColocationShardLayoutCacheEntry is the entry type for
+ * ColocationShardLayoutHash, it points to the layout that new cache entries
+ * of the colocation group use.
+ */
+typedef struct ColocationShardLayoutCacheEntry
+{
+	/* hash key, needs to be first */
+	uint32 colocationId;
+
+	ColocationShardLayout *layout;
+} ColocationShardLayoutCacheEntry;
+
+
 /*
  * State which should be cleared upon DROP EXTENSION. When the configuration
  * changes, e.g. because extension is dropped, these summarily get set to 0.
@@ -192,6 +229,7 @@ typedef struct MetadataCacheData
 	Oid copyFormatTypeId;
 	Oid readIntermediateResultFuncId;
 	Oid readIntermediateResultArrayFuncId;
+	Oid readInlineIntermediateResultFuncId;
 	Oid extraDataContainerFuncId;
 	Oid workerHashFunctionId;
 	Oid anyValueFunctionId;
@@ -223,6 +261,18 @@ static MetadataCacheData MetadataCache;
 /* Citus extension version variables */
 bool EnableVersionChecks = true; /* version checks are enabled */
 
+/* GUC, whether uniformly hashed shards are cached without building intervals */
+bool EnableCompactShardIntervals = false;
+
+/* GUC, whether the placements of a shard are only read when first used */
+bool EnableLazyPlacementLoading = false;
+
+/* GUC, whether colocated tables share the hash ranges of their shards */
+bool EnableSharedShardLayouts = false;
+
+/* length of the placement array of a shard whose placements were not read yet */
+#define PLACEMENTS_NOT_LOADED -1
+
 static bool citusVersionKnownCompatible = false;
 
 /* Variable to determine if we are in the process of creating citus */
@@ -235,6 +285,9 @@ static List *DistTableCacheExpired = NIL;
 /* Hash table for informations about each shard */
 static HTAB *ShardIdCacheHash = NULL;
 
+/* Hash table for the shard layouts of colocation groups */
+static HTAB *ColocationShardLayoutHash = NULL;
+
 static MemoryContext MetadataCacheMemoryContext = NULL;
 
 /* Hash table for information about each object */
@@ -252,6 +305,13 @@ static int32 LocalGroupId = -1;
 /* default value is -1, increases with every node starting from 1 */
 static int32 LocalNodeId = -1;
 
+/*
+ * Incremented whenever the metadata of a Citus table, the worker nodes or
+ * the local group are invalidated, such that caches derived from them can
+ * tell that they are stale, see MetadataCacheGeneration().
+ */
+static uint64 MetadataGeneration = 1;
+
 /* built first time through in InitializeDistCache */
 static ScanKeyData DistPartitionScanKey[1];
 static ScanKeyData DistShardScanKey[1];
@@ -261,8 +321,35 @@ static ScanKeyData DistObjectScanKey[3];
 /* local function forward declarations */
 static HeapTuple PgDistPartitionTupleViaCatalog(Oid relationId);
 static ShardIdCacheEntry * LookupShardIdCacheEntry(int64 shardId, bool missingOk);
-static CitusTableCacheEntry * BuildCitusTableCacheEntry(Oid relationId);
+static CitusTableCacheEntry * BuildCitusTableCacheEntry(Oid relationId,
+														 CitusTableCacheEntry *
+														 previousEntry);
 static void BuildCachedShardList(CitusTableCacheEntry *cacheEntry);
+static bool HasCompactShardIntervals(List *shardMetadataList,
+									 TupleDesc distShardTupleDesc,
+									 uint64 *firstShardId);
+static ShardInterval * BuildCompactShardInterval(CitusTableCacheEntry *cacheEntry,
+												 int shardIndex);
+static bool CanShareColocationShardLayout(CitusTableCacheEntry *cacheEntry);
+static void ShareColocationShardLayout(CitusTableCacheEntry *cacheEntry);
+static bool ShardIntervalsMatchLayout(ColocationShardLayout *layout,
+									  ShardInterval **sortedShardIntervalArray,
+									  int shardCount);
+static ColocationShardLayout * CreateColocationShardLayout(
+	CitusTableCacheEntry *cacheEntry);
+static void ReleaseColocationShardLayout(ColocationShardLayout *layout);
+static ShardInterval * BuildSharedShardInterval(CitusTableCacheEntry *cacheEntry,
+												int shardIndex);
+static void SetCachedShardPlacements(CitusTableCacheEntry *cacheEntry, int shardIndex,
+									 List *placementList);
+static bool CanCopyCachedShardList(CitusTableCacheEntry *cacheEntry,
+								   CitusTableCacheEntry *previousEntry,
+								   List **changedShardIdList);
+static void CopyCachedShardList(CitusTableCacheEntry *cacheEntry,
+								CitusTableCacheEntry *previousEntry,
+								List *changedShardIdList);
+static void RegisterRelcacheInvalidation(Oid relationId);
+static List * LookupShardMetadataList(Oid relationId, bool *placementsLoaded);
 static void PrepareWorkerNodeCache(void);
 static bool CheckInstalledVersion(int elevel);
 static char * AvailableExtensionVersion(void);
@@ -281,6 +368,7 @@ static void ResetCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry);
 static void RemoveStaleShardIdCacheEntries(CitusTableCacheEntry *tableEntry);
 static void CreateDistTableCache(void);
 static void CreateShardIdCache(void);
+static void CreateColocationShardLayoutCache(void);
 static void CreateDistObjectCache(void);
 static void InvalidateForeignRelationGraphCacheCallback(Datum argument, Oid relationId);
 static void InvalidateDistRelationCacheCallback(Datum argument, Oid relationId);
@@ -819,8 +907,7 @@ LoadShardInterval(uint64 shardId)
 	/* the offset better be in a valid range */
 	Assert(shardIndex < tableEntry->shardIntervalArrayLength);
 
-	ShardInterval *sourceShardInterval =
-		tableEntry->sortedShardIntervalArray[shardIndex];
+	ShardInterval *sourceShardInterval = GetCachedShardInterval(tableEntry, shardIndex);
 
 	/* copy value to return */
 	ShardInterval *shardInterval = CopyShardInterval(sourceShardInterval);
@@ -911,10 +998,9 @@ LoadGroupShardPlacement(uint64 shardId, uint64 placementId)
 	/* the offset better be in a valid range */
 	Assert(shardIndex < tableEntry->shardIntervalArrayLength);
 
+	int numberOfPlacements = 0;
 	GroupShardPlacement *placementArray =
-		tableEntry->arrayOfPlacementArrays[shardIndex];
-	int numberOfPlacements =
-		tableEntry->arrayOfPlacementArrayLengths[shardIndex];
+		GetCachedShardPlacementArray(tableEntry, shardIndex, &numberOfPlacements);
 
 	for (int i = 0; i < numberOfPlacements; i++)
 	{
@@ -967,10 +1053,9 @@ ShardPlacementOnGroupIncludingOrphanedPlacements(int32 groupId, uint64 shardId)
 	ShardIdCacheEntry *shardIdEntry = LookupShardIdCacheEntry(shardId, missingOk);
 	CitusTableCacheEntry *tableEntry = shardIdEntry->tableEntry;
 	int shardIndex = shardIdEntry->shardIndex;
+	int numberOfPlacements = 0;
 	GroupShardPlacement *placementArray =
-		tableEntry->arrayOfPlacementArrays[shardIndex];
-	int numberOfPlacements =
-		tableEntry->arrayOfPlacementArrayLengths[shardIndex];
+		GetCachedShardPlacementArray(tableEntry, shardIndex, &numberOfPlacements);
 
 	for (int placementIndex = 0; placementIndex < numberOfPlacements; placementIndex++)
 	{
@@ -1018,7 +1103,7 @@ ResolveGroupShardPlacement(GroupShardPlacement *groupShardPlacement,
 						   CitusTableCacheEntry *tableEntry,
 						   int shardIndex)
 {
-	ShardInterval *shardInterval = tableEntry->sortedShardIntervalArray[shardIndex];
+	ShardInterval *shardInterval = GetCachedShardInterval(tableEntry, shardIndex);
 
 	ShardPlacement *shardPlacement = CitusMakeNode(ShardPlacement);
 	int32 groupId = groupShardPlacement->groupId;
@@ -1150,6 +1235,7 @@ LookupNodeForGroup(int32 groupId)
 	switch (ReadFromSecondaries)
 	{
 		case USE_SECONDARY_NODES_NEVER:
+		case USE_SECONDARY_NODES_CAUGHT_UP:
 		{
 			ereport(ERROR, (errmsg("node group %d does not have a primary node",
 								   groupId)));
@@ -1192,10 +1278,9 @@ ShardPlacementListIncludingOrphanedPlacements(uint64 shardId)
 	/* the offset better be in a valid range */
 	Assert(shardIndex < tableEntry->shardIntervalArrayLength);
 
+	int numberOfPlacements = 0;
 	GroupShardPlacement *placementArray =
-		tableEntry->arrayOfPlacementArrays[shardIndex];
-	int numberOfPlacements =
-		tableEntry->arrayOfPlacementArrayLengths[shardIndex];
+		GetCachedShardPlacementArray(tableEntry, shardIndex, &numberOfPlacements);
 
 	for (int i = 0; i < numberOfPlacements; i++)
 	{
@@ -1423,6 +1508,9 @@ LookupCitusTableCacheEntry(Oid relationId)
 	CitusTableCacheEntrySlot *cacheSlot =
 		hash_search(DistTableCacheHash, hashKey, HASH_ENTER, &foundInCache);
 
+	/* entry that was invalidated, of which parts may be reused */
+	CitusTableCacheEntry *previousEntry = NULL;
+
 	/* return valid matches */
 	if (foundInCache)
 	{
@@ -1450,6 +1538,8 @@ LookupCitusTableCacheEntry(Oid relationId)
 												cacheSlot->citusTableMetadata);
 
 				MemoryContextSwitchTo(oldContext);
+
+				previousEntry = cacheSlot->citusTableMetadata;
 			}
 		}
 	}
@@ -1466,7 +1556,8 @@ LookupCitusTableCacheEntry(Oid relationId)
 	 */
 	HOLD_INTERRUPTS();
 
-	cacheSlot->citusTableMetadata = BuildCitusTableCacheEntry(relationId);
+	cacheSlot->citusTableMetadata = BuildCitusTableCacheEntry(relationId,
+															  previousEntry);
 
 	/*
 	 * Mark it as valid only after building the full entry, such that any
@@ -1476,6 +1567,11 @@ LookupCitusTableCacheEntry(Oid relationId)
 
 	RESUME_INTERRUPTS();
 
+	if (cacheSlot->citusTableMetadata != NULL)
+	{
+		RecordCitusTableCacheBuild(relationId);
+	}
+
 	return cacheSlot->citusTableMetadata;
 }
 
@@ -1589,10 +1685,16 @@ LookupDistObjectCacheEntry(Oid classid, Oid objid, int32 objsubid)
  * BuildCitusTableCacheEntry is a helper routine for
  * LookupCitusTableCacheEntry() for building the cache contents.
  * This function returns NULL if the relation isn't a distributed table.
+ *
+ * If previousEntry is not NULL, it is the invalidated entry of the relation,
+ * whose shards are reused if only their placements changed in the meantime.
  */
 static CitusTableCacheEntry *
-BuildCitusTableCacheEntry(Oid relationId)
+BuildCitusTableCacheEntry(Oid relationId, CitusTableCacheEntry *previousEntry)
 {
+	/* remember which logged changes the catalogs we read below include */
+	uint64 shardInvalidationLogPosition = ShardInvalidationLogPosition();
+
 	Relation pgDistPartition = table_open(DistPartitionRelationId(), AccessShareLock);
 	HeapTuple distPartitionTuple =
 		LookupDistPartitionTuple(pgDistPartition, relationId);
@@ -1677,7 +1779,17 @@ BuildCitusTableCacheEntry(Oid relationId)
 
 	heap_freetuple(distPartitionTuple);
 
-	BuildCachedShardList(cacheEntry);
+	List *changedShardIdList = NIL;
+	if (CanCopyCachedShardList(cacheEntry, previousEntry, &changedShardIdList))
+	{
+		CopyCachedShardList(cacheEntry, previousEntry, changedShardIdList);
+	}
+	else
+	{
+		BuildCachedShardList(cacheEntry);
+	}
+
+	cacheEntry->shardInvalidationLogPosition = shardInvalidationLogPosition;
 
 	/* we only need hash functions for hash distributed tables */
 	if (cacheEntry->partitionMethod == DISTRIBUTE_BY_HASH)
@@ -1696,15 +1808,33 @@ BuildCitusTableCacheEntry(Oid relationId)
 		cacheEntry->hashFunction = hashFunction;
 
 		/* check the shard distribution for hash partitioned tables */
-		cacheEntry->hasUniformHashDistribution =
-			HasUniformHashDistribution(cacheEntry->sortedShardIntervalArray,
-									   cacheEntry->shardIntervalArrayLength);
+		if (cacheEntry->hasCompactShardIntervals)
+		{
+			cacheEntry->hasUniformHashDistribution = true;
+		}
+		else if (cacheEntry->sharedShardLayout != NULL)
+		{
+			cacheEntry->hasUniformHashDistribution =
+				cacheEntry->sharedShardLayout->hasUniformHashDistribution;
+		}
+		else
+		{
+			cacheEntry->hasUniformHashDistribution =
+				HasUniformHashDistribution(cacheEntry->sortedShardIntervalArray,
+										   cacheEntry->shardIntervalArrayLength);
+		}
 	}
 	else
 	{
 		cacheEntry->hashFunction = NULL;
 	}
 
+	if (EnableSharedShardLayouts && cacheEntry->sharedShardLayout == NULL &&
+		CanShareColocationShardLayout(cacheEntry))
+	{
+		ShareColocationShardLayout(cacheEntry);
+	}
+
 	oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
 
 	cacheEntry->referencedRelationsViaForeignKey = ReferencedRelationIdList(
@@ -1745,14 +1875,19 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 							  &intervalTypeId,
 							  &intervalTypeMod);
 
-	List *distShardTupleList = LookupDistShardTuples(cacheEntry->relationId);
-	int shardIntervalArrayLength = list_length(distShardTupleList);
+	bool placementsLoaded = false;
+	List *shardMetadataList = LookupShardMetadataList(cacheEntry->relationId,
+													  &placementsLoaded);
+	int shardIntervalArrayLength = list_length(shardMetadataList);
+	List **placementListArray = NULL;
 	if (shardIntervalArrayLength > 0)
 	{
 		Relation distShardRelation = table_open(DistShardRelationId(), AccessShareLock);
 		TupleDesc distShardTupleDesc = RelationGetDescr(distShardRelation);
 		int arrayIndex = 0;
 
+		placementListArray = palloc0(shardIntervalArrayLength * sizeof(List *));
+
 		shardIntervalArray = MemoryContextAllocZero(MetadataCacheMemoryContext,
 													shardIntervalArrayLength *
 													sizeof(ShardInterval *));
@@ -1766,9 +1901,33 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 								   shardIntervalArrayLength *
 								   sizeof(int));
 
-		HeapTuple shardTuple = NULL;
-		foreach_ptr(shardTuple, distShardTupleList)
+		if (EnableCompactShardIntervals &&
+			cacheEntry->partitionMethod == DISTRIBUTE_BY_HASH &&
+			intervalTypeId == INT4OID)
 		{
+			cacheEntry->hasCompactShardIntervals =
+				HasCompactShardIntervals(shardMetadataList, distShardTupleDesc,
+										 &cacheEntry->firstShardId);
+		}
+
+		DistShardMetadata *shardMetadata = NULL;
+		foreach_ptr(shardMetadata, shardMetadataList)
+		{
+			HeapTuple shardTuple = shardMetadata->shardTuple;
+
+			if (cacheEntry->hasCompactShardIntervals)
+			{
+				/* the intervals are built on first use, in shard ID order */
+				Form_pg_dist_shard shardForm = (Form_pg_dist_shard) GETSTRUCT(shardTuple);
+				int shardIndex = shardForm->shardid - cacheEntry->firstShardId;
+
+				placementListArray[shardIndex] = shardMetadata->placementList;
+
+				heap_freetuple(shardTuple);
+
+				continue;
+			}
+
 			ShardInterval *shardInterval = TupleToShardInterval(shardTuple,
 																distShardTupleDesc,
 																intervalTypeId,
@@ -1779,6 +1938,13 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 
 			MemoryContextSwitchTo(oldContext);
 
+			/*
+			 * Remember where the placements are until the intervals are sorted,
+			 * the shard index is set to its final value below.
+			 */
+			shardIntervalArray[arrayIndex]->shardIndex = arrayIndex;
+			placementListArray[arrayIndex] = shardMetadata->placementList;
+
 			heap_freetuple(shardTuple);
 
 			arrayIndex++;
@@ -1817,9 +1983,17 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 		shardIntervalCompareFunction = NULL;
 	}
 
-	/* reference tables has a single shard which is not initialized */
-	if (cacheEntry->partitionMethod == DISTRIBUTE_BY_NONE)
+	if (cacheEntry->hasCompactShardIntervals)
+	{
+		/* uniformly distributed hash ranges neither overlap nor have gaps */
+		cacheEntry->hasUninitializedShardInterval = false;
+		cacheEntry->hasOverlappingShardInterval = false;
+
+		sortedShardIntervalArray = shardIntervalArray;
+	}
+	else if (cacheEntry->partitionMethod == DISTRIBUTE_BY_NONE)
 	{
+		/* reference tables has a single shard which is not initialized */
 		cacheEntry->hasUninitializedShardInterval = true;
 		cacheEntry->hasOverlappingShardInterval = true;
 
@@ -1876,8 +2050,7 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 	for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
 	{
 		ShardInterval *shardInterval = sortedShardIntervalArray[shardIndex];
-		int64 shardId = shardInterval->shardId;
-		int placementOffset = 0;
+		int64 shardId = GetCachedShardId(cacheEntry, shardIndex);
 
 		/*
 		 * Enable quick lookups of this shard ID by adding it to ShardIdCacheHash
@@ -1896,27 +2069,27 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 		 */
 		cacheEntry->shardIntervalArrayLength++;
 
-		/* build list of shard placements */
-		List *placementList = BuildShardPlacementList(shardId);
-		int numberOfPlacements = list_length(placementList);
-
-		/* and copy that list into the cache entry */
-		MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
-		GroupShardPlacement *placementArray = palloc0(numberOfPlacements *
-													  sizeof(GroupShardPlacement));
-		GroupShardPlacement *srcPlacement = NULL;
-		foreach_ptr(srcPlacement, placementList)
+		if (placementsLoaded)
 		{
-			placementArray[placementOffset] = *srcPlacement;
-			placementOffset++;
+			/* list of shard placements, in the order of the unsorted intervals */
+			List *placementList =
+				cacheEntry->hasCompactShardIntervals ?
+				placementListArray[shardIndex] :
+				placementListArray[shardInterval->shardIndex];
+
+			/* and copy that list into the cache entry */
+			SetCachedShardPlacements(cacheEntry, shardIndex, placementList);
+		}
+		else
+		{
+			cacheEntry->arrayOfPlacementArrayLengths[shardIndex] = PLACEMENTS_NOT_LOADED;
 		}
-		MemoryContextSwitchTo(oldContext);
-
-		cacheEntry->arrayOfPlacementArrays[shardIndex] = placementArray;
-		cacheEntry->arrayOfPlacementArrayLengths[shardIndex] = numberOfPlacements;
 
 		/* store the shard index in the ShardInterval */
-		shardInterval->shardIndex = shardIndex;
+		if (shardInterval != NULL)
+		{
+			shardInterval->shardIndex = shardIndex;
+		}
 	}
 
 	cacheEntry->shardColumnCompareFunction = shardColumnCompareFunction;
@@ -1924,6 +2097,732 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 }
 
 
+/*
+ * HasCompactShardIntervals returns whether the given pg_dist_shard tuples of a
+ * hash distributed table have a uniform hash distribution and consecutive
+ * shard IDs, such that the shard intervals follow from the shard count. If so,
+ * firstShardId is set to the ID of the shard that covers the lowest hash
+ * values.
+ */
+static bool
+HasCompactShardIntervals(List *shardMetadataList, TupleDesc distShardTupleDesc,
+						 uint64 *firstShardId)
+{
+	int shardCount = list_length(shardMetadataList);
+	uint64 hashTokenIncrement = HASH_TOKEN_COUNT / shardCount;
+	bool hasCompactShardIntervals = true;
+
+	int64 *shardIdArray = palloc0(shardCount * sizeof(int64));
+	bool *shardIndexSeen = palloc0(shardCount * sizeof(bool));
+
+	DistShardMetadata *shardMetadata = NULL;
+	foreach_ptr(shardMetadata, shardMetadataList)
+	{
+		Datum datumArray[Natts_pg_dist_shard];
+		bool isNullArray[Natts_pg_dist_shard];
+
+		heap_deform_tuple(shardMetadata->shardTuple, distShardTupleDesc,
+						  datumArray, isNullArray);
+
+		char storageType =
+			DatumGetChar(datumArray[Anum_pg_dist_shard_shardstorage - 1]);
+
+		if (storageType != SHARD_STORAGE_TABLE ||
+			isNullArray[Anum_pg_dist_shard_shardminvalue - 1] ||
+			isNullArray[Anum_pg_dist_shard_shardmaxvalue - 1])
+		{
+			hasCompactShardIntervals = false;
+			break;
+		}
+
+		char *minValueString =
+			TextDatumGetCString(datumArray[Anum_pg_dist_shard_shardminvalue - 1]);
+		char *maxValueString =
+			TextDatumGetCString(datumArray[Anum_pg_dist_shard_shardmaxvalue - 1]);
+		int32 minValue = pg_strtoint32(minValueString);
+		int32 maxValue = pg_strtoint32(maxValueString);
+
+		/* in a uniform distribution, the minimum value determines the index */
+		uint64 shardIndex = ((int64) minValue - PG_INT32_MIN) / hashTokenIncrement;
+		if (shardIndex >= (uint64) shardCount || shardIndexSeen[shardIndex])
+		{
+			hasCompactShardIntervals = false;
+			break;
+		}
+
+		int32 shardMinHashToken = PG_INT32_MIN + (shardIndex * hashTokenIncrement);
+		int32 shardMaxHashToken = shardMinHashToken + (hashTokenIncrement - 1);
+
+		if (shardIndex == (uint64) (shardCount - 1))
+		{
+			shardMaxHashToken = PG_INT32_MAX;
+		}
+
+		if (minValue != shardMinHashToken || maxValue != shardMaxHashToken)
+		{
+			hasCompactShardIntervals = false;
+			break;
+		}
+
+		shardIndexSeen[shardIndex] = true;
+		shardIdArray[shardIndex] =
+			DatumGetInt64(datumArray[Anum_pg_dist_shard_shardid - 1]);
+	}
+
+	/* all indexes were seen once, so the shard IDs only need to be consecutive */
+	for (int shardIndex = 1; hasCompactShardIntervals && shardIndex < shardCount;
+		 shardIndex++)
+	{
+		if (shardIdArray[shardIndex] != shardIdArray[0] + shardIndex)
+		{
+			hasCompactShardIntervals = false;
+		}
+	}
+
+	if (hasCompactShardIntervals)
+	{
+		*firstShardId = shardIdArray[0];
+	}
+
+	pfree(shardIdArray);
+	pfree(shardIndexSeen);
+
+	return hasCompactShardIntervals;
+}
+
+
+/*
+ * GetCachedShardInterval returns the shard interval at the given index in the
+ * sorted shard intervals of the cache entry, building it first if the entry
+ * has compact shard intervals.
+ *
+ * The return value points into the cache and must not be modified.
+ */
+ShardInterval *
+GetCachedShardInterval(CitusTableCacheEntry *cacheEntry, int shardIndex)
+{
+	Assert(shardIndex >= 0 && shardIndex < cacheEntry->shardIntervalArrayLength);
+
+	ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+	if (shardInterval == NULL && cacheEntry->sharedShardLayout != NULL)
+	{
+		shardInterval = BuildSharedShardInterval(cacheEntry, shardIndex);
+		cacheEntry->sortedShardIntervalArray[shardIndex] = shardInterval;
+	}
+	else if (shardInterval == NULL)
+	{
+		Assert(cacheEntry->hasCompactShardIntervals);
+
+		shardInterval = BuildCompactShardInterval(cacheEntry, shardIndex);
+		cacheEntry->sortedShardIntervalArray[shardIndex] = shardInterval;
+	}
+
+	return shardInterval;
+}
+
+
+/*
+ * GetSortedShardIntervalArray returns the sorted shard intervals of the cache
+ * entry, building the ones that are not built yet if the entry has compact
+ * or shared shard intervals.
+ *
+ * The return value points into the cache and must not be modified.
+ */
+ShardInterval **
+GetSortedShardIntervalArray(CitusTableCacheEntry *cacheEntry)
+{
+	if (cacheEntry->hasCompactShardIntervals || cacheEntry->sharedShardLayout != NULL)
+	{
+		for (int shardIndex = 0; shardIndex < cacheEntry->shardIntervalArrayLength;
+			 shardIndex++)
+		{
+			GetCachedShardInterval(cacheEntry, shardIndex);
+		}
+	}
+
+	return cacheEntry->sortedShardIntervalArray;
+}
+
+
+/*
+ * GetCachedShardId returns the ID of the shard at the given index in the sorted
+ * shard intervals of the cache entry, without building its shard interval.
+ */
+uint64
+GetCachedShardId(CitusTableCacheEntry *cacheEntry, int shardIndex)
+{
+	if (cacheEntry->hasCompactShardIntervals)
+	{
+		return cacheEntry->firstShardId + shardIndex;
+	}
+	else if (cacheEntry->sharedShardLayout != NULL)
+	{
+		return cacheEntry->sortedShardIdArray[shardIndex];
+	}
+
+	return cacheEntry->sortedShardIntervalArray[shardIndex]->shardId;
+}
+
+
+/*
+ * BuildCompactShardInterval builds the shard interval at the given index of a
+ * cache entry with compact shard intervals, which is the shardIndex-th range
+ * of a uniform hash distribution. The result is allocated in the cache.
+ */
+static ShardInterval *
+BuildCompactShardInterval(CitusTableCacheEntry *cacheEntry, int shardIndex)
+{
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	uint64 hashTokenIncrement = HASH_TOKEN_COUNT / shardCount;
+	int32 shardMinHashToken = PG_INT32_MIN + (shardIndex * hashTokenIncrement);
+	int32 shardMaxHashToken = shardMinHashToken + (hashTokenIncrement - 1);
+
+	if (shardIndex == (shardCount - 1))
+	{
+		shardMaxHashToken = PG_INT32_MAX;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+
+	ShardInterval *shardInterval = CitusMakeNode(ShardInterval);
+
+	MemoryContextSwitchTo(oldContext);
+
+	shardInterval->relationId = cacheEntry->relationId;
+	shardInterval->storageType = SHARD_STORAGE_TABLE;
+	shardInterval->valueTypeId = INT4OID;
+	shardInterval->valueTypeLen = sizeof(int32);
+	shardInterval->valueByVal = true;
+	shardInterval->minValueExists = true;
+	shardInterval->maxValueExists = true;
+	shardInterval->minValue = Int32GetDatum(shardMinHashToken);
+	shardInterval->maxValue = Int32GetDatum(shardMaxHashToken);
+	shardInterval->shardId = cacheEntry->firstShardId + shardIndex;
+	shardInterval->shardIndex = shardIndex;
+
+	return shardInterval;
+}
+
+
+/*
+ * CanShareColocationShardLayout returns whether the shard intervals of the
+ * given cache entry are hash ranges that could be shared with the other
+ * tables in its colocation group.
+ */
+static bool
+CanShareColocationShardLayout(CitusTableCacheEntry *cacheEntry)
+{
+	if (cacheEntry->partitionMethod != DISTRIBUTE_BY_HASH ||
+		cacheEntry->colocationId == INVALID_COLOCATION_ID ||
+		cacheEntry->hasCompactShardIntervals ||
+		cacheEntry->shardIntervalArrayLength == 0 ||
+		cacheEntry->hasUninitializedShardInterval ||
+		cacheEntry->hasOverlappingShardInterval)
+	{
+		return false;
+	}
+
+	for (int shardIndex = 0; shardIndex < cacheEntry->shardIntervalArrayLength;
+		 shardIndex++)
+	{
+		ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+
+		if (shardInterval == NULL || shardInterval->valueTypeId != INT4OID ||
+			shardInterval->storageType != SHARD_STORAGE_TABLE)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ShareColocationShardLayout makes the given cache entry use the shard layout
+ * of its colocation group, creating the layout if there is none yet or if the
+ * ranges of the group changed since it was created. The shard intervals of
+ * the entry are then replaced by the IDs of its shards.
+ */
+static void
+ShareColocationShardLayout(CitusTableCacheEntry *cacheEntry)
+{
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	bool foundInCache = false;
+
+	ColocationShardLayoutCacheEntry *layoutEntry =
+		hash_search(ColocationShardLayoutHash, &cacheEntry->colocationId,
+					HASH_ENTER, &foundInCache);
+
+	if (!foundInCache)
+	{
+		layoutEntry->layout = NULL;
+	}
+
+	if (layoutEntry->layout == NULL ||
+		!ShardIntervalsMatchLayout(layoutEntry->layout, sortedShardIntervalArray,
+								   shardCount))
+	{
+		/* entries that use the previous layout keep it until they are reset */
+		layoutEntry->layout = CreateColocationShardLayout(cacheEntry);
+	}
+
+	ColocationShardLayout *layout = layoutEntry->layout;
+	layout->referenceCount++;
+
+	uint64 *sortedShardIdArray = MemoryContextAlloc(MetadataCacheMemoryContext,
+													shardCount * sizeof(uint64));
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		sortedShardIdArray[shardIndex] = sortedShardIntervalArray[shardIndex]->shardId;
+
+		/* hash range values are passed by value */
+		pfree(sortedShardIntervalArray[shardIndex]);
+		sortedShardIntervalArray[shardIndex] = NULL;
+	}
+
+	cacheEntry->sharedShardLayout = layout;
+	cacheEntry->sortedShardIdArray = sortedShardIdArray;
+}
+
+
+/*
+ * ShardIntervalsMatchLayout returns whether the given sorted shard intervals
+ * have the hash ranges of the given layout.
+ */
+static bool
+ShardIntervalsMatchLayout(ColocationShardLayout *layout,
+						  ShardInterval **sortedShardIntervalArray, int shardCount)
+{
+	if (layout->shardCount != shardCount)
+	{
+		return false;
+	}
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		ShardInterval *shardInterval = sortedShardIntervalArray[shardIndex];
+
+		if (DatumGetInt32(shardInterval->minValue) !=
+			layout->shardMinValues[shardIndex] ||
+			DatumGetInt32(shardInterval->maxValue) !=
+			layout->shardMaxValues[shardIndex])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CreateColocationShardLayout creates a shard layout from the hash ranges of
+ * the shards of the given cache entry. The layout is allocated in the cache
+ * and freed once no cache entry uses it anymore.
+ */
+static ColocationShardLayout *
+CreateColocationShardLayout(CitusTableCacheEntry *cacheEntry)
+{
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+
+	ColocationShardLayout *layout = palloc0(sizeof(ColocationShardLayout));
+	layout->colocationId = cacheEntry->colocationId;
+	layout->shardCount = shardCount;
+	layout->shardMinValues = palloc0(shardCount * sizeof(int32));
+	layout->shardMaxValues = palloc0(shardCount * sizeof(int32));
+	layout->hasUniformHashDistribution = cacheEntry->hasUniformHashDistribution;
+
+	MemoryContextSwitchTo(oldContext);
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+
+		layout->shardMinValues[shardIndex] = DatumGetInt32(shardInterval->minValue);
+		layout->shardMaxValues[shardIndex] = DatumGetInt32(shardInterval->maxValue);
+	}
+
+	return layout;
+}
+
+
+/*
+ * ReleaseColocationShardLayout is called when a cache entry that uses the
+ * given layout is reset, and frees the layout when it was the last one.
+ */
+static void
+ReleaseColocationShardLayout(ColocationShardLayout *layout)
+{
+	layout->referenceCount--;
+
+	if (layout->referenceCount > 0)
+	{
+		return;
+	}
+
+	bool foundInCache = false;
+	ColocationShardLayoutCacheEntry *layoutEntry =
+		hash_search(ColocationShardLayoutHash, &layout->colocationId, HASH_FIND,
+					&foundInCache);
+
+	if (foundInCache && layoutEntry->layout == layout)
+	{
+		hash_search(ColocationShardLayoutHash, &layout->colocationId, HASH_REMOVE,
+					&foundInCache);
+	}
+
+	pfree(layout->shardMinValues);
+	pfree(layout->shardMaxValues);
+	pfree(layout);
+}
+
+
+/*
+ * BuildSharedShardInterval builds the shard interval at the given index of a
+ * cache entry that uses the shard layout of its colocation group. The result
+ * is allocated in the cache.
+ */
+static ShardInterval *
+BuildSharedShardInterval(CitusTableCacheEntry *cacheEntry, int shardIndex)
+{
+	ColocationShardLayout *layout = cacheEntry->sharedShardLayout;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+
+	ShardInterval *shardInterval = CitusMakeNode(ShardInterval);
+
+	MemoryContextSwitchTo(oldContext);
+
+	shardInterval->relationId = cacheEntry->relationId;
+	shardInterval->storageType = SHARD_STORAGE_TABLE;
+	shardInterval->valueTypeId = INT4OID;
+	shardInterval->valueTypeLen = sizeof(int32);
+	shardInterval->valueByVal = true;
+	shardInterval->minValueExists = true;
+	shardInterval->maxValueExists = true;
+	shardInterval->minValue = Int32GetDatum(layout->shardMinValues[shardIndex]);
+	shardInterval->maxValue = Int32GetDatum(layout->shardMaxValues[shardIndex]);
+	shardInterval->shardId = cacheEntry->sortedShardIdArray[shardIndex];
+	shardInterval->shardIndex = shardIndex;
+
+	return shardInterval;
+}
+
+
+/*
+ * CanCopyCachedShardList returns whether the shards of previousEntry, the
+ * invalidated entry of the same relation, can be copied into cacheEntry. That
+ * is the case if the log of metadata changes shows that only the placements
+ * of some shards changed since previousEntry was built, in which case
+ * changedShardIdList is set to the IDs of those shards.
+ */
+static bool
+CanCopyCachedShardList(CitusTableCacheEntry *cacheEntry,
+					   CitusTableCacheEntry *previousEntry,
+					   List **changedShardIdList)
+{
+	if (previousEntry == NULL)
+	{
+		return false;
+	}
+
+	/* the shard intervals depend on the distribution column */
+	if (cacheEntry->partitionMethod != previousEntry->partitionMethod)
+	{
+		return false;
+	}
+
+	if (cacheEntry->partitionKeyString == NULL ||
+		previousEntry->partitionKeyString == NULL)
+	{
+		if (cacheEntry->partitionKeyString != previousEntry->partitionKeyString)
+		{
+			return false;
+		}
+	}
+	else if (strcmp(cacheEntry->partitionKeyString,
+					previousEntry->partitionKeyString) != 0)
+	{
+		return false;
+	}
+
+	if (!ShardsChangedSinceLogPosition(cacheEntry->relationId,
+									   previousEntry->shardInvalidationLogPosition,
+									   changedShardIdList))
+	{
+		return false;
+	}
+
+	/* when most placements changed, copying the rest is not worth it */
+	return list_length(*changedShardIdList) * 4 <=
+		   previousEntry->shardIntervalArrayLength;
+}
+
+
+/*
+ * CopyCachedShardList is an alternative to BuildCachedShardList() for when
+ * only the placements of the shards in changedShardIdList changed since
+ * previousEntry was built. It copies the shard intervals, and the placements
+ * of the other shards, from previousEntry and only reads the placements of
+ * the changed shards from the catalogs. previousEntry itself is left intact,
+ * since it might still be in use.
+ */
+static void
+CopyCachedShardList(CitusTableCacheEntry *cacheEntry,
+					CitusTableCacheEntry *previousEntry, List *changedShardIdList)
+{
+	int shardCount = previousEntry->shardIntervalArrayLength;
+
+	cacheEntry->hasUninitializedShardInterval =
+		previousEntry->hasUninitializedShardInterval;
+	cacheEntry->hasOverlappingShardInterval =
+		previousEntry->hasOverlappingShardInterval;
+	cacheEntry->hasCompactShardIntervals = previousEntry->hasCompactShardIntervals;
+	cacheEntry->firstShardId = previousEntry->firstShardId;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+
+	if (previousEntry->sharedShardLayout != NULL)
+	{
+		cacheEntry->sharedShardLayout = previousEntry->sharedShardLayout;
+		cacheEntry->sharedShardLayout->referenceCount++;
+
+		cacheEntry->sortedShardIdArray = palloc0(shardCount * sizeof(uint64));
+		memcpy_s(cacheEntry->sortedShardIdArray, shardCount * sizeof(uint64),
+				 previousEntry->sortedShardIdArray, shardCount * sizeof(uint64));
+	}
+
+	if (previousEntry->shardColumnCompareFunction != NULL)
+	{
+		cacheEntry->shardColumnCompareFunction = palloc0(sizeof(FmgrInfo));
+		fmgr_info_copy(cacheEntry->shardColumnCompareFunction,
+					   previousEntry->shardColumnCompareFunction,
+					   MetadataCacheMemoryContext);
+	}
+
+	if (previousEntry->shardIntervalCompareFunction != NULL)
+	{
+		cacheEntry->shardIntervalCompareFunction = palloc0(sizeof(FmgrInfo));
+		fmgr_info_copy(cacheEntry->shardIntervalCompareFunction,
+					   previousEntry->shardIntervalCompareFunction,
+					   MetadataCacheMemoryContext);
+	}
+
+	if (shardCount > 0)
+	{
+		cacheEntry->sortedShardIntervalArray =
+			palloc0(shardCount * sizeof(ShardInterval *));
+		cacheEntry->arrayOfPlacementArrays =
+			palloc0(shardCount * sizeof(GroupShardPlacement *));
+		cacheEntry->arrayOfPlacementArrayLengths = palloc0(shardCount * sizeof(int));
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	cacheEntry->shardIntervalArrayLength = 0;
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		ShardInterval *previousShardInterval =
+			previousEntry->sortedShardIntervalArray[shardIndex];
+		int64 shardId = GetCachedShardId(previousEntry, shardIndex);
+		bool placementsChanged = false;
+
+		uint64 *changedShardIdPointer = NULL;
+		foreach_ptr(changedShardIdPointer, changedShardIdList)
+		{
+			if (*changedShardIdPointer == shardId)
+			{
+				placementsChanged = true;
+				break;
+			}
+		}
+
+		/* compact or shared shard intervals that were not built yet are left for later */
+		if (previousShardInterval != NULL)
+		{
+			oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+
+			cacheEntry->sortedShardIntervalArray[shardIndex] =
+				CopyShardInterval(previousShardInterval);
+
+			MemoryContextSwitchTo(oldContext);
+		}
+
+		/* the previous entry was already removed from ShardIdCacheHash */
+		ShardIdCacheEntry *shardIdCacheEntry =
+			hash_search(ShardIdCacheHash, &shardId, HASH_ENTER, NULL);
+
+		shardIdCacheEntry->tableEntry = cacheEntry;
+		shardIdCacheEntry->shardIndex = shardIndex;
+
+		cacheEntry->shardIntervalArrayLength++;
+
+		int numberOfPlacements = previousEntry->arrayOfPlacementArrayLengths[shardIndex];
+
+		if (placementsChanged && EnableLazyPlacementLoading)
+		{
+			cacheEntry->arrayOfPlacementArrayLengths[shardIndex] = PLACEMENTS_NOT_LOADED;
+		}
+		else if (placementsChanged)
+		{
+			List *placementList = BuildShardPlacementList(shardId);
+
+			SetCachedShardPlacements(cacheEntry, shardIndex, placementList);
+		}
+		else if (numberOfPlacements == PLACEMENTS_NOT_LOADED)
+		{
+			cacheEntry->arrayOfPlacementArrayLengths[shardIndex] = PLACEMENTS_NOT_LOADED;
+		}
+		else
+		{
+			oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+
+			GroupShardPlacement *placementArray =
+				palloc0(numberOfPlacements * sizeof(GroupShardPlacement));
+
+			for (int placementIndex = 0; placementIndex < numberOfPlacements;
+				 placementIndex++)
+			{
+				placementArray[placementIndex] =
+					previousEntry->arrayOfPlacementArrays[shardIndex][placementIndex];
+			}
+
+			MemoryContextSwitchTo(oldContext);
+
+			cacheEntry->arrayOfPlacementArrays[shardIndex] = placementArray;
+			cacheEntry->arrayOfPlacementArrayLengths[shardIndex] = numberOfPlacements;
+		}
+	}
+}
+
+
+/*
+ * GetCachedShardPlacementArray returns the placements of the shard at the given
+ * index in the sorted shard intervals of the cache entry, and sets
+ * numberOfPlacements to their count. If the placements were not read yet, they
+ * are read from pg_dist_placement first. A shard without placements is read
+ * only once as well, since that is remembered as an empty array.
+ *
+ * The return value points into the cache and must not be modified.
+ */
+GroupShardPlacement *
+GetCachedShardPlacementArray(CitusTableCacheEntry *cacheEntry, int shardIndex,
+							 int *numberOfPlacements)
+{
+	Assert(shardIndex >= 0 && shardIndex < cacheEntry->shardIntervalArrayLength);
+
+	if (cacheEntry->arrayOfPlacementArrayLengths[shardIndex] == PLACEMENTS_NOT_LOADED)
+	{
+		uint64 shardId = GetCachedShardId(cacheEntry, shardIndex);
+		List *placementList = BuildShardPlacementList(shardId);
+
+		SetCachedShardPlacements(cacheEntry, shardIndex, placementList);
+	}
+
+	*numberOfPlacements = cacheEntry->arrayOfPlacementArrayLengths[shardIndex];
+
+	return cacheEntry->arrayOfPlacementArrays[shardIndex];
+}
+
+
+/*
+ * SetCachedShardPlacements copies the given list of GroupShardPlacements into
+ * the placement array of the shard at the given index of the cache entry.
+ */
+static void
+SetCachedShardPlacements(CitusTableCacheEntry *cacheEntry, int shardIndex,
+						 List *placementList)
+{
+	int numberOfPlacements = list_length(placementList);
+	int placementOffset = 0;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+	GroupShardPlacement *placementArray = palloc0(numberOfPlacements *
+												  sizeof(GroupShardPlacement));
+	GroupShardPlacement *srcPlacement = NULL;
+	foreach_ptr(srcPlacement, placementList)
+	{
+		placementArray[placementOffset] = *srcPlacement;
+		placementOffset++;
+	}
+	MemoryContextSwitchTo(oldContext);
+
+	cacheEntry->arrayOfPlacementArrays[shardIndex] = placementArray;
+	cacheEntry->arrayOfPlacementArrayLengths[shardIndex] = numberOfPlacements;
+}
+
+
+/*
+ * LookupShardMetadataList returns the pg_dist_shard tuples and the placements
+ * of all shards of the given relation. They are taken from the shared
+ * metadata cache if another backend already read them from the catalogs since
+ * they last changed, and otherwise read from the catalogs and stored there.
+ *
+ * If placements are loaded lazily and the shared metadata cache has no entry,
+ * only the pg_dist_shard tuples are read and placementsLoaded is set to false.
+ */
+static List *
+LookupShardMetadataList(Oid relationId, bool *placementsLoaded)
+{
+	List *shardMetadataList = NIL;
+	uint64 sharedCacheVersion = 0;
+
+	*placementsLoaded = true;
+
+	bool useSharedCache = SharedMetadataCacheBeginRead(&sharedCacheVersion);
+	if (useSharedCache &&
+		SharedMetadataCacheLookup(relationId, sharedCacheVersion, &shardMetadataList))
+	{
+		return shardMetadataList;
+	}
+
+	List *distShardTupleList = LookupDistShardTuples(relationId);
+
+	/* placements are read when first used, the shared cache needs them all */
+	if (EnableLazyPlacementLoading)
+	{
+		HeapTuple shardTuple = NULL;
+		foreach_ptr(shardTuple, distShardTupleList)
+		{
+			DistShardMetadata *shardMetadata = palloc0(sizeof(DistShardMetadata));
+
+			shardMetadata->shardTuple = shardTuple;
+
+			shardMetadataList = lappend(shardMetadataList, shardMetadata);
+		}
+
+		*placementsLoaded = false;
+
+		return shardMetadataList;
+	}
+
+	HeapTuple shardTuple = NULL;
+	foreach_ptr(shardTuple, distShardTupleList)
+	{
+		Form_pg_dist_shard shardForm = (Form_pg_dist_shard) GETSTRUCT(shardTuple);
+		DistShardMetadata *shardMetadata = palloc0(sizeof(DistShardMetadata));
+
+		shardMetadata->shardTuple = shardTuple;
+		shardMetadata->placementList = BuildShardPlacementList(shardForm->shardid);
+
+		shardMetadataList = lappend(shardMetadataList, shardMetadata);
+	}
+
+	if (useSharedCache)
+	{
+		SharedMetadataCacheStore(relationId, sharedCacheVersion, shardMetadataList);
+	}
+
+	return shardMetadataList;
+}
+
+
 /*
  * ErrorIfInconsistentShardIntervals checks if shard intervals are consistent with
  * our expectations.
@@ -2989,6 +3888,26 @@ CitusReadIntermediateResultArrayFuncId(void)
 }
 
 
+/* return oid of the read_inline_intermediate_result(text) function */
+Oid
+CitusReadInlineIntermediateResultFuncId(void)
+{
+	if (MetadataCache.readInlineIntermediateResultFuncId == InvalidOid)
+	{
+		List *functionNameList =
+			list_make2(makeString("pg_catalog"),
+					   makeString("read_inline_intermediate_result"));
+		Oid paramOids[1] = { TEXTOID };
+		bool missingOK = false;
+
+		MetadataCache.readInlineIntermediateResultFuncId =
+			LookupFuncName(functionNameList, 1, paramOids, missingOK);
+	}
+
+	return MetadataCache.readInlineIntermediateResultFuncId;
+}
+
+
 /* return oid of the citus.copy_format enum type */
 Oid
 CitusCopyFormatTypeId(void)
@@ -4019,6 +4938,7 @@ InitializeCaches(void)
 			DistTableCacheHash = NULL;
 			DistTableCacheExpired = NIL;
 			ShardIdCacheHash = NULL;
+			ColocationShardLayoutHash = NULL;
 
 			PG_RE_THROW();
 		}
@@ -4054,6 +4974,7 @@ InitializeDistCache(void)
 
 	CreateDistTableCache();
 	CreateShardIdCache();
+	CreateColocationShardLayoutCache();
 
 	InitializeDistObjectCache();
 
@@ -4466,7 +5387,6 @@ ResetCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry)
 		ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
 		GroupShardPlacement *placementArray =
 			cacheEntry->arrayOfPlacementArrays[shardIndex];
-		bool valueByVal = shardInterval->valueByVal;
 
 		/* delete the shard's placements */
 		if (placementArray != NULL)
@@ -4474,6 +5394,14 @@ ResetCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry)
 			pfree(placementArray);
 		}
 
+		/* compact or shared shard intervals might not have been built */
+		if (shardInterval == NULL)
+		{
+			continue;
+		}
+
+		bool valueByVal = shardInterval->valueByVal;
+
 		/* delete data pointed to by ShardInterval */
 		if (!valueByVal)
 		{
@@ -4497,6 +5425,16 @@ ResetCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry)
 		pfree(cacheEntry->sortedShardIntervalArray);
 		cacheEntry->sortedShardIntervalArray = NULL;
 	}
+	if (cacheEntry->sortedShardIdArray)
+	{
+		pfree(cacheEntry->sortedShardIdArray);
+		cacheEntry->sortedShardIdArray = NULL;
+	}
+	if (cacheEntry->sharedShardLayout)
+	{
+		ReleaseColocationShardLayout(cacheEntry->sharedShardLayout);
+		cacheEntry->sharedShardLayout = NULL;
+	}
 	if (cacheEntry->arrayOfPlacementArrayLengths)
 	{
 		pfree(cacheEntry->arrayOfPlacementArrayLengths);
@@ -4541,9 +5479,7 @@ RemoveStaleShardIdCacheEntries(CitusTableCacheEntry *invalidatedTableEntry)
 
 	for (shardIndex = 0; shardIndex < shardCount; shardIndex++)
 	{
-		ShardInterval *shardInterval =
-			invalidatedTableEntry->sortedShardIntervalArray[shardIndex];
-		int64 shardId = shardInterval->shardId;
+		int64 shardId = GetCachedShardId(invalidatedTableEntry, shardIndex);
 		bool foundInCache = false;
 
 		ShardIdCacheEntry *shardIdCacheEntry =
@@ -4615,8 +5551,11 @@ InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 	/* invalidate either entire cache or a specific entry */
 	if (relationId == InvalidOid)
 	{
+		MetadataGeneration++;
+
 		InvalidateDistTableCache();
 		InvalidateDistObjectCache();
+		InvalidateWorkerPreparedStatements();
 	}
 	else
 	{
@@ -4627,7 +5566,12 @@ InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 			hash_search(DistTableCacheHash, hashKey, HASH_FIND, &foundInCache);
 		if (foundInCache)
 		{
+			MetadataGeneration++;
+
 			InvalidateCitusTableCacheEntrySlot(cacheSlot);
+
+			/* statements on the shards might have a stale definition */
+			InvalidateWorkerPreparedStatements();
 		}
 
 		/*
@@ -4729,10 +5673,14 @@ FlushDistTableCache(void)
 		ResetCitusTableCacheEntry(cacheSlot->citusTableMetadata);
 	}
 
+	MetadataGeneration++;
+
 	hash_destroy(DistTableCacheHash);
 	hash_destroy(ShardIdCacheHash);
+	hash_destroy(ColocationShardLayoutHash);
 	CreateDistTableCache();
 	CreateShardIdCache();
+	CreateColocationShardLayoutCache();
 }
 
 
@@ -4768,6 +5716,22 @@ CreateShardIdCache(void)
 }
 
 
+/* CreateColocationShardLayoutCache initializes the colocation group layout mapping */
+static void
+CreateColocationShardLayoutCache(void)
+{
+	HASHCTL info;
+	MemSet(&info, 0, sizeof(info));
+	info.keysize = sizeof(uint32);
+	info.entrysize = sizeof(ColocationShardLayoutCacheEntry);
+	info.hash = uint32_hash;
+	info.hcxt = MetadataCacheMemoryContext;
+	ColocationShardLayoutHash =
+		hash_create("Colocation Shard Layout Cache", 32, &info,
+					HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+}
+
+
 /* CreateDistObjectCache initializes the per-object hash table */
 static void
 CreateDistObjectCache(void)
@@ -4793,6 +5757,8 @@ InvalidateMetadataSystemCache(void)
 {
 	InvalidateConnParamsHashEntries();
 
+	MetadataGeneration++;
+
 	memset(&MetadataCache, 0, sizeof(MetadataCache));
 	workerNodeHashValid = false;
 	LocalGroupId = -1;
@@ -4800,6 +5766,19 @@ InvalidateMetadataSystemCache(void)
 }
 
 
+/*
+ * MetadataCacheGeneration returns a number that changes whenever the metadata
+ * of a Citus table, the worker nodes or the local group are invalidated.
+ * Caches that are derived from the metadata can remember the generation at
+ * which they were built and discard their contents once it changes.
+ */
+uint64
+MetadataCacheGeneration(void)
+{
+	return MetadataGeneration;
+}
+
+
 /*
  * AllCitusTableIds returns all citus table ids.
  */
@@ -4876,6 +5855,8 @@ InvalidateNodeRelationCacheCallback(Datum argument, Oid relationId)
 {
 	if (relationId == InvalidOid || relationId == MetadataCache.distNodeRelationId)
 	{
+		MetadataGeneration++;
+
 		workerNodeHashValid = false;
 		LocalNodeId = -1;
 	}
@@ -4892,6 +5873,8 @@ InvalidateLocalGroupIdRelationCacheCallback(Datum argument, Oid relationId)
 	/* when invalidation happens simply set the LocalGroupId to the default value */
 	if (relationId == InvalidOid || relationId == MetadataCache.distLocalGroupRelationId)
 	{
+		MetadataGeneration++;
+
 		LocalGroupId = -1;
 	}
 }
@@ -5360,6 +6343,20 @@ RelationExists(Oid relationId)
  */
 void
 CitusInvalidateRelcacheByRelid(Oid relationId)
+{
+	InvalidateSharedMetadataCacheOnCommit(relationId, INVALID_SHARD_ID);
+	InvalidateRoutingTableOnCommit();
+
+	RegisterRelcacheInvalidation(relationId);
+}
+
+
+/*
+ * RegisterRelcacheInvalidation registers a relcache invalidation for the
+ * given relation, if it exists.
+ */
+static void
+RegisterRelcacheInvalidation(Oid relationId)
 {
 	HeapTuple classTuple = SearchSysCache1(RELOID, ObjectIdGetDatum(relationId));
 
@@ -5383,6 +6380,8 @@ CitusInvalidateRelcacheByShardId(int64 shardId)
 	Form_pg_dist_shard shardForm = NULL;
 	Relation pgDistShard = table_open(DistShardRelationId(), AccessShareLock);
 
+	InvalidateRoutingTableOnCommit();
+
 	/*
 	 * Load shard, to find the associated relation id. Can't use
 	 * LoadShardInterval directly because that'd fail if the shard doesn't
@@ -5401,7 +6400,10 @@ CitusInvalidateRelcacheByShardId(int64 shardId)
 	if (HeapTupleIsValid(heapTuple))
 	{
 		shardForm = (Form_pg_dist_shard) GETSTRUCT(heapTuple);
-		CitusInvalidateRelcacheByRelid(shardForm->logicalrelid);
+
+		/* only the placements of this shard changed */
+		InvalidateSharedMetadataCacheOnCommit(shardForm->logicalrelid, shardId);
+		RegisterRelcacheInvalidation(shardForm->logicalrelid);
 	}
 	else
 	{
@@ -5418,6 +6420,8 @@ CitusInvalidateRelcacheByShardId(int64 shardId)
 		 *
 		 * Hence we just emit a DEBUG5 message.
 		 */
+		InvalidateSharedMetadataCacheOnCommit(InvalidOid, shardId);
+
 		ereport(DEBUG5, (errmsg(
 							 "could not find distributed relation to invalidate for "
 							 "shard "INT64_FORMAT, shardId)));
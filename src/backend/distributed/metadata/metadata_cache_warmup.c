@@ -0,0 +1,359 @@
+/*-------------------------------------------------------------------------
+ *
+ * metadata_cache_warmup.c
+ *
+ * Routines for building the metadata cache entries of frequently used Citus
+ * tables before a new backend needs them. Backends count in shared memory how
+ * often they build the cache entry of each table, which the maintenance
+ * daemon periodically decays. The first query that a backend plans then
+ * builds the entries of the tables with the highest counts up front, which
+ * keeps the cost of building them out of the queries that follow, for
+ * instance when a connection pooler replaces its backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "access/hash.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+
+#include "distributed/citus_safe_lib.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_cache_warmup.h"
+
+
+/* maximum number of tables, over all databases, for which builds are counted */
+#define MAX_COUNTED_CACHE_BUILDS 4096
+
+
+/*
+ * CitusTableCacheBuildKey identifies a table across all databases.
+ */
+typedef struct CitusTableCacheBuildKey
+{
+	Oid databaseId;
+	Oid relationId;
+} CitusTableCacheBuildKey;
+
+
+/*
+ * CitusTableCacheBuildEntry is the shared memory hash entry holding the
+ * decayed number of times backends built the cache entry of a table.
+ */
+typedef struct CitusTableCacheBuildEntry
+{
+	CitusTableCacheBuildKey key;
+	uint32 buildCount;
+} CitusTableCacheBuildEntry;
+
+
+/*
+ * MetadataCacheWarmupControlData holds the lock protecting the build counts.
+ */
+typedef struct MetadataCacheWarmupControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+} MetadataCacheWarmupControlData;
+
+
+/* GUC, number of tables whose cache entries are built when a backend starts */
+int MetadataCacheWarmupTableCount = 0;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static MetadataCacheWarmupControlData *MetadataCacheWarmupControl = NULL;
+static HTAB *CitusTableCacheBuildHash = NULL;
+
+/* whether this backend already warmed up its metadata cache */
+static bool MetadataCacheWarmedUp = false;
+
+/* whether this backend is warming up, in which case builds are not counted */
+static bool WarmingUpMetadataCache = false;
+
+static int CompareCacheBuildEntriesByCount(const void *leftElement,
+										   const void *rightElement);
+
+
+/*
+ * InitializeMetadataCacheWarmup requests the shared memory for the build
+ * counts and sets the hook that initializes it.
+ */
+void
+InitializeMetadataCacheWarmup(void)
+{
+	/* On PG 15 and above, we use shmem_request_hook_type */
+	#if PG_VERSION_NUM < PG_VERSION_15
+
+	/* allocate shared memory for pre PG-15 versions */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(MetadataCacheWarmupShmemSize());
+	}
+
+	#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = MetadataCacheWarmupShmemInit;
+}
+
+
+/*
+ * MetadataCacheWarmupShmemSize returns the size of the shared memory used for
+ * the build counts.
+ */
+size_t
+MetadataCacheWarmupShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(MetadataCacheWarmupControlData));
+	size = add_size(size, hash_estimate_size(MAX_COUNTED_CACHE_BUILDS,
+											 sizeof(CitusTableCacheBuildEntry)));
+
+	return size;
+}
+
+
+/*
+ * MetadataCacheWarmupShmemInit initializes the shared memory used for the
+ * build counts.
+ */
+void
+MetadataCacheWarmupShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL hashInfo;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	MetadataCacheWarmupControl =
+		(MetadataCacheWarmupControlData *) ShmemInitStruct("Citus Metadata Cache Warmup",
+														   sizeof(
+															   MetadataCacheWarmupControlData),
+														   &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		MetadataCacheWarmupControl->trancheId = LWLockNewTrancheId();
+		MetadataCacheWarmupControl->lockTrancheName = "Citus Metadata Cache Warmup";
+		LWLockRegisterTranche(MetadataCacheWarmupControl->trancheId,
+							  MetadataCacheWarmupControl->lockTrancheName);
+
+		LWLockInitialize(&MetadataCacheWarmupControl->lock,
+						 MetadataCacheWarmupControl->trancheId);
+	}
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = sizeof(CitusTableCacheBuildKey);
+	hashInfo.entrysize = sizeof(CitusTableCacheBuildEntry);
+	hashInfo.hash = tag_hash;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	CitusTableCacheBuildHash = ShmemInitHash("Citus Metadata Cache Warmup Hash",
+											 MAX_COUNTED_CACHE_BUILDS,
+											 MAX_COUNTED_CACHE_BUILDS,
+											 &hashInfo, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * RecordCitusTableCacheBuild counts that this backend built the cache entry
+ * of the given table. Builds are only counted while warm-up is enabled, and
+ * are not counted if the counts of too many tables are kept already. Builds
+ * done by the warm-up itself are not counted either, otherwise tables would
+ * stay hot merely because new backends keep warming them up.
+ */
+void
+RecordCitusTableCacheBuild(Oid relationId)
+{
+	CitusTableCacheBuildKey key;
+	bool found = false;
+
+	if (MetadataCacheWarmupTableCount <= 0 || CitusTableCacheBuildHash == NULL ||
+		WarmingUpMetadataCache)
+	{
+		return;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.databaseId = MyDatabaseId;
+	key.relationId = relationId;
+
+	LWLockAcquire(&MetadataCacheWarmupControl->lock, LW_EXCLUSIVE);
+
+	CitusTableCacheBuildEntry *entry =
+		(CitusTableCacheBuildEntry *) hash_search(CitusTableCacheBuildHash, &key,
+												  HASH_ENTER_NULL, &found);
+	if (entry != NULL)
+	{
+		if (!found)
+		{
+			entry->buildCount = 0;
+		}
+
+		if (entry->buildCount < PG_UINT32_MAX)
+		{
+			entry->buildCount++;
+		}
+	}
+
+	LWLockRelease(&MetadataCacheWarmupControl->lock);
+}
+
+
+/*
+ * DecayCitusTableCacheBuildCounts halves the build counts of the tables in
+ * the current database, such that the counts reflect recent use, and removes
+ * the tables whose count drops to zero. Dropped tables therefore disappear
+ * after a while, too.
+ */
+void
+DecayCitusTableCacheBuildCounts(void)
+{
+	HASH_SEQ_STATUS status;
+
+	if (CitusTableCacheBuildHash == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&MetadataCacheWarmupControl->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, CitusTableCacheBuildHash);
+
+	CitusTableCacheBuildEntry *entry = NULL;
+	while ((entry = (CitusTableCacheBuildEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (entry->key.databaseId != MyDatabaseId)
+		{
+			continue;
+		}
+
+		entry->buildCount /= 2;
+
+		if (entry->buildCount == 0)
+		{
+			hash_search(CitusTableCacheBuildHash, &entry->key, HASH_REMOVE, NULL);
+		}
+	}
+
+	LWLockRelease(&MetadataCacheWarmupControl->lock);
+}
+
+
+/*
+ * WarmUpMetadataCache builds the cache entries of the tables in the current
+ * database with the highest build counts, up to citus.metadata_cache_warmup_tables
+ * of them. It only does so the first time it is called in a backend. The
+ * entries are built as usual, so they are read from the shared metadata cache
+ * when it holds them.
+ */
+void
+WarmUpMetadataCache(void)
+{
+	HASH_SEQ_STATUS status;
+
+	if (MetadataCacheWarmedUp)
+	{
+		return;
+	}
+
+	MetadataCacheWarmedUp = true;
+
+	if (MetadataCacheWarmupTableCount <= 0 || CitusTableCacheBuildHash == NULL ||
+		!CheckCitusVersion(DEBUG1))
+	{
+		return;
+	}
+
+	CitusTableCacheBuildEntry *entryArray =
+		palloc0(MAX_COUNTED_CACHE_BUILDS * sizeof(CitusTableCacheBuildEntry));
+	int entryCount = 0;
+
+	LWLockAcquire(&MetadataCacheWarmupControl->lock, LW_SHARED);
+
+	hash_seq_init(&status, CitusTableCacheBuildHash);
+
+	CitusTableCacheBuildEntry *entry = NULL;
+	while ((entry = (CitusTableCacheBuildEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (entry->key.databaseId != MyDatabaseId ||
+			entryCount >= MAX_COUNTED_CACHE_BUILDS)
+		{
+			continue;
+		}
+
+		entryArray[entryCount] = *entry;
+		entryCount++;
+	}
+
+	LWLockRelease(&MetadataCacheWarmupControl->lock);
+
+	SafeQsort(entryArray, entryCount, sizeof(CitusTableCacheBuildEntry),
+			  CompareCacheBuildEntriesByCount);
+
+	int warmupCount = Min(entryCount, MetadataCacheWarmupTableCount);
+
+	WarmingUpMetadataCache = true;
+
+	PG_TRY();
+	{
+		for (int entryIndex = 0; entryIndex < warmupCount; entryIndex++)
+		{
+			/* tables that were dropped in the meantime are simply not found */
+			LookupCitusTableCacheEntry(entryArray[entryIndex].key.relationId);
+		}
+	}
+	PG_CATCH();
+	{
+		WarmingUpMetadataCache = false;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	WarmingUpMetadataCache = false;
+
+	pfree(entryArray);
+}
+
+
+/*
+ * CompareCacheBuildEntriesByCount is a comparison function for sorting
+ * CitusTableCacheBuildEntry elements by descending build count.
+ */
+static int
+CompareCacheBuildEntriesByCount(const void *leftElement, const void *rightElement)
+{
+	const CitusTableCacheBuildEntry *leftEntry =
+		(const CitusTableCacheBuildEntry *) leftElement;
+	const CitusTableCacheBuildEntry *rightEntry =
+		(const CitusTableCacheBuildEntry *) rightElement;
+
+	if (leftEntry->buildCount > rightEntry->buildCount)
+	{
+		return -1;
+	}
+	else if (leftEntry->buildCount < rightEntry->buildCount)
+	{
+		return 1;
+	}
+
+	return 0;
+}
@@ -41,8 +41,10 @@
 #include "distributed/citus_ruleutils.h"
 #include "distributed/colocation_utils.h"
 #include "distributed/commands.h"
+#include "distributed/commands/multi_copy.h"
 #include "distributed/deparser.h"
 #include "distributed/distribution_column.h"
+#include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_utility.h"
 #include "distributed/coordinator_protocol.h"
@@ -70,6 +72,7 @@
 #include "distributed/worker_transaction.h"
 #include "distributed/version_compat.h"
 #include "distributed/commands/utility_hook.h"
+#include "executor/executor.h"
 #include "executor/spi.h"
 #include "foreign/foreign.h"
 #include "miscadmin.h"
@@ -91,6 +94,12 @@
 /* managed via a GUC */
 char *EnableManualMetadataChangesForUser = "";
 
+/* GUC, whether node activation sends shards and placements as intermediate results */
+bool EnableBulkMetadataSync = false;
+
+/* number of intermediate results sent by ShardListBulkInsertCommandList */
+static int BulkMetadataSyncResultCount = 0;
+
 
 static void EnsureObjectMetadataIsSane(int distributionArgumentIndex,
 									   int colocationId);
@@ -104,6 +113,9 @@ static NodeMetadataSyncResult SyncNodeMetadataToNodesOptional(void);
 static bool ShouldSyncTableMetadataInternal(bool hashDistributed,
 											bool citusTableWithNoDistKey);
 static bool SyncNodeMetadataSnapshotToNode(WorkerNode *workerNode, bool raiseOnError);
+static void SyncNodeMetadataSnapshotToNodeList(List *workerNodeList);
+static WorkerNode * MarkNodeForNodeMetadataSync(const char *nodeNameString,
+												int32 nodePort);
 static void DropMetadataSnapshotOnNode(WorkerNode *workerNode);
 static char * CreateSequenceDependencyCommand(Oid relationId, Oid sequenceId,
 											  char *columnName);
@@ -143,6 +155,11 @@ static char * ColocationGroupCreateCommand(uint32 colocationId, int shardCount,
 										   Oid distributionColumnCollation);
 static char * ColocationGroupDeleteCommand(uint32 colocationId);
 static char * RemoteTypeIdExpression(Oid typeId);
+static TupleDesc ShardBulkSyncTupleDesc(void);
+static TupleDesc PlacementBulkSyncTupleDesc(void);
+static char * BulkSyncInsertCommand(const char *resultId, TupleDesc tupleDescriptor,
+									const char *functionCall,
+									const char *columnDefinitionList);
 static char * RemoteCollationIdExpression(Oid colocationId);
 
 
@@ -227,6 +244,52 @@ start_metadata_sync_to_all_nodes(PG_FUNCTION_ARGS)
  */
 void
 SyncNodeMetadataToNode(const char *nodeNameString, int32 nodePort)
+{
+	WorkerNode *workerNode = MarkNodeForNodeMetadataSync(nodeNameString, nodePort);
+	if (workerNode == NULL)
+	{
+		return;
+	}
+
+	/* fail if metadata synchronization doesn't succeed */
+	bool raiseInterrupts = true;
+	SyncNodeMetadataSnapshotToNode(workerNode, raiseInterrupts);
+}
+
+
+/*
+ * SyncNodeMetadataToNodeList does the same as SyncNodeMetadataToNode for
+ * all nodes in the given list, but sends the node metadata snapshot to all
+ * of them at once rather than one node after another.
+ */
+void
+SyncNodeMetadataToNodeList(List *nodeList)
+{
+	List *nodesToSync = NIL;
+
+	WorkerNode *node = NULL;
+	foreach_ptr(node, nodeList)
+	{
+		WorkerNode *workerNode = MarkNodeForNodeMetadataSync(node->workerName,
+															 node->workerPort);
+		if (workerNode != NULL)
+		{
+			nodesToSync = lappend(nodesToSync, workerNode);
+		}
+	}
+
+	SyncNodeMetadataSnapshotToNodeList(nodesToSync);
+}
+
+
+/*
+ * MarkNodeForNodeMetadataSync checks that the node metadata can be synced to
+ * the given node and sets its metadatasynced and hasmetadata columns. It
+ * returns the node if the node metadata snapshot should be sent to it, and
+ * NULL for the coordinator and secondary nodes.
+ */
+static WorkerNode *
+MarkNodeForNodeMetadataSync(const char *nodeNameString, int32 nodePort)
 {
 	char *escapedNodeName = quote_literal_cstr(nodeNameString);
 
@@ -261,7 +324,7 @@ SyncNodeMetadataToNode(const char *nodeNameString, int32 nodePort)
 		ereport(NOTICE, (errmsg("%s:%d is the coordinator and already contains "
 								"metadata, skipping syncing the metadata",
 								nodeNameString, nodePort)));
-		return;
+		return NULL;
 	}
 
 	UseCoordinatedTransaction();
@@ -287,12 +350,10 @@ SyncNodeMetadataToNode(const char *nodeNameString, int32 nodePort)
 		 * If this is a secondary node we can't actually sync metadata to it; we assume
 		 * the primary node is receiving metadata.
 		 */
-		return;
+		return NULL;
 	}
 
-	/* fail if metadata synchronization doesn't succeed */
-	bool raiseInterrupts = true;
-	SyncNodeMetadataSnapshotToNode(workerNode, raiseInterrupts);
+	return workerNode;
 }
 
 
@@ -653,6 +714,42 @@ SyncNodeMetadataSnapshotToNode(WorkerNode *workerNode, bool raiseOnError)
 }
 
 
+/*
+ * SyncNodeMetadataSnapshotToNodeList sends the same commands as
+ * SyncNodeMetadataSnapshotToNode to all nodes in the given list at once, and
+ * errors out if synchronization fails. Only the local group id differs per
+ * node, so the node metadata commands are generated once.
+ */
+static void
+SyncNodeMetadataSnapshotToNodeList(List *workerNodeList)
+{
+	if (workerNodeList == NIL)
+	{
+		return;
+	}
+
+	/* generate the queries which drop and create the node metadata from scratch */
+	List *recreateMetadataCommandList = NodeMetadataDropCommands();
+	recreateMetadataCommandList = list_concat(recreateMetadataCommandList,
+											  NodeMetadataCreateCommands());
+
+	List *commandListPerWorker = NIL;
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		char *localGroupIdUpdateCommand = LocalGroupIdUpdateCommand(workerNode->groupId);
+		List *commandList = lcons(localGroupIdUpdateCommand,
+								  list_copy(recreateMetadataCommandList));
+
+		commandListPerWorker = lappend(commandListPerWorker, commandList);
+	}
+
+	SendMetadataCommandListPerWorkerInCoordinatedTransaction(workerNodeList,
+															 CurrentUserName(),
+															 commandListPerWorker);
+}
+
+
 /*
  * DropMetadataSnapshotOnNode creates the queries which drop the metadata and sends them
  * to the worker given as parameter.
@@ -1380,6 +1477,222 @@ ShardListInsertCommand(List *shardIntervalList)
 }
 
 
+/*
+ * ShardListBulkInsertCommandList is the counterpart of ShardListInsertCommand
+ * for syncing the metadata of many shards at once, as when activating a node.
+ * Instead of embedding every shard and placement in the command text, it
+ * broadcasts the shard and placement rows to the given nodes as two
+ * intermediate results via COPY, and returns the commands that insert the
+ * rows from those results. The returned commands therefore need to be sent
+ * in the current coordinated transaction, where the results are visible.
+ */
+List *
+ShardListBulkInsertCommandList(List *shardIntervalList, List *workerNodeList)
+{
+	List *commandList = NIL;
+	bool writeLocalFile = false;
+
+	if (shardIntervalList == NIL || workerNodeList == NIL)
+	{
+		return commandList;
+	}
+
+	/* intermediate results are stored in the directory of the transaction */
+	UseCoordinatedTransaction();
+
+	BulkMetadataSyncResultCount++;
+
+	StringInfo shardResultId = makeStringInfo();
+	appendStringInfo(shardResultId, "citus_metadata_sync_shards_%d",
+					 BulkMetadataSyncResultCount);
+
+	StringInfo placementResultId = makeStringInfo();
+	appendStringInfo(placementResultId, "citus_metadata_sync_placements_%d",
+					 BulkMetadataSyncResultCount);
+
+	EState *estate = CreateExecutorState();
+
+	TupleDesc shardTupleDesc = ShardBulkSyncTupleDesc();
+	TupleTableSlot *shardSlot = MakeSingleTupleTableSlot(shardTupleDesc,
+														 &TTSOpsVirtual);
+	DestReceiver *shardDest =
+		CreateRemoteFileDestReceiver(shardResultId->data, estate, workerNodeList,
+									 writeLocalFile);
+
+	TupleDesc placementTupleDesc = PlacementBulkSyncTupleDesc();
+	TupleTableSlot *placementSlot = MakeSingleTupleTableSlot(placementTupleDesc,
+															 &TTSOpsVirtual);
+	DestReceiver *placementDest =
+		CreateRemoteFileDestReceiver(placementResultId->data, estate, workerNodeList,
+									 writeLocalFile);
+
+	shardDest->rStartup(shardDest, CMD_SELECT, shardTupleDesc);
+	placementDest->rStartup(placementDest, CMD_SELECT, placementTupleDesc);
+
+	uint64 placementCount = 0;
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		uint64 shardId = shardInterval->shardId;
+		char *qualifiedRelationName =
+			generate_qualified_relation_name(shardInterval->relationId);
+
+		ExecClearTuple(shardSlot);
+
+		/* relation names are sent as text, since OIDs differ across nodes */
+		shardSlot->tts_values[0] = CStringGetTextDatum(qualifiedRelationName);
+		shardSlot->tts_isnull[0] = false;
+		shardSlot->tts_values[1] = Int64GetDatum(shardId);
+		shardSlot->tts_isnull[1] = false;
+		shardSlot->tts_values[2] = CharGetDatum(shardInterval->storageType);
+		shardSlot->tts_isnull[2] = false;
+
+		shardSlot->tts_isnull[3] = !shardInterval->minValueExists;
+		if (shardInterval->minValueExists)
+		{
+			char *minValue = psprintf("%d", DatumGetInt32(shardInterval->minValue));
+			shardSlot->tts_values[3] = CStringGetTextDatum(minValue);
+		}
+
+		shardSlot->tts_isnull[4] = !shardInterval->maxValueExists;
+		if (shardInterval->maxValueExists)
+		{
+			char *maxValue = psprintf("%d", DatumGetInt32(shardInterval->maxValue));
+			shardSlot->tts_values[4] = CStringGetTextDatum(maxValue);
+		}
+
+		ExecStoreVirtualTuple(shardSlot);
+		shardDest->receiveSlot(shardSlot, shardDest);
+
+		List *shardPlacementList = ActiveShardPlacementList(shardId);
+
+		ShardPlacement *placement = NULL;
+		foreach_ptr(placement, shardPlacementList)
+		{
+			ExecClearTuple(placementSlot);
+
+			placementSlot->tts_values[0] = Int64GetDatum(shardId);
+			placementSlot->tts_isnull[0] = false;
+			placementSlot->tts_values[1] = Int32GetDatum(placement->shardState);
+			placementSlot->tts_isnull[1] = false;
+			placementSlot->tts_values[2] = Int64GetDatum(placement->shardLength);
+			placementSlot->tts_isnull[2] = false;
+			placementSlot->tts_values[3] = Int32GetDatum(placement->groupId);
+			placementSlot->tts_isnull[3] = false;
+			placementSlot->tts_values[4] = Int64GetDatum(placement->placementId);
+			placementSlot->tts_isnull[4] = false;
+
+			ExecStoreVirtualTuple(placementSlot);
+			placementDest->receiveSlot(placementSlot, placementDest);
+
+			placementCount++;
+		}
+	}
+
+	shardDest->rShutdown(shardDest);
+	shardDest->rDestroy(shardDest);
+	placementDest->rShutdown(placementDest);
+	placementDest->rDestroy(placementDest);
+
+	ExecDropSingleTupleTableSlot(shardSlot);
+	ExecDropSingleTupleTableSlot(placementSlot);
+	FreeExecutorState(estate);
+
+	/*
+	 * Like ShardListInsertCommand, skip the commands when there are no active
+	 * placements. The placement result would not exist in that case, since
+	 * results are only created once the first row is sent.
+	 */
+	if (placementCount > 0)
+	{
+		char *insertShardCommand =
+			BulkSyncInsertCommand(shardResultId->data, shardTupleDesc,
+								  "citus_internal_add_shard_metadata("
+								  "relationname::regclass, shardid, storagetype, "
+								  "shardminvalue, shardmaxvalue)",
+								  "relationname text, shardid bigint, "
+								  "storagetype \"char\", shardminvalue text, "
+								  "shardmaxvalue text");
+		char *insertPlacementCommand =
+			BulkSyncInsertCommand(placementResultId->data, placementTupleDesc,
+								  "citus_internal_add_placement_metadata("
+								  "shardid, shardstate, shardlength, groupid, "
+								  "placementid)",
+								  "shardid bigint, shardstate int, "
+								  "shardlength bigint, groupid int, "
+								  "placementid bigint");
+
+		/* first insert shards, than the placements */
+		commandList = lappend(commandList, insertShardCommand);
+		commandList = lappend(commandList, insertPlacementCommand);
+	}
+
+	return commandList;
+}
+
+
+/*
+ * ShardBulkSyncTupleDesc returns the tuple descriptor of the rows that
+ * ShardListBulkInsertCommandList sends for pg_dist_shard.
+ */
+static TupleDesc
+ShardBulkSyncTupleDesc(void)
+{
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(5);
+
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "relationname", TEXTOID, -1,
+					   0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 2, "shardid", INT8OID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 3, "storagetype", CHAROID, -1,
+					   0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 4, "shardminvalue", TEXTOID, -1,
+					   0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 5, "shardmaxvalue", TEXTOID, -1,
+					   0);
+
+	return tupleDescriptor;
+}
+
+
+/*
+ * PlacementBulkSyncTupleDesc returns the tuple descriptor of the rows that
+ * ShardListBulkInsertCommandList sends for pg_dist_placement.
+ */
+static TupleDesc
+PlacementBulkSyncTupleDesc(void)
+{
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(5);
+
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "shardid", INT8OID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 2, "shardstate", INT4OID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 3, "shardlength", INT8OID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 4, "groupid", INT4OID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 5, "placementid", INT8OID, -1, 0);
+
+	return tupleDescriptor;
+}
+
+
+/*
+ * BulkSyncInsertCommand returns a command that calls the given metadata
+ * function for every row of the intermediate result with the given id.
+ */
+static char *
+BulkSyncInsertCommand(const char *resultId, TupleDesc tupleDescriptor,
+					  const char *functionCall, const char *columnDefinitionList)
+{
+	StringInfo command = makeStringInfo();
+	char *copyFormat = CanUseBinaryCopyFormat(tupleDescriptor) ? "binary" : "text";
+
+	appendStringInfo(command,
+					 "SELECT %s FROM read_intermediate_result(%s, '%s') AS res(%s)",
+					 functionCall, quote_literal_cstr(resultId), copyFormat,
+					 columnDefinitionList);
+
+	return command->data;
+}
+
+
 /*
  * ShardListDeleteCommand generates a command list that can be executed to delete
  * shard and shard placement metadata for the given shard.
@@ -57,7 +57,9 @@
 #include "distributed/relay_utility.h"
 #include "distributed/resource_lock.h"
 #include "distributed/remote_commands.h"
+#include "distributed/shard_size_cache.h"
 #include "distributed/tuplestore.h"
+#include "distributed/utils/array_type.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
@@ -87,7 +89,6 @@ static bool DistributedTableSize(Oid relationId, SizeQueryType sizeQueryType,
 static bool DistributedTableSizeOnWorker(WorkerNode *workerNode, Oid relationId,
 										 SizeQueryType sizeQueryType, bool failOnError,
 										 uint64 *tableSize);
-static List * ShardIntervalsOnWorkerGroup(WorkerNode *workerNode, Oid relationId);
 static char * GenerateShardStatisticsQueryForShardList(List *shardIntervalList);
 static char * GenerateSizeQueryForRelationNameList(List *quotedShardNames,
 												   char *sizeFunction);
@@ -98,10 +99,18 @@ static char * GenerateAllShardStatisticsQueryForNode(WorkerNode *workerNode,
 static List * GenerateShardStatisticsQueryList(List *workerNodeList, List *citusTableIds);
 static void ErrorIfNotSuitableToGetSize(Oid relationId);
 static List * OpenConnectionToNodes(List *workerNodeList);
+static bool AddCachedShardNameAndSizes(List *citusTableIds,
+									   Tuplestorestate *tupleStore,
+									   TupleDesc tupleDescriptor);
 static void ReceiveShardNameAndSizeResults(List *connectionList,
 										   Tuplestorestate *tupleStore,
 										   TupleDesc tupleDescriptor);
 static void AppendShardSizeQuery(StringInfo selectQuery, ShardInterval *shardInterval);
+static char * GenerateShardStatCountersQueryForNode(WorkerNode *workerNode,
+													List *citusTableIds);
+static void ReceiveShardStatCountersResults(List *connectionList, List *workerNodeList,
+											Tuplestorestate *tupleStore,
+											TupleDesc tupleDescriptor);
 
 static HeapTuple CreateDiskSpaceTuple(TupleDesc tupleDesc, uint64 availableBytes,
 									  uint64 totalBytes);
@@ -128,6 +137,7 @@ PG_FUNCTION_INFO_V1(citus_table_size);
 PG_FUNCTION_INFO_V1(citus_total_relation_size);
 PG_FUNCTION_INFO_V1(citus_relation_size);
 PG_FUNCTION_INFO_V1(citus_shard_sizes);
+PG_FUNCTION_INFO_V1(citus_shard_stat_counters);
 
 
 /*
@@ -250,7 +260,9 @@ GetNodeDiskSpaceStatsForConnection(MultiConnection *connection, uint64 *availabl
 
 
 /*
- * citus_shard_sizes returns all shard names and their sizes.
+ * citus_shard_sizes returns all shard names and their sizes. The sizes
+ * collected by the maintenance daemon are returned when all of them are
+ * cached, otherwise the sizes are fetched from the nodes.
  */
 Datum
 citus_shard_sizes(PG_FUNCTION_ARGS)
@@ -259,16 +271,138 @@ citus_shard_sizes(PG_FUNCTION_ARGS)
 
 	List *allCitusTableIds = AllCitusTableIds();
 
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	if (AddCachedShardNameAndSizes(allCitusTableIds, tupleStore, tupleDescriptor))
+	{
+		PG_RETURN_VOID();
+	}
+
 	/* we don't need a distributed transaction here */
 	bool useDistributedTransaction = false;
 
 	List *connectionList =
 		SendShardStatisticsQueriesInParallel(allCitusTableIds, useDistributedTransaction);
 
+	ReceiveShardNameAndSizeResults(connectionList, tupleStore, tupleDescriptor);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * AddCachedShardNameAndSizes adds the names and cached sizes of the shard
+ * placements of the given tables on the active primary nodes to the tuple
+ * store, in the same form as ReceiveShardNameAndSizeResults. If the size of
+ * any placement is not cached, the tuple store is left empty and the function
+ * returns false.
+ */
+static bool
+AddCachedShardNameAndSizes(List *citusTableIds, Tuplestorestate *tupleStore,
+						   TupleDesc tupleDescriptor)
+{
+	List *workerNodeList = ActivePrimaryNodeList(NoLock);
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		Oid relationId = InvalidOid;
+		foreach_oid(relationId, citusTableIds)
+		{
+			/* skip tables that were dropped, like GenerateAllShardStatisticsQueryForNode */
+			Relation relation = try_relation_open(relationId, AccessShareLock);
+			if (relation == NULL)
+			{
+				continue;
+			}
+
+			char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+			char *relationName = get_rel_name(relationId);
+
+			List *shardIntervalsOnNode = ShardIntervalsOnWorkerGroup(workerNode,
+																	 relationId);
+			ShardInterval *shardInterval = NULL;
+			foreach_ptr(shardInterval, shardIntervalsOnNode)
+			{
+				Datum values[SHARD_SIZES_COLUMN_COUNT];
+				bool isNulls[SHARD_SIZES_COLUMN_COUNT];
+				uint64 relationSize = 0;
+				uint64 totalSize = 0;
+
+				if (!CachedShardPlacementSize(shardInterval->shardId,
+											  workerNode->groupId, &relationSize,
+											  &totalSize))
+				{
+					relation_close(relation, AccessShareLock);
+					tuplestore_clear(tupleStore);
+					return false;
+				}
+
+				char *shardName = pstrdup(relationName);
+				AppendShardIdToName(&shardName, shardInterval->shardId);
+
+				memset(values, 0, sizeof(values));
+				memset(isNulls, false, sizeof(isNulls));
+
+				values[0] = CStringGetTextDatum(quote_qualified_identifier(schemaName,
+																		   shardName));
+				values[1] = Int64GetDatum(relationSize);
+
+				tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+			}
+
+			relation_close(relation, AccessShareLock);
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * citus_shard_stat_counters returns the scan and tuple counters that the
+ * statistics collector keeps for each shard placement on the nodes.
+ */
+Datum
+citus_shard_stat_counters(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	List *allCitusTableIds = AllCitusTableIds();
+	List *workerNodeList = ActivePrimaryNodeList(NoLock);
+	List *statCountersQueryList = NIL;
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		char *statCountersQuery =
+			GenerateShardStatCountersQueryForNode(workerNode, allCitusTableIds);
+
+		statCountersQueryList = lappend(statCountersQueryList, statCountersQuery);
+	}
+
+	List *connectionList = OpenConnectionToNodes(workerNodeList);
+	FinishConnectionListEstablishment(connectionList);
+
+	/* send commands in parallel */
+	for (int i = 0; i < list_length(connectionList); i++)
+	{
+		MultiConnection *connection = (MultiConnection *) list_nth(connectionList, i);
+		char *statCountersQuery = (char *) list_nth(statCountersQueryList, i);
+
+		int querySent = SendRemoteCommand(connection, statCountersQuery);
+		if (querySent == 0)
+		{
+			ReportConnectionError(connection, WARNING);
+		}
+	}
+
 	TupleDesc tupleDescriptor = NULL;
 	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
 
-	ReceiveShardNameAndSizeResults(connectionList, tupleStore, tupleDescriptor);
+	ReceiveShardStatCountersResults(connectionList, workerNodeList, tupleStore,
+									tupleDescriptor);
 
 	PG_RETURN_VOID();
 }
@@ -502,6 +636,74 @@ ReceiveShardNameAndSizeResults(List *connectionList, Tuplestorestate *tupleStore
 }
 
 
+/*
+ * ReceiveShardStatCountersResults receives the scan and tuple counters of the
+ * shard placements from the given connections, which are in the same order as
+ * the nodes in workerNodeList.
+ */
+static void
+ReceiveShardStatCountersResults(List *connectionList, List *workerNodeList,
+								Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
+{
+	for (int i = 0; i < list_length(connectionList); i++)
+	{
+		MultiConnection *connection = (MultiConnection *) list_nth(connectionList, i);
+		WorkerNode *workerNode = (WorkerNode *) list_nth(workerNodeList, i);
+		bool raiseInterrupts = true;
+		Datum values[SHARD_STAT_COUNTERS_COLUMN_COUNT + 2];
+		bool isNulls[SHARD_STAT_COUNTERS_COLUMN_COUNT + 2];
+
+		if (PQstatus(connection->pgConn) != CONNECTION_OK)
+		{
+			continue;
+		}
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, WARNING);
+			continue;
+		}
+
+		int64 rowCount = PQntuples(result);
+		int64 colCount = PQnfields(result);
+
+		/* Although it is not expected */
+		if (colCount != SHARD_STAT_COUNTERS_COLUMN_COUNT)
+		{
+			ereport(WARNING, (errmsg("unexpected number of columns from "
+									 "citus_shard_stat_counters")));
+			PQclear(result);
+			ForgetResults(connection);
+			continue;
+		}
+
+		for (int64 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			memset(values, 0, sizeof(values));
+			memset(isNulls, false, sizeof(isNulls));
+
+			/*
+			 * format is [0] shard id, [1] seq scans, [2] index scans, [3] tuples
+			 * read, [4] tuples written, the node goes in between
+			 */
+			values[0] = ParseIntField(result, rowIndex, 0);
+			values[1] = CStringGetTextDatum(workerNode->workerName);
+			values[2] = Int32GetDatum(workerNode->workerPort);
+			values[3] = ParseIntField(result, rowIndex, 1);
+			values[4] = ParseIntField(result, rowIndex, 2);
+			values[5] = ParseIntField(result, rowIndex, 3);
+			values[6] = ParseIntField(result, rowIndex, 4);
+
+			tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+	}
+}
+
+
 /*
  * DistributedTableSize is helper function for each kind of citus size functions.
  * It first checks whether the table is distributed and size query can be run on
@@ -669,10 +871,10 @@ GroupShardPlacementsForTableOnGroup(Oid relationId, int32 groupId)
 
 	for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
 	{
+		int numberOfPlacements = 0;
 		GroupShardPlacement *placementArray =
-			distTableCacheEntry->arrayOfPlacementArrays[shardIndex];
-		int numberOfPlacements =
-			distTableCacheEntry->arrayOfPlacementArrayLengths[shardIndex];
+			GetCachedShardPlacementArray(distTableCacheEntry, shardIndex,
+										 &numberOfPlacements);
 
 		for (int placementIndex = 0; placementIndex < numberOfPlacements;
 			 placementIndex++)
@@ -694,7 +896,7 @@ GroupShardPlacementsForTableOnGroup(Oid relationId, int32 groupId)
  * ShardIntervalsOnWorkerGroup accepts a WorkerNode and returns a list of the shard
  * intervals of the given table which are placed on the group the node is a part of.
  */
-static List *
+List *
 ShardIntervalsOnWorkerGroup(WorkerNode *workerNode, Oid relationId)
 {
 	CitusTableCacheEntry *distTableCacheEntry = GetCitusTableCacheEntry(relationId);
@@ -703,10 +905,10 @@ ShardIntervalsOnWorkerGroup(WorkerNode *workerNode, Oid relationId)
 
 	for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
 	{
+		int numberOfPlacements = 0;
 		GroupShardPlacement *placementArray =
-			distTableCacheEntry->arrayOfPlacementArrays[shardIndex];
-		int numberOfPlacements =
-			distTableCacheEntry->arrayOfPlacementArrayLengths[shardIndex];
+			GetCachedShardPlacementArray(distTableCacheEntry, shardIndex,
+										 &numberOfPlacements);
 
 		for (int placementIndex = 0; placementIndex < numberOfPlacements;
 			 placementIndex++)
@@ -716,7 +918,7 @@ ShardIntervalsOnWorkerGroup(WorkerNode *workerNode, Oid relationId)
 			if (placement->groupId == workerNode->groupId)
 			{
 				ShardInterval *cachedShardInterval =
-					distTableCacheEntry->sortedShardIntervalArray[shardIndex];
+					GetCachedShardInterval(distTableCacheEntry, shardIndex);
 				ShardInterval *shardInterval = CopyShardInterval(cachedShardInterval);
 				shardIntervalList = lappend(shardIntervalList, shardInterval);
 			}
@@ -989,6 +1191,64 @@ AppendShardSizeQuery(StringInfo selectQuery, ShardInterval *shardInterval)
 }
 
 
+/*
+ * GenerateShardStatCountersQueryForNode generates a query that returns:
+ * shard_id, seq_scan, idx_scan, tup_read, tup_written for all shard placements
+ * on the node. The shards are looked up with to_regclass, such that shards
+ * that are dropped concurrently are skipped.
+ */
+static char *
+GenerateShardStatCountersQueryForNode(WorkerNode *workerNode, List *citusTableIds)
+{
+	StringInfo statCountersQuery = makeStringInfo();
+
+	appendStringInfoString(statCountersQuery,
+						   "SELECT s.shard_id, t.seq_scan, "
+						   "coalesce(t.idx_scan, 0), "
+						   "t.seq_tup_read + coalesce(t.idx_tup_fetch, 0), "
+						   "t.n_tup_ins + t.n_tup_upd + t.n_tup_del "
+						   "FROM (VALUES (0::bigint, NULL::text)");
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, citusTableIds)
+	{
+		/* skip tables that were dropped in the meantime, as for the sizes */
+		Relation relation = try_relation_open(relationId, AccessShareLock);
+		if (relation == NULL)
+		{
+			continue;
+		}
+
+		char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+		List *shardIntervalsOnNode = ShardIntervalsOnWorkerGroup(workerNode,
+																 relationId);
+
+		ShardInterval *shardInterval = NULL;
+		foreach_ptr(shardInterval, shardIntervalsOnNode)
+		{
+			char *shardName = get_rel_name(relationId);
+			AppendShardIdToName(&shardName, shardInterval->shardId);
+
+			char *shardQualifiedName = quote_qualified_identifier(schemaName,
+																  shardName);
+
+			appendStringInfo(statCountersQuery, ", (" UINT64_FORMAT ", %s)",
+							 shardInterval->shardId,
+							 quote_literal_cstr(shardQualifiedName));
+		}
+
+		relation_close(relation, AccessShareLock);
+	}
+
+	appendStringInfoString(statCountersQuery,
+						   ") s(shard_id, shard_name) "
+						   "JOIN pg_catalog.pg_stat_all_tables t "
+						   "ON t.relid = pg_catalog.to_regclass(s.shard_name)");
+
+	return statCountersQuery->data;
+}
+
+
 /*
  * ErrorIfNotSuitableToGetSize determines whether the table is suitable to find
  * its' size with internal functions.
@@ -1133,7 +1393,7 @@ LoadShardIntervalList(Oid relationId)
 	for (int i = 0; i < cacheEntry->shardIntervalArrayLength; i++)
 	{
 		ShardInterval *newShardInterval =
-			CopyShardInterval(cacheEntry->sortedShardIntervalArray[i]);
+			CopyShardInterval(GetCachedShardInterval(cacheEntry, i));
 		shardList = lappend(shardList, newShardInterval);
 	}
 
@@ -1195,12 +1455,11 @@ LoadShardIntervalWithLongestShardName(Oid relationId)
 
 	for (int shardIndex = 0; shardIndex <= maxShardIndex; ++shardIndex)
 	{
-		ShardInterval *currentShardInterval =
-			cacheEntry->sortedShardIntervalArray[shardIndex];
+		uint64 currentShardId = GetCachedShardId(cacheEntry, shardIndex);
 
-		if (largestShardId < currentShardInterval->shardId)
+		if (largestShardId < currentShardId)
 		{
-			largestShardId = currentShardInterval->shardId;
+			largestShardId = currentShardId;
 		}
 	}
 
@@ -1236,8 +1495,7 @@ LoadShardList(Oid relationId)
 
 	for (int i = 0; i < cacheEntry->shardIntervalArrayLength; i++)
 	{
-		ShardInterval *currentShardInterval = cacheEntry->sortedShardIntervalArray[i];
-		uint64 *shardIdPointer = AllocateUint64(currentShardInterval->shardId);
+		uint64 *shardIdPointer = AllocateUint64(GetCachedShardId(cacheEntry, i));
 
 		shardList = lappend(shardList, shardIdPointer);
 	}
@@ -2895,10 +3153,14 @@ CreateBackgroundJob(const char *jobType, const char *description)
  * Optionally the new task can depend on separate tasks associated with the same job. When
  * a new task is created with dependencies on previous tasks we assume this task is
  * blocked on its depending tasks.
+ *
+ * The ids of the nodes the task works on are recorded in nodes_involved, such that the
+ * task queue monitor can limit the number of tasks running concurrently on a node.
  */
 BackgroundTask *
 ScheduleBackgroundTask(int64 jobId, Oid owner, char *command, int dependingTaskCount,
-					   int64 dependingTaskIds[])
+					   int64 dependingTaskIds[], int nodesInvolvedCount,
+					   int32 nodesInvolved[])
 {
 	BackgroundTask *task = NULL;
 
@@ -2972,6 +3234,26 @@ ScheduleBackgroundTask(int64 jobId, Oid owner, char *command, int dependingTaskC
 		values[Anum_pg_dist_background_task_message - 1] = CStringGetTextDatum("");
 		nulls[Anum_pg_dist_background_task_message - 1] = false;
 
+		List *nodesInvolvedList = NIL;
+		if (nodesInvolvedCount > 0)
+		{
+			Datum *nodesInvolvedDatumArray = palloc0(nodesInvolvedCount * sizeof(Datum));
+			for (int nodeIndex = 0; nodeIndex < nodesInvolvedCount; nodeIndex++)
+			{
+				nodesInvolvedDatumArray[nodeIndex] =
+					Int32GetDatum(nodesInvolved[nodeIndex]);
+				nodesInvolvedList = lappend_int(nodesInvolvedList,
+												nodesInvolved[nodeIndex]);
+			}
+
+			ArrayType *nodesInvolvedArray =
+				DatumArrayToArrayType(nodesInvolvedDatumArray, nodesInvolvedCount,
+									  INT4OID);
+			values[Anum_pg_dist_background_task_nodes_involved - 1] =
+				PointerGetDatum(nodesInvolvedArray);
+			nulls[Anum_pg_dist_background_task_nodes_involved - 1] = false;
+		}
+
 		HeapTuple newTuple = heap_form_tuple(RelationGetDescr(pgDistBackgroundTask),
 											 values, nulls);
 		CatalogTupleInsert(pgDistBackgroundTask, newTuple);
@@ -2980,6 +3262,7 @@ ScheduleBackgroundTask(int64 jobId, Oid owner, char *command, int dependingTaskC
 		task->taskid = taskId;
 		task->status = BACKGROUND_TASK_STATUS_RUNNABLE;
 		task->command = pstrdup(command);
+		task->nodesInvolved = nodesInvolvedList;
 	}
 
 	/* 3. insert dependencies into catalog */
@@ -3283,6 +3566,13 @@ DeformBackgroundTaskHeapTuple(TupleDesc tupleDescriptor, HeapTuple taskTuple)
 			TextDatumGetCString(values[Anum_pg_dist_background_task_message - 1]);
 	}
 
+	if (!nulls[Anum_pg_dist_background_task_nodes_involved - 1])
+	{
+		ArrayType *nodesInvolvedArray =
+			DatumGetArrayTypeP(values[Anum_pg_dist_background_task_nodes_involved - 1]);
+		task->nodesInvolved = IntegerArrayTypeToList(nodesInvolvedArray);
+	}
+
 	return task;
 }
 
@@ -3375,15 +3665,16 @@ BackgroundTaskReadyToRun(BackgroundTask *task)
 
 
 /*
- * GetRunnableBackgroundTask returns the first candidate for a task to be run. When a task
- * is returned it has been checked for all the preconditions to hold.
+ * GetRunnableBackgroundTaskList returns the candidates for tasks to be run, in order of
+ * their task id. When tasks are returned they have been checked for all the
+ * preconditions to hold.
  *
  * That means, if there is no task returned the background worker should close and let the
  * maintenance daemon start a new background tasks queue monitor once task become
  * available.
  */
-BackgroundTask *
-GetRunnableBackgroundTask(void)
+List *
+GetRunnableBackgroundTaskList(void)
 {
 	Relation pgDistBackgroundTasks =
 		table_open(DistBackgroundTaskRelationId(), ExclusiveLock);
@@ -3392,8 +3683,8 @@ GetRunnableBackgroundTask(void)
 		BACKGROUND_TASK_STATUS_RUNNABLE
 	};
 
-	BackgroundTask *task = NULL;
-	for (int i = 0; !task && i < sizeof(taskStatus) / sizeof(taskStatus[0]); i++)
+	List *taskList = NIL;
+	for (int i = 0; i < sizeof(taskStatus) / sizeof(taskStatus[0]); i++)
 	{
 		const int scanKeyCount = 1;
 		ScanKeyData scanKey[1] = { 0 };
@@ -3414,13 +3705,12 @@ GetRunnableBackgroundTask(void)
 		TupleDesc tupleDescriptor = RelationGetDescr(pgDistBackgroundTasks);
 		while (HeapTupleIsValid(taskTuple = systable_getnext(scanDescriptor)))
 		{
-			task = DeformBackgroundTaskHeapTuple(tupleDescriptor, taskTuple);
+			BackgroundTask *task = DeformBackgroundTaskHeapTuple(tupleDescriptor,
+																 taskTuple);
 			if (BackgroundTaskReadyToRun(task))
 			{
-				/* found task, close table and return */
-				break;
+				taskList = lappend(taskList, task);
 			}
-			task = NULL;
 		}
 
 		systable_endscan(scanDescriptor);
@@ -3428,7 +3718,7 @@ GetRunnableBackgroundTask(void)
 
 	table_close(pgDistBackgroundTasks, NoLock);
 
-	return task;
+	return taskList;
 }
 
 
@@ -101,8 +101,9 @@ static void InsertNodeRow(int nodeid, char *nodename, int32 nodeport, NodeMetada
 						  *nodeMetadata);
 static void DeleteNodeRow(char *nodename, int32 nodeport);
 static void SyncDistributedObjectsToNodeList(List *workerNodeList);
-static void UpdateLocalGroupIdOnNode(WorkerNode *workerNode);
+static void UpdateLocalGroupIdOnNodeList(List *workerNodeList);
 static void SyncPgDistTableMetadataToNodeList(List *nodeList);
+static List * TableMetadataSyncCommandList(List *bulkSyncNodeList);
 static List * InterTableRelationshipCommandList();
 static void BlockDistributedQueriesOnMetadataNodes(void);
 static WorkerNode * TupleToWorkerNode(TupleDesc tupleDescriptor, HeapTuple heapTuple);
@@ -700,6 +701,23 @@ InterTableRelationshipCommandList()
  */
 List *
 PgDistTableMetadataSyncCommandList(void)
+{
+	List *bulkSyncNodeList = NIL;
+
+	return TableMetadataSyncCommandList(bulkSyncNodeList);
+}
+
+
+/*
+ * TableMetadataSyncCommandList returns the command list to sync the table
+ * metadata. If bulkSyncNodeList is not NIL, the shards and placements of all
+ * tables are broadcast to the nodes in it as intermediate results, and the
+ * returned commands read them from there, which avoids generating and parsing
+ * a large command per table. The commands should then only be sent to those
+ * nodes in the current coordinated transaction.
+ */
+static List *
+TableMetadataSyncCommandList(List *bulkSyncNodeList)
 {
 	List *distributedTableList = CitusTableList();
 	List *propagatedTableList = NIL;
@@ -727,13 +745,37 @@ PgDistTableMetadataSyncCommandList(void)
 										  DELETE_ALL_COLOCATION);
 
 	/* create pg_dist_partition, pg_dist_shard and pg_dist_placement entries */
-	foreach_ptr(cacheEntry, propagatedTableList)
+	if (bulkSyncNodeList != NIL)
 	{
-		List *tableMetadataCreateCommandList =
-			CitusTableMetadataCreateCommandList(cacheEntry->relationId);
+		List *shardIntervalList = NIL;
+
+		/* partitions need to exist before their shards are added */
+		foreach_ptr(cacheEntry, propagatedTableList)
+		{
+			char *metadataCommand = DistributionCreateCommand(cacheEntry);
+			metadataSnapshotCommandList = lappend(metadataSnapshotCommandList,
+												  metadataCommand);
 
+			shardIntervalList = list_concat(shardIntervalList,
+											LoadShardIntervalList(
+												cacheEntry->relationId));
+		}
+
+		List *shardMetadataInsertCommandList =
+			ShardListBulkInsertCommandList(shardIntervalList, bulkSyncNodeList);
 		metadataSnapshotCommandList = list_concat(metadataSnapshotCommandList,
-												  tableMetadataCreateCommandList);
+												  shardMetadataInsertCommandList);
+	}
+	else
+	{
+		foreach_ptr(cacheEntry, propagatedTableList)
+		{
+			List *tableMetadataCreateCommandList =
+				CitusTableMetadataCreateCommandList(cacheEntry->relationId);
+
+			metadataSnapshotCommandList = list_concat(metadataSnapshotCommandList,
+													  tableMetadataCreateCommandList);
+		}
 	}
 
 	/* commands to insert pg_dist_colocation entries */
@@ -887,22 +929,38 @@ SyncDistributedObjectsToNodeList(List *workerNodeList)
 
 
 /*
- * UpdateLocalGroupIdOnNode updates local group id on node.
+ * UpdateLocalGroupIdOnNodeList updates the local group id on the nodes in the
+ * given list, on all of them at once.
  */
 static void
-UpdateLocalGroupIdOnNode(WorkerNode *workerNode)
+UpdateLocalGroupIdOnNodeList(List *workerNodeList)
 {
-	if (NodeIsPrimary(workerNode) && !NodeIsCoordinator(workerNode))
+	List *nodesToUpdate = NIL;
+	List *commandListPerWorker = NIL;
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
 	{
-		List *commandList = list_make1(LocalGroupIdUpdateCommand(workerNode->groupId));
+		if (NodeIsPrimary(workerNode) && !NodeIsCoordinator(workerNode))
+		{
+			List *commandList =
+				list_make1(LocalGroupIdUpdateCommand(workerNode->groupId));
 
-		/* send commands to new workers, the current user should be a superuser */
-		Assert(superuser());
-		SendMetadataCommandListToWorkerListInCoordinatedTransaction(
-			list_make1(workerNode),
-			CurrentUserName(),
-			commandList);
+			nodesToUpdate = lappend(nodesToUpdate, workerNode);
+			commandListPerWorker = lappend(commandListPerWorker, commandList);
+		}
 	}
+
+	if (nodesToUpdate == NIL)
+	{
+		return;
+	}
+
+	/* send commands to new workers, the current user should be a superuser */
+	Assert(superuser());
+	SendMetadataCommandListPerWorkerInCoordinatedTransaction(nodesToUpdate,
+															 CurrentUserName(),
+															 commandListPerWorker);
 }
 
 
@@ -932,7 +990,9 @@ SyncPgDistTableMetadataToNodeList(List *nodeList)
 		return;
 	}
 
-	List *syncPgDistMetadataCommandList = PgDistTableMetadataSyncCommandList();
+	List *bulkSyncNodeList = EnableBulkMetadataSync ? nodesWithMetadata : NIL;
+	List *syncPgDistMetadataCommandList =
+		TableMetadataSyncCommandList(bulkSyncNodeList);
 	SendMetadataCommandListToWorkerListInCoordinatedTransaction(
 		nodesWithMetadata,
 		CurrentUserName(),
@@ -1076,7 +1136,12 @@ NodeIsSecondary(WorkerNode *worker)
 bool
 NodeIsReadable(WorkerNode *workerNode)
 {
-	if (ReadFromSecondaries == USE_SECONDARY_NODES_NEVER &&
+	/*
+	 * With caught_up, secondaries are only read from through
+	 * CaughtUpSecondaryNodeForGroup, the metadata refers to the primaries.
+	 */
+	if ((ReadFromSecondaries == USE_SECONDARY_NODES_NEVER ||
+		 ReadFromSecondaries == USE_SECONDARY_NODES_CAUGHT_UP) &&
 		NodeIsPrimary(workerNode))
 	{
 		return true;
@@ -1207,16 +1272,16 @@ ActivateNodeList(List *nodeList)
 			SetWorkerColumn(workerNode, Anum_pg_dist_node_metadatasynced,
 							BoolGetDatum(true));
 
-			/*
-			 * Update local group id first, as object dependency logic requires to have
-			 * updated local group id.
-			 */
-			UpdateLocalGroupIdOnNode(workerNode);
-
 			nodeToSyncMetadata = lappend(nodeToSyncMetadata, workerNode);
 		}
 	}
 
+	/*
+	 * Update local group id first, as object dependency logic requires to have
+	 * updated local group id.
+	 */
+	UpdateLocalGroupIdOnNodeList(nodeToSyncMetadata);
+
 	/*
 	 * Sync distributed objects first. We must sync distributed objects before
 	 * replicating reference tables to the remote node, as reference tables may
@@ -1229,10 +1294,7 @@ ActivateNodeList(List *nodeList)
 	 * related pg_dist_xxx metadata. Since table related metadata requires
 	 * to have right pg_dist_node entries.
 	 */
-	foreach_ptr(node, nodeToSyncMetadata)
-	{
-		SyncNodeMetadataToNode(node->workerName, node->workerPort);
-	}
+	SyncNodeMetadataToNodeList(nodeToSyncMetadata);
 
 	/*
 	 * As the last step, sync the table related metadata to the remote node.
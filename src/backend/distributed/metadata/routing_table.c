@@ -0,0 +1,293 @@
+/*-------------------------------------------------------------------------
+ *
+ * routing_table.c
+ *
+ * Routines that expose the shard ranges of the colocation groups and the
+ * nodes that they live on, such that drivers and proxies can route queries
+ * on a tenant directly to the node that has its shard, rather than through
+ * the coordinator.
+ *
+ * citus_routing_table() returns the active placements of each shard range of
+ * each colocation group of hash distributed tables, along with the routing
+ * table generation of the node. The generation is a number in shared memory
+ * that increases whenever a transaction that changed the Citus metadata
+ * commits on the node, and such commits also notify the citus_routing_table
+ * channel. Clients can therefore cache the routing table, and either LISTEN
+ * on the channel or poll citus_routing_table_generation() to learn when to
+ * refresh it. The generation starts at the time at which the node started,
+ * in microseconds, such that it keeps increasing across restarts.
+ *
+ * Metadata changes that reach a node through prepared transactions, like
+ * metadata syncs to the workers, do not advance its generation, hence
+ * clients should get the routing table from the coordinator.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "commands/async.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/inval.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_utility.h"
+#include "distributed/routing_table.h"
+#include "distributed/tuplestore.h"
+
+
+#define CITUS_ROUTING_TABLE_COLUMNS 6
+
+
+/*
+ * RoutingTableControlData holds the routing table generation of the node.
+ */
+typedef struct RoutingTableControlData
+{
+	pg_atomic_uint64 generation;
+} RoutingTableControlData;
+
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static RoutingTableControlData *RoutingTableControl = NULL;
+
+/* whether the current transaction changed the Citus metadata */
+static bool RoutingTableChangedInTransaction = false;
+
+static uint64 RoutingTableGeneration(void);
+
+
+PG_FUNCTION_INFO_V1(citus_routing_table);
+PG_FUNCTION_INFO_V1(citus_routing_table_generation);
+
+
+/*
+ * InitializeRoutingTable requests the shared memory for the routing table
+ * generation and sets up its initialization.
+ */
+void
+InitializeRoutingTable(void)
+{
+	/* On PG 15 and above, we use shmem_request_hook_type */
+	#if PG_VERSION_NUM < PG_VERSION_15
+
+	/* allocate shared memory for pre PG-15 versions */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(RoutingTableShmemSize());
+	}
+
+	#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = RoutingTableShmemInit;
+}
+
+
+/*
+ * RoutingTableShmemSize returns the size of the shared memory used for the
+ * routing table generation.
+ */
+size_t
+RoutingTableShmemSize(void)
+{
+	return sizeof(RoutingTableControlData);
+}
+
+
+/*
+ * RoutingTableShmemInit initializes the routing table generation to the
+ * current time in microseconds.
+ */
+void
+RoutingTableShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	RoutingTableControl =
+		(RoutingTableControlData *) ShmemInitStruct("Citus Routing Table",
+													sizeof(RoutingTableControlData),
+													&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		pg_atomic_init_u64(&RoutingTableControl->generation,
+						   (uint64) GetCurrentTimestamp());
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * InvalidateRoutingTableOnCommit records that the current transaction changed
+ * the Citus metadata, such that committing it advances the routing table
+ * generation and notifies the clients that listen on the routing table.
+ */
+void
+InvalidateRoutingTableOnCommit(void)
+{
+	RoutingTableChangedInTransaction = true;
+}
+
+
+/*
+ * NotifyRoutingTableChange queues a notification on the citus_routing_table
+ * channel if the committing transaction changed the metadata. Postgres sends
+ * the notification once the transaction committed.
+ */
+void
+NotifyRoutingTableChange(void)
+{
+	if (RoutingTableChangedInTransaction)
+	{
+		Async_Notify(ROUTING_TABLE_NOTIFY_CHANNEL, NULL);
+	}
+}
+
+
+/*
+ * RoutingTableAtCommit advances the routing table generation if the committed
+ * transaction changed the metadata. This happens after the changes became
+ * visible, such that a routing table read after the new generation includes
+ * them.
+ */
+void
+RoutingTableAtCommit(void)
+{
+	if (RoutingTableChangedInTransaction && RoutingTableControl != NULL)
+	{
+		pg_atomic_fetch_add_u64(&RoutingTableControl->generation, 1);
+	}
+
+	RoutingTableChangedInTransaction = false;
+}
+
+
+/*
+ * RoutingTableAtAbort forgets the metadata changes of a transaction that
+ * aborted or was prepared.
+ */
+void
+RoutingTableAtAbort(void)
+{
+	RoutingTableChangedInTransaction = false;
+}
+
+
+/*
+ * RoutingTableGeneration returns the current routing table generation of the
+ * node.
+ */
+static uint64
+RoutingTableGeneration(void)
+{
+	if (RoutingTableControl == NULL)
+	{
+		return 0;
+	}
+
+	return pg_atomic_read_u64(&RoutingTableControl->generation);
+}
+
+
+/*
+ * citus_routing_table returns the node of each active placement of each shard
+ * range of the colocation groups of hash distributed tables, along with the
+ * routing table generation. The ranges are in terms of the hashes of the
+ * distribution column values, see worker_hash().
+ */
+Datum
+citus_routing_table(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	/*
+	 * Read the metadata after the generation, such that the metadata includes
+	 * at least the changes of the transactions that advanced the generation.
+	 */
+	uint64 generation = RoutingTableGeneration();
+
+	AcceptInvalidationMessages();
+	InvalidateCatalogSnapshot();
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	List *colocationIdList = NIL;
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, CitusTableTypeIdList(HASH_DISTRIBUTED))
+	{
+		CitusTableCacheEntry *cacheEntry = LookupCitusTableCacheEntry(relationId);
+		if (cacheEntry == NULL ||
+			list_member_int(colocationIdList, cacheEntry->colocationId))
+		{
+			/* the table was dropped, or we did its colocation group already */
+			continue;
+		}
+
+		colocationIdList = lappend_int(colocationIdList, cacheEntry->colocationId);
+
+		for (int shardIndex = 0; shardIndex < cacheEntry->shardIntervalArrayLength;
+			 shardIndex++)
+		{
+			ShardInterval *shardInterval = GetCachedShardInterval(cacheEntry,
+																  shardIndex);
+
+			ShardPlacement *placement = NULL;
+			foreach_ptr(placement, ActiveShardPlacementList(shardInterval->shardId))
+			{
+				Datum values[CITUS_ROUTING_TABLE_COLUMNS];
+				bool isNulls[CITUS_ROUTING_TABLE_COLUMNS];
+
+				memset(values, 0, sizeof(values));
+				memset(isNulls, false, sizeof(isNulls));
+
+				values[0] = Int64GetDatum((int64) generation);
+				values[1] = UInt32GetDatum(cacheEntry->colocationId);
+				values[2] = shardInterval->minValue;
+				values[3] = shardInterval->maxValue;
+				values[4] = CStringGetTextDatum(placement->nodeName);
+				values[5] = Int32GetDatum(placement->nodePort);
+
+				tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+			}
+		}
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_routing_table_generation returns the routing table generation of the
+ * node, which clients can poll to learn whether their copy of
+ * citus_routing_table() is stale.
+ */
+Datum
+citus_routing_table_generation(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	PG_RETURN_INT64((int64) RoutingTableGeneration());
+}
@@ -0,0 +1,482 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_size_cache.c
+ *
+ * Routines for keeping a shared memory cache of the sizes of the shard
+ * placements of Citus tables. Computing shard sizes requires calling the
+ * size functions for every shard on every node, which is slow and causes
+ * I/O on clusters with many shards. When enabled, the maintenance daemon
+ * periodically collects the sizes, such that citus_shard_sizes(), the
+ * citus_shards view and the by_disk_size rebalance strategy can use them
+ * without contacting the nodes. Setting citus.use_cached_shard_sizes to
+ * off always fetches fresh sizes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "libpq-fe.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "access/hash.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/timestamp.h"
+
+#include "distributed/citus_safe_lib.h"
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_utility.h"
+#include "distributed/multi_partitioning_utils.h"
+#include "distributed/relay_utility.h"
+#include "distributed/remote_commands.h"
+#include "distributed/shard_size_cache.h"
+#include "distributed/worker_manager.h"
+
+
+/* maximum number of shard placements, over all databases, whose size is cached */
+#define MAX_CACHED_SHARD_SIZES 65536
+
+
+/*
+ * ShardSizeCacheKey identifies a shard placement across all databases.
+ */
+typedef struct ShardSizeCacheKey
+{
+	Oid databaseId;
+	uint64 shardId;
+	int32 groupId;
+} ShardSizeCacheKey;
+
+
+/*
+ * ShardSizeCacheEntry is the shared memory hash entry holding the size of a
+ * shard placement. The relation size is the size of the heap, as returned by
+ * citus_shard_sizes(). The total size includes indexes and toast, and for
+ * partitioned shards the partitions, as used by the by_disk_size rebalance
+ * strategy.
+ */
+typedef struct ShardSizeCacheEntry
+{
+	ShardSizeCacheKey key;
+	uint64 relationSize;
+	uint64 totalSize;
+	TimestampTz collectedAt;
+} ShardSizeCacheEntry;
+
+
+/*
+ * ShardSizeCacheControlData holds the lock protecting the shard size hash.
+ */
+typedef struct ShardSizeCacheControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+} ShardSizeCacheControlData;
+
+
+/* GUC, interval in milliseconds between shard size refreshes, 0 to disable */
+int ShardSizeRefreshInterval = 0;
+
+/* GUC, whether shard sizes are read from the cache when possible */
+bool UseCachedShardSizes = true;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static ShardSizeCacheControlData *ShardSizeCacheControl = NULL;
+static HTAB *ShardSizeCacheHash = NULL;
+
+static bool ShardSizeCacheUsable(void);
+static char * NodeShardSizeQuery(WorkerNode *workerNode, List *citusTableIds);
+static bool ReadNodeShardSizes(WorkerNode *workerNode, char *query,
+							   List **shardSizeList);
+static void StoreShardSizes(List *shardSizeList);
+
+
+/*
+ * InitializeShardSizeCache requests the shared memory for the shard size
+ * cache and sets the hook that initializes it.
+ */
+void
+InitializeShardSizeCache(void)
+{
+	/* On PG 15 and above, we use shmem_request_hook_type */
+	#if PG_VERSION_NUM < PG_VERSION_15
+
+	/* allocate shared memory for pre PG-15 versions */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(ShardSizeCacheShmemSize());
+	}
+
+	#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ShardSizeCacheShmemInit;
+}
+
+
+/*
+ * ShardSizeCacheShmemSize returns the size of the shared memory used for the
+ * shard size cache.
+ */
+size_t
+ShardSizeCacheShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(ShardSizeCacheControlData));
+	size = add_size(size, hash_estimate_size(MAX_CACHED_SHARD_SIZES,
+											 sizeof(ShardSizeCacheEntry)));
+
+	return size;
+}
+
+
+/*
+ * ShardSizeCacheShmemInit initializes the shared memory used for the shard
+ * size cache.
+ */
+void
+ShardSizeCacheShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL hashInfo;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ShardSizeCacheControl =
+		(ShardSizeCacheControlData *) ShmemInitStruct("Citus Shard Size Cache",
+													  sizeof(ShardSizeCacheControlData),
+													  &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		ShardSizeCacheControl->trancheId = LWLockNewTrancheId();
+		ShardSizeCacheControl->lockTrancheName = "Citus Shard Size Cache";
+		LWLockRegisterTranche(ShardSizeCacheControl->trancheId,
+							  ShardSizeCacheControl->lockTrancheName);
+
+		LWLockInitialize(&ShardSizeCacheControl->lock,
+						 ShardSizeCacheControl->trancheId);
+	}
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = sizeof(ShardSizeCacheKey);
+	hashInfo.entrysize = sizeof(ShardSizeCacheEntry);
+	hashInfo.hash = tag_hash;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	ShardSizeCacheHash = ShmemInitHash("Citus Shard Size Cache Hash",
+									   MAX_CACHED_SHARD_SIZES,
+									   MAX_CACHED_SHARD_SIZES,
+									   &hashInfo, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * ShardSizeCacheUsable returns whether readers may use the cached shard
+ * sizes, which requires that the maintenance daemon refreshes them.
+ */
+static bool
+ShardSizeCacheUsable(void)
+{
+	return UseCachedShardSizes && ShardSizeRefreshInterval > 0 &&
+		   ShardSizeCacheHash != NULL;
+}
+
+
+/*
+ * CachedShardPlacementSize sets relationSize and totalSize to the cached sizes
+ * of the placement of the given shard in the given group and returns true. If
+ * the cache cannot be used, or the size of the placement was not collected
+ * during the last two refresh intervals, the function returns false.
+ */
+bool
+CachedShardPlacementSize(uint64 shardId, int32 groupId, uint64 *relationSize,
+						 uint64 *totalSize)
+{
+	ShardSizeCacheKey key;
+	bool found = false;
+
+	if (!ShardSizeCacheUsable())
+	{
+		return false;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.databaseId = MyDatabaseId;
+	key.shardId = shardId;
+	key.groupId = groupId;
+
+	LWLockAcquire(&ShardSizeCacheControl->lock, LW_SHARED);
+
+	ShardSizeCacheEntry *entry =
+		(ShardSizeCacheEntry *) hash_search(ShardSizeCacheHash, &key, HASH_FIND,
+											&found);
+	if (found)
+	{
+		*relationSize = entry->relationSize;
+		*totalSize = entry->totalSize;
+
+		/* do not use sizes that the maintenance daemon failed to refresh */
+		found = !TimestampDifferenceExceeds(entry->collectedAt, GetCurrentTimestamp(),
+											2 * ShardSizeRefreshInterval);
+	}
+
+	LWLockRelease(&ShardSizeCacheControl->lock);
+
+	return found;
+}
+
+
+/*
+ * CachedShardListSize sets totalSize to the sum of the cached total sizes of
+ * the placements of the given shards in the given group and returns true.
+ * Partitions are skipped, since their sizes are included in the sizes of
+ * their partitioned shards. If the size of any of the placements is not
+ * cached, the function returns false.
+ */
+bool
+CachedShardListSize(List *shardIntervalList, int32 groupId, uint64 *totalSize)
+{
+	uint64 sizeSum = 0;
+
+	if (!ShardSizeCacheUsable())
+	{
+		return false;
+	}
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		uint64 relationSize = 0;
+		uint64 shardTotalSize = 0;
+
+		if (PartitionTable(shardInterval->relationId))
+		{
+			continue;
+		}
+
+		if (!CachedShardPlacementSize(shardInterval->shardId, groupId, &relationSize,
+									  &shardTotalSize))
+		{
+			return false;
+		}
+
+		sizeSum += shardTotalSize;
+	}
+
+	*totalSize = sizeSum;
+
+	return true;
+}
+
+
+/*
+ * UpdateShardSizeCache collects the sizes of the shard placements of the
+ * Citus tables in the current database from the nodes, and replaces the
+ * cached sizes of the database with them. If any node cannot be reached, the
+ * previous sizes are kept.
+ */
+void
+UpdateShardSizeCache(void)
+{
+	List *citusTableIds = AllCitusTableIds();
+	List *workerNodeList = ActivePrimaryNodeList(NoLock);
+	List *shardSizeList = NIL;
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		char *query = NodeShardSizeQuery(workerNode, citusTableIds);
+		if (query == NULL)
+		{
+			/* no shards on this node */
+			continue;
+		}
+
+		if (!ReadNodeShardSizes(workerNode, query, &shardSizeList))
+		{
+			ereport(WARNING, (errmsg("could not collect shard sizes from %s:%d",
+									 workerNode->workerName,
+									 workerNode->workerPort)));
+			return;
+		}
+	}
+
+	StoreShardSizes(shardSizeList);
+}
+
+
+/*
+ * NodeShardSizeQuery returns a query that returns the shard id, the relation
+ * size and the total size of the shard placements of the given tables on the
+ * given node, or NULL if the node has no shard placements.
+ */
+static char *
+NodeShardSizeQuery(WorkerNode *workerNode, List *citusTableIds)
+{
+	StringInfo shardValues = makeStringInfo();
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, citusTableIds)
+	{
+		char *relationName = get_rel_name(relationId);
+		if (relationName == NULL)
+		{
+			/* table was dropped concurrently */
+			continue;
+		}
+
+		char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+		bool partitionedTable = PartitionedTable(relationId);
+
+		List *shardIntervalList = ShardIntervalsOnWorkerGroup(workerNode, relationId);
+		ShardInterval *shardInterval = NULL;
+		foreach_ptr(shardInterval, shardIntervalList)
+		{
+			uint64 shardId = shardInterval->shardId;
+			char *shardName = pstrdup(relationName);
+			AppendShardIdToName(&shardName, shardId);
+
+			appendStringInfo(shardValues, "%s(" UINT64_FORMAT ", %s, %s)",
+							 shardValues->len > 0 ? ", " : "",
+							 shardId,
+							 quote_literal_cstr(quote_qualified_identifier(schemaName,
+																		   shardName)),
+							 partitionedTable ? "true" : "false");
+		}
+	}
+
+	if (shardValues->len == 0)
+	{
+		return NULL;
+	}
+
+	StringInfo query = makeStringInfo();
+	appendStringInfo(query,
+					 "SELECT shard_id, pg_relation_size(relid), "
+					 "CASE WHEN partitioned "
+					 "THEN worker_partitioned_relation_total_size(relid) "
+					 "ELSE pg_total_relation_size(relid) END "
+					 "FROM (SELECT shard_id, to_regclass(shard_name) AS relid, "
+					 "partitioned FROM (VALUES %s) "
+					 "AS v(shard_id, shard_name, partitioned)) s "
+					 "WHERE relid IS NOT NULL",
+					 shardValues->data);
+
+	return query->data;
+}
+
+
+/*
+ * ReadNodeShardSizes runs the shard size query on the given node and appends
+ * a ShardSizeCacheEntry for each returned placement to shardSizeList. The
+ * function returns false if the query failed.
+ */
+static bool
+ReadNodeShardSizes(WorkerNode *workerNode, char *query, List **shardSizeList)
+{
+	int connectionFlags = 0;
+	bool raiseErrors = false;
+	PGresult *result = NULL;
+
+	MultiConnection *connection = GetNodeConnection(connectionFlags,
+													workerNode->workerName,
+													workerNode->workerPort);
+
+	if (ExecuteOptionalRemoteCommand(connection, query, &result) != 0)
+	{
+		return false;
+	}
+
+	int rowCount = PQntuples(result);
+	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		ShardSizeCacheEntry *shardSize = palloc0(sizeof(ShardSizeCacheEntry));
+
+		shardSize->key.databaseId = MyDatabaseId;
+		shardSize->key.shardId = SafeStringToUint64(PQgetvalue(result, rowIndex, 0));
+		shardSize->key.groupId = workerNode->groupId;
+		shardSize->relationSize = SafeStringToUint64(PQgetvalue(result, rowIndex, 1));
+		shardSize->totalSize = SafeStringToUint64(PQgetvalue(result, rowIndex, 2));
+
+		*shardSizeList = lappend(*shardSizeList, shardSize);
+	}
+
+	PQclear(result);
+	ClearResults(connection, raiseErrors);
+
+	return true;
+}
+
+
+/*
+ * StoreShardSizes replaces the cached shard sizes of the current database in
+ * shared memory with the sizes in shardSizeList.
+ */
+static void
+StoreShardSizes(List *shardSizeList)
+{
+	HASH_SEQ_STATUS status;
+	TimestampTz collectedAt = GetCurrentTimestamp();
+
+	if (ShardSizeCacheHash == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&ShardSizeCacheControl->lock, LW_EXCLUSIVE);
+
+	/* remove the old sizes, including those of dropped shards and placements */
+	ShardSizeCacheEntry *entry = NULL;
+	hash_seq_init(&status, ShardSizeCacheHash);
+	while ((entry = (ShardSizeCacheEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (entry->key.databaseId == MyDatabaseId)
+		{
+			hash_search(ShardSizeCacheHash, &entry->key, HASH_REMOVE, NULL);
+		}
+	}
+
+	ShardSizeCacheEntry *shardSize = NULL;
+	foreach_ptr(shardSize, shardSizeList)
+	{
+		bool found = false;
+
+		if (hash_get_num_entries(ShardSizeCacheHash) >= MAX_CACHED_SHARD_SIZES)
+		{
+			/* readers fetch the sizes of the remaining placements themselves */
+			break;
+		}
+
+		entry = (ShardSizeCacheEntry *) hash_search(ShardSizeCacheHash,
+													&shardSize->key,
+													HASH_ENTER_NULL, &found);
+		if (entry != NULL)
+		{
+			entry->relationSize = shardSize->relationSize;
+			entry->totalSize = shardSize->totalSize;
+			entry->collectedAt = collectedAt;
+		}
+	}
+
+	LWLockRelease(&ShardSizeCacheControl->lock);
+}
@@ -0,0 +1,1100 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_metadata_cache.c
+ *
+ * Routines for keeping the shards and shard placements of Citus tables, as
+ * read from pg_dist_shard and pg_dist_placement, in dynamic shared memory.
+ * When a backend builds the metadata cache entry of a Citus table, it first
+ * looks there, and only scans the catalogs if no other backend did so since
+ * the metadata last changed.
+ *
+ * Entries are tagged with the version of the cache at the time the catalogs
+ * were read, and are only used while that version is current. Transactions
+ * that change pg_dist_shard or pg_dist_placement, which always happens via
+ * CitusInvalidateRelcacheByRelid() or CitusInvalidateRelcacheByShardId(), do
+ * not use the shared cache, and increment the version when they commit.
+ * Prepared transactions are tracked until they are finished, and COMMIT
+ * PREPARED increments the version for transactions that changed metadata, or
+ * that were prepared before the server started.
+ *
+ * Committed changes are also appended to a shared log of invalidations, which
+ * records the shards whose placements changed. When a backend rebuilds the
+ * metadata cache entry of a table after an invalidation, it can use the log
+ * to re-read only the placements of those shards, provided that the log
+ * still contains all changes since the previous entry was built.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "access/htup_details.h"
+#include "access/twophase.h"
+#include "access/xact.h"
+#include "access/xlog.h"
+#include "lib/dshash.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/dsa.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+
+#include "distributed/citus_nodes.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_utility.h"
+#include "distributed/pg_dist_shard.h"
+#include "distributed/relay_utility.h"
+#include "distributed/shared_metadata_cache.h"
+
+
+/* number of records in the shared log of committed metadata changes */
+#define SHARD_INVALIDATION_LOG_SIZE 4096
+
+/* maximum number of records a single transaction appends to the log */
+#define MAX_PENDING_SHARD_INVALIDATIONS 256
+
+
+/*
+ * SharedMetadataCacheKey identifies the shards of a table across databases.
+ * The pg_dist_shard relation is part of the key, such that entries are not
+ * used after the extension is recreated.
+ */
+typedef struct SharedMetadataCacheKey
+{
+	Oid databaseId;
+	Oid relationId;
+	Oid distShardRelationId;
+} SharedMetadataCacheKey;
+
+
+/*
+ * SharedMetadataCacheEntry is the entry of the shared hash, pointing to the
+ * serialized shards and placements of a table.
+ */
+typedef struct SharedMetadataCacheEntry
+{
+	SharedMetadataCacheKey key;
+
+	/* version of the cache at the time the catalogs were read */
+	uint64 version;
+
+	dsa_pointer data;
+	Size dataSize;
+} SharedMetadataCacheEntry;
+
+
+/*
+ * SerializedShardHeader precedes the pg_dist_shard tuple and the placements
+ * of a shard in the serialized representation.
+ */
+typedef struct SerializedShardHeader
+{
+	uint32 tupleLength;
+	int placementCount;
+} SerializedShardHeader;
+
+
+/*
+ * SerializedPlacement is a GroupShardPlacement without the node header and
+ * the shard ID, which is part of the shard tuple.
+ */
+typedef struct SerializedPlacement
+{
+	uint64 placementId;
+	uint64 shardLength;
+	int32 shardState;
+	int32 groupId;
+} SerializedPlacement;
+
+
+/*
+ * ShardInvalidationRecord is an entry in the log of committed metadata
+ * changes. An invalid shard ID stands for a change to any shard of the
+ * relation, and an invalid relation for a change to any relation.
+ */
+typedef struct ShardInvalidationRecord
+{
+	uint64 sequence;
+	Oid databaseId;
+	Oid relationId;
+	uint64 shardId;
+} ShardInvalidationRecord;
+
+
+/*
+ * PreparedTransactionSlot tracks a transaction prepared since the server
+ * started.
+ */
+typedef struct PreparedTransactionSlot
+{
+	bool inUse;
+	bool changedMetadata;
+	char gid[GIDSIZE];
+} PreparedTransactionSlot;
+
+
+/*
+ * SharedMetadataCacheControlData holds the handles to the shared hash and
+ * the state used to decide whether its entries are current.
+ */
+typedef struct SharedMetadataCacheControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+
+	/* protects the creation of the area and the prepared transactions */
+	LWLock lock;
+
+	bool areaCreated;
+	dsa_handle areaHandle;
+	dshash_table_handle hashHandle;
+
+	/* incremented whenever a change to pg_dist_shard or pg_dist_placement commits */
+	pg_atomic_uint64 version;
+
+	/* number of bytes of serialized metadata, bounded by SharedMetadataCacheSize */
+	pg_atomic_uint64 usedBytes;
+
+	/* sequence number of the next record in the invalidation log */
+	uint64 nextInvalidationSequence;
+	ShardInvalidationRecord invalidationLog[SHARD_INVALIDATION_LOG_SIZE];
+
+	int preparedTransactionSlotCount;
+	PreparedTransactionSlot preparedTransactions[FLEXIBLE_ARRAY_MEMBER];
+} SharedMetadataCacheControlData;
+
+
+/* GUC, size of the shared metadata cache in kB, 0 to disable */
+int SharedMetadataCacheSize = 0;
+
+/* GUC, whether placement changes only invalidate the placements of the shard */
+bool EnableShardLevelInvalidation = false;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static SharedMetadataCacheControlData *SharedMetadataCacheControl = NULL;
+static dsa_area *SharedMetadataCacheArea = NULL;
+static dshash_table *SharedMetadataCacheHash = NULL;
+
+/* whether the current transaction changed pg_dist_shard or pg_dist_placement */
+static bool MetadataChangedInTransaction = false;
+
+/*
+ * Changes of the current transaction to append to the invalidation log on
+ * commit, unless there are too many of them, in which case a single record
+ * that stands for all relations is appended.
+ */
+static List *PendingShardInvalidations = NIL;
+static bool PendingShardInvalidationsOverflowed = false;
+
+/* GID of the PREPARE TRANSACTION command of the current transaction, if any */
+static char PreparingTransactionGid[GIDSIZE] = "";
+
+static void AttachSharedMetadataCache(void);
+static dshash_parameters SharedMetadataCacheHashParameters(void);
+static void InitSharedMetadataCacheKey(SharedMetadataCacheKey *key, Oid relationId);
+static bool ReserveSharedMetadataBytes(Size size);
+static void FreeSharedMetadata(dsa_pointer data, Size dataSize);
+#if PG_VERSION_NUM >= PG_VERSION_14
+static void RemoveStaleSharedMetadataEntries(uint64 version);
+#endif
+static Size SerializedShardMetadataSize(List *shardMetadataList);
+static void SerializeShardMetadata(List *shardMetadataList, char *buffer);
+static List * DeserializeShardMetadata(char *buffer, Oid distShardRelationId);
+static void IncrementSharedMetadataCacheVersion(void);
+static void AppendShardInvalidation(Oid databaseId, Oid relationId, uint64 shardId);
+static void AppendPendingShardInvalidations(void);
+static void ResetPendingShardInvalidations(void);
+
+
+/*
+ * InitializeSharedMetadataCache requests the shared memory for the shared
+ * metadata cache and sets the hook that initializes it.
+ */
+void
+InitializeSharedMetadataCache(void)
+{
+	/* On PG 15 and above, we use shmem_request_hook_type */
+	#if PG_VERSION_NUM < PG_VERSION_15
+
+	/* allocate shared memory for pre PG-15 versions */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(SharedMetadataCacheShmemSize());
+	}
+
+	#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = SharedMetadataCacheShmemInit;
+}
+
+
+/*
+ * SharedMetadataCacheShmemSize returns the size of the shared memory used to
+ * find the shared metadata cache and to hold the invalidation log. The cached
+ * metadata itself lives in dynamic shared memory.
+ */
+size_t
+SharedMetadataCacheShmemSize(void)
+{
+	Size size = 0;
+
+	if (SharedMetadataCacheSize == 0 && !EnableShardLevelInvalidation)
+	{
+		return 0;
+	}
+
+	size = add_size(size, offsetof(SharedMetadataCacheControlData,
+								   preparedTransactions));
+	size = add_size(size, mul_size(max_prepared_xacts,
+								   sizeof(PreparedTransactionSlot)));
+
+	return size;
+}
+
+
+/*
+ * SharedMetadataCacheShmemInit initializes the shared memory used to find
+ * the shared metadata cache.
+ */
+void
+SharedMetadataCacheShmemInit(void)
+{
+	if (SharedMetadataCacheSize > 0 || EnableShardLevelInvalidation)
+	{
+		bool alreadyInitialized = false;
+
+		LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+		SharedMetadataCacheControl =
+			(SharedMetadataCacheControlData *) ShmemInitStruct(
+				"Citus Shared Metadata Cache",
+				SharedMetadataCacheShmemSize(),
+				&alreadyInitialized);
+
+		if (!alreadyInitialized)
+		{
+			SharedMetadataCacheControl->trancheId = LWLockNewTrancheId();
+			SharedMetadataCacheControl->lockTrancheName = "Citus Shared Metadata Cache";
+			LWLockRegisterTranche(SharedMetadataCacheControl->trancheId,
+								  SharedMetadataCacheControl->lockTrancheName);
+
+			LWLockInitialize(&SharedMetadataCacheControl->lock,
+							 SharedMetadataCacheControl->trancheId);
+
+			SharedMetadataCacheControl->areaCreated = false;
+			pg_atomic_init_u64(&SharedMetadataCacheControl->version, 1);
+			pg_atomic_init_u64(&SharedMetadataCacheControl->usedBytes, 0);
+
+			SharedMetadataCacheControl->nextInvalidationSequence = 1;
+			memset(SharedMetadataCacheControl->invalidationLog, 0,
+				   sizeof(SharedMetadataCacheControl->invalidationLog));
+
+			SharedMetadataCacheControl->preparedTransactionSlotCount =
+				max_prepared_xacts;
+			memset(SharedMetadataCacheControl->preparedTransactions, 0,
+				   max_prepared_xacts * sizeof(PreparedTransactionSlot));
+		}
+
+		LWLockRelease(AddinShmemInitLock);
+	}
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * SharedMetadataCacheBeginRead returns whether the shared metadata cache can
+ * be used by the current transaction, and if so sets version to the current
+ * version of the cache. The catalog snapshot is refreshed after reading the
+ * version, such that metadata read from the catalogs afterwards is at least
+ * as new as the version.
+ */
+bool
+SharedMetadataCacheBeginRead(uint64 *version)
+{
+	if (SharedMetadataCacheControl == NULL || SharedMetadataCacheSize == 0)
+	{
+		return false;
+	}
+
+	/* changes of the current transaction are not visible to other backends */
+	if (MetadataChangedInTransaction)
+	{
+		return false;
+	}
+
+	/* changes replayed on a standby do not increment the version */
+	if (RecoveryInProgress())
+	{
+		return false;
+	}
+
+	AttachSharedMetadataCache();
+
+	*version = pg_atomic_read_u64(&SharedMetadataCacheControl->version);
+	pg_read_barrier();
+
+	InvalidateCatalogSnapshot();
+
+	return true;
+}
+
+
+/*
+ * SharedMetadataCacheLookup sets shardMetadataList to the shards and
+ * placements of the given table, if they were stored in the shared cache at
+ * the given version, and returns whether it did so.
+ */
+bool
+SharedMetadataCacheLookup(Oid relationId, uint64 version, List **shardMetadataList)
+{
+	SharedMetadataCacheKey key;
+
+	InitSharedMetadataCacheKey(&key, relationId);
+
+	SharedMetadataCacheEntry *entry =
+		(SharedMetadataCacheEntry *) dshash_find(SharedMetadataCacheHash, &key, false);
+	if (entry == NULL)
+	{
+		return false;
+	}
+
+	if (entry->version != version)
+	{
+		dshash_release_lock(SharedMetadataCacheHash, entry);
+		return false;
+	}
+
+	/* copy the data, such that we do not hold the lock while deserializing */
+	Size dataSize = entry->dataSize;
+	char *buffer = palloc_extended(dataSize, MCXT_ALLOC_NO_OOM);
+	if (buffer == NULL)
+	{
+		dshash_release_lock(SharedMetadataCacheHash, entry);
+		return false;
+	}
+
+	memcpy_s(buffer, dataSize,
+			 dsa_get_address(SharedMetadataCacheArea, entry->data), dataSize);
+
+	dshash_release_lock(SharedMetadataCacheHash, entry);
+
+	*shardMetadataList = DeserializeShardMetadata(buffer, key.distShardRelationId);
+
+	pfree(buffer);
+
+	return true;
+}
+
+
+/*
+ * SharedMetadataCacheStore stores the shards and placements of the given
+ * table, as read from the catalogs after SharedMetadataCacheBeginRead()
+ * returned the given version. Nothing is stored if the metadata changed in
+ * the meantime, or if the cache is full.
+ */
+void
+SharedMetadataCacheStore(Oid relationId, uint64 version, List *shardMetadataList)
+{
+	SharedMetadataCacheKey key;
+	bool found = false;
+
+	if (pg_atomic_read_u64(&SharedMetadataCacheControl->version) != version)
+	{
+		return;
+	}
+
+	Size dataSize = SerializedShardMetadataSize(shardMetadataList);
+	if (!ReserveSharedMetadataBytes(dataSize))
+	{
+#if PG_VERSION_NUM >= PG_VERSION_14
+
+		/* make room by removing entries that can no longer be used */
+		RemoveStaleSharedMetadataEntries(version);
+
+		if (!ReserveSharedMetadataBytes(dataSize))
+		{
+			return;
+		}
+#else
+		return;
+#endif
+	}
+
+	InitSharedMetadataCacheKey(&key, relationId);
+
+	SharedMetadataCacheEntry *entry =
+		(SharedMetadataCacheEntry *) dshash_find_or_insert(SharedMetadataCacheHash,
+														   &key, &found);
+	if (!found)
+	{
+		entry->version = 0;
+		entry->data = InvalidDsaPointer;
+		entry->dataSize = 0;
+	}
+	else if (entry->version >= version)
+	{
+		/* another backend stored the same or newer metadata concurrently */
+		dshash_release_lock(SharedMetadataCacheHash, entry);
+		pg_atomic_sub_fetch_u64(&SharedMetadataCacheControl->usedBytes, dataSize);
+		return;
+	}
+
+	dsa_pointer data = dsa_allocate_extended(SharedMetadataCacheArea, dataSize,
+											 DSA_ALLOC_NO_OOM);
+	if (!DsaPointerIsValid(data))
+	{
+		if (found)
+		{
+			dshash_release_lock(SharedMetadataCacheHash, entry);
+		}
+		else
+		{
+			dshash_delete_entry(SharedMetadataCacheHash, entry);
+		}
+
+		pg_atomic_sub_fetch_u64(&SharedMetadataCacheControl->usedBytes, dataSize);
+		return;
+	}
+
+	SerializeShardMetadata(shardMetadataList,
+						   dsa_get_address(SharedMetadataCacheArea, data));
+
+	if (DsaPointerIsValid(entry->data))
+	{
+		FreeSharedMetadata(entry->data, entry->dataSize);
+	}
+
+	entry->version = version;
+	entry->data = data;
+	entry->dataSize = dataSize;
+
+	dshash_release_lock(SharedMetadataCacheHash, entry);
+}
+
+
+/*
+ * InvalidateSharedMetadataCacheOnCommit records that the current transaction
+ * changed pg_dist_shard or pg_dist_placement, such that it does not use the
+ * shared metadata cache anymore, and increments its version on commit.
+ *
+ * The change is also appended to the invalidation log on commit. shardId is
+ * the shard whose placements changed, or INVALID_SHARD_ID if any shard of the
+ * relation may have changed. Changes to unknown relations are not logged,
+ * since they cannot affect any cache entry.
+ */
+void
+InvalidateSharedMetadataCacheOnCommit(Oid relationId, uint64 shardId)
+{
+	MetadataChangedInTransaction = true;
+
+	if (!EnableShardLevelInvalidation || !OidIsValid(relationId) ||
+		PendingShardInvalidationsOverflowed)
+	{
+		return;
+	}
+
+	if (list_length(PendingShardInvalidations) >= MAX_PENDING_SHARD_INVALIDATIONS)
+	{
+		ResetPendingShardInvalidations();
+		PendingShardInvalidationsOverflowed = true;
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	ShardInvalidationRecord *record = palloc0(sizeof(ShardInvalidationRecord));
+	record->databaseId = MyDatabaseId;
+	record->relationId = relationId;
+	record->shardId = shardId;
+
+	PendingShardInvalidations = lappend(PendingShardInvalidations, record);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ShardInvalidationLogPosition returns the sequence number of the next record
+ * in the invalidation log, to pass to ShardsChangedSinceLogPosition() later.
+ * The catalog snapshot is refreshed after reading the position, such that
+ * metadata read from the catalogs afterwards includes all logged changes.
+ *
+ * If the current transaction changed the metadata, 0 is returned, since
+ * metadata read by the transaction includes changes that are not logged
+ * (yet).
+ */
+uint64
+ShardInvalidationLogPosition(void)
+{
+	if (SharedMetadataCacheControl == NULL || !EnableShardLevelInvalidation ||
+		MetadataChangedInTransaction)
+	{
+		return 0;
+	}
+
+	LWLockAcquire(&SharedMetadataCacheControl->lock, LW_SHARED);
+	uint64 position = SharedMetadataCacheControl->nextInvalidationSequence;
+	LWLockRelease(&SharedMetadataCacheControl->lock);
+
+	InvalidateCatalogSnapshot();
+
+	return position;
+}
+
+
+/*
+ * ShardsChangedSinceLogPosition returns whether all changes to the shards of
+ * the given relation since the given log position were changes to the
+ * placements of specific shards, and if so sets shardIdList to the IDs of
+ * those shards. Otherwise, for instance when the log no longer goes back to
+ * the given position, false is returned.
+ */
+bool
+ShardsChangedSinceLogPosition(Oid relationId, uint64 position, List **shardIdList)
+{
+	bool onlyPlacementsChanged = true;
+
+	*shardIdList = NIL;
+
+	if (position == 0 || SharedMetadataCacheControl == NULL ||
+		!EnableShardLevelInvalidation || MetadataChangedInTransaction)
+	{
+		return false;
+	}
+
+	LWLockAcquire(&SharedMetadataCacheControl->lock, LW_SHARED);
+
+	uint64 nextSequence = SharedMetadataCacheControl->nextInvalidationSequence;
+	if (nextSequence - position > SHARD_INVALIDATION_LOG_SIZE)
+	{
+		/* records since the position were overwritten */
+		onlyPlacementsChanged = false;
+	}
+
+	for (uint64 sequence = position;
+		 onlyPlacementsChanged && sequence < nextSequence;
+		 sequence++)
+	{
+		ShardInvalidationRecord *record =
+			&SharedMetadataCacheControl->invalidationLog[sequence %
+														 SHARD_INVALIDATION_LOG_SIZE];
+
+		if (OidIsValid(record->databaseId) && record->databaseId != MyDatabaseId)
+		{
+			continue;
+		}
+
+		if (!OidIsValid(record->relationId))
+		{
+			onlyPlacementsChanged = false;
+		}
+		else if (record->relationId != relationId)
+		{
+			continue;
+		}
+		else if (record->shardId == INVALID_SHARD_ID)
+		{
+			onlyPlacementsChanged = false;
+		}
+		else
+		{
+			uint64 *shardIdPointer = (uint64 *) palloc0(sizeof(uint64));
+			*shardIdPointer = record->shardId;
+
+			*shardIdList = lappend(*shardIdList, shardIdPointer);
+		}
+	}
+
+	LWLockRelease(&SharedMetadataCacheControl->lock);
+
+	return onlyPlacementsChanged;
+}
+
+
+/*
+ * SharedMetadataCacheAtCommit increments the version of the shared metadata
+ * cache if the committed transaction changed the metadata.
+ */
+void
+SharedMetadataCacheAtCommit(void)
+{
+	if (MetadataChangedInTransaction && SharedMetadataCacheControl != NULL)
+	{
+		AppendPendingShardInvalidations();
+		IncrementSharedMetadataCacheVersion();
+	}
+
+	MetadataChangedInTransaction = false;
+	ResetPendingShardInvalidations();
+	PreparingTransactionGid[0] = '\0';
+}
+
+
+/*
+ * SharedMetadataCacheAtPrepare tracks the prepared transaction, such that
+ * finishing it increments the version of the shared metadata cache if it
+ * changed the metadata. If there is no slot left, the transaction is not
+ * tracked, and finishing it increments the version regardless.
+ */
+void
+SharedMetadataCacheAtPrepare(void)
+{
+	if (SharedMetadataCacheControl != NULL && PreparingTransactionGid[0] != '\0')
+	{
+		LWLockAcquire(&SharedMetadataCacheControl->lock, LW_EXCLUSIVE);
+
+		for (int slotIndex = 0;
+			 slotIndex < SharedMetadataCacheControl->preparedTransactionSlotCount;
+			 slotIndex++)
+		{
+			PreparedTransactionSlot *slot =
+				&SharedMetadataCacheControl->preparedTransactions[slotIndex];
+
+			if (!slot->inUse)
+			{
+				slot->inUse = true;
+				slot->changedMetadata = MetadataChangedInTransaction;
+				strlcpy(slot->gid, PreparingTransactionGid, GIDSIZE);
+				break;
+			}
+		}
+
+		LWLockRelease(&SharedMetadataCacheControl->lock);
+	}
+
+	MetadataChangedInTransaction = false;
+	ResetPendingShardInvalidations();
+	PreparingTransactionGid[0] = '\0';
+}
+
+
+/*
+ * SharedMetadataCacheAtAbort forgets the metadata changes of the aborted
+ * transaction.
+ */
+void
+SharedMetadataCacheAtAbort(void)
+{
+	MetadataChangedInTransaction = false;
+	ResetPendingShardInvalidations();
+	PreparingTransactionGid[0] = '\0';
+}
+
+
+/*
+ * SharedMetadataCacheBeforePrepare remembers the GID of a PREPARE TRANSACTION
+ * command, to track the transaction once it is prepared.
+ */
+void
+SharedMetadataCacheBeforePrepare(const char *gid)
+{
+	strlcpy(PreparingTransactionGid, gid, GIDSIZE);
+}
+
+
+/*
+ * SharedMetadataCacheAfterFinishPrepared stops tracking a prepared transaction
+ * after COMMIT PREPARED or ROLLBACK PREPARED, and increments the version of
+ * the shared metadata cache if a committed transaction changed the metadata
+ * or was not tracked.
+ */
+void
+SharedMetadataCacheAfterFinishPrepared(const char *gid, bool isCommit)
+{
+	bool changedMetadata = true;
+
+	if (SharedMetadataCacheControl == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&SharedMetadataCacheControl->lock, LW_EXCLUSIVE);
+
+	for (int slotIndex = 0;
+		 slotIndex < SharedMetadataCacheControl->preparedTransactionSlotCount;
+		 slotIndex++)
+	{
+		PreparedTransactionSlot *slot =
+			&SharedMetadataCacheControl->preparedTransactions[slotIndex];
+
+		if (slot->inUse && strncmp(slot->gid, gid, GIDSIZE) == 0)
+		{
+			changedMetadata = slot->changedMetadata;
+			slot->inUse = false;
+			break;
+		}
+	}
+
+	LWLockRelease(&SharedMetadataCacheControl->lock);
+
+	if (isCommit && changedMetadata)
+	{
+		/* the changes of prepared transactions are not known in detail */
+		LWLockAcquire(&SharedMetadataCacheControl->lock, LW_EXCLUSIVE);
+		AppendShardInvalidation(InvalidOid, InvalidOid, INVALID_SHARD_ID);
+		LWLockRelease(&SharedMetadataCacheControl->lock);
+
+		IncrementSharedMetadataCacheVersion();
+	}
+}
+
+
+/*
+ * AttachSharedMetadataCache attaches the current backend to the shared hash,
+ * which is created by the first backend that uses it.
+ */
+static void
+AttachSharedMetadataCache(void)
+{
+	if (SharedMetadataCacheHash != NULL)
+	{
+		return;
+	}
+
+	dshash_parameters hashParameters = SharedMetadataCacheHashParameters();
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	LWLockAcquire(&SharedMetadataCacheControl->lock, LW_EXCLUSIVE);
+
+	if (!SharedMetadataCacheControl->areaCreated)
+	{
+		SharedMetadataCacheArea = dsa_create(SharedMetadataCacheControl->trancheId);
+
+		/* keep the area around when no backend is attached */
+		dsa_pin(SharedMetadataCacheArea);
+
+		SharedMetadataCacheHash = dshash_create(SharedMetadataCacheArea,
+												&hashParameters, NULL);
+
+		SharedMetadataCacheControl->areaHandle =
+			dsa_get_handle(SharedMetadataCacheArea);
+		SharedMetadataCacheControl->hashHandle =
+			dshash_get_hash_table_handle(SharedMetadataCacheHash);
+		SharedMetadataCacheControl->areaCreated = true;
+	}
+	else
+	{
+		SharedMetadataCacheArea = dsa_attach(SharedMetadataCacheControl->areaHandle);
+		SharedMetadataCacheHash = dshash_attach(SharedMetadataCacheArea,
+												&hashParameters,
+												SharedMetadataCacheControl->hashHandle,
+												NULL);
+	}
+
+	/* stay attached until the backend exits */
+	dsa_pin_mapping(SharedMetadataCacheArea);
+
+	LWLockRelease(&SharedMetadataCacheControl->lock);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * SharedMetadataCacheHashParameters returns the parameters of the shared hash.
+ */
+static dshash_parameters
+SharedMetadataCacheHashParameters(void)
+{
+	dshash_parameters hashParameters;
+
+	memset(&hashParameters, 0, sizeof(hashParameters));
+	hashParameters.key_size = sizeof(SharedMetadataCacheKey);
+	hashParameters.entry_size = sizeof(SharedMetadataCacheEntry);
+	hashParameters.compare_function = dshash_memcmp;
+	hashParameters.hash_function = dshash_memhash;
+	hashParameters.tranche_id = SharedMetadataCacheControl->trancheId;
+
+	return hashParameters;
+}
+
+
+/*
+ * InitSharedMetadataCacheKey initializes the key of the given table in the
+ * current database.
+ */
+static void
+InitSharedMetadataCacheKey(SharedMetadataCacheKey *key, Oid relationId)
+{
+	memset(key, 0, sizeof(SharedMetadataCacheKey));
+	key->databaseId = MyDatabaseId;
+	key->relationId = relationId;
+	key->distShardRelationId = DistShardRelationId();
+}
+
+
+/*
+ * ReserveSharedMetadataBytes accounts for size bytes of serialized metadata
+ * and returns true, unless that would exceed citus.shared_metadata_cache_size.
+ */
+static bool
+ReserveSharedMetadataBytes(Size size)
+{
+	uint64 sizeLimit = (uint64) SharedMetadataCacheSize * 1024;
+	uint64 usedBytes =
+		pg_atomic_add_fetch_u64(&SharedMetadataCacheControl->usedBytes, size);
+
+	if (usedBytes > sizeLimit)
+	{
+		pg_atomic_sub_fetch_u64(&SharedMetadataCacheControl->usedBytes, size);
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * FreeSharedMetadata frees serialized metadata stored in the area.
+ */
+static void
+FreeSharedMetadata(dsa_pointer data, Size dataSize)
+{
+	dsa_free(SharedMetadataCacheArea, data);
+	pg_atomic_sub_fetch_u64(&SharedMetadataCacheControl->usedBytes, dataSize);
+}
+
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+
+/*
+ * RemoveStaleSharedMetadataEntries removes the entries that were stored at a
+ * version other than the given one.
+ */
+static void
+RemoveStaleSharedMetadataEntries(uint64 version)
+{
+	dshash_seq_status status;
+	SharedMetadataCacheEntry *entry = NULL;
+
+	dshash_seq_init(&status, SharedMetadataCacheHash, true);
+
+	while ((entry = (SharedMetadataCacheEntry *) dshash_seq_next(&status)) != NULL)
+	{
+		if (entry->version != version)
+		{
+			if (DsaPointerIsValid(entry->data))
+			{
+				FreeSharedMetadata(entry->data, entry->dataSize);
+			}
+
+			dshash_delete_current(&status);
+		}
+	}
+
+	dshash_seq_term(&status);
+}
+
+
+#endif
+
+
+/*
+ * SerializedShardMetadataSize returns the number of bytes needed to
+ * serialize the given shards and placements.
+ */
+static Size
+SerializedShardMetadataSize(List *shardMetadataList)
+{
+	Size size = MAXALIGN(sizeof(int));
+
+	DistShardMetadata *shardMetadata = NULL;
+	foreach_ptr(shardMetadata, shardMetadataList)
+	{
+		int placementCount = list_length(shardMetadata->placementList);
+
+		size = add_size(size, MAXALIGN(sizeof(SerializedShardHeader)));
+		size = add_size(size, MAXALIGN(shardMetadata->shardTuple->t_len));
+		size = add_size(size, MAXALIGN(placementCount * sizeof(SerializedPlacement)));
+	}
+
+	return size;
+}
+
+
+/*
+ * SerializeShardMetadata writes the given shards and placements to buffer,
+ * which is SerializedShardMetadataSize() bytes long.
+ */
+static void
+SerializeShardMetadata(List *shardMetadataList, char *buffer)
+{
+	char *cursor = buffer;
+
+	*((int *) cursor) = list_length(shardMetadataList);
+	cursor += MAXALIGN(sizeof(int));
+
+	DistShardMetadata *shardMetadata = NULL;
+	foreach_ptr(shardMetadata, shardMetadataList)
+	{
+		HeapTuple shardTuple = shardMetadata->shardTuple;
+		SerializedShardHeader *header = (SerializedShardHeader *) cursor;
+
+		header->tupleLength = shardTuple->t_len;
+		header->placementCount = list_length(shardMetadata->placementList);
+		cursor += MAXALIGN(sizeof(SerializedShardHeader));
+
+		memcpy_s(cursor, header->tupleLength, shardTuple->t_data,
+				 header->tupleLength);
+		cursor += MAXALIGN(header->tupleLength);
+
+		SerializedPlacement *serializedPlacement = (SerializedPlacement *) cursor;
+		GroupShardPlacement *placement = NULL;
+		foreach_ptr(placement, shardMetadata->placementList)
+		{
+			serializedPlacement->placementId = placement->placementId;
+			serializedPlacement->shardLength = placement->shardLength;
+			serializedPlacement->shardState = placement->shardState;
+			serializedPlacement->groupId = placement->groupId;
+			serializedPlacement++;
+		}
+		cursor += MAXALIGN(header->placementCount * sizeof(SerializedPlacement));
+	}
+}
+
+
+/*
+ * DeserializeShardMetadata returns the list of DistShardMetadata that was
+ * serialized to buffer by SerializeShardMetadata().
+ */
+static List *
+DeserializeShardMetadata(char *buffer, Oid distShardRelationId)
+{
+	List *shardMetadataList = NIL;
+	char *cursor = buffer;
+
+	int shardCount = *((int *) cursor);
+	cursor += MAXALIGN(sizeof(int));
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		SerializedShardHeader *header = (SerializedShardHeader *) cursor;
+		cursor += MAXALIGN(sizeof(SerializedShardHeader));
+
+		HeapTuple shardTuple = (HeapTuple) palloc(HEAPTUPLESIZE + header->tupleLength);
+		shardTuple->t_len = header->tupleLength;
+		ItemPointerSetInvalid(&shardTuple->t_self);
+		shardTuple->t_tableOid = distShardRelationId;
+		shardTuple->t_data = (HeapTupleHeader) ((char *) shardTuple + HEAPTUPLESIZE);
+		memcpy_s(shardTuple->t_data, header->tupleLength, cursor,
+				 header->tupleLength);
+		cursor += MAXALIGN(header->tupleLength);
+
+		Form_pg_dist_shard shardForm = (Form_pg_dist_shard) GETSTRUCT(shardTuple);
+		DistShardMetadata *shardMetadata = palloc0(sizeof(DistShardMetadata));
+		shardMetadata->shardTuple = shardTuple;
+
+		SerializedPlacement *serializedPlacement = (SerializedPlacement *) cursor;
+		for (int placementIndex = 0; placementIndex < header->placementCount;
+			 placementIndex++)
+		{
+			GroupShardPlacement *placement = CitusMakeNode(GroupShardPlacement);
+			placement->placementId = serializedPlacement->placementId;
+			placement->shardId = shardForm->shardid;
+			placement->shardLength = serializedPlacement->shardLength;
+			placement->shardState = serializedPlacement->shardState;
+			placement->groupId = serializedPlacement->groupId;
+
+			shardMetadata->placementList = lappend(shardMetadata->placementList,
+												   placement);
+			serializedPlacement++;
+		}
+		cursor += MAXALIGN(header->placementCount * sizeof(SerializedPlacement));
+
+		shardMetadataList = lappend(shardMetadataList, shardMetadata);
+	}
+
+	return shardMetadataList;
+}
+
+
+/*
+ * IncrementSharedMetadataCacheVersion makes all entries of the shared
+ * metadata cache stale.
+ */
+static void
+IncrementSharedMetadataCacheVersion(void)
+{
+	pg_atomic_fetch_add_u64(&SharedMetadataCacheControl->version, 1);
+}
+
+
+/*
+ * AppendShardInvalidation appends a record to the invalidation log. The
+ * caller should hold the lock exclusively.
+ */
+static void
+AppendShardInvalidation(Oid databaseId, Oid relationId, uint64 shardId)
+{
+	uint64 sequence = SharedMetadataCacheControl->nextInvalidationSequence;
+	ShardInvalidationRecord *record =
+		&SharedMetadataCacheControl->invalidationLog[sequence %
+													 SHARD_INVALIDATION_LOG_SIZE];
+
+	record->sequence = sequence;
+	record->databaseId = databaseId;
+	record->relationId = relationId;
+	record->shardId = shardId;
+
+	SharedMetadataCacheControl->nextInvalidationSequence++;
+}
+
+
+/*
+ * AppendPendingShardInvalidations appends the changes of the committing
+ * transaction to the invalidation log. It runs in the commit callback, so it
+ * does not allocate memory.
+ */
+static void
+AppendPendingShardInvalidations(void)
+{
+	if (!EnableShardLevelInvalidation)
+	{
+		return;
+	}
+
+	LWLockAcquire(&SharedMetadataCacheControl->lock, LW_EXCLUSIVE);
+
+	if (PendingShardInvalidationsOverflowed)
+	{
+		AppendShardInvalidation(MyDatabaseId, InvalidOid, INVALID_SHARD_ID);
+	}
+	else
+	{
+		ShardInvalidationRecord *pendingRecord = NULL;
+		foreach_ptr(pendingRecord, PendingShardInvalidations)
+		{
+			AppendShardInvalidation(pendingRecord->databaseId,
+									pendingRecord->relationId,
+									pendingRecord->shardId);
+		}
+	}
+
+	LWLockRelease(&SharedMetadataCacheControl->lock);
+}
+
+
+/*
+ * ResetPendingShardInvalidations forgets the changes of the current
+ * transaction. The list itself is freed along with TopTransactionContext.
+ */
+static void
+ResetPendingShardInvalidations(void)
+{
+	PendingShardInvalidations = NIL;
+	PendingShardInvalidationsOverflowed = false;
+}
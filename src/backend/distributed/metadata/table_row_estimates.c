@@ -0,0 +1,487 @@
+/*-------------------------------------------------------------------------
+ *
+ * table_row_estimates.c
+ *
+ * Routines for keeping a shared memory cache of row count estimates for
+ * Citus tables. The estimates are the sum of the reltuples of the shards,
+ * which the worker nodes maintain as part of (auto)vacuum and analyze. The
+ * maintenance daemon periodically collects them, such that the planner can
+ * use them without contacting the nodes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "fmgr.h"
+#include "libpq-fe.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "access/hash.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_utility.h"
+#include "distributed/relay_utility.h"
+#include "distributed/remote_commands.h"
+#include "distributed/table_row_estimates.h"
+#include "distributed/worker_manager.h"
+
+
+/* maximum number of tables, over all databases, for which we keep estimates */
+#define MAX_TABLE_ROW_ESTIMATES 8192
+
+
+/*
+ * TableRowEstimateKey identifies a table across all databases.
+ */
+typedef struct TableRowEstimateKey
+{
+	Oid databaseId;
+	Oid relationId;
+} TableRowEstimateKey;
+
+
+/*
+ * TableRowEstimateEntry is the shared memory hash entry holding the estimated
+ * number of rows of a table.
+ */
+typedef struct TableRowEstimateEntry
+{
+	TableRowEstimateKey key;
+	double rowCount;
+} TableRowEstimateEntry;
+
+
+/*
+ * RelationRowCount is the entry of the backend-local hash in which the row
+ * counts are summed up while collecting them from the nodes. A negative
+ * row count means that the row count is unknown.
+ */
+typedef struct RelationRowCount
+{
+	Oid relationId;
+	double rowCount;
+} RelationRowCount;
+
+
+/*
+ * TableRowEstimatesControlData holds the lock protecting the estimates hash.
+ */
+typedef struct TableRowEstimatesControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+} TableRowEstimatesControlData;
+
+
+/* GUC, interval in milliseconds between row estimate refreshes, 0 to disable */
+int TableRowEstimateRefreshInterval = 0;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static TableRowEstimatesControlData *TableRowEstimatesControl = NULL;
+static HTAB *TableRowEstimatesHash = NULL;
+
+static char * NodeRowEstimateQuery(WorkerNode *workerNode, List *citusTableIds);
+static bool ReadNodeRowEstimates(WorkerNode *workerNode, char *query,
+								 HTAB *rowCountHash);
+static HTAB * CreateRowCountHash(void);
+static void StoreTableRowEstimates(HTAB *rowCountHash);
+
+PG_FUNCTION_INFO_V1(citus_update_table_row_estimates);
+
+
+/*
+ * citus_update_table_row_estimates refreshes the row estimates of all Citus
+ * tables in the current database, without waiting for the maintenance daemon.
+ */
+Datum
+citus_update_table_row_estimates(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	UpdateTableRowEstimates();
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * InitializeTableRowEstimates requests the shared memory for the row estimates
+ * and sets the hook that initializes it.
+ */
+void
+InitializeTableRowEstimates(void)
+{
+	/* On PG 15 and above, we use shmem_request_hook_type */
+	#if PG_VERSION_NUM < PG_VERSION_15
+
+	/* allocate shared memory for pre PG-15 versions */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(TableRowEstimatesShmemSize());
+	}
+
+	#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = TableRowEstimatesShmemInit;
+}
+
+
+/*
+ * TableRowEstimatesShmemSize returns the size of the shared memory used for
+ * the row estimates.
+ */
+size_t
+TableRowEstimatesShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(TableRowEstimatesControlData));
+	size = add_size(size, hash_estimate_size(MAX_TABLE_ROW_ESTIMATES,
+											 sizeof(TableRowEstimateEntry)));
+
+	return size;
+}
+
+
+/*
+ * TableRowEstimatesShmemInit initializes the shared memory used for the row
+ * estimates.
+ */
+void
+TableRowEstimatesShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL hashInfo;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	TableRowEstimatesControl =
+		(TableRowEstimatesControlData *) ShmemInitStruct("Citus Table Row Estimates",
+														 sizeof(
+															 TableRowEstimatesControlData),
+														 &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		TableRowEstimatesControl->trancheId = LWLockNewTrancheId();
+		TableRowEstimatesControl->lockTrancheName = "Citus Table Row Estimates";
+		LWLockRegisterTranche(TableRowEstimatesControl->trancheId,
+							  TableRowEstimatesControl->lockTrancheName);
+
+		LWLockInitialize(&TableRowEstimatesControl->lock,
+						 TableRowEstimatesControl->trancheId);
+	}
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = sizeof(TableRowEstimateKey);
+	hashInfo.entrysize = sizeof(TableRowEstimateEntry);
+	hashInfo.hash = tag_hash;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	TableRowEstimatesHash = ShmemInitHash("Citus Table Row Estimates Hash",
+										  MAX_TABLE_ROW_ESTIMATES,
+										  MAX_TABLE_ROW_ESTIMATES,
+										  &hashInfo, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * TableRowEstimate sets rowCount to the last collected row estimate of the
+ * given table and returns true. If no estimate was collected for the table,
+ * the function returns false.
+ */
+bool
+TableRowEstimate(Oid relationId, double *rowCount)
+{
+	TableRowEstimateKey key;
+	bool found = false;
+
+	if (TableRowEstimatesHash == NULL)
+	{
+		return false;
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.databaseId = MyDatabaseId;
+	key.relationId = relationId;
+
+	LWLockAcquire(&TableRowEstimatesControl->lock, LW_SHARED);
+
+	TableRowEstimateEntry *entry =
+		(TableRowEstimateEntry *) hash_search(TableRowEstimatesHash, &key,
+											  HASH_FIND, &found);
+	if (found)
+	{
+		*rowCount = entry->rowCount;
+	}
+
+	LWLockRelease(&TableRowEstimatesControl->lock);
+
+	return found;
+}
+
+
+/*
+ * UpdateTableRowEstimates collects the reltuples of all shards of the Citus
+ * tables in the current database from the nodes, and replaces the row
+ * estimates of the database with their sums. Each shard is counted once, on
+ * the node of its first active placement. Tables that have shards that were
+ * never vacuumed or analyzed do not get an estimate. If any node cannot be
+ * reached, the previous estimates are kept.
+ */
+void
+UpdateTableRowEstimates(void)
+{
+	List *citusTableIds = AllCitusTableIds();
+	List *workerNodeList = ActivePrimaryNodeList(NoLock);
+	HTAB *rowCountHash = CreateRowCountHash();
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		char *query = NodeRowEstimateQuery(workerNode, citusTableIds);
+		if (query == NULL)
+		{
+			/* no shards on this node */
+			continue;
+		}
+
+		if (!ReadNodeRowEstimates(workerNode, query, rowCountHash))
+		{
+			ereport(WARNING, (errmsg("could not collect table row estimates "
+									 "from %s:%d", workerNode->workerName,
+									 workerNode->workerPort)));
+
+			hash_destroy(rowCountHash);
+			return;
+		}
+	}
+
+	StoreTableRowEstimates(rowCountHash);
+
+	hash_destroy(rowCountHash);
+}
+
+
+/*
+ * NodeRowEstimateQuery returns a query that returns the relation id and the
+ * summed reltuples of the shards of each of the given tables that are counted
+ * on the given node. The sum is NULL when one of the shards (or, for
+ * partitioned shards, one of their leaf partitions) does not have reltuples
+ * yet. The function returns NULL if no shards are counted on the node.
+ */
+static char *
+NodeRowEstimateQuery(WorkerNode *workerNode, List *citusTableIds)
+{
+	StringInfo query = makeStringInfo();
+	bool missingOk = true;
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, citusTableIds)
+	{
+		char *relationName = get_rel_name(relationId);
+		if (relationName == NULL)
+		{
+			/* table was dropped concurrently */
+			continue;
+		}
+
+		char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+		StringInfo shardNameArray = makeStringInfo();
+
+		List *shardIntervalList = LoadShardIntervalList(relationId);
+		ShardInterval *shardInterval = NULL;
+		foreach_ptr(shardInterval, shardIntervalList)
+		{
+			uint64 shardId = shardInterval->shardId;
+			ShardPlacement *placement = ActiveShardPlacement(shardId, missingOk);
+
+			if (placement == NULL || placement->groupId != workerNode->groupId)
+			{
+				continue;
+			}
+
+			char *shardName = pstrdup(relationName);
+			AppendShardIdToName(&shardName, shardId);
+
+			appendStringInfo(shardNameArray, "%s%s",
+							 shardNameArray->len > 0 ? "," : "",
+							 quote_literal_cstr(quote_qualified_identifier(schemaName,
+																		   shardName)));
+		}
+
+		if (shardNameArray->len == 0)
+		{
+			continue;
+		}
+
+		appendStringInfo(query,
+						 "%sSELECT %u, CASE WHEN bool_or(c.reltuples < 0) THEN NULL "
+						 "ELSE sum(c.reltuples) END FROM unnest(ARRAY[%s]::text[]) "
+						 "AS s(shard_name) CROSS JOIN LATERAL "
+						 "pg_partition_tree(to_regclass(s.shard_name)) AS t "
+						 "JOIN pg_class c ON (c.oid = t.relid) WHERE t.isleaf",
+						 query->len > 0 ? " UNION ALL " : "",
+						 relationId, shardNameArray->data);
+	}
+
+	if (query->len == 0)
+	{
+		return NULL;
+	}
+
+	return query->data;
+}
+
+
+/*
+ * ReadNodeRowEstimates runs the row estimate query on the given node and adds
+ * the results to rowCountHash. A table whose estimate is unknown on any node
+ * stays unknown. The function returns false if the query failed.
+ */
+static bool
+ReadNodeRowEstimates(WorkerNode *workerNode, char *query, HTAB *rowCountHash)
+{
+	int connectionFlags = 0;
+	bool raiseErrors = false;
+	PGresult *result = NULL;
+
+	MultiConnection *connection = GetNodeConnection(connectionFlags,
+													workerNode->workerName,
+													workerNode->workerPort);
+
+	if (ExecuteOptionalRemoteCommand(connection, query, &result) != 0)
+	{
+		return false;
+	}
+
+	int rowCount = PQntuples(result);
+	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		Oid relationId = (Oid) strtoul(PQgetvalue(result, rowIndex, 0), NULL, 10);
+		bool found = false;
+
+		RelationRowCount *entry =
+			(RelationRowCount *) hash_search(rowCountHash, &relationId,
+											 HASH_ENTER, &found);
+		if (!found)
+		{
+			entry->rowCount = 0.0;
+		}
+
+		if (PQgetisnull(result, rowIndex, 1))
+		{
+			entry->rowCount = -1.0;
+		}
+		else if (entry->rowCount >= 0.0)
+		{
+			Datum rowCountDatum = DirectFunctionCall1(float8in,
+													  CStringGetDatum(
+														  PQgetvalue(result,
+																	 rowIndex, 1)));
+
+			entry->rowCount += DatumGetFloat8(rowCountDatum);
+		}
+	}
+
+	PQclear(result);
+	ClearResults(connection, raiseErrors);
+
+	return true;
+}
+
+
+/*
+ * CreateRowCountHash creates a backend-local hash that maps relation ids to
+ * the row counts collected so far.
+ */
+static HTAB *
+CreateRowCountHash(void)
+{
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(RelationRowCount);
+	info.hcxt = CurrentMemoryContext;
+	int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	return hash_create("table row count hash", 32, &info, hashFlags);
+}
+
+
+/*
+ * StoreTableRowEstimates replaces the row estimates of the current database
+ * in shared memory with the known row counts in rowCountHash.
+ */
+static void
+StoreTableRowEstimates(HTAB *rowCountHash)
+{
+	HASH_SEQ_STATUS status;
+
+	if (TableRowEstimatesHash == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&TableRowEstimatesControl->lock, LW_EXCLUSIVE);
+
+	/* remove the old estimates, including those of dropped tables */
+	TableRowEstimateEntry *entry = NULL;
+	hash_seq_init(&status, TableRowEstimatesHash);
+	while ((entry = (TableRowEstimateEntry *) hash_seq_search(&status)) != NULL)
+	{
+		if (entry->key.databaseId == MyDatabaseId)
+		{
+			hash_search(TableRowEstimatesHash, &entry->key, HASH_REMOVE, NULL);
+		}
+	}
+
+	RelationRowCount *rowCountEntry = NULL;
+	hash_seq_init(&status, rowCountHash);
+	while ((rowCountEntry = (RelationRowCount *) hash_seq_search(&status)) != NULL)
+	{
+		TableRowEstimateKey key;
+		bool found = false;
+
+		if (rowCountEntry->rowCount < 0.0 ||
+			hash_get_num_entries(TableRowEstimatesHash) >= MAX_TABLE_ROW_ESTIMATES)
+		{
+			continue;
+		}
+
+		memset(&key, 0, sizeof(key));
+		key.databaseId = MyDatabaseId;
+		key.relationId = rowCountEntry->relationId;
+
+		entry = (TableRowEstimateEntry *) hash_search(TableRowEstimatesHash, &key,
+													  HASH_ENTER_NULL, &found);
+		if (entry != NULL)
+		{
+			entry->rowCount = rowCountEntry->rowCount;
+		}
+	}
+
+	LWLockRelease(&TableRowEstimatesControl->lock);
+}
@@ -0,0 +1,409 @@
+/*-------------------------------------------------------------------------
+ *
+ * bulk_load.c
+ *
+ * This file contains functions to load files on storage that is shared by
+ * the nodes into a distributed table, where the workers read the files and
+ * send the rows to the nodes of their shards rather than the coordinator.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "access/htup_details.h"
+#include "access/table.h"
+#include "access/tupdesc.h"
+#include "catalog/pg_authid.h"
+#include "lib/stringinfo.h"
+#include "nodes/pg_list.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/coordinator_protocol.h"
+#include "distributed/distributed_planner.h"
+#include "distributed/intermediate_results.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_utility.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/resource_lock.h"
+#include "distributed/tuple_destination.h"
+#include "distributed/tuplestore.h"
+#include "distributed/utils/array_type.h"
+#include "distributed/worker_manager.h"
+#include "pg_version_compat.h"
+
+
+static void EnsureCanReadServerFiles(void);
+static List * BulkLoadColumnList(Relation relation);
+static char * BulkLoadColumnNames(List *columnList);
+static char * BulkLoadColumnDefinitions(List *columnList);
+static List * BulkLoadReadTaskList(Datum *fileArray, int fileCount, char *copyFormat,
+								   List *columnList);
+static List * BulkLoadInsertTaskList(CitusTableCacheEntry *targetRelation,
+									 List *columnList, List **redistributedResults,
+									 bool useBinaryFormat);
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(citus_bulk_load);
+PG_FUNCTION_INFO_V1(read_bulk_load_file);
+
+
+/*
+ * citus_bulk_load(table regclass, files text[], format citus_copy_format) loads
+ * the given COPY-formatted files into a hash or range distributed table and
+ * returns the number of rows loaded.
+ *
+ * The files need to be on storage that every node can read at the same path.
+ * Each file is read on a worker node, where its rows are partitioned by the
+ * shards of the table and sent to the nodes of those shards. The rows are then
+ * inserted into the shards, all in the distributed transaction of the caller,
+ * so the coordinator only sees the row counts of the files.
+ */
+Datum
+citus_bulk_load(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+	EnsureCanReadServerFiles();
+
+	Oid relationId = PG_GETARG_OID(0);
+	ArrayType *fileArrayObject = PG_GETARG_ARRAYTYPE_P(1);
+	Datum copyFormatOidDatum = PG_GETARG_DATUM(2);
+	Datum copyFormatLabelDatum = DirectFunctionCall1(enum_out, copyFormatOidDatum);
+	char *copyFormat = DatumGetCString(copyFormatLabelDatum);
+
+	EnsureTablePermissions(relationId, ACL_INSERT);
+
+	if (!IsCitusTableType(relationId, HASH_DISTRIBUTED) &&
+		!IsCitusTableType(relationId, RANGE_DISTRIBUTED))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot bulk load into %s", get_rel_name(relationId)),
+						errdetail("citus_bulk_load is only supported for hash and "
+								  "range distributed tables.")));
+	}
+
+	int fileCount = ArrayObjectCount(fileArrayObject);
+	if (fileCount == 0)
+	{
+		PG_RETURN_INT64(0);
+	}
+
+	Datum *fileArray = DeconstructArrayObject(fileArrayObject);
+
+	Relation relation = table_open(relationId, RowExclusiveLock);
+	List *columnList = BulkLoadColumnList(relation);
+	bool useBinaryFormat = CanUseBinaryCopyFormat(RelationGetDescr(relation));
+
+	CitusTableCacheEntry *targetRelation = GetCitusTableCacheEntry(relationId);
+	AttrNumber partitionColumnNumber = targetRelation->partitionColumn->varattno;
+	int partitionColumnIndex = -1;
+	int columnIndex = 0;
+
+	Form_pg_attribute column = NULL;
+	foreach_ptr(column, columnList)
+	{
+		if (column->attnum == partitionColumnNumber)
+		{
+			partitionColumnIndex = columnIndex;
+		}
+
+		columnIndex++;
+	}
+
+	Assert(partitionColumnIndex != -1);
+
+	/*
+	 * The files are partitioned into intermediate results on the nodes of the
+	 * target shards, the job id keeps the result ids of concurrent loads apart
+	 * within the same distributed transaction.
+	 */
+	StringInfo resultPrefix = makeStringInfo();
+	appendStringInfo(resultPrefix, "bulk_load_" UINT64_FORMAT, UniqueJobId());
+
+	List *readTaskList = BulkLoadReadTaskList(fileArray, fileCount, copyFormat,
+											  columnList);
+	List **redistributedResults = RedistributeTaskListResults(resultPrefix->data,
+															  readTaskList,
+															  partitionColumnIndex,
+															  targetRelation,
+															  useBinaryFormat);
+
+	List *insertTaskList = BulkLoadInsertTaskList(targetRelation, columnList,
+												  redistributedResults,
+												  useBinaryFormat);
+
+	bool expectResults = false;
+	uint64 rowsLoaded = ExecuteTaskListIntoTupleDest(ROW_MODIFY_COMMUTATIVE,
+													 insertTaskList,
+													 CreateTupleDestNone(),
+													 expectResults);
+
+	table_close(relation, NoLock);
+
+	PG_RETURN_INT64(rowsLoaded);
+}
+
+
+/*
+ * read_bulk_load_file returns the records in the given COPY-formatted file on
+ * the local file system as a set of records, which are parsed according to the
+ * column definition list of the caller. It reads the input files of
+ * citus_bulk_load on the worker nodes.
+ */
+Datum
+read_bulk_load_file(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+	EnsureCanReadServerFiles();
+
+	char *fileName = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	Datum copyFormatOidDatum = PG_GETARG_DATUM(1);
+	Datum copyFormatLabelDatum = DirectFunctionCall1(enum_out, copyFormatOidDatum);
+	char *copyFormat = DatumGetCString(copyFormatLabelDatum);
+
+	/* relative paths would point into a different data directory on each node */
+	if (!is_absolute_path(fileName))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_NAME),
+						errmsg("bulk load file \"%s\" is not an absolute path",
+							   fileName)));
+	}
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	ReadCopyFormatFileIntoTupleStore(fileName, copyFormat, tupleDescriptor,
+									 tupleStore);
+
+	PG_RETURN_DATUM(0);
+}
+
+
+/*
+ * EnsureCanReadServerFiles errors out if the current user is not allowed to
+ * read files on the server, which COPY FROM a file requires as well.
+ */
+static void
+EnsureCanReadServerFiles(void)
+{
+	if (!superuser() && !has_privs_of_role(GetUserId(), ROLE_PG_READ_SERVER_FILES))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+						errmsg("must be superuser or a member of the "
+							   "pg_read_server_files role to bulk load from files")));
+	}
+}
+
+
+/*
+ * BulkLoadColumnList returns the attributes of the columns of the relation that
+ * the input files contain, which, as for COPY, are the columns that are neither
+ * dropped nor generated.
+ */
+static List *
+BulkLoadColumnList(Relation relation)
+{
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	List *columnList = NIL;
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute column = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (column->attisdropped ||
+			column->attgenerated == ATTRIBUTE_GENERATED_STORED)
+		{
+			continue;
+		}
+
+		columnList = lappend(columnList, column);
+	}
+
+	return columnList;
+}
+
+
+/*
+ * BulkLoadColumnNames returns the comma separated names of the given columns.
+ */
+static char *
+BulkLoadColumnNames(List *columnList)
+{
+	StringInfo columnNames = makeStringInfo();
+
+	Form_pg_attribute column = NULL;
+	foreach_ptr(column, columnList)
+	{
+		if (columnNames->len > 0)
+		{
+			appendStringInfoString(columnNames, ", ");
+		}
+
+		appendStringInfoString(columnNames, quote_identifier(NameStr(column->attname)));
+	}
+
+	return columnNames->data;
+}
+
+
+/*
+ * BulkLoadColumnDefinitions returns the column definition list with which the
+ * rows of the given columns are read from files and intermediate results.
+ */
+static char *
+BulkLoadColumnDefinitions(List *columnList)
+{
+	StringInfo columnDefinitions = makeStringInfo();
+
+	Form_pg_attribute column = NULL;
+	foreach_ptr(column, columnList)
+	{
+		char *columnType = format_type_extended(column->atttypid, column->atttypmod,
+												FORMAT_TYPE_TYPEMOD_GIVEN |
+												FORMAT_TYPE_FORCE_QUALIFY);
+
+		if (columnDefinitions->len > 0)
+		{
+			appendStringInfoString(columnDefinitions, ", ");
+		}
+
+		appendStringInfo(columnDefinitions, "%s %s",
+						 quote_identifier(NameStr(column->attname)), columnType);
+	}
+
+	return columnDefinitions->data;
+}
+
+
+/*
+ * BulkLoadReadTaskList returns a task for each of the given files that reads
+ * the file, and assigns the tasks to the nodes that can have shards in a round
+ * robin fashion.
+ */
+static List *
+BulkLoadReadTaskList(Datum *fileArray, int fileCount, char *copyFormat,
+					 List *columnList)
+{
+	List *workerNodeList = DistributedTablePlacementNodeList(RowShareLock);
+	if (workerNodeList == NIL)
+	{
+		ereport(ERROR, (errmsg("no worker nodes are available to read the files")));
+	}
+
+	workerNodeList = SortList(workerNodeList, CompareWorkerNodes);
+
+	char *columnNames = BulkLoadColumnNames(columnList);
+	char *columnDefinitions = BulkLoadColumnDefinitions(columnList);
+
+	List *taskList = NIL;
+	uint64 jobId = INVALID_JOB_ID;
+
+	for (int fileIndex = 0; fileIndex < fileCount; fileIndex++)
+	{
+		char *fileName = TextDatumGetCString(fileArray[fileIndex]);
+		WorkerNode *workerNode = list_nth(workerNodeList,
+										  fileIndex % list_length(workerNodeList));
+
+		StringInfo queryString = makeStringInfo();
+		appendStringInfo(queryString,
+						 "SELECT %s FROM read_bulk_load_file(%s, %s) AS res(%s)",
+						 columnNames, quote_literal_cstr(fileName),
+						 quote_literal_cstr(copyFormat), columnDefinitions);
+
+		ShardPlacement *taskPlacement = CitusMakeNode(ShardPlacement);
+		SetPlacementNodeMetadata(taskPlacement, workerNode);
+
+		/* the task ids tell apart the partitions of the files on the same node */
+		Task *task = CreateBasicTask(jobId, fileIndex + 1, READ_TASK,
+									 queryString->data);
+		task->taskPlacementList = list_make1(taskPlacement);
+
+		taskList = lappend(taskList, task);
+	}
+
+	return taskList;
+}
+
+
+/*
+ * BulkLoadInsertTaskList returns a task for each shard of the target relation
+ * that inserts the intermediate results which were redistributed to the shard.
+ * redistributedResults[shardIndex] is the list of result ids for the shard
+ * at targetRelation->sortedShardIntervalArray[shardIndex].
+ */
+static List *
+BulkLoadInsertTaskList(CitusTableCacheEntry *targetRelation, List *columnList,
+					   List **redistributedResults, bool useBinaryFormat)
+{
+	char *columnNames = BulkLoadColumnNames(columnList);
+	char *columnDefinitions = BulkLoadColumnDefinitions(columnList);
+	char *copyFormat = useBinaryFormat ? "binary" : "text";
+
+	List *taskList = NIL;
+	int shardCount = targetRelation->shardIntervalArrayLength;
+	uint32 taskIdIndex = 1;
+	uint64 jobId = INVALID_JOB_ID;
+
+	for (int shardOffset = 0; shardOffset < shardCount; shardOffset++)
+	{
+		ShardInterval *targetShardInterval =
+			GetCachedShardInterval(targetRelation, shardOffset);
+		List *resultIdList = redistributedResults[targetShardInterval->shardIndex];
+		uint64 shardId = targetShardInterval->shardId;
+
+		/* skip shards without rows */
+		if (resultIdList == NIL)
+		{
+			continue;
+		}
+
+		StringInfo resultIdArray = makeStringInfo();
+		char *resultId = NULL;
+		foreach_ptr(resultId, SortList(resultIdList, pg_qsort_strcmp))
+		{
+			if (resultIdArray->len > 0)
+			{
+				appendStringInfoString(resultIdArray, ",");
+			}
+
+			appendStringInfoString(resultIdArray, quote_literal_cstr(resultId));
+		}
+
+		StringInfo queryString = makeStringInfo();
+		appendStringInfo(queryString,
+						 "INSERT INTO %s (%s) SELECT %s FROM "
+						 "read_intermediate_results(ARRAY[%s]::text[], '%s') AS res(%s)",
+						 ConstructQualifiedShardName(targetShardInterval),
+						 columnNames, columnNames, resultIdArray->data, copyFormat,
+						 columnDefinitions);
+
+		LockShardDistributionMetadata(shardId, ShareLock);
+
+		RelationShard *relationShard = CitusMakeNode(RelationShard);
+		relationShard->relationId = targetShardInterval->relationId;
+		relationShard->shardId = shardId;
+
+		Task *modifyTask = CreateBasicTask(jobId, taskIdIndex, MODIFY_TASK,
+										   queryString->data);
+		modifyTask->anchorShardId = shardId;
+		modifyTask->taskPlacementList = ActiveShardPlacementList(shardId);
+		modifyTask->relationShardList = list_make1(relationShard);
+		modifyTask->replicationModel = targetRelation->replicationModel;
+
+		taskList = lappend(taskList, modifyTask);
+
+		taskIdIndex++;
+	}
+
+	return taskList;
+}
@@ -24,9 +24,19 @@
 #include "distributed/remote_commands.h"
 #include "distributed/shard_split.h"
 #include "distributed/utils/distribution_column_map.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_utility.h"
+
+/* largest number of children that we compute split points for */
+#define MAX_SPLIT_POINTS_SHARD_COUNT 1024
+
+static List * SampleShardSplitPoints(ShardInterval *shardInterval, int splitCount,
+									 double samplePercent);
 
 /* declarations for dynamic loading */
 PG_FUNCTION_INFO_V1(citus_split_shard_by_split_points);
+PG_FUNCTION_INFO_V1(citus_shard_split_points);
 
 /*
  * citus_split_shard_by_split_points(shard_id bigint, split_points text[], node_ids integer[], shard_transfer_mode citus.shard_transfer_mode)
@@ -69,6 +79,180 @@ citus_split_shard_by_split_points(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * citus_shard_split_points(shard_id bigint, split_count integer, sample_percent float8)
+ * returns split points for citus_split_shard_by_split_points() that split the given
+ * shard into split_count children with about equally many rows, rather than into
+ * equal hash ranges, which gives unbalanced children when the data is skewed.
+ * The split points are percentiles of the hashes of the distribution column values
+ * in a sample of sample_percent of the pages of the shard. Fewer split points are
+ * returned when too few hash values are distinct, like with a single large tenant.
+ */
+Datum
+citus_shard_split_points(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	uint64 shardId = DatumGetUInt64(PG_GETARG_DATUM(0));
+	int splitCount = PG_GETARG_INT32(1);
+	double samplePercent = PG_GETARG_FLOAT8(2);
+
+	if (splitCount < 2 || splitCount > MAX_SPLIT_POINTS_SHARD_COUNT)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("split_count must be between 2 and %d",
+							   MAX_SPLIT_POINTS_SHARD_COUNT)));
+	}
+
+	if (samplePercent <= 0.0 || samplePercent > 100.0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("sample_percent must be above 0 and at most 100")));
+	}
+
+	ShardInterval *shardInterval = LoadShardInterval(shardId);
+	if (!IsCitusTableType(shardInterval->relationId, HASH_DISTRIBUTED))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot compute split points for shard " UINT64_FORMAT,
+							   shardId),
+						errdetail("Only shards of hash distributed tables can be "
+								  "split.")));
+	}
+
+	List *splitPointList = SampleShardSplitPoints(shardInterval, splitCount,
+												  samplePercent);
+	if (splitPointList == NIL)
+	{
+		ereport(ERROR, (errmsg("cannot compute split points for shard " UINT64_FORMAT,
+							   shardId),
+						errdetail("The sampled rows of the shard have a single "
+								  "distinct hash value."),
+						errhint("Use isolate_tenant_to_new_shard() to split off "
+								"a large tenant.")));
+	}
+
+	int splitPointCount = list_length(splitPointList);
+	Datum *splitPointDatums = palloc0(splitPointCount * sizeof(Datum));
+	int splitPointIndex = 0;
+
+	int32 splitPoint = 0;
+	foreach_int(splitPoint, splitPointList)
+	{
+		splitPointDatums[splitPointIndex++] =
+			CStringGetTextDatum(psprintf("%d", splitPoint));
+	}
+
+	PG_RETURN_ARRAYTYPE_P(DatumArrayToArrayType(splitPointDatums, splitPointCount,
+												TEXTOID));
+}
+
+
+/*
+ * SampleShardSplitPoints computes the hash values that split the rows of the
+ * given shard into splitCount parts of about equal size on a placement of the
+ * shard. It returns the increasing split points that lie inside the hash range
+ * of the shard, falling back to all rows when the sample is empty.
+ */
+static List *
+SampleShardSplitPoints(ShardInterval *shardInterval, int splitCount,
+					   double samplePercent)
+{
+	bool missingOk = false;
+	ShardPlacement *placement = ActiveShardPlacement(shardInterval->shardId,
+													 missingOk);
+
+	CitusTableCacheEntry *cacheEntry =
+		GetCitusTableCacheEntry(shardInterval->relationId);
+	char *distributionColumnName = get_attname(shardInterval->relationId,
+											   cacheEntry->partitionColumn->varattno,
+											   false);
+
+	StringInfo fractionArray = makeStringInfo();
+	appendStringInfoString(fractionArray, "ARRAY[");
+	for (int splitIndex = 1; splitIndex < splitCount; splitIndex++)
+	{
+		appendStringInfo(fractionArray, "%s%d.0 / %d", splitIndex > 1 ? ", " : "",
+						 splitIndex, splitCount);
+	}
+	appendStringInfoString(fractionArray, "]::pg_catalog.float8[]");
+
+	int32 shardMinValue = DatumGetInt32(shardInterval->minValue);
+	int32 shardMaxValue = DatumGetInt32(shardInterval->maxValue);
+	List *splitPointList = NIL;
+
+	uint32 connectionFlags = 0;
+	MultiConnection *connection = GetNodeConnection(connectionFlags,
+													placement->nodeName,
+													placement->nodePort);
+
+	/* sample first, and scan the whole shard if the sample has no rows */
+	bool sampleRows = samplePercent < 100.0;
+
+	while (true)
+	{
+		StringInfo sampleQuery = makeStringInfo();
+		appendStringInfo(sampleQuery,
+						 "SELECT pg_catalog.unnest(pg_catalog.percentile_disc(%s) "
+						 "WITHIN GROUP (ORDER BY pg_catalog.worker_hash(%s))) "
+						 "FROM %s",
+						 fractionArray->data, quote_identifier(distributionColumnName),
+						 ConstructQualifiedShardName(shardInterval));
+
+		if (sampleRows)
+		{
+			appendStringInfo(sampleQuery, " TABLESAMPLE SYSTEM (%g)", samplePercent);
+		}
+
+		PGresult *result = NULL;
+		int queryResult = ExecuteOptionalRemoteCommand(connection, sampleQuery->data,
+													   &result);
+		if (queryResult != RESPONSE_OKAY)
+		{
+			ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+							errmsg("cannot sample shard " UINT64_FORMAT " on %s:%d",
+								   shardInterval->shardId, placement->nodeName,
+								   placement->nodePort)));
+		}
+
+		List *hashValueList = ReadFirstColumnAsText(result);
+
+		PQclear(result);
+		ForgetResults(connection);
+
+		if (hashValueList == NIL && sampleRows)
+		{
+			sampleRows = false;
+			continue;
+		}
+
+		/* a split point ends a child, so the last child needs hash values above it */
+		int32 previousSplitPoint = shardMinValue;
+		bool firstSplitPoint = true;
+
+		StringInfo hashValueString = NULL;
+		foreach_ptr(hashValueString, hashValueList)
+		{
+			int32 hashValue = SafeStringToInt32(hashValueString->data);
+
+			if (hashValue < shardMinValue || hashValue >= shardMaxValue ||
+				(!firstSplitPoint && hashValue <= previousSplitPoint))
+			{
+				continue;
+			}
+
+			splitPointList = lappend_int(splitPointList, hashValue);
+			previousSplitPoint = hashValue;
+			firstSplitPoint = false;
+		}
+
+		break;
+	}
+
+	return splitPointList;
+}
+
+
 /*
  * LookupSplitMode maps the oids of citus.shard_transfer_mode to SplitMode enum.
  */
@@ -14,6 +14,7 @@
 #include "postgres.h"
 
 #include "distributed/argutils.h"
+#include "distributed/connection_management.h"
 #include "distributed/listutils.h"
 #include "distributed/lock_graph.h"
 #include "distributed/metadata_cache.h"
@@ -24,10 +25,25 @@
 
 /* simple query to run on workers to check connectivity */
 #define CONNECTIVITY_CHECK_QUERY "SELECT 1"
-#define CONNECTIVITY_CHECK_COLUMNS 5
+#define CONNECTIVITY_LATENCY_CHECK_COLUMNS 6
+
+
+/* outcome of a connectivity check from a source node to a target node */
+typedef struct ConnectivityCheckResult
+{
+	/* whether the source node returned the outcome of the check */
+	bool responded;
+
+	/* whether the source node could connect to the target node */
+	bool success;
+
+	/* milliseconds the source node took for the check */
+	double latency;
+} ConnectivityCheckResult;
 
 PG_FUNCTION_INFO_V1(citus_check_connection_to_node);
 PG_FUNCTION_INFO_V1(citus_check_cluster_node_health);
+PG_FUNCTION_INFO_V1(citus_check_cluster_node_latency);
 
 static bool CheckConnectionToNode(char *nodeName, uint32 nodePort);
 
@@ -86,26 +102,53 @@ citus_check_cluster_node_health(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * citus_check_cluster_node_latency UDF performs the same connectivity checks as
+ * citus_check_cluster_node_health, and additionally reports how long each check
+ * took on the source node.
+ */
+Datum
+citus_check_cluster_node_latency(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	StoreAllConnectivityChecks(tupleStore, tupleDescriptor);
+
+	PG_RETURN_VOID();
+}
+
+
 /*
  * StoreAllConnectivityChecks performs connectivity checks from all the nodes to all the
  * nodes, and report success status.
  *
  * Algorithm is:
- * for sourceNode in activeReadableNodeList:
- *   c = connectToNode(sourceNode)
- *   for targetNode in activeReadableNodeList:
- *     result = c.execute("SELECT citus_check_connection_to_node(targetNode.name, targetNode.port")
- *     emit sourceNode.name, sourceNode.port, targetNode.name, targetNode.port, result
+ * connect to all nodes in activeReadableNodeList in parallel
+ * for targetNode in activeReadableNodeList:
+ *   for sourceNode in activeReadableNodeList:
+ *     send "SELECT citus_check_connection_to_node(targetNode.name, targetNode.port)"
+ *   wait for all sourceNodes to respond
+ * emit sourceNode.name, sourceNode.port, targetNode.name, targetNode.port, result
+ * ordered by sourceNode, targetNode
  *
  * -- result -> true  -> connection attempt from source to target succeeded
  * -- result -> false -> connection attempt from source to target failed
  * -- result -> NULL  -> connection attempt from the current node to source node failed
+ *
+ * Each source node checks the target nodes one by one, but the source nodes run
+ * their checks concurrently, so the checks take as long as the checks of the
+ * slowest source node instead of the checks of all nodes. We also emit the time
+ * the source node took for the check, which is only part of the tuple
+ * descriptor of citus_check_cluster_node_latency.
  */
 static void
 StoreAllConnectivityChecks(Tuplestorestate *tupleStore, TupleDesc tupleDescriptor)
 {
-	Datum values[CONNECTIVITY_CHECK_COLUMNS];
-	bool isNulls[CONNECTIVITY_CHECK_COLUMNS];
+	Datum values[CONNECTIVITY_LATENCY_CHECK_COLUMNS];
+	bool isNulls[CONNECTIVITY_LATENCY_CHECK_COLUMNS];
 
 	/*
 	 * Get all the readable node list so that we will check connectivity to followers in
@@ -116,46 +159,107 @@ StoreAllConnectivityChecks(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 	/* we want to check for connectivity in a deterministic order */
 	workerNodeList = SortList(workerNodeList, CompareWorkerNodes);
 
-	/*
-	 * We iterate over the workerNodeList twice, for source and target worker nodes. This
-	 * operation is safe for foreach_ptr macro, as long as we use different variables for
-	 * each iteration.
-	 */
-	WorkerNode *sourceWorkerNode = NULL;
-	foreach_ptr(sourceWorkerNode, workerNodeList)
+	int nodeCount = list_length(workerNodeList);
+	MultiConnection **connectionArray = palloc0(nodeCount * sizeof(MultiConnection *));
+	ConnectivityCheckResult *checkResultArray =
+		palloc0(nodeCount * nodeCount * sizeof(ConnectivityCheckResult));
+
+	/* open the connections to all source nodes in parallel */
+	List *connectionList = NIL;
+	for (int sourceIndex = 0; sourceIndex < nodeCount; sourceIndex++)
 	{
-		const char *sourceNodeName = sourceWorkerNode->workerName;
-		const int sourceNodePort = sourceWorkerNode->workerPort;
+		WorkerNode *sourceWorkerNode = list_nth(workerNodeList, sourceIndex);
 		int32 connectionFlags = 0;
 
-		/* open a connection to the source node using the synchronous api */
-		MultiConnection *connectionToSourceNode =
-			GetNodeConnection(connectionFlags, sourceNodeName, sourceNodePort);
+		MultiConnection *connection =
+			StartNodeConnection(connectionFlags, sourceWorkerNode->workerName,
+								sourceWorkerNode->workerPort);
 
-		/* the second iteration over workerNodeList for the target worker nodes. */
-		WorkerNode *targetWorkerNode = NULL;
-		foreach_ptr(targetWorkerNode, workerNodeList)
+		connectionArray[sourceIndex] = connection;
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	for (int targetIndex = 0; targetIndex < nodeCount; targetIndex++)
+	{
+		WorkerNode *targetWorkerNode = list_nth(workerNodeList, targetIndex);
+		char *connectivityCheckCommandToTargetNode =
+			GetConnectivityCheckCommand(targetWorkerNode->workerName,
+										targetWorkerNode->workerPort);
+
+		/* send the check for the current target to all source nodes */
+		List *checkingConnectionList = NIL;
+		for (int sourceIndex = 0; sourceIndex < nodeCount; sourceIndex++)
 		{
-			const char *targetNodeName = targetWorkerNode->workerName;
-			const int targetNodePort = targetWorkerNode->workerPort;
+			MultiConnection *connection = connectionArray[sourceIndex];
 
-			char *connectivityCheckCommandToTargetNode =
-				GetConnectivityCheckCommand(targetNodeName, targetNodePort);
+			int querySent = SendRemoteCommand(connection,
+											  connectivityCheckCommandToTargetNode);
+			if (querySent == 0)
+			{
+				ReportConnectionError(connection, WARNING);
+				continue;
+			}
+
+			checkingConnectionList = lappend(checkingConnectionList, connection);
+		}
+
+		bool raiseInterrupts = true;
+		WaitForAllConnections(checkingConnectionList, raiseInterrupts);
+
+		for (int sourceIndex = 0; sourceIndex < nodeCount; sourceIndex++)
+		{
+			MultiConnection *connection = connectionArray[sourceIndex];
+			ConnectivityCheckResult *checkResult =
+				&checkResultArray[sourceIndex * nodeCount + targetIndex];
 
-			PGresult *result = NULL;
-			int executionResult =
-				ExecuteOptionalRemoteCommand(connectionToSourceNode,
-											 connectivityCheckCommandToTargetNode,
-											 &result);
+			if (!list_member_ptr(checkingConnectionList, connection))
+			{
+				continue;
+			}
+
+			PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+			if (!IsResponseOK(result))
+			{
+				ReportResultError(connection, result, WARNING);
+			}
+			else
+			{
+				int rowIndex = 0;
+				int resultColumnIndex = 0;
+				int latencyColumnIndex = 1;
+
+				checkResult->responded = true;
+				checkResult->success =
+					ParseBoolField(result, rowIndex, resultColumnIndex);
+				checkResult->latency =
+					strtod(PQgetvalue(result, rowIndex, latencyColumnIndex), NULL);
+			}
+
+			PQclear(result);
+			ForgetResults(connection);
+		}
+	}
+
+	for (int sourceIndex = 0; sourceIndex < nodeCount; sourceIndex++)
+	{
+		WorkerNode *sourceWorkerNode = list_nth(workerNodeList, sourceIndex);
+
+		for (int targetIndex = 0; targetIndex < nodeCount; targetIndex++)
+		{
+			WorkerNode *targetWorkerNode = list_nth(workerNodeList, targetIndex);
+			ConnectivityCheckResult *checkResult =
+				&checkResultArray[sourceIndex * nodeCount + targetIndex];
 
 			/* get ready for the next tuple */
 			memset(values, 0, sizeof(values));
 			memset(isNulls, false, sizeof(isNulls));
 
-			values[0] = PointerGetDatum(cstring_to_text(sourceNodeName));
-			values[1] = Int32GetDatum(sourceNodePort);
-			values[2] = PointerGetDatum(cstring_to_text(targetNodeName));
-			values[3] = Int32GetDatum(targetNodePort);
+			values[0] = PointerGetDatum(cstring_to_text(sourceWorkerNode->workerName));
+			values[1] = Int32GetDatum(sourceWorkerNode->workerPort);
+			values[2] = PointerGetDatum(cstring_to_text(targetWorkerNode->workerName));
+			values[3] = Int32GetDatum(targetWorkerNode->workerPort);
 
 			/*
 			 * If we could not send the query or the result was not ok, set success field
@@ -165,21 +269,18 @@ StoreAllConnectivityChecks(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 			 * Therefore, we mark the success as NULL to indicate that the connectivity
 			 * status is unknown.
 			 */
-			if (executionResult != RESPONSE_OKAY)
+			if (!checkResult->responded)
 			{
 				isNulls[4] = true;
+				isNulls[5] = true;
 			}
 			else
 			{
-				int rowIndex = 0;
-				int columnIndex = 0;
-				values[4] = BoolGetDatum(ParseBoolField(result, rowIndex, columnIndex));
+				values[4] = BoolGetDatum(checkResult->success);
+				values[5] = Float8GetDatum(checkResult->latency);
 			}
 
 			tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
-
-			PQclear(result);
-			ForgetResults(connectionToSourceNode);
 		}
 	}
 }
@@ -193,7 +294,9 @@ GetConnectivityCheckCommand(const char *nodeName, const uint32 nodePort)
 {
 	StringInfo connectivityCheckCommand = makeStringInfo();
 	appendStringInfo(connectivityCheckCommand,
-					 "SELECT citus_check_connection_to_node('%s', %d)",
+					 "SELECT citus_check_connection_to_node('%s', %d), "
+					 "extract(epoch FROM clock_timestamp() - statement_timestamp()) "
+					 "* 1000",
 					 nodeName, nodePort);
 
 	return connectivityCheckCommand->data;
@@ -0,0 +1,346 @@
+/*-------------------------------------------------------------------------
+ *
+ * hot_tenant_isolation.c
+ *
+ * This file contains the policy that isolates hot tenants automatically.
+ * When citus.hot_tenant_isolation_threshold is set, the maintenance daemon
+ * of the coordinator periodically looks at the sampled load of the tenants,
+ * see tenant_load_stats.c. Once a tenant takes more than the threshold of
+ * the sampled queries of its colocation group, it schedules a background job
+ * that isolates the tenant to a shard of its own with
+ * isolate_tenant_to_new_shard() and then moves that shard to the node with
+ * the fewest shards of the table. Jobs are only scheduled during the time of
+ * day given by citus.hot_tenant_isolation_window, and only one job at a
+ * time.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include <ctype.h>
+
+#include "lib/stringinfo.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/timestamp.h"
+
+#include "distributed/citus_ruleutils.h"
+#include "distributed/colocation_utils.h"
+#include "distributed/hot_tenant_isolation.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_utility.h"
+#include "distributed/shard_transfer.h"
+#include "distributed/shardinterval_utils.h"
+#include "distributed/tenant_load_stats.h"
+
+
+/* job type of the background jobs that isolate hot tenants */
+#define HOT_TENANT_ISOLATION_JOB_TYPE "isolate_tenant"
+
+#define MINUTES_PER_DAY (24 * 60)
+
+/*
+ * Moves the shard of the given tenant to the node that has the fewest shards
+ * of the table, if there is another node. The shard id is looked up when the
+ * task runs, since the shard is only created by the isolation task.
+ */
+#define MOVE_ISOLATED_TENANT_COMMAND \
+	"SELECT pg_catalog.citus_move_shard_placement(source.shardid, " \
+	"source.nodename, source.nodeport, target.nodename, target.nodeport, " \
+	"'auto') " \
+	"FROM pg_catalog.pg_dist_shard_placement source, LATERAL (" \
+	"SELECT node.nodename, node.nodeport FROM pg_catalog.pg_dist_node node " \
+	"WHERE node.isactive AND node.noderole = 'primary' AND node.shouldhaveshards " \
+	"AND (node.nodename, node.nodeport) <> (source.nodename, source.nodeport) " \
+	"ORDER BY (SELECT count(*) FROM pg_catalog.pg_dist_shard_placement placement " \
+	"JOIN pg_catalog.pg_dist_shard shard USING (shardid) " \
+	"WHERE placement.nodename = node.nodename " \
+	"AND placement.nodeport = node.nodeport AND shard.logicalrelid = %s), " \
+	"node.nodeid LIMIT 1) target " \
+	"WHERE source.shardid = " \
+	"pg_catalog.get_shard_id_for_distribution_column(%s, %s)"
+
+
+/* GUC, share of the load of its colocation group above which a tenant is isolated */
+double HotTenantIsolationThreshold = 0.0;
+
+/* GUC, minimum number of sampled queries of a colocation group to isolate tenants */
+int HotTenantIsolationMinSamples = 1000;
+
+/* GUC, time of day at which hot tenants may be isolated, empty for any time */
+char *HotTenantIsolationWindow = "";
+
+static bool ParseTimeOfDay(const char **string, int *minute);
+static bool InHotTenantIsolationWindow(void);
+static TenantLoad * HottestTenant(void);
+static bool TenantCanBeIsolated(TenantLoad *tenantLoad);
+
+
+/*
+ * ParseHotTenantIsolationWindow parses a window of the form HH:MM-HH:MM into
+ * the minutes of the day at which it starts and ends, and returns whether the
+ * window is valid. A window that ends before it starts spans midnight.
+ */
+bool
+ParseHotTenantIsolationWindow(const char *window, int *startMinute, int *endMinute)
+{
+	const char *position = window;
+
+	if (!ParseTimeOfDay(&position, startMinute) || *position != '-')
+	{
+		return false;
+	}
+
+	position++;
+
+	if (!ParseTimeOfDay(&position, endMinute) || *position != '\0')
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * ParseTimeOfDay parses a time of day of the form HH:MM at the start of the
+ * given string into minutes of the day, and advances the string past it.
+ */
+static bool
+ParseTimeOfDay(const char **string, int *minute)
+{
+	const char *position = *string;
+
+	for (int charIndex = 0; charIndex < 5; charIndex++)
+	{
+		bool isColon = (charIndex == 2);
+		if ((isColon && position[charIndex] != ':') ||
+			(!isColon && !isdigit((unsigned char) position[charIndex])))
+		{
+			return false;
+		}
+	}
+
+	int hour = (position[0] - '0') * 10 + (position[1] - '0');
+	int minuteOfHour = (position[3] - '0') * 10 + (position[4] - '0');
+	if (hour > 23 || minuteOfHour > 59)
+	{
+		return false;
+	}
+
+	*minute = hour * 60 + minuteOfHour;
+	*string = position + 5;
+
+	return true;
+}
+
+
+/*
+ * InHotTenantIsolationWindow returns whether the current time of day, in the
+ * time zone of the server, is inside citus.hot_tenant_isolation_window.
+ */
+static bool
+InHotTenantIsolationWindow(void)
+{
+	int startMinute = 0;
+	int endMinute = 0;
+	struct pg_tm tm;
+	fsec_t fsec;
+	int tz;
+
+	if (HotTenantIsolationWindow == NULL || HotTenantIsolationWindow[0] == '\0')
+	{
+		return true;
+	}
+
+	if (!ParseHotTenantIsolationWindow(HotTenantIsolationWindow, &startMinute,
+									   &endMinute))
+	{
+		/* the check hook does not let invalid windows through */
+		return false;
+	}
+
+	if (timestamp2tm(GetCurrentTimestamp(), &tz, &tm, &fsec, NULL, NULL) != 0)
+	{
+		return false;
+	}
+
+	int currentMinute = (tm.tm_hour * 60 + tm.tm_min) % MINUTES_PER_DAY;
+
+	if (startMinute <= endMinute)
+	{
+		return currentMinute >= startMinute && currentMinute < endMinute;
+	}
+
+	/* the window spans midnight */
+	return currentMinute >= startMinute || currentMinute < endMinute;
+}
+
+
+/*
+ * HottestTenant returns the tenant with the largest share of the sampled
+ * queries of its colocation group, among the tenants whose share exceeds
+ * citus.hot_tenant_isolation_threshold in groups with enough samples, or
+ * NULL if there is no such tenant.
+ */
+static TenantLoad *
+HottestTenant(void)
+{
+	TenantLoad *hottestTenant = NULL;
+	double hottestShare = 0.0;
+
+	TenantLoad *tenantLoad = NULL;
+	foreach_ptr(tenantLoad, TenantLoadList())
+	{
+		if (tenantLoad->groupSampleCount < HotTenantIsolationMinSamples ||
+			tenantLoad->groupSampleCount <= 0)
+		{
+			continue;
+		}
+
+		/* only count the samples that are guaranteed to be of the tenant */
+		double sampleCount = tenantLoad->sampleCount - tenantLoad->sampleCountError;
+		double share = sampleCount / tenantLoad->groupSampleCount;
+		if (share >= HotTenantIsolationThreshold && share > hottestShare)
+		{
+			hottestTenant = tenantLoad;
+			hottestShare = share;
+		}
+	}
+
+	return hottestTenant;
+}
+
+
+/*
+ * TenantCanBeIsolated returns whether isolate_tenant_to_new_shard() can
+ * isolate the given tenant, such that we do not schedule jobs that are bound
+ * to fail.
+ */
+static bool
+TenantCanBeIsolated(TenantLoad *tenantLoad)
+{
+	CitusTableCacheEntry *cacheEntry = LookupCitusTableCacheEntry(
+		tenantLoad->relationId);
+	if (cacheEntry == NULL ||
+		!IsCitusTableTypeCacheEntry(cacheEntry, HASH_DISTRIBUTED) ||
+		cacheEntry->colocationId != tenantLoad->colocationId)
+	{
+		/* the table was dropped or undistributed since the tenant was sampled */
+		return false;
+	}
+
+	Oid distributionColumnType = cacheEntry->partitionColumn->vartype;
+	Datum tenantDatum = StringToDatum(tenantLoad->tenantValue, distributionColumnType);
+	ShardInterval *shardInterval = FindShardInterval(tenantDatum, cacheEntry);
+	if (shardInterval == NULL)
+	{
+		return false;
+	}
+
+	if (DatumGetInt32(shardInterval->minValue) ==
+		DatumGetInt32(shardInterval->maxValue))
+	{
+		/* the tenant is isolated already */
+		return false;
+	}
+
+	if (list_length(ActiveShardPlacementList(shardInterval->shardId)) > 1)
+	{
+		/* tenants cannot be isolated when using shard replication */
+		return false;
+	}
+
+	/* the shards are split and moved with logical replication */
+	Oid colocatedTableId = InvalidOid;
+	foreach_oid(colocatedTableId, ColocatedTableList(tenantLoad->relationId))
+	{
+		if (!RelationCanPublishAllModifications(colocatedTableId))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ScheduleHotTenantIsolation schedules a background job that isolates the
+ * hottest tenant of the current database and moves it to another node, if
+ * there is a tenant that exceeds citus.hot_tenant_isolation_threshold and we
+ * are inside citus.hot_tenant_isolation_window.
+ */
+void
+ScheduleHotTenantIsolation(void)
+{
+	if (HotTenantIsolationThreshold <= 0.0 || !InHotTenantIsolationWindow())
+	{
+		return;
+	}
+
+	if (HasNonTerminalJobOfType(HOT_TENANT_ISOLATION_JOB_TYPE, NULL))
+	{
+		/* isolate one tenant at a time, the load shifts after each isolation */
+		return;
+	}
+
+	TenantLoad *tenantLoad = HottestTenant();
+	if (tenantLoad == NULL)
+	{
+		return;
+	}
+
+	/*
+	 * Forget the load of the tenant either way, such that we do not keep
+	 * checking a tenant that cannot be isolated, and do not isolate it again
+	 * before the new load of the isolated tenant has been sampled.
+	 */
+	RemoveTenantLoad(tenantLoad->colocationId, tenantLoad->tenantValue);
+
+	if (!TenantCanBeIsolated(tenantLoad))
+	{
+		ereport(DEBUG1, (errmsg("skipping isolation of hot tenant %s of %s",
+								tenantLoad->tenantValue,
+								get_rel_name(tenantLoad->relationId))));
+		return;
+	}
+
+	char *qualifiedRelationName = generate_qualified_relation_name(
+		tenantLoad->relationId);
+	char *quotedRelationName = quote_literal_cstr(qualifiedRelationName);
+	char *quotedTenantValue = quote_literal_cstr(tenantLoad->tenantValue);
+
+	StringInfo description = makeStringInfo();
+	appendStringInfo(description, "Isolate hot tenant %s of %s",
+					 quotedTenantValue, qualifiedRelationName);
+
+	int64 jobId = CreateBackgroundJob(HOT_TENANT_ISOLATION_JOB_TYPE,
+									  description->data);
+
+	StringInfo isolateCommand = makeStringInfo();
+	appendStringInfo(isolateCommand,
+					 "SELECT pg_catalog.isolate_tenant_to_new_shard(%s, %s, 'CASCADE', "
+					 "'auto')", quotedRelationName, quotedTenantValue);
+
+	BackgroundTask *isolateTask = ScheduleBackgroundTask(jobId, CitusExtensionOwner(),
+														 isolateCommand->data, 0,
+														 NULL, 0, NULL);
+
+	StringInfo moveCommand = makeStringInfo();
+	appendStringInfo(moveCommand, MOVE_ISOLATED_TENANT_COMMAND,
+					 quotedRelationName, quotedRelationName, quotedTenantValue);
+
+	int64 dependingTaskIds[] = { isolateTask->taskid };
+	ScheduleBackgroundTask(jobId, CitusExtensionOwner(), moveCommand->data,
+						   lengthof(dependingTaskIds), dependingTaskIds, 0, NULL);
+
+	ereport(LOG, (errmsg("scheduled isolation of hot tenant %s of %s as background "
+						 "job %ld", quotedTenantValue, qualifiedRelationName,
+						 jobId)));
+}
@@ -1080,7 +1080,7 @@ CitusCreateAlterColumnarTableSet(char *qualifiedRelationName,
 					 "columnar.chunk_group_row_limit = %d, "
 					 "columnar.stripe_row_limit = %lu, "
 					 "columnar.compression_level = %d, "
-					 "columnar.compression = %s);",
+					 "columnar.compression = %s",
 					 qualifiedRelationName,
 					 options->chunkRowCount,
 					 options->stripeRowCount,
@@ -1088,6 +1088,20 @@ CitusCreateAlterColumnarTableSet(char *qualifiedRelationName,
 					 quote_literal_cstr(extern_CompressionTypeStr(
 											options->compressionType)));
 
+	if (options->bloomColumns != NULL)
+	{
+		appendStringInfo(&buf, ", columnar.bloom_columns = %s",
+						 quote_literal_cstr(options->bloomColumns));
+	}
+
+	if (options->sortBy != NULL)
+	{
+		appendStringInfo(&buf, ", columnar.sort_by = %s",
+						 quote_literal_cstr(options->sortBy));
+	}
+
+	appendStringInfoString(&buf, ");");
+
 	return buf.data;
 }
 
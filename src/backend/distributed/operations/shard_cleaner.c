@@ -11,6 +11,7 @@
  */
 
 #include "postgres.h"
+#include "libpq-fe.h"
 #include "miscadmin.h"
 #include "access/genam.h"
 #include "access/xact.h"
@@ -23,6 +24,7 @@
 #include "utils/fmgroids.h"
 
 #include "distributed/citus_safe_lib.h"
+#include "distributed/connection_management.h"
 #include "distributed/listutils.h"
 #include "distributed/coordinator_protocol.h"
 #include "distributed/metadata_cache.h"
@@ -63,6 +65,30 @@ typedef struct CleanupRecord
 	CleanupPolicy policy;
 } CleanupRecord;
 
+/* maximum number of orphaned shards dropped by a single DROP TABLE command */
+#define CLEANUP_DROP_BATCH_SIZE 100
+
+/*
+ * NodeCleanupState tracks the orphaned shards that are dropped on a single
+ * node by DropOrphanedShardsForCleanup.
+ */
+typedef struct NodeCleanupState
+{
+	int nodeGroupId;
+	WorkerNode *workerNode;
+
+	/* connection over which the batches are sent */
+	MultiConnection *connection;
+
+	/* records to clean up on the node, and the index of the next one to drop */
+	List *recordList;
+	int nextRecordIndex;
+
+	/* records that are dropped by the command that is in progress */
+	List *batchRecordList;
+	bool batchSent;
+} NodeCleanupState;
+
 /* operation ID set by RegisterOperationNeedingCleanup */
 OperationId CurrentOperationId = INVALID_OPERATION_ID;
 
@@ -92,6 +118,14 @@ static bool CleanupRecordExists(uint64 recordId);
 static List * ListCleanupRecords(void);
 static List * ListCleanupRecordsForCurrentOperation(void);
 static int DropOrphanedShardsForCleanup(void);
+static NodeCleanupState * NodeCleanupStateForGroup(List **nodeCleanupStateList,
+												   int nodeGroupId);
+static List * DropOrphanedShardBatches(List *nodeCleanupStateList,
+									   int *failedShardCount);
+static List * NextCleanupBatch(NodeCleanupState *nodeCleanupState);
+static char * DropOrphanedShardBatchCommand(List *recordList);
+static void LogDroppedOrphanedShard(CleanupRecord *record, WorkerNode *workerNode);
+static void DeleteCleanupRecordList(List *recordList);
 
 /*
  * citus_cleanup_orphaned_shards implements a user-facing UDF to delete
@@ -251,6 +285,10 @@ TryDropOrphanedShards(bool waitForLocks)
  * obtained it skips the resource and continues with others.
  * The resource that has been skipped will be removed at a later iteration when there are no
  * locks held anymore.
+ *
+ * The shards are dropped in batches of CLEANUP_DROP_BATCH_SIZE per DROP TABLE
+ * command, with a batch running on each node at the same time, and the records
+ * of the dropped shards are deleted together at the end.
  */
 static int
 DropOrphanedShardsForCleanup()
@@ -262,11 +300,9 @@ DropOrphanedShardsForCleanup()
 	}
 
 	List *cleanupRecordList = ListCleanupRecords();
+	List *nodeCleanupStateList = NIL;
 
-	int removedShardCountForCleanup = 0;
-	int failedShardCountForCleanup = 0;
 	CleanupRecord *record = NULL;
-
 	foreach_ptr(record, cleanupRecordList)
 	{
 		/* We only support one resource type at the moment */
@@ -289,9 +325,6 @@ DropOrphanedShardsForCleanup()
 			continue;
 		}
 
-		char *qualifiedTableName = record->objectName;
-		WorkerNode *workerNode = LookupNodeForGroup(record->nodeGroupId);
-
 		/*
 		 * Now that we have the lock, check if record exists.
 		 * The operation could have completed successfully just after we called
@@ -302,48 +335,235 @@ DropOrphanedShardsForCleanup()
 			continue;
 		}
 
-		if (TryDropShardOutsideTransaction(record->operationId,
-										   qualifiedTableName,
-										   workerNode->workerName,
-										   workerNode->workerPort))
+		NodeCleanupState *nodeCleanupState =
+			NodeCleanupStateForGroup(&nodeCleanupStateList, record->nodeGroupId);
+		nodeCleanupState->recordList = lappend(nodeCleanupState->recordList, record);
+	}
+
+	int failedShardCountForCleanup = 0;
+	List *droppedRecordList = DropOrphanedShardBatches(nodeCleanupStateList,
+													   &failedShardCountForCleanup);
+
+	/* delete the cleanup records */
+	DeleteCleanupRecordList(droppedRecordList);
+
+	if (failedShardCountForCleanup > 0)
+	{
+		ereport(WARNING, (errmsg("failed to clean up %d orphaned shards out of %d",
+								 failedShardCountForCleanup,
+								 list_length(cleanupRecordList))));
+	}
+
+	return list_length(droppedRecordList);
+}
+
+
+/*
+ * NodeCleanupStateForGroup returns the cleanup state of the given node group
+ * in the list, and adds one if there is none yet.
+ */
+static NodeCleanupState *
+NodeCleanupStateForGroup(List **nodeCleanupStateList, int nodeGroupId)
+{
+	NodeCleanupState *nodeCleanupState = NULL;
+	foreach_ptr(nodeCleanupState, *nodeCleanupStateList)
+	{
+		if (nodeCleanupState->nodeGroupId == nodeGroupId)
+		{
+			return nodeCleanupState;
+		}
+	}
+
+	nodeCleanupState = palloc0(sizeof(NodeCleanupState));
+	nodeCleanupState->nodeGroupId = nodeGroupId;
+	nodeCleanupState->workerNode = LookupNodeForGroup(nodeGroupId);
+
+	*nodeCleanupStateList = lappend(*nodeCleanupStateList, nodeCleanupState);
+
+	return nodeCleanupState;
+}
+
+
+/*
+ * DropOrphanedShardBatches drops the orphaned shards of the records in the
+ * given node cleanup states and returns the records of the dropped shards.
+ * Each round sends the next batch of every node before waiting for any of
+ * them, such that the nodes drop their shards in parallel. If a batch fails,
+ * for instance because one of its shards is still locked, its shards are
+ * dropped one by one so that the others are not held back. The number of
+ * shards that could not be dropped is written to failedShardCount.
+ */
+static List *
+DropOrphanedShardBatches(List *nodeCleanupStateList, int *failedShardCount)
+{
+	List *droppedRecordList = NIL;
+	List *connectionList = NIL;
+
+	NodeCleanupState *nodeCleanupState = NULL;
+	foreach_ptr(nodeCleanupState, nodeCleanupStateList)
+	{
+		WorkerNode *workerNode = nodeCleanupState->workerNode;
+		int connectionFlags = OUTSIDE_TRANSACTION;
+
+		nodeCleanupState->connection =
+			StartNodeUserDatabaseConnection(connectionFlags, workerNode->workerName,
+											workerNode->workerPort,
+											CurrentUserName(), NULL);
+		connectionList = lappend(connectionList, nodeCleanupState->connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	bool recordsLeft = (nodeCleanupStateList != NIL);
+	while (recordsLeft)
+	{
+		recordsLeft = false;
+
+		foreach_ptr(nodeCleanupState, nodeCleanupStateList)
+		{
+			MultiConnection *connection = nodeCleanupState->connection;
+
+			nodeCleanupState->batchRecordList = NextCleanupBatch(nodeCleanupState);
+			nodeCleanupState->batchSent = false;
+
+			if (nodeCleanupState->batchRecordList == NIL ||
+				PQstatus(connection->pgConn) != CONNECTION_OK)
+			{
+				continue;
+			}
+
+			char *command =
+				DropOrphanedShardBatchCommand(nodeCleanupState->batchRecordList);
+			nodeCleanupState->batchSent = SendRemoteCommand(connection, command) != 0;
+		}
+
+		foreach_ptr(nodeCleanupState, nodeCleanupStateList)
 		{
-			if (record->policy == CLEANUP_DEFERRED_ON_SUCCESS)
+			MultiConnection *connection = nodeCleanupState->connection;
+			WorkerNode *workerNode = nodeCleanupState->workerNode;
+			List *batchRecordList = nodeCleanupState->batchRecordList;
+
+			if (batchRecordList == NIL)
 			{
-				ereport(LOG, (errmsg("deferred drop of orphaned shard %s on %s:%d "
-									 "completed",
-									 qualifiedTableName,
-									 workerNode->workerName, workerNode->workerPort)));
+				continue;
 			}
-			else
+
+			bool batchDropped = false;
+			if (nodeCleanupState->batchSent)
 			{
-				ereport(LOG, (errmsg("cleaned up orphaned shard %s on %s:%d which "
-									 "was left behind after a failed operation",
-									 qualifiedTableName,
-									 workerNode->workerName, workerNode->workerPort)));
+				bool raiseErrors = false;
+				batchDropped = ClearResultsDiscardWarnings(connection, raiseErrors);
+				ForgetResults(connection);
 			}
 
-			/* delete the cleanup record */
-			DeleteCleanupRecordByRecordId(record->recordId);
-			removedShardCountForCleanup++;
+			CleanupRecord *record = NULL;
+			foreach_ptr(record, batchRecordList)
+			{
+				if (batchDropped ||
+					TryDropShardOutsideTransaction(record->operationId,
+												   record->objectName,
+												   workerNode->workerName,
+												   workerNode->workerPort))
+				{
+					LogDroppedOrphanedShard(record, workerNode);
+					droppedRecordList = lappend(droppedRecordList, record);
+				}
+				else
+				{
+					/*
+					 * We log failures at the end, since they occur repeatedly
+					 * for a large number of objects.
+					 */
+					(*failedShardCount)++;
+				}
+			}
+
+			if (nodeCleanupState->nextRecordIndex <
+				list_length(nodeCleanupState->recordList))
+			{
+				recordsLeft = true;
+			}
 		}
-		else
+	}
+
+	return droppedRecordList;
+}
+
+
+/*
+ * NextCleanupBatch returns the next at most CLEANUP_DROP_BATCH_SIZE records
+ * to drop on the node, or NIL if all of them were dropped.
+ */
+static List *
+NextCleanupBatch(NodeCleanupState *nodeCleanupState)
+{
+	List *batchRecordList = NIL;
+	int recordCount = list_length(nodeCleanupState->recordList);
+
+	while (nodeCleanupState->nextRecordIndex < recordCount &&
+		   list_length(batchRecordList) < CLEANUP_DROP_BATCH_SIZE)
+	{
+		CleanupRecord *record = list_nth(nodeCleanupState->recordList,
+										 nodeCleanupState->nextRecordIndex);
+		batchRecordList = lappend(batchRecordList, record);
+		nodeCleanupState->nextRecordIndex++;
+	}
+
+	return batchRecordList;
+}
+
+
+/*
+ * DropOrphanedShardBatchCommand returns the command that drops the shards of
+ * the given records in a single transaction on their node. As in
+ * TryDropShardOutsideTransaction, a lock_timeout prevents us from getting
+ * blocked by queries that still run on the shards.
+ */
+static char *
+DropOrphanedShardBatchCommand(List *recordList)
+{
+	StringInfo command = makeStringInfo();
+	appendStringInfoString(command, "SET LOCAL lock_timeout TO '1s'; "
+									"DROP TABLE IF EXISTS ");
+
+	CleanupRecord *record = NULL;
+	foreach_ptr(record, recordList)
+	{
+		if (record != linitial(recordList))
 		{
-			/*
-			 * We log failures at the end, since they occur repeatedly
-			 * for a large number of objects.
-			 */
-			failedShardCountForCleanup++;
+			appendStringInfoString(command, ", ");
 		}
+
+		appendStringInfoString(command, record->objectName);
 	}
 
-	if (failedShardCountForCleanup > 0)
+	appendStringInfoString(command, " CASCADE");
+
+	return command->data;
+}
+
+
+/*
+ * LogDroppedOrphanedShard logs that the shard of the given cleanup record was
+ * dropped on the given node.
+ */
+static void
+LogDroppedOrphanedShard(CleanupRecord *record, WorkerNode *workerNode)
+{
+	if (record->policy == CLEANUP_DEFERRED_ON_SUCCESS)
 	{
-		ereport(WARNING, (errmsg("failed to clean up %d orphaned shards out of %d",
-								 failedShardCountForCleanup,
-								 list_length(cleanupRecordList))));
+		ereport(LOG, (errmsg("deferred drop of orphaned shard %s on %s:%d "
+							 "completed",
+							 record->objectName,
+							 workerNode->workerName, workerNode->workerPort)));
+	}
+	else
+	{
+		ereport(LOG, (errmsg("cleaned up orphaned shard %s on %s:%d which "
+							 "was left behind after a failed operation",
+							 record->objectName,
+							 workerNode->workerName, workerNode->workerPort)));
 	}
-
-	return removedShardCountForCleanup;
 }
 
 
@@ -1040,6 +1260,53 @@ DeleteCleanupRecordByRecordId(uint64 recordId)
 }
 
 
+/*
+ * DeleteCleanupRecordList deletes the pg_dist_cleanup entries of the given
+ * cleanup records.
+ */
+static void
+DeleteCleanupRecordList(List *recordList)
+{
+	if (recordList == NIL)
+	{
+		return;
+	}
+
+	Relation pgDistCleanup = table_open(DistCleanupRelationId(),
+										RowExclusiveLock);
+
+	CleanupRecord *record = NULL;
+	foreach_ptr(record, recordList)
+	{
+		const int scanKeyCount = 1;
+		ScanKeyData scanKey[1];
+		bool indexOK = true;
+
+		ScanKeyInit(&scanKey[0], Anum_pg_dist_cleanup_record_id,
+					BTEqualStrategyNumber, F_INT8EQ, UInt64GetDatum(record->recordId));
+
+		SysScanDesc scanDescriptor = systable_beginscan(pgDistCleanup,
+														DistCleanupPrimaryKeyIndexId(),
+														indexOK,
+														NULL, scanKeyCount, scanKey);
+
+		HeapTuple heapTuple = systable_getnext(scanDescriptor);
+		if (heapTuple == NULL)
+		{
+			ereport(ERROR, (errmsg("could not find cleanup record " UINT64_FORMAT,
+								   record->recordId)));
+		}
+
+		simple_heap_delete(pgDistCleanup, &heapTuple->t_self);
+
+		systable_endscan(scanDescriptor);
+	}
+
+	CommandCounterIncrement();
+	table_close(pgDistCleanup, NoLock);
+}
+
+
 /*
  * GetNextCleanupRecordId allocates and returns a unique recordid for a cleanup entry.
  * This allocation occurs both in shared memory and
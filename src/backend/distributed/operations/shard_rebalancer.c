@@ -42,10 +42,13 @@
 #include "distributed/multi_progress.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/pg_dist_rebalance_strategy.h"
+#include "distributed/priority.h"
 #include "distributed/reference_table_utils.h"
 #include "distributed/remote_commands.h"
 #include "distributed/resource_lock.h"
+#include "distributed/shard_access_stats.h"
 #include "distributed/shard_rebalancer.h"
+#include "distributed/shard_size_cache.h"
 #include "distributed/shard_cleaner.h"
 #include "distributed/shard_transfer.h"
 #include "distributed/tuplestore.h"
@@ -190,6 +193,32 @@ typedef struct WorkerShardStatistics
 	HTAB *statistics;
 } WorkerShardStatistics;
 
+/* ShardMoveDependencyInfo holds the latest scheduled move of a co-location group */
+typedef struct ShardMoveDependencyInfo
+{
+	uint32 colocationId;
+	int64 taskId;
+} ShardMoveDependencyInfo;
+
+/* ShardMoveSourceNodeHashEntry holds the scheduled moves away from a node */
+typedef struct ShardMoveSourceNodeHashEntry
+{
+	int32 nodeId;
+
+	/* list of int64 * task ids */
+	List *taskIds;
+} ShardMoveSourceNodeHashEntry;
+
+/*
+ * ShardMoveDependencies tracks which earlier scheduled moves a move of a background
+ * rebalance has to wait for.
+ */
+typedef struct ShardMoveDependencies
+{
+	HTAB *colocationDependencies;
+	HTAB *nodeDependencies;
+} ShardMoveDependencies;
+
 char *VariablesToBePassedToNewConnections = NULL;
 
 /* static declarations for main logic */
@@ -230,6 +259,15 @@ static int CompareShardCostAsc(const void *void1, const void *void2);
 static int CompareShardCostDesc(const void *void1, const void *void2);
 static int CompareDisallowedPlacementAsc(const void *void1, const void *void2);
 static int CompareDisallowedPlacementDesc(const void *void1, const void *void2);
+static int SortedListPosition(List *sortedList, void *pointer,
+							  int (*compare)(const void *, const void *));
+static List * SortedListInsert(List *sortedList, void *pointer,
+							   int (*compare)(const void *, const void *));
+static List * SortedListDelete(List *sortedList, void *pointer,
+							   int (*compare)(const void *, const void *));
+static void RepositionFillState(RebalanceState *state, NodeFillState *fillState);
+static int FirstShardCostFittingTarget(NodeFillState *sourceFillState,
+									   NodeFillState *targetFillState);
 static bool ShardAllowedOnNode(uint64 shardId, WorkerNode *workerNode, void *context);
 static float4 NodeCapacity(WorkerNode *workerNode, void *context);
 static ShardCost GetShardCost(uint64 shardId, void *context);
@@ -237,6 +275,15 @@ static List * NonColocatedDistRelationIdList(void);
 static void RebalanceTableShards(RebalanceOptions *options, Oid shardReplicationModeOid);
 static int64 RebalanceTableShardsBackground(RebalanceOptions *options, Oid
 											shardReplicationModeOid);
+static ShardMoveDependencies InitializeShardMoveDependencies(void);
+static int64 * GenerateTaskMoveDependencyList(PlacementUpdateEvent *move,
+											  uint32 colocationId,
+											  ShardMoveDependencies shardMoveDependencies,
+											  int64 replicateReferenceTablesTaskId,
+											  int *nDepends);
+static void UpdateShardMoveDependencies(PlacementUpdateEvent *move, uint32 colocationId,
+										int64 taskId,
+										ShardMoveDependencies shardMoveDependencies);
 static void AcquireRebalanceColocationLock(Oid relationId, const char *operationName);
 static void ExecutePlacementUpdates(List *placementUpdateList, Oid
 									shardReplicationModeOid, char *noticeOperation);
@@ -270,6 +317,7 @@ PG_FUNCTION_INFO_V1(get_rebalance_progress);
 PG_FUNCTION_INFO_V1(citus_drain_node);
 PG_FUNCTION_INFO_V1(master_drain_node);
 PG_FUNCTION_INFO_V1(citus_shard_cost_by_disk_size);
+PG_FUNCTION_INFO_V1(citus_shard_cost_by_load);
 PG_FUNCTION_INFO_V1(citus_validate_rebalance_strategy_functions);
 PG_FUNCTION_INFO_V1(pg_dist_rebalance_strategy_enterprise_check);
 PG_FUNCTION_INFO_V1(citus_rebalance_start);
@@ -403,11 +451,11 @@ FullShardPlacementList(Oid relationId, ArrayType *excludedShardArray)
 	for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
 	{
 		ShardInterval *shardInterval =
-			citusTableCacheEntry->sortedShardIntervalArray[shardIndex];
+			GetCachedShardInterval(citusTableCacheEntry, shardIndex);
+		int numberOfPlacements = 0;
 		GroupShardPlacement *placementArray =
-			citusTableCacheEntry->arrayOfPlacementArrays[shardIndex];
-		int numberOfPlacements =
-			citusTableCacheEntry->arrayOfPlacementArrayLengths[shardIndex];
+			GetCachedShardPlacementArray(citusTableCacheEntry, shardIndex,
+										 &numberOfPlacements);
 
 		if (BigIntArrayDatumContains(excludedShardArrayDatum, excludedShardIdCount,
 									 shardInterval->shardId))
@@ -580,6 +628,8 @@ GetShardCost(uint64 shardId, void *voidContext)
  * size of the shard on a worker. The worker to check the disk size is
  * determined by choosing the first active placement for the shard. The disk
  * size is calculated using pg_total_relation_size, so it includes indexes.
+ * When the shard sizes are cached by the maintenance daemon, the cached sizes
+ * are used instead.
  *
  * SQL signature:
  * citus_shard_cost_by_disk_size(shardid bigint) returns float4
@@ -599,9 +649,14 @@ citus_shard_cost_by_disk_size(PG_FUNCTION_ARGS)
 	ShardInterval *shardInterval = LoadShardInterval(shardId);
 	List *colocatedShardList = ColocatedNonPartitionShardIntervalList(shardInterval);
 
-	uint64 colocationSizeInBytes = ShardListSizeInBytes(colocatedShardList,
-														shardPlacement->nodeName,
-														shardPlacement->nodePort);
+	uint64 colocationSizeInBytes = 0;
+	if (!CachedShardListSize(colocatedShardList, shardPlacement->groupId,
+							 &colocationSizeInBytes))
+	{
+		colocationSizeInBytes = ShardListSizeInBytes(colocatedShardList,
+													 shardPlacement->nodeName,
+													 shardPlacement->nodePort);
+	}
 
 	MemoryContextSwitchTo(oldContext);
 	MemoryContextReset(localContext);
@@ -615,6 +670,47 @@ citus_shard_cost_by_disk_size(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * citus_shard_cost_by_load gets the cost for a shard based on the recent
+ * execution time of the tasks on the shard and its colocated shards, as
+ * tracked in the shard access statistics on this node. Every shard costs at
+ * least 1, such that shards that are not queried are still spread evenly.
+ *
+ * SQL signature:
+ * citus_shard_cost_by_load(shardid bigint) returns float4
+ */
+Datum
+citus_shard_cost_by_load(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+	uint64 shardId = PG_GETARG_INT64(0);
+	double colocationExecutionTimeMs = 0;
+
+	MemoryContext localContext = AllocSetContextCreate(CurrentMemoryContext,
+													   "CostByLoadContext",
+													   ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(localContext);
+	ShardInterval *shardInterval = LoadShardInterval(shardId);
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		ShardAccessStats stats;
+
+		if (GetShardAccessStats(colocatedShard->shardId, &stats))
+		{
+			colocationExecutionTimeMs += stats.executionTimeMs;
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextReset(localContext);
+
+	PG_RETURN_FLOAT4(1 + colocationExecutionTimeMs);
+}
+
+
 /*
  * GetColocatedRebalanceSteps takes a List of PlacementUpdateEvents and creates
  * a new List of containing those and all the updates for colocated shards.
@@ -1850,10 +1946,139 @@ ErrorOnConcurrentRebalance(RebalanceOptions *options)
 }
 
 
+/*
+ * InitializeShardMoveDependencies creates the hashes used to track which earlier
+ * scheduled moves a move of a background rebalance has to wait for.
+ */
+static ShardMoveDependencies
+InitializeShardMoveDependencies(void)
+{
+	ShardMoveDependencies shardMoveDependencies;
+	shardMoveDependencies.colocationDependencies =
+		CreateSimpleHashWithNameAndSize(uint32, ShardMoveDependencyInfo,
+										"colocationDependencyHashMap", 6);
+	shardMoveDependencies.nodeDependencies =
+		CreateSimpleHashWithNameAndSize(int32, ShardMoveSourceNodeHashEntry,
+										"nodeDependencyHashMap", 6);
+
+	return shardMoveDependencies;
+}
+
+
+/*
+ * GenerateTaskMoveDependencyList returns the ids of the earlier scheduled tasks the
+ * given move has to wait for, and sets nDepends to their number. Moves that do not
+ * depend on each other can run concurrently. A move depends on
+ *  - the task replicating reference tables, if any,
+ *  - the previous move in the same co-location group, as co-located shards move
+ *    together and moves in a co-location group cannot run concurrently,
+ *  - the earlier moves away from its target node, as those make room on the node
+ *    that the plan counted on.
+ */
+static int64 *
+GenerateTaskMoveDependencyList(PlacementUpdateEvent *move, uint32 colocationId,
+							   ShardMoveDependencies shardMoveDependencies,
+							   int64 replicateReferenceTablesTaskId, int *nDepends)
+{
+	List *dependingTaskIdList = NIL;
+	bool found = false;
+
+	if (replicateReferenceTablesTaskId > 0)
+	{
+		int64 *taskId = palloc0(sizeof(int64));
+		*taskId = replicateReferenceTablesTaskId;
+		dependingTaskIdList = lappend(dependingTaskIdList, taskId);
+	}
+
+	ShardMoveDependencyInfo *shardMoveDependencyInfo =
+		hash_search(shardMoveDependencies.colocationDependencies, &colocationId,
+					HASH_FIND, &found);
+	if (found)
+	{
+		dependingTaskIdList = lappend(dependingTaskIdList,
+									  &shardMoveDependencyInfo->taskId);
+	}
+
+	int32 targetNodeId = move->targetNode->nodeId;
+	ShardMoveSourceNodeHashEntry *shardMoveSourceNodeHashEntry =
+		hash_search(shardMoveDependencies.nodeDependencies, &targetNodeId, HASH_FIND,
+					&found);
+	if (found)
+	{
+		dependingTaskIdList = list_concat(dependingTaskIdList,
+										  shardMoveSourceNodeHashEntry->taskIds);
+	}
+
+	/* a task cannot depend on the same task twice */
+	int64 *dependingTaskIds = palloc0(Max(list_length(dependingTaskIdList), 1) *
+									  sizeof(int64));
+	int dependingTaskCount = 0;
+
+	int64 *taskId = NULL;
+	foreach_ptr(taskId, dependingTaskIdList)
+	{
+		bool duplicate = false;
+		for (int taskIndex = 0; taskIndex < dependingTaskCount; taskIndex++)
+		{
+			if (dependingTaskIds[taskIndex] == *taskId)
+			{
+				duplicate = true;
+				break;
+			}
+		}
+
+		if (!duplicate)
+		{
+			dependingTaskIds[dependingTaskCount] = *taskId;
+			dependingTaskCount++;
+		}
+	}
+
+	*nDepends = dependingTaskCount;
+
+	return dependingTaskIds;
+}
+
+
+/*
+ * UpdateShardMoveDependencies records the task of the given move as the latest move in
+ * its co-location group and as a move away from its source node.
+ */
+static void
+UpdateShardMoveDependencies(PlacementUpdateEvent *move, uint32 colocationId,
+							int64 taskId, ShardMoveDependencies shardMoveDependencies)
+{
+	bool found = false;
+
+	ShardMoveDependencyInfo *shardMoveDependencyInfo =
+		hash_search(shardMoveDependencies.colocationDependencies, &colocationId,
+					HASH_ENTER, &found);
+	shardMoveDependencyInfo->taskId = taskId;
+
+	int32 sourceNodeId = move->sourceNode->nodeId;
+	ShardMoveSourceNodeHashEntry *shardMoveSourceNodeHashEntry =
+		hash_search(shardMoveDependencies.nodeDependencies, &sourceNodeId, HASH_ENTER,
+					&found);
+	if (!found)
+	{
+		shardMoveSourceNodeHashEntry->taskIds = NIL;
+	}
+
+	int64 *sourceTaskId = palloc0(sizeof(int64));
+	*sourceTaskId = taskId;
+	shardMoveSourceNodeHashEntry->taskIds =
+		lappend(shardMoveSourceNodeHashEntry->taskIds, sourceTaskId);
+}
+
+
 /*
  * RebalanceTableShardsBackground rebalances the shards for the relations
  * inside the relationIdList across the different workers. It does so using our
  * background job+task infrastructure.
+ *
+ * The moves are scheduled as a dependency graph rather than a chain, such that the
+ * background task queue monitor can run moves of different co-location groups between
+ * different nodes concurrently.
  */
 static int64
 RebalanceTableShardsBackground(RebalanceOptions *options, Oid shardReplicationModeOid)
@@ -1916,15 +2141,10 @@ RebalanceTableShardsBackground(RebalanceOptions *options, Oid shardReplicationMo
 	initStringInfo(&buf);
 
 	/*
-	 * Currently we only have two tasks that any move can depend on:
-	 *  - replicating reference tables
-	 *  - the previous move
-	 *
-	 * prevJobIdx tells what slot to write the id of the task into. We only use both slots
-	 * if we are actually replicating reference tables.
+	 * Replicating reference tables needs to happen before any move, every move depends
+	 * on it if it is scheduled.
 	 */
-	int64 prevJobId[2] = { 0 };
-	int prevJobIdx = 0;
+	int64 replicateReferenceTablesTaskId = 0;
 
 	List *referenceTableIdList = NIL;
 
@@ -1939,15 +2159,14 @@ RebalanceTableShardsBackground(RebalanceOptions *options, Oid shardReplicationMo
 		appendStringInfo(&buf,
 						 "SELECT pg_catalog.replicate_reference_tables(%s)",
 						 quote_literal_cstr(shardTranferModeLabel));
-		BackgroundTask *task = ScheduleBackgroundTask(jobId, GetUserId(), buf.data,
-													  prevJobIdx, prevJobId);
-		prevJobId[prevJobIdx] = task->taskid;
-		prevJobIdx++;
+		BackgroundTask *task = ScheduleBackgroundTask(jobId, GetUserId(), buf.data, 0,
+													  NULL, 0, NULL);
+		replicateReferenceTablesTaskId = task->taskid;
 	}
 
+	ShardMoveDependencies shardMoveDependencies = InitializeShardMoveDependencies();
+
 	PlacementUpdateEvent *move = NULL;
-	bool first = true;
-	int prevMoveIndex = prevJobIdx;
 	foreach_ptr(move, placementUpdateList)
 	{
 		resetStringInfo(&buf);
@@ -1961,14 +2180,27 @@ RebalanceTableShardsBackground(RebalanceOptions *options, Oid shardReplicationMo
 						 move->targetNode->workerPort,
 						 quote_literal_cstr(shardTranferModeLabel));
 
+		uint32 colocationId = TableColocationId(RelationIdForShard(move->shardId));
+
+		int dependingTaskCount = 0;
+		int64 *dependingTaskIds =
+			GenerateTaskMoveDependencyList(move, colocationId, shardMoveDependencies,
+										   replicateReferenceTablesTaskId,
+										   &dependingTaskCount);
+
+		int32 nodesInvolved[] = {
+			move->sourceNode->nodeId,
+			move->targetNode->nodeId
+		};
+
 		BackgroundTask *task = ScheduleBackgroundTask(jobId, GetUserId(), buf.data,
-													  prevJobIdx, prevJobId);
-		prevJobId[prevMoveIndex] = task->taskid;
-		if (first)
-		{
-			first = false;
-			prevJobIdx++;
-		}
+													  dependingTaskCount,
+													  dependingTaskIds,
+													  lengthof(nodesInvolved),
+													  nodesInvolved);
+
+		UpdateShardMoveDependencies(move, colocationId, task->taskid,
+									shardMoveDependencies);
 	}
 
 	ereport(NOTICE,
@@ -2099,6 +2331,15 @@ ExecuteRebalancerCommandInSeparateTransaction(char *command)
 		}
 	}
 
+	if (IoPriorityBackgroundOperations != IO_PRIORITY_INHERIT)
+	{
+		commandList = lappend(commandList,
+							  psprintf("SET LOCAL citus.io_priority TO %s;",
+									   GetConfigOption(
+										   "citus.io_priority_for_background_operations",
+										   false, false)));
+	}
+
 	commandList = lappend(commandList, command);
 
 	SendCommandListToWorkerOutsideTransactionWithConnection(connection, commandList);
@@ -2302,8 +2543,6 @@ InitRebalanceState(List *workerNodeList, List *shardPlacementList,
 													  fillState->capacity);
 		fillState->shardCostListDesc = lappend(fillState->shardCostListDesc,
 											   shardCost);
-		fillState->shardCostListDesc = SortList(fillState->shardCostListDesc,
-												CompareShardCostDesc);
 
 		state->totalCost += shardCost->cost;
 
@@ -2319,6 +2558,14 @@ InitRebalanceState(List *workerNodeList, List *shardPlacementList,
 	}
 	foreach_htab_cleanup(placement, &status);
 
+	/* sort the shards of each node only once, not after every placement */
+	NodeFillState *nodeFillState = NULL;
+	foreach_ptr(nodeFillState, state->fillStateListAsc)
+	{
+		nodeFillState->shardCostListDesc = SortList(nodeFillState->shardCostListDesc,
+													CompareShardCostDesc);
+	}
+
 	state->fillStateListAsc = SortList(state->fillStateListAsc, CompareNodeFillStateAsc);
 	state->fillStateListDesc = SortList(state->fillStateListDesc,
 										CompareNodeFillStateDesc);
@@ -2538,13 +2785,100 @@ FindAllowedTargetFillState(RebalanceState *state, uint64 shardId)
 }
 
 
+/*
+ * SortedListPosition returns the position of the first element in a list that
+ * is sorted according to compare which does not sort before the given
+ * pointer. This is the position of the pointer itself when it is in the list,
+ * because the comparison functions of the rebalancer define a total order.
+ */
+static int
+SortedListPosition(List *sortedList, void *pointer,
+				   int (*compare)(const void *, const void *))
+{
+	int lowerBound = 0;
+	int upperBound = list_length(sortedList);
+
+	while (lowerBound < upperBound)
+	{
+		int middle = lowerBound + (upperBound - lowerBound) / 2;
+		void *middlePointer = list_nth(sortedList, middle);
+
+		if (compare(&middlePointer, &pointer) < 0)
+		{
+			lowerBound = middle + 1;
+		}
+		else
+		{
+			upperBound = middle;
+		}
+	}
+
+	return lowerBound;
+}
+
+
+/*
+ * SortedListInsert inserts the pointer into a list that is sorted according
+ * to compare, such that the list stays sorted.
+ */
+static List *
+SortedListInsert(List *sortedList, void *pointer,
+				 int (*compare)(const void *, const void *))
+{
+	int position = SortedListPosition(sortedList, pointer, compare);
+
+	return list_insert_nth(sortedList, position, pointer);
+}
+
+
+/*
+ * SortedListDelete removes the pointer from a list that is sorted according
+ * to compare.
+ */
+static List *
+SortedListDelete(List *sortedList, void *pointer,
+				 int (*compare)(const void *, const void *))
+{
+	int position = SortedListPosition(sortedList, pointer, compare);
+
+	if (position < list_length(sortedList) && list_nth(sortedList, position) == pointer)
+	{
+		return list_delete_nth_cell(sortedList, position);
+	}
+
+	/* only happens when compare is not a total order, e.g. with NaN costs */
+	return list_delete_ptr(sortedList, pointer);
+}
+
+
+/*
+ * RepositionFillState moves the fill state to its new position in
+ * fillStateListAsc and fillStateListDesc after its utilization changed.
+ */
+static void
+RepositionFillState(RebalanceState *state, NodeFillState *fillState)
+{
+	state->fillStateListAsc = list_delete_ptr(state->fillStateListAsc, fillState);
+	state->fillStateListAsc = SortedListInsert(state->fillStateListAsc, fillState,
+											   CompareNodeFillStateAsc);
+
+	state->fillStateListDesc = list_delete_ptr(state->fillStateListDesc, fillState);
+	state->fillStateListDesc = SortedListInsert(state->fillStateListDesc, fillState,
+												CompareNodeFillStateDesc);
+}
+
+
 /*
  * MoveShardCost moves a shardcost from the source to the target fill states
  * and updates the RebalanceState accordingly. What it does in detail is:
  * 1. add a placement update to state->placementUpdateList
  * 2. update state->placementsHash
  * 3. update totalcost, utilization and shardCostListDesc in source and target
- * 4. resort state->fillStateListAsc/Desc
+ * 4. reposition source and target in state->fillStateListAsc/Desc
+ *
+ * The shard cost and fill state lists are kept sorted by binary search
+ * insertion instead of resorting them, because the source node can have many
+ * thousands of shards.
  */
 static void
 MoveShardCost(NodeFillState *sourceFillState,
@@ -2572,25 +2906,75 @@ MoveShardCost(NodeFillState *sourceFillState,
 	sourceFillState->totalCost -= shardCost->cost;
 	sourceFillState->utilization = CalculateUtilization(sourceFillState->totalCost,
 														sourceFillState->capacity);
-	sourceFillState->shardCostListDesc = list_delete_ptr(
+	sourceFillState->shardCostListDesc = SortedListDelete(
 		sourceFillState->shardCostListDesc,
-		shardCost);
+		shardCost, CompareShardCostDesc);
 
 	targetFillState->totalCost += shardCost->cost;
 	targetFillState->utilization = CalculateUtilization(targetFillState->totalCost,
 														targetFillState->capacity);
-	targetFillState->shardCostListDesc = lappend(targetFillState->shardCostListDesc,
-												 shardCost);
-	targetFillState->shardCostListDesc = SortList(targetFillState->shardCostListDesc,
-												  CompareShardCostDesc);
+	targetFillState->shardCostListDesc = SortedListInsert(
+		targetFillState->shardCostListDesc,
+		shardCost, CompareShardCostDesc);
 
-	state->fillStateListAsc = SortList(state->fillStateListAsc, CompareNodeFillStateAsc);
-	state->fillStateListDesc = SortList(state->fillStateListDesc,
-										CompareNodeFillStateDesc);
+	RepositionFillState(state, sourceFillState);
+	RepositionFillState(state, targetFillState);
 	CheckRebalanceStateInvariants(state);
 }
 
 
+/*
+ * FirstShardCostFittingTarget returns the position of the first shard in the
+ * shardCostListDesc of the source that does not make the target more utilized
+ * than the source is now. FindAndMoveShardCost never moves the shards before
+ * that position, since moving them would only make the balance worse. Because
+ * the shards are sorted by descending cost, the position can be found with a
+ * binary search instead of trying all those shards.
+ */
+static int
+FirstShardCostFittingTarget(NodeFillState *sourceFillState,
+							NodeFillState *targetFillState)
+{
+	List *shardCostList = sourceFillState->shardCostListDesc;
+	int shardCostCount = list_length(shardCostList);
+
+	if (shardCostCount == 0)
+	{
+		return 0;
+	}
+
+	/* with negative costs the utilization is not monotonic in the cost */
+	ShardCost *lowestShardCost = llast(shardCostList);
+	if (lowestShardCost->cost < 0)
+	{
+		return 0;
+	}
+
+	int lowerBound = 0;
+	int upperBound = shardCostCount;
+
+	while (lowerBound < upperBound)
+	{
+		int middle = lowerBound + (upperBound - lowerBound) / 2;
+		ShardCost *shardCost = list_nth(shardCostList, middle);
+		float4 newTargetUtilization =
+			CalculateUtilization(targetFillState->totalCost + shardCost->cost,
+								 targetFillState->capacity);
+
+		if (newTargetUtilization > sourceFillState->utilization)
+		{
+			lowerBound = middle + 1;
+		}
+		else
+		{
+			upperBound = middle;
+		}
+	}
+
+	return lowerBound;
+}
+
+
 /*
  * FindAndMoveShardCost is the main rebalancing algorithm. This takes the
  * current state and returns a list with a new move appended that improves the
@@ -2671,9 +3055,17 @@ FindAndMoveShardCost(float4 utilizationLowerBound,
 			}
 
 			/* find a shardcost that can be moved between between nodes that
-			 * makes the cost distribution more equal */
-			foreach_ptr(shardCost, sourceFillState->shardCostListDesc)
+			 * makes the cost distribution more equal, skipping the shards
+			 * that are too big for the target right away */
+			int shardCostCount = list_length(sourceFillState->shardCostListDesc);
+			int shardCostIndex = FirstShardCostFittingTarget(sourceFillState,
+															 targetFillState);
+
+			for (; shardCostIndex < shardCostCount; shardCostIndex++)
 			{
+				shardCost = list_nth(sourceFillState->shardCostListDesc,
+									 shardCostIndex);
+
 				bool targetHasShard = PlacementsHashFind(state->placementsHash,
 														 shardCost->shardId,
 														 targetFillState->node);
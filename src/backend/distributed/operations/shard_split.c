@@ -44,6 +44,8 @@
 #include "distributed/shardsplit_logical_replication.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/shard_rebalancer.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/pg_version_constants.h"
 #include "postmaster/postmaster.h"
 
 /*
@@ -67,6 +69,15 @@ typedef struct GroupedDummyShards
 	List *shardIntervals;
 } GroupedDummyShards;
 
+/*
+ * Minimum number of blocks each of the concurrent copies of a shard copies,
+ * such that only large shards are divided.
+ */
+#define SPLIT_COPY_MIN_BLOCKS_PER_RANGE 16384
+
+/* GUC, number of concurrent copies into which the copy of a large shard is divided */
+int SplitCopyParallelism = 1;
+
 /* Function declarations */
 static void ErrorIfCannotSplitShard(SplitOperation splitOperation,
 									ShardInterval *sourceShard);
@@ -119,7 +130,11 @@ static void DoSplitCopy(WorkerNode *sourceShardNode,
 static StringInfo CreateSplitCopyCommand(ShardInterval *sourceShardSplitInterval,
 										 char *distributionColumnName,
 										 List *splitChildrenShardIntervalList,
-										 List *workersForPlacementList);
+										 List *workersForPlacementList,
+										 int64 startBlock, int64 endBlock);
+static int SplitCopyBlockRangeCount(WorkerNode *sourceShardNode,
+									ShardInterval *sourceShardInterval,
+									int64 *blockCount);
 static Task * CreateSplitCopyTask(StringInfo splitCopyUdfCommand, char *snapshotName, int
 								  taskId, uint64 jobId);
 static void UpdateDistributionColumnsForShardGroup(List *colocatedShardList,
@@ -901,23 +916,46 @@ DoSplitCopy(WorkerNode *sourceShardNode, List *sourceColocatedShardIntervalList,
 												   distributionColumn->varattno,
 												   missingOK);
 
-		StringInfo splitCopyUdfCommand = CreateSplitCopyCommand(
-			sourceShardIntervalToCopy,
-			distributionColumnName,
-			splitShardIntervalList,
-			destinationWorkerNodesList);
+		/*
+		 * Large shards are copied by several concurrent tasks that each copy
+		 * a range of blocks to all split children. All tasks use the same
+		 * snapshot, such that each tuple is copied exactly once.
+		 */
+		int64 blockCount = 0;
+		int rangeCount = SplitCopyBlockRangeCount(sourceShardNode,
+												  sourceShardIntervalToCopy,
+												  &blockCount);
+
+		for (int rangeIndex = 0; rangeIndex < rangeCount; rangeIndex++)
+		{
+			int64 startBlock = rangeIndex * blockCount / rangeCount;
+
+			/* the last range also covers blocks that were added since */
+			int64 endBlock = -1;
+			if (rangeIndex < rangeCount - 1)
+			{
+				endBlock = (rangeIndex + 1) * blockCount / rangeCount;
+			}
 
-		/* Create copy task. Snapshot name is required for nonblocking splits */
-		Task *splitCopyTask = CreateSplitCopyTask(splitCopyUdfCommand, snapShotName,
-												  taskId,
-												  sourceShardIntervalToCopy->shardId);
+			StringInfo splitCopyUdfCommand = CreateSplitCopyCommand(
+				sourceShardIntervalToCopy,
+				distributionColumnName,
+				splitShardIntervalList,
+				destinationWorkerNodesList,
+				startBlock, endBlock);
 
-		ShardPlacement *taskPlacement = CitusMakeNode(ShardPlacement);
-		SetPlacementNodeMetadata(taskPlacement, sourceShardNode);
-		splitCopyTask->taskPlacementList = list_make1(taskPlacement);
+			/* Create copy task. Snapshot name is required for nonblocking splits */
+			Task *splitCopyTask = CreateSplitCopyTask(splitCopyUdfCommand, snapShotName,
+													  taskId,
+													  sourceShardIntervalToCopy->shardId);
 
-		splitCopyTaskList = lappend(splitCopyTaskList, splitCopyTask);
-		taskId++;
+			ShardPlacement *taskPlacement = CitusMakeNode(ShardPlacement);
+			SetPlacementNodeMetadata(taskPlacement, sourceShardNode);
+			splitCopyTask->taskPlacementList = list_make1(taskPlacement);
+
+			splitCopyTaskList = lappend(splitCopyTaskList, splitCopyTask);
+			taskId++;
+		}
 	}
 
 	ExecuteTaskListOutsideTransaction(ROW_MODIFY_NONE, splitCopyTaskList,
@@ -926,11 +964,65 @@ DoSplitCopy(WorkerNode *sourceShardNode, List *sourceColocatedShardIntervalList,
 }
 
 
+/*
+ * SplitCopyBlockRangeCount returns the number of concurrent tasks into which
+ * the copy of the given source shard is divided, based on
+ * citus.split_copy_parallelism and the number of blocks of the shard, which it
+ * stores in blockCount. Dividing the copy requires TID range scans, which are
+ * available from PostgreSQL 14 on.
+ */
+static int
+SplitCopyBlockRangeCount(WorkerNode *sourceShardNode, ShardInterval *sourceShardInterval,
+						 int64 *blockCount)
+{
+	*blockCount = 0;
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+	if (SplitCopyParallelism <= 1)
+	{
+		return 1;
+	}
+
+	StringInfo blockCountQuery = makeStringInfo();
+	appendStringInfo(blockCountQuery,
+					 "SELECT pg_relation_size(%s) / current_setting('block_size')::bigint",
+					 quote_literal_cstr(ConstructQualifiedShardName(sourceShardInterval)));
+
+	int connectionFlags = 0;
+	MultiConnection *connection = GetNodeConnection(connectionFlags,
+													sourceShardNode->workerName,
+													sourceShardNode->workerPort);
+	PGresult *result = NULL;
+	if (ExecuteOptionalRemoteCommand(connection, blockCountQuery->data, &result) != 0)
+	{
+		/* copy the shard in a single task, which reports errors properly */
+		return 1;
+	}
+
+	if (PQntuples(result) == 1 && !PQgetisnull(result, 0, 0))
+	{
+		*blockCount = (int64) SafeStringToUint64(PQgetvalue(result, 0, 0));
+	}
+
+	PQclear(result);
+	ForgetResults(connection);
+
+	int64 rangeCount = Min(SplitCopyParallelism,
+						   *blockCount / SPLIT_COPY_MIN_BLOCKS_PER_RANGE);
+
+	return (int) Max(rangeCount, 1);
+#else
+	return 1;
+#endif
+}
+
+
 /*
  * Create Copy command for a given shard source shard to be copied to corresponding split children.
  * 'sourceShardSplitInterval' : Source shard interval to be copied.
  * 'splitChildrenShardINnerIntervalList' : List of shard intervals for split children.
  * 'destinationWorkerNodesList' : List of workers for split children placement.
+ * 'startBlock', 'endBlock' : Range of blocks to copy, 0 and -1 for all blocks.
  * Here is an example of a 2 way split copy :
  * SELECT * from worker_split_copy(
  *  81060000, -- source shard id to split copy
@@ -952,7 +1044,8 @@ static StringInfo
 CreateSplitCopyCommand(ShardInterval *sourceShardSplitInterval,
 					   char *distributionColumnName,
 					   List *splitChildrenShardIntervalList,
-					   List *destinationWorkerNodesList)
+					   List *destinationWorkerNodesList,
+					   int64 startBlock, int64 endBlock)
 {
 	StringInfo splitCopyInfoArray = makeStringInfo();
 	appendStringInfo(splitCopyInfoArray, "ARRAY[");
@@ -982,10 +1075,23 @@ CreateSplitCopyCommand(ShardInterval *sourceShardSplitInterval,
 	appendStringInfo(splitCopyInfoArray, "]");
 
 	StringInfo splitCopyUdf = makeStringInfo();
-	appendStringInfo(splitCopyUdf, "SELECT pg_catalog.worker_split_copy(%lu, %s, %s);",
-					 sourceShardSplitInterval->shardId,
-					 quote_literal_cstr(distributionColumnName),
-					 splitCopyInfoArray->data);
+	if (startBlock == 0 && endBlock == -1)
+	{
+		appendStringInfo(splitCopyUdf, "SELECT pg_catalog.worker_split_copy(%lu, %s, %s);",
+						 sourceShardSplitInterval->shardId,
+						 quote_literal_cstr(distributionColumnName),
+						 splitCopyInfoArray->data);
+	}
+	else
+	{
+		appendStringInfo(splitCopyUdf,
+						 "SELECT pg_catalog.worker_split_copy(%lu, %s, %s, "
+						 INT64_FORMAT ", " INT64_FORMAT ");",
+						 sourceShardSplitInterval->shardId,
+						 quote_literal_cstr(distributionColumnName),
+						 splitCopyInfoArray->data,
+						 startBlock, endBlock);
+	}
 
 	return splitCopyUdf;
 }
@@ -2147,6 +2253,7 @@ AddDummyShardEntryInMap(HTAB *mapOfPlacementToDummyShardList, uint32 targetNodeI
 	NodeAndOwner key;
 	key.nodeId = targetNodeId;
 	key.tableOwnerId = TableOwnerOid(shardInterval->relationId);
+	key.subscriptionIndex = 0;
 
 	bool found = false;
 	GroupedDummyShards *nodeMappingEntry =
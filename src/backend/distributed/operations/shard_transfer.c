@@ -42,6 +42,7 @@
 #include "distributed/shard_rebalancer.h"
 #include "distributed/shard_split.h"
 #include "distributed/shard_transfer.h"
+#include "distributed/utils/array_type.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/worker_transaction.h"
@@ -50,6 +51,7 @@
 #include "storage/lmgr.h"
 #include "storage/lock.h"
 #include "storage/lmgr.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
@@ -82,6 +84,8 @@ static void ReplicateColocatedShardPlacement(int64 shardId, char *sourceNodeName
 											 int32 sourceNodePort, char *targetNodeName,
 											 int32 targetNodePort,
 											 char shardReplicationMode);
+static void ReplicateReferenceTableShardToNodes(int64 shardId, List *targetNodeList,
+												char shardReplicationMode);
 static void CopyShardTables(List *shardIntervalList, char *sourceNodeName,
 							int32 sourceNodePort, char *targetNodeName,
 							int32 targetNodePort, bool useLogicalReplication);
@@ -126,11 +130,23 @@ static List * PostLoadShardCreationCommandList(ShardInterval *shardInterval,
 static ShardCommandList * CreateShardCommandList(ShardInterval *shardInterval,
 												 List *ddlCommandList);
 static char * CreateShardCopyCommand(ShardInterval *shard, WorkerNode *targetNode);
+static void CopyShardTablesToNodesViaBlockWrites(List *shardIntervalList,
+												 List *sourceNodeList,
+												 List *targetNodeList);
+static void CopyShardsToNodesAndCreatePostLoadObjects(List *sourceNodeList,
+													  List *targetNodeList,
+													  List *shardIntervalList);
+static List * CopyShardsToNodeTaskList(WorkerNode *sourceNode, WorkerNode *targetNode,
+									   List *shardIntervalList, char *snapshotName);
+static List * PostLoadShardCreationTaskList(List *shardIntervalList,
+											WorkerNode *sourceNode,
+											WorkerNode *targetNode);
 
 
 /* declarations for dynamic loading */
 PG_FUNCTION_INFO_V1(citus_copy_shard_placement);
 PG_FUNCTION_INFO_V1(master_copy_shard_placement);
+PG_FUNCTION_INFO_V1(citus_internal_copy_reference_tables);
 PG_FUNCTION_INFO_V1(citus_move_shard_placement);
 PG_FUNCTION_INFO_V1(master_move_shard_placement);
 
@@ -204,6 +220,40 @@ master_copy_shard_placement(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * citus_internal_copy_reference_tables copies the given reference table shard,
+ * including the shards of all other reference tables, to the given nodes. It is
+ * used when replicating reference tables to new nodes, see
+ * EnsureReferenceTablesExistOnAllNodesExtended.
+ */
+Datum
+citus_internal_copy_reference_tables(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	int64 shardId = PG_GETARG_INT64(0);
+	ArrayType *targetNodeIdArray = PG_GETARG_ARRAYTYPE_P(1);
+	Oid shardReplicationModeOid = PG_GETARG_OID(2);
+
+	char shardReplicationMode = LookupShardTransferMode(shardReplicationModeOid);
+
+	List *targetNodeList = NIL;
+	int targetNodeId = 0;
+	foreach_int(targetNodeId, IntegerArrayTypeToList(targetNodeIdArray))
+	{
+		bool missingOk = false;
+		WorkerNode *targetNode = FindNodeWithNodeId(targetNodeId, missingOk);
+
+		targetNodeList = lappend(targetNodeList, targetNode);
+	}
+
+	ReplicateReferenceTableShardToNodes(shardId, targetNodeList, shardReplicationMode);
+
+	PG_RETURN_VOID();
+}
+
+
 /*
  * citus_move_shard_placement moves given shard (and its co-located shards) from one
  * node to the other node. To accomplish this it entirely recreates the table structure
@@ -1095,6 +1145,188 @@ ReplicateColocatedShardPlacement(int64 shardId, char *sourceNodeName,
 }
 
 
+/*
+ * ReplicateReferenceTableShardToNodes copies the given reference table shard
+ * and its colocated shards to all given nodes at once. Copying to the nodes
+ * one by one would serialize on the colocation lock, so a single call copies
+ * the shards to all of them in parallel. The source of each copy is picked
+ * from the active placements in a round-robin fashion, such that the copies
+ * do not all read from the same node.
+ */
+static void
+ReplicateReferenceTableShardToNodes(int64 shardId, List *targetNodeList,
+									char shardReplicationMode)
+{
+	ShardInterval *shardInterval = LoadShardInterval(shardId);
+	Oid referenceTableId = shardInterval->relationId;
+
+	if (!IsCitusTableType(referenceTableId, REFERENCE_TABLE))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("shard " INT64_FORMAT " is not a reference table shard",
+							   shardId)));
+	}
+
+	EnsureNoModificationsHaveBeenDone();
+
+	AcquirePlacementColocationLock(referenceTableId, ExclusiveLock, "copy");
+
+	List *colocatedTableList = ColocatedTableList(referenceTableId);
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+
+	EnsureTableListOwner(colocatedTableList);
+	EnsureTableListSuitableForReplication(colocatedTableList);
+
+	/*
+	 * We sort shardIntervalList so that lock operations will not cause any
+	 * deadlocks.
+	 */
+	colocatedShardList = SortList(colocatedShardList, CompareShardIntervalsById);
+
+	List *sourcePlacementList = SortList(ActiveShardPlacementList(shardId),
+										 CompareShardPlacementsByGroupId);
+	if (sourcePlacementList == NIL)
+	{
+		ereport(ERROR, (errmsg("reference table shard " INT64_FORMAT
+							   " does not have an active shard placement",
+							   shardId)));
+	}
+
+	List *sourceNodeList = NIL;
+	List *copyTargetNodeList = NIL;
+	List *placementUpdateList = NIL;
+
+	WorkerNode *targetNode = NULL;
+	foreach_ptr(targetNode, targetNodeList)
+	{
+		ErrorIfTargetNodeIsNotSafeToCopyTo(targetNode->workerName,
+										   targetNode->workerPort);
+
+		if (IsShardListOnNode(colocatedShardList, targetNode->workerName,
+							  targetNode->workerPort))
+		{
+			/* a concurrent call might already have copied the shards */
+			continue;
+		}
+
+		int sourceIndex = list_length(sourceNodeList) %
+						  list_length(sourcePlacementList);
+		ShardPlacement *sourcePlacement = list_nth(sourcePlacementList, sourceIndex);
+
+		bool missingOk = false;
+		WorkerNode *sourceNode = FindNodeWithNodeId(sourcePlacement->nodeId, missingOk);
+
+		PlacementUpdateEvent *placementUpdateEvent =
+			palloc0(sizeof(PlacementUpdateEvent));
+		placementUpdateEvent->updateType = PLACEMENT_UPDATE_COPY;
+		placementUpdateEvent->shardId = shardId;
+		placementUpdateEvent->sourceNode = sourceNode;
+		placementUpdateEvent->targetNode = targetNode;
+
+		sourceNodeList = lappend(sourceNodeList, sourceNode);
+		copyTargetNodeList = lappend(copyTargetNodeList, targetNode);
+		placementUpdateList = lappend(placementUpdateList, placementUpdateEvent);
+	}
+
+	if (copyTargetNodeList == NIL)
+	{
+		return;
+	}
+
+	SetupRebalanceMonitor(placementUpdateList, referenceTableId,
+						  REBALANCE_PROGRESS_MOVING,
+						  PLACEMENT_UPDATE_STATUS_SETTING_UP);
+
+	bool useLogicalReplication = CanUseLogicalReplication(referenceTableId,
+														  shardReplicationMode);
+	if (!useLogicalReplication)
+	{
+		BlockWritesToShardList(colocatedShardList);
+	}
+
+	WorkerNode *sourceNode = NULL;
+	ListCell *sourceNodeCell = NULL;
+	ListCell *targetNodeCell = NULL;
+
+	forboth(sourceNodeCell, sourceNodeList, targetNodeCell, copyTargetNodeList)
+	{
+		sourceNode = lfirst(sourceNodeCell);
+		targetNode = lfirst(targetNodeCell);
+
+		ShardInterval *colocatedShard = NULL;
+		foreach_ptr(colocatedShard, colocatedShardList)
+		{
+			EnsureShardCanBeCopied(colocatedShard->shardId,
+								   sourceNode->workerName, sourceNode->workerPort,
+								   targetNode->workerName, targetNode->workerPort);
+		}
+	}
+
+	if (shardReplicationMode == TRANSFER_MODE_AUTOMATIC)
+	{
+		VerifyTablesHaveReplicaIdentity(colocatedTableList);
+	}
+
+	if (useLogicalReplication)
+	{
+		/* each logical replication setup copies to a single node */
+		forboth(sourceNodeCell, sourceNodeList, targetNodeCell, copyTargetNodeList)
+		{
+			sourceNode = lfirst(sourceNodeCell);
+			targetNode = lfirst(targetNodeCell);
+
+			CopyShardTables(colocatedShardList, sourceNode->workerName,
+							sourceNode->workerPort, targetNode->workerName,
+							targetNode->workerPort, useLogicalReplication);
+		}
+	}
+	else
+	{
+		CopyShardTablesToNodesViaBlockWrites(colocatedShardList, sourceNodeList,
+											 copyTargetNodeList);
+	}
+
+	/*
+	 * Finally insert the placements to pg_dist_placement and sync it to the
+	 * metadata workers.
+	 */
+	foreach_ptr(targetNode, copyTargetNodeList)
+	{
+		ShardInterval *colocatedShard = NULL;
+		foreach_ptr(colocatedShard, colocatedShardList)
+		{
+			uint64 colocatedShardId = colocatedShard->shardId;
+			uint64 placementId = GetNextPlacementId();
+
+			InsertShardPlacementRow(colocatedShardId, placementId,
+									SHARD_STATE_ACTIVE, ShardLength(colocatedShardId),
+									targetNode->groupId);
+
+			if (ShouldSyncTableMetadata(colocatedShard->relationId))
+			{
+				char *placementCommand = PlacementUpsertCommand(colocatedShardId,
+																placementId,
+																SHARD_STATE_ACTIVE, 0,
+																targetNode->groupId);
+
+				SendCommandToWorkersWithMetadata(placementCommand);
+			}
+		}
+	}
+
+	foreach_ptr(sourceNode, sourceNodeList)
+	{
+		UpdatePlacementUpdateStatusForShardIntervalList(
+			colocatedShardList,
+			sourceNode->workerName,
+			sourceNode->workerPort,
+			PLACEMENT_UPDATE_STATUS_COMPLETED);
+	}
+
+	FinalizeCurrentProgressMonitor();
+}
+
+
 /*
  * EnsureTableListOwner ensures current user owns given tables. Superusers
  * are regarded as owners.
@@ -1174,6 +1406,14 @@ CopyShardTables(List *shardIntervalList, char *sourceNodeName, int32 sourceNodeP
 /*
  * CopyShardTablesViaLogicalReplication copies a shard along with its co-located shards
  * from a source node to target node via logical replication.
+ *
+ * Note that the rows are copied logically and the indexes are rebuilt on the
+ * target, rather than copying the files of the shards. The files of a shard
+ * are only meaningful within the cluster that wrote them: the tuples refer to
+ * the transaction ids and commit log of the source, TOAST pointers refer to
+ * the OIDs of its TOAST tables and the pages carry LSNs of its WAL. Another
+ * node cannot attach such files without freezing and rewriting them first,
+ * which costs about as much as building the indexes.
  */
 static void
 CopyShardTablesViaLogicalReplication(List *shardIntervalList, char *sourceNodeName,
@@ -1241,68 +1481,77 @@ CopyShardTablesViaBlockWrites(List *shardIntervalList, char *sourceNodeName,
 							  int32 sourceNodePort, char *targetNodeName,
 							  int32 targetNodePort)
 {
-	MemoryContext localContext = AllocSetContextCreate(CurrentMemoryContext,
-													   "CopyShardTablesViaBlockWrites",
-													   ALLOCSET_DEFAULT_SIZES);
-	MemoryContext oldContext = MemoryContextSwitchTo(localContext);
-
 	WorkerNode *sourceNode = FindWorkerNode(sourceNodeName, sourceNodePort);
 	WorkerNode *targetNode = FindWorkerNode(targetNodeName, targetNodePort);
 
-	/* iterate through the colocated shards and copy each */
-	ShardInterval *shardInterval = NULL;
-	foreach_ptr(shardInterval, shardIntervalList)
-	{
-		/*
-		 * For each shard we first create the shard table in a separate
-		 * transaction and then we copy the data and create the indexes in a
-		 * second separate transaction. The reason we don't do both in a single
-		 * transaction is so we can see the size of the new shard growing
-		 * during the copy when we run get_rebalance_progress in another
-		 * session. If we wouldn't split these two phases up, then the table
-		 * wouldn't be visible in the session that get_rebalance_progress uses.
-		 * So get_rebalance_progress would always report its size as 0.
-		 */
-		List *ddlCommandList = RecreateShardDDLCommandList(shardInterval, sourceNodeName,
-														   sourceNodePort);
-		char *tableOwner = TableOwner(shardInterval->relationId);
-		SendCommandListToWorkerOutsideTransaction(targetNodeName, targetNodePort,
-												  tableOwner, ddlCommandList);
-	}
+	CopyShardTablesToNodesViaBlockWrites(shardIntervalList, list_make1(sourceNode),
+										 list_make1(targetNode));
+}
 
-	UpdatePlacementUpdateStatusForShardIntervalList(
-		shardIntervalList,
-		sourceNodeName,
-		sourceNodePort,
-		PLACEMENT_UPDATE_STATUS_COPYING_DATA);
 
-	ConflictWithIsolationTestingBeforeCopy();
-	CopyShardsToNode(sourceNode, targetNode, shardIntervalList, NULL);
-	ConflictWithIsolationTestingAfterCopy();
+/*
+ * CopyShardTablesToNodesViaBlockWrites copies a shard along with its co-located
+ * shards from each of the source nodes to the target node at the same position
+ * in targetNodeList. The copies to the different target nodes run in parallel.
+ */
+static void
+CopyShardTablesToNodesViaBlockWrites(List *shardIntervalList, List *sourceNodeList,
+									 List *targetNodeList)
+{
+	MemoryContext localContext = AllocSetContextCreate(CurrentMemoryContext,
+													   "CopyShardTablesViaBlockWrites",
+													   ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(localContext);
 
-	UpdatePlacementUpdateStatusForShardIntervalList(
-		shardIntervalList,
-		sourceNodeName,
-		sourceNodePort,
-		PLACEMENT_UPDATE_STATUS_CREATING_CONSTRAINTS);
+	WorkerNode *sourceNode = NULL;
+	WorkerNode *targetNode = NULL;
+	ListCell *sourceNodeCell = NULL;
+	ListCell *targetNodeCell = NULL;
 
-	foreach_ptr(shardInterval, shardIntervalList)
+	forboth(sourceNodeCell, sourceNodeList, targetNodeCell, targetNodeList)
 	{
-		List *ddlCommandList =
-			PostLoadShardCreationCommandList(shardInterval, sourceNodeName,
-											 sourceNodePort);
-		char *tableOwner = TableOwner(shardInterval->relationId);
-		SendCommandListToWorkerOutsideTransaction(targetNodeName, targetNodePort,
-												  tableOwner, ddlCommandList);
+		sourceNode = lfirst(sourceNodeCell);
+		targetNode = lfirst(targetNodeCell);
 
-		MemoryContextReset(localContext);
+		/* iterate through the colocated shards and copy each */
+		ShardInterval *shardInterval = NULL;
+		foreach_ptr(shardInterval, shardIntervalList)
+		{
+			/*
+			 * For each shard we first create the shard table in a separate
+			 * transaction and then we copy the data and create the indexes in a
+			 * second separate transaction. The reason we don't do both in a single
+			 * transaction is so we can see the size of the new shard growing
+			 * during the copy when we run get_rebalance_progress in another
+			 * session. If we wouldn't split these two phases up, then the table
+			 * wouldn't be visible in the session that get_rebalance_progress uses.
+			 * So get_rebalance_progress would always report its size as 0.
+			 */
+			List *ddlCommandList = RecreateShardDDLCommandList(shardInterval,
+															   sourceNode->workerName,
+															   sourceNode->workerPort);
+			char *tableOwner = TableOwner(shardInterval->relationId);
+			SendCommandListToWorkerOutsideTransaction(targetNode->workerName,
+													  targetNode->workerPort,
+													  tableOwner, ddlCommandList);
+		}
+
+		UpdatePlacementUpdateStatusForShardIntervalList(
+			shardIntervalList,
+			sourceNode->workerName,
+			sourceNode->workerPort,
+			PLACEMENT_UPDATE_STATUS_COPYING_DATA);
 	}
 
+	CopyShardsToNodesAndCreatePostLoadObjects(sourceNodeList, targetNodeList,
+											  shardIntervalList);
+
 	/*
 	 * Once all shards are copied, we can recreate relationships between shards.
 	 * Create DDL commands to Attach child tables to their parents in a partitioning hierarchy.
 	 */
 	List *shardIntervalWithDDCommandsList = NIL;
+	ShardInterval *shardInterval = NULL;
 	foreach_ptr(shardInterval, shardIntervalList)
 	{
 		if (PartitionTable(shardInterval->relationId))
@@ -1318,11 +1567,14 @@ CopyShardTablesViaBlockWrites(List *shardIntervalList, char *sourceNodeName,
 		}
 	}
 
-	UpdatePlacementUpdateStatusForShardIntervalList(
-		shardIntervalList,
-		sourceNodeName,
-		sourceNodePort,
-		PLACEMENT_UPDATE_STATUS_CREATING_FOREIGN_KEYS);
+	foreach_ptr(sourceNode, sourceNodeList)
+	{
+		UpdatePlacementUpdateStatusForShardIntervalList(
+			shardIntervalList,
+			sourceNode->workerName,
+			sourceNode->workerPort,
+			PLACEMENT_UPDATE_STATUS_CREATING_FOREIGN_KEYS);
+	}
 
 	/*
 	 * Iterate through the colocated shards and create DDL commamnds
@@ -1346,26 +1598,171 @@ CopyShardTablesViaBlockWrites(List *shardIntervalList, char *sourceNodeName,
 	}
 
 	/* Now execute the Partitioning & Foreign constraints creation commads. */
-	ShardCommandList *shardCommandList = NULL;
-	foreach_ptr(shardCommandList, shardIntervalWithDDCommandsList)
+	foreach_ptr(targetNode, targetNodeList)
 	{
-		char *tableOwner = TableOwner(shardCommandList->shardInterval->relationId);
-		SendCommandListToWorkerOutsideTransaction(targetNodeName, targetNodePort,
-												  tableOwner,
-												  shardCommandList->ddlCommandList);
+		ShardCommandList *shardCommandList = NULL;
+		foreach_ptr(shardCommandList, shardIntervalWithDDCommandsList)
+		{
+			char *tableOwner = TableOwner(shardCommandList->shardInterval->relationId);
+			SendCommandListToWorkerOutsideTransaction(targetNode->workerName,
+													  targetNode->workerPort,
+													  tableOwner,
+													  shardCommandList->ddlCommandList);
+		}
 	}
 
-	UpdatePlacementUpdateStatusForShardIntervalList(
-		shardIntervalList,
-		sourceNodeName,
-		sourceNodePort,
-		PLACEMENT_UPDATE_STATUS_COMPLETING);
+	foreach_ptr(sourceNode, sourceNodeList)
+	{
+		UpdatePlacementUpdateStatusForShardIntervalList(
+			shardIntervalList,
+			sourceNode->workerName,
+			sourceNode->workerPort,
+			PLACEMENT_UPDATE_STATUS_COMPLETING);
+	}
 
 	MemoryContextReset(localContext);
 	MemoryContextSwitchTo(oldContext);
 }
 
 
+/*
+ * CopyShardsToNodesAndCreatePostLoadObjects copies the list of shards from each
+ * of the source nodes to the target node at the same position in targetNodeList
+ * and creates the indexes and other post load objects of the shards on the
+ * targets.
+ *
+ * The shards are copied in batches of citus.max_adaptive_executor_pool_size
+ * shards, each over its own connection. While a batch is being copied, the
+ * post load objects of the previous batch are created on the target, such that
+ * building the indexes of the copied shards overlaps with copying the data of
+ * the remaining shards. Since indexes of different shards do not depend on each
+ * other, they are created in parallel as well. A batch is copied to all the
+ * targets at once.
+ */
+static void
+CopyShardsToNodesAndCreatePostLoadObjects(List *sourceNodeList, List *targetNodeList,
+										  List *shardIntervalList)
+{
+	int batchSize = Max(MaxAdaptiveExecutorPoolSize, 1);
+	int shardCount = list_length(shardIntervalList);
+
+	/* shards that are copied, but whose post load objects are not created yet */
+	List *copiedShardIntervalList = NIL;
+
+	ConflictWithIsolationTestingBeforeCopy();
+
+	for (int batchStart = 0;
+		 batchStart < shardCount || copiedShardIntervalList != NIL;
+		 batchStart += batchSize)
+	{
+		List *batchShardIntervalList = NIL;
+		for (int shardIndex = batchStart;
+			 shardIndex < Min(batchStart + batchSize, shardCount);
+			 shardIndex++)
+		{
+			batchShardIntervalList = lappend(batchShardIntervalList,
+											 list_nth(shardIntervalList, shardIndex));
+		}
+
+		if (batchShardIntervalList == NIL)
+		{
+			/* all data is copied, only the last post load objects remain */
+			ConflictWithIsolationTestingAfterCopy();
+		}
+
+		List *taskList = NIL;
+		ListCell *sourceNodeCell = NULL;
+		ListCell *targetNodeCell = NULL;
+
+		forboth(sourceNodeCell, sourceNodeList, targetNodeCell, targetNodeList)
+		{
+			WorkerNode *sourceNode = lfirst(sourceNodeCell);
+			WorkerNode *targetNode = lfirst(targetNodeCell);
+
+			if (batchShardIntervalList == NIL)
+			{
+				UpdatePlacementUpdateStatusForShardIntervalList(
+					shardIntervalList,
+					sourceNode->workerName,
+					sourceNode->workerPort,
+					PLACEMENT_UPDATE_STATUS_CREATING_CONSTRAINTS);
+			}
+
+			taskList = list_concat(taskList,
+								   CopyShardsToNodeTaskList(sourceNode, targetNode,
+															batchShardIntervalList,
+															NULL));
+			taskList = list_concat(taskList,
+								   PostLoadShardCreationTaskList(copiedShardIntervalList,
+																 sourceNode,
+																 targetNode));
+		}
+
+		ExecuteTaskListOutsideTransaction(ROW_MODIFY_NONE, taskList,
+										  MaxAdaptiveExecutorPoolSize,
+										  NULL /* jobIdList (ignored by API implementation) */);
+
+		copiedShardIntervalList = batchShardIntervalList;
+	}
+}
+
+
+/*
+ * PostLoadShardCreationTaskList returns a task per shard that creates the post
+ * load objects of the shard on the target node. The commands of a shard run in
+ * a single transaction, because some of them depend on the created indexes.
+ * The objects are created as the table owner, as if the commands were sent
+ * over a connection of the table owner, and with the configured index build
+ * settings.
+ */
+static List *
+PostLoadShardCreationTaskList(List *shardIntervalList, WorkerNode *sourceNode,
+							  WorkerNode *targetNode)
+{
+	int taskId = 0;
+	List *taskList = NIL;
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		List *shardCommandList =
+			PostLoadShardCreationCommandList(shardInterval, sourceNode->workerName,
+											 sourceNode->workerPort);
+		if (shardCommandList == NIL)
+		{
+			continue;
+		}
+
+		char *tableOwner = TableOwner(shardInterval->relationId);
+		StringInfo setRoleCommand = makeStringInfo();
+		appendStringInfo(setRoleCommand, "SET LOCAL ROLE %s;",
+						 quote_identifier(tableOwner));
+
+		List *commandList = list_make2("BEGIN;", setRoleCommand->data);
+		commandList = list_concat(commandList, ShardIndexBuildSettingCommandList());
+		commandList = list_concat(commandList, shardCommandList);
+		commandList = lappend(commandList, "COMMIT;");
+
+		Task *task = CitusMakeNode(Task);
+		task->jobId = shardInterval->shardId;
+		task->taskId = taskId;
+		task->taskType = DDL_TASK;
+		task->replicationModel = REPLICATION_MODEL_INVALID;
+		SetTaskQueryStringList(task, commandList);
+
+		/* this placement currently does not exist */
+		ShardPlacement *taskPlacement = CitusMakeNode(ShardPlacement);
+		SetPlacementNodeMetadata(taskPlacement, targetNode);
+
+		task->taskPlacementList = list_make1(taskPlacement);
+
+		taskList = lappend(taskList, task);
+		taskId++;
+	}
+
+	return taskList;
+}
+
+
 /*
  * CopyShardsToNode copies the list of shards from the source to the target.
  * When snapshotName is not NULL it will do the COPY using this snapshot name.
@@ -1373,6 +1770,23 @@ CopyShardTablesViaBlockWrites(List *shardIntervalList, char *sourceNodeName,
 void
 CopyShardsToNode(WorkerNode *sourceNode, WorkerNode *targetNode, List *shardIntervalList,
 				 char *snapshotName)
+{
+	List *copyTaskList = CopyShardsToNodeTaskList(sourceNode, targetNode,
+												  shardIntervalList, snapshotName);
+
+	ExecuteTaskListOutsideTransaction(ROW_MODIFY_NONE, copyTaskList,
+									  MaxAdaptiveExecutorPoolSize,
+									  NULL /* jobIdList (ignored by API implementation) */);
+}
+
+
+/*
+ * CopyShardsToNodeTaskList returns a task per shard that copies the shard from
+ * the source to the target, see CopyShardsToNode.
+ */
+static List *
+CopyShardsToNodeTaskList(WorkerNode *sourceNode, WorkerNode *targetNode,
+						 List *shardIntervalList, char *snapshotName)
 {
 	int taskId = 0;
 	List *copyTaskList = NIL;
@@ -1439,9 +1853,7 @@ CopyShardsToNode(WorkerNode *sourceNode, WorkerNode *targetNode, List *shardInte
 		taskId++;
 	}
 
-	ExecuteTaskListOutsideTransaction(ROW_MODIFY_NONE, copyTaskList,
-									  MaxAdaptiveExecutorPoolSize,
-									  NULL /* jobIdList (ignored by API implementation) */);
+	return copyTaskList;
 }
 
 
@@ -0,0 +1,301 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_transfer_throttle.c
+ *
+ * Routines for limiting the rate at which a node sends shard data to other
+ * nodes when shards are moved, copied or split, such that the transfers do
+ * not saturate the network and disks that foreground queries use.
+ *
+ * Backends that send shard data reserve a time slot for every chunk they
+ * send, both in the bucket of the node they send to and in the bucket of the
+ * whole node, and wait until the reserved slots end. The buckets are kept in
+ * shared memory, such that the limits hold over all the backends that send
+ * data concurrently, e.g. for the colocated shards of a move. The limits are
+ * reloaded from the configuration while waiting, which means that changing
+ * them also affects the transfers that are already running.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "postmaster/interrupt.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/guc.h"
+#include "utils/timestamp.h"
+
+#include "distributed/shard_transfer_throttle.h"
+
+
+/* number of bytes a backend sends before it reserves a time slot for them */
+#define SHARD_TRANSFER_THROTTLE_CHUNK_SIZE (64 * 1024)
+
+/* maximum number of target nodes whose transfers are limited at the same time */
+#define MAX_THROTTLED_TARGET_NODES 64
+
+
+/*
+ * ShardTransferRateBucket holds the time until which the data sent to a
+ * target node has used up the limit.
+ */
+typedef struct ShardTransferRateBucket
+{
+	uint32 targetNodeId;
+	TimestampTz nextSendTime;
+} ShardTransferRateBucket;
+
+
+/*
+ * ShardTransferThrottleControlData holds the buckets of the target nodes and
+ * the bucket of the node as a whole.
+ */
+typedef struct ShardTransferThrottleControlData
+{
+	slock_t mutex;
+	TimestampTz nextSendTime;
+	ShardTransferRateBucket targetBuckets[MAX_THROTTLED_TARGET_NODES];
+} ShardTransferThrottleControlData;
+
+
+/* GUC, maximum rate in MB/s at which data is sent to a node, 0 for no limit */
+int MaxShardTransferRate = 0;
+
+/* GUC, maximum rate in MB/s at which this node sends shard data, 0 for no limit */
+int MaxTotalShardTransferRate = 0;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static ShardTransferThrottleControlData *ShardTransferThrottleControl = NULL;
+
+/* number of bytes sent by this backend for which no time slot was reserved yet */
+static uint64 UnthrottledByteCount = 0;
+
+static TimestampTz ReserveTransferSlot(TimestampTz *nextSendTime, TimestampTz now,
+									   uint64 byteCount, int maxRate);
+static ShardTransferRateBucket * TargetNodeRateBucket(uint32 targetNodeId,
+													  TimestampTz now);
+
+
+/*
+ * InitializeShardTransferThrottle requests the shared memory for the rate
+ * buckets and sets the hook that initializes it.
+ */
+void
+InitializeShardTransferThrottle(void)
+{
+	/* On PG 15 and above, we use shmem_request_hook_type */
+	#if PG_VERSION_NUM < PG_VERSION_15
+
+	/* allocate shared memory for pre PG-15 versions */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(ShardTransferThrottleShmemSize());
+	}
+
+	#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ShardTransferThrottleShmemInit;
+}
+
+
+/*
+ * ShardTransferThrottleShmemSize returns the size of the shared memory used
+ * for the rate buckets.
+ */
+size_t
+ShardTransferThrottleShmemSize(void)
+{
+	return sizeof(ShardTransferThrottleControlData);
+}
+
+
+/*
+ * ShardTransferThrottleShmemInit initializes the shared memory used for the
+ * rate buckets.
+ */
+void
+ShardTransferThrottleShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ShardTransferThrottleControl =
+		(ShardTransferThrottleControlData *) ShmemInitStruct(
+			"Citus Shard Transfer Throttle",
+			sizeof(ShardTransferThrottleControlData),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		memset(ShardTransferThrottleControl, 0,
+			   sizeof(ShardTransferThrottleControlData));
+		SpinLockInit(&ShardTransferThrottleControl->mutex);
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * ThrottleShardTransfer accounts for byteCount bytes of shard data that were
+ * sent to the given target node, and waits as long as needed to stay within
+ * citus.max_shard_transfer_rate for the target node and within
+ * citus.max_total_shard_transfer_rate for all transfers of this node. The
+ * target node can be SHARD_TRANSFER_ANY_NODE, in which case only the latter
+ * applies.
+ */
+void
+ThrottleShardTransfer(uint32 targetNodeId, uint64 byteCount)
+{
+	UnthrottledByteCount += byteCount;
+
+	if (UnthrottledByteCount < SHARD_TRANSFER_THROTTLE_CHUNK_SIZE ||
+		ShardTransferThrottleControl == NULL)
+	{
+		return;
+	}
+
+	/* pick up changed limits, also when no limit applied so far */
+	if (ConfigReloadPending)
+	{
+		ConfigReloadPending = false;
+		ProcessConfigFile(PGC_SIGHUP);
+	}
+
+	uint64 chunkByteCount = UnthrottledByteCount;
+	UnthrottledByteCount = 0;
+
+	if (MaxShardTransferRate <= 0 && MaxTotalShardTransferRate <= 0)
+	{
+		return;
+	}
+
+	TimestampTz now = GetCurrentTimestamp();
+	TimestampTz sendUntil = now;
+
+	SpinLockAcquire(&ShardTransferThrottleControl->mutex);
+
+	if (MaxTotalShardTransferRate > 0)
+	{
+		TimestampTz nodeSendUntil =
+			ReserveTransferSlot(&ShardTransferThrottleControl->nextSendTime, now,
+								chunkByteCount, MaxTotalShardTransferRate);
+		sendUntil = Max(sendUntil, nodeSendUntil);
+	}
+
+	if (MaxShardTransferRate > 0 && targetNodeId != SHARD_TRANSFER_ANY_NODE)
+	{
+		ShardTransferRateBucket *bucket = TargetNodeRateBucket(targetNodeId, now);
+		TimestampTz targetSendUntil =
+			ReserveTransferSlot(&bucket->nextSendTime, now, chunkByteCount,
+								MaxShardTransferRate);
+		sendUntil = Max(sendUntil, targetSendUntil);
+	}
+
+	SpinLockRelease(&ShardTransferThrottleControl->mutex);
+
+	while (now < sendUntil)
+	{
+		long secs = 0;
+		int microsecs = 0;
+
+		TimestampDifference(now, sendUntil, &secs, &microsecs);
+
+		long timeout = secs * 1000 + microsecs / 1000;
+		if (timeout <= 0)
+		{
+			break;
+		}
+
+		int latchFlags = WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH;
+		int rc = WaitLatch(MyLatch, latchFlags, timeout, PG_WAIT_EXTENSION);
+
+		/* emergency bailout if postmaster has died */
+		if (rc & WL_POSTMASTER_DEATH)
+		{
+			proc_exit(1);
+		}
+
+		if (rc & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+			CHECK_FOR_INTERRUPTS();
+		}
+
+		now = GetCurrentTimestamp();
+	}
+}
+
+
+/*
+ * ReserveTransferSlot reserves the time needed to send byteCount bytes at
+ * maxRate MB/s in the bucket whose next free time is nextSendTime, and
+ * returns the time at which the reserved slot ends. Buckets that were idle do
+ * not build up credit, so transfers never exceed the limit in bursts.
+ */
+static TimestampTz
+ReserveTransferSlot(TimestampTz *nextSendTime, TimestampTz now, uint64 byteCount,
+					int maxRate)
+{
+	double bytesPerMicrosecond = (double) maxRate * 1024.0 * 1024.0 / USECS_PER_SEC;
+	int64 slotMicroseconds = (int64) (byteCount / bytesPerMicrosecond);
+
+	TimestampTz slotStart = Max(*nextSendTime, now);
+	*nextSendTime = slotStart + slotMicroseconds;
+
+	return *nextSendTime;
+}
+
+
+/*
+ * TargetNodeRateBucket returns the bucket of the given target node, and takes
+ * over an idle bucket for the node if it does not have one. The caller should
+ * hold the mutex.
+ */
+static ShardTransferRateBucket *
+TargetNodeRateBucket(uint32 targetNodeId, TimestampTz now)
+{
+	ShardTransferRateBucket *idlestBucket = NULL;
+
+	for (int bucketIndex = 0; bucketIndex < MAX_THROTTLED_TARGET_NODES; bucketIndex++)
+	{
+		ShardTransferRateBucket *bucket =
+			&ShardTransferThrottleControl->targetBuckets[bucketIndex];
+
+		if (bucket->targetNodeId == targetNodeId)
+		{
+			return bucket;
+		}
+
+		if (idlestBucket == NULL || bucket->nextSendTime < idlestBucket->nextSendTime)
+		{
+			idlestBucket = bucket;
+		}
+	}
+
+	/*
+	 * Take over the bucket that was idle the longest. Only with more than
+	 * MAX_THROTTLED_TARGET_NODES concurrent targets is that bucket still in
+	 * use, in which case the targets share its limit.
+	 */
+	idlestBucket->targetNodeId = targetNodeId;
+	idlestBucket->nextSendTime = Max(idlestBucket->nextSendTime, now);
+
+	return idlestBucket;
+}
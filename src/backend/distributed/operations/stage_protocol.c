@@ -62,8 +62,21 @@
 #include "utils/rel.h"
 
 
+/*
+ * State of the deferred shard creation of create_time_partitions(), which
+ * creates the shards of all new partitions in a single execution. The tasks
+ * are kept in TopTransactionContext until the deferral finishes.
+ */
+static int DeferredShardCreationLevel = 0;
+static int DeferredShardCreationNestLevel = 0;
+static bool DeferredShardCreationInterrupted = false;
+static int DeferredShardCreationPoolSize = 1;
+static List *DeferredShardCreationTaskList = NIL;
+
 /* Local functions forward declarations */
 static List * RelationShardListForShardCreate(ShardInterval *shardInterval);
+static void DeferShardCreationTaskList(List *taskList, int poolSize);
+static void ExecuteDeferredShardCreation(void);
 static bool WorkerShardStats(ShardPlacement *placement, Oid relationId,
 							 const char *shardName, uint64 *shardSize);
 static void UpdateTableStatistics(Oid relationId);
@@ -80,6 +93,8 @@ PG_FUNCTION_INFO_V1(master_append_table_to_shard);
 PG_FUNCTION_INFO_V1(citus_update_shard_statistics);
 PG_FUNCTION_INFO_V1(master_update_shard_statistics);
 PG_FUNCTION_INFO_V1(citus_update_table_statistics);
+PG_FUNCTION_INFO_V1(citus_internal_begin_deferred_shard_creation);
+PG_FUNCTION_INFO_V1(citus_internal_finish_deferred_shard_creation);
 
 
 /*
@@ -489,11 +504,195 @@ CreateShardsOnWorkers(Oid distributedRelationId, List *shardPlacements,
 		 */
 		poolSize = MaxAdaptiveExecutorPoolSize;
 	}
+
+	if (DeferredShardCreationLevel > 0)
+	{
+		DeferShardCreationTaskList(taskList, poolSize);
+		return;
+	}
+
 	bool localExecutionSupported = true;
 	ExecuteUtilityTaskListExtended(taskList, poolSize, localExecutionSupported);
 }
 
 
+/*
+ * citus_internal_begin_deferred_shard_creation makes the subsequent shard
+ * creations of the transaction only remember their tasks until
+ * citus_internal_finish_deferred_shard_creation is called. It is used by
+ * create_time_partitions() to create the shards of all new partitions in
+ * one execution instead of one execution per partition.
+ */
+Datum
+citus_internal_begin_deferred_shard_creation(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	if (DeferredShardCreationLevel == 0)
+	{
+		DeferredShardCreationNestLevel = GetCurrentTransactionNestLevel();
+		DeferredShardCreationInterrupted = false;
+		DeferredShardCreationPoolSize = 1;
+		DeferredShardCreationTaskList = NIL;
+	}
+
+	DeferredShardCreationLevel++;
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_internal_finish_deferred_shard_creation creates the shards of which
+ * the creation was deferred since the matching call to
+ * citus_internal_begin_deferred_shard_creation.
+ */
+Datum
+citus_internal_finish_deferred_shard_creation(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	if (DeferredShardCreationLevel == 0)
+	{
+		ereport(ERROR, (errmsg("shard creation is not deferred")));
+	}
+
+	DeferredShardCreationLevel--;
+
+	if (DeferredShardCreationLevel == 0)
+	{
+		ExecuteDeferredShardCreation();
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * DeferShardCreationTaskList remembers the given shard creation tasks until
+ * the deferred shard creation finishes.
+ */
+static void
+DeferShardCreationTaskList(List *taskList, int poolSize)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		DeferredShardCreationTaskList = lappend(DeferredShardCreationTaskList,
+												copyObject(task));
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	DeferredShardCreationPoolSize = Max(DeferredShardCreationPoolSize, poolSize);
+}
+
+
+/*
+ * ExecuteDeferredShardCreation creates the shards of which the creation was
+ * deferred in a single execution.
+ *
+ * When all deferred creations would have used a single connection per worker,
+ * the creation commands for the same worker can also be combined into a
+ * single command. Otherwise, the shards keep getting created over exclusive
+ * connections such that later commands in the transaction can access them
+ * in parallel.
+ */
+static void
+ExecuteDeferredShardCreation(void)
+{
+	List *taskList = DeferredShardCreationTaskList;
+	int poolSize = DeferredShardCreationPoolSize;
+
+	if (DeferredShardCreationInterrupted)
+	{
+		ereport(ERROR, (errmsg("cannot create the deferred shards after a "
+							   "subtransaction was rolled back")));
+	}
+
+	ResetDeferredShardCreation();
+
+	if (taskList == NIL)
+	{
+		return;
+	}
+
+	/* the tasks of different tables got the same task ids */
+	int taskId = 1;
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		task->taskId = taskId++;
+	}
+
+	bool localExecutionSupported = true;
+	if (poolSize == 1)
+	{
+		ExecuteSequentialUtilityTaskList(taskList, localExecutionSupported);
+	}
+	else
+	{
+		ExecuteUtilityTaskListExtended(taskList, poolSize, localExecutionSupported);
+	}
+}
+
+
+/*
+ * ErrorIfShardCreationDeferred errors out when the transaction is about to
+ * commit while the creation of some of its shards is still deferred.
+ */
+void
+ErrorIfShardCreationDeferred(void)
+{
+	if (DeferredShardCreationLevel > 0)
+	{
+		ereport(ERROR, (errmsg("cannot commit while shard creation is deferred")));
+	}
+}
+
+
+/*
+ * DeferredShardCreationAtSubAbort discards the deferred shard creation when
+ * the subtransaction in which it began is rolled back. When a subtransaction
+ * inside the deferral is rolled back, some of the deferred tasks may belong
+ * to tables that no longer exist, hence the deferral can no longer finish.
+ */
+void
+DeferredShardCreationAtSubAbort(void)
+{
+	if (DeferredShardCreationLevel == 0)
+	{
+		return;
+	}
+
+	if (GetCurrentTransactionNestLevel() <= DeferredShardCreationNestLevel)
+	{
+		ResetDeferredShardCreation();
+	}
+	else
+	{
+		DeferredShardCreationInterrupted = true;
+	}
+}
+
+
+/*
+ * ResetDeferredShardCreation resets the state of the deferred shard creation.
+ * The deferred tasks themselves live in TopTransactionContext.
+ */
+void
+ResetDeferredShardCreation(void)
+{
+	DeferredShardCreationLevel = 0;
+	DeferredShardCreationNestLevel = 0;
+	DeferredShardCreationInterrupted = false;
+	DeferredShardCreationPoolSize = 1;
+	DeferredShardCreationTaskList = NIL;
+}
+
+
 /*
  * RelationShardListForShardCreate gets a shard interval and returns the placement
  * accesses that would happen when a placement of the shard interval is created.
@@ -16,6 +16,7 @@
 #include "utils/lsyscache.h"
 #include "utils/builtins.h"
 #include "distributed/remote_commands.h"
+#include "distributed/shard_transfer_throttle.h"
 #include "distributed/worker_shard_copy.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/local_multi_copy.h"
@@ -223,6 +224,9 @@ ShardCopyDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 									  copyOutState->fe_msgbuf->data,
 									  copyDest->destinationNodeId)));
 		}
+
+		ThrottleShardTransfer(copyDest->destinationNodeId,
+							  copyOutState->fe_msgbuf->len);
 	}
 
 	MemoryContextSwitchTo(oldContext);
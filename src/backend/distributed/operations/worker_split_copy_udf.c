@@ -16,6 +16,7 @@
 #include "distributed/multi_executor.h"
 #include "distributed/utils/array_type.h"
 #include "distributed/worker_shard_copy.h"
+#include "storage/block.h"
 #include "utils/lsyscache.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
@@ -49,10 +50,16 @@ static char * TraceWorkerSplitCopyUdf(char *sourceShardToCopySchemaName,
 									  List *splitCopyInfoList);
 
 /*
- * worker_split_copy(source_shard_id bigint, splitCopyInfo pg_catalog.split_copy_info[])
+ * worker_split_copy(source_shard_id bigint, splitCopyInfo pg_catalog.split_copy_info[]
+ *                   [, start_block bigint, end_block bigint])
  * UDF to split copy shard to list of destination shards.
  * 'source_shard_id' : Source ShardId to split copy.
  * 'splitCopyInfos'   : Array of Split Copy Info (destination_shard's id, min/max ranges and node_id)
+ * 'start_block'      : First block of the source shard to copy, optional.
+ * 'end_block'        : Block at which the copy stops, or -1 to copy until the end.
+ *
+ * With a block range, only the tuples in the given blocks are copied, such that
+ * the copy of a large shard can be divided over concurrent calls.
  */
 Datum
 worker_split_copy(PG_FUNCTION_ARGS)
@@ -88,6 +95,24 @@ worker_split_copy(PG_FUNCTION_ARGS)
 		splitCopyInfoList = lappend(splitCopyInfoList, splitCopyInfo);
 	}
 
+	int64 startBlock = 0;
+	int64 endBlock = -1;
+	if (PG_NARGS() == 5)
+	{
+		startBlock = PG_GETARG_INT64(3);
+		endBlock = PG_GETARG_INT64(4);
+
+		if (startBlock < 0 || startBlock > MaxBlockNumber ||
+			endBlock < -1 || endBlock > MaxBlockNumber ||
+			(endBlock != -1 && endBlock <= startBlock))
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("invalid block range [" INT64_FORMAT ", "
+								   INT64_FORMAT ") for split copy",
+								   startBlock, endBlock)));
+		}
+	}
+
 	EState *executor = CreateExecutorState();
 	DestReceiver *splitCopyDestReceiver = CreatePartitionedSplitCopyDestReceiver(executor,
 																				 shardIntervalToSplitCopy,
@@ -104,14 +129,33 @@ worker_split_copy(PG_FUNCTION_ARGS)
 		sourceShardToCopySchemaName,
 		sourceShardToCopyName);
 
-	ereport(LOG, (errmsg("%s", TraceWorkerSplitCopyUdf(sourceShardToCopySchemaName,
-													   sourceShardPrefix,
-													   sourceShardToCopyQualifiedName,
-													   splitCopyInfoList))));
-
+	char *splitCopyTrace = TraceWorkerSplitCopyUdf(sourceShardToCopySchemaName,
+												   sourceShardPrefix,
+												   sourceShardToCopyQualifiedName,
+												   splitCopyInfoList);
 	StringInfo selectShardQueryForCopy = makeStringInfo();
 	appendStringInfo(selectShardQueryForCopy,
-					 "SELECT * FROM %s;", sourceShardToCopyQualifiedName);
+					 "SELECT * FROM %s", sourceShardToCopyQualifiedName);
+
+	if (PG_NARGS() == 5)
+	{
+		/* TID range scans make sure only the blocks in the range are read */
+		appendStringInfo(selectShardQueryForCopy,
+						 " WHERE ctid >= '(" INT64_FORMAT ",0)'::tid", startBlock);
+
+		if (endBlock != -1)
+		{
+			appendStringInfo(selectShardQueryForCopy,
+							 " AND ctid < '(" INT64_FORMAT ",0)'::tid", endBlock);
+		}
+
+		splitCopyTrace = psprintf("%s for blocks [" INT64_FORMAT ", " INT64_FORMAT ")",
+								  splitCopyTrace, startBlock, endBlock);
+	}
+
+	appendStringInfoString(selectShardQueryForCopy, ";");
+
+	ereport(LOG, (errmsg("%s", splitCopyTrace)));
 
 	ParamListInfo params = NULL;
 	ExecuteQueryStringIntoDestReceiver(selectShardQueryForCopy->data, params,
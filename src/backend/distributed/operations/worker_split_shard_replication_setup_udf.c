@@ -247,6 +247,7 @@ AddShardSplitInfoEntryForNodeInMap(ShardSplitInfo *shardSplitInfo)
 	NodeAndOwner key;
 	key.nodeId = shardSplitInfo->nodeId;
 	key.tableOwnerId = TableOwnerOid(shardSplitInfo->distributedTableOid);
+	key.subscriptionIndex = 0;
 
 	bool found = false;
 	GroupedShardSplitInfos *groupedInfos =
@@ -19,18 +19,26 @@
 #include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/combine_query_planner.h"
+#include "distributed/distributed_planner.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/parallel_combine.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/clauses.h"
 #include "optimizer/planner.h"
 #include "rewrite/rewriteManip.h"
+#include "utils/lsyscache.h"
 
 static List * RemoteScanTargetList(List *workerTargetList);
 static PlannedStmt * BuildSelectStatementViaStdPlanner(Query *combineQuery,
 													   List *remoteScanTargetList,
 													   CustomScan *remoteScan);
+static PlannedStmt * PlanCombineQueryViaStdPlanner(Query *combineQuery,
+												   int cursorOptions,
+												   CustomScan *remoteScan);
 
+static bool PathKeysMatchSortedMerge(List *pathKeyList, List *sortClauseList,
+									 Index scanRelationId);
 static Plan * CitusCustomScanPathPlan(PlannerInfo *root, RelOptInfo *rel,
 									  struct CustomPath *best_path, List *tlist,
 									  List *clauses, List *custom_plans);
@@ -156,10 +164,97 @@ CreateCitusCustomScanPath(PlannerInfo *root, RelOptInfo *relOptInfo,
 	path->custom_path.path.rows = 100000;
 	path->remoteScan = remoteScan;
 
+	DistributedPlan *distributedPlan = GetDistributedPlan(remoteScan);
+	if (distributedPlan->sortedMergeClauseList != NIL && root->parse->groupClause != NIL)
+	{
+		/*
+		 * The CustomScan merges the groups of the tasks in the order of the
+		 * GROUP BY, which lets the standard planner combine them with a
+		 * GroupAggregate instead of hashing or sorting all of them.
+		 */
+		if (PathKeysMatchSortedMerge(root->group_pathkeys,
+									 distributedPlan->sortedMergeClauseList,
+									 relOptInfo->relid))
+		{
+			path->custom_path.path.pathkeys = root->group_pathkeys;
+		}
+	}
+	else if (distributedPlan->sortedMergeClauseList != NIL)
+	{
+		/*
+		 * The CustomScan merges the sorted results of the tasks, which lets the
+		 * standard planner skip sorting the rows for the combine query.
+		 */
+		path->custom_path.path.pathkeys = root->sort_pathkeys;
+	}
+
 	return (Path *) path;
 }
 
 
+/*
+ * PathKeysMatchSortedMerge returns whether the rows that the CustomScan merges
+ * by the given clauses (see SortedMergeClauseList) are ordered by the given
+ * pathkeys. The planner may have reordered the GROUP BY to match the ORDER BY
+ * or removed redundant keys, in which case the orders can differ.
+ */
+static bool
+PathKeysMatchSortedMerge(List *pathKeyList, List *sortClauseList, Index scanRelationId)
+{
+	if (pathKeyList == NIL || list_length(pathKeyList) > list_length(sortClauseList))
+	{
+		return false;
+	}
+
+	ListCell *pathKeyCell = NULL;
+	ListCell *sortClauseCell = NULL;
+	forboth(pathKeyCell, pathKeyList, sortClauseCell, sortClauseList)
+	{
+		PathKey *pathKey = lfirst(pathKeyCell);
+		SortGroupClause *sortClause = lfirst(sortClauseCell);
+		Oid opfamily = InvalidOid;
+		Oid opcintype = InvalidOid;
+		int16 strategy = 0;
+
+		if (!get_ordering_op_properties(sortClause->sortop, &opfamily, &opcintype,
+										&strategy) ||
+			pathKey->pk_opfamily != opfamily || pathKey->pk_strategy != strategy ||
+			pathKey->pk_nulls_first != sortClause->nulls_first)
+		{
+			return false;
+		}
+
+		/* tleSortGroupRef holds the column of the CustomScan that we merge by */
+		AttrNumber columnNumber = (AttrNumber) sortClause->tleSortGroupRef;
+		bool columnInClass = false;
+		EquivalenceMember *member = NULL;
+		foreach_ptr(member, pathKey->pk_eclass->ec_members)
+		{
+			Expr *memberExpr = member->em_expr;
+			while (IsA(memberExpr, RelabelType))
+			{
+				memberExpr = ((RelabelType *) memberExpr)->arg;
+			}
+
+			if (IsA(memberExpr, Var) &&
+				((Var *) memberExpr)->varno == scanRelationId &&
+				((Var *) memberExpr)->varattno == columnNumber)
+			{
+				columnInClass = true;
+				break;
+			}
+		}
+
+		if (!columnInClass)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
 /*
  * CitusCustomScanPathPlan is called for the CitusCustomScanPath node in the best_path
  * after the postgres planner has evaluated all possible paths.
@@ -291,6 +386,34 @@ BuildSelectStatementViaStdPlanner(Query *combineQuery, List *remoteScanTargetLis
 		elog(logCombineQueryLevel, "combine query: %s", queryString->data);
 	}
 
+	if (EnableParallelCombine)
+	{
+		/* keep a copy in case we need to plan again without parallel workers */
+		Query *serialCombineQuery = copyObject(combineQuery);
+
+		PlannedStmt *parallelStmt =
+			PlanCombineQueryViaStdPlanner(combineQuery, CURSOR_OPT_PARALLEL_OK,
+										  remoteScan);
+		if (AddParallelCombineSource(parallelStmt, remoteScan))
+		{
+			return parallelStmt;
+		}
+
+		combineQuery = serialCombineQuery;
+	}
+
+	return PlanCombineQueryViaStdPlanner(combineQuery, 0, remoteScan);
+}
+
+
+/*
+ * PlanCombineQueryViaStdPlanner plans the combine query with the standard planner,
+ * while replacing the citus_extradata_container by the remote scan.
+ */
+static PlannedStmt *
+PlanCombineQueryViaStdPlanner(Query *combineQuery, int cursorOptions,
+							  CustomScan *remoteScan)
+{
 	PlannedStmt *standardStmt = NULL;
 	PG_TRY();
 	{
@@ -299,8 +422,9 @@ BuildSelectStatementViaStdPlanner(Query *combineQuery, List *remoteScanTargetLis
 		Assert(ReplaceCitusExtraDataContainerWithCustomScan == NULL);
 		ReplaceCitusExtraDataContainer = true;
 		ReplaceCitusExtraDataContainerWithCustomScan = remoteScan;
+		ResetParallelCombineScanCount();
 
-		standardStmt = standard_planner(combineQuery, NULL, 0, NULL);
+		standardStmt = standard_planner(combineQuery, NULL, cursorOptions, NULL);
 
 		ReplaceCitusExtraDataContainer = false;
 		ReplaceCitusExtraDataContainerWithCustomScan = NULL;
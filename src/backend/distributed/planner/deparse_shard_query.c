@@ -25,6 +25,7 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_router_planner.h"
+#include "distributed/planner_timing.h"
 #include "distributed/shard_utils.h"
 #include "distributed/version_compat.h"
 #include "lib/stringinfo.h"
@@ -35,16 +36,36 @@
 #include "nodes/pg_list.h"
 #include "parser/parsetree.h"
 #include "storage/lock.h"
+#include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
 
 
+/* prefix of the names we deparse in place of shard names in a query template */
+#define SHARD_NAME_PLACEHOLDER_PREFIX "citus_shard_placeholder_"
+
+
+/* context for replacing relation names with shard name placeholders */
+typedef struct ShardNamePlaceholderContext
+{
+	List *relationIdList;
+
+	/* set to false if the query accesses a Citus table not in relationIdList */
+	bool allRelationsFound;
+} ShardNamePlaceholderContext;
+
+
 static void UpdateTaskQueryString(Query *query, Task *task);
 static RelationShard * FindRelationShard(Oid inputRelationId, List *relationShardList);
 static void ConvertRteToSubqueryWithEmptyResult(RangeTblEntry *rte);
 static bool ShouldLazyDeparseQuery(Task *task);
 static char * DeparseTaskQuery(Task *task, Query *query);
+static bool UpdateRelationToShardNamePlaceholders(Node *node,
+												  ShardNamePlaceholderContext *context);
+static char * ShardNamePlaceholder(int relationIndex);
+static bool SplitShardQueryTemplate(ShardQueryTemplate *queryTemplate,
+									char *queryString);
 
 
 /*
@@ -59,6 +80,8 @@ RebuildQueryStrings(Job *workerJob)
 	Task *task = NULL;
 	bool isSingleTask = list_length(taskList) == 1;
 
+	BeginPlannerPhase(PLANNER_PHASE_DEPARSE);
+
 	if (originalQuery->commandType == CMD_INSERT)
 	{
 		AddInsertAliasIfNeeded(originalQuery);
@@ -152,6 +175,8 @@ RebuildQueryStrings(Job *workerJob)
 		ereport(DEBUG4, (errmsg("query after rebuilding:  %s",
 								TaskQueryString(task))));
 	}
+
+	EndPlannerPhase(PLANNER_PHASE_DEPARSE);
 }
 
 
@@ -303,6 +328,237 @@ FindRelationShard(Oid inputRelationId, List *relationShardList)
 }
 
 
+/*
+ * CreateShardQueryTemplate deparses the given query once, with placeholders in
+ * place of the shard names of the relations in relationIdList. The query is
+ * modified in place. Each task that accesses one shard of each of those
+ * relations can then get its query string from InstantiateShardQueryTemplate,
+ * which gives the same string as UpdateRelationToShardNames followed by
+ * pg_get_query_def, but only costs a string copy per task.
+ *
+ * The function returns NULL if the query cannot be expressed as a template,
+ * in which case the caller should deparse the query for each task.
+ */
+ShardQueryTemplate *
+CreateShardQueryTemplate(Query *query, List *relationIdList)
+{
+	ShardNamePlaceholderContext context = {
+		.relationIdList = relationIdList,
+		.allRelationsFound = true
+	};
+
+	UpdateRelationToShardNamePlaceholders((Node *) query, &context);
+	if (!context.allRelationsFound)
+	{
+		/* the task queries would replace such relations with empty subqueries */
+		return NULL;
+	}
+
+	StringInfo queryString = makeStringInfo();
+	pg_get_query_def(query, queryString);
+
+	ShardQueryTemplate *queryTemplate = palloc0(sizeof(ShardQueryTemplate));
+	queryTemplate->relationIdList = relationIdList;
+
+	if (!SplitShardQueryTemplate(queryTemplate, queryString->data))
+	{
+		return NULL;
+	}
+
+	return queryTemplate;
+}
+
+
+/*
+ * UpdateRelationToShardNamePlaceholders is the counterpart of
+ * UpdateRelationToShardNames for query templates, it sets the shard name of
+ * the Citus tables in the query to the placeholder of the relation.
+ */
+static bool
+UpdateRelationToShardNamePlaceholders(Node *node, ShardNamePlaceholderContext *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, UpdateRelationToShardNamePlaceholders,
+								 context, QTW_EXAMINE_RTES_BEFORE);
+	}
+
+	if (!IsA(node, RangeTblEntry))
+	{
+		return expression_tree_walker(node, UpdateRelationToShardNamePlaceholders,
+									  context);
+	}
+
+	RangeTblEntry *newRte = (RangeTblEntry *) node;
+
+	if (newRte->rtekind == RTE_FUNCTION)
+	{
+		newRte = NULL;
+		if (!FindCitusExtradataContainerRTE(node, &newRte))
+		{
+			return false;
+		}
+	}
+	else if (newRte->rtekind != RTE_RELATION)
+	{
+		return false;
+	}
+
+	if (!IsCitusTable(newRte->relid))
+	{
+		return false;
+	}
+
+	int relationIndex = 0;
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, context->relationIdList)
+	{
+		if (relationId == newRte->relid)
+		{
+			break;
+		}
+
+		relationIndex++;
+	}
+
+	if (relationIndex == list_length(context->relationIdList))
+	{
+		context->allRelationsFound = false;
+		return false;
+	}
+
+	char *schemaName = get_namespace_name(get_rel_namespace(newRte->relid));
+
+	ModifyRangeTblExtraData(newRte, CITUS_RTE_SHARD, schemaName,
+							ShardNamePlaceholder(relationIndex), NIL);
+
+	return false;
+}
+
+
+/*
+ * ShardNamePlaceholder returns the placeholder for the shard name of the
+ * relation at the given index. The placeholder does not need quoting, so it
+ * appears in the deparsed query as is.
+ */
+static char *
+ShardNamePlaceholder(int relationIndex)
+{
+	return psprintf(SHARD_NAME_PLACEHOLDER_PREFIX "%d", relationIndex);
+}
+
+
+/*
+ * SplitShardQueryTemplate splits the deparsed query string of a template into
+ * the text around the placeholders. It returns false if it finds something
+ * that looks like a placeholder but is not, for instance in a string literal
+ * that happens to contain the placeholder prefix.
+ */
+static bool
+SplitShardQueryTemplate(ShardQueryTemplate *queryTemplate, char *queryString)
+{
+	int prefixLength = strlen(SHARD_NAME_PLACEHOLDER_PREFIX);
+	int relationCount = list_length(queryTemplate->relationIdList);
+	char *fragmentStart = queryString;
+	char *placeholder = NULL;
+
+	while ((placeholder = strstr(fragmentStart, SHARD_NAME_PLACEHOLDER_PREFIX)) != NULL)
+	{
+		char *indexStart = placeholder + prefixLength;
+		char *indexEnd = indexStart;
+
+		while (*indexEnd >= '0' && *indexEnd <= '9')
+		{
+			indexEnd++;
+		}
+
+		/* placeholders are always qualified with the schema name */
+		if (indexEnd == indexStart || *indexEnd == '_' || *indexEnd == '$' ||
+			(*indexEnd >= 'a' && *indexEnd <= 'z') ||
+			placeholder == queryString || placeholder[-1] != '.')
+		{
+			return false;
+		}
+
+		int relationIndex = strtol(indexStart, NULL, 10);
+		if (relationIndex >= relationCount)
+		{
+			return false;
+		}
+
+		queryTemplate->fragmentList =
+			lappend(queryTemplate->fragmentList,
+					pnstrdup(fragmentStart, placeholder - fragmentStart));
+		queryTemplate->placeholderList =
+			lappend_int(queryTemplate->placeholderList, relationIndex);
+
+		fragmentStart = indexEnd;
+	}
+
+	queryTemplate->fragmentList = lappend(queryTemplate->fragmentList,
+										  pstrdup(fragmentStart));
+
+	return true;
+}
+
+
+/*
+ * InstantiateShardQueryTemplate builds the query string of a task from a
+ * query template, by filling in the names of the shards in relationShardList.
+ * It returns NULL if relationShardList lacks a valid shard for one of the
+ * relations of the template.
+ */
+char *
+InstantiateShardQueryTemplate(ShardQueryTemplate *queryTemplate,
+							  List *relationShardList)
+{
+	int relationCount = list_length(queryTemplate->relationIdList);
+	const char **shardNameArray = palloc0(relationCount * sizeof(char *));
+	int relationIndex = 0;
+	Oid relationId = InvalidOid;
+
+	foreach_oid(relationId, queryTemplate->relationIdList)
+	{
+		RelationShard *relationShard = FindRelationShard(relationId,
+														 relationShardList);
+		if (relationShard == NULL || relationShard->shardId == INVALID_SHARD_ID)
+		{
+			return NULL;
+		}
+
+		char *shardName = get_rel_name(relationId);
+		AppendShardIdToName(&shardName, relationShard->shardId);
+
+		shardNameArray[relationIndex++] = quote_identifier(shardName);
+	}
+
+	StringInfo queryString = makeStringInfo();
+	ListCell *fragmentCell = NULL;
+	int placeholderIndex = 0;
+
+	foreach(fragmentCell, queryTemplate->fragmentList)
+	{
+		appendStringInfoString(queryString, (char *) lfirst(fragmentCell));
+
+		if (placeholderIndex < list_length(queryTemplate->placeholderList))
+		{
+			int shardRelationIndex = list_nth_int(queryTemplate->placeholderList,
+												  placeholderIndex);
+
+			appendStringInfoString(queryString, shardNameArray[shardRelationIndex]);
+			placeholderIndex++;
+		}
+	}
+
+	return queryString->data;
+}
+
+
 /*
  * ConvertRteToSubqueryWithEmptyResult converts given relation RTE into
  * subquery RTE that returns no results.
@@ -43,6 +43,10 @@
 #include "distributed/multi_physical_planner.h"
 #include "distributed/combine_query_planner.h"
 #include "distributed/multi_router_planner.h"
+#include "distributed/parallel_combine.h"
+#include "distributed/parallel_result_scan.h"
+#include "distributed/planner_timing.h"
+#include "distributed/query_stats.h"
 #include "distributed/query_utils.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/shardinterval_utils.h"
@@ -71,6 +75,9 @@ static List *plannerRestrictionContextList = NIL;
 int MultiTaskQueryLogLevel = CITUS_LOG_LEVEL_OFF; /* multi-task query log level */
 static uint64 NextPlanId = 1;
 
+/* GUC, whether multi-shard SELECTs can be planned with unresolved parameters */
+bool EnableGenericMultiShardPlans = false;
+
 /* keep track of planner call stack levels */
 int PlannerLevel = 0;
 
@@ -130,6 +137,11 @@ static PlannedStmt * PlanDistributedStmt(DistributedPlanningContext *planContext
 static RTEListProperties * GetRTEListProperties(List *rangeTableList);
 static List * TranslatedVars(PlannerInfo *root, int relationIndex);
 static void WarnIfListHasForeignDistributedTable(List *rangeTableList);
+static DistributedPlan * TryCreateGenericMultiShardPlan(Query *originalQuery,
+														Query *query,
+														PlannerRestrictionContext *
+														plannerRestrictionContext);
+static bool CanPlanGenericMultiShardQuery(Query *query);
 
 
 /* Distributed planner hook */
@@ -160,6 +172,9 @@ distributed_planner(Query *parse,
 	}
 	else if (CitusHasBeenLoaded())
 	{
+		/* build the cache entries of frequently used tables on first use */
+		WarmUpMetadataCache();
+
 		bool maybeHasForeignDistributedTable = false;
 		needsDistributedPlanning =
 			ListContainsDistributedTableRTE(rangeTableList,
@@ -231,6 +246,19 @@ distributed_planner(Query *parse,
 	/* create a restriction context and put it at the end if context list */
 	planContext.plannerRestrictionContext = CreateAndPushPlannerRestrictionContext();
 
+	/*
+	 * Time the phases of the distributed planning of top-level queries, in case
+	 * citus_stat_statements or EXPLAIN want to report them.
+	 */
+	bool timePlannerPhases = needsDistributedPlanning && PlannerLevel == 0;
+	bool trackPlannerPhases = timePlannerPhases &&
+							  StatStatementsTrack == STAT_STATEMENTS_TRACK_ALL &&
+							  parse->queryId != UINT64CONST(0);
+	if (timePlannerPhases)
+	{
+		BeginPlannerPhaseTimings(trackPlannerPhases);
+	}
+
 	/*
 	 * We keep track of how many times we've recursed into the planner, primarily
 	 * to detect whether we are in a function call. We need to make sure that the
@@ -273,6 +301,11 @@ distributed_planner(Query *parse,
 
 		PlannerLevel--;
 
+		if (timePlannerPhases)
+		{
+			AbortPlannerPhaseTimings();
+		}
+
 		PG_RE_THROW();
 	}
 	PG_END_TRY();
@@ -282,6 +315,16 @@ distributed_planner(Query *parse,
 	/* remove the context from the context list */
 	PopPlannerRestrictionContext();
 
+	if (timePlannerPhases)
+	{
+		PlannerPhaseTimings plannerPhaseTimings;
+
+		if (EndPlannerPhaseTimings(&plannerPhaseTimings) && trackPlannerPhases)
+		{
+			CitusQueryStatsPlannerTimingsEntry(parse->queryId, &plannerPhaseTimings);
+		}
+	}
+
 	/*
 	 * In some cases, for example; parameterized SQL functions, we may miss that
 	 * there is a need for distributed planning. Such cases only become clear after
@@ -1044,9 +1087,23 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 		 * There are parameters that don't have a value in boundParams.
 		 *
 		 * The remainder of the planning logic cannot handle unbound
-		 * parameters. We return a NULL plan, which will have an
-		 * extremely high cost, such that postgres will replan with
-		 * bound parameters.
+		 * parameters in general. Simple multi-shard SELECTs can still be
+		 * planned once, with the parameters sent to the workers along with
+		 * the shard queries, such that postgres can cache the plan.
+		 */
+		if (EnableGenericMultiShardPlans && !IsModifyCommand(originalQuery))
+		{
+			distributedPlan = TryCreateGenericMultiShardPlan(originalQuery, query,
+															 plannerRestrictionContext);
+			if (distributedPlan != NULL)
+			{
+				return distributedPlan;
+			}
+		}
+
+		/*
+		 * We return a NULL plan, which will have an extremely high cost,
+		 * such that postgres will replan with bound parameters.
 		 */
 		return NULL;
 	}
@@ -1068,8 +1125,10 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 	 * Plan subqueries and CTEs that cannot be pushed down by recursively
 	 * calling the planner and return the resulting plans to subPlanList.
 	 */
+	BeginPlannerPhase(PLANNER_PHASE_RECURSIVE_PLANNING);
 	List *subPlanList = GenerateSubplansForSubqueriesAndCTEs(planId, originalQuery,
 															 plannerRestrictionContext);
+	EndPlannerPhase(PLANNER_PHASE_RECURSIVE_PLANNING);
 
 	/*
 	 * If subqueries were recursively planned then we need to replan the query
@@ -1167,6 +1226,121 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 }
 
 
+/*
+ * TryCreateGenericMultiShardPlan tries to plan a multi-shard SELECT that has
+ * unresolved parameters via the logical and physical planners. The parameters
+ * stay in the shard queries and the combine query, and the executor sends their
+ * values to the workers. Hence postgres can reuse the resulting generic plan for
+ * every execution of the prepared statement instead of going though distributed
+ * planning each time.
+ *
+ * Shard pruning only uses constants, so parameters in filters on the distribution
+ * column do not prune shards in such a plan. Postgres picks the generic plan only
+ * when it is not more expensive than the custom plans it built for the first few
+ * executions.
+ *
+ * When the shards of a table change, the relcache of the table is invalidated,
+ * which also invalidates the cached plans that use it.
+ *
+ * The function returns NULL if the query cannot be planned this way, in which
+ * case the caller falls back to custom plans.
+ */
+static DistributedPlan *
+TryCreateGenericMultiShardPlan(Query *originalQuery, Query *query,
+							   PlannerRestrictionContext *plannerRestrictionContext)
+{
+	if (!CanPlanGenericMultiShardQuery(originalQuery))
+	{
+		return NULL;
+	}
+
+	MemoryContext savedContext = CurrentMemoryContext;
+	DistributedPlan *distributedPlan = NULL;
+
+	PG_TRY();
+	{
+		MultiTreeRoot *logicalPlan = MultiLogicalPlanCreate(originalQuery, query,
+															plannerRestrictionContext);
+		MultiLogicalPlanOptimize(logicalPlan);
+
+		CheckNodeIsDumpable((Node *) logicalPlan);
+
+		distributedPlan = CreatePhysicalDistributedPlan(logicalPlan,
+														plannerRestrictionContext);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(savedContext);
+		ErrorData *edata = CopyErrorData();
+		FlushErrorState();
+
+		/* don't try to intercept PANIC or FATAL, let those breeze past us */
+		if (edata->elevel != ERROR)
+		{
+			PG_RE_THROW();
+		}
+
+		ereport(DEBUG4, (errmsg("could not plan multi-shard query with unresolved "
+								"parameters: %s", edata->message)));
+
+		FreeErrorData(edata);
+
+		distributedPlan = NULL;
+	}
+	PG_END_TRY();
+
+	/* repartition jobs embed results of other jobs, keep those on custom plans */
+	if (distributedPlan != NULL &&
+		(distributedPlan->planningError != NULL ||
+		 distributedPlan->workerJob->dependentJobList != NIL))
+	{
+		return NULL;
+	}
+
+	return distributedPlan;
+}
+
+
+/*
+ * CanPlanGenericMultiShardQuery returns true if the SELECT only consists of
+ * joins of distributed and reference tables, such that the logical planner can
+ * plan it without recursive planning, which needs the parameter values.
+ */
+static bool
+CanPlanGenericMultiShardQuery(Query *query)
+{
+	if (query->commandType != CMD_SELECT || query->cteList != NIL ||
+		query->hasSubLinks || query->setOperations != NULL ||
+		query->rowMarks != NIL)
+	{
+		return false;
+	}
+
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_ptr(rangeTableEntry, query->rtable)
+	{
+		if (rangeTableEntry->rtekind == RTE_JOIN)
+		{
+			continue;
+		}
+
+		if (rangeTableEntry->rtekind != RTE_RELATION ||
+			!IsCitusTable(rangeTableEntry->relid))
+		{
+			return false;
+		}
+
+		if (!IsCitusTableType(rangeTableEntry->relid, DISTRIBUTED_TABLE) &&
+			!IsCitusTableType(rangeTableEntry->relid, REFERENCE_TABLE))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
 /*
  * EnsurePartitionTableNotReplicated errors out if the input relation is
  * a partition table and the table has a replication factor greater than
@@ -1877,12 +2051,23 @@ multi_relation_restriction_hook(PlannerInfo *root, RelOptInfo *relOptInfo,
 		relOptInfo->pathlist = list_make1(path);
 		set_cheapest(relOptInfo);
 
+		if (EnableParallelCombine && relOptInfo->consider_parallel)
+		{
+			/* let the planner consider reading the rows in parallel workers */
+			Path *partialPath = CreateParallelCombineScanPath(root, relOptInfo,
+															  ReplaceCitusExtraDataContainerWithCustomScan);
+			add_partial_path(relOptInfo, partialPath);
+		}
+
 		return;
 	}
 
 	AdjustReadIntermediateResultCost(rte, relOptInfo);
 	AdjustReadIntermediateResultArrayCost(rte, relOptInfo);
 
+	/* let the planner consider reading intermediate results in parallel workers */
+	AddParallelResultScanPath(root, relOptInfo, rte);
+
 	if (rte->rtekind != RTE_RELATION)
 	{
 		return;
@@ -29,6 +29,12 @@
  * could use to decide the shard that a distributed query touches reside on
  * a worker node.
  *
+ * When citus.enable_fast_path_array_filters is on, "distribution_key IN (...)"
+ * and "distribution_key = ANY(array)" filters are also accepted. If all the
+ * values belong to a single shard, we end up with a regular router plan.
+ * Otherwise, for queries whose results can simply be concatenated, we create
+ * one task per shard, each only with the values that belong to its shard.
+ *
  * Copyright (c) Citus Data, Inc.
  *-------------------------------------------------------------------------
  */
@@ -38,26 +44,41 @@
 
 #include "distributed/distributed_planner.h"
 #include "distributed/insert_select_planner.h"
+#include "distributed/listutils.h"
 #include "distributed/multi_physical_planner.h" /* only to use some utility functions */
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/shard_pruning.h"
+#include "distributed/multi_logical_planner.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "nodes/parsenodes.h"
 #include "nodes/pg_list.h"
 #include "optimizer/optimizer.h"
 #include "tcop/pquery.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"
 
 bool EnableFastPathRouterPlanner = true;
 
+/* GUC, whether IN-lists and = ANY(array) on the distribution key are fast-path */
+bool EnableFastPathArrayFilters = false;
+
 static bool ColumnAppearsMultipleTimes(Node *quals, Var *distributionKey);
 static bool ConjunctionContainsColumnFilter(Node *node, Var *column,
 											Node **distributionKeyValue);
 static bool DistKeyInSimpleOpExpression(Expr *clause, Var *distColumn,
 										Node **distributionKeyValue);
+static bool DistKeyInScalarArrayOpExpression(ScalarArrayOpExpr *arrayOpExpr,
+											 Var *distColumn,
+											 Node **distributionKeyValue);
+static bool ArrayFilterQuerySupported(Query *query);
+static bool ResultsCanBeConcatenated(Query *query);
+static ScalarArrayOpExpr * FindDistKeyArrayFilterInConjunction(Node *node,
+															   Var *distColumn);
+static Const * ArrayFilterValues(ScalarArrayOpExpr *arrayOpExpr);
 
 
 /*
@@ -255,13 +276,58 @@ FastPathRouterQuery(Query *query, Node **distributionKeyValue)
 	if (ConjunctionContainsColumnFilter(quals, distributionKey, distributionKeyValue) &&
 		!ColumnAppearsMultipleTimes(quals, distributionKey))
 	{
-		return true;
+		return ArrayFilterQuerySupported(query);
 	}
 
 	return false;
 }
 
 
+/*
+ * ArrayFilterQuerySupported returns whether a query that passed the other
+ * fast-path checks can also be planned by the fast-path planner in case the
+ * filter on the distribution key is an IN-list or = ANY(array).
+ *
+ * If the results of the tasks can simply be concatenated, we can have one
+ * task per shard. Otherwise, all the values should belong to a single shard,
+ * which we can only know upfront if the values are constants.
+ */
+static bool
+ArrayFilterQuerySupported(Query *query)
+{
+	ScalarArrayOpExpr *arrayOpExpr = FindDistributionKeyArrayFilter(query);
+	if (arrayOpExpr == NULL)
+	{
+		/* the filter is a simple equality */
+		return true;
+	}
+
+	if (ResultsCanBeConcatenated(query))
+	{
+		return true;
+	}
+
+	return list_length(DistributionKeyValueGroups(query)) == 1;
+}
+
+
+/*
+ * ResultsCanBeConcatenated returns whether the results of a single table SELECT
+ * on multiple shards can be returned one after the other, without any further
+ * processing on the coordinator.
+ */
+static bool
+ResultsCanBeConcatenated(Query *query)
+{
+	return query->commandType == CMD_SELECT &&
+		   !query->hasAggs && !query->hasWindowFuncs &&
+		   query->groupClause == NIL && query->groupingSets == NIL &&
+		   query->havingQual == NULL && query->sortClause == NIL &&
+		   query->distinctClause == NIL && query->limitCount == NULL &&
+		   query->limitOffset == NULL && query->rowMarks == NIL;
+}
+
+
 /*
  * ColumnAppearsMultipleTimes returns true if the given input
  * appears more than once in the quals.
@@ -320,6 +386,11 @@ ConjunctionContainsColumnFilter(Node *node, Var *column, Node **distributionKeyV
 
 		return OperatorImplementsEquality(opExpr->opno);
 	}
+	else if (IsA(node, ScalarArrayOpExpr))
+	{
+		return DistKeyInScalarArrayOpExpression((ScalarArrayOpExpr *) node, column,
+												distributionKeyValue);
+	}
 	else if (IsA(node, BoolExpr))
 	{
 		BoolExpr *boolExpr = (BoolExpr *) node;
@@ -429,3 +500,248 @@ DistKeyInSimpleOpExpression(Expr *clause, Var *distColumn, Node **distributionKe
 
 	return distColumnExists;
 }
+
+
+/*
+ * DistKeyInScalarArrayOpExpression checks whether given expression is an
+ * IN-list or = ANY(array) filter on the distribution key, with either a
+ * parameter or constants for the values.
+ *
+ * When the values come from a parameter, distributionKeyValue is set to the
+ * parameter such that the pruning is deferred to the execution.
+ */
+static bool
+DistKeyInScalarArrayOpExpression(ScalarArrayOpExpr *arrayOpExpr, Var *distColumn,
+								 Node **distributionKeyValue)
+{
+	if (!EnableFastPathArrayFilters || !arrayOpExpr->useOr ||
+		list_length(arrayOpExpr->args) != 2 ||
+		!OperatorImplementsEquality(arrayOpExpr->opno))
+	{
+		return false;
+	}
+
+	Node *leftOperand = linitial(arrayOpExpr->args);
+	Node *rightOperand = lsecond(arrayOpExpr->args);
+	if (!IsA(leftOperand, Var) || !equal(leftOperand, distColumn))
+	{
+		return false;
+	}
+
+	Oid arrayType = exprType(rightOperand);
+	if (get_element_type(arrayType) != distColumn->vartype)
+	{
+		/* we do not deal with implicit coercions, like for simple equalities */
+		return false;
+	}
+
+	if (IsA(rightOperand, Param))
+	{
+		Param *paramClause = (Param *) rightOperand;
+		if (paramClause->paramkind != PARAM_EXTERN)
+		{
+			return false;
+		}
+
+		*distributionKeyValue = (Node *) copyObject(paramClause);
+		return true;
+	}
+
+	return ArrayFilterValues(arrayOpExpr) != NULL;
+}
+
+
+/*
+ * FindDistributionKeyArrayFilter returns the IN-list or = ANY(array) filter
+ * on the distribution key of a fast-path query, or NULL if the query filters
+ * the distribution key in a different way.
+ */
+ScalarArrayOpExpr *
+FindDistributionKeyArrayFilter(Query *query)
+{
+	if (!EnableFastPathArrayFilters || query->jointree == NULL ||
+		query->jointree->quals == NULL)
+	{
+		return NULL;
+	}
+
+	Oid relationId = ExtractFirstCitusTableId(query);
+	Var *distributionKey = PartitionColumn(relationId, 1);
+	if (distributionKey == NULL)
+	{
+		return NULL;
+	}
+
+	Node *quals = query->jointree->quals;
+	if (IsA(quals, List))
+	{
+		quals = (Node *) make_ands_explicit((List *) quals);
+	}
+
+	return FindDistKeyArrayFilterInConjunction(quals, distributionKey);
+}
+
+
+/*
+ * FindDistKeyArrayFilterInConjunction looks for an IN-list or = ANY(array)
+ * filter on the distribution column that is ANDed with the rest of the quals,
+ * the same way ConjunctionContainsColumnFilter does for simple equalities.
+ */
+static ScalarArrayOpExpr *
+FindDistKeyArrayFilterInConjunction(Node *node, Var *distColumn)
+{
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	if (IsA(node, ScalarArrayOpExpr))
+	{
+		ScalarArrayOpExpr *arrayOpExpr = (ScalarArrayOpExpr *) node;
+		Node *distributionKeyValue = NULL;
+
+		if (DistKeyInScalarArrayOpExpression(arrayOpExpr, distColumn,
+											 &distributionKeyValue))
+		{
+			return arrayOpExpr;
+		}
+	}
+	else if (IsA(node, BoolExpr) && ((BoolExpr *) node)->boolop == AND_EXPR)
+	{
+		Node *argumentNode = NULL;
+		foreach_ptr(argumentNode, ((BoolExpr *) node)->args)
+		{
+			ScalarArrayOpExpr *arrayOpExpr =
+				FindDistKeyArrayFilterInConjunction(argumentNode, distColumn);
+			if (arrayOpExpr != NULL)
+			{
+				return arrayOpExpr;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ArrayFilterValues returns the values of an IN-list or = ANY(array) filter as
+ * a non-null array constant, or NULL if the values are not all constants.
+ */
+static Const *
+ArrayFilterValues(ScalarArrayOpExpr *arrayOpExpr)
+{
+	Node *arrayNode = lsecond(arrayOpExpr->args);
+
+	if (IsA(arrayNode, ArrayExpr))
+	{
+		/* IN-lists are only folded into an array constant by the planner */
+		arrayNode = eval_const_expressions(NULL, arrayNode);
+	}
+
+	if (!IsA(arrayNode, Const) || ((Const *) arrayNode)->constisnull)
+	{
+		return NULL;
+	}
+
+	return (Const *) arrayNode;
+}
+
+
+/*
+ * DistributionKeyValueGroups groups the values of the IN-list or = ANY(array)
+ * filter on the distribution key of a fast-path query by shard, and returns
+ * a list of DistributionKeyValueGroups ordered by shard index. NULL values
+ * are skipped, as they cannot match any rows.
+ *
+ * The function returns NIL if the query does not have such a filter, if the
+ * values are not (yet) constants, or if none of the values is non-null.
+ */
+List *
+DistributionKeyValueGroups(Query *query)
+{
+	ScalarArrayOpExpr *arrayOpExpr = FindDistributionKeyArrayFilter(query);
+	if (arrayOpExpr == NULL)
+	{
+		return NIL;
+	}
+
+	Const *arrayConst = ArrayFilterValues(arrayOpExpr);
+	if (arrayConst == NULL)
+	{
+		return NIL;
+	}
+
+	Oid relationId = ExtractFirstCitusTableId(query);
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+
+	ArrayType *array = DatumGetArrayTypeP(arrayConst->constvalue);
+	Oid elementType = ARR_ELEMTYPE(array);
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	char typeAlignment = 0;
+	Datum *elementArray = NULL;
+	bool *nullArray = NULL;
+	int elementCount = 0;
+
+	get_typlenbyvalalign(elementType, &typeLength, &typeByValue, &typeAlignment);
+	deconstruct_array(array, elementType, typeLength, typeByValue, typeAlignment,
+					  &elementArray, &nullArray, &elementCount);
+
+	/* values per shard index */
+	Datum **shardValueArray = palloc0(shardCount * sizeof(Datum *));
+	int *shardValueCountArray = palloc0(shardCount * sizeof(int));
+
+	for (int elementIndex = 0; elementIndex < elementCount; elementIndex++)
+	{
+		if (nullArray[elementIndex])
+		{
+			continue;
+		}
+
+		ShardInterval *shardInterval =
+			FindShardInterval(elementArray[elementIndex], cacheEntry);
+		if (shardInterval == NULL)
+		{
+			ereport(ERROR, (errmsg("could not find shardinterval to which to send "
+								   "the query")));
+		}
+
+		int shardIndex = shardInterval->shardIndex;
+		if (shardValueArray[shardIndex] == NULL)
+		{
+			shardValueArray[shardIndex] = palloc(elementCount * sizeof(Datum));
+		}
+
+		shardValueArray[shardIndex][shardValueCountArray[shardIndex]++] =
+			elementArray[elementIndex];
+	}
+
+	List *valueGroupList = NIL;
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		if (shardValueCountArray[shardIndex] == 0)
+		{
+			continue;
+		}
+
+		ArrayType *groupArray = construct_array(shardValueArray[shardIndex],
+												shardValueCountArray[shardIndex],
+												elementType, typeLength, typeByValue,
+												typeAlignment);
+
+		DistributionKeyValueGroup *valueGroup = palloc0(
+			sizeof(DistributionKeyValueGroup));
+		valueGroup->shardInterval =
+			CopyShardInterval(GetCachedShardInterval(cacheEntry, shardIndex));
+		valueGroup->valueArray = makeConst(arrayConst->consttype, -1,
+										   arrayConst->constcollid, -1,
+										   PointerGetDatum(groupArray), false, false);
+
+		valueGroupList = lappend(valueGroupList, valueGroup);
+	}
+
+	return valueGroupList;
+}
@@ -17,6 +17,7 @@
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 #include "commands/defrem.h"
+#include "common/hashfn.h"
 #include "distributed/backend_data.h"
 #include "distributed/metadata_utility.h"
 #include "distributed/citus_ruleutils.h"
@@ -38,6 +39,7 @@
 #include "distributed/recursive_planning.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_manager.h"
+#include "distributed/worker_prepared_statements.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "nodes/parsenodes.h"
@@ -47,8 +49,12 @@
 #include "parser/parse_coerce.h"
 #include "parser/parsetree.h"
 #include "miscadmin.h"
+#include "storage/lmgr.h"
 #include "tcop/dest.h"
+#include "utils/hsearch.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
 #include "utils/syscache.h"
 
 struct ParamWalkerContext
@@ -57,6 +63,17 @@ struct ParamWalkerContext
 	ParamKind paramKind;
 };
 
+
+/*
+ * DelegationColocatedTableCacheEntry remembers the table that a delegated
+ * function call of a colocation group resolves its shard in.
+ */
+typedef struct DelegationColocatedTableCacheEntry
+{
+	uint32 colocationId;
+	Oid colocatedRelationId;
+} DelegationColocatedTableCacheEntry;
+
 extern AllowedDistributionColumn AllowedDistributionColumnValue;
 
 static bool contain_param_walker(Node *node, void *context);
@@ -65,6 +82,14 @@ static void CheckDelegatedFunctionExecution(DistObjectCacheEntry *procedure,
 static bool IsQuerySimple(Query *query);
 static FuncExpr * FunctionInFromClause(List *fromlist, Query *query);
 static void EnableInForceDelegatedFuncExecution(Const *distArgument, uint32 colocationId);
+static Oid DelegationColocatedTableId(uint32 colocationId);
+static bool CachedColocatedTableIsValid(Oid relationId, uint32 colocationId);
+static Query * ParameterizeDelegatedFunctionCall(Query *query, FuncExpr *funcExpr,
+												 List **parameterValueList);
+
+
+/* colocated tables of delegated function calls, keyed by colocation id */
+static HTAB *DelegationColocatedTableHash = NULL;
 
 
 /* global variable keeping track of whether we are in a delegated function call */
@@ -301,6 +326,19 @@ TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
 			}
 		}
 
+		/*
+		 * The coordinator may send the arguments as parameters of a prepared
+		 * statement. The flags above are only set while planning, so make sure
+		 * every call gets planned with the parameter values.
+		 */
+		(void) expression_tree_walker((Node *) funcExpr->args, contain_param_walker,
+									  &walkerParamContext);
+		if (walkerParamContext.hasParam &&
+			walkerParamContext.paramKind == PARAM_EXTERN)
+		{
+			DissuadePlannerFromUsingPlan(planContext->plan);
+		}
+
 		return NULL;
 	}
 
@@ -385,7 +423,7 @@ TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
 		return NULL;
 	}
 
-	Oid colocatedRelationId = ColocatedTableId(procedure->colocationId);
+	Oid colocatedRelationId = DelegationColocatedTableId(procedure->colocationId);
 	if (colocatedRelationId == InvalidOid)
 	{
 		ereport(DEBUG1, (errmsg("function does not have co-located tables")));
@@ -477,15 +515,29 @@ TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
 		task->taskType = READ_TASK;
 	}
 
+	/*
+	 * With worker prepared statements, send the constant arguments as
+	 * parameters, such that all calls of the function use the same statement
+	 * on the worker connection.
+	 */
+	Query *jobQuery = planContext->query;
+	List *parameterValueList = NIL;
+	if (EnableWorkerPreparedStatements)
+	{
+		jobQuery = ParameterizeDelegatedFunctionCall(jobQuery, funcExpr,
+													 &parameterValueList);
+	}
+
 	task->taskPlacementList = list_make1(placement);
-	SetTaskQueryIfShouldLazyDeparse(task, planContext->query);
+	SetTaskQueryIfShouldLazyDeparse(task, jobQuery);
 	task->anchorShardId = placement->shardId;
 	task->replicationModel = distTable->replicationModel;
 
 	Job *job = CitusMakeNode(Job);
 	job->jobId = UniqueJobId();
-	job->jobQuery = planContext->query;
+	job->jobQuery = jobQuery;
 	job->taskList = list_make1(task);
+	job->parameterValueList = parameterValueList;
 
 	DistributedPlan *distributedPlan = CitusMakeNode(DistributedPlan);
 	distributedPlan->workerJob = job;
@@ -499,6 +551,133 @@ TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
 }
 
 
+/*
+ * DelegationColocatedTableId returns a table in the given colocation group,
+ * like ColocatedTableId, but remembers the table across calls such that
+ * frequent calls of a delegated function do not have to scan pg_dist_partition.
+ *
+ * The remembered table is checked on every use, since it might have been
+ * dropped or moved to another colocation group in the meantime.
+ */
+static Oid
+DelegationColocatedTableId(uint32 colocationId)
+{
+	if (colocationId == INVALID_COLOCATION_ID)
+	{
+		return InvalidOid;
+	}
+
+	if (DelegationColocatedTableHash == NULL)
+	{
+		HASHCTL info;
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(uint32);
+		info.entrysize = sizeof(DelegationColocatedTableCacheEntry);
+		info.hash = uint32_hash;
+		info.hcxt = CacheMemoryContext;
+		int hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+		DelegationColocatedTableHash =
+			hash_create("Delegated function colocated tables", 32, &info, hashFlags);
+	}
+
+	DelegationColocatedTableCacheEntry *cacheEntry =
+		hash_search(DelegationColocatedTableHash, &colocationId, HASH_FIND, NULL);
+	if (cacheEntry != NULL)
+	{
+		if (CachedColocatedTableIsValid(cacheEntry->colocatedRelationId, colocationId))
+		{
+			return cacheEntry->colocatedRelationId;
+		}
+
+		hash_search(DelegationColocatedTableHash, &colocationId, HASH_REMOVE, NULL);
+	}
+
+	Oid colocatedRelationId = ColocatedTableId(colocationId);
+	if (colocatedRelationId != InvalidOid)
+	{
+		cacheEntry = hash_search(DelegationColocatedTableHash, &colocationId,
+								 HASH_ENTER, NULL);
+		cacheEntry->colocatedRelationId = colocatedRelationId;
+	}
+
+	return colocatedRelationId;
+}
+
+
+/*
+ * CachedColocatedTableIsValid locks the given table like ColocatedTableId does
+ * and returns whether it still exists and belongs to the given colocation group.
+ */
+static bool
+CachedColocatedTableIsValid(Oid relationId, uint32 colocationId)
+{
+	LockRelationOid(relationId, AccessShareLock);
+
+	Relation relation = RelationIdGetRelation(relationId);
+	if (!RelationIsValid(relation))
+	{
+		return false;
+	}
+
+	RelationClose(relation);
+
+	CitusTableCacheEntry *cacheEntry = LookupCitusTableCacheEntry(relationId);
+	return cacheEntry != NULL && cacheEntry->colocationId == colocationId;
+}
+
+
+/*
+ * ParameterizeDelegatedFunctionCall returns a copy of the query of a
+ * delegated function call in which the constant arguments of the function
+ * are replaced by parameters. The values of the parameters are returned in
+ * parameterValueList.
+ */
+static Query *
+ParameterizeDelegatedFunctionCall(Query *query, FuncExpr *funcExpr,
+								  List **parameterValueList)
+{
+	List *argumentList = NIL;
+	int parameterId = 0;
+
+	Node *argument = NULL;
+	foreach_ptr(argument, funcExpr->args)
+	{
+		if (IsA(argument, Const))
+		{
+			Const *argumentConst = (Const *) argument;
+			Param *param = makeNode(Param);
+
+			param->paramkind = PARAM_EXTERN;
+			param->paramid = ++parameterId;
+			param->paramtype = argumentConst->consttype;
+			param->paramtypmod = argumentConst->consttypmod;
+			param->paramcollid = argumentConst->constcollid;
+			param->location = argumentConst->location;
+
+			*parameterValueList = lappend(*parameterValueList, argumentConst);
+			argument = (Node *) param;
+		}
+
+		argumentList = lappend(argumentList, argument);
+	}
+
+	if (parameterId == 0)
+	{
+		/* send the query as is */
+		return query;
+	}
+
+	/* temporarily swap the arguments, such that the copy has the parameters */
+	List *originalArgumentList = funcExpr->args;
+	funcExpr->args = argumentList;
+	Query *parameterizedQuery = copyObject(query);
+	funcExpr->args = originalArgumentList;
+
+	return parameterizedQuery;
+}
+
+
 /*
  * ShardPlacementForFunctionColocatedWithDistTable decides on a placement
  * for delegating a procedure call that accesses a distributed table.
@@ -580,7 +759,7 @@ ShardPlacementForFunctionColocatedWithDistTable(DistObjectCacheEntry *procedure,
 ShardPlacement *
 ShardPlacementForFunctionColocatedWithReferenceTable(CitusTableCacheEntry *cacheEntry)
 {
-	const ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[0];
+	const ShardInterval *shardInterval = GetCachedShardInterval(cacheEntry, 0);
 	const uint64 referenceTableShardId = shardInterval->shardId;
 
 	/* Get the list of active shard placements ordered by the groupid */
@@ -595,6 +774,10 @@ ShardPlacementForFunctionColocatedWithReferenceTable(CitusTableCacheEntry *cache
 		/* reorder the placement list */
 		placementList = RoundRobinReorder(placementList);
 	}
+	else if (TaskAssignmentPolicy == TASK_ASSIGNMENT_LEAST_LOADED)
+	{
+		placementList = LeastLoadedReorder(placementList);
+	}
 
 	return (ShardPlacement *) linitial(placementList);
 }
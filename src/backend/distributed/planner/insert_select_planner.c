@@ -313,7 +313,7 @@ CreateDistributedInsertSelectPlan(Query *originalQuery,
 	for (int shardOffset = 0; shardOffset < shardCount; shardOffset++)
 	{
 		ShardInterval *targetShardInterval =
-			targetCacheEntry->sortedShardIntervalArray[shardOffset];
+			GetCachedShardInterval(targetCacheEntry, shardOffset);
 
 		Task *modifyTask = RouterModifyTaskForShardInterval(originalQuery,
 															targetCacheEntry,
@@ -7,6 +7,11 @@
  * that use them in the remainder of the distributed plan to avoid unnecessary
  * network traffic.
  *
+ * When recursive planning shares a subplan between identical subqueries or
+ * CTEs, all of them read the same result id. Their usages end up in the same
+ * IntermediateResultsHashEntry, such that the result is sent only once to
+ * each node that needs it.
+ *
  * Copyright (c) Citus Data, Inc.
  *
  *-------------------------------------------------------------------------
@@ -16,14 +16,28 @@
 #include "distributed/local_plan_cache.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/citus_ruleutils.h"
+#include "distributed/combine_query_planner.h"
 #include "distributed/insert_select_planner.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
 #include "distributed/version_compat.h"
 #include "optimizer/optimizer.h"
 #include "optimizer/clauses.h"
+#include "utils/memutils.h"
 
 
+/* GUC, whether plans of the local tasks of multi-shard queries are cached */
+bool EnableMultiShardLocalPlanCaching = false;
+
+/* GUC, maximum number of local plans cached per distributed plan, -1 for no limit */
+int MaxCachedLocalPlans = -1;
+
+/* counter that orders the uses of cached local plans in this backend */
+static uint64 LocalPlanUseCount = 0;
+
+static bool IsMultiShardLocalPlanCachingSupported(Job *currentJob);
+static void AddCachedLocalPlan(Job *workerJob,
+							   LocalPlannedStatement *localPlannedStatement);
 static Query * GetLocalShardQueryForCache(Query *jobQuery, Task *task,
 										  ParamListInfo paramListInfo);
 static char * DeparseLocalShardQuery(Query *jobQuery, List *relationShardList,
@@ -53,12 +67,21 @@ CacheLocalPlanForShardQuery(Task *task, DistributedPlan *originalDistributedPlan
 		return;
 	}
 
+	if (MaxCachedLocalPlans == 0)
+	{
+		/* user disabled local plan caching */
+		return;
+	}
+
 	/*
-	 * All memory allocations should happen in the plan's context
-	 * since we'll cache the local plan there.
+	 * All memory allocations should happen in a context that lives as long
+	 * as the plan, since we'll cache the local plan there. Each local plan
+	 * gets its own context, such that it can be freed when it is evicted.
 	 */
-	MemoryContext oldContext =
-		MemoryContextSwitchTo(GetMemoryChunkContext(originalDistributedPlan));
+	MemoryContext planContext =
+		AllocSetContextCreate(GetMemoryChunkContext(originalDistributedPlan),
+							  "Local Plan Context", ALLOCSET_SMALL_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(planContext);
 
 	/*
 	 * We prefer to use jobQuery (over task->query) because we don't want any
@@ -79,28 +102,77 @@ CacheLocalPlanForShardQuery(Task *task, DistributedPlan *originalDistributedPlan
 	 */
 	if (rangeTableEntry->relid == InvalidOid)
 	{
-		pfree(jobQuery);
-		pfree(localShardQuery);
 		MemoryContextSwitchTo(oldContext);
+		MemoryContextDelete(planContext);
 		return;
 	}
 
 	LockRelationOid(rangeTableEntry->relid, lockMode);
 
-	LocalPlannedStatement *localPlannedStatement = CitusMakeNode(LocalPlannedStatement);
 	localPlan = planner(localShardQuery, NULL, 0, NULL);
+
+	MemoryContextSwitchTo(GetMemoryChunkContext(originalDistributedPlan));
+
+	LocalPlannedStatement *localPlannedStatement = CitusMakeNode(LocalPlannedStatement);
 	localPlannedStatement->localPlan = localPlan;
 	localPlannedStatement->shardId = task->anchorShardId;
 	localPlannedStatement->localGroupId = GetLocalGroupId();
+	localPlannedStatement->lastUsed = ++LocalPlanUseCount;
+	localPlannedStatement->planContext = planContext;
 
-	originalDistributedPlan->workerJob->localPlannedStatements =
-		lappend(originalDistributedPlan->workerJob->localPlannedStatements,
-				localPlannedStatement);
+	AddCachedLocalPlan(originalDistributedPlan->workerJob, localPlannedStatement);
 
 	MemoryContextSwitchTo(oldContext);
 }
 
 
+/*
+ * AddCachedLocalPlan adds the given local plan to the cached local plans of
+ * the given job. When citus.max_cached_local_plans plans are cached already,
+ * the new plan takes the place of the least recently used plan.
+ *
+ * The evicted plan might still be in use by an execution of the same plan
+ * further up the stack, hence its memory is only freed at the end of the
+ * transaction. The list itself is never shortened, since copies of the
+ * distributed plan for the current execution point to the same list.
+ */
+static void
+AddCachedLocalPlan(Job *workerJob, LocalPlannedStatement *localPlannedStatement)
+{
+	List *cachedPlanList = workerJob->localPlannedStatements;
+
+	if (MaxCachedLocalPlans < 0 || list_length(cachedPlanList) < MaxCachedLocalPlans)
+	{
+		workerJob->localPlannedStatements = lappend(cachedPlanList,
+													localPlannedStatement);
+		return;
+	}
+
+	ListCell *leastRecentlyUsedCell = NULL;
+	ListCell *cachedPlanCell = NULL;
+	foreach(cachedPlanCell, cachedPlanList)
+	{
+		LocalPlannedStatement *cachedPlan = lfirst(cachedPlanCell);
+
+		if (leastRecentlyUsedCell == NULL ||
+			cachedPlan->lastUsed <
+			((LocalPlannedStatement *) lfirst(leastRecentlyUsedCell))->lastUsed)
+		{
+			leastRecentlyUsedCell = cachedPlanCell;
+		}
+	}
+
+	LocalPlannedStatement *evictedPlan = lfirst(leastRecentlyUsedCell);
+	if (evictedPlan->planContext != NULL)
+	{
+		MemoryContextSetParent(evictedPlan->planContext, TopTransactionContext);
+		evictedPlan->planContext = NULL;
+	}
+
+	lfirst(leastRecentlyUsedCell) = localPlannedStatement;
+}
+
+
 /*
  * GetLocalShardQueryForCache is a helper function which generates
  * the local shard query based on the jobQuery. The function should
@@ -248,6 +320,8 @@ GetCachedLocalPlan(Task *task, DistributedPlan *distributedPlan)
 		if (localPlannedStatement->shardId == task->anchorShardId &&
 			localPlannedStatement->localGroupId == localGroupId)
 		{
+			localPlannedStatement->lastUsed = ++LocalPlanUseCount;
+
 			/* already have a cached plan, no need to continue */
 			return localPlannedStatement->localPlan;
 		}
@@ -273,7 +347,15 @@ IsLocalPlanCachingSupported(Job *currentJob, DistributedPlan *originalDistribute
 		return false;
 	}
 
-	if (!currentJob->deferredPruning)
+	List *taskList = currentJob->taskList;
+	if (list_length(taskList) > 1)
+	{
+		if (!IsMultiShardLocalPlanCachingSupported(currentJob))
+		{
+			return false;
+		}
+	}
+	else if (!currentJob->deferredPruning)
 	{
 		/*
 		 * When not using deferred pruning we may have already replaced distributed
@@ -288,17 +370,15 @@ IsLocalPlanCachingSupported(Job *currentJob, DistributedPlan *originalDistribute
 		return false;
 	}
 
-	List *taskList = currentJob->taskList;
-	if (list_length(taskList) != 1)
+	else if (list_length(taskList) != 1)
 	{
-		/* we only support plan caching for single shard queries */
+		/* zero shard queries are not worth caching */
 		return false;
 	}
 
-	Task *task = linitial(taskList);
-	if (!TaskAccessesLocalNode(task))
+	if (!AnyTaskAccessesLocalNode(taskList))
 	{
-		/* not a local task */
+		/* no local tasks */
 		return false;
 	}
 
@@ -330,3 +410,50 @@ IsLocalPlanCachingSupported(Job *currentJob, DistributedPlan *originalDistribute
 
 	return true;
 }
+
+
+/*
+ * IsMultiShardLocalPlanCachingSupported returns whether the plans of the local
+ * tasks of the given multi-task job can be cached. Each of those plans is
+ * built from the job query with the tables replaced by the shards of its
+ * task, so the tasks should only differ in the shards they access.
+ */
+static bool
+IsMultiShardLocalPlanCachingSupported(Job *currentJob)
+{
+	if (!EnableMultiShardLocalPlanCaching)
+	{
+		return false;
+	}
+
+	/* multi-row INSERTs send different rows to each shard */
+	Query *jobQuery = currentJob->jobQuery;
+	if (jobQuery == NULL || jobQuery->commandType == CMD_INSERT)
+	{
+		return false;
+	}
+
+	/* repartition joins have tasks that depend on the tasks of other jobs */
+	if (currentJob->dependentJobList != NIL)
+	{
+		return false;
+	}
+
+	/* the job query should still refer to the distributed tables */
+	RangeTblEntry *shardPlaceholderRte = NULL;
+	if (FindCitusExtradataContainerRTE((Node *) jobQuery, &shardPlaceholderRte))
+	{
+		return false;
+	}
+
+	Task *task = NULL;
+	foreach_ptr(task, currentJob->taskList)
+	{
+		if (task->dependentTaskList != NIL)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
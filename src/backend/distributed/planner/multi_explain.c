@@ -41,6 +41,7 @@
 #include "distributed/multi_router_planner.h"
 #include "distributed/distributed_planner.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/planner_timing.h"
 #include "distributed/remote_commands.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/placement_connection.h"
@@ -74,6 +75,9 @@ bool ExplainDistributedQueries = true;
 bool ExplainAllTasks = false;
 int ExplainAnalyzeSortMethod = EXPLAIN_ANALYZE_SORT_BY_TIME;
 
+/* GUC, whether EXPLAIN ANALYZE shows network and connection metrics of tasks */
+bool ExplainAnalyzeNetworkMetrics = false;
+
 /*
  * If enabled, EXPLAIN ANALYZE output & other statistics of last worker task
  * are saved in following variables.
@@ -135,6 +139,7 @@ static RemoteExplainPlan * FetchRemoteExplainFromWorkers(Task *task, ExplainStat
 static void ExplainTask(CitusScanState *scanState, Task *task, int placementIndex,
 						List *explainOutputList,
 						ExplainState *es);
+static void ExplainTaskNetworkMetrics(Task *task, ExplainState *es);
 static void ExplainTaskPlacement(ShardPlacement *taskPlacement, List *explainOutputList,
 								 ExplainState *es);
 static StringInfo BuildRemoteExplainQuery(char *queryString, ExplainState *es);
@@ -170,6 +175,8 @@ static double elapsed_time(instr_time *starttime);
 static void ExplainPropertyBytes(const char *qlabel, int64 bytes, ExplainState *es);
 static uint64 TaskReceivedTupleData(Task *task);
 static bool ShowReceivedTupleData(CitusScanState *scanState, ExplainState *es);
+static void ExplainPlannerPhaseTimingsGroup(PlannerPhaseTimings *timings,
+											ExplainState *es);
 
 
 /* exports for SQL callable functions */
@@ -200,6 +207,12 @@ CitusExplainScan(CustomScanState *node, List *ancestors, struct ExplainState *es
 
 	ExplainOpenGroup("Distributed Query", "Distributed Query", true, es);
 
+	PlannerPhaseTimings *plannerPhaseTimings = ExplainPlannerPhaseTimings();
+	if (plannerPhaseTimings != NULL)
+	{
+		ExplainPlannerPhaseTimingsGroup(plannerPhaseTimings, es);
+	}
+
 	/*
 	 * ExplainOnePlan function of postgres might be called in this codepath.
 	 * It requires an ActiveSnapshot being set. Make sure to make ActiveSnapshot available before calling into
@@ -220,6 +233,34 @@ CitusExplainScan(CustomScanState *node, List *ancestors, struct ExplainState *es
 }
 
 
+/*
+ * ExplainPlannerPhaseTimingsGroup shows the time spent in the phases of the
+ * distributed planning of the query.
+ */
+static void
+ExplainPlannerPhaseTimingsGroup(PlannerPhaseTimings *timings, ExplainState *es)
+{
+	ExplainOpenGroup("Planner Phases", "Planner Phases", true, es);
+
+	ExplainPropertyFloat("Distributed Planning Time", "ms", timings->totalMillisecs,
+						 3, es);
+	ExplainPropertyFloat("Recursive Planning Time", "ms",
+						 timings->phaseMillisecs[PLANNER_PHASE_RECURSIVE_PLANNING],
+						 3, es);
+	ExplainPropertyFloat("Pushdown Checks Time", "ms",
+						 timings->phaseMillisecs[PLANNER_PHASE_PUSHDOWN_CHECKS],
+						 3, es);
+	ExplainPropertyFloat("Shard Pruning Time", "ms",
+						 timings->phaseMillisecs[PLANNER_PHASE_SHARD_PRUNING],
+						 3, es);
+	ExplainPropertyFloat("Deparse Time", "ms",
+						 timings->phaseMillisecs[PLANNER_PHASE_DEPARSE],
+						 3, es);
+
+	ExplainCloseGroup("Planner Phases", "Planner Phases", true, es);
+}
+
+
 /*
  * NonPushableInsertSelectExplainScan is a custom scan explain callback function
  * which is used to print explain information of a Citus plan for an INSERT INTO
@@ -337,7 +378,11 @@ ExplainSubPlans(DistributedPlan *distributedPlan, ExplainState *es)
 								 subPlan->bytesSentPerWorker, es);
 
 			StringInfo destination = makeStringInfo();
-			if (subPlan->remoteWorkerCount && subPlan->writeLocalFile)
+			if (subPlan->inlined)
+			{
+				appendStringInfoString(destination, "Inline into task queries");
+			}
+			else if (subPlan->remoteWorkerCount && subPlan->writeLocalFile)
 			{
 				appendStringInfo(destination, "Send to %d nodes, write locally",
 								 subPlan->remoteWorkerCount);
@@ -438,6 +483,15 @@ ExplainJob(CitusScanState *scanState, Job *job, ExplainState *es,
 							 es);
 	}
 
+	if (es->analyze && es->timing && ExplainAnalyzeNetworkMetrics)
+	{
+		/* coordinator CPU time spent on the results versus time spent waiting */
+		ExplainPropertyFloat("Result Decoding Time", "ms", scanState->resultDecodeTime,
+							 3, es);
+		ExplainPropertyFloat("Remote Wait Time", "ms", scanState->remoteWaitTime, 3,
+							 es);
+	}
+
 	if (dependentJobCount > 0)
 	{
 		ExplainPropertyText("Tasks Shown", "None, not supported for re-partition "
@@ -532,6 +586,15 @@ ExplainMapMergeJob(MapMergeJob *mapMergeJob, ExplainState *es)
 	ExplainPropertyInteger("Map Task Count", NULL, mapTaskCount, es);
 	ExplainPropertyInteger("Merge Task Count", NULL, mergeTaskCount, es);
 
+	/* show how the map tasks treat the heavy hitters of the join key */
+	if (mapMergeJob->heavyHitterResultId != NULL)
+	{
+		const char *skewHandling = mapMergeJob->samplesHeavyHitters ?
+								   "spread heavy hitters" :
+								   "replicate heavy hitters";
+		ExplainPropertyText("Skew Handling", skewHandling, es);
+	}
+
 	if (dependentJobCount > 0)
 	{
 		ExplainOpenGroup("Dependent Jobs", "Dependent Jobs", false, es);
@@ -813,6 +876,11 @@ ExplainTask(CitusScanState *scanState, Task *task, int placementIndex,
 							 es);
 	}
 
+	if (es->analyze && ExplainAnalyzeNetworkMetrics && task->explainAnalyzeRoundTrips > 0)
+	{
+		ExplainTaskNetworkMetrics(task, es);
+	}
+
 	if (explainOutputList != NIL)
 	{
 		List *taskPlacementList = task->taskPlacementList;
@@ -834,6 +902,27 @@ ExplainTask(CitusScanState *scanState, Task *task, int placementIndex,
 }
 
 
+/*
+ * ExplainTaskNetworkMetrics shows how long the task waited for a connection and
+ * for its first row, how many round trips it took and whether it used a
+ * connection that the session had already opened.
+ */
+static void
+ExplainTaskNetworkMetrics(Task *task, ExplainState *es)
+{
+	if (es->timing)
+	{
+		ExplainPropertyFloat("Connection Wait Time", "ms",
+							 task->explainAnalyzeConnectionWaitTime, 3, es);
+		ExplainPropertyFloat("Time To First Row", "ms",
+							 task->explainAnalyzeFirstRowTime, 3, es);
+	}
+
+	ExplainPropertyInteger("Round Trips", NULL, task->explainAnalyzeRoundTrips, es);
+	ExplainPropertyBool("Connection Reused", task->explainAnalyzeConnectionReused, es);
+}
+
+
 /*
  * ExplainTaskPlacement shows the EXPLAIN output for an individual task placement.
  * It corrects the indentation of the remote explain output to match the local
@@ -1208,8 +1297,25 @@ CitusExplainOneQuery(Query *query, int cursorOptions, IntoClause *into,
 	 */
 	SetLocalHideCitusDependentObjectsDisabledWhenAlreadyEnabled();
 
+	/* let the planner know whether we are going to show the planner phases */
+	SetExplainPlannerPhaseTimingsRequested(ExplainPlannerPhases && es->summary);
+
 	/* plan the query */
-	PlannedStmt *plan = pg_plan_query(query, NULL, cursorOptions, params);
+	PlannedStmt *plan = NULL;
+
+	PG_TRY();
+	{
+		plan = pg_plan_query(query, NULL, cursorOptions, params);
+	}
+	PG_CATCH();
+	{
+		SetExplainPlannerPhaseTimingsRequested(false);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	SetExplainPlannerPhaseTimingsRequested(false);
+
 	INSTR_TIME_SET_CURRENT(planduration);
 	INSTR_TIME_SUBTRACT(planduration, planstart);
 
@@ -1344,6 +1450,37 @@ ResetExplainAnalyzeData(List *taskList)
 		task->totalReceivedTupleData = 0;
 		task->fetchedExplainAnalyzePlacementIndex = 0;
 		task->fetchedExplainAnalyzePlan = NULL;
+		task->explainAnalyzeConnectionWaitTime = 0.0;
+		task->explainAnalyzeFirstRowTime = 0.0;
+		task->explainAnalyzeRoundTrips = 0;
+		task->explainAnalyzeConnectionReused = false;
+	}
+}
+
+
+/*
+ * SaveExplainAnalyzeTaskMetrics copies the network and connection metrics that
+ * the executor recorded on the tasks returned by ExplainAnalyzeTaskList to the
+ * original tasks, which ExplainTask shows.
+ */
+void
+SaveExplainAnalyzeTaskMetrics(List *explainAnalyzeTaskList)
+{
+	Task *explainAnalyzeTask = NULL;
+	foreach_ptr(explainAnalyzeTask, explainAnalyzeTaskList)
+	{
+		ExplainAnalyzeDestination *tupleDestination =
+			(ExplainAnalyzeDestination *) explainAnalyzeTask->tupleDest;
+		Task *originalTask = tupleDestination->originalTask;
+
+		originalTask->explainAnalyzeConnectionWaitTime =
+			explainAnalyzeTask->explainAnalyzeConnectionWaitTime;
+		originalTask->explainAnalyzeFirstRowTime =
+			explainAnalyzeTask->explainAnalyzeFirstRowTime;
+		originalTask->explainAnalyzeRoundTrips =
+			explainAnalyzeTask->explainAnalyzeRoundTrips;
+		originalTask->explainAnalyzeConnectionReused =
+			explainAnalyzeTask->explainAnalyzeConnectionReused;
 	}
 }
 
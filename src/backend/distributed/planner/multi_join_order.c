@@ -2,7 +2,8 @@
  *
  * multi_join_order.c
  *
- * Routines for constructing the join order list using a rule-based approach.
+ * Routines for constructing the join order list using a rule-based approach,
+ * optionally refined by the row estimates of the tables.
  *
  * Copyright (c) Citus Data, Inc.
  *
@@ -26,6 +27,7 @@
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/pg_dist_partition.h"
+#include "distributed/table_row_estimates.h"
 #include "distributed/worker_protocol.h"
 #include "lib/stringinfo.h"
 #include "optimizer/optimizer.h"
@@ -41,6 +43,8 @@
 /* Config variables managed via guc.c */
 bool LogMultiJoinOrder = false; /* print join order as a debugging aid */
 bool EnableSingleHashRepartitioning = false;
+bool EnableCostBasedJoinOrder = false;
+bool EnableNestedShardJoins = false;
 
 /* Function pointer type definition for join rule evaluation functions */
 typedef JoinOrderNode *(*RuleEvalFunction) (JoinOrderNode *currentJoinNode,
@@ -58,10 +62,12 @@ static bool ExtractLeftMostRangeTableIndex(Node *node, int *rangeTableIndex);
 static List * JoinOrderForTable(TableEntry *firstTable, List *tableEntryList,
 								List *joinClauseList);
 static List * BestJoinOrder(List *candidateJoinOrders);
+static List * CheapestJoinOrder(List *candidateJoinOrders, double *shuffledRows);
+static bool JoinOrderShuffledRows(List *joinOrder, double *shuffledRows);
 static List * FewestOfJoinRuleType(List *candidateJoinOrders, JoinRuleType ruleType);
 static uint32 JoinRuleTypeCount(List *joinOrder, JoinRuleType ruleTypeToCount);
 static List * LatestLargeDataTransfer(List *candidateJoinOrders);
-static void PrintJoinOrderList(List *joinOrder);
+static void PrintJoinOrderList(List *joinOrder, double shuffledRows);
 static uint32 LargeDataTransferLocation(List *joinOrder);
 static List * TableEntryListDifference(List *lhsTableList, List *rhsTableList);
 
@@ -313,12 +319,24 @@ JoinOrderList(List *tableEntryList, List *joinClauseList)
 							   "equal operator")));
 	}
 
-	List *bestJoinOrder = BestJoinOrder(candidateJoinOrderList);
+	/* negative when the join order is not chosen based on row estimates */
+	double shuffledRows = -1.0;
+	List *bestJoinOrder = NIL;
+
+	if (EnableCostBasedJoinOrder)
+	{
+		bestJoinOrder = CheapestJoinOrder(candidateJoinOrderList, &shuffledRows);
+	}
+
+	if (bestJoinOrder == NIL)
+	{
+		bestJoinOrder = BestJoinOrder(candidateJoinOrderList);
+	}
 
 	/* if logging is enabled, print join order */
 	if (LogMultiJoinOrder)
 	{
-		PrintJoinOrderList(bestJoinOrder);
+		PrintJoinOrderList(bestJoinOrder, shuffledRows);
 	}
 
 	return bestJoinOrder;
@@ -475,6 +493,138 @@ BestJoinOrder(List *candidateJoinOrders)
 }
 
 
+/*
+ * CheapestJoinOrder takes in a list of candidate join orders, and returns the
+ * join order that is estimated to shuffle the fewest rows between the nodes,
+ * using the row estimates of the tables. Like BestJoinOrder, the function
+ * first keeps the join orders with the fewest cartesian products, and it uses
+ * BestJoinOrder to break ties between the cheapest join orders. The function
+ * sets shuffledRows to the estimate for the returned join order, or returns
+ * NIL if a table in the join orders has no row estimate.
+ */
+static List *
+CheapestJoinOrder(List *candidateJoinOrders, double *shuffledRows)
+{
+	List *cheapestJoinOrders = NIL;
+	double cheapestShuffledRows = 0.0;
+
+	candidateJoinOrders = FewestOfJoinRuleType(candidateJoinOrders, CARTESIAN_PRODUCT);
+	candidateJoinOrders = FewestOfJoinRuleType(candidateJoinOrders,
+											   CARTESIAN_PRODUCT_REFERENCE_JOIN);
+
+	List *joinOrder = NIL;
+	foreach_ptr(joinOrder, candidateJoinOrders)
+	{
+		double joinOrderShuffledRows = 0.0;
+
+		if (!JoinOrderShuffledRows(joinOrder, &joinOrderShuffledRows))
+		{
+			return NIL;
+		}
+
+		if (cheapestJoinOrders != NIL &&
+			joinOrderShuffledRows == cheapestShuffledRows)
+		{
+			cheapestJoinOrders = lappend(cheapestJoinOrders, joinOrder);
+		}
+		else if (cheapestJoinOrders == NIL ||
+				 joinOrderShuffledRows < cheapestShuffledRows)
+		{
+			cheapestJoinOrders = list_make1(joinOrder);
+			cheapestShuffledRows = joinOrderShuffledRows;
+		}
+	}
+
+	*shuffledRows = cheapestShuffledRows;
+
+	return BestJoinOrder(cheapestJoinOrders);
+}
+
+
+/*
+ * JoinOrderShuffledRows estimates the number of rows that the given join order
+ * shuffles between the nodes and returns true, or returns false if one of the
+ * tables has no row estimate. Without statistics on the join clauses, the
+ * function assumes that a join returns as many rows as its larger input, and
+ * that a cartesian product returns the product of its inputs. Single
+ * repartition joins shuffle the side that is not partitioned on the join
+ * column, dual repartition joins and cartesian products shuffle both sides,
+ * and the other join rules do not shuffle any rows.
+ */
+static bool
+JoinOrderShuffledRows(List *joinOrder, double *shuffledRows)
+{
+	double joinedRows = 0.0;
+
+	*shuffledRows = 0.0;
+
+	JoinOrderNode *joinOrderNode = NULL;
+	foreach_ptr(joinOrderNode, joinOrder)
+	{
+		double tableRows = 0.0;
+
+		if (!TableRowEstimate(joinOrderNode->tableEntry->relationId, &tableRows))
+		{
+			return false;
+		}
+
+		switch (joinOrderNode->joinRuleType)
+		{
+			case JOIN_RULE_INVALID_FIRST:
+			{
+				joinedRows = tableRows;
+				break;
+			}
+
+			case SINGLE_HASH_PARTITION_JOIN:
+			case SINGLE_RANGE_PARTITION_JOIN:
+			{
+				/* the new table becomes the anchor when the joined tables move */
+				if (joinOrderNode->anchorTable == joinOrderNode->tableEntry)
+				{
+					*shuffledRows += joinedRows;
+				}
+				else
+				{
+					*shuffledRows += tableRows;
+				}
+
+				joinedRows = Max(joinedRows, tableRows);
+				break;
+			}
+
+			case DUAL_PARTITION_JOIN:
+			{
+				*shuffledRows += joinedRows + tableRows;
+				joinedRows = Max(joinedRows, tableRows);
+				break;
+			}
+
+			case CARTESIAN_PRODUCT:
+			{
+				*shuffledRows += joinedRows + tableRows;
+				joinedRows = joinedRows * tableRows;
+				break;
+			}
+
+			case CARTESIAN_PRODUCT_REFERENCE_JOIN:
+			{
+				joinedRows = joinedRows * tableRows;
+				break;
+			}
+
+			default:
+			{
+				joinedRows = Max(joinedRows, tableRows);
+				break;
+			}
+		}
+	}
+
+	return true;
+}
+
+
 /*
  * FewestOfJoinRuleType finds join orders that have the fewest number of times
  * the given join rule occurs in the candidate join orders, and filters all
@@ -597,9 +747,13 @@ LargeDataTransferLocation(List *joinOrder)
 }
 
 
-/* Prints the join order list and join rules for debugging purposes. */
+/*
+ * Prints the join order list and join rules for debugging purposes. When the
+ * join order was chosen based on row estimates, shuffledRows holds the estimated
+ * number of rows it shuffles, and is otherwise negative.
+ */
 static void
-PrintJoinOrderList(List *joinOrder)
+PrintJoinOrderList(List *joinOrder, double shuffledRows)
 {
 	StringInfo printBuffer = makeStringInfo();
 	ListCell *joinOrderNodeCell = NULL;
@@ -626,6 +780,11 @@ PrintJoinOrderList(List *joinOrder)
 		}
 	}
 
+	if (shuffledRows >= 0.0)
+	{
+		appendStringInfo(printBuffer, " estimated shuffled rows: %.0f", shuffledRows);
+	}
+
 	ereport(LOG, (errmsg("join order: %s",
 						 printBuffer->data)));
 }
@@ -938,6 +1097,17 @@ LocalJoin(JoinOrderNode *currentJoinNode, TableEntry *candidateTable,
 	bool coPartitionedTables = CoPartitionedTables(currentAnchorTable->relationId,
 												   relationId);
 
+	/*
+	 * Tables whose shard ranges nest can also be joined locally. The fragment
+	 * combinations then pair each shard with each shard of the other table
+	 * that it overlaps, see JoinPrunable().
+	 */
+	if (!coPartitionedTables && EnableNestedShardJoins)
+	{
+		coPartitionedTables = NestedShardPartitionedTables(
+			currentAnchorTable->relationId, relationId);
+	}
+
 	if (!coPartitionedTables)
 	{
 		return NULL;
@@ -1008,9 +1178,10 @@ SinglePartitionJoin(JoinOrderNode *currentJoinNode, TableEntry *candidateTable,
 		{
 			/*
 			 * Single hash repartitioning may perform worse than dual hash
-			 * repartitioning. Thus, we control it via a guc.
+			 * repartitioning. Thus, we control it via a guc, unless the join
+			 * order is chosen based on row estimates.
 			 */
-			if (!EnableSingleHashRepartitioning)
+			if (!EnableSingleHashRepartitioning && !EnableCostBasedJoinOrder)
 			{
 				return NULL;
 			}
@@ -1046,9 +1217,10 @@ SinglePartitionJoin(JoinOrderNode *currentJoinNode, TableEntry *candidateTable,
 			{
 				/*
 				 * Single hash repartitioning may perform worse than dual hash
-				 * repartitioning. Thus, we control it via a guc.
+				 * repartitioning. Thus, we control it via a guc, unless the join
+				 * order is chosen based on row estimates.
 				 */
-				if (!EnableSingleHashRepartitioning)
+				if (!EnableSingleHashRepartitioning && !EnableCostBasedJoinOrder)
 				{
 					return NULL;
 				}
@@ -30,6 +30,7 @@
 #include "distributed/citus_nodes.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/colocation_utils.h"
+#include "distributed/commands/multi_copy.h"
 #include "distributed/errormessage.h"
 #include "distributed/extended_op_node_utils.h"
 #include "distributed/function_utils.h"
@@ -40,6 +41,7 @@
 #include "distributed/multi_physical_planner.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/query_pushdown_planning.h"
+#include "distributed/sorted_merge.h"
 #include "distributed/string_utils.h"
 #include "distributed/tdigest_extension.h"
 #include "distributed/worker_protocol.h"
@@ -58,12 +60,19 @@
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
+#include "utils/typcache.h"
 
 /* Config variable managed via guc.c */
 int LimitClauseRowFetchCount = -1; /* number of rows to fetch from each task */
 double CountDistinctErrorRate = 0.0; /* precision of count(distinct) approximate */
 int CoordinatorAggregationStrategy = COORDINATOR_AGGREGATION_ROW_GATHER;
 
+/* GUC, determines whether partial aggregate states are sent in binary form */
+bool EnableBinaryPartialAggregates = false;
+
+/* GUC, determines whether we repartition the input of window functions */
+bool EnableRepartitionedWindowFunctions = false;
+
 /* Constant used throughout file */
 static const uint32 masterTableId = 1; /* first range table reference on the master node */
 
@@ -169,6 +178,12 @@ typedef struct OrderByLimitReference
 
 
 /* Local functions forward declarations */
+static Var * WindowRepartitionColumn(MultiNode *logicalPlanNode,
+									 MultiExtendedOp *extendedOpNode);
+static bool ColumnInAllWindowPartitions(Var *column, List *windowClauseList,
+										List *targetList);
+static void RepartitionWindowFunctionInput(MultiExtendedOp *workerExtendedOpNode,
+										   Var *partitionColumn);
 static MultiSelect * AndSelectNode(MultiSelect *selectNode);
 static MultiSelect * OrSelectNode(MultiSelect *selectNode);
 static List * OrSelectClauseList(List *selectClauseList);
@@ -278,6 +293,9 @@ static bool AggregateEnabledCustom(Aggref *aggregateExpression);
 static Oid CitusFunctionOidWithSignature(char *functionName, int numargs, Oid *argtypes);
 static Oid WorkerPartialAggOid(void);
 static Oid CoordCombineAggOid(void);
+static Oid WorkerPartialAggBinaryOid(void);
+static Oid CoordCombineAggBinaryOid(void);
+static bool UseBinaryPartialAggregate(Oid aggregateOid);
 static Oid AggregateFunctionOid(const char *functionName, Oid inputType);
 static Oid TypeOid(Oid schemaId, const char *typeName);
 static SortGroupClause * CreateSortGroupClause(Var *column);
@@ -316,11 +334,13 @@ static Node * WorkerLimitCount(Node *limitCount, Node *limitOffset, OrderByLimit
 static List * WorkerSortClauseList(Node *limitCount,
 								   List *groupClauseList, List *sortClauseList,
 								   OrderByLimitReference orderByLimitReference);
+static bool GroupClauseListIsSortable(List *groupClauseList);
 static bool CanPushDownLimitApproximate(List *sortClauseList, List *targetList);
 static bool HasOrderByAggregate(List *sortClauseList, List *targetList);
 static bool HasOrderByNonCommutativeAggregate(List *sortClauseList, List *targetList);
 static bool HasOrderByComplexExpression(List *sortClauseList, List *targetList);
 static bool HasOrderByHllType(List *sortClauseList, List *targetList);
+static bool HllExtensionLoaded(void);
 static bool ShouldProcessDistinctOrderAndLimitForWorker(
 	ExtendedOpNodeProperties *extendedOpNodeProperties,
 	bool pushingDownOriginalGrouping,
@@ -348,6 +368,25 @@ MultiLogicalPlanOptimize(MultiTreeRoot *multiLogicalPlan)
 		logicalPlanNode);
 	List *extendedOpNodeList = FindNodesOfType(logicalPlanNode, T_MultiExtendedOp);
 	MultiExtendedOp *extendedOpNode = (MultiExtendedOp *) linitial(extendedOpNodeList);
+
+	/*
+	 * Window functions that do not partition by the distribution column are
+	 * evaluated on the coordinator, unless we repartition their input by a
+	 * column of their PARTITION BY, in which case the workers can evaluate
+	 * them like pushable window functions.
+	 */
+	Var *windowPartitionColumn = NULL;
+	if (EnableRepartitionedWindowFunctions && extendedOpNode->hasWindowFuncs &&
+		!extendedOpNode->onlyPushableWindowFunctions)
+	{
+		windowPartitionColumn = WindowRepartitionColumn(logicalPlanNode,
+														extendedOpNode);
+		if (windowPartitionColumn != NULL)
+		{
+			extendedOpNode->onlyPushableWindowFunctions = true;
+		}
+	}
+
 	ExtendedOpNodeProperties extendedOpNodeProperties = BuildExtendedOpNodeProperties(
 		extendedOpNode, hasNonDistributableAggregates);
 
@@ -433,6 +472,11 @@ MultiLogicalPlanOptimize(MultiTreeRoot *multiLogicalPlan)
 
 	ApplyExtendedOpNodes(extendedOpNode, masterExtendedOpNode, workerExtendedOpNode);
 
+	if (windowPartitionColumn != NULL)
+	{
+		RepartitionWindowFunctionInput(workerExtendedOpNode, windowPartitionColumn);
+	}
+
 	List *tableNodeList = FindNodesOfType(logicalPlanNode, T_MultiTable);
 	MultiTable *tableNode = NULL;
 	foreach_ptr(tableNode, tableNodeList)
@@ -485,6 +529,129 @@ MultiLogicalPlanOptimize(MultiTreeRoot *multiLogicalPlan)
 }
 
 
+/*
+ * WindowRepartitionColumn returns a column that all the window functions of
+ * the extended operator partition by, such that repartitioning the rows by
+ * its hash puts every window partition on a single node. We only do that for
+ * window functions over plain rows, hence the function returns NULL if the
+ * query groups or aggregates, or if there is no such column.
+ */
+static Var *
+WindowRepartitionColumn(MultiNode *logicalPlanNode, MultiExtendedOp *extendedOpNode)
+{
+	List *targetList = extendedOpNode->targetList;
+	List *windowClauseList = extendedOpNode->windowClause;
+
+	if (windowClauseList == NIL || extendedOpNode->groupClauseList != NIL ||
+		extendedOpNode->havingQual != NULL ||
+		contain_aggs_of_level((Node *) targetList, 0))
+	{
+		return NULL;
+	}
+
+	/* repartitioned subqueries already repartition their rows by the GROUP BY */
+	List *tableNodeList = FindNodesOfType(logicalPlanNode, T_MultiTable);
+	MultiTable *tableNode = NULL;
+	foreach_ptr(tableNode, tableNodeList)
+	{
+		if (tableNode->relationId == SUBQUERY_RELATION_ID)
+		{
+			return NULL;
+		}
+	}
+
+	WindowClause *firstWindowClause = (WindowClause *) linitial(windowClauseList);
+
+	SortGroupClause *partitionClause = NULL;
+	foreach_ptr(partitionClause, firstWindowClause->partitionClause)
+	{
+		TargetEntry *targetEntry = get_sortgroupclause_tle(partitionClause,
+														   targetList);
+		if (!IsA(targetEntry->expr, Var))
+		{
+			continue;
+		}
+
+		Var *column = (Var *) targetEntry->expr;
+		if (column->varlevelsup != 0 ||
+			!ColumnInAllWindowPartitions(column, windowClauseList, targetList))
+		{
+			continue;
+		}
+
+		/* the map tasks hash the column to find the partition of a row */
+		TypeCacheEntry *typeEntry = lookup_type_cache(column->vartype,
+													  TYPECACHE_HASH_PROC);
+		if (!OidIsValid(typeEntry->hash_proc))
+		{
+			continue;
+		}
+
+		return column;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ColumnInAllWindowPartitions returns whether all the given window clauses
+ * have the given column in their PARTITION BY.
+ */
+static bool
+ColumnInAllWindowPartitions(Var *column, List *windowClauseList, List *targetList)
+{
+	WindowClause *windowClause = NULL;
+	foreach_ptr(windowClause, windowClauseList)
+	{
+		bool columnInPartition = false;
+
+		SortGroupClause *partitionClause = NULL;
+		foreach_ptr(partitionClause, windowClause->partitionClause)
+		{
+			TargetEntry *targetEntry = get_sortgroupclause_tle(partitionClause,
+															   targetList);
+			if (equal(targetEntry->expr, column))
+			{
+				columnInPartition = true;
+				break;
+			}
+		}
+
+		if (!columnInPartition)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * RepartitionWindowFunctionInput adds a partition and a collect node below
+ * the worker extended operator node, such that the rows that the window
+ * functions read are first hash repartitioned by the given column. The
+ * physical planner then builds a map merge job for the partition node, and
+ * the worker query evaluates the window functions on each partition.
+ */
+static void
+RepartitionWindowFunctionInput(MultiExtendedOp *workerExtendedOpNode,
+							   Var *partitionColumn)
+{
+	MultiNode *childNode = ChildNode((MultiUnaryNode *) workerExtendedOpNode);
+
+	MultiPartition *partitionNode = CitusMakeNode(MultiPartition);
+	partitionNode->partitionColumn = copyObject(partitionColumn);
+
+	MultiCollect *collectNode = CitusMakeNode(MultiCollect);
+
+	SetChild((MultiUnaryNode *) workerExtendedOpNode, (MultiNode *) partitionNode);
+	SetChild((MultiUnaryNode *) partitionNode, (MultiNode *) collectNode);
+	SetChild((MultiUnaryNode *) collectNode, childNode);
+}
+
+
 /*
  * AndSelectNode looks for AND clauses in the given select node. If they exist,
  * the function returns these clauses in a new node. Otherwise, the function
@@ -1696,6 +1863,48 @@ MasterAggregateExpression(Aggref *originalAggregate,
 
 		newMasterExpression = (Expr *) aggregate;
 	}
+	else if (aggregateType == AGGREGATE_COUNT && originalAggregate->aggdistinct &&
+			 CountDistinctErrorRate != DISABLE_DISTINCT_APPROXIMATION &&
+			 !HllExtensionLoaded())
+	{
+		/*
+		 * Without the hll extension, we fall back to the sketches that ship
+		 * with Citus. Workers compute citus_hll_add_agg(column, log2m) and we
+		 * compute citus_hll_cardinality(citus_hll_union_agg(sketch)) here.
+		 */
+		Oid unionArgumentTypes[1] = { BYTEAOID };
+		Oid cardinalityArgumentTypes[1] = { BYTEAOID };
+		Oid unionFunctionId =
+			CitusFunctionOidWithSignature(CITUS_HLL_UNION_AGGREGATE_NAME, 1,
+										  unionArgumentTypes);
+		Oid cardinalityFunctionId =
+			CitusFunctionOidWithSignature(CITUS_HLL_CARDINALITY_FUNC_NAME, 1,
+										  cardinalityArgumentTypes);
+
+		Var *sketchColumn = makeVar(masterTableId, walkerContext->columnId, BYTEAOID,
+									-1, InvalidOid, columnLevelsUp);
+		walkerContext->columnId++;
+
+		TargetEntry *sketchTargetEntry = makeTargetEntry((Expr *) sketchColumn,
+														 argumentId, NULL, false);
+
+		Aggref *unionAggregate = makeNode(Aggref);
+		unionAggregate->aggfnoid = unionFunctionId;
+		unionAggregate->aggtype = BYTEAOID;
+		unionAggregate->args = list_make1(sketchTargetEntry);
+		unionAggregate->aggkind = AGGKIND_NORMAL;
+		unionAggregate->aggfilter = NULL;
+		unionAggregate->aggtranstype = InvalidOid;
+		unionAggregate->aggargtypes = list_make1_oid(BYTEAOID);
+		unionAggregate->aggsplit = AGGSPLIT_SIMPLE;
+
+		FuncExpr *cardinalityExpression = makeNode(FuncExpr);
+		cardinalityExpression->funcid = cardinalityFunctionId;
+		cardinalityExpression->funcresulttype = FLOAT8OID;
+		cardinalityExpression->args = list_make1(unionAggregate);
+
+		newMasterExpression = (Expr *) cardinalityExpression;
+	}
 	else if (aggregateType == AGGREGATE_COUNT && originalAggregate->aggdistinct &&
 			 CountDistinctErrorRate != DISABLE_DISTINCT_APPROXIMATION)
 	{
@@ -2136,8 +2345,10 @@ MasterAggregateExpression(Aggref *originalAggregate,
 
 		if (combine != InvalidOid)
 		{
-			Oid coordCombineId = CoordCombineAggOid();
-			Oid workerReturnType = CSTRINGOID;
+			bool binaryState = UseBinaryPartialAggregate(originalAggregate->aggfnoid);
+			Oid coordCombineId = binaryState ? CoordCombineAggBinaryOid() :
+								 CoordCombineAggOid();
+			Oid workerReturnType = binaryState ? BYTEAOID : CSTRINGOID;
 			int32 workerReturnTypeMod = -1;
 			Oid workerCollationId = InvalidOid;
 			Oid resultType = exprType((Node *) originalAggregate);
@@ -2156,7 +2367,7 @@ MasterAggregateExpression(Aggref *originalAggregate,
 						   makeTargetEntry((Expr *) column, 2, NULL, false),
 						   makeTargetEntry((Expr *) nullTag, 3, NULL, false));
 
-			/* coord_combine_agg(agg, workercol) */
+			/* coord_combine_agg(agg, workercol) or coord_combine_agg_binary(...) */
 			Aggref *newMasterAggregate = makeNode(Aggref);
 			newMasterAggregate->aggfnoid = coordCombineId;
 			newMasterAggregate->aggtype = originalAggregate->aggtype;
@@ -2164,7 +2375,7 @@ MasterAggregateExpression(Aggref *originalAggregate,
 			newMasterAggregate->aggkind = AGGKIND_NORMAL;
 			newMasterAggregate->aggfilter = NULL;
 			newMasterAggregate->aggtranstype = INTERNALOID;
-			newMasterAggregate->aggargtypes = list_make3_oid(OIDOID, CSTRINGOID,
+			newMasterAggregate->aggargtypes = list_make3_oid(OIDOID, workerReturnType,
 															 resultType);
 			newMasterAggregate->aggsplit = AGGSPLIT_SIMPLE;
 
@@ -3114,6 +3325,44 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 
 		walkerContext->createGroupByClause = true;
 	}
+	else if (aggregateType == AGGREGATE_COUNT && originalAggregate->aggdistinct &&
+			 CountDistinctErrorRate != DISABLE_DISTINCT_APPROXIMATION &&
+			 !HllExtensionLoaded())
+	{
+		/*
+		 * Without the hll extension, we compute citus_hll_add_agg(var, log2m)
+		 * on worker nodes. The sketch hashes its input itself.
+		 */
+		const AttrNumber firstArgumentId = 1;
+		const AttrNumber secondArgumentId = 2;
+
+		Oid argumentType = AggregateArgumentType(originalAggregate);
+		TargetEntry *argument = (TargetEntry *) linitial(originalAggregate->args);
+		Expr *argumentExpression = copyObject(argument->expr);
+
+		Oid addArgumentTypes[2] = { ANYELEMENTOID, INT4OID };
+		Oid addFunctionId =
+			CitusFunctionOidWithSignature(CITUS_HLL_ADD_AGGREGATE_NAME, 2,
+										  addArgumentTypes);
+		int logOfStorageSize = CountDistinctStorageSize(CountDistinctErrorRate);
+		Const *logOfStorageSizeConst = MakeIntegerConst(logOfStorageSize);
+
+		TargetEntry *columnArgument = makeTargetEntry(argumentExpression,
+													  firstArgumentId, NULL, false);
+		TargetEntry *storageSizeArgument = makeTargetEntry((Expr *) logOfStorageSizeConst,
+														   secondArgumentId, NULL, false);
+
+		Aggref *addAggregateFunction = makeNode(Aggref);
+		addAggregateFunction->aggfnoid = addFunctionId;
+		addAggregateFunction->aggtype = BYTEAOID;
+		addAggregateFunction->args = list_make2(columnArgument, storageSizeArgument);
+		addAggregateFunction->aggkind = AGGKIND_NORMAL;
+		addAggregateFunction->aggfilter = (Expr *) copyObject(
+			originalAggregate->aggfilter);
+		addAggregateFunction->aggargtypes = list_make2_oid(argumentType, INT4OID);
+
+		workerAggregateList = lappend(workerAggregateList, addAggregateFunction);
+	}
 	else if (aggregateType == AGGREGATE_COUNT && originalAggregate->aggdistinct &&
 			 CountDistinctErrorRate != DISABLE_DISTINCT_APPROXIMATION)
 	{
@@ -3297,7 +3546,9 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 
 		if (combine != InvalidOid)
 		{
-			Oid workerPartialId = WorkerPartialAggOid();
+			bool binaryState = UseBinaryPartialAggregate(originalAggregate->aggfnoid);
+			Oid workerPartialId = binaryState ? WorkerPartialAggBinaryOid() :
+								  WorkerPartialAggOid();
 
 			Const *aggOidParam = makeConst(REGPROCEDUREOID, -1, InvalidOid, sizeof(Oid),
 										   ObjectIdGetDatum(originalAggregate->aggfnoid),
@@ -3347,7 +3598,7 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 			/* worker_partial_agg(agg, arg) or worker_partial_agg(agg, ROW(...args)) */
 			Aggref *newWorkerAggregate = copyObject(originalAggregate);
 			newWorkerAggregate->aggfnoid = workerPartialId;
-			newWorkerAggregate->aggtype = CSTRINGOID;
+			newWorkerAggregate->aggtype = binaryState ? BYTEAOID : CSTRINGOID;
 			newWorkerAggregate->args = newWorkerAggregateArgs;
 			newWorkerAggregate->aggkind = AGGKIND_NORMAL;
 			newWorkerAggregate->aggtranstype = INTERNALOID;
@@ -3547,7 +3798,13 @@ AggregateEnabledCustom(Aggref *aggregateExpression)
 	}
 	Form_pg_type typeform = (Form_pg_type) GETSTRUCT(typeTuple);
 
-	bool supportsSafeCombine = typeform->typtype != TYPTYPE_PSEUDO;
+	/*
+	 * Pseudo-typed states cannot be sent to the coordinator, except for
+	 * internal states that we can send via the serialfunc of the aggregate.
+	 */
+	bool supportsSafeCombine = typeform->typtype != TYPTYPE_PSEUDO ||
+							   (aggform->aggtranstype == INTERNALOID &&
+								UseBinaryPartialAggregate(aggregateOid));
 
 	ReleaseSysCache(aggTuple);
 	ReleaseSysCache(typeTuple);
@@ -3667,6 +3924,75 @@ CoordCombineAggOid()
 }
 
 
+/*
+ * WorkerPartialAggBinaryOid looks up oid of pg_catalog.worker_partial_agg_binary
+ */
+static Oid
+WorkerPartialAggBinaryOid()
+{
+	Oid argtypes[] = {
+		OIDOID,
+		ANYELEMENTOID,
+	};
+
+	return CitusFunctionOidWithSignature(WORKER_PARTIAL_BINARY_AGGREGATE_NAME, 2,
+										 argtypes);
+}
+
+
+/*
+ * CoordCombineAggBinaryOid looks up oid of pg_catalog.coord_combine_agg_binary
+ */
+static Oid
+CoordCombineAggBinaryOid()
+{
+	Oid argtypes[] = {
+		OIDOID,
+		BYTEAOID,
+		ANYELEMENTOID,
+	};
+
+	return CitusFunctionOidWithSignature(COORD_COMBINE_BINARY_AGGREGATE_NAME, 3,
+										 argtypes);
+}
+
+
+/*
+ * UseBinaryPartialAggregate returns whether the transition state of the given
+ * aggregate should be sent from workers to the coordinator in binary form. We
+ * do so when enabled and the state can be serialized, either via the
+ * serialfunc & deserialfunc pair for internal states or via the binary send &
+ * receive functions of the transition type.
+ */
+static bool
+UseBinaryPartialAggregate(Oid aggregateOid)
+{
+	if (!EnableBinaryPartialAggregates)
+	{
+		return false;
+	}
+
+	HeapTuple aggTuple = SearchSysCache1(AGGFNOID, ObjectIdGetDatum(aggregateOid));
+	if (!HeapTupleIsValid(aggTuple))
+	{
+		elog(ERROR, "citus cache lookup failed for aggregate %u", aggregateOid);
+	}
+	Form_pg_aggregate aggform = (Form_pg_aggregate) GETSTRUCT(aggTuple);
+
+	Oid transtype = aggform->aggtranstype;
+	bool hasSerialFunctions = OidIsValid(aggform->aggserialfn) &&
+							  OidIsValid(aggform->aggdeserialfn);
+	ReleaseSysCache(aggTuple);
+
+	if (transtype == INTERNALOID)
+	{
+		return hasSerialFunctions;
+	}
+
+	return CanUseBinaryCopyFormatForType(transtype);
+}
+
+
 /*
  * TypeOid looks for a type that has the given name and schema, and returns the
  * corresponding type's oid.
@@ -4111,25 +4437,15 @@ DeferErrorIfUnsupportedAggregateDistinct(Aggref *aggregateExpression,
 		}
 	}
 
-	/* if we have a count(distinct), and distinct approximation is enabled */
+	/*
+	 * If we have a count(distinct), and distinct approximation is enabled, we
+	 * use the hll extension when it is loaded and the built-in sketches
+	 * otherwise.
+	 */
 	if (aggregateType == AGGREGATE_COUNT &&
 		CountDistinctErrorRate != DISABLE_DISTINCT_APPROXIMATION)
 	{
-		bool missingOK = true;
-		Oid distinctExtensionId = get_extension_oid(HLL_EXTENSION_NAME, missingOK);
-
-		/* if extension for distinct approximation is loaded, we are good */
-		if (distinctExtensionId != InvalidOid)
-		{
-			return NULL;
-		}
-		else
-		{
-			return DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
-								 "cannot compute count (distinct) approximation",
-								 NULL,
-								 "You need to have the hll extension loaded.");
-		}
+		return NULL;
 	}
 
 	if (aggregateType == AGGREGATE_COUNT)
@@ -4783,7 +5099,9 @@ WorkerLimitCount(Node *limitCount, Node *limitOffset, OrderByLimitReference
  * or hasDistinctOn that can be pushed down. If it does, the function then
  * checks if we need to add any sorting and grouping clauses to the sort list we
  * push down for the limit. If we do, the function adds these clauses and
- * returns them. Otherwise, the function returns null.
+ * returns them. Without a limit, the function returns the group by clauses
+ * if the coordinator merges the groups of the tasks in that order. Otherwise,
+ * the function returns null.
  */
 static List *
 WorkerSortClauseList(Node *limitCount, List *groupClauseList, List *sortClauseList,
@@ -4794,6 +5112,20 @@ WorkerSortClauseList(Node *limitCount, List *groupClauseList, List *sortClauseLi
 	/* if no limit node and no hasDistinctOn, no need to push down sort clauses */
 	if (limitCount == NULL && !orderByLimitReference.hasDistinctOn)
 	{
+		if (EnableSortedMergeAggregation &&
+			!orderByLimitReference.groupClauseIsEmpty &&
+			!orderByLimitReference.groupedByDisjointPartitionColumn &&
+			orderByLimitReference.onlyPushableWindowFunctions &&
+			GroupClauseListIsSortable(groupClauseList))
+		{
+			/*
+			 * Sorting the groups on the workers lets the coordinator merge the
+			 * task results and combine adjacent groups instead of hashing all
+			 * of them.
+			 */
+			return copyObject(groupClauseList);
+		}
+
 		return NIL;
 	}
 
@@ -4838,6 +5170,26 @@ WorkerSortClauseList(Node *limitCount, List *groupClauseList, List *sortClauseLi
 }
 
 
+/*
+ * GroupClauseListIsSortable returns whether all the given group by clauses
+ * have an ordering operator, such that the groups can be sorted by them.
+ */
+static bool
+GroupClauseListIsSortable(List *groupClauseList)
+{
+	SortGroupClause *groupClause = NULL;
+	foreach_ptr(groupClause, groupClauseList)
+	{
+		if (!OidIsValid(groupClause->sortop))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
 /*
  * CanPushDownLimitApproximate checks if we can push down the limit clause to
  * the worker nodes, and get approximate and meaningful results. We can do this
@@ -4977,34 +5329,59 @@ static bool
 HasOrderByHllType(List *sortClauseList, List *targetList)
 {
 	bool hasOrderByHllType = false;
+	Oid hllTypeId = InvalidOid;
 
 	/* check whether HLL is loaded */
 	Oid hllId = get_extension_oid(HLL_EXTENSION_NAME, true);
-	if (!OidIsValid(hllId))
+	if (OidIsValid(hllId))
 	{
-		return hasOrderByHllType;
+		Oid hllSchemaOid = get_extension_schema(hllId);
+		hllTypeId = TypeOid(hllSchemaOid, HLL_TYPE_NAME);
 	}
 
-	Oid hllSchemaOid = get_extension_schema(hllId);
-	Oid hllTypeId = TypeOid(hllSchemaOid, HLL_TYPE_NAME);
-
 	SortGroupClause *sortClause = NULL;
 	foreach_ptr(sortClause, sortClauseList)
 	{
 		Node *sortExpression = get_sortgroupclause_expr(sortClause, targetList);
 
 		Oid sortColumnTypeId = exprType(sortExpression);
-		if (sortColumnTypeId == hllTypeId)
+		if (OidIsValid(hllTypeId) && sortColumnTypeId == hllTypeId)
 		{
 			hasOrderByHllType = true;
 			break;
 		}
+
+		/* built-in sketches are bytea, so we look for their aggregate instead */
+		if (IsA(sortExpression, Aggref) &&
+			((Aggref *) sortExpression)->aggtype == BYTEAOID)
+		{
+			char *aggregateName = get_func_name(((Aggref *) sortExpression)->aggfnoid);
+			if (aggregateName != NULL &&
+				strcmp(aggregateName, CITUS_HLL_ADD_AGGREGATE_NAME) == 0)
+			{
+				hasOrderByHllType = true;
+				break;
+			}
+		}
 	}
 
 	return hasOrderByHllType;
 }
 
 
+/*
+ * HllExtensionLoaded returns whether the hll extension is installed in the
+ * current database. When it is not, count(distinct) approximations use the
+ * sketches built into Citus.
+ */
+static bool
+HllExtensionLoaded(void)
+{
+	bool missingOK = true;
+	return OidIsValid(get_extension_oid(HLL_EXTENSION_NAME, missingOK));
+}
+
+
 /*
  * ShouldProcessDistinctOrderAndLimitForWorker returns whether
  * ProcessDistinctClauseForWorkerQuery should be called. If not,
@@ -29,6 +29,7 @@
 #include "distributed/multi_logical_optimizer.h"
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/planner_timing.h"
 #include "distributed/reference_table_utils.h"
 #include "distributed/relation_restriction_equivalence.h"
 #include "distributed/query_pushdown_planning.h"
@@ -146,7 +147,12 @@ MultiLogicalPlanCreate(Query *originalQuery, Query *queryTree,
 	MultiNode *multiQueryNode = NULL;
 
 
-	if (ShouldUseSubqueryPushDown(originalQuery, queryTree, plannerRestrictionContext))
+	BeginPlannerPhase(PLANNER_PHASE_PUSHDOWN_CHECKS);
+	bool useSubqueryPushdown = ShouldUseSubqueryPushDown(originalQuery, queryTree,
+														 plannerRestrictionContext);
+	EndPlannerPhase(PLANNER_PHASE_PUSHDOWN_CHECKS);
+
+	if (useSubqueryPushdown)
 	{
 		multiQueryNode = SubqueryMultiNodeTree(originalQuery, queryTree,
 											   plannerRestrictionContext);
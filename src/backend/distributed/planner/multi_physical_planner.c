@@ -42,6 +42,7 @@
 #include "distributed/coordinator_protocol.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_logical_optimizer.h"
@@ -51,12 +52,16 @@
 #include "distributed/log_utils.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/pg_dist_shard.h"
+#include "distributed/planner_timing.h"
 #include "distributed/query_pushdown_planning.h"
 #include "distributed/query_utils.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/shard_pruning.h"
+#include "distributed/shared_connection_stats.h"
+#include "distributed/sorted_merge.h"
 #include "distributed/string_utils.h"
+#include "distributed/table_row_estimates.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
@@ -84,6 +89,21 @@
 /* RepartitionJoinBucketCountPerNode determines bucket amount during repartitions */
 int RepartitionJoinBucketCountPerNode = 8;
 
+/* GUC, whether dual repartition joins filter rows on the join keys of one side */
+bool EnableRepartitionJoinFilters = false;
+
+/* GUC, size of the join key filters of repartition joins in kilobytes */
+int RepartitionJoinFilterSize = 1024;
+
+/* GUC, whether dual repartition joins spread the rows of heavy hitter join keys */
+bool EnableRepartitionJoinSkewHandling = false;
+
+/* GUC, estimated rows per bucket of dual repartition joins, 0 means a static count */
+int RepartitionJoinRowsPerBucket = 0;
+
+/* GUC, whether merge tasks fetch all fragments of a node at once */
+bool EnableRepartitionFragmentCoalescing = false;
+
 /* Policy to use when assigning tasks to worker nodes */
 int TaskAssignmentPolicy = TASK_ASSIGNMENT_GREEDY;
 bool EnableUniqueJobIds = true;
@@ -115,6 +135,20 @@ typedef struct AddAnyValueAggregatesContext
 } AddAnyValueAggregatesContext;
 
 
+/* load of a worker node, used by the least-loaded task assignment policy */
+typedef struct WorkerLoad
+{
+	char *nodeName;
+	uint32 nodePort;
+
+	/* number of running tasks, including the ones we assigned in the meantime */
+	int runningTaskCount;
+
+	/* moving average of the task execution times in microseconds */
+	double avgTaskExecutionTime;
+} WorkerLoad;
+
+
 /* Local functions forward declarations for job creation */
 static Job * BuildJobTree(MultiTreeRoot *multiTree);
 static MultiNode * LeftMostNode(MultiTreeRoot *multiTree);
@@ -159,18 +193,26 @@ static MapMergeJob * BuildMapMergeJob(Query *jobQuery, List *dependentJobList,
 									  Oid baseRelationId,
 									  BoundaryNodeJobType boundaryNodeJobType);
 static uint32 HashPartitionCount(void);
+static void AdjustDualHashPartitionCount(List *mapMergeJobList);
+static bool EstimateMapMergeJobRowCount(MapMergeJob *mapMergeJob, double *rowCount);
+static uint32 AdaptiveHashPartitionCount(double rowCount);
 
 /* Local functions forward declarations for task list creation and helper functions */
 static Job * BuildJobTreeTaskList(Job *jobTree,
 								  PlannerRestrictionContext *plannerRestrictionContext);
 static bool IsInnerTableOfOuterJoin(RelationRestriction *relationRestriction);
 static void ErrorIfUnsupportedShardDistribution(Query *query);
+static List * ActivePlacementGroupIdList(uint64 shardId);
 static Task * QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 									  RelationRestrictionContext *restrictionContext,
 									  uint32 taskId,
 									  TaskType taskType,
 									  bool modifyRequiresCoordinatorEvaluation,
+									  ShardQueryTemplate *queryTemplate,
 									  DeferredErrorMessage **planningError);
+static ShardQueryTemplate * QueryPushdownTemplateCreate(Query *originalQuery,
+														RelationRestrictionContext *
+														restrictionContext);
 static List * SqlTaskList(Job *job);
 static bool DependsOnHashPartitionJob(Job *job);
 static uint32 AnchorRangeTableId(List *rangeTableList);
@@ -209,6 +251,9 @@ static Task * GreedyAssignTask(WorkerNode *workerNode, List *taskList,
 							   List *activeShardPlacementLists);
 static List * ReorderAndAssignTaskList(List *taskList,
 									   ReorderFunction reorderFunction);
+static List * MoveLeastLoadedPlacementFirst(List *placementList, List **workerLoadList);
+static WorkerLoad * FindOrFetchWorkerLoad(ShardPlacement *placement,
+										  List **workerLoadList);
 static int CompareTasksByShardId(const void *leftElement, const void *rightElement);
 static List * ActiveShardPlacementLists(List *taskList);
 static List * LeftRotateList(List *list, uint32 rotateCount);
@@ -217,6 +262,13 @@ static List * AssignDualHashTaskList(List *taskList);
 static void AssignDataFetchDependencies(List *taskList);
 static uint32 TaskListHighestTaskId(List *taskList);
 static List * MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList);
+static List * FetchMapTaskGroupList(List *mapTaskList);
+static void PlanRepartitionJoinFilters(Job *job);
+static bool CanUseRepartitionJoinFilter(MapMergeJob *leftJob, MapMergeJob *rightJob);
+static Task * JoinKeyFilterTask(Task *filterTask, uint32 partitionColumnIndex);
+static void PlanRepartitionJoinSkewHandling(Job *job);
+static bool CanHandleRepartitionJoinSkew(MapMergeJob *leftJob, MapMergeJob *rightJob);
+static Task * HeavyHitterSampleTask(Task *filterTask, uint32 partitionColumnIndex);
 static StringInfo CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
 									   uint32 partitionColumnIndex, bool useBinaryFormat);
 static char * PartitionResultNamePrefix(uint64 jobId, int32 taskId);
@@ -245,6 +297,16 @@ CreatePhysicalDistributedPlan(MultiTreeRoot *multiTree,
 	/* build the worker job tree and check that we only have one job in the tree */
 	Job *workerJob = BuildJobTree(multiTree);
 
+	if (EnableRepartitionJoinFilters)
+	{
+		PlanRepartitionJoinFilters(workerJob);
+	}
+
+	if (EnableRepartitionJoinSkewHandling)
+	{
+		PlanRepartitionJoinSkewHandling(workerJob);
+	}
+
 	/* create the tree of executable tasks for the worker job */
 	workerJob = BuildJobTreeTaskList(workerJob, plannerRestrictionContext);
 
@@ -258,6 +320,13 @@ CreatePhysicalDistributedPlan(MultiTreeRoot *multiTree,
 	distributedPlan->modLevel = ROW_MODIFY_READONLY;
 	distributedPlan->expectResults = true;
 
+	if (EnableSortedMerge || EnableSortedMergeAggregation)
+	{
+		/* merge the sorted task results rather than sorting them again */
+		distributedPlan->sortedMergeClauseList =
+			SortedMergeClauseList(combineQuery, workerJob->jobQuery);
+	}
+
 	return distributedPlan;
 }
 
@@ -394,6 +463,33 @@ BuildJobTree(MultiTreeRoot *multiTree)
 				/* append to the dependent job list for on-going dependencies */
 				loopDependentJobList = lappend(loopDependentJobList, mapMergeJob);
 			}
+
+			if (partitionType == DUAL_HASH_PARTITION_TYPE &&
+				RepartitionJoinRowsPerBucket > 0)
+			{
+				AdjustDualHashPartitionCount(loopDependentJobList);
+			}
+		}
+		else if (boundaryNodeJobType == SUBQUERY_MAP_MERGE_JOB)
+		{
+			/*
+			 * The rows below the extended operator are hash repartitioned, for
+			 * instance such that each partition holds whole window partitions.
+			 */
+			MultiPartition *partitionNode = (MultiPartition *) currentNode;
+			MultiNode *queryNode = GrandChildNode((MultiUnaryNode *) partitionNode);
+			Var *partitionKey = partitionNode->partitionColumn;
+
+			List *dependentJobList = list_copy(loopDependentJobList);
+			Query *jobQuery = BuildJobQuery(queryNode, dependentJobList);
+
+			MapMergeJob *mapMergeJob = BuildMapMergeJob(jobQuery, dependentJobList,
+														partitionKey,
+														DUAL_HASH_PARTITION_TYPE,
+														InvalidOid,
+														SUBQUERY_MAP_MERGE_JOB);
+
+			loopDependentJobList = list_make1(mapMergeJob);
 		}
 		else if (boundaryNodeJobType == TOP_LEVEL_WORKER_JOB)
 		{
@@ -1954,15 +2050,13 @@ BuildMapMergeJob(Query *jobQuery, List *dependentJobList, Var *partitionKey,
 	Var *partitionColumn = copyObject(partitionKey);
 
 	/* update the logical partition key's table and column identifiers */
-	if (boundaryNodeJobType != SUBQUERY_MAP_MERGE_JOB)
-	{
-		UpdateColumnAttributes(partitionColumn, rangeTableList, dependentJobList);
-	}
+	UpdateColumnAttributes(partitionColumn, rangeTableList, dependentJobList);
 
 	MapMergeJob *mapMergeJob = CitusMakeNode(MapMergeJob);
 	mapMergeJob->job.jobId = UniqueJobId();
 	mapMergeJob->job.jobQuery = jobQuery;
 	mapMergeJob->job.dependentJobList = dependentJobList;
+	mapMergeJob->boundaryNodeJobType = boundaryNodeJobType;
 	mapMergeJob->partitionColumn = partitionColumn;
 	mapMergeJob->sortedShardIntervalArrayLength = 0;
 
@@ -1986,7 +2080,7 @@ BuildMapMergeJob(Query *jobQuery, List *dependentJobList, Var *partitionKey,
 		CitusTableCacheEntry *cache = GetCitusTableCacheEntry(baseRelationId);
 		int shardCount = cache->shardIntervalArrayLength;
 		ShardInterval **cachedSortedShardIntervalArray =
-			cache->sortedShardIntervalArray;
+			GetSortedShardIntervalArray(cache);
 		bool hasUninitializedShardInterval =
 			cache->hasUninitializedShardInterval;
 
@@ -2033,6 +2127,120 @@ HashPartitionCount(void)
 }
 
 
+/*
+ * AdjustDualHashPartitionCount sets the number of partitions of both sides of
+ * a dual repartition join based on the estimated number of rows that they
+ * repartition. Both sides need the same number of partitions, since merge
+ * task i joins partition i of both sides. If we cannot estimate the rows of
+ * either side, we keep the partition count of HashPartitionCount().
+ */
+static void
+AdjustDualHashPartitionCount(List *mapMergeJobList)
+{
+	double totalRowCount = 0.0;
+
+	if (list_length(mapMergeJobList) != 2)
+	{
+		return;
+	}
+
+	Job *job = NULL;
+	foreach_ptr(job, mapMergeJobList)
+	{
+		if (!CitusIsA(job, MapMergeJob))
+		{
+			return;
+		}
+
+		double rowCount = 0.0;
+		if (!EstimateMapMergeJobRowCount((MapMergeJob *) job, &rowCount))
+		{
+			return;
+		}
+
+		totalRowCount += rowCount;
+	}
+
+	uint32 partitionCount = AdaptiveHashPartitionCount(totalRowCount);
+
+	ereport(DEBUG2, (errmsg("using %u partitions for a dual repartition join of "
+							"about %.0f rows", partitionCount, totalRowCount)));
+
+	foreach_ptr(job, mapMergeJobList)
+	{
+		((MapMergeJob *) job)->partitionCount = partitionCount;
+	}
+}
+
+
+/*
+ * EstimateMapMergeJobRowCount estimates the number of rows that the given job
+ * repartitions from the row estimates of the tables it reads. We only know
+ * those for jobs that read directly from shards. Other tables in the job, such
+ * as reference tables, are assumed not to add rows, so we use the largest
+ * estimate.
+ */
+static bool
+EstimateMapMergeJobRowCount(MapMergeJob *mapMergeJob, double *rowCount)
+{
+	Query *jobQuery = mapMergeJob->job.jobQuery;
+	bool foundCitusTable = false;
+
+	*rowCount = 0.0;
+
+	if (mapMergeJob->job.dependentJobList != NIL)
+	{
+		return false;
+	}
+
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_ptr(rangeTableEntry, jobQuery->rtable)
+	{
+		if (rangeTableEntry->rtekind != RTE_RELATION ||
+			!IsCitusTable(rangeTableEntry->relid))
+		{
+			continue;
+		}
+
+		double tableRowCount = 0.0;
+		if (!TableRowEstimate(rangeTableEntry->relid, &tableRowCount))
+		{
+			return false;
+		}
+
+		*rowCount = Max(*rowCount, tableRowCount);
+		foundCitusTable = true;
+	}
+
+	return foundCitusTable;
+}
+
+
+/*
+ * AdaptiveHashPartitionCount returns the number of partitions for a dual
+ * repartition join of the given number of rows, such that each partition gets
+ * about citus.repartition_join_rows_per_bucket rows. We use at least one
+ * partition per node, such that all nodes take part in the merge, and at most
+ * as many partitions per node as the executor opens connections to a node,
+ * such that all merge tasks can run at the same time. The count is a multiple
+ * of the node count to balance the merge tasks across nodes.
+ */
+static uint32
+AdaptiveHashPartitionCount(double rowCount)
+{
+	uint32 groupCount = Max(list_length(ActiveReadableNodeList()), 1);
+	uint32 maxPartitionCountPerNode = Max(MaxAdaptiveExecutorPoolSize, 1);
+
+	double bucketCount = ceil(rowCount / RepartitionJoinRowsPerBucket);
+	double partitionCountPerNode = ceil(bucketCount / groupCount);
+
+	partitionCountPerNode = Max(partitionCountPerNode, 1.0);
+	partitionCountPerNode = Min(partitionCountPerNode, maxPartitionCountPerNode);
+
+	return groupCount * (uint32) partitionCountPerNode;
+}
+
+
 /* ------------------------------------------------------------
  * Functions that relate to building and assigning tasks follow
  * ------------------------------------------------------------
@@ -2270,6 +2478,33 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 	 * given that hash-distributed tables typically only have a few shards the
 	 * iteration is still very fast.
 	 */
+	ShardQueryTemplate *queryTemplate = NULL;
+	bool deparseTaskQueries = (taskType == MODIFY_TASK &&
+							   !modifyRequiresCoordinatorEvaluation) ||
+							  taskType == READ_TASK;
+
+	if (deparseTaskQueries && maxShardOffset > minShardOffset)
+	{
+		/*
+		 * The tasks only differ in the shard names, so rather than deparsing
+		 * the query for every shard we deparse it once with placeholders.
+		 */
+		BeginPlannerPhase(PLANNER_PHASE_DEPARSE);
+		queryTemplate = QueryPushdownTemplateCreate(query, relationRestrictionContext);
+		EndPlannerPhase(PLANNER_PHASE_DEPARSE);
+	}
+
+	/*
+	 * Creating a task leaves behind copies of the query and the shard intervals,
+	 * intermediate placement lists and oversized deparse buffers, which add up
+	 * to a lot of memory for tables with many shards. We therefore create each
+	 * task in a scratch context that we reset right after, and only keep a
+	 * compact copy of the task.
+	 */
+	MemoryContext taskCreationContext = AllocSetContextCreate(CurrentMemoryContext,
+															  "QueryPushdownTaskCreate",
+															  ALLOCSET_DEFAULT_SIZES);
+
 	for (int shardOffset = minShardOffset; shardOffset <= maxShardOffset; shardOffset++)
 	{
 		if (taskRequiredForShardIndex != NULL && !taskRequiredForShardIndex[shardOffset])
@@ -2278,22 +2513,35 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 			continue;
 		}
 
+		MemoryContext oldContext = MemoryContextSwitchTo(taskCreationContext);
+
 		Task *subqueryTask = QueryPushdownTaskCreate(query, shardOffset,
 													 relationRestrictionContext,
 													 taskIdIndex,
 													 taskType,
 													 modifyRequiresCoordinatorEvaluation,
+													 queryTemplate,
 													 planningError);
+
+		MemoryContextSwitchTo(oldContext);
+
 		if (*planningError != NULL)
 		{
+			/* the error lives in the scratch context, which goes with the planner's */
 			return NIL;
 		}
+
+		subqueryTask = copyObject(subqueryTask);
+		MemoryContextReset(taskCreationContext);
+
 		subqueryTask->jobId = jobId;
 		sqlTaskList = lappend(sqlTaskList, subqueryTask);
 
 		++taskIdIndex;
 	}
 
+	MemoryContextDelete(taskCreationContext);
+
 	/* If it is a modify task with multiple tables */
 	if (taskType == MODIFY_TASK && list_length(
 			relationRestrictionContext->relationRestrictionList) > 1)
@@ -2454,11 +2702,9 @@ static Task *
 QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 						RelationRestrictionContext *restrictionContext, uint32 taskId,
 						TaskType taskType, bool modifyRequiresCoordinatorEvaluation,
+						ShardQueryTemplate *queryTemplate,
 						DeferredErrorMessage **planningError)
 {
-	Query *taskQuery = copyObject(originalQuery);
-
-	StringInfo queryString = makeStringInfo();
 	ListCell *restrictionCell = NULL;
 	List *taskShardList = NIL;
 	List *relationShardList = NIL;
@@ -2493,7 +2739,7 @@ QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 		if (IsCitusTableTypeCacheEntry(cacheEntry, CITUS_TABLE_WITH_NO_DIST_KEY))
 		{
 			/* non-distributed tables have only one shard */
-			shardInterval = cacheEntry->sortedShardIntervalArray[0];
+			shardInterval = GetCachedShardInterval(cacheEntry, 0);
 
 			/* only use reference table as anchor shard if none exists yet */
 			if (anchorShardId == INVALID_SHARD_ID)
@@ -2503,7 +2749,7 @@ QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 		}
 		else if (UpdateOrDeleteQuery(originalQuery))
 		{
-			shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+			shardInterval = GetCachedShardInterval(cacheEntry, shardIndex);
 			if (!modifyWithSubselect || relationId == resultRelationOid)
 			{
 				/* for UPDATE/DELETE the shard in the result relation becomes the anchor shard */
@@ -2513,7 +2759,7 @@ QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 		else
 		{
 			/* for SELECT we pick an arbitrary shard as the anchor shard */
-			shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+			shardInterval = GetCachedShardInterval(cacheEntry, shardIndex);
 			anchorShardId = shardInterval->shardId;
 		}
 
@@ -2541,6 +2787,52 @@ QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 		return NULL;
 	}
 
+	Task *subqueryTask = CreateBasicTask(jobId, taskId, taskType, NULL);
+
+	if ((taskType == MODIFY_TASK && !modifyRequiresCoordinatorEvaluation) ||
+		taskType == READ_TASK)
+	{
+		char *queryString = NULL;
+
+		BeginPlannerPhase(PLANNER_PHASE_DEPARSE);
+
+		if (queryTemplate != NULL)
+		{
+			queryString = InstantiateShardQueryTemplate(queryTemplate,
+														relationShardList);
+		}
+
+		if (queryString == NULL)
+		{
+			queryString = QueryPushdownTaskQueryString(originalQuery,
+													   relationShardList);
+		}
+
+		EndPlannerPhase(PLANNER_PHASE_DEPARSE);
+
+		ereport(DEBUG4, (errmsg("distributed statement: %s", queryString)));
+		SetTaskQueryString(subqueryTask, queryString);
+	}
+
+	subqueryTask->dependentTaskList = NULL;
+	subqueryTask->anchorShardId = anchorShardId;
+	subqueryTask->taskPlacementList = taskPlacementList;
+	subqueryTask->relationShardList = relationShardList;
+
+	return subqueryTask;
+}
+
+
+/*
+ * QueryPushdownTaskQueryString deparses the query of a pushdown task that
+ * accesses the shards in relationShardList.
+ */
+char *
+QueryPushdownTaskQueryString(Query *originalQuery, List *relationShardList)
+{
+	Query *taskQuery = copyObject(originalQuery);
+	StringInfo queryString = makeStringInfo();
+
 	/*
 	 * Augment the relations in the query with the shard IDs.
 	 */
@@ -2558,23 +2850,40 @@ QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 			(List *) taskQuery->jointree->quals);
 	}
 
-	Task *subqueryTask = CreateBasicTask(jobId, taskId, taskType, NULL);
+	pg_get_query_def(taskQuery, queryString);
 
-	if ((taskType == MODIFY_TASK && !modifyRequiresCoordinatorEvaluation) ||
-		taskType == READ_TASK)
+	return queryString->data;
+}
+
+
+/*
+ * QueryPushdownTemplateCreate deparses the query of the pushdown tasks once,
+ * with placeholders for the shard names of the relations in the restriction
+ * context. It returns NULL if the query cannot be expressed as a template.
+ */
+static ShardQueryTemplate *
+QueryPushdownTemplateCreate(Query *originalQuery,
+							RelationRestrictionContext *restrictionContext)
+{
+	Query *templateQuery = copyObject(originalQuery);
+	List *relationIdList = NIL;
+	RelationRestriction *relationRestriction = NULL;
+
+	foreach_ptr(relationRestriction, restrictionContext->relationRestrictionList)
 	{
-		pg_get_query_def(taskQuery, queryString);
-		ereport(DEBUG4, (errmsg("distributed statement: %s",
-								queryString->data)));
-		SetTaskQueryString(subqueryTask, queryString->data);
+		relationIdList = list_append_unique_oid(relationIdList,
+												relationRestriction->relationId);
 	}
 
-	subqueryTask->dependentTaskList = NULL;
-	subqueryTask->anchorShardId = anchorShardId;
-	subqueryTask->taskPlacementList = taskPlacementList;
-	subqueryTask->relationShardList = relationShardList;
+	/* same as in QueryPushdownTaskQueryString */
+	if (templateQuery->jointree->quals != NULL &&
+		IsA(templateQuery->jointree->quals, List))
+	{
+		templateQuery->jointree->quals = (Node *) make_ands_explicit(
+			(List *) templateQuery->jointree->quals);
+	}
 
-	return subqueryTask;
+	return CreateShardQueryTemplate(templateQuery, relationIdList);
 }
 
 
@@ -2620,6 +2929,115 @@ CoPartitionedTables(Oid firstRelationId, Oid secondRelationId)
 }
 
 
+/*
+ * NestedShardPartitionedTables checks if the shards of one of the given hash
+ * distributed tables each cover a run of whole shards of the other, as with
+ * tables of 32 and 128 shards that both use uniform hash ranges. The covered
+ * shards also need to have their placements in the same groups as the shard
+ * that covers them, such that the shards can be joined on the same nodes.
+ */
+bool
+NestedShardPartitionedTables(Oid firstRelationId, Oid secondRelationId)
+{
+	CitusTableCacheEntry *coarseTableCache = GetCitusTableCacheEntry(firstRelationId);
+	CitusTableCacheEntry *fineTableCache = GetCitusTableCacheEntry(secondRelationId);
+
+	if (!IsCitusTableTypeCacheEntry(coarseTableCache, HASH_DISTRIBUTED) ||
+		!IsCitusTableTypeCacheEntry(fineTableCache, HASH_DISTRIBUTED) ||
+		!coarseTableCache->hasUniformHashDistribution ||
+		!fineTableCache->hasUniformHashDistribution)
+	{
+		return false;
+	}
+
+	/* the distribution column values need to hash the same way */
+	Var *coarsePartitionColumn = coarseTableCache->partitionColumn;
+	Var *finePartitionColumn = fineTableCache->partitionColumn;
+	if (coarsePartitionColumn->vartype != finePartitionColumn->vartype ||
+		coarsePartitionColumn->varcollid != finePartitionColumn->varcollid)
+	{
+		return false;
+	}
+
+	if (coarseTableCache->shardIntervalArrayLength >
+		fineTableCache->shardIntervalArrayLength)
+	{
+		CitusTableCacheEntry *tableCache = coarseTableCache;
+		coarseTableCache = fineTableCache;
+		fineTableCache = tableCache;
+	}
+
+	int coarseShardCount = coarseTableCache->shardIntervalArrayLength;
+	int fineShardCount = fineTableCache->shardIntervalArrayLength;
+	if (coarseShardCount == 0 || fineShardCount % coarseShardCount != 0)
+	{
+		return false;
+	}
+
+	int coveredShardCount = fineShardCount / coarseShardCount;
+
+	for (int coarseShardIndex = 0; coarseShardIndex < coarseShardCount;
+		 coarseShardIndex++)
+	{
+		ShardInterval *coarseInterval =
+			coarseTableCache->sortedShardIntervalArray[coarseShardIndex];
+		int firstFineShardIndex = coarseShardIndex * coveredShardCount;
+		ShardInterval *firstFineInterval =
+			fineTableCache->sortedShardIntervalArray[firstFineShardIndex];
+		ShardInterval *lastFineInterval =
+			fineTableCache->sortedShardIntervalArray[firstFineShardIndex +
+													 coveredShardCount - 1];
+
+		/* uniform hash ranges are contiguous, so the bounds of the run suffice */
+		if (DatumGetInt32(coarseInterval->minValue) !=
+			DatumGetInt32(firstFineInterval->minValue) ||
+			DatumGetInt32(coarseInterval->maxValue) !=
+			DatumGetInt32(lastFineInterval->maxValue))
+		{
+			return false;
+		}
+
+		List *coarseGroupIdList = ActivePlacementGroupIdList(coarseInterval->shardId);
+
+		for (int fineShardIndex = firstFineShardIndex;
+			 fineShardIndex < firstFineShardIndex + coveredShardCount;
+			 fineShardIndex++)
+		{
+			ShardInterval *fineInterval =
+				fineTableCache->sortedShardIntervalArray[fineShardIndex];
+			List *fineGroupIdList = ActivePlacementGroupIdList(fineInterval->shardId);
+
+			if (list_length(fineGroupIdList) != list_length(coarseGroupIdList) ||
+				list_difference_int(fineGroupIdList, coarseGroupIdList) != NIL)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ActivePlacementGroupIdList returns the groups of the active placements of
+ * the given shard.
+ */
+static List *
+ActivePlacementGroupIdList(uint64 shardId)
+{
+	List *groupIdList = NIL;
+
+	ShardPlacement *placement = NULL;
+	foreach_ptr(placement, ActiveShardPlacementList(shardId))
+	{
+		groupIdList = list_append_unique_int(groupIdList, placement->groupId);
+	}
+
+	return groupIdList;
+}
+
+
 /*
  * SqlTaskList creates a list of SQL tasks to execute the given job. For this,
  * the function walks over each range table in the job's range table list, gets
@@ -4167,12 +4585,17 @@ FetchTaskResultNameList(List *mapOutputFetchTaskList)
 
 	foreach_ptr(mapOutputFetchTask, mapOutputFetchTaskList)
 	{
-		Task *mapTask = linitial(mapOutputFetchTask->dependentTaskList);
 		int partitionId = mapOutputFetchTask->partitionId;
-		char *resultName =
-			PartitionResultName(mapTask->jobId, mapTask->taskId, partitionId);
 
-		resultNameList = lappend(resultNameList, resultName);
+		/* a fetch task may fetch the fragments of several map tasks */
+		Task *mapTask = NULL;
+		foreach_ptr(mapTask, mapOutputFetchTask->dependentTaskList)
+		{
+			char *resultName =
+				PartitionResultName(mapTask->jobId, mapTask->taskId, partitionId);
+
+			resultNameList = lappend(resultNameList, resultName);
+		}
 	}
 
 	return resultNameList;
@@ -4295,6 +4718,22 @@ MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList)
 	foreach(filterTaskCell, filterTaskList)
 	{
 		Task *filterTask = (Task *) lfirst(filterTaskCell);
+
+		if (mapMergeJob->buildsJoinKeyFilter)
+		{
+			Task *joinKeyFilterTask = JoinKeyFilterTask(filterTask,
+														partitionColumnResNo);
+			mapMergeJob->joinKeyFilterTaskList =
+				lappend(mapMergeJob->joinKeyFilterTaskList, joinKeyFilterTask);
+		}
+
+		if (mapMergeJob->samplesHeavyHitters)
+		{
+			Task *sampleTask = HeavyHitterSampleTask(filterTask, partitionColumnResNo);
+			mapMergeJob->heavyHitterSampleTaskList =
+				lappend(mapMergeJob->heavyHitterSampleTaskList, sampleTask);
+		}
+
 		StringInfo mapQueryString = CreateMapQueryString(mapMergeJob, filterTask,
 														 partitionColumnResNo,
 														 useBinaryFormat);
@@ -4318,6 +4757,232 @@ MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList)
 }
 
 
+/*
+ * PlanRepartitionJoinFilters walks over the job tree and finds the dual
+ * repartition joins that can skip repartitioning rows without a join partner.
+ * For those, one side builds a bloom filter of its join keys before the map
+ * tasks run, and the other side only repartitions the rows that pass it.
+ *
+ * We do not have statistics to find the smaller side. Since the logical plan
+ * is left deep, the right side is the table that is joined last, which is
+ * usually the dimension table in a star schema query, so we pick that one.
+ */
+static void
+PlanRepartitionJoinFilters(Job *job)
+{
+	Job *dependentJob = NULL;
+	foreach_ptr(dependentJob, job->dependentJobList)
+	{
+		PlanRepartitionJoinFilters(dependentJob);
+	}
+
+	if (list_length(job->dependentJobList) != 2)
+	{
+		return;
+	}
+
+	Job *leftJob = (Job *) linitial(job->dependentJobList);
+	Job *rightJob = (Job *) lsecond(job->dependentJobList);
+	if (!CitusIsA(leftJob, MapMergeJob) || !CitusIsA(rightJob, MapMergeJob))
+	{
+		return;
+	}
+
+	MapMergeJob *probeJob = (MapMergeJob *) leftJob;
+	MapMergeJob *buildJob = (MapMergeJob *) rightJob;
+	if (!CanUseRepartitionJoinFilter(probeJob, buildJob))
+	{
+		return;
+	}
+
+	StringInfo resultId = makeStringInfo();
+	appendStringInfo(resultId, "repartition_" UINT64_FORMAT "_join_key_filter",
+					 probeJob->job.jobId);
+
+	probeJob->joinKeyFilterResultId = resultId->data;
+	buildJob->joinKeyFilterResultId = resultId->data;
+	buildJob->buildsJoinKeyFilter = true;
+}
+
+
+/*
+ * CanUseRepartitionJoinFilter returns whether the given sides of a join can
+ * use a join key filter. The join needs to be a dual repartition join, and we
+ * only consider sides that read from shards, since the filter is built before
+ * any of the map tasks run. Both sides also need to hash their join keys the
+ * same way.
+ */
+static bool
+CanUseRepartitionJoinFilter(MapMergeJob *leftJob, MapMergeJob *rightJob)
+{
+	if (leftJob->partitionType != DUAL_HASH_PARTITION_TYPE ||
+		rightJob->partitionType != DUAL_HASH_PARTITION_TYPE)
+	{
+		return false;
+	}
+
+	if (leftJob->job.dependentJobList != NIL || rightJob->job.dependentJobList != NIL)
+	{
+		return false;
+	}
+
+	Var *leftColumn = leftJob->partitionColumn;
+	Var *rightColumn = rightJob->partitionColumn;
+	if (leftColumn->vartype != rightColumn->vartype ||
+		leftColumn->varcollid != rightColumn->varcollid)
+	{
+		return false;
+	}
+
+	TypeCacheEntry *typeEntry = lookup_type_cache(leftColumn->vartype,
+												  TYPECACHE_HASH_EXTENDED_PROC);
+
+	return OidIsValid(typeEntry->hash_extended_proc);
+}
+
+
+/*
+ * JoinKeyFilterTask returns a copy of the given filter task that builds the
+ * join key filter of the task's rows on the worker.
+ */
+static Task *
+JoinKeyFilterTask(Task *filterTask, uint32 partitionColumnIndex)
+{
+	Task *joinKeyFilterTask = copyObject(filterTask);
+	char *filterQueryString = TaskQueryString(filterTask);
+	int filterSize = RepartitionJoinFilterSize * 1024;
+
+	StringInfo joinKeyFilterQueryString = makeStringInfo();
+	appendStringInfo(joinKeyFilterQueryString,
+					 "SELECT pg_catalog.worker_build_join_key_filter(%s,%d,%d)",
+					 quote_literal_cstr(filterQueryString),
+					 partitionColumnIndex - 1,
+					 filterSize);
+
+	SetTaskQueryString(joinKeyFilterTask, joinKeyFilterQueryString->data);
+
+	return joinKeyFilterTask;
+}
+
+
+/*
+ * PlanRepartitionJoinSkewHandling walks over the job tree and finds the dual
+ * repartition joins whose sides read from shards. For those, the map tasks
+ * spread the rows of the heavy hitters of the join key across all partitions
+ * instead of sending them all to the one partition that the key hashes to.
+ *
+ * Before the map tasks run, we sample the join keys of the left side, which
+ * is usually the larger fact table in a left deep plan. The left side then
+ * spreads its rows with a heavy hitter key over all partitions, and the right
+ * side sends its rows with a heavy hitter key to all partitions, such that
+ * every pair of matching rows still meets in exactly one merge task.
+ */
+static void
+PlanRepartitionJoinSkewHandling(Job *job)
+{
+	Job *dependentJob = NULL;
+	foreach_ptr(dependentJob, job->dependentJobList)
+	{
+		PlanRepartitionJoinSkewHandling(dependentJob);
+	}
+
+	if (list_length(job->dependentJobList) != 2)
+	{
+		return;
+	}
+
+	Job *leftJob = (Job *) linitial(job->dependentJobList);
+	Job *rightJob = (Job *) lsecond(job->dependentJobList);
+	if (!CitusIsA(leftJob, MapMergeJob) || !CitusIsA(rightJob, MapMergeJob))
+	{
+		return;
+	}
+
+	MapMergeJob *spreadJob = (MapMergeJob *) leftJob;
+	MapMergeJob *replicateJob = (MapMergeJob *) rightJob;
+	if (!CanHandleRepartitionJoinSkew(spreadJob, replicateJob))
+	{
+		return;
+	}
+
+	StringInfo resultId = makeStringInfo();
+	appendStringInfo(resultId, "repartition_" UINT64_FORMAT "_heavy_hitters",
+					 spreadJob->job.jobId);
+
+	spreadJob->heavyHitterResultId = resultId->data;
+	replicateJob->heavyHitterResultId = resultId->data;
+	spreadJob->samplesHeavyHitters = true;
+}
+
+
+/*
+ * CanHandleRepartitionJoinSkew returns whether the given sides of a join can
+ * spread the rows of heavy hitters. The join needs to be a dual repartition
+ * join, and we only consider sides that read from shards, since the heavy
+ * hitters are sampled before any of the map tasks run. Both sides need the
+ * same join key type, since the heavy hitters of the left side are looked up
+ * on both sides.
+ */
+static bool
+CanHandleRepartitionJoinSkew(MapMergeJob *leftJob, MapMergeJob *rightJob)
+{
+	if (leftJob->partitionType != DUAL_HASH_PARTITION_TYPE ||
+		rightJob->partitionType != DUAL_HASH_PARTITION_TYPE)
+	{
+		return false;
+	}
+
+	if (leftJob->job.dependentJobList != NIL || rightJob->job.dependentJobList != NIL)
+	{
+		return false;
+	}
+
+	Var *leftColumn = leftJob->partitionColumn;
+	Var *rightColumn = rightJob->partitionColumn;
+
+	return leftColumn->vartype == rightColumn->vartype &&
+		   leftColumn->varcollid == rightColumn->varcollid;
+}
+
+
+/*
+ * HeavyHitterSampleTask returns a copy of the given filter task that returns
+ * the frequencies of the join keys among the first rows of the task.
+ */
+static Task *
+HeavyHitterSampleTask(Task *filterTask, uint32 partitionColumnIndex)
+{
+	Task *sampleTask = copyObject(filterTask);
+	char *filterQueryString = TaskQueryString(filterTask);
+
+	/*
+	 * We name the columns up to the join key, which is allowed to be fewer
+	 * than the number of columns of the subquery.
+	 */
+	StringInfo columnAliases = makeStringInfo();
+	for (uint32 columnIndex = 1; columnIndex < partitionColumnIndex; columnIndex++)
+	{
+		appendStringInfo(columnAliases, "sample_column_%u,", columnIndex);
+	}
+
+	appendStringInfoString(columnAliases, "sample_join_key");
+
+	StringInfo sampleQueryString = makeStringInfo();
+	appendStringInfo(sampleQueryString,
+					 "SELECT sample_join_key::text, count(*) "
+					 "FROM (SELECT * FROM (%s) sampled_rows LIMIT %d) "
+					 "sample_rows(%s) "
+					 "WHERE sample_join_key IS NOT NULL GROUP BY 1",
+					 filterQueryString,
+					 HEAVY_HITTER_SAMPLE_SIZE,
+					 columnAliases->data);
+
+	SetTaskQueryString(sampleTask, sampleQueryString->data);
+
+	return sampleTask;
+}
+
+
 /*
  * PartitionColumnIndex finds the index of the given target var.
  */
@@ -4414,12 +5079,35 @@ CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
 	 */
 	bool generateEmptyResults = true;
 
+	StringInfo optionalArguments = makeStringInfo();
+
+	/* the side of a join that does not build the join key filter applies it */
+	if (mapMergeJob->joinKeyFilterResultId != NULL && !mapMergeJob->buildsJoinKeyFilter)
+	{
+		appendStringInfo(optionalArguments, ",%s",
+						 quote_literal_cstr(mapMergeJob->joinKeyFilterResultId));
+	}
+
+	/*
+	 * Both sides of a join that handles skew look up the heavy hitters. The
+	 * side that sampled them spreads their rows, the other side replicates
+	 * them.
+	 */
+	if (mapMergeJob->heavyHitterResultId != NULL)
+	{
+		appendStringInfo(optionalArguments,
+						 ",heavy_hitter_result_id => %s"
+						 ",replicate_heavy_hitters => %s",
+						 quote_literal_cstr(mapMergeJob->heavyHitterResultId),
+						 mapMergeJob->samplesHeavyHitters ? "false" : "true");
+	}
+
 	appendStringInfo(mapQueryString,
 					 "SELECT partition_index"
 					 ", %s || '_' || partition_index::text "
 					 ", rows_written "
 					 "FROM pg_catalog.worker_partition_query_result"
-					 "(%s,%s,%d,%s,%s,%s,%s,%s,%s) WHERE rows_written > 0",
+					 "(%s,%s,%d,%s,%s,%s,%s,%s,%s%s) WHERE rows_written > 0",
 					 quote_literal_cstr(resultNamePrefix),
 					 quote_literal_cstr(resultNamePrefix),
 					 quote_literal_cstr(filterQueryString),
@@ -4429,7 +5117,8 @@ CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
 					 maxValuesString->data,
 					 useBinaryFormat ? "true" : "false",
 					 allowNullPartitionColumnValue ? "true" : "false",
-					 generateEmptyResults ? "true" : "false");
+					 generateEmptyResults ? "true" : "false",
+					 optionalArguments->data);
 
 	return mapQueryString;
 }
@@ -4626,6 +5315,56 @@ ArrayObjectToString(ArrayType *arrayObject, Oid columnType, int32 columnTypeMod)
 }
 
 
+/*
+ * FetchMapTaskGroupList groups the given map tasks by the fetch task that
+ * fetches their fragments to a merge task. By default, each fragment is
+ * fetched separately. When citus.enable_repartition_fragment_coalescing is
+ * on, the fragments of all map tasks that ran on the same node are fetched
+ * together, which saves a round trip for every additional map task on a node.
+ */
+static List *
+FetchMapTaskGroupList(List *mapTaskList)
+{
+	List *mapTaskGroupList = NIL;
+
+	Task *mapTask = NULL;
+	foreach_ptr(mapTask, mapTaskList)
+	{
+		ShardPlacement *mapTaskPlacement = linitial(mapTask->taskPlacementList);
+		List **existingGroup = NULL;
+
+		if (EnableRepartitionFragmentCoalescing)
+		{
+			ListCell *groupCell = NULL;
+			foreach(groupCell, mapTaskGroupList)
+			{
+				List *mapTaskGroup = (List *) lfirst(groupCell);
+				Task *groupMapTask = (Task *) linitial(mapTaskGroup);
+				ShardPlacement *groupPlacement =
+					linitial(groupMapTask->taskPlacementList);
+
+				if (groupPlacement->nodeId == mapTaskPlacement->nodeId)
+				{
+					existingGroup = (List **) &lfirst(groupCell);
+					break;
+				}
+			}
+		}
+
+		if (existingGroup != NULL)
+		{
+			*existingGroup = lappend(*existingGroup, mapTask);
+		}
+		else
+		{
+			mapTaskGroupList = lappend(mapTaskGroupList, list_make1(mapTask));
+		}
+	}
+
+	return mapTaskGroupList;
+}
+
+
 /*
  * MergeTaskList creates a list of merge tasks for the given MapMerge job. While
  * doing this, the function also establishes dependencies between each merge
@@ -4666,12 +5405,14 @@ MergeTaskList(MapMergeJob *mapMergeJob, List *mapTaskList, uint32 taskIdIndex)
 		initialPartitionId = 0;
 	}
 
+	/* map tasks whose fragments are fetched together */
+	List *mapTaskGroupList = FetchMapTaskGroupList(mapTaskList);
+
 	/* build merge tasks and their associated "map output fetch" tasks */
 	for (uint32 partitionId = initialPartitionId; partitionId < partitionCount;
 		 partitionId++)
 	{
 		List *mapOutputFetchTaskList = NIL;
-		ListCell *mapTaskCell = NULL;
 		uint32 mergeTaskId = taskIdIndex;
 
 		/* create logical merge task (not executed, but useful for bookkeeping) */
@@ -4681,24 +5422,30 @@ MergeTaskList(MapMergeJob *mapMergeJob, List *mapTaskList, uint32 taskIdIndex)
 		taskIdIndex++;
 
 		/* create tasks to fetch map outputs to this merge task */
-		foreach(mapTaskCell, mapTaskList)
+		List *mapTaskGroup = NIL;
+		foreach_ptr(mapTaskGroup, mapTaskGroupList)
 		{
-			Task *mapTask = (Task *) lfirst(mapTaskCell);
+			Task *firstMapTask = (Task *) linitial(mapTaskGroup);
 
 			/* find the node name/port for map task's execution */
-			List *mapTaskPlacementList = mapTask->taskPlacementList;
+			List *mapTaskPlacementList = firstMapTask->taskPlacementList;
 			ShardPlacement *mapTaskPlacement = linitial(mapTaskPlacementList);
 
-			char *partitionResultName =
-				PartitionResultName(jobId, mapTask->taskId, partitionId);
-
-			/* we currently only fetch a single fragment at a time */
-			DistributedResultFragment singleFragmentTransfer;
-			singleFragmentTransfer.resultId = partitionResultName;
-			singleFragmentTransfer.nodeId = mapTaskPlacement->nodeId;
-			singleFragmentTransfer.rowCount = 0;
-			singleFragmentTransfer.targetShardId = INVALID_SHARD_ID;
-			singleFragmentTransfer.targetShardIndex = partitionId;
+			List *fragmentList = NIL;
+			Task *mapTask = NULL;
+			foreach_ptr(mapTask, mapTaskGroup)
+			{
+				DistributedResultFragment *fragment =
+					palloc0(sizeof(DistributedResultFragment));
+				fragment->resultId = PartitionResultName(jobId, mapTask->taskId,
+														 partitionId);
+				fragment->nodeId = mapTaskPlacement->nodeId;
+				fragment->rowCount = 0;
+				fragment->targetShardId = INVALID_SHARD_ID;
+				fragment->targetShardIndex = partitionId;
+
+				fragmentList = lappend(fragmentList, fragment);
+			}
 
 			NodeToNodeFragmentsTransfer fragmentsTransfer;
 			fragmentsTransfer.nodes.sourceNodeId = mapTaskPlacement->nodeId;
@@ -4709,7 +5456,7 @@ MergeTaskList(MapMergeJob *mapMergeJob, List *mapTaskList, uint32 taskIdIndex)
 			 */
 			fragmentsTransfer.nodes.targetNodeId = -1;
 
-			fragmentsTransfer.fragmentList = list_make1(&singleFragmentTransfer);
+			fragmentsTransfer.fragmentList = fragmentList;
 
 			char *fetchQueryString = QueryStringForFragmentsTransfer(&fragmentsTransfer);
 
@@ -4718,7 +5465,7 @@ MergeTaskList(MapMergeJob *mapMergeJob, List *mapTaskList, uint32 taskIdIndex)
 													   fetchQueryString);
 			mapOutputFetchTask->partitionId = partitionId;
 			mapOutputFetchTask->upstreamTaskId = mergeTaskId;
-			mapOutputFetchTask->dependentTaskList = list_make1(mapTask);
+			mapOutputFetchTask->dependentTaskList = list_copy(mapTaskGroup);
 			taskIdIndex++;
 
 			mapOutputFetchTaskList = lappend(mapOutputFetchTaskList, mapOutputFetchTask);
@@ -5006,6 +5753,10 @@ AssignAnchorShardTaskList(List *taskList)
 	{
 		assignedTaskList = RoundRobinAssignTaskList(taskList);
 	}
+	else if (TaskAssignmentPolicy == TASK_ASSIGNMENT_LEAST_LOADED)
+	{
+		assignedTaskList = LeastLoadedAssignTaskList(taskList);
+	}
 
 	Assert(assignedTaskList != NIL);
 	return assignedTaskList;
@@ -5220,6 +5971,124 @@ RoundRobinReorder(List *placementList)
 }
 
 
+/*
+ * LeastLoadedAssignTaskList assigns each task to the placement whose worker has
+ * the fewest running tasks, and among those the lowest recent task execution
+ * time, as observed by all backends. Since other backends only see the tasks
+ * once they start, we count the tasks that we assign as running while going
+ * over the task list. Ties are broken in a round-robin fashion.
+ */
+List *
+LeastLoadedAssignTaskList(List *taskList)
+{
+	List *workerLoadList = NIL;
+
+	taskList = ReorderAndAssignTaskList(taskList, RoundRobinReorder);
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		task->taskPlacementList =
+			MoveLeastLoadedPlacementFirst(task->taskPlacementList, &workerLoadList);
+	}
+
+	return taskList;
+}
+
+
+/*
+ * LeastLoadedReorder implements the least-loaded assignment policy for a single
+ * task. It returns a copy of the placement list, in which the placement on the
+ * least loaded worker comes first.
+ */
+List *
+LeastLoadedReorder(List *placementList)
+{
+	List *workerLoadList = NIL;
+
+	placementList = RoundRobinReorder(placementList);
+
+	return MoveLeastLoadedPlacementFirst(placementList, &workerLoadList);
+}
+
+
+/*
+ * MoveLeastLoadedPlacementFirst returns a copy of the placement list in which
+ * the placement on the least loaded worker comes first, while the remaining
+ * placements keep their order for failover. The load of the chosen worker in
+ * workerLoadList is incremented to account for the new task.
+ */
+static List *
+MoveLeastLoadedPlacementFirst(List *placementList, List **workerLoadList)
+{
+	ShardPlacement *leastLoadedPlacement = NULL;
+	WorkerLoad *leastLoad = NULL;
+
+	ShardPlacement *placement = NULL;
+	foreach_ptr(placement, placementList)
+	{
+		WorkerLoad *workerLoad = FindOrFetchWorkerLoad(placement, workerLoadList);
+
+		if (leastLoad == NULL ||
+			workerLoad->runningTaskCount < leastLoad->runningTaskCount ||
+			(workerLoad->runningTaskCount == leastLoad->runningTaskCount &&
+			 workerLoad->avgTaskExecutionTime < leastLoad->avgTaskExecutionTime))
+		{
+			leastLoadedPlacement = placement;
+			leastLoad = workerLoad;
+		}
+	}
+
+	if (leastLoadedPlacement == NULL)
+	{
+		return placementList;
+	}
+
+	leastLoad->runningTaskCount++;
+
+	List *reorderedPlacementList = list_make1(leastLoadedPlacement);
+
+	foreach_ptr(placement, placementList)
+	{
+		if (placement != leastLoadedPlacement)
+		{
+			reorderedPlacementList = lappend(reorderedPlacementList, placement);
+		}
+	}
+
+	return reorderedPlacementList;
+}
+
+
+/*
+ * FindOrFetchWorkerLoad returns the load of the worker of the placement from
+ * workerLoadList, or reads it from shared memory and adds it to the list.
+ */
+static WorkerLoad *
+FindOrFetchWorkerLoad(ShardPlacement *placement, List **workerLoadList)
+{
+	WorkerLoad *workerLoad = NULL;
+	foreach_ptr(workerLoad, *workerLoadList)
+	{
+		if (workerLoad->nodePort == placement->nodePort &&
+			strncmp(workerLoad->nodeName, placement->nodeName, WORKER_LENGTH) == 0)
+		{
+			return workerLoad;
+		}
+	}
+
+	workerLoad = palloc0(sizeof(WorkerLoad));
+	workerLoad->nodeName = placement->nodeName;
+	workerLoad->nodePort = placement->nodePort;
+	GetWorkerLoad(placement->nodeName, placement->nodePort,
+				  &workerLoad->runningTaskCount, &workerLoad->avgTaskExecutionTime);
+
+	*workerLoadList = lappend(*workerLoadList, workerLoad);
+
+	return workerLoad;
+}
+
+
 /*
  * ReorderAndAssignTaskList finds the placements for a task based on its anchor
  * shard id and then sorts them by insertion time. If reorderFunction is given,
@@ -22,6 +22,7 @@
 #include "catalog/pg_opfamily.h"
 #include "catalog/pg_type.h"
 #include "distributed/colocation_utils.h"
+#include "distributed/connection_management.h"
 #include "distributed/citus_clauses.h"
 #include "distributed/citus_nodes.h"
 #include "distributed/citus_nodefuncs.h"
@@ -42,6 +43,7 @@
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/planner_timing.h"
 #include "distributed/listutils.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/query_pushdown_planning.h"
@@ -51,6 +53,7 @@
 #include "distributed/relay_utility.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/resource_lock.h"
+#include "distributed/router_placement_cache.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/shard_pruning.h"
 #include "executor/execdesc.h"
@@ -114,6 +117,9 @@ typedef struct WalkerState
 
 bool EnableRouterExecution = true;
 
+/* GUC, whether router planning starts the connections that the query needs */
+bool EnableEarlyConnectionEstablishment = false;
+
 
 /* planner functions forward declarations */
 static void CreateSingleTaskRouterSelectPlan(DistributedPlan *distributedPlan,
@@ -122,6 +128,7 @@ static void CreateSingleTaskRouterSelectPlan(DistributedPlan *distributedPlan,
 											 PlannerRestrictionContext *
 											 plannerRestrictionContext);
 static Oid ResultRelationOidForQuery(Query *query);
+static void StartTaskPlacementConnections(Job *job);
 static bool IsTidColumn(Node *node);
 static DeferredErrorMessage * ModifyPartialQuerySupported(Query *queryTree, bool
 														  multiShardQuery,
@@ -154,6 +161,8 @@ static void AppendNextDummyColReference(Alias *expendedReferenceNames);
 static String * MakeDummyColumnString(int dummyColumnId);
 static List * BuildRoutesForInsert(Query *query, DeferredErrorMessage **planningError);
 static List * GroupInsertValuesByShardId(List *insertValuesList);
+static List * GroupConstInsertValuesByShardIndex(Query *query,
+												 CitusTableCacheEntry *cacheEntry);
 static List * ExtractInsertValuesList(Query *query, Var *partitionColumn);
 static DeferredErrorMessage * DeferErrorIfUnsupportedRouterPlannableSelectQuery(
 	Query *query);
@@ -167,6 +176,8 @@ static ShardPlacement * CreateDummyPlacement(bool hasLocalRelation);
 static ShardPlacement * CreateLocalDummyPlacement();
 static int CompareInsertValuesByShardId(const void *leftElement,
 										const void *rightElement);
+static int CompareModifyRoutesByShardId(const void *leftElement,
+										const void *rightElement);
 static List * SingleShardTaskList(Query *query, uint64 jobId,
 								  List *relationShardList, List *placementList,
 								  uint64 shardId, bool parametersInQueryResolved,
@@ -1275,8 +1286,10 @@ MultiShardUpdateDeleteSupported(Query *originalQuery,
 	}
 	else
 	{
+		BeginPlannerPhase(PLANNER_PHASE_PUSHDOWN_CHECKS);
 		errorMessage = DeferErrorIfUnsupportedSubqueryPushdown(originalQuery,
 															   plannerRestrictionContext);
+		EndPlannerPhase(PLANNER_PHASE_PUSHDOWN_CHECKS);
 	}
 
 	return errorMessage;
@@ -1793,6 +1806,7 @@ RouterJob(Query *originalQuery, PlannerRestrictionContext *plannerRestrictionCon
 	bool replacePrunedQueryWithDummy = true;
 
 	bool isLocalTableModification = false;
+	List *valueGroupList = NIL;
 
 	/* check if this query requires coordinator evaluation */
 	bool requiresCoordinatorEvaluation = RequiresCoordinatorEvaluation(originalQuery);
@@ -1814,6 +1828,24 @@ RouterJob(Query *originalQuery, PlannerRestrictionContext *plannerRestrictionCon
 								"query")));
 		return job;
 	}
+	else if (fastPathRestrictionContext->fastPathRouterQuery &&
+			 originalQuery->commandType == CMD_SELECT &&
+			 list_length(valueGroupList = DistributionKeyValueGroups(originalQuery)) > 1)
+	{
+		/* the values of the IN-list or = ANY(array) belong to multiple shards */
+		Job *job = CreateJob(originalQuery);
+		job->taskList = FastPathArrayFilterTaskList(job, valueGroupList, planningError);
+		if (*planningError)
+		{
+			return NULL;
+		}
+
+		ereport(DEBUG2, (errmsg("Creating a fast-path router plan with %d tasks",
+								list_length(job->taskList))));
+
+		job->requiresCoordinatorEvaluation = requiresCoordinatorEvaluation;
+		return job;
+	}
 	else
 	{
 		(*planningError) = PlanRouterQuery(originalQuery, plannerRestrictionContext,
@@ -1870,6 +1902,11 @@ RouterJob(Query *originalQuery, PlannerRestrictionContext *plannerRestrictionCon
 		GenerateSingleShardRouterTaskList(job, relationShardList,
 										  placementList, shardId,
 										  isLocalTableModification);
+
+		if (EnableEarlyConnectionEstablishment)
+		{
+			StartTaskPlacementConnections(job);
+		}
 	}
 
 	job->requiresCoordinatorEvaluation = requiresCoordinatorEvaluation;
@@ -1877,6 +1914,52 @@ RouterJob(Query *originalQuery, PlannerRestrictionContext *plannerRestrictionCon
 }
 
 
+/*
+ * StartTaskPlacementConnections starts establishing the connections to the
+ * remote placements of the single task of a router job, such that connecting
+ * overlaps with the rest of planning. The connections are not claimed, so the
+ * executor finds them in the connection cache and finishes establishing them.
+ * When there already is an unclaimed connection to a node, nothing happens.
+ */
+static void
+StartTaskPlacementConnections(Job *job)
+{
+	if (list_length(job->taskList) != 1 || IsAbortedTransactionBlockState())
+	{
+		return;
+	}
+
+	Task *task = linitial(job->taskList);
+	if (task->anchorShardId == INVALID_SHARD_ID)
+	{
+		return;
+	}
+
+	List *placementList = task->taskPlacementList;
+	if (task->taskType == READ_TASK && placementList != NIL)
+	{
+		/* reads go to the first placement unless it fails */
+		placementList = list_make1(linitial(placementList));
+	}
+
+	int32 localGroupId = GetLocalGroupId();
+
+	ShardPlacement *placement = NULL;
+	foreach_ptr(placement, placementList)
+	{
+		if (placement->groupId == localGroupId)
+		{
+			/* local placements are likely accessed via local execution */
+			continue;
+		}
+
+		/* do not take a connection slot that we might not end up using */
+		StartNodeUserDatabaseConnection(OPTIONAL_CONNECTION, placement->nodeName,
+										placement->nodePort, NULL, NULL);
+	}
+}
+
+
 /*
  * GenerateSingleShardRouterTaskList is a wrapper around other corresponding task
  * list generation functions specific to single shard selects and modifications.
@@ -1929,12 +2012,83 @@ GenerateSingleShardRouterTaskList(Job *job, List *relationShardList,
 }
 
 
+/*
+ * FastPathArrayFilterTaskList creates a task for each of the given
+ * DistributionKeyValueGroups of a fast-path SELECT with an IN-list or
+ * = ANY(array) filter on the distribution key. The query of each task only
+ * contains the values that belong to its shard, and the results of the tasks
+ * are returned one after the other.
+ */
+List *
+FastPathArrayFilterTaskList(Job *job, List *valueGroupList,
+							DeferredErrorMessage **planningError)
+{
+	List *taskList = NIL;
+	uint32 taskId = 0;
+	DistributionKeyValueGroup *valueGroup = NULL;
+
+	Assert(job->jobQuery->commandType == CMD_SELECT);
+
+	foreach_ptr(valueGroup, valueGroupList)
+	{
+		ShardInterval *shardInterval = valueGroup->shardInterval;
+		List *shardIntervalListList = list_make1(list_make1(shardInterval));
+		bool shardsPresent = true;
+		bool generateDummyPlacement = false;
+		bool hasLocalRelation = false;
+
+		List *placementList =
+			CreateTaskPlacementListForShardIntervals(shardIntervalListList,
+													 shardsPresent,
+													 generateDummyPlacement,
+													 hasLocalRelation);
+		if (placementList == NIL)
+		{
+			*planningError = DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
+										   "found no worker with all shard placements",
+										   NULL, NULL);
+			return NIL;
+		}
+
+		Query *taskQuery = copyObject(job->jobQuery);
+
+		ScalarArrayOpExpr *arrayOpExpr = FindDistributionKeyArrayFilter(taskQuery);
+		Assert(arrayOpExpr != NULL);
+		arrayOpExpr->args = list_make2(linitial(arrayOpExpr->args),
+									   valueGroup->valueArray);
+
+		RelationShard *relationShard = CitusMakeNode(RelationShard);
+		relationShard->relationId = shardInterval->relationId;
+		relationShard->shardId = shardInterval->shardId;
+
+		List *relationShardList = list_make1(relationShard);
+		UpdateRelationToShardNames((Node *) taskQuery, relationShardList);
+
+		bool isLocalTableModification = false;
+		List *shardTaskList = SingleShardTaskList(taskQuery, job->jobId,
+												  relationShardList, placementList,
+												  shardInterval->shardId,
+												  job->parametersInJobQueryResolved,
+												  isLocalTableModification);
+
+		Task *task = (Task *) linitial(shardTaskList);
+		task->taskId = ++taskId;
+
+		taskList = lappend(taskList, task);
+	}
+
+	return taskList;
+}
+
+
 /*
  * ReorderTaskPlacementsByTaskAssignmentPolicy applies selective reordering for supported
  * TaskAssignmentPolicyTypes.
  *
  * Supported Types
  * - TASK_ASSIGNMENT_ROUND_ROBIN round robin schedule queries among placements
+ * - TASK_ASSIGNMENT_LEAST_LOADED schedule queries on the placement with the fewest
+ *   running tasks
  *
  * By default it does not reorder the task list, implying a first-replica strategy.
  */
@@ -1943,7 +2097,8 @@ ReorderTaskPlacementsByTaskAssignmentPolicy(Job *job,
 											TaskAssignmentPolicyType taskAssignmentPolicy,
 											List *placementList)
 {
-	if (taskAssignmentPolicy == TASK_ASSIGNMENT_ROUND_ROBIN)
+	if (taskAssignmentPolicy == TASK_ASSIGNMENT_ROUND_ROBIN ||
+		taskAssignmentPolicy == TASK_ASSIGNMENT_LEAST_LOADED)
 	{
 		/*
 		 * We hit a single shard on router plans, and there should be only
@@ -1953,7 +2108,7 @@ ReorderTaskPlacementsByTaskAssignmentPolicy(Job *job,
 		Task *task = (Task *) linitial(job->taskList);
 
 		/*
-		 * For round-robin SELECT queries, we don't want to include the coordinator
+		 * For round-robin and least-loaded SELECT queries, we don't want to include the coordinator
 		 * because the user is trying to distributed the load across nodes via
 		 * round-robin policy. Otherwise, the local execution would prioritize
 		 * executing the local tasks and especially for reference tables on the
@@ -1967,7 +2122,10 @@ ReorderTaskPlacementsByTaskAssignmentPolicy(Job *job,
 		placementList = RemoveCoordinatorPlacementIfNotSingleNode(placementList);
 
 		/* reorder the placement list */
-		List *reorderedPlacementList = RoundRobinReorder(placementList);
+		List *reorderedPlacementList =
+			taskAssignmentPolicy == TASK_ASSIGNMENT_ROUND_ROBIN ?
+			RoundRobinReorder(placementList) :
+			LeastLoadedReorder(placementList);
 		task->taskPlacementList = reorderedPlacementList;
 
 		ShardPlacement *primaryPlacement = (ShardPlacement *) linitial(
@@ -2227,6 +2385,7 @@ PlanRouterQuery(Query *originalQuery,
 	CmdType commandType = originalQuery->commandType;
 	bool fastPathRouterQuery =
 		plannerRestrictionContext->fastPathRestrictionContext->fastPathRouterQuery;
+	List *cachedPlacementList = NIL;
 
 	*placementList = NIL;
 
@@ -2243,7 +2402,8 @@ PlanRouterQuery(Query *originalQuery,
 		List *shardIntervalList =
 			TargetShardIntervalForFastPathQuery(originalQuery, &isMultiShardQuery,
 												distributionKeyValue,
-												partitionValueConst);
+												partitionValueConst,
+												&cachedPlacementList);
 
 		/*
 		 * This could only happen when there is a parameter on the distribution key.
@@ -2344,11 +2504,16 @@ PlanRouterQuery(Query *originalQuery,
 	}
 	bool hasPostgresLocalRelation =
 		rteProperties->hasPostgresLocalTable || rteProperties->hasMaterializedView;
-	List *taskPlacementList =
-		CreateTaskPlacementListForShardIntervals(*prunedShardIntervalListList,
-												 shardsPresent,
-												 replacePrunedQueryWithDummy,
-												 hasPostgresLocalRelation);
+	List *taskPlacementList = cachedPlacementList;
+	if (taskPlacementList == NIL || hasPostgresLocalRelation)
+	{
+		taskPlacementList =
+			CreateTaskPlacementListForShardIntervals(*prunedShardIntervalListList,
+													 shardsPresent,
+													 replacePrunedQueryWithDummy,
+													 hasPostgresLocalRelation);
+	}
+
 	if (taskPlacementList == NIL)
 	{
 		planningError = DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
@@ -2605,12 +2770,19 @@ GetAnchorShardId(List *prunedShardIntervalListList)
  *
  * If the caller requested the distributionKey value that this function
  * yields, set outputPartitionValueConst.
+ *
+ * When the shard was found through the router placement cache, placementList
+ * is set to the active placements of the shard, such that the caller does not
+ * need to look them up. Otherwise, it is set to NIL.
  */
 List *
 TargetShardIntervalForFastPathQuery(Query *query, bool *isMultiShardQuery,
 									Const *inputDistributionKeyValue,
-									Const **outputPartitionValueConst)
+									Const **outputPartitionValueConst,
+									List **placementList)
 {
+	*placementList = NIL;
+
 	Oid relationId = ExtractFirstCitusTableId(query);
 
 	if (IsCitusTableType(relationId, CITUS_TABLE_WITH_NO_DIST_KEY))
@@ -2636,9 +2808,25 @@ TargetShardIntervalForFastPathQuery(Query *query, bool *isMultiShardQuery,
 												   inputDistributionKeyValue, missingOk);
 		}
 
-		ShardInterval *cachedShardInterval =
-			FindShardInterval(inputDistributionKeyValue->constvalue, cache);
-		if (cachedShardInterval == NULL)
+		ShardInterval *shardInterval = NULL;
+		if (EnableRouterPlacementCache &&
+			IsCitusTableTypeCacheEntry(cache, HASH_DISTRIBUTED))
+		{
+			shardInterval =
+				RouterPlacementCacheLookup(cache, inputDistributionKeyValue->constvalue,
+										   placementList);
+		}
+		else
+		{
+			ShardInterval *cachedShardInterval =
+				FindShardInterval(inputDistributionKeyValue->constvalue, cache);
+			if (cachedShardInterval != NULL)
+			{
+				shardInterval = CopyShardInterval(cachedShardInterval);
+			}
+		}
+
+		if (shardInterval == NULL)
 		{
 			ereport(ERROR, (errmsg(
 								"could not find shardinterval to which to send the query")));
@@ -2649,12 +2837,36 @@ TargetShardIntervalForFastPathQuery(Query *query, bool *isMultiShardQuery,
 			/* set the outgoing partition column value if requested */
 			*outputPartitionValueConst = inputDistributionKeyValue;
 		}
-		ShardInterval *shardInterval = CopyShardInterval(cachedShardInterval);
 		List *shardIntervalList = list_make1(shardInterval);
 
 		return list_make1(shardIntervalList);
 	}
 
+	ScalarArrayOpExpr *arrayOpExpr = FindDistributionKeyArrayFilter(query);
+	if (arrayOpExpr != NULL && !IsA(lsecond(arrayOpExpr->args), Param))
+	{
+		/* prune based on the values of the IN-list or = ANY(array) filter */
+		List *valueGroupList = DistributionKeyValueGroups(query);
+		List *prunedShardIntervalList = NIL;
+		DistributionKeyValueGroup *valueGroup = NULL;
+
+		foreach_ptr(valueGroup, valueGroupList)
+		{
+			prunedShardIntervalList = lappend(prunedShardIntervalList,
+											  valueGroup->shardInterval);
+		}
+
+		if (prunedShardIntervalList == NIL)
+		{
+			/* none of the values is non-null, so the query cannot return rows */
+			return NIL;
+		}
+
+		*isMultiShardQuery = list_length(prunedShardIntervalList) > 1;
+
+		return list_make1(prunedShardIntervalList);
+	}
+
 	Node *quals = query->jointree->quals;
 	int relationIndex = 1;
 
@@ -2681,11 +2893,28 @@ TargetShardIntervalForFastPathQuery(Query *query, bool *isMultiShardQuery,
 	{
 		*isMultiShardQuery = true;
 	}
-	else if (list_length(prunedShardIntervalList) == 1 &&
-			 outputPartitionValueConst != NULL)
+	else if (list_length(prunedShardIntervalList) == 1)
 	{
-		/* set the outgoing partition column value if requested */
-		*outputPartitionValueConst = distributionKeyValueInQuals;
+		if (outputPartitionValueConst != NULL)
+		{
+			/* set the outgoing partition column value if requested */
+			*outputPartitionValueConst = distributionKeyValueInQuals;
+		}
+
+		/* parameters are pruned here during execution, so get cached placements */
+		CitusTableCacheEntry *cache = GetCitusTableCacheEntry(relationId);
+		if (EnableRouterPlacementCache &&
+			IsCitusTableTypeCacheEntry(cache, HASH_DISTRIBUTED) &&
+			distributionKeyValueInQuals->consttype == cache->partitionColumn->vartype)
+		{
+			ShardInterval *shardInterval =
+				RouterPlacementCacheLookup(cache, distributionKeyValueInQuals->constvalue,
+										   placementList);
+			if (shardInterval != NULL)
+			{
+				prunedShardIntervalList = list_make1(shardInterval);
+			}
+		}
 	}
 
 	return list_make1(prunedShardIntervalList);
@@ -2948,6 +3177,16 @@ BuildRoutesForInsert(Query *query, DeferredErrorMessage **planningError)
 
 	Var *partitionColumn = cacheEntry->partitionColumn;
 
+	if (IsCitusTableTypeCacheEntry(cacheEntry, HASH_DISTRIBUTED))
+	{
+		/* take the bulk route for multi-row INSERTs with plain values */
+		modifyRouteList = GroupConstInsertValuesByShardIndex(query, cacheEntry);
+		if (modifyRouteList != NIL)
+		{
+			return modifyRouteList;
+		}
+	}
+
 	/* get full list of insert values and iterate over them to prune */
 	List *insertValuesList = ExtractInsertValuesList(query, partitionColumn);
 
@@ -3369,6 +3608,93 @@ GroupInsertValuesByShardId(List *insertValuesList)
 }
 
 
+/*
+ * GroupConstInsertValuesByShardIndex groups the rows of a multi-row INSERT
+ * into a hash distributed table by target shard in a single pass, when the
+ * partition column value of every row is a non-NULL constant of the column's
+ * type, as is the case for large VALUES lists sent by applications. It puts
+ * the rows in an array indexed by shard index rather than building, pruning
+ * and sorting an InsertValues per row, and returns the same routes as
+ * GroupInsertValuesByShardId. When any row needs the general route, it
+ * returns NIL.
+ */
+static List *
+GroupConstInsertValuesByShardIndex(Query *query, CitusTableCacheEntry *cacheEntry)
+{
+	Var *partitionColumn = cacheEntry->partitionColumn;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+
+	RangeTblEntry *valuesRTE = ExtractDistributedInsertValuesRTE(query);
+	if (valuesRTE == NULL || shardCount == 0)
+	{
+		return NIL;
+	}
+
+	TargetEntry *targetEntry = get_tle_by_resno(query->targetList,
+												partitionColumn->varattno);
+	if (targetEntry == NULL || !IsA(targetEntry->expr, Var))
+	{
+		return NIL;
+	}
+
+	Var *partitionVar = (Var *) targetEntry->expr;
+	List **rowValuesListsByShardIndex = palloc0(shardCount * sizeof(List *));
+
+	List *rowValues = NIL;
+	foreach_ptr(rowValues, valuesRTE->values_lists)
+	{
+		Node *partitionValueExpr = list_nth(rowValues, partitionVar->varattno - 1);
+		if (!IsA(partitionValueExpr, Const))
+		{
+			return NIL;
+		}
+
+		Const *partitionValueConst = (Const *) partitionValueExpr;
+		if (partitionValueConst->constisnull ||
+			partitionValueConst->consttype != partitionColumn->vartype)
+		{
+			return NIL;
+		}
+
+		Datum hashedValue = FunctionCall1Coll(cacheEntry->hashFunction,
+											  partitionColumn->varcollid,
+											  partitionValueConst->constvalue);
+
+		int shardIndex = FindShardIntervalIndex(hashedValue, cacheEntry);
+		if (shardIndex == INVALID_SHARD_INDEX)
+		{
+			return NIL;
+		}
+
+		rowValuesListsByShardIndex[shardIndex] =
+			lappend(rowValuesListsByShardIndex[shardIndex], rowValues);
+	}
+
+	List *modifyRouteList = NIL;
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		if (rowValuesListsByShardIndex[shardIndex] == NIL)
+		{
+			continue;
+		}
+
+		ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+		ModifyRoute *route = (ModifyRoute *) palloc(sizeof(ModifyRoute));
+
+		route->shardId = shardInterval->shardId;
+		route->rowValuesLists = rowValuesListsByShardIndex[shardIndex];
+
+		modifyRouteList = lappend(modifyRouteList, route);
+	}
+
+	pfree(rowValuesListsByShardIndex);
+
+	/* like GroupInsertValuesByShardId, go in shard order to avoid deadlocks */
+	return SortList(modifyRouteList, CompareModifyRoutesByShardId);
+}
+
+
 /*
  * ExtractInsertValuesList extracts the partition column value for an INSERT
  * command and returns it within an InsertValues struct. For single-row INSERTs
@@ -3908,3 +4234,28 @@ CompareInsertValuesByShardId(const void *leftElement, const void *rightElement)
 		}
 	}
 }
+
+
+/*
+ * CompareModifyRoutesByShardId is a comparison function for sorting
+ * ModifyRoute objects by their shard.
+ */
+static int
+CompareModifyRoutesByShardId(const void *leftElement, const void *rightElement)
+{
+	ModifyRoute *leftRoute = *((ModifyRoute **) leftElement);
+	ModifyRoute *rightRoute = *((ModifyRoute **) rightElement);
+
+	if (leftRoute->shardId > rightRoute->shardId)
+	{
+		return 1;
+	}
+	else if (leftRoute->shardId < rightRoute->shardId)
+	{
+		return -1;
+	}
+	else
+	{
+		return 0;
+	}
+}
@@ -0,0 +1,189 @@
+/*-------------------------------------------------------------------------
+ *
+ * planner_timing.c
+ *	  Timing of the phases of distributed planning.
+ *
+ * While a top-level query goes through distributed_planner, we measure how
+ * long we spend in recursive planning, pushdown checks, shard pruning and
+ * deparsing. The timings are only collected when someone is going to look
+ * at them, that is when citus_stat_statements tracks all queries or when
+ * EXPLAIN (SUMMARY) is used with citus.explain_planner_phases enabled.
+ *
+ * A phase can be entered again while it is already running, for instance
+ * when recursive planning plans a subquery that has subqueries itself. We
+ * only measure the outermost entry, such that the time is not counted twice.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/planner_timing.h"
+#include "portability/instr_time.h"
+
+
+/* GUC, whether to show the planner phase timings in EXPLAIN (SUMMARY) */
+bool ExplainPlannerPhases = false;
+
+/* whether we are timing the current top-level distributed planning */
+static bool PlannerPhaseTimingActive = false;
+
+/* whether CitusExplainOneQuery wants the timings of the query it plans */
+static bool ExplainPlannerPhaseTimingsRequested = false;
+
+/* timings of the last query planned by CitusExplainOneQuery */
+static bool ExplainPlannerPhaseTimingsValid = false;
+static PlannerPhaseTimings LastExplainPlannerPhaseTimings;
+
+/* state of the current top-level distributed planning */
+static instr_time PlanningStartTime;
+static int PlannerPhaseNestingLevel[PLANNER_PHASE_COUNT];
+static instr_time PlannerPhaseStartTime[PLANNER_PHASE_COUNT];
+static PlannerPhaseTimings CurrentPlannerPhaseTimings;
+
+
+/*
+ * BeginPlannerPhaseTimings starts timing a top-level distributed planning if
+ * the caller wants to track the timings, or if we are planning a query for
+ * EXPLAIN that should show them.
+ */
+void
+BeginPlannerPhaseTimings(bool trackingRequested)
+{
+	PlannerPhaseTimingActive = trackingRequested || ExplainPlannerPhaseTimingsRequested;
+	if (!PlannerPhaseTimingActive)
+	{
+		return;
+	}
+
+	memset(&CurrentPlannerPhaseTimings, 0, sizeof(CurrentPlannerPhaseTimings));
+	memset(PlannerPhaseNestingLevel, 0, sizeof(PlannerPhaseNestingLevel));
+
+	INSTR_TIME_SET_CURRENT(PlanningStartTime);
+}
+
+
+/*
+ * EndPlannerPhaseTimings finishes timing a top-level distributed planning
+ * and writes the timings to the given struct. It returns false if the
+ * planning was not timed.
+ */
+bool
+EndPlannerPhaseTimings(PlannerPhaseTimings *timings)
+{
+	if (!PlannerPhaseTimingActive)
+	{
+		return false;
+	}
+
+	instr_time planningDuration;
+	INSTR_TIME_SET_CURRENT(planningDuration);
+	INSTR_TIME_SUBTRACT(planningDuration, PlanningStartTime);
+
+	CurrentPlannerPhaseTimings.totalMillisecs =
+		INSTR_TIME_GET_MILLISEC(planningDuration);
+
+	*timings = CurrentPlannerPhaseTimings;
+
+	if (ExplainPlannerPhaseTimingsRequested)
+	{
+		LastExplainPlannerPhaseTimings = CurrentPlannerPhaseTimings;
+		ExplainPlannerPhaseTimingsValid = true;
+	}
+
+	PlannerPhaseTimingActive = false;
+
+	return true;
+}
+
+
+/*
+ * AbortPlannerPhaseTimings stops timing a top-level distributed planning
+ * that failed.
+ */
+void
+AbortPlannerPhaseTimings(void)
+{
+	PlannerPhaseTimingActive = false;
+}
+
+
+/*
+ * BeginPlannerPhase marks the start of a planner phase.
+ */
+void
+BeginPlannerPhase(PlannerPhase phase)
+{
+	if (!PlannerPhaseTimingActive)
+	{
+		return;
+	}
+
+	if (PlannerPhaseNestingLevel[phase]++ == 0)
+	{
+		INSTR_TIME_SET_CURRENT(PlannerPhaseStartTime[phase]);
+	}
+}
+
+
+/*
+ * EndPlannerPhase marks the end of a planner phase started by
+ * BeginPlannerPhase, and adds the time spent to the timings of the phase.
+ */
+void
+EndPlannerPhase(PlannerPhase phase)
+{
+	/* the timing might have started after the phase, in a nested planner call */
+	if (!PlannerPhaseTimingActive || PlannerPhaseNestingLevel[phase] == 0)
+	{
+		return;
+	}
+
+	if (--PlannerPhaseNestingLevel[phase] == 0)
+	{
+		instr_time phaseDuration;
+		INSTR_TIME_SET_CURRENT(phaseDuration);
+		INSTR_TIME_SUBTRACT(phaseDuration, PlannerPhaseStartTime[phase]);
+
+		CurrentPlannerPhaseTimings.phaseMillisecs[phase] +=
+			INSTR_TIME_GET_MILLISEC(phaseDuration);
+	}
+}
+
+
+/*
+ * SetExplainPlannerPhaseTimingsRequested is called by CitusExplainOneQuery
+ * around planning the query, to let us know whether it will show the
+ * planner phase timings.
+ */
+void
+SetExplainPlannerPhaseTimingsRequested(bool requested)
+{
+	if (requested)
+	{
+		ExplainPlannerPhaseTimingsValid = false;
+	}
+
+	ExplainPlannerPhaseTimingsRequested = requested;
+}
+
+
+/*
+ * ExplainPlannerPhaseTimings returns the planner phase timings of the query
+ * that is being explained, or NULL if there are none. The timings are only
+ * returned once, such that they are only shown for the top-level plan.
+ */
+PlannerPhaseTimings *
+ExplainPlannerPhaseTimings(void)
+{
+	if (!ExplainPlannerPhaseTimingsValid)
+	{
+		return NULL;
+	}
+
+	ExplainPlannerPhaseTimingsValid = false;
+
+	return &LastExplainPlannerPhaseTimings;
+}
@@ -32,6 +32,7 @@
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/pg_dist_partition.h"
+#include "distributed/planner_timing.h"
 #include "distributed/query_utils.h"
 #include "distributed/query_pushdown_planning.h"
 #include "distributed/recursive_planning.h"
@@ -532,9 +533,11 @@ SubqueryMultiNodeTree(Query *originalQuery, Query *queryTree,
 		RaiseDeferredError(unsupportedQueryError, ERROR);
 	}
 
+	BeginPlannerPhase(PLANNER_PHASE_PUSHDOWN_CHECKS);
 	DeferredErrorMessage *subqueryPushdownError = DeferErrorIfUnsupportedSubqueryPushdown(
 		originalQuery,
 		plannerRestrictionContext);
+	EndPlannerPhase(PLANNER_PHASE_PUSHDOWN_CHECKS);
 	if (subqueryPushdownError != NULL)
 	{
 		RaiseDeferredError(subqueryPushdownError, ERROR);
@@ -81,6 +81,7 @@
 #include "optimizer/planner.h"
 #include "optimizer/prep.h"
 #include "parser/parsetree.h"
+#include "rewrite/rewriteManip.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "nodes/nodes.h"
@@ -103,12 +104,33 @@ struct RecursivePlanningContextInternal
 	uint64 planId;
 	bool allDistributionKeysInQueryAreEqual; /* used for some optimizations */
 	List *subPlanList;
+
+	/* list of DeduplicatableSubPlan, for subplans that can be reused */
+	List *deduplicatableSubPlanList;
+
 	PlannerRestrictionContext *plannerRestrictionContext;
 };
 
+/*
+ * DeduplicatableSubPlan records the deparsed query of a subplan, such that
+ * structurally identical subqueries and CTEs can read the same intermediate
+ * result.
+ */
+typedef struct DeduplicatableSubPlan
+{
+	char *queryString;
+	uint32 subPlanId;
+} DeduplicatableSubPlan;
+
 /* track depth of current recursive planner query */
 static int recursivePlanningDepth = 0;
 
+/* GUC, whether identical subqueries and CTEs share a subplan */
+bool EnableSubPlanDeduplication = false;
+
+/* GUC, whether filters on recursively planned CTEs are pushed into the CTEs */
+bool EnableCTEPredicatePushdown = false;
+
 /*
  * CteReferenceWalkerContext is used to collect CTE references in
  * CteReferenceListWalker.
@@ -119,6 +141,17 @@ typedef struct CteReferenceWalkerContext
 	List *cteReferenceList;
 } CteReferenceWalkerContext;
 
+/*
+ * RestrictionWalkerContext is used to check in RestrictionOnlyReferencesCteWalker
+ * whether a restriction only references the given CTE, and to collect the
+ * attribute numbers of the referenced CTE columns.
+ */
+typedef struct RestrictionWalkerContext
+{
+	int cteRangeTableIndex;
+	List *attributeNumberList;
+} RestrictionWalkerContext;
+
 /*
  * VarLevelsUpWalkerContext is used to find Vars in a (sub)query that
  * refer to upper levels and therefore cannot be planned separately.
@@ -169,9 +202,23 @@ static bool RecursivelyPlanSubquery(Query *subquery,
 static void RecursivelyPlanSetOperations(Query *query, Node *node,
 										 RecursivePlanningContext *context);
 static bool IsLocalTableRteOrMatView(Node *node);
+static bool CanDeduplicateSubPlan(Query *subquery);
+static char * SubPlanQueryString(Query *subquery);
+static uint32 FindIdenticalSubPlan(RecursivePlanningContext *planningContext,
+								   char *queryString);
+static void RecordDeduplicatableSubPlan(RecursivePlanningContext *planningContext,
+										char *queryString, uint32 subPlanId);
 static DistributedSubPlan * CreateDistributedSubPlan(uint32 subPlanId,
 													 Query *subPlanQuery);
 static bool CteReferenceListWalker(Node *node, CteReferenceWalkerContext *context);
+static void PushDownRestrictionsIntoCte(Query *query, CommonTableExpr *cte);
+static bool CteQueryAllowsRestrictionPushdown(Query *cteQuery);
+static int CteRangeTableIndex(Query *query, CommonTableExpr *cte);
+static bool RangeTableIndexInInnerJoin(Node *joinTreeNode, int rangeTableIndex);
+static bool RestrictionCanBePushedIntoCte(Node *restriction, int cteRangeTableIndex,
+										  Query *cteQuery);
+static bool RestrictionOnlyReferencesCteWalker(Node *node,
+											   RestrictionWalkerContext *context);
 static bool ContainsReferencesToOuterQueryWalker(Node *node,
 												 VarLevelsUpWalkerContext *context);
 static bool NodeContainsSubqueryReferencingOuterQuery(Node *node);
@@ -210,6 +257,7 @@ GenerateSubplansForSubqueriesAndCTEs(uint64 planId, Query *originalQuery,
 	context.level = 0;
 	context.planId = planId;
 	context.subPlanList = NIL;
+	context.deduplicatableSubPlanList = NIL;
 	context.plannerRestrictionContext = plannerRestrictionContext;
 
 	/*
@@ -754,21 +802,49 @@ RecursivelyPlanCTEs(Query *query, RecursivePlanningContext *planningContext)
 			continue;
 		}
 
-		uint32 subPlanId = list_length(planningContext->subPlanList) + 1;
+		if (EnableCTEPredicatePushdown)
+		{
+			PushDownRestrictionsIntoCte(query, cte);
+		}
 
-		if (IsLoggableLevel(DEBUG1))
+		bool deduplicateSubPlan = CanDeduplicateSubPlan(subquery);
+		char *subPlanString = NULL;
+
+		if (IsLoggableLevel(DEBUG1) || deduplicateSubPlan)
 		{
-			StringInfo subPlanString = makeStringInfo();
-			pg_get_query_def(subquery, subPlanString);
-			ereport(DEBUG1, (errmsg("generating subplan " UINT64_FORMAT
+			subPlanString = SubPlanQueryString(subquery);
+		}
+
+		uint32 subPlanId = 0;
+		if (deduplicateSubPlan)
+		{
+			subPlanId = FindIdenticalSubPlan(planningContext, subPlanString);
+		}
+
+		if (subPlanId != 0)
+		{
+			ereport(DEBUG1, (errmsg("reusing subplan " UINT64_FORMAT
 									"_%u for CTE %s: %s", planId, subPlanId,
-									cteName,
-									subPlanString->data)));
+									cteName, subPlanString)));
 		}
+		else
+		{
+			subPlanId = list_length(planningContext->subPlanList) + 1;
+
+			ereport(DEBUG1, (errmsg("generating subplan " UINT64_FORMAT
+									"_%u for CTE %s: %s", planId, subPlanId,
+									cteName, subPlanString)));
 
-		/* build a sub plan for the CTE */
-		DistributedSubPlan *subPlan = CreateDistributedSubPlan(subPlanId, subquery);
-		planningContext->subPlanList = lappend(planningContext->subPlanList, subPlan);
+			/* build a sub plan for the CTE */
+			DistributedSubPlan *subPlan = CreateDistributedSubPlan(subPlanId, subquery);
+			planningContext->subPlanList = lappend(planningContext->subPlanList,
+												   subPlan);
+
+			if (deduplicateSubPlan)
+			{
+				RecordDeduplicatableSubPlan(planningContext, subPlanString, subPlanId);
+			}
+		}
 
 		/* build the result_id parameter for the call to read_intermediate_result */
 		char *resultId = GenerateResultId(planId, subPlanId);
@@ -842,6 +918,229 @@ RecursivelyPlanCTEs(Query *query, RecursivePlanningContext *planningContext)
 }
 
 
+/*
+ * PushDownRestrictionsIntoCte adds the restrictions in the WHERE clause of the
+ * given query that only reference the output columns of the given CTE to the
+ * WHERE clause of the CTE, before the CTE is recursively planned, such that
+ * the intermediate result of the CTE only contains the rows that the query
+ * can use.
+ *
+ * This is only done when the query is the only reference to the CTE, the CTE
+ * is not explicitly MATERIALIZED, and the CTE takes part in an inner join of
+ * the query, such that filtering the CTE does not change the result of the
+ * query. The restrictions also stay in the query.
+ */
+static void
+PushDownRestrictionsIntoCte(Query *query, CommonTableExpr *cte)
+{
+	Query *cteQuery = (Query *) cte->ctequery;
+
+	if (cte->cterefcount != 1 || cte->ctematerialized == CTEMaterializeAlways ||
+		query->jointree == NULL || query->jointree->quals == NULL ||
+		!CteQueryAllowsRestrictionPushdown(cteQuery))
+	{
+		return;
+	}
+
+	int cteRangeTableIndex = CteRangeTableIndex(query, cte);
+	if (cteRangeTableIndex == 0 ||
+		!RangeTableIndexInInnerJoin((Node *) query->jointree, cteRangeTableIndex))
+	{
+		/* the CTE is referenced in a subquery, or on the nullable side of a join */
+		return;
+	}
+
+	RangeTblEntry *cteRangeTableEntry = rt_fetch(cteRangeTableIndex, query->rtable);
+	List *restrictionList = make_ands_implicit((Expr *) query->jointree->quals);
+
+	Node *restriction = NULL;
+	foreach_ptr(restriction, restrictionList)
+	{
+		if (!RestrictionCanBePushedIntoCte(restriction, cteRangeTableIndex, cteQuery))
+		{
+			continue;
+		}
+
+		/* replace the references to the CTE columns with their expressions */
+		Node *cteRestriction =
+			ReplaceVarsFromTargetList(copyObject(restriction), cteRangeTableIndex, 0,
+									  cteRangeTableEntry, cteQuery->targetList,
+									  REPLACEVARS_REPORT_ERROR, 0,
+									  &cteQuery->hasSubLinks);
+
+		cteQuery->jointree->quals = make_and_qual(cteQuery->jointree->quals,
+												  cteRestriction);
+
+		ereport(DEBUG2, (errmsg("pushing down a restriction into CTE %s",
+								cte->ctename)));
+	}
+}
+
+
+/*
+ * CteQueryAllowsRestrictionPushdown returns whether adding restrictions to the
+ * WHERE clause of the given CTE query filters its output rows without changing
+ * the remaining rows. That is not the case for queries that compute their rows
+ * from groups or windows of rows, or that limit the number of rows.
+ */
+static bool
+CteQueryAllowsRestrictionPushdown(Query *cteQuery)
+{
+	return cteQuery->commandType == CMD_SELECT && cteQuery->jointree != NULL &&
+		   cteQuery->setOperations == NULL && cteQuery->limitCount == NULL &&
+		   cteQuery->limitOffset == NULL && cteQuery->groupClause == NIL &&
+		   cteQuery->groupingSets == NIL && cteQuery->havingQual == NULL &&
+		   cteQuery->distinctClause == NIL && !cteQuery->hasAggs &&
+		   !cteQuery->hasWindowFuncs && !cteQuery->hasTargetSRFs &&
+		   !cteQuery->hasModifyingCTE && cteQuery->rowMarks == NIL;
+}
+
+
+/*
+ * CteRangeTableIndex returns the range table index of the reference to the
+ * given CTE in the range table of the given query, or 0 if the query itself
+ * does not reference the CTE.
+ */
+static int
+CteRangeTableIndex(Query *query, CommonTableExpr *cte)
+{
+	int rangeTableIndex = 0;
+
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_ptr(rangeTableEntry, query->rtable)
+	{
+		rangeTableIndex++;
+
+		if (rangeTableEntry->rtekind == RTE_CTE && rangeTableEntry->ctelevelsup == 0 &&
+			strncmp(rangeTableEntry->ctename, cte->ctename, NAMEDATALEN) == 0)
+		{
+			return rangeTableIndex;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * RangeTableIndexInInnerJoin returns whether the range table entry with the
+ * given index appears in the given join tree through inner joins only.
+ */
+static bool
+RangeTableIndexInInnerJoin(Node *joinTreeNode, int rangeTableIndex)
+{
+	if (joinTreeNode == NULL)
+	{
+		return false;
+	}
+	else if (IsA(joinTreeNode, RangeTblRef))
+	{
+		return ((RangeTblRef *) joinTreeNode)->rtindex == rangeTableIndex;
+	}
+	else if (IsA(joinTreeNode, FromExpr))
+	{
+		FromExpr *fromExpr = (FromExpr *) joinTreeNode;
+
+		Node *fromItem = NULL;
+		foreach_ptr(fromItem, fromExpr->fromlist)
+		{
+			if (RangeTableIndexInInnerJoin(fromItem, rangeTableIndex))
+			{
+				return true;
+			}
+		}
+	}
+	else if (IsA(joinTreeNode, JoinExpr))
+	{
+		JoinExpr *joinExpr = (JoinExpr *) joinTreeNode;
+
+		if (joinExpr->jointype == JOIN_INNER)
+		{
+			return RangeTableIndexInInnerJoin(joinExpr->larg, rangeTableIndex) ||
+				   RangeTableIndexInInnerJoin(joinExpr->rarg, rangeTableIndex);
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * RestrictionCanBePushedIntoCte returns whether the given restriction of the
+ * query only references output columns of the CTE at the given range table
+ * index, is deterministic, and the columns that it references are plain
+ * deterministic expressions in the CTE query.
+ */
+static bool
+RestrictionCanBePushedIntoCte(Node *restriction, int cteRangeTableIndex,
+							  Query *cteQuery)
+{
+	RestrictionWalkerContext context = { cteRangeTableIndex, NIL };
+
+	if (contain_volatile_functions(restriction) ||
+		RestrictionOnlyReferencesCteWalker(restriction, &context) ||
+		context.attributeNumberList == NIL)
+	{
+		return false;
+	}
+
+	int attributeNumber = 0;
+	foreach_int(attributeNumber, context.attributeNumberList)
+	{
+		TargetEntry *targetEntry = get_tle_by_resno(cteQuery->targetList,
+													attributeNumber);
+		if (targetEntry == NULL || targetEntry->resjunk ||
+			contain_volatile_functions((Node *) targetEntry->expr) ||
+			checkExprHasSubLink((Node *) targetEntry->expr))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * RestrictionOnlyReferencesCteWalker returns true if the given node contains
+ * anything other than references to user columns of the CTE at the range
+ * table index in the context, and plain expressions on them. It collects the
+ * attribute numbers of the referenced columns in the context.
+ */
+static bool
+RestrictionOnlyReferencesCteWalker(Node *node, RestrictionWalkerContext *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Var))
+	{
+		Var *column = (Var *) node;
+
+		if (column->varlevelsup != 0 || column->varno != context->cteRangeTableIndex ||
+			column->varattno <= 0)
+		{
+			return true;
+		}
+
+		context->attributeNumberList = list_append_unique_int(
+			context->attributeNumberList, column->varattno);
+
+		return false;
+	}
+	else if (IsA(node, SubLink) || IsA(node, Param) || IsA(node, Aggref) ||
+			 IsA(node, WindowFunc) || IsA(node, GroupingFunc) ||
+			 IsA(node, PlaceHolderVar))
+	{
+		return true;
+	}
+
+	return expression_tree_walker(node, RestrictionOnlyReferencesCteWalker, context);
+}
+
+
 /*
  * RecursivelyPlanSubqueryWalker recursively finds all the Query nodes and
  * recursively plans if necessary.
@@ -1155,15 +1454,47 @@ RecursivelyPlanSubquery(Query *subquery, RecursivePlanningContext *planningConte
 		debugQuery = copyObject(subquery);
 	}
 
+	/*
+	 * If we already planned a structurally identical subquery, we read its
+	 * intermediate result instead of creating a new one.
+	 */
+	bool deduplicateSubPlan = CanDeduplicateSubPlan(subquery);
+	char *subqueryString = NULL;
+	uint32 subPlanId = 0;
+
+	if (deduplicateSubPlan)
+	{
+		subqueryString = SubPlanQueryString(subquery);
+		subPlanId = FindIdenticalSubPlan(planningContext, subqueryString);
+	}
+
+	if (subPlanId != 0)
+	{
+		ereport(DEBUG1, (errmsg("reusing subplan " UINT64_FORMAT
+								"_%u for subquery %s", planId, subPlanId,
+								subqueryString)));
+
+		char *resultId = GenerateResultId(planId, subPlanId);
+		Query *resultQuery = BuildSubPlanResultQuery(subquery->targetList, NIL,
+													 resultId);
+
+		*subquery = *resultQuery;
+		return true;
+	}
 
 	/*
 	 * Create the subplan and append it to the list in the planning context.
 	 */
-	int subPlanId = list_length(planningContext->subPlanList) + 1;
+	subPlanId = list_length(planningContext->subPlanList) + 1;
 
 	DistributedSubPlan *subPlan = CreateDistributedSubPlan(subPlanId, subquery);
 	planningContext->subPlanList = lappend(planningContext->subPlanList, subPlan);
 
+	if (deduplicateSubPlan)
+	{
+		RecordDeduplicatableSubPlan(planningContext, subqueryString, subPlanId);
+	}
+
 	/* build the result_id parameter for the call to read_intermediate_result */
 	char *resultId = GenerateResultId(planId, subPlanId);
 
@@ -1190,6 +1521,83 @@ RecursivelyPlanSubquery(Query *subquery, RecursivePlanningContext *planningConte
 }
 
 
+/*
+ * CanDeduplicateSubPlan returns whether the intermediate result of the given
+ * subquery or CTE can be shared with structurally identical ones. This is
+ * only the case for SELECTs without volatile functions, since every
+ * occurrence of other queries needs to be executed.
+ */
+static bool
+CanDeduplicateSubPlan(Query *subquery)
+{
+	if (!EnableSubPlanDeduplication)
+	{
+		return false;
+	}
+
+	if (subquery->commandType != CMD_SELECT || subquery->hasModifyingCTE ||
+		subquery->rowMarks != NIL)
+	{
+		return false;
+	}
+
+	return !contain_volatile_functions((Node *) subquery);
+}
+
+
+/*
+ * SubPlanQueryString deparses a copy of the given subquery. Deparsed queries
+ * do not contain locations, hence the strings of structurally identical
+ * subqueries are the same.
+ */
+static char *
+SubPlanQueryString(Query *subquery)
+{
+	StringInfo subqueryString = makeStringInfo();
+
+	pg_get_query_def(copyObject(subquery), subqueryString);
+
+	return subqueryString->data;
+}
+
+
+/*
+ * FindIdenticalSubPlan returns the id of a subplan of the current planning
+ * context with the given deparsed query, or 0 if there is none.
+ */
+static uint32
+FindIdenticalSubPlan(RecursivePlanningContext *planningContext, char *queryString)
+{
+	DeduplicatableSubPlan *subPlan = NULL;
+	foreach_ptr(subPlan, planningContext->deduplicatableSubPlanList)
+	{
+		if (strcmp(subPlan->queryString, queryString) == 0)
+		{
+			return subPlan->subPlanId;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * RecordDeduplicatableSubPlan remembers the deparsed query of a subplan, such
+ * that later identical subqueries and CTEs can reuse it.
+ */
+static void
+RecordDeduplicatableSubPlan(RecursivePlanningContext *planningContext,
+							char *queryString, uint32 subPlanId)
+{
+	DeduplicatableSubPlan *subPlan = palloc0(sizeof(DeduplicatableSubPlan));
+	subPlan->queryString = queryString;
+	subPlan->subPlanId = subPlanId;
+
+	planningContext->deduplicatableSubPlanList =
+		lappend(planningContext->deduplicatableSubPlanList, subPlan);
+}
+
+
 /*
  * CreateDistributedSubPlan creates a distributed subplan by recursively calling
  * the planner from the top, which may either generate a local plan or another
@@ -0,0 +1,169 @@
+/*-------------------------------------------------------------------------
+ *
+ * router_placement_cache.c
+ *
+ * This file contains a small per-backend cache of the shard and the active
+ * placements that a distribution column value of a hash distributed table
+ * routes to. Fast path router queries normally find the shard interval for
+ * the value and then build the list of active placements of the shard from
+ * the metadata cache, which involves several hash table lookups, the worker
+ * node of each placement and a number of allocations. OLTP workloads keep
+ * routing the same values, so when citus.enable_router_placement_cache is
+ * on we remember the outcome in a direct-mapped cache, indexed by the table
+ * and the hash of the value.
+ *
+ * Entries are only valid for the generation of the metadata cache in which
+ * they were built, see MetadataCacheGeneration(). Any invalidation of a
+ * Citus table, pg_dist_node or the local group therefore discards the whole
+ * cache.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+#include "postgres.h"
+
+#include "common/hashfn.h"
+#include "utils/memutils.h"
+
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_utility.h"
+#include "distributed/router_placement_cache.h"
+#include "distributed/shardinterval_utils.h"
+
+
+/* number of entries in the cache, needs to be a power of 2 */
+#define ROUTER_PLACEMENT_CACHE_SIZE 256
+
+
+/*
+ * RouterPlacementCacheEntry is the shard index and the active placements of
+ * the shard that a hash value of the distribution column of a table routes
+ * to. An entry whose generation differs from the metadata cache is unused.
+ */
+typedef struct RouterPlacementCacheEntry
+{
+	uint64 generation;
+	Oid relationId;
+	uint32 hashValue;
+	int shardIndex;
+	List *placementList;
+} RouterPlacementCacheEntry;
+
+
+/* GUC, whether fast path router queries use the router placement cache */
+bool EnableRouterPlacementCache = false;
+
+static RouterPlacementCacheEntry RouterPlacementCache[ROUTER_PLACEMENT_CACHE_SIZE];
+
+/* generation of the metadata cache at which the cache was last emptied */
+static uint64 RouterPlacementCacheGeneration = 0;
+
+/* memory context in which the placements of the entries are allocated */
+static MemoryContext RouterPlacementCacheContext = NULL;
+
+static void ResetRouterPlacementCache(uint64 generation);
+static void FreeRouterPlacementCacheEntry(RouterPlacementCacheEntry *entry);
+
+
+/*
+ * RouterPlacementCacheLookup returns a copy of the shard interval that the
+ * given distribution column value of the given hash distributed table
+ * routes to, and sets placementList to a copy of the active placements of
+ * the shard, from the cache if possible. Returns NULL if the table has no
+ * shard for the value.
+ */
+ShardInterval *
+RouterPlacementCacheLookup(CitusTableCacheEntry *cacheEntry, Datum distributionValue,
+						   List **placementList)
+{
+	Assert(IsCitusTableTypeCacheEntry(cacheEntry, HASH_DISTRIBUTED));
+
+	uint64 generation = MetadataCacheGeneration();
+	if (generation != RouterPlacementCacheGeneration)
+	{
+		ResetRouterPlacementCache(generation);
+	}
+
+	Datum hashedValue = FunctionCall1Coll(cacheEntry->hashFunction,
+										  cacheEntry->partitionColumn->varcollid,
+										  distributionValue);
+	uint32 hashValue = (uint32) DatumGetInt32(hashedValue);
+	Oid relationId = cacheEntry->relationId;
+
+	uint32 slotIndex = hash_combine(hash_uint32(relationId), hashValue) &
+					   (ROUTER_PLACEMENT_CACHE_SIZE - 1);
+	RouterPlacementCacheEntry *entry = &RouterPlacementCache[slotIndex];
+
+	if (entry->generation != generation || entry->relationId != relationId ||
+		entry->hashValue != hashValue)
+	{
+		int shardIndex = FindShardIntervalIndex(hashedValue, cacheEntry);
+		if (shardIndex == INVALID_SHARD_INDEX)
+		{
+			*placementList = NIL;
+			return NULL;
+		}
+
+		ShardInterval *shardInterval = GetCachedShardInterval(cacheEntry, shardIndex);
+		List *activePlacementList = ActiveShardPlacementList(shardInterval->shardId);
+
+		FreeRouterPlacementCacheEntry(entry);
+
+		MemoryContext oldContext = MemoryContextSwitchTo(RouterPlacementCacheContext);
+		entry->placementList = copyObject(activePlacementList);
+		MemoryContextSwitchTo(oldContext);
+
+		entry->generation = generation;
+		entry->relationId = relationId;
+		entry->hashValue = hashValue;
+		entry->shardIndex = shardIndex;
+	}
+
+	/* the caller may keep the placements in a plan, so hand out copies */
+	*placementList = copyObject(entry->placementList);
+
+	return CopyShardInterval(GetCachedShardInterval(cacheEntry, entry->shardIndex));
+}
+
+
+/*
+ * ResetRouterPlacementCache empties the cache and remembers the generation of
+ * the metadata cache for which new entries are built.
+ */
+static void
+ResetRouterPlacementCache(uint64 generation)
+{
+	if (RouterPlacementCacheContext == NULL)
+	{
+		RouterPlacementCacheContext = AllocSetContextCreate(CacheMemoryContext,
+															"RouterPlacementCache",
+															ALLOCSET_SMALL_SIZES);
+	}
+	else
+	{
+		MemoryContextReset(RouterPlacementCacheContext);
+	}
+
+	memset(RouterPlacementCache, 0, sizeof(RouterPlacementCache));
+	RouterPlacementCacheGeneration = generation;
+}
+
+
+/*
+ * FreeRouterPlacementCacheEntry frees the placements of an entry that is
+ * about to be replaced.
+ */
+static void
+FreeRouterPlacementCacheEntry(RouterPlacementCacheEntry *entry)
+{
+	ShardPlacement *placement = NULL;
+	foreach_ptr(placement, entry->placementList)
+	{
+		pfree(placement->nodeName);
+		pfree(placement);
+	}
+
+	list_free(entry->placementList);
+	entry->placementList = NIL;
+}
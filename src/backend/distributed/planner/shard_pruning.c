@@ -60,6 +60,12 @@
  * Finally, the union of the shards found by each pruning instance is
  * returned.
  *
+ * Large IN lists on the partition column of a uniformly hash distributed
+ * table would otherwise result in one pruning instance per element. They are
+ * handled up front instead: all elements are hashed in a single pass into a
+ * set of surviving shard indexes, which is intersected with the result of
+ * pruning on the remaining restrictions.
+ *
  * Copyright (c) Citus Data, Inc.
  *
  *-------------------------------------------------------------------------
@@ -83,6 +89,7 @@
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/pg_dist_partition.h"
+#include "distributed/planner_timing.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_protocol.h"
@@ -188,6 +195,12 @@ typedef struct PendingPruningInstance
 	PruningTreeNode *continueAt;
 } PendingPruningInstance;
 
+/*
+ * Minimum number of elements in the array of a partcol = ANY(array)
+ * restriction to prune all elements in a single pass.
+ */
+#define SAO_BATCH_PRUNING_MIN_ELEMENTS 64
+
 typedef union \
 { \
 	FunctionCallInfoBaseData fcinfo; \
@@ -241,6 +254,8 @@ typedef struct ClauseWalkerContext
 	FunctionCall2InfoData compareIntervalFunctionCall;
 } ClauseWalkerContext;
 
+static List * PruneShardsInternal(Oid relationId, Index rangeTableId,
+								  List *whereClauseList, Const **partitionValueConst);
 static bool BuildPruningTree(Node *node, PruningTreeBuildContext *context);
 static void SimplifyPruningTree(PruningTreeNode *node, PruningTreeNode *parent);
 static void PrunableExpressions(PruningTreeNode *node, ClauseWalkerContext *context);
@@ -253,6 +268,13 @@ static void AddPartitionKeyRestrictionToInstance(ClauseWalkerContext *context,
 static void AddSAOPartitionKeyRestrictionToInstance(ClauseWalkerContext *context,
 													ScalarArrayOpExpr *
 													arrayOperatorExpression);
+static ScalarArrayOpExpr * FindBatchPrunableSAORestriction(
+	CitusTableCacheEntry *cacheEntry, Var *partitionColumn, List *whereClauseList);
+static List * PruneShardsWithSAOBatch(Oid relationId, Index rangeTableId,
+									  List *whereClauseList,
+									  ScalarArrayOpExpr *arrayOperatorExpression);
+static Bitmapset * SAORestrictionShardIndexes(CitusTableCacheEntry *cacheEntry,
+											  ScalarArrayOpExpr *arrayOperatorExpression);
 static bool SAORestrictions(ScalarArrayOpExpr *arrayOperatorExpression,
 							Var *partitionColumn,
 							List **requestedRestrictions);
@@ -309,6 +331,24 @@ static int ConstraintCount(PruningTreeNode *node);
 List *
 PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 			Const **partitionValueConst)
+{
+	BeginPlannerPhase(PLANNER_PHASE_SHARD_PRUNING);
+
+	List *prunedList = PruneShardsInternal(relationId, rangeTableId, whereClauseList,
+										   partitionValueConst);
+
+	EndPlannerPhase(PLANNER_PHASE_SHARD_PRUNING);
+
+	return prunedList;
+}
+
+
+/*
+ * PruneShardsInternal implements PruneShards.
+ */
+static List *
+PruneShardsInternal(Oid relationId, Index rangeTableId, List *whereClauseList,
+					Const **partitionValueConst)
 {
 	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
 	int shardCount = cacheEntry->shardIntervalArrayLength;
@@ -335,11 +375,26 @@ PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 	/* short circuit for non-distributed tables such as reference table */
 	if (IsCitusTableTypeCacheEntry(cacheEntry, CITUS_TABLE_WITH_NO_DIST_KEY))
 	{
-		prunedList = ShardArrayToList(cacheEntry->sortedShardIntervalArray,
+		prunedList = ShardArrayToList(GetSortedShardIntervalArray(cacheEntry),
 									  cacheEntry->shardIntervalArrayLength);
 		return DeepCopyShardIntervalList(prunedList);
 	}
 
+	ScalarArrayOpExpr *batchRestriction =
+		FindBatchPrunableSAORestriction(cacheEntry,
+										PartitionColumn(relationId, rangeTableId),
+										whereClauseList);
+	if (batchRestriction != NULL)
+	{
+		/* the IN list has many values, so there is no single partition value */
+		if (partitionValueConst != NULL)
+		{
+			*partitionValueConst = NULL;
+		}
+
+		return PruneShardsWithSAOBatch(relationId, rangeTableId, whereClauseList,
+									   batchRestriction);
+	}
 
 	context.partitionMethod = partitionMethod;
 	context.partitionColumn = PartitionColumn(relationId, rangeTableId);
@@ -474,7 +529,7 @@ PruneShards(Oid relationId, Index rangeTableId, List *whereClauseList,
 	/* found no valid restriction, build list of all shards */
 	if (!foundRestriction)
 	{
-		prunedList = ShardArrayToList(cacheEntry->sortedShardIntervalArray,
+		prunedList = ShardArrayToList(GetSortedShardIntervalArray(cacheEntry),
 									  cacheEntry->shardIntervalArrayLength);
 	}
 
@@ -952,6 +1007,184 @@ AddSAOPartitionKeyRestrictionToInstance(ClauseWalkerContext *context,
 }
 
 
+/*
+ * FindBatchPrunableSAORestriction returns a top-level partcol = ANY(array)
+ * restriction in whereClauseList whose array has enough elements to be worth
+ * pruning in a single pass, or NULL if there is none. This is only done for
+ * hash distributed tables with a uniform hash distribution, where we can
+ * compute the shard index of a hash value directly.
+ */
+static ScalarArrayOpExpr *
+FindBatchPrunableSAORestriction(CitusTableCacheEntry *cacheEntry, Var *partitionColumn,
+								List *whereClauseList)
+{
+	if (!IsCitusTableTypeCacheEntry(cacheEntry, HASH_DISTRIBUTED) ||
+		!cacheEntry->hasUniformHashDistribution)
+	{
+		return NULL;
+	}
+
+	Node *clause = NULL;
+	foreach_ptr(clause, whereClauseList)
+	{
+		if (!IsA(clause, ScalarArrayOpExpr))
+		{
+			continue;
+		}
+
+		ScalarArrayOpExpr *arrayOperatorExpression = (ScalarArrayOpExpr *) clause;
+		Node *leftOpExpression =
+			strip_implicit_coercions(linitial(arrayOperatorExpression->args));
+		Node *arrayArgument = lsecond(arrayOperatorExpression->args);
+
+		if (!arrayOperatorExpression->useOr ||
+			!OperatorImplementsEquality(arrayOperatorExpression->opno) ||
+			!equal(leftOpExpression, partitionColumn) ||
+			!IsA(arrayArgument, Const) || ((Const *) arrayArgument)->constisnull)
+		{
+			continue;
+		}
+
+		ArrayType *array = DatumGetArrayTypeP(((Const *) arrayArgument)->constvalue);
+
+		/* values of other types need to be coerced one by one */
+		if (ARR_ELEMTYPE(array) != partitionColumn->vartype)
+		{
+			continue;
+		}
+
+		if (ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array)) >=
+			SAO_BATCH_PRUNING_MIN_ELEMENTS)
+		{
+			return arrayOperatorExpression;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * PruneShardsWithSAOBatch prunes the shards of a table using a large
+ * partcol = ANY(array) restriction found by FindBatchPrunableSAORestriction,
+ * and the remaining clauses in whereClauseList. The shards survive if they
+ * contain one of the array elements and are not pruned away by the other
+ * clauses.
+ */
+static List *
+PruneShardsWithSAOBatch(Oid relationId, Index rangeTableId, List *whereClauseList,
+						ScalarArrayOpExpr *arrayOperatorExpression)
+{
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+
+	Bitmapset *shardIndexes = SAORestrictionShardIndexes(cacheEntry,
+														 arrayOperatorExpression);
+	if (bms_is_empty(shardIndexes))
+	{
+		return NIL;
+	}
+
+	List *remainingClauseList = list_delete_ptr(list_copy(whereClauseList),
+												arrayOperatorExpression);
+	List *remainingShardList = NIL;
+	List *prunedList = NIL;
+
+	if (remainingClauseList == NIL)
+	{
+		remainingShardList =
+			DeepCopyShardIntervalList(ShardArrayToList(
+										  GetSortedShardIntervalArray(cacheEntry),
+										  cacheEntry->shardIntervalArrayLength));
+	}
+	else
+	{
+		remainingShardList = PruneShards(relationId, rangeTableId,
+										 remainingClauseList, NULL);
+	}
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, remainingShardList)
+	{
+		if (bms_is_member(shardInterval->shardIndex, shardIndexes))
+		{
+			prunedList = lappend(prunedList, shardInterval);
+		}
+	}
+
+	if (IsLoggableLevel(DEBUG3))
+	{
+		ereport(DEBUG3, (errmsg("shard count after pruning IN list for %s: %d",
+								get_rel_name(relationId),
+								list_length(prunedList))));
+	}
+
+	return prunedList;
+}
+
+
+/*
+ * SAORestrictionShardIndexes hashes all the elements of the array of a
+ * partcol = ANY(array) restriction in a single pass, and returns the set of
+ * indexes of the shards the elements fall into. NULL elements never match,
+ * so they are skipped.
+ */
+static Bitmapset *
+SAORestrictionShardIndexes(CitusTableCacheEntry *cacheEntry,
+						   ScalarArrayOpExpr *arrayOperatorExpression)
+{
+	Const *arrayConst = (Const *) lsecond(arrayOperatorExpression->args);
+	ArrayType *array = DatumGetArrayTypeP(arrayConst->constvalue);
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	Bitmapset *shardIndexes = NULL;
+	int shardIndexCount = 0;
+	Datum arrayElement = 0;
+	bool isNull = false;
+
+	/* initiate the hash function call info once, instead of once per element */
+	LOCAL_FCINFO(hashFunctionCall, 1);
+	InitFunctionCallInfoData(*hashFunctionCall, cacheEntry->hashFunction, 1,
+							 cacheEntry->partitionColumn->varcollid, NULL, NULL);
+
+	ArrayIterator arrayIterator = array_create_iterator(array, 0, NULL);
+	while (array_iterate(arrayIterator, &arrayElement, &isNull))
+	{
+		if (isNull)
+		{
+			continue;
+		}
+
+		hashFunctionCall->args[0].value = arrayElement;
+		hashFunctionCall->args[0].isnull = false;
+		hashFunctionCall->isnull = false;
+
+		Datum hashedValue = FunctionCallInvoke(hashFunctionCall);
+		if (hashFunctionCall->isnull)
+		{
+			ereport(ERROR, (errmsg("function %u returned NULL",
+								   cacheEntry->hashFunction->fn_oid)));
+		}
+
+		int shardIndex = CalculateUniformHashRangeIndex(DatumGetInt32(hashedValue),
+														shardCount);
+		if (!bms_is_member(shardIndex, shardIndexes))
+		{
+			shardIndexes = bms_add_member(shardIndexes, shardIndex);
+			shardIndexCount++;
+
+			if (shardIndexCount == shardCount)
+			{
+				/* all shards survive, no need to look at the other elements */
+				break;
+			}
+		}
+	}
+
+	array_free_iterator(arrayIterator);
+
+	return shardIndexes;
+}
+
+
 /*
  * SAORestrictions checks whether an SAO constraint is valid.
  * Also obtains equality restrictions.
@@ -1445,8 +1678,6 @@ PruneOne(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *context,
 	 */
 	if (prune->hashedEqualConsts)
 	{
-		ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
-
 		Assert(context->partitionMethod == DISTRIBUTE_BY_HASH);
 
 		int shardIndex = FindShardIntervalIndex(prune->hashedEqualConsts->constvalue,
@@ -1457,7 +1688,7 @@ PruneOne(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *context,
 			return NIL;
 		}
 		else if (shardInterval &&
-				 sortedShardIntervalArray[shardIndex]->shardId != shardInterval->shardId)
+				 GetCachedShardId(cacheEntry, shardIndex) != shardInterval->shardId)
 		{
 			/*
 			 * equalConst based pruning above yielded a different shard than
@@ -1469,7 +1700,7 @@ PruneOne(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *context,
 		}
 		else
 		{
-			return list_make1(sortedShardIntervalArray[shardIndex]);
+			return list_make1(GetCachedShardInterval(cacheEntry, shardIndex));
 		}
 	}
 
@@ -1771,7 +2002,8 @@ PruneWithBoundaries(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *conte
 {
 	List *remainingShardList = NIL;
 	int shardCount = cacheEntry->shardIntervalArrayLength;
-	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	ShardInterval **sortedShardIntervalArray =
+		GetSortedShardIntervalArray(cacheEntry);
 	bool hasLowerBound = false;
 	bool hasUpperBound = false;
 	Datum lowerBound = 0;
@@ -1886,7 +2118,8 @@ ExhaustivePrune(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *context,
 {
 	List *remainingShardList = NIL;
 	int shardCount = cacheEntry->shardIntervalArrayLength;
-	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	ShardInterval **sortedShardIntervalArray =
+		GetSortedShardIntervalArray(cacheEntry);
 
 	for (int curIdx = 0; curIdx < shardCount; curIdx++)
 	{
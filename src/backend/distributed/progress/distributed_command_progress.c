@@ -0,0 +1,707 @@
+/*-------------------------------------------------------------------------
+ *
+ * distributed_command_progress.c
+ *	  Routines for reporting the progress of long-running distributed COPY,
+ *	  INSERT..SELECT and repartition join commands, and for reading it back.
+ *
+ * The progress monitors of multi_progress.c are registered through
+ * pg_stat_progress_vacuum, which only has room for a single command per
+ * backend and which COPY already uses for pg_stat_progress_copy. We
+ * therefore keep the progress of distributed commands in a shared memory
+ * slot per backend, which the backend updates with atomics while other
+ * backends read it. The rows routed to each shard of the target table go
+ * into the steps of a progress monitor, whose handle is kept in the slot.
+ *
+ * A backend reports the progress of a single command at a time. Commands
+ * that run as part of another one, such as the COPY into the target table of
+ * an INSERT..SELECT, add to the progress of the outer command.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "catalog/pg_authid.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+#include "distributed/backend_data.h"
+#include "distributed/distributed_command_progress.h"
+#include "distributed/hash_helpers.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_progress.h"
+#include "distributed/tuplestore.h"
+
+
+/*
+ * DistributedCommandProgress is the shared memory slot in which a backend
+ * reports the progress of its distributed command.
+ */
+typedef struct DistributedCommandProgress
+{
+	/* odd while the backend changes the fields that are not atomics */
+	pg_atomic_uint32 changeCount;
+
+	/* DISTRIBUTED_COMMAND_NONE while there is no command in progress */
+	DistributedCommandType command;
+	int processId;
+	Oid databaseId;
+	Oid userId;
+	Oid relationId;
+	TimestampTz startTime;
+
+	/* progress monitor with the rows per shard, or DSM_HANDLE_INVALID */
+	dsm_handle shardProgressHandle;
+
+	pg_atomic_uint32 phase;
+	pg_atomic_uint64 rowsProcessed;
+	pg_atomic_uint64 bytesSent;
+	pg_atomic_uint64 fragmentsProduced;
+	pg_atomic_uint64 fragmentsFetched;
+} DistributedCommandProgress;
+
+
+/*
+ * DistributedCommandShardProgress is a step of the progress monitor of a
+ * distributed command, there is one for each shard that received rows.
+ */
+typedef struct DistributedCommandShardProgress
+{
+	/* 0 until the step is assigned to a shard */
+	pg_atomic_uint64 shardId;
+	pg_atomic_uint64 rowsProcessed;
+} DistributedCommandShardProgress;
+
+
+/* maps a shard to its step in the progress monitor */
+typedef struct ShardProgressStepEntry
+{
+	uint64 shardId;
+	DistributedCommandShardProgress *step;
+} ShardProgressStepEntry;
+
+
+static const char *DistributedCommandNames[] = {
+	"",
+	"COPY",
+	"INSERT ... SELECT",
+	"repartition join"
+};
+
+static const char *DistributedCommandPhaseNames[] = {
+	"routing rows",
+	"partitioning results",
+	"fetching fragments",
+	"writing results"
+};
+
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static DistributedCommandProgress *DistributedCommandProgressArray = NULL;
+
+/* state of the command whose progress the current backend reports */
+static DistributedCommandType ActiveCommand = DISTRIBUTED_COMMAND_NONE;
+static DistributedCommandProgress *MyCommandProgress = NULL;
+static SubTransactionId ActiveCommandSubTransactionId = InvalidSubTransactionId;
+static dsm_segment *ShardProgressSegment = NULL;
+static DistributedCommandShardProgress *ShardProgressSteps = NULL;
+static int ShardProgressStepCount = 0;
+static int UsedShardProgressStepCount = 0;
+static MemoryContext ShardProgressContext = NULL;
+static HTAB *ShardProgressStepHash = NULL;
+
+static void SetupShardProgressMonitor(int shardCount, dsm_handle *shardProgressHandle);
+static DistributedCommandShardProgress * ShardProgressStep(uint64 shardId);
+static void ReadDistributedCommandProgress(DistributedCommandProgress *slot,
+										   DistributedCommandProgress *copy);
+static bool CanSeeDistributedCommandProgress(DistributedCommandProgress *progress);
+static void AddToAtomic(pg_atomic_uint64 *counter, uint64 value);
+
+PG_FUNCTION_INFO_V1(citus_distributed_command_progress);
+PG_FUNCTION_INFO_V1(citus_distributed_command_shard_progress);
+
+
+/*
+ * InitializeDistributedCommandProgress requests the shared memory for the
+ * progress of distributed commands and sets the hook that initializes it.
+ */
+void
+InitializeDistributedCommandProgress(void)
+{
+	/* On PG 15 and above, we use shmem_request_hook_type */
+	#if PG_VERSION_NUM < PG_VERSION_15
+
+	/* allocate shared memory for pre PG-15 versions */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(DistributedCommandProgressShmemSize());
+	}
+
+	#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = DistributedCommandProgressShmemInit;
+}
+
+
+/*
+ * DistributedCommandProgressShmemSize returns the size of the shared memory
+ * slots in which the backends report the progress of their commands.
+ */
+size_t
+DistributedCommandProgressShmemSize(void)
+{
+	return mul_size(sizeof(DistributedCommandProgress), TotalProcCount());
+}
+
+
+/*
+ * DistributedCommandProgressShmemInit initializes the shared memory slots in
+ * which the backends report the progress of their commands.
+ */
+void
+DistributedCommandProgressShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	DistributedCommandProgressArray =
+		(DistributedCommandProgress *) ShmemInitStruct(
+			"Citus Distributed Command Progress",
+			DistributedCommandProgressShmemSize(),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		int totalProcCount = TotalProcCount();
+
+		for (int procIndex = 0; procIndex < totalProcCount; procIndex++)
+		{
+			DistributedCommandProgress *progress =
+				&DistributedCommandProgressArray[procIndex];
+
+			pg_atomic_init_u32(&progress->changeCount, 0);
+			progress->command = DISTRIBUTED_COMMAND_NONE;
+			progress->shardProgressHandle = DSM_HANDLE_INVALID;
+			pg_atomic_init_u32(&progress->phase, 0);
+			pg_atomic_init_u64(&progress->rowsProcessed, 0);
+			pg_atomic_init_u64(&progress->bytesSent, 0);
+			pg_atomic_init_u64(&progress->fragmentsProduced, 0);
+			pg_atomic_init_u64(&progress->fragmentsFetched, 0);
+		}
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * StartDistributedCommandProgress starts reporting the progress of the given
+ * command on the given relation, with rows per shard for up to shardCount
+ * shards. Returns false if the backend already reports the progress of
+ * another command, to which the given command then contributes.
+ */
+bool
+StartDistributedCommandProgress(DistributedCommandType command, Oid relationId,
+								int shardCount)
+{
+	if (ActiveCommand != DISTRIBUTED_COMMAND_NONE ||
+		DistributedCommandProgressArray == NULL || MyProc == NULL)
+	{
+		return false;
+	}
+
+	dsm_handle shardProgressHandle = DSM_HANDLE_INVALID;
+	if (shardCount > 0)
+	{
+		SetupShardProgressMonitor(shardCount, &shardProgressHandle);
+	}
+
+	MyCommandProgress = &DistributedCommandProgressArray[MyProc->pgprocno];
+
+	pg_atomic_fetch_add_u32(&MyCommandProgress->changeCount, 1);
+	pg_write_barrier();
+
+	MyCommandProgress->command = command;
+	MyCommandProgress->processId = MyProcPid;
+	MyCommandProgress->databaseId = MyDatabaseId;
+	MyCommandProgress->userId = GetUserId();
+	MyCommandProgress->relationId = relationId;
+	MyCommandProgress->startTime = GetCurrentTimestamp();
+	MyCommandProgress->shardProgressHandle = shardProgressHandle;
+
+	pg_atomic_write_u32(&MyCommandProgress->phase,
+						DISTRIBUTED_COMMAND_PHASE_ROUTING_ROWS);
+	pg_atomic_write_u64(&MyCommandProgress->rowsProcessed, 0);
+	pg_atomic_write_u64(&MyCommandProgress->bytesSent, 0);
+	pg_atomic_write_u64(&MyCommandProgress->fragmentsProduced, 0);
+	pg_atomic_write_u64(&MyCommandProgress->fragmentsFetched, 0);
+
+	pg_write_barrier();
+	pg_atomic_fetch_add_u32(&MyCommandProgress->changeCount, 1);
+
+	ActiveCommand = command;
+	ActiveCommandSubTransactionId = GetCurrentSubTransactionId();
+
+	return true;
+}
+
+
+/*
+ * SetupShardProgressMonitor creates the progress monitor that holds the rows
+ * per shard of the command. The segment is pinned to the session, such that
+ * it stays around until ResetDistributedCommandProgress detaches it.
+ */
+static void
+SetupShardProgressMonitor(int shardCount, dsm_handle *shardProgressHandle)
+{
+	ProgressMonitorData *monitor =
+		CreateProgressMonitor(shardCount, sizeof(DistributedCommandShardProgress),
+							  shardProgressHandle);
+	if (monitor == NULL)
+	{
+		*shardProgressHandle = DSM_HANDLE_INVALID;
+		return;
+	}
+
+	ShardProgressSegment = dsm_find_mapping(*shardProgressHandle);
+	dsm_pin_mapping(ShardProgressSegment);
+
+	ShardProgressSteps = ProgressMonitorSteps(monitor);
+	ShardProgressStepCount = shardCount;
+	UsedShardProgressStepCount = 0;
+
+	for (int stepIndex = 0; stepIndex < shardCount; stepIndex++)
+	{
+		pg_atomic_init_u64(&ShardProgressSteps[stepIndex].shardId, 0);
+		pg_atomic_init_u64(&ShardProgressSteps[stepIndex].rowsProcessed, 0);
+	}
+
+	ShardProgressContext = AllocSetContextCreate(TopMemoryContext,
+												 "Distributed Command Progress",
+												 ALLOCSET_SMALL_SIZES);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(ShardProgressContext);
+	ShardProgressStepHash = CreateSimpleHashWithName(uint64, ShardProgressStepEntry,
+													 "Shard Progress Steps");
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * FinishDistributedCommandProgress stops reporting the progress of the
+ * current command, if the caller started it.
+ */
+void
+FinishDistributedCommandProgress(bool progressStarted)
+{
+	if (progressStarted)
+	{
+		ResetDistributedCommandProgress();
+	}
+}
+
+
+/*
+ * SetDistributedCommandPhase reports the phase of the current command.
+ */
+void
+SetDistributedCommandPhase(DistributedCommandPhase phase)
+{
+	if (ActiveCommand == DISTRIBUTED_COMMAND_NONE)
+	{
+		return;
+	}
+
+	pg_atomic_write_u32(&MyCommandProgress->phase, phase);
+}
+
+
+/*
+ * ReportDistributedCommandShardRows adds the given number of rows that the
+ * current command routed to the given shard.
+ */
+void
+ReportDistributedCommandShardRows(uint64 shardId, uint64 rowCount)
+{
+	if (ActiveCommand == DISTRIBUTED_COMMAND_NONE)
+	{
+		return;
+	}
+
+	AddToAtomic(&MyCommandProgress->rowsProcessed, rowCount);
+
+	DistributedCommandShardProgress *step = ShardProgressStep(shardId);
+	if (step != NULL)
+	{
+		AddToAtomic(&step->rowsProcessed, rowCount);
+	}
+}
+
+
+/*
+ * ShardProgressStep returns the step of the progress monitor for the given
+ * shard, which is assigned when the shard receives its first rows, or NULL
+ * if the command does not report rows per shard.
+ */
+static DistributedCommandShardProgress *
+ShardProgressStep(uint64 shardId)
+{
+	bool found = false;
+
+	if (ShardProgressStepHash == NULL)
+	{
+		return NULL;
+	}
+
+	ShardProgressStepEntry *entry = hash_search(ShardProgressStepHash, &shardId,
+												HASH_ENTER, &found);
+	if (!found)
+	{
+		entry->step = NULL;
+
+		if (UsedShardProgressStepCount < ShardProgressStepCount)
+		{
+			entry->step = &ShardProgressSteps[UsedShardProgressStepCount];
+			UsedShardProgressStepCount++;
+
+			pg_atomic_write_u64(&entry->step->shardId, shardId);
+		}
+	}
+
+	return entry->step;
+}
+
+
+/*
+ * ReportDistributedCommandBytesSent adds the given number of bytes that the
+ * current command sent to the workers.
+ */
+void
+ReportDistributedCommandBytesSent(uint64 byteCount)
+{
+	if (ActiveCommand == DISTRIBUTED_COMMAND_NONE)
+	{
+		return;
+	}
+
+	AddToAtomic(&MyCommandProgress->bytesSent, byteCount);
+}
+
+
+/*
+ * ReportDistributedCommandFragmentsProduced adds the given number of result
+ * fragments that the current command produced on the workers.
+ */
+void
+ReportDistributedCommandFragmentsProduced(uint64 fragmentCount)
+{
+	if (ActiveCommand == DISTRIBUTED_COMMAND_NONE)
+	{
+		return;
+	}
+
+	AddToAtomic(&MyCommandProgress->fragmentsProduced, fragmentCount);
+}
+
+
+/*
+ * ReportDistributedCommandFragmentsFetched adds the given number of result
+ * fragments that the current command fetched between the workers.
+ */
+void
+ReportDistributedCommandFragmentsFetched(uint64 fragmentCount)
+{
+	if (ActiveCommand == DISTRIBUTED_COMMAND_NONE)
+	{
+		return;
+	}
+
+	AddToAtomic(&MyCommandProgress->fragmentsFetched, fragmentCount);
+}
+
+
+/*
+ * AddToAtomic adds the given value to a counter that only the current backend
+ * writes to, which does not require a locked instruction.
+ */
+static void
+AddToAtomic(pg_atomic_uint64 *counter, uint64 value)
+{
+	pg_atomic_write_u64(counter, pg_atomic_read_u64(counter) + value);
+}
+
+
+/*
+ * ResetDistributedCommandProgress stops reporting the progress of the current
+ * command. A command that fails cannot finish its progress, so we also call
+ * this when the transaction aborts.
+ */
+void
+ResetDistributedCommandProgress(void)
+{
+	if (ActiveCommand == DISTRIBUTED_COMMAND_NONE)
+	{
+		return;
+	}
+
+	pg_atomic_fetch_add_u32(&MyCommandProgress->changeCount, 1);
+	pg_write_barrier();
+
+	MyCommandProgress->command = DISTRIBUTED_COMMAND_NONE;
+	MyCommandProgress->shardProgressHandle = DSM_HANDLE_INVALID;
+
+	pg_write_barrier();
+	pg_atomic_fetch_add_u32(&MyCommandProgress->changeCount, 1);
+
+	if (ShardProgressSegment != NULL)
+	{
+		dsm_detach(ShardProgressSegment);
+		ShardProgressSegment = NULL;
+	}
+
+	/* also frees the hash of the steps */
+	if (ShardProgressContext != NULL)
+	{
+		MemoryContextDelete(ShardProgressContext);
+		ShardProgressContext = NULL;
+	}
+
+	ShardProgressStepHash = NULL;
+
+	ShardProgressSteps = NULL;
+	ShardProgressStepCount = 0;
+	UsedShardProgressStepCount = 0;
+
+	ActiveCommand = DISTRIBUTED_COMMAND_NONE;
+	ActiveCommandSubTransactionId = InvalidSubTransactionId;
+}
+
+
+/*
+ * ResetDistributedCommandProgressAtSubXactAbort stops reporting the progress
+ * of the current command if it started in the aborted subtransaction, or in
+ * one of its children.
+ */
+void
+ResetDistributedCommandProgressAtSubXactAbort(SubTransactionId subId)
+{
+	if (ActiveCommand != DISTRIBUTED_COMMAND_NONE &&
+		ActiveCommandSubTransactionId >= subId)
+	{
+		ResetDistributedCommandProgress();
+	}
+}
+
+
+/*
+ * ReadDistributedCommandProgress copies a consistent version of the fields of
+ * the given slot that are not atomics.
+ */
+static void
+ReadDistributedCommandProgress(DistributedCommandProgress *slot,
+							   DistributedCommandProgress *copy)
+{
+	for (;;)
+	{
+		uint32 changeCountBefore = pg_atomic_read_u32(&slot->changeCount);
+		pg_read_barrier();
+
+		copy->command = slot->command;
+		copy->processId = slot->processId;
+		copy->databaseId = slot->databaseId;
+		copy->userId = slot->userId;
+		copy->relationId = slot->relationId;
+		copy->startTime = slot->startTime;
+		copy->shardProgressHandle = slot->shardProgressHandle;
+
+		pg_read_barrier();
+		uint32 changeCountAfter = pg_atomic_read_u32(&slot->changeCount);
+
+		if (changeCountBefore == changeCountAfter && (changeCountBefore & 1) == 0)
+		{
+			break;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+
+/*
+ * CanSeeDistributedCommandProgress returns whether the current user may see
+ * the given progress, which follows the rules of pg_stat_progress_*.
+ */
+static bool
+CanSeeDistributedCommandProgress(DistributedCommandProgress *progress)
+{
+	if (progress->command == DISTRIBUTED_COMMAND_NONE ||
+		progress->databaseId != MyDatabaseId)
+	{
+		return false;
+	}
+
+	return superuser() || has_privs_of_role(GetUserId(), progress->userId) ||
+		   is_member_of_role(GetUserId(),
+#if PG_VERSION_NUM >= PG_VERSION_14
+							 ROLE_PG_READ_ALL_STATS);
+#else
+							 DEFAULT_ROLE_READ_ALL_STATS);
+#endif
+}
+
+
+/*
+ * citus_distributed_command_progress returns a row for each distributed COPY,
+ * INSERT..SELECT and repartition join in progress in the current database.
+ */
+Datum
+citus_distributed_command_progress(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	if (DistributedCommandProgressArray == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	int totalProcCount = TotalProcCount();
+
+	for (int procIndex = 0; procIndex < totalProcCount; procIndex++)
+	{
+		DistributedCommandProgress *slot = &DistributedCommandProgressArray[procIndex];
+		DistributedCommandProgress progress;
+
+		ReadDistributedCommandProgress(slot, &progress);
+		if (!CanSeeDistributedCommandProgress(&progress))
+		{
+			continue;
+		}
+
+		Datum values[9];
+		bool isNulls[9];
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		uint32 phase = pg_atomic_read_u32(&slot->phase);
+
+		values[0] = Int32GetDatum(progress.processId);
+		values[1] = CStringGetTextDatum(DistributedCommandNames[progress.command]);
+		values[2] = ObjectIdGetDatum(progress.relationId);
+		isNulls[2] = !OidIsValid(progress.relationId);
+		values[3] = CStringGetTextDatum(DistributedCommandPhaseNames[phase]);
+		values[4] = TimestampTzGetDatum(progress.startTime);
+		values[5] = Int64GetDatum(pg_atomic_read_u64(&slot->rowsProcessed));
+		values[6] = Int64GetDatum(pg_atomic_read_u64(&slot->bytesSent));
+		values[7] = Int64GetDatum(pg_atomic_read_u64(&slot->fragmentsProduced));
+		values[8] = Int64GetDatum(pg_atomic_read_u64(&slot->fragmentsFetched));
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_distributed_command_shard_progress returns a row for each shard that
+ * received rows from a distributed command in progress in the current
+ * database, with the number of rows routed to it.
+ */
+Datum
+citus_distributed_command_shard_progress(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	if (DistributedCommandProgressArray == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	int totalProcCount = TotalProcCount();
+
+	for (int procIndex = 0; procIndex < totalProcCount; procIndex++)
+	{
+		DistributedCommandProgress *slot = &DistributedCommandProgressArray[procIndex];
+		DistributedCommandProgress progress;
+
+		ReadDistributedCommandProgress(slot, &progress);
+		if (!CanSeeDistributedCommandProgress(&progress) ||
+			progress.shardProgressHandle == DSM_HANDLE_INVALID)
+		{
+			continue;
+		}
+
+		/* the segment of our own command is already mapped and must stay so */
+		bool ownSegment = dsm_find_mapping(progress.shardProgressHandle) != NULL;
+		dsm_segment *segment = NULL;
+
+		ProgressMonitorData *monitor =
+			MonitorDataFromDSMHandle(progress.shardProgressHandle, &segment);
+		if (monitor == NULL)
+		{
+			/* the command finished in the meantime */
+			continue;
+		}
+
+		if (monitor->processId == (uint64) progress.processId)
+		{
+			DistributedCommandShardProgress *steps = ProgressMonitorSteps(monitor);
+
+			for (int stepIndex = 0; stepIndex < monitor->stepCount; stepIndex++)
+			{
+				uint64 shardId = pg_atomic_read_u64(&steps[stepIndex].shardId);
+				if (shardId == 0)
+				{
+					/* steps are assigned in order */
+					break;
+				}
+
+				Datum values[3];
+				bool isNulls[3];
+
+				memset(isNulls, false, sizeof(isNulls));
+
+				values[0] = Int32GetDatum(progress.processId);
+				values[1] = Int64GetDatum(shardId);
+				values[2] =
+					Int64GetDatum(pg_atomic_read_u64(&steps[stepIndex].rowsProcessed));
+
+				tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+			}
+		}
+
+		if (!ownSegment)
+		{
+			dsm_detach(segment);
+		}
+	}
+
+	PG_RETURN_VOID();
+}
@@ -22,9 +22,6 @@
 /* dynamic shared memory handle of the current progress */
 static uint64 currentProgressDSMHandle = DSM_HANDLE_INVALID;
 
-static ProgressMonitorData * MonitorDataFromDSMHandle(dsm_handle dsmHandle,
-													  dsm_segment **attachedSegment);
-
 
 /*
  * CreateProgressMonitor is used to create a place to store progress
@@ -230,7 +227,8 @@ ProgressMonitorList(uint64 commandTypeMagicNumber, List **attachedDSMSegments)
 
 /*
  * MonitorDataFromDSMHandle returns the progress monitoring data structure at the
- * given segment
+ * given segment, attaching to the segment if needed. Returns NULL if the
+ * segment no longer exists.
  */
 ProgressMonitorData *
 MonitorDataFromDSMHandle(dsm_handle dsmHandle, dsm_segment **attachedSegment)
@@ -0,0 +1,188 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_task_progress.c
+ *	  Routines for reporting the progress of the shard tasks of distributed
+ *	  commands through the progress monitor, and for reading it back.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/multi_progress.h"
+#include "distributed/shard_task_progress.h"
+#include "distributed/tuplestore.h"
+#include "utils/builtins.h"
+#include "utils/timestamp.h"
+
+
+static const char *ShardTaskProgressStateNames[] = {
+	"Waiting",
+	"Running",
+	"Finished"
+};
+
+
+PG_FUNCTION_INFO_V1(citus_index_build_progress);
+
+
+/*
+ * SetupShardTaskProgressMonitor creates and registers a progress monitor with
+ * a step for each task in the given list, under the given magic number, and
+ * returns the array of steps. The steps are in the same order as the tasks.
+ * Returns NULL if the dynamic shared memory could not be allocated, in which
+ * case the command runs without reporting progress.
+ */
+ShardTaskProgress *
+SetupShardTaskProgressMonitor(uint64 magicNumber, List *taskList)
+{
+	if (list_length(taskList) == 0)
+	{
+		return NULL;
+	}
+
+	dsm_handle dsmHandle;
+	ProgressMonitorData *monitor = CreateProgressMonitor(list_length(taskList),
+														 sizeof(ShardTaskProgress),
+														 &dsmHandle);
+	if (monitor == NULL)
+	{
+		return NULL;
+	}
+
+	ShardTaskProgress *taskProgressSteps = ProgressMonitorSteps(monitor);
+	Oid relationId = InvalidOid;
+
+	int taskIndex = 0;
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		ShardTaskProgress *taskProgress = taskProgressSteps + taskIndex;
+
+		taskProgress->shardId = task->anchorShardId;
+		taskProgress->relationId = InvalidOid;
+		if (task->anchorShardId != INVALID_SHARD_ID)
+		{
+			taskProgress->relationId = RelationIdForShard(task->anchorShardId);
+		}
+
+		if (!OidIsValid(relationId))
+		{
+			relationId = taskProgress->relationId;
+		}
+
+		taskProgress->nodeName[0] = '\0';
+		taskProgress->nodePort = 0;
+		if (task->taskPlacementList != NIL)
+		{
+			ShardPlacement *placement = linitial(task->taskPlacementList);
+
+			strlcpy(taskProgress->nodeName, placement->nodeName, 255);
+			taskProgress->nodePort = placement->nodePort;
+		}
+
+		pg_atomic_init_u64(&taskProgress->state, SHARD_TASK_PROGRESS_WAITING);
+		pg_atomic_init_u64(&taskProgress->startTime, 0);
+		pg_atomic_init_u64(&taskProgress->finishTime, 0);
+
+		taskIndex++;
+	}
+
+	RegisterProgressMonitor(magicNumber, relationId, dsmHandle);
+
+	return taskProgressSteps;
+}
+
+
+/*
+ * ReportShardTaskStarted marks the task as running, unless one of its other
+ * placements already started it.
+ */
+void
+ReportShardTaskStarted(ShardTaskProgress *taskProgress)
+{
+	if (pg_atomic_read_u64(&taskProgress->state) != SHARD_TASK_PROGRESS_WAITING)
+	{
+		return;
+	}
+
+	pg_atomic_write_u64(&taskProgress->startTime, (uint64) GetCurrentTimestamp());
+	pg_atomic_write_u64(&taskProgress->state, SHARD_TASK_PROGRESS_RUNNING);
+}
+
+
+/*
+ * ReportShardTaskFinished marks the task as finished.
+ */
+void
+ReportShardTaskFinished(ShardTaskProgress *taskProgress)
+{
+	pg_atomic_write_u64(&taskProgress->finishTime, (uint64) GetCurrentTimestamp());
+	pg_atomic_write_u64(&taskProgress->state, SHARD_TASK_PROGRESS_FINISHED);
+}
+
+
+/*
+ * citus_index_build_progress returns a row for each shard task of the ongoing
+ * CREATE INDEX and REINDEX commands on distributed tables, with its state and
+ * the times at which it started and finished. The times of the finished tasks
+ * can be used to estimate when the remaining ones finish.
+ */
+Datum
+citus_index_build_progress(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	List *segmentList = NIL;
+	TupleDesc tupdesc;
+	Tuplestorestate *tupstore = SetupTuplestore(fcinfo, &tupdesc);
+
+	List *monitorList = ProgressMonitorList(INDEX_BUILD_ACTIVITY_MAGIC_NUMBER,
+											&segmentList);
+
+	ProgressMonitorData *monitor = NULL;
+	foreach_ptr(monitor, monitorList)
+	{
+		ShardTaskProgress *taskProgressSteps = ProgressMonitorSteps(monitor);
+
+		for (int stepIndex = 0; stepIndex < monitor->stepCount; stepIndex++)
+		{
+			ShardTaskProgress *step = taskProgressSteps + stepIndex;
+			uint64 state = pg_atomic_read_u64(&step->state);
+			TimestampTz startTime = (TimestampTz) pg_atomic_read_u64(&step->startTime);
+			TimestampTz finishTime =
+				(TimestampTz) pg_atomic_read_u64(&step->finishTime);
+
+			Datum values[8];
+			bool nulls[8];
+
+			memset(values, 0, sizeof(values));
+			memset(nulls, 0, sizeof(nulls));
+
+			values[0] = Int32GetDatum((int32) monitor->processId);
+			values[1] = ObjectIdGetDatum(step->relationId);
+			nulls[1] = !OidIsValid(step->relationId);
+			values[2] = Int64GetDatum(step->shardId);
+			values[3] = PointerGetDatum(cstring_to_text(step->nodeName));
+			values[4] = Int32GetDatum(step->nodePort);
+			values[5] = PointerGetDatum(
+				cstring_to_text(ShardTaskProgressStateNames[state]));
+			values[6] = TimestampTzGetDatum(startTime);
+			nulls[6] = (startTime == 0);
+			values[7] = TimestampTzGetDatum(finishTime);
+			nulls[7] = (finishTime == 0);
+
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+	}
+
+	DetachFromDSMSegments(segmentList);
+
+	return (Datum) 0;
+}
@@ -33,6 +33,7 @@
 #include "distributed/citus_safe_lib.h"
 #include "distributed/colocation_utils.h"
 #include "distributed/connection_management.h"
+#include "distributed/deparse_shard_query.h"
 #include "distributed/hash_helpers.h"
 #include "distributed/listutils.h"
 #include "distributed/coordinator_protocol.h"
@@ -104,10 +105,22 @@ static const char *subscriptionRolePrefix[] = {
 };
 
 
+/* GUC variable, number of subscriptions per table owner of a shard move */
+int LogicalReplicationApplyParallelism = 1;
+
 /* GUC variable, defaults to 2 hours */
 int LogicalReplicationTimeout = 2 * 60 * 60 * 1000;
 
 
+/* GUC variable, -1 uses the maintenance_work_mem of the target node */
+int ShardIndexBuildMaintenanceWorkMem = -1;
+
+/* GUC variable, -1 uses the max_parallel_maintenance_workers of the target node */
+int ShardIndexBuildMaxParallelWorkers = -1;
+
+/* GUC variable, 0 uses citus.max_adaptive_executor_pool_size */
+int ShardIndexBuildParallelism = 0;
+
 /* see the comment in master_move_shard_placement */
 bool PlacementMovedUsingLogicalReplicationInTX = false;
 
@@ -126,6 +139,9 @@ static void ExecuteCreateConstraintsBackedByIndexCommands(List *logicalRepTarget
 static List * ConvertNonExistingPlacementDDLCommandsToTasks(List *shardCommandList,
 															char *targetNodeName,
 															int targetNodePort);
+static List * ConvertIndexBuildCommandsToTasks(List *shardCommandList,
+											   char *targetNodeName,
+											   int targetNodePort);
 static void ExecuteClusterOnCommands(List *logicalRepTargetList);
 static void ExecuteCreateIndexStatisticsCommands(List *logicalRepTargetList);
 static void ExecuteRemainingPostLoadTableCommands(List *logicalRepTargetList);
@@ -146,9 +162,13 @@ static void DropAllSubscriptions(MultiConnection *connection, LogicalRepType typ
 static void DropAllReplicationSlots(MultiConnection *connection, LogicalRepType type);
 static void DropAllPublications(MultiConnection *connection, LogicalRepType type);
 static void DropAllUsers(MultiConnection *connection, LogicalRepType type);
+static uint32 ShardMoveSubscriptionIndex(ShardInterval *shardInterval,
+										 List *replicationSubscriptionList);
+static char * ShardMoveSubscriptionObjectName(char *name, uint32 subscriptionIndex);
 static HTAB * CreateShardMovePublicationInfoHash(WorkerNode *targetNode,
 												 List *shardIntervals);
 static List * CreateShardMoveLogicalRepTargetList(HTAB *publicationInfoHash,
+												  List *replicationSubscriptionList,
 												  List *shardList);
 static void WaitForGroupedLogicalRepTargetsToCatchUp(XLogRecPtr sourcePosition,
 													 GroupedLogicalRepTargets *
@@ -204,8 +224,8 @@ LogicallyReplicateShards(List *shardList, char *sourceNodeName, int sourceNodePo
 	HTAB *publicationInfoHash = CreateShardMovePublicationInfoHash(
 		targetNode, replicationSubscriptionList);
 
-	List *logicalRepTargetList = CreateShardMoveLogicalRepTargetList(publicationInfoHash,
-																	 shardList);
+	List *logicalRepTargetList = CreateShardMoveLogicalRepTargetList(
+		publicationInfoHash, replicationSubscriptionList, shardList);
 
 	HTAB *groupedLogicalRepTargetsHash = CreateGroupedLogicalRepTargetsHash(
 		logicalRepTargetList);
@@ -460,12 +480,69 @@ CompleteNonBlockingShardTransfer(List *shardList,
 }
 
 
+/*
+ * ShardMoveSubscriptionIndex returns the index of the subscription that
+ * replicates the given shard during a shard move. The replicated shards are
+ * spread over citus.logical_replication_apply_parallelism subscriptions per
+ * table owner, such that their changes are applied by several apply workers
+ * on the target. Shards that are not replicated, like the shards of
+ * partitioned tables, belong to the first subscription of their owner.
+ */
+static uint32
+ShardMoveSubscriptionIndex(ShardInterval *shardInterval,
+						   List *replicationSubscriptionList)
+{
+	Oid tableOwnerId = TableOwnerOid(shardInterval->relationId);
+	uint32 ownerShardPosition = 0;
+
+	if (LogicalReplicationApplyParallelism <= 1)
+	{
+		return 0;
+	}
+
+	ShardInterval *replicatedShardInterval = NULL;
+	foreach_ptr(replicatedShardInterval, replicationSubscriptionList)
+	{
+		if (replicatedShardInterval->shardId == shardInterval->shardId)
+		{
+			return ownerShardPosition % LogicalReplicationApplyParallelism;
+		}
+
+		if (TableOwnerOid(replicatedShardInterval->relationId) == tableOwnerId)
+		{
+			ownerShardPosition++;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * ShardMoveSubscriptionObjectName returns the name of the publication,
+ * replication slot, subscription or subscription role of the subscription
+ * with the given index, based on the name that the first subscription of
+ * its table owner uses.
+ */
+static char *
+ShardMoveSubscriptionObjectName(char *name, uint32 subscriptionIndex)
+{
+	if (subscriptionIndex == 0)
+	{
+		return name;
+	}
+
+	return psprintf("%s_%u", name, subscriptionIndex);
+}
+
+
 /*
  * CreateShardMovePublicationInfoHash creates hashmap of PublicationInfos for a
  * shard move. Even though we only support moving a shard to a single target
  * node, the resulting hashmap can have multiple PublicationInfos in it.
  * The reason for that is that we need a separate publication for each
- * distributed table owning user in the shard group.
+ * distributed table owning user in the shard group, and for each of the
+ * subscriptions that replicate the shards of that user.
  */
 static HTAB *
 CreateShardMovePublicationInfoHash(WorkerNode *targetNode, List *shardIntervals)
@@ -477,6 +554,8 @@ CreateShardMovePublicationInfoHash(WorkerNode *targetNode, List *shardIntervals)
 		NodeAndOwner key;
 		key.nodeId = targetNode->nodeId;
 		key.tableOwnerId = TableOwnerOid(shardInterval->relationId);
+		key.subscriptionIndex = ShardMoveSubscriptionIndex(shardInterval,
+														   shardIntervals);
 		bool found = false;
 		PublicationInfo *publicationInfo =
 			(PublicationInfo *) hash_search(publicationInfoHash, &key,
@@ -484,8 +563,9 @@ CreateShardMovePublicationInfoHash(WorkerNode *targetNode, List *shardIntervals)
 											&found);
 		if (!found)
 		{
-			publicationInfo->name = PublicationName(SHARD_MOVE, key.nodeId,
-													key.tableOwnerId);
+			publicationInfo->name = ShardMoveSubscriptionObjectName(
+				PublicationName(SHARD_MOVE, key.nodeId, key.tableOwnerId),
+				key.subscriptionIndex);
 			publicationInfo->shardIntervals = NIL;
 		}
 		publicationInfo->shardIntervals =
@@ -501,7 +581,8 @@ CreateShardMovePublicationInfoHash(WorkerNode *targetNode, List *shardIntervals)
  * publicationHash.
  */
 static List *
-CreateShardMoveLogicalRepTargetList(HTAB *publicationInfoHash, List *shardList)
+CreateShardMoveLogicalRepTargetList(HTAB *publicationInfoHash,
+									List *replicationSubscriptionList, List *shardList)
 {
 	List *logicalRepTargetList = NIL;
 
@@ -513,18 +594,21 @@ CreateShardMoveLogicalRepTargetList(HTAB *publicationInfoHash, List *shardList)
 	while ((publication = (PublicationInfo *) hash_seq_search(&status)) != NULL)
 	{
 		Oid ownerId = publication->key.tableOwnerId;
+		uint32 subscriptionIndex = publication->key.subscriptionIndex;
 		nodeId = publication->key.nodeId;
 		LogicalRepTarget *target = palloc0(sizeof(LogicalRepTarget));
-		target->subscriptionName = SubscriptionName(SHARD_MOVE, ownerId);
+		target->subscriptionName = ShardMoveSubscriptionObjectName(
+			SubscriptionName(SHARD_MOVE, ownerId), subscriptionIndex);
 		target->tableOwnerId = ownerId;
 		target->publication = publication;
 		publication->target = target;
 		target->newShards = NIL;
-		target->subscriptionOwnerName = SubscriptionRoleName(SHARD_MOVE, ownerId);
+		target->subscriptionOwnerName = ShardMoveSubscriptionObjectName(
+			SubscriptionRoleName(SHARD_MOVE, ownerId), subscriptionIndex);
 		target->replicationSlot = palloc0(sizeof(ReplicationSlotInfo));
-		target->replicationSlot->name = ReplicationSlotNameForNodeAndOwner(SHARD_MOVE,
-																		   nodeId,
-																		   ownerId);
+		target->replicationSlot->name = ShardMoveSubscriptionObjectName(
+			ReplicationSlotNameForNodeAndOwner(SHARD_MOVE, nodeId, ownerId),
+			subscriptionIndex);
 		target->replicationSlot->targetNodeId = nodeId;
 		target->replicationSlot->tableOwnerId = ownerId;
 		logicalRepTargetList = lappend(logicalRepTargetList, target);
@@ -536,6 +620,8 @@ CreateShardMoveLogicalRepTargetList(HTAB *publicationInfoHash, List *shardList)
 		NodeAndOwner key;
 		key.nodeId = nodeId;
 		key.tableOwnerId = TableOwnerOid(shardInterval->relationId);
+		key.subscriptionIndex = ShardMoveSubscriptionIndex(shardInterval,
+														   replicationSubscriptionList);
 
 		bool found = false;
 		publication = (PublicationInfo *) hash_search(
@@ -865,7 +951,7 @@ ExecuteCreateIndexCommands(List *logicalRepTargetList)
 				WorkerApplyShardDDLCommandList(tableCreateIndexCommandList,
 											   shardInterval->shardId);
 			List *taskListForShard =
-				ConvertNonExistingPlacementDDLCommandsToTasks(
+				ConvertIndexBuildCommandsToTasks(
 					shardCreateIndexCommandList,
 					target->superuserConnection->hostname,
 					target->superuserConnection->port);
@@ -888,11 +974,93 @@ ExecuteCreateIndexCommands(List *logicalRepTargetList)
 							"(indexes)")));
 
 	ExecuteTaskListOutsideTransaction(ROW_MODIFY_NONE, taskList,
-									  MaxAdaptiveExecutorPoolSize,
+									  ShardIndexBuildPoolSize(),
 									  NIL);
 }
 
 
+/*
+ * ShardIndexBuildPoolSize returns the maximum number of connections per node
+ * over which the indexes of moved or split shards are built.
+ */
+int
+ShardIndexBuildPoolSize(void)
+{
+	if (ShardIndexBuildParallelism > 0)
+	{
+		return ShardIndexBuildParallelism;
+	}
+
+	return MaxAdaptiveExecutorPoolSize;
+}
+
+
+/*
+ * ShardIndexBuildSettingCommandList returns the SET LOCAL commands that apply
+ * citus.shard_index_build_maintenance_work_mem and
+ * citus.shard_index_build_max_parallel_workers to a transaction that builds
+ * indexes of moved or split shards, or NIL if both use the defaults of the
+ * target node.
+ */
+List *
+ShardIndexBuildSettingCommandList(void)
+{
+	List *commandList = NIL;
+
+	if (ShardIndexBuildMaintenanceWorkMem != -1)
+	{
+		StringInfo command = makeStringInfo();
+		appendStringInfo(command, "SET LOCAL maintenance_work_mem TO '%dkB';",
+						 ShardIndexBuildMaintenanceWorkMem);
+		commandList = lappend(commandList, command->data);
+	}
+
+	if (ShardIndexBuildMaxParallelWorkers != -1)
+	{
+		StringInfo command = makeStringInfo();
+		appendStringInfo(command, "SET LOCAL max_parallel_maintenance_workers TO %d;",
+						 ShardIndexBuildMaxParallelWorkers);
+		commandList = lappend(commandList, command->data);
+	}
+
+	return commandList;
+}
+
+
+/*
+ * ConvertIndexBuildCommandsToTasks generates one task per CREATE INDEX command
+ * in shardCommandList, like ConvertNonExistingPlacementDDLCommandsToTasks. When
+ * index build settings are configured, each command runs in a transaction that
+ * sets them locally, such that they do not stay on the connection.
+ */
+static List *
+ConvertIndexBuildCommandsToTasks(List *shardCommandList, char *targetNodeName,
+								 int targetNodePort)
+{
+	List *taskList = ConvertNonExistingPlacementDDLCommandsToTasks(shardCommandList,
+																   targetNodeName,
+																   targetNodePort);
+	List *settingCommandList = ShardIndexBuildSettingCommandList();
+	if (settingCommandList == NIL)
+	{
+		return taskList;
+	}
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		List *queryStringList = list_make1("BEGIN;");
+		queryStringList = list_concat(queryStringList, settingCommandList);
+		queryStringList = lappend(queryStringList, TaskQueryString(task));
+		queryStringList = lappend(queryStringList, "COMMIT;");
+
+		SetTaskQueryStringList(task, queryStringList);
+	}
+
+	return taskList;
+}
+
+
 /*
  * ExecuteCreateConstraintsBackedByIndexCommands gets a shardList and creates all the constraints
  * that are backed by indexes for the given shardList in the given target node.
@@ -1905,14 +2073,27 @@ CreateSubscriptions(MultiConnection *sourceConnection,
 						 sourceConnection->port,
 						 escape_param_str(sourceConnection->user), escape_param_str(
 							 databaseName));
+		StringInfo senderOptions = makeStringInfo();
 		if (CpuPriorityLogicalRepSender != CPU_PRIORITY_INHERIT &&
 			list_length(logicalRepTargetList) <= MaxHighPriorityBackgroundProcesess)
 		{
-			appendStringInfo(conninfo,
-							 " options='-c citus.cpu_priority=%d'",
+			appendStringInfo(senderOptions, " -c citus.cpu_priority=%d",
 							 CpuPriorityLogicalRepSender);
 		}
 
+		if (IoPriorityLogicalRepSender != IO_PRIORITY_INHERIT)
+		{
+			appendStringInfo(senderOptions, " -c citus.io_priority=%s",
+							 GetConfigOption(
+								 "citus.io_priority_for_logical_replication_senders",
+								 false, false));
+		}
+
+		if (senderOptions->len > 0)
+		{
+			appendStringInfo(conninfo, " options='%s'", senderOptions->data + 1);
+		}
+
 		StringInfo createSubscriptionCommand = makeStringInfo();
 		appendStringInfo(createSubscriptionCommand,
 						 "CREATE SUBSCRIPTION %s CONNECTION %s PUBLICATION %s "
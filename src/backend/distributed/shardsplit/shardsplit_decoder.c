@@ -8,8 +8,10 @@
  *-------------------------------------------------------------------------
  */
 #include "postgres.h"
+#include "distributed/citus_safe_lib.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/shardsplit_shared_memory.h"
+#include "distributed/shard_transfer_throttle.h"
 #include "distributed/listutils.h"
 #include "replication/logical.h"
 #include "utils/typcache.h"
@@ -27,8 +29,11 @@ static void split_change_cb(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 /* Helper methods */
 static int32_t GetHashValueForIncomingTuple(Relation sourceShardRelation,
 											HeapTuple tuple,
-											int partitionColumIndex,
-											Oid distributedTableOid);
+											SourceToDestinationShardMapEntry *entry);
+static void BuildShardSplitRouting(SourceToDestinationShardMapEntry *entry,
+								   Relation sourceShardRelation);
+static int CompareShardSplitInfoByMinValue(const void *leftElement,
+										   const void *rightElement);
 
 static Oid FindTargetRelationOid(Relation sourceShardRelation,
 								 HeapTuple tuple,
@@ -200,6 +205,20 @@ split_change_cb(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 
 	pgoutputChangeCB(ctx, txn, targetRelation, change);
 	RelationClose(targetRelation);
+
+	/* the new shards may be on other nodes, so only the node limit applies */
+	uint64 changeByteCount = 0;
+	if (change->data.tp.newtuple != NULL)
+	{
+		changeByteCount += change->data.tp.newtuple->tuple.t_len;
+	}
+
+	if (change->data.tp.oldtuple != NULL)
+	{
+		changeByteCount += change->data.tp.oldtuple->tuple.t_len;
+	}
+
+	ThrottleShardTransfer(SHARD_TRANSFER_ANY_NODE, changeByteCount);
 }
 
 
@@ -240,21 +259,37 @@ FindTargetRelationOid(Relation sourceShardRelation,
 		return InvalidOid;
 	}
 
-	ShardSplitInfo *shardSplitInfo = (ShardSplitInfo *) lfirst(list_head(
-																   entry->
-																   shardSplitInfoList));
-	int hashValue = GetHashValueForIncomingTuple(sourceShardRelation, tuple,
-												 shardSplitInfo->partitionColumnIndex,
-												 shardSplitInfo->distributedTableOid);
+	if (entry->sortedShardSplitInfoArray == NULL)
+	{
+		BuildShardSplitRouting(entry, sourceShardRelation);
+	}
 
-	shardSplitInfo = NULL;
-	foreach_ptr(shardSplitInfo, entry->shardSplitInfoList)
+	int32 hashValue = GetHashValueForIncomingTuple(sourceShardRelation, tuple, entry);
+
+	/* find the last child shard whose range starts at or before the hash value */
+	int lowerIndex = 0;
+	int upperIndex = entry->shardSplitInfoCount;
+	while (lowerIndex < upperIndex)
+	{
+		int middleIndex = lowerIndex + (upperIndex - lowerIndex) / 2;
+
+		if (entry->sortedShardSplitInfoArray[middleIndex]->shardMinValue <= hashValue)
+		{
+			lowerIndex = middleIndex + 1;
+		}
+		else
+		{
+			upperIndex = middleIndex;
+		}
+	}
+
+	/* the slot may only handle some of the child shards, so check the range end */
+	if (lowerIndex > 0)
 	{
-		if (shardSplitInfo->shardMinValue <= hashValue &&
-			shardSplitInfo->shardMaxValue >= hashValue)
+		ShardSplitInfo *shardSplitInfo = entry->sortedShardSplitInfoArray[lowerIndex - 1];
+		if (shardSplitInfo->shardMaxValue >= hashValue)
 		{
 			targetRelationOid = shardSplitInfo->splitChildShardOid;
-			break;
 		}
 	}
 
@@ -262,32 +297,98 @@ FindTargetRelationOid(Relation sourceShardRelation,
 }
 
 
+/*
+ * BuildShardSplitRouting sorts the child shards of the given source shard by
+ * their hash range and looks up the hash function of the partition column,
+ * such that they are not looked up for every change. The routing state lives
+ * as long as the map, in TopMemoryContext.
+ */
+static void
+BuildShardSplitRouting(SourceToDestinationShardMapEntry *entry,
+					   Relation sourceShardRelation)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+	int shardSplitInfoCount = list_length(entry->shardSplitInfoList);
+	ShardSplitInfo **sortedShardSplitInfoArray =
+		(ShardSplitInfo **) palloc0(shardSplitInfoCount * sizeof(ShardSplitInfo *));
+
+	int shardSplitInfoIndex = 0;
+	ShardSplitInfo *shardSplitInfo = NULL;
+	foreach_ptr(shardSplitInfo, entry->shardSplitInfoList)
+	{
+		sortedShardSplitInfoArray[shardSplitInfoIndex++] = shardSplitInfo;
+	}
+
+	SafeQsort(sortedShardSplitInfoArray, shardSplitInfoCount, sizeof(ShardSplitInfo *),
+			  CompareShardSplitInfoByMinValue);
+
+	ShardSplitInfo *firstShardSplitInfo = sortedShardSplitInfoArray[0];
+	TupleDesc relationTupleDes = RelationGetDescr(sourceShardRelation);
+	Form_pg_attribute partitionColumn =
+		TupleDescAttr(relationTupleDes, firstShardSplitInfo->partitionColumnIndex);
+
+	TypeCacheEntry *typeEntry = lookup_type_cache(partitionColumn->atttypid,
+												  TYPECACHE_HASH_PROC_FINFO);
+
+	FmgrInfo *hashFunction = (FmgrInfo *) palloc0(sizeof(FmgrInfo));
+	fmgr_info_copy(hashFunction, &(typeEntry->hash_proc_finfo), TopMemoryContext);
+
+	entry->hashFunction = hashFunction;
+	entry->hashFunctionCollation = typeEntry->typcollation;
+	entry->shardSplitInfoCount = shardSplitInfoCount;
+	entry->sortedShardSplitInfoArray = sortedShardSplitInfoArray;
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * CompareShardSplitInfoByMinValue is a comparator for sorting child shards
+ * by the start of their hash range.
+ */
+static int
+CompareShardSplitInfoByMinValue(const void *leftElement, const void *rightElement)
+{
+	ShardSplitInfo *leftShardSplitInfo = *((ShardSplitInfo **) leftElement);
+	ShardSplitInfo *rightShardSplitInfo = *((ShardSplitInfo **) rightElement);
+
+	if (leftShardSplitInfo->shardMinValue < rightShardSplitInfo->shardMinValue)
+	{
+		return -1;
+	}
+	else if (leftShardSplitInfo->shardMinValue > rightShardSplitInfo->shardMinValue)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+
 /*
  * GetHashValueForIncomingTuple returns the hash value of the partition
- * column for the incoming tuple.
+ * column for the incoming tuple, using the hash function cached in the map
+ * entry of the source shard.
  */
 static int32_t
 GetHashValueForIncomingTuple(Relation sourceShardRelation,
 							 HeapTuple tuple,
-							 int partitionColumnIndex,
-							 Oid distributedTableOid)
+							 SourceToDestinationShardMapEntry *entry)
 {
 	TupleDesc relationTupleDes = RelationGetDescr(sourceShardRelation);
-	Form_pg_attribute partitionColumn = TupleDescAttr(relationTupleDes,
-													  partitionColumnIndex);
+	int partitionColumnIndex = entry->sortedShardSplitInfoArray[0]->partitionColumnIndex;
 
+	/* only deforms the tuple up to the partition column */
 	bool isNull = false;
 	Datum partitionColumnValue = heap_getattr(tuple,
 											  partitionColumnIndex + 1,
 											  relationTupleDes,
 											  &isNull);
 
-	TypeCacheEntry *typeEntry = lookup_type_cache(partitionColumn->atttypid,
-												  TYPECACHE_HASH_PROC_FINFO);
-
 	/* get hashed value of the distribution value */
-	Datum hashedValueDatum = FunctionCall1Coll(&(typeEntry->hash_proc_finfo),
-											   typeEntry->typcollation,
+	Datum hashedValueDatum = FunctionCall1Coll(entry->hashFunction,
+											   entry->hashFunctionCollation,
 											   partitionColumnValue);
 
 	return DatumGetInt32(hashedValueDatum);
@@ -124,6 +124,7 @@ AddPublishableShardEntryInMap(uint32 targetNodeId, ShardInterval *shardInterval,
 	NodeAndOwner key;
 	key.nodeId = targetNodeId;
 	key.tableOwnerId = TableOwnerOid(shardInterval->relationId);
+	key.subscriptionIndex = 0;
 
 	bool found = false;
 	PublicationInfo *publicationInfo =
@@ -211,6 +212,7 @@ PopulateShardSplitSubscriptionsMetadataList(HTAB *shardSplitInfoHashMap,
 			NodeAndOwner key;
 			key.nodeId = workerPlacementNode->nodeId;
 			key.tableOwnerId = TableOwnerOid(shardInterval->relationId);
+			key.subscriptionIndex = 0;
 
 			bool found = false;
 			publication = (PublicationInfo *) hash_search(
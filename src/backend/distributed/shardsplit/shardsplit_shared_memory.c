@@ -352,6 +352,10 @@ PopulateSourceToDestinationShardMapForSlot(char *slotName, MemoryContext cxt)
 			{
 				entry->shardSplitInfoList = NIL;
 				entry->sourceShardKey = sourceShardOid;
+				entry->sortedShardSplitInfoArray = NULL;
+				entry->shardSplitInfoCount = 0;
+				entry->hashFunction = NULL;
+				entry->hashFunctionCollation = InvalidOid;
 			}
 
 			ShardSplitInfo *shardSplitInfoForSlot = (ShardSplitInfo *) palloc0(
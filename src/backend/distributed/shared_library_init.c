@@ -31,8 +31,10 @@
 #include "commands/extension.h"
 #include "common/string.h"
 #include "executor/executor.h"
+#include "distributed/admission_control.h"
 #include "distributed/backend_data.h"
 #include "distributed/background_jobs.h"
+#include "distributed/binary_copy_passthrough.h"
 #include "distributed/causal_clock.h"
 #include "distributed/citus_depended_object.h"
 #include "distributed/citus_nodefuncs.h"
@@ -40,22 +42,33 @@
 #include "distributed/commands.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/commands/utility_hook.h"
+#include "distributed/compressed_copy.h"
 #include "distributed/connection_management.h"
 #include "distributed/cte_inline.h"
+#include "distributed/directed_acyclic_graph_execution.h"
+#include "distributed/distributed_command_progress.h"
 #include "distributed/distributed_deadlock_detection.h"
 #include "distributed/errormessage.h"
 #include "distributed/insert_select_executor.h"
+#include "distributed/intermediate_result_column_batches.h"
+#include "distributed/intermediate_result_compression.h"
+#include "distributed/intermediate_results.h"
 #include "distributed/intermediate_result_pruning.h"
 #include "distributed/local_multi_copy.h"
 #include "distributed/local_executor.h"
+#include "distributed/local_plan_cache.h"
 #include "distributed/local_distributed_join_planner.h"
 #include "distributed/locally_reserved_shared_connections.h"
+#include "distributed/hot_tenant_isolation.h"
+#include "distributed/lock_graph.h"
 #include "distributed/log_utils.h"
 #include "distributed/maintenanced.h"
 #include "distributed/shard_cleaner.h"
 #include "distributed/metadata_utility.h"
 #include "distributed/coordinator_protocol.h"
+#include "distributed/metadata/dependency.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/metadata_cache_warmup.h"
 #include "distributed/metadata_sync.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_executor.h"
@@ -64,15 +77,23 @@
 #include "distributed/multi_logical_replication.h"
 #include "distributed/multi_logical_optimizer.h"
 #include "distributed/distributed_planner.h"
+#include "distributed/distributed_table_statistics.h"
 #include "distributed/combine_query_planner.h"
+#include "distributed/parallel_combine.h"
+#include "distributed/parallel_result_scan.h"
+#include "distributed/parallel_local_table_copy.h"
+#include "distributed/parallel_multi_copy.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/placement_connection.h"
+#include "distributed/planner_timing.h"
 #include "distributed/priority.h"
+#include "distributed/query_result_cache.h"
 #include "distributed/query_stats.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/reference_table_utils.h"
+#include "distributed/reference_table_write_batch.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/run_from_same_connection.h"
 #include "distributed/shard_cleaner.h"
@@ -81,23 +102,40 @@
 #include "distributed/shardsplit_shared_memory.h"
 #include "distributed/query_pushdown_planning.h"
 #include "distributed/time_constants.h"
+#include "distributed/trace_context.h"
 #include "distributed/query_stats.h"
 #include "distributed/remote_commands.h"
+#include "distributed/shard_access_stats.h"
 #include "distributed/shard_rebalancer.h"
+#include "distributed/shard_transfer_throttle.h"
 #include "distributed/shared_library_init.h"
+#include "distributed/shared_metadata_cache.h"
+#include "distributed/sorted_merge.h"
+#include "distributed/stat_activity_snapshot.h"
 #include "distributed/statistics_collection.h"
+#include "distributed/shard_size_cache.h"
+#include "distributed/shard_split.h"
+#include "distributed/table_row_estimates.h"
+#include "distributed/tenant_load_stats.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/resource_lock.h"
+#include "distributed/router_placement_cache.h"
+#include "distributed/routing_table.h"
 #include "distributed/transaction_management.h"
 #include "distributed/transaction_recovery.h"
+#include "distributed/transmit.h"
+#include "distributed/tuple_destination.h"
 #include "distributed/utils/directory.h"
 #include "distributed/worker_log_messages.h"
 #include "distributed/worker_manager.h"
+#include "distributed/worker_prepared_statements.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/worker_shard_visibility.h"
+#include "distributed/worker_transaction.h"
 #include "distributed/adaptive_executor.h"
 #include "libpq/auth.h"
 #include "port/atomics.h"
+#include "postmaster/bgworker_internals.h"
 #include "postmaster/postmaster.h"
 #include "replication/walsender.h"
 #include "storage/ipc.h"
@@ -192,12 +230,19 @@ static bool ShowShardsForAppNamePrefixesCheckHook(char **newval, void **extra,
 static void ShowShardsForAppNamePrefixesAssignHook(const char *newval, void *extra);
 static void ApplicationNameAssignHook(const char *newval, void *extra);
 static void CpuPriorityAssignHook(int newval, void *extra);
+static void IoPriorityAssignHook(int newval, void *extra);
 static bool NodeConninfoGucCheckHook(char **newval, void **extra, GucSource source);
 static void NodeConninfoGucAssignHook(const char *newval, void *extra);
 static const char * MaxSharedPoolSizeGucShowHook(void);
 static const char * LocalPoolSizeGucShowHook(void);
+static bool TraceContextGucCheckHook(char **newval, void **extra, GucSource source);
+static const char * TraceContextGucShowHook(void);
+static bool HotTenantIsolationWindowGucCheckHook(char **newval, void **extra,
+												 GucSource source);
 static bool StatisticsCollectionGucCheckHook(bool *newval, void **extra, GucSource
 											 source);
+static bool ShardIndexBuildMaintenanceWorkMemCheckHook(int *newval, void **extra,
+													   GucSource source);
 static void CitusAuthHook(Port *port, int status);
 static bool IsSuperuser(char *userName);
 
@@ -223,6 +268,7 @@ static const struct config_enum_entry task_assignment_policy_options[] = {
 	{ "greedy", TASK_ASSIGNMENT_GREEDY, false },
 	{ "first-replica", TASK_ASSIGNMENT_FIRST_REPLICA, false },
 	{ "round-robin", TASK_ASSIGNMENT_ROUND_ROBIN, false },
+	{ "least-loaded", TASK_ASSIGNMENT_LEAST_LOADED, false },
 	{ NULL, 0, false }
 };
 
@@ -242,6 +288,7 @@ static const struct config_enum_entry task_executor_type_options[] = {
 static const struct config_enum_entry use_secondary_nodes_options[] = {
 	{ "never", USE_SECONDARY_NODES_NEVER, false },
 	{ "always", USE_SECONDARY_NODES_ALWAYS, false },
+	{ "caught_up", USE_SECONDARY_NODES_CAUGHT_UP, false },
 	{ NULL, 0, false }
 };
 
@@ -296,6 +343,17 @@ static const struct config_enum_entry create_object_propagation_options[] = {
 	{NULL,        0,                                   false}
 };
 
+static const struct config_enum_entry intermediate_result_compression_options[] = {
+	{ "none", INTERMEDIATE_RESULT_COMPRESSION_NONE, false },
+#if HAVE_CITUS_LIBLZ4
+	{ "lz4", INTERMEDIATE_RESULT_COMPRESSION_LZ4, false },
+#endif
+#if HAVE_LIBZSTD
+	{ "zstd", INTERMEDIATE_RESULT_COMPRESSION_ZSTD, false },
+#endif
+	{ NULL, 0, false }
+};
+
 /*
  * This used to choose CPU priorities for GUCs. For most other integer options
  * we use the -1 value as inherit/default/unset. For CPU priorities this isn't
@@ -353,6 +411,15 @@ static const struct config_enum_entry cpu_priority_options[] = {
 	{ NULL, 0, false}
 };
 
+static const struct config_enum_entry io_priority_options[] = {
+	{ "inherit", IO_PRIORITY_INHERIT, false },
+	{ "high", IO_PRIORITY_HIGH, false },
+	{ "normal", IO_PRIORITY_NORMAL, false },
+	{ "low", IO_PRIORITY_LOW, false },
+	{ "idle", IO_PRIORITY_IDLE, false },
+	{ NULL, 0, false }
+};
+
 
 /* *INDENT-ON* */
 
@@ -462,6 +529,18 @@ _PG_init(void)
 	InitializeSharedConnectionStats();
 	InitializeLocallyReservedSharedConnections();
 	InitializeClusterClockMem();
+	InitializeTableRowEstimates();
+	InitializeSharedMetadataCache();
+	InitializeMetadataCacheWarmup();
+	InitializeShardAccessStats();
+	InitializeShardTransferThrottle();
+	InitializeShardSizeCache();
+	InitializeStatActivitySnapshot();
+	InitializeDistributedCommandProgress();
+	InitializeTenantLoadStats();
+	InitializeRoutingTable();
+	InitializeQueryResultCache();
+	InitializeExecutionAdmission();
 
 	/* initialize shard split shared memory handle management */
 	InitializeShardSplitSMHandleManagement();
@@ -548,6 +627,18 @@ citus_shmem_request(void)
 	RequestAddinShmemSpace(MaintenanceDaemonShmemSize());
 	RequestAddinShmemSpace(CitusQueryStatsSharedMemSize());
 	RequestAddinShmemSpace(LogicalClockShmemSize());
+	RequestAddinShmemSpace(TableRowEstimatesShmemSize());
+	RequestAddinShmemSpace(SharedMetadataCacheShmemSize());
+	RequestAddinShmemSpace(MetadataCacheWarmupShmemSize());
+	RequestAddinShmemSpace(ShardAccessStatsShmemSize());
+	RequestAddinShmemSpace(ShardTransferThrottleShmemSize());
+	RequestAddinShmemSpace(ShardSizeCacheShmemSize());
+	RequestAddinShmemSpace(StatActivitySnapshotShmemSize());
+	RequestAddinShmemSpace(DistributedCommandProgressShmemSize());
+	RequestAddinShmemSpace(TenantLoadStatsShmemSize());
+	RequestAddinShmemSpace(RoutingTableShmemSize());
+	RequestAddinShmemSpace(QueryResultCacheShmemSize());
+	RequestAddinShmemSpace(ExecutionAdmissionShmemSize());
 	RequestNamedLWLockTranche(STATS_SHARED_MEM_NAME, 1);
 }
 
@@ -914,6 +1005,22 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.coarse_shard_lock_threshold",
+		gettext_noop("Sets the number of shards of a co-location group from which "
+					 "a single lock replaces the shard locks of the group."),
+		gettext_noop("Multi-shard modifications take one lock per shard. When a "
+					 "single lock request covers at least this many shards of a "
+					 "co-location group in a mode of SHARE or stronger, a single "
+					 "lock on the co-location group is taken instead. To make this "
+					 "safe, every shard lock also takes a weak lock on the "
+					 "co-location group of the shard. 0 disables this."),
+		&CoarseShardLockThreshold,
+		0, 0, INT_MAX,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.coordinator_aggregation_strategy",
 		gettext_noop("Sets the strategy for when an aggregate cannot be pushed down. "
@@ -1076,6 +1183,89 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		ErrorIfNotASuitableDeadlockFactor, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.distributed_deadlock_detection_min_wait_time",
+		gettext_noop("Sets the time a distributed transaction needs to wait for a "
+					 "lock before it is considered by distributed deadlock detection."),
+		gettext_noop("Transactions that only wait briefly cannot be part of a "
+					 "deadlock that persists, so skipping them reduces the number "
+					 "of wait edges that each node sends to the coordinator. "
+					 "A deadlock is still detected, but may take up to this long "
+					 "longer to be detected. The setting should be the same on "
+					 "all nodes. 0 disables the filter."),
+		&DistributedDeadlockMinWaitTime,
+		0, 0, INT_MAX,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.distributed_sequence_cache_size",
+		gettext_noop("Sets the number of values of sequences used in distributed "
+					 "tables that each backend preallocates."),
+		gettext_noop("When a table with a sequence-backed default is distributed, "
+					 "a CACHE setting of 1 of the sequence is raised to this value "
+					 "on all nodes, such that inserts through the coordinator do "
+					 "not access the sequence for every row. Values are then not "
+					 "assigned in order across backends. undistribute_table "
+					 "restores the CACHE setting. 0 leaves the sequences as is."),
+		&DistributedSequenceCacheSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.distributed_statistics_refresh_interval",
+		gettext_noop("Sets the time to wait between refreshes of the column "
+					 "statistics of distributed tables."),
+		gettext_noop("The maintenance daemon on the coordinator periodically "
+					 "samples rows from the shards of all distributed and "
+					 "reference tables, and stores the column statistics for "
+					 "their shell tables, like citus_analyze_distributed() "
+					 "does. Use 0 to disable."),
+		&DistributedStatisticsRefreshInterval,
+		0, 0, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.distributed_table_write_batch_size",
+		gettext_noop("Sets the maximum number of single-row writes to hash "
+					 "distributed tables that are held back within a transaction "
+					 "block."),
+		gettext_noop("When set to a value larger than 1, single-row INSERTs into "
+					 "hash distributed tables in a transaction block are not sent "
+					 "to the shard placements right away. Instead, consecutive "
+					 "writes into the same shard are sent together as a single "
+					 "command when this many writes are pending, or when the next "
+					 "statement, savepoint or the commit starts. Errors in the held "
+					 "back writes are reported by the statement that sends them. "
+					 "0 disables batching."),
+		&DistributedTableWriteBatchSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_adaptive_copy_flush",
+		gettext_noop("Sizes the COPY flush threshold of each connection from "
+					 "its observed throughput."),
+		gettext_noop("When enabled, Citus measures how fast the COPY data "
+					 "buffered for a connection drains to the worker and "
+					 "flushes fast connections in large batches and slow "
+					 "connections in small batches, such that a slow worker "
+					 "does not hold up the others for long. "
+					 "citus.remote_copy_flush_threshold is the upper bound "
+					 "of the threshold."),
+		&EnableAdaptiveCopyFlush,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_alter_database_owner",
 		gettext_noop("Enables propagating ALTER DATABASE ... OWNER TO ... statements to "
@@ -1108,6 +1298,38 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_binary_copy_passthrough",
+		gettext_noop("Enables forwarding rows of a binary COPY to the shards "
+					 "without deserializing them"),
+		gettext_noop("When the client sends COPY data in binary format and the "
+					 "shards receive binary COPY data as well, only the "
+					 "distribution column of each row is read to find its shard "
+					 "and the row is forwarded as it was sent. Invalid values in "
+					 "other columns are then reported by the worker nodes."),
+		&EnableBinaryCopyPassthrough,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_binary_partial_aggregates",
+		gettext_noop("Enables sending partial aggregate states in binary form"),
+		gettext_noop("Aggregates without a built-in distributed implementation "
+					 "send their transition state from the workers to the "
+					 "coordinator. When enabled, the state is sent as bytea "
+					 "produced by the serialfunc of the aggregate or the send "
+					 "function of the transition type, which also allows "
+					 "aggregates with internal transition state to be "
+					 "pushed down. All nodes need to run a Citus version "
+					 "that has the worker_partial_agg_binary aggregate."),
+		&EnableBinaryPartialAggregates,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_binary_protocol",
 		gettext_noop(
@@ -1123,6 +1345,22 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_bulk_metadata_sync",
+		gettext_noop("Sends shard and placement metadata in bulk when activating "
+					 "a node"),
+		gettext_noop("When enabled, node activation broadcasts the pg_dist_shard "
+					 "and pg_dist_placement rows of all tables to the nodes as "
+					 "intermediate results via COPY, and the nodes insert them "
+					 "from there, instead of receiving a generated command with "
+					 "all rows of each table. This makes activating nodes in "
+					 "clusters with many shards considerably faster."),
+		&EnableBulkMetadataSync,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_cluster_clock",
 		gettext_noop("When users explicitly call UDF citus_get_transaction_clock() "
@@ -1136,6 +1374,51 @@ RegisterCitusConfigVariables(void)
 		PGC_USERSET,
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_column_batched_intermediate_results",
+		gettext_noop("Writes intermediate results in batches of columns"),
+		gettext_noop("When enabled, intermediate results are written in batches "
+					 "that store the values of each column together, instead of "
+					 "in COPY format. Values of built-in fixed-width types are "
+					 "then read without parsing them. All nodes need to run a "
+					 "version of Citus that can read column batches."),
+		&EnableColumnBatchedIntermediateResults,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_compact_shard_intervals",
+		gettext_noop("Caches uniformly hashed shards without building their "
+					 "intervals"),
+		gettext_noop("When enabled, the metadata cache of a hash distributed "
+					 "table whose shards have a uniform hash distribution and "
+					 "consecutive shard IDs only stores the shard count and the "
+					 "first shard ID. The interval of a shard is built when it "
+					 "is first used, which reduces the memory use and build "
+					 "time of the cache for tables with many shards."),
+		&EnableCompactShardIntervals,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_copy_serialization_cache",
+		gettext_noop("Keeps the functions that COPY uses to serialize rows for "
+					 "shards across statements"),
+		gettext_noop("By default, every COPY into a distributed table looks up "
+					 "the output and coercion functions of its columns. When "
+					 "enabled, they are cached for the rest of the session, "
+					 "which helps loaders that send many small COPY commands."),
+		&EnableCopySerializationCache,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_cost_based_connection_establishment",
 		gettext_noop("When enabled the connection establishment times "
@@ -1148,6 +1431,23 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_cost_based_join_order",
+		gettext_noop("Uses table row estimates to choose the join order of "
+					 "repartition joins."),
+		gettext_noop("When enabled, the planner picks the join order that is "
+					 "estimated to shuffle the fewest rows between the nodes, "
+					 "based on the row estimates that are collected every "
+					 "citus.table_row_estimate_refresh_interval. Single hash "
+					 "repartition joins are considered in this mode. If a "
+					 "table has no row estimate, the rule-based join order "
+					 "is used."),
+		&EnableCostBasedJoinOrder,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_create_role_propagation",
 		gettext_noop("Enables propagating CREATE ROLE "
@@ -1169,6 +1469,22 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_cte_predicate_pushdown",
+		gettext_noop("Enables pushing filters into CTEs that are planned "
+					 "recursively."),
+		gettext_noop("When enabled, the deterministic filters of a query that "
+					 "only reference the columns of a CTE that the query "
+					 "references once, and joins with an inner join, are added "
+					 "to the CTE before it is executed. That makes the "
+					 "intermediate result of the CTE smaller. CTEs that are "
+					 "explicitly MATERIALIZED are not changed."),
+		&EnableCTEPredicatePushdown,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_ddl_propagation",
 		gettext_noop("Enables propagating DDL statements to worker shards"),
@@ -1194,6 +1510,51 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_dependency_cache",
+		gettext_noop("Caches the dependencies of objects in each backend"),
+		gettext_noop("Propagating DDL commands and activating nodes follow the "
+					 "dependencies of objects through pg_depend and pg_shdepend, "
+					 "often for the same objects many times. When enabled, the "
+					 "dependencies found for an object are cached in the backend "
+					 "until any relation, type, function, schema, collation, role, "
+					 "foreign server or text search object changes."),
+		&EnableDependencyCache,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_early_connection_establishment",
+		gettext_noop("Starts connecting to the target node of router queries "
+					 "during planning."),
+		gettext_noop("When enabled, the router planner starts establishing the "
+					 "connection to the remote placement of a single shard query "
+					 "as soon as the placement is known, and the executor picks "
+					 "up the connection that is being established. This hides "
+					 "part of the connection latency when no cached connection "
+					 "to the node is available."),
+		&EnableEarlyConnectionEstablishment,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_fast_path_array_filters",
+		gettext_noop("Enables the fast path router planner for IN-lists and "
+					 "= ANY(array) filters on the distribution column"),
+		gettext_noop("When enabled, single table queries that filter the "
+					 "distribution column with an IN-list or = ANY(array) skip "
+					 "the regular planners. The values are grouped by shard and "
+					 "each task only gets the values of its own shard."),
+		&EnableFastPathArrayFilters,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_fast_path_router_planner",
 		gettext_noop("Enables fast path router planner"),
@@ -1204,6 +1565,66 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_generic_multi_shard_plans",
+		gettext_noop("Enables generic plans for multi-shard prepared SELECT queries"),
+		gettext_noop("When enabled, multi-shard SELECT queries that only join "
+					 "distributed and reference tables are planned once with their "
+					 "parameters unresolved, which allows Postgres to cache the plan "
+					 "of a prepared statement. Parameters then do not prune shards."),
+		&EnableGenericMultiShardPlans,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_known_shard_cache",
+		gettext_noop("Caches in each backend which relations are shards"),
+		gettext_noop("Hiding shards from pg_class checks for every relation "
+					 "whether it is a shard, which takes several catalog lookups "
+					 "per relation. When enabled, the results are cached in the "
+					 "backend until the relation, its table or its distributed "
+					 "table changes, which makes listing relations on nodes with "
+					 "many shards considerably faster."),
+		&EnableKnownShardCache,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_lazy_placement_loading",
+		gettext_noop("Reads the placements of a shard into the metadata cache "
+					 "when they are first used"),
+		gettext_noop("By default, building the metadata cache entry of a "
+					 "distributed table reads the placements of all its shards. "
+					 "When enabled, the placements of each shard are only read "
+					 "from pg_dist_placement when a query first needs them, "
+					 "which makes single shard queries on tables with many "
+					 "shards cheaper right after the cache was invalidated."),
+		&EnableLazyPlacementLoading,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_local_copy_multi_insert",
+		gettext_noop("Writes rows of a COPY into local shard placements without "
+					 "serializing them."),
+		gettext_noop("By default, rows that a COPY sends to a shard placement on "
+					 "the local node are serialized into the COPY format and "
+					 "parsed again by a local COPY into the shard. When enabled, "
+					 "the rows are written with table_multi_insert instead, "
+					 "unless the shard has triggers, generated columns, row "
+					 "level security or columns that need defaults."),
+		&EnableLocalCopyMultiInsert,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_local_execution",
 		gettext_noop("Enables queries on shards that are local to the current node "
@@ -1215,6 +1636,22 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_local_execution_from_query_tree",
+		gettext_noop("Plans local shard queries from the query tree instead of "
+					 "the query string."),
+		gettext_noop("By default, local execution deparses the shard query of a "
+					 "router query and parses it again before planning it. When "
+					 "enabled, the distributed tables in the query tree are "
+					 "replaced by their local shards instead, unless the "
+					 "columns of a shard might differ from those of its table "
+					 "or the query uses ON CONFLICT or row level security."),
+		&EnableLocalExecutionFromQueryTree,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_local_reference_table_foreign_keys",
 		gettext_noop("Enables foreign keys from/to local tables"),
@@ -1259,6 +1696,175 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_multi_shard_local_plan_caching",
+		gettext_noop("Enables caching the local plans of multi-shard queries."),
+		gettext_noop("When enabled, prepared multi-shard queries cache a plan "
+					 "for each of their tasks that is executed locally, rather "
+					 "than planning the shard queries on every execution. The "
+					 "number of cached plans is bounded by "
+					 "citus.max_cached_local_plans."),
+		&EnableMultiShardLocalPlanCaching,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_nested_shard_joins",
+		gettext_noop("Enables local joins between hash distributed tables whose "
+					 "shard ranges nest."),
+		gettext_noop("Tables with different shard counts are not co-located, "
+					 "so joins between them are repartitioned. When enabled, "
+					 "a join on the distribution columns of such tables is "
+					 "done locally if each shard of one table covers whole "
+					 "shards of the other, as with 32 and 128 shards, and the "
+					 "covered shards are placed on the same nodes."),
+		&EnableNestedShardJoins,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_overlapping_local_execution",
+		gettext_noop("Runs the local tasks of a read while its remote tasks are "
+					 "in flight."),
+		gettext_noop("By default, the local tasks of a query that also has "
+					 "remote tasks run after the remote tasks are finished. "
+					 "When enabled, read-only queries send their remote tasks "
+					 "first, run the local tasks while the workers are busy and "
+					 "process the arrived results in between local tasks."),
+		&EnableOverlappingLocalExecution,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+
+		gettext_noop("Enables parallel workers for the combine query on the "
+					 "coordinator"),
+		gettext_noop("When enabled, the rows returned by the workers can be "
+					 "read by postgres parallel workers through a shared "
+					 "tuple store, such that the standard planner can use "
+					 "partial and finalize aggregation for the parallel-safe "
+					 "parts of the combine query."),
+		&EnableParallelCombine,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_parallel_copy_to",
+		gettext_noop("Exports multiple shards at once in COPY .. TO of a "
+					 "distributed table."),
+		gettext_noop("By default, COPY .. TO exports the shards of a distributed "
+					 "table one at a time and in shard order. When enabled, up to "
+					 "citus.max_adaptive_executor_pool_size shards per node are "
+					 "exported at once, and rows are forwarded from whichever "
+					 "shard has data ready, so the order of the rows is not "
+					 "defined."),
+		&EnableParallelCopyTo,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_parallel_result_scan",
+		gettext_noop("Enables parallel workers for reading intermediate results."),
+		gettext_noop("When enabled, the rows of an intermediate result can be "
+					 "read by postgres parallel workers through a shared tuple "
+					 "store, such that the standard planner can use parallel "
+					 "joins and aggregates above the result, for instance when "
+					 "joining a recursively planned subquery with local tables "
+					 "on the coordinator."),
+		&EnableParallelResultScan,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_parallel_subplans",
+		gettext_noop("Executes the distributed queries of independent subplans "
+					 "at once."),
+		gettext_noop("By default, the subplans of a query, such as CTEs and "
+					 "subqueries that are planned recursively, execute one after "
+					 "the other. When enabled, the tasks of consecutive read-only "
+					 "subplans that do not use each other's results are sent to "
+					 "the workers together, such that they run concurrently "
+					 "within citus.max_adaptive_executor_pool_size."),
+		&EnableParallelSubPlans,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartition_dataflow_scheduling",
+		gettext_noop("Starts the tasks of a repartition join as soon as their own "
+					 "dependencies are completed."),
+		gettext_noop("By default, the tasks of a repartition join run in levels, "
+					 "where all the map tasks finish before the fragments are "
+					 "fetched. When enabled, the tasks run through a single "
+					 "execution that starts each task once the tasks it depends "
+					 "on are done, such that a slow map task only holds back the "
+					 "tasks that need its output. Repartition joins that access "
+					 "shards on the local node still run in levels."),
+		&EnableRepartitionDataflowScheduling,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartition_fragment_coalescing",
+		gettext_noop("Fetches the fragments of all map tasks on a node at once "
+					 "in repartition joins."),
+		gettext_noop("By default, each merge task of a repartition join fetches "
+					 "the fragment of every map task separately. When enabled, "
+					 "a merge task fetches the fragments of all map tasks that "
+					 "ran on the same node with a single command, which saves a "
+					 "round trip for every additional map task on a node."),
+		&EnableRepartitionFragmentCoalescing,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartition_join_filters",
+		gettext_noop("Filters rows without a join partner in dual repartition joins."),
+		gettext_noop("When enabled, one side of a dual repartition join builds a "
+					 "bloom filter of its join keys before any data is shuffled. "
+					 "The other side then skips the rows whose join key is not "
+					 "in the filter, which reduces the amount of data that is "
+					 "shuffled for selective joins."),
+		&EnableRepartitionJoinFilters,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartition_join_skew_handling",
+		gettext_noop("Spreads the rows of frequent join keys in dual repartition "
+					 "joins."),
+		gettext_noop("When enabled, the join keys of one side of a dual repartition "
+					 "join are sampled before any data is shuffled. That side "
+					 "spreads the rows of join keys that are more frequent than "
+					 "the average partition size across all partitions, and the "
+					 "other side sends its rows with those keys to all partitions, "
+					 "such that a single frequent key does not make one merge "
+					 "task much slower than all others."),
+		&EnableRepartitionJoinSkewHandling,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_repartition_joins",
 		gettext_noop("Allows Citus to repartition data between nodes."),
@@ -1279,6 +1885,22 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_repartitioned_window_functions",
+		gettext_noop("Enables repartitioning the rows of window functions that "
+					 "do not partition by the distribution column."),
+		gettext_noop("When all the window functions of a query partition by a "
+					 "common column, the rows are hash repartitioned across the "
+					 "workers by that column and the workers evaluate the window "
+					 "functions, instead of the coordinator evaluating them over "
+					 "all the rows. Queries that also group or aggregate keep "
+					 "evaluating the window functions on the coordinator."),
+		&EnableRepartitionedWindowFunctions,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_router_execution",
 		gettext_noop("Enables router execution"),
@@ -1289,6 +1911,53 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_router_placement_cache",
+		gettext_noop("Caches the shard and placements that distribution column "
+					 "values of fast path router queries route to."),
+		gettext_noop("When enabled, each backend remembers the shard and the "
+					 "active placements for recently queried values of hash "
+					 "distributed tables, such that repeated router queries for "
+					 "the same values skip building the placement list. The "
+					 "cache is discarded whenever the metadata changes."),
+		&EnableRouterPlacementCache,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_shard_level_invalidation",
+		gettext_noop("Enables rebuilding only the changed shard placements in the "
+					 "metadata cache."),
+		gettext_noop("When enabled, changes to the placements of a shard are "
+					 "recorded in shared memory, such that backends that "
+					 "rebuild the metadata of the table afterwards only re-read "
+					 "the placements of that shard instead of all shards of "
+					 "the table. Changes made by prepared transactions still "
+					 "cause full rebuilds."),
+		&EnableShardLevelInvalidation,
+		false,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_shared_shard_layouts",
+		gettext_noop("Shares the hash ranges of the shards of colocated tables "
+					 "in the metadata cache"),
+		gettext_noop("When enabled, the metadata cache stores the hash ranges of "
+					 "the shards of a colocation group once, and only stores "
+					 "the shard IDs for each of its tables. The interval of a "
+					 "shard is built when it is first used, which reduces the "
+					 "memory use of the cache for partitioned tables with many "
+					 "partitions."),
+		&EnableSharedShardLayouts,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_single_hash_repartition_joins",
 		gettext_noop("Enables single hash repartitioning between hash "
@@ -1300,6 +1969,53 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_sorted_merge",
+		gettext_noop("Enables merging sorted task results on the coordinator."),
+		gettext_noop("When the workers return the rows of a multi-shard query "
+					 "in the ORDER BY order of the query, the coordinator "
+					 "merges the rows of the tasks as they arrive instead of "
+					 "sorting all of them again, and stops reading once it "
+					 "returned the rows that the LIMIT needs."),
+		&EnableSortedMerge,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_sorted_merge_aggregation",
+		gettext_noop("Enables combining the sorted groups of the tasks on the "
+					 "coordinator."),
+		gettext_noop("When a multi-shard query groups by columns other than the "
+					 "distribution column, the workers sort their groups by the "
+					 "GROUP BY keys and the coordinator merges the groups of the "
+					 "tasks in that order, such that it can combine adjacent "
+					 "groups with a GroupAggregate whose memory use depends on "
+					 "the number of tasks rather than the number of groups."),
+		&EnableSortedMergeAggregation,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_spilled_result_compression",
+		gettext_noop("Compresses the wide values of result sets that do not fit "
+					 "in work_mem on the coordinator."),
+		gettext_noop("The results of distributed queries are collected in a tuple "
+					 "store, which writes them to a temporary file once they "
+					 "exceed work_mem. When enabled, the variable-length values "
+					 "of the tuples beyond work_mem are compressed with the "
+					 "default_toast_compression method before they are stored, "
+					 "which reduces temporary file I/O for wide result sets at "
+					 "the cost of compressing and decompressing the values."),
+		&EnableSpilledResultCompression,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_statistics_collection",
 		gettext_noop("Enables sending basic usage statistics to Citus."),
@@ -1319,13 +2035,61 @@ RegisterCitusConfigVariables(void)
 		NULL, NULL);
 
 	DefineCustomBoolVariable(
-		"citus.enable_unique_job_ids",
-		gettext_noop("Enables unique job IDs by prepending the local process ID and "
-					 "group ID. This should usually be enabled, but can be disabled "
-					 "for repeatable output in regression tests."),
-		NULL,
-		&EnableUniqueJobIds,
-		true,
+		"citus.enable_streaming_repartition",
+		gettext_noop("Enables streaming repartitioned INSERT..SELECT results to "
+					 "the nodes of the target shards."),
+		gettext_noop("By default, each worker writes the partitions of its "
+					 "part of a repartitioned INSERT..SELECT to local files, "
+					 "which are fetched by the nodes of the target shards once "
+					 "all partitions are written. When enabled, the partitions "
+					 "are sent to the nodes of the target shards while they "
+					 "are produced. This only applies when the source tasks and "
+					 "the target shards each have a single placement."),
+		&EnableStreamingRepartition,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_streaming_results",
+		gettext_noop("Enables returning rows of multi-shard queries while "
+					 "the execution is running."),
+		gettext_noop("By default, the adaptive executor writes all the rows of "
+					 "a multi-shard SELECT to a tuple store before returning the "
+					 "first row. When enabled, read-only queries that run outside "
+					 "of a transaction block return the rows as they arrive from "
+					 "the workers, and only keep the rows that are not returned "
+					 "yet in memory."),
+		&EnableStreamingResults,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_subplan_deduplication",
+		gettext_noop("Enables sharing intermediate results between identical "
+					 "subqueries and CTEs."),
+		gettext_noop("When enabled, recursive planning creates a single subplan "
+					 "for structurally identical subqueries and CTEs in a query, "
+					 "such that the intermediate result is computed and "
+					 "broadcast only once. Subqueries with volatile functions "
+					 "always get their own subplan."),
+		&EnableSubPlanDeduplication,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_unique_job_ids",
+		gettext_noop("Enables unique job IDs by prepending the local process ID and "
+					 "group ID. This should usually be enabled, but can be disabled "
+					 "for repeatable output in regression tests."),
+		NULL,
+		&EnableUniqueJobIds,
+		true,
 		PGC_USERSET,
 		GUC_SUPERUSER_ONLY | GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
@@ -1362,6 +2126,36 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_worker_prepared_statements",
+		gettext_noop("Sends parameterized router queries to the workers through "
+					 "named prepared statements"),
+		gettext_noop("When enabled, a connection prepares the shard query of a "
+					 "parameterized router query the first time it runs it, and "
+					 "afterwards only sends the parameters, which saves parse and "
+					 "plan time on the workers. The statements are deallocated "
+					 "after DDL on distributed tables or other metadata changes."),
+		&EnableWorkerPreparedStatements,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_zero_copy_result_transfer",
+		gettext_noop("Sends intermediate result files to other nodes without "
+					 "copying them through the backend"),
+		gettext_noop("When enabled, a node that serves an intermediate result "
+					 "file over an unencrypted connection lets the kernel send "
+					 "the file to the socket directly with sendfile(), which "
+					 "reduces the CPU usage of large shuffles. Only available "
+					 "on Linux."),
+		&EnableZeroCopyResultTransfer,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enforce_foreign_key_restrictions",
 		gettext_noop("Enforce restrictions while querying distributed/reference "
@@ -1386,6 +2180,40 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.executor_pipeline_depth",
+		gettext_noop("Sets the maximum number of read tasks that are sent over "
+					 "a connection before waiting for their results."),
+		gettext_noop("When a connection executes multiple tasks of a multi-shard "
+					 "query, the executor normally waits for the results of a "
+					 "task before sending the next one, which costs a network "
+					 "round trip per task. When this setting is larger than 1, "
+					 "the executor sends up to this many single-query read tasks "
+					 "in a libpq pipeline and processes their results in order. "
+					 "This requires PostgreSQL 14 or later."),
+		&ExecutorPipelineDepth,
+		1, 1, 1000,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.executor_result_chunk_size",
+		gettext_noop("Sets the maximum number of rows that are fetched from a "
+					 "worker in a single result."),
+		gettext_noop("The executor processes the rows of a task as they arrive "
+					 "such that the memory used on the coordinator does not "
+					 "depend on the size of the result. By default, rows are "
+					 "fetched one by one, which has some overhead per row. "
+					 "When this setting is larger than 1 and libpq supports "
+					 "chunked rows mode (PostgreSQL 17 or later), rows are "
+					 "fetched in batches of up to this many rows instead."),
+		&ExecutorResultChunkSize,
+		1, 1, 100000,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.executor_slow_start_interval",
 		gettext_noop("Time to wait between opening connections to the same worker node"),
@@ -1402,6 +2230,45 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS | GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.executor_task_group_size",
+		gettext_noop("Sets the maximum number of read tasks for the same worker "
+					 "that are sent as a single query."),
+		gettext_noop("When a multi-shard query reads many shards on the same "
+					 "worker, every task normally costs a round trip and a "
+					 "separate statement on the worker. When this setting is "
+					 "larger than 1, the executor combines up to this many "
+					 "read tasks for the same worker into a single UNION ALL "
+					 "query. Fewer tasks also means less parallelism on the "
+					 "worker, so a high value is mainly useful for queries "
+					 "that read many small shards. Tasks are not combined "
+					 "inside transaction blocks."),
+		&ExecutorTaskGroupSize,
+		1, 1, 1000,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.executor_utility_task_group_size",
+		gettext_noop("Sets the maximum number of shard commands of a utility "
+					 "command for the same worker that are sent as a single "
+					 "command."),
+		gettext_noop("Commands such as CREATE INDEX, ALTER TABLE and TRUNCATE "
+					 "normally cost a round trip for every shard. When this "
+					 "setting is larger than 1, the executor combines up to this "
+					 "many shard commands for the same worker into a single "
+					 "multi-statement command, and runs the commands for "
+					 "different workers in parallel. Commands are not combined "
+					 "inside transaction blocks, after the table was accessed in "
+					 "the transaction, or when they cannot run in a transaction "
+					 "block."),
+		&ExecutorUtilityTaskGroupSize,
+		1, 1, 10000,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.explain_all_tasks",
 		gettext_noop("Enables showing output for all tasks in Explain."),
@@ -1415,6 +2282,22 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.explain_analyze_network_metrics",
+		gettext_noop("Shows network and connection metrics of tasks in "
+					 "EXPLAIN ANALYZE."),
+		gettext_noop("When enabled, EXPLAIN ANALYZE shows for every task how long "
+					 "it waited for a connection and for its first row, how many "
+					 "round trips it took and whether it reused an established "
+					 "connection, as well as the time the coordinator spent "
+					 "decoding results and waiting for the workers. This helps "
+					 "to tune citus.max_adaptive_executor_pool_size."),
+		&ExplainAnalyzeNetworkMetrics,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.explain_analyze_sort_method",
 		gettext_noop("Sets the sorting method for EXPLAIN ANALYZE queries."),
@@ -1442,6 +2325,19 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.explain_planner_phases",
+		gettext_noop("Shows the time spent in the phases of distributed planning "
+					 "in the EXPLAIN summary."),
+		gettext_noop("When enabled, EXPLAIN (SUMMARY) shows the time spent in "
+					 "recursive planning, pushdown checks, shard pruning and "
+					 "deparsing while planning a distributed query."),
+		&ExplainPlannerPhases,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.force_max_query_parallelization",
 		gettext_noop("Open as many connections as possible to maximize query "
@@ -1484,6 +2380,23 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomRealVariable(
+		"citus.hedged_read_delay_factor",
+		gettext_noop("Sets after how many multiples of the average task execution "
+					 "time a read-only task is also started on another placement."),
+		gettext_noop("When a read-only task on a replicated shard runs longer than "
+					 "this factor times the average execution time of recent tasks "
+					 "on the same worker, the executor starts the same task on the "
+					 "next placement of the shard. The results of the copy that "
+					 "responds first are used and the other copy is cancelled. "
+					 "Hedged reads are only used outside of transaction blocks. "
+					 "0 disables hedged reads."),
+		&HedgedReadDelayFactor,
+		0.0, 0.0, 1000.0,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.hide_citus_dependent_objects",
 		gettext_noop(
@@ -1516,6 +2429,138 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.hot_tenant_isolation_min_samples",
+		gettext_noop("Sets the minimum number of sampled queries of a colocation "
+					 "group before its hot tenants are isolated."),
+		gettext_noop("The share of a tenant in the load of its colocation group "
+					 "is not meaningful when only a few of its queries were "
+					 "sampled. The sample counts are halved every 5 minutes."),
+		&HotTenantIsolationMinSamples,
+		1000, 1, INT_MAX,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomRealVariable(
+		"citus.hot_tenant_isolation_threshold",
+		gettext_noop("Sets the share of the load of its colocation group above "
+					 "which a tenant is isolated automatically."),
+		gettext_noop("When set, the maintenance daemon of the coordinator "
+					 "schedules a background job that isolates a tenant to a "
+					 "shard of its own and moves that shard to another node, "
+					 "once the tenant takes more than this fraction of the "
+					 "queries sampled by citus.tenant_load_sample_rate in its "
+					 "colocation group. Use 0 to disable."),
+		&HotTenantIsolationThreshold,
+		0.0, 0.0, 1.0,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomStringVariable(
+		"citus.hot_tenant_isolation_window",
+		gettext_noop("Sets the time of day at which hot tenants may be "
+					 "isolated automatically."),
+		gettext_noop("The window is of the form HH:MM-HH:MM in the time zone "
+					 "of the server, and spans midnight when it ends before it "
+					 "starts. Empty means any time of day."),
+		&HotTenantIsolationWindow,
+		"",
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		HotTenantIsolationWindowGucCheckHook, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.inline_intermediate_result_threshold",
+		gettext_noop("Sets the number of rows up to which the results of "
+					 "subqueries and CTEs are inlined into the worker queries."),
+		gettext_noop("Intermediate results that are only read by the tasks of "
+					 "the distributed query on remote nodes, and have at most "
+					 "this many rows, are inlined into the task queries instead "
+					 "of being sent to the workers as files. This saves the "
+					 "broadcast of the result and the file I/O on the workers. "
+					 "0 disables inlining."),
+		&InlineIntermediateResultThreshold,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.intermediate_result_broadcast_fanout",
+		gettext_noop("Sets the number of nodes to which intermediate results are "
+					 "sent directly."),
+		gettext_noop("When an intermediate result needs to be sent to more nodes "
+					 "than this, it is only sent to this many nodes. The other "
+					 "nodes then fetch it from the nodes that already have it, "
+					 "such that the number of nodes that have it doubles in every "
+					 "round. This relieves the network of the node that generates "
+					 "the result in large clusters. 0 means that the result is "
+					 "sent to all nodes directly."),
+		&IntermediateResultBroadcastFanout,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomEnumVariable(
+		"citus.intermediate_result_compression",
+		gettext_noop("Sets the compression method for intermediate results."),
+		gettext_noop("When set, intermediate result files and the data sent "
+					 "between nodes to transfer them are compressed with the "
+					 "given method. Nodes detect compressed files when reading "
+					 "them, but all nodes need to run a version of Citus that "
+					 "can read compressed intermediate results and is built "
+					 "with the chosen method."),
+		&IntermediateResultCompression,
+		INTERMEDIATE_RESULT_COMPRESSION_NONE,
+		intermediate_result_compression_options,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomEnumVariable(
+		"citus.io_priority",
+		gettext_noop("Sets the I/O priority of the current backend."),
+		gettext_noop("Only takes effect on Linux, with I/O schedulers that "
+					 "support priorities, such as BFQ. 'idle' only gets disk "
+					 "time when no other process needs it. 'inherit' keeps "
+					 "the priority that the backend started with."),
+		&IoPriority,
+		IO_PRIORITY_INHERIT, io_priority_options,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, IoPriorityAssignHook, NULL);
+
+	DefineCustomEnumVariable(
+		"citus.io_priority_for_background_operations",
+		gettext_noop("Sets the I/O priority for the backends that run shard "
+					 "moves and other rebalancer commands, and for background "
+					 "task executors."),
+		gettext_noop("Shard moves are mostly I/O bound, so lowering their "
+					 "priority leaves more disk time to other queries. "
+					 "'inherit' disables overriding the I/O priority of these "
+					 "backends."),
+		&IoPriorityBackgroundOperations,
+		IO_PRIORITY_INHERIT, io_priority_options,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomEnumVariable(
+		"citus.io_priority_for_logical_replication_senders",
+		gettext_noop("Sets the I/O priority for backends that send logical "
+					 "replication changes to other nodes for online shard "
+					 "moves and splits."),
+		gettext_noop("'inherit' disables overriding the I/O priority for "
+					 "backends that send logical replication changes."),
+		&IoPriorityLogicalRepSender,
+		IO_PRIORITY_INHERIT, io_priority_options,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.isolation_test_session_process_id",
 		NULL,
@@ -1589,6 +2634,21 @@ RegisterCitusConfigVariables(void)
 		GUC_SUPERUSER_ONLY,
 		NULL, NULL, LocalPoolSizeGucShowHook);
 
+	DefineCustomIntVariable(
+		"citus.local_table_copy_parallel_workers",
+		gettext_noop("Sets the number of parallel workers that read the local data "
+					 "of a table that is being distributed."),
+		gettext_noop("When set, create_distributed_table and create_reference_table "
+					 "read the local data of heap tables that are larger than "
+					 "min_parallel_table_scan_size in parallel workers, which find "
+					 "the shards of the rows while the backend forwards them. The "
+					 "default value of 0 reads the data in the backend itself."),
+		&LocalTableCopyParallelWorkers,
+		0, 0, 64,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.local_table_join_policy",
 		gettext_noop("defines the behaviour when a distributed table "
@@ -1660,6 +2720,26 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.logical_replication_apply_parallelism",
+		gettext_noop("Sets the number of subscriptions that replicate the shards "
+					 "of a table owner during a shard move."),
+		gettext_noop("A shard move replicates the changes to the shards of each "
+					 "table owner in the shard group through a subscription, "
+					 "which a single apply worker on the target applies. When "
+					 "set above 1, the shards are spread over up to this many "
+					 "subscriptions, each with its own replication slot, such "
+					 "that they catch up concurrently. The writes are blocked "
+					 "and all subscriptions are caught up at once at the end "
+					 "of the move. The target needs enough "
+					 "max_logical_replication_workers and the source enough "
+					 "max_replication_slots and max_wal_senders."),
+		&LogicalReplicationApplyParallelism,
+		1, 1, 64,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.logical_replication_timeout",
 		gettext_noop("Sets the timeout to error out when logical replication is used"),
@@ -1672,6 +2752,23 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL | GUC_UNIT_MS,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.maintenance_daemon_idle_timeout",
+		gettext_noop("Sets the time after which the maintenance daemon of an "
+					 "idle database exits."),
+		gettext_noop("Each database that uses Citus has a maintenance daemon "
+					 "that takes up a background worker slot. When set, the "
+					 "daemon exits once the database had no other backends "
+					 "for this long and no 2PC recovery, cleanup, metadata "
+					 "sync or background tasks are pending. The next backend "
+					 "that uses Citus in the database starts it again. "
+					 "0 keeps the daemons running."),
+		&MaintenanceDaemonIdleTimeout,
+		0, 0, INT_MAX,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_adaptive_executor_pool_size",
 		gettext_noop("Sets the maximum number of connections per worker node used by "
@@ -1690,6 +2787,33 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_background_task_executors",
+		gettext_noop("Sets the maximum number of background tasks that are executed "
+					 "concurrently."),
+		gettext_noop("The background task queue monitor starts a background worker "
+					 "per running task, for instance per shard move of a background "
+					 "rebalance. This setting limits how many of them run at the "
+					 "same time."),
+		&MaxBackgroundTaskExecutors,
+		1, 1, 128,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_background_task_executors_per_node",
+		gettext_noop("Sets the maximum number of concurrently executed background "
+					 "tasks that work on the same node."),
+		gettext_noop("A shard move works on its source and its target node. This "
+					 "setting limits how many of the concurrently executed tasks "
+					 "involve any one node, to bound the load the moves put on it."),
+		&MaxBackgroundTaskExecutorsPerNode,
+		1, 1, 128,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_cached_connection_lifetime",
 		gettext_noop("Sets the maximum lifetime of cached connections to other nodes."),
@@ -1714,6 +2838,20 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_cached_local_plans",
+		gettext_noop("Sets the maximum number of local plans to cache per "
+					 "prepared statement."),
+		gettext_noop("When a prepared statement has more local plans cached "
+					 "than this, the least recently used plan is evicted. "
+					 "A value of 0 disables local plan caching, -1 removes "
+					 "the limit."),
+		&MaxCachedLocalPlans,
+		-1, -1, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_client_connections",
 		gettext_noop("Sets the maximum number of connections regular clients can make"),
@@ -1731,6 +2869,21 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_concurrent_multi_shard_queries",
+		gettext_noop("Sets the maximum number of multi-shard queries that run "
+					 "at once on the node."),
+		gettext_noop("Read-only queries with more than one remote task wait "
+					 "until fewer than this many such queries run, such that "
+					 "a few large analytical queries cannot take up all the "
+					 "connections to the workers. Router queries are never "
+					 "queued. A value of 0 disables the limit."),
+		&MaxConcurrentMultiShardQueries,
+		0, 0, INT_MAX,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_high_priority_background_processes",
 		gettext_noop("Sets the maximum number of background processes "
@@ -1745,6 +2898,21 @@ RegisterCitusConfigVariables(void)
 		NULL, NULL, NULL);
 
 
+	DefineCustomIntVariable(
+		"citus.max_index_builds_per_worker",
+		gettext_noop("Sets the maximum number of shard indexes that CREATE INDEX "
+					 "and REINDEX build concurrently on each worker."),
+		gettext_noop("Each index build runs over its own connection and uses up to "
+					 "maintenance_work_mem on the worker. Lowering this value "
+					 "limits the load of building an index on a distributed table, "
+					 "at the cost of a longer build. When 0, the builds are only "
+					 "limited by citus.max_adaptive_executor_pool_size."),
+		&MaxIndexBuildsPerWorker,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_intermediate_result_size",
 		gettext_noop("Sets the maximum size of the intermediate results in KB for "
@@ -1767,6 +2935,22 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MB | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_parallel_metadata_sync_nodes",
+		gettext_noop("Sets the maximum number of nodes to which metadata is synced "
+					 "at the same time"),
+		gettext_noop("Activating nodes syncs objects and metadata to all the "
+					 "activated nodes at once, as part of a single coordinated "
+					 "transaction. This setting caps the number of nodes that "
+					 "execute the metadata commands at the same time, the other "
+					 "nodes are handled in subsequent batches within the same "
+					 "transaction. 0 means no limit."),
+		&MaxParallelMetadataSyncNodes,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_rebalancer_logged_ignored_moves",
 		gettext_noop("Sets the maximum number of ignored moves the rebalance logs"),
@@ -1777,6 +2961,22 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_shard_transfer_rate",
+		gettext_noop("Sets the maximum rate in MB/s at which shard data is sent "
+					 "from this node to another node when moving, copying or "
+					 "splitting shards."),
+		gettext_noop("The limit applies to the initial data copy of each target "
+					 "node, and is shared by the colocated shards that are sent "
+					 "to the same node. It is set on the node that sends the data. "
+					 "A configuration reload also throttles the transfers that "
+					 "are already running. 0 means no limit."),
+		&MaxShardTransferRate,
+		0, 0, INT_MAX / 1024,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_shared_pool_size",
 		gettext_noop("Sets the maximum number of connections allowed per worker node "
@@ -1791,6 +2991,35 @@ RegisterCitusConfigVariables(void)
 		GUC_SUPERUSER_ONLY,
 		NULL, NULL, MaxSharedPoolSizeGucShowHook);
 
+	DefineCustomIntVariable(
+		"citus.max_total_shard_transfer_rate",
+		gettext_noop("Sets the maximum rate in MB/s at which this node sends "
+					 "shard data to all other nodes together when moving, "
+					 "copying or splitting shards."),
+		gettext_noop("The limit applies to the initial data copy and to the "
+					 "changes that are replicated to the new shards of a shard "
+					 "split. A configuration reload also throttles the transfers "
+					 "that are already running. 0 means no limit."),
+		&MaxTotalShardTransferRate,
+		0, 0, INT_MAX / 1024,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_vacuum_tasks_per_worker",
+		gettext_noop("Sets the number of shards that VACUUM and ANALYZE process "
+					 "concurrently on each worker."),
+		gettext_noop("When set, the shards of all the tables in a VACUUM or ANALYZE "
+					 "command are processed together, each over its own connection, "
+					 "with at most this many of them running on each worker. "
+					 "When 0, the tables are processed one after another."),
+		&MaxVacuumTasksPerWorker,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_worker_nodes_tracked",
 		gettext_noop("Sets the maximum number of worker nodes that are tracked."),
@@ -1810,6 +3039,22 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.metadata_cache_warmup_tables",
+		gettext_noop("Sets the number of frequently used tables whose metadata "
+					 "is cached before the first query of a session."),
+		gettext_noop("When set, backends count how often they build the "
+					 "metadata cache entry of each distributed table, and the "
+					 "first query that a new backend plans first builds the "
+					 "entries of that many tables with the highest counts. "
+					 "This helps connection poolers that replace their "
+					 "backends. 0 disables the warm-up."),
+		&MetadataCacheWarmupTableCount,
+		0, 0, 4096,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.metadata_sync_interval",
 		gettext_noop("Sets the time to wait between metadata syncs."),
@@ -1862,6 +3107,20 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.multi_shard_query_priority",
+		gettext_noop("Sets the priority of multi-shard queries that wait for "
+					 "admission."),
+		gettext_noop("When citus.max_concurrent_multi_shard_queries queries "
+					 "already run, waiting queries with a higher priority are "
+					 "admitted first, and queries with the same priority in "
+					 "the order in which they arrived. Can be set per role."),
+		&MultiShardQueryPriority,
+		0, -100, 100,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.multi_task_query_log_level",
 		gettext_noop("Sets the level of multi task query execution log messages"),
@@ -1971,6 +3230,21 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.parallel_copy_workers",
+		gettext_noop("Sets the number of background workers that parse the input "
+					 "of a COPY into a distributed table."),
+		gettext_noop("When set, a COPY that runs outside of a transaction block splits "
+					 "its input into chunks of lines and parses them in background "
+					 "workers, which frees the backend to forward rows to the shards. "
+					 "Errors in the input are reported without a line number. The "
+					 "default value of 0 parses the input in the backend itself."),
+		&ParallelCopyWorkers,
+		0, 0, 64,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.prevent_incomplete_connection_establishment",
 		gettext_noop("When enabled, the executor waits until all the connections "
@@ -2008,6 +3282,52 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.propagate_trace_context",
+		gettext_noop("Sends a child span of citus.trace_context with the tasks "
+					 "of distributed queries."),
+		gettext_noop("When enabled and citus.trace_context is set, every task "
+					 "query that the adaptive executor sends to a worker starts "
+					 "with a comment that holds a W3C traceparent with a new "
+					 "span id, such that the task shows up as a child span in "
+					 "pg_stat_activity and the logs of the worker."),
+		&PropagateTraceContext,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.query_result_cache_size",
+		gettext_noop("Sets the maximum size of the cached query results of a "
+					 "backend."),
+		gettext_noop("Query results that do not fit are not cached, see "
+					 "citus.query_result_cache_ttl."),
+		&QueryResultCacheSize,
+		16384, 0, MAX_KILOBYTES,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.query_result_cache_ttl",
+		gettext_noop("Sets the time for which the results of repeated read-only "
+					 "distributed queries are cached."),
+		gettext_noop("When set to a value larger than 0, the rows that the tasks "
+					 "of a read-only distributed query outside of a transaction "
+					 "block return are cached in the backend, and a repeated run "
+					 "of the same query uses them instead of running the tasks "
+					 "again. Cached results are discarded when a transaction "
+					 "that modified one of the shards commits through this node, "
+					 "when the metadata changes, or after this time. Writes that "
+					 "do not go through this node are only seen once the cached "
+					 "results expired. 0 disables the cache."),
+		&QueryResultCacheTTL,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.recover_2pc_interval",
 		gettext_noop("Sets the time to wait between recovering 2PCs."),
@@ -2022,6 +3342,58 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.reference_table_write_batch_size",
+		gettext_noop("Sets the maximum number of single-row writes to reference "
+					 "tables that are held back within a transaction block."),
+		gettext_noop("When set to a value larger than 1, single-row INSERTs into "
+					 "reference tables in a transaction block are not sent to the "
+					 "placements right away. Instead, they are sent together as "
+					 "a single command per node when this many writes are "
+					 "pending, or when the next statement or the commit starts. "
+					 "Errors in the held back writes are reported by the "
+					 "statement that sends them. 0 disables batching."),
+		&ReferenceTableWriteBatchSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.release_cached_connections_on_full_pool",
+		gettext_noop("Closes cached connections at the end of a transaction when "
+					 "the shared pool for the node is full."),
+		gettext_noop("Connections that a session caches for later use count "
+					 "towards citus.max_shared_pool_size, even while the session "
+					 "is idle. With many concurrent sessions, this can make "
+					 "sessions wait for connections that other sessions do not "
+					 "use. When enabled, sessions close their cached connections "
+					 "to a node at the end of a transaction if the shared pool "
+					 "for that node is full, such that other sessions can "
+					 "connect instead."),
+		&ReleaseCachedConnectionsOnFullPool,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomEnumVariable(
+		"citus.remote_copy_compression",
+		gettext_noop("Sets the compression method for COPY data sent to shards."),
+		gettext_noop("When set, the rows that COPY and INSERT..SELECT send to "
+					 "shards on other nodes are compressed with the given method "
+					 "and decompressed by the worker nodes. This reduces the "
+					 "network traffic of the coordinator at the cost of CPU "
+					 "time. All nodes need to run a version of Citus that can "
+					 "receive compressed COPY data and is built with the chosen "
+					 "method."),
+		&RemoteCopyCompression,
+		INTERMEDIATE_RESULT_COMPRESSION_NONE,
+		intermediate_result_compression_options,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.remote_copy_flush_threshold",
 		gettext_noop("Sets the threshold for remote copy to be flushed."),
@@ -2059,6 +3431,35 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD | GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.repartition_join_filter_size",
+		gettext_noop("Sets the size of the join key filters of repartition joins."),
+		gettext_noop("Larger filters let fewer rows without a join partner "
+					 "through, but take longer to send to the workers. A filter "
+					 "that has more than half of its bits set is not applied."),
+		&RepartitionJoinFilterSize,
+		1024, 1, 65536,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.repartition_join_rows_per_bucket",
+		gettext_noop("Sets the estimated number of rows per bucket of dual "
+					 "repartition joins."),
+		gettext_noop("When set, the number of buckets of a dual repartition join "
+					 "is picked from the row estimates of the joined tables, such "
+					 "that each bucket gets about this many rows. Each node gets "
+					 "at least one bucket and at most "
+					 "citus.max_adaptive_executor_pool_size buckets. When 0, or "
+					 "when the tables have no row estimates, "
+					 "citus.repartition_join_bucket_count_per_node is used."),
+		&RepartitionJoinRowsPerBucket,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	/* deprecated setting */
 	DefineCustomBoolVariable(
 		"citus.replicate_reference_tables_on_activate",
@@ -2124,6 +3525,45 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.shard_index_build_maintenance_work_mem",
+		gettext_noop("Sets the maintenance_work_mem used to build the indexes of "
+					 "moved or split shards."),
+		gettext_noop("When a shard is moved or split using logical replication, its "
+					 "indexes are built on the target node after the data is copied. "
+					 "A larger value speeds up building large indexes. The default "
+					 "value of -1 uses the maintenance_work_mem of the target node."),
+		&ShardIndexBuildMaintenanceWorkMem,
+		-1, -1, MAX_KILOBYTES,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		ShardIndexBuildMaintenanceWorkMemCheckHook, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_index_build_max_parallel_workers",
+		gettext_noop("Sets the max_parallel_maintenance_workers used to build the "
+					 "indexes of moved or split shards."),
+		gettext_noop("The default value of -1 uses the "
+					 "max_parallel_maintenance_workers of the target node."),
+		&ShardIndexBuildMaxParallelWorkers,
+		-1, -1, MAX_PARALLEL_WORKER_LIMIT,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_index_build_parallelism",
+		gettext_noop("Sets the maximum number of indexes of moved or split shards "
+					 "that are built concurrently on a node."),
+		gettext_noop("Each index is built over a separate connection to the target "
+					 "node. The default value of 0 uses "
+					 "citus.max_adaptive_executor_pool_size."),
+		&ShardIndexBuildParallelism,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.shard_replication_factor",
 		gettext_noop("Sets the replication factor for shards."),
@@ -2137,6 +3577,74 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.shard_size_refresh_interval",
+		gettext_noop("Sets the time to wait between refreshes of the cached "
+					 "shard sizes."),
+		gettext_noop("The maintenance daemon collects the sizes of the shard "
+					 "placements of all Citus tables every so often, such that "
+					 "reading shard sizes does not need to contact the nodes. "
+					 "Sizes that were not refreshed for two intervals are not "
+					 "used. Use 0 to disable."),
+		&ShardSizeRefreshInterval,
+		0, 0, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shared_metadata_cache_size",
+		gettext_noop("Sets the amount of dynamic shared memory used to share the "
+					 "shards and placements of Citus tables across backends."),
+		gettext_noop("When enabled, backends read the shards and placements of a "
+					 "table from the catalogs only if no other backend did so since "
+					 "they last changed. 0 disables the shared metadata cache."),
+		&SharedMetadataCacheSize,
+		0, 0, MAX_KILOBYTES,
+		PGC_POSTMASTER,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.shared_pool_fair_share",
+		gettext_noop("Shares the connections to a node among the roles that wait "
+					 "for one by their citus.shared_pool_weight."),
+		gettext_noop("By default, connection slots of citus.max_shared_pool_size "
+					 "go to whichever backend asks first, such that a single busy "
+					 "role can take all slots. When enabled, a role cannot take a "
+					 "slot beyond its share of the pool while other roles wait."),
+		&SharedPoolFairShare,
+		false,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shared_pool_min_connections_per_role",
+		gettext_noop("Sets the number of connections to a node that each role "
+					 "can always get from the shared pool."),
+		gettext_noop("Slots of citus.max_shared_pool_size that other active roles "
+					 "can still claim this way are not given to a role that has "
+					 "its minimum already. 0 disables the guarantee."),
+		&SharedPoolMinConnectionsPerRole,
+		0, 0, INT_MAX,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shared_pool_weight",
+		gettext_noop("Sets the weight of the role in the shared pool when "
+					 "citus.shared_pool_fair_share is enabled."),
+		gettext_noop("A role gets a share of the connections to a node that is "
+					 "proportional to its weight among the roles that use the "
+					 "node. Typically set per role with ALTER ROLE."),
+		&SharedPoolWeight,
+		1, 1, 1000,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomStringVariable(
 		"citus.show_shards_for_app_name_prefixes",
 		gettext_noop("If application_name starts with one of these values, show shards"),
@@ -2215,6 +3723,64 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.split_copy_parallelism",
+		gettext_noop("Sets the number of concurrent copies into which the data copy "
+					 "of a large shard is divided during shard splits."),
+		gettext_noop("Each copy reads a range of blocks of the source shard over a "
+					 "separate connection and writes to all split children. Shards "
+					 "smaller than 128MB per copy are divided into fewer copies. "
+					 "Requires PostgreSQL 14 or later, which support TID range "
+					 "scans."),
+		&SplitCopyParallelism,
+		1, 1, 64,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.stat_activity_max_staleness",
+		gettext_noop("Sets the maximum age of the activity snapshot that "
+					 "citus_stat_activity may return."),
+		gettext_noop("When the maintenance daemon collects activity snapshots, "
+					 "citus_stat_activity and the views built on it return the "
+					 "last snapshot instead of querying all nodes, provided that "
+					 "it is not older than this and the user may read all "
+					 "statistics. Use 0 to always return the live activity."),
+		&StatActivityMaxStaleness,
+		0, 0, 7 * MS_PER_DAY,
+		PGC_USERSET,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.stat_activity_snapshot_interval",
+		gettext_noop("Sets the time to wait between snapshots of the activity "
+					 "on all nodes."),
+		gettext_noop("The maintenance daemon on the coordinator collects the "
+					 "activity of all nodes every so often into shared memory, "
+					 "such that monitoring queries that set "
+					 "citus.stat_activity_max_staleness do not need to contact "
+					 "the nodes. Use 0 to disable."),
+		&StatActivitySnapshotInterval,
+		0, 0, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.stat_shard_access_max",
+		gettext_noop("Determines maximum number of shards whose queries, rows "
+					 "and execution time are tracked."),
+		gettext_noop("The tracked statistics are used as the shard cost of the "
+					 "by_load rebalance strategy. Setting it to 0 disables "
+					 "tracking."),
+		&StatShardAccessMax,
+		10000, 0, INT_MAX,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	/*
 	 * It takes about 140 bytes of shared memory to store one row, therefore
 	 * this setting should be used responsibly. setting it to 10M will require
@@ -2242,6 +3808,21 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS | GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	/*
+	 * It takes about 700 bytes of shared memory to store the task timings of a
+	 * query on a worker.
+	 */
+	DefineCustomIntVariable(
+		"citus.stat_statements_task_timings_max",
+		gettext_noop("Determines maximum number of query and worker combinations "
+					 "tracked by citus_stat_statements_task_timings."),
+		NULL,
+		&StatStatementsTaskTimingsMax,
+		5000, 100, 10000000,
+		PGC_POSTMASTER,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.stat_statements_track",
 		gettext_noop(
@@ -2256,6 +3837,32 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.stat_statements_track_workers",
+		gettext_noop("Enables the stats collection for citus_stat_statements_cluster."),
+		gettext_noop("When enabled along with citus.stat_statements_track, the "
+					 "identifier of a distributed query is sent to the workers in a "
+					 "comment in front of the task queries. The workers track the "
+					 "execution time, rows and buffer usage of the tasks under "
+					 "that identifier, instead of under the shard-specific "
+					 "queries alone."),
+		&StatStatementsTrackWorkers,
+		false,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.stat_statements_worker_max",
+		gettext_noop("Determines maximum number of distributed queries whose "
+					 "task statistics are tracked on a worker."),
+		NULL,
+		&StatStatementsWorkerMax,
+		5000, 100, 10000000,
+		PGC_POSTMASTER,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.subquery_pushdown",
 		gettext_noop("Usage of this GUC is highly discouraged, please read the long "
@@ -2274,6 +3881,20 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NoticeIfSubqueryPushdownEnabled, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.table_row_estimate_refresh_interval",
+		gettext_noop("Sets the time to wait between refreshes of the table "
+					 "row estimates."),
+		gettext_noop("The maintenance daemon collects the reltuples of the "
+					 "shards of all Citus tables every so often, which "
+					 "citus.enable_cost_based_join_order uses to choose join "
+					 "orders. Use 0 to disable."),
+		&TableRowEstimateRefreshInterval,
+		0, 0, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.task_assignment_policy",
 		gettext_noop("Sets the policy to use when assigning tasks to worker nodes."),
@@ -2282,8 +3903,9 @@ RegisterCitusConfigVariables(void)
 					 "use when making these assignments. The greedy policy aims to "
 					 "evenly distribute tasks across worker nodes, first-replica just "
 					 "assigns tasks in the order shard placements were created, "
-					 "and the round-robin policy assigns tasks to worker nodes in "
-					 "a round-robin fashion."),
+					 "the round-robin policy assigns tasks to worker nodes in "
+					 "a round-robin fashion, and the least-loaded policy assigns "
+					 "tasks to the worker node with the fewest running tasks."),
 		&TaskAssignmentPolicy,
 		TASK_ASSIGNMENT_GREEDY,
 		task_assignment_policy_options,
@@ -2305,6 +3927,71 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		WarnIfDeprecatedExecutorUsed, NULL, NULL);
 
+	DefineCustomRealVariable(
+		"citus.tenant_load_sample_rate",
+		gettext_noop("Sets the fraction of router queries whose distribution "
+					 "column value is sampled."),
+		gettext_noop("The calls, rows, execution time and CPU time of the "
+					 "sampled queries are extrapolated to all queries of their "
+					 "distribution column value, see citus_stat_tenants, and "
+					 "the sample counts are used by "
+					 "citus.hot_tenant_isolation_threshold. Only sampled "
+					 "queries pay for the bookkeeping. Use 0 to disable."),
+		&TenantLoadSampleRate,
+		0.0, 0.0, 1.0,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomStringVariable(
+		"citus.trace_context",
+		gettext_noop("Sets the W3C traceparent of the current statement."),
+		gettext_noop("Applications that trace their queries can set this to the "
+					 "traceparent of a statement, in the form "
+					 "00-<trace id>-<parent id>-<trace flags>. While a worker "
+					 "runs a task of a traced statement, this shows the span "
+					 "of the task."),
+		&TraceContext,
+		"",
+		PGC_USERSET,
+		GUC_STANDARD,
+		TraceContextGucCheckHook, NULL, TraceContextGucShowHook);
+
+	DefineCustomIntVariable(
+		"citus.two_phase_commit_delay",
+		gettext_noop("Sets the commit_delay for distributed transactions that "
+					 "use two-phase commit, in microseconds."),
+		gettext_noop("Distributed transactions that use two-phase commit write "
+					 "records to pg_dist_transaction, and the client waits for "
+					 "the WAL flush of the local commit. When this setting is "
+					 "larger than 0, commit_delay is set to this value for the "
+					 "commit of such transactions, such that concurrently "
+					 "committing transactions can share a single WAL flush. "
+					 "This is a shorthand for commit_delay, so the delay only "
+					 "applies when at least commit_siblings other transactions "
+					 "are active, and the commits of the prepared transactions "
+					 "on the workers are not delayed."),
+		&TwoPhaseCommitDelay,
+		0, 0, 100000,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.use_cached_shard_sizes",
+		gettext_noop("Uses the shard sizes collected by the maintenance daemon "
+					 "when possible."),
+		gettext_noop("When citus.shard_size_refresh_interval is set, "
+					 "citus_shard_sizes(), the citus_shards view and the "
+					 "by_disk_size rebalance strategy use the cached shard sizes "
+					 "instead of fetching them from the nodes. Disable to always "
+					 "get fresh sizes."),
+		&UseCachedShardSizes,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.use_citus_managed_tables",
 		gettext_noop("Allows new local tables to be accessed on workers"),
@@ -2319,7 +4006,10 @@ RegisterCitusConfigVariables(void)
 	DefineCustomEnumVariable(
 		"citus.use_secondary_nodes",
 		gettext_noop("Sets the policy to use when choosing nodes for SELECT queries."),
-		NULL,
+		gettext_noop("When set to caught_up, writes go to the primary nodes and "
+					 "SELECT queries outside of transaction blocks go to a "
+					 "secondary node that has replayed the session's writes to "
+					 "the primary of its group, or to the primary otherwise."),
 		&ReadFromSecondaries,
 		USE_SECONDARY_NODES_NEVER, use_secondary_nodes_options,
 		PGC_SU_BACKEND,
@@ -2635,6 +4325,17 @@ CpuPriorityAssignHook(int newval, void *extra)
 }
 
 
+/*
+ * IoPriorityAssignHook changes the I/O priority of the current backend to
+ * match the chosen value.
+ */
+static void
+IoPriorityAssignHook(int newval, void *extra)
+{
+	SetOwnIoPriority(newval);
+}
+
+
 /*
  * NodeConninfoGucAssignHook is the assignment hook for the node_conninfo GUC
  * variable. Though this GUC is a "string", we actually parse it as a non-URI
@@ -2724,6 +4425,66 @@ LocalPoolSizeGucShowHook(void)
 }
 
 
+/*
+ * TraceContextGucCheckHook ensures that citus.trace_context is either empty
+ * or a valid W3C traceparent, since we send it to the workers as is.
+ */
+static bool
+TraceContextGucCheckHook(char **newval, void **extra, GucSource source)
+{
+	if (*newval == NULL || (*newval)[0] == '\0')
+	{
+		return true;
+	}
+
+	if (!IsValidTraceParent(*newval))
+	{
+		GUC_check_errdetail("citus.trace_context must be a W3C traceparent of the "
+							"form 00-<32 hex digits>-<16 hex digits>-<2 hex digits>");
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * HotTenantIsolationWindowGucCheckHook ensures that
+ * citus.hot_tenant_isolation_window is either empty or of the form HH:MM-HH:MM.
+ */
+static bool
+HotTenantIsolationWindowGucCheckHook(char **newval, void **extra, GucSource source)
+{
+	int startMinute = 0;
+	int endMinute = 0;
+
+	if (*newval == NULL || (*newval)[0] == '\0')
+	{
+		return true;
+	}
+
+	if (!ParseHotTenantIsolationWindow(*newval, &startMinute, &endMinute))
+	{
+		GUC_check_errdetail("citus.hot_tenant_isolation_window must be of the form "
+							"HH:MM-HH:MM");
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * TraceContextGucShowHook shows the trace context of the task that we received
+ * from the coordinator while it runs, and citus.trace_context otherwise.
+ */
+static const char *
+TraceContextGucShowHook(void)
+{
+	return CurrentTraceContext();
+}
+
+
 static bool
 StatisticsCollectionGucCheckHook(bool *newval, void **extra, GucSource source)
 {
@@ -2746,6 +4507,25 @@ StatisticsCollectionGucCheckHook(bool *newval, void **extra, GucSource source)
 }
 
 
+/*
+ * ShardIndexBuildMaintenanceWorkMemCheckHook ensures that
+ * citus.shard_index_build_maintenance_work_mem is either -1 or a valid
+ * maintenance_work_mem, such that index builds do not fail on the target node.
+ */
+static bool
+ShardIndexBuildMaintenanceWorkMemCheckHook(int *newval, void **extra, GucSource source)
+{
+	if (*newval != -1 && *newval < 1024)
+	{
+		GUC_check_errdetail("The value should be -1 or at least 1MB, which is the "
+							"minimum of maintenance_work_mem.");
+		return false;
+	}
+
+	return true;
+}
+
+
 /*
  * CitusAuthHook is a callback for client authentication that Postgres provides.
  * Citus uses this hook to count the number of active backends.
@@ -2,6 +2,9 @@
 
 DROP FUNCTION pg_catalog.worker_append_table_to_shard(text, text, text, integer);
 
+-- ids of the nodes a background task works on, to limit the tasks running on a node
+ALTER TABLE pg_catalog.pg_dist_background_task ADD COLUMN nodes_involved INT[] DEFAULT NULL;
+
 #include "udfs/get_rebalance_progress/11.2-1.sql"
 #include "udfs/citus_isolation_test_session_is_blocked/11.2-1.sql"
 #include "datatypes/citus_cluster_clock/11.2-1.sql"
@@ -9,3 +12,83 @@ DROP FUNCTION pg_catalog.worker_append_table_to_shard(text, text, text, integer)
 #include "udfs/citus_get_transaction_clock/11.2-1.sql"
 #include "udfs/citus_is_clock_after/11.2-1.sql"
 #include "udfs/citus_internal_adjust_local_clock_to_remote/11.2-1.sql"
+#include "udfs/citus_query_task_timings/11.2-1.sql"
+#include "udfs/citus_prewarm_connections/11.2-1.sql"
+#include "udfs/citus_query_planner_timings/11.2-1.sql"
+#include "udfs/worker_build_join_key_filter/11.2-1.sql"
+#include "udfs/worker_partition_query_result/11.2-1.sql"
+#include "udfs/citus_update_table_row_estimates/11.2-1.sql"
+#include "udfs/citus_analyze_distributed/11.2-1.sql"
+#include "udfs/citus_hll_add_agg/11.2-1.sql"
+#include "udfs/citus_hll_union_agg/11.2-1.sql"
+#include "udfs/citus_hll_cardinality/11.2-1.sql"
+#include "udfs/worker_partial_agg_binary/11.2-1.sql"
+#include "udfs/coord_combine_agg_binary/11.2-1.sql"
+#include "udfs/citus_extradata_container/11.2-1.sql"
+#include "udfs/citus_copy_connection_stats/11.2-1.sql"
+#include "udfs/citus_shard_access_stats/11.2-1.sql"
+#include "udfs/citus_shard_cost_by_load/11.2-1.sql"
+
+INSERT INTO pg_catalog.pg_dist_rebalance_strategy(
+    name,
+    default_strategy,
+    shard_cost_function,
+    node_capacity_function,
+    shard_allowed_on_node_function,
+    default_threshold,
+    minimum_threshold,
+    improvement_threshold
+) VALUES (
+    'by_load',
+    false,
+    'citus_shard_cost_by_load',
+    'citus_node_capacity_1',
+    'citus_shard_allowed_on_node_true',
+    0.1,
+    0.01,
+    0.5
+);
+#include "udfs/citus_shard_stat_counters/11.2-1.sql"
+#include "udfs/citus_stat_shards/11.2-1.sql"
+#include "udfs/worker_split_copy/11.2-1.sql"
+#include "udfs/citus_index_build_progress/11.2-1.sql"
+#include "udfs/citus_internal_begin_deferred_shard_creation/11.2-1.sql"
+#include "udfs/citus_internal_finish_deferred_shard_creation/11.2-1.sql"
+#include "udfs/create_time_partitions/11.2-1.sql"
+#include "udfs/citus_delegate_procedure_calls/11.2-1.sql"
+#include "udfs/citus_internal_copy_reference_tables/11.2-1.sql"
+#include "udfs/citus_check_cluster_node_latency/11.2-1.sql"
+#include "udfs/citus_internal_collect_stat_activity/11.2-1.sql"
+#include "udfs/citus_internal_stat_activity_snapshot/11.2-1.sql"
+#include "udfs/citus_stat_activity/11.2-1.sql"
+#include "udfs/citus_worker_query_stats/11.2-1.sql"
+#include "udfs/citus_stat_statements_cluster/11.2-1.sql"
+#include "udfs/citus_backend_wait_events/11.2-1.sql"
+#include "udfs/citus_distributed_command_progress/11.2-1.sql"
+#include "udfs/citus_distributed_command_shard_progress/11.2-1.sql"
+#include "udfs/citus_stat_progress_distributed/11.2-1.sql"
+#include "udfs/citus_tenant_load_stats/11.2-1.sql"
+#include "udfs/citus_stat_tenants/11.2-1.sql"
+#include "udfs/citus_routing_table/11.2-1.sql"
+#include "udfs/read_inline_intermediate_result/11.2-1.sql"
+
+-- Rollups that aggregate the rows of a table with a progress column value
+-- above aggregated_until when they are refreshed.
+CREATE TABLE citus.pg_dist_rollup (
+    rollup_name text NOT NULL,
+    source_table regclass NOT NULL,
+    progress_column name NOT NULL,
+    refresh_command text NOT NULL,
+    aggregated_until bigint NOT NULL DEFAULT 0,
+
+    CONSTRAINT pg_dist_rollup_pkey PRIMARY KEY (rollup_name)
+);
+ALTER TABLE citus.pg_dist_rollup SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.pg_dist_rollup TO PUBLIC;
+
+#include "udfs/citus_create_incremental_rollup/11.2-1.sql"
+#include "udfs/citus_refresh_incremental_rollup/11.2-1.sql"
+#include "udfs/citus_drop_incremental_rollup/11.2-1.sql"
+#include "udfs/citus_shard_split_points/11.2-1.sql"
+#include "udfs/read_bulk_load_file/11.2-1.sql"
+#include "udfs/citus_bulk_load/11.2-1.sql"
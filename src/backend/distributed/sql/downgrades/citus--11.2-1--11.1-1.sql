@@ -1,6 +1,29 @@
 -- citus--11.2-1--11.1-1
 #include "../udfs/get_rebalance_progress/11.1-1.sql"
 #include "../udfs/citus_isolation_test_session_is_blocked/11.1-1.sql"
+DROP VIEW pg_catalog.citus_stat_statements_task_timings;
+DROP FUNCTION pg_catalog.citus_query_task_timings();
+DROP VIEW pg_catalog.citus_stat_statements_planner_timings;
+DROP FUNCTION pg_catalog.citus_query_planner_timings();
+DROP FUNCTION pg_catalog.citus_prewarm_connections();
+DROP FUNCTION pg_catalog.worker_build_join_key_filter(text, int, int);
+DROP FUNCTION pg_catalog.citus_update_table_row_estimates();
+DROP FUNCTION pg_catalog.citus_analyze_distributed(regclass);
+DROP AGGREGATE pg_catalog.citus_hll_add_agg(anyelement, integer);
+DROP AGGREGATE pg_catalog.citus_hll_union_agg(bytea);
+DROP FUNCTION pg_catalog.citus_hll_add_agg_sfunc(internal, anyelement, integer);
+DROP FUNCTION pg_catalog.citus_hll_union_agg_sfunc(internal, bytea);
+DROP FUNCTION pg_catalog.citus_hll_agg_ffunc(internal);
+DROP FUNCTION pg_catalog.citus_hll_cardinality(bytea);
+DROP AGGREGATE pg_catalog.worker_partial_agg_binary(oid, anyelement);
+DROP FUNCTION pg_catalog.worker_partial_agg_binary_ffunc(internal);
+DROP AGGREGATE pg_catalog.coord_combine_agg_binary(oid, bytea, anyelement);
+DROP FUNCTION pg_catalog.coord_combine_agg_binary_sfunc(internal, oid, bytea, anyelement);
+DROP FUNCTION pg_catalog.coord_combine_agg_binary_ffunc(internal, oid, bytea, anyelement);
+ALTER FUNCTION pg_catalog.citus_extradata_container(INTERNAL) PARALLEL UNSAFE;
+DROP VIEW pg_catalog.citus_stat_copy_connections;
+DROP FUNCTION pg_catalog.citus_copy_connection_stats();
+DROP FUNCTION pg_catalog.worker_partition_query_result(text, text, int, citus.distribution_type, text[], text[], boolean, boolean, boolean, text, text[], int[], text, boolean);
 DROP FUNCTION pg_catalog.citus_get_node_clock();
 DROP FUNCTION pg_catalog.citus_get_transaction_clock();
 DROP FUNCTION pg_catalog.citus_internal_adjust_local_clock_to_remote(cluster_clock);
@@ -11,9 +34,97 @@ DROP OPERATOR CLASS pg_catalog.cluster_clock_ops USING btree CASCADE;
 DROP OPERATOR FAMILY pg_catalog.cluster_clock_ops USING btree CASCADE;
 DROP TYPE pg_catalog.cluster_clock CASCADE;
 
+ALTER TABLE pg_catalog.pg_dist_background_task DROP COLUMN nodes_involved;
+
 CREATE FUNCTION pg_catalog.worker_append_table_to_shard(text, text, text, integer)
     RETURNS void
     LANGUAGE C STRICT
     AS 'MODULE_PATHNAME', $$worker_append_table_to_shard$$;
 COMMENT ON FUNCTION pg_catalog.worker_append_table_to_shard(text, text, text, integer)
     IS 'append a regular table''s contents to the shard';
+
+CREATE FUNCTION pg_catalog.worker_partition_query_result(
+    result_prefix text,
+    query text,
+    partition_column_index int,
+    partition_method citus.distribution_type,
+    partition_min_values text[],
+    partition_max_values text[],
+    binary_copy boolean,
+    allow_null_partition_column boolean DEFAULT false,
+    generate_empty_results boolean DEFAULT false,
+    OUT partition_index int,
+    OUT rows_written bigint,
+    OUT bytes_written bigint)
+RETURNS SETOF record
+LANGUAGE C STRICT VOLATILE
+AS 'MODULE_PATHNAME', $$worker_partition_query_result$$;
+COMMENT ON FUNCTION pg_catalog.worker_partition_query_result(text, text, int, citus.distribution_type, text[], text[], boolean, boolean, boolean)
+IS 'execute a query and partitions its results in set of local result files';
+
+DROP VIEW pg_catalog.citus_stat_shards;
+DROP FUNCTION pg_catalog.citus_shard_stat_counters();
+DELETE FROM pg_catalog.pg_dist_rebalance_strategy WHERE name = 'by_load';
+DROP FUNCTION pg_catalog.citus_shard_cost_by_load(bigint);
+DROP FUNCTION pg_catalog.citus_shard_access_stats();
+DROP FUNCTION pg_catalog.worker_split_copy(bigint, text, pg_catalog.split_copy_info[], bigint, bigint);
+DROP FUNCTION pg_catalog.citus_index_build_progress();
+#include "../udfs/create_time_partitions/10.2-1.sql"
+DROP FUNCTION pg_catalog.citus_internal_begin_deferred_shard_creation();
+DROP FUNCTION pg_catalog.citus_internal_finish_deferred_shard_creation();
+DROP FUNCTION pg_catalog.citus_delegate_procedure_calls(text[], int);
+DROP FUNCTION pg_catalog.citus_internal_copy_reference_tables(bigint, integer[], citus.shard_transfer_mode);
+DROP FUNCTION pg_catalog.citus_check_cluster_node_latency();
+
+-- restore citus_stat_activity() of 11.0-1, the view on it stays as is
+CREATE OR REPLACE FUNCTION pg_catalog.citus_stat_activity(OUT global_pid bigint, OUT nodeid int, OUT is_worker_query boolean, OUT datid oid, OUT datname name, OUT pid integer,
+                                                          OUT leader_pid integer, OUT usesysid oid, OUT usename name, OUT application_name text, OUT client_addr inet, OUT client_hostname text,
+                                                          OUT client_port integer, OUT backend_start timestamp with time zone, OUT xact_start timestamp with time zone,
+                                                          OUT query_start timestamp with time zone, OUT state_change timestamp with time zone, OUT wait_event_type text, OUT wait_event text,
+                                                          OUT state text, OUT backend_xid xid, OUT backend_xmin xid, OUT query_id bigint, OUT query text, OUT backend_type text)
+    RETURNS SETOF record
+    LANGUAGE plpgsql
+    AS $function$
+BEGIN
+    RETURN QUERY SELECT * FROM jsonb_to_recordset((
+        SELECT jsonb_agg(all_csa_rows_as_jsonb.csa_row_as_jsonb)::JSONB FROM (
+            SELECT jsonb_array_elements(run_command_on_all_nodes.result::JSONB)::JSONB || ('{"nodeid":' || run_command_on_all_nodes.nodeid || '}')::JSONB AS csa_row_as_jsonb
+            FROM run_command_on_all_nodes($$
+                SELECT coalesce(to_jsonb(array_agg(csa_from_one_node.*)), '[{}]'::JSONB)
+                FROM (
+                    SELECT global_pid, worker_query AS is_worker_query, pg_stat_activity.* FROM
+                    pg_stat_activity LEFT JOIN get_all_active_transactions() ON process_id = pid
+                ) AS csa_from_one_node;
+            $$, parallel:=true, give_warning_for_connection_errors:=true)
+            WHERE success = 't'
+        ) AS all_csa_rows_as_jsonb
+    ))
+    AS (global_pid bigint, nodeid int, is_worker_query boolean, datid oid, datname name, pid integer,
+        leader_pid integer, usesysid oid, usename name, application_name text, client_addr inet, client_hostname text,
+        client_port integer, backend_start timestamp with time zone, xact_start timestamp with time zone,
+        query_start timestamp with time zone, state_change timestamp with time zone, wait_event_type text, wait_event text,
+        state text, backend_xid xid, backend_xmin xid, query_id bigint, query text, backend_type text);
+END;
+$function$;
+DROP FUNCTION pg_catalog.citus_internal_stat_activity_snapshot();
+DROP FUNCTION pg_catalog.citus_internal_collect_stat_activity();
+DROP VIEW pg_catalog.citus_stat_statements_cluster;
+DROP FUNCTION pg_catalog.citus_cluster_query_stats();
+DROP FUNCTION pg_catalog.citus_worker_query_stats();
+DROP FUNCTION pg_catalog.citus_backend_wait_events();
+DROP VIEW pg_catalog.citus_stat_progress_distributed;
+DROP FUNCTION pg_catalog.citus_distributed_command_shard_progress();
+DROP FUNCTION pg_catalog.citus_distributed_command_progress();
+DROP FUNCTION pg_catalog.citus_tenant_load_stats();
+DROP VIEW pg_catalog.citus_stat_tenants;
+DROP FUNCTION pg_catalog.citus_cluster_tenant_stats();
+DROP FUNCTION pg_catalog.citus_routing_table_generation();
+DROP FUNCTION pg_catalog.citus_routing_table();
+DROP FUNCTION pg_catalog.read_inline_intermediate_result(text);
+DROP FUNCTION pg_catalog.citus_drop_incremental_rollup(text);
+DROP PROCEDURE pg_catalog.citus_refresh_incremental_rollup(text);
+DROP FUNCTION pg_catalog.citus_create_incremental_rollup(text, regclass, name, text);
+DROP TABLE pg_catalog.pg_dist_rollup;
+DROP FUNCTION pg_catalog.citus_shard_split_points(bigint, integer, float8);
+DROP FUNCTION pg_catalog.citus_bulk_load(regclass, text[], pg_catalog.citus_copy_format);
+DROP FUNCTION pg_catalog.read_bulk_load_file(text, pg_catalog.citus_copy_format);
@@ -0,0 +1,7 @@
+CREATE FUNCTION pg_catalog.citus_analyze_distributed(relation regclass DEFAULT NULL)
+    RETURNS void
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$citus_analyze_distributed$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_analyze_distributed(regclass)
+    IS 'samples the shards of a distributed table, or of all distributed tables, to compute column statistics for the shell tables';
@@ -0,0 +1,7 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_backend_wait_events(OUT pid integer,
+                                                                OUT wait_event text)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_backend_wait_events$$;
+COMMENT ON FUNCTION pg_catalog.citus_backend_wait_events()
+    IS 'returns the Citus wait events of the backends that pg_stat_activity shows as Extension waits';
@@ -0,0 +1,9 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_bulk_load(
+    table_name regclass,
+    file_names text[],
+    format pg_catalog.citus_copy_format DEFAULT 'csv')
+RETURNS bigint
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_bulk_load$$;
+COMMENT ON FUNCTION pg_catalog.citus_bulk_load(table_name regclass, file_names text[], format pg_catalog.citus_copy_format)
+    IS 'load files on storage shared by the nodes into a distributed table, reading them on the workers';
@@ -0,0 +1,14 @@
+CREATE FUNCTION pg_catalog.citus_check_cluster_node_latency (
+    OUT from_nodename text,
+    OUT from_nodeport int,
+    OUT to_nodename text,
+    OUT to_nodeport int,
+    OUT result bool,
+    OUT latency_ms double precision )
+    RETURNS SETOF RECORD
+    LANGUAGE C
+    STRICT
+    AS 'MODULE_PATHNAME', $$citus_check_cluster_node_latency$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_check_cluster_node_latency ()
+    IS 'checks connections between all nodes in the cluster and reports their latency';
@@ -0,0 +1,19 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_copy_connection_stats(OUT nodename text,
+                                                                   OUT nodeport integer,
+                                                                   OUT connection_id bigint,
+                                                                   OUT bytes_sent bigint,
+                                                                   OUT flushes bigint,
+                                                                   OUT flush_time double precision,
+                                                                   OUT throughput double precision,
+                                                                   OUT flush_threshold bigint)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_copy_connection_stats$$;
+COMMENT ON FUNCTION pg_catalog.citus_copy_connection_stats()
+    IS 'returns the COPY throughput in bytes per second and the flush threshold of the connections of the current session';
+
+CREATE OR REPLACE VIEW citus.citus_stat_copy_connections AS
+SELECT * FROM pg_catalog.citus_copy_connection_stats();
+
+ALTER VIEW citus.citus_stat_copy_connections SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_copy_connections TO PUBLIC;
@@ -0,0 +1,38 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_create_incremental_rollup(
+    rollup_name text,
+    source_table regclass,
+    progress_column name,
+    refresh_command text)
+RETURNS void
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    progress_column_type regtype;
+BEGIN
+    SELECT atttypid::regtype
+    INTO progress_column_type
+    FROM pg_attribute
+    WHERE attrelid = source_table AND attname = progress_column AND NOT attisdropped;
+
+    IF NOT FOUND THEN
+        RAISE 'column % of % does not exist', progress_column, source_table;
+    END IF;
+
+    -- the refresh command gets the bounds of the window as bigint parameters
+    IF progress_column_type NOT IN ('smallint'::regtype, 'integer'::regtype, 'bigint'::regtype) THEN
+        RAISE 'column % of % is of type %, but needs to be an integer column',
+              progress_column, source_table, progress_column_type
+        USING HINT = 'Use a column that is filled from a sequence, like a bigserial column.';
+    END IF;
+
+    INSERT INTO pg_catalog.pg_dist_rollup (rollup_name, source_table, progress_column,
+                                           refresh_command)
+    VALUES (rollup_name, source_table, progress_column, refresh_command);
+END;
+$$;
+COMMENT ON FUNCTION pg_catalog.citus_create_incremental_rollup(
+    rollup_name text,
+    source_table regclass,
+    progress_column name,
+    refresh_command text)
+IS 'define a rollup that aggregates the new rows of a table on each refresh';
@@ -0,0 +1,8 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_delegate_procedure_calls(
+    call_commands text[],
+    batch_size int DEFAULT 100)
+    RETURNS void
+    LANGUAGE C STRICT VOLATILE
+    AS 'MODULE_PATHNAME', $$citus_delegate_procedure_calls$$;
+COMMENT ON FUNCTION pg_catalog.citus_delegate_procedure_calls(text[], int)
+    IS 'delegate CALLs of distributed procedures to the workers in batches per worker';
@@ -0,0 +1,14 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_distributed_command_progress(OUT pid integer,
+                                                                         OUT command text,
+                                                                         OUT table_name regclass,
+                                                                         OUT phase text,
+                                                                         OUT started_at timestamptz,
+                                                                         OUT rows_processed bigint,
+                                                                         OUT bytes_sent bigint,
+                                                                         OUT fragments_produced bigint,
+                                                                         OUT fragments_fetched bigint)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_distributed_command_progress$$;
+COMMENT ON FUNCTION pg_catalog.citus_distributed_command_progress()
+    IS 'returns the progress of ongoing distributed COPY, INSERT..SELECT and repartition join commands';
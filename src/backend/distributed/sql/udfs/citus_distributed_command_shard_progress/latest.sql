@@ -0,0 +1,8 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_distributed_command_shard_progress(OUT pid integer,
+                                                                               OUT shardid bigint,
+                                                                               OUT rows_processed bigint)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_distributed_command_shard_progress$$;
+COMMENT ON FUNCTION pg_catalog.citus_distributed_command_shard_progress()
+    IS 'returns the rows that ongoing distributed COPY and INSERT..SELECT commands routed to each shard';
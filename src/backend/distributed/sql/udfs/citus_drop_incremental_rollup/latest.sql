@@ -0,0 +1,15 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_drop_incremental_rollup(rollup_name text)
+RETURNS void
+LANGUAGE plpgsql
+AS $$
+BEGIN
+    DELETE FROM pg_catalog.pg_dist_rollup r
+    WHERE r.rollup_name = citus_drop_incremental_rollup.rollup_name;
+
+    IF NOT FOUND THEN
+        RAISE 'incremental rollup % does not exist', rollup_name;
+    END IF;
+END;
+$$;
+COMMENT ON FUNCTION pg_catalog.citus_drop_incremental_rollup(rollup_name text)
+IS 'remove the definition of a rollup, which leaves its table in place';
@@ -0,0 +1,9 @@
+-- the combine query may read the rows of the remote scan in parallel workers
+-- when citus.enable_parallel_combine is on, which requires the placeholder
+-- function that stands in for the remote scan to be parallel safe
+CREATE OR REPLACE FUNCTION pg_catalog.citus_extradata_container(INTERNAL)
+    RETURNS SETOF record
+    LANGUAGE C PARALLEL SAFE
+AS 'MODULE_PATHNAME', $$citus_extradata_container$$;
+COMMENT ON FUNCTION pg_catalog.citus_extradata_container(INTERNAL)
+    IS 'placeholder function to store additional data in postgres node trees';
@@ -0,0 +1,23 @@
+CREATE FUNCTION pg_catalog.citus_hll_add_agg_sfunc(internal, anyelement, integer)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C PARALLEL SAFE;
+COMMENT ON FUNCTION pg_catalog.citus_hll_add_agg_sfunc(internal, anyelement, integer)
+    IS 'transition function for citus_hll_add_agg';
+
+CREATE FUNCTION pg_catalog.citus_hll_agg_ffunc(internal)
+RETURNS bytea
+AS 'MODULE_PATHNAME'
+LANGUAGE C PARALLEL SAFE;
+COMMENT ON FUNCTION pg_catalog.citus_hll_agg_ffunc(internal)
+    IS 'finalizer for citus_hll_add_agg and citus_hll_union_agg';
+
+-- select citus_hll_add_agg(col, log2m)
+-- builds a HyperLogLog sketch with 2^log2m registers of the values of col
+CREATE AGGREGATE pg_catalog.citus_hll_add_agg(anyelement, integer) (
+    STYPE = internal,
+    SFUNC = pg_catalog.citus_hll_add_agg_sfunc,
+    FINALFUNC = pg_catalog.citus_hll_agg_ffunc
+);
+COMMENT ON AGGREGATE pg_catalog.citus_hll_add_agg(anyelement, integer)
+    IS 'support aggregate for approximating count(distinct) on workers';
@@ -0,0 +1,6 @@
+CREATE FUNCTION pg_catalog.citus_hll_cardinality(bytea)
+RETURNS double precision
+AS 'MODULE_PATHNAME'
+LANGUAGE C IMMUTABLE PARALLEL SAFE;
+COMMENT ON FUNCTION pg_catalog.citus_hll_cardinality(bytea)
+    IS 'estimates the number of distinct values in a HyperLogLog sketch';
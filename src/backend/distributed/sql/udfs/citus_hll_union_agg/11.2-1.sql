@@ -0,0 +1,16 @@
+CREATE FUNCTION pg_catalog.citus_hll_union_agg_sfunc(internal, bytea)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C PARALLEL SAFE;
+COMMENT ON FUNCTION pg_catalog.citus_hll_union_agg_sfunc(internal, bytea)
+    IS 'transition function for citus_hll_union_agg';
+
+-- select citus_hll_union_agg(sketch)
+-- merges the HyperLogLog sketches that citus_hll_add_agg built
+CREATE AGGREGATE pg_catalog.citus_hll_union_agg(bytea) (
+    STYPE = internal,
+    SFUNC = pg_catalog.citus_hll_union_agg_sfunc,
+    FINALFUNC = pg_catalog.citus_hll_agg_ffunc
+);
+COMMENT ON AGGREGATE pg_catalog.citus_hll_union_agg(bytea)
+    IS 'support aggregate for combining count(distinct) approximations from workers';
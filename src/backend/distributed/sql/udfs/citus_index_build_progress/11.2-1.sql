@@ -0,0 +1,13 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_index_build_progress(OUT pid integer,
+                                                                 OUT table_name regclass,
+                                                                 OUT shardid bigint,
+                                                                 OUT nodename text,
+                                                                 OUT nodeport integer,
+                                                                 OUT status text,
+                                                                 OUT started_at timestamptz,
+                                                                 OUT finished_at timestamptz)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_index_build_progress$$;
+COMMENT ON FUNCTION pg_catalog.citus_index_build_progress()
+    IS 'returns the progress of the shard index builds of ongoing CREATE INDEX and REINDEX commands on distributed tables';
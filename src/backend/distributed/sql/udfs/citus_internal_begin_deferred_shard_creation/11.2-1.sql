@@ -0,0 +1,6 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_internal_begin_deferred_shard_creation()
+    RETURNS void
+    LANGUAGE C VOLATILE
+    AS 'MODULE_PATHNAME', $$citus_internal_begin_deferred_shard_creation$$;
+COMMENT ON FUNCTION pg_catalog.citus_internal_begin_deferred_shard_creation()
+    IS 'Internal UDF that defers the creation of new shards in the transaction';
@@ -0,0 +1,21 @@
+-- citus_internal_collect_stat_activity returns the pg_stat_activity rows of all nodes, with
+-- their global_pid, nodeid and is_worker_query, as a jsonb array. It is used by citus_stat_activity
+-- and by the maintenance daemon to collect the activity snapshot.
+CREATE OR REPLACE FUNCTION pg_catalog.citus_internal_collect_stat_activity()
+    RETURNS jsonb
+    LANGUAGE sql
+    AS $function$
+    SELECT jsonb_agg(all_csa_rows_as_jsonb.csa_row_as_jsonb)::JSONB FROM (
+        SELECT jsonb_array_elements(run_command_on_all_nodes.result::JSONB)::JSONB || ('{"nodeid":' || run_command_on_all_nodes.nodeid || '}')::JSONB AS csa_row_as_jsonb
+        FROM run_command_on_all_nodes($$
+            SELECT coalesce(to_jsonb(array_agg(csa_from_one_node.*)), '[{}]'::JSONB)
+            FROM (
+                SELECT global_pid, worker_query AS is_worker_query, pg_stat_activity.* FROM
+                pg_stat_activity LEFT JOIN get_all_active_transactions() ON process_id = pid
+            ) AS csa_from_one_node;
+        $$, parallel:=true, give_warning_for_connection_errors:=true)
+        WHERE success = 't'
+    ) AS all_csa_rows_as_jsonb;
+$function$;
+COMMENT ON FUNCTION pg_catalog.citus_internal_collect_stat_activity()
+    IS 'Internal UDF that collects the activity of all nodes for citus_stat_activity';
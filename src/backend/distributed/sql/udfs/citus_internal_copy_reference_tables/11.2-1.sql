@@ -0,0 +1,9 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_internal_copy_reference_tables(
+    shard_id bigint,
+    target_node_ids integer[],
+    transfer_mode citus.shard_transfer_mode default 'auto')
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_internal_copy_reference_tables$$;
+COMMENT ON FUNCTION pg_catalog.citus_internal_copy_reference_tables(bigint, integer[], citus.shard_transfer_mode)
+    IS 'Internal UDF that copies the reference tables to the given nodes in parallel';
@@ -0,0 +1,6 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_internal_finish_deferred_shard_creation()
+    RETURNS void
+    LANGUAGE C VOLATILE
+    AS 'MODULE_PATHNAME', $$citus_internal_finish_deferred_shard_creation$$;
+COMMENT ON FUNCTION pg_catalog.citus_internal_finish_deferred_shard_creation()
+    IS 'Internal UDF that creates the shards of which the creation was deferred';
@@ -0,0 +1,6 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_internal_stat_activity_snapshot()
+    RETURNS jsonb
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_internal_stat_activity_snapshot$$;
+COMMENT ON FUNCTION pg_catalog.citus_internal_stat_activity_snapshot()
+    IS 'Internal UDF that returns the activity snapshot collected by the maintenance daemon, if recent enough';
@@ -9,6 +9,16 @@ RETURNS boolean AS $$
       RETURN true;
     END IF;
 
+    -- sessions that wait for an admission slot, see
+    -- citus.max_concurrent_multi_shard_queries, or for a connection slot, see
+    -- citus.max_shared_pool_size, wait for the other sessions without waiting
+    -- for a lock
+    IF EXISTS (SELECT 1 FROM pg_catalog.citus_backend_wait_events()
+               WHERE pid = pBlockedPid AND
+                     wait_event IN ('CitusExecutionAdmission', 'CitusSharedConnection')) THEN
+      RETURN true;
+    END IF;
+
     -- pg says we're not blocked locally; check whether we're blocked globally.
     -- Note that worker process may be blocked or waiting for a lock. So we need to
     -- get transaction number for both of them. Following IF provides the transaction
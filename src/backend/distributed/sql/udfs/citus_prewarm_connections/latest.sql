@@ -0,0 +1,7 @@
+CREATE FUNCTION pg_catalog.citus_prewarm_connections()
+    RETURNS integer
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_prewarm_connections$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_prewarm_connections()
+    IS 'opens and caches connections to all worker nodes for the current session';
@@ -0,0 +1,20 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_query_planner_timings(OUT queryid bigint,
+                                                                   OUT userid oid,
+                                                                   OUT dbid oid,
+                                                                   OUT plans bigint,
+                                                                   OUT total_plan_time double precision,
+                                                                   OUT recursive_planning_time double precision,
+                                                                   OUT pushdown_checks_time double precision,
+                                                                   OUT shard_pruning_time double precision,
+                                                                   OUT deparse_time double precision)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_query_planner_timings$$;
+COMMENT ON FUNCTION pg_catalog.citus_query_planner_timings()
+    IS 'returns the number of distributed plans of queries and the total time spent in the phases of planning them in milliseconds, per query';
+
+CREATE OR REPLACE VIEW citus.citus_stat_statements_planner_timings AS
+SELECT * FROM pg_catalog.citus_query_planner_timings();
+
+ALTER VIEW citus.citus_stat_statements_planner_timings SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_statements_planner_timings TO PUBLIC;
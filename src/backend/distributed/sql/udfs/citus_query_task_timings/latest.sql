@@ -0,0 +1,25 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_query_task_timings(OUT queryid bigint,
+                                                                OUT userid oid,
+                                                                OUT dbid oid,
+                                                                OUT nodename text,
+                                                                OUT nodeport integer,
+                                                                OUT tasks bigint,
+                                                                OUT connection_wait_p50 double precision,
+                                                                OUT connection_wait_p99 double precision,
+                                                                OUT query_send_p50 double precision,
+                                                                OUT query_send_p99 double precision,
+                                                                OUT first_result_p50 double precision,
+                                                                OUT first_result_p99 double precision,
+                                                                OUT result_transfer_p50 double precision,
+                                                                OUT result_transfer_p99 double precision)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_query_task_timings$$;
+COMMENT ON FUNCTION pg_catalog.citus_query_task_timings()
+    IS 'returns percentiles of the durations of the phases of the tasks of queries in milliseconds, per query and worker';
+
+CREATE OR REPLACE VIEW citus.citus_stat_statements_task_timings AS
+SELECT * FROM pg_catalog.citus_query_task_timings();
+
+ALTER VIEW citus.citus_stat_statements_task_timings SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_statements_task_timings TO PUBLIC;
@@ -0,0 +1,57 @@
+CREATE OR REPLACE PROCEDURE pg_catalog.citus_refresh_incremental_rollup(rollup_name text)
+LANGUAGE plpgsql
+AS $$
+DECLARE
+    -- the rollup to refresh
+    rollup record;
+
+    -- the rows with progress column values in (window_start, window_end] are aggregated
+    window_start bigint;
+    window_end bigint;
+BEGIN
+    SELECT *
+    INTO rollup
+    FROM pg_catalog.pg_dist_rollup r
+    WHERE r.rollup_name = citus_refresh_incremental_rollup.rollup_name;
+
+    IF NOT FOUND THEN
+        RAISE 'incremental rollup % does not exist', rollup_name;
+    END IF;
+
+    -- Wait for the writes that are in progress, such that no row with a value
+    -- below the end of the window gets committed after we aggregated it. The
+    -- lock only lasts until the end of the window is found.
+    EXECUTE format('LOCK TABLE %s IN EXCLUSIVE MODE', rollup.source_table);
+
+    EXECUTE format('SELECT max(%I) FROM %s WHERE %I > $1',
+                   rollup.progress_column, rollup.source_table, rollup.progress_column)
+    INTO window_end
+    USING rollup.aggregated_until;
+
+    COMMIT;
+
+    IF window_end IS NULL THEN
+        -- there are no new rows
+        RETURN;
+    END IF;
+
+    -- another refresh may have aggregated part of the window in the meantime
+    SELECT aggregated_until
+    INTO window_start
+    FROM pg_catalog.pg_dist_rollup r
+    WHERE r.rollup_name = citus_refresh_incremental_rollup.rollup_name
+    FOR UPDATE;
+
+    IF NOT FOUND OR window_start >= window_end THEN
+        RETURN;
+    END IF;
+
+    EXECUTE rollup.refresh_command USING window_start, window_end;
+
+    UPDATE pg_catalog.pg_dist_rollup r
+    SET aggregated_until = window_end
+    WHERE r.rollup_name = citus_refresh_incremental_rollup.rollup_name;
+END;
+$$;
+COMMENT ON PROCEDURE pg_catalog.citus_refresh_incremental_rollup(rollup_name text)
+IS 'aggregate the rows that were added to the source table of a rollup since its last refresh';
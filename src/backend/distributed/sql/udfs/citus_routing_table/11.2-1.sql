@@ -0,0 +1,18 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_routing_table(OUT generation bigint,
+                                                           OUT colocation_id int,
+                                                           OUT shard_min_value int,
+                                                           OUT shard_max_value int,
+                                                           OUT nodename text,
+                                                           OUT nodeport int)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_routing_table$$;
+COMMENT ON FUNCTION pg_catalog.citus_routing_table()
+    IS 'returns the nodes of the shard ranges of each colocation group of hash distributed tables, along with the routing table generation';
+
+CREATE OR REPLACE FUNCTION pg_catalog.citus_routing_table_generation()
+RETURNS bigint
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_routing_table_generation$$;
+COMMENT ON FUNCTION pg_catalog.citus_routing_table_generation()
+    IS 'returns the routing table generation, which increases whenever the metadata changes';
@@ -0,0 +1,9 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_shard_access_stats(OUT shardid bigint,
+                                                                OUT queries double precision,
+                                                                OUT rows double precision,
+                                                                OUT execution_time double precision)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_access_stats$$;
+COMMENT ON FUNCTION pg_catalog.citus_shard_access_stats()
+    IS 'returns the recent number of tasks, rows and execution time in milliseconds per shard, as used by the by_load rebalance strategy';
@@ -0,0 +1,6 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_shard_cost_by_load(bigint)
+    RETURNS float4
+    AS 'MODULE_PATHNAME'
+    LANGUAGE C STRICT VOLATILE;
+COMMENT ON FUNCTION pg_catalog.citus_shard_cost_by_load(bigint)
+  IS 'a shard cost function for use by the rebalance algorithm that returns 1 plus the recent execution time in milliseconds of the tasks on the specified shard and the shards that are colocated with it';
@@ -0,0 +1,9 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_shard_split_points(
+    shard_id bigint,
+    split_count integer,
+    sample_percent float8 DEFAULT 1.0)
+RETURNS text[]
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_split_points$$;
+COMMENT ON FUNCTION pg_catalog.citus_shard_split_points(shard_id bigint, split_count integer, sample_percent float8)
+    IS 'compute split points that split a shard into children with about equally many rows';
@@ -0,0 +1,12 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_shard_stat_counters(OUT shardid bigint,
+                                                                 OUT nodename text,
+                                                                 OUT nodeport integer,
+                                                                 OUT seq_scan bigint,
+                                                                 OUT idx_scan bigint,
+                                                                 OUT tup_read bigint,
+                                                                 OUT tup_written bigint)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_stat_counters$$;
+COMMENT ON FUNCTION pg_catalog.citus_shard_stat_counters()
+    IS 'returns the scan and tuple counters of the shard placements on all nodes';
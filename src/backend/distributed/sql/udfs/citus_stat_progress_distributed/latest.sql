@@ -0,0 +1,20 @@
+-- citus_stat_progress_distributed shows the progress of the distributed commands of the
+-- backends on this node, along with their activity
+CREATE OR REPLACE VIEW citus.citus_stat_progress_distributed AS
+SELECT p.pid,
+       a.datname,
+       a.usename,
+       p.command,
+       p.table_name,
+       p.phase,
+       p.started_at,
+       p.rows_processed,
+       p.bytes_sent,
+       p.fragments_produced,
+       p.fragments_fetched,
+       a.query
+FROM pg_catalog.citus_distributed_command_progress() p
+LEFT JOIN pg_catalog.pg_stat_activity a ON a.pid = p.pid;
+
+ALTER VIEW citus.citus_stat_progress_distributed SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_progress_distributed TO PUBLIC;
@@ -0,0 +1,35 @@
+CREATE OR REPLACE VIEW citus.citus_stat_shards AS
+SELECT
+     pg_dist_shard.logicalrelid AS table_name,
+     pg_dist_shard.shardid,
+     shard_name(pg_dist_shard.logicalrelid, pg_dist_shard.shardid) AS shard_name,
+     coalesce(counters.seq_scan, 0) AS seq_scan,
+     coalesce(counters.idx_scan, 0) AS idx_scan,
+     coalesce(counters.tup_read, 0) AS tup_read,
+     coalesce(counters.tup_written, 0) AS tup_written,
+     coalesce(access.queries, 0) AS queries,
+     coalesce(access.rows, 0) AS rows,
+     coalesce(access.execution_time, 0) AS execution_time
+FROM
+   pg_dist_shard
+LEFT JOIN
+   (SELECT
+        shardid,
+        sum(seq_scan)::bigint AS seq_scan,
+        sum(idx_scan)::bigint AS idx_scan,
+        sum(tup_read)::bigint AS tup_read,
+        sum(tup_written)::bigint AS tup_written
+    FROM pg_catalog.citus_shard_stat_counters()
+    GROUP BY shardid) AS counters
+ON
+   pg_dist_shard.shardid = counters.shardid
+LEFT JOIN
+   pg_catalog.citus_shard_access_stats() AS access
+ON
+   pg_dist_shard.shardid = access.shardid
+ORDER BY
+   pg_dist_shard.logicalrelid::text, pg_dist_shard.shardid
+;
+
+ALTER VIEW citus.citus_stat_shards SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_shards TO PUBLIC;
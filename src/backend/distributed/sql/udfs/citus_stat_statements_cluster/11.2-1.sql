@@ -0,0 +1,61 @@
+-- citus_cluster_query_stats combines citus_worker_query_stats() of all nodes. The user and the
+-- database are returned by name, since their OIDs differ between the nodes.
+CREATE OR REPLACE FUNCTION pg_catalog.citus_cluster_query_stats(OUT queryid bigint,
+                                                                OUT nodeid integer,
+                                                                OUT username name,
+                                                                OUT datname name,
+                                                                OUT calls bigint,
+                                                                OUT total_exec_time double precision,
+                                                                OUT rows bigint,
+                                                                OUT shared_blks_hit bigint,
+                                                                OUT shared_blks_read bigint,
+                                                                OUT shared_blks_written bigint)
+    RETURNS SETOF record
+    LANGUAGE plpgsql
+    AS $function$
+BEGIN
+    RETURN QUERY SELECT * FROM jsonb_to_recordset((
+        SELECT coalesce(jsonb_agg(all_wqs_rows_as_jsonb.wqs_row_as_jsonb), '[]'::JSONB) FROM (
+            SELECT jsonb_array_elements(run_command_on_all_nodes.result::JSONB)::JSONB || ('{"nodeid":' || run_command_on_all_nodes.nodeid || '}')::JSONB AS wqs_row_as_jsonb
+            FROM run_command_on_all_nodes($$
+                SELECT coalesce(to_jsonb(array_agg(wqs_from_one_node.*)), '[]'::JSONB)
+                FROM (
+                    SELECT queryid, pg_get_userbyid(userid) AS username, pg_database.datname, calls, total_exec_time,
+                           rows, shared_blks_hit, shared_blks_read, shared_blks_written
+                    FROM citus_worker_query_stats() JOIN pg_database ON pg_database.oid = dbid
+                ) AS wqs_from_one_node;
+            $$, parallel:=true, give_warning_for_connection_errors:=true)
+            WHERE success = 't'
+        ) AS all_wqs_rows_as_jsonb
+    ))
+    AS (queryid bigint, nodeid integer, username name, datname name, calls bigint, total_exec_time double precision,
+        rows bigint, shared_blks_hit bigint, shared_blks_read bigint, shared_blks_written bigint);
+END;
+$function$;
+COMMENT ON FUNCTION pg_catalog.citus_cluster_query_stats()
+    IS 'returns the statistics of the tasks of distributed queries on all nodes, per query identifier on the coordinator';
+
+-- citus_stat_statements_cluster shows the distributed queries of citus_stat_statements along
+-- with the execution time, rows and buffer usage of their tasks on each node. Requires
+-- citus.stat_statements_track_workers on the coordinator.
+CREATE OR REPLACE VIEW citus.citus_stat_statements_cluster AS
+SELECT css.queryid, css.userid, css.dbid, css.query, css.calls, cqs.nodeid,
+       cqs.calls AS worker_calls,
+       cqs.total_exec_time AS worker_total_exec_time,
+       cqs.rows AS worker_rows,
+       cqs.shared_blks_hit AS worker_shared_blks_hit,
+       cqs.shared_blks_read AS worker_shared_blks_read,
+       cqs.shared_blks_written AS worker_shared_blks_written
+FROM (
+    SELECT queryid, userid, dbid, query, sum(calls)::bigint AS calls
+    FROM pg_catalog.citus_stat_statements
+    GROUP BY queryid, userid, dbid, query
+) css
+JOIN pg_catalog.pg_database ON pg_database.oid = css.dbid
+JOIN pg_catalog.citus_cluster_query_stats() cqs
+    ON cqs.queryid = css.queryid AND
+       cqs.username = pg_catalog.pg_get_userbyid(css.userid) AND
+       cqs.datname = pg_database.datname;
+
+ALTER VIEW citus.citus_stat_statements_cluster SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_statements_cluster TO PUBLIC;
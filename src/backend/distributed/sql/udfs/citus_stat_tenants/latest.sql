@@ -0,0 +1,51 @@
+-- citus_cluster_tenant_stats combines citus_tenant_load_stats() of all nodes. The tables are
+-- returned by name, since their OIDs differ between the nodes.
+CREATE OR REPLACE FUNCTION pg_catalog.citus_cluster_tenant_stats(OUT nodeid integer,
+                                                                 OUT colocation_id integer,
+                                                                 OUT table_name text,
+                                                                 OUT tenant_id text,
+                                                                 OUT calls bigint,
+                                                                 OUT rows bigint,
+                                                                 OUT total_exec_time double precision,
+                                                                 OUT cpu_time double precision,
+                                                                 OUT sampled_queries double precision,
+                                                                 OUT load_share double precision)
+    RETURNS SETOF record
+    LANGUAGE plpgsql
+    AS $function$
+BEGIN
+    RETURN QUERY SELECT * FROM jsonb_to_recordset((
+        SELECT coalesce(jsonb_agg(all_tls_rows_as_jsonb.tls_row_as_jsonb), '[]'::JSONB) FROM (
+            SELECT jsonb_array_elements(run_command_on_all_nodes.result::JSONB)::JSONB || ('{"nodeid":' || run_command_on_all_nodes.nodeid || '}')::JSONB AS tls_row_as_jsonb
+            FROM run_command_on_all_nodes($$
+                SELECT coalesce(to_jsonb(array_agg(tls_from_one_node.*)), '[]'::JSONB)
+                FROM (
+                    SELECT colocation_id, table_name::text AS table_name, tenant_id, calls, rows,
+                           total_exec_time, cpu_time, sampled_queries, load_share
+                    FROM citus_tenant_load_stats()
+                ) AS tls_from_one_node;
+            $$, parallel:=true, give_warning_for_connection_errors:=true)
+            WHERE success = 't'
+        ) AS all_tls_rows_as_jsonb
+    ))
+    AS (nodeid integer, colocation_id integer, table_name text, tenant_id text, calls bigint,
+        rows bigint, total_exec_time double precision, cpu_time double precision,
+        sampled_queries double precision, load_share double precision);
+END;
+$function$;
+COMMENT ON FUNCTION pg_catalog.citus_cluster_tenant_stats()
+    IS 'returns the estimated statistics of the router queries per distribution column value on all nodes';
+
+-- citus_stat_tenants sums the statistics of the tenants over the nodes that routed their
+-- queries. Requires citus.tenant_load_sample_rate on those nodes.
+CREATE OR REPLACE VIEW citus.citus_stat_tenants AS
+SELECT colocation_id, min(table_name) AS table_name, tenant_id,
+       sum(calls)::bigint AS calls,
+       sum(rows)::bigint AS rows,
+       sum(total_exec_time) AS total_exec_time,
+       sum(cpu_time) AS cpu_time
+FROM pg_catalog.citus_cluster_tenant_stats()
+GROUP BY colocation_id, tenant_id;
+
+ALTER VIEW citus.citus_stat_tenants SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_tenants TO PUBLIC;
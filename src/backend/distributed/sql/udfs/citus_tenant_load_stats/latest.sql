@@ -0,0 +1,14 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_tenant_load_stats(OUT colocation_id int,
+                                                               OUT table_name regclass,
+                                                               OUT tenant_id text,
+                                                               OUT calls bigint,
+                                                               OUT rows bigint,
+                                                               OUT total_exec_time double precision,
+                                                               OUT cpu_time double precision,
+                                                               OUT sampled_queries double precision,
+                                                               OUT load_share double precision)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_tenant_load_stats$$;
+COMMENT ON FUNCTION pg_catalog.citus_tenant_load_stats()
+    IS 'returns the estimated calls, rows, execution time and CPU time of the router queries per distribution column value on this node, extrapolated from sampled queries';
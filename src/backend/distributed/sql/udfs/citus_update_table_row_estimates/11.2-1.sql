@@ -0,0 +1,7 @@
+CREATE FUNCTION pg_catalog.citus_update_table_row_estimates()
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$citus_update_table_row_estimates$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_update_table_row_estimates()
+    IS 'refreshes the row estimates of all Citus tables that the planner uses to choose join orders';
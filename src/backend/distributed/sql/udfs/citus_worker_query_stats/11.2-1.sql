@@ -0,0 +1,14 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_worker_query_stats(OUT queryid bigint,
+                                                               OUT userid oid,
+                                                               OUT dbid oid,
+                                                               OUT calls bigint,
+                                                               OUT total_exec_time double precision,
+                                                               OUT rows bigint,
+                                                               OUT shared_blks_hit bigint,
+                                                               OUT shared_blks_read bigint,
+                                                               OUT shared_blks_written bigint)
+RETURNS SETOF record
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_worker_query_stats$$;
+COMMENT ON FUNCTION pg_catalog.citus_worker_query_stats()
+    IS 'returns the statistics of the tasks of distributed queries executed on this node, per query identifier on the coordinator';
@@ -0,0 +1,33 @@
+CREATE FUNCTION pg_catalog.coord_combine_agg_binary_sfunc(internal, oid, bytea, anyelement)
+RETURNS internal
+AS 'MODULE_PATHNAME'
+LANGUAGE C PARALLEL SAFE;
+COMMENT ON FUNCTION pg_catalog.coord_combine_agg_binary_sfunc(internal, oid, bytea, anyelement)
+    IS 'transition function for coord_combine_agg_binary';
+
+CREATE FUNCTION pg_catalog.coord_combine_agg_binary_ffunc(internal, oid, bytea, anyelement)
+RETURNS anyelement
+AS 'MODULE_PATHNAME', $$coord_combine_agg_ffunc$$
+LANGUAGE C PARALLEL SAFE;
+COMMENT ON FUNCTION pg_catalog.coord_combine_agg_binary_ffunc(internal, oid, bytea, anyelement)
+    IS 'finalizer for coord_combine_agg_binary';
+
+-- select coord_combine_agg_binary(agg, col)
+-- equivalent to
+-- select agg_ffunc(agg_combine(agg_deserialize(col)))
+CREATE AGGREGATE pg_catalog.coord_combine_agg_binary(oid, bytea, anyelement) (
+    STYPE = internal,
+    SFUNC = pg_catalog.coord_combine_agg_binary_sfunc,
+    FINALFUNC = pg_catalog.coord_combine_agg_binary_ffunc,
+    FINALFUNC_EXTRA
+);
+COMMENT ON AGGREGATE pg_catalog.coord_combine_agg_binary(oid, bytea, anyelement)
+    IS 'support aggregate for implementing combining binary partial aggregate results from workers';
+
+REVOKE ALL ON FUNCTION pg_catalog.coord_combine_agg_binary_ffunc FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_catalog.coord_combine_agg_binary_sfunc FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_catalog.coord_combine_agg_binary FROM PUBLIC;
+
+GRANT EXECUTE ON FUNCTION pg_catalog.coord_combine_agg_binary_ffunc TO PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_catalog.coord_combine_agg_binary_sfunc TO PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_catalog.coord_combine_agg_binary TO PUBLIC;
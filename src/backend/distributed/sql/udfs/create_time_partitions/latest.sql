@@ -26,6 +26,10 @@ BEGIN
     FROM pg_class JOIN pg_namespace ON pg_class.relnamespace = pg_namespace.oid
     WHERE pg_class.oid = table_name::oid;
 
+    -- Create the shards of all partitions in one go after creating the
+    -- partitions rather than once per partition.
+    PERFORM pg_catalog.citus_internal_begin_deferred_shard_creation();
+
     -- Get missing partition range info using the get_missing_partition_ranges
     -- and create partitions using that info.
     FOR missing_partition_record IN
@@ -43,6 +47,8 @@ BEGIN
         partition_created := true;
     END LOOP;
 
+    PERFORM pg_catalog.citus_internal_finish_deferred_shard_creation();
+
     RETURN partition_created;
 END;
 $$;
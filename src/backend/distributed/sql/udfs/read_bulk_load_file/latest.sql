@@ -0,0 +1,6 @@
+CREATE OR REPLACE FUNCTION pg_catalog.read_bulk_load_file(file_name text, format pg_catalog.citus_copy_format DEFAULT 'csv')
+    RETURNS SETOF record
+    LANGUAGE C STRICT VOLATILE PARALLEL RESTRICTED
+    AS 'MODULE_PATHNAME', $$read_bulk_load_file$$;
+COMMENT ON FUNCTION pg_catalog.read_bulk_load_file(text, pg_catalog.citus_copy_format)
+    IS 'read a COPY-formatted file on the local file system and return it as a set of records';
@@ -0,0 +1,6 @@
+CREATE OR REPLACE FUNCTION pg_catalog.read_inline_intermediate_result(copy_data text)
+    RETURNS SETOF record
+    LANGUAGE C STRICT VOLATILE PARALLEL SAFE
+    AS 'MODULE_PATHNAME', $$read_inline_intermediate_result$$;
+COMMENT ON FUNCTION pg_catalog.read_inline_intermediate_result(text)
+    IS 'read an intermediate result that is inlined in COPY text format and return it as a set of records';
@@ -0,0 +1,10 @@
+CREATE FUNCTION pg_catalog.worker_build_join_key_filter(
+    query text,
+    join_column_index int,
+    filter_size int)
+    RETURNS bytea
+    LANGUAGE C STRICT VOLATILE
+    AS 'MODULE_PATHNAME', $$worker_build_join_key_filter$$;
+
+COMMENT ON FUNCTION pg_catalog.worker_build_join_key_filter(text, int, int)
+    IS 'execute a query and build a bloom filter of the values of a column';
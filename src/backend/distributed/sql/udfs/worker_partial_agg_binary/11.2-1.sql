@@ -0,0 +1,23 @@
+CREATE FUNCTION pg_catalog.worker_partial_agg_binary_ffunc(internal)
+RETURNS bytea
+AS 'MODULE_PATHNAME'
+LANGUAGE C PARALLEL SAFE;
+COMMENT ON FUNCTION pg_catalog.worker_partial_agg_binary_ffunc(internal)
+    IS 'finalizer for worker_partial_agg_binary';
+
+-- select worker_partial_agg_binary(agg, ...)
+-- equivalent to
+-- select agg_serialize(agg_without_ffunc(...))
+CREATE AGGREGATE pg_catalog.worker_partial_agg_binary(oid, anyelement) (
+    STYPE = internal,
+    SFUNC = pg_catalog.worker_partial_agg_sfunc,
+    FINALFUNC = pg_catalog.worker_partial_agg_binary_ffunc
+);
+COMMENT ON AGGREGATE pg_catalog.worker_partial_agg_binary(oid, anyelement)
+    IS 'support aggregate for implementing partial aggregation on workers with binary transition states';
+
+REVOKE ALL ON FUNCTION pg_catalog.worker_partial_agg_binary_ffunc FROM PUBLIC;
+REVOKE ALL ON FUNCTION pg_catalog.worker_partial_agg_binary FROM PUBLIC;
+
+GRANT EXECUTE ON FUNCTION pg_catalog.worker_partial_agg_binary_ffunc TO PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_catalog.worker_partial_agg_binary TO PUBLIC;
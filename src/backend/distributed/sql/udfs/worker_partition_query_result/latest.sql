@@ -1,4 +1,4 @@
-DROP FUNCTION pg_catalog.worker_partition_query_result(text, text, int, citus.distribution_type, text[], text[], boolean);
+DROP FUNCTION pg_catalog.worker_partition_query_result(text, text, int, citus.distribution_type, text[], text[], boolean, boolean, boolean);
 
 CREATE OR REPLACE FUNCTION pg_catalog.worker_partition_query_result(
     result_prefix text,
@@ -10,11 +10,16 @@ CREATE OR REPLACE FUNCTION pg_catalog.worker_partition_query_result(
     binary_copy boolean,
     allow_null_partition_column boolean DEFAULT false,
     generate_empty_results boolean DEFAULT false,
+    join_key_filter_result_id text DEFAULT '',
+    target_node_names text[] DEFAULT '{}',
+    target_node_ports int[] DEFAULT '{}',
+    heavy_hitter_result_id text DEFAULT '',
+    replicate_heavy_hitters boolean DEFAULT false,
     OUT partition_index int,
     OUT rows_written bigint,
     OUT bytes_written bigint)
 RETURNS SETOF record
 LANGUAGE C STRICT VOLATILE
 AS 'MODULE_PATHNAME', $$worker_partition_query_result$$;
-COMMENT ON FUNCTION pg_catalog.worker_partition_query_result(text, text, int, citus.distribution_type, text[], text[], boolean, boolean, boolean)
+COMMENT ON FUNCTION pg_catalog.worker_partition_query_result(text, text, int, citus.distribution_type, text[], text[], boolean, boolean, boolean, text, text[], int[], text, boolean)
 IS 'execute a query and partitions its results in set of local result files';
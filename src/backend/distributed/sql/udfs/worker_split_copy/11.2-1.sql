@@ -0,0 +1,11 @@
+CREATE OR REPLACE FUNCTION pg_catalog.worker_split_copy(
+    source_shard_id bigint,
+	distribution_column text,
+    splitCopyInfos pg_catalog.split_copy_info[],
+    start_block bigint,
+    end_block bigint)
+RETURNS void
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$worker_split_copy$$;
+COMMENT ON FUNCTION pg_catalog.worker_split_copy(source_shard_id bigint, distribution_column text, splitCopyInfos pg_catalog.split_copy_info[], start_block bigint, end_block bigint)
+    IS 'Perform split copy for the blocks of a shard in the range [start_block, end_block), end_block -1 meaning until the end';
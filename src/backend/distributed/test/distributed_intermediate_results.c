@@ -159,7 +159,7 @@ redistribute_task_list_results(PG_FUNCTION_ARGS)
 	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
 	{
 		ShardInterval *shardInterval =
-			targetRelation->sortedShardIntervalArray[shardIndex];
+			GetCachedShardInterval(targetRelation, shardIndex);
 		uint64 shardId = shardInterval->shardId;
 
 		int fragmentCount = list_length(shardResultIds[shardIndex]);
@@ -0,0 +1,498 @@
+/*-------------------------------------------------------------------------
+ *
+ * test/src/microbenchmarks.c
+ *
+ * This file contains functions that time internals of the planner and the
+ * executor in a loop, such that the effect of optimizations can be measured
+ * on any schema. Each function returns the average time of an iteration in
+ * nanoseconds, as measured by instr_time.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "c.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "access/htup_details.h"
+#include "access/relation.h"
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "distributed/adaptive_executor.h"
+#include "distributed/citus_nodes.h"
+#include "distributed/citus_ruleutils.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_utility.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/multi_router_planner.h"
+#include "distributed/shard_pruning.h"
+#include "distributed/shardinterval_utils.h"
+#include "distributed/version_compat.h"
+#include "lib/stringinfo.h"
+#include "nodes/makefuncs.h"
+#include "nodes/parsenodes.h"
+#include "optimizer/optimizer.h"
+#include "portability/instr_time.h"
+#include "tcop/tcopprot.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+
+static Query * ParseBenchmarkQuery(text *queryText);
+static Oid BenchmarkQueryRelationId(Query *query);
+static void CheckIterationCount(int iterations);
+static MemoryContext CreateBenchmarkContext(void);
+static double NanosecondsPerCall(instr_time totalTime, uint64 callCount);
+
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(benchmark_prune_shards);
+PG_FUNCTION_INFO_V1(benchmark_fast_path_router_query);
+PG_FUNCTION_INFO_V1(benchmark_citus_table_cache_entry);
+PG_FUNCTION_INFO_V1(benchmark_deparse_shard_query);
+PG_FUNCTION_INFO_V1(benchmark_find_shard_interval);
+PG_FUNCTION_INFO_V1(benchmark_build_tuple_from_bytes);
+
+
+/*
+ * benchmark_prune_shards times PruneShards for the filters of the given
+ * query, which should select from a single distributed table.
+ */
+Datum
+benchmark_prune_shards(PG_FUNCTION_ARGS)
+{
+	Query *query = ParseBenchmarkQuery(PG_GETARG_TEXT_P(0));
+	int iterations = PG_GETARG_INT32(1);
+	Index rangeTableId = 1;
+	instr_time startTime;
+	instr_time totalTime;
+
+	CheckIterationCount(iterations);
+
+	Oid relationId = BenchmarkQueryRelationId(query);
+
+	/* the planner sees the filters with constants folded */
+	Node *quals = eval_const_expressions(NULL, query->jointree->quals);
+	List *whereClauseList = make_ands_implicit((Expr *) quals);
+
+	MemoryContext benchmarkContext = CreateBenchmarkContext();
+	MemoryContext oldContext = MemoryContextSwitchTo(benchmarkContext);
+
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		Const *partitionValueConst = NULL;
+
+		PruneShards(relationId, rangeTableId, whereClauseList, &partitionValueConst);
+
+		MemoryContextReset(benchmarkContext);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	INSTR_TIME_SET_CURRENT(totalTime);
+	INSTR_TIME_SUBTRACT(totalTime, startTime);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(benchmarkContext);
+
+	PG_RETURN_FLOAT8(NanosecondsPerCall(totalTime, iterations));
+}
+
+
+/*
+ * benchmark_fast_path_router_query times FastPathRouterQuery for the given
+ * query, and errors out if the query is not a fast-path router query.
+ */
+Datum
+benchmark_fast_path_router_query(PG_FUNCTION_ARGS)
+{
+	Query *query = ParseBenchmarkQuery(PG_GETARG_TEXT_P(0));
+	int iterations = PG_GETARG_INT32(1);
+	Node *distributionKeyValue = NULL;
+	instr_time startTime;
+	instr_time totalTime;
+
+	CheckIterationCount(iterations);
+
+	if (!FastPathRouterQuery(query, &distributionKeyValue))
+	{
+		ereport(ERROR, (errmsg("query is not a fast-path router query")));
+	}
+
+	MemoryContext benchmarkContext = CreateBenchmarkContext();
+	MemoryContext oldContext = MemoryContextSwitchTo(benchmarkContext);
+
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		FastPathRouterQuery(query, &distributionKeyValue);
+
+		MemoryContextReset(benchmarkContext);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	INSTR_TIME_SET_CURRENT(totalTime);
+	INSTR_TIME_SUBTRACT(totalTime, startTime);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(benchmarkContext);
+
+	PG_RETURN_FLOAT8(NanosecondsPerCall(totalTime, iterations));
+}
+
+
+/*
+ * benchmark_citus_table_cache_entry times building the metadata cache entry
+ * of the given table. The entry is invalidated before each iteration, which
+ * is not timed, such that GetCitusTableCacheEntry rebuilds it.
+ */
+Datum
+benchmark_citus_table_cache_entry(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	int iterations = PG_GETARG_INT32(1);
+	instr_time startTime;
+	instr_time endTime;
+	instr_time totalTime;
+
+	CheckIterationCount(iterations);
+
+	if (!IsCitusTable(relationId))
+	{
+		ereport(ERROR, (errmsg("relation %s is not a citus table",
+							   get_rel_name(relationId))));
+	}
+
+	INSTR_TIME_SET_ZERO(totalTime);
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		/* processes the invalidation, including our relcache callback */
+		CacheInvalidateRelcacheByRelid(relationId);
+		CommandCounterIncrement();
+
+		INSTR_TIME_SET_CURRENT(startTime);
+
+		GetCitusTableCacheEntry(relationId);
+
+		INSTR_TIME_SET_CURRENT(endTime);
+		INSTR_TIME_ACCUM_DIFF(totalTime, endTime, startTime);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	PG_RETURN_FLOAT8(NanosecondsPerCall(totalTime, iterations));
+}
+
+
+/*
+ * benchmark_deparse_shard_query times deparsing the given query for each
+ * shard of the distributed table it selects from, as the planner does for
+ * the tasks of multi-shard queries. Copying the query for each shard is not
+ * timed, and the average time per shard is returned.
+ */
+Datum
+benchmark_deparse_shard_query(PG_FUNCTION_ARGS)
+{
+	Query *query = ParseBenchmarkQuery(PG_GETARG_TEXT_P(0));
+	int iterations = PG_GETARG_INT32(1);
+	uint64 deparseCount = 0;
+	instr_time startTime;
+	instr_time endTime;
+	instr_time totalTime;
+
+	CheckIterationCount(iterations);
+
+	Oid relationId = BenchmarkQueryRelationId(query);
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+
+	MemoryContext benchmarkContext = CreateBenchmarkContext();
+	MemoryContext oldContext = MemoryContextSwitchTo(benchmarkContext);
+
+	INSTR_TIME_SET_ZERO(totalTime);
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		ShardInterval *shardInterval = NULL;
+		foreach_ptr(shardInterval, shardIntervalList)
+		{
+			Query *shardQuery = copyObject(query);
+
+			RelationShard *relationShard = CitusMakeNode(RelationShard);
+			relationShard->relationId = relationId;
+			relationShard->shardId = shardInterval->shardId;
+
+			INSTR_TIME_SET_CURRENT(startTime);
+
+			StringInfo queryString = makeStringInfo();
+			UpdateRelationToShardNames((Node *) shardQuery, list_make1(relationShard));
+			pg_get_query_def(shardQuery, queryString);
+
+			INSTR_TIME_SET_CURRENT(endTime);
+			INSTR_TIME_ACCUM_DIFF(totalTime, endTime, startTime);
+
+			MemoryContextReset(benchmarkContext);
+			deparseCount++;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(benchmarkContext);
+
+	if (deparseCount == 0)
+	{
+		PG_RETURN_NULL();
+	}
+
+	PG_RETURN_FLOAT8(NanosecondsPerCall(totalTime, deparseCount));
+}
+
+
+/*
+ * benchmark_find_shard_interval times finding the shard of the given
+ * distribution column value, which is how COPY routes each row to a shard.
+ */
+Datum
+benchmark_find_shard_interval(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	char *valueString = text_to_cstring(PG_GETARG_TEXT_P(1));
+	int iterations = PG_GETARG_INT32(2);
+	Oid inputFunctionId = InvalidOid;
+	Oid typeIoParam = InvalidOid;
+	instr_time startTime;
+	instr_time totalTime;
+
+	CheckIterationCount(iterations);
+
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	Var *partitionColumn = cacheEntry->partitionColumn;
+	if (partitionColumn == NULL)
+	{
+		ereport(ERROR, (errmsg("relation %s does not have a distribution column",
+							   get_rel_name(relationId))));
+	}
+
+	getTypeInputInfo(partitionColumn->vartype, &inputFunctionId, &typeIoParam);
+	Datum partitionValue = OidInputFunctionCall(inputFunctionId, valueString,
+												typeIoParam,
+												partitionColumn->vartypmod);
+
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		FindShardInterval(partitionValue, cacheEntry);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	INSTR_TIME_SET_CURRENT(totalTime);
+	INSTR_TIME_SUBTRACT(totalTime, startTime);
+
+	PG_RETURN_FLOAT8(NanosecondsPerCall(totalTime, iterations));
+}
+
+
+/*
+ * benchmark_build_tuple_from_bytes times building a tuple of the given
+ * relation from the values in the binary format, as the executor does for
+ * the rows it receives from the workers over the binary protocol. The values
+ * are given as text, one for each column of the relation.
+ */
+Datum
+benchmark_build_tuple_from_bytes(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	ArrayType *valueArray = PG_GETARG_ARRAYTYPE_P(1);
+	int iterations = PG_GETARG_INT32(2);
+	Datum *valueDatums = NULL;
+	bool *valueNulls = NULL;
+	int valueCount = 0;
+	instr_time startTime;
+	instr_time totalTime;
+
+	CheckIterationCount(iterations);
+
+	Relation relation = relation_open(relationId, AccessShareLock);
+	TupleDesc tupleDescriptor = CreateTupleDescCopy(RelationGetDescr(relation));
+	relation_close(relation, AccessShareLock);
+
+	deconstruct_array(valueArray, TEXTOID, -1, false, TYPALIGN_INT,
+					  &valueDatums, &valueNulls, &valueCount);
+
+	int columnCount = tupleDescriptor->natts;
+	if (valueCount != columnCount)
+	{
+		ereport(ERROR, (errmsg("expected %d values, one for each column of %s",
+							   columnCount, get_rel_name(relationId))));
+	}
+
+	AttInMetadata *attInMetadata = TupleDescGetAttBinaryInMetadata(tupleDescriptor);
+	fmStringInfo *columnBytes = palloc0(columnCount * sizeof(fmStringInfo));
+	Datum *columnValues = palloc0(columnCount * sizeof(Datum));
+	bool *columnNulls = palloc0(columnCount * sizeof(bool));
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid inputFunctionId = InvalidOid;
+		Oid typeIoParam = InvalidOid;
+		Oid sendFunctionId = InvalidOid;
+		bool typeIsVarlena = false;
+
+		/* BuildTupleFromBytes skips non-null columns without bytes */
+		columnNulls[columnIndex] = true;
+
+		if (valueNulls[columnIndex] || attribute->attisdropped)
+		{
+			continue;
+		}
+
+		getTypeInputInfo(attribute->atttypid, &inputFunctionId, &typeIoParam);
+		Datum value = OidInputFunctionCall(inputFunctionId,
+										   TextDatumGetCString(valueDatums[columnIndex]),
+										   typeIoParam, attribute->atttypmod);
+
+		getTypeBinaryOutputInfo(attribute->atttypid, &sendFunctionId, &typeIsVarlena);
+		bytea *valueBytes = OidSendFunctionCall(sendFunctionId, value);
+
+		StringInfo valueBuffer = makeStringInfo();
+		appendBinaryStringInfo(valueBuffer, VARDATA(valueBytes),
+							   VARSIZE(valueBytes) - VARHDRSZ);
+		columnBytes[columnIndex] = valueBuffer;
+	}
+
+	MemoryContext benchmarkContext = CreateBenchmarkContext();
+	MemoryContext oldContext = MemoryContextSwitchTo(benchmarkContext);
+
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		/* receive functions consume the bytes */
+		for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			if (columnBytes[columnIndex] != NULL)
+			{
+				columnBytes[columnIndex]->cursor = 0;
+			}
+		}
+
+		BuildTupleFromBytes(attInMetadata, columnBytes, columnValues, columnNulls);
+
+		MemoryContextReset(benchmarkContext);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	INSTR_TIME_SET_CURRENT(totalTime);
+	INSTR_TIME_SUBTRACT(totalTime, startTime);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(benchmarkContext);
+
+	PG_RETURN_FLOAT8(NanosecondsPerCall(totalTime, iterations));
+}
+
+
+/*
+ * ParseBenchmarkQuery parses and analyzes the given query, which should be
+ * a single statement.
+ */
+static Query *
+ParseBenchmarkQuery(text *queryText)
+{
+	char *queryString = text_to_cstring(queryText);
+	List *parseTreeList = pg_parse_query(queryString);
+
+	if (list_length(parseTreeList) != 1)
+	{
+		ereport(ERROR, (errmsg("expected a single statement")));
+	}
+
+	RawStmt *parseTree = linitial(parseTreeList);
+	List *queryTreeList = pg_analyze_and_rewrite_fixedparams(parseTree, queryString,
+															 NULL, 0, NULL);
+	if (list_length(queryTreeList) != 1)
+	{
+		ereport(ERROR, (errmsg("expected a statement that is not rewritten into "
+							   "multiple statements")));
+	}
+
+	return (Query *) linitial(queryTreeList);
+}
+
+
+/*
+ * BenchmarkQueryRelationId returns the distributed table that the given
+ * query selects from, and errors out if it is not first in the range table.
+ */
+static Oid
+BenchmarkQueryRelationId(Query *query)
+{
+	if (list_length(query->rtable) == 0)
+	{
+		ereport(ERROR, (errmsg("query does not select from a table")));
+	}
+
+	RangeTblEntry *rangeTableEntry = linitial(query->rtable);
+	if (rangeTableEntry->rtekind != RTE_RELATION ||
+		!IsCitusTableType(rangeTableEntry->relid, DISTRIBUTED_TABLE))
+	{
+		ereport(ERROR, (errmsg("query does not select from a distributed table")));
+	}
+
+	return rangeTableEntry->relid;
+}
+
+
+/*
+ * CheckIterationCount errors out if the given number of iterations is not
+ * positive.
+ */
+static void
+CheckIterationCount(int iterations)
+{
+	if (iterations <= 0)
+	{
+		ereport(ERROR, (errmsg("iterations must be a positive number")));
+	}
+}
+
+
+/*
+ * CreateBenchmarkContext returns a memory context for the allocations of an
+ * iteration, which is reset after each iteration such that the benchmarks
+ * do not run out of memory.
+ */
+static MemoryContext
+CreateBenchmarkContext(void)
+{
+	return AllocSetContextCreate(CurrentMemoryContext, "Microbenchmark Context",
+								 ALLOCSET_DEFAULT_SIZES);
+}
+
+
+/*
+ * NanosecondsPerCall returns the average time of a call in nanoseconds.
+ */
+static double
+NanosecondsPerCall(instr_time totalTime, uint64 callCount)
+{
+	return INSTR_TIME_GET_DOUBLE(totalTime) * 1e9 / callCount;
+}
@@ -244,7 +244,7 @@ SortedShardIntervalArray(Oid distributedTableId)
 	Oid shardIdTypeId = INT8OID;
 
 	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(distributedTableId);
-	ShardInterval **shardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	ShardInterval **shardIntervalArray = GetSortedShardIntervalArray(cacheEntry);
 	int shardIdCount = cacheEntry->shardIntervalArrayLength;
 	Datum *shardIdDatumArray = palloc0(shardIdCount * sizeof(Datum));
 
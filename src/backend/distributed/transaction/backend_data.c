@@ -25,6 +25,7 @@
 #include "catalog/pg_type.h"
 #include "datatype/timestamp.h"
 #include "distributed/backend_data.h"
+#include "distributed/citus_safe_lib.h"
 #include "distributed/connection_management.h"
 #include "distributed/listutils.h"
 #include "distributed/lock_graph.h"
@@ -98,6 +99,9 @@ static void StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc
 static bool UserHasPermissionToViewStatsOf(Oid currentUserId, Oid backendOwnedId);
 static uint64 CalculateGlobalPID(int32 nodeId, pid_t pid);
 static uint64 GenerateGlobalPID(void);
+static void BeginBackendDataUpdate(BackendData *backendData);
+static void EndBackendDataUpdate(BackendData *backendData);
+static void ReadBackendDataSnapshot(BackendData *backendData, BackendData *result);
 
 static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 static BackendManagementShmemData *backendManagementShmemData = NULL;
@@ -146,12 +150,12 @@ assign_distributed_transaction_id(PG_FUNCTION_ARGS)
 	 * initiator node, which already takes the required lock to enforce the consistency.
 	 */
 
-	SpinLockAcquire(&MyBackendData->mutex);
+	BeginBackendDataUpdate(MyBackendData);
 
 	/* if an id is already assigned, release the lock and error */
 	if (MyBackendData->transactionId.transactionNumber != 0)
 	{
-		SpinLockRelease(&MyBackendData->mutex);
+		EndBackendDataUpdate(MyBackendData);
 
 		ereport(ERROR, (errmsg("the backend has already been assigned a "
 							   "transaction id")));
@@ -162,7 +166,7 @@ assign_distributed_transaction_id(PG_FUNCTION_ARGS)
 	MyBackendData->transactionId.timestamp = timestamp;
 	MyBackendData->transactionId.transactionOriginator = false;
 
-	SpinLockRelease(&MyBackendData->mutex);
+	EndBackendDataUpdate(MyBackendData);
 
 	PG_RETURN_VOID();
 }
@@ -375,25 +379,22 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 		showAllBackends = true;
 	}
 
-	/* we're reading all distributed transactions, prevent new backends */
-	LockBackendSharedMemory(LW_SHARED);
-
 	for (int backendIndex = 0; backendIndex < TotalProcCount(); ++backendIndex)
 	{
 		bool showCurrentBackendDetails = showAllBackends;
-		BackendData *currentBackend =
-			&backendManagementShmemData->backends[backendIndex];
+		BackendData currentBackend;
 		PGPROC *currentProc = &ProcGlobal->allProcs[backendIndex];
 
-		/* to work on data after releasing g spinlock to protect against errors */
-		uint64 transactionNumber = 0;
-
-		SpinLockAcquire(&currentBackend->mutex);
+		/*
+		 * Take a consistent copy of the slot without blocking the backend, which
+		 * might be starting or finishing a distributed transaction concurrently.
+		 */
+		ReadBackendDataSnapshot(&backendManagementShmemData->backends[backendIndex],
+								&currentBackend);
 
-		if (currentProc->pid == 0 || !currentBackend->activeBackend)
+		if (currentProc->pid == 0 || !currentBackend.activeBackend)
 		{
 			/* unused PGPROC slot or the backend already exited */
-			SpinLockRelease(&currentBackend->mutex);
 			continue;
 		}
 
@@ -407,7 +408,7 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 			showCurrentBackendDetails = true;
 		}
 
-		Oid databaseId = currentBackend->databaseId;
+		Oid databaseId = currentBackend.databaseId;
 		int backendPid = ProcGlobal->allProcs[backendIndex].pid;
 
 		/*
@@ -416,12 +417,10 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 		 * we negate the result before returning.
 		 */
 		bool distributedCommandOriginator =
-			currentBackend->distributedCommandOriginator;
-
-		transactionNumber = currentBackend->transactionId.transactionNumber;
-		TimestampTz transactionIdTimestamp = currentBackend->transactionId.timestamp;
+			currentBackend.distributedCommandOriginator;
 
-		SpinLockRelease(&currentBackend->mutex);
+		uint64 transactionNumber = currentBackend.transactionId.transactionNumber;
+		TimestampTz transactionIdTimestamp = currentBackend.transactionId.timestamp;
 
 		memset(values, 0, sizeof(values));
 		memset(isNulls, false, sizeof(isNulls));
@@ -439,7 +438,7 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 		{
 			bool missingOk = true;
 			int initiatorNodeId =
-				ExtractNodeIdFromGlobalPID(currentBackend->globalPID, missingOk);
+				ExtractNodeIdFromGlobalPID(currentBackend.globalPID, missingOk);
 
 			values[0] = ObjectIdGetDatum(databaseId);
 			values[1] = Int32GetDatum(backendPid);
@@ -447,7 +446,7 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 			values[3] = !distributedCommandOriginator;
 			values[4] = UInt64GetDatum(transactionNumber);
 			values[5] = TimestampTzGetDatum(transactionIdTimestamp);
-			values[6] = UInt64GetDatum(currentBackend->globalPID);
+			values[6] = UInt64GetDatum(currentBackend.globalPID);
 		}
 		else
 		{
@@ -457,7 +456,7 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 			values[3] = !distributedCommandOriginator;
 			isNulls[4] = true;
 			isNulls[5] = true;
-			values[6] = UInt64GetDatum(currentBackend->globalPID);
+			values[6] = UInt64GetDatum(currentBackend.globalPID);
 		}
 
 		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
@@ -470,8 +469,6 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 		memset(values, 0, sizeof(values));
 		memset(isNulls, false, sizeof(isNulls));
 	}
-
-	UnlockBackendSharedMemory();
 }
 
 
@@ -582,6 +579,7 @@ BackendManagementShmemInit(void)
 			BackendData *backendData =
 				&backendManagementShmemData->backends[backendIndex];
 			SpinLockInit(&backendData->mutex);
+			pg_atomic_init_u32(&backendData->changeCount, 0);
 		}
 	}
 
@@ -702,10 +700,10 @@ InitializeBackendData(const char *applicationName)
 	UnSetDistributedTransactionId();
 	UnSetGlobalPID();
 
-	SpinLockAcquire(&MyBackendData->mutex);
+	BeginBackendDataUpdate(MyBackendData);
 	MyBackendData->distributedCommandOriginator = IsExternalClientBackend();
 	MyBackendData->globalPID = gpid;
-	SpinLockRelease(&MyBackendData->mutex);
+	EndBackendDataUpdate(MyBackendData);
 
 	/*
 	 * Signal that this backend is active and should show up
@@ -727,7 +725,7 @@ UnSetDistributedTransactionId(void)
 	/* backend does not exist if the extension is not created */
 	if (MyBackendData)
 	{
-		SpinLockAcquire(&MyBackendData->mutex);
+		BeginBackendDataUpdate(MyBackendData);
 
 		MyBackendData->cancelledDueToDeadlock = false;
 		MyBackendData->transactionId.initiatorNodeIdentifier = 0;
@@ -735,7 +733,7 @@ UnSetDistributedTransactionId(void)
 		MyBackendData->transactionId.transactionNumber = 0;
 		MyBackendData->transactionId.timestamp = 0;
 
-		SpinLockRelease(&MyBackendData->mutex);
+		EndBackendDataUpdate(MyBackendData);
 	}
 }
 
@@ -749,14 +747,14 @@ UnSetGlobalPID(void)
 	/* backend does not exist if the extension is not created */
 	if (MyBackendData)
 	{
-		SpinLockAcquire(&MyBackendData->mutex);
+		BeginBackendDataUpdate(MyBackendData);
 
 		MyBackendData->globalPID = 0;
 		MyBackendData->databaseId = 0;
 		MyBackendData->userId = 0;
 		MyBackendData->distributedCommandOriginator = false;
 
-		SpinLockRelease(&MyBackendData->mutex);
+		EndBackendDataUpdate(MyBackendData);
 	}
 }
 
@@ -770,11 +768,11 @@ SetActiveMyBackend(bool value)
 	/* backend does not exist if the extension is not created */
 	if (MyBackendData)
 	{
-		SpinLockAcquire(&MyBackendData->mutex);
+		BeginBackendDataUpdate(MyBackendData);
 
 		MyBackendData->activeBackend = value;
 
-		SpinLockRelease(&MyBackendData->mutex);
+		EndBackendDataUpdate(MyBackendData);
 	}
 }
 
@@ -855,14 +853,14 @@ AssignDistributedTransactionId(void)
 	int32 localGroupId = GetLocalGroupId();
 	TimestampTz currentTimestamp = GetCurrentTimestamp();
 
-	SpinLockAcquire(&MyBackendData->mutex);
+	BeginBackendDataUpdate(MyBackendData);
 
 	MyBackendData->transactionId.initiatorNodeIdentifier = localGroupId;
 	MyBackendData->transactionId.transactionOriginator = true;
 	MyBackendData->transactionId.transactionNumber = nextTransactionNumber;
 	MyBackendData->transactionId.timestamp = currentTimestamp;
 
-	SpinLockRelease(&MyBackendData->mutex);
+	EndBackendDataUpdate(MyBackendData);
 }
 
 
@@ -913,14 +911,14 @@ AssignGlobalPID(void)
 
 	Oid userId = GetUserId();
 
-	SpinLockAcquire(&MyBackendData->mutex);
+	BeginBackendDataUpdate(MyBackendData);
 
 	MyBackendData->globalPID = globalPID;
 	MyBackendData->distributedCommandOriginator = distributedCommandOriginator;
 	MyBackendData->databaseId = MyDatabaseId;
 	MyBackendData->userId = userId;
 
-	SpinLockRelease(&MyBackendData->mutex);
+	EndBackendDataUpdate(MyBackendData);
 }
 
 
@@ -935,10 +933,10 @@ SetBackendDataDistributedCommandOriginator(bool distributedCommandOriginator)
 	{
 		return;
 	}
-	SpinLockAcquire(&MyBackendData->mutex);
+	BeginBackendDataUpdate(MyBackendData);
 	MyBackendData->distributedCommandOriginator =
 		distributedCommandOriginator;
-	SpinLockRelease(&MyBackendData->mutex);
+	EndBackendDataUpdate(MyBackendData);
 }
 
 
@@ -1157,14 +1155,72 @@ GetBackendDataForProc(PGPROC *proc, BackendData *result)
 
 	BackendData *backendData = &backendManagementShmemData->backends[pgprocno];
 
+	ReadBackendDataSnapshot(backendData, result);
+}
+
+
+/*
+ * BeginBackendDataUpdate acquires the mutex of the given backend data and
+ * marks the slot as being updated, such that concurrent readers in
+ * ReadBackendDataSnapshot retry until EndBackendDataUpdate is called.
+ */
+static void
+BeginBackendDataUpdate(BackendData *backendData)
+{
 	SpinLockAcquire(&backendData->mutex);
 
-	*result = *backendData;
+	/* pg_atomic_fetch_add_u32 acts as a full memory barrier */
+	pg_atomic_fetch_add_u32(&backendData->changeCount, 1);
+}
+
+
+/*
+ * EndBackendDataUpdate marks the update of the given backend data as done
+ * and releases its mutex.
+ */
+static void
+EndBackendDataUpdate(BackendData *backendData)
+{
+	pg_atomic_fetch_add_u32(&backendData->changeCount, 1);
 
 	SpinLockRelease(&backendData->mutex);
 }
 
 
+/*
+ * ReadBackendDataSnapshot copies the given backend data into result without
+ * taking its mutex. If a writer modifies the slot while we copy it, the
+ * change counter moves and we simply copy again. Updates only touch a few
+ * fields, so retries are short and rare.
+ */
+static void
+ReadBackendDataSnapshot(BackendData *backendData, BackendData *result)
+{
+	for (;;)
+	{
+		uint32 changeCountBefore = pg_atomic_read_u32(&backendData->changeCount);
+
+		if (changeCountBefore % 2 != 0)
+		{
+			/* a writer is in the middle of an update */
+			pg_spin_delay();
+			continue;
+		}
+
+		pg_read_barrier();
+
+		memcpy_s(result, sizeof(BackendData), backendData, sizeof(BackendData));
+
+		pg_read_barrier();
+
+		if (pg_atomic_read_u32(&backendData->changeCount) == changeCountBefore)
+		{
+			break;
+		}
+	}
+}
+
+
 /*
  * CancelTransactionDueToDeadlock cancels the input proc and also marks the backend
  * data with this information.
@@ -1180,13 +1236,13 @@ CancelTransactionDueToDeadlock(PGPROC *proc)
 		return;
 	}
 
-	SpinLockAcquire(&backendData->mutex);
+	BeginBackendDataUpdate(backendData);
 
 	/* send a SIGINT only if the process is still in a distributed transaction */
 	if (backendData->transactionId.transactionNumber != 0)
 	{
 		backendData->cancelledDueToDeadlock = true;
-		SpinLockRelease(&backendData->mutex);
+		EndBackendDataUpdate(backendData);
 
 		if (kill(proc->pid, SIGINT) != 0)
 		{
@@ -1198,7 +1254,7 @@ CancelTransactionDueToDeadlock(PGPROC *proc)
 	}
 	else
 	{
-		SpinLockRelease(&backendData->mutex);
+		EndBackendDataUpdate(backendData);
 	}
 }
 
@@ -1223,7 +1279,7 @@ MyBackendGotCancelledDueToDeadlock(bool clearState)
 		return false;
 	}
 
-	SpinLockAcquire(&MyBackendData->mutex);
+	BeginBackendDataUpdate(MyBackendData);
 
 	if (IsInDistributedTransaction(MyBackendData))
 	{
@@ -1234,7 +1290,7 @@ MyBackendGotCancelledDueToDeadlock(bool clearState)
 		MyBackendData->cancelledDueToDeadlock = false;
 	}
 
-	SpinLockRelease(&MyBackendData->mutex);
+	EndBackendDataUpdate(MyBackendData);
 
 	return cancelledDueToDeadlock;
 }
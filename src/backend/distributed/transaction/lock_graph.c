@@ -24,6 +24,7 @@
 #include "distributed/listutils.h"
 #include "distributed/lock_graph.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/pg_version_constants.h"
 #include "distributed/remote_commands.h"
 #include "distributed/tuplestore.h"
 #include "storage/proc.h"
@@ -45,6 +46,13 @@ typedef struct PROCStack
 } PROCStack;
 
 
+/*
+ * GUC, minimum time a distributed transaction needs to wait on a lock before
+ * its wait edges are reported to the distributed deadlock detector.
+ */
+int DistributedDeadlockMinWaitTime = 0;
+
+
 static void AddWaitEdgeFromResult(WaitGraph *waitGraph, PGresult *result, int rowIndex);
 static void ReturnWaitGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo);
 static void AddWaitEdgeFromBlockedProcessResult(WaitGraph *waitGraph, PGresult *result,
@@ -52,6 +60,7 @@ static void AddWaitEdgeFromBlockedProcessResult(WaitGraph *waitGraph, PGresult *
 static void ReturnBlockedProcessGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo);
 static WaitGraph * BuildLocalWaitGraph(bool onlyDistributedTx);
 static bool IsProcessWaitingForSafeOperations(PGPROC *proc);
+static bool ProcessWaitedLongerThan(PGPROC *proc, TimestampTz waitStartCutoff);
 static void LockLockData(void);
 static void UnlockLockData(void);
 static void AddEdgesForLockWaits(WaitGraph *waitGraph, PGPROC *waitingProc,
@@ -523,12 +532,26 @@ ReturnBlockedProcessGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo)
  * (e.g., AssignDistributedTransaction() or assign_distributed_transactions())
  * has been called for the process. Distributed deadlock detection only
  * interested in these processes.
+ *
+ * When citus.distributed_deadlock_detection_min_wait_time is set, distributed
+ * transactions that started waiting more recently than that are not used as
+ * starting points. A deadlock never resolves by itself, so its edges are still
+ * reported by a later run, whereas short-lived lock contention, which makes up
+ * the bulk of the wait edges on a busy cluster, is never shipped to the
+ * coordinator.
  */
 static WaitGraph *
 BuildLocalWaitGraph(bool onlyDistributedTx)
 {
 	PROCStack remaining;
 	int totalProcs = TotalProcCount();
+	TimestampTz waitStartCutoff = 0;
+
+	if (onlyDistributedTx && DistributedDeadlockMinWaitTime > 0)
+	{
+		waitStartCutoff = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+													  -DistributedDeadlockMinWaitTime);
+	}
 
 	/*
 	 * Try hard to avoid allocations while holding lock. Thus we pre-allocate
@@ -602,6 +625,13 @@ BuildLocalWaitGraph(bool onlyDistributedTx)
 			continue;
 		}
 
+		/* skip if the process only started waiting recently */
+		if (waitStartCutoff != 0 &&
+			!ProcessWaitedLongerThan(currentProc, waitStartCutoff))
+		{
+			continue;
+		}
+
 		AddProcToVisit(&remaining, currentProc);
 	}
 
@@ -678,6 +708,32 @@ IsProcessWaitingForSafeOperations(PGPROC *proc)
 }
 
 
+/*
+ * ProcessWaitedLongerThan returns true if the given waiting PROC started
+ * waiting for its lock before waitStartCutoff.
+ *
+ * Postgres only records the wait start time since PG14. On older versions
+ * we cannot tell, and we conservatively treat every wait as long enough.
+ */
+static bool
+ProcessWaitedLongerThan(PGPROC *proc, TimestampTz waitStartCutoff)
+{
+#if PG_VERSION_NUM >= PG_VERSION_14
+	TimestampTz waitStart = (TimestampTz) pg_atomic_read_u64(&proc->waitStart);
+
+	/* the wait start is set right after the process goes to sleep */
+	if (waitStart == 0)
+	{
+		return false;
+	}
+
+	return waitStart < waitStartCutoff;
+#else
+	return true;
+#endif
+}
+
+
 /*
  * LockLockData takes locks the shared lock data structure, which prevents
  * concurrent lock acquisitions/releases.
@@ -21,13 +21,16 @@
 
 #include "access/xact.h"
 #include "distributed/backend_data.h"
+#include "distributed/causal_clock.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/citus_wait_events.h"
 #include "distributed/connection_management.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/placement_connection.h"
 #include "distributed/remote_commands.h"
 #include "distributed/remote_transaction.h"
+#include "distributed/secondary_read_routing.h"
 #include "distributed/transaction_identifier.h"
 #include "distributed/transaction_management.h"
 #include "distributed/transaction_recovery.h"
@@ -55,6 +58,13 @@ static void FinishRemoteTransactionSavepointRollback(MultiConnection *connection
 													 SubTransactionId subId);
 
 static void Assign2PCIdentifier(MultiConnection *connection);
+static void LogPreparedTransactionRecords(List *connectionList);
+static char * WithTransactionClockAdjustment(MultiConnection *connection,
+											 char *command);
+static PGresult * GetTransactionCommandResult(MultiConnection *connection,
+											  bool raiseErrors);
+static char * WithWalPositionRequest(MultiConnection *connection, char *command);
+static void ReceiveWalPosition(MultiConnection *connection, bool raiseErrors);
 
 
 static char *IsolationLevelName[] = {
@@ -372,7 +382,7 @@ StartRemoteTransactionCommit(MultiConnection *connection)
 
 		transaction->transactionState = REMOTE_TRANS_2PC_COMMITTING;
 
-		if (!SendRemoteCommand(connection, command))
+		if (!SendRemoteCommand(connection, WithWalPositionRequest(connection, command)))
 		{
 			HandleRemoteTransactionConnectionError(connection, raiseErrors);
 		}
@@ -382,7 +392,10 @@ StartRemoteTransactionCommit(MultiConnection *connection)
 		/* initiate remote transaction commit */
 		transaction->transactionState = REMOTE_TRANS_1PC_COMMITTING;
 
-		if (!SendRemoteCommand(connection, "COMMIT"))
+		char *command = WithTransactionClockAdjustment(connection, "COMMIT");
+		command = WithWalPositionRequest(connection, command);
+
+		if (!SendRemoteCommand(connection, command))
 		{
 			/*
 			 * For a moment there I thought we were in trouble.
@@ -411,7 +424,7 @@ FinishRemoteTransactionCommit(MultiConnection *connection)
 		   transaction->transactionState == REMOTE_TRANS_1PC_COMMITTING ||
 		   transaction->transactionState == REMOTE_TRANS_2PC_COMMITTING);
 
-	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
+	PGresult *result = GetTransactionCommandResult(connection, raiseErrors);
 
 	if (!IsResponseOK(result))
 	{
@@ -447,8 +460,12 @@ FinishRemoteTransactionCommit(MultiConnection *connection)
 	else
 	{
 		transaction->transactionState = REMOTE_TRANS_COMMITTED;
+
+		ReceiveWalPosition(connection, raiseErrors);
 	}
 
+	transaction->walPositionRequested = false;
+
 	PQclear(result);
 
 	ForgetResults(connection);
@@ -592,7 +609,9 @@ RemoteTransactionAbort(MultiConnection *connection)
 
 /*
  * StartRemoteTransactionPrepare initiates preparing the transaction in a
- * non-blocking manner.
+ * non-blocking manner. The caller is responsible for logging the prepared
+ * transaction in pg_dist_transaction before the local transaction commits,
+ * see LogPreparedTransactionRecords.
  */
 void
 StartRemoteTransactionPrepare(struct MultiConnection *connection)
@@ -611,13 +630,6 @@ StartRemoteTransactionPrepare(struct MultiConnection *connection)
 
 	Assign2PCIdentifier(connection);
 
-	/* log transactions to workers in pg_dist_transaction */
-	WorkerNode *workerNode = FindWorkerNode(connection->hostname, connection->port);
-	if (workerNode != NULL)
-	{
-		LogTransactionRecord(workerNode->groupId, transaction->preparedName);
-	}
-
 	/*
 	 * We need to allocate 424 bytes for command buffer (including '\0'):
 	 *  - len("PREPARE TRANSACTION ") = 20
@@ -628,7 +640,8 @@ StartRemoteTransactionPrepare(struct MultiConnection *connection)
 	SafeSnprintf(command, sizeof(command), "PREPARE TRANSACTION %s", quotedPrepName);
 	pfree(quotedPrepName);
 
-	if (!SendRemoteCommand(connection, command))
+	if (!SendRemoteCommand(connection,
+						   WithTransactionClockAdjustment(connection, command)))
 	{
 		HandleRemoteTransactionConnectionError(connection, raiseErrors);
 	}
@@ -652,7 +665,7 @@ FinishRemoteTransactionPrepare(struct MultiConnection *connection)
 
 	Assert(transaction->transactionState == REMOTE_TRANS_PREPARING);
 
-	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
+	PGresult *result = GetTransactionCommandResult(connection, raiseErrors);
 
 	if (!IsResponseOK(result))
 	{
@@ -921,8 +934,13 @@ CoordinatedRemoteTransactionsPrepare(void)
 		}
 	}
 
+	/* log the transactions in pg_dist_transaction while the workers prepare */
+	LogPreparedTransactionRecords(connectionList);
+
 	bool raiseInterrupts = true;
-	WaitForAllConnections(connectionList, raiseInterrupts);
+	WaitForAllConnectionsWithWaitEvent(connectionList, raiseInterrupts,
+									   CitusWaitEventInfo(
+										   CITUS_WAIT_EVENT_TRANSACTION_PREPARE));
 
 	/* Wait for result */
 	dlist_foreach(iter, &InProgressTransactions)
@@ -951,6 +969,44 @@ CoordinatedRemoteTransactionsPrepare(void)
 }
 
 
+/*
+ * LogPreparedTransactionRecords adds the pg_dist_transaction records for the
+ * transactions that are being prepared over the given connections in a single
+ * batch. The records become visible when the local transaction commits, and
+ * until then recovery does not touch the prepared transactions as the
+ * distributed transaction is still in progress. Hence, it is safe to write
+ * them after sending PREPARE TRANSACTION.
+ */
+static void
+LogPreparedTransactionRecords(List *connectionList)
+{
+	List *groupIdList = NIL;
+	List *transactionNameList = NIL;
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+
+		if (transaction->transactionState != REMOTE_TRANS_PREPARING)
+		{
+			/* sending PREPARE failed */
+			continue;
+		}
+
+		WorkerNode *workerNode = FindWorkerNode(connection->hostname, connection->port);
+		if (workerNode != NULL)
+		{
+			groupIdList = lappend_int(groupIdList, workerNode->groupId);
+			transactionNameList = lappend(transactionNameList,
+										  transaction->preparedName);
+		}
+	}
+
+	LogTransactionRecordList(groupIdList, transactionNameList);
+}
+
+
 /*
  * CoordinatedRemoteTransactionsCommit performs distributed transactions
  * handling at commit time. This will be called at XACT_EVENT_PRE_COMMIT if
@@ -992,7 +1048,9 @@ CoordinatedRemoteTransactionsCommit(void)
 	}
 
 	bool raiseInterrupts = false;
-	WaitForAllConnections(connectionList, raiseInterrupts);
+	WaitForAllConnectionsWithWaitEvent(connectionList, raiseInterrupts,
+									   CitusWaitEventInfo(
+										   CITUS_WAIT_EVENT_TRANSACTION_COMMIT));
 
 	/* wait for the replies to the commands to come in */
 	dlist_foreach(iter, &InProgressTransactions)
@@ -1564,3 +1622,102 @@ ParsePreparedTransactionName(char *preparedTransactionName,
 
 	return true;
 }
+
+
+/*
+ * WithTransactionClockAdjustment prepends the command that adjusts the remote
+ * node's clock to the given COMMIT or PREPARE TRANSACTION command, if the current
+ * transaction negotiated a cluster clock. This saves a separate round trip to
+ * every participating node. GetTransactionCommandResult consumes the extra result.
+ */
+static char *
+WithTransactionClockAdjustment(MultiConnection *connection, char *command)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	char *clockAdjustmentCommand = TransactionClockAdjustmentCommand();
+
+	if (clockAdjustmentCommand == NULL)
+	{
+		return command;
+	}
+
+	transaction->clockAdjustmentSent = true;
+
+	return psprintf("%s%s", clockAdjustmentCommand, command);
+}
+
+
+/*
+ * GetTransactionCommandResult returns the result of the COMMIT or PREPARE
+ * TRANSACTION command sent over the connection. If the cluster clock adjustment
+ * was sent in front of the command, its result is consumed first. When the
+ * adjustment failed, the remote node skipped the transaction command and we
+ * return the failed result instead.
+ */
+static PGresult *
+GetTransactionCommandResult(MultiConnection *connection, bool raiseErrors)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+
+	if (transaction->clockAdjustmentSent)
+	{
+		transaction->clockAdjustmentSent = false;
+
+		PGresult *clockResult = GetRemoteCommandResult(connection, raiseErrors);
+		if (!IsResponseOK(clockResult))
+		{
+			return clockResult;
+		}
+
+		PQclear(clockResult);
+	}
+
+	return GetRemoteCommandResult(connection, raiseErrors);
+}
+
+
+/*
+ * WithWalPositionRequest appends a query for the current WAL position to the
+ * given COMMIT or COMMIT PREPARED command when citus.use_secondary_nodes is set
+ * to caught_up. The position tells how far a secondary needs to replay before
+ * we can read our own writes from it, see ReceiveWalPosition.
+ */
+static char *
+WithWalPositionRequest(MultiConnection *connection, char *command)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+
+	if (!ReadFromCaughtUpSecondaries())
+	{
+		return command;
+	}
+
+	transaction->walPositionRequested = true;
+
+	return psprintf("%s;%s", command, CURRENT_WAL_POSITION_COMMAND);
+}
+
+
+/*
+ * ReceiveWalPosition reads the WAL position that follows a successful COMMIT
+ * or COMMIT PREPARED, if it was requested, and records it for the node.
+ */
+static void
+ReceiveWalPosition(MultiConnection *connection, bool raiseErrors)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+
+	if (!transaction->walPositionRequested)
+	{
+		return;
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
+	if (IsResponseOK(result) && PQntuples(result) == 1 && !PQgetisnull(result, 0, 0))
+	{
+		RecordNodeWritePosition(connection->hostname, connection->port,
+								PQgetvalue(result, 0, 0));
+	}
+
+	PQclear(result);
+}
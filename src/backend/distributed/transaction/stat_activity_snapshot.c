@@ -0,0 +1,384 @@
+/*-------------------------------------------------------------------------
+ *
+ * stat_activity_snapshot.c
+ *
+ * Routines for keeping a snapshot of the activity on all nodes in shared
+ * memory of the coordinator. citus_stat_activity, and the views built on it,
+ * queries pg_stat_activity on every node over a separate connection, which
+ * makes dashboards that poll the views every few seconds a constant source
+ * of cross-node traffic. When citus.stat_activity_snapshot_interval is set,
+ * the maintenance daemon collects the activity of the cluster at that
+ * interval, and sessions that set citus.stat_activity_max_staleness read
+ * the collected activity instead, as long as it is fresh enough.
+ *
+ * The snapshot is collected by the extension owner, so it contains the
+ * backends of all users. It is therefore only handed out to users that can
+ * see all backends anyway, others always see the live activity.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "catalog/pg_authid.h"
+#include "executor/spi.h"
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+
+#include "distributed/citus_safe_lib.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/stat_activity_snapshot.h"
+
+
+/* maximum number of databases for which we keep an activity snapshot */
+#define MAX_STAT_ACTIVITY_SNAPSHOTS 128
+
+/* query that collects the activity of all nodes */
+#define COLLECT_STAT_ACTIVITY_QUERY \
+	"SELECT pg_catalog.citus_internal_collect_stat_activity()::text"
+
+
+/*
+ * StatActivitySnapshotEntry is the shared memory hash entry that points to
+ * the dynamic shared memory segment holding the activity snapshot of a
+ * database, as jsonb text.
+ */
+typedef struct StatActivitySnapshotEntry
+{
+	Oid databaseId;
+	dsm_handle segmentHandle;
+	Size snapshotSize;
+	TimestampTz collectedAt;
+} StatActivitySnapshotEntry;
+
+
+/*
+ * StatActivitySnapshotControlData holds the lock protecting the snapshot hash.
+ */
+typedef struct StatActivitySnapshotControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+} StatActivitySnapshotControlData;
+
+
+/* GUC, interval in milliseconds between activity snapshots, 0 to disable */
+int StatActivitySnapshotInterval = 0;
+
+/* GUC, maximum age in milliseconds of a snapshot that may be read, 0 for none */
+int StatActivityMaxStaleness = 0;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static StatActivitySnapshotControlData *StatActivitySnapshotControl = NULL;
+static HTAB *StatActivitySnapshotHash = NULL;
+
+static bool StatActivitySnapshotUsable(void);
+static char * CollectStatActivity(void);
+static void StoreStatActivitySnapshot(char *snapshot);
+static char * ReadStatActivitySnapshot(void);
+
+PG_FUNCTION_INFO_V1(citus_internal_stat_activity_snapshot);
+
+
+/*
+ * InitializeStatActivitySnapshot requests the shared memory for the activity
+ * snapshots and sets the hook that initializes it.
+ */
+void
+InitializeStatActivitySnapshot(void)
+{
+	/* On PG 15 and above, we use shmem_request_hook_type */
+	#if PG_VERSION_NUM < PG_VERSION_15
+
+	/* allocate shared memory for pre PG-15 versions */
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(StatActivitySnapshotShmemSize());
+	}
+
+	#endif
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = StatActivitySnapshotShmemInit;
+}
+
+
+/*
+ * StatActivitySnapshotShmemSize returns the size of the shared memory used
+ * to track the activity snapshots. The snapshots themselves live in dynamic
+ * shared memory.
+ */
+size_t
+StatActivitySnapshotShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(StatActivitySnapshotControlData));
+	size = add_size(size, hash_estimate_size(MAX_STAT_ACTIVITY_SNAPSHOTS,
+											 sizeof(StatActivitySnapshotEntry)));
+
+	return size;
+}
+
+
+/*
+ * StatActivitySnapshotShmemInit initializes the shared memory used to track
+ * the activity snapshots.
+ */
+void
+StatActivitySnapshotShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL hashInfo;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	StatActivitySnapshotControl =
+		(StatActivitySnapshotControlData *) ShmemInitStruct(
+			"Citus Stat Activity Snapshot",
+			sizeof(StatActivitySnapshotControlData),
+			&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		StatActivitySnapshotControl->trancheId = LWLockNewTrancheId();
+		StatActivitySnapshotControl->lockTrancheName = "Citus Stat Activity Snapshot";
+		LWLockRegisterTranche(StatActivitySnapshotControl->trancheId,
+							  StatActivitySnapshotControl->lockTrancheName);
+
+		LWLockInitialize(&StatActivitySnapshotControl->lock,
+						 StatActivitySnapshotControl->trancheId);
+	}
+
+	memset(&hashInfo, 0, sizeof(hashInfo));
+	hashInfo.keysize = sizeof(Oid);
+	hashInfo.entrysize = sizeof(StatActivitySnapshotEntry);
+	hashInfo.hash = tag_hash;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION);
+
+	StatActivitySnapshotHash = ShmemInitHash("Citus Stat Activity Snapshot Hash",
+											 MAX_STAT_ACTIVITY_SNAPSHOTS,
+											 MAX_STAT_ACTIVITY_SNAPSHOTS,
+											 &hashInfo, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * StatActivitySnapshotUsable returns whether the current user may read the
+ * activity snapshot, which requires that the maintenance daemon collects it
+ * and that the user may see the backends of all users.
+ */
+static bool
+StatActivitySnapshotUsable(void)
+{
+	if (StatActivitySnapshotInterval <= 0 || StatActivityMaxStaleness <= 0 ||
+		StatActivitySnapshotHash == NULL)
+	{
+		return false;
+	}
+
+	return superuser() ||
+		   is_member_of_role(GetUserId(),
+#if PG_VERSION_NUM >= PG_VERSION_14
+							 ROLE_PG_READ_ALL_STATS);
+#else
+							 DEFAULT_ROLE_READ_ALL_STATS);
+#endif
+}
+
+
+/*
+ * UpdateStatActivitySnapshot collects the activity of all nodes and replaces
+ * the activity snapshot of the current database with it.
+ */
+void
+UpdateStatActivitySnapshot(void)
+{
+	char *snapshot = CollectStatActivity();
+	if (snapshot == NULL)
+	{
+		return;
+	}
+
+	StoreStatActivitySnapshot(snapshot);
+}
+
+
+/*
+ * CollectStatActivity returns the activity of all nodes as jsonb text, as
+ * returned by citus_internal_collect_stat_activity(), or NULL if there is no
+ * activity at all.
+ */
+static char *
+CollectStatActivity(void)
+{
+	char *snapshot = NULL;
+
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	int spiStatus = SPI_execute(COLLECT_STAT_ACTIVITY_QUERY, true, 1);
+	if (spiStatus != SPI_OK_SELECT)
+	{
+		ereport(ERROR, (errmsg("could not collect the activity of the cluster")));
+	}
+
+	if (SPI_processed == 1)
+	{
+		char *value = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+		if (value != NULL)
+		{
+			/* SPI_finish releases the memory of the SPI context */
+			snapshot = MemoryContextStrdup(TopTransactionContext, value);
+		}
+	}
+
+	if (SPI_finish() != SPI_OK_FINISH)
+	{
+		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+	}
+
+	PopActiveSnapshot();
+
+	return snapshot;
+}
+
+
+/*
+ * StoreStatActivitySnapshot copies the given snapshot into a new dynamic
+ * shared memory segment, which replaces the segment of the previous snapshot
+ * of the current database.
+ *
+ * The segments are pinned, such that they outlive the session of the
+ * maintenance daemon. Readers attach to the segment while holding the lock,
+ * so the previous segment stays around until they are done with it, even
+ * though we unpin it right after swapping the handles.
+ */
+static void
+StoreStatActivitySnapshot(char *snapshot)
+{
+	Size snapshotSize = strlen(snapshot) + 1;
+	bool found = false;
+
+	dsm_segment *segment = dsm_create(snapshotSize, 0);
+	memcpy_s(dsm_segment_address(segment), snapshotSize, snapshot, snapshotSize);
+	dsm_pin_segment(segment);
+
+	LWLockAcquire(&StatActivitySnapshotControl->lock, LW_EXCLUSIVE);
+
+	StatActivitySnapshotEntry *entry =
+		(StatActivitySnapshotEntry *) hash_search(StatActivitySnapshotHash,
+												  &MyDatabaseId, HASH_ENTER_NULL,
+												  &found);
+	if (entry == NULL)
+	{
+		LWLockRelease(&StatActivitySnapshotControl->lock);
+
+		dsm_unpin_segment(dsm_segment_handle(segment));
+		dsm_detach(segment);
+
+		ereport(WARNING, (errmsg("could not store the activity snapshot, too many "
+								 "databases have an activity snapshot")));
+		return;
+	}
+
+	dsm_handle previousHandle = found ? entry->segmentHandle : DSM_HANDLE_INVALID;
+
+	entry->segmentHandle = dsm_segment_handle(segment);
+	entry->snapshotSize = snapshotSize;
+	entry->collectedAt = GetCurrentTimestamp();
+
+	LWLockRelease(&StatActivitySnapshotControl->lock);
+
+	if (previousHandle != DSM_HANDLE_INVALID)
+	{
+		dsm_unpin_segment(previousHandle);
+	}
+
+	dsm_detach(segment);
+}
+
+
+/*
+ * ReadStatActivitySnapshot returns a copy of the activity snapshot of the
+ * current database, or NULL if there is none or it is older than
+ * citus.stat_activity_max_staleness.
+ */
+static char *
+ReadStatActivitySnapshot(void)
+{
+	char *snapshot = NULL;
+	bool found = false;
+
+	if (!StatActivitySnapshotUsable())
+	{
+		return NULL;
+	}
+
+	LWLockAcquire(&StatActivitySnapshotControl->lock, LW_SHARED);
+
+	StatActivitySnapshotEntry *entry =
+		(StatActivitySnapshotEntry *) hash_search(StatActivitySnapshotHash,
+												  &MyDatabaseId, HASH_FIND, &found);
+	if (found && !TimestampDifferenceExceeds(entry->collectedAt, GetCurrentTimestamp(),
+											 StatActivityMaxStaleness))
+	{
+		dsm_segment *segment = dsm_attach(entry->segmentHandle);
+		if (segment != NULL)
+		{
+			snapshot = palloc(entry->snapshotSize);
+			memcpy_s(snapshot, entry->snapshotSize, dsm_segment_address(segment),
+					 entry->snapshotSize);
+
+			dsm_detach(segment);
+		}
+	}
+
+	LWLockRelease(&StatActivitySnapshotControl->lock);
+
+	return snapshot;
+}
+
+
+/*
+ * citus_internal_stat_activity_snapshot returns the activity snapshot of the
+ * current database as jsonb, or NULL if the caller should collect the live
+ * activity instead.
+ */
+Datum
+citus_internal_stat_activity_snapshot(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	char *snapshot = ReadStatActivitySnapshot();
+	if (snapshot == NULL)
+	{
+		PG_RETURN_NULL();
+	}
+
+	PG_RETURN_DATUM(DirectFunctionCall1(jsonb_in, CStringGetDatum(snapshot)));
+}
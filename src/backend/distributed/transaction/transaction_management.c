@@ -19,9 +19,13 @@
 
 #include "access/twophase.h"
 #include "access/xact.h"
+#include "distributed/admission_control.h"
 #include "distributed/backend_data.h"
+#include "distributed/causal_clock.h"
 #include "distributed/citus_safe_lib.h"
 #include "distributed/connection_management.h"
+#include "distributed/coordinator_protocol.h"
+#include "distributed/distributed_command_progress.h"
 #include "distributed/distributed_planner.h"
 #include "distributed/function_call_delegation.h"
 #include "distributed/hash_helpers.h"
@@ -33,12 +37,18 @@
 #include "distributed/multi_executor.h"
 #include "distributed/multi_logical_replication.h"
 #include "distributed/multi_explain.h"
+#include "distributed/multi_progress.h"
+#include "distributed/query_result_cache.h"
+#include "distributed/reference_table_write_batch.h"
 #include "distributed/repartition_join_execution.h"
 #include "distributed/transaction_management.h"
 #include "distributed/placement_connection.h"
 #include "distributed/relation_access_tracking.h"
+#include "distributed/routing_table.h"
 #include "distributed/shared_connection_stats.h"
+#include "distributed/shared_metadata_cache.h"
 #include "distributed/shard_cleaner.h"
+#include "distributed/string_utils.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_log_messages.h"
@@ -125,6 +135,9 @@ bool FunctionOpensTransactionBlock = true;
 /* if true, we should trigger node metadata sync on commit */
 bool NodeMetadataSyncOnCommit = false;
 
+/* GUC, commit_delay in microseconds for the commit of 2PC transactions */
+int TwoPhaseCommitDelay = 0;
+
 /*
  * In an explicit BEGIN ...; we keep track of top-level transaction characteristics
  * specified by the user.
@@ -145,6 +158,7 @@ static void PopSubXact(SubTransactionId subId);
 static void ResetGlobalVariables(void);
 static bool SwallowErrors(void (*func)(void));
 static void ForceAllInProgressConnectionsToClose(void);
+static void SetTwoPhaseCommitDelayLocally(void);
 static void EnsurePrepareTransactionIsAllowed(void);
 
 
@@ -318,6 +332,16 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 				TriggerNodeMetadataSync(MyDatabaseId);
 			}
 
+			/* let other backends stop using shared metadata that changed */
+			SharedMetadataCacheAtCommit();
+			RoutingTableAtCommit();
+
+			/* the modified shards are committed on all nodes by now */
+			QueryResultCacheAtCommit();
+
+			/* give back the admission slot of executions that did not finish */
+			ResetExecutionAdmission();
+
 			ResetGlobalVariables();
 			ResetRelationAccessHash();
 
@@ -356,6 +380,15 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 
 			RemoveIntermediateResultsDirectories();
 
+			SharedMetadataCacheAtAbort();
+			RoutingTableAtAbort();
+			QueryResultCacheAtAbort();
+			ResetExecutionAdmission();
+
+			/* a command that failed cannot finish the progress it reports */
+			FinalizeCurrentProgressMonitor();
+			ResetDistributedCommandProgress();
+
 			/* handles both already prepared and open transactions */
 			if (CurrentCoordinatedTransactionState > COORD_TRANS_IDLE)
 			{
@@ -462,12 +495,28 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			 */
 			RemoveIntermediateResultsDirectories();
 
+			/* track the transaction until COMMIT PREPARED or ROLLBACK PREPARED */
+			SharedMetadataCacheAtPrepare();
+
+			/* prepared transactions do not advance the routing table generation */
+			RoutingTableAtAbort();
+
+			/* the modified shards only become visible with COMMIT PREPARED */
+			QueryResultCacheAtPrepare();
+			ResetExecutionAdmission();
+
 			UnSetDistributedTransactionId();
 			break;
 		}
 
 		case XACT_EVENT_PRE_COMMIT:
 		{
+			/* the held back reference table writes are part of the transaction */
+			FlushReferenceTableWrites();
+
+			/* shards of which the creation was deferred would be missing */
+			ErrorIfShardCreationDeferred();
+
 			/*
 			 * If the distributed query involves 2PC, we already removed
 			 * the intermediate result directory on XACT_EVENT_PREPARE. However,
@@ -480,6 +529,7 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			/* nothing further to do if there's no managed remote xacts */
 			if (CurrentCoordinatedTransactionState == COORD_TRANS_NONE)
 			{
+				NotifyRoutingTableChange();
 				break;
 			}
 
@@ -496,6 +546,11 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 				CoordinatedRemoteTransactionsPrepare();
 				CurrentCoordinatedTransactionState = COORD_TRANS_PREPARED;
 
+				if (TwoPhaseCommitDelay > 0)
+				{
+					SetTwoPhaseCommitDelayLocally();
+				}
+
 				/*
 				 * Make sure we did not have any failures on connections marked as
 				 * critical before committing.
@@ -520,6 +575,9 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			 * committed. This handles failure at COMMIT time.
 			 */
 			ErrorIfPostCommitFailedShardPlacements();
+
+			/* placements might have been marked as failed above */
+			NotifyRoutingTableChange();
 			break;
 		}
 
@@ -533,6 +591,28 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 }
 
 
+/*
+ * SetTwoPhaseCommitDelayLocally sets commit_delay to citus.two_phase_commit_delay
+ * for the commit of the current transaction. Distributed transactions that use
+ * 2PC write pg_dist_transaction records, so their local commit always waits for
+ * a WAL flush. With commit_delay, the backend that flushes the WAL waits briefly
+ * for other committing backends, such that concurrent distributed transactions
+ * share a single WAL flush.
+ *
+ * This is merely a shorthand for setting commit_delay in the transactions that
+ * use 2PC, the COMMIT PREPARED commands that we send to the workers after the
+ * local commit are not delayed. The setting is reverted at the end of the
+ * transaction, after the commit record has been flushed.
+ */
+static void
+SetTwoPhaseCommitDelayLocally(void)
+{
+	set_config_option("commit_delay", ConvertIntToString(TwoPhaseCommitDelay),
+					  PGC_SUSET, PGC_S_SESSION,
+					  GUC_ACTION_LOCAL, true, 0, false);
+}
+
+
 /*
  * ForceAllInProgressConnectionsToClose forces all connections of in progress transactions
  * to close at the end of the transaction.
@@ -618,6 +698,9 @@ ResetGlobalVariables()
 	BeginXactReadOnly = BeginXactReadOnly_NotSet;
 	BeginXactDeferrable = BeginXactDeferrable_NotSet;
 	ResetWorkerErrorIndication();
+	ResetTransactionClock();
+	ResetDeferredShardCreation();
+	DiscardReferenceTableWrites();
 	memset(&AllowedDistributionColumnValue, 0,
 		   sizeof(AllowedDistributionColumn));
 }
@@ -704,6 +787,16 @@ CoordinatedSubTransactionCallback(SubXactEvent event, SubTransactionId subId,
 			}
 			PopSubXact(subId);
 
+			DeferredShardCreationAtSubAbort();
+			ResetDistributedCommandProgressAtSubXactAbort(subId);
+			ExecutionAdmissionAtSubAbort(subId);
+
+			/*
+			 * SAVEPOINT flushes the pending reference table writes, so all of
+			 * them belong to the aborted subtransaction.
+			 */
+			DiscardReferenceTableWrites();
+
 			/*
 			 * Clear MetadataCache table if we're aborting from a CREATE EXTENSION Citus
 			 * so that any created OIDs from the table are cleared and invalidated. We
@@ -38,6 +38,7 @@
 #include "distributed/transaction_recovery.h"
 #include "distributed/worker_manager.h"
 #include "distributed/version_compat.h"
+#include "executor/tuptable.h"
 #include "lib/stringinfo.h"
 #include "storage/lmgr.h"
 #include "storage/lock.h"
@@ -47,13 +48,38 @@
 #include "utils/rel.h"
 
 
+/*
+ * WorkerTransactionRecovery holds the state of recovering the prepared
+ * transactions on a single worker. RecoverTwoPhaseCommits goes through the
+ * steps of the recovery for all workers at once, such that the round trips
+ * to the workers overlap.
+ */
+typedef struct WorkerTransactionRecovery
+{
+	WorkerNode *workerNode;
+	MultiConnection *connection;
+
+	/* prepared transactions on the worker before and after the snapshot */
+	HTAB *pendingTransactionSet;
+	HTAB *recheckTransactionSet;
+
+	/* scan over the pg_dist_transaction records of the worker */
+	SysScanDesc scanDescriptor;
+} WorkerTransactionRecovery;
+
+
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(recover_prepared_transactions);
 
 
 /* Local functions forward declarations */
-static int RecoverWorkerTransactions(WorkerNode *workerNode);
-static List * PendingWorkerTransactionList(MultiConnection *connection);
+static List * StartWorkerTransactionRecoveries(List *workerList);
+static void FetchPendingWorkerTransactions(List *recoveryList, bool recheck);
+static int RecoverWorkerTransactions(WorkerTransactionRecovery *recovery,
+									 Relation pgDistTransaction,
+									 HTAB *activeTransactionNumberSet);
+static void SendPendingWorkerTransactionQuery(MultiConnection *connection);
+static List * ReceivePendingWorkerTransactionList(MultiConnection *connection);
 static bool IsTransactionInProgress(HTAB *activeTransactionNumberSet,
 									char *preparedTransactionName);
 static bool RecoverPreparedTransactionOnWorker(MultiConnection *connection,
@@ -83,24 +109,82 @@ recover_prepared_transactions(PG_FUNCTION_ARGS)
 void
 LogTransactionRecord(int32 groupId, char *transactionName)
 {
-	Datum values[Natts_pg_dist_transaction];
-	bool isNulls[Natts_pg_dist_transaction];
+	LogTransactionRecordList(list_make1_int(groupId), list_make1(transactionName));
+}
 
-	/* form new transaction tuple */
-	memset(values, 0, sizeof(values));
-	memset(isNulls, false, sizeof(isNulls));
 
-	values[Anum_pg_dist_transaction_groupid - 1] = Int32GetDatum(groupId);
-	values[Anum_pg_dist_transaction_gid - 1] = CStringGetTextDatum(transactionName);
+/*
+ * LogTransactionRecordList registers the transactions that have been
+ * prepared on the given groups, where the i-th group id in groupIdList
+ * belongs to the i-th name in transactionNameList. The records are inserted
+ * with a single multi-insert where possible, which writes one WAL record per
+ * heap page rather than one per record.
+ */
+void
+LogTransactionRecordList(List *groupIdList, List *transactionNameList)
+{
+	Assert(list_length(groupIdList) == list_length(transactionNameList));
+
+	int recordCount = list_length(groupIdList);
+	if (recordCount == 0)
+	{
+		return;
+	}
 
-	/* open transaction relation and insert new tuple */
+	/* open transaction relation and insert new tuples */
 	Relation pgDistTransaction = table_open(DistTransactionRelationId(),
 											RowExclusiveLock);
-
 	TupleDesc tupleDescriptor = RelationGetDescr(pgDistTransaction);
-	HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
 
-	CatalogTupleInsert(pgDistTransaction, heapTuple);
+#if PG_VERSION_NUM >= PG_VERSION_14
+	TupleTableSlot **slotArray = palloc0(recordCount * sizeof(TupleTableSlot *));
+#endif
+
+	ListCell *groupIdCell = NULL;
+	ListCell *transactionNameCell = NULL;
+	int recordIndex = 0;
+
+	forboth(groupIdCell, groupIdList, transactionNameCell, transactionNameList)
+	{
+		Datum values[Natts_pg_dist_transaction];
+		bool isNulls[Natts_pg_dist_transaction];
+
+		/* form new transaction tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		char *transactionName = (char *) lfirst(transactionNameCell);
+
+		values[Anum_pg_dist_transaction_groupid - 1] =
+			Int32GetDatum(lfirst_int(groupIdCell));
+		values[Anum_pg_dist_transaction_gid - 1] = CStringGetTextDatum(transactionName);
+
+		HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+		slotArray[recordIndex] = MakeSingleTupleTableSlot(tupleDescriptor,
+														  &TTSOpsHeapTuple);
+		ExecStoreHeapTuple(heapTuple, slotArray[recordIndex], true);
+#else
+		CatalogTupleInsert(pgDistTransaction, heapTuple);
+#endif
+
+		recordIndex++;
+	}
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+	CatalogIndexState indexState = CatalogOpenIndexes(pgDistTransaction);
+	CatalogTuplesMultiInsertWithInfo(pgDistTransaction, slotArray, recordCount,
+									 indexState);
+	CatalogCloseIndexes(indexState);
+
+	for (recordIndex = 0; recordIndex < recordCount; recordIndex++)
+	{
+		ExecDropSingleTupleTableSlot(slotArray[recordIndex]);
+	}
+
+	pfree(slotArray);
+#endif
 
 	CommandCounterIncrement();
 
@@ -121,64 +205,19 @@ RecoverTwoPhaseCommits(void)
 	/* take advisory lock first to avoid running concurrently */
 	LockTransactionRecovery(ShareUpdateExclusiveLock);
 
-	List *workerList = ActivePrimaryNodeList(NoLock);
-	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerList)
-	{
-		recoveredTransactionCount += RecoverWorkerTransactions(workerNode);
-	}
-
-	return recoveredTransactionCount;
-}
-
-
-/*
- * RecoverWorkerTransactions recovers any pending prepared transactions
- * started by this node on the specified worker.
- */
-static int
-RecoverWorkerTransactions(WorkerNode *workerNode)
-{
-	int recoveredTransactionCount = 0;
-
-	int32 groupId = workerNode->groupId;
-	char *nodeName = workerNode->workerName;
-	int nodePort = workerNode->workerPort;
-
-
-	ScanKeyData scanKey[1];
-	int scanKeyCount = 1;
-	bool indexOK = true;
-	HeapTuple heapTuple = NULL;
-
-	HASH_SEQ_STATUS status;
-
-	bool recoveryFailed = false;
-
-	int connectionFlags = 0;
-	MultiConnection *connection = GetNodeConnection(connectionFlags, nodeName, nodePort);
-	if (connection->pgConn == NULL || PQstatus(connection->pgConn) != CONNECTION_OK)
-	{
-		ereport(WARNING, (errmsg("transaction recovery cannot connect to %s:%d",
-								 nodeName, nodePort)));
-
-		return 0;
-	}
-
 	MemoryContext localContext = AllocSetContextCreateInternal(CurrentMemoryContext,
-															   "RecoverWorkerTransactions",
+															   "RecoverTwoPhaseCommits",
 															   ALLOCSET_DEFAULT_MINSIZE,
 															   ALLOCSET_DEFAULT_INITSIZE,
 															   ALLOCSET_DEFAULT_MAXSIZE);
 
 	MemoryContext oldContext = MemoryContextSwitchTo(localContext);
 
-	Relation pgDistTransaction = table_open(DistTransactionRelationId(),
-											RowExclusiveLock);
-	TupleDesc tupleDescriptor = RelationGetDescr(pgDistTransaction);
+	List *workerList = ActivePrimaryNodeList(NoLock);
+	List *recoveryList = StartWorkerTransactionRecoveries(workerList);
 
 	/*
-	 * We're going to check the list of prepared transactions on the worker,
+	 * We're going to check the list of prepared transactions on the workers,
 	 * but some of those prepared transactions might belong to ongoing
 	 * distributed transactions.
 	 *
@@ -207,32 +246,167 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 	 * We therefore observe the set of prepared transactions one more time in
 	 * step 4. The aforementioned transactions would show up in Q, but not in
 	 * P. We can skip those transactions and recover them later.
+	 *
+	 * Each step is done for all workers before moving on to the next step,
+	 * which preserves the order for every worker while the workers answer
+	 * in parallel.
 	 */
 
-	/* find stale prepared transactions on the remote node */
-	List *pendingTransactionList = PendingWorkerTransactionList(connection);
-	HTAB *pendingTransactionSet = ListToHashSet(pendingTransactionList, NAMEDATALEN,
-												true);
+	/* find stale prepared transactions on the remote nodes */
+	bool recheck = false;
+	FetchPendingWorkerTransactions(recoveryList, recheck);
 
 	/* find in-progress distributed transactions */
 	List *activeTransactionNumberList = ActiveDistributedTransactionNumbers();
 	HTAB *activeTransactionNumberSet = ListToHashSet(activeTransactionNumberList,
 													 sizeof(uint64), false);
 
-	/* scan through all recovery records of the current worker */
-	ScanKeyInit(&scanKey[0], Anum_pg_dist_transaction_groupid,
-				BTEqualStrategyNumber, F_INT4EQ, Int32GetDatum(groupId));
+	Relation pgDistTransaction = table_open(DistTransactionRelationId(),
+											RowExclusiveLock);
 
-	/* get a snapshot of pg_dist_transaction */
-	SysScanDesc scanDescriptor = systable_beginscan(pgDistTransaction,
-													DistTransactionGroupIndexId(),
-													indexOK,
-													NULL, scanKeyCount, scanKey);
+	/* get a snapshot of pg_dist_transaction for each of the workers */
+	WorkerTransactionRecovery *recovery = NULL;
+	foreach_ptr(recovery, recoveryList)
+	{
+		ScanKeyData scanKey[1];
+		int scanKeyCount = 1;
+		bool indexOK = true;
+
+		/* scan through all recovery records of the current worker */
+		ScanKeyInit(&scanKey[0], Anum_pg_dist_transaction_groupid,
+					BTEqualStrategyNumber, F_INT4EQ,
+					Int32GetDatum(recovery->workerNode->groupId));
+
+		recovery->scanDescriptor = systable_beginscan(pgDistTransaction,
+													  DistTransactionGroupIndexId(),
+													  indexOK,
+													  NULL, scanKeyCount, scanKey);
+	}
 
-	/* find stale prepared transactions on the remote node */
-	List *recheckTransactionList = PendingWorkerTransactionList(connection);
-	HTAB *recheckTransactionSet = ListToHashSet(recheckTransactionList, NAMEDATALEN,
-												true);
+	/* find stale prepared transactions on the remote nodes once more */
+	recheck = true;
+	FetchPendingWorkerTransactions(recoveryList, recheck);
+
+	foreach_ptr(recovery, recoveryList)
+	{
+		recoveredTransactionCount += RecoverWorkerTransactions(recovery,
+															   pgDistTransaction,
+															   activeTransactionNumberSet);
+	}
+
+	table_close(pgDistTransaction, NoLock);
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(localContext);
+
+	return recoveredTransactionCount;
+}
+
+
+/*
+ * StartWorkerTransactionRecoveries connects to the given workers in parallel
+ * and returns a WorkerTransactionRecovery for each worker that we could
+ * connect to.
+ */
+static List *
+StartWorkerTransactionRecoveries(List *workerList)
+{
+	List *connectionList = NIL;
+	List *recoveryList = NIL;
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerList)
+	{
+		int connectionFlags = 0;
+		MultiConnection *connection = StartNodeConnection(connectionFlags,
+														  workerNode->workerName,
+														  workerNode->workerPort);
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	MultiConnection *connection = NULL;
+	forboth_ptr(workerNode, workerList, connection, connectionList)
+	{
+		if (connection->pgConn == NULL ||
+			PQstatus(connection->pgConn) != CONNECTION_OK)
+		{
+			ereport(WARNING, (errmsg("transaction recovery cannot connect to %s:%d",
+									 workerNode->workerName,
+									 workerNode->workerPort)));
+
+			continue;
+		}
+
+		WorkerTransactionRecovery *recovery = palloc0(sizeof(WorkerTransactionRecovery));
+		recovery->workerNode = workerNode;
+		recovery->connection = connection;
+
+		recoveryList = lappend(recoveryList, recovery);
+	}
+
+	return recoveryList;
+}
+
+
+/*
+ * FetchPendingWorkerTransactions finds the prepared transactions that were
+ * started by this node on each of the workers, sending the queries to all
+ * workers before waiting for the results. With recheck, the transactions
+ * are stored in the recheckTransactionSet of the workers, otherwise in the
+ * pendingTransactionSet.
+ */
+static void
+FetchPendingWorkerTransactions(List *recoveryList, bool recheck)
+{
+	WorkerTransactionRecovery *recovery = NULL;
+	foreach_ptr(recovery, recoveryList)
+	{
+		SendPendingWorkerTransactionQuery(recovery->connection);
+	}
+
+	foreach_ptr(recovery, recoveryList)
+	{
+		List *transactionList = ReceivePendingWorkerTransactionList(recovery->connection);
+		HTAB *transactionSet = ListToHashSet(transactionList, NAMEDATALEN, true);
+
+		if (recheck)
+		{
+			recovery->recheckTransactionSet = transactionSet;
+		}
+		else
+		{
+			recovery->pendingTransactionSet = transactionSet;
+		}
+	}
+}
+
+
+/*
+ * RecoverWorkerTransactions recovers any pending prepared transactions
+ * started by this node on the worker of the given recovery, based on the
+ * pg_dist_transaction records in its scan and the prepared transactions
+ * observed before and after the scan started.
+ */
+static int
+RecoverWorkerTransactions(WorkerTransactionRecovery *recovery,
+						  Relation pgDistTransaction,
+						  HTAB *activeTransactionNumberSet)
+{
+	int recoveredTransactionCount = 0;
+
+	MultiConnection *connection = recovery->connection;
+	HTAB *pendingTransactionSet = recovery->pendingTransactionSet;
+	HTAB *recheckTransactionSet = recovery->recheckTransactionSet;
+	SysScanDesc scanDescriptor = recovery->scanDescriptor;
+	TupleDesc tupleDescriptor = RelationGetDescr(pgDistTransaction);
+	HeapTuple heapTuple = NULL;
+
+	HASH_SEQ_STATUS status;
+
+	bool recoveryFailed = false;
 
 	while (HeapTupleIsValid(heapTuple = systable_getnext(scanDescriptor)))
 	{
@@ -346,7 +520,6 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 	}
 
 	systable_endscan(scanDescriptor);
-	table_close(pgDistTransaction, NoLock);
 
 	if (!recoveryFailed)
 	{
@@ -384,23 +557,18 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 		}
 	}
 
-	MemoryContextSwitchTo(oldContext);
-	MemoryContextDelete(localContext);
-
 	return recoveredTransactionCount;
 }
 
 
 /*
- * PendingWorkerTransactionList returns a list of pending prepared
+ * SendPendingWorkerTransactionQuery sends the query for the pending prepared
  * transactions on a remote node that were started by this node.
  */
-static List *
-PendingWorkerTransactionList(MultiConnection *connection)
+static void
+SendPendingWorkerTransactionQuery(MultiConnection *connection)
 {
 	StringInfo command = makeStringInfo();
-	bool raiseInterrupts = true;
-	List *transactionNames = NIL;
 	int32 coordinatorId = GetLocalGroupId();
 
 	appendStringInfo(command, "SELECT gid FROM pg_prepared_xacts "
@@ -412,6 +580,18 @@ PendingWorkerTransactionList(MultiConnection *connection)
 	{
 		ReportConnectionError(connection, ERROR);
 	}
+}
+
+
+/*
+ * ReceivePendingWorkerTransactionList returns the list of pending prepared
+ * transactions that SendPendingWorkerTransactionQuery asked for.
+ */
+static List *
+ReceivePendingWorkerTransactionList(MultiConnection *connection)
+{
+	bool raiseInterrupts = true;
+	List *transactionNames = NIL;
 
 	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
 	if (!IsResponseOK(result))
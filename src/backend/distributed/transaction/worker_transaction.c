@@ -44,6 +44,11 @@ static void SendCommandToWorkersParamsInternal(TargetWorkerSet targetWorkerSet,
 											   const Oid *parameterTypes,
 											   const char *const *parameterValues);
 static void ErrorIfAnyMetadataNodeOutOfSync(List *metadataNodeList);
+static void SendMetadataCommandStringsToWorkerList(List *workerNodeList,
+												   List *commandStringList);
+
+/* GUC, number of nodes to which metadata commands are sent at the same time */
+int MaxParallelMetadataSyncNodes = 0;
 
 
 /*
@@ -390,60 +395,140 @@ SendMetadataCommandListToWorkerListInCoordinatedTransaction(List *workerNodeList
 		return;
 	}
 
-	UseCoordinatedTransaction();
+	/*
+	 * In order to avoid round-trips per query in queryStringList,
+	 * we join the string and send as a single command. Also,
+	 * if there is only a single command, avoid additional call to
+	 * StringJoin given that some strings can be quite large.
+	 */
+	char *stringToSend = (list_length(commandList) == 1) ?
+						 linitial(commandList) : StringJoin(commandList, ';');
 
-	List *connectionList = NIL;
+	List *commandStringList = NIL;
+	for (int nodeIndex = 0; nodeIndex < list_length(workerNodeList); nodeIndex++)
+	{
+		commandStringList = lappend(commandStringList, stringToSend);
+	}
+
+	SendMetadataCommandStringsToWorkerList(workerNodeList, commandStringList);
+}
+
+
+/*
+ * SendMetadataCommandListPerWorkerInCoordinatedTransaction is like
+ * SendMetadataCommandListToWorkerListInCoordinatedTransaction, but sends
+ * each worker in workerNodeList its own list of commands from
+ * commandListPerWorker, which holds a List * for every worker in order. The
+ * commands are still sent to all workers at once rather than one worker
+ * after another.
+ */
+void
+SendMetadataCommandListPerWorkerInCoordinatedTransaction(List *workerNodeList,
+														 const char *nodeUser,
+														 List *commandListPerWorker)
+{
+	Assert(list_length(workerNodeList) == list_length(commandListPerWorker));
+
+	List *sendNodeList = NIL;
+	List *commandStringList = NIL;
 
 	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerNodeList)
+	List *commandList = NIL;
+	forboth_ptr(workerNode, workerNodeList, commandList, commandListPerWorker)
 	{
-		const char *nodeName = workerNode->workerName;
-		int nodePort = workerNode->workerPort;
-		int connectionFlags = REQUIRE_METADATA_CONNECTION;
+		if (list_length(commandList) == 0)
+		{
+			continue;
+		}
 
-		MultiConnection *connection =
-			StartNodeConnection(connectionFlags, nodeName, nodePort);
+		char *stringToSend = (list_length(commandList) == 1) ?
+							 linitial(commandList) : StringJoin(commandList, ';');
 
-		MarkRemoteTransactionCritical(connection);
+		sendNodeList = lappend(sendNodeList, workerNode);
+		commandStringList = lappend(commandStringList, stringToSend);
+	}
 
-		/*
-		 * connection can only be NULL for optional connections, which we don't
-		 * support in this codepath.
-		 */
-		Assert((connectionFlags & OPTIONAL_CONNECTION) == 0);
-		Assert(connection != NULL);
-		connectionList = lappend(connectionList, connection);
+	if (sendNodeList == NIL)
+	{
+		/* nothing to do */
+		return;
 	}
 
-	FinishConnectionListEstablishment(connectionList);
+	SendMetadataCommandStringsToWorkerList(sendNodeList, commandStringList);
+}
 
-	/* must open transaction blocks to use intermediate results */
-	RemoteTransactionsBeginIfNecessary(connectionList);
 
-	/*
-	 * In order to avoid round-trips per query in queryStringList,
-	 * we join the string and send as a single command. Also,
-	 * if there is only a single command, avoid additional call to
-	 * StringJoin given that some strings can be quite large.
-	 */
-	char *stringToSend = (list_length(commandList) == 1) ?
-						 linitial(commandList) : StringJoin(commandList, ';');
+/*
+ * SendMetadataCommandStringsToWorkerList sends the command strings in
+ * commandStringList to the corresponding workers in workerNodeList as part
+ * of the coordinated transaction, over metadata connections. The commands
+ * are sent to at most citus.max_parallel_metadata_sync_nodes workers at a
+ * time, and any failure aborts the coordinated transaction.
+ */
+static void
+SendMetadataCommandStringsToWorkerList(List *workerNodeList, List *commandStringList)
+{
+	UseCoordinatedTransaction();
 
-	/* send commands in parallel */
-	bool failOnError = true;
-	MultiConnection *connection = NULL;
-	foreach_ptr(connection, connectionList)
+	int nodeCount = list_length(workerNodeList);
+	int batchSize = nodeCount;
+	if (MaxParallelMetadataSyncNodes > 0)
 	{
-		int querySent = SendRemoteCommand(connection, stringToSend);
-		if (querySent == 0)
-		{
-			ReportConnectionError(connection, ERROR);
-		}
+		batchSize = Min(nodeCount, MaxParallelMetadataSyncNodes);
 	}
 
-	foreach_ptr(connection, connectionList)
+	for (int batchStart = 0; batchStart < nodeCount; batchStart += batchSize)
 	{
-		ClearResults(connection, failOnError);
+		int batchEnd = Min(batchStart + batchSize, nodeCount);
+		List *connectionList = NIL;
+
+		for (int nodeIndex = batchStart; nodeIndex < batchEnd; nodeIndex++)
+		{
+			WorkerNode *workerNode = (WorkerNode *) list_nth(workerNodeList, nodeIndex);
+			const char *nodeName = workerNode->workerName;
+			int nodePort = workerNode->workerPort;
+			int connectionFlags = REQUIRE_METADATA_CONNECTION;
+
+			MultiConnection *connection =
+				StartNodeConnection(connectionFlags, nodeName, nodePort);
+
+			MarkRemoteTransactionCritical(connection);
+
+			/*
+			 * connection can only be NULL for optional connections, which we don't
+			 * support in this codepath.
+			 */
+			Assert((connectionFlags & OPTIONAL_CONNECTION) == 0);
+			Assert(connection != NULL);
+			connectionList = lappend(connectionList, connection);
+		}
+
+		FinishConnectionListEstablishment(connectionList);
+
+		/* must open transaction blocks to use intermediate results */
+		RemoteTransactionsBeginIfNecessary(connectionList);
+
+		/* send commands in parallel */
+		bool failOnError = true;
+		MultiConnection *connection = NULL;
+		int nodeIndex = batchStart;
+		foreach_ptr(connection, connectionList)
+		{
+			char *stringToSend = (char *) list_nth(commandStringList, nodeIndex);
+
+			int querySent = SendRemoteCommand(connection, stringToSend);
+			if (querySent == 0)
+			{
+				ReportConnectionError(connection, ERROR);
+			}
+
+			nodeIndex++;
+		}
+
+		foreach_ptr(connection, connectionList)
+		{
+			ClearResults(connection, failOnError);
+		}
 	}
 }
 
@@ -7,6 +7,13 @@
  * When an aggregate has a combinefunc, we use worker_partial_agg to skip
  * calling finalfunc on workers, instead passing state to coordinator where
  * it uses combinefunc in coord_combine_agg & applying finalfunc only at end.
+ * The worker_partial_agg_binary & coord_combine_agg_binary variants pass the
+ * state as bytea produced by serialfunc or the type's send function instead,
+ * which also covers aggregates with internal transition state.
+ *
+ * For count(distinct) approximations without the hll extension, workers
+ * build HyperLogLog sketches via citus_hll_add_agg, which the coordinator
+ * merges via citus_hll_union_agg before estimating the count.
  *
  * Copyright Citus Data, Inc.
  *
@@ -20,7 +27,9 @@
 #include "catalog/pg_aggregate.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
+#include "distributed/citus_safe_lib.h"
 #include "distributed/version_compat.h"
+#include "lib/stringinfo.h"
 #include "nodes/nodeFuncs.h"
 #include "utils/acl.h"
 #include "utils/builtins.h"
@@ -31,11 +40,31 @@
 #include "fmgr.h"
 #include "miscadmin.h"
 #include "pg_config_manual.h"
+#include "port/pg_bitutils.h"
+
+#include <math.h>
 
 PG_FUNCTION_INFO_V1(worker_partial_agg_sfunc);
 PG_FUNCTION_INFO_V1(worker_partial_agg_ffunc);
+PG_FUNCTION_INFO_V1(worker_partial_agg_binary_ffunc);
 PG_FUNCTION_INFO_V1(coord_combine_agg_sfunc);
+PG_FUNCTION_INFO_V1(coord_combine_agg_binary_sfunc);
 PG_FUNCTION_INFO_V1(coord_combine_agg_ffunc);
+PG_FUNCTION_INFO_V1(citus_hll_add_agg_sfunc);
+PG_FUNCTION_INFO_V1(citus_hll_union_agg_sfunc);
+PG_FUNCTION_INFO_V1(citus_hll_agg_ffunc);
+PG_FUNCTION_INFO_V1(citus_hll_cardinality);
+
+/* range of the log-base-2 of the number of registers of a sketch */
+#define HLL_MIN_LOG2M 4
+#define HLL_MAX_LOG2M 17
+
+/* layout of serialized sketches */
+#define HLL_SKETCH_VERSION 1
+#define HLL_SKETCH_HEADER_SIZE 3
+#define HLL_DENSE_ENCODING 0
+#define HLL_SPARSE_ENCODING 1
+#define HLL_SPARSE_ENTRY_SIZE 4
 
 /*
  * Holds information describing the structure of aggregation arguments
@@ -73,6 +102,17 @@ typedef struct StypeBox
 	AggregationArgumentContext *aggregationArgumentContext;
 } StypeBox;
 
+/*
+ * HllSketch is the transition state of the HyperLogLog aggregates. Each
+ * register holds the maximum rank, i.e. the position of the leftmost one
+ * bit after the index bits, of the hashes that map to the register.
+ */
+typedef struct HllSketch
+{
+	int log2m;
+	uint8 registers[FLEXIBLE_ARRAY_MEMBER];
+} HllSketch;
+
 static HeapTuple GetAggregateForm(Oid oid, Form_pg_aggregate *form);
 static HeapTuple GetProcForm(Oid oid, Form_pg_proc *form);
 static HeapTuple GetTypeForm(Oid oid, Form_pg_type *form);
@@ -92,9 +132,22 @@ static void ExtractAggregationValues(FunctionCallInfo fcinfo, int argumentIndex,
 static void HandleTransition(StypeBox *box, FunctionCallInfo fcinfo,
 							 FunctionCallInfo innerFcinfo);
 static void HandleStrictUninit(StypeBox *box, FunctionCallInfo fcinfo, Datum value);
+static StypeBox * CoordCombineAggStypeBox(FunctionCallInfo fcinfo,
+										  const char *functionName,
+										  bool allowInternal, Oid *combine,
+										  Oid *deserial);
+static void CombineIntoStypeBox(StypeBox *box, FunctionCallInfo fcinfo, Oid combine,
+								Datum value, bool valueNull);
 static bool TypecheckWorkerPartialAggArgType(FunctionCallInfo fcinfo, StypeBox *box);
 static bool TypecheckCoordCombineAggReturnType(FunctionCallInfo fcinfo, Oid ffunc,
 											   StypeBox *box);
+static HllSketch * CreateHllSketch(FunctionCallInfo fcinfo, int log2m);
+static uint64 HllHashValue(FunctionCallInfo fcinfo, int argumentIndex);
+static void HllSketchAdd(HllSketch *sketch, uint64 hash);
+static bytea * SerializeHllSketch(HllSketch *sketch);
+static int DeserializeHllSketchLog2m(bytea *serializedSketch);
+static void HllSketchUnion(HllSketch *sketch, bytea *serializedSketch);
+static double HllSketchCardinality(HllSketch *sketch);
 
 /*
  * GetAggregateForm loads corresponding tuple & Form_pg_aggregate for oid
@@ -663,6 +716,77 @@ worker_partial_agg_ffunc(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * worker_partial_agg_binary_ffunc serializes transition state in binary form,
+ * using the serialfunc of the aggregate for internal states and the binary
+ * send function of the transition type otherwise:
+ *
+ * (box) -> bytea
+ * return box.agg.serialize(box.value)
+ */
+Datum
+worker_partial_agg_binary_ffunc(PG_FUNCTION_ARGS)
+{
+	LOCAL_FCINFO(innerFcinfo, 1);
+	FmgrInfo info;
+	StypeBox *box = (StypeBox *) (PG_ARGISNULL(0) ? NULL : PG_GETARG_POINTER(0));
+	Form_pg_aggregate aggform;
+
+	if (box == NULL)
+	{
+		box = TryCreateStypeBoxFromFcinfoAggref(fcinfo);
+	}
+
+	if (box == NULL || box->valueNull)
+	{
+		PG_RETURN_NULL();
+	}
+
+	HeapTuple aggtuple = GetAggregateForm(box->agg, &aggform);
+
+	if (aggform->aggcombinefn == InvalidOid)
+	{
+		ereport(ERROR, (errmsg("worker_partial_agg_binary_ffunc expects an aggregate "
+							   "with COMBINEFUNC")));
+	}
+
+	Oid transtype = aggform->aggtranstype;
+	Oid serial = aggform->aggserialfn;
+	ReleaseSysCache(aggtuple);
+
+	if (transtype == INTERNALOID)
+	{
+		if (serial == InvalidOid)
+		{
+			ereport(ERROR, (errmsg("worker_partial_agg_binary_ffunc expects an "
+								   "aggregate with SERIALFUNC")));
+		}
+
+		fmgr_info(serial, &info);
+	}
+	else
+	{
+		Oid typsend = InvalidOid;
+		bool typIsVarlena = false;
+
+		getTypeBinaryOutputInfo(transtype, &typsend, &typIsVarlena);
+		fmgr_info(typsend, &info);
+	}
+
+	InitFunctionCallInfoData(*innerFcinfo, &info, 1, fcinfo->fncollation,
+							 fcinfo->context, fcinfo->resultinfo);
+	fcSetArgExt(innerFcinfo, 0, box->value, box->valueNull);
+
+	Datum result = FunctionCallInvoke(innerFcinfo);
+
+	if (innerFcinfo->isnull)
+	{
+		PG_RETURN_NULL();
+	}
+	PG_RETURN_DATUM(result);
+}
+
+
 /*
  * coord_combine_agg_sfunc deserializes transition state from worker
  * & advances transition state using combinefunc,
@@ -678,9 +802,130 @@ coord_combine_agg_sfunc(PG_FUNCTION_ARGS)
 {
 	LOCAL_FCINFO(innerFcinfo, 3);
 	FmgrInfo info;
-	Form_pg_aggregate aggform;
 	Form_pg_type transtypeform;
 	Datum value;
+	Oid combine = InvalidOid;
+	Oid deserial = InvalidOid;
+
+	StypeBox *box = CoordCombineAggStypeBox(fcinfo, "coord_combine_agg_sfunc", false,
+											&combine, &deserial);
+
+	bool valueNull = PG_ARGISNULL(2);
+	HeapTuple transtypetuple = GetTypeForm(box->transtype, &transtypeform);
+	Oid ioparam = getTypeIOParam(transtypetuple);
+	Oid typinput = transtypeform->typinput;
+	ReleaseSysCache(transtypetuple);
+
+	fmgr_info(typinput, &info);
+	if (valueNull && info.fn_strict)
+	{
+		value = (Datum) 0;
+	}
+	else
+	{
+		InitFunctionCallInfoData(*innerFcinfo, &info, 3, fcinfo->fncollation,
+								 fcinfo->context, fcinfo->resultinfo);
+		fcSetArgExt(innerFcinfo, 0, PG_GETARG_DATUM(2), valueNull);
+		fcSetArg(innerFcinfo, 1, ObjectIdGetDatum(ioparam));
+		fcSetArg(innerFcinfo, 2, Int32GetDatum(-1)); /* typmod */
+
+		value = FunctionCallInvoke(innerFcinfo);
+		valueNull = innerFcinfo->isnull;
+	}
+
+	CombineIntoStypeBox(box, fcinfo, combine, value, valueNull);
+
+	PG_RETURN_POINTER(box);
+}
+
+
+/*
+ * coord_combine_agg_binary_sfunc is the counterpart of coord_combine_agg_sfunc
+ * for states sent by worker_partial_agg_binary. States of type internal are
+ * read with the deserialfunc of the aggregate, all other states are read with
+ * the binary receive function of the transition type:
+ *
+ * (box, agg, bytea) -> box
+ * box.agg = agg
+ * box.value = agg.combine(box.value, agg.deserialize(bytea))
+ * return box
+ */
+Datum
+coord_combine_agg_binary_sfunc(PG_FUNCTION_ARGS)
+{
+	LOCAL_FCINFO(innerFcinfo, 2);
+	FmgrInfo info;
+	Datum value = (Datum) 0;
+	Oid combine = InvalidOid;
+	Oid deserial = InvalidOid;
+
+	StypeBox *box = CoordCombineAggStypeBox(fcinfo, "coord_combine_agg_binary_sfunc",
+											true, &combine, &deserial);
+
+	bool valueNull = PG_ARGISNULL(2);
+
+	if (box->transtype == INTERNALOID)
+	{
+		fmgr_info(deserial, &info);
+		if (!(valueNull && info.fn_strict))
+		{
+			InitFunctionCallInfoData(*innerFcinfo, &info, 2, fcinfo->fncollation,
+									 fcinfo->context, fcinfo->resultinfo);
+			fcSetArgExt(innerFcinfo, 0, PG_GETARG_DATUM(2), valueNull);
+			fcSetArgExt(innerFcinfo, 1, (Datum) 0, false);
+
+			value = FunctionCallInvoke(innerFcinfo);
+			valueNull = innerFcinfo->isnull;
+		}
+	}
+	else
+	{
+		Oid typreceive = InvalidOid;
+		Oid ioparam = InvalidOid;
+		StringInfoData buffer;
+		StringInfo bufferPointer = NULL;
+
+		getTypeBinaryInputInfo(box->transtype, &typreceive, &ioparam);
+		fmgr_info(typreceive, &info);
+
+		if (!valueNull)
+		{
+			bytea *serializedValue = PG_GETARG_BYTEA_PP(2);
+
+			initStringInfo(&buffer);
+			appendBinaryStringInfo(&buffer, VARDATA_ANY(serializedValue),
+								   VARSIZE_ANY_EXHDR(serializedValue));
+			bufferPointer = &buffer;
+		}
+
+		value = ReceiveFunctionCall(&info, bufferPointer, ioparam, -1);
+
+		if (bufferPointer != NULL && buffer.cursor != buffer.len)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg("incorrect binary data format in partial "
+								   "aggregate state")));
+		}
+	}
+
+	CombineIntoStypeBox(box, fcinfo, combine, value, valueNull);
+
+	PG_RETURN_POINTER(box);
+}
+
+
+/*
+ * CoordCombineAggStypeBox returns the transition state of a coord_combine_agg
+ * variant, creating it on the first call, and looks up the combinefunc and
+ * deserialfunc of the aggregate being distributed. Only binary variants can
+ * handle aggregates with internal transition state, since those states exist
+ * in serialized form only.
+ */
+static StypeBox *
+CoordCombineAggStypeBox(FunctionCallInfo fcinfo, const char *functionName,
+						bool allowInternal, Oid *combine, Oid *deserial)
+{
+	Form_pg_aggregate aggform;
 	StypeBox *box = NULL;
 
 	if (PG_ARGISNULL(0))
@@ -698,18 +943,28 @@ coord_combine_agg_sfunc(PG_FUNCTION_ARGS)
 
 	if (aggform->aggcombinefn == InvalidOid)
 	{
-		ereport(ERROR, (errmsg(
-							"coord_combine_agg_sfunc expects an aggregate with COMBINEFUNC")));
+		ereport(ERROR, (errmsg("%s expects an aggregate with COMBINEFUNC",
+							   functionName)));
 	}
 
 	if (aggform->aggtranstype == INTERNALOID)
 	{
-		ereport(ERROR,
-				(errmsg(
-					 "coord_combine_agg_sfunc does not support aggregates with INTERNAL transition state")));
+		if (!allowInternal)
+		{
+			ereport(ERROR,
+					(errmsg("%s does not support aggregates with INTERNAL "
+							"transition state", functionName)));
+		}
+
+		if (aggform->aggdeserialfn == InvalidOid)
+		{
+			ereport(ERROR, (errmsg("%s expects an aggregate with DESERIALFUNC",
+								   functionName)));
+		}
 	}
 
-	Oid combine = aggform->aggcombinefn;
+	*combine = aggform->aggcombinefn;
+	*deserial = aggform->aggdeserialfn;
 
 	if (PG_ARGISNULL(0))
 	{
@@ -725,28 +980,20 @@ coord_combine_agg_sfunc(PG_FUNCTION_ARGS)
 						&box->transtypeByVal);
 	}
 
-	bool valueNull = PG_ARGISNULL(2);
-	HeapTuple transtypetuple = GetTypeForm(box->transtype, &transtypeform);
-	Oid ioparam = getTypeIOParam(transtypetuple);
-	Oid deserial = transtypeform->typinput;
-	ReleaseSysCache(transtypetuple);
+	return box;
+}
 
-	fmgr_info(deserial, &info);
-	if (valueNull && info.fn_strict)
-	{
-		value = (Datum) 0;
-	}
-	else
-	{
-		InitFunctionCallInfoData(*innerFcinfo, &info, 3, fcinfo->fncollation,
-								 fcinfo->context, fcinfo->resultinfo);
-		fcSetArgExt(innerFcinfo, 0, PG_GETARG_DATUM(2), valueNull);
-		fcSetArg(innerFcinfo, 1, ObjectIdGetDatum(ioparam));
-		fcSetArg(innerFcinfo, 2, Int32GetDatum(-1)); /* typmod */
 
-		value = FunctionCallInvoke(innerFcinfo);
-		valueNull = innerFcinfo->isnull;
-	}
+/*
+ * CombineIntoStypeBox advances the transition state in the box by calling the
+ * given combinefunc with the deserialized worker state.
+ */
+static void
+CombineIntoStypeBox(StypeBox *box, FunctionCallInfo fcinfo, Oid combine,
+					Datum value, bool valueNull)
+{
+	LOCAL_FCINFO(innerFcinfo, 2);
+	FmgrInfo info;
 
 	fmgr_info(combine, &info);
 
@@ -754,18 +1001,18 @@ coord_combine_agg_sfunc(PG_FUNCTION_ARGS)
 	{
 		if (valueNull)
 		{
-			PG_RETURN_POINTER(box);
+			return;
 		}
 
 		if (!box->valueInit)
 		{
 			HandleStrictUninit(box, fcinfo, value);
-			PG_RETURN_POINTER(box);
+			return;
 		}
 
 		if (box->valueNull)
 		{
-			PG_RETURN_POINTER(box);
+			return;
 		}
 	}
 
@@ -775,8 +1022,6 @@ coord_combine_agg_sfunc(PG_FUNCTION_ARGS)
 	fcSetArgExt(innerFcinfo, 1, value, valueNull);
 
 	HandleTransition(box, fcinfo, innerFcinfo);
-
-	PG_RETURN_POINTER(box);
 }
 
 
@@ -957,3 +1202,394 @@ TypecheckCoordCombineAggReturnType(FunctionCallInfo fcinfo, Oid ffunc, StypeBox
 	return nulltag != NULL && IsA(nulltag->expr, Const) &&
 		   ((Const *) nulltag->expr)->consttype == finalType;
 }
+
+
+/*
+ * citus_hll_add_agg_sfunc adds the hash of the given value to a HyperLogLog
+ * sketch with 2^log2m registers, which it creates on the first call.
+ */
+Datum
+citus_hll_add_agg_sfunc(PG_FUNCTION_ARGS)
+{
+	HllSketch *sketch = NULL;
+
+	if (!PG_ARGISNULL(0))
+	{
+		sketch = (HllSketch *) PG_GETARG_POINTER(0);
+	}
+	else
+	{
+		if (PG_ARGISNULL(2))
+		{
+			ereport(ERROR, (errmsg("sketch precision cannot be NULL")));
+		}
+
+		sketch = CreateHllSketch(fcinfo, PG_GETARG_INT32(2));
+	}
+
+	/* like count(distinct), we skip NULL values */
+	if (!PG_ARGISNULL(1))
+	{
+		HllSketchAdd(sketch, HllHashValue(fcinfo, 1));
+	}
+
+	PG_RETURN_POINTER(sketch);
+}
+
+
+/*
+ * citus_hll_union_agg_sfunc merges the given serialized sketch into the
+ * transition state, which it creates on the first call.
+ */
+Datum
+citus_hll_union_agg_sfunc(PG_FUNCTION_ARGS)
+{
+	HllSketch *sketch = PG_ARGISNULL(0) ? NULL : (HllSketch *) PG_GETARG_POINTER(0);
+
+	if (PG_ARGISNULL(1))
+	{
+		/* shards without rows return NULL */
+		if (sketch == NULL)
+		{
+			PG_RETURN_NULL();
+		}
+
+		PG_RETURN_POINTER(sketch);
+	}
+
+	bytea *serializedSketch = PG_GETARG_BYTEA_PP(1);
+
+	if (sketch == NULL)
+	{
+		int log2m = DeserializeHllSketchLog2m(serializedSketch);
+		sketch = CreateHllSketch(fcinfo, log2m);
+	}
+
+	HllSketchUnion(sketch, serializedSketch);
+
+	PG_RETURN_POINTER(sketch);
+}
+
+
+/*
+ * citus_hll_agg_ffunc serializes the transition state of citus_hll_add_agg
+ * and citus_hll_union_agg.
+ */
+Datum
+citus_hll_agg_ffunc(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+	{
+		PG_RETURN_NULL();
+	}
+
+	HllSketch *sketch = (HllSketch *) PG_GETARG_POINTER(0);
+
+	PG_RETURN_BYTEA_P(SerializeHllSketch(sketch));
+}
+
+
+/*
+ * citus_hll_cardinality returns the estimated number of distinct values that
+ * were added to the given serialized sketch, or 0 for NULL.
+ */
+Datum
+citus_hll_cardinality(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+	{
+		PG_RETURN_FLOAT8(0.0);
+	}
+
+	bytea *serializedSketch = PG_GETARG_BYTEA_PP(0);
+	int log2m = DeserializeHllSketchLog2m(serializedSketch);
+	int registerCount = 1 << log2m;
+
+	HllSketch *sketch = palloc0(offsetof(HllSketch, registers) + registerCount);
+	sketch->log2m = log2m;
+
+	HllSketchUnion(sketch, serializedSketch);
+
+	PG_RETURN_FLOAT8(HllSketchCardinality(sketch));
+}
+
+
+/*
+ * CreateHllSketch allocates an empty sketch with 2^log2m registers in the
+ * aggregate context.
+ */
+static HllSketch *
+CreateHllSketch(FunctionCallInfo fcinfo, int log2m)
+{
+	if (log2m < HLL_MIN_LOG2M || log2m > HLL_MAX_LOG2M)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("sketch precision must be between %d and %d",
+							   HLL_MIN_LOG2M, HLL_MAX_LOG2M)));
+	}
+
+	int registerCount = 1 << log2m;
+	size_t sketchSize = offsetof(HllSketch, registers) + registerCount;
+
+	HllSketch *sketch = pallocInAggContext(fcinfo, sketchSize);
+	memset(sketch, 0, sketchSize);
+	sketch->log2m = log2m;
+
+	return sketch;
+}
+
+
+/*
+ * HllHashValue returns a 64-bit hash of the given argument, using the
+ * extended hash function of its type. We cache the type cache entry of the
+ * argument type in fn_extra since it does not change between calls.
+ */
+static uint64
+HllHashValue(FunctionCallInfo fcinfo, int argumentIndex)
+{
+	TypeCacheEntry *typeEntry = (TypeCacheEntry *) fcinfo->flinfo->fn_extra;
+
+	if (typeEntry == NULL)
+	{
+		Oid argumentType = get_fn_expr_argtype(fcinfo->flinfo, argumentIndex);
+
+		typeEntry = lookup_type_cache(argumentType, TYPECACHE_HASH_EXTENDED_PROC_FINFO);
+		if (!OidIsValid(typeEntry->hash_extended_proc_finfo.fn_oid))
+		{
+			ereport(ERROR, (errcode(ERRCODE_UNDEFINED_FUNCTION),
+							errmsg("could not identify an extended hash function "
+								   "for type %s", format_type_be(argumentType))));
+		}
+
+		fcinfo->flinfo->fn_extra = typeEntry;
+	}
+
+	Datum hashDatum = FunctionCall2Coll(&typeEntry->hash_extended_proc_finfo,
+										PG_GET_COLLATION(),
+										PG_GETARG_DATUM(argumentIndex),
+										UInt64GetDatum(0));
+	uint64 hash = DatumGetUInt64(hashDatum);
+
+	/*
+	 * Some types, like integers, have weak hash functions in the upper bits
+	 * that the sketch uses for the register index, so mix the bits first.
+	 */
+	hash ^= hash >> 33;
+	hash *= UINT64CONST(0xff51afd7ed558ccd);
+	hash ^= hash >> 33;
+	hash *= UINT64CONST(0xc4ceb9fe1a85ec53);
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+
+/*
+ * HllSketchAdd adds the given hash to the sketch. The first log2m bits of the
+ * hash determine the register, and the remaining bits the rank.
+ */
+static void
+HllSketchAdd(HllSketch *sketch, uint64 hash)
+{
+	uint32 registerIndex = (uint32) (hash >> (64 - sketch->log2m));
+	uint64 remainingBits = hash << sketch->log2m;
+	uint8 rank = 64 - sketch->log2m + 1;
+
+	if (remainingBits != 0)
+	{
+		rank = 64 - pg_leftmost_one_pos64(remainingBits);
+	}
+
+	if (rank > sketch->registers[registerIndex])
+	{
+		sketch->registers[registerIndex] = rank;
+	}
+}
+
+
+/*
+ * SerializeHllSketch returns the sketch as a bytea. Sketches with few
+ * non-empty registers, which are common when a shard has few distinct
+ * values, are stored as a list of (register, rank) entries.
+ */
+static bytea *
+SerializeHllSketch(HllSketch *sketch)
+{
+	int registerCount = 1 << sketch->log2m;
+	int usedRegisterCount = 0;
+
+	for (int registerIndex = 0; registerIndex < registerCount; registerIndex++)
+	{
+		if (sketch->registers[registerIndex] != 0)
+		{
+			usedRegisterCount++;
+		}
+	}
+
+	bool useSparseEncoding = usedRegisterCount * HLL_SPARSE_ENTRY_SIZE < registerCount;
+	int payloadSize = useSparseEncoding ?
+					  usedRegisterCount * HLL_SPARSE_ENTRY_SIZE : registerCount;
+
+	bytea *serializedSketch = palloc(VARHDRSZ + HLL_SKETCH_HEADER_SIZE + payloadSize);
+	SET_VARSIZE(serializedSketch, VARHDRSZ + HLL_SKETCH_HEADER_SIZE + payloadSize);
+
+	uint8 *data = (uint8 *) VARDATA(serializedSketch);
+	data[0] = HLL_SKETCH_VERSION;
+	data[1] = (uint8) sketch->log2m;
+	data[2] = useSparseEncoding ? HLL_SPARSE_ENCODING : HLL_DENSE_ENCODING;
+	data += HLL_SKETCH_HEADER_SIZE;
+
+	if (!useSparseEncoding)
+	{
+		memcpy_s(data, registerCount, sketch->registers, registerCount);
+		return serializedSketch;
+	}
+
+	/* 3 bytes of register index in network byte order, followed by the rank */
+	for (int registerIndex = 0; registerIndex < registerCount; registerIndex++)
+	{
+		uint8 rank = sketch->registers[registerIndex];
+		if (rank == 0)
+		{
+			continue;
+		}
+
+		data[0] = (uint8) (registerIndex >> 16);
+		data[1] = (uint8) (registerIndex >> 8);
+		data[2] = (uint8) registerIndex;
+		data[3] = rank;
+		data += HLL_SPARSE_ENTRY_SIZE;
+	}
+
+	return serializedSketch;
+}
+
+
+/*
+ * DeserializeHllSketchLog2m validates the header of the serialized sketch
+ * and returns the log-base-2 of its number of registers.
+ */
+static int
+DeserializeHllSketchLog2m(bytea *serializedSketch)
+{
+	int dataSize = VARSIZE_ANY_EXHDR(serializedSketch);
+	uint8 *data = (uint8 *) VARDATA_ANY(serializedSketch);
+
+	if (dataSize < HLL_SKETCH_HEADER_SIZE || data[0] != HLL_SKETCH_VERSION ||
+		data[1] < HLL_MIN_LOG2M || data[1] > HLL_MAX_LOG2M)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("invalid HyperLogLog sketch")));
+	}
+
+	int log2m = data[1];
+	int registerCount = 1 << log2m;
+	int payloadSize = dataSize - HLL_SKETCH_HEADER_SIZE;
+
+	if ((data[2] == HLL_DENSE_ENCODING && payloadSize != registerCount) ||
+		(data[2] == HLL_SPARSE_ENCODING && payloadSize % HLL_SPARSE_ENTRY_SIZE != 0) ||
+		(data[2] != HLL_DENSE_ENCODING && data[2] != HLL_SPARSE_ENCODING))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("invalid HyperLogLog sketch")));
+	}
+
+	return log2m;
+}
+
+
+/*
+ * HllSketchUnion merges the given serialized sketch into the sketch by
+ * keeping the maximum rank of each register.
+ */
+static void
+HllSketchUnion(HllSketch *sketch, bytea *serializedSketch)
+{
+	int log2m = DeserializeHllSketchLog2m(serializedSketch);
+	if (log2m != sketch->log2m)
+	{
+		ereport(ERROR, (errmsg("cannot merge HyperLogLog sketches with different "
+							   "precisions")));
+	}
+
+	int registerCount = 1 << log2m;
+	uint8 *data = (uint8 *) VARDATA_ANY(serializedSketch);
+	uint8 encoding = data[2];
+	int payloadSize = VARSIZE_ANY_EXHDR(serializedSketch) - HLL_SKETCH_HEADER_SIZE;
+	data += HLL_SKETCH_HEADER_SIZE;
+
+	if (encoding == HLL_DENSE_ENCODING)
+	{
+		for (int registerIndex = 0; registerIndex < registerCount; registerIndex++)
+		{
+			sketch->registers[registerIndex] = Max(sketch->registers[registerIndex],
+												   data[registerIndex]);
+		}
+
+		return;
+	}
+
+	for (int offset = 0; offset < payloadSize; offset += HLL_SPARSE_ENTRY_SIZE)
+	{
+		uint32 registerIndex = ((uint32) data[offset] << 16) |
+							   ((uint32) data[offset + 1] << 8) |
+							   (uint32) data[offset + 2];
+		uint8 rank = data[offset + 3];
+
+		if (registerIndex >= (uint32) registerCount)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("invalid HyperLogLog sketch")));
+		}
+
+		sketch->registers[registerIndex] = Max(sketch->registers[registerIndex], rank);
+	}
+}
+
+
+/*
+ * HllSketchCardinality returns the HyperLogLog estimate of the number of
+ * distinct values in the sketch, using linear counting for small estimates.
+ */
+static double
+HllSketchCardinality(HllSketch *sketch)
+{
+	int registerCount = 1 << sketch->log2m;
+	int emptyRegisterCount = 0;
+	double inverseSum = 0.0;
+
+	for (int registerIndex = 0; registerIndex < registerCount; registerIndex++)
+	{
+		uint8 rank = sketch->registers[registerIndex];
+
+		inverseSum += ldexp(1.0, -rank);
+
+		if (rank == 0)
+		{
+			emptyRegisterCount++;
+		}
+	}
+
+	double alpha = 0.7213 / (1.0 + 1.079 / registerCount);
+	if (registerCount == 16)
+	{
+		alpha = 0.673;
+	}
+	else if (registerCount == 32)
+	{
+		alpha = 0.697;
+	}
+	else if (registerCount == 64)
+	{
+		alpha = 0.709;
+	}
+
+	double estimate = alpha * registerCount * registerCount / inverseSum;
+
+	if (estimate <= 2.5 * registerCount && emptyRegisterCount > 0)
+	{
+		estimate = registerCount * log((double) registerCount / emptyRegisterCount);
+	}
+
+	return estimate;
+}
@@ -37,6 +37,7 @@
 #include "libpq/pqsignal.h"
 #include "parser/analyze.h"
 #include "pgstat.h"
+#include "postmaster/interrupt.h"
 #include "storage/dsm.h"
 #include "storage/ipc.h"
 #include "storage/procarray.h"
@@ -46,6 +47,8 @@
 #include "tcop/tcopprot.h"
 #include "tcop/utility.h"
 #include "utils/fmgrprotos.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
 #include "utils/memutils.h"
 #include "utils/portal.h"
 #include "utils/ps_status.h"
@@ -55,10 +58,12 @@
 
 #include "distributed/background_jobs.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/hash_helpers.h"
 #include "distributed/listutils.h"
 #include "distributed/maintenanced.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_utility.h"
+#include "distributed/priority.h"
 #include "distributed/shard_cleaner.h"
 #include "distributed/resource_lock.h"
 
@@ -71,13 +76,81 @@
 #define CITUS_BACKGROUND_TASK_KEY_TASK_ID 4
 #define CITUS_BACKGROUND_TASK_NKEYS 5
 
+/*
+ * BackgroundTaskExecution keeps the state of a task that the queue monitor executes in a
+ * background task executor, while the executor is running.
+ */
+typedef struct BackgroundTaskExecution
+{
+	/* hash key, must be the first field */
+	int64 taskId;
+
+	/* job the task belongs to */
+	int64 jobId;
+
+	dsm_segment *seg;
+	shm_mq_handle *responseq;
+
+	/* ids of the nodes the task works on, as a list of int */
+	List *nodesInvolved;
+
+	/* output of the executor received so far */
+	StringInfoData message;
+	bool hadError;
+} BackgroundTaskExecution;
+
+/*
+ * JobTaskCount counts the tasks of a job, used by OrderBackgroundTasksFairly.
+ */
+typedef struct JobTaskCount
+{
+	/* hash key, must be the first field */
+	int64 jobId;
+
+	int taskCount;
+} JobTaskCount;
+
+/*
+ * FairTaskOrder is the position of a runnable task in the order in which
+ * StartRunnableBackgroundTasks tries to start them.
+ */
+typedef struct FairTaskOrder
+{
+	BackgroundTask *task;
+
+	/* number of tasks of the same job that are running or come earlier */
+	int jobRank;
+
+	/* position of the task in the list of runnable tasks */
+	int taskIndex;
+} FairTaskOrder;
+
+
+/* GUC, maximum number of tasks the queue monitor executes concurrently */
+int MaxBackgroundTaskExecutors = 1;
+
+/* GUC, maximum number of tasks working on a node that are executed concurrently */
+int MaxBackgroundTaskExecutorsPerNode = 1;
+
+static int StartRunnableBackgroundTasks(HTAB *executionHash,
+										MemoryContext executionContext,
+										MemoryContext perTaskContext,
+										bool *foundRunnableTask,
+										TimestampTz *backgroundWorkerFailedStartTime);
+static bool BackgroundTaskNodesHaveCapacity(HTAB *executionHash, BackgroundTask *task);
+static List * OrderBackgroundTasksFairly(HTAB *executionHash, List *taskList);
+static int CompareFairTaskOrder(const void *leftElement, const void *rightElement);
+static int ConsumeBackgroundTaskExecutions(HTAB *executionHash,
+										   MemoryContext perTaskContext);
+static void FinishBackgroundTaskExecution(BackgroundTaskExecution *execution,
+										  MemoryContext perTaskContext);
 static BackgroundWorkerHandle * StartCitusBackgroundTaskExecuter(char *database,
 																 char *user,
 																 char *command,
 																 int64 taskId,
 																 dsm_segment **pSegment);
 static void ExecuteSqlString(const char *sql);
-static void ConsumeTaskWorkerOutput(shm_mq_handle *responseq, StringInfo message,
+static bool ConsumeTaskWorkerOutput(shm_mq_handle *responseq, StringInfo message,
 									bool *hadError);
 static void UpdateDependingTasks(BackgroundTask *task);
 static int64 CalculateBackoffDelay(int retryCount);
@@ -318,8 +391,11 @@ CitusBackgroundTaskQueueMonitorErrorCallback(void *arg)
  * tasks and jobs state machines associated with the task. When no new task can be found
  * it will exit(0) and lets the maintenance daemon poll for new tasks.
  *
- * The main loop is currently implemented as a synchronous loop stepping through the task
- * and update its state before going to the next.
+ * The main loop starts executors for runnable tasks, up to
+ * citus.max_background_task_executors concurrently and at most
+ * citus.max_background_task_executors_per_node working on the same node, and consumes
+ * the output of the running executors without blocking on any of them. A task's state is
+ * updated once its executor finishes.
  */
 void
 CitusBackgroundTaskQueueMonitorMain(Datum arg)
@@ -331,6 +407,9 @@ CitusBackgroundTaskQueueMonitorMain(Datum arg)
 	memcpy_s(&extensionOwner, sizeof(extensionOwner),
 			 MyBgworkerEntry->bgw_extra, sizeof(Oid));
 
+	/* the limits on concurrently executed tasks can be changed by a reload */
+	pqsignal(SIGHUP, SignalHandlerForConfigReload);
+
 	BackgroundWorkerUnblockSignals();
 
 	/* connect to database, after that we can actually access catalogs */
@@ -407,6 +486,26 @@ CitusBackgroundTaskQueueMonitorMain(Datum arg)
 
 
 	MemoryContext oldContextPerJob = MemoryContextSwitchTo(perTaskContext);
+
+	/*
+	 * The state of the tasks that are being executed is kept across iterations of the
+	 * loop, hence in a context that is not reset per iteration.
+	 */
+	MemoryContext executionContext = AllocSetContextCreate(TopMemoryContext,
+														   "BackgroundTaskExecutions",
+														   ALLOCSET_DEFAULT_SIZES);
+
+	HASHCTL info;
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(int64);
+	info.entrysize = sizeof(BackgroundTaskExecution);
+	info.hash = tag_hash;
+	info.hcxt = executionContext;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	HTAB *executionHash = hash_create("Background Task Executions", 32, &info,
+									  hashFlags);
+
 	TimestampTz backgroundWorkerFailedStartTime = 0;
 
 	/*
@@ -420,38 +519,112 @@ CitusBackgroundTaskQueueMonitorMain(Datum arg)
 
 		CHECK_FOR_INTERRUPTS();
 
-		InvalidateMetadataSystemCache();
-		StartTransactionCommand();
-		PushActiveSnapshot(GetTransactionSnapshot());
-
-		/*
-		 * We need to load the task into the perTaskContext as we will switch contexts
-		 * later due to the committing and starting of new transactions
-		 */
-		oldContext = MemoryContextSwitchTo(perTaskContext);
-		BackgroundTask *task = GetRunnableBackgroundTask();
-
-		if (!task)
+		if (ConfigReloadPending)
 		{
-			MemoryContextSwitchTo(oldContext);
+			ConfigReloadPending = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
 
-			PopActiveSnapshot();
-			CommitTransactionCommand();
+		bool foundRunnableTask = false;
+		int startedTaskCount = 0;
+		if (hash_get_num_entries(executionHash) < MaxBackgroundTaskExecutors)
+		{
+			startedTaskCount =
+				StartRunnableBackgroundTasks(executionHash, executionContext,
+											 perTaskContext, &foundRunnableTask,
+											 &backgroundWorkerFailedStartTime);
+		}
 
+		if (hash_get_num_entries(executionHash) == 0 && !foundRunnableTask)
+		{
 			hasTasks = false;
 			break;
 		}
 
-		/* we load the database name and username here as we are still in a transaction */
-		char *databaseName = get_database_name(MyDatabaseId);
-		char *userName = GetUserNameFromId(task->owner, false);
+		int finishedTaskCount = ConsumeBackgroundTaskExecutions(executionHash,
+																perTaskContext);
 
-		MemoryContextSwitchTo(oldContext);
+		if (startedTaskCount == 0 && finishedTaskCount == 0)
+		{
+			/*
+			 * Nothing progressed, wait for output of a running task or retry starting
+			 * tasks after a short sleep.
+			 */
+			const long delay_ms = 1000;
+			(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+							 delay_ms, WAIT_EVENT_PG_SLEEP);
+			ResetLatch(MyLatch);
+		}
+	}
 
-		PopActiveSnapshot();
-		CommitTransactionCommand();
+	MemoryContextSwitchTo(oldContextPerJob);
+	MemoryContextDelete(perTaskContext);
+	MemoryContextDelete(executionContext);
+}
 
-		MemoryContextSwitchTo(perTaskContext);
+
+/*
+ * StartRunnableBackgroundTasks starts background task executors for the tasks that are
+ * ready to run, as long as fewer than citus.max_background_task_executors tasks are
+ * running and the nodes a task works on have fewer than
+ * citus.max_background_task_executors_per_node tasks running. The started tasks are
+ * added to executionHash.
+ *
+ * foundRunnableTask is set when there are tasks ready to run, whether they could be
+ * started or not. Returns the number of started tasks.
+ */
+static int
+StartRunnableBackgroundTasks(HTAB *executionHash, MemoryContext executionContext,
+							 MemoryContext perTaskContext, bool *foundRunnableTask,
+							 TimestampTz *backgroundWorkerFailedStartTime)
+{
+	int startedTaskCount = 0;
+
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	/*
+	 * We need to load the tasks into the perTaskContext as we will switch contexts
+	 * later due to the committing and starting of new transactions
+	 */
+	MemoryContext oldContext = MemoryContextSwitchTo(perTaskContext);
+	List *taskList = GetRunnableBackgroundTaskList();
+	taskList = OrderBackgroundTasksFairly(executionHash, taskList);
+
+	/* we load the database name and usernames here as we are still in a transaction */
+	char *databaseName = get_database_name(MyDatabaseId);
+	List *userNameList = NIL;
+	BackgroundTask *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		userNameList = lappend(userNameList, GetUserNameFromId(task->owner, false));
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	MemoryContextSwitchTo(perTaskContext);
+
+	*foundRunnableTask = list_length(taskList) > 0;
+
+	int taskIndex = 0;
+	foreach_ptr(task, taskList)
+	{
+		char *userName = list_nth(userNameList, taskIndex);
+		taskIndex++;
+
+		if (hash_get_num_entries(executionHash) >= MaxBackgroundTaskExecutors)
+		{
+			break;
+		}
+
+		if (!BackgroundTaskNodesHaveCapacity(executionHash, task))
+		{
+			continue;
+		}
 
 		/*
 		 * The background worker needs to be started outside of the transaction, otherwise
@@ -467,25 +640,20 @@ CitusBackgroundTaskQueueMonitorMain(Datum arg)
 		{
 			/*
 			 * We are unable to start a background worker for the task execution.
-			 * Probably we are out of background workers. Warn once and restart the loop
-			 * after a short sleep.
+			 * Probably we are out of background workers. Warn once and retry after a
+			 * short sleep.
 			 */
-			if (backgroundWorkerFailedStartTime == 0)
+			if (*backgroundWorkerFailedStartTime == 0)
 			{
 				ereport(WARNING, (errmsg("unable to start background worker for "
 										 "background task execution")));
-				backgroundWorkerFailedStartTime = GetCurrentTimestamp();
+				*backgroundWorkerFailedStartTime = GetCurrentTimestamp();
 			}
 
-			const long delay_ms = 1000;
-			(void) WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
-							 delay_ms, WAIT_EVENT_PG_SLEEP);
-			ResetLatch(MyLatch);
-
-			continue;
+			break;
 		}
 
-		if (backgroundWorkerFailedStartTime > 0)
+		if (*backgroundWorkerFailedStartTime > 0)
 		{
 			/*
 			 * We had a delay in starting the background worker for task execution. Report
@@ -494,12 +662,12 @@ CitusBackgroundTaskQueueMonitorMain(Datum arg)
 			 */
 			long secs = 0;
 			int microsecs = 0;
-			TimestampDifference(backgroundWorkerFailedStartTime, GetCurrentTimestamp(),
+			TimestampDifference(*backgroundWorkerFailedStartTime, GetCurrentTimestamp(),
 								&secs, &microsecs);
 			ereport(LOG, (errmsg("able to start a background worker with %ld seconds"
 								 "delay", secs)));
 
-			backgroundWorkerFailedStartTime = 0;
+			*backgroundWorkerFailedStartTime = 0;
 		}
 
 
@@ -523,15 +691,18 @@ CitusBackgroundTaskQueueMonitorMain(Datum arg)
 		LockRelationOid(DistBackgroundTaskRelationId(), ExclusiveLock);
 
 		oldContext = MemoryContextSwitchTo(perTaskContext);
-		task = GetBackgroundTaskByTaskId(task->taskid);
+		BackgroundTask *currentTask = GetBackgroundTaskByTaskId(task->taskid);
 		MemoryContextSwitchTo(oldContext);
 
-		if (!task || task->status == BACKGROUND_TASK_STATUS_CANCELLING ||
-			task->status == BACKGROUND_TASK_STATUS_CANCELLED)
+		if (!currentTask || currentTask->status == BACKGROUND_TASK_STATUS_CANCELLING ||
+			currentTask->status == BACKGROUND_TASK_STATUS_CANCELLED)
 		{
-			task->status = BACKGROUND_TASK_STATUS_CANCELLED;
-			UpdateBackgroundTask(task);
-			UpdateBackgroundJob(task->jobid);
+			if (currentTask)
+			{
+				currentTask->status = BACKGROUND_TASK_STATUS_CANCELLED;
+				UpdateBackgroundTask(currentTask);
+				UpdateBackgroundJob(currentTask->jobid);
+			}
 
 			PopActiveSnapshot();
 			CommitTransactionCommand();
@@ -543,6 +714,8 @@ CitusBackgroundTaskQueueMonitorMain(Datum arg)
 			TerminateBackgroundWorker(handle);
 			dsm_detach(seg);
 
+			MemoryContextSwitchTo(perTaskContext);
+
 			/* there could be an other task ready to run, let a new loop decide */
 			continue;
 		}
@@ -551,74 +724,266 @@ CitusBackgroundTaskQueueMonitorMain(Datum arg)
 		 * Now that we have verified the task has not been cancelled and still exist we
 		 * update it to reflect the new state
 		 */
-		task->status = BACKGROUND_TASK_STATUS_RUNNING;
-		SET_NULLABLE_FIELD(task, pid, pid);
+		currentTask->status = BACKGROUND_TASK_STATUS_RUNNING;
+		SET_NULLABLE_FIELD(currentTask, pid, pid);
 
 		/* Update task status to indicate it is running */
-		UpdateBackgroundTask(task);
-		UpdateBackgroundJob(task->jobid);
+		UpdateBackgroundTask(currentTask);
+		UpdateBackgroundJob(currentTask->jobid);
 
 		PopActiveSnapshot();
 		CommitTransactionCommand();
 
+		/* keep track of the execution till the executor detaches from the queue */
+		oldContext = MemoryContextSwitchTo(executionContext);
+
+		bool found = false;
+		BackgroundTaskExecution *execution =
+			hash_search(executionHash, &task->taskid, HASH_ENTER, &found);
+		Assert(!found);
+
+		execution->jobId = task->jobid;
+		execution->seg = seg;
+		execution->nodesInvolved = list_copy(task->nodesInvolved);
+		execution->hadError = false;
+		initStringInfo(&execution->message);
+
+		shm_toc *toc = shm_toc_attach(CITUS_BACKGROUND_TASK_MAGIC,
+									  dsm_segment_address(seg));
+		shm_mq *mq = shm_toc_lookup(toc, CITUS_BACKGROUND_TASK_KEY_QUEUE, false);
+		execution->responseq = shm_mq_attach(mq, seg, NULL);
+
 		MemoryContextSwitchTo(perTaskContext);
 
-		bool hadError = false;
-		StringInfoData message = { 0 };
-		initStringInfo(&message);
+		startedTaskCount++;
+	}
 
-		{
-			shm_toc *toc = shm_toc_attach(CITUS_BACKGROUND_TASK_MAGIC,
-										  dsm_segment_address(seg));
-			shm_mq *mq = shm_toc_lookup(toc, CITUS_BACKGROUND_TASK_KEY_QUEUE, false);
-			shm_mq_handle *responseq = shm_mq_attach(mq, seg, NULL);
+	return startedTaskCount;
+}
 
-			/*
-			 * We consume the complete shm_mq here as ConsumeTaskWorkerOutput loops till
-			 * it reaches a SHM_MQ_DETACHED response.
-			 */
-			ConsumeTaskWorkerOutput(responseq, &message, &hadError);
 
-			shm_mq_detach(responseq);
+/*
+ * BackgroundTaskNodesHaveCapacity returns whether each of the nodes the given task works
+ * on has fewer than citus.max_background_task_executors_per_node tasks running.
+ */
+static bool
+BackgroundTaskNodesHaveCapacity(HTAB *executionHash, BackgroundTask *task)
+{
+	int nodeId = 0;
+	foreach_int(nodeId, task->nodesInvolved)
+	{
+		int nodeTaskCount = 0;
+
+		HASH_SEQ_STATUS status;
+		hash_seq_init(&status, executionHash);
+
+		BackgroundTaskExecution *execution = NULL;
+		while ((execution = hash_seq_search(&status)) != NULL)
+		{
+			if (list_member_int(execution->nodesInvolved, nodeId))
+			{
+				nodeTaskCount++;
+			}
+		}
+
+		if (nodeTaskCount >= MaxBackgroundTaskExecutorsPerNode)
+		{
+			return false;
 		}
+	}
 
-		StartTransactionCommand();
-		PushActiveSnapshot(GetTransactionSnapshot());
+	return true;
+}
 
-		/*
-		 * Same as before, we need to lock pg_dist_background_task in a way where we can
-		 * check if there had been a concurrent cancel.
-		 */
-		LockRelationOid(DistBackgroundTaskRelationId(), ExclusiveLock);
 
-		oldContext = MemoryContextSwitchTo(perTaskContext);
-		task = GetBackgroundTaskByTaskId(task->taskid);
-		MemoryContextSwitchTo(oldContext);
+/*
+ * OrderBackgroundTasksFairly returns the runnable tasks in the order in which they
+ * should be started, such that the running tasks are spread evenly across the jobs.
+ * Tasks are ordered by the number of tasks of their job that are running or come
+ * before them in the list, and by their original order otherwise. The first tasks
+ * of each job thereby come first, and a job that already has tasks running yields
+ * to the others. Tasks that cannot start because their nodes are busy are skipped
+ * by the caller, such that the capacity of the other nodes is still used.
+ */
+static List *
+OrderBackgroundTasksFairly(HTAB *executionHash, List *taskList)
+{
+	int taskCount = list_length(taskList);
+	if (taskCount <= 1)
+	{
+		return taskList;
+	}
 
-		if (!task || task->status == BACKGROUND_TASK_STATUS_CANCELLING ||
-			task->status == BACKGROUND_TASK_STATUS_CANCELLED)
+	HTAB *jobTaskCounts = CreateSimpleHash(int64, JobTaskCount);
+
+	HASH_SEQ_STATUS status;
+	hash_seq_init(&status, executionHash);
+
+	BackgroundTaskExecution *execution = NULL;
+	while ((execution = hash_seq_search(&status)) != NULL)
+	{
+		bool found = false;
+		JobTaskCount *jobTaskCount =
+			hash_search(jobTaskCounts, &execution->jobId, HASH_ENTER, &found);
+		if (!found)
 		{
-			/*
-			 * A concurrent cancel has happened or the task has disappeared, we are not
-			 * retrying or changing state, we will only reflect the message onto the task
-			 * and for completeness we update the job aswell, this should be a no-op
-			 *
-			 * We still need to release the shared memory and xact before looping
-			 */
+			jobTaskCount->taskCount = 0;
+		}
 
-			dsm_detach(seg);
+		jobTaskCount->taskCount++;
+	}
 
-			task->status = BACKGROUND_TASK_STATUS_CANCELLED;
-			task->message = message.data;
-			UpdateBackgroundTask(task);
-			UpdateBackgroundJob(task->jobid);
+	FairTaskOrder *taskOrder = palloc0(taskCount * sizeof(FairTaskOrder));
 
-			PopActiveSnapshot();
-			CommitTransactionCommand();
+	int taskIndex = 0;
+	BackgroundTask *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		bool found = false;
+		JobTaskCount *jobTaskCount =
+			hash_search(jobTaskCounts, &task->jobid, HASH_ENTER, &found);
+		if (!found)
+		{
+			jobTaskCount->taskCount = 0;
+		}
+
+		taskOrder[taskIndex].task = task;
+		taskOrder[taskIndex].jobRank = jobTaskCount->taskCount++;
+		taskOrder[taskIndex].taskIndex = taskIndex;
+		taskIndex++;
+	}
+
+	SafeQsort(taskOrder, taskCount, sizeof(FairTaskOrder), CompareFairTaskOrder);
+
+	List *orderedTaskList = NIL;
+	for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+	{
+		orderedTaskList = lappend(orderedTaskList, taskOrder[taskIndex].task);
+	}
+
+	pfree(taskOrder);
+	hash_destroy(jobTaskCounts);
+
+	return orderedTaskList;
+}
+
+
+/*
+ * CompareFairTaskOrder orders FairTaskOrder entries by their job rank and by
+ * their position in the list of runnable tasks.
+ */
+static int
+CompareFairTaskOrder(const void *leftElement, const void *rightElement)
+{
+	const FairTaskOrder *leftTask = (const FairTaskOrder *) leftElement;
+	const FairTaskOrder *rightTask = (const FairTaskOrder *) rightElement;
+
+	if (leftTask->jobRank != rightTask->jobRank)
+	{
+		return (leftTask->jobRank < rightTask->jobRank) ? -1 : 1;
+	}
+
+	if (leftTask->taskIndex != rightTask->taskIndex)
+	{
+		return (leftTask->taskIndex < rightTask->taskIndex) ? -1 : 1;
+	}
+
+	return 0;
+}
 
+
+/*
+ * ConsumeBackgroundTaskExecutions consumes the output the executors of the running tasks
+ * have sent so far. The tasks whose executor finished are transitioned to their next
+ * state and removed from executionHash. Returns the number of finished tasks.
+ */
+static int
+ConsumeBackgroundTaskExecutions(HTAB *executionHash, MemoryContext perTaskContext)
+{
+	int finishedTaskCount = 0;
+	List *finishedTaskIdList = NIL;
+
+	HASH_SEQ_STATUS status;
+	hash_seq_init(&status, executionHash);
+
+	BackgroundTaskExecution *execution = NULL;
+	while ((execution = hash_seq_search(&status)) != NULL)
+	{
+		bool detached = ConsumeTaskWorkerOutput(execution->responseq,
+												&execution->message,
+												&execution->hadError);
+		if (!detached)
+		{
 			continue;
 		}
-		else if (hadError)
+
+		FinishBackgroundTaskExecution(execution, perTaskContext);
+
+		int64 *taskId = palloc0(sizeof(int64));
+		*taskId = execution->taskId;
+		finishedTaskIdList = lappend(finishedTaskIdList, taskId);
+	}
+
+	/* remove the finished executions after the scan, as the hash is not frozen */
+	int64 *taskId = NULL;
+	foreach_ptr(taskId, finishedTaskIdList)
+	{
+		hash_search(executionHash, taskId, HASH_REMOVE, NULL);
+		finishedTaskCount++;
+	}
+
+	return finishedTaskCount;
+}
+
+
+/*
+ * FinishBackgroundTaskExecution transitions a task whose executor finished to its next
+ * state, based on whether the executor reported an error, and releases the resources of
+ * the execution.
+ */
+static void
+FinishBackgroundTaskExecution(BackgroundTaskExecution *execution,
+							  MemoryContext perTaskContext)
+{
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	/*
+	 * Same as before, we need to lock pg_dist_background_task in a way where we can
+	 * check if there had been a concurrent cancel.
+	 */
+	LockRelationOid(DistBackgroundTaskRelationId(), ExclusiveLock);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(perTaskContext);
+	BackgroundTask *task = GetBackgroundTaskByTaskId(execution->taskId);
+	char *message = pstrdup(execution->message.data);
+	MemoryContextSwitchTo(oldContext);
+
+	shm_mq_detach(execution->responseq);
+	dsm_detach(execution->seg);
+	pfree(execution->message.data);
+	list_free(execution->nodesInvolved);
+
+	if (!task)
+	{
+		/* the task has disappeared, there is nothing to update */
+	}
+	else if (task->status == BACKGROUND_TASK_STATUS_CANCELLING ||
+			 task->status == BACKGROUND_TASK_STATUS_CANCELLED)
+	{
+		/*
+		 * A concurrent cancel has happened, we are not retrying or changing state, we
+		 * will only reflect the message onto the task and for completeness we update
+		 * the job aswell, this should be a no-op
+		 */
+		task->status = BACKGROUND_TASK_STATUS_CANCELLED;
+		task->message = message;
+		UpdateBackgroundTask(task);
+		UpdateBackgroundJob(task->jobid);
+	}
+	else
+	{
+		if (execution->hadError)
 		{
 			/*
 			 * When we had an error we need to decide if we want to retry (keep the
@@ -657,20 +1022,17 @@ CitusBackgroundTaskQueueMonitorMain(Datum arg)
 			task->status = BACKGROUND_TASK_STATUS_DONE;
 		}
 		UNSET_NULLABLE_FIELD(task, pid);
-		task->message = message.data;
+		task->message = message;
 
 		UpdateBackgroundTask(task);
 		UpdateDependingTasks(task);
 		UpdateBackgroundJob(task->jobid);
-
-		dsm_detach(seg);
-
-		PopActiveSnapshot();
-		CommitTransactionCommand();
 	}
 
-	MemoryContextSwitchTo(oldContextPerJob);
-	MemoryContextDelete(perTaskContext);
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	MemoryContextSwitchTo(perTaskContext);
 }
 
 
@@ -850,12 +1212,15 @@ UpdateDependingTasks(BackgroundTask *task)
 
 
 /*
- * ConsumeTaskWorkerOutput consumes the output of an executor and mutates the
- * BackgroundTask object to reflect changes like the message and status on the task.
+ * ConsumeTaskWorkerOutput consumes the output an executor has sent so far, without
+ * waiting for more, and reflects it in message and hadError. Returns true once the
+ * executor detached from the queue, meaning it will not send any more output.
  */
-static void
+static bool
 ConsumeTaskWorkerOutput(shm_mq_handle *responseq, StringInfo message, bool *hadError)
 {
+	bool detached = false;
+
 	/*
 	 * Message-parsing routines operate on a null-terminated StringInfo,
 	 * so we must construct one.
@@ -868,16 +1233,21 @@ ConsumeTaskWorkerOutput(shm_mq_handle *responseq, StringInfo message, bool *hadE
 		resetStringInfo(&msg);
 
 		/*
-		 * Get next message. Currently blocking, when multiple backends get implemented it
-		 * should switch to a non-blocking receive
+		 * Get next message without blocking, the monitor consumes the output of all
+		 * running executors in turn.
 		 */
 		Size nbytes = 0;
 		void *data = NULL;
-		const bool noWait = false;
+		const bool noWait = true;
 		shm_mq_result res = shm_mq_receive(responseq, &nbytes, &data, noWait);
 
-		if (res != SHM_MQ_SUCCESS)
+		if (res == SHM_MQ_WOULD_BLOCK)
+		{
+			break;
+		}
+		else if (res != SHM_MQ_SUCCESS)
 		{
+			detached = true;
 			break;
 		}
 
@@ -958,6 +1328,8 @@ ConsumeTaskWorkerOutput(shm_mq_handle *responseq, StringInfo message, bool *hadE
 	}
 
 	pfree(msg.data);
+
+	return detached;
 }
 
 
@@ -1170,6 +1542,8 @@ CitusBackgroundTaskExecuter(Datum main_arg)
 
 	BackgroundWorkerInitializeConnection(database, username, 0);
 
+	SetOwnIoPriority(IoPriorityBackgroundOperations);
+
 	/* make sure we are the only backend running for this task */
 	LOCKTAG locktag = { 0 };
 	SET_LOCKTAG_BACKGROUND_TASK(locktag, *taskId);
@@ -101,6 +101,7 @@ copyJobInfo(Job *newnode, Job *from)
 	COPY_NODE_FIELD(partitionKeyValue);
 	COPY_NODE_FIELD(localPlannedStatements);
 	COPY_SCALAR_FIELD(parametersInJobQueryResolved);
+	COPY_NODE_FIELD(parameterValueList);
 }
 
 
@@ -124,6 +125,7 @@ CopyNodeDistributedPlan(COPYFUNC_ARGS)
 
 	COPY_NODE_FIELD(workerJob);
 	COPY_NODE_FIELD(combineQuery);
+	COPY_NODE_FIELD(sortedMergeClauseList);
 	COPY_SCALAR_FIELD(queryId);
 	COPY_NODE_FIELD(relationIdList);
 	COPY_SCALAR_FIELD(targetRelationId);
@@ -198,6 +200,7 @@ CopyNodeMapMergeJob(COPYFUNC_ARGS)
 
 	copyJobInfo(&newnode->job, &from->job);
 
+	COPY_SCALAR_FIELD(boundaryNodeJobType);
 	COPY_SCALAR_FIELD(partitionType);
 	COPY_NODE_FIELD(partitionColumn);
 	COPY_SCALAR_FIELD(partitionCount);
@@ -210,6 +213,12 @@ CopyNodeMapMergeJob(COPYFUNC_ARGS)
 
 	COPY_NODE_FIELD(mapTaskList);
 	COPY_NODE_FIELD(mergeTaskList);
+	COPY_STRING_FIELD(joinKeyFilterResultId);
+	COPY_SCALAR_FIELD(buildsJoinKeyFilter);
+	COPY_NODE_FIELD(joinKeyFilterTaskList);
+	COPY_STRING_FIELD(heavyHitterResultId);
+	COPY_SCALAR_FIELD(samplesHeavyHitters);
+	COPY_NODE_FIELD(heavyHitterSampleTaskList);
 }
 
 
@@ -323,10 +332,15 @@ CopyNodeTask(COPYFUNC_ARGS)
 	COPY_SCALAR_FIELD(parametersInQueryStringResolved);
 	COPY_SCALAR_FIELD(tupleDest);
 	COPY_SCALAR_FIELD(queryCount);
+	COPY_SCALAR_FIELD(sendQueriesTogether);
 	COPY_SCALAR_FIELD(totalReceivedTupleData);
 	COPY_SCALAR_FIELD(fetchedExplainAnalyzePlacementIndex);
 	COPY_STRING_FIELD(fetchedExplainAnalyzePlan);
 	COPY_SCALAR_FIELD(fetchedExplainAnalyzeExecutionDuration);
+	COPY_SCALAR_FIELD(explainAnalyzeConnectionWaitTime);
+	COPY_SCALAR_FIELD(explainAnalyzeFirstRowTime);
+	COPY_SCALAR_FIELD(explainAnalyzeRoundTrips);
+	COPY_SCALAR_FIELD(explainAnalyzeConnectionReused);
 	COPY_SCALAR_FIELD(isLocalTableModification);
 	COPY_SCALAR_FIELD(cannotBeExecutedInTransction);
 }
@@ -340,6 +354,7 @@ CopyNodeLocalPlannedStatement(COPYFUNC_ARGS)
 	COPY_SCALAR_FIELD(shardId);
 	COPY_SCALAR_FIELD(localGroupId);
 	COPY_NODE_FIELD(localPlan);
+	COPY_SCALAR_FIELD(lastUsed);
 }
 
 
@@ -189,6 +189,7 @@ OutDistributedPlan(OUTFUNC_ARGS)
 
 	WRITE_NODE_FIELD(workerJob);
 	WRITE_NODE_FIELD(combineQuery);
+	WRITE_NODE_FIELD(sortedMergeClauseList);
 	WRITE_UINT64_FIELD(queryId);
 	WRITE_NODE_FIELD(relationIdList);
 	WRITE_OID_FIELD(targetRelationId);
@@ -347,6 +348,7 @@ OutJobFields(StringInfo str, const Job *node)
 	WRITE_NODE_FIELD(partitionKeyValue);
 	WRITE_NODE_FIELD(localPlannedStatements);
 	WRITE_BOOL_FIELD(parametersInJobQueryResolved);
+	WRITE_NODE_FIELD(parameterValueList);
 }
 
 
@@ -401,6 +403,7 @@ OutMapMergeJob(OUTFUNC_ARGS)
 	WRITE_NODE_TYPE("MAPMERGEJOB");
 
 	OutJobFields(str, (Job *) node);
+	WRITE_ENUM_FIELD(boundaryNodeJobType, BoundaryNodeJobType);
 	WRITE_ENUM_FIELD(partitionType, PartitionType);
 	WRITE_NODE_FIELD(partitionColumn);
 	WRITE_UINT_FIELD(partitionCount);
@@ -413,6 +416,12 @@ OutMapMergeJob(OUTFUNC_ARGS)
 
 	WRITE_NODE_FIELD(mapTaskList);
 	WRITE_NODE_FIELD(mergeTaskList);
+	WRITE_STRING_FIELD(joinKeyFilterResultId);
+	WRITE_BOOL_FIELD(buildsJoinKeyFilter);
+	WRITE_NODE_FIELD(joinKeyFilterTaskList);
+	WRITE_STRING_FIELD(heavyHitterResultId);
+	WRITE_BOOL_FIELD(samplesHeavyHitters);
+	WRITE_NODE_FIELD(heavyHitterSampleTaskList);
 }
 
 
@@ -530,10 +539,15 @@ OutTask(OUTFUNC_ARGS)
 	WRITE_BOOL_FIELD(partiallyLocalOrRemote);
 	WRITE_BOOL_FIELD(parametersInQueryStringResolved);
 	WRITE_INT_FIELD(queryCount);
+	WRITE_BOOL_FIELD(sendQueriesTogether);
 	WRITE_UINT64_FIELD(totalReceivedTupleData);
 	WRITE_INT_FIELD(fetchedExplainAnalyzePlacementIndex);
 	WRITE_STRING_FIELD(fetchedExplainAnalyzePlan);
 	WRITE_FLOAT_FIELD(fetchedExplainAnalyzeExecutionDuration, "%.2f");
+	WRITE_FLOAT_FIELD(explainAnalyzeConnectionWaitTime, "%.3f");
+	WRITE_FLOAT_FIELD(explainAnalyzeFirstRowTime, "%.3f");
+	WRITE_UINT_FIELD(explainAnalyzeRoundTrips);
+	WRITE_BOOL_FIELD(explainAnalyzeConnectionReused);
 	WRITE_BOOL_FIELD(isLocalTableModification);
 	WRITE_BOOL_FIELD(cannotBeExecutedInTransction);
 }
@@ -549,6 +563,7 @@ OutLocalPlannedStatement(OUTFUNC_ARGS)
 	WRITE_UINT64_FIELD(shardId);
 	WRITE_UINT_FIELD(localGroupId);
 	WRITE_NODE_FIELD(localPlan);
+	WRITE_UINT64_FIELD(lastUsed);
 }
 
 void
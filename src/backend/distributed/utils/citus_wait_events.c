@@ -0,0 +1,130 @@
+/*-------------------------------------------------------------------------
+ *
+ * citus_wait_events.c
+ *	  Names of the wait events that backends report while waiting in
+ *	  distributed execution.
+ *
+ * Postgres shows all waits of extensions as the Extension wait event, which
+ * does not tell a backend that waits for a slot in the shared connection
+ * pool from one that waits for a slow worker. Citus therefore reports its
+ * own identifiers within the extension wait event class, and
+ * citus_backend_wait_events() maps the wait events of the backends to
+ * names.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "distributed/pg_version_constants.h"
+
+#include "catalog/pg_authid.h"
+#include "storage/proc.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+
+#include "distributed/citus_wait_events.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/tuplestore.h"
+
+
+#define CITUS_BACKEND_WAIT_EVENTS_COLUMNS 2
+
+
+/* names of the Citus wait events, in the order of CitusWaitEvent */
+static const char *const CitusWaitEventNames[CITUS_WAIT_EVENT_COUNT] = {
+	"CitusSharedConnection",
+	"CitusRemoteConnect",
+	"CitusRemoteQueryResult",
+	"CitusCopyFlush",
+	"CitusTransactionPrepare",
+	"CitusTransactionCommit",
+	"CitusIntermediateResultFetch",
+	"CitusExecutionAdmission"
+};
+
+
+PG_FUNCTION_INFO_V1(citus_backend_wait_events);
+
+
+/*
+ * CitusWaitEventName returns the name of the given wait event if it is a Citus
+ * wait event, and NULL otherwise.
+ */
+const char *
+CitusWaitEventName(uint32 waitEventInfo)
+{
+	if ((waitEventInfo & 0xFF000000) != PG_WAIT_EXTENSION)
+	{
+		return NULL;
+	}
+
+	uint32 eventId = waitEventInfo & 0x0000FFFF;
+	if (eventId < CITUS_WAIT_EVENT_OFFSET ||
+		eventId >= CITUS_WAIT_EVENT_OFFSET + CITUS_WAIT_EVENT_COUNT)
+	{
+		return NULL;
+	}
+
+	return CitusWaitEventNames[eventId - CITUS_WAIT_EVENT_OFFSET];
+}
+
+
+/*
+ * citus_backend_wait_events returns the process id and the Citus wait event
+ * of the backends that currently wait in distributed execution. Like
+ * pg_stat_activity, it only shows the backends of other users to members of
+ * pg_read_all_stats.
+ */
+Datum
+citus_backend_wait_events(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	Oid currentUserId = GetUserId();
+	bool canSeeAllBackends = is_member_of_role(currentUserId,
+#if PG_VERSION_NUM >= PG_VERSION_14
+											   ROLE_PG_READ_ALL_STATS);
+#else
+											   DEFAULT_ROLE_READ_ALL_STATS);
+#endif
+
+	for (int procIndex = 0; procIndex < ProcGlobal->allProcCount; procIndex++)
+	{
+		PGPROC *proc = &ProcGlobal->allProcs[procIndex];
+		Datum values[CITUS_BACKEND_WAIT_EVENTS_COLUMNS];
+		bool isNulls[CITUS_BACKEND_WAIT_EVENTS_COLUMNS];
+
+		/* the fields are read without a lock, like pg_stat_activity does */
+		int pid = proc->pid;
+		Oid roleId = proc->roleId;
+		uint32 waitEventInfo = *((volatile uint32 *) &proc->wait_event_info);
+		const char *waitEventName = CitusWaitEventName(waitEventInfo);
+
+		if (pid == 0 || waitEventName == NULL)
+		{
+			continue;
+		}
+
+		if (!canSeeAllBackends && !has_privs_of_role(currentUserId, roleId))
+		{
+			continue;
+		}
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = Int32GetDatum(pid);
+		values[1] = CStringGetTextDatum(waitEventName);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	PG_RETURN_VOID();
+}
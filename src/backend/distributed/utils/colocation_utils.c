@@ -1076,7 +1076,7 @@ ColocatedShardIntervalList(ShardInterval *shardInterval)
 			   colocatedTableCacheEntry->shardIntervalArrayLength);
 
 		ShardInterval *colocatedShardInterval =
-			colocatedTableCacheEntry->sortedShardIntervalArray[shardIntervalIndex];
+			GetCachedShardInterval(colocatedTableCacheEntry, shardIntervalIndex);
 
 		ShardInterval *copyShardInterval = CopyShardInterval(colocatedShardInterval);
 
@@ -1147,7 +1147,7 @@ ColocatedNonPartitionShardIntervalList(ShardInterval *shardInterval)
 			   colocatedTableCacheEntry->shardIntervalArrayLength);
 
 		ShardInterval *colocatedShardInterval =
-			colocatedTableCacheEntry->sortedShardIntervalArray[shardIntervalIndex];
+			GetCachedShardInterval(colocatedTableCacheEntry, shardIntervalIndex);
 
 		ShardInterval *copyShardInterval = CopyShardInterval(colocatedShardInterval);
 
@@ -1240,7 +1240,7 @@ ColocatedShardIdInRelation(Oid relationId, int shardIndex)
 {
 	CitusTableCacheEntry *tableCacheEntry = GetCitusTableCacheEntry(relationId);
 
-	return tableCacheEntry->sortedShardIntervalArray[shardIndex]->shardId;
+	return GetCachedShardId(tableCacheEntry, shardIndex);
 }
 
 
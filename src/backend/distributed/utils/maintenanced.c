@@ -9,6 +9,12 @@
  * can then perform work like deadlock detection, prepared transaction
  * recovery, and cleanup.
  *
+ * When citus.maintenance_daemon_idle_timeout is set, the worker of a database
+ * that had no other backends for that long, and that has no pending 2PC
+ * recovery, cleanup, metadata sync or background tasks, exits to free its
+ * background worker slot. The next backend that uses Citus in the database
+ * starts it again.
+ *
  * Copyright (c) Citus Data, Inc.
  *
  *-------------------------------------------------------------------------
@@ -23,6 +29,8 @@
 #include "miscadmin.h"
 #include "pgstat.h"
 
+#include "access/genam.h"
+#include "access/table.h"
 #include "access/xact.h"
 #include "access/xlog.h"
 #include "catalog/pg_extension.h"
@@ -36,13 +44,21 @@
 #include "distributed/background_jobs.h"
 #include "distributed/citus_safe_lib.h"
 #include "distributed/distributed_deadlock_detection.h"
+#include "distributed/distributed_table_statistics.h"
+#include "distributed/hot_tenant_isolation.h"
 #include "distributed/maintenanced.h"
 #include "distributed/coordinator_protocol.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/metadata_cache_warmup.h"
+#include "distributed/shard_access_stats.h"
 #include "distributed/shard_cleaner.h"
 #include "distributed/metadata_sync.h"
 #include "distributed/query_stats.h"
 #include "distributed/statistics_collection.h"
+#include "distributed/shard_size_cache.h"
+#include "distributed/stat_activity_snapshot.h"
+#include "distributed/table_row_estimates.h"
+#include "distributed/tenant_load_stats.h"
 #include "distributed/transaction_recovery.h"
 #include "distributed/version_compat.h"
 #include "nodes/makefuncs.h"
@@ -51,6 +67,7 @@
 #include "nodes/makefuncs.h"
 #include "storage/ipc.h"
 #include "storage/proc.h"
+#include "storage/procarray.h"
 #include "storage/latch.h"
 #include "storage/lmgr.h"
 #include "storage/lwlock.h"
@@ -99,6 +116,9 @@ int Recover2PCInterval = 60000;
 int DeferShardDeleteInterval = 15000;
 int BackgroundTaskQueueCheckInterval = 5000;
 
+/* GUC, time without other backends after which the daemon exits, 0 to never exit */
+int MaintenanceDaemonIdleTimeout = 0;
+
 /* config variables for metadata sync timeout */
 int MetadataSyncInterval = 60000;
 int MetadataSyncRetryInterval = 5000;
@@ -124,6 +144,9 @@ static void MaintenanceDaemonShmemExit(int code, Datum arg);
 static void MaintenanceDaemonErrorContext(void *arg);
 static bool MetadataSyncTriggeredCheckAndReset(MaintenanceDaemonDBData *dbData);
 static void WarnMaintenanceDaemonNotStarted(void);
+static bool MaintenanceDaemonHasPendingWork(void);
+static bool CitusCatalogIsEmpty(Oid relationId);
+static bool DeregisterIdleMaintenanceDaemon(MaintenanceDaemonDBData *dbData);
 
 /*
  * InitializeMaintenanceDaemon, called at server start, is responsible for
@@ -284,7 +307,16 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 	TimestampTz lastRecoveryTime = 0;
 	TimestampTz lastShardCleanTime = 0;
 	TimestampTz lastStatStatementsPurgeTime = 0;
+	TimestampTz lastTableRowEstimateRefreshTime = 0;
+	TimestampTz lastShardSizeRefreshTime = 0;
+	TimestampTz lastStatActivitySnapshotTime = 0;
+	TimestampTz lastCacheBuildCountDecayTime = 0;
+	TimestampTz lastShardAccessStatsDecayTime = 0;
+	TimestampTz lastTenantLoadStatsDecayTime = 0;
+	TimestampTz lastHotTenantIsolationCheckTime = 0;
+	TimestampTz lastDistributedStatisticsRefreshTime = 0;
 	TimestampTz nextMetadataSyncTime = 0;
+	TimestampTz idleSince = 0;
 
 	/* state kept for the background tasks queue monitor */
 	TimestampTz lastBackgroundTaskQueueCheck = GetCurrentTimestamp();
@@ -690,6 +722,191 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 			timeout = Min(timeout, (StatStatementsPurgeInterval * 1000));
 		}
 
+		if (TableRowEstimateRefreshInterval > 0 &&
+			TimestampDifferenceExceeds(lastTableRowEstimateRefreshTime,
+									   GetCurrentTimestamp(),
+									   TableRowEstimateRefreshInterval))
+		{
+			StartTransactionCommand();
+
+			if (!LockCitusExtension())
+			{
+				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+										"skipping table row estimate refresh")));
+			}
+			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+			{
+				/*
+				 * Record last time we refreshed the estimates to ensure we run
+				 * once per TableRowEstimateRefreshInterval, even if a node is
+				 * unreachable.
+				 */
+				lastTableRowEstimateRefreshTime = GetCurrentTimestamp();
+
+				UpdateTableRowEstimates();
+			}
+
+			CommitTransactionCommand();
+
+			/* make sure we don't wait too long */
+			timeout = Min(timeout, TableRowEstimateRefreshInterval);
+		}
+
+		if (ShardSizeRefreshInterval > 0 &&
+			TimestampDifferenceExceeds(lastShardSizeRefreshTime,
+									   GetCurrentTimestamp(),
+									   ShardSizeRefreshInterval))
+		{
+			StartTransactionCommand();
+
+			if (!LockCitusExtension())
+			{
+				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+										"skipping shard size refresh")));
+			}
+			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded() &&
+					 IsCoordinator())
+			{
+				/*
+				 * Record last time we refreshed the sizes to ensure we run
+				 * once per ShardSizeRefreshInterval, even if a node is
+				 * unreachable.
+				 */
+				lastShardSizeRefreshTime = GetCurrentTimestamp();
+
+				UpdateShardSizeCache();
+			}
+
+			CommitTransactionCommand();
+
+			/* make sure we don't wait too long */
+			timeout = Min(timeout, ShardSizeRefreshInterval);
+		}
+
+		if (StatActivitySnapshotInterval > 0 &&
+			TimestampDifferenceExceeds(lastStatActivitySnapshotTime,
+									   GetCurrentTimestamp(),
+									   StatActivitySnapshotInterval))
+		{
+			StartTransactionCommand();
+
+			if (!LockCitusExtension())
+			{
+				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+										"skipping activity snapshot")));
+			}
+			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded() &&
+					 IsCoordinator())
+			{
+				lastStatActivitySnapshotTime = GetCurrentTimestamp();
+
+				UpdateStatActivitySnapshot();
+			}
+
+			CommitTransactionCommand();
+
+			/* make sure we don't wait too long */
+			timeout = Min(timeout, StatActivitySnapshotInterval);
+		}
+
+		if (TimestampDifferenceExceeds(lastCacheBuildCountDecayTime,
+									   GetCurrentTimestamp(),
+									   METADATA_CACHE_WARMUP_DECAY_INTERVAL))
+		{
+			/* only touches shared memory, so no transaction is needed */
+			lastCacheBuildCountDecayTime = GetCurrentTimestamp();
+
+			DecayCitusTableCacheBuildCounts();
+
+			timeout = Min(timeout, METADATA_CACHE_WARMUP_DECAY_INTERVAL);
+		}
+
+		if (TimestampDifferenceExceeds(lastShardAccessStatsDecayTime,
+									   GetCurrentTimestamp(),
+									   SHARD_ACCESS_STATS_DECAY_INTERVAL))
+		{
+			/* the first decay only happens after a full interval */
+			if (lastShardAccessStatsDecayTime != 0)
+			{
+				DecayShardAccessStats();
+			}
+
+			lastShardAccessStatsDecayTime = GetCurrentTimestamp();
+
+			timeout = Min(timeout, SHARD_ACCESS_STATS_DECAY_INTERVAL);
+		}
+
+		if (TimestampDifferenceExceeds(lastTenantLoadStatsDecayTime,
+									   GetCurrentTimestamp(),
+									   TENANT_LOAD_STATS_DECAY_INTERVAL))
+		{
+			/* the first decay only happens after a full interval */
+			if (lastTenantLoadStatsDecayTime != 0)
+			{
+				DecayTenantLoadStats();
+			}
+
+			lastTenantLoadStatsDecayTime = GetCurrentTimestamp();
+
+			timeout = Min(timeout, TENANT_LOAD_STATS_DECAY_INTERVAL);
+		}
+
+		if (HotTenantIsolationThreshold > 0 && !RecoveryInProgress() &&
+			TimestampDifferenceExceeds(lastHotTenantIsolationCheckTime,
+									   GetCurrentTimestamp(),
+									   HOT_TENANT_ISOLATION_CHECK_INTERVAL))
+		{
+			StartTransactionCommand();
+
+			if (!LockCitusExtension())
+			{
+				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+										"skipping hot tenant isolation")));
+			}
+			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded() &&
+					 IsCoordinator())
+			{
+				lastHotTenantIsolationCheckTime = GetCurrentTimestamp();
+
+				ScheduleHotTenantIsolation();
+			}
+
+			CommitTransactionCommand();
+
+			/* make sure we don't wait too long */
+			timeout = Min(timeout, HOT_TENANT_ISOLATION_CHECK_INTERVAL);
+		}
+
+		if (DistributedStatisticsRefreshInterval > 0 && !RecoveryInProgress() &&
+			TimestampDifferenceExceeds(lastDistributedStatisticsRefreshTime,
+									   GetCurrentTimestamp(),
+									   DistributedStatisticsRefreshInterval))
+		{
+			StartTransactionCommand();
+
+			if (!LockCitusExtension())
+			{
+				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+										"skipping distributed statistics refresh")));
+			}
+			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded() &&
+					 IsCoordinator())
+			{
+				/*
+				 * Record last time we refreshed the statistics to ensure we run
+				 * once per DistributedStatisticsRefreshInterval.
+				 */
+				lastDistributedStatisticsRefreshTime = GetCurrentTimestamp();
+
+				AnalyzeAllDistributedTables();
+			}
+
+			CommitTransactionCommand();
+
+			/* make sure we don't wait too long */
+			timeout = Min(timeout, DistributedStatisticsRefreshInterval);
+		}
+
 		pid_t backgroundTaskQueueWorkerPid = 0;
 		BgwHandleStatus backgroundTaskQueueWorkerStatus =
 			backgroundTasksQueueBgwHandle != NULL ? GetBackgroundWorkerPid(
@@ -792,6 +1009,33 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 			timeout = Min(timeout, BackgroundTaskQueueCheckInterval);
 		}
 
+		/*
+		 * Other backends in the database, including the metadata sync and the
+		 * background task workers that we started, keep the daemon around.
+		 */
+		if (MaintenanceDaemonIdleTimeout > 0 && !RecoveryInProgress())
+		{
+			if (CountDBBackends(databaseOid) > 1)
+			{
+				idleSince = 0;
+			}
+			else if (idleSince == 0)
+			{
+				idleSince = GetCurrentTimestamp();
+			}
+			else if (TimestampDifferenceExceeds(idleSince, GetCurrentTimestamp(),
+												MaintenanceDaemonIdleTimeout) &&
+					 !MaintenanceDaemonHasPendingWork() &&
+					 DeregisterIdleMaintenanceDaemon(myDbData))
+			{
+				elog(LOG, "stopping idle maintenance daemon on database %u",
+					 databaseOid);
+				break;
+			}
+
+			timeout = Min(timeout, MaintenanceDaemonIdleTimeout);
+		}
+
 		/*
 		 * Wait until timeout, or until somebody wakes us up. Also cast the timeout to
 		 * integer where we've calculated it using double for not losing the precision.
@@ -929,16 +1173,15 @@ MaintenanceDaemonShmemExit(int code, Datum arg)
 										hash_search(MaintenanceDaemonDBHash, &databaseOid,
 													HASH_FIND, NULL);
 
-	/* myDbData is NULL after StopMaintenanceDaemon */
-	if (myDbData != NULL)
+	/*
+	 * myDbData is NULL after StopMaintenanceDaemon, and no longer ours after
+	 * DeregisterIdleMaintenanceDaemon.
+	 */
+	if (myDbData != NULL && myDbData->workerPid == MyProcPid)
 	{
-		/*
-		 * Confirm that I am still the registered maintenance daemon before exiting.
-		 */
-		Assert(myDbData->workerPid == MyProcPid);
-
 		myDbData->daemonStarted = false;
 		myDbData->workerPid = 0;
+		myDbData->latch = NULL;
 	}
 
 	LWLockRelease(&MaintenanceDaemonControl->lock);
@@ -1074,8 +1317,11 @@ TriggerNodeMetadataSync(Oid databaseId)
 	{
 		dbData->triggerNodeMetadataSync = true;
 
-		/* set latch to wake-up the maintenance loop */
-		SetLatch(dbData->latch);
+		/* set latch to wake-up the maintenance loop, if it is running */
+		if (dbData->latch != NULL)
+		{
+			SetLatch(dbData->latch);
+		}
 	}
 
 	LWLockRelease(&MaintenanceDaemonControl->lock);
@@ -1098,3 +1344,87 @@ MetadataSyncTriggeredCheckAndReset(MaintenanceDaemonDBData *dbData)
 
 	return metadataSyncTriggered;
 }
+
+
+/*
+ * MaintenanceDaemonHasPendingWork returns whether the maintenance daemon still
+ * has work to do in the database when no backends are around to start it, in
+ * which case it should not exit when idle.
+ */
+static bool
+MaintenanceDaemonHasPendingWork(void)
+{
+	bool hasPendingWork = true;
+
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	if (!LockCitusExtension())
+	{
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping idle check")));
+	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		bool lockFailure = false;
+		bool syncMetadata = ShouldInitiateMetadataSync(&lockFailure);
+
+		hasPendingWork = syncMetadata || lockFailure ||
+						 !CitusCatalogIsEmpty(DistTransactionRelationId()) ||
+						 !CitusCatalogIsEmpty(DistCleanupRelationId()) ||
+						 HasRunnableBackgroundTask();
+	}
+
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	return hasPendingWork;
+}
+
+
+/*
+ * CitusCatalogIsEmpty returns whether the given catalog table has no rows.
+ */
+static bool
+CitusCatalogIsEmpty(Oid relationId)
+{
+	Relation relation = table_open(relationId, AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan(relation, InvalidOid, false,
+													NULL, 0, NULL);
+
+	bool isEmpty = !HeapTupleIsValid(systable_getnext(scanDescriptor));
+
+	systable_endscan(scanDescriptor);
+	table_close(relation, AccessShareLock);
+
+	return isEmpty;
+}
+
+
+/*
+ * DeregisterIdleMaintenanceDaemon marks the maintenance daemon of the database
+ * as stopped if there are still no other backends in the database, such that
+ * the next backend that uses Citus starts a new one. Backends are in the proc
+ * array before they call InitializeMaintenanceDaemonBackend, hence checking
+ * under the lock ensures that none of them relies on the exiting daemon.
+ */
+static bool
+DeregisterIdleMaintenanceDaemon(MaintenanceDaemonDBData *dbData)
+{
+	bool deregistered = false;
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	if (CountDBBackends(dbData->databaseOid) <= 1)
+	{
+		dbData->daemonStarted = false;
+		dbData->workerPid = 0;
+		dbData->latch = NULL;
+		deregistered = true;
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	return deregistered;
+}
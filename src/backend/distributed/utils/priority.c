@@ -1,7 +1,7 @@
 /*-------------------------------------------------------------------------
  *
  * priority.c
- *	  Utilities for managing CPU priority.
+ *	  Utilities for managing CPU and I/O priority.
  *
  * Copyright (c) Citus Data, Inc.
  *-------------------------------------------------------------------------
@@ -14,12 +14,37 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(SYS_ioprio_set) && defined(SYS_ioprio_get)
+#define HAVE_IOPRIO
+#endif
 
 #include "distributed/priority.h"
 
 int CpuPriority = 0;
 int CpuPriorityLogicalRepSender = CPU_PRIORITY_INHERIT;
 int MaxHighPriorityBackgroundProcesess = 2;
+int IoPriority = IO_PRIORITY_INHERIT;
+int IoPriorityBackgroundOperations = IO_PRIORITY_INHERIT;
+int IoPriorityLogicalRepSender = IO_PRIORITY_INHERIT;
+
+#ifdef HAVE_IOPRIO
+
+/* see ioprio_set(2), glibc does not provide these */
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_PRIO_VALUE(ioClass, data) (((ioClass) << IOPRIO_CLASS_SHIFT) | (data))
+
+/* I/O priority of the backend before we first changed it, or -1 */
+static int OriginalIoPriorityValue = -1;
+
+static int IoPriorityValue(int ioPriority);
+#endif
 
 
 /*
@@ -70,3 +95,86 @@ GetOwnPriority(void)
 	}
 	return result;
 }
+
+
+/*
+ * SetOwnIoPriority changes the I/O priority of the current backend, which
+ * Linux I/O schedulers such as BFQ take into account. IO_PRIORITY_INHERIT
+ * restores the priority that the backend had before we changed it. If the OS
+ * disallows the change, or does not support I/O priorities, we only warn
+ * about it.
+ */
+void
+SetOwnIoPriority(int ioPriority)
+{
+#ifdef HAVE_IOPRIO
+	if (OriginalIoPriorityValue == -1)
+	{
+		if (ioPriority == IO_PRIORITY_INHERIT)
+		{
+			/* we never changed the priority */
+			return;
+		}
+
+		OriginalIoPriorityValue = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+		if (OriginalIoPriorityValue == -1)
+		{
+			ereport(WARNING, (errmsg("could not get current io priority: %m")));
+			return;
+		}
+	}
+
+	int ioPriorityValue = ioPriority == IO_PRIORITY_INHERIT ?
+						  OriginalIoPriorityValue :
+						  IoPriorityValue(ioPriority);
+
+	if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioPriorityValue) == -1)
+	{
+		ereport(WARNING, (errmsg("could not set io priority: %m")));
+	}
+#else
+	if (ioPriority != IO_PRIORITY_INHERIT)
+	{
+		ereport(WARNING, (errmsg("io priorities are not supported on this "
+								 "platform")));
+	}
+#endif
+}
+
+
+#ifdef HAVE_IOPRIO
+
+/*
+ * IoPriorityValue returns the ioprio_set value for the given I/O priority.
+ * The levels of the best-effort class go from 0, the highest, to 7.
+ */
+static int
+IoPriorityValue(int ioPriority)
+{
+	switch (ioPriority)
+	{
+		case IO_PRIORITY_HIGH:
+		{
+			return IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE, 0);
+		}
+
+		case IO_PRIORITY_LOW:
+		{
+			return IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE, 7);
+		}
+
+		case IO_PRIORITY_IDLE:
+		{
+			return IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0);
+		}
+
+		case IO_PRIORITY_NORMAL:
+		default:
+		{
+			return IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE, 4);
+		}
+	}
+}
+
+
+#endif
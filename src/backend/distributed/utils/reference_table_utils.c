@@ -41,10 +41,9 @@
 
 /* local function forward declarations */
 static List * WorkersWithoutReferenceTablePlacement(uint64 shardId, LOCKMODE lockMode);
-static StringInfo CopyShardPlacementToWorkerNodeQuery(
-	ShardPlacement *sourceShardPlacement,
-	WorkerNode *workerNode,
-	char transferMode);
+static StringInfo CopyReferenceTablesToNodesQuery(uint64 shardId,
+												  List *workerNodeList,
+												  char transferMode);
 static bool AnyRelationsModifiedInTransaction(List *relationIdList);
 static List * ReplicatedMetadataSyncedDistributedTableList(void);
 static bool NodeHasAllReferenceTableReplicas(WorkerNode *workerNode);
@@ -190,9 +189,9 @@ EnsureReferenceTablesExistOnAllNodesExtended(char transferMode)
 	}
 
 	/*
-	 * citus_copy_shard_placement triggers metadata sync-up, which tries to
-	 * acquire a ShareLock on pg_dist_node. We do master_copy_shad_placement
-	 * in a separate connection. If we have modified pg_dist_node in the
+	 * citus_internal_copy_reference_tables triggers metadata sync-up, which
+	 * tries to acquire a ShareLock on pg_dist_node. We do the copy in a
+	 * separate connection. If we have modified pg_dist_node in the
 	 * current backend, this will cause a deadlock.
 	 */
 	if (TransactionModifiedNodeMetadata)
@@ -204,7 +203,8 @@ EnsureReferenceTablesExistOnAllNodesExtended(char transferMode)
 
 	/*
 	 * Modifications to reference tables in current transaction are not visible
-	 * to citus_copy_shard_placement, since it is done in a separate backend.
+	 * to citus_internal_copy_reference_tables, since it is done in a separate
+	 * backend.
 	 */
 	if (AnyRelationsModifiedInTransaction(referenceTableIdList))
 	{
@@ -213,68 +213,57 @@ EnsureReferenceTablesExistOnAllNodesExtended(char transferMode)
 							   "that modified a reference table")));
 	}
 
-	bool missingOk = false;
-	ShardPlacement *sourceShardPlacement = ActiveShardPlacement(shardId, missingOk);
-	if (sourceShardPlacement == NULL)
-	{
-		/* check for corrupt metadata */
-		ereport(ERROR, (errmsg("reference table shard "
-							   UINT64_FORMAT
-							   " does not have an active shard placement",
-							   shardId)));
-	}
-
 	WorkerNode *newWorkerNode = NULL;
 	foreach_ptr(newWorkerNode, newWorkersList)
 	{
 		ereport(NOTICE, (errmsg("replicating reference table '%s' to %s:%d ...",
 								referenceTableName, newWorkerNode->workerName,
 								newWorkerNode->workerPort)));
+	}
 
-		/*
-		 * Call citus_copy_shard_placement using citus extension owner. Current
-		 * user might not have permissions to do the copy.
-		 */
-		const char *userName = CitusExtensionOwnerName();
-		int connectionFlags = OUTSIDE_TRANSACTION;
+	/*
+	 * Call citus_internal_copy_reference_tables using citus extension owner.
+	 * Current user might not have permissions to do the copy. It copies the
+	 * reference tables to all new nodes at once, reading from different source
+	 * placements.
+	 */
+	const char *userName = CitusExtensionOwnerName();
+	int connectionFlags = OUTSIDE_TRANSACTION;
 
-		MultiConnection *connection = GetNodeUserDatabaseConnection(
-			connectionFlags, LocalHostName, PostPortNumber,
-			userName, NULL);
+	MultiConnection *connection = GetNodeUserDatabaseConnection(
+		connectionFlags, LocalHostName, PostPortNumber,
+		userName, NULL);
 
-		if (PQstatus(connection->pgConn) == CONNECTION_OK)
-		{
-			UseCoordinatedTransaction();
+	if (PQstatus(connection->pgConn) == CONNECTION_OK)
+	{
+		UseCoordinatedTransaction();
 
-			RemoteTransactionBegin(connection);
-			StringInfo placementCopyCommand =
-				CopyShardPlacementToWorkerNodeQuery(sourceShardPlacement,
-													newWorkerNode,
-													transferMode);
+		RemoteTransactionBegin(connection);
+		StringInfo placementCopyCommand =
+			CopyReferenceTablesToNodesQuery(shardId, newWorkersList, transferMode);
 
-			/*
-			 * The placement copy command uses distributed execution to copy
-			 * the shard. This is allowed when indicating that the backend is a
-			 * rebalancer backend.
-			 */
-			ExecuteCriticalRemoteCommand(connection,
-										 "SET LOCAL application_name TO "
-										 CITUS_REBALANCER_NAME);
-			ExecuteCriticalRemoteCommand(connection, placementCopyCommand->data);
-			RemoteTransactionCommit(connection);
-		}
-		else
-		{
-			ereport(ERROR, (errmsg("could not open a connection to localhost "
-								   "when replicating reference tables"),
-							errdetail(
-								"citus.replicate_reference_tables_on_activate = false "
-								"requires localhost connectivity.")));
-		}
-
-		CloseConnection(connection);
+		/*
+		 * The placement copy command uses distributed execution to copy
+		 * the shard. This is allowed when indicating that the backend is a
+		 * rebalancer backend.
+		 */
+		ExecuteCriticalRemoteCommand(connection,
+									 "SET LOCAL application_name TO "
+									 CITUS_REBALANCER_NAME);
+		ExecuteCriticalRemoteCommand(connection, placementCopyCommand->data);
+		RemoteTransactionCommit(connection);
+	}
+	else
+	{
+		ereport(ERROR, (errmsg("could not open a connection to localhost "
+							   "when replicating reference tables"),
+						errdetail(
+							"citus.replicate_reference_tables_on_activate = false "
+							"requires localhost connectivity.")));
 	}
 
+	CloseConnection(connection);
+
 	/*
 	 * Since reference tables have been copied via a loopback connection we do not have to
 	 * retain our locks. Since Citus only runs well in READ COMMITTED mode we can be sure
@@ -402,30 +391,35 @@ WorkersWithoutReferenceTablePlacement(uint64 shardId, LOCKMODE lockMode)
 
 
 /*
- * CopyShardPlacementToWorkerNodeQuery returns the citus_copy_shard_placement
- * command to copy the given shard placement to given node.
+ * CopyReferenceTablesToNodesQuery returns the citus_internal_copy_reference_tables
+ * command to copy the reference tables to the given worker nodes.
  */
 static StringInfo
-CopyShardPlacementToWorkerNodeQuery(ShardPlacement *sourceShardPlacement,
-									WorkerNode *workerNode,
-									char transferMode)
+CopyReferenceTablesToNodesQuery(uint64 shardId, List *workerNodeList, char transferMode)
 {
 	StringInfo queryString = makeStringInfo();
+	StringInfo nodeIdArrayString = makeStringInfo();
 
 	const char *transferModeString =
 		transferMode == TRANSFER_MODE_BLOCK_WRITES ? "block_writes" :
 		transferMode == TRANSFER_MODE_FORCE_LOGICAL ? "force_logical" :
 		"auto";
 
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		if (nodeIdArrayString->len > 0)
+		{
+			appendStringInfoChar(nodeIdArrayString, ',');
+		}
+
+		appendStringInfo(nodeIdArrayString, "%d", workerNode->nodeId);
+	}
+
 	appendStringInfo(queryString,
-					 "SELECT citus_copy_shard_placement("
-					 UINT64_FORMAT ", %s, %d, %s, %d, "
-								   "transfer_mode := %s)",
-					 sourceShardPlacement->shardId,
-					 quote_literal_cstr(sourceShardPlacement->nodeName),
-					 sourceShardPlacement->nodePort,
-					 quote_literal_cstr(workerNode->workerName),
-					 workerNode->workerPort,
+					 "SELECT pg_catalog.citus_internal_copy_reference_tables("
+					 UINT64_FORMAT ", ARRAY[%s]::int[], transfer_mode := %s)",
+					 shardId, nodeIdArrayString->data,
 					 quote_literal_cstr(transferModeString));
 
 	return queryString;
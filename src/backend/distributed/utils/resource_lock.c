@@ -20,6 +20,7 @@
 #include "access/xact.h"
 #include "catalog/namespace.h"
 #include "commands/tablecmds.h"
+#include "distributed/citus_safe_lib.h"
 #include "distributed/colocation_utils.h"
 #include "distributed/commands.h"
 #include "distributed/listutils.h"
@@ -93,6 +94,11 @@ static void LockReferencedReferenceShardResources(uint64 shardId, LOCKMODE lockM
 static bool AnyTableReplicated(List *shardIntervalList,
 							   List **replicatedShardIntervalList);
 static void LockShardListResources(List *shardIntervalList, LOCKMODE lockMode);
+static void LockShardListResourcesByColocationGroup(List *shardIntervalList,
+													LOCKMODE lockMode);
+static void LockShardResourceInternal(uint64 shardId, LOCKMODE lockmode);
+static uint32 ShardResourceColocationId(uint64 shardId);
+static void LockColocatedShardResources(uint32 colocationId, LOCKMODE lockMode);
 static void LockShardListResourcesOnFirstWorker(LOCKMODE lockmode,
 												List *shardIntervalList);
 static bool IsFirstWorkerNode();
@@ -111,6 +117,12 @@ PG_FUNCTION_INFO_V1(lock_relation_if_exists);
 bool EnableAcquiringUnsafeLockFromWorkers = false;
 bool SkipAdvisoryLockPermissionChecks = false;
 
+/*
+ * GUC, number of shards of a co-location group in a single lock request from
+ * which one lock on the co-location group replaces the shard locks, 0 to disable
+ */
+int CoarseShardLockThreshold = 0;
+
 
 /*
  * lock_shard_metadata allows the shard distribution metadata to be locked
@@ -652,6 +664,27 @@ GetSortedReferenceShardIntervals(List *relationList)
  */
 void
 LockShardResource(uint64 shardId, LOCKMODE lockmode)
+{
+	if (CoarseShardLockThreshold > 0)
+	{
+		uint32 colocationId = ShardResourceColocationId(shardId);
+		if (colocationId != INVALID_COLOCATION_ID)
+		{
+			/* announce the shard lock on the co-location group, see below */
+			LockColocatedShardResources(colocationId, RowExclusiveLock);
+		}
+	}
+
+	LockShardResourceInternal(shardId, lockmode);
+}
+
+
+/*
+ * LockShardResourceInternal acquires the resource lock of a single shard,
+ * without taking the intention lock on its co-location group.
+ */
+static void
+LockShardResourceInternal(uint64 shardId, LOCKMODE lockmode)
 {
 	LOCKTAG tag;
 	const bool sessionLock = false;
@@ -663,6 +696,48 @@ LockShardResource(uint64 shardId, LOCKMODE lockmode)
 }
 
 
+/*
+ * ShardResourceColocationId returns the co-location id of the table of the
+ * given shard, or INVALID_COLOCATION_ID if the shard is not in the metadata,
+ * as for shard resource locks taken on workers without metadata.
+ */
+static uint32
+ShardResourceColocationId(uint64 shardId)
+{
+	if (!ShardExists(shardId))
+	{
+		return INVALID_COLOCATION_ID;
+	}
+
+	Oid relationId = RelationIdForShard(shardId);
+
+	return TableColocationId(relationId);
+}
+
+
+/*
+ * LockColocatedShardResources acquires the lock that stands for the shard
+ * resource locks of all shards in a co-location group.
+ *
+ * When citus.coarse_shard_lock_threshold is set, every shard resource lock is
+ * preceded by a RowExclusiveLock on the co-location group of the shard. A lock
+ * request for many shards of a group in a mode that conflicts with it can then
+ * be served by a single lock on the group in that mode, which conflicts with
+ * all concurrent shard lockers of the group, instead of one lock per shard.
+ */
+static void
+LockColocatedShardResources(uint32 colocationId, LOCKMODE lockMode)
+{
+	LOCKTAG tag;
+	const bool sessionLock = false;
+	const bool dontWait = false;
+
+	SET_LOCKTAG_COLOCATED_SHARD_RESOURCES(tag, MyDatabaseId, colocationId);
+
+	(void) LockAcquire(&tag, lockMode, sessionLock, dontWait);
+}
+
+
 /* LockTransactionRecovery acquires a lock for transaction recovery */
 void
 LockTransactionRecovery(LOCKMODE lockmode)
@@ -822,6 +897,12 @@ LockShardListResources(List *shardIntervalList, LOCKMODE lockMode)
 	/* lock shards in order of shard id to prevent deadlock */
 	shardIntervalList = SortList(shardIntervalList, CompareShardIntervalsById);
 
+	if (CoarseShardLockThreshold > 0)
+	{
+		LockShardListResourcesByColocationGroup(shardIntervalList, lockMode);
+		return;
+	}
+
 	ShardInterval *shardInterval = NULL;
 	foreach_ptr(shardInterval, shardIntervalList)
 	{
@@ -832,6 +913,88 @@ LockShardListResources(List *shardIntervalList, LOCKMODE lockMode)
 }
 
 
+/*
+ * LockShardListResourcesByColocationGroup takes locks on all shards in the
+ * sorted shardIntervalList, but locks co-location groups with at least
+ * citus.coarse_shard_lock_threshold shards in the list as a whole. This keeps
+ * multi-shard modifications from filling the lock table with one lock per
+ * shard.
+ *
+ * Only lock modes that conflict with the intention lock that is taken on the
+ * co-location group of every locked shard can be used for the whole group;
+ * weaker modes still lock the individual shards. Group locks are taken in
+ * order of co-location id, before any shard lock, to prevent deadlocks.
+ */
+static void
+LockShardListResourcesByColocationGroup(List *shardIntervalList, LOCKMODE lockMode)
+{
+	int shardCount = list_length(shardIntervalList);
+	Oid *colocationIdArray = palloc0(shardCount * sizeof(Oid));
+	Oid *sortedColocationIdArray = palloc0(shardCount * sizeof(Oid));
+	List *coarseColocationIdList = NIL;
+	int shardIndex = 0;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		colocationIdArray[shardIndex] =
+			ShardResourceColocationId(shardInterval->shardId);
+		sortedColocationIdArray[shardIndex] = colocationIdArray[shardIndex];
+		shardIndex++;
+	}
+
+	SafeQsort(sortedColocationIdArray, shardCount, sizeof(Oid), CompareOids);
+
+	int groupStartIndex = 0;
+	while (groupStartIndex < shardCount)
+	{
+		uint32 colocationId = sortedColocationIdArray[groupStartIndex];
+		int groupEndIndex = groupStartIndex + 1;
+
+		while (groupEndIndex < shardCount &&
+			   sortedColocationIdArray[groupEndIndex] == colocationId)
+		{
+			groupEndIndex++;
+		}
+
+		int groupShardCount = groupEndIndex - groupStartIndex;
+		groupStartIndex = groupEndIndex;
+
+		if (colocationId == INVALID_COLOCATION_ID)
+		{
+			continue;
+		}
+
+		if (groupShardCount >= CoarseShardLockThreshold && lockMode >= ShareLock)
+		{
+			LockColocatedShardResources(colocationId, lockMode);
+			coarseColocationIdList = lappend_oid(coarseColocationIdList, colocationId);
+		}
+		else
+		{
+			LockColocatedShardResources(colocationId, RowExclusiveLock);
+		}
+	}
+
+	shardIndex = 0;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		Oid colocationId = colocationIdArray[shardIndex];
+		shardIndex++;
+
+		if (list_member_oid(coarseColocationIdList, colocationId))
+		{
+			continue;
+		}
+
+		LockShardResourceInternal(shardInterval->shardId, lockMode);
+	}
+
+	pfree(colocationIdArray);
+	pfree(sortedColocationIdArray);
+}
+
+
 /*
  * LockRelationShardResources takes locks on all shards in a list of RelationShards
  * to prevent concurrent DML statements on those shards.
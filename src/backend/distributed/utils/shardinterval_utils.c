@@ -275,7 +275,7 @@ FindShardInterval(Datum partitionColumnValue, CitusTableCacheEntry *cacheEntry)
 		return NULL;
 	}
 
-	return cacheEntry->sortedShardIntervalArray[shardIndex];
+	return GetCachedShardInterval(cacheEntry, shardIndex);
 }
 
 
@@ -294,6 +294,7 @@ FindShardInterval(Datum partitionColumnValue, CitusTableCacheEntry *cacheEntry)
 int
 FindShardIntervalIndex(Datum searchedValue, CitusTableCacheEntry *cacheEntry)
 {
+	/* only searched if the hash distribution is not uniform, and thus not compact */
 	ShardInterval **shardIntervalCache = cacheEntry->sortedShardIntervalArray;
 	int shardCount = cacheEntry->shardIntervalArrayLength;
 	FmgrInfo *compareFunction = cacheEntry->shardIntervalCompareFunction;
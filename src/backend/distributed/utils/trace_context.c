@@ -0,0 +1,290 @@
+/*-------------------------------------------------------------------------
+ *
+ * trace_context.c
+ *	  Propagation of W3C trace contexts to the commands sent to workers.
+ *
+ * Clients that trace their queries can set citus.trace_context to the W3C
+ * traceparent of a statement. When citus.propagate_trace_context is on, the
+ * adaptive executor creates a child span for every task and sends it to the
+ * worker in a comment in front of the task query:
+ *
+ *   / * traceparent='00-<trace id>-<span id>-<flags>' * / SELECT ...
+ *
+ * The comment shows up in pg_stat_activity and the logs of the worker, and
+ * while the worker executes the task, citus.trace_context shows the child
+ * span. When a task finishes, CitusTraceSpanHook is called with its timing,
+ * such that external collectors can report the spans.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "lib/stringinfo.h"
+#include "utils/timestamp.h"
+
+#include "distributed/citus_safe_lib.h"
+#include "distributed/query_stats.h"
+#include "distributed/trace_context.h"
+
+
+/* offsets of the fields in a version 00 traceparent */
+#define TRACE_ID_OFFSET 3
+#define TRACE_ID_LENGTH 32
+#define SPAN_ID_OFFSET 36
+#define SPAN_ID_LENGTH 16
+#define TRACE_FLAGS_OFFSET 53
+
+
+/* hook for external collectors of the spans of tasks */
+CitusTraceSpanHookType CitusTraceSpanHook = NULL;
+
+/* GUC, W3C traceparent of the current statement */
+char *TraceContext = "";
+
+/* GUC, whether the trace context is sent to the workers */
+bool PropagateTraceContext = false;
+
+/* trace context that the current statement received from the coordinator */
+static char ReceivedTraceContext[TRACE_PARENT_LENGTH + 1] = "";
+
+
+static bool IsHexString(const char *string, int length);
+static bool IsAllZeros(const char *string, int length);
+
+
+/*
+ * IsValidTraceParent returns whether the given string is a version 00 W3C
+ * traceparent with a non-zero trace id and span id.
+ */
+bool
+IsValidTraceParent(const char *traceParent)
+{
+	if (strlen(traceParent) != TRACE_PARENT_LENGTH)
+	{
+		return false;
+	}
+
+	if (strncmp(traceParent, "00-", TRACE_ID_OFFSET) != 0 ||
+		traceParent[SPAN_ID_OFFSET - 1] != '-' ||
+		traceParent[TRACE_FLAGS_OFFSET - 1] != '-')
+	{
+		return false;
+	}
+
+	return IsHexString(traceParent + TRACE_ID_OFFSET, TRACE_ID_LENGTH) &&
+		   IsHexString(traceParent + SPAN_ID_OFFSET, SPAN_ID_LENGTH) &&
+		   IsHexString(traceParent + TRACE_FLAGS_OFFSET, 2) &&
+		   !IsAllZeros(traceParent + TRACE_ID_OFFSET, TRACE_ID_LENGTH) &&
+		   !IsAllZeros(traceParent + SPAN_ID_OFFSET, SPAN_ID_LENGTH);
+}
+
+
+/*
+ * IsHexString returns whether the first length characters of the given string
+ * are lower case hexadecimal digits, as W3C trace contexts require.
+ */
+static bool
+IsHexString(const char *string, int length)
+{
+	for (int charIndex = 0; charIndex < length; charIndex++)
+	{
+		char character = string[charIndex];
+
+		if (!((character >= '0' && character <= '9') ||
+			  (character >= 'a' && character <= 'f')))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * IsAllZeros returns whether the first length characters of the given string
+ * are all zeros, which W3C trace contexts consider invalid ids.
+ */
+static bool
+IsAllZeros(const char *string, int length)
+{
+	for (int charIndex = 0; charIndex < length; charIndex++)
+	{
+		if (string[charIndex] != '0')
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ShouldPropagateTraceContext returns whether the tasks of the current
+ * statement should carry a trace context to the workers.
+ */
+bool
+ShouldPropagateTraceContext(void)
+{
+	return PropagateTraceContext && CurrentTraceContext()[0] != '\0';
+}
+
+
+/*
+ * CreateChildTraceParent returns a traceparent with the trace id and flags of
+ * the current trace context and a new, random span id.
+ */
+char *
+CreateChildTraceParent(void)
+{
+	const char *parentTraceParent = CurrentTraceContext();
+	uint8 spanId[SPAN_ID_LENGTH / 2];
+
+	if (!pg_strong_random(spanId, sizeof(spanId)))
+	{
+		/* unlikely, but a colliding span id is better than failing the query */
+		uint64 fallbackSpanId = ((uint64) MyProcPid << 32) ^ GetCurrentTimestamp();
+		memcpy_s(spanId, sizeof(spanId), &fallbackSpanId, sizeof(fallbackSpanId));
+	}
+
+	StringInfo traceParent = makeStringInfo();
+	appendBinaryStringInfo(traceParent, parentTraceParent, SPAN_ID_OFFSET);
+
+	for (int byteIndex = 0; byteIndex < (int) sizeof(spanId); byteIndex++)
+	{
+		appendStringInfo(traceParent, "%02x", spanId[byteIndex]);
+	}
+
+	appendStringInfoString(traceParent, parentTraceParent + SPAN_ID_OFFSET +
+						   SPAN_ID_LENGTH);
+
+	return traceParent->data;
+}
+
+
+/*
+ * QueryStringWithTraceParent returns the given task query string, prefixed
+ * with a comment that carries the given traceparent to the worker.
+ */
+char *
+QueryStringWithTraceParent(const char *traceParent, const char *queryString)
+{
+	return psprintf(TRACE_PARENT_COMMENT_PREFIX "%s' */ %s", traceParent, queryString);
+}
+
+
+/*
+ * ReportTraceSpan passes the span of a finished task to CitusTraceSpanHook,
+ * if an external collector installed it.
+ */
+void
+ReportTraceSpan(const char *traceParent, const char *nodeName, int nodePort,
+				uint64 shardId, double durationMillisecs, bool succeeded)
+{
+	if (CitusTraceSpanHook == NULL)
+	{
+		return;
+	}
+
+	CitusTraceSpanHook(traceParent, CurrentTraceContext(), nodeName, nodePort,
+					   shardId, durationMillisecs, succeeded);
+}
+
+
+/*
+ * SetReceivedTraceContext remembers the trace context that the given query
+ * string of a task carries in its leading comments, such that
+ * citus.trace_context shows it while the task runs. The function returns
+ * whether the query string carries a trace context.
+ */
+bool
+SetReceivedTraceContext(const char *queryString)
+{
+	if (queryString == NULL)
+	{
+		return false;
+	}
+
+	/* the query identifier comment, if any, comes first */
+	if (CitusQueryIdFromQueryString(queryString) != 0)
+	{
+		const char *commentEnd = strstr(queryString, "*/ ");
+		if (commentEnd == NULL)
+		{
+			return false;
+		}
+
+		queryString = commentEnd + 3;
+	}
+
+	int prefixLength = strlen(TRACE_PARENT_COMMENT_PREFIX);
+	if (strncmp(queryString, TRACE_PARENT_COMMENT_PREFIX, prefixLength) != 0)
+	{
+		return false;
+	}
+
+	const char *traceParent = queryString + prefixLength;
+	if (strnlen(traceParent, TRACE_PARENT_LENGTH + 1) <= TRACE_PARENT_LENGTH ||
+		traceParent[TRACE_PARENT_LENGTH] != '\'')
+	{
+		return false;
+	}
+
+	strlcpy(ReceivedTraceContext, traceParent, TRACE_PARENT_LENGTH + 1);
+
+	if (!IsValidTraceParent(ReceivedTraceContext))
+	{
+		ReceivedTraceContext[0] = '\0';
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * ResetReceivedTraceContext forgets the trace context of the task that just
+ * finished.
+ */
+void
+ResetReceivedTraceContext(void)
+{
+	ReceivedTraceContext[0] = '\0';
+}
+
+
+/*
+ * CurrentTraceContext returns the trace context of the current statement,
+ * which is the one received from the coordinator while running a task, and
+ * otherwise citus.trace_context.
+ */
+const char *
+CurrentTraceContext(void)
+{
+	if (ReceivedTraceContext[0] != '\0')
+	{
+		return ReceivedTraceContext;
+	}
+
+	return TraceContext != NULL ? TraceContext : "";
+}
+
+
+/*
+ * TraceContextErrorCallback adds the trace context that the current task
+ * received from the coordinator to the context of errors, such that they can
+ * be correlated with the trace of the distributed statement.
+ */
+void
+TraceContextErrorCallback(void *arg)
+{
+	if (ReceivedTraceContext[0] != '\0')
+	{
+		errcontext("traceparent %s", ReceivedTraceContext);
+	}
+}
@@ -24,7 +24,10 @@
 #include "distributed/worker_shard_visibility.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/syscache.h"
 #include "utils/varlena.h"
 
@@ -37,9 +40,30 @@ typedef enum HideShardsMode
 	DO_NOT_HIDE_SHARDS
 } HideShardsMode;
 
+/*
+ * KnownShardCacheEntry caches whether a relation is a known shard, as
+ * returned by RelationIsAKnownShard.
+ */
+typedef struct KnownShardCacheEntry
+{
+	Oid relationId;
+	bool isKnownShard;
+} KnownShardCacheEntry;
+
+/*
+ * KnownShardCacheDependency lists the relations whose cached result depends
+ * on the relation with the given OID.
+ */
+typedef struct KnownShardCacheDependency
+{
+	Oid relationId;
+	List *dependentRelationIds;
+} KnownShardCacheDependency;
+
 /* Config variable managed via guc.c */
 bool OverrideTableVisibility = true;
 bool EnableManualChangesToShards = false;
+bool EnableKnownShardCache = false;
 
 /* show shards when the application_name starts with one of: */
 char *ShowShardsForAppNamePrefixes = "";
@@ -47,7 +71,32 @@ char *ShowShardsForAppNamePrefixes = "";
 /* cache of whether or not to hide shards */
 static HideShardsMode HideShards = CHECK_APPLICATION_NAME;
 
+/* per-backend cache of whether relations are known shards */
+static HTAB *KnownShardCache = NULL;
+static MemoryContext KnownShardCacheContext = NULL;
+
+/*
+ * Relations other than the cached ones whose changes can change cached results,
+ * namely the distributed tables of cached shards and the tables of cached
+ * indexes, each with the list of cached relations that depend on it.
+ */
+static HTAB *KnownShardCacheDependencies = NULL;
+
+/* pg_dist_shard, whose changes mark the whole cache as outdated */
+static Oid KnownShardCacheDistShardRelationId = InvalidOid;
+
+/* whether KnownShardCache reflects the current catalogs */
+static bool KnownShardCacheValid = false;
+
+/* number of invalidations seen, to detect those that arrive during a lookup */
+static uint64 KnownShardCacheInvalidationCount = 0;
+
 static bool ShouldHideShards(void);
+static bool RelationIsAKnownShardInternal(Oid shardRelationId, Oid *indexedRelationId,
+										  Oid *distributedRelationId, bool *cacheable);
+static void InitializeKnownShardCache(void);
+static void AddKnownShardCacheDependency(Oid relationId, Oid dependentRelationId);
+static void InvalidateKnownShardCacheCallback(Datum argument, Oid relationId);
 static bool ShouldHideShardsInternal(void);
 static bool IsPgBgWorker(void);
 static bool FilterShardsFromPgclass(Node *node, void *context);
@@ -178,12 +227,18 @@ ErrorIfIllegallyChangingKnownShard(Oid relationId)
 /*
  * RelationIsAKnownShard gets a relationId, check whether it's a shard of
  * any distributed table.
+ *
+ * Filtering pg_class calls this for every relation, so with
+ * citus.enable_known_shard_cache the results are cached in the backend until
+ * the relation, or one of the relations the result depends on, changes.
  */
 bool
 RelationIsAKnownShard(Oid shardRelationId)
 {
-	bool missingOk = true;
-	char relKind = '\0';
+	Oid indexedRelationId = InvalidOid;
+	Oid distributedRelationId = InvalidOid;
+	bool cacheable = false;
+	bool found = false;
 
 	if (!OidIsValid(shardRelationId))
 	{
@@ -207,6 +262,64 @@ RelationIsAKnownShard(Oid shardRelationId)
 		}
 	}
 
+	if (!EnableKnownShardCache)
+	{
+		return RelationIsAKnownShardInternal(shardRelationId, &indexedRelationId,
+											 &distributedRelationId, &cacheable);
+	}
+
+	if (!KnownShardCacheValid)
+	{
+		InitializeKnownShardCache();
+	}
+
+	KnownShardCacheEntry *entry = hash_search(KnownShardCache, &shardRelationId,
+											  HASH_FIND, &found);
+	if (found)
+	{
+		return entry->isKnownShard;
+	}
+
+	uint64 invalidationCount = KnownShardCacheInvalidationCount;
+
+	bool isKnownShard = RelationIsAKnownShardInternal(shardRelationId,
+													  &indexedRelationId,
+													  &distributedRelationId,
+													  &cacheable);
+
+	/* do not cache results that might have been changed by an invalidation */
+	if (!cacheable || !KnownShardCacheValid ||
+		invalidationCount != KnownShardCacheInvalidationCount)
+	{
+		return isKnownShard;
+	}
+
+	AddKnownShardCacheDependency(indexedRelationId, shardRelationId);
+	AddKnownShardCacheDependency(distributedRelationId, shardRelationId);
+
+	entry = hash_search(KnownShardCache, &shardRelationId, HASH_ENTER, &found);
+	entry->isKnownShard = isKnownShard;
+
+	return isKnownShard;
+}
+
+
+/*
+ * RelationIsAKnownShardInternal implements RelationIsAKnownShard without the
+ * coordinator check. It also returns the table of the relation if the
+ * relation is an index, and the distributed table the relation was compared
+ * against, since the result depends on them. cacheable is set to false when
+ * the result could change without an invalidation of any of those relations.
+ */
+static bool
+RelationIsAKnownShardInternal(Oid shardRelationId, Oid *indexedRelationId,
+							  Oid *distributedRelationId, bool *cacheable)
+{
+	bool missingOk = true;
+	char relKind = '\0';
+
+	*cacheable = false;
+
 	/*
 	 * We do not take locks here, because that might block a query on pg_class.
 	 */
@@ -226,6 +339,7 @@ RelationIsAKnownShard(Oid shardRelationId)
 	if (relKind == RELKIND_INDEX || relKind == RELKIND_PARTITIONED_INDEX)
 	{
 		shardRelationId = IndexGetRelation(shardRelationId, false);
+		*indexedRelationId = shardRelationId;
 	}
 
 	/* get the shard's relation name */
@@ -238,6 +352,7 @@ RelationIsAKnownShard(Oid shardRelationId)
 		 * The format of the table name does not align with
 		 * our shard name definition.
 		 */
+		*cacheable = true;
 		return false;
 	}
 
@@ -245,10 +360,13 @@ RelationIsAKnownShard(Oid shardRelationId)
 	Oid relationId = LookupShardRelationFromCatalog(shardId, true);
 	if (!OidIsValid(relationId))
 	{
-		/* there is no such relation */
+		/* there is no such relation, but the shard might be added later */
 		return false;
 	}
 
+	*distributedRelationId = relationId;
+	*cacheable = true;
+
 	/* verify that their namespaces are the same */
 	if (get_rel_namespace(shardRelationId) != get_rel_namespace(relationId))
 	{
@@ -272,6 +390,122 @@ RelationIsAKnownShard(Oid shardRelationId)
 }
 
 
+/*
+ * InitializeKnownShardCache creates an empty known shard cache, or empties the
+ * existing one. The invalidation callback is registered on first use.
+ */
+static void
+InitializeKnownShardCache(void)
+{
+	HASHCTL info;
+
+	if (KnownShardCacheContext == NULL)
+	{
+		KnownShardCacheContext = AllocSetContextCreate(CacheMemoryContext,
+													   "Known Shard Cache",
+													   ALLOCSET_DEFAULT_SIZES);
+
+		CacheRegisterRelcacheCallback(InvalidateKnownShardCacheCallback, (Datum) 0);
+	}
+	else
+	{
+		MemoryContextReset(KnownShardCacheContext);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(KnownShardCacheEntry);
+	info.hcxt = KnownShardCacheContext;
+	int hashFlags = (HASH_ELEM | HASH_CONTEXT | HASH_BLOBS);
+
+	KnownShardCache = hash_create("Known Shard Cache", 1024, &info, hashFlags);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(KnownShardCacheDependency);
+	info.hcxt = KnownShardCacheContext;
+
+	KnownShardCacheDependencies = hash_create("Known Shard Cache Dependencies", 32,
+											  &info, hashFlags);
+
+	/* shards are looked up in pg_dist_shard */
+	KnownShardCacheDistShardRelationId = DistShardRelationId();
+
+	KnownShardCacheValid = true;
+}
+
+
+/*
+ * AddKnownShardCacheDependency records that the cached result of
+ * dependentRelationId depends on relationId, such that changes to relationId
+ * remove the cached result.
+ */
+static void
+AddKnownShardCacheDependency(Oid relationId, Oid dependentRelationId)
+{
+	bool found = false;
+
+	if (!OidIsValid(relationId))
+	{
+		return;
+	}
+
+	KnownShardCacheDependency *dependency =
+		hash_search(KnownShardCacheDependencies, &relationId, HASH_ENTER, &found);
+	if (!found)
+	{
+		dependency->dependentRelationIds = NIL;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(KnownShardCacheContext);
+	dependency->dependentRelationIds = lappend_oid(dependency->dependentRelationIds,
+												   dependentRelationId);
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * InvalidateKnownShardCacheCallback removes the cached result of a relation
+ * when the relation changes, along with the cached results that depend on the
+ * relation. Changes to pg_dist_shard and full relcache resets mark the whole
+ * cache as outdated, which empties it on next use.
+ */
+static void
+InvalidateKnownShardCacheCallback(Datum argument, Oid relationId)
+{
+	bool found = false;
+
+	KnownShardCacheInvalidationCount++;
+
+	if (!KnownShardCacheValid)
+	{
+		return;
+	}
+
+	if (relationId == InvalidOid || relationId == KnownShardCacheDistShardRelationId)
+	{
+		KnownShardCacheValid = false;
+		return;
+	}
+
+	hash_search(KnownShardCache, &relationId, HASH_REMOVE, NULL);
+
+	KnownShardCacheDependency *dependency =
+		hash_search(KnownShardCacheDependencies, &relationId, HASH_FIND, &found);
+	if (found)
+	{
+		Oid dependentRelationId = InvalidOid;
+		foreach_oid(dependentRelationId, dependency->dependentRelationIds)
+		{
+			hash_search(KnownShardCache, &dependentRelationId, HASH_REMOVE, NULL);
+		}
+
+		list_free(dependency->dependentRelationIds);
+		hash_search(KnownShardCacheDependencies, &relationId, HASH_REMOVE, NULL);
+	}
+}
+
+
 /*
  * HideShardsFromSomeApplications transforms queries to pg_class to
  * filter out known shards if the application_name does not match any of
@@ -14,6 +14,8 @@
 #include "pgstat.h"
 
 #include "distributed/commands/multi_copy.h"
+#include "distributed/intermediate_result_column_batches.h"
+#include "distributed/intermediate_result_compression.h"
 #include "distributed/multi_executor.h"
 #include "distributed/transmit.h"
 #include "distributed/version_compat.h"
@@ -50,6 +52,13 @@ typedef struct TaskFileDestReceiver
 	CopyOutState copyOutState;
 	FmgrInfo *columnOutputFunctions;
 
+	/* set when rows are written in column batches instead of COPY format */
+	ColumnBatchWriter *columnBatchWriter;
+
+	/* compression of the file, see intermediate_result_compression.c */
+	IntermediateResultCompressionType compressionType;
+	StringInfo compressedData;
+
 	/* statistics */
 	uint64 tuplesSent;
 	uint64 bytesSent;
@@ -60,6 +69,7 @@ static void TaskFileDestReceiverStartup(DestReceiver *dest, int operation,
 										TupleDesc inputTupleDescriptor);
 static bool TaskFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
 static void WriteToLocalFile(StringInfo copyData, TaskFileDestReceiver *taskFileDest);
+static void WriteBytesToLocalFile(StringInfo data, TaskFileDestReceiver *taskFileDest);
 static void TaskFileDestReceiverShutdown(DestReceiver *destReceiver);
 static void TaskFileDestReceiverDestroy(DestReceiver *destReceiver);
 
@@ -148,7 +158,23 @@ TaskFileDestReceiverStartup(DestReceiver *dest, int operation,
 														   fileFlags,
 														   fileMode));
 
-	if (copyOutState->binary)
+	taskFileDest->compressionType = IntermediateResultCompression;
+	if (taskFileDest->compressionType != INTERMEDIATE_RESULT_COMPRESSION_NONE)
+	{
+		/* the signature tells readers that the file is compressed */
+		taskFileDest->compressedData = makeStringInfo();
+		AppendCompressedResultHeader(taskFileDest->compressedData);
+		WriteBytesToLocalFile(taskFileDest->compressedData, taskFileDest);
+	}
+
+	if (EnableColumnBatchedIntermediateResults)
+	{
+		/* write the description of the columns when using column batches */
+		taskFileDest->columnBatchWriter = CreateColumnBatchWriter(inputTupleDescriptor);
+		AppendColumnBatchHeader(taskFileDest->columnBatchWriter,
+								copyOutState->fe_msgbuf);
+	}
+	else if (copyOutState->binary)
 	{
 		/* write headers when using binary encoding */
 		AppendCopyBinaryHeaders(copyOutState);
@@ -183,9 +209,21 @@ TaskFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 	Datum *columnValues = slot->tts_values;
 	bool *columnNulls = slot->tts_isnull;
 
-	/* construct row in COPY format */
-	AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-					  copyOutState, columnOutputFunctions, NULL);
+	if (taskFileDest->columnBatchWriter != NULL)
+	{
+		/* add row to the current batch, and append the batch once it is full */
+		if (ColumnBatchWriterAddRow(taskFileDest->columnBatchWriter, columnValues,
+									columnNulls))
+		{
+			AppendColumnBatch(taskFileDest->columnBatchWriter, copyData);
+		}
+	}
+	else
+	{
+		/* construct row in COPY format */
+		AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
+						  copyOutState, columnOutputFunctions, NULL);
+	}
 
 	if (copyData->len > COPY_BUFFER_SIZE)
 	{
@@ -204,13 +242,35 @@ TaskFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 
 
 /*
- * WriteToLocalResultsFile writes the bytes in a StringInfo to a local file.
+ * WriteToLocalFile writes the COPY data in a StringInfo to a local file,
+ * compressing it first if the file is compressed.
  */
 static void
 WriteToLocalFile(StringInfo copyData, TaskFileDestReceiver *taskFileDest)
 {
-	int bytesWritten = FileWriteCompat(&taskFileDest->fileCompat, copyData->data,
-									   copyData->len, PG_WAIT_IO);
+	if (taskFileDest->compressionType == INTERMEDIATE_RESULT_COMPRESSION_NONE)
+	{
+		WriteBytesToLocalFile(copyData, taskFileDest);
+		return;
+	}
+
+	StringInfo compressedData = taskFileDest->compressedData;
+
+	resetStringInfo(compressedData);
+	AppendCompressedResultFrame(compressedData, copyData->data, copyData->len,
+								taskFileDest->compressionType);
+	WriteBytesToLocalFile(compressedData, taskFileDest);
+}
+
+
+/*
+ * WriteBytesToLocalFile writes the bytes in a StringInfo to a local file.
+ */
+static void
+WriteBytesToLocalFile(StringInfo data, TaskFileDestReceiver *taskFileDest)
+{
+	int bytesWritten = FileWriteCompat(&taskFileDest->fileCompat, data->data,
+									   data->len, PG_WAIT_IO);
 	if (bytesWritten < 0)
 	{
 		ereport(ERROR, (errcode_for_file_access(),
@@ -232,16 +292,20 @@ TaskFileDestReceiverShutdown(DestReceiver *destReceiver)
 	TaskFileDestReceiver *taskFileDest = (TaskFileDestReceiver *) destReceiver;
 	CopyOutState copyOutState = taskFileDest->copyOutState;
 
-	if (copyOutState->fe_msgbuf->len > 0)
+	if (taskFileDest->columnBatchWriter != NULL)
 	{
-		WriteToLocalFile(copyOutState->fe_msgbuf, taskFileDest);
-		resetStringInfo(copyOutState->fe_msgbuf);
+		/* write the last batch and the trailer when using column batches */
+		AppendColumnBatch(taskFileDest->columnBatchWriter, copyOutState->fe_msgbuf);
+		AppendColumnBatchTrailer(copyOutState->fe_msgbuf);
 	}
-
-	if (copyOutState->binary)
+	else if (copyOutState->binary)
 	{
 		/* write footers when using binary encoding */
 		AppendCopyBinaryFooters(copyOutState);
+	}
+
+	if (copyOutState->fe_msgbuf->len > 0)
+	{
 		WriteToLocalFile(copyOutState->fe_msgbuf, taskFileDest);
 		resetStringInfo(copyOutState->fe_msgbuf);
 	}
@@ -13,9 +13,11 @@
 #define COLUMNAR_H
 #include "postgres.h"
 
+#include "access/tableam.h"
 #include "fmgr.h"
 #include "lib/stringinfo.h"
 #include "nodes/parsenodes.h"
+#include "port/atomics.h"
 #include "storage/bufpage.h"
 #include "storage/lockdefs.h"
 #include "storage/relfilenode.h"
@@ -23,6 +25,7 @@
 #include "utils/snapmgr.h"
 
 #include "columnar/columnar_compression.h"
+#include "columnar/columnar_encoding.h"
 #include "columnar/columnar_metadata.h"
 
 #define COLUMNAR_AM_NAME "columnar"
@@ -67,6 +70,12 @@ typedef struct ColumnarOptions
 	uint32 chunkRowCount;
 	CompressionType compressionType;
 	int compressionLevel;
+
+	/* comma separated names of the columns to build bloom filters for, or NULL */
+	char *bloomColumns;
+
+	/* comma separated names of the columns to sort the rows of stripes by, or NULL */
+	char *sortBy;
 } ColumnarOptions;
 
 
@@ -97,6 +106,10 @@ typedef struct ColumnChunkSkipNode
 
 	CompressionType valueCompressionType;
 	int valueCompressionLevel;
+	ColumnEncodingType valueEncodingType;
+
+	/* bloom filter of the values, if the column is in bloom_columns */
+	bytea *bloomFilter;
 } ColumnChunkSkipNode;
 
 
@@ -135,6 +148,12 @@ typedef struct ChunkData
 
 	/* valueBuffer keeps actual data for type-by-reference datums from valueArray. */
 	StringInfo *valueBufferArray;
+
+	/*
+	 * dictionaryArray[column] holds the distinct values of the column if its
+	 * chunk is dictionary encoded, and is NULL otherwise.
+	 */
+	ColumnChunkDictionary **dictionaryArray;
 } ChunkData;
 
 
@@ -142,7 +161,8 @@ typedef struct ChunkData
  * ColumnChunkBuffers represents a chunk of serialized data in a column.
  * valueBuffer stores the serialized values of data, and existsBuffer stores
  * serialized value of presence information. valueCompressionType contains
- * compression type if valueBuffer is compressed. Finally rowCount has
+ * compression type if valueBuffer is compressed, and valueEncodingType the
+ * encoding of the values before compression. Finally rowCount has
  * the number of rows in this chunk.
  */
 typedef struct ColumnChunkBuffers
@@ -150,7 +170,14 @@ typedef struct ColumnChunkBuffers
 	StringInfo existsBuffer;
 	StringInfo valueBuffer;
 	CompressionType valueCompressionType;
+	ColumnEncodingType valueEncodingType;
 	uint64 decompressedValueSize;
+
+	/* key of the chunk in the shared chunk cache, or NULL if not cacheable */
+	struct ColumnarChunkCacheKey *cacheKey;
+
+	/* dictionary that the values were compressed with, or NULL */
+	bytea *compressionDictionary;
 } ColumnChunkBuffers;
 
 
@@ -172,9 +199,23 @@ typedef struct StripeBuffers
 	ColumnBuffers **columnBuffersArray;
 
 	uint32 *selectedChunkGroupRowCounts;
+
+	/* offset of the first row of each selected chunk group in the stripe */
+	uint64 *selectedChunkGroupRowOffsets;
 } StripeBuffers;
 
 
+/*
+ * Deleted rows of a stripe are kept in bitmaps with one bit per row of the
+ * stripe, in row number order.
+ */
+#define COLUMNAR_DELETION_BITMAP_SIZE(rowCount) (((rowCount) + 7) / 8)
+#define COLUMNAR_ROW_IS_DELETED(bitmap, rowOffset) \
+	(((bitmap)[(rowOffset) / 8] & (1 << ((rowOffset) % 8))) != 0)
+#define COLUMNAR_MARK_ROW_DELETED(bitmap, rowOffset) \
+	((bitmap)[(rowOffset) / 8] |= (1 << ((rowOffset) % 8)))
+
+
 /* return value of StripeWriteState to decide stripe write state */
 typedef enum StripeWriteStateEnum
 {
@@ -214,6 +255,16 @@ extern int columnar_compression;
 extern int columnar_stripe_row_limit;
 extern int columnar_chunk_group_row_limit;
 extern int columnar_compression_level;
+extern bool columnar_enable_column_encoding;
+extern bool columnar_enable_vectorized_filter;
+extern int columnar_chunk_cache_size;
+extern bool columnar_enable_chunk_cache;
+extern int columnar_stripe_skip_list_cache_size;
+extern bool columnar_stream_chunk_groups;
+extern bool columnar_enable_bulk_read_strategy;
+extern int columnar_compression_workers;
+extern int columnar_large_value_compression_threshold;
+extern int columnar_chunk_group_size_limit;
 
 /* called when the user changes options on the given relation */
 typedef void (*ColumnarTableSetOptions_hook_type)(Oid relid, ColumnarOptions options);
@@ -229,6 +280,10 @@ extern ColumnarWriteState * ColumnarBeginWrite(RelFileNode relfilenode,
 											   TupleDesc tupleDescriptor);
 extern uint64 ColumnarWriteRow(ColumnarWriteState *state, Datum *columnValues,
 							   bool *columnNulls);
+extern TM_Result ColumnarDeleteRow(ColumnarWriteState *state, Relation relation,
+								   uint64 rowNumber, Snapshot snapshot);
+extern bool ColumnarWriteStateDeletedRow(ColumnarWriteState *state, uint64 stripeId,
+										 uint64 rowOffset);
 extern void ColumnarFlushPendingWrites(ColumnarWriteState *state);
 extern void ColumnarEndWrite(ColumnarWriteState *state);
 extern bool ContainsPendingWrites(ColumnarWriteState *state);
@@ -243,7 +298,8 @@ extern ColumnarReadState * ColumnarBeginRead(Relation relation,
 											 List *qualConditions,
 											 MemoryContext scanContext,
 											 Snapshot snaphot,
-											 bool randomAccess);
+											 bool randomAccess,
+											 pg_atomic_uint64 *parallelStripeCounter);
 extern void ColumnarReadFlushPendingWrites(ColumnarReadState *readState);
 extern void ColumnarEndRead(ColumnarReadState *state);
 extern void ColumnarResetRead(ColumnarReadState *readState);
@@ -251,7 +307,13 @@ extern void ColumnarResetRead(ColumnarReadState *readState);
 /* functions only applicable for sequential access */
 extern bool ColumnarReadNextRow(ColumnarReadState *state, Datum *columnValues,
 								bool *columnNulls, uint64 *rowNumber);
+extern bool ColumnarReadNextChunkGroup(ColumnarReadState *readState,
+									   ChunkData **chunkGroupData, uint32 *rowCount);
+extern bool ColumnarReadNextStripeSkipList(ColumnarReadState *readState,
+										   StripeSkipList **stripeSkipList);
+extern bool ColumnarReadHasDeletedRows(ColumnarReadState *readState);
 extern int64 ColumnarReadChunkGroupsFiltered(ColumnarReadState *state);
+extern int64 ColumnarReadRowsFiltered(ColumnarReadState *state);
 extern void ColumnarRescan(ColumnarReadState *readState, List *scanQual);
 
 /* functions only applicable for random access */
@@ -277,9 +339,26 @@ extern void SetColumnarOptions(Oid regclass, ColumnarOptions *options);
 extern bool DeleteColumnarTableOptions(Oid regclass, bool missingOk);
 extern bool ReadColumnarOptions(Oid regclass, ColumnarOptions *options);
 extern bool IsColumnarTableAmTable(Oid relationId);
+extern List * ColumnarOptionColumnNameList(const char *optionName,
+											 const char *optionValue);
 
 /* columnar_metadata_tables.c */
 extern void DeleteMetadataRows(RelFileNode relfilenode);
+extern void DeleteStripeMetadata(RelFileNode relfilenode, uint64 stripeId);
+extern void InsertCompressionDictionary(RelFileNode relfilenode, AttrNumber attrNum,
+										bytea *dictionary);
+extern bytea * ReadCompressionDictionary(RelFileNode relfilenode, AttrNumber attrNum,
+										 uint32 dictionaryId);
+extern bytea ** ReadLatestCompressionDictionaries(RelFileNode relfilenode,
+												  uint32 columnCount);
+extern void CopyCompressionDictionaries(RelFileNode sourceRelfilenode,
+										RelFileNode targetRelfilenode);
+extern void SaveStripeDeletedRows(RelFileNode relfilenode, uint64 stripeId,
+								  uint8 *deletedRows, uint64 rowCount);
+extern uint8 * ReadStripeDeletedRows(RelFileNode relfilenode, uint64 stripeId,
+									 uint64 rowCount, Snapshot snapshot,
+									 uint8 **deletedByOtherXacts);
+extern bool StorageHasDeletedRows(RelFileNode relfilenode, Snapshot snapshot);
 extern uint64 ColumnarMetadataNewStorageId(void);
 extern uint64 GetHighestUsedAddress(RelFileNode relfilenode);
 extern EmptyStripeReservation * ReserveEmptyStripe(Relation rel, uint64 columnCount,
@@ -288,6 +367,10 @@ extern EmptyStripeReservation * ReserveEmptyStripe(Relation rel, uint64 columnCo
 extern StripeMetadata * CompleteStripeReservation(Relation rel, uint64 stripeId,
 												  uint64 sizeBytes, uint64 rowCount,
 												  uint64 chunkCount);
+extern StripeMetadata * CompleteStripeReservationAt(Relation rel, uint64 stripeId,
+													uint64 fileOffset, uint64 sizeBytes,
+													uint64 rowCount, uint64 chunkCount);
+extern void RecomputeStorageTotals(Relation rel);
 extern void SaveStripeSkipList(RelFileNode relfilenode, uint64 stripe,
 							   StripeSkipList *stripeSkipList,
 							   TupleDesc tupleDescriptor);
@@ -326,6 +409,8 @@ extern void MarkRelfilenodeDropped(Oid relfilenode, SubTransactionId currentSubX
 extern void NonTransactionDropWriteState(Oid relfilenode);
 extern bool PendingWritesInUpperTransactions(Oid relfilenode,
 											 SubTransactionId currentSubXid);
+extern bool RowDeletedByCurrentSubXact(Oid relfilenode, SubTransactionId currentSubXid,
+									   uint64 stripeId, uint64 rowOffset);
 extern MemoryContext GetWriteContextForDebug(void);
 
 #endif /* COLUMNAR_H */
@@ -0,0 +1,20 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_bloom_filter.h
+ *
+ * Type and function declarations for the bloom filters of column chunks.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COLUMNAR_BLOOM_FILTER_H
+#define COLUMNAR_BLOOM_FILTER_H
+
+#include "postgres.h"
+
+extern bytea * BuildBloomFilter(uint32 *hashArray, uint32 hashCount);
+extern bool BloomFilterMightContain(bytea *bloomFilter, uint32 hash);
+
+#endif /* COLUMNAR_BLOOM_FILTER_H */
@@ -0,0 +1,43 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_chunk_cache.h
+ *
+ * Type and function declarations for the shared cache of decompressed
+ * column chunks.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COLUMNAR_CHUNK_CACHE_H
+#define COLUMNAR_CHUNK_CACHE_H
+
+#include "postgres.h"
+
+#include "lib/stringinfo.h"
+
+
+/*
+ * ColumnarChunkCacheKey identifies a column chunk across all databases.
+ * Storage ids are only unique within a database, and stripes are never
+ * modified once written, so the decompressed data of a key never changes.
+ * Keys are hashed as a whole, so they should be zeroed before they are
+ * filled in.
+ */
+typedef struct ColumnarChunkCacheKey
+{
+	uint64 storageId;
+	uint64 stripeId;
+	Oid databaseId;
+	uint32 chunkIndex;
+	uint32 columnIndex;
+} ColumnarChunkCacheKey;
+
+
+extern void ColumnarChunkCacheInit(void);
+extern bool ColumnarChunkCacheEnabled(void);
+extern StringInfo ColumnarChunkCacheLookup(ColumnarChunkCacheKey *key);
+extern void ColumnarChunkCacheInsert(ColumnarChunkCacheKey *key, StringInfo valueBuffer);
+
+#endif /* COLUMNAR_CHUNK_CACHE_H */
@@ -24,11 +24,38 @@ typedef enum
 	COMPRESSION_COUNT
 } CompressionType;
 
+/* the size of the zstd dictionaries that are trained for columns */
+#define COMPRESSION_DICTIONARY_SIZE (64 * 1024)
+
+/*
+ * CompressionJob is a buffer for CompressBuffersInParallel to compress.
+ * outputBuffer and compressed are set by CompressBuffersInParallel.
+ */
+typedef struct CompressionJob
+{
+	StringInfo inputBuffer;
+	bytea *dictionary;
+	StringInfo outputBuffer;
+	bool compressed;
+} CompressionJob;
+
 extern bool CompressBuffer(StringInfo inputBuffer,
 						   StringInfo outputBuffer,
 						   CompressionType compressionType,
-						   int compressionLevel);
+						   int compressionLevel,
+						   bytea *dictionary);
+extern uint64 CompressedSizeBound(uint32 inputSize, CompressionType compressionType);
 extern StringInfo DecompressBuffer(StringInfo buffer, CompressionType compressionType,
-								   uint64 decompressedSize);
+								   uint64 decompressedSize, bytea *dictionary);
+extern bytea * TrainCompressionDictionary(char *sampleData, size_t *sampleSizeArray,
+										  uint32 sampleCount, uint32 dictionarySize);
+extern uint32 CompressionDictionaryId(bytea *dictionary);
+extern uint32 CompressedBufferDictionaryId(StringInfo buffer);
+
+/* columnar_compression_workers.c */
+extern void CompressBuffersInParallel(CompressionJob *jobArray, int jobCount,
+									  CompressionType compressionType,
+									  int compressionLevel, int workerCount);
+extern PGDLLEXPORT void ColumnarCompressionWorkerMain(Datum main_arg);
 
 #endif /* COLUMNAR_COMPRESSION_H */
@@ -14,6 +14,7 @@
 #define COLUMNAR_CUSTOMSCAN_H
 
 void columnar_customscan_init(void);
+void columnar_aggregate_scan_init(void);
 
 
 #endif /* COLUMNAR_CUSTOMSCAN_H */
@@ -0,0 +1,54 @@
+/*-------------------------------------------------------------------------
+ *
+ * columnar_encoding.h
+ *
+ * Type and function declarations for lightweight column encodings.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COLUMNAR_ENCODING_H
+#define COLUMNAR_ENCODING_H
+
+#include "access/tupdesc.h"
+#include "lib/stringinfo.h"
+
+/* Enumeration for the encoding of the values of a column chunk */
+typedef enum
+{
+	ENCODING_NONE = 0,
+	ENCODING_DICTIONARY = 1,
+	ENCODING_RUN_LENGTH = 2,
+	ENCODING_FRAME_OF_REFERENCE = 3,
+	ENCODING_DELTA = 4,
+
+	ENCODING_COUNT
+} ColumnEncodingType;
+
+
+/*
+ * ColumnChunkDictionary holds the distinct values of a dictionary encoded
+ * column chunk. entryIndexArray is indexed by row, and holds the index of the
+ * value of the row in entryArray for the rows that are not NULL.
+ */
+typedef struct ColumnChunkDictionary
+{
+	uint32 entryCount;
+	Datum *entryArray;
+	uint8 *entryIndexArray;
+} ColumnChunkDictionary;
+
+
+extern ColumnEncodingType EncodeValueBuffer(StringInfo inputBuffer,
+											StringInfo outputBuffer,
+											bool *existsArray, uint32 rowCount,
+											Form_pg_attribute attributeForm);
+extern void DecodeValueBuffer(StringInfo encodedBuffer,
+							  ColumnEncodingType encodingType,
+							  bool *existsArray, uint32 rowCount,
+							  Form_pg_attribute attributeForm, Datum *datumArray,
+							  ColumnChunkDictionary **dictionary);
+
+#endif /* COLUMNAR_ENCODING_H */
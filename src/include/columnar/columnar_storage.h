@@ -14,6 +14,7 @@
 
 #include "postgres.h"
 
+#include "storage/bufmgr.h"
 #include "storage/smgr.h"
 #include "utils/rel.h"
 
@@ -37,6 +38,19 @@
 #define ColumnarLogicalOffsetIsValid(X) ((X) >= ColumnarFirstLogicalOffset)
 
 
+/*
+ * ColumnarStorageTotals are the running totals of the flushed stripes of a
+ * relation that are kept in its metapage.
+ */
+typedef struct ColumnarStorageTotals
+{
+	uint64 stripeCount;
+	uint64 rowCount;
+	uint64 dataLength;
+	uint32 maxColumnCount;
+} ColumnarStorageTotals;
+
+
 extern void ColumnarStorageInit(SMgrRelation srel, uint64 storageId);
 extern bool ColumnarStorageIsCurrent(Relation rel);
 extern void ColumnarStorageUpdateCurrent(Relation rel, bool upgrade,
@@ -50,6 +64,11 @@ extern uint64 ColumnarStorageGetStorageId(Relation rel, bool force);
 extern uint64 ColumnarStorageGetReservedStripeId(Relation rel, bool force);
 extern uint64 ColumnarStorageGetReservedRowNumber(Relation rel, bool force);
 extern uint64 ColumnarStorageGetReservedOffset(Relation rel, bool force);
+extern bool ColumnarStorageGetTotals(Relation rel, ColumnarStorageTotals *totals);
+extern void ColumnarStorageSetTotals(Relation rel, ColumnarStorageTotals *totals);
+extern void ColumnarStorageAddStripeTotals(Relation rel, uint64 rowCount,
+										   uint64 dataLength, uint32 columnCount,
+										   bool add);
 
 extern uint64 ColumnarStorageReserveData(Relation rel, uint64 amount);
 extern uint64 ColumnarStorageReserveRowNumber(Relation rel, uint64 nrows);
@@ -57,6 +76,11 @@ extern uint64 ColumnarStorageReserveStripeId(Relation rel);
 
 extern void ColumnarStorageRead(Relation rel, uint64 logicalOffset,
 								char *data, uint32 amount);
+extern void ColumnarStorageReadExtended(Relation rel, uint64 logicalOffset,
+										char *data, uint32 amount,
+										BufferAccessStrategy strategy);
+extern void ColumnarStoragePrefetch(Relation rel, uint64 logicalOffset,
+									uint32 amount);
 extern void ColumnarStorageWrite(Relation rel, uint64 logicalOffset,
 								 char *data, uint32 amount);
 extern bool ColumnarStorageTruncate(Relation rel, uint64 newDataReservation);
@@ -1,8 +1,12 @@
 #ifndef ADAPTIVE_EXECUTOR_H
 #define ADAPTIVE_EXECUTOR_H
 
+#include "funcapi.h"
+
 #include "distributed/multi_physical_planner.h"
 
+struct CitusScanState;
+
 /* GUC, determining whether Citus opens 1 connection per task */
 extern bool ForceMaxQueryParallelization;
 extern int MaxAdaptiveExecutorPoolSize;
@@ -11,16 +15,49 @@ extern bool EnableBinaryProtocol;
 
 /* GUC, number of ms to wait between opening connections to the same worker */
 extern int ExecutorSlowStartInterval;
+
+/* GUC, maximum number of read tasks sent in a single pipeline over a connection */
+extern int ExecutorPipelineDepth;
+
+/* GUC, number of rows libpq collects into a single result while fetching rows */
+extern int ExecutorResultChunkSize;
+
+/* GUC, maximum number of read tasks for the same worker combined into one query */
+extern int ExecutorTaskGroupSize;
+extern int ExecutorUtilityTaskGroupSize;
+
+/* GUC, maximum number of concurrent index builds per worker, 0 means no limit */
+extern int MaxIndexBuildsPerWorker;
+
+/* GUC, determining whether the scan returns rows while the execution is running */
+extern bool EnableStreamingResults;
+
+/* GUC, determining whether local tasks run while remote tasks are in flight */
+extern bool EnableOverlappingLocalExecution;
+
+/* GUC, multiple of the average task execution time after which reads are hedged */
+extern double HedgedReadDelayFactor;
 extern bool EnableCostBasedConnectionEstablishment;
 extern bool PreventIncompleteConnectionEstablishment;
 
 extern bool ShouldRunTasksSequentially(List *taskList);
 extern uint64 ExecuteTaskList(RowModifyLevel modLevel, List *taskList);
 extern uint64 ExecuteUtilityTaskList(List *utilityTaskList, bool localExecutionSupported);
+extern uint64 ExecuteSequentialUtilityTaskList(List *utilityTaskList,
+											   bool localExecutionSupported);
 extern uint64 ExecuteUtilityTaskListExtended(List *utilityTaskList, int poolSize,
 											 bool localExecutionSupported);
+extern List * CombineUtilityTasksByWorker(List *taskList, int maxGroupSize);
+extern uint64 ExecuteIndexBuildTaskList(List *utilityTaskList,
+										bool localExecutionSupported);
 extern uint64 ExecuteTaskListOutsideTransaction(RowModifyLevel modLevel, List *taskList,
 												int targetPoolSize, List *jobIdList);
+extern void ContinueStreamingExecution(struct CitusScanState *scanState);
+extern void EndStreamingExecution(struct CitusScanState *scanState);
+extern void FinishStreamingExecution(struct CitusScanState *scanState);
+extern AttInMetadata * TupleDescGetAttBinaryInMetadata(TupleDesc tupdesc);
+extern HeapTuple BuildTupleFromBytes(AttInMetadata *attinmeta, fmStringInfo *values,
+									 Datum *dvalues, bool *nulls);
 
 
 #endif /* ADAPTIVE_EXECUTOR_H */
@@ -0,0 +1,35 @@
+/*-------------------------------------------------------------------------
+ *
+ * admission_control.h
+ *	  Limits the number of multi-shard queries that run at once across the
+ *	  backends of a node, admitting waiting queries in order of priority.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include "distributed/multi_physical_planner.h"
+#include "nodes/pg_list.h"
+
+
+/* GUC, maximum number of multi-shard queries that run at once, 0 for no limit */
+extern int MaxConcurrentMultiShardQueries;
+
+/* GUC, queries with a higher priority are admitted before those that wait longer */
+extern int MultiShardQueryPriority;
+
+
+extern void InitializeExecutionAdmission(void);
+extern size_t ExecutionAdmissionShmemSize(void);
+extern void ExecutionAdmissionShmemInit(void);
+extern SubTransactionId AdmitMultiShardExecution(RowModifyLevel modLevel,
+												 List *remoteTaskList);
+extern void ReleaseExecutionAdmission(SubTransactionId admittedSubId);
+extern void ExecutionAdmissionAtSubAbort(SubTransactionId subId);
+extern void ResetExecutionAdmission(void);
+
+#endif /* ADMISSION_CONTROL_H */
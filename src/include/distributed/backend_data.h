@@ -17,6 +17,7 @@
 #include "datatype/timestamp.h"
 #include "distributed/transaction_identifier.h"
 #include "nodes/pg_list.h"
+#include "port/atomics.h"
 #include "storage/lwlock.h"
 #include "storage/proc.h"
 #include "storage/s_lock.h"
@@ -32,12 +33,19 @@
  * transaction as well. In other words, we could have backends that
  * CitusInitiatedBackend is set but DistributedTransactionId is not set such as an
  * "INSERT" query which is not inside a transaction block.
+ *
+ * Writers modify the fields while holding the mutex, and bump changeCount
+ * before and after doing so. Readers that only need a consistent copy of a
+ * slot use changeCount as a sequence lock and never take the mutex, so
+ * monitoring queries do not delay backends starting or finishing distributed
+ * transactions.
  */
 typedef struct BackendData
 {
 	Oid databaseId;
 	Oid userId;
 	slock_t mutex;
+	pg_atomic_uint32 changeCount; /* odd while an update is in progress */
 	bool cancelledDueToDeadlock;
 	uint64 globalPID;
 	bool distributedCommandOriginator;
@@ -17,6 +17,10 @@
 
 #include "distributed/metadata_utility.h"
 
+/* GUCs limiting the number of concurrently executed background tasks */
+extern int MaxBackgroundTaskExecutors;
+extern int MaxBackgroundTaskExecutorsPerNode;
+
 extern BackgroundWorkerHandle * StartCitusBackgroundTaskQueueMonitor(Oid database,
 																	 Oid extensionOwner);
 extern void CitusBackgroundTaskQueueMonitorMain(Datum arg);
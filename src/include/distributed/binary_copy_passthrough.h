@@ -0,0 +1,27 @@
+/*-------------------------------------------------------------------------
+ *
+ * binary_copy_passthrough.h
+ *    Declarations for forwarding the rows of a binary COPY into a
+ *    distributed table without deserializing them.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef BINARY_COPY_PASSTHROUGH_H
+#define BINARY_COPY_PASSTHROUGH_H
+
+#include "distributed/commands/multi_copy.h"
+
+
+/* GUC, whether rows of a binary COPY are forwarded without deserializing them */
+extern bool EnableBinaryCopyPassthrough;
+
+
+extern bool BinaryCopyPassthroughToExistingShards(CopyStmt *copyStatement,
+												  Relation distributedRelation,
+												  CitusCopyDestReceiver *copyDest,
+												  uint64 *processedRowCount);
+
+#endif /* BINARY_COPY_PASSTHROUGH_H */
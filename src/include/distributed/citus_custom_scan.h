@@ -27,6 +27,25 @@ typedef struct CitusScanState
 	MultiExecutorType executorType;   /* distributed executor type */
 	bool finishedRemoteScan;          /* flag to check if remote scan is finished */
 	Tuplestorestate *tuplestorestate; /* tuple store to store distributed results */
+	int eflags;                       /* executor flags passed to the scan */
+
+	/* execution that still writes to the tuple store while the scan runs */
+	struct DistributedExecution *streamingExecution;
+	uint64 returnedTupleCount;        /* number of tuples read from the tuple store */
+
+	/* merge of the sorted rows of the tasks, read instead of the tuple store */
+	struct SortedMergeState *sortedMerge;
+
+	/*
+	 * Milliseconds the executor spent decoding the results of the tasks and
+	 * waiting for the workers, shown by EXPLAIN ANALYZE when
+	 * citus.explain_analyze_network_metrics is on.
+	 */
+	double resultDecodeTime;
+	double remoteWaitTime;
+
+	/* sample of the tenant of a router query, see tenant_load_stats.c */
+	struct TenantLoadSample *tenantLoadSample;
 } CitusScanState;
 
 
@@ -0,0 +1,68 @@
+/*-------------------------------------------------------------------------
+ *
+ * citus_wait_events.h
+ *	  Wait events that backends report while waiting in distributed
+ *	  execution.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef CITUS_WAIT_EVENTS_H
+#define CITUS_WAIT_EVENTS_H
+
+#include "distributed/pg_version_constants.h"
+
+#if PG_VERSION_NUM >= PG_VERSION_14
+#include "utils/wait_event.h"
+#else
+#include "pgstat.h"
+#endif
+
+
+/*
+ * The identifiers of the Citus wait events within the extension wait event
+ * class. pg_stat_activity shows all of them as Extension, the
+ * citus_backend_wait_events() UDF tells them apart. The offset is arbitrary,
+ * it makes collisions with other extensions less likely.
+ */
+#define CITUS_WAIT_EVENT_OFFSET 0xC100
+
+typedef enum CitusWaitEvent
+{
+	/* waiting for a slot in the shared connection pool */
+	CITUS_WAIT_EVENT_SHARED_CONNECTION = 0,
+
+	/* waiting for new connections to be established */
+	CITUS_WAIT_EVENT_REMOTE_CONNECT = 1,
+
+	/* waiting for the results of remote commands */
+	CITUS_WAIT_EVENT_REMOTE_QUERY_RESULT = 2,
+
+	/* waiting for COPY data to be flushed to a worker */
+	CITUS_WAIT_EVENT_COPY_FLUSH = 3,
+
+	/* waiting for the remote transactions to prepare */
+	CITUS_WAIT_EVENT_TRANSACTION_PREPARE = 4,
+
+	/* waiting for the remote transactions to commit */
+	CITUS_WAIT_EVENT_TRANSACTION_COMMIT = 5,
+
+	/* waiting for an intermediate result to be fetched from a worker */
+	CITUS_WAIT_EVENT_INTERMEDIATE_RESULT_FETCH = 6,
+
+	/* waiting for the admission of a multi-shard query */
+	CITUS_WAIT_EVENT_EXECUTION_ADMISSION = 7,
+
+	CITUS_WAIT_EVENT_COUNT = 8
+} CitusWaitEvent;
+
+/* wait_event_info value to report for a Citus wait event */
+#define CitusWaitEventInfo(waitEvent) \
+	((uint32) (PG_WAIT_EXTENSION | (CITUS_WAIT_EVENT_OFFSET + (waitEvent))))
+
+
+extern const char * CitusWaitEventName(uint32 waitEventInfo);
+
+#endif /* CITUS_WAIT_EVENTS_H */
@@ -37,6 +37,9 @@ extern bool EnableUnsafeTriggers;
 
 extern int MaxMatViewSizeToAutoRecreate;
 
+/* GUC, maximum number of shards vacuumed concurrently per worker */
+extern int MaxVacuumTasksPerWorker;
+
 extern bool EnforceLocalObjectRestrictions;
 
 extern void SwitchToSequentialAndLocalExecutionIfRelationNameTooLong(Oid relationId,
@@ -452,6 +455,9 @@ extern List * AlterSchemaRenameStmtObjectAddress(Node *node, bool missing_ok, bo
 												 isPostprocess);
 
 /* sequence.c - forward declarations */
+extern int DistributedSequenceCacheSize;
+extern void EnsureDistributedSequenceCacheSize(Oid sequenceOid);
+extern void ResetDistributedSequenceCacheSize(Oid sequenceOid);
 extern List * PreprocessAlterSequenceStmt(Node *node, const char *queryString,
 										  ProcessUtilityContext processUtilityContext);
 extern List * PreprocessAlterSequenceSchemaStmt(Node *node, const char *queryString,
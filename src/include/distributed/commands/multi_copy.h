@@ -13,9 +13,11 @@
 #define MULTI_COPY_H
 
 
+#include "distributed/copy_on_conflict.h"
 #include "distributed/metadata_utility.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/version_compat.h"
+#include "commands/copy.h"
 #include "nodes/execnodes.h"
 #include "nodes/parsenodes.h"
 #include "parser/parse_coerce.h"
@@ -82,6 +84,19 @@ typedef struct CopyCoercionData
 	Oid typioparam; /* inputFunction has an extra param */
 } CopyCoercionData;
 
+/*
+ * CopyHashMethod indicates how the destination receiver hashes values of the
+ * distribution column. For the most common distribution column types the
+ * hash function is evaluated inline instead of through the function manager.
+ */
+typedef enum CopyHashMethod
+{
+	COPY_HASH_FUNCTION_CALL,
+	COPY_HASH_INT4,
+	COPY_HASH_INT8,
+	COPY_HASH_TEXT
+} CopyHashMethod;
+
 /* CopyDestReceiver can be used to stream results into a distributed table */
 typedef struct CitusCopyDestReceiver
 {
@@ -124,6 +139,12 @@ typedef struct CitusCopyDestReceiver
 	/* instructions for coercing incoming tuples */
 	CopyCoercionData *columnCoercionPaths;
 
+	/* metadata of the distributed table, used for routing tuples to shards */
+	CitusTableCacheEntry *tableCacheEntry;
+
+	/* how to route on hashes of the distribution column, if not by function call */
+	CopyHashMethod partitionHashMethod;
+
 	/* number of tuples sent */
 	int64 tuplesSent;
 
@@ -146,11 +167,19 @@ typedef struct CitusCopyDestReceiver
 	 * upfront.
 	 */
 	uint64 appendShardId;
+
+	/* what the shards do with rows that conflict with existing rows */
+	CopyOnConflictAction onConflictAction;
+
+	/* whether the COPY reports its own progress, rather than that of its caller */
+	bool progressStarted;
 } CitusCopyDestReceiver;
 
 
 /* GUCs */
 extern bool SkipJsonbValidationInCopy;
+extern bool EnableParallelCopyTo;
+extern bool EnableCopySerializationCache;
 
 /* managed via GUC, the default is 4MB */
 extern int CopySwitchOverThresholdBytes;
@@ -171,6 +200,20 @@ extern void AppendCopyRowData(Datum *valueArray, bool *isNullArray,
 							  CopyOutState rowOutputState,
 							  FmgrInfo *columnOutputFunctions,
 							  CopyCoercionData *columnCoercionPaths);
+extern void PrepareCopyRowSerialization(CitusCopyDestReceiver *copyDest,
+										Relation distributedRelation,
+										TupleDesc inputTupleDescriptor,
+										bool binaryFormat);
+extern CopyFromState BeginCopyFromDistributedRelation(CopyStmt *copyStatement,
+													  Relation distributedRelation,
+													  CitusCopyDestReceiver *copyDest,
+													  copy_data_source_cb
+													  dataSourceCallback);
+extern uint64 ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues,
+							  bool *columnNulls);
+extern void CitusSendCopyRowToPlacements(CitusCopyDestReceiver *copyDest,
+										 uint64 shardId, StringInfo serializedRow);
+extern void CitusPrepareCopyToShard(CitusCopyDestReceiver *copyDest, uint64 shardId);
 extern void AppendCopyBinaryHeaders(CopyOutState headerOutputState);
 extern void AppendCopyBinaryFooters(CopyOutState footerOutputState);
 extern void EndRemoteCopy(int64 shardId, List *connectionList);
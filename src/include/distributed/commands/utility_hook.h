@@ -73,6 +73,13 @@ typedef struct DDLJob
 	 */
 	const char *metadataSyncCommand;
 
+	/*
+	 * Whether the tasks build indexes (CREATE INDEX and REINDEX), such that
+	 * we limit the number of concurrent builds per worker and report their
+	 * progress.
+	 */
+	bool buildsIndexes;
+
 	List *taskList;            /* worker DDL tasks to execute */
 } DDLJob;
 
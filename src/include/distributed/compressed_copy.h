@@ -0,0 +1,37 @@
+/*-------------------------------------------------------------------------
+ *
+ * compressed_copy.h
+ *	  Compression of the COPY data that is sent to shards.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COMPRESSED_COPY_H
+#define COMPRESSED_COPY_H
+
+#include "distributed/intermediate_result_compression.h"
+#include "nodes/parsenodes.h"
+#include "tcop/cmdtag.h"
+
+
+/* COPY option with which the coordinator marks compressed COPY data */
+#define REMOTE_COPY_COMPRESSION_OPTION "compression"
+
+/* number of bytes of COPY data we collect before compressing them */
+#define REMOTE_COPY_COMPRESSION_FRAME_SIZE (64 * 1024)
+
+
+/* GUC, determines how the COPY data sent to shards is compressed */
+extern int RemoteCopyCompression;
+
+
+extern const char * RemoteCopyCompressionName(IntermediateResultCompressionType
+											  compressionType);
+extern bool IsCompressedCopyStmt(CopyStmt *copyStatement);
+extern void CopyCompressedDataIntoTable(CopyStmt *copyStatement,
+										QueryCompletion *completionTag,
+										const char *queryString);
+
+#endif /* COMPRESSED_COPY_H */
@@ -195,13 +195,35 @@ typedef struct MultiConnection
 	/* list of all placements referenced by this connection */
 	dlist_head referencedPlacements;
 
+	/*
+	 * Summary of referencedPlacements, such that we do not need to walk the
+	 * list on every statement, see placement_connection.c.
+	 */
+	List *referencedColocationGroups;
+	uint64 referencedPlacementId;
+	bool referencedMultiplePlacements;
+	bool referencedPlacementModified;
+
 	/* number of bytes sent to PQputCopyData() since last flush */
 	uint64 copyBytesWrittenSinceLastFlush;
 
+	/* COPY flush threshold and throughput statistics, see PutRemoteCopyData() */
+	uint64 copyFlushThreshold;
+	uint64 copyBytesSent;
+	uint64 copyFlushCount;
+	instr_time copyFlushDuration;
+	double copyDrainRate;
+
 	/* replication option */
 	bool requiresReplication;
 
+	/* statements prepared on the remote end, see worker_prepared_statements.c */
+	struct WorkerPreparedStatementCache *preparedStatementCache;
+
 	MultiConnectionStructInitializationState initilizationState;
+
+	/* role that the slot of the connection in the shared pool is charged to */
+	Oid sharedPoolRoleId;
 } MultiConnection;
 
 
@@ -254,6 +276,9 @@ extern int MaxCachedConnectionsPerWorker;
 /* maximum lifetime of connections in miliseconds */
 extern int MaxCachedConnectionLifetime;
 
+/* whether to close cached connections when other backends wait for connections */
+extern bool ReleaseCachedConnectionsOnFullPool;
+
 /* parameters used for outbound connections */
 extern char *NodeConninfo;
 extern char *LocalHostName;
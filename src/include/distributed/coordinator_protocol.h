@@ -238,6 +238,9 @@ extern void CreateAppendDistributedShardPlacements(Oid relationId, int64 shardId
 extern void CreateShardsOnWorkers(Oid distributedRelationId, List *shardPlacements,
 								  bool useExclusiveConnection,
 								  bool colocatedShard);
+extern void ErrorIfShardCreationDeferred(void);
+extern void DeferredShardCreationAtSubAbort(void);
+extern void ResetDeferredShardCreation(void);
 extern List * InsertShardPlacementRows(Oid relationId, int64 shardId,
 									   List *workerNodeList, int workerStartIndex,
 									   int replicationFactor);
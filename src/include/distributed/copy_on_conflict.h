@@ -0,0 +1,49 @@
+/*-------------------------------------------------------------------------
+ *
+ * copy_on_conflict.h
+ *	  COPY FROM that skips or updates rows that conflict with existing rows.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COPY_ON_CONFLICT_H
+#define COPY_ON_CONFLICT_H
+
+#include "commands/copy.h"
+#include "nodes/parsenodes.h"
+#include "parser/parse_node.h"
+#include "tcop/cmdtag.h"
+#include "utils/relcache.h"
+
+
+/* COPY option that determines what to do with rows that violate a unique key */
+#define COPY_ON_CONFLICT_OPTION "on_conflict"
+
+
+/*
+ * CopyOnConflictAction is the value of the on_conflict option of COPY.
+ */
+typedef enum CopyOnConflictAction
+{
+	COPY_ON_CONFLICT_NONE = 0,
+	COPY_ON_CONFLICT_DO_NOTHING,
+	COPY_ON_CONFLICT_DO_UPDATE
+} CopyOnConflictAction;
+
+
+extern CopyOnConflictAction ExtractCopyOnConflictOption(List **copyOptions);
+extern const char * CopyOnConflictActionName(CopyOnConflictAction action);
+extern void EnsureCopyOnConflictSupported(Relation relation,
+										  CopyOnConflictAction action);
+extern bool IsCopyOnConflictStmt(CopyStmt *copyStatement);
+extern void CopyOnConflictIntoTable(CopyStmt *copyStatement,
+									QueryCompletion *completionTag,
+									const char *queryString);
+extern uint64 CopyFromWithOnConflict(Relation relation, ParseState *parseState,
+									 copy_data_source_cb dataSourceCallback,
+									 List *attributeList, List *copyOptions,
+									 CopyOnConflictAction action);
+
+#endif /* COPY_ON_CONFLICT_H */
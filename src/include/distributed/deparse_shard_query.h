@@ -21,6 +21,24 @@
 #include "distributed/citus_custom_scan.h"
 
 
+/*
+ * ShardQueryTemplate is a query string in which the shard names are left as
+ * placeholders, such that we can build the query string of many tasks that
+ * only differ in the shards they access without deparsing the query again.
+ */
+typedef struct ShardQueryTemplate
+{
+	/* relations whose shard names appear in the query */
+	List *relationIdList;
+
+	/* query text around the placeholders, one more than placeholderList */
+	List *fragmentList;
+
+	/* index into relationIdList of the relation of each placeholder */
+	List *placeholderList;
+} ShardQueryTemplate;
+
+
 extern void RebuildQueryStrings(Job *workerJob);
 extern bool UpdateRelationToShardNames(Node *node, List *relationShardList);
 extern void SetTaskQueryIfShouldLazyDeparse(Task *task, Query *query);
@@ -30,6 +48,10 @@ extern char * TaskQueryString(Task *task);
 extern char * TaskQueryStringAtIndex(Task *task, int index);
 extern int GetTaskQueryType(Task *task);
 extern void AddInsertAliasIfNeeded(Query *query);
+extern ShardQueryTemplate * CreateShardQueryTemplate(Query *query,
+													 List *relationIdList);
+extern char * InstantiateShardQueryTemplate(ShardQueryTemplate *queryTemplate,
+											List *relationShardList);
 
 
 #endif /* DEPARSE_SHARD_QUERY_H */
@@ -14,6 +14,9 @@
 
 #include "nodes/pg_list.h"
 
+/* GUC, whether tasks start as soon as their own dependencies are completed */
+extern bool EnableRepartitionDataflowScheduling;
+
 extern void ExecuteTasksInDependencyOrder(List *allTasks, List *excludedTasks,
 										  List *jobIds);
 
@@ -0,0 +1,54 @@
+/*-------------------------------------------------------------------------
+ *
+ * distributed_command_progress.h
+ *	  Declarations for reporting the progress of long-running distributed
+ *	  COPY, INSERT..SELECT and repartition join commands.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef DISTRIBUTED_COMMAND_PROGRESS_H
+#define DISTRIBUTED_COMMAND_PROGRESS_H
+
+#include "postgres.h"
+
+#include "access/xact.h"
+
+
+/* distributed commands that report their progress */
+typedef enum DistributedCommandType
+{
+	DISTRIBUTED_COMMAND_NONE = 0,
+	DISTRIBUTED_COMMAND_COPY,
+	DISTRIBUTED_COMMAND_INSERT_SELECT,
+	DISTRIBUTED_COMMAND_REPARTITION_JOIN
+} DistributedCommandType;
+
+/* phases of the distributed commands that report their progress */
+typedef enum DistributedCommandPhase
+{
+	DISTRIBUTED_COMMAND_PHASE_ROUTING_ROWS = 0,
+	DISTRIBUTED_COMMAND_PHASE_PARTITIONING_RESULTS,
+	DISTRIBUTED_COMMAND_PHASE_FETCHING_FRAGMENTS,
+	DISTRIBUTED_COMMAND_PHASE_WRITING_RESULTS
+} DistributedCommandPhase;
+
+
+extern void InitializeDistributedCommandProgress(void);
+extern size_t DistributedCommandProgressShmemSize(void);
+extern void DistributedCommandProgressShmemInit(void);
+
+extern bool StartDistributedCommandProgress(DistributedCommandType command,
+											Oid relationId, int shardCount);
+extern void FinishDistributedCommandProgress(bool progressStarted);
+extern void SetDistributedCommandPhase(DistributedCommandPhase phase);
+extern void ReportDistributedCommandShardRows(uint64 shardId, uint64 rowCount);
+extern void ReportDistributedCommandBytesSent(uint64 byteCount);
+extern void ReportDistributedCommandFragmentsProduced(uint64 fragmentCount);
+extern void ReportDistributedCommandFragmentsFetched(uint64 fragmentCount);
+extern void ResetDistributedCommandProgress(void);
+extern void ResetDistributedCommandProgressAtSubXactAbort(SubTransactionId subId);
+
+#endif /* DISTRIBUTED_COMMAND_PROGRESS_H */
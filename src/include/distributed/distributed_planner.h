@@ -33,6 +33,9 @@
 /* level of planner calls */
 extern int PlannerLevel;
 
+/* GUC, whether multi-shard SELECTs can be planned with unresolved parameters */
+extern bool EnableGenericMultiShardPlans;
+
 
 typedef struct RelationRestrictionContext
 {
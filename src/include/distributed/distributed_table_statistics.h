@@ -0,0 +1,21 @@
+/*-------------------------------------------------------------------------
+ *
+ * distributed_table_statistics.h
+ *	  Column statistics for the shell tables of distributed tables.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef DISTRIBUTED_TABLE_STATISTICS_H
+#define DISTRIBUTED_TABLE_STATISTICS_H
+
+
+/* GUC, interval in milliseconds between statistics refreshes */
+extern int DistributedStatisticsRefreshInterval;
+
+extern void AnalyzeDistributedTable(Oid relationId);
+extern void AnalyzeAllDistributedTables(void);
+
+#endif /* DISTRIBUTED_TABLE_STATISTICS_H */
@@ -0,0 +1,29 @@
+/*-------------------------------------------------------------------------
+ *
+ * hot_tenant_isolation.h
+ *	  Policy that isolates tenants taking a large share of the load of their
+ *	  colocation group in background jobs.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef HOT_TENANT_ISOLATION_H
+#define HOT_TENANT_ISOLATION_H
+
+
+/* interval in milliseconds at which the maintenance daemon looks for hot tenants */
+#define HOT_TENANT_ISOLATION_CHECK_INTERVAL (60 * 1000)
+
+
+/* GUCs that configure the hot tenant isolation policy */
+extern double HotTenantIsolationThreshold;
+extern int HotTenantIsolationMinSamples;
+extern char *HotTenantIsolationWindow;
+
+extern bool ParseHotTenantIsolationWindow(const char *window, int *startMinute,
+										  int *endMinute);
+extern void ScheduleHotTenantIsolation(void);
+
+#endif /* HOT_TENANT_ISOLATION_H */
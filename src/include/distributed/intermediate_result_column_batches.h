@@ -0,0 +1,38 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_column_batches.h
+ *	  Column-batched format of intermediate result files.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INTERMEDIATE_RESULT_COLUMN_BATCHES_H
+#define INTERMEDIATE_RESULT_COLUMN_BATCHES_H
+
+#include "access/tupdesc.h"
+#include "lib/stringinfo.h"
+#include "utils/tuplestore.h"
+
+
+/* ColumnBatchWriter is opaque, see intermediate_result_column_batches.c */
+typedef struct ColumnBatchWriter ColumnBatchWriter;
+
+
+/* GUC, determines whether new intermediate results are written in column batches */
+extern bool EnableColumnBatchedIntermediateResults;
+
+
+extern ColumnBatchWriter * CreateColumnBatchWriter(TupleDesc tupleDescriptor);
+extern void AppendColumnBatchHeader(ColumnBatchWriter *writer, StringInfo output);
+extern bool ColumnBatchWriterAddRow(ColumnBatchWriter *writer, Datum *columnValues,
+									bool *columnNulls);
+extern void AppendColumnBatch(ColumnBatchWriter *writer, StringInfo output);
+extern void AppendColumnBatchTrailer(StringInfo output);
+extern bool IsColumnBatchResultFile(const char *fileName, bool compressedFile);
+extern void ReadColumnBatchFileIntoTupleStore(const char *fileName, bool compressedFile,
+											  TupleDesc tupleDescriptor,
+											  Tuplestorestate *tupstore);
+
+#endif /* INTERMEDIATE_RESULT_COLUMN_BATCHES_H */
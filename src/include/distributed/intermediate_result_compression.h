@@ -0,0 +1,58 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_compression.h
+ *	  Compression of intermediate result files.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INTERMEDIATE_RESULT_COMPRESSION_H
+#define INTERMEDIATE_RESULT_COMPRESSION_H
+
+#include "lib/stringinfo.h"
+
+
+/* number of bytes of COPY data we collect before compressing them */
+#define INTERMEDIATE_RESULT_FRAME_SIZE (256 * 1024)
+
+/* signature at the start of compressed data, including its zero byte */
+#define COMPRESSED_RESULT_SIGNATURE "CITUSZ\n"
+#define COMPRESSED_RESULT_SIGNATURE_SIZE sizeof(COMPRESSED_RESULT_SIGNATURE)
+
+/* size of the method, uncompressed length and compressed length of a frame */
+#define COMPRESSED_RESULT_FRAME_HEADER_SIZE (1 + 2 * sizeof(uint32))
+
+/* method of a frame whose data could not be made smaller */
+#define COMPRESSED_RESULT_FRAME_STORED 0
+
+
+/* methods for compressing intermediate results */
+typedef enum IntermediateResultCompressionType
+{
+	INTERMEDIATE_RESULT_COMPRESSION_NONE = 0,
+	INTERMEDIATE_RESULT_COMPRESSION_LZ4 = 1,
+	INTERMEDIATE_RESULT_COMPRESSION_ZSTD = 2
+} IntermediateResultCompressionType;
+
+
+/* GUC, determines how new intermediate results are compressed */
+extern int IntermediateResultCompression;
+
+
+extern void AppendCompressedResultHeader(StringInfo output);
+extern void AppendCompressedResultFrame(StringInfo output, const char *data, int length,
+										IntermediateResultCompressionType
+										compressionType);
+extern void ParseCompressedResultFrameHeader(const char *frameHeader, uint8 *method,
+											 int *rawLength, int *compressedLength);
+extern bool DecompressResultFrame(uint8 method, const char *compressedData,
+								  int compressedLength, char *rawData, int rawLength);
+extern bool IsCompressedResultFile(const char *fileName);
+extern void BeginCompressedResultRead(const char *fileName);
+extern int ReadCompressedResult(void *outbuf, int minread, int maxread);
+extern int PeekCompressedResult(char *buffer, int length);
+extern void EndCompressedResultRead(void);
+
+#endif /* INTERMEDIATE_RESULT_COMPRESSION_H */
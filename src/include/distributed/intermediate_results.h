@@ -72,6 +72,9 @@ typedef struct NodeToNodeFragmentsTransfer
 /* Forward Declarations */
 struct CitusTableCacheEntry;
 
+/* GUC, number of nodes that receive a broadcast directly, 0 for all nodes */
+extern int IntermediateResultBroadcastFanout;
+
 /* intermediate_results.c */
 extern DestReceiver * CreateRemoteFileDestReceiver(const char *resultId,
 												   EState *executorState,
@@ -85,12 +88,19 @@ extern DestReceiver * CreatePartitionedResultDestReceiver(int partitionColumnInd
 														  partitionedDestReceivers,
 														  bool lazyStartup,
 														  bool allowNullPartitionValues);
+extern void SetPartitionedResultHeavyHitters(DestReceiver *dest,
+											 Datum *heavyHitterValues,
+											 int heavyHitterCount, Oid typeId,
+											 Oid collation,
+											 bool replicateHeavyHitters);
 extern CitusTableCacheEntry * QueryTupleShardSearchInfo(ArrayType *minValuesArray,
 														ArrayType *maxValuesArray,
 														char partitionMethod,
 														Var *partitionColumn);
 extern void WriteToLocalFile(StringInfo copyData, FileCompat *fileCompat);
 extern uint64 RemoteFileDestReceiverBytesSent(DestReceiver *destReceiver);
+extern void RemoteFileDestReceiverStats(DestReceiver *destReceiver, uint64 *rowsSent,
+										uint64 *bytesSent);
 extern void SendQueryResultViaCopy(const char *resultId);
 extern void ReceiveQueryResultViaCopy(const char *resultId);
 extern void RemoveIntermediateResultsDirectories(void);
@@ -102,6 +112,7 @@ extern ArrayType * CreateArrayFromDatums(Datum *datumArray, bool *nullsArray, in
 
 
 /* distributed_intermediate_results.c */
+extern bool EnableStreamingRepartition;
 extern List ** RedistributeTaskListResults(const char *resultIdPrefix,
 										   List *selectTaskList,
 										   int partitionColumnIndex,
@@ -17,6 +17,7 @@
 
 /* enabled with GUCs*/
 extern bool EnableLocalExecution;
+extern bool EnableLocalExecutionFromQueryTree;
 extern bool LogLocalCommands;
 
 /* global variable that tracks whether the local execution is on a shard */
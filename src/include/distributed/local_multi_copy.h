@@ -11,6 +11,11 @@
  */
 extern int LocalCopyFlushThresholdByte;
 
+/* GUC, whether local placements are written with table_multi_insert */
+extern bool EnableLocalCopyMultiInsert;
+
+typedef struct LocalMultiInsertState LocalMultiInsertState;
+
 extern void WriteTupleToLocalShard(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest,
 								   int64
 								   shardId,
@@ -22,5 +27,11 @@ extern void FinishLocalCopyToShard(CitusCopyDestReceiver *copyDest, int64 shardI
 								   CopyOutState localCopyOutState);
 extern void FinishLocalCopyToFile(CopyOutState localFileCopyOutState,
 								  FileCompat *fileCompat);
+extern LocalMultiInsertState * StartLocalMultiInsert(CitusCopyDestReceiver *copyDest,
+													 int64 shardId);
+extern void WriteTupleToLocalMultiInsert(TupleTableSlot *slot,
+										 CitusCopyDestReceiver *copyDest,
+										 LocalMultiInsertState *multiInsertState);
+extern void FinishLocalMultiInsert(LocalMultiInsertState *multiInsertState);
 
 #endif /* LOCAL_MULTI_COPY */
@@ -1,6 +1,9 @@
 #ifndef LOCAL_PLAN_CACHE
 #define LOCAL_PLAN_CACHE
 
+extern bool EnableMultiShardLocalPlanCaching;
+extern int MaxCachedLocalPlans;
+
 extern bool IsLocalPlanCachingSupported(Job *currentJob,
 										DistributedPlan *originalDistributedPlan);
 extern PlannedStmt * GetCachedLocalPlan(Task *task, DistributedPlan *distributedPlan);
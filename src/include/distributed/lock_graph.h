@@ -60,6 +60,9 @@ typedef struct WaitGraph
 } WaitGraph;
 
 
+/* GUC, minimum lock wait time before reporting edges for deadlock detection */
+extern int DistributedDeadlockMinWaitTime;
+
 extern WaitGraph * BuildGlobalWaitGraph(bool onlyDistributedTx);
 extern bool IsProcessWaitingForLock(PGPROC *proc);
 extern bool IsInDistributedTransaction(BackendData *backendData);
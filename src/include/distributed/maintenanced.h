@@ -21,6 +21,9 @@
 /* config variable for */
 extern double DistributedDeadlockDetectionTimeoutFactor;
 
+/* GUC, time without other backends after which the maintenance daemon exits */
+extern int MaintenanceDaemonIdleTimeout;
+
 extern void StopMaintenanceDaemon(Oid databaseId);
 extern void TriggerNodeMetadataSync(Oid databaseId);
 extern void InitializeMaintenanceDaemon(void);
@@ -19,8 +19,12 @@
 #include "distributed/errormessage.h"
 #include "nodes/pg_list.h"
 
+/* GUC, whether the dependencies of objects are cached across traversals */
+extern bool EnableDependencyCache;
+
 extern List * GetUniqueDependenciesList(List *objectAddressesList);
 extern List * GetDependenciesForObject(const ObjectAddress *target);
+extern List * GetDependenciesForObjectList(const List *targets);
 extern List * GetAllSupportedDependenciesForObject(const ObjectAddress *target);
 extern List * GetAllDependenciesForObject(const ObjectAddress *target);
 extern bool ErrorOrWarnIfAnyObjectHasUnsupportedDependency(List *objectAddresses);
@@ -33,5 +37,6 @@ extern List * GetPgDependTuplesForDependingObjects(Oid targetObjectClassId,
 												   Oid targetObjectId);
 extern List * GetDependingViews(Oid relationId);
 extern Oid GetDependingView(Form_pg_depend pg_depend);
+extern void ResetDependencyCache(void);
 
 #endif /* CITUS_DEPENDENCY_H */
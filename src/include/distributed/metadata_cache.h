@@ -20,12 +20,16 @@
 #include "utils/hsearch.h"
 
 extern bool EnableVersionChecks;
+extern bool EnableCompactShardIntervals;
+extern bool EnableLazyPlacementLoading;
+extern bool EnableSharedShardLayouts;
 
 /* managed via guc.c */
 typedef enum
 {
 	USE_SECONDARY_NODES_NEVER = 0,
-	USE_SECONDARY_NODES_ALWAYS = 1
+	USE_SECONDARY_NODES_ALWAYS = 1,
+	USE_SECONDARY_NODES_CAUGHT_UP = 2
 } ReadFromSecondariesType;
 extern int ReadFromSecondaries;
 
@@ -65,10 +69,37 @@ typedef struct
 	char replicationModel;
 	bool autoConverted; /* table auto-added to metadata, valid for citus local tables */
 
-	/* pg_dist_shard metadata (variable-length ShardInterval array) for this table */
+	/*
+	 * Position in the log of shard invalidations at which the shards of this
+	 * entry were read, see ShardInvalidationLogPosition().
+	 */
+	uint64 shardInvalidationLogPosition;
+
+	/*
+	 * pg_dist_shard metadata (variable-length ShardInterval array) for this table,
+	 * use GetCachedShardInterval() or GetSortedShardIntervalArray() to read it.
+	 */
 	int shardIntervalArrayLength;
 	ShardInterval **sortedShardIntervalArray;
 
+	/*
+	 * Whether the shards have a uniform hash distribution and consecutive shard
+	 * IDs starting at firstShardId. In that case the intervals are implied by
+	 * the shard count, and the elements of sortedShardIntervalArray are only
+	 * built when they are first used.
+	 */
+	bool hasCompactShardIntervals;
+	uint64 firstShardId;
+
+	/*
+	 * Hash ranges of the shards, shared with the other tables in the
+	 * colocation group, and the IDs of the shards of this table in the same
+	 * order. When set, the elements of sortedShardIntervalArray are only built
+	 * when they are first used.
+	 */
+	struct ColocationShardLayout *sharedShardLayout;
+	uint64 *sortedShardIdArray;
+
 	/* comparator for partition column's type, NULL if DISTRIBUTE_BY_NONE */
 	FmgrInfo *shardColumnCompareFunction;
 
@@ -93,7 +124,10 @@ typedef struct
 	List *referencedRelationsViaForeignKey;
 	List *referencingRelationsViaForeignKey;
 
-	/* pg_dist_placement metadata */
+	/*
+	 * pg_dist_placement metadata, use GetCachedShardPlacementArray() to read it
+	 * since the placements of a shard might not be loaded yet.
+	 */
 	GroupShardPlacement **arrayOfPlacementArrays;
 	int *arrayOfPlacementArrayLengths;
 } CitusTableCacheEntry;
@@ -168,6 +202,13 @@ extern GroupShardPlacement * LoadGroupShardPlacement(uint64 shardId, uint64 plac
 extern ShardPlacement * LoadShardPlacement(uint64 shardId, uint64 placementId);
 extern CitusTableCacheEntry * GetCitusTableCacheEntry(Oid distributedRelationId);
 extern CitusTableCacheEntry * LookupCitusTableCacheEntry(Oid relationId);
+extern ShardInterval * GetCachedShardInterval(CitusTableCacheEntry *cacheEntry,
+											  int shardIndex);
+extern ShardInterval ** GetSortedShardIntervalArray(CitusTableCacheEntry *cacheEntry);
+extern uint64 GetCachedShardId(CitusTableCacheEntry *cacheEntry, int shardIndex);
+extern GroupShardPlacement * GetCachedShardPlacementArray(CitusTableCacheEntry *cacheEntry,
+														  int shardIndex,
+														  int *numberOfPlacements);
 extern DistObjectCacheEntry * LookupDistObjectCacheEntry(Oid classid, Oid objid, int32
 														 objsubid);
 extern int32 GetLocalGroupId(void);
@@ -180,6 +221,7 @@ extern void CitusInvalidateRelcacheByShardId(int64 shardId);
 extern void InvalidateForeignKeyGraph(void);
 extern void FlushDistTableCache(void);
 extern void InvalidateMetadataSystemCache(void);
+extern uint64 MetadataCacheGeneration(void);
 extern List * CitusTableTypeIdList(CitusTableType citusTableType);
 extern Datum DistNodeMetadata(void);
 extern bool HasUniformHashDistribution(ShardInterval **shardIntervalArray,
@@ -271,6 +313,7 @@ extern Oid CitusCopyFormatTypeId(void);
 /* function oids */
 extern Oid CitusReadIntermediateResultFuncId(void);
 Oid CitusReadIntermediateResultArrayFuncId(void);
+extern Oid CitusReadInlineIntermediateResultFuncId(void);
 extern Oid CitusExtraDataContainerFuncId(void);
 extern Oid CitusAnyValueFunctionId(void);
 extern Oid CitusTextSendAsJsonbFunctionId(void);
@@ -0,0 +1,30 @@
+/*-------------------------------------------------------------------------
+ *
+ * metadata_cache_warmup.h
+ *	  Pre-building metadata cache entries of frequently used Citus tables in
+ *	  new backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef METADATA_CACHE_WARMUP_H
+#define METADATA_CACHE_WARMUP_H
+
+
+/* interval in milliseconds at which the maintenance daemon decays build counts */
+#define METADATA_CACHE_WARMUP_DECAY_INTERVAL (60 * 1000)
+
+
+/* GUC, number of tables whose cache entries are built when a backend starts */
+extern int MetadataCacheWarmupTableCount;
+
+extern void InitializeMetadataCacheWarmup(void);
+extern size_t MetadataCacheWarmupShmemSize(void);
+extern void MetadataCacheWarmupShmemInit(void);
+extern void RecordCitusTableCacheBuild(Oid relationId);
+extern void DecayCitusTableCacheBuildCounts(void);
+extern void WarmUpMetadataCache(void);
+
+#endif /* METADATA_CACHE_WARMUP_H */
@@ -42,6 +42,7 @@
 	"worker_partitioned_relation_total_size(%s)"
 
 #define SHARD_SIZES_COLUMN_COUNT (3)
+#define SHARD_STAT_COUNTERS_COLUMN_COUNT (5)
 
 /*
  * Flag to keep track of whether the process is currently in a function converting the
@@ -255,6 +256,9 @@ typedef struct BackgroundTask
 	TimestampTz *not_before;
 	char *message;
 
+	/* ids of the nodes the task works on, as a list of int */
+	List *nodesInvolved;
+
 	/* extra space to store values for nullable value types above */
 	struct
 	{
@@ -376,6 +380,7 @@ extern void GetIntervalTypeInfo(char partitionMethod, Var *partitionColumn,
 								Oid *intervalTypeId, int32 *intervalTypeMod);
 extern List * SendShardStatisticsQueriesInParallel(List *citusTableIds,
 												   bool useDistributedTransaction);
+extern List * ShardIntervalsOnWorkerGroup(WorkerNode *workerNode, Oid relationId);
 extern bool GetNodeDiskSpaceStatsForConnection(MultiConnection *connection,
 											   uint64 *availableBytes,
 											   uint64 *totalBytes);
@@ -390,8 +395,10 @@ extern bool HasNonTerminalJobOfType(const char *jobType, int64 *jobIdOut);
 extern int64 CreateBackgroundJob(const char *jobType, const char *description);
 extern BackgroundTask * ScheduleBackgroundTask(int64 jobId, Oid owner, char *command,
 											   int dependingTaskCount,
-											   int64 dependingTaskIds[]);
-extern BackgroundTask * GetRunnableBackgroundTask(void);
+											   int64 dependingTaskIds[],
+											   int nodesInvolvedCount,
+											   int32 nodesInvolved[]);
+extern List * GetRunnableBackgroundTaskList(void);
 extern void ResetRunningBackgroundTasks(void);
 extern BackgroundJob * GetBackgroundJobByJobId(int64 jobId);
 extern BackgroundTask * GetBackgroundTaskByTaskId(int64 taskId);
@@ -80,6 +80,13 @@ extern void AdaptiveExecutorPreExecutorRun(CitusScanState *scanState);
 extern TupleTableSlot * AdaptiveExecutor(CitusScanState *scanState);
 
 
+/*
+ * TaskFinishedCallback is called when a remote task of an execution finishes,
+ * and returns the tasks that become ready to execute as a result.
+ */
+typedef List *(*TaskFinishedCallback)(Task *task, void *context);
+
+
 /*
  * ExecutionParams contains parameters that are used during the execution.
  * Some of these can be the zero value if it is not needed during the execution.
@@ -114,6 +121,21 @@ typedef struct ExecutionParams
 	/* isUtilityCommand is true if the current execution is for a utility
 	 * command such as a DDL command.*/
 	bool isUtilityCommand;
+
+	/*
+	 * taskProgressMagicNumber is the magic number under which the progress of
+	 * the remote tasks is reported, or 0 if we do not report their progress.
+	 */
+	uint64 taskProgressMagicNumber;
+
+	/*
+	 * taskFinishedCallback, if set, is called with taskFinishedContext whenever
+	 * a remote task finishes, and the tasks that it returns are appended to
+	 * taskList and executed by the same execution. Such executions should not
+	 * use local execution, since local tasks run after the remote execution.
+	 */
+	TaskFinishedCallback taskFinishedCallback;
+	void *taskFinishedContext;
 } ExecutionParams;
 
 ExecutionParams * CreateBasicExecutionParams(RowModifyLevel modLevel,
@@ -122,14 +144,27 @@ ExecutionParams * CreateBasicExecutionParams(RowModifyLevel modLevel,
 											 bool localExecutionSupported);
 
 extern uint64 ExecuteTaskListExtended(ExecutionParams *executionParams);
+extern uint64 ExecuteTaskListWithTaskFinishedCallback(RowModifyLevel modLevel,
+													  List *taskList,
+													  TaskFinishedCallback
+													  taskFinishedCallback,
+													  void *taskFinishedContext);
 extern uint64 ExecuteTaskListIntoTupleDest(RowModifyLevel modLevel, List *taskList,
 										   TupleDestination *tupleDest,
 										   bool expectResults);
 extern bool IsCitusCustomState(PlanState *planState);
 extern TupleTableSlot * CitusExecScan(CustomScanState *node);
 extern TupleTableSlot * ReturnTupleFromTuplestore(CitusScanState *scanState);
+extern TupleTableSlot * ReadNextTupleFromTuplestore(CitusScanState *scanState,
+													bool forwardScanDirection);
 extern void ReadFileIntoTupleStore(char *fileName, char *copyFormat, TupleDesc
 								   tupleDescriptor, Tuplestorestate *tupstore);
+extern void ReadCopyFormatFileIntoTupleStore(char *fileName, char *copyFormat,
+											 TupleDesc tupleDescriptor,
+											 Tuplestorestate *tupstore);
+extern void ReadCopyDataIntoTupleStore(char *copyData, int copyDataLength,
+									   TupleDesc tupleDescriptor,
+									   Tuplestorestate *tupstore);
 extern Query * ParseQueryString(const char *queryString, Oid *paramOids, int numParams);
 extern Query * RewriteRawQueryStmt(RawStmt *rawStmt, const char *queryString,
 								   Oid *paramOids, int numParams);
@@ -23,6 +23,7 @@ typedef enum
 extern bool ExplainDistributedQueries;
 extern bool ExplainAllTasks;
 extern int ExplainAnalyzeSortMethod;
+extern bool ExplainAnalyzeNetworkMetrics;
 
 extern void FreeSavedExplainPlan(void);
 extern void CitusExplainOneQuery(Query *query, int cursorOptions, IntoClause *into,
@@ -34,5 +35,6 @@ extern List * ExplainAnalyzeTaskList(List *originalTaskList,
 									 tupleDesc, ParamListInfo params);
 extern bool RequestedForExplainAnalyze(CitusScanState *node);
 extern void ResetExplainAnalyzeData(List *taskList);
+extern void SaveExplainAnalyzeTaskMetrics(List *explainAnalyzeTaskList);
 
 #endif /* MULTI_EXPLAIN_H */
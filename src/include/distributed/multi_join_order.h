@@ -86,6 +86,8 @@ typedef struct JoinOrderNode
 /* Config variables managed via guc.c */
 extern bool LogMultiJoinOrder;
 extern bool EnableSingleHashRepartitioning;
+extern bool EnableCostBasedJoinOrder;
+extern bool EnableNestedShardJoins;
 
 
 /* Function declaration for determining table join orders */
@@ -28,6 +28,8 @@
 #define JSON_CAT_AGGREGATE_NAME "json_cat_agg"
 #define WORKER_PARTIAL_AGGREGATE_NAME "worker_partial_agg"
 #define COORD_COMBINE_AGGREGATE_NAME "coord_combine_agg"
+#define WORKER_PARTIAL_BINARY_AGGREGATE_NAME "worker_partial_agg_binary"
+#define COORD_COMBINE_BINARY_AGGREGATE_NAME "coord_combine_agg_binary"
 #define WORKER_COLUMN_FORMAT "worker_column_%d"
 
 /* Definitions related to count(distinct) approximations */
@@ -42,6 +44,11 @@
 #define HLL_CARDINALITY_FUNC_NAME "hll_cardinality"
 #define HLL_FORCE_GROUPAGG_GUC_NAME "hll.force_groupagg"
 
+/* Definitions related to built-in count(distinct) approximations */
+#define CITUS_HLL_ADD_AGGREGATE_NAME "citus_hll_add_agg"
+#define CITUS_HLL_UNION_AGGREGATE_NAME "citus_hll_union_agg"
+#define CITUS_HLL_CARDINALITY_FUNC_NAME "citus_hll_cardinality"
+
 /* Definitions related to Top-N approximations */
 #define TOPN_ADD_AGGREGATE_NAME "topn_add_agg"
 #define TOPN_UNION_AGGREGATE_NAME "topn_union_agg"
@@ -158,6 +165,8 @@ static const char *const AggregateNames[] = {
 extern int LimitClauseRowFetchCount;
 extern double CountDistinctErrorRate;
 extern int CoordinatorAggregationStrategy;
+extern bool EnableBinaryPartialAggregates;
+extern bool EnableRepartitionedWindowFunctions;
 
 
 /* Function declaration for optimizing logical plans */
@@ -20,20 +20,27 @@
 
 
 /* Config variables managed via guc.c */
+extern int LogicalReplicationApplyParallelism;
 extern int LogicalReplicationTimeout;
+extern int ShardIndexBuildMaintenanceWorkMem;
+extern int ShardIndexBuildMaxParallelWorkers;
+extern int ShardIndexBuildParallelism;
 
 extern bool PlacementMovedUsingLogicalReplicationInTX;
 
 /*
  * NodeAndOwner should be used as a key for structs that should be hashed by a
- * combination of node and owner.
+ * combination of node and owner. Shard moves can replicate the shards of an
+ * owner through several subscriptions, which are told apart by their
+ * subscriptionIndex. It is always 0 for shard splits.
  */
 typedef struct NodeAndOwner
 {
 	uint32_t nodeId;
 	Oid tableOwnerId;
+	uint32 subscriptionIndex;
 } NodeAndOwner;
-assert_valid_hash_key2(NodeAndOwner, nodeId, tableOwnerId);
+assert_valid_hash_key3(NodeAndOwner, nodeId, tableOwnerId, subscriptionIndex);
 
 
 /*
@@ -182,5 +189,7 @@ extern void CompleteNonBlockingShardTransfer(List *shardList,
 											 LogicalRepType type);
 extern void CreateUncheckedForeignKeyConstraints(List *logicalRepTargetList);
 extern void CreatePartitioningHierarchy(List *logicalRepTargetList);
+extern int ShardIndexBuildPoolSize(void);
+extern List * ShardIndexBuildSettingCommandList(void);
 
 #endif /* MULTI_LOGICAL_REPLICATION_H_ */
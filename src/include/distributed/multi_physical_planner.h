@@ -37,7 +37,15 @@
 #define NON_PRUNABLE_JOIN -1
 #define RESERVED_HASHED_COLUMN_ID MaxAttrNumber
 
+/* number of rows of each map task we sample to find heavy hitters of join keys */
+#define HEAVY_HITTER_SAMPLE_SIZE 10000
+
 extern int RepartitionJoinBucketCountPerNode;
+extern bool EnableRepartitionJoinFilters;
+extern int RepartitionJoinFilterSize;
+extern bool EnableRepartitionJoinSkewHandling;
+extern int RepartitionJoinRowsPerBucket;
+extern bool EnableRepartitionFragmentCoalescing;
 
 typedef enum CitusRTEKind
 {
@@ -86,7 +94,8 @@ typedef enum
 	TASK_ASSIGNMENT_INVALID_FIRST = 0,
 	TASK_ASSIGNMENT_GREEDY = 1,
 	TASK_ASSIGNMENT_ROUND_ROBIN = 2,
-	TASK_ASSIGNMENT_FIRST_REPLICA = 3
+	TASK_ASSIGNMENT_FIRST_REPLICA = 3,
+	TASK_ASSIGNMENT_LEAST_LOADED = 4
 } TaskAssignmentPolicyType;
 
 
@@ -121,6 +130,12 @@ typedef struct LocalPlannedStatement
 	uint64 shardId;
 	uint32 localGroupId;
 	PlannedStmt *localPlan;
+
+	/* value of the local plan use counter when the plan was last used */
+	uint64 lastUsed;
+
+	/* memory context that holds the local plan, not copied */
+	MemoryContext planContext;
 } LocalPlannedStatement;
 
 
@@ -153,6 +168,13 @@ typedef struct Job
 	 */
 	bool parametersInJobQueryResolved;
 	uint32 colocationId; /* common colocation group ID of the relations */
+
+	/*
+	 * Values of the parameters in jobQuery as a list of Const nodes. When set,
+	 * the tasks are sent with these parameters instead of the ones of the
+	 * execution.
+	 */
+	List *parameterValueList;
 } Job;
 
 
@@ -160,6 +182,7 @@ typedef struct Job
 typedef struct MapMergeJob
 {
 	Job job;
+	BoundaryNodeJobType boundaryNodeJobType; /* join or subquery repartitioning */
 	PartitionType partitionType;
 	Var *partitionColumn;
 	uint32 partitionCount;
@@ -167,6 +190,26 @@ typedef struct MapMergeJob
 	ShardInterval **sortedShardIntervalArray; /* only applies to range partitioning */
 	List *mapTaskList;
 	List *mergeTaskList;
+
+	/*
+	 * Both sides of a dual repartition join that uses a join key filter have
+	 * the result id of the filter. The side that builds the filter runs
+	 * joinKeyFilterTaskList, the other side only repartitions rows that pass
+	 * the filter.
+	 */
+	char *joinKeyFilterResultId;
+	bool buildsJoinKeyFilter;
+	List *joinKeyFilterTaskList;
+
+	/*
+	 * Both sides of a dual repartition join that handles skew have the result
+	 * id of the heavy hitters of the join key. The side that samples them runs
+	 * heavyHitterSampleTaskList and spreads the rows of heavy hitters across
+	 * all partitions, the other side sends them to all partitions.
+	 */
+	char *heavyHitterResultId;
+	bool samplesHeavyHitters;
+	List *heavyHitterSampleTaskList;
 } MapMergeJob;
 
 typedef enum TaskQueryType
@@ -243,6 +286,13 @@ typedef struct Task
 	 */
 	int queryCount;
 
+	/*
+	 * sendQueriesTogether is set when the queries of a TASK_QUERY_TEXT_LIST
+	 * task can be sent to remote placements as a single multi-statement
+	 * command. Local execution still plans and runs them one by one.
+	 */
+	bool sendQueriesTogether;
+
 	Oid anchorDistributedTableId;     /* only applies to insert tasks */
 	uint64 anchorShardId;       /* only applies to compute tasks */
 	List *taskPlacementList;    /* only applies to compute tasks */
@@ -322,6 +372,16 @@ typedef struct Task
 	 */
 	double fetchedExplainAnalyzeExecutionDuration;
 
+	/*
+	 * Network and connection metrics of the remote execution of the task, which
+	 * EXPLAIN ANALYZE shows when citus.explain_analyze_network_metrics is on.
+	 * Times are in milliseconds and round trips count the task queries sent.
+	 */
+	double explainAnalyzeConnectionWaitTime;
+	double explainAnalyzeFirstRowTime;
+	uint32 explainAnalyzeRoundTrips;
+	bool explainAnalyzeConnectionReused;
+
 	/*
 	 * isLocalTableModification is true if the task is on modifying a local table.
 	 */
@@ -400,6 +460,12 @@ typedef struct DistributedPlan
 	/* local query that merges results from the workers */
 	Query *combineQuery;
 
+	/*
+	 * Sort clauses by which the CustomScan merges the sorted results of the
+	 * tasks, such that the combine query does not sort them, or NIL.
+	 */
+	List *sortedMergeClauseList;
+
 	/* query identifier (copied from the top-level PlannedStmt) */
 	uint64 queryId;
 
@@ -478,6 +544,7 @@ typedef struct DistributedSubPlan
 	uint32 remoteWorkerCount;
 	double durationMillisecs;
 	bool writeLocalFile;
+	bool inlined;
 } DistributedSubPlan;
 
 
@@ -561,6 +628,7 @@ extern bool ShardIntervalsOverlapWithParams(Datum firstMin, Datum firstMax,
 											FmgrInfo *comparisonFunction,
 											Oid collation);
 extern bool CoPartitionedTables(Oid firstRelationId, Oid secondRelationId);
+extern bool NestedShardPartitionedTables(Oid firstRelationId, Oid secondRelationId);
 extern ShardInterval ** GenerateSyntheticShardIntervalArray(int partitionCount);
 extern RowModifyLevel RowModifyLevelForQuery(Query *query);
 extern StringInfo ArrayObjectToString(ArrayType *arrayObject,
@@ -575,6 +643,8 @@ extern List * AssignAnchorShardTaskList(List *taskList);
 extern List * FirstReplicaAssignTaskList(List *taskList);
 extern List * RoundRobinAssignTaskList(List *taskList);
 extern List * RoundRobinReorder(List *placementList);
+extern List * LeastLoadedAssignTaskList(List *taskList);
+extern List * LeastLoadedReorder(List *placementList);
 extern void SetPlacementNodeMetadata(ShardPlacement *placement, WorkerNode *workerNode);
 extern int CompareTasksByTaskId(const void *leftElement, const void *rightElement);
 extern int CompareTasksByExecutionDuration(const void *leftElement, const
@@ -587,6 +657,8 @@ extern List * QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 									   List *prunedRelationShardList, TaskType taskType,
 									   bool modifyRequiresCoordinatorEvaluation,
 									   DeferredErrorMessage **planningError);
+extern char * QueryPushdownTaskQueryString(Query *originalQuery,
+										   List *relationShardList);
 
 extern bool ModifyLocalTableJob(Job *job);
 
@@ -39,6 +39,8 @@ extern List * ProgressMonitorList(uint64 commandTypeMagicNumber,
 								  List **attachedDSMSegmentList);
 extern void DetachFromDSMSegments(List *dsmSegmentList);
 extern void * ProgressMonitorSteps(ProgressMonitorData *monitor);
+extern ProgressMonitorData * MonitorDataFromDSMHandle(dsm_handle dsmHandle,
+													  dsm_segment **attachedSegment);
 
 
 #endif /* MULTI_PROGRESS_H */
@@ -26,7 +26,22 @@
 #define CITUS_TABLE_ALIAS "citus_table_alias"
 
 extern bool EnableRouterExecution;
+extern bool EnableEarlyConnectionEstablishment;
 extern bool EnableFastPathRouterPlanner;
+extern bool EnableFastPathArrayFilters;
+
+
+/*
+ * DistributionKeyValueGroup contains the values of an IN-list or = ANY(array)
+ * filter on the distribution key that belong to the same shard.
+ */
+typedef struct DistributionKeyValueGroup
+{
+	ShardInterval *shardInterval;
+
+	/* array constant with the values of the group */
+	Const *valueArray;
+} DistributionKeyValueGroup;
 
 extern DistributedPlan * CreateRouterPlan(Query *originalQuery, Query *query,
 										  PlannerRestrictionContext *
@@ -82,7 +97,8 @@ extern uint64 GetAnchorShardId(List *relationShardList);
 extern List * TargetShardIntervalForFastPathQuery(Query *query,
 												  bool *isMultiShardQuery,
 												  Const *inputDistributionKeyValue,
-												  Const **outGoingPartitionValueConst);
+												  Const **outGoingPartitionValueConst,
+												  List **placementList);
 extern void GenerateSingleShardRouterTaskList(Job *job,
 											  List *relationShardList,
 											  List *placementList,
@@ -97,6 +113,10 @@ extern void GenerateSingleShardRouterTaskList(Job *job,
 extern PlannedStmt * FastPathPlanner(Query *originalQuery, Query *parse, ParamListInfo
 									 boundParams);
 extern bool FastPathRouterQuery(Query *query, Node **distributionKeyValue);
+extern ScalarArrayOpExpr * FindDistributionKeyArrayFilter(Query *query);
+extern List * DistributionKeyValueGroups(Query *query);
+extern List * FastPathArrayFilterTaskList(Job *job, List *valueGroupList,
+										  DeferredErrorMessage **planningError);
 extern bool JoinConditionIsOnFalse(List *relOptInfo);
 
 
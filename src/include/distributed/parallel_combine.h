@@ -0,0 +1,33 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_combine.h
+ *	  Reading the rows of a distributed query from postgres parallel workers
+ *	  during the combine query.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PARALLEL_COMBINE_H
+#define PARALLEL_COMBINE_H
+
+#include "distributed/citus_custom_scan.h"
+#include "nodes/pathnodes.h"
+#include "nodes/plannodes.h"
+
+
+/* GUC, determines whether the combine query may use parallel workers */
+extern bool EnableParallelCombine;
+
+extern CustomScanMethods ParallelCombineCustomScanMethods;
+
+
+extern Path * CreateParallelCombineScanPath(PlannerInfo *root, RelOptInfo *relOptInfo,
+											CustomScan *remoteScan);
+extern void ResetParallelCombineScanCount(void);
+extern bool AddParallelCombineSource(PlannedStmt *combinePlan, CustomScan *remoteScan);
+extern void ExecInitParallelCombineSource(CitusScanState *scanState, EState *estate,
+										  int eflags);
+
+#endif /* PARALLEL_COMBINE_H */
@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_local_table_copy.h
+ *    Declarations for copying the local data of a table that is being
+ *    distributed into its shards with parallel workers.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PARALLEL_LOCAL_TABLE_COPY
+#define PARALLEL_LOCAL_TABLE_COPY
+
+#include "access/parallel.h"
+#include "distributed/commands/multi_copy.h"
+
+
+/* GUC, number of parallel workers that read the local data of a table */
+extern int LocalTableCopyParallelWorkers;
+
+
+extern bool ParallelCopyLocalTableIntoShards(Relation distributedRelation,
+											 CitusCopyDestReceiver *copyDest,
+											 uint64 *rowsCopied);
+extern void CitusLocalTableCopyWorkerMain(dsm_segment *segment, shm_toc *toc);
+
+#endif /* PARALLEL_LOCAL_TABLE_COPY */
@@ -0,0 +1,27 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_multi_copy.h
+ *    Declarations for parsing the input of a COPY into a distributed table
+ *    in background workers.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PARALLEL_MULTI_COPY
+#define PARALLEL_MULTI_COPY
+
+#include "distributed/commands/multi_copy.h"
+
+
+/* GUC, number of background workers that parse the input of a COPY */
+extern int ParallelCopyWorkers;
+
+
+extern bool ParallelCopyToExistingShards(CopyStmt *copyStatement,
+										 CitusCopyDestReceiver *copyDest,
+										 uint64 *processedRowCount);
+extern void CitusParallelCopyWorkerMain(Datum main_arg);
+
+#endif /* PARALLEL_MULTI_COPY */
@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * parallel_result_scan.h
+ *	  Reading intermediate results from postgres parallel workers.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PARALLEL_RESULT_SCAN_H
+#define PARALLEL_RESULT_SCAN_H
+
+#include "nodes/extensible.h"
+#include "nodes/pathnodes.h"
+#include "nodes/parsenodes.h"
+
+
+/* GUC, determines whether intermediate results may be read by parallel workers */
+extern bool EnableParallelResultScan;
+
+extern CustomScanMethods ParallelResultScanCustomScanMethods;
+
+
+extern void AddParallelResultScanPath(PlannerInfo *root, RelOptInfo *relOptInfo,
+									  RangeTblEntry *rangeTableEntry);
+
+#endif /* PARALLEL_RESULT_SCAN_H */
@@ -0,0 +1,58 @@
+/*-------------------------------------------------------------------------
+ *
+ * planner_timing.h
+ *	  Timing of the phases of distributed planning.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PLANNER_TIMING_H
+#define PLANNER_TIMING_H
+
+
+/* phases of distributed planning that we time separately */
+typedef enum PlannerPhase
+{
+	/* planning subqueries and CTEs that cannot be pushed down */
+	PLANNER_PHASE_RECURSIVE_PLANNING = 0,
+
+	/* checking whether subqueries and joins can be pushed down */
+	PLANNER_PHASE_PUSHDOWN_CHECKS = 1,
+
+	/* finding the shards a query needs to access */
+	PLANNER_PHASE_SHARD_PRUNING = 2,
+
+	/* building the query strings of the tasks */
+	PLANNER_PHASE_DEPARSE = 3,
+
+	PLANNER_PHASE_COUNT = 4
+} PlannerPhase;
+
+/* time spent in distributed planning, in milliseconds */
+typedef struct PlannerPhaseTimings
+{
+	/* total time spent in distributed_planner */
+	double totalMillisecs;
+
+	/*
+	 * Time spent in each phase. The phases can overlap, e.g. recursive
+	 * planning includes the pruning and deparsing of the subplans.
+	 */
+	double phaseMillisecs[PLANNER_PHASE_COUNT];
+} PlannerPhaseTimings;
+
+
+/* GUC, whether to show the planner phase timings in EXPLAIN (SUMMARY) */
+extern bool ExplainPlannerPhases;
+
+extern void BeginPlannerPhaseTimings(bool trackingRequested);
+extern bool EndPlannerPhaseTimings(PlannerPhaseTimings *timings);
+extern void AbortPlannerPhaseTimings(void);
+extern void BeginPlannerPhase(PlannerPhase phase);
+extern void EndPlannerPhase(PlannerPhase phase);
+extern void SetExplainPlannerPhaseTimingsRequested(bool requested);
+extern PlannerPhaseTimings * ExplainPlannerPhaseTimings(void);
+
+#endif /* PLANNER_TIMING_H */
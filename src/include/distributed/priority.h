@@ -1,7 +1,7 @@
 /*-------------------------------------------------------------------------
  *
  * priority.h
- *	  Shared declarations for managing CPU priority.
+ *	  Shared declarations for managing CPU and I/O priority.
  *
  * Copyright (c) Citus Data, Inc.
  *
@@ -20,12 +20,26 @@
 extern int CpuPriority;
 extern int CpuPriorityLogicalRepSender;
 extern int MaxHighPriorityBackgroundProcesess;
+extern int IoPriority;
+extern int IoPriorityBackgroundOperations;
+extern int IoPriorityLogicalRepSender;
 
 #define CPU_PRIORITY_INHERIT 1234
 
+/* values of the citus.io_priority settings */
+typedef enum IoPriorityLevel
+{
+	IO_PRIORITY_INHERIT,
+	IO_PRIORITY_HIGH,
+	IO_PRIORITY_NORMAL,
+	IO_PRIORITY_LOW,
+	IO_PRIORITY_IDLE
+} IoPriorityLevel;
+
 /* Function declarations for transmitting files between two nodes */
 extern void SetOwnPriority(int priority);
 extern int GetOwnPriority(void);
+extern void SetOwnIoPriority(int ioPriority);
 
 
 #endif   /* CITUS_PRIORITY_H */
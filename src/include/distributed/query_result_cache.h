@@ -0,0 +1,47 @@
+/*-------------------------------------------------------------------------
+ *
+ * query_result_cache.h
+ *	  Opt-in cache of the results of repeated read-only distributed queries,
+ *	  invalidated by per-shard modification counters in shared memory.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef QUERY_RESULT_CACHE_H
+#define QUERY_RESULT_CACHE_H
+
+#include "distributed/multi_physical_planner.h"
+#include "nodes/params.h"
+#include "utils/tuplestore.h"
+
+
+/* GUC, milliseconds for which query results are cached, 0 to disable */
+extern int QueryResultCacheTTL;
+
+/* GUC, maximum size of the cached query results of a backend in kB */
+extern int QueryResultCacheSize;
+
+
+typedef struct QueryResultCacheState QueryResultCacheState;
+
+extern void InitializeQueryResultCache(void);
+extern size_t QueryResultCacheShmemSize(void);
+extern void QueryResultCacheShmemInit(void);
+extern void RecordShardModification(uint64 shardId);
+extern void QueryResultCacheAtCommit(void);
+extern void QueryResultCacheAtPrepare(void);
+extern void QueryResultCacheAtAbort(void);
+extern void QueryResultCacheBeforePrepare(const char *gid);
+extern void QueryResultCacheAfterFinishPrepared(const char *gid, bool isCommit);
+extern bool ShouldCacheQueryResult(DistributedPlan *distributedPlan);
+extern Tuplestorestate * LookupQueryResultCache(List *taskList,
+												ParamListInfo paramListInfo,
+												TupleDesc tupleDescriptor,
+												QueryResultCacheState **cacheState);
+extern void StoreQueryResult(QueryResultCacheState *cacheState,
+							 Tuplestorestate *tupleStore,
+							 TupleDesc tupleDescriptor);
+
+#endif /* QUERY_RESULT_CACHE_H */
@@ -11,9 +11,14 @@
 #define QUERY_STATS_H
 
 #include "distributed/multi_server_executor.h"
+#include "distributed/planner_timing.h"
+#include "executor/instrument.h"
 
 #define STATS_SHARED_MEM_NAME "citus_query_stats"
 
+/* leading comment of task queries that carries the query identifier to workers */
+#define CITUS_QUERY_ID_COMMENT_PREFIX "/* citus_query_id="
+
 extern Size CitusQueryStatsSharedMemSize(void);
 extern void InitializeCitusQueryStats(void);
 extern void CitusQueryStatsExecutorsEntry(uint64 queryId, MultiExecutorType executorType,
@@ -21,7 +26,54 @@ extern void CitusQueryStatsExecutorsEntry(uint64 queryId, MultiExecutorType exec
 extern void CitusQueryStatsSynchronizeEntries(void);
 extern int StatStatementsPurgeInterval;
 extern int StatStatementsMax;
+extern int StatStatementsTaskTimingsMax;
+extern int StatStatementsWorkerMax;
 extern int StatStatementsTrack;
+extern bool StatStatementsTrackWorkers;
+
+/*
+ * Number of buckets in the task timing histograms, bucket i counts durations
+ * between 2^i and 2^(i+1) microseconds and the last bucket counts all longer
+ * durations.
+ */
+#define TASK_TIMING_HISTOGRAM_BUCKETS 24
+
+/* phases of the execution of a task, see citus_stat_statements_task_timings */
+typedef enum TaskTimingPhase
+{
+	/* until a connection is available, e.g. while connecting to the worker */
+	TASK_TIMING_CONNECTION_WAIT = 0,
+
+	/* until the query is sent over the connection */
+	TASK_TIMING_QUERY_SEND = 1,
+
+	/* until the first result arrives, mostly the execution on the worker */
+	TASK_TIMING_FIRST_RESULT = 2,
+
+	/* until the last result arrives */
+	TASK_TIMING_RESULT_TRANSFER = 3,
+
+	TASK_TIMING_PHASE_COUNT = 4
+} TaskTimingPhase;
+
+/* histograms of the durations of the phases of a set of tasks */
+typedef struct TaskTimingHistogram
+{
+	int64 taskCount;
+	uint32 bucketCounts[TASK_TIMING_PHASE_COUNT][TASK_TIMING_HISTOGRAM_BUCKETS];
+} TaskTimingHistogram;
+
+extern void AddTaskTimingToHistogram(TaskTimingHistogram *histogram,
+									 TaskTimingPhase phase, uint64 durationMicrosecs);
+extern void CitusQueryStatsTaskTimingsEntry(uint64 queryId, const char *nodeName,
+											int nodePort,
+											TaskTimingHistogram *histogram);
+extern void CitusQueryStatsPlannerTimingsEntry(uint64 queryId,
+											   PlannerPhaseTimings *timings);
+extern char * QueryStringWithCitusQueryId(uint64 queryId, const char *queryString);
+extern uint64 CitusQueryIdFromQueryString(const char *queryString);
+extern void CitusQueryStatsWorkerEntry(uint64 queryId, instr_time startTime,
+									   BufferUsage *startBufferUsage, uint64 rows);
 
 
 typedef enum
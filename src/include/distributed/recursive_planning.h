@@ -20,6 +20,12 @@
 
 typedef struct RecursivePlanningContextInternal RecursivePlanningContext;
 
+/* GUC, whether identical subqueries and CTEs share a subplan */
+extern bool EnableSubPlanDeduplication;
+
+/* GUC, whether filters on recursively planned CTEs are pushed into the CTEs */
+extern bool EnableCTEPredicatePushdown;
+
 typedef struct RangeTblEntryIndex
 {
 	RangeTblEntry *rangeTableEntry;
@@ -0,0 +1,35 @@
+/*-------------------------------------------------------------------------
+ *
+ * reference_table_write_batch.h
+ *	  Batching of single-row modifications of reference tables and hash
+ *	  distributed tables within a transaction block.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef REFERENCE_TABLE_WRITE_BATCH_H
+#define REFERENCE_TABLE_WRITE_BATCH_H
+
+#include "distributed/multi_physical_planner.h"
+#include "nodes/params.h"
+#include "nodes/plannodes.h"
+
+
+/* GUC, maximum number of reference table writes we hold back in a transaction */
+extern int ReferenceTableWriteBatchSize;
+
+/* GUC, maximum number of distributed table writes we hold back in a transaction */
+extern int DistributedTableWriteBatchSize;
+
+
+extern bool IsReferenceTableWriteBatchCandidate(PlannedStmt *plannedStmt);
+extern bool ShouldBatchReferenceTableWrite(DistributedPlan *distributedPlan,
+										   ParamListInfo paramListInfo);
+extern void BatchReferenceTableWrite(Task *task);
+extern bool HasPendingReferenceTableWrites(void);
+extern void FlushReferenceTableWrites(void);
+extern void DiscardReferenceTableWrites(void);
+
+#endif /* REFERENCE_TABLE_WRITE_BATCH_H */
@@ -25,9 +25,17 @@ extern char *GrepRemoteCommands;
 /* GUC that determines the number of bytes after which remote COPY is flushed */
 extern int RemoteCopyFlushThreshold;
 
+/* GUC, whether the COPY flush threshold adapts to the throughput of connections */
+extern bool EnableAdaptiveCopyFlush;
+
 
 /* simple helpers */
 extern bool IsResponseOK(PGresult *result);
+extern bool IsPipelineSyncResult(PGresult *result);
+extern bool InPipelineMode(MultiConnection *connection);
+extern bool EnterPipelineMode(MultiConnection *connection);
+extern bool SendPipelineSync(MultiConnection *connection);
+extern bool ExitPipelineModeIfDone(MultiConnection *connection);
 extern void ForgetResults(MultiConnection *connection);
 extern bool ClearResults(MultiConnection *connection, bool raiseErrors);
 extern bool ClearResultsDiscardWarnings(MultiConnection *connection, bool raiseErrors);
@@ -65,6 +73,9 @@ extern bool PutRemoteCopyEnd(MultiConnection *connection, const char *errormsg);
 
 /* waiting for multiple command results */
 extern void WaitForAllConnections(List *connectionList, bool raiseInterrupts);
+extern void WaitForAllConnectionsWithWaitEvent(List *connectionList,
+											   bool raiseInterrupts,
+											   uint32 waitEventInfo);
 
 extern bool SendCancelationRequest(MultiConnection *connection);
 
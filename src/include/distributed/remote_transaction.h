@@ -86,6 +86,12 @@ typedef struct RemoteTransaction
 
 	/* set when BEGIN is sent over the connection */
 	bool beginSent;
+
+	/* set when the cluster clock adjustment is sent along with COMMIT/PREPARE */
+	bool clockAdjustmentSent;
+
+	/* set when the WAL position is requested along with COMMIT */
+	bool walPositionRequested;
 } RemoteTransaction;
 
 
@@ -0,0 +1,24 @@
+/*-------------------------------------------------------------------------
+ *
+ * repartition_join_filter.h
+ *	  Join key filters for dual repartition joins.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef REPARTITION_JOIN_FILTER_H
+#define REPARTITION_JOIN_FILTER_H
+
+#include "distributed/multi_physical_planner.h"
+#include "tcop/dest.h"
+
+
+extern void ExecuteRepartitionJoinFilters(Job *topLevelJob);
+extern bytea * ReadJoinKeyFilter(char *resultId);
+extern DestReceiver * CreateJoinKeyFilterDestReceiver(DestReceiver *innerDest,
+													  int columnIndex,
+													  bytea *joinKeyFilter);
+
+#endif /* REPARTITION_JOIN_FILTER_H */
@@ -0,0 +1,21 @@
+/*-------------------------------------------------------------------------
+ *
+ * repartition_join_skew.h
+ *	  Handling of heavy hitter join keys in dual repartition joins.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef REPARTITION_JOIN_SKEW_H
+#define REPARTITION_JOIN_SKEW_H
+
+#include "distributed/multi_physical_planner.h"
+
+
+extern void ExecuteRepartitionJoinSkewHandling(Job *topLevelJob);
+extern Datum * ReadRepartitionJoinHeavyHitters(char *resultId, Oid typeId,
+											   int32 typeMod, int *heavyHitterCount);
+
+#endif /* REPARTITION_JOIN_SKEW_H */
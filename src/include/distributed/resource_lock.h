@@ -43,7 +43,8 @@ typedef enum AdvisoryLocktagClass
 	ADV_LOCKTAG_CLASS_CITUS_CLEANUP_OPERATION_ID = 10,
 	ADV_LOCKTAG_CLASS_CITUS_LOGICAL_REPLICATION = 12,
 	ADV_LOCKTAG_CLASS_CITUS_REBALANCE_PLACEMENT_COLOCATION = 13,
-	ADV_LOCKTAG_CLASS_CITUS_BACKGROUND_TASK = 14
+	ADV_LOCKTAG_CLASS_CITUS_BACKGROUND_TASK = 14,
+	ADV_LOCKTAG_CLASS_CITUS_COLOCATED_SHARD_RESOURCES = 15
 } AdvisoryLocktagClass;
 
 /* CitusOperations has constants for citus operations */
@@ -141,6 +142,14 @@ typedef enum CitusOperations
 						 (uint32) (taskId), \
 						 ADV_LOCKTAG_CLASS_CITUS_BACKGROUND_TASK)
 
+/* reuse advisory lock, but with different, unused field 4 (15)*/
+#define SET_LOCKTAG_COLOCATED_SHARD_RESOURCES(tag, db, colocationId) \
+	SET_LOCKTAG_ADVISORY(tag, \
+						 db, \
+						 (uint32) 0, \
+						 (uint32) (colocationId), \
+						 ADV_LOCKTAG_CLASS_CITUS_COLOCATED_SHARD_RESOURCES)
+
 /*
  * DistLockConfigs are used to configure the locking behaviour of AcquireDistributedLockOnRelations
  */
@@ -209,5 +218,6 @@ extern void PreprocessLockStatement(LockStmt *stmt, ProcessUtilityContext contex
 
 extern bool EnableAcquiringUnsafeLockFromWorkers;
 extern bool SkipAdvisoryLockPermissionChecks;
+extern int CoarseShardLockThreshold;
 
 #endif /* RESOURCE_LOCK_H */
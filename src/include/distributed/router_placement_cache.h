@@ -0,0 +1,25 @@
+/*-------------------------------------------------------------------------
+ *
+ * router_placement_cache.h
+ *	  Per-backend cache of the shard and placements that the distribution
+ *	  column values of fast path router queries route to.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef ROUTER_PLACEMENT_CACHE_H
+#define ROUTER_PLACEMENT_CACHE_H
+
+#include "distributed/metadata_cache.h"
+
+
+/* GUC, whether fast path router queries use the router placement cache */
+extern bool EnableRouterPlacementCache;
+
+extern ShardInterval * RouterPlacementCacheLookup(CitusTableCacheEntry *cacheEntry,
+												  Datum distributionValue,
+												  List **placementList);
+
+#endif /* ROUTER_PLACEMENT_CACHE_H */
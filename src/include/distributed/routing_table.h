@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * routing_table.h
+ *	  Versioned routing table of the shard ranges of the colocation groups,
+ *	  for clients that route queries to the workers themselves.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef ROUTING_TABLE_H
+#define ROUTING_TABLE_H
+
+
+/* channel that is notified when a transaction that changed the metadata commits */
+#define ROUTING_TABLE_NOTIFY_CHANNEL "citus_routing_table"
+
+
+extern void InitializeRoutingTable(void);
+extern size_t RoutingTableShmemSize(void);
+extern void RoutingTableShmemInit(void);
+extern void InvalidateRoutingTableOnCommit(void);
+extern void NotifyRoutingTableChange(void);
+extern void RoutingTableAtCommit(void);
+extern void RoutingTableAtAbort(void);
+
+#endif /* ROUTING_TABLE_H */
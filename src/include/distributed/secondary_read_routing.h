@@ -0,0 +1,29 @@
+/*-------------------------------------------------------------------------
+ *
+ * secondary_read_routing.h
+ *	  Routing of read-only tasks to secondary nodes that have replayed the
+ *	  writes of the current session.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SECONDARY_READ_ROUTING_H
+#define SECONDARY_READ_ROUTING_H
+
+#include "access/xlogdefs.h"
+#include "distributed/worker_manager.h"
+
+
+/* command appended to COMMIT to learn the WAL position of the committed writes */
+#define CURRENT_WAL_POSITION_COMMAND "SELECT pg_catalog.pg_current_wal_lsn()"
+
+
+extern bool ReadFromCaughtUpSecondaries(void);
+extern void RecordNodeWritePosition(const char *nodeName, int nodePort,
+									const char *walPositionString);
+extern WorkerNode * CaughtUpSecondaryNodeForGroup(int32 groupId,
+												  WorkerNode *primaryNode);
+
+#endif /* SECONDARY_READ_ROUTING_H */
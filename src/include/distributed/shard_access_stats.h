@@ -0,0 +1,43 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_access_stats.h
+ *	  Decayed counts of the queries, rows and execution time of tasks per
+ *	  shard, kept in shared memory.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_ACCESS_STATS_H
+#define SHARD_ACCESS_STATS_H
+
+
+/* interval in milliseconds at which the maintenance daemon halves the counts */
+#define SHARD_ACCESS_STATS_DECAY_INTERVAL (5 * 60 * 1000)
+
+
+/*
+ * ShardAccessStats holds the decayed statistics of the tasks that ran on the
+ * placements of a shard.
+ */
+typedef struct ShardAccessStats
+{
+	double queryCount;
+	double rowCount;
+	double executionTimeMs;
+} ShardAccessStats;
+
+
+/* GUC, maximum number of shards whose accesses are counted, 0 to disable */
+extern int StatShardAccessMax;
+
+extern void InitializeShardAccessStats(void);
+extern size_t ShardAccessStatsShmemSize(void);
+extern void ShardAccessStatsShmemInit(void);
+extern void RecordShardAccess(uint64 shardId, uint64 rowCount,
+							  uint64 executionTimeMicrosecs);
+extern bool GetShardAccessStats(uint64 shardId, ShardAccessStats *stats);
+extern void DecayShardAccessStats(void);
+
+#endif /* SHARD_ACCESS_STATS_H */
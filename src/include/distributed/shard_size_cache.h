@@ -0,0 +1,32 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_size_cache.h
+ *	  Shared memory cache of the sizes of shard placements.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_SIZE_CACHE_H
+#define SHARD_SIZE_CACHE_H
+
+#include "nodes/pg_list.h"
+
+
+/* GUC, interval in milliseconds between shard size refreshes */
+extern int ShardSizeRefreshInterval;
+
+/* GUC, whether shard sizes are read from the cache when possible */
+extern bool UseCachedShardSizes;
+
+extern void InitializeShardSizeCache(void);
+extern size_t ShardSizeCacheShmemSize(void);
+extern void ShardSizeCacheShmemInit(void);
+extern void UpdateShardSizeCache(void);
+extern bool CachedShardPlacementSize(uint64 shardId, int32 groupId,
+									 uint64 *relationSize, uint64 *totalSize);
+extern bool CachedShardListSize(List *shardIntervalList, int32 groupId,
+								uint64 *totalSize);
+
+#endif /* SHARD_SIZE_CACHE_H */
@@ -14,6 +14,9 @@
 
 #include "distributed/utils/distribution_column_map.h"
 
+/* GUC, number of concurrent copies into which the copy of a large shard is divided */
+extern int SplitCopyParallelism;
+
 /* Split Modes supported by Shard Split API */
 typedef enum SplitMode
 {
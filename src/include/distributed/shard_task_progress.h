@@ -0,0 +1,52 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_task_progress.h
+ *	  Declarations for tracking the progress of the shard tasks of a
+ *	  distributed command, such as the index builds of CREATE INDEX.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_TASK_PROGRESS_H
+#define SHARD_TASK_PROGRESS_H
+
+#include "postgres.h"
+
+#include "nodes/pg_list.h"
+#include "port/atomics.h"
+
+
+#define INDEX_BUILD_ACTIVITY_MAGIC_NUMBER 1338
+
+/* states of a shard task in the progress monitor */
+#define SHARD_TASK_PROGRESS_WAITING 0
+#define SHARD_TASK_PROGRESS_RUNNING 1
+#define SHARD_TASK_PROGRESS_FINISHED 2
+
+
+/*
+ * ShardTaskProgress is a step of the progress monitor of a distributed
+ * command, there is one for each of its remote tasks.
+ */
+typedef struct ShardTaskProgress
+{
+	Oid relationId;
+	uint64 shardId;
+	char nodeName[255];
+	int nodePort;
+	pg_atomic_uint64 state;
+
+	/* TimestampTz values, 0 if the task did not start or finish yet */
+	pg_atomic_uint64 startTime;
+	pg_atomic_uint64 finishTime;
+} ShardTaskProgress;
+
+
+extern ShardTaskProgress * SetupShardTaskProgressMonitor(uint64 magicNumber,
+														 List *taskList);
+extern void ReportShardTaskStarted(ShardTaskProgress *taskProgress);
+extern void ReportShardTaskFinished(ShardTaskProgress *taskProgress);
+
+#endif /* SHARD_TASK_PROGRESS_H */
@@ -0,0 +1,30 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_transfer_throttle.h
+ *	  Limits for the rate at which shard data is sent to other nodes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_TRANSFER_THROTTLE_H
+#define SHARD_TRANSFER_THROTTLE_H
+
+
+/* node id used when the data is not sent to a particular node */
+#define SHARD_TRANSFER_ANY_NODE 0
+
+
+/* GUC, maximum rate in MB/s at which data is sent to a node, 0 for no limit */
+extern int MaxShardTransferRate;
+
+/* GUC, maximum rate in MB/s at which this node sends shard data, 0 for no limit */
+extern int MaxTotalShardTransferRate;
+
+extern void InitializeShardTransferThrottle(void);
+extern size_t ShardTransferThrottleShmemSize(void);
+extern void ShardTransferThrottleShmemInit(void);
+extern void ThrottleShardTransfer(uint32 targetNodeId, uint64 byteCount);
+
+#endif /* SHARD_TRANSFER_THROTTLE_H */
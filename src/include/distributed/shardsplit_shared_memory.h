@@ -15,6 +15,7 @@
 #define SHARDSPLIT_SHARED_MEMORY_H
 
 #include "postgres.h"
+#include "fmgr.h"
 
 /*
  * In-memory mapping of a split child shard.
@@ -55,6 +56,17 @@ typedef struct SourceToDestinationShardMapEntry
 {
 	Oid sourceShardKey;
 	List *shardSplitInfoList;
+
+	/*
+	 * Routing state that the decoder builds on the first change of the source
+	 * shard: the child shards sorted by hash range, such that the child of a
+	 * tuple can be found with a binary search, and the hash function of the
+	 * partition column.
+	 */
+	ShardSplitInfo **sortedShardSplitInfoArray;
+	int shardSplitInfoCount;
+	FmgrInfo *hashFunction;
+	Oid hashFunctionCollation;
 } SourceToDestinationShardMapEntry;
 
 typedef struct ShardSplitShmemData
@@ -20,6 +20,9 @@
 extern int MaxSharedPoolSize;
 extern int LocalSharedPoolSize;
 extern int MaxClientConnections;
+extern bool SharedPoolFairShare;
+extern int SharedPoolMinConnectionsPerRole;
+extern int SharedPoolWeight;
 
 
 extern void InitializeSharedConnectionStats(void);
@@ -32,9 +35,23 @@ extern int GetMaxSharedPoolSize(void);
 extern int GetLocalSharedPoolSize(void);
 extern bool TryToIncrementSharedConnectionCounter(const char *hostname, int port);
 extern void WaitLoopForSharedConnection(const char *hostname, int port);
-extern void DecrementSharedConnectionCounter(const char *hostname, int port);
+extern void DecrementSharedConnectionCounter(const char *hostname, int port,
+											 Oid roleId);
 extern void IncrementSharedConnectionCounter(const char *hostname, int port);
+extern bool SharedConnectionPoolIsFull(const char *hostname, int port);
 extern int AdaptiveConnectionManagementFlag(bool connectToLocalNode, int
 											activeConnectionCount);
+extern void RecordWorkerConnectionEstablishmentTime(const char *hostname, int port,
+													double durationMicrosecs);
+extern void RecordWorkerTaskExecutionTime(const char *hostname, int port,
+										  uint64 queryShapeId,
+										  double durationMicrosecs);
+extern void GetWorkerLatencyEstimates(const char *hostname, int port,
+									  uint64 queryShapeId,
+									  double *avgTaskExecutionTime,
+									  double *avgConnectionEstablishmentTime);
+extern void AdjustWorkerRunningTaskCount(const char *hostname, int port, int delta);
+extern void GetWorkerLoad(const char *hostname, int port, int *runningTaskCount,
+						  double *avgTaskExecutionTime);
 
 #endif /* SHARED_CONNECTION_STATS_H */
@@ -0,0 +1,55 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_metadata_cache.h
+ *	  Shards and shard placements of Citus tables, shared across backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARED_METADATA_CACHE_H
+#define SHARED_METADATA_CACHE_H
+
+#include "access/htup.h"
+#include "nodes/pg_list.h"
+
+
+/*
+ * DistShardMetadata is a pg_dist_shard tuple together with the placements
+ * of the shard, as read from pg_dist_placement.
+ */
+typedef struct DistShardMetadata
+{
+	HeapTuple shardTuple;
+
+	/* list of GroupShardPlacement * */
+	List *placementList;
+} DistShardMetadata;
+
+
+/* GUC, size of the shared metadata cache in kB, 0 to disable */
+extern int SharedMetadataCacheSize;
+
+/* GUC, whether placement changes only invalidate the placements of the shard */
+extern bool EnableShardLevelInvalidation;
+
+extern void InitializeSharedMetadataCache(void);
+extern size_t SharedMetadataCacheShmemSize(void);
+extern void SharedMetadataCacheShmemInit(void);
+extern bool SharedMetadataCacheBeginRead(uint64 *version);
+extern bool SharedMetadataCacheLookup(Oid relationId, uint64 version,
+									  List **shardMetadataList);
+extern void SharedMetadataCacheStore(Oid relationId, uint64 version,
+									 List *shardMetadataList);
+extern void InvalidateSharedMetadataCacheOnCommit(Oid relationId, uint64 shardId);
+extern uint64 ShardInvalidationLogPosition(void);
+extern bool ShardsChangedSinceLogPosition(Oid relationId, uint64 position,
+										  List **shardIdList);
+extern void SharedMetadataCacheAtCommit(void);
+extern void SharedMetadataCacheAtPrepare(void);
+extern void SharedMetadataCacheAtAbort(void);
+extern void SharedMetadataCacheBeforePrepare(const char *gid);
+extern void SharedMetadataCacheAfterFinishPrepared(const char *gid, bool isCommit);
+
+#endif /* SHARED_METADATA_CACHE_H */
@@ -0,0 +1,43 @@
+/*-------------------------------------------------------------------------
+ *
+ * sorted_merge.h
+ *	  Merging the sorted results of the tasks of a distributed query.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SORTED_MERGE_H
+#define SORTED_MERGE_H
+
+#include "distributed/tuple_destination.h"
+#include "executor/tuptable.h"
+#include "nodes/parsenodes.h"
+#include "nodes/pg_list.h"
+
+
+typedef struct SortedMergeState SortedMergeState;
+
+
+/* GUC, determines whether we merge sorted task results on the coordinator */
+extern bool EnableSortedMerge;
+
+/* GUC, determines whether the workers sort groups to merge them on the coordinator */
+extern bool EnableSortedMergeAggregation;
+
+
+extern List * SortedMergeClauseList(Query *combineQuery, Query *workerQuery);
+extern SortedMergeState * CreateSortedMergeState(List *sortClauseList,
+												 TupleDesc tupleDescriptor,
+												 TupleDestination *defaultTupleDest);
+extern List * SortedMergeTaskList(SortedMergeState *mergeState, List *taskList);
+extern void SortedMergeTaskFinished(SortedMergeState *mergeState, Task *task);
+extern void SortedMergeExecutionFinished(SortedMergeState *mergeState);
+extern bool SortedMergeHasNextTuple(SortedMergeState *mergeState);
+extern bool SortedMergeGetNextTuple(SortedMergeState *mergeState,
+									TupleTableSlot *slot);
+extern void SortedMergeIntoTupleStore(SortedMergeState *mergeState,
+									  Tuplestorestate *tupleStore);
+
+#endif /* SORTED_MERGE_H */
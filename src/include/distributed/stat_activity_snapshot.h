@@ -0,0 +1,26 @@
+/*-------------------------------------------------------------------------
+ *
+ * stat_activity_snapshot.h
+ *	  Shared memory snapshot of the activity on all nodes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef STAT_ACTIVITY_SNAPSHOT_H
+#define STAT_ACTIVITY_SNAPSHOT_H
+
+
+/* GUC, interval in milliseconds between activity snapshots */
+extern int StatActivitySnapshotInterval;
+
+/* GUC, maximum age in milliseconds of a snapshot that may be read */
+extern int StatActivityMaxStaleness;
+
+extern void InitializeStatActivitySnapshot(void);
+extern size_t StatActivitySnapshotShmemSize(void);
+extern void StatActivitySnapshotShmemInit(void);
+extern void UpdateStatActivitySnapshot(void);
+
+#endif /* STAT_ACTIVITY_SNAPSHOT_H */
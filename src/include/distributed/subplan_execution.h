@@ -13,11 +13,17 @@
 
 
 #include "distributed/multi_physical_planner.h"
+#include "utils/tuplestore.h"
 
 extern int MaxIntermediateResult;
 extern int SubPlanLevel;
+extern bool EnableParallelSubPlans;
+extern int InlineIntermediateResultThreshold;
 
 extern void ExecuteSubPlans(DistributedPlan *distributedPlan);
+extern DistributedPlan * ExecuteSubPlansAndInlineResults(DistributedPlan *
+														 distributedPlan);
+extern Tuplestorestate * TakePrefetchedSubPlanResult(DistributedPlan *distributedPlan);
 
 /**
  * IntermediateResultsHashEntry is used to store which nodes need to receive
@@ -0,0 +1,24 @@
+/*-------------------------------------------------------------------------
+ *
+ * table_row_estimates.h
+ *	  Shared memory cache of row count estimates for Citus tables.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef TABLE_ROW_ESTIMATES_H
+#define TABLE_ROW_ESTIMATES_H
+
+
+/* GUC, interval in milliseconds between row estimate refreshes */
+extern int TableRowEstimateRefreshInterval;
+
+extern void InitializeTableRowEstimates(void);
+extern size_t TableRowEstimatesShmemSize(void);
+extern void TableRowEstimatesShmemInit(void);
+extern void UpdateTableRowEstimates(void);
+extern bool TableRowEstimate(Oid relationId, double *rowCount);
+
+#endif /* TABLE_ROW_ESTIMATES_H */
@@ -0,0 +1,75 @@
+/*-------------------------------------------------------------------------
+ *
+ * tenant_load_stats.h
+ *	  Decayed statistics of sampled router queries per distribution column
+ *	  value, kept in shared memory.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef TENANT_LOAD_STATS_H
+#define TENANT_LOAD_STATS_H
+
+#include "distributed/multi_physical_planner.h"
+#include "utils/pg_rusage.h"
+
+
+/* interval in milliseconds at which the maintenance daemon halves the counts */
+#define TENANT_LOAD_STATS_DECAY_INTERVAL (5 * 60 * 1000)
+
+/* distribution column values of this length or longer are not sampled */
+#define TENANT_VALUE_MAX_LENGTH 64
+
+
+/*
+ * TenantLoad describes the sampled load of a distribution column value in
+ * its colocation group.
+ *
+ * The calls, rows and times are estimates for all queries of the tenant,
+ * extrapolated from the sampled queries. The sample count of a tenant may be
+ * overestimated by up to sampleCountError, see AddTenantLoadSample.
+ */
+typedef struct TenantLoad
+{
+	uint32 colocationId;
+	Oid relationId;
+	char tenantValue[TENANT_VALUE_MAX_LENGTH];
+	double calls;
+	double rows;
+	double totalTimeMs;
+	double cpuTimeMs;
+	double sampleCount;
+	double sampleCountError;
+	double groupSampleCount;
+} TenantLoad;
+
+
+/*
+ * TenantLoadSample is a router query whose distribution column value is
+ * sampled, from the start of its execution.
+ */
+typedef struct TenantLoadSample
+{
+	uint32 colocationId;
+	Oid relationId;
+	char tenantValue[TENANT_VALUE_MAX_LENGTH];
+	double sampleRate;
+	PGRUsage startUsage;
+} TenantLoadSample;
+
+
+/* GUC, fraction of the router queries whose distribution value is sampled */
+extern double TenantLoadSampleRate;
+
+extern void InitializeTenantLoadStats(void);
+extern size_t TenantLoadStatsShmemSize(void);
+extern void TenantLoadStatsShmemInit(void);
+extern TenantLoadSample * StartTenantLoadSample(Job *job);
+extern void FinishTenantLoadSample(TenantLoadSample *sample, uint64 rowCount);
+extern List * TenantLoadList(void);
+extern void RemoveTenantLoad(uint32 colocationId, const char *tenantValue);
+extern void DecayTenantLoadStats(void);
+
+#endif /* TENANT_LOAD_STATS_H */
@@ -0,0 +1,54 @@
+/*-------------------------------------------------------------------------
+ *
+ * trace_context.h
+ *	  Propagation of W3C trace contexts to the commands sent to workers.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef TRACE_CONTEXT_H
+#define TRACE_CONTEXT_H
+
+
+/* length of a version 00 traceparent, e.g. 00-<trace id>-<span id>-<flags> */
+#define TRACE_PARENT_LENGTH 55
+
+/* leading comment of task queries that carries the trace context to workers */
+#define TRACE_PARENT_COMMENT_PREFIX "/* traceparent='"
+
+
+/*
+ * CitusTraceSpanHook is called for each task that the adaptive executor ran
+ * on a worker with a trace context, such that external collectors can record
+ * a child span of the statement.
+ */
+typedef void (*CitusTraceSpanHookType)(const char *traceParent,
+									   const char *parentTraceParent,
+									   const char *nodeName, int nodePort,
+									   uint64 shardId, double durationMillisecs,
+									   bool succeeded);
+extern PGDLLIMPORT CitusTraceSpanHookType CitusTraceSpanHook;
+
+/* GUC, W3C traceparent of the current statement */
+extern char *TraceContext;
+
+/* GUC, whether the trace context is sent to the workers */
+extern bool PropagateTraceContext;
+
+
+extern bool IsValidTraceParent(const char *traceParent);
+extern bool ShouldPropagateTraceContext(void);
+extern char * CreateChildTraceParent(void);
+extern char * QueryStringWithTraceParent(const char *traceParent,
+										 const char *queryString);
+extern void ReportTraceSpan(const char *traceParent, const char *nodeName,
+							int nodePort, uint64 shardId, double durationMillisecs,
+							bool succeeded);
+extern bool SetReceivedTraceContext(const char *queryString);
+extern void ResetReceivedTraceContext(void);
+extern const char * CurrentTraceContext(void);
+extern void TraceContextErrorCallback(void *arg);
+
+#endif /* TRACE_CONTEXT_H */
@@ -116,6 +116,9 @@ extern bool SelectOpensTransactionBlock;
  */
 extern bool FunctionOpensTransactionBlock;
 
+/* GUC, commit_delay in microseconds for the commit of 2PC transactions */
+extern int TwoPhaseCommitDelay;
+
 /* state needed to prevent new connections during modifying transactions */
 extern XactModificationType XactModificationLevel;
 
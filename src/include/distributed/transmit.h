@@ -18,10 +18,14 @@
 #include "storage/fd.h"
 
 
+/* GUC, whether files are sent to clients without copying them into userspace */
+extern bool EnableZeroCopyResultTransfer;
+
 /* Function declarations for transmitting files between two nodes */
 extern void RedirectCopyDataToRegularFile(const char *filename);
 extern void SendRegularFile(const char *filename);
 extern File FileOpenForTransmit(const char *filename, int fileFlags, int fileMode);
+extern bool ReceiveCopyData(StringInfo copyData);
 
 
 #endif   /* TRANSMIT_H */
@@ -18,6 +18,9 @@
 
 typedef struct TupleDestination TupleDestination;
 
+/* GUC, whether large result sets are stored with compressed values */
+extern bool EnableSpilledResultCompression;
+
 
 /*
  * TupleDestinationStats holds the size related stats.
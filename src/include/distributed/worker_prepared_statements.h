@@ -0,0 +1,28 @@
+/*-------------------------------------------------------------------------
+ *
+ * worker_prepared_statements.h
+ *	  Named prepared statements on worker connections.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef WORKER_PREPARED_STATEMENTS_H
+#define WORKER_PREPARED_STATEMENTS_H
+
+#include "distributed/connection_management.h"
+
+
+/* GUC, whether to use named prepared statements for parameterized router queries */
+extern bool EnableWorkerPreparedStatements;
+
+
+extern int SendRemoteCommandPrepared(MultiConnection *connection, const char *command,
+									 int parameterCount, const Oid *parameterTypes,
+									 const char *const *parameterValues,
+									 bool binaryResults);
+extern void InvalidateWorkerPreparedStatements(void);
+extern void FreeWorkerPreparedStatementCache(MultiConnection *connection);
+
+#endif /* WORKER_PREPARED_STATEMENTS_H */
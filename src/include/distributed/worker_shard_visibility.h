@@ -15,6 +15,7 @@
 
 extern bool OverrideTableVisibility;
 extern bool EnableManualChangesToShards;
+extern bool EnableKnownShardCache;
 extern char *ShowShardsForAppNamePrefixes;
 
 
@@ -47,6 +47,9 @@ typedef enum TargetWorkerSet
 } TargetWorkerSet;
 
 
+/* GUC, number of nodes to which metadata commands are sent at the same time */
+extern int MaxParallelMetadataSyncNodes;
+
 /* Functions declarations for worker transactions */
 extern List * GetWorkerTransactions(void);
 extern List * TargetWorkerSetNodeList(TargetWorkerSet targetWorkerSet, LOCKMODE lockMode);
@@ -87,6 +90,10 @@ extern void SendMetadataCommandListToWorkerListInCoordinatedTransaction(
 	const char *
 	nodeUser,
 	List *commandList);
+extern void SendMetadataCommandListPerWorkerInCoordinatedTransaction(
+	List *workerNodeList,
+	const char *nodeUser,
+	List *commandListPerWorker);
 extern void RemoveWorkerTransaction(const char *nodeName, int32 nodePort);
 
 /* helper functions for worker transactions */
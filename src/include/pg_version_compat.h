@@ -22,6 +22,7 @@
 	"CREATE %sSEQUENCE IF NOT EXISTS %s AS %s INCREMENT BY " INT64_FORMAT \
 	" MINVALUE " INT64_FORMAT " MAXVALUE " INT64_FORMAT \
 	" START WITH " INT64_FORMAT " CACHE " INT64_FORMAT " %sCYCLE"
+#define shm_mq_send_compat(a, b, c, d, e) shm_mq_send(a, b, c, d, e)
 #else
 
 #include "nodes/value.h"
@@ -71,6 +72,8 @@ RelationGetSmgr(Relation rel)
 	" MINVALUE " INT64_FORMAT " MAXVALUE " INT64_FORMAT \
 	" START WITH " INT64_FORMAT " CACHE " INT64_FORMAT " %sCYCLE"
 
+#define shm_mq_send_compat(a, b, c, d, e) shm_mq_send(a, b, c, d)
+
 #endif
 
 #if PG_VERSION_NUM >= PG_VERSION_14
@@ -97,6 +100,8 @@ RelationGetSmgr(Relation rel)
 #define RelationGetPartitionDesc_compat(a, b) RelationGetPartitionDesc(a, b)
 #define make_simple_restrictinfo_compat(a, b) make_simple_restrictinfo(a, b)
 #define pull_varnos_compat(a, b) pull_varnos(a, b)
+#define ExecInsertIndexTuples_compat(a, b, c, d, e, f, g) \
+	ExecInsertIndexTuples(a, b, c, d, e, f, g)
 #else
 #define AlterTableStmtObjType_compat(a) ((a)->relkind)
 #define F_NEXTVAL F_NEXTVAL_OID
@@ -131,7 +136,10 @@ RelationGetSmgr(Relation rel)
 #define PQ_LARGE_MESSAGE_LIMIT 0
 #define make_simple_restrictinfo_compat(a, b) make_simple_restrictinfo(b)
 #define pull_varnos_compat(a, b) pull_varnos(b)
+#define ExecInsertIndexTuples_compat(a, b, c, d, e, f, g) \
+	ExecInsertIndexTuples(b, c, e, f, g)
 #define ROLE_PG_READ_ALL_STATS DEFAULT_ROLE_READ_ALL_STATS
+#define ROLE_PG_READ_SERVER_FILES DEFAULT_ROLE_READ_SERVER_FILES
 #endif
 
 #define SetListCellPtr(a, b) ((a)->ptr_value = (b))
@@ -35,6 +35,7 @@ MIXED_BEFORE_CITUS_UPGRADE_SCHEDULE = "./mixed_before_citus_upgrade_schedule"
 MIXED_AFTER_CITUS_UPGRADE_SCHEDULE = "./mixed_after_citus_upgrade_schedule"
 
 CITUS_ARBITRARY_TEST_DIR = "./tmp_citus_test"
+CITUS_PERF_TEST_DIR = "./tmp_citus_perf"
 
 MASTER = "master"
 # This should be updated when citus version changes
@@ -173,7 +174,11 @@ class CitusUpgradeConfig(CitusBaseClusterConfig):
         self.pre_tar_path = arguments["--citus-pre-tar"]
         self.post_tar_path = arguments["--citus-post-tar"]
         self.temp_dir = "./tmp_citus_upgrade"
-        self.new_settings = {"citus.enable_version_checks": "false"}
+        self.new_settings = {
+            "citus.enable_version_checks": "false",
+            # the old columnar stripes are read through the chunk cache after the upgrade
+            "columnar.chunk_cache_size": "16MB",
+        }
         self.user = SUPER_USER_NAME
         self.mixed_mode = arguments["--mixed"]
         self.fixed_port = 57635
@@ -347,6 +352,23 @@ class CitusNonMxClusterConfig(CitusDefaultClusterConfig):
         self.skip_tests = ["function_create", "functions", "nested_execution"]
 
 
+class CitusPerfConfig(CitusBaseClusterConfig):
+    def __init__(self, arguments):
+        super().__init__(arguments)
+        self.temp_dir = CITUS_PERF_TEST_DIR
+        self.user = SUPER_USER_NAME
+        self.add_coordinator_to_metadata = True
+        self.new_settings = {
+            "client_min_messages": "WARNING",
+            "log_min_messages": "WARNING",
+            "log_error_verbosity": "default",
+            "shared_buffers": "256MB",
+            "max_wal_size": "4GB",
+            "checkpoint_timeout": "30min",
+            "synchronous_commit": False,
+        }
+
+
 class PGUpgradeConfig(CitusBaseClusterConfig):
     def __init__(self, arguments):
         super().__init__(arguments)
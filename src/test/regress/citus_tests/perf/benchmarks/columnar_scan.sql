@@ -0,0 +1 @@
+SELECT value, count(*), sum(other_key) FROM perf_columnar GROUP BY value;
@@ -0,0 +1 @@
+COPY perf_copy FROM PROGRAM 'seq -f ''%g,copied'' 1 10000' WITH (format csv);
@@ -0,0 +1,2 @@
+\set key random(1, 100000 * :scale)
+SELECT value, counter FROM perf_router WHERE key = :key;
@@ -0,0 +1,2 @@
+\set value random(0, 96)
+INSERT INTO perf_insert_select SELECT key, other_key, value FROM perf_events WHERE value = :value;
@@ -0,0 +1,4 @@
+\set value random(0, 96)
+SELECT count(*)
+FROM perf_events e JOIN perf_router r ON (e.other_key = r.key)
+WHERE e.value = :value;
@@ -0,0 +1,2 @@
+\set key random(1, 1000000000)
+INSERT INTO perf_insert VALUES (:key, 'inserted');
@@ -0,0 +1,5 @@
+\set key random(1, 100000 * :scale)
+SELECT r.value, count(e.key)
+FROM perf_router r LEFT JOIN perf_events e USING (key)
+WHERE r.key = :key
+GROUP BY r.value;
@@ -0,0 +1,41 @@
+-- Creates the tables the benchmarks run against. The number of rows scales with
+-- the psql variable scale, which the driver sets from --scale.
+SET citus.shard_replication_factor TO 1;
+SET client_min_messages TO WARNING;
+
+-- router queries and fast-path prepared statements
+CREATE TABLE perf_router (key bigint PRIMARY KEY, value text, counter bigint DEFAULT 0);
+SELECT create_distributed_table('perf_router', 'key');
+INSERT INTO perf_router (key, value)
+SELECT s, 'value ' || s FROM generate_series(1, 100000 * :scale) s;
+
+-- multi-shard aggregates, repartition joins and the source of INSERT..SELECT
+CREATE TABLE perf_events (key bigint, other_key bigint, value int);
+SELECT create_distributed_table('perf_events', 'key', colocate_with := 'perf_router');
+INSERT INTO perf_events
+SELECT s, (s * 7919) % (100000 * :scale) + 1, s % 97
+FROM generate_series(1, 1000000 * :scale) s;
+
+-- router INSERTs
+CREATE TABLE perf_insert (key bigint, value text);
+SELECT create_distributed_table('perf_insert', 'key');
+
+-- COPY ingest
+CREATE TABLE perf_copy (key bigint, value text);
+SELECT create_distributed_table('perf_copy', 'key');
+
+-- distributed by a different column than perf_events, so INSERT..SELECT repartitions
+CREATE TABLE perf_insert_select (key bigint, other_key bigint, value int);
+SELECT create_distributed_table('perf_insert_select', 'other_key');
+
+-- columnar scans
+CREATE TABLE perf_columnar (key bigint, other_key bigint, value int) USING columnar;
+SELECT create_distributed_table('perf_columnar', 'key');
+INSERT INTO perf_columnar SELECT * FROM perf_events;
+
+-- shard moves, with few shards such that each move carries some data
+CREATE TABLE perf_move (key bigint, value text);
+SELECT create_distributed_table('perf_move', 'key', shard_count := 4, colocate_with := 'none');
+INSERT INTO perf_move SELECT s, 'value ' || s FROM generate_series(1, 100000 * :scale) s;
+
+VACUUM ANALYZE;
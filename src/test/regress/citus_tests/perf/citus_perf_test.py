@@ -0,0 +1,287 @@
+#!/usr/bin/env python3
+
+"""citus_perf_test
+Usage:
+    citus_perf_test --bindir=<bindir> --pgxsdir=<pgxsdir> [--benchmarks=<benchmarks>] [--duration=<duration>] [--clients=<clients>] [--scale=<scale>] [--output=<output>] [--compare=<compare>]
+
+Options:
+    --bindir=<bindir>              The PostgreSQL executable directory(ex: '~/.pgenv/pgsql-11.3/bin')
+    --pgxsdir=<pgxsdir>            Path to the PGXS directory(ex: ~/.pgenv/src/postgresql-11.3)
+    --benchmarks=<benchmarks>      Comma separated names of the benchmarks to run, all by default
+    --duration=<duration>          Duration of each pgbench benchmark in seconds [default: 30]
+    --clients=<clients>            Number of pgbench clients [default: 8]
+    --scale=<scale>                Scale factor of the benchmark data [default: 1]
+    --output=<output>              Path of the JSON results file [default: perf_results.json]
+    --compare=<compare>            Path of a JSON results file of another commit to compare with
+"""
+import sys
+import os
+import json
+import re
+import subprocess
+import time
+import datetime
+
+# https://stackoverflow.com/questions/14132789/relative-imports-for-the-billionth-time/14132912#14132912
+sys.path.append(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+import common
+import config as cfg
+import utils
+from utils import USER
+from docopt import docopt
+
+
+BENCHMARK_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "benchmarks")
+SETUP_SCRIPT = os.path.join(BENCHMARK_DIR, "setup.sql")
+
+# pgbench benchmarks, by name, with the script and the query protocol they use
+PGBENCH_BENCHMARKS = {
+    "router_select": ("router_select.sql", "simple"),
+    "router_insert": ("router_insert.sql", "simple"),
+    "fast_path_prepared": ("fast_path_select.sql", "prepared"),
+    "multi_shard_aggregate": ("multi_shard_aggregate.sql", "simple"),
+    "copy_ingest": ("copy_ingest.sql", "simple"),
+    "repartition_join": ("repartition_join.sql", "simple"),
+    "insert_select": ("insert_select.sql", "simple"),
+    "columnar_scan": ("columnar_scan.sql", "simple"),
+}
+
+# benchmarks that the driver times itself, since pgbench cannot run them
+SHARD_MOVE_BENCHMARK = "shard_move"
+SHARD_MOVE_COUNT = 6
+
+ALL_BENCHMARKS = list(PGBENCH_BENCHMARKS.keys()) + [SHARD_MOVE_BENCHMARK]
+
+
+def option_value(arguments, name, default):
+    # make passes empty values for variables that are not set
+    value = arguments[name]
+    if value is None or value == "":
+        return default
+    return value
+
+
+def current_commit():
+    try:
+        return (
+            subprocess.check_output(
+                ["git", "rev-parse", "HEAD"], stderr=subprocess.DEVNULL
+            )
+            .decode()
+            .strip()
+        )
+    except (subprocess.CalledProcessError, OSError):
+        return None
+
+
+def load_benchmark_data(config, scale):
+    command = [
+        os.path.join(config.bindir, "psql"),
+        "-U",
+        USER,
+        "-p",
+        str(config.coordinator_port()),
+        "-v",
+        "ON_ERROR_STOP=1",
+        "-v",
+        "scale={}".format(scale),
+        "-f",
+        SETUP_SCRIPT,
+        "--no-psqlrc",
+        "--quiet",
+    ]
+    subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+
+
+def parse_pgbench_output(output):
+    result = {}
+
+    # PG13 reports the tps with and without connection establishment, we
+    # want the latter, which comes last
+    tps_matches = re.findall(r"^tps = ([0-9.]+)", output, re.MULTILINE)
+    if tps_matches:
+        result["tps"] = float(tps_matches[-1])
+
+    patterns = {
+        "transactions": r"^number of transactions actually processed: ([0-9]+)",
+        "failed_transactions": r"^number of failed transactions: ([0-9]+)",
+        "latency_avg_ms": r"^latency average = ([0-9.]+) ms",
+        "latency_stddev_ms": r"^latency stddev = ([0-9.]+) ms",
+    }
+    for key, pattern in patterns.items():
+        match = re.search(pattern, output, re.MULTILINE)
+        if match:
+            value = match.group(1)
+            result[key] = float(value) if "." in value else int(value)
+
+    return result
+
+
+def run_pgbench_benchmark(config, name, duration, clients, scale):
+    script, protocol = PGBENCH_BENCHMARKS[name]
+    command = [
+        os.path.join(config.bindir, "pgbench"),
+        "-U",
+        USER,
+        "-p",
+        str(config.coordinator_port()),
+        "--no-vacuum",
+        "--file",
+        os.path.join(BENCHMARK_DIR, script),
+        "--protocol",
+        protocol,
+        "--client",
+        str(clients),
+        "--jobs",
+        str(clients),
+        "--time",
+        str(duration),
+        "--define",
+        "scale={}".format(scale),
+        "postgres",
+    ]
+    completed = subprocess.run(
+        command, check=True, stdout=subprocess.PIPE, stderr=subprocess.STDOUT
+    )
+    output = completed.stdout.decode()
+
+    result = parse_pgbench_output(output)
+    result.update({"clients": clients, "duration_s": duration, "protocol": protocol})
+    return result
+
+
+def run_shard_move_benchmark(config):
+    port = config.coordinator_port()
+    shard_id = int(
+        utils.psql_capture(
+            config.bindir,
+            port,
+            "SELECT min(shardid) FROM pg_dist_shard "
+            "WHERE logicalrelid = 'perf_move'::regclass",
+        )
+    )
+
+    durations = []
+    for _ in range(SHARD_MOVE_COUNT):
+        source_port = int(
+            utils.psql_capture(
+                config.bindir,
+                port,
+                "SELECT nodeport FROM pg_dist_shard_placement "
+                "WHERE shardid = {}".format(shard_id),
+            )
+        )
+        target_port = next(
+            worker_port
+            for worker_port in config.worker_ports
+            if worker_port != source_port
+        )
+
+        start_time = time.monotonic()
+        utils.psql_capture(
+            config.bindir,
+            port,
+            "SELECT citus_move_shard_placement({}, 'localhost', {}, 'localhost', {}, "
+            "shard_transfer_mode := 'block_writes')".format(
+                shard_id, source_port, target_port
+            ),
+        )
+        durations.append((time.monotonic() - start_time) * 1000)
+
+        # the placement on the source node is only dropped by the cleanup
+        utils.psql_capture(
+            config.bindir, port, "CALL citus_cleanup_orphaned_resources()"
+        )
+
+    return {
+        "moves": len(durations),
+        "latency_avg_ms": sum(durations) / len(durations),
+        "latency_min_ms": min(durations),
+        "latency_max_ms": max(durations),
+    }
+
+
+def compare_results(results, compare_path):
+    with open(compare_path) as compare_file:
+        previous = json.load(compare_file)
+
+    print(
+        "\nComparison with {}:".format(previous.get("commit") or compare_path)
+    )
+    for name, result in results["benchmarks"].items():
+        previous_result = previous.get("benchmarks", {}).get(name)
+        if previous_result is None:
+            continue
+
+        for key in ("tps", "latency_avg_ms"):
+            if key in result and previous_result.get(key):
+                change = (result[key] - previous_result[key]) / previous_result[key]
+                print(
+                    "  {:<24} {:<16} {:>12.2f} -> {:>12.2f} ({:+.1%})".format(
+                        name, key, previous_result[key], result[key], change
+                    )
+                )
+
+
+def main(config, arguments):
+    duration = int(option_value(arguments, "--duration", 30))
+    clients = int(option_value(arguments, "--clients", 8))
+    scale = int(option_value(arguments, "--scale", 1))
+    output_path = option_value(arguments, "--output", "perf_results.json")
+    compare_path = option_value(arguments, "--compare", None)
+
+    benchmarks = ALL_BENCHMARKS
+    benchmark_names = option_value(arguments, "--benchmarks", None)
+    if benchmark_names is not None:
+        benchmarks = benchmark_names.split(",")
+        for name in benchmarks:
+            if name not in ALL_BENCHMARKS:
+                sys.exit(
+                    "unknown benchmark {}, available benchmarks are: {}".format(
+                        name, ", ".join(ALL_BENCHMARKS)
+                    )
+                )
+
+    common.initialize_temp_dir(config.temp_dir)
+    common.initialize_citus_cluster(
+        config.bindir, config.datadir, config.settings, config
+    )
+
+    print("Loading benchmark data with scale {}".format(scale))
+    load_benchmark_data(config, scale)
+
+    results = {
+        "commit": current_commit(),
+        "started_at": datetime.datetime.utcnow().isoformat() + "Z",
+        "scale": scale,
+        "workers": config.worker_amount,
+        "benchmarks": {},
+    }
+
+    for name in benchmarks:
+        print("Running benchmark: {}".format(name))
+        if name == SHARD_MOVE_BENCHMARK:
+            result = run_shard_move_benchmark(config)
+        else:
+            result = run_pgbench_benchmark(config, name, duration, clients, scale)
+
+        results["benchmarks"][name] = result
+        print("  {}".format(json.dumps(result)))
+
+    with open(output_path, "w") as output_file:
+        json.dump(results, output_file, indent=2, sort_keys=True)
+        output_file.write("\n")
+    print("Results written to {}".format(output_path))
+
+    if compare_path is not None:
+        compare_results(results, compare_path)
+
+    common.stop_databases(
+        config.bindir, config.datadir, config.node_name_to_ports, config.name
+    )
+
+
+if __name__ == "__main__":
+    arguments = docopt(__doc__, version="citus_perf_test")
+    main(cfg.CitusPerfConfig(arguments), arguments)
@@ -492,6 +492,10 @@ push(@pgOptions, "citus.show_shards_for_app_name_prefixes='pg_regress'");
 # we disable slow start by default to encourage parallelism within tests
 push(@pgOptions, "citus.executor_slow_start_interval=0ms");
 
+# columnar scans read through the shared chunk cache, which tests can turn off
+# with columnar.enable_chunk_cache
+push(@pgOptions, "columnar.chunk_cache_size='16MB'");
+
 # we set some GUCs to not break postgres vanilla tests
 if($vanillatest)
 {
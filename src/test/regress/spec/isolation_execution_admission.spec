@@ -0,0 +1,112 @@
+// Tests that multi-shard queries wait for an admission slot when
+// citus.max_concurrent_multi_shard_queries queries run, and that the slot
+// of a query is given back when it finishes or when its subtransaction aborts.
+#include "isolation_mx_common.include.spec"
+
+// ALTER SYSTEM cannot run in the transaction of a multi-statement setup
+setup
+{
+	ALTER SYSTEM SET citus.max_concurrent_multi_shard_queries TO 1;
+}
+
+setup
+{
+	SELECT pg_reload_conf();
+
+	SET citus.next_shard_id TO 1810000;
+	SET citus.shard_count TO 4;
+	CREATE TABLE admission_items (key int, value int);
+	SELECT create_distributed_table('admission_items', 'key');
+	INSERT INTO admission_items SELECT i, i FROM generate_series(1, 10) i;
+
+	CREATE TABLE admission_other_items (key int, value int);
+	SELECT create_distributed_table('admission_other_items', 'key');
+	INSERT INTO admission_other_items SELECT i, i FROM generate_series(1, 10) i;
+}
+
+teardown
+{
+	SELECT pg_reload_conf();
+
+	DROP TABLE admission_items;
+	DROP TABLE admission_other_items;
+}
+
+session "s1"
+
+step "s1-begin"
+{
+	BEGIN;
+}
+
+step "s1-select"
+{
+	SELECT count(*) FROM admission_items;
+}
+
+step "s1-savepoint"
+{
+	SAVEPOINT s1;
+}
+
+step "s1-select-division-by-zero"
+{
+	SELECT count(*) FROM admission_items WHERE value / (key - key) > 0;
+}
+
+step "s1-rollback-to-savepoint"
+{
+	ROLLBACK TO SAVEPOINT s1;
+}
+
+step "s1-commit"
+{
+	COMMIT;
+}
+
+session "s2"
+
+step "s2-select-other"
+{
+	SELECT count(*) FROM admission_other_items;
+}
+
+teardown
+{
+	ALTER SYSTEM RESET citus.max_concurrent_multi_shard_queries;
+}
+
+// worker 1 xact session
+session "w1"
+
+step "w1-start-session-level-connection"
+{
+	SELECT start_session_level_connection_to_node('localhost', 57637);
+}
+
+step "w1-begin"
+{
+	SELECT run_commands_on_session_level_connection_to_node('BEGIN');
+}
+
+// the first shard of admission_items is on worker 1
+step "w1-lock-shard"
+{
+	SELECT run_commands_on_session_level_connection_to_node('LOCK admission_items_1810000 IN ACCESS EXCLUSIVE MODE');
+}
+
+step "w1-rollback"
+{
+	SELECT run_commands_on_session_level_connection_to_node('ROLLBACK');
+}
+
+step "w1-stop-connection"
+{
+	SELECT stop_session_level_connection_to_node();
+}
+
+// s1 holds the slot while it waits for the shard lock, so s2 waits for s1
+permutation "w1-start-session-level-connection" "w1-begin" "w1-lock-shard" "s1-begin" "s1-select" "s2-select-other"("s1-select") "w1-rollback" "s1-commit" "w1-stop-connection"
+
+// s2 does not wait for the slot that the failed query of s1 took
+permutation "s1-begin" "s1-savepoint" "s1-select-division-by-zero" "s2-select-other" "s1-rollback-to-savepoint" "s1-select" "s1-commit"
@@ -0,0 +1,55 @@
+// Tests that results cached with citus.query_result_cache_ttl are not used
+// after a concurrent write commits, including writes that were in progress
+// while the results were cached.
+setup
+{
+	CREATE TABLE cached_items (key int, value int);
+	SELECT create_distributed_table('cached_items', 'key', shard_count := 4);
+	INSERT INTO cached_items SELECT i, i FROM generate_series(1, 10) i;
+}
+
+teardown
+{
+	DROP TABLE cached_items;
+}
+
+session "s1"
+
+step "s1-begin"
+{
+	BEGIN;
+}
+
+step "s1-update"
+{
+	UPDATE cached_items SET value = value + 10;
+}
+
+step "s1-update-router"
+{
+	UPDATE cached_items SET value = value + 100 WHERE key = 1;
+}
+
+step "s1-commit"
+{
+	COMMIT;
+}
+
+session "s2"
+
+step "s2-enable-cache"
+{
+	SET citus.query_result_cache_ttl TO '1h';
+}
+
+step "s2-select"
+{
+	SELECT sum(value) FROM cached_items;
+}
+
+// the result cached before the write started is discarded on commit
+permutation "s2-enable-cache" "s2-select" "s1-begin" "s1-update" "s2-select" "s1-commit" "s2-select"
+
+// the result cached while the write was in progress is discarded on commit
+permutation "s2-enable-cache" "s1-begin" "s1-update" "s2-select" "s1-commit" "s2-select"
+permutation "s2-enable-cache" "s1-begin" "s1-update-router" "s2-select" "s1-commit" "s2-select"
@@ -0,0 +1,99 @@
+// Tests that citus.max_shared_pool_size limits the connections that
+// concurrent sessions open to each worker, such that a session that needs a
+// connection to a worker whose pool is full waits until another session gives
+// its connection back.
+
+// ALTER SYSTEM cannot run in the transaction of a multi-statement setup
+setup
+{
+	ALTER SYSTEM SET citus.max_shared_pool_size TO 1;
+}
+
+setup
+{
+	SELECT pg_reload_conf();
+
+	-- the connections of this session should not keep the slots either
+	SET citus.max_cached_conns_per_worker TO 0;
+	SET citus.next_shard_id TO 1830000;
+	SET citus.shard_count TO 4;
+	CREATE TABLE pool_items (key int, value int);
+	SELECT create_distributed_table('pool_items', 'key');
+	INSERT INTO pool_items SELECT i, i FROM generate_series(1, 10) i;
+}
+
+teardown
+{
+	SELECT pg_reload_conf();
+
+	DROP TABLE pool_items;
+}
+
+session "s1"
+
+setup
+{
+	SET citus.max_cached_conns_per_worker TO 0;
+}
+
+step "s1-begin"
+{
+	BEGIN;
+}
+
+step "s1-select"
+{
+	SELECT count(*) FROM pool_items;
+}
+
+step "s1-update"
+{
+	UPDATE pool_items SET value = value + 1;
+}
+
+step "s1-release-connections-on-full-pool"
+{
+	SET citus.max_cached_conns_per_worker TO 1;
+	SET citus.release_cached_connections_on_full_pool TO on;
+}
+
+step "s1-commit"
+{
+	COMMIT;
+}
+
+step "s1-rollback"
+{
+	ROLLBACK;
+}
+
+session "s2"
+
+setup
+{
+	SET citus.max_cached_conns_per_worker TO 0;
+}
+
+step "s2-select"
+{
+	SELECT count(*) FROM pool_items;
+}
+
+step "s2-sum"
+{
+	SELECT sum(value) FROM pool_items;
+}
+
+teardown
+{
+	ALTER SYSTEM RESET citus.max_shared_pool_size;
+}
+
+// the connections of s1 take the pool of each worker until s1 commits
+permutation "s1-begin" "s1-select" "s2-select" "s1-commit"
+
+// the same holds when s1 writes over its connections
+permutation "s1-begin" "s1-update" "s2-sum" "s1-rollback"
+
+// a session that is done does not keep the slots through its cached connections
+permutation "s1-release-connections-on-full-pool" "s1-select" "s2-select"
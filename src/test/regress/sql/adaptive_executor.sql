@@ -58,4 +58,141 @@ SELECT select_for_update();
 
 SET citus.log_remote_commands TO off;
 
+-- pipeline the tasks over a single connection per worker
+SET citus.executor_pipeline_depth TO 4;
+SET citus.max_adaptive_executor_pool_size TO 1;
+SELECT count(*) FROM test;
+SELECT x, y FROM test ORDER BY x;
+
+BEGIN;
+SELECT count(*), sum(y) FROM test;
+INSERT INTO test VALUES (3, 4);
+SELECT count(*), sum(y) FROM test;
+ROLLBACK;
+
+-- errors in the middle of a pipeline abort the query
+SELECT x / (x - 3) FROM test ORDER BY x;
+SELECT count(*) FROM test;
+
+RESET citus.executor_pipeline_depth;
+RESET citus.max_adaptive_executor_pool_size;
+
+-- return rows of multi-shard queries while the execution is running
+SET citus.enable_streaming_results TO on;
+SELECT x, y FROM test ORDER BY x;
+SELECT x FROM test ORDER BY x LIMIT 2;
+SELECT x / (x - 3) FROM test ORDER BY x;
+SELECT count(*) FROM test;
+RESET citus.enable_streaming_results;
+
+-- merge the sorted results of the tasks rather than sorting them again
+SET citus.enable_sorted_merge TO on;
+SELECT public.coordinator_plan($Q$
+EXPLAIN (COSTS OFF) SELECT x FROM test ORDER BY x LIMIT 2;
+$Q$);
+SELECT x, y FROM test ORDER BY x DESC LIMIT 3;
+SELECT x FROM test ORDER BY x LIMIT 2 OFFSET 1;
+SET citus.enable_streaming_results TO on;
+SELECT x FROM test ORDER BY x LIMIT 2;
+SELECT x, y FROM test ORDER BY y, x DESC LIMIT 3;
+RESET citus.enable_streaming_results;
+RESET citus.enable_sorted_merge;
+
+-- combine the partial aggregates of the sorted groups of the tasks while
+-- merging them, rather than hashing all groups
+CREATE FUNCTION uses_sorted_merge_aggregation(explain_command text)
+RETURNS bool AS $$
+DECLARE
+  query_plan text;
+  merges_groups bool := false;
+BEGIN
+  FOR query_plan IN EXECUTE explain_command LOOP
+    IF query_plan LIKE '%Task Count:%' THEN
+      RETURN merges_groups;
+    ELSIF query_plan LIKE '%Sort%' THEN
+      RETURN false;
+    ELSIF query_plan LIKE '%GroupAggregate%' THEN
+      merges_groups := true;
+    END IF;
+  END LOOP;
+  RETURN merges_groups;
+END; $$ LANGUAGE plpgsql;
+BEGIN;
+INSERT INTO test SELECT i, i % 3 FROM generate_series(20, 39) i;
+SELECT uses_sorted_merge_aggregation($Q$
+EXPLAIN (COSTS OFF) SELECT y, count(*), sum(x) FROM test GROUP BY y;
+$Q$);
+SELECT y, count(*), sum(x) FROM test GROUP BY y ORDER BY y;
+SET LOCAL citus.enable_sorted_merge_aggregation TO on;
+SELECT uses_sorted_merge_aggregation($Q$
+EXPLAIN (COSTS OFF) SELECT y, count(*), sum(x) FROM test GROUP BY y;
+$Q$);
+SELECT y, count(*), sum(x) FROM test GROUP BY y ORDER BY y;
+-- groups that are filtered by HAVING are still hashed
+SELECT uses_sorted_merge_aggregation($Q$
+EXPLAIN (COSTS OFF) SELECT y, count(*) FROM test GROUP BY y HAVING count(*) > 6;
+$Q$);
+SELECT y, count(*) FROM test GROUP BY y HAVING count(*) > 6 ORDER BY y;
+ROLLBACK;
+
+-- read the rows of the tasks in parallel workers during the combine query
+CREATE FUNCTION uses_parallel_combine(explain_command text)
+RETURNS bool AS $$
+DECLARE
+  query_plan text;
+BEGIN
+  FOR query_plan IN EXECUTE explain_command LOOP
+    IF query_plan LIKE '%Citus Parallel Combine%' THEN
+      RETURN true;
+    END IF;
+  END LOOP;
+  RETURN false;
+END; $$ LANGUAGE plpgsql;
+SET citus.enable_parallel_combine TO on;
+SET parallel_setup_cost TO 0;
+SET parallel_tuple_cost TO 0;
+SET max_parallel_workers_per_gather TO 2;
+SELECT uses_parallel_combine($Q$
+EXPLAIN (COSTS OFF) SELECT y, count(*), sum(x) FROM test GROUP BY y;
+$Q$);
+SELECT y, count(*), sum(x) FROM test GROUP BY y ORDER BY y;
+SELECT count(*), max(x) FROM test;
+RESET max_parallel_workers_per_gather;
+RESET parallel_tuple_cost;
+RESET parallel_setup_cost;
+RESET citus.enable_parallel_combine;
+
+-- fetch rows from the workers in chunks rather than one by one
+SET citus.executor_result_chunk_size TO 2;
+SELECT x, y FROM test ORDER BY x;
+SELECT count(*) FROM (SELECT x FROM test LIMIT 3) s;
+RESET citus.executor_result_chunk_size;
+
+-- combine the tasks for the same worker into a single query
+SET citus.executor_task_group_size TO 4;
+SELECT count(*) FROM test;
+SELECT x, y FROM test ORDER BY x;
+SELECT x FROM test ORDER BY x LIMIT 2;
+SELECT x / (x - 3) FROM test ORDER BY x;
+RESET citus.executor_task_group_size;
+
+-- start reads of slow tasks on another placement as well
+SET citus.shard_replication_factor TO 2;
+CREATE TABLE test_replicated (x int, y int);
+SELECT create_distributed_table('test_replicated','x');
+INSERT INTO test_replicated SELECT * FROM test;
+
+SET citus.hedged_read_delay_factor TO 0.01;
+SELECT count(*) FROM test_replicated;
+SELECT count(*) FROM test_replicated a JOIN (SELECT x, pg_sleep(0.1) FROM test_replicated) b USING (x);
+SELECT x, y FROM test_replicated ORDER BY x;
+RESET citus.hedged_read_delay_factor;
+
+-- cancel the remaining tasks once there are enough rows for the LIMIT
+SET citus.max_adaptive_executor_pool_size TO 1;
+SELECT count(*) FROM (SELECT x FROM test LIMIT 1) s;
+SELECT count(*) FROM (SELECT x FROM test LIMIT 2 OFFSET 1) s;
+SELECT count(*) FROM (SELECT x FROM test LIMIT 0) s;
+SELECT count(*) FROM test;
+RESET citus.max_adaptive_executor_pool_size;
 DROP SCHEMA adaptive_executor CASCADE;
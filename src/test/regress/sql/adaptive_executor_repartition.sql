@@ -79,4 +79,58 @@ select count(*) from trips t1, cars r1, trips t2, cars r2 where t1.trip_id = t2.
 set citus.enable_single_hash_repartition_joins to on;
 select count(*) from trips t1, cars r1, trips t2, cars r2 where t1.trip_id = t2.trip_id and t1.car_id = r1.car_id and t2.car_id = r2.car_id;
 
+-- join key filters do not change the results of dual repartition joins
+set citus.enable_single_hash_repartition_joins to off;
+set citus.enable_repartition_join_filters to on;
+SELECT COUNT(*) FROM ab k, ab l WHERE k.a = l.b;
+SELECT COUNT(*) FROM ab k, ab l WHERE k.a = l.b AND l.b < 3;
+SELECT COUNT(*) FROM ab k, ab l WHERE k.a = l.b AND k.a < 3;
+select count(*) from trips t1, cars r1, trips t2, cars r2 where t1.trip_id = t2.trip_id and t1.car_id = r1.car_id and t2.car_id = r2.car_id;
+
+reset citus.enable_repartition_join_filters;
+
+-- bucket counts from row estimates and coalesced fetches do not change the results
+ANALYZE ab;
+SELECT citus_update_table_row_estimates();
+set citus.repartition_join_rows_per_bucket to 4;
+set citus.enable_repartition_fragment_coalescing to on;
+SELECT COUNT(*) FROM ab k, ab l WHERE k.a = l.b;
+SELECT COUNT(*) FROM ab k, ab l WHERE k.a = l.b AND k.a < 3;
+reset citus.repartition_join_rows_per_bucket;
+reset citus.enable_repartition_fragment_coalescing;
+
+-- spreading heavy hitters does not change the results of dual repartition joins
+CREATE TABLE skewed_keys(key int, value int);
+SELECT create_distributed_table('skewed_keys', 'value');
+INSERT INTO skewed_keys SELECT CASE WHEN i % 2 = 0 THEN 1 ELSE i END, i FROM generate_series(1, 2000) i;
+CREATE FUNCTION skew_handling_lines(explain_command text)
+RETURNS SETOF text AS $$
+DECLARE
+  query_plan text;
+BEGIN
+  FOR query_plan IN EXECUTE explain_command LOOP
+    IF query_plan LIKE '%Skew Handling%' THEN
+      RETURN NEXT trim(query_plan);
+    END IF;
+  END LOOP;
+END; $$ LANGUAGE plpgsql;
+set citus.enable_repartition_join_skew_handling to on;
+SELECT skew_handling_lines('EXPLAIN (COSTS OFF) SELECT count(*) FROM skewed_keys k, skewed_keys l WHERE k.key = l.key');
+SELECT count(*) FROM skewed_keys k, skewed_keys l WHERE k.key = l.key;
+SELECT count(*) FROM skewed_keys k, skewed_keys l WHERE k.key = l.key AND k.key > 1;
+reset citus.enable_repartition_join_skew_handling;
+DROP FUNCTION skew_handling_lines(text);
+DROP TABLE skewed_keys;
+
+-- starting each task as soon as its own dependencies are done does not change
+-- the results of repartition joins
+set citus.enable_repartition_dataflow_scheduling to on;
+SELECT COUNT(*) FROM ab k, ab l WHERE k.a = l.b;
+SELECT COUNT(*) FROM ab k, ab l, ab m, ab t WHERE k.a = l.b AND k.a = m.b AND t.b = l.a;
+select count(*) from trips t1, cars r1, trips t2, cars r2 where t1.trip_id = t2.trip_id and t1.car_id = r1.car_id and t2.car_id = r2.car_id;
+set citus.enable_single_hash_repartition_joins to on;
+select count(*) from trips t1, cars r1, trips t2, cars r2 where t1.trip_id = t2.trip_id and t1.car_id = r1.car_id and t2.car_id = r2.car_id;
+set citus.enable_single_hash_repartition_joins to off;
+reset citus.enable_repartition_dataflow_scheduling;
+
 DROP SCHEMA adaptive_executor CASCADE;
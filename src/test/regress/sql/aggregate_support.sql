@@ -432,6 +432,17 @@ select pg_catalog.worker_partial_agg('sum(int)'::regprocedure, id) from nulltabl
 select pg_catalog.coord_combine_agg('sum(float8)'::regprocedure, id::text::cstring, null::float8) from nulltable;
 select pg_catalog.coord_combine_agg('avg(float8)'::regprocedure, ARRAY[id,id,id]::text::cstring, null::float8) from nulltable;
 
+-- Partial aggregate states can also be sent in binary form, which covers
+-- aggregates with internal transition state such as stddev(int)
+select pg_catalog.coord_combine_agg_binary('sum(float8)'::regprocedure, float8send(id::float8), null::float8) from nulltable;
+select pg_catalog.coord_combine_agg_binary('sum(float8)'::regprocedure, id::text::bytea, null::float8) from nulltable;
+set citus.coordinator_aggregation_strategy to 'disabled';
+select key, stddev(val)::numeric(10,5), stddev(valf)::numeric(10,5) from aggdata group by key order by key;
+set citus.enable_binary_partial_aggregates to on;
+select key, stddev(val)::numeric(10,5), stddev(valf)::numeric(10,5) from aggdata group by key order by key;
+reset citus.enable_binary_partial_aggregates;
+set citus.coordinator_aggregation_strategy to 'row-gather';
+
 
 -- Test that we don't crash with empty resultset
 -- See https://github.com/citusdata/citus/issues/3953
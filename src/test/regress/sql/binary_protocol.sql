@@ -103,5 +103,16 @@ SELECT id, val1
 FROM test_table_1 LEFT JOIN test_table_2 USING(id, val1)
 ORDER BY 1, 2;
 
+-- fixed-width by-value types are decoded without their receive function
+CREATE TABLE fixed_width_types (id int, b bool, s int2, o oid, l int8, f4 float4,
+                                f8 float8, ts timestamp, tstz timestamptz);
+SELECT create_distributed_table('fixed_width_types', 'id');
+INSERT INTO fixed_width_types VALUES
+    (1, true, -2, 3, -4000000000, 1.5, -2.25, '2022-01-01 10:00:00', 'infinity'),
+    (2, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL),
+    (3, false, 32767, 4294967295, 9223372036854775807, -0.5, 3.125, '-infinity',
+     '2000-02-29 08:00:00+00');
+SELECT * FROM fixed_width_types ORDER BY id;
+
 SET client_min_messages TO WARNING;
 DROP SCHEMA binary_protocol CASCADE;
@@ -0,0 +1,50 @@
+--
+-- citus_analyze_distributed.sql
+--
+-- Test that citus_analyze_distributed computes column statistics for the
+-- shell tables of distributed tables from a sample of their shards
+--
+CREATE SCHEMA analyze_distributed;
+SET search_path TO analyze_distributed;
+SET citus.next_shard_id TO 983000;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+
+CREATE TABLE dist_table (id int, category int, name text);
+SELECT create_distributed_table('dist_table', 'id');
+
+CREATE TABLE never_analyzed (id int);
+SELECT create_distributed_table('never_analyzed', 'id');
+
+CREATE TABLE local_table (id int);
+
+INSERT INTO dist_table SELECT i, i % 5, NULL FROM generate_series(1, 1000) i;
+
+-- shell tables do not have statistics of their own
+ANALYZE dist_table;
+SELECT count(*) FROM pg_stats WHERE schemaname = 'analyze_distributed';
+
+-- shards without row estimates are skipped
+SELECT citus_analyze_distributed('never_analyzed');
+
+-- only distributed and reference tables can be analyzed
+SELECT citus_analyze_distributed('local_table');
+
+-- the sample covers all rows of small tables
+SELECT citus_analyze_distributed('dist_table');
+SELECT attname, null_frac, n_distinct
+FROM pg_stats
+WHERE schemaname = 'analyze_distributed' AND tablename = 'dist_table'
+ORDER BY attname;
+
+-- refreshing the statistics updates the existing rows
+INSERT INTO dist_table SELECT i, i % 10, 'name' FROM generate_series(1001, 2000) i;
+ANALYZE dist_table;
+SELECT citus_analyze_distributed('dist_table');
+SELECT attname, null_frac, n_distinct
+FROM pg_stats
+WHERE schemaname = 'analyze_distributed' AND tablename = 'dist_table'
+ORDER BY attname;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA analyze_distributed CASCADE;
@@ -130,9 +130,10 @@ SET client_min_messages TO DEBUG1;
 SELECT citus_get_transaction_clock() as txnclock \gset
 ROLLBACK;
 
+-- the workers only move to the transaction clock when the transaction commits
 SELECT result as logseq from run_command_on_workers($$SELECT last_value FROM pg_dist_clock_logical_seq$$) limit 1 \gset
 SELECT cluster_clock_logical(:'txnclock') as txnlog \gset
-SELECT :logseq = :txnlog;
+SELECT :logseq <= :txnlog;
 
 SELECT run_command_on_workers($$SELECT citus_get_node_clock()$$);
 
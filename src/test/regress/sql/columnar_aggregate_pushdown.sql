@@ -0,0 +1,160 @@
+--
+-- Test that the aggregates that columnar computes from the column vectors and
+-- the chunk metadata, and the quals that it evaluates over whole chunk groups,
+-- give the same results as the regular executor.
+--
+
+CREATE SCHEMA columnar_aggregate_pushdown;
+SET search_path TO columnar_aggregate_pushdown;
+
+-- results_match returns whether the query gives the same rows with the
+-- given setting off and on
+CREATE FUNCTION results_match(query text, setting text) RETURNS boolean AS $$
+DECLARE
+  result_off text;
+  result_on text;
+BEGIN
+  PERFORM set_config(setting, 'off', true);
+  EXECUTE 'SELECT array_agg(q::text ORDER BY q::text) FROM (' || query || ') q'
+  INTO result_off;
+
+  PERFORM set_config(setting, 'on', true);
+  EXECUTE 'SELECT array_agg(q::text ORDER BY q::text) FROM (' || query || ') q'
+  INTO result_on;
+
+  PERFORM set_config(setting, 'off', true);
+  RETURN result_off IS NOT DISTINCT FROM result_on;
+END; $$ LANGUAGE plpgsql;
+
+CREATE FUNCTION uses_aggregate_scan(query text) RETURNS boolean AS $$
+DECLARE
+  query_plan text;
+BEGIN
+  FOR query_plan IN EXECUTE 'EXPLAIN (COSTS OFF) ' || query LOOP
+    IF query_plan ILIKE '%Custom Scan (ColumnarAggregateScan)%' THEN
+      RETURN true;
+    END IF;
+  END LOOP;
+  RETURN false;
+END; $$ LANGUAGE plpgsql;
+
+CREATE FUNCTION aggregates_from_metadata(query text) RETURNS boolean AS $$
+DECLARE
+  query_plan text;
+BEGIN
+  FOR query_plan IN EXECUTE 'EXPLAIN (COSTS OFF) ' || query LOOP
+    IF query_plan ILIKE '%Columnar Aggregates From Metadata: true%' THEN
+      RETURN true;
+    END IF;
+  END LOOP;
+  RETURN false;
+END; $$ LANGUAGE plpgsql;
+
+-- every tenth value of a is NULL, and c only has NULL values in the first chunk
+-- group, the sum of b does not fit into a bigint
+SET columnar.stripe_row_limit TO 2000;
+SET columnar.chunk_group_row_limit TO 1000;
+CREATE TABLE items (a int, b bigint, c smallint, d text) USING columnar;
+INSERT INTO items
+SELECT CASE WHEN i % 10 = 0 THEN NULL ELSE i END,
+       (i % 3) * 4000000000000000000,
+       CASE WHEN i <= 1000 THEN NULL ELSE i % 100 END,
+       i::text
+FROM generate_series(1, 5000) i;
+RESET columnar.stripe_row_limit;
+RESET columnar.chunk_group_row_limit;
+
+SET columnar.enable_aggregate_pushdown TO on;
+SELECT uses_aggregate_scan($$
+  SELECT count(*), count(a), sum(a), min(a), max(a), sum(b), min(c), max(c) FROM items
+$$);
+SELECT aggregates_from_metadata($$
+  SELECT count(*), count(a), sum(a), min(a), max(a), sum(b), min(c), max(c) FROM items
+$$);
+SELECT count(*), count(a), sum(a), min(a), max(a), sum(b), min(c), max(c) FROM items;
+SELECT aggregates_from_metadata($$SELECT count(*), min(a), max(c) FROM items$$);
+SELECT count(*), min(a), max(a), min(c), max(c) FROM items;
+
+-- the queries that the aggregate scan does not handle use the regular executor
+SELECT uses_aggregate_scan($$SELECT count(*) FROM items WHERE a > 100$$);
+SELECT uses_aggregate_scan($$SELECT avg(a) FROM items$$);
+SELECT uses_aggregate_scan($$SELECT sum(a) FROM items GROUP BY c$$);
+SELECT uses_aggregate_scan($$SELECT count(DISTINCT c) FROM items$$);
+RESET columnar.enable_aggregate_pushdown;
+
+SELECT results_match($$
+  SELECT count(*), count(a), sum(a), min(a), max(a), sum(b), min(c), max(c) FROM items
+$$, 'columnar.enable_aggregate_pushdown');
+SELECT results_match($$
+  SELECT count(*), min(a), max(a), min(b), max(b), min(c), max(c) FROM items
+$$, 'columnar.enable_aggregate_pushdown');
+SELECT results_match($$
+  SELECT max(a) - min(a), sum(c) + count(c) FROM items
+$$, 'columnar.enable_aggregate_pushdown');
+SELECT results_match($$
+  SELECT count(*), sum(a), avg(b) FROM items WHERE a > 100
+$$, 'columnar.enable_aggregate_pushdown');
+
+-- mixed-type comparisons, with the column on either side of the operator
+SELECT results_match($$
+  SELECT count(*), sum(a) FROM items WHERE a < 2500::bigint
+$$, 'columnar.enable_vectorized_filter');
+SELECT results_match($$
+  SELECT count(*), sum(c) FROM items WHERE c > 50 AND b >= 4000000000000000000
+$$, 'columnar.enable_vectorized_filter');
+SELECT results_match($$
+  SELECT a, b, c FROM items WHERE c = 7::bigint AND 2500 > a
+$$, 'columnar.enable_vectorized_filter');
+SELECT results_match($$
+  SELECT a, d FROM items WHERE a::numeric > 4990.5 AND c <= 95::int2
+$$, 'columnar.enable_vectorized_filter');
+SELECT results_match($$
+  SELECT d FROM items WHERE d COLLATE "C" < '11' AND a IS NOT NULL
+$$, 'columnar.enable_vectorized_filter');
+
+-- the deleted rows are not counted, neither from the column vectors nor from
+-- the chunk metadata
+DELETE FROM items WHERE a BETWEEN 1 AND 999;
+
+SET columnar.enable_aggregate_pushdown TO on;
+SELECT count(*), min(a), max(a) FROM items;
+RESET columnar.enable_aggregate_pushdown;
+
+SELECT results_match($$
+  SELECT count(*), count(a), sum(a), min(a), max(a), sum(b), min(c), max(c) FROM items
+$$, 'columnar.enable_aggregate_pushdown');
+SELECT results_match($$
+  SELECT count(*), min(a), max(a), min(c), max(c) FROM items
+$$, 'columnar.enable_aggregate_pushdown');
+SELECT results_match($$
+  SELECT a, c FROM items WHERE a < 1200 AND c >= 90::bigint
+$$, 'columnar.enable_vectorized_filter');
+
+-- rows that are inserted in the same transaction are counted as well
+BEGIN;
+INSERT INTO items SELECT i, i, i % 100, i::text FROM generate_series(5001, 6000) i;
+DELETE FROM items WHERE a BETWEEN 5991 AND 6000;
+
+SET LOCAL columnar.enable_aggregate_pushdown TO on;
+SELECT count(*), min(a), max(a) FROM items;
+SET LOCAL columnar.enable_aggregate_pushdown TO off;
+
+SELECT results_match($$
+  SELECT count(*), count(a), sum(a), min(a), max(a), sum(b), min(c), max(c) FROM items
+$$, 'columnar.enable_aggregate_pushdown');
+SELECT results_match($$
+  SELECT count(*), min(a), max(a), min(c), max(c) FROM items
+$$, 'columnar.enable_aggregate_pushdown');
+SELECT results_match($$
+  SELECT a, b FROM items WHERE b > 5500::int AND c < 10::int2
+$$, 'columnar.enable_vectorized_filter');
+ROLLBACK;
+
+-- a table without rows gives a single row of aggregates
+CREATE TABLE empty_items (a int, b bigint) USING columnar;
+SELECT results_match($$
+  SELECT count(*), count(a), sum(a), min(a), max(b), sum(b) FROM empty_items
+$$, 'columnar.enable_aggregate_pushdown');
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_aggregate_pushdown CASCADE;
@@ -0,0 +1,88 @@
+--
+-- Test that scans that copy column chunks from the shared chunk cache return
+-- the same rows as scans that decompress the chunks.
+--
+
+CREATE SCHEMA columnar_chunk_cache;
+SET search_path TO columnar_chunk_cache;
+
+-- the regression tests run with a chunk cache
+SHOW columnar.chunk_cache_size;
+
+SET columnar.stripe_row_limit TO 10000;
+SET columnar.chunk_group_row_limit TO 1000;
+CREATE TABLE items (a int, b text) USING columnar;
+ALTER TABLE items SET (columnar.compression = pglz);
+INSERT INTO items SELECT i, repeat('x', i % 50) || i FROM generate_series(1, 30000) i;
+RESET columnar.stripe_row_limit;
+RESET columnar.chunk_group_row_limit;
+
+-- without the cache, scans decompress all chunks that they read
+SET columnar.enable_chunk_cache TO off;
+SELECT count(*), sum(a), sum(length(b)) FROM items;
+SELECT count(*) AS row_count, sum(hashtext(a || ':' || b)) AS content_hash
+FROM items \gset uncached_
+
+-- the first scan adds the chunks to the cache, the second copies them out
+SET columnar.enable_chunk_cache TO on;
+SELECT count(*) = :uncached_row_count AS row_counts_match,
+       sum(hashtext(a || ':' || b)) = :uncached_content_hash AS contents_match
+FROM items;
+SELECT count(*) = :uncached_row_count AS row_counts_match,
+       sum(hashtext(a || ':' || b)) = :uncached_content_hash AS contents_match
+FROM items;
+
+-- scans that filter chunk groups or project a single column use the cache too
+SELECT count(*), sum(a) FROM items WHERE a BETWEEN 12345 AND 12400;
+SELECT sum(length(b)) FROM items WHERE a > 25000;
+
+-- index scans read single rows of cached chunks
+CREATE INDEX items_a_idx ON items (a);
+SET enable_seqscan TO off;
+SET columnar.enable_custom_scan TO off;
+SELECT columnar_test_helpers.uses_index_scan (
+$$
+SELECT b FROM items WHERE a = 17777;
+$$
+);
+SELECT b FROM items WHERE a = 17777;
+SET columnar.enable_chunk_cache TO off;
+SELECT b FROM items WHERE a = 17777;
+SET columnar.enable_chunk_cache TO on;
+RESET enable_seqscan;
+RESET columnar.enable_custom_scan;
+DROP INDEX items_a_idx;
+
+-- deleted rows are skipped even though their chunks are cached
+DELETE FROM items WHERE a % 3 = 0;
+SELECT count(*), sum(a), sum(length(b)) FROM items;
+SET columnar.enable_chunk_cache TO off;
+SELECT count(*), sum(a), sum(length(b)) FROM items;
+SET columnar.enable_chunk_cache TO on;
+
+-- the chunks of a stripe that was rolled back are not read for later stripes
+BEGIN;
+INSERT INTO items SELECT i, repeat('y', 100) FROM generate_series(30001, 31000) i;
+SELECT count(*), sum(length(b)) FROM items WHERE a > 30000;
+ROLLBACK;
+INSERT INTO items SELECT i, 'z' FROM generate_series(30001, 30500) i;
+SELECT count(*), sum(length(b)) FROM items WHERE a > 30000;
+
+-- rewritten tables get a new storage id, so their old chunks are not read
+VACUUM FULL items;
+SELECT count(*), sum(a), sum(length(b)) FROM items;
+TRUNCATE items;
+INSERT INTO items SELECT i, repeat('w', 100) FROM generate_series(1, 1000) i;
+SELECT count(*), sum(a), sum(length(b)) FROM items;
+
+-- uncompressed chunks are not cached, but read the same way
+CREATE TABLE uncompressed_items (a int, b text) USING columnar;
+ALTER TABLE uncompressed_items SET (columnar.compression = none);
+INSERT INTO uncompressed_items SELECT i, repeat('x', i % 50) FROM generate_series(1, 5000) i;
+SELECT count(*), sum(a), sum(length(b)) FROM uncompressed_items;
+SELECT count(*), sum(a), sum(length(b)) FROM uncompressed_items;
+
+RESET columnar.enable_chunk_cache;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_chunk_cache CASCADE;
@@ -440,5 +440,25 @@ WHERE "bbbbbbbbbbbbbbbbbbbbbbbbb\!bbbb'bbbbbbbbbbbbbbbbbbbbb''bbbbbbbb" * 2 >
 EXPLAIN (COSTS OFF, SUMMARY OFF)
 SELECT COUNT(*) FROM weird_col_explain;
 
+-- repartitioned INSERT .. SELECT writes each target shard in full stripes
+CREATE TABLE repartition_source (a int, b int);
+SELECT create_distributed_table('repartition_source', 'a');
+INSERT INTO repartition_source SELECT i, i % 1000 FROM generate_series(1, 20000) i;
+CREATE TABLE repartition_columnar_target (a int, b int) USING columnar;
+SELECT create_distributed_table('repartition_columnar_target', 'a');
+INSERT INTO repartition_columnar_target SELECT b, a FROM repartition_source;
+SELECT count(*), sum(a), sum(b) FROM repartition_columnar_target;
+SELECT DISTINCT result FROM run_command_on_placements('repartition_columnar_target', $cmd$
+  SELECT count(*) FROM columnar.stripe WHERE relation = '%s'::regclass
+$cmd$);
+BEGIN;
+INSERT INTO repartition_columnar_target SELECT b, a FROM repartition_source WHERE a <= 10;
+SAVEPOINT s1;
+INSERT INTO repartition_columnar_target SELECT b, a FROM repartition_source WHERE a <= 100;
+ROLLBACK TO SAVEPOINT s1;
+INSERT INTO repartition_columnar_target SELECT b, a FROM repartition_source WHERE a <= 1000;
+COMMIT;
+SELECT count(*), sum(a), sum(b) FROM repartition_columnar_target;
+
 SET client_min_messages TO WARNING;
 DROP SCHEMA columnar_citus_integration CASCADE;
@@ -0,0 +1,102 @@
+--
+-- Test that stripes that are compressed by background workers when they are
+-- flushed are stored and read the same way as stripes that the writing
+-- backend compresses itself.
+--
+
+CREATE SCHEMA columnar_compression_workers;
+SET search_path TO columnar_compression_workers;
+
+-- the compression of all chunks of a table, which does not depend on who
+-- compressed them
+CREATE VIEW chunk_compression AS
+SELECT relation, stripe_num, attr_num, chunk_group_num, value_compression_type,
+       value_stream_length, value_decompressed_length, value_count
+FROM columnar.chunk;
+
+SET columnar.stripe_row_limit TO 10000;
+SET columnar.chunk_group_row_limit TO 1000;
+
+-- 3 stripes of 25 chunk groups of 2 columns
+CREATE TABLE serial_items (a int, b text) USING columnar;
+ALTER TABLE serial_items SET (columnar.compression = pglz);
+INSERT INTO serial_items
+SELECT i, repeat('x', i % 50) || i FROM generate_series(1, 25000) i;
+
+SET columnar.compression_workers TO 2;
+CREATE TABLE parallel_items (a int, b text) USING columnar;
+ALTER TABLE parallel_items SET (columnar.compression = pglz);
+INSERT INTO parallel_items
+SELECT i, repeat('x', i % 50) || i FROM generate_series(1, 25000) i;
+RESET columnar.compression_workers;
+
+-- the chunks are compressed the same way
+SELECT count(*) FROM chunk_compression WHERE relation = 'parallel_items'::regclass;
+SELECT bool_or(value_compression_type <> 0) AS compressed
+FROM chunk_compression WHERE relation = 'parallel_items'::regclass;
+SELECT count(*) FROM (
+  (SELECT stripe_num, attr_num, chunk_group_num, value_compression_type,
+          value_stream_length, value_decompressed_length, value_count
+   FROM chunk_compression WHERE relation = 'serial_items'::regclass
+   EXCEPT ALL
+   SELECT stripe_num, attr_num, chunk_group_num, value_compression_type,
+          value_stream_length, value_decompressed_length, value_count
+   FROM chunk_compression WHERE relation = 'parallel_items'::regclass)
+  UNION ALL
+  (SELECT stripe_num, attr_num, chunk_group_num, value_compression_type,
+          value_stream_length, value_decompressed_length, value_count
+   FROM chunk_compression WHERE relation = 'parallel_items'::regclass
+   EXCEPT ALL
+   SELECT stripe_num, attr_num, chunk_group_num, value_compression_type,
+          value_stream_length, value_decompressed_length, value_count
+   FROM chunk_compression WHERE relation = 'serial_items'::regclass)
+) chunk_differences;
+
+-- and read back the same rows, with and without the chunk cache
+SELECT count(*), sum(a), sum(length(b)) FROM parallel_items;
+SELECT count(*) AS row_count, sum(hashtext(a || ':' || b)) AS content_hash
+FROM serial_items \gset serial_
+SELECT count(*) = :serial_row_count AS row_counts_match,
+       sum(hashtext(a || ':' || b)) = :serial_content_hash AS contents_match
+FROM parallel_items;
+SET columnar.enable_chunk_cache TO off;
+SELECT count(*) = :serial_row_count AS row_counts_match,
+       sum(hashtext(a || ':' || b)) = :serial_content_hash AS contents_match
+FROM parallel_items;
+RESET columnar.enable_chunk_cache;
+
+-- stripes that are flushed by a read in the same transaction are compressed as well
+SET columnar.compression_workers TO 2;
+BEGIN;
+INSERT INTO parallel_items SELECT i, repeat('y', 100) FROM generate_series(25001, 26000) i;
+INSERT INTO parallel_items SELECT i, repeat('y', 100) FROM generate_series(26001, 27000) i;
+SELECT count(*), sum(length(b)) FROM parallel_items WHERE a > 25000;
+INSERT INTO parallel_items SELECT i, repeat('y', 100) FROM generate_series(27001, 28000) i;
+COMMIT;
+SELECT count(*), sum(length(b)) FROM parallel_items WHERE a > 25000;
+
+-- the workers are not used for uncompressed tables and streamed chunk groups
+CREATE TABLE uncompressed_items (a int, b text) USING columnar;
+ALTER TABLE uncompressed_items SET (columnar.compression = none);
+INSERT INTO uncompressed_items
+SELECT i, repeat('x', i % 50) || i FROM generate_series(1, 25000) i;
+SELECT count(*) FROM chunk_compression
+WHERE relation = 'uncompressed_items'::regclass AND value_compression_type <> 0;
+SELECT count(*), sum(a), sum(length(b)) FROM uncompressed_items;
+
+SET columnar.stream_chunk_groups TO on;
+CREATE TABLE streamed_items (a int, b text) USING columnar;
+ALTER TABLE streamed_items SET (columnar.compression = pglz);
+INSERT INTO streamed_items
+SELECT i, repeat('x', i % 50) || i FROM generate_series(1, 25000) i;
+RESET columnar.stream_chunk_groups;
+SELECT count(*) = :serial_row_count AS row_counts_match,
+       sum(hashtext(a || ':' || b)) = :serial_content_hash AS contents_match
+FROM streamed_items;
+RESET columnar.compression_workers;
+
+RESET columnar.stripe_row_limit;
+RESET columnar.chunk_group_row_limit;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_compression_workers CASCADE;
@@ -0,0 +1,80 @@
+--
+-- Test that parallel scans of columnar tables, where the participants read
+-- different stripes, return every row exactly once.
+--
+
+CREATE SCHEMA columnar_parallel_scan;
+SET search_path TO columnar_parallel_scan;
+
+CREATE FUNCTION uses_parallel_scan(query text) RETURNS boolean AS $$
+DECLARE
+  query_plan text;
+BEGIN
+  FOR query_plan IN EXECUTE 'EXPLAIN (COSTS OFF) ' || query LOOP
+    IF query_plan ILIKE '%Parallel Custom Scan (ColumnarScan)%' THEN
+      RETURN true;
+    END IF;
+  END LOOP;
+  RETURN false;
+END; $$ LANGUAGE plpgsql;
+
+-- 15 stripes, large enough for multiple parallel workers
+SET columnar.stripe_row_limit TO 10000;
+CREATE TABLE items (i int, t text) USING columnar;
+ALTER TABLE items SET (columnar.compression = none);
+INSERT INTO items SELECT i, i::text FROM generate_series(1, 150000) i;
+RESET columnar.stripe_row_limit;
+VACUUM ANALYZE items;
+
+SET columnar.enable_parallel_scan TO on;
+SET force_parallel_mode TO regress;
+SET min_parallel_table_scan_size TO 1;
+SET parallel_setup_cost TO 0;
+SET parallel_tuple_cost TO 0;
+SET max_parallel_workers TO 4;
+SET max_parallel_workers_per_gather TO 4;
+
+SELECT uses_parallel_scan($$SELECT count(*), sum(i), sum(length(t)) FROM items$$);
+SELECT count(*), sum(i), min(i), max(i), sum(length(t)) FROM items;
+SELECT count(*) AS row_count, sum(hashtext(i || ':' || t)) AS content_hash
+FROM items \gset parallel_
+
+-- the quals of the scan filter the chunk groups of each stripe
+SELECT uses_parallel_scan($$SELECT count(*) FROM items WHERE i > 100000 AND i % 2 = 0$$);
+SELECT count(*), sum(i) FROM items WHERE i > 100000 AND i % 2 = 0;
+
+-- the rows are the same as in a scan without workers
+SET columnar.enable_parallel_scan TO off;
+SELECT uses_parallel_scan($$SELECT count(*), sum(i), sum(length(t)) FROM items$$);
+SELECT count(*) = :parallel_row_count AS row_counts_match,
+       sum(hashtext(i || ':' || t)) = :parallel_content_hash AS contents_match
+FROM items;
+SET columnar.enable_parallel_scan TO on;
+
+-- the participants skip the deleted rows of their stripes
+DELETE FROM items WHERE i % 7 = 0;
+SELECT uses_parallel_scan($$SELECT count(*), sum(i), sum(length(t)) FROM items$$);
+SELECT count(*), sum(i) FROM items;
+
+-- the pending writes of the leader are flushed before the workers start
+BEGIN;
+INSERT INTO items SELECT i, i::text FROM generate_series(150001, 160000) i;
+SELECT count(*), sum(i), max(i) FROM items;
+SELECT count(*) AS row_count, sum(hashtext(i || ':' || t)) AS content_hash
+FROM items \gset parallel_
+SET LOCAL columnar.enable_parallel_scan TO off;
+SELECT count(*) = :parallel_row_count AS row_counts_match,
+       sum(hashtext(i || ':' || t)) = :parallel_content_hash AS contents_match
+FROM items;
+ROLLBACK;
+
+RESET columnar.enable_parallel_scan;
+RESET force_parallel_mode;
+RESET min_parallel_table_scan_size;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET max_parallel_workers;
+RESET max_parallel_workers_per_gather;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA columnar_parallel_scan CASCADE;
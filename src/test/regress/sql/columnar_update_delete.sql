@@ -5,10 +5,13 @@ INSERT INTO columnar_update VALUES (1, 10);
 INSERT INTO columnar_update VALUES (2, 20);
 INSERT INTO columnar_update VALUES (3, 30);
 
--- should fail
+-- should succeed
 UPDATE columnar_update SET j = j+1 WHERE i = 2;
--- should fail
+SELECT * FROM columnar_update ORDER BY i;
+
+-- should succeed
 DELETE FROM columnar_update WHERE i = 2;
+SELECT * FROM columnar_update ORDER BY i;
 
 -- should succeed because there's no target
 INSERT INTO columnar_update VALUES
@@ -58,9 +61,9 @@ SELECT * FROM parent;
 UPDATE p2 SET i = i+1 WHERE ts = '2020-03-15';
 DELETE FROM p2 WHERE ts = '2020-03-21';
 
--- update on specific columnar partition should fail
+-- update on specific columnar partition should succeed
 UPDATE p1 SET i = i+1 WHERE ts = '2020-02-15';
-DELETE FROM p1 WHERE ts = '2020-02-15';
+DELETE FROM p0 WHERE ts = '2020-01-15';
 
 -- partitioned updates that affect only row tables
 -- should succeed
@@ -68,16 +71,16 @@ UPDATE parent SET i = i+1 WHERE ts = '2020-03-15';
 DELETE FROM parent WHERE ts = '2020-03-22';
 
 -- partitioned updates that affect columnar tables
--- should fail
-UPDATE parent SET i = i+1 WHERE ts > '2020-02-15';
-DELETE FROM parent WHERE ts > '2020-02-15';
+-- should succeed
+UPDATE parent SET i = i+1 WHERE ts > '2020-02-14';
+DELETE FROM parent WHERE ts > '2020-02-14' AND i = 34;
 
--- non-partitioned update should fail, even if it
--- only affects a row partition
+-- non-partitioned updates should succeed, and
+-- should not see the deleted columnar rows
 UPDATE parent SET i = i+1 WHERE n = 300;
-DELETE FROM parent WHERE n = 303;
+DELETE FROM parent WHERE n = 100;
 
-SELECT * FROM parent;
+SELECT * FROM parent ORDER BY ts;
 
 -- detach partition
 ALTER TABLE parent DETACH PARTITION p0;
@@ -0,0 +1,55 @@
+--
+-- DISTRIBUTED_SEQUENCE_CACHE
+--
+-- Tests for citus.distributed_sequence_cache_size, which raises the CACHE
+-- setting of the sequences used in column defaults of Citus tables.
+--
+CREATE SCHEMA sequence_cache;
+SET search_path TO sequence_cache;
+SET citus.next_shard_id TO 1800000;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+
+-- the default leaves the sequence as is
+CREATE TABLE unchanged (id bigserial, value int);
+SELECT create_distributed_table('unchanged', 'value');
+SELECT seqcache FROM pg_sequence WHERE seqrelid = 'unchanged_id_seq'::regclass;
+
+SET citus.distributed_sequence_cache_size TO 10;
+
+CREATE TABLE items (id bigserial, value int);
+SELECT create_distributed_table('items', 'value');
+SELECT seqcache FROM pg_sequence WHERE seqrelid = 'items_id_seq'::regclass;
+SELECT run_command_on_workers($$
+	SELECT seqcache FROM pg_sequence
+	WHERE seqrelid = 'sequence_cache.items_id_seq'::regclass
+$$);
+
+-- each backend reserves 10 values at a time
+INSERT INTO items (value) VALUES (1), (2);
+\c - - - :master_port
+SET search_path TO sequence_cache;
+INSERT INTO items (value) VALUES (3);
+SELECT id, value FROM items ORDER BY id;
+
+-- users still cannot change the sequence
+ALTER SEQUENCE items_id_seq CACHE 5;
+
+-- undistribute_table resets the cache
+SET citus.distributed_sequence_cache_size TO 10;
+SELECT undistribute_table('items');
+SELECT seqcache FROM pg_sequence WHERE seqrelid = 'items_id_seq'::regclass;
+SELECT id, value FROM items ORDER BY id;
+
+-- a cache that is not the default is left as is
+CREATE SEQUENCE custom_seq CACHE 3;
+CREATE TABLE custom (id bigint DEFAULT nextval('custom_seq'), value int);
+SELECT create_distributed_table('custom', 'value');
+SELECT seqcache FROM pg_sequence WHERE seqrelid = 'custom_seq'::regclass;
+SELECT run_command_on_workers($$
+	SELECT seqcache FROM pg_sequence
+	WHERE seqrelid = 'sequence_cache.custom_seq'::regclass
+$$);
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA sequence_cache CASCADE;
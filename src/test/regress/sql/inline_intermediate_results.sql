@@ -0,0 +1,105 @@
+--
+-- INLINE_INTERMEDIATE_RESULTS
+--
+-- Tests for inlining small intermediate results into the task queries with
+-- citus.inline_intermediate_result_threshold.
+--
+CREATE SCHEMA inline_results;
+SET search_path TO inline_results;
+SET citus.next_shard_id TO 1820000;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+
+CREATE TABLE items (key int, value int, name text);
+SELECT create_distributed_table('items', 'key');
+INSERT INTO items SELECT i, i * 10, 'name ' || i FROM generate_series(1, 10) i;
+INSERT INTO items VALUES (11, NULL, NULL), (12, 5, E'tab\there'),
+                         (13, 15, E'back\\slash'), (14, 25, 'quote''s');
+
+-- returns where EXPLAIN ANALYZE reports the subplans of the query to send their results
+CREATE FUNCTION subplan_result_destinations(query text)
+RETURNS SETOF text LANGUAGE plpgsql AS $$
+DECLARE
+    explain_line text;
+BEGIN
+    FOR explain_line IN
+        EXECUTE 'EXPLAIN (ANALYZE on, COSTS off, TIMING off, SUMMARY off) ' || query
+    LOOP
+        IF explain_line LIKE '%Result destination%' THEN
+            RETURN NEXT trim(explain_line);
+        END IF;
+    END LOOP;
+END;
+$$;
+
+-- the results are the same with and without inlining
+SELECT count(*), sum(key) FROM items
+WHERE value IN (SELECT value FROM items ORDER BY value LIMIT 3);
+SELECT count(*) FROM items
+WHERE key = 1 AND value IN (SELECT value FROM items ORDER BY value LIMIT 3);
+SELECT key FROM items
+WHERE name IN (SELECT name FROM items WHERE key > 10 ORDER BY key LIMIT 4)
+ORDER BY key;
+
+SET citus.inline_intermediate_result_threshold TO 10;
+
+SELECT count(*), sum(key) FROM items
+WHERE value IN (SELECT value FROM items ORDER BY value LIMIT 3);
+SELECT count(*) FROM items
+WHERE key = 1 AND value IN (SELECT value FROM items ORDER BY value LIMIT 3);
+
+-- NULLs and characters that COPY and the query string need to escape
+SELECT key FROM items
+WHERE name IN (SELECT name FROM items WHERE key > 10 ORDER BY key LIMIT 4)
+ORDER BY key;
+
+-- results of multi-shard and router queries are inlined
+SELECT subplan_result_destinations($$
+SELECT count(*) FROM items
+WHERE value IN (SELECT value FROM items ORDER BY value LIMIT 3)
+$$);
+SELECT subplan_result_destinations($$
+SELECT count(*) FROM items
+WHERE key = 1 AND value IN (SELECT value FROM items ORDER BY value LIMIT 3)
+$$);
+
+-- results that are read on the coordinator are not inlined
+SELECT subplan_result_destinations($$
+WITH top_values AS MATERIALIZED (SELECT value FROM items ORDER BY value LIMIT 3)
+SELECT count(*) FROM top_values
+$$);
+
+-- results with more rows than the threshold fall back to intermediate results
+SET citus.inline_intermediate_result_threshold TO 2;
+
+SELECT subplan_result_destinations($$
+SELECT count(*) FROM items
+WHERE value IN (SELECT value FROM items ORDER BY value LIMIT 3)
+$$);
+SELECT count(*), sum(key) FROM items
+WHERE value IN (SELECT value FROM items ORDER BY value LIMIT 3);
+
+-- the coordinator runs the tasks on its own shards through local execution,
+-- which reads the intermediate result files
+SET client_min_messages TO ERROR;
+SELECT 1 FROM master_add_node('localhost', :master_port, groupid => 0);
+RESET client_min_messages;
+SELECT citus_set_node_property('localhost', :master_port, 'shouldhaveshards', true);
+
+CREATE TABLE local_items (key int, value int);
+SELECT create_distributed_table('local_items', 'key', colocate_with => 'none');
+SELECT count(*) > 0 AS has_local_shards
+FROM pg_dist_placement JOIN pg_dist_shard USING (shardid)
+WHERE logicalrelid = 'local_items'::regclass AND groupid = 0;
+INSERT INTO local_items SELECT key, value FROM items;
+
+SET citus.inline_intermediate_result_threshold TO 10;
+
+SELECT count(*), sum(key) FROM local_items
+WHERE value IN (SELECT value FROM items ORDER BY value LIMIT 3);
+
+RESET citus.inline_intermediate_result_threshold;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA inline_results CASCADE;
+SELECT 1 FROM master_remove_node('localhost', :master_port);
@@ -645,6 +645,19 @@ insert into table_with_user_sequences values (1,1);
 select create_distributed_table('table_with_user_sequences','x');
 explain (costs off) insert into table_with_user_sequences select y, x from table_with_user_sequences;
 
+-- verify that streaming the partitions to the target nodes gives the same result
+SET citus.shard_count TO 4;
+CREATE TABLE streaming_source(a int, b int);
+SELECT create_distributed_table('streaming_source', 'a');
+SET citus.shard_count TO 3;
+CREATE TABLE streaming_target(a int, b int);
+SELECT create_distributed_table('streaming_target', 'a');
+INSERT INTO streaming_source SELECT i, i % 7 FROM generate_series(1, 100) i;
+SET citus.enable_streaming_repartition TO on;
+INSERT INTO streaming_target SELECT b, a FROM streaming_source;
+SELECT a, count(*), sum(b) FROM streaming_target GROUP BY a ORDER BY a;
+RESET citus.enable_streaming_repartition;
+
 -- clean-up
 SET client_min_messages TO WARNING;
 DROP SCHEMA insert_select_repartition CASCADE;
@@ -249,6 +249,58 @@ SELECT * FROM fetch_intermediate_results(ARRAY[]::text[], 'localhost', :worker_1
 SELECT * FROM fetch_intermediate_results(ARRAY[NULL, 'squares_1', 'squares_2']::text[], 'localhost', :worker_1_port);
 END;
 
+-- intermediate results can be compressed
+SET citus.intermediate_result_compression TO 'lz4';
+BEGIN;
+SELECT create_intermediate_result('compressed_squares', 'SELECT s, s*s FROM generate_series(1,1000) s');
+SELECT count(*), sum(x2) FROM read_intermediate_result('compressed_squares', 'binary') AS res (x int, x2 int);
+SELECT broadcast_intermediate_result('compressed_squares', 'SELECT s, s*s FROM generate_series(1,1000) s');
+SELECT x, x2
+FROM interesting_squares
+JOIN (SELECT * FROM read_intermediate_result('compressed_squares', 'binary') AS res (x int, x2 int)) squares ON (x::text = interested_in)
+ORDER BY x;
+SELECT sum(rows_written) FROM worker_partition_query_result('compressed_parts',
+                                                            'SELECT i, i * i FROM generate_series(1, 100) i', 0, 'range',
+                                                            '{1,51}'::text[], '{50,100}'::text[], false);
+SELECT count(*), sum(x2) FROM read_intermediate_results(ARRAY['compressed_parts_0', 'compressed_parts_1']::text[], 'text') AS res (x int, x2 int);
+END;
+RESET citus.intermediate_result_compression;
+
+-- intermediate results can be written in column batches
+SET citus.enable_column_batched_intermediate_results TO on;
+BEGIN;
+SELECT create_intermediate_result('batched_squares', 'SELECT s, s*s, s::text, CASE WHEN s % 2 = 0 THEN NULL ELSE s::float8 END FROM generate_series(1,10000) s');
+SELECT count(*), sum(x2), count(t), sum(f) FROM read_intermediate_result('batched_squares', 'binary') AS res (x int, x2 int, t text, f float8);
+SELECT broadcast_intermediate_result('batched_squares', 'SELECT s, s*s, s::text, CASE WHEN s % 2 = 0 THEN NULL ELSE s::float8 END FROM generate_series(1,10000) s');
+SELECT x, x2, t, f
+FROM interesting_squares
+JOIN (SELECT * FROM read_intermediate_result('batched_squares', 'binary') AS res (x int, x2 int, t text, f float8)) squares ON (t = interested_in)
+ORDER BY x;
+-- raw values cannot be read as a different type
+SELECT count(*) FROM read_intermediate_result('batched_squares', 'binary') AS res (x bigint, x2 int, t text, f float8);
+END;
+-- column batches can be compressed
+SET citus.intermediate_result_compression TO 'lz4';
+BEGIN;
+SELECT sum(rows_written) FROM worker_partition_query_result('batched_parts',
+                                                            'SELECT i, i * i FROM generate_series(1, 100) i', 0, 'range',
+                                                            '{1,51}'::text[], '{50,100}'::text[], false);
+SELECT count(*), sum(x2) FROM read_intermediate_results(ARRAY['batched_parts_0', 'batched_parts_1']::text[], 'text') AS res (x int, x2 int);
+END;
+RESET citus.intermediate_result_compression;
+RESET citus.enable_column_batched_intermediate_results;
+
+-- with a fanout of 1, the second worker fetches the result from the first
+SET citus.intermediate_result_broadcast_fanout TO 1;
+BEGIN;
+SELECT broadcast_intermediate_result('relayed_squares', 'SELECT s, s*s FROM generate_series(1,5) s');
+SELECT x, x2
+FROM interesting_squares
+JOIN (SELECT * FROM read_intermediate_result('relayed_squares', 'binary') AS res (x int, x2 int)) squares ON (x::text = interested_in)
+ORDER BY x;
+END;
+RESET citus.intermediate_result_broadcast_fanout;
+
 -- results should have been deleted after transaction commit
 SELECT * FROM read_intermediate_results(ARRAY['squares_1', 'squares_2']::text[], 'binary') AS res (x int, x2 int);
 
@@ -333,6 +385,48 @@ BEGIN;
   SELECT * FROM security_definer_in_files_2(), security_definer_in_files();
 COMMIT;
 
+-- read intermediate results in parallel workers
+SET search_path TO 'intermediate_results';
+CREATE FUNCTION uses_parallel_result_scan(query text) RETURNS boolean AS $$
+DECLARE
+  query_plan text;
+BEGIN
+  FOR query_plan IN EXECUTE 'EXPLAIN (COSTS OFF) ' || query LOOP
+    IF query_plan LIKE '%Parallel Custom Scan (Citus Parallel Result Scan)%' THEN
+      RETURN true;
+    END IF;
+  END LOOP;
+  RETURN false;
+END; $$ LANGUAGE plpgsql;
+
+BEGIN;
+SELECT create_intermediate_result('squares', 'SELECT s, s*s FROM generate_series(1,20000) s');
+SET LOCAL citus.enable_parallel_result_scan TO on;
+SET LOCAL force_parallel_mode TO regress;
+SET LOCAL min_parallel_table_scan_size TO 0;
+SET LOCAL parallel_setup_cost TO 0;
+SET LOCAL parallel_tuple_cost TO 0;
+SET LOCAL max_parallel_workers_per_gather TO 2;
+SELECT uses_parallel_result_scan($$
+  SELECT count(*), sum(x), sum(x2), min(x), max(x), sum(hashtext(x || ':' || x2))
+  FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int)
+$$);
+SELECT count(*), sum(x), sum(x2), min(x), max(x)
+FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int);
+SELECT count(*) AS row_count, sum(hashtext(x || ':' || x2)) AS content_hash
+FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int) \gset parallel_
+
+-- the rows are the same as when the leader reads the result by itself
+SET LOCAL citus.enable_parallel_result_scan TO off;
+SELECT uses_parallel_result_scan($$
+  SELECT count(*), sum(x), sum(x2), min(x), max(x), sum(hashtext(x || ':' || x2))
+  FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int)
+$$);
+SELECT count(*) = :parallel_row_count AS row_counts_match,
+       sum(hashtext(x || ':' || x2)) = :parallel_content_hash AS contents_match
+FROM read_intermediate_result('squares', 'binary') AS res (x int, x2 int);
+END;
+
 -- cleanup
 SET client_min_messages TO ERROR;
 DROP SCHEMA other_schema CASCADE;
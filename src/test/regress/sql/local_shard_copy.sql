@@ -305,6 +305,25 @@ COPY distributed_table FROM STDIN WITH delimiter ',';
 SELECT key FROM distributed_table WHERE key = 1;
 ROLLBACK;
 
+-- local placements can also be written without serializing the rows,
+-- constraints and indexes are still enforced
+SET citus.enable_local_copy_multi_insert TO on;
+BEGIN;
+COPY distributed_table FROM STDIN WITH delimiter ',';
+1,15
+\.
+COPY distributed_table FROM STDIN WITH delimiter ',';
+1,16
+\.
+ROLLBACK;
+
+BEGIN;
+COPY distributed_table FROM STDIN WITH delimiter ',';
+1,9
+\.
+ROLLBACK;
+RESET citus.enable_local_copy_multi_insert;
+
 \c - - - :master_port
 
 SET search_path TO local_shard_copy;
@@ -0,0 +1,77 @@
+--
+-- Test that distributing a table whose local data is read by parallel workers
+-- puts the same rows into the same shards as when the backend reads it.
+--
+
+CREATE SCHEMA local_table_copy_parallel;
+SET search_path TO local_table_copy_parallel;
+SET citus.next_shard_id TO 14200000;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+
+CREATE TABLE serial_items (key int, value text);
+INSERT INTO serial_items SELECT i, repeat('x', i % 50) || i FROM generate_series(1, 50000) i;
+CREATE TABLE parallel_items (LIKE serial_items);
+INSERT INTO parallel_items SELECT * FROM serial_items;
+CREATE TABLE parallel_reference_items (LIKE serial_items);
+INSERT INTO parallel_reference_items SELECT * FROM serial_items;
+CREATE TABLE columnar_items (LIKE serial_items) USING columnar;
+INSERT INTO columnar_items SELECT * FROM serial_items;
+
+-- without the setting the backend reads the local data itself
+SELECT create_distributed_table('serial_items', 'key');
+
+SET citus.local_table_copy_parallel_workers TO 2;
+SET min_parallel_table_scan_size TO 0;
+SELECT create_distributed_table('parallel_items', 'key', colocate_with => 'serial_items');
+
+-- the shards with the same hash ranges hold the same number of rows
+SELECT array_agg(result ORDER BY shardid) AS shard_row_counts
+FROM run_command_on_placements('serial_items', 'SELECT count(*) FROM %s') \gset serial_
+SELECT array_agg(result ORDER BY shardid) = :'serial_shard_row_counts' AS shard_row_counts_match
+FROM run_command_on_placements('parallel_items', 'SELECT count(*) FROM %s');
+
+SELECT count(*), sum(key), sum(length(value)) FROM parallel_items;
+SELECT count(*) AS row_count, sum(hashtext(key || ':' || value)) AS content_hash
+FROM serial_items \gset serial_
+SELECT count(*) = :serial_row_count AS row_counts_match,
+       sum(hashtext(key || ':' || value)) = :serial_content_hash AS contents_match
+FROM parallel_items;
+
+-- every placement of a reference table gets all rows
+SELECT create_reference_table('parallel_reference_items');
+SELECT DISTINCT result
+FROM run_command_on_placements('parallel_reference_items', 'SELECT count(*) FROM %s');
+SELECT count(*) = :serial_row_count AS row_counts_match,
+       sum(hashtext(key || ':' || value)) = :serial_content_hash AS contents_match
+FROM parallel_reference_items;
+
+-- other table access methods are read by the backend
+SELECT create_distributed_table('columnar_items', 'key', colocate_with => 'serial_items');
+SELECT count(*) = :serial_row_count AS row_counts_match,
+       sum(hashtext(key || ':' || value)) = :serial_content_hash AS contents_match
+FROM columnar_items;
+
+-- tables smaller than min_parallel_table_scan_size are read by the backend
+RESET min_parallel_table_scan_size;
+CREATE TABLE small_items (key int, value text);
+INSERT INTO small_items SELECT i, i::text FROM generate_series(1, 100) i;
+SELECT create_distributed_table('small_items', 'key', colocate_with => 'serial_items');
+SELECT count(*), sum(key) FROM small_items;
+
+-- the rows that the workers read are part of the transaction
+SET min_parallel_table_scan_size TO 0;
+CREATE TABLE aborted_items (LIKE serial_items);
+INSERT INTO aborted_items SELECT * FROM serial_items;
+BEGIN;
+SELECT create_distributed_table('aborted_items', 'key', colocate_with => 'serial_items');
+SELECT count(*) FROM aborted_items;
+ROLLBACK;
+SELECT count(*) FROM pg_dist_partition WHERE logicalrelid = 'aborted_items'::regclass;
+SELECT count(*) FROM aborted_items;
+
+RESET citus.local_table_copy_parallel_workers;
+RESET min_parallel_table_scan_size;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA local_table_copy_parallel CASCADE;
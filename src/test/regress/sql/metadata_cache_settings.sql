@@ -0,0 +1,96 @@
+--
+-- METADATA_CACHE_SETTINGS
+--
+-- Tests that the metadata cache follows shard moves, shard splits and node
+-- additions, including those made by other backends. The test runs in
+-- multi_1_schedule with the shipped defaults, and in metadata_cache_schedule
+-- with citus.shared_metadata_cache_size and
+-- citus.enable_shard_level_invalidation, which can only be set at server
+-- start.
+--
+CREATE SCHEMA metadata_cache;
+SET search_path TO metadata_cache;
+SET citus.next_shard_id TO 1790000;
+SET citus.shard_count TO 2;
+SET citus.shard_replication_factor TO 1;
+
+SET citus.enable_bulk_metadata_sync TO on;
+SET citus.enable_compact_shard_intervals TO on;
+SET citus.enable_dependency_cache TO on;
+SET citus.enable_known_shard_cache TO on;
+SET citus.enable_lazy_placement_loading TO on;
+
+-- runs a command in a new backend on the coordinator
+CREATE FUNCTION run_in_new_backend(command text)
+RETURNS text LANGUAGE sql AS $$
+	SELECT CASE WHEN success THEN result ELSE 'error: ' || result END
+	FROM master_run_on_worker(ARRAY['localhost'], ARRAY[current_setting('port')::int],
+							  ARRAY[command], false)
+$$;
+
+CREATE TABLE items (key int, value int);
+SELECT create_distributed_table('items', 'key', colocate_with => 'none');
+INSERT INTO items SELECT i, i FROM generate_series(1, 10) i;
+
+CREATE TABLE ref (key int, value int);
+SELECT create_reference_table('ref');
+INSERT INTO ref SELECT i, i FROM generate_series(1, 10) i;
+
+-- load the metadata of the tables into the cache
+SELECT count(*), sum(value) FROM items;
+SELECT get_shard_id_for_distribution_column('items', 2) = 1790001;
+SELECT count(*), sum(value) FROM ref;
+
+-- another backend moves a shard, the old placement stays until cleanup
+SELECT nodeport AS source_port,
+	   CASE WHEN nodeport = :worker_1_port THEN :worker_2_port
+			ELSE :worker_1_port END AS target_port
+FROM pg_dist_shard_placement WHERE shardid = 1790000 \gset
+
+SELECT run_in_new_backend(format(
+	'SELECT citus_move_shard_placement(1790000, %L, %s, %L, %s, %L)',
+	'localhost', :source_port, 'localhost', :target_port, 'block_writes'));
+
+-- this backend uses the new placement, other backends see the writes
+INSERT INTO items SELECT i, i FROM generate_series(11, 20) i;
+SELECT count(*), sum(value) FROM items;
+SELECT run_in_new_backend('SELECT sum(value) FROM metadata_cache.items');
+
+-- another backend splits a shard
+SELECT nodeid AS worker_1_node FROM pg_dist_node WHERE nodeport = :worker_1_port \gset
+SELECT nodeid AS worker_2_node FROM pg_dist_node WHERE nodeport = :worker_2_port \gset
+
+SELECT run_in_new_backend(format(
+	'SELECT citus_split_shard_by_split_points(1790001, ARRAY[%L], ARRAY[%s, %s], %L)',
+	'1073741823', :worker_1_node, :worker_2_node, 'block_writes'));
+
+-- this backend uses the new shards
+SELECT get_shard_id_for_distribution_column('items', 2) = 1790001;
+INSERT INTO items SELECT i, i FROM generate_series(21, 30) i;
+SELECT count(*), sum(value) FROM items;
+SELECT run_in_new_backend('SELECT sum(value) FROM metadata_cache.items');
+
+-- adding a node adds placements of the reference table
+SET client_min_messages TO ERROR;
+SELECT 1 FROM master_add_node('localhost', :master_port, groupid => 0);
+SELECT replicate_reference_tables('block_writes');
+RESET client_min_messages;
+
+-- other backends write into the new placement
+SELECT run_in_new_backend('INSERT INTO metadata_cache.ref VALUES (11, 11)');
+SELECT count(*), sum(value) FROM ref_1790002;
+
+-- and so do the nodes the metadata was synced to
+\c - - - :worker_1_port
+SET search_path TO metadata_cache;
+INSERT INTO ref VALUES (12, 12);
+
+\c - - - :master_port
+SET search_path TO metadata_cache;
+SELECT count(*), sum(value) FROM ref_1790002;
+SELECT count(*), sum(value) FROM ref;
+
+SET client_min_messages TO WARNING;
+CALL citus_cleanup_orphaned_resources();
+DROP SCHEMA metadata_cache CASCADE;
+SELECT 1 FROM master_remove_node('localhost', :master_port);
@@ -134,3 +134,29 @@ SELECT
 
 SET citus.count_distinct_error_rate = 0.0;
 SELECT count(distinct l_orderkey) FROM lineitem;
+
+-- Check the built-in sketches that are used when the hll extension is not loaded
+
+SELECT citus_hll_cardinality(citus_hll_add_agg(i, 12)) BETWEEN 950 AND 1050 AS close_enough
+FROM generate_series(1, 1000) i;
+
+SELECT citus_hll_cardinality(citus_hll_add_agg(i % 10, 12)) BETWEEN 9 AND 11 AS close_enough
+FROM generate_series(1, 1000) i;
+
+SELECT citus_hll_cardinality(citus_hll_union_agg(sketch)) BETWEEN 950 AND 1050 AS close_enough
+FROM (
+	SELECT citus_hll_add_agg(i, 12) AS sketch FROM generate_series(1, 600) i
+	UNION ALL
+	SELECT citus_hll_add_agg(i, 12) AS sketch FROM generate_series(401, 1000) i
+) sketches;
+
+SELECT citus_hll_cardinality(citus_hll_add_agg(i, 12)) FROM generate_series(1, 0) i;
+
+SELECT citus_hll_add_agg(i, 30) FROM generate_series(1, 10) i;
+
+SELECT citus_hll_union_agg(sketch)
+FROM (
+	SELECT citus_hll_add_agg(1, 10) AS sketch
+	UNION ALL
+	SELECT citus_hll_add_agg(1, 11) AS sketch
+) sketches;
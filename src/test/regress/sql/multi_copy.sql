@@ -792,3 +792,190 @@ red	{"r":255,"g":0,"b":0
 \.
 
 DROP TABLE copy_jsonb;
+
+-- parse the input in background workers
+SET citus.parallel_copy_workers TO 2;
+CREATE TABLE copy_parallel (key int, value text);
+SELECT create_distributed_table('copy_parallel', 'key');
+
+\COPY copy_parallel FROM STDIN
+1	one
+2	two\
+lines
+3	\N
+4	four
+\.
+
+\COPY copy_parallel FROM STDIN WITH (format csv)
+5,"five"
+6,"six
+lines"
+7,
+8,"quoted ""eight"""
+\.
+
+\COPY copy_parallel FROM STDIN WITH (format csv, quote '''', escape '\')
+9,'nine \' escaped'
+10,'ten, with comma'
+\.
+
+SELECT * FROM copy_parallel ORDER BY key;
+SELECT count(*) FROM copy_parallel;
+
+RESET citus.parallel_copy_workers;
+DROP TABLE copy_parallel;
+
+-- forward binary rows without deserializing them
+SET citus.enable_binary_copy_passthrough TO on;
+CREATE TABLE copy_binary_passthrough (key int, value text, numbers int[]);
+SELECT create_distributed_table('copy_binary_passthrough', 'key');
+INSERT INTO copy_binary_passthrough
+  SELECT i, 'value ' || i, ARRAY[i, i * 2] FROM generate_series(1, 10) i;
+INSERT INTO copy_binary_passthrough VALUES (11, NULL, NULL);
+COPY copy_binary_passthrough TO :'temp_dir''copy_binary_passthrough.pgcopy' WITH (format binary);
+COPY copy_binary_passthrough FROM :'temp_dir''copy_binary_passthrough.pgcopy' WITH (format binary);
+SELECT key, count(*), min(value), min(numbers) FROM copy_binary_passthrough GROUP BY key ORDER BY key;
+
+-- a NULL distribution column should still be rejected
+INSERT INTO copy_binary_passthrough VALUES (12, 'twelve');
+COPY (SELECT NULL::int, 'null key'::text, NULL::int[]) TO :'temp_dir''copy_binary_passthrough.pgcopy' WITH (format binary);
+COPY copy_binary_passthrough FROM :'temp_dir''copy_binary_passthrough.pgcopy' WITH (format binary);
+
+RESET citus.enable_binary_copy_passthrough;
+DROP TABLE copy_binary_passthrough;
+
+-- rows routed with inline hashing should be found by router queries
+CREATE TABLE copy_hash_routing_int4 (int4_key int, int8_key bigint, text_key text);
+SELECT create_distributed_table('copy_hash_routing_int4', 'int4_key');
+CREATE TABLE copy_hash_routing_int8 (LIKE copy_hash_routing_int4);
+SELECT create_distributed_table('copy_hash_routing_int8', 'int8_key');
+CREATE TABLE copy_hash_routing_text (LIKE copy_hash_routing_int4);
+SELECT create_distributed_table('copy_hash_routing_text', 'text_key');
+
+\COPY copy_hash_routing_int4 FROM STDIN WITH (format csv)
+1,1,one
+-2,-2,two
+2147483647,9223372036854775807,large
+-2147483648,-9223372036854775808,small
+0,4294967296,zero
+\.
+\COPY copy_hash_routing_int8 FROM STDIN WITH (format csv)
+1,1,one
+-2,-2,two
+2147483647,9223372036854775807,large
+-2147483648,-9223372036854775808,small
+0,4294967296,zero
+\.
+\COPY copy_hash_routing_text FROM STDIN WITH (format csv)
+1,1,one
+-2,-2,two
+2147483647,9223372036854775807,large
+-2147483648,-9223372036854775808,small
+0,4294967296,zero
+\.
+
+SELECT count(*) FROM copy_hash_routing_int4 WHERE int4_key = 1;
+SELECT count(*) FROM copy_hash_routing_int4 WHERE int4_key = -2;
+SELECT count(*) FROM copy_hash_routing_int4 WHERE int4_key = 2147483647;
+SELECT count(*) FROM copy_hash_routing_int4 WHERE int4_key = -2147483648;
+SELECT count(*) FROM copy_hash_routing_int8 WHERE int8_key = -2;
+SELECT count(*) FROM copy_hash_routing_int8 WHERE int8_key = 9223372036854775807;
+SELECT count(*) FROM copy_hash_routing_int8 WHERE int8_key = -9223372036854775808;
+SELECT count(*) FROM copy_hash_routing_int8 WHERE int8_key = 4294967296;
+SELECT count(*) FROM copy_hash_routing_text WHERE text_key = 'one';
+SELECT count(*) FROM copy_hash_routing_text WHERE text_key = 'large';
+
+DROP TABLE copy_hash_routing_int4, copy_hash_routing_int8, copy_hash_routing_text;
+
+-- rows sent to the shards can be compressed
+CREATE TABLE copy_compressed (key int, value text);
+SELECT create_distributed_table('copy_compressed', 'key');
+SET citus.remote_copy_compression TO 'lz4';
+\COPY copy_compressed FROM STDIN WITH (format csv)
+1,one
+2,two
+3,three
+\.
+INSERT INTO copy_compressed SELECT i, repeat('value', i % 10) FROM generate_series(4, 1000) i;
+SET citus.remote_copy_compression TO 'zstd';
+COPY copy_compressed TO :'temp_dir''copy_compressed.pgcopy' WITH (format binary);
+COPY copy_compressed FROM :'temp_dir''copy_compressed.pgcopy' WITH (format binary);
+SELECT count(*), count(DISTINCT key), sum(length(value)) FROM copy_compressed;
+SELECT * FROM copy_compressed WHERE key <= 3 ORDER BY key, value;
+RESET citus.remote_copy_compression;
+DROP TABLE copy_compressed;
+
+-- flush thresholds can adapt to the throughput of each connection
+CREATE TABLE copy_adaptive_flush (key int, value text);
+SELECT create_distributed_table('copy_adaptive_flush', 'key');
+SET citus.enable_adaptive_copy_flush TO on;
+COPY copy_adaptive_flush FROM :'temp_dir''copy_compressed.pgcopy' WITH (format binary);
+SELECT count(*), count(DISTINCT key) FROM copy_adaptive_flush;
+SELECT count(*) > 0, bool_and(bytes_sent > 0), bool_and(throughput > 0),
+       bool_and(flush_threshold BETWEEN 64 * 1024 AND 8 * 1024 * 1024)
+FROM citus_stat_copy_connections WHERE flushes > 0;
+RESET citus.enable_adaptive_copy_flush;
+DROP TABLE copy_adaptive_flush;
+
+-- shards can be exported in parallel, the header still comes first
+CREATE TABLE copy_parallel_to (key int, value text);
+SELECT create_distributed_table('copy_parallel_to', 'key');
+INSERT INTO copy_parallel_to SELECT i, 'same' FROM generate_series(1, 10) i;
+SET citus.enable_parallel_copy_to TO on;
+COPY copy_parallel_to (value) TO STDOUT WITH (format csv, header);
+SET citus.max_adaptive_executor_pool_size TO 1;
+COPY copy_parallel_to (value) TO STDOUT;
+RESET citus.max_adaptive_executor_pool_size;
+RESET citus.enable_parallel_copy_to;
+DROP TABLE copy_parallel_to;
+
+-- rows that conflict with existing rows can be skipped or updated
+CREATE TABLE copy_on_conflict (key int PRIMARY KEY, value text);
+SELECT create_distributed_table('copy_on_conflict', 'key');
+INSERT INTO copy_on_conflict VALUES (1, 'old'), (2, 'old');
+COPY copy_on_conflict FROM STDIN WITH (format csv, on_conflict 'do_nothing');
+2,new
+3,new
+\.
+SELECT * FROM copy_on_conflict ORDER BY key;
+COPY copy_on_conflict FROM STDIN WITH (format csv, on_conflict 'do_update');
+1,newer
+3,newer
+4,newer
+\.
+SELECT * FROM copy_on_conflict ORDER BY key;
+SET citus.remote_copy_compression TO 'lz4';
+COPY copy_on_conflict FROM STDIN WITH (format csv, on_conflict 'do_update');
+4,compressed
+5,compressed
+\.
+RESET citus.remote_copy_compression;
+SELECT * FROM copy_on_conflict ORDER BY key;
+COPY copy_on_conflict FROM STDIN WITH (on_conflict 'replace');
+CREATE TABLE copy_on_conflict_no_key (key int, value text);
+SELECT create_distributed_table('copy_on_conflict_no_key', 'key');
+COPY copy_on_conflict_no_key FROM STDIN WITH (format csv, on_conflict 'do_update');
+1,one
+\.
+DROP TABLE copy_on_conflict, copy_on_conflict_no_key;
+
+-- serialization functions can be kept across COPY commands
+CREATE TABLE copy_serialization_cache (key int, value int);
+SELECT create_distributed_table('copy_serialization_cache', 'key');
+SET citus.enable_copy_serialization_cache TO on;
+COPY copy_serialization_cache FROM STDIN WITH (format csv);
+1,1
+\.
+COPY copy_serialization_cache FROM STDIN WITH (format csv);
+2,2
+\.
+ALTER TABLE copy_serialization_cache ALTER COLUMN value TYPE text;
+COPY copy_serialization_cache FROM STDIN WITH (format csv);
+3,three
+\.
+COPY copy_serialization_cache (value, key) FROM STDIN WITH (format csv);
+four,4
+\.
+SELECT * FROM copy_serialization_cache ORDER BY key;
+RESET citus.enable_copy_serialization_cache;
+DROP TABLE copy_serialization_cache;
@@ -1142,5 +1142,22 @@ PREPARE q2(int_wrapper_type) AS WITH a AS (UPDATE tbl SET b = $1 WHERE a = 1 RET
 EXPLAIN (COSTS false) EXECUTE q2('(1)');
 EXPLAIN :default_analyze_flags EXECUTE q2('(1)');
 
+-- time spent in the phases of distributed planning
+SET citus.explain_planner_phases TO on;
+CREATE FUNCTION explain_planner_phase_timings(explain_command text)
+RETURNS SETOF text AS $$
+DECLARE
+    query_plan text;
+BEGIN
+    FOR query_plan IN EXECUTE explain_command LOOP
+        IF query_plan LIKE '% Time: %' THEN
+            RETURN NEXT regexp_replace(trim(query_plan), '[0-9.]+ ms', 'N ms');
+        END IF;
+    END LOOP;
+    RETURN;
+END; $$ language plpgsql;
+SELECT explain_planner_phase_timings('EXPLAIN (COSTS OFF, SUMMARY ON) SELECT * FROM tbl WHERE a IN (SELECT a FROM tbl LIMIT 1)');
+RESET citus.explain_planner_phases;
+
 SET client_min_messages TO ERROR;
 DROP SCHEMA multi_explain CASCADE;
@@ -95,6 +95,14 @@ SELECT count(*) FROM citus_lock_waits;
 SELECT count(*) FROM citus_dist_stat_activity WHERE global_pid = citus_backend_gpid();
 
 
+-- with caught_up, the coordinator writes to the primaries and reads the session's
+-- writes from the secondaries once they have replayed them, or from the primaries
+\c "port=57636 dbname=regression options='-c\ citus.use_secondary_nodes=caught_up'"
+INSERT INTO the_table (a, b) VALUES (2, 3);
+SELECT * FROM the_table ORDER BY a, b;
+DELETE FROM the_table WHERE a = 2;
+SELECT * FROM the_table ORDER BY a, b;
+
 -- okay, now let's play with nodecluster. If we change the cluster of our follower node
 -- queries should stat failing again, since there are no worker nodes in the new cluster
 
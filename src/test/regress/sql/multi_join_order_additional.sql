@@ -135,6 +135,87 @@ JOIN (
      WHERE event_type = 5
 ) AS some_users ON (some_users.user_id = bar.user_id);
 
+-- Validate that the join order can be chosen based on table row estimates,
+-- which also considers single hash repartition joins
+CREATE TABLE estimate_big (id int, value int);
+CREATE TABLE estimate_small (id int, value int);
+SELECT create_distributed_table('estimate_big', 'id');
+SELECT create_distributed_table('estimate_small', 'id');
+INSERT INTO estimate_big SELECT i, i % 10 FROM generate_series(1, 1000) i;
+INSERT INTO estimate_small SELECT i, i FROM generate_series(1, 10) i;
+ANALYZE estimate_big;
+ANALYZE estimate_small;
+
+SET citus.enable_cost_based_join_order TO on;
+
+-- without row estimates we fall back to the rule-based join order
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM estimate_big b, estimate_small s
+	WHERE b.value = s.id;
+
+SELECT citus_update_table_row_estimates();
+
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM estimate_big b, estimate_small s
+	WHERE b.value = s.id;
+
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM estimate_big b, estimate_small s
+	WHERE b.value = s.value;
+
+RESET citus.enable_cost_based_join_order;
+DROP TABLE estimate_big, estimate_small;
+
+-- hash distributed tables whose shards nest are joined locally when
+-- citus.enable_nested_shard_joins is on
+SET citus.shard_replication_factor TO 2;
+SET citus.shard_count TO 4;
+CREATE TABLE nested_coarse (id int, value int);
+SELECT create_distributed_table('nested_coarse', 'id');
+SET citus.shard_count TO 8;
+CREATE TABLE nested_fine (id int, value int);
+SELECT create_distributed_table('nested_fine', 'id');
+SET citus.shard_count TO 6;
+CREATE TABLE nested_uneven (id int, value int);
+SELECT create_distributed_table('nested_uneven', 'id');
+SET citus.shard_replication_factor TO 1;
+SET citus.shard_count TO 8;
+CREATE TABLE nested_fine_single (id int, value int);
+SELECT create_distributed_table('nested_fine_single', 'id');
+INSERT INTO nested_coarse SELECT i, i FROM generate_series(1, 100) i;
+INSERT INTO nested_fine SELECT i, i FROM generate_series(1, 100) i;
+INSERT INTO nested_uneven SELECT i, i FROM generate_series(1, 100) i;
+INSERT INTO nested_fine_single SELECT i, i FROM generate_series(1, 100) i;
+
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM nested_coarse c, nested_fine f
+	WHERE c.id = f.id;
+SELECT count(*), sum(f.value) FROM nested_coarse c, nested_fine f
+	WHERE c.id = f.id;
+
+SET citus.enable_nested_shard_joins TO on;
+
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM nested_coarse c, nested_fine f
+	WHERE c.id = f.id;
+SELECT count(*), sum(f.value) FROM nested_coarse c, nested_fine f
+	WHERE c.id = f.id;
+
+-- shards that only partially overlap, or are placed on different nodes, are
+-- still repartitioned
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM nested_coarse c, nested_uneven u
+	WHERE c.id = u.id;
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM nested_coarse c, nested_fine_single f
+	WHERE c.id = f.id;
+SELECT count(*), sum(f.value) FROM nested_coarse c, nested_fine_single f
+	WHERE c.id = f.id;
+
+RESET citus.enable_nested_shard_joins;
+SET citus.shard_count TO 2;
+DROP TABLE nested_coarse, nested_fine, nested_uneven, nested_fine_single;
+
 -- Reset client logging level to its previous value
 SET client_min_messages TO NOTICE;
 
@@ -875,6 +875,51 @@ DELETE FROM summary_table WHERE id < (
 CREATE TABLE multi_modifications.local (a int default 1, b int);
 INSERT INTO multi_modifications.local VALUES (default, (SELECT min(id) FROM summary_table));
 
+-- multi-row inserts with constant distribution column values are grouped by
+-- shard in one pass, and go to the same shards as single-row inserts
+CREATE TABLE single_row_inserts (key int PRIMARY KEY, value text);
+SELECT create_distributed_table('single_row_inserts', 'key');
+CREATE TABLE multi_row_inserts (key int PRIMARY KEY, value text);
+SELECT create_distributed_table('multi_row_inserts', 'key', colocate_with => 'single_row_inserts');
+
+DO $$
+BEGIN
+  FOR i IN 1..100 LOOP
+    INSERT INTO single_row_inserts VALUES (i, 'value-' || i);
+  END LOOP;
+END; $$;
+DO $$
+BEGIN
+  EXECUTE 'INSERT INTO multi_row_inserts VALUES ' ||
+          (SELECT string_agg(format('(%s, %L)', i, 'value-' || i), ', ')
+           FROM generate_series(1, 100) i);
+END; $$;
+
+SELECT array_agg(result ORDER BY shardid, result) AS shard_keys
+FROM run_command_on_placements('single_row_inserts',
+	'SELECT string_agg(key || '':'' || value, '','' ORDER BY key) FROM %s') \gset single_
+SELECT array_agg(result ORDER BY shardid, result) = :'single_shard_keys' AS shard_keys_match
+FROM run_command_on_placements('multi_row_inserts',
+	'SELECT string_agg(key || '':'' || value, '','' ORDER BY key) FROM %s');
+
+WITH inserted AS (
+	INSERT INTO multi_row_inserts VALUES (101, 'value-101'), (102, 'value-102'), (103, 'value-103')
+	RETURNING key, value
+)
+SELECT * FROM inserted ORDER BY key;
+
+INSERT INTO multi_row_inserts VALUES (1, 'updated-1'), (104, 'value-104'), (2, 'updated-2')
+ON CONFLICT (key) DO UPDATE SET value = EXCLUDED.value;
+SELECT * FROM multi_row_inserts WHERE key IN (1, 2, 104) ORDER BY key;
+
+-- rows with other distribution column values take the general route
+INSERT INTO multi_row_inserts VALUES (105, 'value-105'), (106 + 0, 'value-106');
+SELECT * FROM multi_row_inserts WHERE key IN (105, 106) ORDER BY key;
+INSERT INTO multi_row_inserts VALUES (107, 'value-107'), (NULL, 'value-null');
+SELECT count(*) FROM multi_row_inserts;
+
+DROP TABLE single_row_inserts, multi_row_inserts;
+
 DROP TABLE insufficient_shards;
 DROP TABLE raw_table;
 DROP TABLE summary_table;
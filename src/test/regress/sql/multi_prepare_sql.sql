@@ -643,6 +643,45 @@ WHERE shardid IN (
 EXECUTE countsome; -- should indicate replanning
 EXECUTE countsome; -- no replanning
 
+-- multi-shard prepared statements with a generic plan
+SET citus.enable_generic_multi_shard_plans TO on;
+SET plan_cache_mode TO force_generic_plan;
+CREATE TABLE generic_plan_table (key int, value int);
+SELECT create_distributed_table('generic_plan_table', 'key');
+INSERT INTO generic_plan_table SELECT i, i % 3 FROM generate_series(1, 30) i;
+PREPARE generic_multi_shard(int) AS
+	SELECT value, count(*) FROM generic_plan_table WHERE value >= $1 GROUP BY value ORDER BY value;
+EXECUTE generic_multi_shard(1);
+EXECUTE generic_multi_shard(2);
+PREPARE generic_multi_shard_having(int) AS
+	SELECT value FROM generic_plan_table GROUP BY value HAVING count(*) > $1 ORDER BY value;
+EXECUTE generic_multi_shard_having(5);
+EXECUTE generic_multi_shard_having(10);
+DROP TABLE generic_plan_table;
+RESET plan_cache_mode;
+RESET citus.enable_generic_multi_shard_plans;
+
+-- router queries through prepared statements on the workers
+SET citus.enable_worker_prepared_statements TO on;
+SET plan_cache_mode TO force_generic_plan;
+CREATE TABLE worker_prepared_table (key int, value int);
+SELECT create_distributed_table('worker_prepared_table', 'key');
+INSERT INTO worker_prepared_table SELECT i, i * 10 FROM generate_series(1, 10) i;
+PREPARE worker_prepared_lookup(int) AS
+	SELECT key, value FROM worker_prepared_table WHERE key = $1;
+EXECUTE worker_prepared_lookup(1);
+EXECUTE worker_prepared_lookup(2);
+EXECUTE worker_prepared_lookup(1);
+EXECUTE worker_prepared_lookup(11);
+-- changing the table makes the workers prepare the statements again
+ALTER TABLE worker_prepared_table ALTER COLUMN value TYPE bigint;
+EXECUTE worker_prepared_lookup(1);
+EXECUTE worker_prepared_lookup(2);
+DEALLOCATE worker_prepared_lookup;
+DROP TABLE worker_prepared_table;
+RESET plan_cache_mode;
+RESET citus.enable_worker_prepared_statements;
+
 -- reset
 \set VERBOSITY default
 
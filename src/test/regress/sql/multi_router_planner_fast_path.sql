@@ -853,6 +853,43 @@ SELECT count(*) FILTER (where value = 15) FROM collections_list_2 WHERE key = 4;
 INSERT INTO authors_reference (id, name) VALUES (generate_series(1, 10), repeat('Migjeni', 3));
 SELECT * FROM authors_reference ORDER BY 1, 2;
 
+-- IN-lists and = ANY(array) on the distribution column
+SET client_min_messages to 'NOTICE';
+SET citus.enable_fast_path_array_filters TO on;
+SET citus.shard_count TO 2;
+CREATE TABLE fast_path_in_list (key int, value int);
+SELECT create_distributed_table('fast_path_in_list', 'key');
+INSERT INTO fast_path_in_list VALUES (1, 10), (2, 20), (3, 30), (4, 40);
+
+SET client_min_messages to 'DEBUG2';
+
+-- 1 and 3 are on the same shard
+SELECT key, value FROM fast_path_in_list WHERE key IN (1, 3);
+SELECT count(*) FROM fast_path_in_list WHERE key IN (1, 3);
+
+-- 1 and 2 are on different shards, we get one task per shard
+SELECT key, value FROM fast_path_in_list WHERE key = ANY('{1,2}') AND value > 10;
+
+SET client_min_messages to 'NOTICE';
+
+-- aggregates across shards go through the regular planner
+SELECT count(*) FROM fast_path_in_list WHERE key IN (1, 2);
+
+-- array parameters are pruned at execution time
+PREPARE fast_path_in_list_select(int[]) AS
+    SELECT key, value FROM fast_path_in_list WHERE key = ANY($1) AND value >= 20;
+EXECUTE fast_path_in_list_select('{1,2}');
+EXECUTE fast_path_in_list_select('{1,2}');
+EXECUTE fast_path_in_list_select('{1,2}');
+EXECUTE fast_path_in_list_select('{1,2}');
+EXECUTE fast_path_in_list_select('{1,2}');
+EXECUTE fast_path_in_list_select('{1,2}');
+EXECUTE fast_path_in_list_select('{3,4}');
+DEALLOCATE fast_path_in_list_select;
+
+DROP TABLE fast_path_in_list;
+RESET citus.enable_fast_path_array_filters;
+
 SET client_min_messages to 'NOTICE';
 
 DROP FUNCTION author_articles_max_id();
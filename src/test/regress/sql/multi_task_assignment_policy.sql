@@ -254,6 +254,32 @@ $cmd$, 'task_assignment_test_table_2');
 -- different workers
 SELECT count(DISTINCT value) FROM explain_outputs;
 
+TRUNCATE explain_outputs;
+
+-- the least-loaded policy picks one of the placements of each task
+SET citus.task_assignment_policy TO 'least-loaded';
+SELECT count(*) FROM task_assignment_reference_table;
+SELECT count(*) FROM task_assignment_replicated_hash;
+
+-- the shard exists in only one worker node, so we should always pick that one
+INSERT INTO explain_outputs
+SELECT parse_explain_output($cmd$
+EXPLAIN SELECT *
+FROM (SELECT * FROM task_assignment_nonreplicated_hash WHERE test_id = 3) AS dist
+       LEFT JOIN task_assignment_reference_table ref
+                 ON dist.ref_id = ref.test_id
+$cmd$, 'task_assignment_nonreplicated_hash');
+
+INSERT INTO explain_outputs
+SELECT parse_explain_output($cmd$
+EXPLAIN SELECT *
+FROM (SELECT * FROM task_assignment_nonreplicated_hash WHERE test_id = 3) AS dist
+       LEFT JOIN task_assignment_reference_table ref
+                 ON dist.ref_id = ref.test_id
+$cmd$, 'task_assignment_nonreplicated_hash');
+
+SELECT count(DISTINCT value) FROM explain_outputs;
+
 RESET citus.task_assignment_policy;
 RESET client_min_messages;
 
@@ -249,6 +249,26 @@ COMMIT;
 SELECT count(*) FROM pg_dist_transaction;
 SELECT recover_prepared_transactions();
 
+-- citus.two_phase_commit_delay applies commit_delay to the local commit
+-- of a 2PC transaction and restores the commit_delay of the session once
+-- the transaction ends
+SET citus.two_phase_commit_delay TO 1000;
+SET commit_delay TO 10;
+BEGIN;
+INSERT INTO test_2pcskip VALUES (6), (7);
+COMMIT;
+SHOW commit_delay;
+SELECT count(*) FROM test_2pcskip WHERE a IN (6, 7);
+SELECT count(*) FROM pg_dist_transaction;
+SELECT recover_prepared_transactions();
+RESET citus.two_phase_commit_delay;
+RESET commit_delay;
+-- only superusers can set citus.two_phase_commit_delay
+CREATE USER two_phase_commit_delay_user;
+SET ROLE two_phase_commit_delay_user;
+SET citus.two_phase_commit_delay TO 1000;
+RESET ROLE;
+DROP USER two_phase_commit_delay_user;
 -- Test whether auto-recovery runs
 ALTER SYSTEM SET citus.recover_2pc_interval TO 10;
 SELECT pg_reload_conf();
@@ -0,0 +1,81 @@
+--
+-- QUERY_RESULT_CACHE
+--
+-- Tests that results cached with citus.query_result_cache_ttl are discarded
+-- once a write through this node commits. Writes to the shards that bypass
+-- the distributed tables are only seen once the results expire, which tells
+-- cached results apart from new ones.
+--
+CREATE SCHEMA result_cache;
+SET search_path TO result_cache;
+SET citus.next_shard_id TO 1780000;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+
+-- citus local tables have their placement on the coordinator
+SET client_min_messages TO ERROR;
+SELECT 1 FROM master_add_node('localhost', :master_port, groupid => 0);
+RESET client_min_messages;
+
+CREATE TABLE items (key int, value int);
+SELECT create_distributed_table('items', 'key', colocate_with => 'none');
+INSERT INTO items SELECT i, i FROM generate_series(1, 10) i;
+
+CREATE TABLE local_items (key int, value int);
+SELECT citus_add_local_table_to_metadata('local_items');
+INSERT INTO local_items SELECT i, i FROM generate_series(1, 10) i;
+
+SET citus.query_result_cache_ttl TO '1h';
+
+SELECT count(*), sum(value) FROM items;
+SELECT count(*) FROM run_command_on_placements('items', 'UPDATE %s SET value = value + 100');
+SELECT count(*), sum(value) FROM items;
+
+-- a router write invalidates the cached result
+UPDATE items SET value = value WHERE key = 1;
+SELECT count(*), sum(value) FROM items;
+
+-- a multi-shard write invalidates the cached result
+SELECT count(*) FROM run_command_on_placements('items', 'UPDATE %s SET value = value + 100');
+SELECT count(*), sum(value) FROM items;
+UPDATE items SET value = value - 200;
+SELECT count(*), sum(value) FROM items;
+
+-- COPY invalidates the cached result
+SELECT count(*) FROM run_command_on_placements('items', 'UPDATE %s SET value = value + 100');
+SELECT count(*), sum(value) FROM items;
+COPY items FROM STDIN WITH (FORMAT csv);
+11,11
+\.
+SELECT count(*), sum(value) FROM items;
+
+-- a rolled back write keeps the cached result
+SELECT count(*) FROM run_command_on_placements('items', 'UPDATE %s SET value = value + 100');
+BEGIN;
+UPDATE items SET value = value - 1000;
+ROLLBACK;
+SELECT count(*), sum(value) FROM items;
+
+-- a write via local execution invalidates the cached result
+SELECT count(*), sum(value) FROM local_items;
+INSERT INTO local_items_1780004 VALUES (100, 100);
+SELECT count(*), sum(value) FROM local_items;
+UPDATE local_items SET value = value + 1 WHERE key = 100;
+SELECT count(*), sum(value) FROM local_items;
+
+-- a local COPY invalidates the cached result
+INSERT INTO local_items_1780004 VALUES (200, 200);
+SELECT count(*), sum(value) FROM local_items;
+COPY local_items FROM STDIN WITH (FORMAT csv);
+12,12
+\.
+SELECT count(*), sum(value) FROM local_items;
+
+-- without the cache, writes that bypass the distributed tables show up
+RESET citus.query_result_cache_ttl;
+INSERT INTO local_items_1780004 VALUES (300, 300);
+SELECT count(*), sum(value) FROM local_items;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA result_cache CASCADE;
+SELECT 1 FROM master_remove_node('localhost', :master_port);
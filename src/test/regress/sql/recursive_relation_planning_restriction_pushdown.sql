@@ -292,5 +292,66 @@ SELECT 1 as x FROM (SELECT 1 FROM tbl1, tbl2 WHERE tbl2.b > 0) AS s1 WHERE false
 
 \set VERBOSITY terse
 RESET client_min_messages;
+
+-- filters on CTEs that cannot be inlined are pushed into the recursively
+-- planned CTEs when citus.enable_cte_predicate_pushdown is on
+CREATE FUNCTION pushes_filter_into_cte(query text, cte_filter text) RETURNS boolean AS $$
+DECLARE
+  query_plan text;
+BEGIN
+  FOR query_plan IN EXECUTE 'EXPLAIN (COSTS OFF) ' || query LOOP
+    IF query_plan LIKE '%Filter: ' || cte_filter || '%' THEN
+      RETURN true;
+    END IF;
+  END LOOP;
+  RETURN false;
+END; $$ LANGUAGE plpgsql;
+
+CREATE TABLE cte_items (key int, value int);
+SELECT create_distributed_table('cte_items', 'key');
+INSERT INTO cte_items SELECT i, i FROM generate_series(1, 20) i;
+
+SELECT pushes_filter_into_cte($$
+WITH cte AS (SELECT key, value * 2 AS doubled, random() AS r FROM cte_items)
+SELECT count(*), sum(doubled) FROM cte WHERE doubled > 10
+$$, '((value * 2) > 10)');
+WITH cte AS (SELECT key, value * 2 AS doubled, random() AS r FROM cte_items)
+SELECT count(*), sum(doubled) FROM cte WHERE doubled > 10;
+
+SET citus.enable_cte_predicate_pushdown TO on;
+SELECT pushes_filter_into_cte($$
+WITH cte AS (SELECT key, value * 2 AS doubled, random() AS r FROM cte_items)
+SELECT count(*), sum(doubled) FROM cte WHERE doubled > 10
+$$, '((value * 2) > 10)');
+WITH cte AS (SELECT key, value * 2 AS doubled, random() AS r FROM cte_items)
+SELECT count(*), sum(doubled) FROM cte WHERE doubled > 10;
+SELECT pushes_filter_into_cte($$
+WITH cte AS (SELECT key, value * 2 AS doubled, random() AS r FROM cte_items)
+SELECT count(*) FROM cte_items i JOIN cte USING (key) WHERE doubled > 10
+$$, '((value * 2) > 10)');
+WITH cte AS (SELECT key, value * 2 AS doubled, random() AS r FROM cte_items)
+SELECT count(*) FROM cte_items i JOIN cte USING (key) WHERE doubled > 10;
+
+-- not when the CTE is materialized, on the nullable side of a join, or the
+-- filter is on a volatile column
+SELECT pushes_filter_into_cte($$
+WITH cte AS MATERIALIZED (SELECT key, value * 2 AS doubled FROM cte_items)
+SELECT count(*), sum(doubled) FROM cte WHERE doubled > 10
+$$, '((value * 2) > 10)');
+WITH cte AS MATERIALIZED (SELECT key, value * 2 AS doubled FROM cte_items)
+SELECT count(*), sum(doubled) FROM cte WHERE doubled > 10;
+SELECT pushes_filter_into_cte($$
+WITH cte AS (SELECT key, value * 2 AS doubled, random() AS r FROM cte_items)
+SELECT count(*) FROM cte_items i LEFT JOIN cte USING (key) WHERE doubled > 10
+$$, '((value * 2) > 10)');
+WITH cte AS (SELECT key, value * 2 AS doubled, random() AS r FROM cte_items)
+SELECT count(*) FROM cte_items i LEFT JOIN cte USING (key) WHERE doubled > 10;
+SELECT pushes_filter_into_cte($$
+WITH cte AS (SELECT key, value * 2 AS doubled, random() AS r FROM cte_items)
+SELECT count(*) FROM cte WHERE r < 2
+$$, '(random() <');
+WITH cte AS (SELECT key, value * 2 AS doubled, random() AS r FROM cte_items)
+SELECT count(*) FROM cte WHERE r < 2;
+RESET citus.enable_cte_predicate_pushdown;
 DROP SCHEMA push_down_filters CASCADE;
 
@@ -0,0 +1,114 @@
+--
+-- REFERENCE_TABLE_WRITE_BATCH
+--
+-- Tests for holding back single-row INSERTs in transaction blocks with
+-- citus.reference_table_write_batch_size and
+-- citus.distributed_table_write_batch_size.
+--
+CREATE SCHEMA write_batch;
+SET search_path TO write_batch;
+SET citus.next_shard_id TO 1770000;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+
+-- reference tables get a placement on the coordinator, which runs the
+-- batched writes through the local executor
+SET client_min_messages TO ERROR;
+SELECT 1 FROM master_add_node('localhost', :master_port, groupid => 0);
+RESET client_min_messages;
+
+CREATE TABLE ref (a int PRIMARY KEY, b text);
+SELECT create_reference_table('ref');
+
+-- 1 and 5 go to the first shard, 3 and 4 to the second one
+CREATE TABLE dist (a int PRIMARY KEY, b text);
+SELECT create_distributed_table('dist', 'a', colocate_with => 'none');
+
+SET citus.reference_table_write_batch_size TO 10;
+SET citus.distributed_table_write_batch_size TO 10;
+SET citus.log_remote_commands TO on;
+SET citus.grep_remote_commands TO '%INSERT INTO write_batch%';
+
+-- the pending writes are sent before the next read, with a single command
+-- per remote placement and one by one on the local placement
+BEGIN;
+INSERT INTO ref VALUES (1, 'a');
+INSERT INTO ref VALUES (2, 'b');
+SELECT a, b FROM ref ORDER BY a;
+COMMIT;
+
+-- the pending writes are sent at commit
+BEGIN;
+INSERT INTO ref VALUES (3, 'c');
+INSERT INTO ref VALUES (4, 'd');
+COMMIT;
+SELECT a, b FROM ref ORDER BY a;
+
+-- SAVEPOINT sends the pending writes and ROLLBACK TO discards the newer ones
+BEGIN;
+INSERT INTO ref VALUES (5, 'e');
+SAVEPOINT s1;
+INSERT INTO ref VALUES (6, 'f');
+ROLLBACK TO SAVEPOINT s1;
+SELECT a, b FROM ref WHERE a >= 5 ORDER BY a;
+COMMIT;
+
+-- consecutive writes into the same shard share a command
+BEGIN;
+INSERT INTO dist VALUES (1, 'a');
+INSERT INTO dist VALUES (5, 'e');
+INSERT INTO dist VALUES (3, 'c');
+INSERT INTO dist VALUES (4, 'd');
+COMMIT;
+
+-- writes into different shards are never merged and keep their order
+BEGIN;
+INSERT INTO dist VALUES (8, 'h');
+INSERT INTO dist VALUES (7, 'g');
+INSERT INTO dist VALUES (10, 'j');
+SELECT a, b FROM dist ORDER BY a;
+COMMIT;
+
+RESET citus.log_remote_commands;
+RESET citus.grep_remote_commands;
+
+-- an error in a held back write is reported by the statement that sends it
+BEGIN;
+INSERT INTO ref VALUES (7, 'g');
+INSERT INTO ref VALUES (1, 'duplicate');
+SELECT count(*) FROM ref;
+ROLLBACK;
+
+BEGIN;
+INSERT INTO dist VALUES (1, 'duplicate');
+COMMIT;
+SELECT a, b FROM dist WHERE a = 1;
+
+-- writes into local shards on a worker with metadata
+\c - - - :worker_1_port
+SET search_path TO write_batch;
+SET citus.reference_table_write_batch_size TO 10;
+SET citus.distributed_table_write_batch_size TO 10;
+SET citus.log_remote_commands TO on;
+SET citus.grep_remote_commands TO '%INSERT INTO write_batch%';
+
+-- 6 and 13 go to a shard on this worker, 12 and 11 to one on the other worker
+BEGIN;
+INSERT INTO ref VALUES (8, 'h');
+INSERT INTO ref VALUES (9, 'i');
+SELECT count(*) FROM ref;
+INSERT INTO dist VALUES (6, 'f');
+INSERT INTO dist VALUES (13, 'm');
+INSERT INTO dist VALUES (12, 'l');
+INSERT INTO dist VALUES (11, 'k');
+SELECT a, b FROM dist WHERE a IN (6, 11, 12, 13) ORDER BY a;
+COMMIT;
+
+\c - - - :master_port
+SET search_path TO write_batch;
+SELECT a, b FROM ref ORDER BY a;
+SELECT a, b FROM dist ORDER BY a;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA write_batch CASCADE;
+SELECT 1 FROM master_remove_node('localhost', :master_port);
@@ -520,6 +520,29 @@ BEGIN;
 	SELECT * FROM citus_reserved_connection_stats() ORDER BY 1,2;
 COMMIT;
 
+-- close cached connections at the end of a transaction when the pool is full
+ALTER SYSTEM SET citus.max_shared_pool_size TO 1;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+SET citus.release_cached_connections_on_full_pool TO on;
+SELECT count(*) FROM test;
+
+-- show that no connections are cached
+SELECT
+	connection_count_to_node
+FROM
+	citus_remote_connection_stats()
+WHERE
+	port IN (SELECT node_port FROM master_get_active_worker_nodes()) AND
+	database_name = 'regression'
+ORDER BY
+	hostname, port;
+
+RESET citus.release_cached_connections_on_full_pool;
+ALTER SYSTEM RESET citus.max_shared_pool_size;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+
 -- should close all connections
 SET citus.max_cached_connection_lifetime TO '0s';
 SELECT count(*) FROM test;
@@ -535,6 +558,21 @@ WHERE
 ORDER BY
 	hostname, port;
 
+-- open connections to all the nodes ahead of the first query
+RESET citus.max_cached_connection_lifetime;
+SELECT citus_prewarm_connections();
+
+-- show that one connection per node is cached
+SELECT
+	connection_count_to_node
+FROM
+	citus_remote_connection_stats()
+WHERE
+	port IN (SELECT node_port FROM master_get_active_worker_nodes()) AND
+	database_name = 'regression'
+ORDER BY
+	hostname, port;
+
 -- in case other tests relies on these setting, reset them
 ALTER SYSTEM RESET citus.distributed_deadlock_detection_factor;
 ALTER SYSTEM RESET citus.recover_2pc_interval;
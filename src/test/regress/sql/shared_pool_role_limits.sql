@@ -0,0 +1,139 @@
+--
+-- SHARED_POOL_ROLE_LIMITS
+--
+-- Tests that citus.shared_pool_min_connections_per_role keeps the other roles
+-- from taking the connections that an active role can still claim, and that
+-- the shared pool is first come, first served when it is not set.
+--
+CREATE SCHEMA shared_pool_role_limits;
+SET search_path TO shared_pool_role_limits;
+SET citus.next_shard_id TO 14100000;
+
+-- do not cache connections, and keep the maintenance daemon from using any,
+-- such that only the connections of this session are counted
+ALTER SYSTEM SET citus.max_cached_conns_per_worker TO 0;
+ALTER SYSTEM SET citus.distributed_deadlock_detection_factor TO -1;
+ALTER SYSTEM SET citus.recover_2pc_interval TO '1h';
+ALTER SYSTEM SET citus.max_shared_pool_size TO 4;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+
+SET citus.shard_count TO 32;
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE test (a int);
+SELECT create_distributed_table('test', 'a');
+INSERT INTO test SELECT i FROM generate_series(0,100)i;
+
+CREATE ROLE pool_role_a LOGIN;
+CREATE ROLE pool_role_b LOGIN;
+GRANT USAGE ON SCHEMA shared_pool_role_limits TO pool_role_a, pool_role_b;
+GRANT SELECT ON test TO pool_role_a, pool_role_b;
+
+-- without the limits per role, pool_role_a takes the remaining 3 connections
+-- to each node next to the connection of pool_role_b
+BEGIN;
+	SET LOCAL ROLE pool_role_b;
+	SET LOCAL citus.max_adaptive_executor_pool_size TO 1;
+	SELECT count(*) FROM test;
+
+	SET LOCAL ROLE pool_role_a;
+	SET LOCAL citus.max_adaptive_executor_pool_size TO 16;
+	with cte_1 as (select pg_sleep(0.1) is null, a from test) SELECT a from cte_1 ORDER By 1 LIMIT 1;
+
+	RESET ROLE;
+	SELECT
+		connection_count_to_node
+	FROM
+		citus_remote_connection_stats()
+	WHERE
+		port IN (SELECT node_port FROM master_get_active_worker_nodes()) AND
+		database_name = 'regression'
+	ORDER BY
+		hostname, port;
+COMMIT;
+
+-- now every active role can get 2 connections to each node
+ALTER SYSTEM SET citus.shared_pool_min_connections_per_role TO 2;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+
+-- pool_role_a leaves the connection that pool_role_b can still claim,
+-- which pool_role_b takes when it needs more connections
+BEGIN;
+	SET LOCAL ROLE pool_role_b;
+	SET LOCAL citus.max_adaptive_executor_pool_size TO 1;
+	SELECT count(*) FROM test;
+
+	SET LOCAL ROLE pool_role_a;
+	SET LOCAL citus.max_adaptive_executor_pool_size TO 16;
+	with cte_1 as (select pg_sleep(0.1) is null, a from test) SELECT a from cte_1 ORDER By 1 LIMIT 1;
+
+	RESET ROLE;
+	SELECT
+		connection_count_to_node
+	FROM
+		citus_remote_connection_stats()
+	WHERE
+		port IN (SELECT node_port FROM master_get_active_worker_nodes()) AND
+		database_name = 'regression'
+	ORDER BY
+		hostname, port;
+
+	SET LOCAL ROLE pool_role_b;
+	SET LOCAL citus.max_adaptive_executor_pool_size TO 16;
+	with cte_1 as (select pg_sleep(0.1) is null, a from test) SELECT a from cte_1 ORDER By 1 LIMIT 1;
+
+	RESET ROLE;
+	SELECT
+		connection_count_to_node
+	FROM
+		citus_remote_connection_stats()
+	WHERE
+		port IN (SELECT node_port FROM master_get_active_worker_nodes()) AND
+		database_name = 'regression'
+	ORDER BY
+		hostname, port;
+COMMIT;
+
+-- the connections per role are released once the connections are closed
+SELECT
+	connection_count_to_node
+FROM
+	citus_remote_connection_stats()
+WHERE
+	port IN (SELECT node_port FROM master_get_active_worker_nodes()) AND
+	database_name = 'regression'
+ORDER BY
+	hostname, port;
+
+-- so the roles start over in the next transaction
+BEGIN;
+	SET LOCAL ROLE pool_role_a;
+	SET LOCAL citus.max_adaptive_executor_pool_size TO 16;
+	with cte_1 as (select pg_sleep(0.1) is null, a from test) SELECT a from cte_1 ORDER By 1 LIMIT 1;
+
+	RESET ROLE;
+	SELECT
+		connection_count_to_node
+	FROM
+		citus_remote_connection_stats()
+	WHERE
+		port IN (SELECT node_port FROM master_get_active_worker_nodes()) AND
+		database_name = 'regression'
+	ORDER BY
+		hostname, port;
+COMMIT;
+
+-- in case other tests relies on these setting, reset them
+ALTER SYSTEM RESET citus.shared_pool_min_connections_per_role;
+ALTER SYSTEM RESET citus.max_shared_pool_size;
+ALTER SYSTEM RESET citus.distributed_deadlock_detection_factor;
+ALTER SYSTEM RESET citus.recover_2pc_interval;
+ALTER SYSTEM RESET citus.max_cached_conns_per_worker;
+SELECT pg_reload_conf();
+
+BEGIN;
+SET LOCAL client_min_messages TO WARNING;
+DROP SCHEMA shared_pool_role_limits CASCADE;
+COMMIT;
+DROP ROLE pool_role_a, pool_role_b;
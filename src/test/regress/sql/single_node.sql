@@ -703,6 +703,11 @@ SELECT * FROM test t1, test t2 WHERE t1.x = t2.y ORDER BY t1.x;
 SET citus.task_assignment_policy TO 'first-replica';
 SELECT * FROM test t1, test t2 WHERE t1.x = t2.y ORDER BY t1.x;
 
+-- the tasks access the local node, so they keep running level by level
+SET citus.enable_repartition_dataflow_scheduling TO ON;
+SELECT * FROM test t1, test t2 WHERE t1.x = t2.y ORDER BY t1.x;
+RESET citus.enable_repartition_dataflow_scheduling;
+
 RESET citus.enable_repartition_joins;
 RESET citus.enable_single_hash_repartition_joins;
 
@@ -278,6 +278,14 @@ RESET ROLE;
 -- stats-role/superuser should be able to see entries belonging to other users
 SELECT partition_key FROM citus_query_stats() WHERE partition_key = '2';
 
+-- task timings of multi-shard queries are tracked per query and worker
+SELECT count(*) FROM lineitem_hash_part;
+SELECT count(*) > 0 AS has_task_timings FROM citus_stat_statements_task_timings
+WHERE tasks > 0 AND first_result_p99 >= first_result_p50;
+
+SELECT count(*) > 0 AS has_planner_timings FROM citus_stat_statements_planner_timings
+WHERE plans > 0 AND total_plan_time >= shard_pruning_time;
+
 -- drop pg_stat_statements and verify citus_stat_statement does not work anymore
 DROP extension pg_stat_statements;
 SELECT normalize_query_string(query), executor, partition_key, calls
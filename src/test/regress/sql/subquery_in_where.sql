@@ -847,8 +847,51 @@ WHERE (SELECT COUNT(DISTINCT e1.value_2)
      WHERE e1.user_id = u1.user_id
           ) > 115 AND false;
 
+-- identical subqueries share a subplan when deduplication is enabled
+SET citus.enable_subplan_deduplication TO on;
+SELECT count(*) >= 0 AS ok
+FROM users_table
+WHERE user_id IN (SELECT max(user_id) FROM events_table)
+  AND value_1 IN (SELECT max(user_id) FROM events_table);
+
+-- volatile subqueries are still planned separately
+SELECT count(*) >= 0 AS ok
+FROM users_table
+WHERE user_id IN (SELECT max(user_id) FROM events_table WHERE random() >= 0)
+  AND value_1 IN (SELECT max(user_id) FROM events_table WHERE random() >= 0);
+RESET citus.enable_subplan_deduplication;
+
 SET client_min_messages TO DEFAULT;
 
+-- the tasks of independent subplans execute together, while a subplan that uses
+-- the result of another subplan still waits for it
+SELECT count(*) AS row_count, sum(value_2) AS value_sum
+FROM users_table
+WHERE user_id IN (SELECT max(user_id) FROM events_table WHERE random() >= 0)
+   OR value_1 IN (SELECT min(value_2) FROM events_table WHERE random() >= 0) \gset independent_
+WITH active_users AS MATERIALIZED (
+  SELECT DISTINCT user_id FROM events_table WHERE value_2 > 2
+), active_user_values AS MATERIALIZED (
+  SELECT user_id, value_1 FROM users_table WHERE user_id IN (SELECT user_id FROM active_users)
+)
+SELECT count(*) AS row_count, sum(value_1) AS value_sum FROM active_user_values \gset dependent_
+
+SET citus.enable_parallel_subplans TO on;
+SELECT count(*) = :independent_row_count AS row_counts_match,
+       sum(value_2) = :independent_value_sum AS sums_match
+FROM users_table
+WHERE user_id IN (SELECT max(user_id) FROM events_table WHERE random() >= 0)
+   OR value_1 IN (SELECT min(value_2) FROM events_table WHERE random() >= 0);
+WITH active_users AS MATERIALIZED (
+  SELECT DISTINCT user_id FROM events_table WHERE value_2 > 2
+), active_user_values AS MATERIALIZED (
+  SELECT user_id, value_1 FROM users_table WHERE user_id IN (SELECT user_id FROM active_users)
+)
+SELECT count(*) = :dependent_row_count AS row_counts_match,
+       sum(value_1) = :dependent_value_sum AS sums_match
+FROM active_user_values;
+RESET citus.enable_parallel_subplans;
+
 DROP TABLE local_table;
 DROP SCHEMA subquery_in_where CASCADE;
 SET search_path TO public;
@@ -76,3 +76,21 @@ VACUUM FULL columnar_table_2;
 SELECT version_major, version_minor, reserved_stripe_id, reserved_row_number
   FROM columnar_storage_info('columnar_table_2');
 SELECT * FROM columnar_table_stripe_info WHERE relname = 'columnar_table_2' ORDER BY stripe_num;
+
+-- the stripes that the old version wrote read the same through the chunk cache
+SET columnar.enable_chunk_cache TO off;
+SELECT count(*), sum(a) FROM columnar_table_1;
+SELECT count(*), sum(b) FROM columnar_table_2;
+RESET columnar.enable_chunk_cache;
+SELECT count(*), sum(a) FROM columnar_table_1;
+SELECT count(*), sum(a) FROM columnar_table_1;
+SELECT count(*), sum(b) FROM columnar_table_2;
+
+-- stripes that are compressed by background workers can be added to old tables
+SET columnar.compression_workers TO 2;
+INSERT INTO columnar_table_3 SELECT i FROM generate_series(3, 20000) i;
+RESET columnar.compression_workers;
+SELECT count(*), sum(b) FROM columnar_table_3;
+SET columnar.enable_chunk_cache TO off;
+SELECT count(*), sum(b) FROM columnar_table_3;
+RESET columnar.enable_chunk_cache;
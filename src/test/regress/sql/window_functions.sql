@@ -642,3 +642,61 @@ GROUP BY
 	1, value_1
 ORDER BY
 	2 DESC, 1;
+
+-- window functions that partition by another column than the distribution
+-- column are evaluated on the workers after repartitioning the rows by that
+-- column when citus.enable_repartitioned_window_functions is on
+CREATE FUNCTION uses_window_repartition(query text) RETURNS boolean AS $$
+DECLARE
+  query_plan text;
+BEGIN
+  FOR query_plan IN EXECUTE 'EXPLAIN (COSTS OFF) ' || query LOOP
+    IF query_plan LIKE '%MapMergeJob%' THEN
+      RETURN true;
+    END IF;
+  END LOOP;
+  RETURN false;
+END; $$ LANGUAGE plpgsql;
+
+CREATE TABLE window_items (key int, category int, value int);
+SELECT create_distributed_table('window_items', 'key');
+INSERT INTO window_items SELECT i, i % 3, i FROM generate_series(1, 12) i;
+
+SELECT uses_window_repartition($$
+SELECT key, rank() OVER (PARTITION BY category ORDER BY value DESC),
+	sum(value) OVER (PARTITION BY category)
+FROM window_items
+$$);
+SELECT key, category, rank() OVER (PARTITION BY category ORDER BY value DESC),
+	sum(value) OVER (PARTITION BY category)
+FROM window_items
+ORDER BY category, key;
+
+SET citus.enable_repartitioned_window_functions TO on;
+SELECT uses_window_repartition($$
+SELECT key, rank() OVER (PARTITION BY category ORDER BY value DESC),
+	sum(value) OVER (PARTITION BY category)
+FROM window_items
+$$);
+SELECT key, category, rank() OVER (PARTITION BY category ORDER BY value DESC),
+	sum(value) OVER (PARTITION BY category)
+FROM window_items
+ORDER BY category, key;
+
+-- the windows of grouped queries, or of windows without a common partition
+-- column, are still evaluated on the coordinator
+SELECT uses_window_repartition($$
+SELECT category, count(*), rank() OVER (PARTITION BY category ORDER BY count(*))
+FROM window_items GROUP BY category
+$$);
+SELECT category, count(*), rank() OVER (PARTITION BY category ORDER BY count(*))
+FROM window_items GROUP BY category
+ORDER BY category;
+SELECT uses_window_repartition($$
+SELECT key, count(*) OVER (PARTITION BY category), count(*) OVER (PARTITION BY value)
+FROM window_items
+$$);
+RESET citus.enable_repartitioned_window_functions;
+
+DROP TABLE window_items;
+DROP FUNCTION uses_window_repartition(text);